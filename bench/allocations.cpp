@@ -0,0 +1,41 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <allocation_counter.hpp>
+#include <benchmark/benchmark.h>
+
+#include <optional>
+
+// Google Benchmark runs every benchmark once more with the memory manager
+// and reports the allocations per iteration along with its time, both on
+// the console and in the JSON that bench_json writes.
+namespace Gigamonkey {
+    
+    namespace {
+        
+        struct allocation_manager final : benchmark::MemoryManager {
+            std::optional<test::allocation_counter> Counter;
+            
+            void Start () override {
+                Counter.emplace ();
+            }
+            
+            void Stop (Result &r) override {
+                r.num_allocs = int64_t (Counter->allocations ());
+                r.total_allocated_bytes = int64_t (Counter->allocated ());
+                
+                // frees are not counted, so the peak is not known and max_bytes_used is left unset.
+                Counter.reset ();
+            }
+        };
+        
+        allocation_manager Manager {};
+        
+        const bool Registered = [] () {
+            benchmark::RegisterMemoryManager (&Manager);
+            return true;
+        } ();
+        
+    }
+    
+}
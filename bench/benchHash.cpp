@@ -0,0 +1,31 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/hash.hpp>
+#include <gigamonkey/timechain.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Bitcoin {
+    
+    void BenchHash256 (benchmark::State &state) {
+        bytes b (state.range (0));
+        for (size_t i = 0; i < b.size (); i++) b[i] = byte (i);
+        
+        for (auto _ : state) benchmark::DoNotOptimize (Hash256 (b));
+        
+        state.SetBytesProcessed (int64_t (state.iterations ()) * state.range (0));
+    }
+    
+    // a digest, a pair of digests, a header, a typical transaction and a big one.
+    BENCHMARK (BenchHash256)->Arg (32)->Arg (64)->Arg (80)->Arg (250)->Arg (1 << 10)->Arg (1 << 16)->Arg (1 << 20);
+    
+    void BenchHeaderHash (benchmark::State &state) {
+        header h {int32_little {1}, digest256 {uint256 {1}}, digest256 {uint256 {2}},
+            timestamp {1231006505}, target {uint32 (0x1d00ffff)}, uint32_little {2083236893}};
+        
+        for (auto _ : state) benchmark::DoNotOptimize (h.hash ());
+    }
+    
+    BENCHMARK (BenchHeaderHash);
+    
+}
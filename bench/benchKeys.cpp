@@ -0,0 +1,43 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/schema/hd.hpp>
+#include <gigamonkey/p2p/checksum.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::HD {
+    
+    const char *Master = "xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi";
+    
+    void BenchBIP32DeriveSecret (benchmark::State &state) {
+        BIP_32::secret master = BIP_32::secret::read (Master);
+        uint32 child = state.range (0) ? BIP_32::harden (0) : 0;
+        for (auto _ : state) benchmark::DoNotOptimize (BIP_32::derive (master, child++));
+    }
+    
+    // normal and hardened children.
+    BENCHMARK (BenchBIP32DeriveSecret)->Arg (0)->Arg (1);
+    
+    void BenchBIP32DerivePubkey (benchmark::State &state) {
+        BIP_32::pubkey master = BIP_32::secret::read (Master).to_public ();
+        uint32 child = 0;
+        for (auto _ : state) benchmark::DoNotOptimize (BIP_32::derive (master, child++));
+    }
+    
+    BENCHMARK (BenchBIP32DerivePubkey);
+    
+}
+
+namespace Gigamonkey::base58 {
+    
+    // an address and an extended key.
+    void BenchBase58CheckEncode (benchmark::State &state) {
+        bytes b (state.range (0));
+        for (size_t i = 0; i < b.size (); i++) b[i] = byte (i * 7 + 1);
+        check c {0, b};
+        for (auto _ : state) benchmark::DoNotOptimize (c.encode ());
+    }
+    
+    BENCHMARK (BenchBase58CheckEncode)->Arg (20)->Arg (74);
+    
+}
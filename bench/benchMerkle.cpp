@@ -0,0 +1,31 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/tree.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Merkle {
+    
+    leaf_digests leaves (uint32 n) {
+        leaf_digests l;
+        for (uint32 i = n; i > 0; i--) l = l << digest {uint256 {i}};
+        return l;
+    }
+    
+    void BenchMerkleTreeMake (benchmark::State &state) {
+        leaf_digests l = leaves (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (tree::make (l));
+        state.SetItemsProcessed (int64_t (state.iterations ()) * state.range (0));
+    }
+    
+    BENCHMARK (BenchMerkleTreeMake)->Arg (1 << 10)->Arg (1 << 20)->Unit (benchmark::kMillisecond);
+    
+    void BenchMerkleRoot (benchmark::State &state) {
+        leaf_digests l = leaves (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (root (l));
+        state.SetItemsProcessed (int64_t (state.iterations ()) * state.range (0));
+    }
+    
+    BENCHMARK (BenchMerkleRoot)->Arg (1 << 10)->Arg (1 << 20)->Unit (benchmark::kMillisecond);
+    
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/boost/boost.hpp>
+#include <gigamonkey/wif.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Bitcoin {
+    
+    void BenchMachineP2PKH (benchmark::State &state) {
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        incomplete::transaction tx {transaction::LatestVersion,
+            list<incomplete::input> {incomplete::input {outpoint {txid {uint256 {1000}}, 0}}},
+            list<output> {output {satoshi {900}, lock}}, 0};
+        
+        redemption_document doc {satoshi {1000}, tx, 0};
+        bytes unlock = pay_to_address::redeem (key.sign (sighash::document {doc.RedeemedValue, lock, tx, 0}), pk);
+        
+        for (auto _ : state) benchmark::DoNotOptimize (interpreter::machine {unlock, lock, doc}.run ());
+    }
+    
+    BENCHMARK (BenchMachineP2PKH);
+    
+}
+
+namespace Gigamonkey::Boost {
+    
+    // redeem a Boost bounty script, which proves the work in the script.
+    void BenchMachineBoost (benchmark::State &state) {
+        Bitcoin::secret key (Bitcoin::secret::main, secp256k1::secret (uint256 (5555)));
+        Bitcoin::pubkey pubkey = key.to_public ();
+        digest160 address = Bitcoin::Hash160 (pubkey);
+        
+        uint256 content {};
+        content[7] = 0x99;
+        
+        output_script o = output_script::bounty (0x21e8, content, work::compact {32, 0x0080ff}, bytes {}, 81, bytes (40, 0x11));
+        bytes lock = o.write ();
+        
+        Bitcoin::incomplete::transaction tx {
+            {Bitcoin::incomplete::input {Bitcoin::outpoint {Bitcoin::txid {}, 0}, 0xffffffff}},
+            {Bitcoin::output {Bitcoin::satoshi {900}, lock}}, 0};
+        Bitcoin::redemption_document doc {Bitcoin::satoshi {1000}, tx, 0};
+        
+        work::proof p = work::cpu_solve (work_puzzle (o, address),
+            work::solution {work::share {Bitcoin::timestamp {1000}, 0, bytes (8, 0x02)}, 353});
+        const work::share &x = p.Solution.Share;
+        
+        Bitcoin::signature sig = key.sign (Bitcoin::sighash::document {doc.RedeemedValue, lock, tx, 0});
+        bytes unlock = input_script::bounty (sig, pubkey, x.Nonce, x.Timestamp, x.ExtraNonce2, p.Solution.ExtraNonce1, address).write ();
+        
+        for (auto _ : state) benchmark::DoNotOptimize (Bitcoin::interpreter::machine {unlock, lock, doc}.run ());
+    }
+    
+    BENCHMARK (BenchMachineBoost);
+    
+}
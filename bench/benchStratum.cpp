@@ -0,0 +1,47 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/mining_notify.hpp>
+#include <gigamonkey/stratum/mining_submit.hpp>
+#include <gigamonkey/stratum/fast_json.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Stratum::mining {
+    
+    // taken from https://braiins.com/stratum-v1/docs, as in testStratum.cpp
+    const char *Notify = R"({"params": ["bf", "4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000", )"
+        R"("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008", )"
+        R"("072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", )"
+        R"([], "00000002", "1c2ac4af", "504e86b9", false], "id": null, "method": "mining.notify"})";
+    
+    const char *Submit = R"({"params": ["slush.miner1", "bf", "00000001", "504e86ed", "b2957c02"], "id": 4, "method": "mining.submit"})";
+    
+    // read a notification and write it again, as a pool and a miner do on every job.
+    void BenchNotifyRoundTrip (benchmark::State &state) {
+        for (auto _ : state) {
+            notify n {JSON::parse (Notify)};
+            notify::parameters p = n.params ();
+            benchmark::DoNotOptimize (notify::line (p));
+        }
+    }
+    
+    BENCHMARK (BenchNotifyRoundTrip);
+    
+    void BenchSubmitRoundTrip (benchmark::State &state) {
+        for (auto _ : state) {
+            submit_request r {JSON::parse (Submit)};
+            share x = r.params ();
+            benchmark::DoNotOptimize (JSON (submit_request {r.id (), x}).dump ());
+        }
+    }
+    
+    BENCHMARK (BenchSubmitRoundTrip);
+    
+    // the path that a server takes for submit lines before falling back to JSON.
+    void BenchSubmitReadLine (benchmark::State &state) {
+        for (auto _ : state) benchmark::DoNotOptimize (read_submit (Submit));
+    }
+    
+    BENCHMARK (BenchSubmitReadLine);
+    
+}
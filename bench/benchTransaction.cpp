@@ -0,0 +1,61 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/sighash.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // an incomplete transaction that spends n inputs to one output.
+    incomplete::transaction spend (uint32 inputs, const bytes &lock) {
+        list<incomplete::input> in;
+        for (uint32 i = 0; i < inputs; i++) in <<= incomplete::input {outpoint {txid {uint256 {1000 + i}}, i}};
+        return incomplete::transaction {transaction::LatestVersion, in, list<output> {output {satoshi {5000}, lock}}, 0};
+    }
+    
+    // n inputs, each of which has a P2PKH input script.
+    transaction make_transaction (uint32 inputs) {
+        bytes lock = pay_to_address::script (Hash160 (string_view {"benchmark"}));
+        list<bytes> unlocks;
+        for (uint32 i = 0; i < inputs; i++) unlocks <<= bytes (107, byte (i));
+        return spend (inputs, lock).complete (unlocks);
+    }
+    
+    void BenchTransactionRead (benchmark::State &state) {
+        bytes b = bytes (make_transaction (state.range (0)));
+        for (auto _ : state) benchmark::DoNotOptimize (transaction {b});
+        state.SetBytesProcessed (int64_t (state.iterations ()) * b.size ());
+    }
+    
+    BENCHMARK (BenchTransactionRead)->Arg (1)->Arg (10)->Arg (100)->Arg (1000);
+    
+    void BenchTransactionWrite (benchmark::State &state) {
+        transaction tx = make_transaction (state.range (0));
+        size_t size = tx.serialized_size ();
+        for (auto _ : state) benchmark::DoNotOptimize (bytes (tx));
+        state.SetBytesProcessed (int64_t (state.iterations ()) * size);
+    }
+    
+    BENCHMARK (BenchTransactionWrite)->Arg (1)->Arg (10)->Arg (100)->Arg (1000);
+    
+    // the document for every input of an n-input transaction, with and without
+    // the parts that are the same for every input computed beforehand.
+    void BenchSighashWrite (benchmark::State &state) {
+        uint32 inputs = state.range (0);
+        bool precompute = state.range (1);
+        bytes lock = pay_to_address::script (Hash160 (string_view {"benchmark"}));
+        incomplete::transaction tx = spend (inputs, lock);
+        
+        for (auto _ : state) {
+            ptr<const sighash::precomputed> p = precompute ? std::make_shared<const sighash::precomputed> (tx) : nullptr;
+            for (uint32 i = 0; i < inputs; i++)
+                benchmark::DoNotOptimize (sighash::write (sighash::document {satoshi {1000}, lock, tx, i, p}, directive (sighash::all)));
+        }
+        
+        state.SetItemsProcessed (int64_t (state.iterations ()) * inputs);
+    }
+    
+    BENCHMARK (BenchSighashWrite)->ArgsProduct ({{1, 10, 100, 1000}, {0, 1}})->Unit (benchmark::kMicrosecond);
+    
+}
@@ -0,0 +1,284 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// Run scripts through each of the ways that interpreter::machine can evaluate
+// them, check that they all give the same results and errors, and report how
+// fast each is compared to the reference.
+//
+//     gigamonkey_differential [--scripts <n>] [--seed <n>] [--corpus <file>]
+//
+// The reference runs each script one step at a time with a new machine and
+// with the specialized functions for P2PKH and P2PK turned off. It is compared to
+//
+//     run        machine::run, with the specialized functions.
+//     reset      one machine that is reset for every script and so reuses its buffers.
+//     deferred   machine::run with signatures checked after the script.
+//     budget     machine::advance with a budget too big to be reached.
+//
+// Scripts are generated at random from every opcode but those that need a
+// transaction, and P2PKH and P2PK scripts are made with valid and invalid
+// signatures. Each line of the corpus is another pair of scripts, the unlocking
+// script and then the locking script in hex, separated by a space.
+//
+// The code in src/sv/script only has the operations that machine gives to it,
+// so it cannot run whole scripts and it is not compared separately.
+
+#include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/wif.hpp>
+#include <gigamonkey/hex.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        using clock = std::chrono::steady_clock;
+        
+        struct test_case {
+            bytes Unlock;
+            bytes Lock;
+            maybe<redemption_document> Document;
+            uint32 Flags;
+        };
+        
+        // machine holds pointers into itself, so it is never copied or moved.
+        template <typename F> result with_machine (const test_case &x, F f) {
+            if (x.Document) {
+                interpreter::machine m {x.Unlock, x.Lock, *x.Document, x.Flags};
+                return f (m);
+            }
+            
+            interpreter::machine m {x.Unlock, x.Lock, x.Flags};
+            return f (m);
+        }
+        
+        struct engine {
+            std::string Name;
+            std::function<result (const test_case &)> Run;
+            uint64 Nanoseconds {0};
+            uint64 Mismatches {0};
+            
+            result operator () (const test_case &x) {
+                auto start = clock::now ();
+                result r = Run (x);
+                Nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now () - start).count ();
+                return r;
+            }
+        };
+        
+        result reference (const test_case &x) {
+            return with_machine (x, [] (interpreter::machine &m) {
+                m.specialize_standard_scripts (false);
+                while (!m.Halt) m.step ();
+                return m.Result;
+            });
+        }
+        
+        result run (const test_case &x) {
+            return with_machine (x, [] (interpreter::machine &m) {
+                return m.run ();
+            });
+        }
+        
+        result deferred (const test_case &x) {
+            return with_machine (x, [] (interpreter::machine &m) {
+                m.defer_signatures ();
+                return m.run ();
+            });
+        }
+        
+        result budgeted (const test_case &x) {
+            return with_machine (x, [] (interpreter::machine &m) {
+                interpreter::machine::budget b {};
+                b.Time = std::chrono::hours {1};
+                b.Operations = uint64 (1) << 40;
+                b.StackBytes = uint64 (1) << 40;
+                m.limit (b);
+                while (!m.advance (16));
+                return m.Result;
+            });
+        }
+        
+        result reset (const test_case &x) {
+            static interpreter::machine Machine {bytes {}, bytes {}};
+            if (x.Document) Machine.reset (x.Unlock, x.Lock, *x.Document, x.Flags);
+            else Machine.reset (x.Unlock, x.Lock, x.Flags);
+            return Machine.run ();
+        }
+        
+        // every opcode whose result does not depend on a transaction.
+        const std::vector<op> &alphabet () {
+            static std::vector<op> Alphabet {
+                OP_0, OP_1NEGATE, OP_1, OP_2, OP_3, OP_16, OP_NOP,
+                OP_IF, OP_NOTIF, OP_ELSE, OP_ENDIF, OP_VERIFY, OP_RETURN,
+                OP_TOALTSTACK, OP_FROMALTSTACK, OP_2DROP, OP_2DUP, OP_3DUP, OP_2OVER, OP_2ROT, OP_2SWAP,
+                OP_IFDUP, OP_DEPTH, OP_DROP, OP_DUP, OP_NIP, OP_OVER, OP_PICK, OP_ROLL, OP_ROT, OP_SWAP, OP_TUCK,
+                OP_CAT, OP_SPLIT, OP_NUM2BIN, OP_BIN2NUM, OP_SIZE,
+                OP_INVERT, OP_AND, OP_OR, OP_XOR, OP_EQUAL, OP_EQUALVERIFY, OP_LSHIFT, OP_RSHIFT,
+                OP_1ADD, OP_1SUB, OP_NEGATE, OP_ABS, OP_NOT, OP_0NOTEQUAL,
+                OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_BOOLAND, OP_BOOLOR,
+                OP_NUMEQUAL, OP_NUMEQUALVERIFY, OP_NUMNOTEQUAL, OP_LESSTHAN, OP_GREATERTHAN,
+                OP_LESSTHANOREQUAL, OP_GREATERTHANOREQUAL, OP_MIN, OP_MAX, OP_WITHIN,
+                OP_RIPEMD160, OP_SHA1, OP_SHA256, OP_HASH160, OP_HASH256, OP_CODESEPARATOR};
+            return Alphabet;
+        }
+        
+        // numbers near the edges of what fits in the small integers of the
+        // interpreter, as well as random bytes that may not be minimal.
+        bytes random_push (std::mt19937_64 &r) {
+            switch (r () % 4) {
+                case 0: return bytes (Z {int64 (r () % 33) - 16});
+                case 1: {
+                    int64 n = std::numeric_limits<int64>::max () - int64 (r () % 4);
+                    return bytes (Z {r () % 2 ? n : -n});
+                }
+                case 2: return bytes (Z {int64 (r () % 2 ? 1 : -1) << (r () % 63)});
+                default: {
+                    bytes b (r () % 10);
+                    for (byte &x : b) x = byte (r ());
+                    return b;
+                }
+            }
+        }
+        
+        test_case random_case (std::mt19937_64 &r) {
+            program unlock {};
+            for (size_t i = 0, n = r () % 5; i < n; i++) unlock <<= instruction::push (random_push (r));
+            
+            program lock {};
+            const std::vector<op> &ops = alphabet ();
+            for (size_t i = 0, n = r () % 24; i < n; i++)
+                if (r () % 4 == 0) lock <<= instruction::push (random_push (r));
+                else lock <<= instruction {ops[r () % ops.size ()]};
+            
+            uint32 flags = r () % 2 ? StandardScriptVerifyFlags (true, true) : StandardScriptVerifyFlags (false, false);
+            return test_case {compile (unlock), compile (lock), {}, flags};
+        }
+        
+        // P2PKH and P2PK scripts with correct and incorrect signatures.
+        std::vector<test_case> standard_cases () {
+            secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+            secret other {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a8"}}};
+            pubkey pk = key.to_public ();
+            pubkey other_pk = other.to_public ();
+            
+            incomplete::transaction incomplete {transaction::LatestVersion,
+                list<incomplete::input> {incomplete::input {outpoint {txid {uint256 {1000}}, 0}}},
+                list<output> {output {satoshi {900}, pay_to_address::script (Hash160 (pk))}}, 0};
+            
+            std::vector<test_case> cases;
+            for (const bytes &lock : {pay_to_address::script (Hash160 (pk)), pay_to_pubkey::script (pk)}) {
+                redemption_document doc {satoshi {1000}, incomplete, 0};
+                sighash::document signed_doc {doc.RedeemedValue, lock, incomplete, 0};
+                signature sig = key.sign (signed_doc);
+                signature wrong = other.sign (signed_doc);
+                
+                bool p2pkh = lock.size () == 25;
+                auto redeem = [p2pkh] (const signature &x, const pubkey &p) -> bytes {
+                    return p2pkh ? pay_to_address::redeem (x, p) : pay_to_pubkey::redeem (x);
+                };
+                
+                for (const bytes &unlock : {redeem (sig, pk), redeem (wrong, pk), redeem (sig, other_pk), redeem (signature {}, pk)})
+                    for (uint32 flags : {StandardScriptVerifyFlags (true, true), StandardScriptVerifyFlags (false, false)}) {
+                        cases.push_back (test_case {unlock, lock, {doc}, flags});
+                        cases.push_back (test_case {unlock, lock, {}, flags});
+                    }
+            }
+            
+            return cases;
+        }
+        
+        std::vector<test_case> read_corpus (const std::string &file) {
+            std::ifstream f {file};
+            if (!f) throw std::runtime_error {"could not open " + file};
+            
+            std::vector<test_case> cases;
+            std::string line;
+            while (std::getline (f, line)) {
+                if (line.empty ()) continue;
+                std::stringstream ss {line};
+                std::string unlock, lock;
+                ss >> unlock >> lock;
+                maybe<bytes> u = hex::read (unlock);
+                maybe<bytes> l = hex::read (lock);
+                if (!u || !l) throw std::runtime_error {"invalid line in corpus: " + line};
+                cases.push_back (test_case {*u, *l, {}, StandardScriptVerifyFlags (true, true)});
+            }
+            
+            return cases;
+        }
+        
+    }
+    
+}
+
+int main (int argc, char **argv) {
+    using namespace Gigamonkey;
+    using namespace Gigamonkey::Bitcoin;
+    
+    uint64 scripts = 100000;
+    uint64 seed = 0;
+    std::string corpus {};
+    
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag {argv[i]};
+        if (i + 1 == argc) {
+            std::cerr << "usage: " << argv[0] << " [--scripts <n>] [--seed <n>] [--corpus <file>]" << std::endl;
+            return 1;
+        }
+        
+        if (flag == "--scripts") scripts = std::stoull (argv[i + 1]);
+        else if (flag == "--seed") seed = std::stoull (argv[i + 1]);
+        else if (flag == "--corpus") corpus = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+    
+    try {
+        std::vector<test_case> cases = standard_cases ();
+        if (corpus != "") for (test_case &x : read_corpus (corpus)) cases.push_back (std::move (x));
+        
+        std::mt19937_64 r {seed};
+        for (uint64 i = 0; i < scripts; i++) cases.push_back (random_case (r));
+        
+        engine ref {"reference", reference};
+        std::vector<engine> engines {{"run", run}, {"reset", reset}, {"deferred", deferred}, {"budget", budgeted}};
+        
+        uint64 failures = 0;
+        for (const test_case &x : cases) {
+            result expected = ref (x);
+            for (engine &e : engines) {
+                result got = e (x);
+                if (got == expected) continue;
+                
+                e.Mismatches++;
+                if (failures++ < 20) std::cout << "mismatch in " << e.Name << ": unlock " << hex::write (x.Unlock)
+                    << " lock " << hex::write (x.Lock) << " flags " << x.Flags
+                    << " expected " << expected << " got " << got << std::endl;
+            }
+        }
+        
+        std::cout << cases.size () << " scripts" << std::endl;
+        std::cout << std::left << std::setw (12) << ref.Name << std::right << std::setw (14) << ref.Nanoseconds << " ns" << std::endl;
+        for (const engine &e : engines) std::cout << std::left << std::setw (12) << e.Name << std::right
+            << std::setw (14) << e.Nanoseconds << " ns" << std::setw (10) << std::fixed << std::setprecision (2)
+            << (e.Nanoseconds == 0 ? 0. : double (ref.Nanoseconds) / e.Nanoseconds) << "x"
+            << std::setw (10) << e.Mismatches << " mismatches" << std::endl;
+        
+        return failures == 0 ? 0 : 1;
+    } catch (const std::exception &x) {
+        std::cerr << "error: " << x.what () << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,663 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// Drive a Stratum server with many simulated miners and report how well it keeps up.
+//
+//     gigamonkey_loadgen <host> <port> [options]
+//
+//     --miners N               simulated miners (1000)
+//     --seconds S              how long to run after the first miner connects (60)
+//     --threads N              event loops to run the miners on (1)
+//     --ramp S                 seconds over which the miners first connect (10)
+//     --shares-per-minute R    the average rate of shares from each miner (6)
+//     --version-rolling        ask for version rolling and roll version bits in shares
+//     --stale F                the chance that a miner submits one more share for
+//                              the old job when a job with clean_jobs arrives (0)
+//     --storm-every S          every miner disconnects and reconnects at once every S seconds
+//     --source A,B,...         local addresses to connect from in turn. One address can only
+//                              make about 28000 connections to one port, so use several,
+//                              such as 127.0.0.2, 127.0.0.3, ... on loopback.
+//     --worker NAME            workers are called NAME.0, NAME.1, ... (loadgen)
+//     --server-pid P           measure the memory of the server per session from /proc/P/status
+//     --json FILE              write the report as JSON
+//
+// The miners do not hash. Their shares have random nonces, so they are rejected
+// unless the difficulty is very low, but they cost the server as much to check.
+// They are not client_session, which has a thread of its own for every session;
+// each is a socket with a few hundred bytes of state on a shared event loop. For
+// 100k miners, raise the limit on open files with ulimit -n.
+//
+// Times measured:
+//     notify fan-out   for each job, from when the first miner got it to when each of
+//                      the others did. Jobs that are the first after a miner connects
+//                      are not counted.
+//     notify spread    for each job, from when the first miner got it to the last.
+//     share ack        from writing a share to reading its response.
+//     subscribe        from connecting to reading the response to mining.subscribe.
+
+#include <gigamonkey/stratum/mining_configure.hpp>
+#include <gigamonkey/stratum/mining_authorize.hpp>
+#include <gigamonkey/stratum/mining_subscribe.hpp>
+#include <gigamonkey/stratum/mining_submit.hpp>
+#include <gigamonkey/stratum/mining_notify.hpp>
+#include <gigamonkey/stratum/mining_set_extranonce.hpp>
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        namespace asio = boost::asio;
+        using tcp = asio::ip::tcp;
+        using steady = std::chrono::steady_clock;
+        
+        constexpr int32 VersionRollingMask = 0x1fffe000;
+        
+        struct options {
+            tcp::endpoint Server {};
+            uint32 Miners {1000};
+            double Seconds {60};
+            uint32 Threads {1};
+            double Ramp {10};
+            double SharesPerMinute {6};
+            bool VersionRolling {false};
+            double Stale {0};
+            double StormEvery {0};
+            std::vector<asio::ip::address> Sources {};
+            string Worker {"loadgen"};
+            int ServerPID {0};
+            string JSONFile {};
+        };
+        
+        uint64 nanoseconds (steady::duration d) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds> (d).count ();
+        }
+        
+        // latencies in nanoseconds.
+        struct latencies {
+            std::string Name;
+            std::vector<uint64> Samples {};
+            
+            explicit latencies (std::string name) : Name {name} {}
+            
+            void add (steady::duration d) {
+                Samples.push_back (nanoseconds (d));
+            }
+            
+            // Samples must be sorted.
+            uint64 percentile (double p) const {
+                if (Samples.empty ()) return 0;
+                return Samples[std::min (Samples.size () - 1, size_t (p * Samples.size ()))];
+            }
+            
+            JSON to_JSON () const {
+                return JSON {
+                    {"name", Name},
+                    {"samples", Samples.size ()},
+                    {"p50_ns", percentile (.5)},
+                    {"p90_ns", percentile (.9)},
+                    {"p99_ns", percentile (.99)},
+                    {"p999_ns", percentile (.999)},
+                    {"max_ns", Samples.empty () ? 0 : Samples.back ()}};
+            }
+        };
+        
+        std::ostream &operator << (std::ostream &o, const latencies &x) {
+            return o << x.Name << ": " << x.Samples.size () << " samples; p50 " << x.percentile (.5) / 1e3
+                << "us, p90 " << x.percentile (.9) / 1e3 << "us, p99 " << x.percentile (.99) / 1e3
+                << "us, max " << (x.Samples.empty () ? 0 : x.Samples.back ()) / 1e3 << "us";
+        }
+        
+        // kept by each event loop without locks and added up at the end.
+        struct results {
+            latencies ShareAck {"share ack"};
+            latencies Subscribe {"subscribe"};
+            
+            // when each job was received by each miner.
+            std::unordered_map<job_id, std::vector<steady::time_point>> Jobs {};
+            
+            uint64 Connects {0};
+            uint64 Disconnects {0};
+            uint64 ConnectErrors {0};
+            uint64 Notifies {0};
+            uint64 CleanJobs {0};
+            uint64 Submitted {0};
+            uint64 StaleSubmitted {0};
+            uint64 Accepted {0};
+            uint64 Rejected {0};
+            uint64 InvalidMessages {0};
+            
+            void add (results &x) {
+                ShareAck.Samples.insert (ShareAck.Samples.end (), x.ShareAck.Samples.begin (), x.ShareAck.Samples.end ());
+                Subscribe.Samples.insert (Subscribe.Samples.end (), x.Subscribe.Samples.begin (), x.Subscribe.Samples.end ());
+                for (auto &[id, times] : x.Jobs) {
+                    auto &all = Jobs[id];
+                    all.insert (all.end (), times.begin (), times.end ());
+                }
+                
+                Connects += x.Connects;
+                Disconnects += x.Disconnects;
+                ConnectErrors += x.ConnectErrors;
+                Notifies += x.Notifies;
+                CleanJobs += x.CleanJobs;
+                Submitted += x.Submitted;
+                StaleSubmitted += x.StaleSubmitted;
+                Accepted += x.Accepted;
+                Rejected += x.Rejected;
+                InvalidMessages += x.InvalidMessages;
+            }
+        };
+        
+        struct loop;
+        
+        struct miner : std::enable_shared_from_this<miner> {
+            loop &Loop;
+            const uint32 Index;
+            
+            tcp::socket Socket;
+            asio::steady_timer Timer;
+            asio::steady_timer ShareTimer;
+            asio::streambuf Input;
+            std::deque<string> Output {};
+            
+            // incremented on every connection so that callbacks for an old one are ignored.
+            uint32 Generation {0};
+            bool Open {false};
+            bool Subscribed {false};
+            bool HadJob {false};
+            bool SharesScheduled {false};
+            
+            struct pending {
+                method Method;
+                steady::time_point Sent;
+            };
+            
+            uint32 NextID {1};
+            std::unordered_map<uint32, pending> Pending {};
+            steady::time_point Connected {};
+            
+            maybe<mining::notify::parameters> Job {};
+            size_t ExtraNonce2Size {extranonce::BitcoinExtraNonce2Size};
+            maybe<int32> Mask {};
+            
+            std::mt19937_64 Random;
+            
+            miner (loop &l, uint32 index);
+            
+            void connect (steady::duration after);
+            void disconnect ();
+            
+            void read ();
+            void write ();
+            void send (const JSON &);
+            void send_request (method, const Stratum::parameters &);
+            
+            void receive (const JSON &);
+            void receive_notify (const mining::notify::parameters &);
+            void receive_response (const pending &, const JSON &);
+            
+            void schedule_share ();
+            void submit (const mining::notify::parameters &);
+        };
+        
+        // an event loop with its own miners, run on one thread.
+        struct loop {
+            const options &Options;
+            std::atomic<int64> &Subscribed;
+            
+            asio::io_context IO {};
+            asio::steady_timer Storm;
+            std::vector<ptr<miner>> Miners {};
+            results Results {};
+            bool Stopping {false};
+            
+            loop (const options &o, std::atomic<int64> &subscribed) : Options {o}, Subscribed {subscribed}, Storm {IO} {}
+            
+            void start (uint32 first, uint32 count);
+            void storm ();
+            void stop ();
+        };
+        
+        miner::miner (loop &l, uint32 index) : Loop {l}, Index {index}, Socket {l.IO}, Timer {l.IO}, ShareTimer {l.IO},
+            Input {1 << 16}, Random {index} {}
+        
+        void miner::connect (steady::duration after) {
+            Timer.expires_after (after);
+            Timer.async_wait ([self = shared_from_this (), g = Generation] (const boost::system::error_code &err) {
+                if (err || g != self->Generation || self->Loop.Stopping) return;
+                
+                boost::system::error_code e;
+                const options &o = self->Loop.Options;
+                self->Socket.open (o.Server.protocol (), e);
+                if (!e && !o.Sources.empty ()) self->Socket.bind (tcp::endpoint {o.Sources[self->Index % o.Sources.size ()], 0}, e);
+                if (e) {
+                    self->Loop.Results.ConnectErrors++;
+                    self->disconnect ();
+                    return self->connect (std::chrono::seconds {1});
+                }
+                
+                self->Connected = steady::now ();
+                self->Socket.async_connect (o.Server, [self, g] (const boost::system::error_code &err) {
+                    if (g != self->Generation || self->Loop.Stopping) return;
+                    if (err) {
+                        self->Loop.Results.ConnectErrors++;
+                        self->disconnect ();
+                        return self->connect (std::chrono::seconds {1});
+                    }
+                    
+                    self->Open = true;
+                    self->Loop.Results.Connects++;
+                    
+                    if (self->Loop.Options.VersionRolling) self->send_request (mining_configure,
+                        mining::configure_request::serialize (mining::configure_request::parameters {
+                            extensions::requests {{}}.insert<extensions::version_rolling> (
+                                extensions::configuration<extensions::version_rolling> {int32_little {VersionRollingMask}, 2})}));
+                    
+                    self->send_request (mining_subscribe, mining::subscribe_request::serialize (
+                        mining::subscribe_request::parameters {"gigamonkey_loadgen"}));
+                    self->send_request (mining_authorize, mining::authorize_request::serialize (
+                        mining::authorize_request::parameters {self->Loop.Options.Worker + "." + std::to_string (self->Index)}));
+                    self->read ();
+                });
+            });
+        }
+        
+        // everything about the connection is forgotten.
+        void miner::disconnect () {
+            boost::system::error_code err;
+            Socket.close (err);
+            ShareTimer.cancel ();
+            
+            if (Open) Loop.Results.Disconnects++;
+            if (Subscribed) Loop.Subscribed--;
+            
+            Generation++;
+            Open = false;
+            Subscribed = false;
+            HadJob = false;
+            SharesScheduled = false;
+            Output.clear ();
+            Pending.clear ();
+            Job = {};
+            Mask = {};
+            ExtraNonce2Size = extranonce::BitcoinExtraNonce2Size;
+        }
+        
+        void miner::read () {
+            asio::async_read_until (Socket, Input, '\n', [self = shared_from_this (), g = Generation]
+                (const boost::system::error_code &err, size_t size) {
+                if (g != self->Generation) return;
+                if (err) {
+                    self->disconnect ();
+                    return self->connect (std::chrono::seconds {1});
+                }
+                
+                string line {asio::buffers_begin (self->Input.data ()), asio::buffers_begin (self->Input.data ()) + size};
+                self->Input.consume (size);
+                
+                JSON j = JSON::parse (line, nullptr, false);
+                if (j.is_discarded ()) self->Loop.Results.InvalidMessages++;
+                else self->receive (j);
+                
+                if (g == self->Generation) self->read ();
+            });
+        }
+        
+        void miner::send (const JSON &j) {
+            if (!Open) return;
+            Output.push_back (j.dump () + "\n");
+            if (Output.size () == 1) write ();
+        }
+        
+        void miner::write () {
+            asio::async_write (Socket, asio::buffer (Output.front ()), [self = shared_from_this (), g = Generation]
+                (const boost::system::error_code &err, size_t) {
+                if (g != self->Generation) return;
+                if (err) {
+                    self->disconnect ();
+                    return self->connect (std::chrono::seconds {1});
+                }
+                
+                self->Output.pop_front ();
+                if (!self->Output.empty ()) self->write ();
+            });
+        }
+        
+        void miner::send_request (method m, const Stratum::parameters &p) {
+            uint32 id = NextID++;
+            Pending[id] = pending {m, steady::now ()};
+            send (Stratum::request {message_id {id}, m, p});
+        }
+        
+        void miner::receive (const JSON &j) {
+            if (notification::valid (j)) switch (notification::method (j)) {
+                case mining_notify: {
+                    mining::notify::parameters p = mining::notify::deserialize (notification::params (j));
+                    if (!p.valid ()) Loop.Results.InvalidMessages++;
+                    else receive_notify (p);
+                    return;
+                }
+                
+                case mining_set_extranonce: {
+                    auto x = mining::set_extranonce::deserialize (notification::params (j));
+                    if (x) ExtraNonce2Size = x->ExtraNonce2Size;
+                    return;
+                }
+                
+                default: return;
+            }
+            
+            if (response::valid (j)) {
+                message_id id = response::id (j);
+                if (!id.is_number_unsigned ()) return;
+                
+                auto x = Pending.find (uint32 (uint64 (id)));
+                if (x == Pending.end ()) return;
+                pending p = x->second;
+                Pending.erase (x);
+                return receive_response (p, j);
+            }
+            
+            // the only request that a server sends.
+            if (request::valid (j) && request::method (j) == client_get_version)
+                return send (response {request::id (j), JSON (string {"gigamonkey_loadgen"})});
+            
+            Loop.Results.InvalidMessages++;
+        }
+        
+        void miner::receive_response (const pending &p, const JSON &j) {
+            bool ok = !response::error (j) && response::result (j) != false;
+            switch (p.Method) {
+                case mining_submit: {
+                    Loop.Results.ShareAck.add (steady::now () - p.Sent);
+                    if (ok) Loop.Results.Accepted++;
+                    else Loop.Results.Rejected++;
+                    return;
+                }
+                
+                case mining_subscribe: {
+                    if (!ok) return;
+                    Loop.Results.Subscribe.add (steady::now () - Connected);
+                    if (mining::subscribe_response::valid (j)) ExtraNonce2Size = mining::subscribe_response::extra_nonce_2_size (j);
+                    Subscribed = true;
+                    Loop.Subscribed++;
+                    return;
+                }
+                
+                case mining_configure: {
+                    if (ok) Mask = VersionRollingMask;
+                    return;
+                }
+                
+                default: return;
+            }
+        }
+        
+        void miner::receive_notify (const mining::notify::parameters &p) {
+            results &r = Loop.Results;
+            r.Notifies++;
+            
+            // the first job after connecting tells us nothing about fan-out.
+            if (HadJob) r.Jobs[p.JobID].push_back (steady::now ());
+            HadJob = true;
+            
+            if (p.Clean) {
+                r.CleanJobs++;
+                if (Job && std::uniform_real_distribution<double> {0, 1} (Random) < Loop.Options.Stale) {
+                    r.StaleSubmitted++;
+                    submit (*Job);
+                }
+            }
+            
+            Job = p;
+            if (!SharesScheduled) schedule_share ();
+        }
+        
+        // shares come at random with the average rate.
+        void miner::schedule_share () {
+            if (!(Loop.Options.SharesPerMinute > 0)) return;
+            SharesScheduled = true;
+            
+            double wait = std::exponential_distribution<double> {Loop.Options.SharesPerMinute / 60} (Random);
+            ShareTimer.expires_after (std::chrono::duration_cast<steady::duration> (std::chrono::duration<double> {wait}));
+            ShareTimer.async_wait ([self = shared_from_this (), g = Generation] (const boost::system::error_code &err) {
+                if (err || g != self->Generation) return;
+                if (self->Job) self->submit (*self->Job);
+                self->schedule_share ();
+            });
+        }
+        
+        void miner::submit (const mining::notify::parameters &job) {
+            bytes en2 (ExtraNonce2Size);
+            for (byte &b : en2) b = byte (Random ());
+            
+            nonce n {uint32 (Random ())};
+            work::share x = Mask ?
+                work::share {job.Now, n, en2, int32_little {int32 (Random ()) & *Mask}} :
+                work::share {job.Now, n, en2};
+            
+            Loop.Results.Submitted++;
+            send_request (mining_submit, mining::submit_request::serialize (
+                share {Loop.Options.Worker + "." + std::to_string (Index), job.JobID, x}));
+        }
+        
+        void loop::start (uint32 first, uint32 count) {
+            for (uint32 i = 0; i < count; i++) {
+                auto m = std::make_shared<miner> (*this, first + i);
+                Miners.push_back (m);
+                
+                // the miners of all the loops are spread evenly over the ramp.
+                double at = Options.Miners > 1 ? Options.Ramp * (first + i) / (Options.Miners - 1) : 0;
+                m->connect (std::chrono::duration_cast<steady::duration> (std::chrono::duration<double> {at}));
+            }
+            
+            if (Options.StormEvery > 0) storm ();
+        }
+        
+        void loop::storm () {
+            Storm.expires_after (std::chrono::duration_cast<steady::duration> (std::chrono::duration<double> {Options.StormEvery}));
+            Storm.async_wait ([this] (const boost::system::error_code &err) {
+                if (err || Stopping) return;
+                for (const ptr<miner> &m : Miners) if (m->Open) {
+                    m->disconnect ();
+                    m->connect (steady::duration {0});
+                }
+                storm ();
+            });
+        }
+        
+        void loop::stop () {
+            asio::post (IO, [this] () {
+                Stopping = true;
+                Storm.cancel ();
+                for (const ptr<miner> &m : Miners) {
+                    m->Timer.cancel ();
+                    m->disconnect ();
+                }
+                
+                IO.stop ();
+            });
+        }
+        
+        // resident memory of a process in bytes, or 0 if we cannot tell.
+        uint64 resident (const string &pid) {
+            std::ifstream status {"/proc/" + pid + "/status"};
+            string line;
+            while (std::getline (status, line)) if (line.rfind ("VmRSS:", 0) == 0) {
+                std::stringstream x {line.substr (6)};
+                uint64 kb;
+                if (x >> kb) return kb * 1024;
+            }
+            
+            return 0;
+        }
+        
+        // memory per session, from the sample with the most sessions.
+        struct memory {
+            string PID;
+            uint64 Baseline;
+            uint64 Resident {0};
+            int64 Sessions {0};
+            
+            explicit memory (const string &pid) : PID {pid}, Baseline {resident (pid)} {}
+            
+            void sample (int64 sessions) {
+                if (sessions <= Sessions) return;
+                uint64 r = resident (PID);
+                if (r == 0) return;
+                Sessions = sessions;
+                Resident = r;
+            }
+            
+            double per_session () const {
+                return Sessions == 0 || Resident < Baseline ? 0. : double (Resident - Baseline) / Sessions;
+            }
+        };
+        
+    }
+    
+}
+
+int main (int argc, char **argv) {
+    using namespace Gigamonkey;
+    using namespace Gigamonkey::Stratum;
+    
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <host> <port> [--miners N] [--seconds S] [--threads N] [--ramp S] "
+            "[--shares-per-minute R] [--version-rolling] [--stale F] [--storm-every S] [--source A,B,...] "
+            "[--worker NAME] [--server-pid P] [--json FILE]" << std::endl;
+        return 1;
+    }
+    
+    try {
+        options o {};
+        
+        asio::io_context resolve;
+        o.Server = *tcp::resolver {resolve}.resolve (argv[1], argv[2]).begin ();
+        
+        for (int i = 3; i < argc; i++) {
+            string flag {argv[i]};
+            if (flag == "--version-rolling") {
+                o.VersionRolling = true;
+                continue;
+            }
+            
+            if (i + 1 == argc) throw std::invalid_argument {"no value for " + flag};
+            string value {argv[++i]};
+            
+            if (flag == "--miners") o.Miners = std::stoul (value);
+            else if (flag == "--seconds") o.Seconds = std::stod (value);
+            else if (flag == "--threads") o.Threads = std::max (std::stoul (value), 1ul);
+            else if (flag == "--ramp") o.Ramp = std::stod (value);
+            else if (flag == "--shares-per-minute") o.SharesPerMinute = std::stod (value);
+            else if (flag == "--stale") o.Stale = std::stod (value);
+            else if (flag == "--storm-every") o.StormEvery = std::stod (value);
+            else if (flag == "--worker") o.Worker = value;
+            else if (flag == "--server-pid") o.ServerPID = std::stoi (value);
+            else if (flag == "--json") o.JSONFile = value;
+            else if (flag == "--source") {
+                std::stringstream sources {value};
+                string address;
+                while (std::getline (sources, address, ',')) o.Sources.push_back (asio::ip::make_address (address));
+            } else throw std::invalid_argument {"unknown option " + flag};
+        }
+        
+        memory client {"self"};
+        maybe<memory> server;
+        if (o.ServerPID != 0) server.emplace (std::to_string (o.ServerPID));
+        
+        std::atomic<int64> subscribed {0};
+        std::vector<std::unique_ptr<loop>> loops;
+        std::vector<std::thread> threads;
+        for (uint32 t = 0; t < o.Threads; t++) {
+            uint32 first = uint64 (o.Miners) * t / o.Threads;
+            uint32 last = uint64 (o.Miners) * (t + 1) / o.Threads;
+            loops.push_back (std::make_unique<loop> (o, subscribed));
+            loops.back ()->start (first, last - first);
+        }
+        
+        for (auto &l : loops) threads.emplace_back ([&l] () {
+            auto work = asio::make_work_guard (l->IO);
+            l->IO.run ();
+        });
+        
+        // sample memory and print progress every second.
+        auto start = steady::now ();
+        while (steady::now () - start < std::chrono::duration<double> {o.Ramp + o.Seconds}) {
+            std::this_thread::sleep_for (std::chrono::seconds {1});
+            int64 sessions = subscribed.load ();
+            client.sample (sessions);
+            if (server) server->sample (sessions);
+            std::cerr << "\r" << sessions << " sessions" << std::flush;
+        }
+        
+        std::cerr << std::endl;
+        
+        for (auto &l : loops) l->stop ();
+        for (std::thread &t : threads) t.join ();
+        
+        results r {};
+        for (auto &l : loops) r.add (l->Results);
+        
+        latencies fanout {"notify fan-out"};
+        latencies spread {"notify spread"};
+        for (const auto &[id, times] : r.Jobs) {
+            if (times.size () < 2) continue;
+            auto [first, last] = std::minmax_element (times.begin (), times.end ());
+            for (const steady::time_point &t : times) fanout.add (t - *first);
+            spread.add (*last - *first);
+        }
+        
+        std::vector<latencies *> all {&fanout, &spread, &r.ShareAck, &r.Subscribe};
+        for (latencies *x : all) std::sort (x->Samples.begin (), x->Samples.end ());
+        
+        std::cout << r.Connects << " connections, " << r.Disconnects << " disconnections, " << r.ConnectErrors << " failed connections, "
+            << r.Notifies << " jobs received, of which " << r.CleanJobs << " clean, " << r.Submitted << " shares submitted, of which "
+            << r.StaleSubmitted << " knowingly stale, " << r.Accepted << " accepted, " << r.Rejected << " rejected, "
+            << r.InvalidMessages << " invalid messages" << std::endl;
+        for (const latencies *x : all) std::cout << *x << std::endl;
+        std::cout << "client memory per miner: " << client.per_session () << " bytes" << std::endl;
+        if (server) std::cout << "server memory per session: " << server->per_session () << " bytes over "
+            << server->Sessions << " sessions" << std::endl;
+        
+        if (o.JSONFile != "") {
+            JSON::array_t stages;
+            for (const latencies *x : all) stages.push_back (x->to_JSON ());
+            JSON j {
+                {"miners", o.Miners},
+                {"connects", r.Connects},
+                {"disconnects", r.Disconnects},
+                {"connect_errors", r.ConnectErrors},
+                {"notifies", r.Notifies},
+                {"clean_jobs", r.CleanJobs},
+                {"submitted", r.Submitted},
+                {"stale_submitted", r.StaleSubmitted},
+                {"accepted", r.Accepted},
+                {"rejected", r.Rejected},
+                {"invalid_messages", r.InvalidMessages},
+                {"latencies", stages},
+                {"client_bytes_per_miner", client.per_session ()}};
+            if (server) j["server_bytes_per_session"] = server->per_session ();
+            
+            std::ofstream out {o.JSONFile};
+            out << j.dump (4) << std::endl;
+        }
+    } catch (const std::exception &x) {
+        std::cerr << "error: " << x.what () << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,354 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// Replay a directory of real blocks through the library and report the
+// throughput and latency of each stage.
+//
+//     gigamonkey_replay <directory> [--json <file>] [--profile <file>]
+//
+// Every file in the directory whose name ends in .block is a serialized block.
+// Blocks are replayed in the order of their file names, so name them by height.
+// The outputs that the inputs of X.block spend, other than those created
+// earlier in the same block or in an earlier block of the replay, go in
+// X.prevouts, which is
+//
+//     block height            uint32 little endian
+//     number of prevouts      var_int
+//     for each prevout
+//         outpoint            36 bytes
+//         output              as in a transaction
+//         height of creation  uint32 little endian
+//
+// The heights determine the script flags. Inputs whose prevout cannot be found
+// are counted as missing and are not evaluated.
+//
+// With --profile, the cost of each opcode is recorded, which makes script
+// evaluation slower. A table for the whole replay is printed and the cost of
+// every script is written to the file in the folded format of flamegraph tools.
+
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/script/profile.hpp>
+#include <gigamonkey/boost/boost.hpp>
+#include <gigamonkey/p2p/var_int.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        // the first block with the Genesis rules on mainnet.
+        constexpr uint32 GenesisHeight = 620538;
+        
+        using clock = std::chrono::steady_clock;
+        
+        // latencies in nanoseconds, with the number of
+        // items and bytes that were processed.
+        struct stage {
+            std::string Name;
+            std::vector<uint64> Latencies {};
+            uint64 Items {0};
+            uint64 Bytes {0};
+            
+            explicit stage (std::string name) : Name {name} {}
+            
+            // time f, which processes the given number of items and bytes.
+            template <typename F> auto time (uint64 items, uint64 bytes, F f) {
+                auto start = clock::now ();
+                auto x = f ();
+                Latencies.push_back (std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now () - start).count ());
+                Items += items;
+                Bytes += bytes;
+                return x;
+            }
+            
+            uint64 total () const {
+                uint64 t = 0;
+                for (uint64 x : Latencies) t += x;
+                return t;
+            }
+            
+            // Latencies must be sorted.
+            uint64 percentile (double p) const {
+                if (Latencies.empty ()) return 0;
+                return Latencies[std::min (Latencies.size () - 1, size_t (p * Latencies.size ()))];
+            }
+            
+            // the number of latencies in [2^i, 2^(i + 1)) nanoseconds for each i.
+            std::vector<uint64> histogram () const {
+                std::vector<uint64> h;
+                for (uint64 x : Latencies) {
+                    size_t i = x == 0 ? 0 : std::bit_width (x) - 1;
+                    if (h.size () <= i) h.resize (i + 1);
+                    h[i]++;
+                }
+                return h;
+            }
+            
+            JSON to_JSON () const {
+                double seconds = double (total ()) / 1e9;
+                JSON::array_t h;
+                for (uint64 x : histogram ()) h.push_back (x);
+                return JSON {
+                    {"name", Name},
+                    {"samples", Latencies.size ()},
+                    {"items", Items},
+                    {"bytes", Bytes},
+                    {"seconds", seconds},
+                    {"items_per_second", seconds == 0 ? 0. : Items / seconds},
+                    {"bytes_per_second", seconds == 0 ? 0. : Bytes / seconds},
+                    {"p50_ns", percentile (.5)},
+                    {"p90_ns", percentile (.9)},
+                    {"p99_ns", percentile (.99)},
+                    {"max_ns", Latencies.empty () ? 0 : Latencies.back ()},
+                    {"log2_ns_histogram", h}};
+            }
+        };
+        
+        struct prevout_entry {
+            output Output;
+            uint32 Height;
+        };
+        
+        using prevouts = std::unordered_map<outpoint, prevout_entry>;
+        
+        bytes read_file (const std::filesystem::path &p) {
+            std::ifstream f {p, std::ios::binary};
+            if (!f) throw std::runtime_error {"could not open " + p.string ()};
+            bytes b (std::filesystem::file_size (p));
+            f.read ((char *) b.data (), b.size ());
+            if (!f) throw std::runtime_error {"could not read " + p.string ()};
+            return b;
+        }
+        
+        // returns the height of the block.
+        uint32 read_prevouts (const std::filesystem::path &p, prevouts &x) {
+            bytes b = read_file (p);
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            
+            try {
+                uint32_little height;
+                var_int count;
+                r >> height >> count;
+                for (uint64 i = 0; i < count.Value; i++) {
+                    outpoint op;
+                    output o;
+                    uint32_little created;
+                    r >> op >> o >> created;
+                    x[op] = prevout_entry {o, uint32 (created)};
+                }
+                
+                return uint32 (height);
+            } catch (const data::end_of_stream &) {
+                throw std::runtime_error {"invalid prevouts file " + p.string ()};
+            }
+        }
+        
+        struct replay {
+            stage Parse {"block parse"};
+            stage TXIDs {"txids"};
+            stage MerkleRoot {"merkle root"};
+            stage Scripts {"script evaluation"};
+            stage BoostDetection {"Boost output detection"};
+            
+            prevouts Prevouts {};
+            
+            // if set, scripts are profiled and the cost of each is written to Folded.
+            std::ostream *Folded {nullptr};
+            interpreter::profile Profile {};
+            
+            uint64 Blocks {0};
+            uint64 InvalidBlocks {0};
+            uint64 BadMerkleRoots {0};
+            uint64 MissingPrevouts {0};
+            uint64 FailedInputs {0};
+            uint64 BoostOutputs {0};
+            
+            void block (bytes_view b, uint32 height, const std::string &name);
+            JSON to_JSON () const;
+            
+            std::vector<const stage *> stages () const {
+                return {&Parse, &TXIDs, &MerkleRoot, &Scripts, &BoostDetection};
+            }
+        };
+        
+        void replay::block (bytes_view b, uint32 height, const std::string &name) {
+            Blocks++;
+            
+            block_view v = Parse.time (1, b.size (), [b] () {
+                return block_view {b};
+            });
+            
+            if (!v.valid ()) {
+                InvalidBlocks++;
+                return;
+            }
+            
+            std::vector<txid> ids = TXIDs.time (v.size (), b.size () - 80, [&v] () {
+                std::vector<txid> ids;
+                ids.reserve (v.size ());
+                for (const transaction_view &tx : v) ids.push_back (tx.id ());
+                return ids;
+            });
+            
+            digest256 root = MerkleRoot.time (v.size (), 0, [&v] () {
+                return v.merkle_root ();
+            });
+            
+            if (root != v.header ().MerkleRoot) BadMerkleRoots++;
+            
+            for (size_t i = 0; i < v.size (); i++) {
+                const transaction_view &tx = v[i];
+                
+                // the coinbase has nothing to evaluate.
+                if (i != 0) {
+                    incomplete::transaction incomplete = static_cast<incomplete::transaction> (tx);
+                    ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+                    
+                    for (size_t j = 0; j < tx.input_count (); j++) {
+                        input_view in = tx.input (j);
+                        auto p = Prevouts.find (in.reference ());
+                        if (p == Prevouts.end ()) {
+                            MissingPrevouts++;
+                            continue;
+                        }
+                        
+                        const prevout_entry &e = p->second;
+                        uint32 flags = StandardScriptVerifyFlags (height >= GenesisHeight, e.Height >= GenesisHeight);
+                        script unlock {in.script ()};
+                        
+                        interpreter::profile script_profile {};
+                        bool verified = Scripts.time (1, unlock.size () + e.Output.Script.size (), [&] () {
+                            redemption_document doc {e.Output.Value, incomplete, static_cast<uint32> (j), precomputed};
+                            interpreter::machine m {unlock, e.Output.Script, doc, flags};
+                            if (Folded != nullptr) m.measure (script_profile);
+                            return m.run ().verify ();
+                        });
+                        
+                        if (Folded != nullptr) {
+                            std::stringstream script_name;
+                            script_name << name << ";" << ids[i] << ":" << j;
+                            script_profile.write_folded (*Folded, script_name.str ());
+                            Profile += script_profile;
+                        }
+                        
+                        if (!verified) FailedInputs++;
+                        Prevouts.erase (p);
+                    }
+                }
+                
+                BoostOutputs += BoostDetection.time (tx.output_count (), 0, [&tx] () {
+                    uint64 n = 0;
+                    for (size_t k = 0; k < tx.output_count (); k++)
+                        if (Boost::output_script::valid (script {tx.output (k).script ()})) n++;
+                    return n;
+                });
+                
+                for (size_t k = 0; k < tx.output_count (); k++)
+                    Prevouts[outpoint {ids[i], static_cast<uint32> (k)}] = prevout_entry {output (tx.output (k)), height};
+            }
+        }
+        
+        JSON replay::to_JSON () const {
+            JSON::array_t s;
+            for (const stage *x : stages ()) s.push_back (x->to_JSON ());
+            return JSON {
+                {"blocks", Blocks},
+                {"invalid_blocks", InvalidBlocks},
+                {"bad_merkle_roots", BadMerkleRoots},
+                {"missing_prevouts", MissingPrevouts},
+                {"failed_inputs", FailedInputs},
+                {"boost_outputs", BoostOutputs},
+                {"stages", s}};
+        }
+        
+        std::ostream &operator << (std::ostream &o, const stage &s) {
+            double seconds = double (s.total ()) / 1e9;
+            return o << std::left << std::setw (24) << s.Name << std::right
+                << std::setw (12) << s.Items << " items"
+                << std::setw (14) << std::fixed << std::setprecision (0) << (seconds == 0 ? 0. : s.Items / seconds) << " /s"
+                << std::setw (10) << std::setprecision (1) << (seconds == 0 ? 0. : s.Bytes / seconds / 1e6) << " MB/s"
+                << "   p50 " << s.percentile (.5) / 1000. << "us"
+                << " p90 " << s.percentile (.9) / 1000. << "us"
+                << " p99 " << s.percentile (.99) / 1000. << "us"
+                << " max " << (s.Latencies.empty () ? 0 : s.Latencies.back ()) / 1000. << "us";
+        }
+        
+    }
+    
+}
+
+int main (int argc, char **argv) {
+    using namespace Gigamonkey;
+    namespace fs = std::filesystem;
+    
+    if (argc < 2 || argc % 2 != 0) {
+        std::cerr << "usage: " << argv[0] << " <directory> [--json <file>] [--profile <file>]" << std::endl;
+        return 1;
+    }
+    
+    std::string json_file {};
+    std::string profile_file {};
+    for (int i = 2; i < argc; i += 2) {
+        std::string flag {argv[i]};
+        if (flag == "--json") json_file = argv[i + 1];
+        else if (flag == "--profile") profile_file = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+    
+    try {
+        std::vector<fs::path> blocks;
+        for (const fs::directory_entry &e : fs::directory_iterator {argv[1]})
+            if (e.is_regular_file () && e.path ().extension () == ".block") blocks.push_back (e.path ());
+        std::sort (blocks.begin (), blocks.end ());
+        
+        Bitcoin::replay r;
+        
+        std::ofstream folded;
+        if (profile_file != "") {
+            folded.open (profile_file);
+            if (!folded) throw std::runtime_error {"could not open " + profile_file};
+            r.Folded = &folded;
+        }
+        
+        for (const fs::path &p : blocks) {
+            fs::path prevouts = fs::path {p}.replace_extension (".prevouts");
+            uint32 height = fs::exists (prevouts) ? Bitcoin::read_prevouts (prevouts, r.Prevouts) : Bitcoin::GenesisHeight;
+            r.block (Bitcoin::read_file (p), height, p.stem ().string ());
+        }
+        
+        std::vector<Bitcoin::stage *> stages {&r.Parse, &r.TXIDs, &r.MerkleRoot, &r.Scripts, &r.BoostDetection};
+        for (Bitcoin::stage *s : stages) std::sort (s->Latencies.begin (), s->Latencies.end ());
+        
+        std::cout << r.Blocks << " blocks, " << r.InvalidBlocks << " invalid, " << r.BadMerkleRoots << " with bad Merkle roots, "
+            << r.MissingPrevouts << " missing prevouts, " << r.FailedInputs << " failed inputs, "
+            << r.BoostOutputs << " Boost outputs" << std::endl;
+        for (const Bitcoin::stage *s : stages) std::cout << *s << std::endl;
+        
+        if (r.Folded != nullptr) std::cout << "\nscript profile: " << r.Profile << std::endl;
+        
+        if (json_file != "") {
+            JSON j = r.to_JSON ();
+            if (r.Folded != nullptr) j["profile"] = JSON (r.Profile);
+            std::ofstream out {json_file};
+            out << j.dump (4) << std::endl;
+        }
+    } catch (const std::exception &x) {
+        std::cerr << "error: " << x.what () << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
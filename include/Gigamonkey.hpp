@@ -123,6 +123,9 @@
 // fees has to do with determining the correct tx fee. 
 #include <gigamonkey/fees.hpp> 
 
+// choose outputs to spend from a large wallet.
+#include <gigamonkey/coin_selection.hpp>
+
 // MAPI implementation. I think it's an earlier version
 // so it might need to be updated. 
 #include <gigamonkey/mapi/mapi.hpp>
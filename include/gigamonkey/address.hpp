@@ -6,6 +6,8 @@
 
 #include <gigamonkey/signature.hpp>
 
+#include <span>
+
 namespace Gigamonkey::Bitcoin {
     
     struct pubkey;
@@ -66,6 +68,29 @@ namespace Gigamonkey::Bitcoin {
         address (decoded);
     };
     
+    // Many addresses written one after another in one string, as for a column
+    // of a table. Address i is Characters[Offsets[i], Offsets[i + 1]). Checksums
+    // are computed several at a time with sha256::double_hash_short.
+    struct address_column {
+        string Characters;
+        std::vector<uint64> Offsets;
+
+        size_t size () const;
+        string_view operator [] (size_t i) const;
+
+        static address_column encode (const std::vector<address::decoded> &);
+        static address_column encode (address::type, const std::vector<digest160> &);
+
+        // the addresses paid to by pay to address scripts. Other scripts are
+        // written as empty strings so that the rows still line up.
+        static address_column scripts (address::type, const std::vector<bytes_view> &);
+
+        // entries that are not valid addresses with a 20 byte digest are decoded {}.
+        std::vector<address::decoded> decode () const;
+
+        address_column () : Characters {}, Offsets {0} {}
+    };
+    
     // a Bitcoin pubkey is the same as a secp256k1 pubkey except 
     // that we have a standard human representation, which is
     // a hex string. 
@@ -90,6 +115,15 @@ namespace Gigamonkey::Bitcoin {
         }
     };
 
+    // Hash160 of compressed pubkeys stored one after another, 33 bytes each, as in
+    // BIP_32::children. Each is hashed with one block of SHA-256 and one of RIPEMD-160,
+    // several at a time. Throws std::invalid_argument if out does not have one digest
+    // for each pubkey.
+    void Hash160_pubkeys (std::span<const byte> compressed, std::span<digest160> out);
+    
+    // the same for any pubkeys. Those that are not compressed are hashed one at a time.
+    void Hash160_pubkeys (std::span<const pubkey>, std::span<digest160> out);
+    
     std::ostream inline &operator << (std::ostream& o, const address &a) {
         return o << static_cast<string> (a);
     }
@@ -154,6 +188,14 @@ namespace Gigamonkey::Bitcoin {
         return static_cast<string> (encode ());
     }
     
+    size_t inline address_column::size () const {
+        return Offsets.size () - 1;
+    }
+
+    string_view inline address_column::operator [] (size_t i) const {
+        return string_view {Characters}.substr (Offsets[i], Offsets[i + 1] - Offsets[i]);
+    }
+    
     inline pubkey::operator string () const {
         return encoding::hex::write (*this);
     }
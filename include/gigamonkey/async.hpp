@@ -0,0 +1,75 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_ASYNC
+#define GIGAMONKEY_ASYNC
+
+#include <boost/asio.hpp>
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+
+// Glue between coroutines running on an event loop and code that blocks
+// or that gives its results to callbacks on threads of its own.
+namespace Gigamonkey {
+    
+    template <typename X> using awaitable = boost::asio::awaitable<X>;
+    
+    // Call f on an executor, typically of a thread pool, and resume the calling
+    // coroutine on its own executor when f returns. An exception thrown by f is
+    // thrown from co_await.
+    template <typename F> auto run_on (boost::asio::any_io_executor on, F f) -> awaitable<decltype (f ())>;
+    
+    // Run a coroutine on an executor and wait for it. This must not be called
+    // from a thread that runs the executor, or it will wait forever.
+    template <typename X> X wait (boost::asio::any_io_executor on, awaitable<X> a);
+    
+    // Start something that gives its result to one of two callbacks and wait for it
+    // without blocking the thread. The callbacks may be called on any thread; the
+    // coroutine is resumed on its own executor.
+    template <typename X> using start_with_callbacks =
+        std::function<void (std::function<void (const X &)>, std::function<void (std::exception_ptr)>)>;
+    
+    template <typename X> awaitable<X> from_callbacks (start_with_callbacks<X> start);
+    
+    // asio gives a default value along with an exception, which our
+    // types don't always have, so results are passed as optionals.
+    
+    template <typename F> auto run_on (boost::asio::any_io_executor on, F f) -> awaitable<decltype (f ())> {
+        using X = decltype (f ());
+        std::optional<X> x = co_await boost::asio::co_spawn (on,
+            [f = std::move (f)] () -> awaitable<std::optional<X>> {
+                co_return std::optional<X> {f ()};
+            }, boost::asio::use_awaitable);
+        co_return std::move (*x);
+    }
+    
+    template <typename X> X wait (boost::asio::any_io_executor on, awaitable<X> a) {
+        return *boost::asio::co_spawn (on,
+            [a = std::move (a)] () mutable -> awaitable<std::optional<X>> {
+                co_return std::optional<X> {co_await std::move (a)};
+            }, boost::asio::use_future).get ();
+    }
+    
+    template <typename X> awaitable<X> from_callbacks (start_with_callbacks<X> start) {
+        std::optional<X> x = co_await boost::asio::async_initiate<decltype (boost::asio::use_awaitable),
+            void (std::exception_ptr, std::optional<X>)> ([start] (auto handler) {
+                auto h = std::make_shared<decltype (handler)> (std::move (handler));
+                start ([h] (const X &x) {
+                    boost::asio::post (boost::asio::get_associated_executor (*h), [h, x] () {
+                        std::move (*h) (nullptr, std::optional<X> {x});
+                    });
+                }, [h] (std::exception_ptr e) {
+                    boost::asio::post (boost::asio::get_associated_executor (*h), [h, e] () {
+                        std::move (*h) (e, std::optional<X> {});
+                    });
+                });
+            }, boost::asio::use_awaitable);
+        co_return std::move (*x);
+    }
+    
+}
+
+#endif
@@ -0,0 +1,141 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_ASYNC_LEDGER
+#define GIGAMONKEY_ASYNC_LEDGER
+
+#include <gigamonkey/ledger.hpp>
+#include <gigamonkey/async.hpp>
+
+namespace Gigamonkey {
+    
+    // The same as ledger except that every call is a coroutine, so that an
+    // implementation that waits on the network does not hold a thread while
+    // it waits. Arguments given by reference must last until the call is done,
+    // as they do in co_await l.transaction (id).
+    struct async_ledger {
+        using block_header = ledger::block_header;
+        using confirmation = ledger::confirmation;
+        using vertex = ledger::vertex;
+        
+        virtual awaitable<list<block_header>> headers (uint64 since_height) = 0;
+        
+        virtual awaitable<data::entry<bytes, confirmation>> transaction (const Bitcoin::txid &) const = 0;
+        
+        virtual awaitable<block_header> header (const digest256 &) const = 0;
+        
+        virtual awaitable<bytes> block (const digest256 &) const = 0;
+        
+        // As for ledger, the outputs that the outpoints refer to, in the same
+        // order and invalid if they cannot be found. By default, each previous
+        // transaction is fetched once with transaction (txid).
+        virtual awaitable<std::vector<Bitcoin::output>> prevouts (std::vector<Bitcoin::outpoint>) const;
+        
+        awaitable<vertex> make_vertex (Bitcoin::transaction) const;
+        
+        virtual ~async_ledger () {}
+    };
+    
+    struct async_timechain : async_ledger {
+        virtual awaitable<bool> broadcast (bytes) = 0;
+        virtual ~async_timechain () {}
+    };
+    
+    // Calls to a blocking ledger are made on the given executor, which should
+    // belong to a thread pool, so that the event loop is never blocked.
+    struct async_ledger_adapter final : async_ledger {
+        async_ledger_adapter (ledger &l, boost::asio::any_io_executor pool) : Ledger {l}, Pool {pool} {}
+        
+        awaitable<list<block_header>> headers (uint64 since_height) override;
+        awaitable<data::entry<bytes, confirmation>> transaction (const Bitcoin::txid &) const override;
+        awaitable<block_header> header (const digest256 &) const override;
+        awaitable<bytes> block (const digest256 &) const override;
+        awaitable<std::vector<Bitcoin::output>> prevouts (std::vector<Bitcoin::outpoint>) const override;
+    
+    private:
+        ledger &Ledger;
+        boost::asio::any_io_executor Pool;
+    };
+    
+    struct async_timechain_adapter final : async_timechain {
+        async_timechain_adapter (timechain &t, boost::asio::any_io_executor pool) : Timechain {t}, Ledger {t, pool}, Pool {pool} {}
+        
+        awaitable<list<block_header>> headers (uint64 since_height) override {
+            return Ledger.headers (since_height);
+        }
+        
+        awaitable<data::entry<bytes, confirmation>> transaction (const Bitcoin::txid &t) const override {
+            return Ledger.transaction (t);
+        }
+        
+        awaitable<block_header> header (const digest256 &d) const override {
+            return Ledger.header (d);
+        }
+        
+        awaitable<bytes> block (const digest256 &d) const override {
+            return Ledger.block (d);
+        }
+        
+        awaitable<std::vector<Bitcoin::output>> prevouts (std::vector<Bitcoin::outpoint> refs) const override {
+            return Ledger.prevouts (std::move (refs));
+        }
+        
+        awaitable<bool> broadcast (bytes) override;
+    
+    private:
+        timechain &Timechain;
+        async_ledger_adapter Ledger;
+        boost::asio::any_io_executor Pool;
+    };
+    
+    // The other way: a blocking ledger that runs the coroutines of an async_ledger
+    // on an event loop and waits for them. It must not be called from a thread that
+    // runs the loop. prevouts does not wait, since it returns a future.
+    struct blocking_ledger final : ledger {
+        blocking_ledger (async_ledger &l, boost::asio::any_io_executor loop) : Ledger {l}, Loop {loop} {}
+        
+        list<block_header> headers (uint64 since_height) override;
+        data::entry<bytes, confirmation> transaction (const Bitcoin::txid &) const override;
+        block_header header (const digest256 &) const override;
+        bytes block (const digest256 &) const override;
+        std::future<std::vector<Bitcoin::output>> prevouts (std::span<const Bitcoin::outpoint>) const override;
+    
+    private:
+        async_ledger &Ledger;
+        boost::asio::any_io_executor Loop;
+    };
+    
+    struct blocking_timechain final : timechain {
+        blocking_timechain (async_timechain &t, boost::asio::any_io_executor loop) : Timechain {t}, Ledger {t, loop}, Loop {loop} {}
+        
+        list<block_header> headers (uint64 since_height) override {
+            return Ledger.headers (since_height);
+        }
+        
+        data::entry<bytes, confirmation> transaction (const Bitcoin::txid &t) const override {
+            return Ledger.transaction (t);
+        }
+        
+        block_header header (const digest256 &d) const override {
+            return Ledger.header (d);
+        }
+        
+        bytes block (const digest256 &d) const override {
+            return Ledger.block (d);
+        }
+        
+        std::future<std::vector<Bitcoin::output>> prevouts (std::span<const Bitcoin::outpoint> refs) const override {
+            return Ledger.prevouts (refs);
+        }
+        
+        bool broadcast (const bytes_view &) override;
+    
+    private:
+        async_timechain &Timechain;
+        blocking_ledger Ledger;
+        boost::asio::any_io_executor Loop;
+    };
+    
+}
+
+#endif
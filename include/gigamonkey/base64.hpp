@@ -0,0 +1,40 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BASE64
+#define GIGAMONKEY_BASE64
+
+#include <gigamonkey/types.hpp>
+
+// Base64 for the payloads of JSON envelopes, which are big enough that it is
+// worth doing 24 bytes at a time with AVX2 or 48 at a time with NEON when the
+// cpu has them. Output is padded with '='. Input may be padded or not.
+namespace Gigamonkey::base64 {
+    
+    // the number of characters that size bytes are written as.
+    size_t constexpr inline encoded_size (size_t size) {
+        return (size + 2) / 3 * 4;
+    }
+    
+    // the number of bytes that some base64 is read as, or nothing if
+    // there cannot be that many characters.
+    maybe<size_t> decoded_size (string_view);
+    
+    // write encoded_size (size) characters to out.
+    void write (char *out, const byte *in, size_t size);
+    
+    // read into out, which must have room for decoded_size bytes. False if any character
+    // is not base64 or the size is wrong, in which case out may have been partly written.
+    bool read (byte *out, string_view);
+    
+    string write (bytes_view);
+    
+    // nothing if the input is not base64.
+    maybe<bytes> read (string_view);
+    
+    // read into a buffer that belongs to the caller so that its memory can be reused.
+    bool read (string_view, bytes &);
+    
+}
+
+#endif
@@ -0,0 +1,156 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BEEF
+#define GIGAMONKEY_BEEF
+
+#include <gigamonkey/ledger.hpp>
+#include <gigamonkey/merkle/bump.hpp>
+#include <gigamonkey/script/verify.hpp>
+
+namespace Gigamonkey {
+    
+    // Background Evaluation Extended Format (BRC-62). A transaction is sent
+    // with its unconfirmed ancestors and Merkle proofs of the confirmed
+    // transactions that they come from, so that whoever receives it can check
+    // it by SPV without looking anything up in a ledger. Proofs from the same
+    // block are stored as one BUMP and transactions come after their parents.
+    struct BEEF {
+        static constexpr uint32 version = 0xEFBE0001;
+        
+        struct transaction {
+            bytes Transaction;
+            
+            // the index of the BUMP with a proof of this transaction, if it is confirmed.
+            maybe<uint64> BUMP;
+            
+            bool operator == (const transaction &) const = default;
+        };
+        
+        std::vector<Merkle::BUMP> BUMPs;
+        std::vector<transaction> Transactions;
+        
+        BEEF () : BUMPs {}, Transactions {} {}
+        BEEF (std::vector<Merkle::BUMP> b, std::vector<transaction> t) : BUMPs {b}, Transactions {t} {}
+        
+        // Every transaction can be read, every confirmed transaction is a client of
+        // its BUMP, and every input of an unconfirmed one spends an output of a
+        // transaction earlier in the package. Proofs are not checked against headers.
+        bool valid () const;
+        
+        // the transaction that the package is for, which is the last one.
+        Bitcoin::txid id () const;
+        
+        // Package a transaction with its ancestors from the ledger, going back as
+        // far as confirmed transactions. Throws std::invalid_argument if the
+        // transaction cannot be read or an ancestor cannot be found.
+        static BEEF make (const ledger &, bytes_view tx);
+        
+        bool operator == (const BEEF &) const = default;
+        
+        bytes write () const;
+        
+        explicit operator bytes () const {
+            return write ();
+        }
+        
+        // nothing if the bytes are not a valid BEEF.
+        static maybe<BEEF> read (bytes_view);
+    };
+    
+    // Read and check a BEEF as it arrives, so that a bad one is given up on
+    // before all of it has been received. Each BUMP is checked against the
+    // headers as soon as it has been read, and each transaction is checked as
+    // soon as it has been read: a confirmed one must be a client of its BUMP
+    // and an unconfirmed one must only spend outputs of transactions that came
+    // before it. If an executor is given, the scripts of unconfirmed
+    // transactions are run on it too.
+    class BEEF_reader {
+    public:
+        enum class error : byte {
+            none,
+            
+            // the bytes are not a BEEF, or a part is too big.
+            format,
+            
+            // the block of a BUMP is not in the headers or its root is wrong.
+            invalid_proof,
+            
+            // a transaction is not in the BUMP that it says it is in.
+            not_in_proof,
+            
+            // an unconfirmed transaction spends an output that is not in the package.
+            missing_parent,
+            
+            // a script failed.
+            invalid_script
+        };
+        
+        // no BUMP or transaction may be bigger than max_part_size.
+        explicit BEEF_reader (const headers &, executor * = nullptr, uint32 flags = 0, size_t max_part_size = 1 << 30);
+        virtual ~BEEF_reader () {}
+        
+        // called for every transaction once it has been checked. The
+        // view is only good until this returns.
+        virtual void receive (const Bitcoin::transaction_view &, bool confirmed) {}
+        
+        // returns false once the package is found to be bad, after
+        // which everything written is ignored.
+        bool write (bytes_view);
+        
+        // every transaction has been read and checked.
+        bool complete () const {
+            return Stage == stage::complete;
+        }
+        
+        bool failed () const {
+            return Error != error::none;
+        }
+        
+        error why () const {
+            return Error;
+        }
+        
+        uint64 transactions_read () const {
+            return Read;
+        }
+        
+        // the last transaction read, which is the one that the package is for once it is complete.
+        const Bitcoin::txid &last () const {
+            return Last;
+        }
+    
+    private:
+        enum class stage : byte {version, BUMP_count, BUMPs, transaction_count, transactions, complete};
+        
+        const headers &Headers;
+        executor *Executor;
+        uint32 Flags;
+        size_t MaxPartSize;
+        
+        stage Stage;
+        error Error;
+        uint64 Count;
+        uint64 Read;
+        
+        std::vector<Merkle::BUMP> BUMPs;
+        
+        // outputs of every transaction read so far.
+        hash_map<Bitcoin::txid, std::vector<Bitcoin::output>> Outputs;
+        Bitcoin::txid Last;
+        
+        Bitcoin::transaction_scanner Scanner;
+        bytes Buffer;
+        
+        size_t consume (bytes_view);
+        
+        // the size of the part at the front if it is complete and good, or 0.
+        size_t next (bytes_view);
+        size_t next_transaction (bytes_view);
+        
+        size_t fail (error);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BLOCK_ASSEMBLER
+#define GIGAMONKEY_BLOCK_ASSEMBLER
+
+#include <gigamonkey/mempool.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/work/proof.hpp>
+
+#include <vector>
+
+namespace Gigamonkey {
+    
+    // Blocks made from a template as soon as it is solved. The transactions of
+    // the template are kept serialized and are shared by every block that is
+    // made, so that a block is only the header, the number of transactions and
+    // the coinbase in front of them. It can be written as it is, one part after
+    // another, without being copied into one buffer.
+    struct block_assembler {
+        
+        // the transactions after the coinbase.
+        explicit block_assembler (std::vector<Bitcoin::shared_transaction>);
+        explicit block_assembler (const mempool::block_template &t) : block_assembler {t.Transactions} {}
+        
+        struct block {
+            Bitcoin::header Header;
+            
+            // the header and the number of transactions, serialized.
+            bytes Prefix;
+            bytes Coinbase;
+            ptr<const std::vector<Bitcoin::shared_transaction>> Transactions;
+            
+            uint64 size () const;
+            
+            // the parts of the serialized block in order.
+            std::vector<bytes_view> parts () const;
+            
+            // the serialized block, copied in parallel if there is an executor.
+            bytes write (executor * = nullptr) const;
+            
+            explicit operator bytes () const {
+                return write ();
+            }
+            
+            // write to a file or socket with as few calls as possible, without
+            // copying the block. Throws std::runtime_error if it cannot be written.
+            void write_to (int descriptor) const;
+        };
+        
+        block assemble (const Bitcoin::header &, bytes coinbase) const;
+        
+        // the header and the coinbase of a solved puzzle.
+        block assemble (const work::proof &) const;
+        
+        size_t transactions () const {
+            return Transactions->size ();
+        }
+        
+        // the size of a block with the given coinbase.
+        uint64 size (uint64 coinbase_size) const;
+    
+    private:
+        ptr<const std::vector<Bitcoin::shared_transaction>> Transactions;
+        uint64 Size;
+    };
+    
+}
+
+#endif
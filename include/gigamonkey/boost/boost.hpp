@@ -272,6 +272,72 @@ namespace Gigamonkey {
             
         };
         
+        // Where each field of a Boost output script is, found in one pass
+        // over the script without copying it. The script itself is checked
+        // once, when the view is made, and the view is only good for as long
+        // as the script is. Only the encoding that output_script::write
+        // produces is recognized.
+        struct output_view {
+            Boost::type Type;
+            bool UseGeneralPurposeBits;
+            
+            // empty for a bounty script.
+            bytes_view MinerPubkeyHash;
+            bytes_view Category;
+            bytes_view Content;
+            bytes_view Target;
+            bytes_view Tag;
+            bytes_view UserNonce;
+            bytes_view AdditionalData;
+            
+            // Type is invalid if this is not a Boost output script.
+            explicit output_view (bytes_view script);
+            
+            bool valid () const {
+                return Type != Boost::invalid;
+            }
+            
+            int32_little category () const;
+            uint16_little magic_number () const;
+            uint256 content () const;
+            work::compact target () const;
+            uint32_little user_nonce () const;
+            digest160 miner_pubkey_hash () const;
+            
+            explicit operator output_script () const;
+        };
+        
+        // Where each field of a Boost input script is, like output_view.
+        struct input_view {
+            Boost::type Type;
+            
+            bytes_view Signature;
+            bytes_view Pubkey;
+            bytes_view Nonce;
+            bytes_view Timestamp;
+            bytes_view ExtraNonce2;
+            bytes_view ExtraNonce1;
+            
+            // empty if not present.
+            bytes_view GeneralPurposeBits;
+            bytes_view MinerPubkeyHash;
+            
+            explicit input_view (bytes_view script);
+            
+            bool valid () const {
+                return Type != Boost::invalid;
+            }
+            
+            uint32_little nonce () const;
+            Bitcoin::timestamp timestamp () const;
+            Stratum::session_id extra_nonce_1 () const;
+            maybe<int32_little> general_purpose_bits () const;
+            digest160 miner_pubkey_hash () const;
+            work::solution solution () const;
+            
+            explicit operator input_script () const;
+        };
+        
         // construct a work::puzzle from an output_script. 
         // for script type contract, we don't need a miner key. 
         work::puzzle work_puzzle (const output_script &script, const digest160 &key = {});
@@ -473,39 +539,43 @@ namespace Gigamonkey {
         }
         
         Boost::type inline output_script::type (script x) {
-            return read (x).Type;
+            return output_view {x}.Type;
         }
         
         bool inline output_script::valid (script x) {
-            return read (x).valid ();
+            return output_view {x}.valid ();
         }
         
         int32_little inline output_script::version (script x) {
-            return read (x).Type;
+            return output_view {x}.category ();
+        }
+        
+        uint16_little inline output_script::magic_number (script x) {
+            return output_view {x}.magic_number ();
         }
         
         uint256 inline output_script::content (script x) {
-            return read (x).Content;
+            return output_view {x}.content ();
         }
         
         work::compact inline output_script::target (script x) {
-            return read (x).Target;
+            return output_view {x}.target ();
         }
         
         bytes inline output_script::tag (script x) {
-            return read (x).Tag;
+            return bytes (output_view {x}.Tag);
         }
         
         uint32_little inline output_script::user_nonce (script x) {
-            return read (x).UserNonce;
+            return output_view {x}.user_nonce ();
         }
         
         bytes inline output_script::additional_data (script x) {
-            return read (x).AdditionalData;
+            return bytes (output_view {x}.AdditionalData);
         }
         
         digest160 inline output_script::miner_pubkey_hash (script x) {
-            return read (x).MinerPubkeyHash;
+            return output_view {x}.miner_pubkey_hash ();
         }
         
         inline output_script::output_script (
@@ -679,11 +749,11 @@ namespace Gigamonkey {
         inline input_script::input_script (bytes b) : input_script {read (b)} {}
         
         Boost::type inline input_script::type (script x) {
-            return read (x).Type;
+            return input_view {x}.Type;
         }
         
         bool inline input_script::valid (script x) {
-            return read (x).valid ();
+            return input_view {x}.valid ();
         }
         
         Bitcoin::signature inline input_script::signature (script x) {
@@ -695,15 +765,15 @@ namespace Gigamonkey {
         }
         
         Bitcoin::timestamp inline input_script::timestamp (script x) {
-            return read (x).Timestamp;
+            return input_view {x}.timestamp ();
         }
         
         uint32_little inline input_script::nonce (script x) {
-            return read (x).Nonce;
+            return input_view {x}.nonce ();
         }
         
         digest160 inline input_script::miner_pubkey_hash (script x) {
-            return read (x).MinerPubkeyHash;
+            return input_view {x}.miner_pubkey_hash ();
         }
             
         uint64 inline input_script::expected_size (Boost::type t, bool use_general_purpose_bits, bool compressed_pubkey) {
@@ -0,0 +1,88 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BOOST_JOB_INDEX
+#define GIGAMONKEY_BOOST_JOB_INDEX
+
+#include <gigamonkey/boost/boost.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <set>
+#include <shared_mutex>
+
+namespace Gigamonkey::Boost {
+    
+    // The unspent Boost outputs that we know about, grouped into candidates
+    // by script and ranked by profitability, which is satoshis per unit of
+    // difficulty. Outputs are added when they are created and removed when
+    // they are redeemed, and only the candidate that was changed is ranked
+    // again, so the best one is always at the front.
+    struct job_index {
+        
+        // false if the script is not a Boost output script or we already have it.
+        bool add (const Bitcoin::outpoint &, Bitcoin::satoshi value, bytes_view script);
+        bool add (const Bitcoin::prevout &);
+        
+        // an output has been redeemed. false if we did not have it.
+        bool remove (const Bitcoin::outpoint &);
+        
+        maybe<candidate> best () const;
+        
+        // the n most profitable candidates, best first.
+        std::vector<candidate> top (size_t n) const;
+        
+        // wait until there is something and return the best.
+        candidate wait () const;
+        
+        // the number of outputs.
+        size_t size () const;
+        
+        size_t candidates () const;
+    
+    private:
+        struct entry {
+            candidate Candidate;
+            std::map<Bitcoin::outpoint, Bitcoin::satoshi> Outputs;
+            int64 Value;
+            double Difficulty;
+            
+            double profitability () const {
+                return double (Value) / Difficulty;
+            }
+        };
+        
+        using rank = std::pair<double, digest256>;
+        
+        mutable std::shared_mutex Mutex;
+        mutable std::condition_variable_any Added;
+        
+        std::map<digest256, entry> Entries;
+        std::map<Bitcoin::outpoint, digest256> Outputs;
+        
+        // most profitable first.
+        std::set<rank, std::greater<rank>> Ranking;
+    };
+    
+    // Gives miners the most profitable job in an index. Redeeming a solution
+    // is left to a derived type, which can get the Boost puzzle that it was
+    // for from selected.
+    struct job_selector : work::selector {
+        job_selector (const job_index &x, const Bitcoin::secret &miner) : Index {x}, MinerKey {miner}, Mutex {}, Selected {} {}
+        
+        // blocks until the index has something.
+        work::puzzle select () override;
+        
+        Boost::puzzle selected () const;
+    
+    private:
+        const job_index &Index;
+        Bitcoin::secret MinerKey;
+        
+        mutable std::mutex Mutex;
+        Boost::puzzle Selected;
+    };
+    
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BOOST_VALIDATE
+#define GIGAMONKEY_BOOST_VALIDATE
+
+#include <gigamonkey/boost/boost.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/signature.hpp>
+
+namespace Gigamonkey::Boost {
+    
+    // an input script that redeems a Boost output script.
+    struct redemption {
+        bytes_view OutputScript;
+        bytes_view InputScript;
+        
+        // if provided, the signature is checked against it.
+        const Bitcoin::sighash::document *Document;
+        
+        redemption (bytes_view out, bytes_view in, const Bitcoin::sighash::document *doc = nullptr) :
+            OutputScript {out}, InputScript {in}, Document {doc} {}
+    };
+    
+    struct validation {
+        // whether the scripts are Boost scripts that go together.
+        bool Decoded;
+        
+        // whether the proof of work is good.
+        bool Work;
+        
+        // nothing if there was no document to check against.
+        maybe<bool> Signature;
+        
+        bool valid () const {
+            return Decoded && Work && (!bool (Signature) || *Signature);
+        }
+    };
+    
+    // Validate many redemptions at once. Scripts are read with output_view and
+    // input_view, all the work strings are hashed together with sha256::double_hash_80,
+    // and signatures are checked on the executor if one is given. The result for
+    // each redemption is in the same place as the redemption.
+    std::vector<validation> validate (const std::vector<redemption> &);
+    std::vector<validation> validate (const std::vector<redemption> &, executor &);
+    
+}
+
+#endif
@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_BUILDER
+#define GIGAMONKEY_BUILDER
+
+#include <gigamonkey/fees.hpp>
+
+#include <vector>
+
+namespace Gigamonkey {
+    
+    // Writes a transaction_design straight into one buffer of the size that
+    // expected_size gives, without going through incomplete::transaction or
+    // transaction. Each input script has a slot of ExpectedScriptSize bytes
+    // that is filled in when the script is known, as after signing with signer.
+    //
+    // The txid is hashed as the bytes become final. Everything before the first
+    // empty slot is final, so filling the slots in order hashes every byte once.
+    struct transaction_builder {
+        explicit transaction_builder (const transaction_design &);
+        
+        size_t inputs () const {
+            return Slots.size ();
+        }
+        
+        // Write the script of an input. If it is not the size that was expected,
+        // everything after it is moved. A slot that has been filled already may be
+        // filled again. Throws std::out_of_range if there is no such input.
+        void set (size_t input, bytes_view script);
+        
+        // whether every input has its script.
+        bool complete () const {
+            return FirstEmpty == Slots.size ();
+        }
+        
+        // empty slots are zeros.
+        bytes_view serialized () const {
+            return Bytes;
+        }
+        
+        // throws std::logic_error if the transaction is not complete.
+        Bitcoin::txid id () const;
+        
+        explicit operator bytes () const {
+            return Bytes;
+        }
+    
+    private:
+        bytes Bytes;
+        
+        struct slot {
+            // where the size of the script begins.
+            size_t Offset;
+            uint64 Size;
+            bool Filled;
+        };
+        
+        std::vector<slot> Slots;
+        size_t FirstEmpty;
+        
+        // the first SHA-256 of the txid up to Hashed.
+        sha256::hasher Hasher;
+        size_t Hashed;
+        
+        void hash ();
+    };
+    
+}
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_COIN_SELECTION
+#define GIGAMONKEY_COIN_SELECTION
+
+#include <gigamonkey/fees.hpp>
+
+#include <vector>
+
+namespace Gigamonkey {
+    
+    // Chooses which of many outputs to spend in order to pay for a given set
+    // of outputs at a given fee rate. Branch and bound looks first for a set
+    // of inputs that covers the payments and the fee closely enough that a
+    // change output would cost more than it is worth. Failing that, the
+    // smallest single candidate that can pay with change is used, and failing
+    // that, the largest candidates are taken until there is enough.
+    struct coin_selector {
+        using candidate = transaction_design::input;
+        
+        struct options {
+            // change is only made if it would be at least this much.
+            Bitcoin::satoshi Dust {1};
+            
+            // the size of the input that will spend the change output later,
+            // which is counted as part of the cost of making change.
+            uint64 ChangeInputSize {148};
+            
+            // branch and bound gives up after this many steps.
+            uint64 MaxTries {100000};
+            
+            int32_little Version {1};
+            uint32_little Locktime {0};
+            
+            options () {};
+        };
+        
+        explicit coin_selector (std::vector<candidate>, const options & = options {});
+        
+        // nothing if the candidates together are not worth enough. If change_script is
+        // empty, no change is made and anything left over goes to the fee.
+        maybe<transaction_design> select (list<Bitcoin::output> payments, satoshi_per_byte, const bytes &change_script = {}) const;
+        
+        const std::vector<candidate> &candidates () const {
+            return Candidates;
+        }
+    
+    private:
+        std::vector<candidate> Candidates;
+        options Options;
+    };
+    
+}
+
+#endif
@@ -4,28 +4,53 @@
 #ifndef GIGAMONKEY_COINBASE
 #define GIGAMONKEY_COINBASE
 
-#include <gigamonkey/timechain.hpp>
+#include <gigamonkey/view.hpp>
 
 namespace Gigamonkey::Bitcoin {
     transaction coinbase(script, list<output>);
-    
+
+    // the input script of the first transaction of a serialized block, which
+    // is read in place without reading the rest of the block. Nothing if
+    // the block is too short or the first transaction has no inputs.
+    maybe<bytes_view> coinbase_script(bytes_view block);
+
+    // BIP 34 says that the input script of the coinbase of a block of
+    // version 2 or more begins with the height of the block, pushed as
+    // a script number in the same way that a script would push it.
     namespace BIP34 {
-        
-        N read(reader&);
-        writer &write(writer& w, N height);
-        
-        N inline read(const bytes& b) {
-            return read(reader{b.begin(), b.end()});
+
+        // the height at the beginning of a coinbase script. Nothing if
+        // the script does not begin with a push of a positive number.
+        maybe<uint64> read(bytes_view script);
+
+        // the push of the height that a coinbase script begins with.
+        bytes write(uint64 height);
+
+        // the height from the coinbase as given by block_reader::receive_transaction.
+        maybe<uint64> inline read(const transaction_view &coinbase) {
+            if (coinbase.input_count() == 0) return {};
+            return read(coinbase.input(0).script());
+        }
+
+        // the height of a serialized block, which takes time proportional to the size of the coinbase.
+        maybe<uint64> inline height(bytes_view block) {
+            maybe<bytes_view> script = coinbase_script(block);
+            if (!script) return {};
+            return read(*script);
         }
-        
-        bool valid(const block& b, N height) {
-            return b.version() == 1 || 
-                (b.version() == 1 && height = read(b.coinbase().Inputs.first().Script));
+
+        // blocks of version 1 came before BIP 34 and are always valid.
+        bool valid(bytes_view block, uint64 height);
+
+        bool inline valid(const block &b, uint64 height) {
+            if (b.Header.Version < 2) return true;
+            if (b.Transactions.size() == 0 || b.Transactions.first().Inputs.size() == 0) return false;
+            maybe<uint64> h = read(b.Transactions.first().Inputs.first().Script);
+            return bool(h) && *h == height;
         }
-        
+
     }
-    
+
 }
 
 #endif
-
@@ -0,0 +1,94 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_COINBASE_BUILDER
+#define GIGAMONKEY_COINBASE_BUILDER
+
+#include <gigamonkey/timechain.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <vector>
+
+namespace Gigamonkey {
+
+    // A coinbase for a pool that pays its miners in the coinbase, kept
+    // serialized as the two halves that Stratum puts around the extra nonces.
+    // The input script is prefix | extra nonces | suffix, so the first half
+    // ends with the prefix and the second begins with the suffix and holds
+    // every output. The place of each amount in the second half is known, so
+    // new amounts are written over the old ones in place and nothing else is
+    // serialized again. The same goes for a new prefix of the same size, such
+    // as the height of the next block.
+    //
+    // The first half is also kept hashed up to its last full block of 64
+    // bytes, which is where every hash of the coinbase for every miner
+    // begins. It is only hashed again when the first half changes.
+    struct coinbase_builder {
+
+        // extra_nonce_size is the size of extra nonce 1 and extra nonce 2 together.
+        // Throws std::invalid_argument if an output is not valid.
+        coinbase_builder (bytes script_prefix, bytes script_suffix, size_t extra_nonce_size, const std::vector<Bitcoin::output> &);
+
+        // the first half of the coinbase, up to the extra nonces; coinbase1 in Stratum.
+        const bytes &header () const {
+            return Header;
+        }
+
+        // the second half of the coinbase, after the extra nonces; coinbase2 in Stratum.
+        const bytes &body () const {
+            return Body;
+        }
+
+        // the whole coinbase with the given extra nonces.
+        bytes coinbase (bytes_view extra_nonces) const;
+
+        size_t outputs () const {
+            return Offsets.size ();
+        }
+
+        Bitcoin::satoshi value (size_t index) const;
+
+        // change the amount of one output. Throws std::out_of_range if there is no such output.
+        void set_value (size_t index, Bitcoin::satoshi);
+
+        // change every amount, writing only the ones that are different. Returns the number that
+        // were changed. Throws std::invalid_argument if the number of amounts is wrong.
+        size_t set_values (const std::vector<Bitcoin::satoshi> &);
+
+        // a new input script prefix. If it is the same size as the old one it is written in place
+        // and the midstate is only worked out again if the prefix reaches into it. Otherwise the
+        // first half is made again.
+        void set_script_prefix (bytes_view);
+
+        // a new set of outputs, which serializes the second half again.
+        void set_outputs (const std::vector<Bitcoin::output> &);
+
+        // the SHA-256 state after the first midstate_size () bytes of the header.
+        const sha256::state &midstate () const {
+            return Midstate;
+        }
+
+        // the number of bytes of the header that the midstate covers, a multiple of 64.
+        size_t midstate_size () const {
+            return Header.size () - Header.size () % 64;
+        }
+
+    private:
+        bytes ScriptPrefix;
+        bytes ScriptSuffix;
+        size_t ExtraNonceSize;
+
+        bytes Header;
+        bytes Body;
+
+        // where the amount of each output is in Body.
+        std::vector<size_t> Offsets;
+
+        sha256::state Midstate;
+
+        void write_header ();
+    };
+
+}
+
+#endif
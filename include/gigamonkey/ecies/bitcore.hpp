@@ -6,15 +6,58 @@
 
 #include <gigamonkey/hash.hpp>
 #include <gigamonkey/secp256k1.hpp>
+#include <gigamonkey/ecies/cbc_hmac.hpp>
 #include <data/encoding/base58.hpp>
 
+// Bitcore's ECIES, which begins with an ephemeral public key followed by
+// the iv and the cipher text of AES-256. The x coordinate of the shared
+// point gives the AES key and the key for the mac, which covers the iv and
+// the cipher text. Bitcore derives the iv from the message by default, which
+// can't be done when the message is written in pieces, so we choose it at
+// random. Bitcore reads the result either way.
 namespace Gigamonkey::ECIES::bitcore {
     
     bytes encrypt(const bytes message, const secp256k1::pubkey& to);
         
+    // throws std::invalid_argument if the message can't be decrypted.
     bytes decrypt(const bytes message, const secp256k1::secret& to);
     
+    struct encryptor : writer {
+        // a random ephemeral key and iv are generated.
+        encryptor(writer &out, const secp256k1::pubkey &to);
+        encryptor(writer &out, const secp256k1::pubkey &to, const secp256k1::secret &ephemeral, bytes_view iv);
+        
+        void write(const byte *, size_t) override;
+        
+        // nothing can be written after this.
+        void finish();
+        
+    private:
+        ptr<cbc_hmac_encryptor> Cipher;
+        
+        encryptor(writer &out, const secp256k1::pubkey &to, const std::pair<secp256k1::secret, bytes> &);
+    };
+    
+    // Plain text is written as soon as it is decrypted, before the mac can
+    // be checked, so what was written must be thrown away if finish is false.
+    struct decryptor : writer {
+        decryptor(writer &out, const secp256k1::secret &to);
+        
+        void write(const byte *, size_t) override;
+        
+        // whether the message was valid.
+        bool finish();
+        
+    private:
+        writer &Out;
+        secp256k1::secret To;
+        
+        // the ephemeral key and the iv.
+        bytes Header;
+        ptr<cbc_hmac_decryptor> Cipher;
+        bool Invalid;
+    };
+    
 }
 
 #endif
-
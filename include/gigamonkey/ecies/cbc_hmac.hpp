@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_ECIES_CBC_HMAC
+#define GIGAMONKEY_ECIES_CBC_HMAC
+
+#include <gigamonkey/hash.hpp>
+
+#include "cryptopp/aes.h"
+#include "cryptopp/modes.h"
+#include "cryptopp/hmac.h"
+#include "cryptopp/sha.h"
+
+// Both kinds of ECIES that we support encrypt with AES in CBC mode with
+// PKCS #7 padding and then authenticate the result with HMAC-SHA256. These
+// do that on data that is given in pieces, so that a message never has
+// to be in memory all at once.
+namespace Gigamonkey::ECIES {
+    
+    struct cbc_hmac_encryptor {
+        // key is 16 or 32 bytes for AES-128 or AES-256 and iv is 16 bytes.
+        cbc_hmac_encryptor(writer &out, bytes_view key, bytes_view iv, bytes_view mac_key);
+        
+        // data that is written and authenticated but not encrypted.
+        void authenticated(bytes_view);
+        
+        void write(bytes_view);
+        
+        // write the last block and the mac.
+        void finish();
+    
+    private:
+        writer &Out;
+        CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption Cipher;
+        CryptoPP::HMAC<CryptoPP::SHA256> MAC;
+        byte Buffer[16];
+        size_t Buffered;
+        bool Finished;
+        
+        void emit(const byte *, size_t);
+    };
+    
+    // Plain text is written as soon as it has been decrypted, which is before
+    // the mac can be checked, so everything that was written must be thrown
+    // away if finish returns false.
+    struct cbc_hmac_decryptor {
+        cbc_hmac_decryptor(writer &out, bytes_view key, bytes_view iv, bytes_view mac_key);
+        
+        // data that was authenticated but not encrypted, which is not written.
+        void authenticated(bytes_view);
+        
+        // cipher text followed by the mac.
+        void write(bytes_view);
+        
+        // whether the cipher text and the mac were valid.
+        bool finish();
+    
+    private:
+        writer &Out;
+        CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption Cipher;
+        CryptoPP::HMAC<CryptoPP::SHA256> MAC;
+        
+        // the last block and the mac can't be told apart from
+        // the rest until the end, so at least 48 bytes are kept.
+        std::vector<byte> Tail;
+        bool Finished;
+    };
+    
+}
+
+#endif
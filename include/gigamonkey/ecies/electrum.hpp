@@ -6,15 +6,112 @@
 
 #include <gigamonkey/hash.hpp>
 #include <gigamonkey/secp256k1.hpp>
+#include <gigamonkey/ecies/cbc_hmac.hpp>
 #include <data/encoding/base58.hpp>
 
+#include <array>
+#include <vector>
+
+// Electrum's ECIES, which begins with the magic bytes BIE1 followed by an
+// ephemeral public key. The key derived from the shared point gives the iv
+// and key for AES-128 and the key for the mac, which covers everything.
 namespace Gigamonkey::ECIES::electrum {
     
     bytes encrypt(const bytes message, const secp256k1::pubkey& to);
         
+    // throws std::invalid_argument if the message can't be decrypted.
     bytes decrypt(const bytes message, const secp256k1::secret& to);
     
+    // Encrypts a message that is written in pieces and writes the result
+    // as it goes. Key derivation is done once in the constructor.
+    struct encryptor : writer {
+        // a random ephemeral key is generated.
+        encryptor(writer &out, const secp256k1::pubkey &to);
+        encryptor(writer &out, const secp256k1::pubkey &to, const secp256k1::secret &ephemeral);
+        
+        void write(const byte *, size_t) override;
+        
+        // nothing can be written after this.
+        void finish();
+        
+    private:
+        ptr<cbc_hmac_encryptor> Cipher;
+    };
+    
+    // Plain text is written as soon as it is decrypted, before the mac can
+    // be checked, so what was written must be thrown away if finish is false.
+    struct decryptor : writer {
+        decryptor(writer &out, const secp256k1::secret &to);
+        
+        void write(const byte *, size_t) override;
+        
+        // whether the message was valid.
+        bool finish();
+        
+    private:
+        writer &Out;
+        secp256k1::secret To;
+        
+        // the magic bytes and the ephemeral key.
+        bytes Header;
+        ptr<cbc_hmac_decryptor> Cipher;
+        bool Invalid;
+    };
+    
+    // An envelope is a message that is encrypted once for many recipients. It
+    // begins with the magic bytes BIEM, one ephemeral public key and the number
+    // of recipients. For each recipient there follows a random content key,
+    // encrypted with the key derived from the shared point as above. Then comes
+    // the message, encrypted with the content key. The mac of the message covers
+    // everything before it as well. A recipient needs only one multiplication to
+    // find its content key, however many recipients there are. There is no
+    // envelope in Bitcore's format, and neither Electrum nor Bitcore can read
+    // these, so every recipient must use this library.
+    bytes encrypt(const bytes message, const std::vector<secp256k1::pubkey> &to);
+    
+    // throws std::invalid_argument if the envelope can't be decrypted with this key.
+    bytes decrypt_envelope(const bytes message, const secp256k1::secret &to);
+    
+    struct envelope_encryptor : writer {
+        // there can be at most max_recipients.
+        static constexpr uint32 max_recipients = 1 << 16;
+        
+        envelope_encryptor(writer &out, const std::vector<secp256k1::pubkey> &to);
+        envelope_encryptor(writer &out, const std::vector<secp256k1::pubkey> &to, const secp256k1::secret &ephemeral);
+        
+        void write(const byte *, size_t) override;
+        
+        void finish();
+        
+    private:
+        ptr<cbc_hmac_encryptor> Cipher;
+    };
+    
+    struct envelope_decryptor : writer {
+        envelope_decryptor(writer &out, const secp256k1::secret &to);
+        
+        void write(const byte *, size_t) override;
+        
+        // whether the envelope was valid and had a content key for us.
+        bool finish();
+        
+    private:
+        writer &Out;
+        secp256k1::secret To;
+        
+        // everything before the message.
+        bytes Header;
+        size_t HeaderSize;
+        
+        // the key derived from the shared point.
+        std::array<byte, 64> Key;
+        
+        ptr<cbc_hmac_decryptor> Cipher;
+        bool Invalid;
+        
+        void read_header();
+    };
+    
 }
 
 #endif
-
@@ -0,0 +1,100 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_EXECUTOR
+#define GIGAMONKEY_EXECUTOR
+
+#include <gigamonkey/types.hpp>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+
+namespace Gigamonkey {
+    
+    // A pool of threads that run tasks. Each thread has its own queue
+    // and takes work from the others when its own queue is empty.
+    //
+    // Everything in the library that works in parallel can be given an
+    // executor, so that a process that uses several of them can run them
+    // all on the same threads rather than each on threads of its own.
+    struct executor {
+        using task = std::function<void ()>;
+        
+        struct options {
+            // 0 means one thread per core that we are allowed to run on.
+            uint32 Threads {0};
+            
+            // the cores to run on. If empty, every core that we are allowed to run on.
+            std::vector<uint32> Cores {};
+            
+            // whether to keep each thread on one core. Threads are spread over the
+            // cores one NUMA node at a time, and a thread with nothing to do takes
+            // work from threads on its own node before it tries the others.
+            // Nothing is pinned where this is not supported.
+            bool Pin {false};
+            
+            options () {};
+        };
+        
+        // 0 means one thread per core that we are allowed to run on.
+        explicit executor (uint32 threads = 0);
+        explicit executor (const options &);
+        
+        // an executor with default options for everything in the process to share,
+        // which is made the first time it is asked for.
+        static executor &shared ();
+        
+        // waits for tasks that have already been submitted.
+        ~executor ();
+        
+        executor (const executor &) = delete;
+        executor &operator = (const executor &) = delete;
+        
+        uint32 threads () const {
+            return static_cast<uint32> (Workers.size ());
+        }
+        
+        // a task submitted from one of our own threads goes to that thread's queue.
+        void submit (task);
+        
+        // call f on every number in [0, n) and block until they have all returned.
+        // The calling thread works too, so it is safe to call from one of our own
+        // threads. If any call throws, the first exception is rethrown here.
+        void parallel_for (size_t n, std::function<void (size_t)> f);
+        
+        // like parallel_for but f is called on ranges [begin, end) of at most
+        // grain numbers, for loops whose every step is too small to be a task.
+        // 0 means a few ranges per thread.
+        void bulk (size_t n, size_t grain, std::function<void (size_t begin, size_t end)> f);
+    
+    private:
+        struct queue {
+            std::mutex Mutex;
+            std::deque<task> Tasks;
+        };
+        
+        std::vector<queue> Queues;
+        std::vector<std::thread> Workers;
+        
+        // for each thread, the queues that it takes work from when its own is empty, in order.
+        std::vector<std::vector<size_t>> Victims;
+        
+        // used to sleep when there is nothing to do.
+        std::mutex Mutex;
+        std::condition_variable Wake;
+        std::atomic<size_t> Pending;
+        std::atomic<size_t> Next;
+        bool Stop;
+        
+        bool take (size_t index, task &);
+        void work (size_t index);
+    };
+    
+}
+
+#endif
@@ -87,27 +87,46 @@ namespace Gigamonkey {
         list<Bitcoin::output> Outputs;
         uint32_little Locktime; 
         
+        // The sizes and values of the inputs and outputs are added up once here and
+        // kept up to date by add and set_output. Change Inputs and Outputs through
+        // them, or call recount after changing them some other way.
+        transaction_design(int32_little v, list<input> i, list<Bitcoin::output> o, uint32_little l) :
+            Version{v}, Inputs{i}, Outputs{o}, Locktime{l} {
+            recount();
+        }
+        
+        transaction_design() : transaction_design{1, {}, {}, 0} {}
+        
+        transaction_design &add(const input &in) {
+            Inputs = Inputs << in;
+            Totals.add(in);
+            return *this;
+        }
+        
+        transaction_design &add(const Bitcoin::output &out) {
+            Outputs = Outputs << out;
+            Totals.add(out);
+            return *this;
+        }
+        
+        // replace an output, as when the amount of change is adjusted. The
+        // totals are updated without going through the other outputs.
+        transaction_design &set_output(uint32 index, const Bitcoin::output &out);
+        
+        void recount();
+        
         // compare this to a satoshi_per_byte value to see if the fee is good enough. 
         uint64 expected_size() const {
-            return 8u + Bitcoin::var_int::size(Inputs.size()) + Bitcoin::var_int::size(Inputs.size()) + 
-                data::fold([](uint64 size, const input &i) -> uint64 {
-                    return size + i.serialized_size();
-                }, 0u, Inputs) + 
-                data::fold([](uint64 size, const Bitcoin::output &o) -> uint64 {
-                    return size + o.serialized_size();
-                }, 0u, Outputs);
+            return 8u + Bitcoin::var_int::size(Totals.InputCount) + Bitcoin::var_int::size(Totals.OutputCount) + 
+                Totals.InputsSize + Totals.OutputsSize;
         }
         
         Bitcoin::satoshi spent() const {
-            return data::fold([](Bitcoin::satoshi x, const input &in) -> Bitcoin::satoshi {
-                return in.Prevout.value() + x;
-            }, Bitcoin::satoshi{0}, Inputs);
+            return Totals.Spent;
         }
         
         Bitcoin::satoshi sent() const {
-            return data::fold([](Bitcoin::satoshi x, const Bitcoin::output &out) -> Bitcoin::satoshi {
-                return out.Value + x;
-            }, Bitcoin::satoshi{0}, Outputs);
+            return Totals.Sent;
         }
         
         Bitcoin::satoshi fee() const {
@@ -128,9 +147,11 @@ namespace Gigamonkey {
         // construct the signature documents for each input. 
         list<Bitcoin::sighash::document> documents() const {
             Bitcoin::incomplete::transaction incomplete(*this);
+            // the parts of the signature hash that are the same for every input.
+            ptr<const Bitcoin::sighash::precomputed> precomputed = std::make_shared<const Bitcoin::sighash::precomputed>(incomplete);
             uint32 index = 0;
-            return data::for_each([&incomplete, &index](const input &in) -> Bitcoin::sighash::document {
-                return Bitcoin::sighash::document{in.Prevout.value(), in.script_code(), incomplete, index++};
+            return data::for_each([&incomplete, &precomputed, &index](const input &in) -> Bitcoin::sighash::document {
+                return Bitcoin::sighash::document{in.Prevout.value(), in.script_code(), incomplete, index++, precomputed};
             }, Inputs);
         }
         
@@ -145,8 +166,56 @@ namespace Gigamonkey {
                     Inputs)};
         }
         
+    private:
+        struct totals {
+            uint64 InputCount{0};
+            uint64 OutputCount{0};
+            uint64 InputsSize{0};
+            uint64 OutputsSize{0};
+            Bitcoin::satoshi Spent{0};
+            Bitcoin::satoshi Sent{0};
+            
+            void add(const input &in) {
+                InputCount++;
+                InputsSize += in.serialized_size();
+                Spent = Spent + in.Prevout.value();
+            }
+            
+            void add(const Bitcoin::output &out) {
+                OutputCount++;
+                OutputsSize += out.serialized_size();
+                Sent = Sent + out.Value;
+            }
+        };
+        
+        totals Totals;
+        
     };
     
+    void inline transaction_design::recount() {
+        Totals = totals{};
+        for (const input &in : Inputs) Totals.add(in);
+        for (const Bitcoin::output &out : Outputs) Totals.add(out);
+    }
+    
+    transaction_design inline &transaction_design::set_output(uint32 index, const Bitcoin::output &out) {
+        if (index >= Totals.OutputCount) throw std::out_of_range{"no such output"};
+        
+        list<Bitcoin::output> replaced;
+        uint32 i = 0;
+        for (const Bitcoin::output &o : Outputs) {
+            if (i++ != index) replaced = replaced << o;
+            else {
+                Totals.OutputsSize = Totals.OutputsSize - o.serialized_size() + out.serialized_size();
+                Totals.Sent = Totals.Sent - o.Value + out.Value;
+                replaced = replaced << out;
+            }
+        }
+        
+        Outputs = replaced;
+        return *this;
+    }
+    
 }
 
 #endif 
@@ -0,0 +1,130 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_FLAT
+#define GIGAMONKEY_FLAT
+
+#include <gigamonkey/view.hpp>
+
+#include <vector>
+
+// transactions and blocks with their parts in vectors rather than in lists.
+// list is persistent, so it is cheap to copy and to add to, but going to
+// the i-th element takes time O(i). Use these types for anything that goes
+// through the inputs or outputs of a big transaction by position. They
+// convert to and from the list types and are serialized the same way.
+namespace Gigamonkey::Bitcoin {
+    
+    template <typename X> std::vector<X> to_vector (const list<X> &);
+    template <typename X> list<X> to_list (const std::vector<X> &);
+    
+    struct flat_transaction {
+        int32_little Version;
+        std::vector<Bitcoin::input> Inputs;
+        std::vector<Bitcoin::output> Outputs;
+        uint32_little Locktime;
+        
+        flat_transaction (int32_little v, std::vector<Bitcoin::input> i, std::vector<Bitcoin::output> o, uint32_little t = 0) :
+            Version {v}, Inputs {std::move (i)}, Outputs {std::move (o)}, Locktime {t} {}
+        
+        flat_transaction () : Version {}, Inputs {}, Outputs {}, Locktime {} {}
+        
+        explicit flat_transaction (const transaction &t) :
+            Version {t.Version}, Inputs {to_vector (t.Inputs)}, Outputs {to_vector (t.Outputs)}, Locktime {t.Locktime} {}
+        
+        explicit flat_transaction (const transaction_view &);
+        
+        // an invalid transaction if b cannot be read, including
+        // if a length in it is more than could be allocated.
+        explicit flat_transaction (bytes_view b);
+        
+        explicit operator transaction () const {
+            return transaction {Version, to_list (Inputs), to_list (Outputs), Locktime};
+        }
+        
+        explicit operator incomplete::transaction () const;
+        
+        explicit operator bytes () const;
+        
+        bool valid () const;
+        
+        txid id () const;
+        
+        uint64 serialized_size () const;
+        
+        satoshi sent () const;
+    };
+    
+    bool operator == (const flat_transaction &, const flat_transaction &);
+    
+    writer &operator << (writer &w, const flat_transaction &);
+    reader &operator >> (reader &r, flat_transaction &);
+    
+    struct flat_block {
+        Bitcoin::header Header;
+        std::vector<flat_transaction> Transactions;
+        
+        flat_block () : Header {}, Transactions {} {}
+        flat_block (const Bitcoin::header &h, std::vector<flat_transaction> t) : Header {h}, Transactions {std::move (t)} {}
+        
+        explicit flat_block (const block &);
+        
+        // an invalid block if b cannot be read.
+        explicit flat_block (bytes_view b);
+        
+        explicit operator block () const;
+        
+        explicit operator bytes () const;
+        
+        bool valid () const;
+        
+        uint64 serialized_size () const;
+        
+        digest256 merkle_root () const;
+    };
+    
+    bool operator == (const flat_block &, const flat_block &);
+    
+    writer &operator << (writer &w, const flat_block &);
+    reader &operator >> (reader &r, flat_block &);
+    
+    template <typename X> std::vector<X> to_vector (const list<X> &l) {
+        std::vector<X> v;
+        v.reserve (l.size ());
+        for (const X &x : l) v.push_back (x);
+        return v;
+    }
+    
+    template <typename X> list<X> to_list (const std::vector<X> &v) {
+        list<X> l;
+        for (const X &x : v) l <<= x;
+        return l;
+    }
+    
+    bool inline operator == (const flat_transaction &a, const flat_transaction &b) {
+        return a.Version == b.Version && a.Inputs == b.Inputs && a.Outputs == b.Outputs && a.Locktime == b.Locktime;
+    }
+    
+    bool inline operator == (const flat_block &a, const flat_block &b) {
+        return a.Header == b.Header && a.Transactions == b.Transactions;
+    }
+    
+    writer inline &operator << (writer &w, const flat_transaction &t) {
+        return w << t.Version << var_vector<input> {t.Inputs} << var_vector<output> {t.Outputs} << t.Locktime;
+    }
+    
+    reader inline &operator >> (reader &r, flat_transaction &t) {
+        return r >> t.Version >> var_vector<input> {t.Inputs} >> var_vector<output> {t.Outputs} >> t.Locktime;
+    }
+    
+    writer inline &operator << (writer &w, const flat_block &b) {
+        return w << b.Header << var_vector<flat_transaction> {b.Transactions};
+    }
+    
+    reader inline &operator >> (reader &r, flat_block &b) {
+        return r >> b.Header >> var_vector<flat_transaction> {b.Transactions};
+    }
+    
+}
+
+#endif
@@ -269,6 +269,7 @@ namespace Gigamonkey {
 #include "cryptopp/ripemd.h"
 #include "cryptopp/sha.h"
 #include "cryptopp/sha3.h"
+#include <gigamonkey/sha256.hpp>
 
 namespace Gigamonkey {
     
@@ -284,7 +285,8 @@ namespace Gigamonkey {
     
     using SHA2_224_writer = CryptoPP::hash_writer<CryptoPP::SHA224, 28>;
     
-    using SHA2_256_writer = bitcoind::hash_writer<CSHA256>;
+    // uses the fastest SHA-256 that this cpu supports, which is chosen at runtime.
+    using SHA2_256_writer = bitcoind::hash_writer<sha256::hasher>;
     
     using SHA2_384_writer = CryptoPP::hash_writer<CryptoPP::SHA384, 48>;
     
@@ -447,4 +449,14 @@ namespace Gigamonkey {
 
 }
 
+// digests are already random, so we just take the first few bytes.
+template <size_t size> struct std::hash<Gigamonkey::digest<size>> {
+    size_t operator () (const Gigamonkey::digest<size> &d) const {
+        static_assert (size >= sizeof (size_t));
+        size_t x;
+        std::copy (d.begin (), d.begin () + sizeof (size_t), reinterpret_cast<Gigamonkey::byte *> (&x));
+        return x;
+    }
+};
+
 #endif
@@ -0,0 +1,31 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_HEX
+#define GIGAMONKEY_HEX
+
+#include <gigamonkey/types.hpp>
+
+// Hex for digests and raw transactions, which are big enough that it is
+// worth doing 16 or 32 bytes at a time with SSSE3 or AVX2 when the cpu has
+// them. Output is lower case and input may be in either case.
+namespace Gigamonkey::hex {
+    
+    // write 2 * size characters to out.
+    void write (char *out, const byte *in, size_t size);
+    
+    // read 2 * size characters into size bytes. False if any character is
+    // not a hex digit, in which case out may have been partly written.
+    bool read (byte *out, const char *in, size_t size);
+    
+    string write (bytes_view);
+    
+    // nothing if the number of characters is odd or if any is not a hex digit.
+    maybe<bytes> read (string_view);
+    
+    // read into a buffer that belongs to the caller so that its memory can be reused.
+    bool read (string_view, bytes &);
+    
+}
+
+#endif
@@ -6,6 +6,10 @@
 
 #include "spv.hpp"
 #include <gigamonkey/script/script.hpp>
+#include <gigamonkey/view.hpp>
+
+#include <future>
+#include <stdexcept>
 
 namespace Gigamonkey::Bitcoin {
         
@@ -84,15 +88,16 @@ namespace Gigamonkey {
             data::map<Bitcoin::outpoint, Bitcoin::output> Previous;
             
             Bitcoin::satoshi spent () const {
-                return data::fold([] (Bitcoin::satoshi x, const edge &p) -> Bitcoin::satoshi {
-                    return x + p.spent ();
-                }, Bitcoin::satoshi {0}, incoming_edges ());
+                Bitcoin::satoshi x {0};
+                for (const Bitcoin::input &in : this->Inputs) x = x + Previous[in.Reference].Value;
+                return x;
             }
             
             Bitcoin::satoshi fee () const {
                 return spent () - sent ();
             }
             
+            // the size is measured each time, since the transaction can be changed.
             double fee_rate () const {
                 return double (fee ()) / double (this->serialized_size ());
             }
@@ -101,33 +106,58 @@ namespace Gigamonkey {
             
             list<edge> incoming_edges () const {
                 list<edge> p;
-                list<Bitcoin::input> inputs = this->Inputs;
-                for (const Bitcoin::input& in : inputs) p = p << edge {Previous[in.Reference], in};
+                for (const Bitcoin::input &in : this->Inputs) p = p << edge {Previous[in.Reference], in};
                 return p;
             }
             
+            // the incoming edges in the order of the inputs, made from the
+            // inputs as they are now. Use this to go through them by index.
+            std::vector<edge> edges () const {
+                std::vector<edge> e;
+                e.reserve (this->Inputs.size ());
+                for (const Bitcoin::input &in : this->Inputs) e.push_back (edge {Previous[in.Reference], in});
+                return e;
+            }
+            
             vertex (const Bitcoin::transaction &d, data::map<Bitcoin::outpoint, Bitcoin::output> p) :
                 Bitcoin::transaction {d}, Previous {p} {}
+            vertex (const Bitcoin::transaction_view &d, data::map<Bitcoin::outpoint, Bitcoin::output> p) :
+                Bitcoin::transaction {d.serialized ()}, Previous {p} {}
             vertex () : Bitcoin::transaction {}, Previous {} {}
             
-            edge operator [] (index i) {
-                struct Bitcoin::input in = this->Inputs [i];
-                
-                return {Previous[in.Reference], in};
+            // takes time O(i), since the inputs are a list. Throws std::out_of_range if i is too big.
+            edge operator [] (index i) const {
+                uint32 n = uint32 (i);
+                for (const Bitcoin::input &in : this->Inputs) if (n-- == 0) return edge {Previous[in.Reference], in};
+                throw std::out_of_range {"vertex has no input at that index"};
             }
         };
         
+        // look up the outputs that many outpoints refer to, in the same order.
+        // An output that cannot be found is left invalid. Override this for a
+        // ledger that can fetch them all in one request. By default, each
+        // previous transaction is fetched once with transaction (txid) and the
+        // future is ready when this returns.
+        virtual std::future<std::vector<Bitcoin::output>> prevouts (std::span<const Bitcoin::outpoint>) const;
+        
+        vertex make_vertex (const Bitcoin::transaction_view &d) {
+            std::vector<Bitcoin::outpoint> refs;
+            refs.reserve (d.input_count ());
+            for (size_t i = 0; i < d.input_count (); i++) refs.push_back (d.input (i).reference ());
+            return {d, previous (refs)};
+        }
+        
         vertex make_vertex (const Bitcoin::transaction& d) {
-            list<Bitcoin::input> in = d.Inputs;
-            data::map<Bitcoin::outpoint, Bitcoin::output> p;
-            for (const Bitcoin::input& i : in) p = 
-                p.insert (i.Reference,
-                    Bitcoin::output {Bitcoin::transaction::output (transaction (i.Reference.Digest).Key, i.Reference.Index)});
-            return {d, p};
+            std::vector<Bitcoin::outpoint> refs;
+            for (const Bitcoin::input& i : d.Inputs) refs.push_back (i.Reference);
+            return {d, previous (refs)};
         }
         
         virtual ~ledger () {}
         
+    private:
+        data::map<Bitcoin::outpoint, Bitcoin::output> previous (std::span<const Bitcoin::outpoint>) const;
+        
     };
     
     struct timechain : ledger {
@@ -136,6 +166,42 @@ namespace Gigamonkey {
         virtual ~timechain () {}
     };
     
+    // Check many confirmations at once against a headers store. Each header is
+    // looked up once, proofs with the same root are checked together so that a
+    // node that they share is only computed once, and proofs that have been
+    // verified recently are remembered. Not thread safe.
+    struct confirmation_verifier {
+        explicit confirmation_verifier (const headers &h, size_t max_cached = 1 << 16) :
+            Headers {h}, MaxCached {max_cached}, Cache {} {}
+        
+        // a confirmation is valid if its header is in the store
+        // and its proof is valid with the header's merkle root.
+        std::vector<bool> verify (std::span<const ledger::confirmation>);
+        
+        bool verify (const ledger::confirmation &c) {
+            return verify (std::span<const ledger::confirmation> {&c, 1})[0];
+        }
+        
+        size_t cached () const {
+            return Cache.size ();
+        }
+        
+    private:
+        const headers &Headers;
+        size_t MaxCached;
+        
+        // a txid and a merkle root.
+        using key = std::pair<digest256, digest256>;
+        
+        struct hasher {
+            size_t operator () (const key &k) const {
+                return std::hash<digest256> {} (k.first) ^ std::hash<digest256> {} (k.second);
+            }
+        };
+        
+        hash_set<key, hasher> Cache;
+    };
+    
     bool inline ledger::confirmation::operator == (const confirmation &t) const {
         // if the types are valid then checking this proves that they are equal. 
         return Header == t.Header && Proof.index () == t.Proof.index ();
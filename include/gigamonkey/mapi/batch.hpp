@@ -0,0 +1,105 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_BATCH
+#define GIGAMONKEY_MAPI_BATCH
+
+#include <gigamonkey/mapi/pool.hpp>
+#include <gigamonkey/mapi/journal.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <chrono>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // Collects transactions that are submitted one at a time and sends them
+    // with submit_transactions. A batch goes out when it has MaxBatch
+    // transactions or when the oldest of them has waited MaxWaitMilliseconds.
+    // The status of each transaction in the response goes to its own future.
+    // A transaction that fails without a double spend, and one that is missing
+    // from the response, is put into a later batch up to Retries more times.
+    // If the whole request fails, every transaction in it is tried again in
+    // the same way, and the last error goes to the future.
+    //
+    // If a journal is given, every transaction is appended to it when it is
+    // submitted and the journal is committed before each batch is sent, so
+    // there is one sync for each batch. A transaction is acknowledged once a
+    // miner has answered for it. Whatever is pending in the journal when the
+    // batcher starts is submitted again.
+    //
+    // A transaction is traced with a mapi.submit span in the span that
+    // submitted it, which ends when it has a response, and a mapi.batch_wait
+    // span for each time that it waits for a batch. The call for a batch is
+    // made in the span of the first transaction in it that is sampled.
+    struct MAPI_batcher {
+        
+        struct options {
+            size_t MaxBatch {100};
+            uint32 MaxWaitMilliseconds {200};
+            uint32 Retries {2};
+            
+            options () {};
+        };
+        
+        // the pool must outlive the batcher.
+        explicit MAPI_batcher (MAPI_pool &, const options & = options {});
+        
+        // the journal must outlive the batcher too.
+        MAPI_batcher (MAPI_pool &, MAPI_journal &, const options & = options {});
+        
+        // sends everything that is waiting, along with any retries, before returning.
+        ~MAPI_batcher ();
+        
+        MAPI_batcher (const MAPI_batcher &) = delete;
+        MAPI_batcher &operator = (const MAPI_batcher &) = delete;
+        
+        std::future<MAPI::submit_transaction_response> submit (const MAPI::transaction_submission &);
+        
+        // send what is waiting now without waiting for a batch to fill up.
+        void flush ();
+    
+    private:
+        using clock = std::chrono::steady_clock;
+        
+        struct entry {
+            MAPI::transaction_submission Submission;
+            Bitcoin::txid TXID;
+            uint32 Tries;
+            
+            // the number of the entry in the journal.
+            uint64 Entry;
+            clock::time_point Time;
+            ptr<std::promise<MAPI::submit_transaction_response>> Promise;
+            
+            trace::async_span Span;
+            
+            // when the entry began to wait, for the trace.
+            uint64 Queued;
+        };
+        
+        MAPI_pool &Pool;
+        MAPI_journal *Journal;
+        options Options;
+        
+        std::mutex Mutex;
+        std::condition_variable Wake;
+        std::deque<entry> Waiting;
+        
+        // batches that have been sent and not answered.
+        uint32 InFlight;
+        bool Flush;
+        bool Stop;
+        std::thread Thread;
+        
+        void run ();
+        void send (std::vector<entry> &&);
+        void receive (std::vector<entry> &, const MAPI::submit_transactions_response &);
+        void fail (std::vector<entry> &, std::exception_ptr);
+        
+        // retries go back in the queue and the batch is no longer in flight.
+        void done (std::vector<entry> &&retry);
+    };
+    
+}
+
+#endif
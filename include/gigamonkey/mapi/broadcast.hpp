@@ -0,0 +1,121 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_BROADCAST
+#define GIGAMONKEY_MAPI_BROADCAST
+
+#include <gigamonkey/mapi/pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // Broadcasts a transaction to several miners, stopping at the first that
+    // accepts it. The transaction goes first to the miner that we expect to
+    // accept it soonest. If it has not answered by the time that it has answered
+    // HedgePercentile of its recent requests, or if it rejects the transaction
+    // or fails, the transaction goes to the next miner as well, and so on.
+    // Once one miner accepts, requests that have not been sent yet are dropped.
+    // Requests already on the network can't be taken back, but their responses
+    // are used to keep the statistics up to date.
+    struct MAPI_broadcaster {
+        
+        struct options {
+            double HedgePercentile {.9};
+            
+            // how long to wait on a miner that has not answered anything yet.
+            uint32 DefaultHedgeMilliseconds {1000};
+            
+            // how many recent latencies to keep for each miner.
+            size_t LatencySamples {100};
+            
+            options () {};
+        };
+        
+        explicit MAPI_broadcaster (const options & = options {});
+        
+        // waits for requests that are out.
+        ~MAPI_broadcaster ();
+        
+        MAPI_broadcaster (const MAPI_broadcaster &) = delete;
+        MAPI_broadcaster &operator = (const MAPI_broadcaster &) = delete;
+        
+        // a miner to broadcast to. The pool must outlive us.
+        void add (const string &miner, MAPI_pool &);
+        
+        struct result {
+            string Miner;
+            MAPI::submit_transaction_response Response;
+        };
+        
+        // the first response that accepts the transaction. If none do, the
+        // last rejection, or the last error if every request failed.
+        std::future<result> broadcast (const MAPI::submit_transaction_request &);
+        
+        struct statistics {
+            uint64 Requests;
+            uint64 Accepted;
+            uint64 Rejected;
+            
+            // requests that threw.
+            uint64 Errors;
+            
+            // at HedgePercentile.
+            std::chrono::milliseconds Latency;
+        };
+        
+        statistics stats (const string &miner) const;
+        
+        // the order in which miners would be tried now.
+        std::vector<string> order () const;
+    
+    private:
+        using clock = std::chrono::steady_clock;
+        
+        struct miner {
+            string Name;
+            MAPI_pool *Pool;
+            
+            uint64 Requests;
+            uint64 Accepted;
+            uint64 Rejected;
+            uint64 Errors;
+            
+            // milliseconds, oldest first.
+            std::deque<double> Latencies;
+            
+            double latency (const options &) const;
+            
+            // how long we expect to wait for an answer that is not an error.
+            double score (const options &) const;
+        };
+        
+        struct attempt;
+        
+        options Options;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Wake;
+        std::vector<ptr<miner>> Miners;
+        
+        // when to go on to the next miner, and which miner we will have sent to by then.
+        std::multimap<clock::time_point, std::pair<ptr<attempt>, size_t>> Timers;
+        
+        uint32 InFlight;
+        bool Stop;
+        std::thread Thread;
+        
+        // Mutex must be held for all of these.
+        std::vector<ptr<miner>> sorted () const;
+        void send (ptr<attempt>);
+        void next (ptr<attempt>);
+        void fail (ptr<attempt>, ptr<miner>, std::exception_ptr);
+        
+        void run ();
+    };
+    
+}
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_CALLBACK
+#define GIGAMONKEY_MAPI_CALLBACK
+
+#include <gigamonkey/mapi/envelope.hpp>
+#include <gigamonkey/merkle/serialize.hpp>
+
+#include <atomic>
+#include <memory>
+
+// https://github.com/bitcoin-sv-specs/brfc-merchantapi#callback-notifications
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // what a miner sends to the CallbackURL of submit_transaction_parameters.
+    struct MAPI_callback {
+        enum callback_reason {
+            invalid,
+            merkle_proof,
+            double_spend,
+            double_spend_attempt
+        };
+        
+        callback_reason Reason;
+        string APIVersion;
+        string Timestamp;
+        string MinerID;
+        Bitcoin::txid TXID;
+        digest256 BlockHash;
+        uint64 BlockHeight;
+        
+        // for merkle_proof.
+        proofs_serialization_standard Proof;
+        
+        // for double_spend and double_spend_attempt.
+        Bitcoin::txid DoubleSpendTXID;
+        bytes DoubleSpendTransaction;
+        
+        MAPI_callback () : Reason {invalid}, APIVersion {}, Timestamp {}, MinerID {}, TXID {}, BlockHash {},
+            BlockHeight {0}, Proof {}, DoubleSpendTXID {}, DoubleSpendTransaction {} {}
+        
+        bool valid () const {
+            return Reason != invalid;
+        }
+        
+        // read the payload of an envelope. Invalid if it is not a callback.
+        static MAPI_callback read (const JSON_envelope &);
+    };
+    
+    // Takes the bodies of callback requests from an HTTP server, checks
+    // them, and puts the callbacks in a queue for another thread to take.
+    // Any number of threads may receive and pop at once without locking.
+    struct MAPI_callback_receiver {
+        
+        struct options {
+            // rounded up to a power of two.
+            size_t QueueSize {1 << 16};
+            
+            // if false, callbacks without signatures are accepted.
+            bool RequireSignature {true};
+            
+            options () {};
+        };
+        
+        explicit MAPI_callback_receiver (const options & = options {});
+        
+        MAPI_callback_receiver (const MAPI_callback_receiver &) = delete;
+        MAPI_callback_receiver &operator = (const MAPI_callback_receiver &) = delete;
+        
+        // false if the body is not a valid callback or if the queue is full.
+        bool receive (string_view body);
+        
+        // receive many bodies at once using the threads of e. Signatures are
+        // checked with JSON_envelope's batch verify.
+        std::vector<bool> receive (std::span<const string_view> bodies, executor &e);
+        
+        // false if there is nothing in the queue.
+        bool pop (MAPI_callback &);
+        
+        // callbacks that were valid but were dropped because the queue was full.
+        uint64 dropped () const {
+            return Dropped.load (std::memory_order_relaxed);
+        }
+        
+        // read an envelope without making a JSON object. Anything that can't be
+        // read this way is given to the JSON parser, so the result is the same
+        // as JSON_envelope {JSON::parse (body)}. Nothing if it is not valid.
+        static maybe<JSON_envelope> read_envelope (string_view body);
+    
+    private:
+        options Options;
+        
+        struct cell {
+            std::atomic<size_t> Sequence;
+            MAPI_callback Callback;
+        };
+        
+        std::unique_ptr<cell[]> Cells;
+        size_t Mask;
+        
+        alignas (64) std::atomic<size_t> Head;
+        alignas (64) std::atomic<size_t> Tail;
+        std::atomic<uint64> Dropped;
+        
+        bool accept (const JSON_envelope &) const;
+        bool push (MAPI_callback &&);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,138 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_CHAIN
+#define GIGAMONKEY_MAPI_CHAIN
+
+#include <gigamonkey/mapi/batch.hpp>
+#include <gigamonkey/fees.hpp>
+#include <gigamonkey/wif.hpp>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // A chain of payments. Each spends the change of the one before it, before that
+    // one has been mined. Payments go through three stages, each on a thread of its own:
+    //
+    //   1. The transaction is designed, signed and written with transaction_builder.
+    //      This is one stage because each transaction spends its parent's txid.
+    //   2. It is submitted without waiting for the answer.
+    //   3. The answers are awaited in order.
+    //
+    // If a transaction is rejected, the chain goes back to the change that it spent.
+    // Every payment made on top of it is rolled back. The payments that come after
+    // are made from there.
+    struct payment_chain {
+        using submit = std::function<std::future<MAPI::submit_transaction_response> (const MAPI::transaction_submission &)>;
+        
+        struct options {
+            satoshi_per_byte FeeRate {Bitcoin::satoshi {50}, 1000};
+            
+            // a payment that would leave less change than this is not made.
+            Bitcoin::satoshi MinChange {1};
+            
+            Bitcoin::sighash::directive Directive {Bitcoin::directive (Bitcoin::sighash::all)};
+            
+            MAPI::submit_transaction_parameters Parameters {};
+            
+            options () {};
+        };
+        
+        struct payment {
+            Bitcoin::txid TXID;
+            bytes Transaction;
+            MAPI::submit_transaction_response Response;
+        };
+        
+        // given to a payment that was made on top of a payment that was rejected.
+        struct rolled_back : std::exception {
+            const char *what () const noexcept override {
+                return "an earlier payment in the chain was rejected";
+            }
+        };
+        
+        // given to a payment that would leave less than MinChange.
+        struct insufficient_funds : std::exception {
+            const char *what () const noexcept override {
+                return "not enough left in the chain to make payment";
+            }
+        };
+        
+        // change is spent by the first payment. It must pay to the address of key,
+        // as all the change after it will. The batcher must outlive the chain.
+        payment_chain (MAPI_batcher &, const Bitcoin::prevout &change, const Bitcoin::secret &key, const options & = options {});
+        payment_chain (submit, const Bitcoin::prevout &change, const Bitcoin::secret &key, const options & = options {});
+        
+        // waits for every payment to be answered.
+        ~payment_chain ();
+        
+        payment_chain (const payment_chain &) = delete;
+        payment_chain &operator = (const payment_chain &) = delete;
+        
+        // Does not wait. The future is ready when the transaction has been answered.
+        // A rejection is given as a response. If the submission throws, that is
+        // treated as a rejection and the exception is given to the future.
+        std::future<payment> pay (list<Bitcoin::output>);
+        
+        // the change output that the next payment will spend.
+        Bitcoin::prevout tip () const;
+        
+        // payments that have been made and not answered.
+        size_t pending () const;
+    
+    private:
+        struct request {
+            list<Bitcoin::output> Outputs;
+            ptr<std::promise<payment>> Promise;
+        };
+        
+        struct made {
+            payment Payment;
+            
+            // the change that this payment spent, to which the chain goes back if it is rejected.
+            Bitcoin::prevout Spent;
+            Bitcoin::prevout Change;
+            ptr<std::promise<payment>> Promise;
+            std::future<MAPI::submit_transaction_response> Response;
+        };
+        
+        submit Submit;
+        options Options;
+        
+        Bitcoin::secret Key;
+        Bitcoin::pubkey Pubkey;
+        secp256k1::signing_key Signer;
+        bytes ChangeScript;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Wake;
+        Bitcoin::prevout Tip;
+        
+        // goes up every time that the chain is rolled back.
+        uint64 Generation;
+        
+        std::deque<request> Requests;
+        std::deque<made> Built;
+        std::deque<made> Sent;
+        
+        // the number of stages that have finished.
+        uint32 Finished;
+        bool Stop;
+        
+        std::thread Building;
+        std::thread Sending;
+        std::thread Watching;
+        
+        void build ();
+        void send ();
+        void watch ();
+        
+        // throws insufficient_funds.
+        made make (const Bitcoin::prevout &, const list<Bitcoin::output> &) const;
+        
+        // with the lock held.
+        void roll_back (const Bitcoin::prevout &to);
+    };
+    
+}
+
+#endif
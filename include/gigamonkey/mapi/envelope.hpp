@@ -5,9 +5,13 @@
 #define GIGAMONKEY_MAPI_JSONENVELOPE
 
 #include <gigamonkey/secp256k1.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/base64.hpp>
 #include <data/encoding/base64.hpp>
 #include <data/encoding/unicode.hpp>
 
+#include <span>
+
 // https://github.com/bitcoin-sv-specs/brfc-misc/tree/master/jsonenvelope
 
 namespace Gigamonkey::BitcoinAssociation {
@@ -47,6 +51,11 @@ namespace Gigamonkey::BitcoinAssociation {
         static bool valid (const JSON &);
         static bool verify (const JSON &);
         
+        // verify many envelopes on the threads of e, with a result for each.
+        // Payloads are decoded and hashed and signatures are checked in
+        // parallel, all with the same verification context.
+        static std::vector<bool> verify (std::span<const JSON_envelope>, executor &e);
+        
         JSON_envelope () : Payload {}, Encoding {none}, Mimetype {}, PublicKey {}, Signature {} {}
     };
     
@@ -82,13 +91,13 @@ namespace Gigamonkey::BitcoinAssociation {
     }
     
     inline JSON_envelope::JSON_envelope (const bytes &pl, const string &mime) :
-        Payload {encoding::base64::write (pl)}, Encoding {base64}, Mimetype {mime}, PublicKey {}, Signature {} {}
+        Payload {Gigamonkey::base64::write (pl)}, Encoding {base64}, Mimetype {mime}, PublicKey {}, Signature {} {}
     
     inline JSON_envelope::JSON_envelope (const string &pl, const string &mime) :
         Payload {pl}, Encoding {UTF_8}, Mimetype {mime}, PublicKey {}, Signature {} {}
     
     inline JSON_envelope::JSON_envelope (const bytes &pl, const string &mime, secp256k1::secret &secret) :
-        Payload {encoding::base64::write (pl)}, Encoding {base64}, Mimetype {mime},
+        Payload {Gigamonkey::base64::write (pl)}, Encoding {base64}, Mimetype {mime},
         PublicKey {secret.to_public ()}, Signature {secret.sign (Gigamonkey::SHA2_256 (pl))} {}
     
     inline JSON_envelope::JSON_envelope (const string &pl, const string &mime, secp256k1::secret &secret) :
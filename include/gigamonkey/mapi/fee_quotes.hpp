@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_FEE_QUOTES
+#define GIGAMONKEY_MAPI_FEE_QUOTES
+
+#include <gigamonkey/mapi/pool.hpp>
+
+#include <chrono>
+#include <map>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // Fee quotes from many miners that may be shared between threads. A quote
+    // is kept until it expires and is fetched again in the background a little
+    // before then, so that looking up a fee does not usually wait on the network.
+    // Requests for a miner that we are already waiting on share one response.
+    struct fee_quotes {
+        using clock = std::chrono::system_clock;
+        
+        struct options {
+            // how long before a quote expires to fetch a new one.
+            uint32 RefreshSeconds {30};
+            
+            // how long to keep a quote whose expiry time we can't read.
+            uint32 DefaultLifetimeSeconds {600};
+            
+            options () {};
+        };
+        
+        explicit fee_quotes (const options & = options {});
+        
+        // waits for requests that are out.
+        ~fee_quotes ();
+        
+        fee_quotes (const fee_quotes &) = delete;
+        fee_quotes &operator = (const fee_quotes &) = delete;
+        
+        // a miner to get quotes from. The pool must outlive us.
+        void add (const string &miner, MAPI_pool &);
+        
+        // the quote we have from a miner if it has not expired, and a new one otherwise.
+        std::shared_future<MAPI::get_fee_quote_response> quote (const string &miner);
+        
+        struct best {
+            string Miner;
+            satoshi_per_byte Rate;
+        };
+        
+        // the lowest rate for the given fee type and service among the quotes that
+        // have not expired. This never waits, so nothing is returned until we have
+        // heard from at least one miner.
+        maybe<best> select (const string &fee_type = "standard", MAPI::service = MAPI::mine) const;
+        
+        // the fee at the best rate for a transaction of the given size, or for a design.
+        maybe<Bitcoin::satoshi> fee (uint64 size, const string &fee_type = "standard", MAPI::service = MAPI::mine) const;
+        maybe<Bitcoin::satoshi> fee (const transaction_design &, const string &fee_type = "standard", MAPI::service = MAPI::mine) const;
+        
+        // when a quote from a MAPI response expires.
+        static maybe<clock::time_point> expiry (const MAPI::get_fee_quote_response &);
+    
+    private:
+        options Options;
+        
+        struct miner {
+            MAPI_pool *Pool;
+            maybe<MAPI::get_fee_quote_response> Quote;
+            clock::time_point Expires;
+            
+            // when to ask again after a request failed.
+            clock::time_point Retry;
+            
+            // whether a request is out, and its response if so.
+            bool Requesting;
+            std::shared_future<MAPI::get_fee_quote_response> Pending;
+        };
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Wake;
+        std::map<string, miner> Miners;
+        uint32 InFlight;
+        bool Stop;
+        std::thread Thread;
+        
+        // start a request for a miner. Mutex must be held.
+        std::shared_future<MAPI::get_fee_quote_response> request (const string &name, miner &);
+        
+        void run ();
+    };
+    
+    maybe<Bitcoin::satoshi> inline fee_quotes::fee (uint64 size, const string &fee_type, MAPI::service z) const {
+        maybe<best> b = select (fee_type, z);
+        if (!b) return {};
+        return calculate_fee (b->Rate, size);
+    }
+    
+    maybe<Bitcoin::satoshi> inline fee_quotes::fee (const transaction_design &d, const string &fee_type, MAPI::service z) const {
+        return fee (d.expected_size (), fee_type, z);
+    }
+    
+}
+
+#endif
@@ -0,0 +1,91 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_JOURNAL
+#define GIGAMONKEY_MAPI_JOURNAL
+
+#include <gigamonkey/mapi/mapi.hpp>
+
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // Transactions that are waiting to be submitted, in a memory-mapped file,
+    // so that they are not lost if we stop before a miner has answered. Each
+    // entry is appended to the file with a checksum, and so is each
+    // acknowledgement of an entry. When we start up, the file is read up to
+    // the first record that is not whole, and every entry that has not been
+    // acknowledged is pending again.
+    //
+    // Appending only writes to memory. Nothing is on the disk until commit is
+    // called, and threads that commit at the same time share one sync.
+    //
+    // The file is made with room for a given number of bytes and never grows.
+    // When it is full, it is written again without acknowledged entries.
+    struct MAPI_journal {
+        
+        // open the journal at path or make a new one with room for capacity bytes.
+        // throws std::invalid_argument if the file is not a journal and std::runtime_error
+        // if it cannot be opened or mapped.
+        MAPI_journal (const std::filesystem::path &, uint64 capacity);
+        ~MAPI_journal ();
+        
+        MAPI_journal (const MAPI_journal &) = delete;
+        MAPI_journal &operator = (const MAPI_journal &) = delete;
+        
+        // Returns the number of the entry. throws std::length_error if there
+        // is no room for it even without acknowledged entries.
+        uint64 append (const MAPI::transaction_submission &);
+        
+        // The entry will not be pending again. It does no harm if an
+        // acknowledgement is lost, since a transaction can be submitted twice.
+        void acknowledge (uint64);
+        
+        // wait until everything that has been appended is on the disk.
+        void commit ();
+        
+        // entries that have not been acknowledged, in the order in which they were appended.
+        std::vector<std::pair<uint64, MAPI::transaction_submission>> pending () const;
+        
+        // write the file again without acknowledged entries.
+        void compact ();
+        
+        // bytes that have been used.
+        uint64 size () const;
+        
+        uint64 capacity () const {
+            return Capacity;
+        }
+    
+    private:
+        std::filesystem::path Path;
+        uint64 Capacity;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Synced;
+        
+        int Descriptor;
+        byte *Map;
+        
+        // the end of the records and the part of them that is on the disk.
+        uint64 End;
+        uint64 Durable;
+        bool Syncing;
+        
+        // where the record of every entry that has not been acknowledged is.
+        std::map<uint64, uint64> Entries;
+        uint64 Next;
+        
+        // call with the lock held. Returns false if there is no room.
+        bool write (byte type, uint64 number, const bytes &body);
+        void compact (std::unique_lock<std::mutex> &);
+        
+        void close ();
+    };
+    
+}
+
+#endif
@@ -35,6 +35,12 @@ namespace Gigamonkey::BitcoinAssociation {
         struct submit_transactions_response;
         submit_transactions_response submit_transactions (const submit_transactions_request &);
         
+        // the same, except that each transaction status is given to f as soon as it has
+        // been read, which is before the signature of the response has been checked.
+        struct transaction_status;
+        submit_transactions_response submit_transactions (const submit_transactions_request &,
+            const std::function<void (const transaction_status &)> &f);
+        
         enum service {
             mine, 
             relay
@@ -315,6 +321,15 @@ namespace Gigamonkey::BitcoinAssociation {
             submit_transactions_response (const JSON&);
             operator JSON () const;
             
+            // Read a response from the body of an HTTP response in one pass,
+            // without making JSON documents of the envelope or the payload.
+            // Each transaction status is given to f as soon as it has been read,
+            // so f may see statuses from a response that turns out to have a bad
+            // signature. Nothing is returned if the envelope cannot be read or
+            // its signature is wrong.
+            static maybe<submit_transactions_response> read (string_view body,
+                const std::function<void (const transaction_status &)> &f = {});
+            
         };
         
     private:
@@ -330,6 +345,9 @@ namespace Gigamonkey::BitcoinAssociation {
         net::HTTP::request submit_transaction_HTTP_request (const submit_transaction_request &) const;
         net::HTTP::request submit_transactions_HTTP_request (const submit_transactions_request &) const;
         
+        // throws if the status or the content type is wrong.
+        net::HTTP::response fetch (const net::HTTP::request &r);
+        
         JSON call (const net::HTTP::request &r);
     };
     
@@ -350,7 +368,7 @@ namespace Gigamonkey::BitcoinAssociation {
     }
     
     MAPI::submit_transactions_response inline MAPI::submit_transactions (const submit_transactions_request &r) {
-        return call (submit_transactions_HTTP_request (r));
+        return submit_transactions (r, {});
     }
     
     bool inline MAPI::fee::valid () const {
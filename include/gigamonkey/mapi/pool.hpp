@@ -0,0 +1,227 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_POOL
+#define GIGAMONKEY_MAPI_POOL
+
+#include <gigamonkey/mapi/mapi.hpp>
+#include <gigamonkey/async.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // A MAPI client that may be shared between threads and that never makes
+    // the caller wait on the network. Requests are queued and handled by a
+    // fixed number of connections, each kept open by a thread of its own, and
+    // every call returns a future for its response. A connection that throws
+    // is dropped and a new one is made for the next request.
+    struct MAPI_pool {
+        using connect = std::function<ptr<MAPI> ()>;
+        
+        MAPI_pool (connect, uint32 connections);
+        
+        // waits for requests that have already been made.
+        ~MAPI_pool ();
+        
+        MAPI_pool (const MAPI_pool &) = delete;
+        MAPI_pool &operator = (const MAPI_pool &) = delete;
+        
+        std::future<MAPI::get_policy_quote_response> get_policy_quote ();
+        std::future<MAPI::get_fee_quote_response> get_fee_quote ();
+        std::future<MAPI::transaction_status_response> get_transaction_status (const Bitcoin::txid &);
+        std::future<MAPI::submit_transaction_response> submit_transaction (const MAPI::submit_transaction_request &);
+        std::future<MAPI::submit_transactions_response> submit_transactions (const MAPI::submit_transactions_request &);
+        
+        // the same except that the response or the error is given to a callback on
+        // the thread of the connection that handled it. Callbacks must not throw.
+        void get_fee_quote (
+            std::function<void (const MAPI::get_fee_quote_response &)>,
+            std::function<void (std::exception_ptr)>);
+        
+        void submit_transactions (const MAPI::submit_transactions_request &,
+            std::function<void (const MAPI::submit_transactions_response &)>,
+            std::function<void (std::exception_ptr)>);
+        
+        void get_transaction_status (const Bitcoin::txid &,
+            std::function<void (const MAPI::transaction_status_response &)>,
+            std::function<void (std::exception_ptr)>);
+        
+        // given to the fail callback of a request that was cancelled before it was sent.
+        struct cancelled : std::exception {
+            const char *what () const noexcept override {
+                return "MAPI request was cancelled";
+            }
+        };
+        
+        // if cancel returns true when a connection takes the request, it is not sent.
+        void submit_transaction (const MAPI::submit_transaction_request &,
+            std::function<void (const MAPI::submit_transaction_response &)>,
+            std::function<void (std::exception_ptr)>,
+            std::function<bool ()> cancel = {});
+        
+        // for coroutines, which are resumed on their own executors, so that
+        // many can wait for responses on one event loop.
+        awaitable<MAPI::get_fee_quote_response> async_get_fee_quote ();
+        awaitable<MAPI::submit_transaction_response> async_submit_transaction (const MAPI::submit_transaction_request &);
+        awaitable<MAPI::submit_transactions_response> async_submit_transactions (const MAPI::submit_transactions_request &);
+        
+        // requests that have not been taken by a connection yet.
+        size_t waiting () const;
+    
+    private:
+        // a task is given the connection of the thread that runs it, which may be null.
+        using task = std::function<void (ptr<MAPI> &)>;
+        
+        connect Connect;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Wake;
+        std::deque<task> Tasks;
+        bool Stop;
+        
+        std::vector<std::thread> Workers;
+        
+        void work ();
+        void push (task);
+        
+        template <typename response, typename f> std::future<response> make (f call);
+        
+        // nothing is sent and no connection is made if cancel returns true.
+        template <typename response, typename f> void make (f call,
+            std::function<void (const response &)> then, std::function<void (std::exception_ptr)> fail,
+            std::function<bool ()> cancel = {});
+    };
+    
+    template <typename response, typename f> std::future<response> MAPI_pool::make (f call) {
+        auto promise = std::make_shared<std::promise<response>> ();
+        std::future<response> future = promise->get_future ();
+        
+        push ([this, promise, call] (ptr<MAPI> &connection) {
+            try {
+                if (connection == nullptr) connection = Connect ();
+                promise->set_value (call (*connection));
+            } catch (...) {
+                promise->set_exception (std::current_exception ());
+                
+                // we don't know what state the connection is in, so we will make a new one.
+                connection = nullptr;
+            }
+        });
+        
+        return future;
+    }
+    
+    template <typename response, typename f> void MAPI_pool::make (f call,
+        std::function<void (const response &)> then, std::function<void (std::exception_ptr)> fail,
+        std::function<bool ()> cancel) {
+        push ([this, call, then, fail, cancel] (ptr<MAPI> &connection) {
+            response x;
+            try {
+                if (cancel && cancel ()) throw cancelled {};
+                if (connection == nullptr) connection = Connect ();
+                x = call (*connection);
+            } catch (const cancelled &) {
+                // nothing was sent, so the connection is fine.
+                fail (std::current_exception ());
+                return;
+            } catch (...) {
+                connection = nullptr;
+                fail (std::current_exception ());
+                return;
+            }
+            
+            then (x);
+        });
+    }
+    
+    void inline MAPI_pool::get_fee_quote (
+        std::function<void (const MAPI::get_fee_quote_response &)> then,
+        std::function<void (std::exception_ptr)> fail) {
+        make<MAPI::get_fee_quote_response> ([] (MAPI &m) {
+            return m.get_fee_quote ();
+        }, then, fail);
+    }
+    
+    void inline MAPI_pool::submit_transactions (const MAPI::submit_transactions_request &r,
+        std::function<void (const MAPI::submit_transactions_response &)> then,
+        std::function<void (std::exception_ptr)> fail) {
+        make<MAPI::submit_transactions_response> ([r] (MAPI &m) {
+            return m.submit_transactions (r);
+        }, then, fail);
+    }
+    
+    void inline MAPI_pool::get_transaction_status (const Bitcoin::txid &x,
+        std::function<void (const MAPI::transaction_status_response &)> then,
+        std::function<void (std::exception_ptr)> fail) {
+        make<MAPI::transaction_status_response> ([x] (MAPI &m) {
+            return m.get_transaction_status (x);
+        }, then, fail);
+    }
+    
+    void inline MAPI_pool::submit_transaction (const MAPI::submit_transaction_request &r,
+        std::function<void (const MAPI::submit_transaction_response &)> then,
+        std::function<void (std::exception_ptr)> fail,
+        std::function<bool ()> cancel) {
+        make<MAPI::submit_transaction_response> ([r] (MAPI &m) {
+            return m.submit_transaction (r);
+        }, then, fail, cancel);
+    }
+    
+    std::future<MAPI::get_policy_quote_response> inline MAPI_pool::get_policy_quote () {
+        return make<MAPI::get_policy_quote_response> ([] (MAPI &m) {
+            return m.get_policy_quote ();
+        });
+    }
+    
+    std::future<MAPI::get_fee_quote_response> inline MAPI_pool::get_fee_quote () {
+        return make<MAPI::get_fee_quote_response> ([] (MAPI &m) {
+            return m.get_fee_quote ();
+        });
+    }
+    
+    std::future<MAPI::transaction_status_response> inline MAPI_pool::get_transaction_status (const Bitcoin::txid &x) {
+        return make<MAPI::transaction_status_response> ([x] (MAPI &m) {
+            return m.get_transaction_status (x);
+        });
+    }
+    
+    std::future<MAPI::submit_transaction_response> inline MAPI_pool::submit_transaction (const MAPI::submit_transaction_request &r) {
+        return make<MAPI::submit_transaction_response> ([r] (MAPI &m) {
+            return m.submit_transaction (r);
+        });
+    }
+    
+    std::future<MAPI::submit_transactions_response> inline MAPI_pool::submit_transactions (const MAPI::submit_transactions_request &r) {
+        return make<MAPI::submit_transactions_response> ([r] (MAPI &m) {
+            return m.submit_transactions (r);
+        });
+    }
+    
+    awaitable<MAPI::get_fee_quote_response> inline MAPI_pool::async_get_fee_quote () {
+        return from_callbacks<MAPI::get_fee_quote_response> ([this] (auto then, auto fail) {
+            get_fee_quote (then, fail);
+        });
+    }
+    
+    awaitable<MAPI::submit_transaction_response> inline MAPI_pool::async_submit_transaction (const MAPI::submit_transaction_request &r) {
+        return from_callbacks<MAPI::submit_transaction_response> ([this, r] (auto then, auto fail) {
+            submit_transaction (r, then, fail);
+        });
+    }
+    
+    awaitable<MAPI::submit_transactions_response> inline MAPI_pool::async_submit_transactions (const MAPI::submit_transactions_request &r) {
+        return from_callbacks<MAPI::submit_transactions_response> ([this, r] (auto then, auto fail) {
+            submit_transactions (r, then, fail);
+        });
+    }
+    
+}
+
+#endif
@@ -0,0 +1,145 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_STATUS
+#define GIGAMONKEY_MAPI_STATUS
+
+#include <gigamonkey/mapi/pool.hpp>
+#include <gigamonkey/mapi/callback.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    // Keeps track of the status of transactions that we have submitted so that
+    // everything that wants to know about them doesn't ask MAPI separately.
+    // Requests for the status of a transaction that are made while one is
+    // already waiting for an answer share that answer.
+    //
+    // A transaction that is tracked is polled soon after it has been submitted
+    // and then less and less often, until it has been mined or has a conflict.
+    // If callbacks are used, a transaction is polled right away when a callback
+    // comes for it, and otherwise only at a slow fallback rate. Every status
+    // that we get for a tracked transaction goes to the subscribers.
+    //
+    // If a file is given, the transactions that are being tracked are kept in it,
+    // so that they are tracked again when we start up. Nothing is kept if the
+    // file cannot be written.
+    struct MAPI_status_tracker {
+        using request = std::function<void (const Bitcoin::txid &,
+            std::function<void (const MAPI::transaction_status_response &)>,
+            std::function<void (std::exception_ptr)>)>;
+        
+        using subscriber = std::function<void (const MAPI::transaction_status_response &)>;
+        
+        struct options {
+            // how long to wait before the first poll. Each wait after is twice as long, up to MaxPollMilliseconds.
+            uint32 FirstPollMilliseconds {1000};
+            uint32 MaxPollMilliseconds {10 * 60 * 1000};
+            
+            // whether callbacks have been set up, and if so, how long to wait between polls.
+            bool Callbacks {false};
+            uint32 FallbackPollMilliseconds {30 * 60 * 1000};
+            
+            // tracking stops when a transaction has this many confirmations.
+            uint32 Confirmations {1};
+            
+            // where tracked transactions are kept. They are not kept if this is empty.
+            std::filesystem::path File {};
+            
+            options () {};
+        };
+        
+        // the pool must outlive the tracker.
+        explicit MAPI_status_tracker (MAPI_pool &, const options & = options {});
+        
+        // the request must call one of the functions that it is given. Throws
+        // std::runtime_error if the file cannot be read.
+        explicit MAPI_status_tracker (request, const options & = options {});
+        
+        // waits for answers to requests that have been made.
+        ~MAPI_status_tracker ();
+        
+        MAPI_status_tracker (const MAPI_status_tracker &) = delete;
+        MAPI_status_tracker &operator = (const MAPI_status_tracker &) = delete;
+        
+        // the status of a transaction, which is asked for now unless a request for it is already waiting.
+        std::shared_future<MAPI::transaction_status_response> status (const Bitcoin::txid &);
+        
+        // start tracking a transaction that has just been submitted.
+        void track (const Bitcoin::txid &);
+        
+        void forget (const Bitcoin::txid &);
+        
+        // a callback from a miner. Anything but a callback for a tracked transaction is ignored.
+        void receive (const MAPI_callback &);
+        
+        // subscribers are called on the thread that got the answer and must not throw.
+        uint64 subscribe (subscriber);
+        void unsubscribe (uint64);
+        
+        // transactions that are being tracked.
+        std::vector<Bitcoin::txid> pending () const;
+    
+    private:
+        using clock = std::chrono::steady_clock;
+        
+        struct tracked {
+            // the wait before the last poll.
+            uint32 Wait;
+            
+            // when the next poll will be, or Schedule.end () if a request is waiting.
+            std::multimap<clock::time_point, Bitcoin::txid>::iterator Next;
+            
+            // a callback came while a request was waiting, so its answer may be out of date.
+            bool Again;
+        };
+        
+        request Request;
+        options Options;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Wake;
+        
+        hash_map<Bitcoin::txid, tracked> Tracked;
+        std::multimap<clock::time_point, Bitcoin::txid> Schedule;
+        
+        // requests that have not been answered.
+        hash_map<Bitcoin::txid, std::pair<ptr<std::promise<MAPI::transaction_status_response>>,
+            std::shared_future<MAPI::transaction_status_response>>> Waiting;
+        uint32 Outstanding;
+        
+        std::map<uint64, subscriber> Subscribers;
+        uint64 NextSubscriber;
+        
+        // whether the file needs to be written again.
+        bool Changed;
+        bool Stop;
+        std::thread Thread;
+        
+        void run ();
+        
+        std::vector<Bitcoin::txid> pending_locked () const;
+        
+        // call with the lock held.
+        std::shared_future<MAPI::transaction_status_response> ask (const Bitcoin::txid &, std::unique_lock<std::mutex> &);
+        void schedule (const Bitcoin::txid &, tracked &, clock::duration);
+        
+        // the next poll after one that has been answered, which is later than the last.
+        void later (const Bitcoin::txid &, tracked &);
+        
+        // schedule the next poll after an answer unless one has been scheduled already.
+        void next (const Bitcoin::txid &, tracked &);
+        
+        void answer (const Bitcoin::txid &, const MAPI::transaction_status_response &);
+        void fail (const Bitcoin::txid &, std::exception_ptr);
+        
+        void load ();
+        void save (const std::vector<Bitcoin::txid> &) const;
+    };
+    
+}
+
+#endif
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MEMORY
+#define GIGAMONKEY_MEMORY
+
+#include <gigamonkey/types.hpp>
+
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// bytes is a std::vector<byte> from the data library, so it always uses the
+// global allocator. These are for code that would rather use its own memory,
+// such as everything made while validating a block, which can then be thrown
+// away all at once.
+namespace Gigamonkey {
+    
+    // bytes that take their memory from a std::pmr::memory_resource.
+    using pmr_bytes = std::pmr::vector<byte>;
+    
+    pmr_bytes inline make_pmr_bytes (bytes_view b, std::pmr::memory_resource *r) {
+        return pmr_bytes (b.begin (), b.end (), r);
+    }
+    
+    // Memory for things that are all thrown away together. Deallocating does
+    // nothing and release frees everything at once, however much was made.
+    // Memory is taken from upstream in chunks, the first of which has the
+    // initial size. An arena may only be used by one thread at a time.
+    struct arena final : std::pmr::memory_resource {
+        
+        explicit arena (size_t initial_size = 1 << 16,
+            std::pmr::memory_resource *upstream = std::pmr::get_default_resource ()) :
+            Resource {initial_size, upstream}, Allocated {0}, Allocations {0} {}
+        
+        arena (const arena &) = delete;
+        arena &operator = (const arena &) = delete;
+        
+        // free everything that has been made in the arena.
+        void release () {
+            Resource.release ();
+            Allocated = 0;
+            Allocations = 0;
+        }
+        
+        // a copy of b that lasts until release.
+        bytes_view copy (bytes_view b);
+        
+        // construct an object in the arena. Its destructor is never run,
+        // so it should not own anything that is not in the arena too.
+        template <typename X, typename... P> X *make (P &&...p) {
+            return new (allocate (sizeof (X), alignof (X))) X {std::forward<P> (p)...};
+        }
+        
+        // bytes and allocations since the last release.
+        size_t allocated () const {
+            return Allocated;
+        }
+        
+        size_t allocations () const {
+            return Allocations;
+        }
+    
+    private:
+        std::pmr::monotonic_buffer_resource Resource;
+        size_t Allocated;
+        size_t Allocations;
+        
+        void *do_allocate (size_t size, size_t alignment) override;
+        void do_deallocate (void *, size_t, size_t) override {}
+        bool do_is_equal (const std::pmr::memory_resource &x) const noexcept override {
+            return this == &x;
+        }
+    };
+    
+    // The memory that a container uses in bytes by what it is for. Overhead is
+    // what the structure itself needs, such as nodes and buckets, and slack is
+    // memory that is allocated but not in use, such as empty slots in a table.
+    // These are estimates, since an allocator may round sizes up, but they are
+    // kept as the container changes, so they can be read at any time.
+    struct memory_report {
+        uint64 Keys {0};
+        uint64 Values {0};
+        uint64 Overhead {0};
+        uint64 Slack {0};
+        
+        uint64 total () const {
+            return Keys + Values + Overhead + Slack;
+        }
+        
+        memory_report &operator += (const memory_report &x) {
+            Keys += x.Keys;
+            Values += x.Values;
+            Overhead += x.Overhead;
+            Slack += x.Slack;
+            return *this;
+        }
+        
+        memory_report operator + (const memory_report &x) const {
+            memory_report m = *this;
+            return m += x;
+        }
+        
+        bool operator == (const memory_report &) const = default;
+        
+        explicit operator JSON () const;
+    };
+    
+    // the overhead of the standard containers, not counting their elements,
+    // for libstdc++ and libc++. A node of an unordered container has a pointer
+    // to the next node and the hash, and a node of a tree has three pointers
+    // and a color.
+    template <typename M> uint64 inline hash_table_overhead (const M &m) {
+        return m.size () * 2 * sizeof (void *) + m.bucket_count () * sizeof (void *);
+    }
+    
+    template <typename M> uint64 inline tree_overhead (const M &m) {
+        return m.size () * 4 * sizeof (void *);
+    }
+    
+    // Pools of blocks by size for the calling thread, which are never
+    // shared with another thread and so are never contended. Memory from
+    // this must be freed on the same thread before the thread exits.
+    std::pmr::memory_resource *thread_pool ();
+    
+}
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MEMPOOL
+#define GIGAMONKEY_MEMPOOL
+
+#include <gigamonkey/timechain.hpp>
+#include <gigamonkey/memory.hpp>
+#include <gigamonkey/merkle/accumulator.hpp>
+#include <gigamonkey/work/proof.hpp>
+
+#include <set>
+#include <shared_mutex>
+
+namespace Gigamonkey {
+    
+    // Transactions waiting to be mined, for building block templates. Each
+    // transaction knows the sizes and fees of its ancestors and descendants
+    // in the pool, which are updated as transactions come and go. Two indices
+    // are kept in order as this happens: one by the fee rate of a transaction
+    // together with its ancestors, which is the order in which they are put in
+    // a block, and one by the fee rate of a transaction with its descendants,
+    // which is the order in which they are evicted when the pool is too big.
+    //
+    // Any number of threads may build templates while one inserts or removes.
+    struct mempool {
+        struct options {
+            // the most bytes of transactions to keep.
+            uint64 MaxSize {uint64 {1} << 30};
+            
+            // the most transactions that one may depend on in the pool or that may
+            // depend on one, counting itself. These bound the time to insert.
+            uint32 MaxAncestors {1000};
+            uint32 MaxDescendants {1000};
+        };
+        
+        struct entry {
+            Bitcoin::shared_transaction Transaction;
+            Bitcoin::satoshi Fee;
+            
+            // totals of the transaction and all of its ancestors in the pool.
+            uint32 AncestorCount;
+            uint64 AncestorSize;
+            Bitcoin::satoshi AncestorFees;
+            
+            // totals of the transaction and all of its descendants in the pool.
+            uint32 DescendantCount;
+            uint64 DescendantSize;
+            Bitcoin::satoshi DescendantFees;
+            
+            uint64 size () const {
+                return Transaction.serialized_size ();
+            }
+            
+            double fee_rate () const {
+                return double (Fee) / double (size ());
+            }
+            
+            double ancestor_fee_rate () const {
+                return double (AncestorFees) / double (AncestorSize);
+            }
+            
+            double descendant_fee_rate () const {
+                return double (DescendantFees) / double (DescendantSize);
+            }
+        };
+        
+        enum result {
+            accepted,
+            duplicate,
+            
+            // an output that it spends is already spent by a transaction in the pool.
+            conflict,
+            too_many_ancestors,
+            too_many_descendants,
+            
+            // the pool was full and the transaction paid too little to stay.
+            evicted
+        };
+        
+        mempool (options o) : Options {o}, Mutex {}, Entries {}, Spent {}, ByAncestorRate {}, ByDescendantRate {}, TotalSize {0}, Links {0} {}
+        mempool () : mempool {options {}} {}
+        
+        // The fee is given by the caller, who has had to look up the outputs that
+        // the transaction spends to check it anyway, for example with ledger::make_vertex.
+        result insert (const Bitcoin::shared_transaction &, Bitcoin::satoshi fee);
+        
+        // remove a transaction and everything that depends on it. Returns the number removed.
+        size_t remove (const Bitcoin::txid &);
+        
+        // Remove the transactions of a new block, given in the order of the block,
+        // and everything in the pool that spends the same outputs as they do. The
+        // descendants of the transactions that are mined stay.
+        void remove_confirmed (std::span<const Bitcoin::shared_transaction>);
+        
+        maybe<entry> operator [] (const Bitcoin::txid &) const;
+        
+        bool contains (const Bitcoin::txid &) const;
+        
+        // the number of transactions.
+        size_t size () const;
+        
+        // the bytes of all the transactions together.
+        uint64 total_size () const;
+        
+        // transactions are counted by their serialized size.
+        memory_report memory_usage () const;
+        
+        // Transactions to fill a block with at most max_size bytes of them, in an order
+        // in which every transaction comes after those that it spends. Transactions
+        // are taken in order of their fee rate with their ancestors, and each is
+        // preceded by the ancestors that are not already in.
+        std::vector<Bitcoin::shared_transaction> select (uint64 max_size) const;
+        
+        struct block_template {
+            std::vector<Bitcoin::shared_transaction> Transactions;
+            
+            // the txids with a placeholder for the coinbase in front, so that more
+            // transactions can be appended to the template without starting over.
+            Merkle::accumulator Accumulator;
+            
+            // the candidate whose path goes with the accumulator.
+            work::candidate Candidate;
+        };
+        
+        block_template make_template (int32_little version, const digest256 &previous, work::compact target, uint64 max_size) const;
+    
+    private:
+        struct score {
+            double Rate;
+            Bitcoin::txid ID;
+            
+            bool operator < (const score &x) const {
+                return Rate < x.Rate || (Rate == x.Rate && ID < x.ID);
+            }
+            
+            bool operator > (const score &x) const {
+                return x < *this;
+            }
+        };
+        
+        struct node {
+            entry Entry;
+            
+            // the transactions in the pool that this spends and that spend this.
+            hash_set<Bitcoin::txid> Parents;
+            hash_set<Bitcoin::txid> Children;
+            
+            score ancestor_score () const {
+                return score {Entry.ancestor_fee_rate (), Entry.Transaction.id ()};
+            }
+            
+            score descendant_score () const {
+                return score {Entry.descendant_fee_rate (), Entry.Transaction.id ()};
+            }
+        };
+        
+        const options Options;
+        
+        mutable std::shared_mutex Mutex;
+        hash_map<Bitcoin::txid, node> Entries;
+        
+        // the outputs spent by transactions in the pool.
+        hash_map<Bitcoin::outpoint, Bitcoin::txid> Spent;
+        
+        // highest first.
+        std::set<score, std::greater<score>> ByAncestorRate;
+        
+        // lowest first.
+        std::set<score> ByDescendantRate;
+        
+        uint64 TotalSize;
+        
+        // the number of txids in Parents and Children altogether.
+        uint64 Links;
+        
+        // the ancestors or descendants of a transaction, not including itself.
+        hash_set<Bitcoin::txid> ancestors (const node &) const;
+        hash_set<Bitcoin::txid> descendants (const node &) const;
+        
+        // remove one transaction and take it out of the totals of the rest.
+        void erase (const Bitcoin::txid &);
+        
+        size_t erase_with_descendants (const Bitcoin::txid &);
+    };
+    
+}
+
+#endif
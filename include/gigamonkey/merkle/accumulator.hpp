@@ -0,0 +1,58 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_ACCUMULATOR
+#define GIGAMONKEY_MERKLE_ACCUMULATOR
+
+#include <gigamonkey/merkle/proof.hpp>
+
+#include <vector>
+
+namespace Gigamonkey::Merkle {
+    
+    // An append-only Merkle tree that only keeps the right edge, so that
+    // adding a leaf takes O(log n) time. This is for building block templates:
+    // append a placeholder for the coinbase and then the txids as they come in.
+    // The path of the coinbase does not depend on the coinbase itself, so it
+    // can be given to work::candidate or to mining.notify at any time.
+    struct accumulator final {
+        accumulator () : Width {0}, Frontier {}, Branch {} {}
+        
+        uint32 width () const {
+            return Width;
+        }
+        
+        void append (const digest &);
+        
+        accumulator &operator << (const digest &d) {
+            append (d);
+            return *this;
+        }
+        
+        // the root of the tree of all the leaves appended so far.
+        digest root () const;
+        
+        // the root if the first leaf were replaced by the given coinbase txid.
+        digest root (const digest &coinbase) const {
+            return coinbase_path ().derive_root (coinbase);
+        }
+        
+        // the path of the first leaf.
+        path coinbase_path () const;
+    
+    private:
+        uint32 Width;
+        
+        // Frontier[i] is the root of a complete subtree of 2^i leaves if bit i of Width is set.
+        std::vector<digest> Frontier;
+        
+        // the parts of the coinbase path that can no longer change.
+        std::vector<digest> Branch;
+        
+        // the last node at the given height, built from the frontier below it.
+        digest fold (uint32 height) const;
+    };
+    
+}
+
+#endif
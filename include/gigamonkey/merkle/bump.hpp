@@ -0,0 +1,105 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_BUMP
+#define GIGAMONKEY_MERKLE_BUMP
+
+#include <gigamonkey/merkle/dual.hpp>
+
+#include <map>
+#include <vector>
+
+namespace Gigamonkey::Merkle {
+    
+    // BSV Unified Merkle Path (BRC-74). Proofs for many transactions in one
+    // block are stored as a single partial tree, level by level, so that a
+    // node that is shared by several paths is only stored once, and a node
+    // that can be computed from the level below is not stored at all.
+    struct BUMP {
+        
+        enum flag : byte {
+            intermediate = 0,
+            
+            // the node is the same as its sibling, so no digest is stored.
+            duplicate = 1,
+            
+            // one of the transactions that the proof is for.
+            client = 2
+        };
+        
+        struct node {
+            uint64 Offset;
+            flag Flag;
+            digest Digest;
+            
+            bool operator == (const node &n) const {
+                return Offset == n.Offset && Flag == n.Flag && Digest == n.Digest;
+            }
+        };
+        
+        uint64 BlockHeight;
+        
+        // levels from the leaves up, each sorted by offset. There is one
+        // level for every digest in a path.
+        std::vector<std::vector<node>> Levels;
+        
+        BUMP () : BlockHeight {0}, Levels {} {}
+        
+        // all branches must be from the same tree. Throws std::invalid_argument if
+        // they are not or if there are none.
+        BUMP (uint64 block_height, const std::vector<branch> &);
+        BUMP (uint64 block_height, const dual &);
+        BUMP (uint64 block_height, const proof &p) : BUMP {block_height, std::vector<branch> {p.Branch}} {}
+        
+        bool valid () const;
+        
+        // the height of the Merkle tree.
+        size_t height () const {
+            return Levels.size ();
+        }
+        
+        maybe<digest> root () const;
+        
+        bool verify (const digest &root) const;
+        
+        // the transactions that we have proofs of.
+        std::vector<leaf> leaves () const;
+        
+        bool contains (const digest &txid) const;
+        
+        // an invalid proof if the txid is not a client of this BUMP.
+        proof operator [] (const digest &txid) const;
+        
+        // combine proofs from the same block. Throws std::invalid_argument if
+        // they are from different blocks.
+        BUMP operator + (const BUMP &) const;
+        
+        // remove a client and all nodes that only it needed.
+        BUMP prune (const digest &txid) const;
+        
+        explicit operator dual () const;
+        
+        bool operator == (const BUMP &b) const {
+            return BlockHeight == b.BlockHeight && Levels == b.Levels;
+        }
+        
+        bytes write () const;
+        
+        explicit operator bytes () const {
+            return write ();
+        }
+        
+        // nothing if the bytes are not a valid BUMP.
+        static maybe<BUMP> read (bytes_view);
+    
+    private:
+        // every node that can be known at every level, including the root.
+        // false if the nodes do not fit together.
+        bool expand (std::vector<std::map<uint64, digest>> &) const;
+        
+        std::vector<branch> branches () const;
+    };
+    
+}
+
+#endif
@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_COMPACT_DUAL
+#define GIGAMONKEY_MERKLE_COMPACT_DUAL
+
+#include <gigamonkey/merkle/dual.hpp>
+#include <gigamonkey/memory.hpp>
+
+#include <map>
+#include <vector>
+
+namespace Gigamonkey::Merkle {
+    
+    // Like dual, but every node of the tree is stored once no matter how
+    // many paths go through it, so that a wallet with many transactions in
+    // one block doesn't keep the upper levels of the tree many times over.
+    // Nodes are kept level by level by their offset in the level, and each
+    // counts the leaves that need it, so that removing a leaf removes every
+    // node that nothing else needs.
+    struct compact_dual {
+        
+        compact_dual () : Height {0}, Root {}, Levels {}, Leaves {} {}
+        
+        // throws std::invalid_argument if the dual is not valid.
+        explicit compact_dual (const dual &);
+        
+        bool valid () const {
+            return Leaves.size () != 0;
+        }
+        
+        digest root () const {
+            return Root;
+        }
+        
+        // the number of leaves.
+        size_t size () const {
+            return Leaves.size ();
+        }
+        
+        // the number of digests that are stored, not counting the root.
+        size_t nodes () const;
+        
+        // the leaves are the keys and the nodes are the values.
+        memory_report memory_usage () const;
+        
+        bool contains (const digest &leaf) const {
+            return Leaves.contains (leaf);
+        }
+        
+        // O(log n). Throws std::invalid_argument if the proof is not valid or
+        // is not from the same tree. Nothing is changed if it throws.
+        void insert (const proof &);
+        
+        // false if the leaf was not there.
+        bool remove (const digest &leaf);
+        
+        // an invalid proof if the leaf is not there.
+        proof operator [] (const digest &leaf) const;
+        
+        // in the order of their indices.
+        std::vector<leaf> leaves () const;
+        
+        // O(k log n) where k is the size of the other dual.
+        compact_dual &operator += (const compact_dual &);
+        
+        compact_dual operator + (const compact_dual &d) const {
+            compact_dual x = *this;
+            return x += d;
+        }
+        
+        explicit operator dual () const;
+        
+        bool operator == (const compact_dual &d) const {
+            return Root == d.Root && Leaves == d.Leaves;
+        }
+    
+    private:
+        struct node {
+            digest Digest;
+            
+            // the number of leaves that need this node.
+            uint32 References;
+        };
+        
+        // the length of every path.
+        uint32 Height;
+        digest Root;
+        
+        // nodes below the root at each level by offset, leaves first.
+        std::vector<std::map<uint32, node>> Levels;
+        
+        // the index of every leaf.
+        hash_map<digest, uint32> Leaves;
+        
+        bool fits (uint32 height, uint32 offset, const digest &) const;
+        void add (uint32 height, uint32 offset, const digest &);
+        void release (uint32 height, uint32 offset);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,107 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_DISK_TREE
+#define GIGAMONKEY_MERKLE_DISK_TREE
+
+#include <gigamonkey/merkle/proof.hpp>
+
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Gigamonkey::Merkle {
+    
+    // A Merkle tree for blocks that are too big to keep in memory. Leaves
+    // are appended one at a time, for example from block_reader::receive_transaction,
+    // and every level is written to its own file as it grows, so only a
+    // small buffer for each level is kept in memory. Once finish has been
+    // called, the files are mapped and proofs are served from them in the
+    // same way as by server.
+    class disk_tree final {
+    public:
+        // level h is written to prefix.h and the index of leaves to prefix.index.
+        // The files are removed when the tree is destroyed. Throws std::runtime_error
+        // if a file cannot be written or mapped.
+        explicit disk_tree (const std::string &prefix);
+        ~disk_tree ();
+        
+        disk_tree (const disk_tree &) = delete;
+        disk_tree &operator = (const disk_tree &) = delete;
+        
+        void append (const digest &);
+        
+        disk_tree &operator << (const digest &d) {
+            append (d);
+            return *this;
+        }
+        
+        // write what is left of every level and map the files. No more
+        // leaves can be appended after this. Throws std::logic_error if
+        // there are no leaves.
+        void finish ();
+        
+        bool finished () const {
+            return Height != 0;
+        }
+        
+        uint32 width () const {
+            return Width;
+        }
+        
+        // zero until the tree is finished.
+        uint32 height () const {
+            return Height;
+        }
+        
+        // everything below is only available once the tree is finished.
+        digest root () const;
+        
+        // the index of a leaf given its digest.
+        maybe<uint32> find (const digest &) const;
+        
+        // as with server::write_path.
+        size_t write_path (uint32 i, std::span<digest> p) const;
+        
+        proof operator [] (const digest &) const;
+        
+        std::vector<proof> operator [] (std::span<const digest>) const;
+    
+    private:
+        struct level {
+            int Descriptor;
+            
+            // digests that have been written to the file.
+            uint64 Written;
+            
+            // digests that have not been written yet.
+            std::vector<digest> Buffer;
+            
+            const digest *Map;
+        };
+        
+        std::string Prefix;
+        std::vector<level> Levels;
+        
+        uint32 Width;
+        uint32 Height;
+        
+        // open-addressing hash table of leaf indices + 1, as in server.
+        int IndexDescriptor;
+        uint32 *Slots;
+        size_t Capacity;
+        
+        std::string file_name (uint32 height) const;
+        
+        void push (uint32 height, const digest &);
+        
+        // write the buffer of a level and give the parents of its digests to the level above.
+        void flush (uint32 height);
+        
+        void index ();
+        void close ();
+    };
+    
+}
+
+#endif
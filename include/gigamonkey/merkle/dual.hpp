@@ -5,6 +5,7 @@
 #define GIGAMONKEY_MERKLE_DUAL
 
 #include <gigamonkey/merkle/proof.hpp>
+#include <gigamonkey/executor.hpp>
 
 namespace Gigamonkey::Merkle {
     
@@ -18,6 +19,7 @@ namespace Gigamonkey::Merkle {
     std::ostream &operator << (std::ostream &o, const dual &d);
     
     struct tree;
+    struct flat_tree;
     
     using map = data::map<digest, path>;
     
@@ -34,9 +36,15 @@ namespace Gigamonkey::Merkle {
         dual (const proof &p) : Paths {entry (p.Branch)}, Root {p.Root} {}
         
         dual (const tree &t);
+        dual (const flat_tree &t);
         
+        // every node that is on some path is worked out once, so
+        // the nodes that paths share are not hashed again for each.
         bool valid () const;
         
+        // hash big levels on the threads of e.
+        bool valid (executor &e) const;
+        
         bool contains (const digest &b) const {
             return Paths.contains (b);
         }
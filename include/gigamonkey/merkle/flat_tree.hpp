@@ -0,0 +1,128 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_FLAT_TREE
+#define GIGAMONKEY_MERKLE_FLAT_TREE
+
+#include <gigamonkey/merkle/proof.hpp>
+#include <gigamonkey/executor.hpp>
+
+#include <span>
+#include <vector>
+
+namespace Gigamonkey::Merkle {
+    
+    struct tree;
+    
+    // Every proof of a tree together, for publishing all the proofs of a block.
+    // Each leaf has its digest followed by its path, from the bottom up, in one
+    // buffer, so the proofs are made without allocating for each of them and
+    // can be written from many threads at once.
+    struct proofs_table final {
+        uint32 Width;
+        
+        // the number of digests in each path.
+        uint32 Depth;
+        
+        digest Root;
+        
+        // Depth + 1 digests for each leaf.
+        std::vector<digest> Digests;
+        
+        proofs_table () : Width {0}, Depth {0}, Root {}, Digests {} {}
+        
+        // levels is every level of a tree with the given width, leaves first, as in flat_tree.
+        proofs_table (std::span<const digest> levels, uint32 width, executor *e = nullptr);
+        
+        const digest &leaf (uint32 index) const {
+            return Digests[size_t (index) * (Depth + 1)];
+        }
+        
+        std::span<const digest> path (uint32 index) const {
+            return std::span<const digest> {Digests.data () + size_t (index) * (Depth + 1) + 1, Depth};
+        }
+        
+        proof operator [] (uint32 index) const;
+        
+        // the size of a proof in the binary format of BitcoinAssociation::proofs_serialization_standard
+        // with the txid and the Merkle root as the target.
+        size_t serialized_size (uint32 index) const;
+        
+        // write every proof in that format in order, one after the other.
+        bytes write (executor *e = nullptr) const;
+        
+        // write one proof in that format. out must have room for serialized_size (index) bytes.
+        void write (uint32 index, byte *out) const;
+    };
+    
+    // hash the pairs of consecutive digests in in and write the results to out,
+    // many pairs at a time with the multi-buffer kernel.
+    void hash_pairs (digest *out, const digest *in, size_t pairs);
+    
+    // The root of a tree whose first leaf is the coinbase, from the digests on
+    // the left edge of the tree from the bottom up, which are the path of the
+    // coinbase. Only these change when the coinbase does, so this is the way to
+    // get a new root for each extra nonce without building the tree again.
+    digest coinbase_root (const digest &coinbase, std::span<const digest> branch);
+    
+    // the same for many coinbases at once with the multi-buffer kernel.
+    // roots must be the same size as coinbases.
+    void coinbase_roots (std::span<digest> roots, std::span<const digest> coinbases, std::span<const digest> branch);
+    
+    // A Merkle tree with every level stored in one array, leaves first and
+    // root last, in the same order as server. Each level is hashed with the
+    // multi-buffer kernel, so this is the fast way to build a tree for a big block.
+    struct flat_tree final {
+        uint32 Width;
+        uint32 Height;
+        
+        // all levels, starting with the leaves.
+        std::vector<digest> Digests;
+        
+        flat_tree () : Width {0}, Height {0}, Digests {} {}
+        
+        explicit flat_tree (leaf_digests);
+        explicit flat_tree (std::vector<digest> leaves);
+        
+        // hash big levels on the threads of e.
+        flat_tree (std::vector<digest> leaves, executor &e);
+        
+        bool valid () const {
+            return Width != 0 && Digests.size () == size (Width);
+        }
+        
+        digest root () const {
+            return Digests.empty () ? digest {} : Digests.back ();
+        }
+        
+        // level 0 is the leaves and level Height - 1 is the root.
+        std::span<const digest> level (uint32 height) const;
+        
+        proof operator [] (uint32 index) const;
+        
+        list<proof> proofs () const;
+        
+        proofs_table all_proofs () const {
+            return proofs_table {Digests, Width};
+        }
+        
+        proofs_table all_proofs (executor &e) const {
+            return proofs_table {Digests, Width, &e};
+        }
+        
+        operator tree () const;
+        
+        bool operator == (const flat_tree &t) const {
+            return Width == t.Width && Height == t.Height && Digests == t.Digests;
+        }
+        
+        // the total number of digests in a tree with the given number of leaves.
+        static size_t size (uint32 width);
+    
+    private:
+        void build (executor *);
+    };
+    
+}
+
+#endif
@@ -10,9 +10,14 @@ namespace Gigamonkey::Merkle {
     
     using digest = digest256;
     
-    // the function that is used to compute successive nodes in the Merkle tree. 
+    // The function that is used to compute successive nodes in the Merkle tree,
+    // which is Hash256 of the two digests written one after another. The message
+    // is always 64 bytes long, so it is done with sha256::double_hash_64.
+    digest hash_pair (const digest &a, const digest &b);
+    
+    // the old name of hash_pair.
     inline digest hash_concatinated (const digest &a, const digest &b) {
-        return Bitcoin::Hash256 (write (64, a, b));
+        return hash_pair (a, b);
     }
     
     // all hashes for the leaves of a given tree in order starting from zero.
@@ -111,6 +111,10 @@ namespace Gigamonkey::BitcoinAssociation {
         // but not necessarily check the whole proof. 
         digest256 root() const;
         
+        // the binary format read in place, for checking proofs without
+        // copying them. The buffer must outlive the view. 
+        struct view;
+        
     private:
         // Everything below this point is subject to change as 
         // more about the composite format is specified. 
@@ -162,9 +166,68 @@ namespace Gigamonkey::BitcoinAssociation {
         
     };
     
+    struct proofs_serialization_standard::view {
+        
+        // the buffer is read once and the positions of the fields are kept. 
+        // Composite proofs and trees are not supported, so they are invalid. 
+        explicit view (bytes_view);
+        
+        bool valid () const;
+        
+        byte Flags;
+        uint32 Index;
+        
+        // one of these is empty. 
+        bytes_view Transaction;
+        bytes_view Txid;
+        
+        // 32 or 80 bytes depending on the target type. 
+        bytes_view Target;
+        
+        // the encoded nodes, each being either a 0 followed by a 
+        // digest or a 1 to say that the digest is duplicated. 
+        size_t Nodes;
+        bytes_view Path;
+        
+        bool transaction_included () const;
+        target_type_value target_type () const;
+        
+        // hashes the transaction if it is included. 
+        digest256 txid () const;
+        
+        maybe<digest256> block_hash () const;
+        maybe<digest256> Merkle_root () const;
+        maybe<Bitcoin::header> block_header () const;
+        
+        // the root that the nodes lead to, computed without making a Merkle::path. 
+        digest256 root () const;
+        
+        // whether the root matches the target. If the target is a block hash, 
+        // we need the header to check it. 
+        bool verify () const;
+        bool verify (const Bitcoin::header &) const;
+        
+        Merkle::path path () const;
+        
+    private:
+        bool Valid;
+    };
+    
     digest256 read_digest (const string &);
     string write_digest (const digest256 &);
     
+    bool inline proofs_serialization_standard::view::valid () const {
+        return Valid;
+    }
+    
+    bool inline proofs_serialization_standard::view::transaction_included () const {
+        return proofs_serialization_standard::transaction_included (Flags);
+    }
+    
+    proofs_serialization_standard::target_type_value inline proofs_serialization_standard::view::target_type () const {
+        return proofs_serialization_standard::target_type (Flags);
+    }
+    
     bool inline proofs_serialization_standard::valid (bytes_view b) {
         return read_binary (b).valid ();
     }
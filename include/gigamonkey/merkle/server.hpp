@@ -5,17 +5,28 @@
 #define GIGAMONKEY_MERKLE_SERVER
 
 #include <gigamonkey/merkle/proof.hpp>
+#include <gigamonkey/executor.hpp>
+
+#include <span>
+#include <vector>
 
 namespace Gigamonkey::Merkle {
     
     struct tree;
+    struct flat_tree;
+    struct proofs_table;
     
     // for serving branches. Would be on a miner's computer. 
     class server final {
+        // every level of the tree, leaves first, as in flat_tree. 
         cross<digest> Digests;
-        data::map<digest, uint32> Indices;
         
-        server () : Digests {}, Indices {}, Width {0}, Height {0} {}
+        // open-addressing hash table of leaf indices + 1, with 0 for an empty slot. 
+        std::vector<uint32> Slots;
+        
+        server () : Digests {}, Slots {}, Width {0}, Height {0} {}
+        
+        void index ();
         
     public:
         uint32 Width;
@@ -23,6 +34,7 @@ namespace Gigamonkey::Merkle {
         
         server (leaf_digests);
         server (const tree &);
+        server (const flat_tree &);
         
         operator tree () const;
         
@@ -30,8 +42,23 @@ namespace Gigamonkey::Merkle {
         
         list<proof> proofs () const;
         
+        // every proof at once, which is much faster than proofs () for a big tree.
+        proofs_table all_proofs () const;
+        proofs_table all_proofs (executor &) const;
+        
+        // the index of a leaf given its digest. 
+        maybe<uint32> find (const digest &d) const;
+        
+        // write the path of the leaf at index i into p, which must have room for 
+        // Height - 1 digests, and return the number of digests written. Nothing 
+        // is allocated, so this is the way to serve a lot of proofs. 
+        size_t write_path (uint32 i, std::span<digest> p) const;
+        
         proof operator [] (const digest &d) const;
         
+        // look up many proofs at once. Digests that are not leaves get an invalid proof. 
+        std::vector<proof> operator [] (std::span<const digest> d) const;
+        
         bool operator == (const server &s) const;
     };
     
@@ -5,11 +5,13 @@
 #define GIGAMONKEY_MERKLE_TREE
 
 #include <gigamonkey/merkle/proof.hpp>
+#include <gigamonkey/executor.hpp>
 
 namespace Gigamonkey::Merkle {
     
     struct dual;
     class server;
+    struct flat_tree;
     
     struct tree final : data::tree<digest> {
         uint32 Width;
@@ -23,6 +25,9 @@ namespace Gigamonkey::Merkle {
         
         bool valid () const;
         
+        // hash big levels on the threads of e.
+        bool valid (executor &e) const;
+        
         const list<proof> proofs () const;
         
         proof operator[] (uint32 i) const;
@@ -32,6 +37,7 @@ namespace Gigamonkey::Merkle {
     private:
         tree (data::tree<digest> t, uint32 w, uint32 h) : data::tree<digest> {t}, Width {w}, Height {h} {}
         friend class server;
+        friend struct flat_tree;
     };
     
     inline digest root (const tree t) {
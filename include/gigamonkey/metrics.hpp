@@ -0,0 +1,164 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_METRICS
+#define GIGAMONKEY_METRICS
+
+#include <gigamonkey/memory.hpp>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Counters and latency histograms for the hot paths of the library. They are
+// only kept if the library is built with GIGAMONKEY_METRICS, in which case
+// GIGAMONKEY_ENABLE_METRICS is defined. Otherwise count and stopwatch do
+// nothing and collect returns zeros.
+//
+// Each thread has its own counters, which only it writes, so counting costs
+// a load and a store. collect adds up the counters of every thread.
+//
+// Containers that may be big, such as the UTXO set or the mempool, can be
+// given to a memory_source so that collect reports how much memory they use.
+// Memory is reported whether or not the library is built with metrics, since
+// it is only found when collect is called.
+namespace Gigamonkey::metrics {
+
+#ifdef GIGAMONKEY_ENABLE_METRICS
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+    
+    enum counter : byte {
+        // double SHA-256 digests computed with the functions in sha256.hpp.
+        hashes,
+        scripts,
+        signatures,
+        shares_accepted,
+        shares_rejected,
+        MAPI_calls,
+        Merkle_trees,
+        counters
+    };
+    
+    enum timer : byte {
+        script_run,
+        signature_verify,
+        // a batch of shares in a share_pipeline.
+        share_check,
+        MAPI_call,
+        Merkle_tree_make,
+        timers
+    };
+    
+    const char *name (counter);
+    const char *name (timer);
+    
+    // latencies in nanoseconds. Values below 16 have a bucket each and above
+    // that each power of two is divided into 8 buckets, so a bucket is never
+    // wider than an eighth of the values in it.
+    struct histogram {
+        static constexpr size_t buckets = 16 + 60 * 8;
+        
+        static size_t bucket (uint64 ns);
+        
+        // the least value that goes in a bucket.
+        static uint64 lower (size_t bucket);
+        
+        uint64 Count;
+        uint64 Sum;
+        uint64 Max;
+        std::vector<uint64> Buckets;
+        
+        histogram () : Count {0}, Sum {0}, Max {0}, Buckets (buckets, 0) {}
+        
+        // the lower bound of the bucket that contains the p-th quantile.
+        uint64 percentile (double p) const;
+        
+        double mean () const {
+            return Count == 0 ? 0 : double (Sum) / Count;
+        }
+    };
+    
+    struct snapshot {
+        std::array<uint64, counters> Counters {};
+        std::array<histogram, timers> Timers {};
+        
+        uint64 operator [] (counter c) const {
+            return Counters[c];
+        }
+        
+        const histogram &operator [] (timer t) const {
+            return Timers[t];
+        }
+        
+        // the memory of every memory_source by name.
+        std::map<std::string, memory_report> Memory {};
+        
+        explicit operator JSON () const;
+    };
+    
+    // A container that reports its memory in collect under a name for as long
+    // as this exists. Sources with the same name are added together, so that,
+    // for example, every session may report its own memory under one name.
+    // The function is called from the thread that calls collect.
+    struct memory_source {
+        memory_source (std::string name, std::function<memory_report ()>);
+        ~memory_source ();
+        
+        memory_source (const memory_source &) = delete;
+        memory_source &operator = (const memory_source &) = delete;
+    
+    private:
+        std::string Name;
+        std::function<memory_report ()> Report;
+        
+        friend snapshot collect ();
+    };
+    
+    // the totals over every thread, including those that have exited.
+    snapshot collect ();
+    
+    // set everything to zero. Counts made while this
+    // runs on other threads may or may not be lost.
+    void reset ();
+    
+    namespace detail {
+        void count (counter, uint64);
+        void time (timer, uint64 ns);
+    }
+    
+    void inline count (counter c, uint64 n = 1) {
+        if constexpr (enabled) detail::count (c, n);
+    }
+    
+    // time a scope.
+    struct stopwatch {
+        using clock = std::chrono::steady_clock;
+
+#ifdef GIGAMONKEY_ENABLE_METRICS
+        explicit stopwatch (timer t) : Timer {t}, Start {clock::now ()} {}
+        
+        ~stopwatch () {
+            detail::time (Timer, std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now () - Start).count ());
+        }
+#else
+        explicit stopwatch (timer) {}
+#endif
+        
+        stopwatch (const stopwatch &) = delete;
+        stopwatch &operator = (const stopwatch &) = delete;
+
+#ifdef GIGAMONKEY_ENABLE_METRICS
+    private:
+        timer Timer;
+        clock::time_point Start;
+#endif
+    };
+    
+}
+
+#endif
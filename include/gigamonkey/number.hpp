@@ -8,6 +8,15 @@
 
 #include <sv/arith_uint256.h>
 
+#include <array>
+#include <cstring>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <data/encoding/words.hpp>
 #include <data/encoding/halves.hpp>
 
@@ -180,6 +189,13 @@ namespace Gigamonkey {
     template <size_t size> writer &operator << (writer &, const uint<size> &);
     template <size_t size> reader &operator >> (reader &, uint<size> &);
     
+    template <size_t size> bool operator == (const uint<size> &, const uint<size> &);
+    template <size_t size> bool operator != (const uint<size> &, const uint<size> &);
+    template <size_t size> bool operator <= (const uint<size> &, const uint<size> &);
+    template <size_t size> bool operator >= (const uint<size> &, const uint<size> &);
+    template <size_t size> bool operator < (const uint<size> &, const uint<size> &);
+    template <size_t size> bool operator > (const uint<size> &, const uint<size> &);
+    
     template <endian::order r> struct integer : bytes {
         
         static bool minimal (const bytes_view b);
@@ -382,6 +398,158 @@ namespace data::encoding::decimal {
 
 namespace Gigamonkey {
 
+    // Arithmetic for uint<X> is done on 64-bit limbs, least significant
+    // first, rather than with the 32-bit words of base_uint. A uint whose
+    // size is not a multiple of 8 is given a partial top limb which is
+    // zero when loaded and cut off when stored.
+    namespace limbs {
+        
+        template <size_t X> using number = std::array<uint64, (X + 7) / 8>;
+        
+        template <size_t X> number<X> inline load (const byte *b) {
+            number<X> x {};
+            std::memcpy (x.data (), b, X);
+            return x;
+        }
+        
+        template <size_t X> void inline store (const number<X> &x, byte *b) {
+            std::memcpy (b, x.data (), X);
+        }
+        
+        // compares a and b, returning -1, 0, or 1. Every limb is compared and
+        // the most significant one that differs is selected without a branch.
+        template <size_t n> constexpr int compare (const std::array<uint64, n> &a, const std::array<uint64, n> &b) {
+            int r = 0;
+            for (size_t i = 0; i < n; i++) {
+                int c = int (a[i] > b[i]) - int (a[i] < b[i]);
+                r = c != 0 ? c : r;
+            }
+            return r;
+        }
+        
+        // the index of the most significant of 16 bytes at a and b that
+        // differ, or -1 if they are all the same.
+        inline int highest_difference (const byte *a, const byte *b) {
+#if defined (__SSE2__)
+            int m = ~_mm_movemask_epi8 (_mm_cmpeq_epi8 (
+                _mm_loadu_si128 (reinterpret_cast<const __m128i *> (a)),
+                _mm_loadu_si128 (reinterpret_cast<const __m128i *> (b)))) & 0xffff;
+            return m == 0 ? -1 : 31 - __builtin_clz (m);
+#elif defined (__ARM_NEON)
+            // four bits for each byte, since NEON has no movemask.
+            uint64 m = ~vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (
+                vreinterpretq_u16_u8 (vceqq_u8 (vld1q_u8 (a), vld1q_u8 (b))), 4)), 0);
+            return m == 0 ? -1 : (63 - __builtin_clzll (m)) / 4;
+#else
+            for (int i = 15; i >= 0; i--) if (a[i] != b[i]) return i;
+            return -1;
+#endif
+        }
+        
+        // compares numbers of X bytes stored little endian at a and b, returning
+        // -1, 0, or 1. The top X % 16 bytes are compared as limbs and the rest
+        // 16 at a time with a vector compare.
+        template <size_t X> inline int compare (const byte *a, const byte *b) {
+#if defined (__SSE2__) || defined (__ARM_NEON)
+            constexpr size_t whole = X - X % 16;
+            if constexpr (X % 16 != 0) {
+                int c = compare (load<X % 16> (a + whole), load<X % 16> (b + whole));
+                if (c != 0) return c;
+            }
+            
+            for (size_t i = whole; i > 0; i -= 16) {
+                int k = highest_difference (a + i - 16, b + i - 16);
+                if (k >= 0) return a[i - 16 + k] < b[i - 16 + k] ? -1 : 1;
+            }
+            
+            return 0;
+#else
+            return compare (load<X> (a), load<X> (b));
+#endif
+        }
+        
+        // a += b, returning the carry.
+        template <size_t n> constexpr bool add (std::array<uint64, n> &a, const std::array<uint64, n> &b) {
+            unsigned __int128 carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                carry += static_cast<unsigned __int128> (a[i]) + b[i];
+                a[i] = static_cast<uint64> (carry);
+                carry >>= 64;
+            }
+            return carry != 0;
+        }
+        
+        // a -= b, returning the borrow.
+        template <size_t n> constexpr bool subtract (std::array<uint64, n> &a, const std::array<uint64, n> &b) {
+            uint64 borrow = 0;
+            for (size_t i = 0; i < n; i++) {
+                unsigned __int128 d = static_cast<unsigned __int128> (a[i]) - b[i] - borrow;
+                a[i] = static_cast<uint64> (d);
+                borrow = static_cast<uint64> (d >> 64) & 1;
+            }
+            return borrow != 0;
+        }
+        
+        // the lowest n limbs of a * b.
+        template <size_t n> constexpr std::array<uint64, n> multiply (const std::array<uint64, n> &a, const std::array<uint64, n> &b) {
+            std::array<uint64, n> x {};
+            for (size_t i = 0; i < n; i++) {
+                if (a[i] == 0) continue;
+                unsigned __int128 carry = 0;
+                for (size_t j = 0; i + j < n; j++) {
+                    carry += static_cast<unsigned __int128> (a[i]) * b[j] + x[i + j];
+                    x[i + j] = static_cast<uint64> (carry);
+                    carry >>= 64;
+                }
+            }
+            return x;
+        }
+        
+        template <size_t n> constexpr std::array<uint64, n> shift_left (const std::array<uint64, n> &a, unsigned int bits) {
+            std::array<uint64, n> x {};
+            size_t words = bits / 64;
+            unsigned int offset = bits % 64;
+            for (size_t i = n; i > words; i--) {
+                size_t from = i - 1 - words;
+                x[i - 1] = a[from] << offset;
+                if (offset != 0 && from > 0) x[i - 1] |= a[from - 1] >> (64 - offset);
+            }
+            return x;
+        }
+        
+        template <size_t n> constexpr std::array<uint64, n> shift_right (const std::array<uint64, n> &a, unsigned int bits) {
+            std::array<uint64, n> x {};
+            size_t words = bits / 64;
+            unsigned int offset = bits % 64;
+            for (size_t i = 0; i + words < n; i++) {
+                size_t from = i + words;
+                x[i] = a[from] >> offset;
+                if (offset != 0 && from + 1 < n) x[i] |= a[from + 1] << (64 - offset);
+            }
+            return x;
+        }
+        
+        // a / b, which must not be zero, one bit at a time.
+        template <size_t n> constexpr std::array<uint64, n> divide (const std::array<uint64, n> &a, const std::array<uint64, n> &b) {
+            std::array<uint64, n> q {};
+            std::array<uint64, n> r {};
+            for (size_t i = 64 * n; i > 0; i--) {
+                size_t bit = i - 1;
+                
+                // the remainder is less than b, so if it overflows when doubled, it is more than b.
+                bool carry = (r[n - 1] >> 63) != 0;
+                r = shift_left (r, 1);
+                r[0] |= (a[bit / 64] >> (bit % 64)) & 1;
+                if (carry || compare (r, b) >= 0) {
+                    subtract (r, b);
+                    q[bit / 64] |= uint64 (1) << (bit % 64);
+                }
+            }
+            return q;
+        }
+        
+    }
+    
     template <size_t X>
     inline uint<X>::uint (const slice<X> x) {
         std::copy (x.begin (), x.end (), begin ());
@@ -389,15 +557,13 @@ namespace Gigamonkey {
     
     template <size_t X>
     uint<X>::operator N () const {
+        limbs::number<X> x = limbs::load<X> (data ());
         N n (0);
-        int width = X / 4;
-        int i;
-        for (i = width - 1; i > 0; i--) {
-            uint32 step = boost::endian::load_little_u32 (data () + 4 * i);
-            n += step;
-            n <<= 32;
+        for (size_t i = x.size (); i > 1; i--) {
+            n += x[i - 1];
+            n <<= 64;
         }
-        n += uint64 (boost::endian::load_little_u32 (data ()));
+        n += x[0];
         return n;
     }
     
@@ -503,13 +669,15 @@ namespace Gigamonkey {
     
     template <size_t X>
     inline uint<X>& uint<X>::operator <<= (unsigned int shift) {
-        base_uint<bits>::operator <<= (shift);
+        if (shift >= bits) return *this = 0;
+        limbs::store<X> (limbs::shift_left (limbs::load<X> (data ()), shift), data ());
         return *this;
     }
     
     template <size_t X>
     inline uint<X>& uint<X>::operator >>= (unsigned int shift) {
-        base_uint<bits>::operator >>= (shift);
+        if (shift >= bits) return *this = 0;
+        limbs::store<X> (limbs::shift_right (limbs::load<X> (data ()), shift), data ());
         return *this;
     }
     
@@ -525,26 +693,29 @@ namespace Gigamonkey {
     
     template <size_t X>
     inline uint<X>& uint<X>::operator += (const uint &b) {
-        base_uint<bits>::operator += (b);
+        limbs::number<X> x = limbs::load<X> (data ());
+        limbs::add (x, limbs::load<X> (b.data ()));
+        limbs::store<X> (x, data ());
         return *this;
     }
     
     template <size_t X>
     inline uint<X>& uint<X>::operator -= (const uint &b) {
-        base_uint<bits>::operator -= (b);
+        limbs::number<X> x = limbs::load<X> (data ());
+        limbs::subtract (x, limbs::load<X> (b.data ()));
+        limbs::store<X> (x, data ());
         return *this;
     }
     
     template <size_t X>
     inline uint<X>& uint<X>::operator *= (const uint &b) {
-        base_uint<bits>::operator *= (b);
+        limbs::store<X> (limbs::multiply (limbs::load<X> (data ()), limbs::load<X> (b.data ())), data ());
         return *this;
     }
     
     template <size_t X>
     inline uint<X>& uint<X>::operator ++ () {
-        base_uint<bits>::operator ++ ();
-        return *this;
+        return *this += uint {1};
     }
     
     template <size_t X>
@@ -557,8 +728,7 @@ namespace Gigamonkey {
     
     template <size_t X>
     inline uint<X>& uint<X>::operator -- () {
-        base_uint<bits>::operator -- ();
-        return *this;
+        return *this -= uint {1};
     }
     
     template <size_t X>
@@ -586,15 +756,15 @@ namespace Gigamonkey {
     }
     
     template <size_t X> uint<X> inline uint<X>::operator + (const uint<X> &b) {
-        return base_uint<bits> (*this) += b;
+        return uint<X> (*this) += b;
     }
     
     template <size_t X> uint<X> inline uint<X>::operator - (const uint<X> &b) {
-        return base_uint<bits> (*this) -= b;
+        return uint<X> (*this) -= b;
     }
     
     template <size_t X> uint<X> inline uint<X>::operator * (const uint &b) {
-        return base_uint<bits> (*this) *= b;
+        return uint<X> (*this) *= b;
     }
     
     template <size_t X> math::division<uint<X>>  inline uint<X>::divide (const uint &u) const {
@@ -647,6 +817,30 @@ namespace Gigamonkey {
         return begin ();
     }
     
+    template <size_t X> bool inline operator == (const uint<X> &a, const uint<X> &b) {
+        return std::memcmp (a.data (), b.data (), X) == 0;
+    }
+    
+    template <size_t X> bool inline operator != (const uint<X> &a, const uint<X> &b) {
+        return !(a == b);
+    }
+    
+    template <size_t X> bool inline operator <= (const uint<X> &a, const uint<X> &b) {
+        return limbs::compare<X> (a.data (), b.data ()) <= 0;
+    }
+    
+    template <size_t X> bool inline operator >= (const uint<X> &a, const uint<X> &b) {
+        return limbs::compare<X> (a.data (), b.data ()) >= 0;
+    }
+    
+    template <size_t X> bool inline operator < (const uint<X> &a, const uint<X> &b) {
+        return limbs::compare<X> (a.data (), b.data ()) < 0;
+    }
+    
+    template <size_t X> bool inline operator > (const uint<X> &a, const uint<X> &b) {
+        return limbs::compare<X> (a.data (), b.data ()) > 0;
+    }
+    
     template <size_t X> size_t uint<X>::serialized_size () const {
         size_t last_0 = 0;
         for (size_t i = 0; i < X; i++) if ((*this)[i] != 0x00) last_0 = i + 1;
@@ -0,0 +1,116 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_P2P_BLOCK_FILTER
+#define GIGAMONKEY_P2P_BLOCK_FILTER
+
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/spv.hpp>
+
+#include <span>
+#include <vector>
+
+// Compact block filters as in BIP 158. The basic filter of a block is a
+// Golomb-coded set of the output scripts of the block and of the scripts
+// of the outputs that it spends, so that a light client can tell whether
+// a block might concern it without downloading it or telling anyone what
+// it is looking for. Each element is hashed with SipHash keyed with the
+// block hash and the hashes are sorted and written as Golomb-Rice coded
+// differences.
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    // the parameters of the basic filter.
+    constexpr uint32 basic_filter_P = 19;
+    constexpr uint64 basic_filter_M = 784931;
+    
+    struct block_filter {
+        digest256 Block;
+        
+        // the number of elements.
+        uint64 N;
+        
+        // the coded differences.
+        bytes Data;
+        
+        // as in a cfilter message: N as a var_int followed by Data.
+        explicit operator bytes () const;
+        static maybe<block_filter> read (const digest256 &block, bytes_view);
+        
+        // the hash of the serialized filter.
+        digest256 hash () const;
+        
+        // commits to this filter and, through previous, to every filter before it.
+        digest256 header (const digest256 &previous) const;
+        
+        bool match (bytes_view script) const;
+        
+        // whether any of the scripts might be in the filter. The scripts are hashed
+        // and sorted and then compared to the filter as it is decoded, so the
+        // filter is only read once however many there are.
+        bool match_any (std::span<const bytes_view> scripts) const;
+    };
+    
+    // Build a filter while a block is being read. Spent scripts must be
+    // given separately since they are not in the block, and they may be
+    // given at any time after the header.
+    struct block_filter_builder final : block_reader {
+        explicit block_filter_builder (size_t max_part_size = 1 << 30) :
+            block_reader {max_part_size}, Block {}, K0 {0}, K1 {0}, Hashes {} {}
+        
+        void receive_header (const Bitcoin::header &, uint64 transactions) override;
+        void receive_transaction (const transaction_view &) override;
+        
+        void spent (bytes_view script);
+        
+        // call when the block is complete and every spent script has been given.
+        block_filter finish ();
+    
+    private:
+        digest256 Block;
+        uint64 K0;
+        uint64 K1;
+        
+        // the SipHash of every element.
+        std::vector<uint64> Hashes;
+        
+        void add (bytes_view script);
+    };
+    
+    // spent is the script of every output spent by the block, in any order.
+    block_filter basic_filter (const block_view &, std::span<const bytes_view> spent);
+    
+    // The chain of filter headers, which a light client follows together with
+    // the block headers. A filter is accepted if its block is in the headers
+    // and comes right after the block of the last filter.
+    struct filter_headers {
+        explicit filter_headers (const headers &h) : Headers {h}, Blocks {}, FilterHeaders {} {}
+        
+        bool insert (const block_filter &);
+        
+        // the number of filters.
+        uint64 size () const {
+            return FilterHeaders.size ();
+        }
+        
+        // by height from the first filter inserted.
+        const digest256 &operator [] (uint64 i) const {
+            return FilterHeaders[i];
+        }
+        
+        // the filter header of the last filter, or zero if there is none.
+        digest256 latest () const {
+            return FilterHeaders.empty () ? digest256 {} : FilterHeaders.back ();
+        }
+        
+        // remove every filter header after the first n, to follow a reorg.
+        void truncate (uint64 n);
+    
+    private:
+        const headers &Headers;
+        std::vector<digest256> Blocks;
+        std::vector<digest256> FilterHeaders;
+    };
+    
+}
+
+#endif
@@ -40,6 +40,39 @@ namespace Gigamonkey::base58 {
 
 }
 
+namespace Gigamonkey::base58 {
+
+    // Base 58 check for data of a fixed size, which is how addresses (21 bytes
+    // before the checksum) and WIF keys (33 or 34 bytes) are written. The result
+    // is the same as with check, but numbers are divided by 58^5 at a time
+    // with 64 bit arithmetic and nothing is allocated except for the strings
+    // that are returned. Instantiated for 21, 33, 34 and 78 bytes, the last
+    // of which is a BIP 32 extended key.
+    template <size_t size> struct fixed_check {
+        // the longest a string with this much data can be.
+        static constexpr size_t MaxEncodedSize = 2 * (size + 4);
+
+        // write to out, which must have room for MaxEncodedSize characters,
+        // and return the number of characters written.
+        static size_t encode (const byte *in, char *out);
+        static std::string encode (const byte_array<size> &);
+
+        // false if the string is not base 58 check with exactly size bytes of data.
+        static bool decode (string_view, byte *out);
+        static maybe<byte_array<size>> decode (string_view);
+
+        static std::vector<std::string> encode (const std::vector<byte_array<size>> &);
+        static std::vector<maybe<byte_array<size>>> decode (const std::vector<string_view> &);
+
+        // the same except that the checksum is not computed or checked. in and
+        // out are size + 4 bytes with the checksum at the end. These are for
+        // computing many checksums at once.
+        static size_t write (const byte *in, char *out);
+        static bool read (string_view, byte *out);
+    };
+
+}
+
 namespace Gigamonkey::Bitcoin {
 
     // A Bitcoin checksum takes the hash256 value of a string
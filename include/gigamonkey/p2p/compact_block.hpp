@@ -0,0 +1,150 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_P2P_COMPACT_BLOCK
+#define GIGAMONKEY_P2P_COMPACT_BLOCK
+
+#include <gigamonkey/view.hpp>
+
+#include <deque>
+#include <span>
+#include <vector>
+
+// Compact blocks as in BIP 152. A compact block has the header and a 6 byte
+// short id for each transaction, so a peer that already has the transactions
+// can put the block back together, and ask with getblocktxn for the ones that
+// it does not have. Short ids are the SipHash-2-4 of the txid with a key made
+// from the header and a nonce.
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    uint64 siphash (uint64 k0, uint64 k1, const digest256 &);
+    uint64 siphash (uint64 k0, uint64 k1, bytes_view);
+    
+    // only the lower 48 bits are used.
+    using short_id = uint64;
+    
+    constexpr short_id short_id_mask = (uint64 {1} << 48) - 1;
+    
+    // the SipHash key made from a header and a nonce, which is worth keeping
+    // when many short ids are computed for the same block.
+    struct short_id_key {
+        uint64 K0;
+        uint64 K1;
+        
+        short_id_key (const Bitcoin::header &, uint64 nonce);
+        
+        short_id operator () (const txid &) const;
+    };
+    
+    struct prefilled_transaction {
+        // the position of the transaction in the block.
+        uint64 Index;
+        bytes Transaction;
+    };
+    
+    // the payload of a cmpctblock message.
+    struct compact_block {
+        Bitcoin::header Header;
+        uint64 Nonce;
+        std::vector<short_id> ShortIDs;
+        
+        // in order of their indices. The coinbase is always sent.
+        std::vector<prefilled_transaction> Prefilled;
+        
+        // the coinbase and the transactions at the positions in prefill are sent whole.
+        static compact_block make (const block_view &, uint64 nonce, std::span<const size_t> prefill = {});
+        
+        // the number of transactions in the block.
+        size_t size () const {
+            return ShortIDs.size () + Prefilled.size ();
+        }
+        
+        // the key is made again each time, so use short_id_key for many ids.
+        short_id id (const txid &) const;
+        
+        explicit operator bytes () const;
+        
+        // nothing if b is not a compact block.
+        static maybe<compact_block> read (bytes_view b);
+    };
+    
+    // the payload of getblocktxn.
+    struct block_transactions_request {
+        digest256 Block;
+        
+        // in increasing order.
+        std::vector<uint64> Indices;
+        
+        explicit operator bytes () const;
+        static maybe<block_transactions_request> read (bytes_view);
+    };
+    
+    // the payload of blocktxn.
+    struct block_transactions {
+        digest256 Block;
+        std::vector<bytes> Transactions;
+        
+        explicit operator bytes () const;
+        static maybe<block_transactions> read (bytes_view);
+        
+        // the transactions that r asks for from b.
+        static block_transactions make (const block_view &b, const block_transactions_request &r);
+    };
+    
+    // a transaction that the caller already has.
+    struct mempool_entry {
+        txid ID;
+        bytes_view Transaction;
+    };
+    
+    // A block put together from a compact block and transactions that are already
+    // known. The transactions are not copied until the block is assembled, so the
+    // mempool must last until then.
+    class partial_block {
+    public:
+        partial_block (const compact_block &, std::span<const mempool_entry> mempool);
+        
+        // false if the compact block can't be used, because two of its short
+        // ids are the same or a prefilled index is too big. Ask for the whole block.
+        bool valid () const {
+            return Valid;
+        }
+        
+        // the indices of transactions that we don't have. A short id that matches
+        // more than one transaction in the mempool is counted as missing.
+        std::vector<uint64> missing () const;
+        
+        block_transactions_request request () const;
+        
+        // false if the response does not have one transaction for each missing index.
+        bool fill (const block_transactions &);
+        
+        bool complete () const {
+            return Valid && Missing == 0;
+        }
+        
+        // put the block together and check its merkle root on the threads of e.
+        // The view is invalid if the root is wrong, as it would be if two
+        // transactions had the same short id. It refers to data owned by this.
+        block_view assemble (executor &e);
+        block_view assemble ();
+    
+    private:
+        Bitcoin::header Header;
+        bool Valid;
+        size_t Missing;
+        
+        // views of the transactions in the block, which are either in
+        // the mempool or in Owned. Missing transactions are empty.
+        std::vector<bytes_view> Transactions;
+        std::deque<bytes> Owned;
+        
+        bytes Serialized;
+        
+        void serialize ();
+        block_view check (executor *);
+    };
+    
+}
+
+#endif
@@ -15,7 +15,7 @@ namespace Gigamonkey::Bitcoin {
 	  public:
 		constexpr string () : m_data ({}) {}
 		constexpr string (std::string_view str) {
-			for (int i=0; i< str.size(); i++) m_data[i] = str[i];
+			for (std::size_t i=0; i< str.size() && i < Size; i++) m_data[i] = str[i];
 		}
 		
 		constexpr  char const* data () const { return m_data;}
@@ -23,6 +23,19 @@ namespace Gigamonkey::Bitcoin {
 		constexpr char const& operator[] (std::size_t i) const { return m_data[i];}
 		constexpr const char* begin () const { return std::begin (m_data);}
 		constexpr const char* end () const { return std::end (m_data);}
+		
+		// the characters before the first null.
+		constexpr std::string_view view () const {
+			std::size_t n = 0;
+			while (n < Size && m_data[n] != 0) n++;
+			return std::string_view {m_data, n};
+		}
+		
+		// compare every character, not the pointers that a string converts to.
+		constexpr bool operator == (const string &x) const {
+			for (std::size_t i = 0; i < Size; i++) if (m_data[i] != x.m_data[i]) return false;
+			return true;
+		}
 	};
 }
 
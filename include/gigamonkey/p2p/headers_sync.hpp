@@ -0,0 +1,159 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_P2P_HEADERS_SYNC
+#define GIGAMONKEY_P2P_HEADERS_SYNC
+
+#include <gigamonkey/p2p/message.hpp>
+#include <gigamonkey/spv.hpp>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Keep a headers store up to date from the peer-to-peer network without a
+// full node. The client does the handshake with several peers, asks one of
+// them for headers with getheaders and a locator made from the store, and
+// asks for the next batch as soon as one arrives, before it has been checked.
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    constexpr int32 protocol_version = 70016;
+    
+    // the most headers that a peer sends in one message.
+    constexpr size_t max_headers = 2000;
+    
+    struct version_message {
+        int32 Version;
+        uint64 Services;
+        int64 Timestamp;
+        uint64 Nonce;
+        std::string UserAgent;
+        int32 StartHeight;
+        bool Relay;
+        
+        // the addresses are written as zeros.
+        explicit operator bytes () const;
+        
+        // nothing if the payload cannot be read.
+        static maybe<version_message> read (const segments &payload);
+    };
+    
+    bytes getheaders_payload (std::span<const digest256> locator, const digest256 &stop = digest256 {});
+    
+    bytes headers_payload (std::span<const Bitcoin::header>);
+    
+    // nothing if the payload is not a list of at most max_headers headers.
+    maybe<std::vector<Bitcoin::header>> read_headers (const segments &payload);
+    
+    // hashes of the best chain from the tip down, ten in a row and then twice
+    // as far apart each time, always ending with the first header in the store.
+    std::vector<digest256> locator (const headers &);
+    
+    // Check headers from a peer and add them to a store. The headers must
+    // connect to each other and the first must follow a header in the store.
+    // Their proof of work is checked with validate_chain, on the threads of
+    // the executor if there is one.
+    struct headers_sync {
+        struct result {
+            size_t Received;
+            // headers that were not already in the store.
+            size_t Inserted;
+            // the peer sent headers that are not valid or do not connect.
+            bool Invalid;
+        };
+        
+        headers &Store;
+        executor *Executor;
+        
+        explicit headers_sync (headers &h, executor *e = nullptr) : Store {h}, Executor {e} {}
+        
+        result receive (std::span<const Bitcoin::header>);
+    };
+    
+    // Runs on its own thread and writes to the store from it. Use lock ()
+    // to read the store while the client is running.
+    struct headers_client {
+        struct options {
+            uint32 Magic {magic::main};
+            std::string UserAgent {"/Gigamonkey:0.0.1/"};
+            
+            // a request that has not been answered in this time has stalled, and
+            // the next request goes to the fastest of the other peers.
+            std::chrono::milliseconds StallTimeout {std::chrono::seconds {10}};
+            
+            // how often to ask for new headers once we have caught up.
+            std::chrono::milliseconds Poll {std::chrono::seconds {30}};
+            
+            // how long to wait before connecting to a peer again.
+            std::chrono::milliseconds Reconnect {std::chrono::seconds {30}};
+            
+            executor *Executor {nullptr};
+            
+            // called on the client's thread after every headers message.
+            std::function<void (const headers_sync::result &)> OnHeaders {};
+        };
+        
+        headers_client (headers &, std::vector<boost::asio::ip::tcp::endpoint> peers, options);
+        headers_client (headers &h, std::vector<boost::asio::ip::tcp::endpoint> peers) :
+            headers_client {h, peers, options {}} {}
+        
+        ~headers_client ();
+        
+        headers_client (const headers_client &) = delete;
+        headers_client &operator = (const headers_client &) = delete;
+        
+        // held while the store is written.
+        std::unique_lock<std::mutex> lock () const {
+            return std::unique_lock<std::mutex> {Mutex};
+        }
+        
+        // peers that have finished the handshake.
+        size_t ready () const;
+        
+        // the last headers message had fewer than max_headers headers.
+        bool synced () const {
+            return Synced.load ();
+        }
+        
+        struct peer;
+    
+    private:
+        headers &Store;
+        const options Options;
+        
+        mutable std::mutex Mutex;
+        headers_sync Sync;
+        
+        std::atomic<bool> Synced {false};
+        std::atomic<size_t> Ready {0};
+        
+        boost::asio::io_context IO;
+        boost::asio::steady_timer Timer;
+        std::vector<ptr<peer>> Peers;
+        
+        // the peer that we are waiting for and when we asked.
+        peer *Active {nullptr};
+        std::chrono::steady_clock::time_point Requested {};
+        
+        std::thread Thread;
+        
+        friend struct peer;
+        
+        void tick ();
+        void request (peer *, std::vector<digest256> locator);
+        void request ();
+        void receive (peer &, const std::vector<Bitcoin::header> &);
+        void handshake (peer &);
+        void closed (peer &);
+        
+        // the fastest peer that is ready other than p.
+        peer *fastest (const peer *p) const;
+    };
+    
+}
+
+#endif
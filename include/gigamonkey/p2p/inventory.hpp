@@ -0,0 +1,159 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_P2P_INVENTORY
+#define GIGAMONKEY_P2P_INVENTORY
+
+#include <gigamonkey/p2p/message.hpp>
+#include <gigamonkey/timechain.hpp>
+
+#include <chrono>
+#include <mutex>
+
+// Relay of transactions to peers with inv messages. Instead of an inv for
+// every transaction, the txids for each peer are saved up and sent together
+// when a timer for that peer goes off. The timers are random so that the
+// order in which peers learn of a transaction says little about where it
+// came from. A filter for each peer remembers what it already knows so
+// that nothing is announced to a peer twice, and getdata is answered from
+// a cache of transactions shared by all peers.
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    // an entry in an inv, getdata or notfound message.
+    struct inventory {
+        enum type : uint32 {
+            error = 0,
+            transaction = 1,
+            block = 2,
+            filtered_block = 3,
+            compact_block = 4
+        };
+        
+        type Type;
+        digest256 Hash;
+        
+        static constexpr size_t serialized_size = 36;
+    };
+    
+    bool inline operator == (const inventory &a, const inventory &b) {
+        return a.Type == b.Type && a.Hash == b.Hash;
+    }
+    
+    // the most entries in one inv message.
+    constexpr size_t max_inventory = 50000;
+    
+    bytes inventory_payload (std::span<const inventory>);
+    
+    // nothing if the payload is not a list of at most max_inventory entries.
+    maybe<std::vector<inventory>> read_inventory (const segments &payload);
+    
+    // A Bloom filter that forgets the oldest entries as new ones are added,
+    // so that it can be used forever with constant memory. The last elements
+    // entries are always remembered and at most 1.5 times that many. Entries
+    // record one of three generations in two bits, and every time that half
+    // of elements entries have been added, the oldest generation is cleared.
+    struct rolling_bloom_filter {
+        rolling_bloom_filter (uint32 elements, double false_positive_rate);
+        
+        void insert (const digest256 &);
+        bool contains (const digest256 &) const;
+        
+        void reset ();
+    
+    private:
+        uint32 EntriesPerGeneration;
+        uint32 EntriesThisGeneration;
+        uint32 Generation;
+        uint32 HashFunctions;
+        
+        // random keys so that peers can't choose txids that collide.
+        uint64 K0;
+        uint64 K1;
+        
+        std::vector<uint64> Data;
+        
+        uint64 hash (uint32 n, const digest256 &) const;
+    };
+    
+    // Decides what to tell each peer about and when. This class does no
+    // networking. Call flush for each peer when next says that it is due and
+    // send what it returns in an inv message. It is safe to use from more than
+    // one thread.
+    struct relay {
+        using clock = std::chrono::steady_clock;
+        using peer_id = uint64;
+        
+        struct options {
+            // the average time between announcements to one peer.
+            std::chrono::milliseconds Interval {std::chrono::seconds {5}};
+            
+            // the most txids in one announcement. The rest wait for the next one.
+            size_t MaxBatch {max_inventory};
+            
+            // how many txids to remember for each peer.
+            uint32 KnownInventory {50000};
+            
+            // how long getdata for a transaction is answered after it is broadcast.
+            std::chrono::milliseconds Expire {std::chrono::minutes {15}};
+        };
+        
+        relay (options o) : Options {o} {}
+        relay () : relay {options {}} {}
+        
+        // peers start with no inventory and their first announcement is one interval away.
+        void add_peer (peer_id, clock::time_point now);
+        void remove_peer (peer_id);
+        
+        // false if the transaction is already being relayed.
+        bool broadcast (const shared_transaction &, clock::time_point now);
+        
+        // a peer told us about these, so it need not hear about them from us.
+        void known (peer_id, std::span<const inventory>);
+        
+        // when the next announcement to the peer is due.
+        clock::time_point next (peer_id) const;
+        
+        // The txids to announce if the peer is due, which are then known to
+        // the peer. Empty if it is not due or there is nothing to announce.
+        std::vector<inventory> flush (peer_id, clock::time_point now);
+        
+        struct response {
+            // send each in a tx message.
+            std::vector<shared_transaction> Transactions;
+            
+            // send in a notfound message.
+            std::vector<inventory> NotFound;
+        };
+        
+        response get_data (std::span<const inventory>) const;
+        
+        // remove transactions that have been in the cache longer than Options.Expire.
+        void expire (clock::time_point now);
+        
+        size_t cached () const;
+    
+    private:
+        struct peer {
+            rolling_bloom_filter Known;
+            std::vector<txid> Queue;
+            clock::time_point Next;
+        };
+        
+        struct entry {
+            shared_transaction Transaction;
+            clock::time_point Expires;
+        };
+        
+        const options Options;
+        
+        mutable std::mutex Mutex;
+        hash_map<txid, entry> Cache;
+        hash_map<peer_id, peer> Peers;
+        
+        // a random time from now with an exponential distribution.
+        clock::time_point schedule (clock::time_point now) const;
+    };
+    
+}
+
+#endif
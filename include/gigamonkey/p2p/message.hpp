@@ -0,0 +1,185 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_P2P_MESSAGE
+#define GIGAMONKEY_P2P_MESSAGE
+
+#include <gigamonkey/p2p/header_string.hpp>
+#include <gigamonkey/p2p/var_int.hpp>
+
+#include <array>
+#include <span>
+#include <vector>
+
+// The framing of Bitcoin peer-to-peer messages. Every message begins with a
+// 24 byte header that has the network magic, the command, the length of
+// the payload and the first four bytes of the double SHA-256 of the payload.
+// Payloads of 4GB or more are sent with the extended format, in which the
+// command is extmsg, the length is 0xffffffff and the checksum is zero, and
+// then the real command and a 64 bit length follow. Extended messages
+// have no checksum.
+//
+// Messages are read in place from data that may wrap around the end of a
+// ring buffer. Only the header is copied.
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    using command = Bitcoin::string<12>;
+    
+    // network magic numbers as they are read from the wire as a little-endian 32 bit number.
+    namespace magic {
+        constexpr uint32 main = 0xe8f3e1e3;
+        constexpr uint32 test = 0xf4f3e5f4;
+        constexpr uint32 regtest = 0xfabfb5da;
+        constexpr uint32 STN = 0xf9c4cefb;
+    }
+    
+    // data that is in one or two pieces, such as the readable part of a
+    // ring buffer that has wrapped around. Second follows First.
+    struct segments {
+        bytes_view First;
+        bytes_view Second;
+        
+        segments () : First {}, Second {} {}
+        segments (bytes_view a, bytes_view b = {}) : First {a}, Second {b} {}
+        
+        size_t size () const {
+            return First.size () + Second.size ();
+        }
+        
+        byte operator [] (size_t i) const {
+            return i < First.size () ? First[i] : Second[i - First.size ()];
+        }
+        
+        // n bytes starting from position i. Throws std::out_of_range if there are not enough.
+        segments substr (size_t i, size_t n) const;
+        
+        // copy size () bytes to out.
+        void copy (byte *out) const;
+        
+        explicit operator bytes () const;
+    };
+    
+    struct header {
+        static constexpr size_t size = 24;
+        
+        // the size of the header of an extended message.
+        static constexpr size_t extended_size = size + 20;
+        
+        static constexpr uint32 extended_length = 0xffffffff;
+        
+        static constexpr command extended_command {"extmsg"};
+        
+        uint32_little Magic;
+        command Command;
+        uint64 Length;
+        Gigamonkey::checksum Checksum;
+        
+        bool extended () const {
+            return Length >= extended_length;
+        }
+        
+        size_t serialized_size () const {
+            return extended () ? extended_size : size;
+        }
+        
+        // the header of a message with the given payload, whose checksum is computed.
+        static header make (uint32 magic, const command &, const segments &payload);
+        
+        // write serialized_size () bytes to out.
+        void write (byte *out) const;
+    };
+    
+    bool operator == (const header &, const header &);
+    
+    // a message in data that it does not own.
+    struct message_view {
+        p2p::header Header;
+        segments Payload;
+        
+        // the size of the whole message, header included.
+        uint64 serialized_size () const {
+            return Header.serialized_size () + Payload.size ();
+        }
+        
+        bool checksum_valid () const;
+    };
+    
+    // a whole message with the header.
+    bytes write (uint32 magic, const command &, bytes_view payload);
+    
+    // the checksum of data in pieces.
+    Gigamonkey::checksum checksum (const segments &);
+    
+    // check many checksums at once. Short payloads of the same size, such as
+    // pings and pongs, are hashed together with the multi-buffer SHA-256 kernel.
+    // Extended messages have no checksum and so are always true.
+    std::vector<bool> checksums_valid (std::span<const message_view>);
+    
+    struct decoder {
+        enum status : byte {
+            // there is not yet a whole message.
+            incomplete,
+            message,
+            wrong_magic,
+            // the command has characters after a null.
+            invalid_command,
+            too_big,
+            invalid_checksum
+        };
+        
+        uint32 Magic;
+        
+        // messages with longer payloads are rejected as soon as their headers are read.
+        uint64 MaxPayload;
+        
+        // whether to check the checksum, which can be done later with checksums_valid.
+        bool CheckChecksum;
+        
+        explicit decoder (uint32 m, uint64 max_payload = uint64 {1} << 32, bool check = true) :
+            Magic {m}, MaxPayload {max_payload}, CheckChecksum {check} {}
+        
+        // read the message at the front of data. If the result is message,
+        // m refers to data and its serialized_size () bytes can be consumed.
+        // If it is incomplete, more data is needed. Anything else means
+        // that the connection should be dropped.
+        status read (const segments &data, message_view &m) const;
+    };
+    
+    const char *name (decoder::status);
+    
+    // A table of commands in a fixed order that is made at compile time. dispatch
+    // calls the handler in the same position as the command of a message.
+    template <size_t n> struct commands {
+        std::array<command, n> Commands;
+        
+        constexpr commands (std::array<command, n> x) : Commands {x} {}
+        
+        // the position of c or n if it is not in the table.
+        constexpr size_t find (const command &c) const {
+            for (size_t i = 0; i < n; i++) if (Commands[i] == c) return i;
+            return n;
+        }
+        
+        // false if the command is not in the table.
+        template <typename... handlers>
+        bool dispatch (const message_view &m, handlers &&...h) const {
+            static_assert (sizeof... (handlers) == n, "one handler is needed for each command");
+            size_t i = find (m.Header.Command);
+            if (i == n) return false;
+            size_t j = 0;
+            ((j++ == i ? (h (m), true) : false) || ...);
+            return true;
+        }
+    };
+    
+    template <typename... X> constexpr commands<sizeof... (X)> inline make_commands (X... x) {
+        return commands<sizeof... (X)> {std::array<command, sizeof... (X)> {command {x}...}};
+    }
+    
+    bool inline operator == (const header &a, const header &b) {
+        return a.Magic == b.Magic && a.Command == b.Command && a.Length == b.Length && a.Checksum == b.Checksum;
+    }
+    
+}
+
+#endif
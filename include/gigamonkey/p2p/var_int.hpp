@@ -6,6 +6,11 @@
 
 #include <gigamonkey/types.hpp>
 
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <vector>
+
 // types that are used for reading and writing serialized formats. 
 namespace Gigamonkey::Bitcoin {
     
@@ -24,6 +29,11 @@ namespace Gigamonkey::Bitcoin {
     template <typename X> writer inline &operator << (writer &w, const var_sequence<X> &x);
     template <typename X> reader inline &operator >> (reader &r, var_sequence<X> &x);
     
+    template <typename X> struct var_vector;
+    
+    template <typename X> writer inline &operator << (writer &w, const var_vector<X> &x);
+    template <typename X> reader inline &operator >> (reader &r, var_vector<X> x);
+    
     struct var_int {
         uint64 Value;
         
@@ -50,6 +60,107 @@ namespace Gigamonkey::Bitcoin {
         return r;
     }
     
+    // Writers and readers over raw memory for the serializers that are used
+    // most, which do not go through the virtual writer and reader. Bounds
+    // are checked with check, once for each part whose size is known, and
+    // the fields in it are written or read without checking again.
+    struct write_cursor {
+        byte *It;
+        byte *End;
+        
+        // throws data::end_of_stream if there is not room for n more bytes.
+        void check (size_t n) const {
+            if (static_cast<size_t> (End - It) < n) throw data::end_of_stream {};
+        }
+        
+        void put (const byte *b, size_t n) {
+            std::memcpy (It, b, n);
+            It += n;
+        }
+        
+        void put (bytes_view b) {
+            put (b.data (), b.size ());
+        }
+        
+        template <std::integral X> void put_little (X x) {
+            using U = std::make_unsigned_t<X>;
+            U u = static_cast<U> (x);
+            for (size_t i = 0; i < sizeof (X); i++) *It++ = static_cast<byte> (u >> (8 * i));
+        }
+        
+        void put_var_int (uint64 x) {
+            if (x <= 0xfc) put_little (static_cast<byte> (x));
+            else if (x <= 0xffff) {
+                *It++ = 0xfd;
+                put_little (static_cast<uint16> (x));
+            } else if (x <= 0xffffffff) {
+                *It++ = 0xfe;
+                put_little (static_cast<uint32> (x));
+            } else {
+                *It++ = 0xff;
+                put_little (x);
+            }
+        }
+        
+        void put_var_string (bytes_view b) {
+            put_var_int (b.size ());
+            put (b);
+        }
+    };
+    
+    struct read_cursor {
+        const byte *It;
+        const byte *End;
+        
+        void check (size_t n) const {
+            if (static_cast<size_t> (End - It) < n) throw data::end_of_stream {};
+        }
+        
+        void get (byte *b, size_t n) {
+            std::memcpy (b, It, n);
+            It += n;
+        }
+        
+        void skip (size_t n) {
+            It += n;
+        }
+        
+        template <std::integral X> X get_little () {
+            using U = std::make_unsigned_t<X>;
+            U u = 0;
+            for (size_t i = 0; i < sizeof (X); i++) u |= static_cast<U> (It[i]) << (8 * i);
+            It += sizeof (X);
+            return static_cast<X> (u);
+        }
+        
+        // var ints check their own bounds.
+        uint64 get_var_int () {
+            check (1);
+            byte b = *It++;
+            if (b <= 0xfc) return b;
+            if (b == 0xfd) {
+                check (2);
+                return get_little<uint16> ();
+            }
+            
+            if (b == 0xfe) {
+                check (4);
+                return get_little<uint32> ();
+            }
+            
+            check (8);
+            return get_little<uint64> ();
+        }
+        
+        bytes get_var_string () {
+            uint64 size = get_var_int ();
+            check (size);
+            bytes b (size);
+            get (b.data (), size);
+            return b;
+        }
+    };
+    
     struct var_string {
         bytes &String;
         
@@ -111,6 +222,49 @@ namespace Gigamonkey::Bitcoin {
         return var_sequence<X>::read (r, x.List);
     }
     
+    // the same as var_sequence for a std::vector.
+    template <typename X>
+    struct var_vector {
+        std::vector<X> &Vector;
+        
+        var_vector (const std::vector<X> &b) : Vector {const_cast<std::vector<X> &> (b)} {};
+        var_vector (std::vector<X> &b) : Vector {b} {};
+        
+        static reader &read (reader &r, std::vector<X> &v) {
+            v.clear ();
+            var_int size;
+            r >> size;
+            
+            // the size has not been checked against the
+            // data yet, so don't trust it with too much memory.
+            v.reserve (std::min (size.Value, uint64 {1} << 16));
+            for (uint64 i = 0; i < size.Value; i++) {
+                X x;
+                r >> x;
+                v.push_back (std::move (x));
+            }
+            
+            return r;
+        }
+        
+        static writer &write (writer &w, const std::vector<X> &v) {
+            w << var_int {v.size ()};
+            for (const X &x: v) w << x;
+            return w;
+        }
+    
+    };
+    
+    template <typename X>
+    writer inline &operator << (writer &w, const var_vector<X> &x) {
+        return var_vector<X>::write (w, x.Vector);
+    }
+    
+    template <typename X>
+    reader inline &operator >> (reader &r, var_vector<X> x) {
+        return var_vector<X>::read (r, x.Vector);
+    }
+    
 }
 
 #endif 
@@ -0,0 +1,59 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_POLICY
+#define GIGAMONKEY_POLICY
+
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/fees.hpp>
+
+// Checks that a node makes on a transaction before it relays it or puts it
+// in the mempool, which do not need its scripts to be run. A transaction that
+// fails them is rejected before any expensive work is done on it.
+namespace Gigamonkey::policy {
+    
+    enum reason : byte {
+        standard,
+        
+        // the transaction could not be read.
+        invalid,
+        
+        version,
+        too_big,
+        script_sig_size,
+        script_sig_not_push_only,
+        
+        // an output script does not match any of the standard templates.
+        script_pubkey,
+        dust
+    };
+    
+    std::ostream &operator << (std::ostream &, reason);
+    
+    struct limits {
+        int32 MinVersion {1};
+        int32 MaxVersion {2};
+        
+        uint64 MaxSize {DEFAULT_MAX_TX_SIZE_POLICY_AFTER_GENESIS};
+        uint64 MaxScriptSigSize {DEFAULT_MAX_SCRIPT_SIZE_POLICY_AFTER_GENESIS};
+        
+        // An output that is not OP_RETURN is dust if spending it would cost more
+        // than a third of its value at this rate, counting it together with the
+        // 148 bytes of the input that would spend it.
+        satoshi_per_byte DustRelayFee {Bitcoin::satoshi {250}, 1000};
+        
+        // whether input scripts must contain only pushes, as they must after genesis.
+        bool PushOnly {true};
+    };
+    
+    // The output scripts must be P2PKH, P2PK or OP_RETURN. The transaction is
+    // scanned once, the reason for the first check that fails is returned, and
+    // nothing is allocated.
+    reason check_standard (const Bitcoin::transaction_view &, const limits & = {});
+    
+    // whether an output is too small to be worth spending.
+    bool is_dust (const Bitcoin::output_view &, const limits & = {});
+    
+}
+
+#endif
@@ -0,0 +1,20 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_RIPEMD160
+#define GIGAMONKEY_RIPEMD160
+
+#include <gigamonkey/types.hpp>
+
+// A RIPEMD-160 kernel for the second half of Hash160, where the message is
+// always a 32-byte SHA-256 digest. The message and its padding fit in one
+// block, so each digest is a single transform, and several are done at once.
+namespace Gigamonkey::ripemd160 {
+    
+    // RIPEMD-160 of count 32-byte messages stored contiguously.
+    // 20 * count bytes are written to out.
+    void hash_32 (byte *out, const byte *in, size_t count);
+    
+}
+
+#endif
@@ -0,0 +1,96 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCAN
+#define GIGAMONKEY_SCAN
+
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/executor.hpp>
+
+// Find the outputs of a block that pay to a large set of watched addresses.
+// Every P2PKH, P2PK and P2SH output gives a digest160 (for P2PK, the Hash160
+// of the pubkey, which is its address) that is checked against a filter and,
+// if the filter says it might be there, against the exact set.
+namespace Gigamonkey {
+    
+    // What a wallet watches for. may_contain is called for every candidate and
+    // may have false positives. contains is only called for those that pass and
+    // must be exact. Both are called from many threads at once.
+    struct watch_list {
+        virtual bool may_contain (const digest160 &) const = 0;
+        virtual bool contains (const digest160 &) const = 0;
+        virtual ~watch_list () {}
+    };
+    
+    // A Bloom filter of digests. The bits of the digests are used as they are 
+    // rather than hashed again, so someone who wants to make false positives can, 
+    // but they only cost a look in the exact set.
+    struct bloom_filter {
+        bloom_filter (uint64 elements, double false_positive_rate);
+        
+        void insert (const digest160 &);
+        bool contains (const digest160 &) const;
+    
+    private:
+        uint32 HashFunctions;
+        uint64 Bits;
+        std::vector<uint64> Data;
+    };
+    
+    // a Bloom filter in front of a hash set.
+    struct watched_addresses final : watch_list {
+        watched_addresses (uint64 expected, double false_positive_rate = 0.001) : Filter {expected, false_positive_rate}, Addresses {} {}
+        
+        void insert (const digest160 &d) {
+            Filter.insert (d);
+            Addresses.insert (d);
+        }
+        
+        size_t size () const {
+            return Addresses.size ();
+        }
+        
+        bool may_contain (const digest160 &d) const override {
+            return Filter.contains (d);
+        }
+        
+        bool contains (const digest160 &d) const override {
+            return Addresses.contains (d);
+        }
+    
+    private:
+        struct hasher {
+            size_t operator () (const digest160 &d) const;
+        };
+        
+        bloom_filter Filter;
+        hash_set<digest160, hasher> Addresses;
+    };
+    
+    struct output_match {
+        enum kind : byte {
+            address,
+            pubkey,
+            script_hash
+        };
+        
+        // the index of the transaction in the block and of the output in the transaction.
+        uint32 Transaction;
+        uint32 Output;
+        
+        kind Kind;
+        
+        // the address, the Hash160 of the pubkey or the script hash.
+        digest160 Hash;
+    };
+    
+    // matches in the order of the outputs.
+    std::vector<output_match> scan (const Bitcoin::transaction_view &, const watch_list &, uint32 index = 0);
+    std::vector<output_match> scan (const Bitcoin::block_view &, const watch_list &);
+    
+    // scan the transactions of the block in parallel.
+    std::vector<output_match> scan (const Bitcoin::block_view &, const watch_list &, executor &);
+    
+}
+
+#endif
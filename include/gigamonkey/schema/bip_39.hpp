@@ -6,6 +6,8 @@
 
 #include <gigamonkey/schema/hd.hpp>
 
+#include <array>
+
 // HD is a format for infinite sequences of keys that 
 // can be derived from a single master. This key format
 // will be depricated but needs to be supported for 
@@ -20,11 +22,24 @@ namespace Gigamonkey::HD::BIP_39 {
     
     seed read (std::string words, const string &passphrase = "", language lang = language::english);
     
+    // seeds for many mnemonics with the same passphrase, derived in parallel.
+    std::vector<seed> read (const std::vector<std::string> &words, const string &passphrase, executor &, language lang = language::english);
+    
     std::string generate (entropy, language lang = language::english);
     bool valid (std::string words, language lang = language::english);
     
+    // the words of a language, which are compiled in so that nothing has to be built
+    // before they can be used. Any language but japanese is english.
+    const std::array<std::string_view, 2048> &word_list (language lang = language::english);
+    
+    // the same words as strings, which are made the first time that they are asked for.
     const cross<std::string> &english_words ();
     const cross<std::string> &japanese_words ();
+    
+    const cross<std::string> &words (language lang = language::english);
+    
+    // the position of a word in the list for a language, or nothing if it is not there.
+    maybe<uint32> word_index (std::string_view word, language lang = language::english);
 }
 
 #endif
@@ -5,6 +5,10 @@
 #define GIGAMONKEY_SCHEMA_BIP_44
 
 #include <gigamonkey/schema/bip_39.hpp>
+#include <gigamonkey/schema/hd.hpp>
+
+#include <future>
+#include <span>
 
 // HD is a format for infinite sequences of keys that 
 // can be derived from a single master. This key format
@@ -79,6 +83,64 @@ namespace Gigamonkey::HD::BIP_44 {
         
     };
     
+    // Says which addresses have been used, as a ledger or an indexer would. The answer
+    // may come later, as when the question goes over the network, and the digests stay
+    // where they are until it does. Many questions may be asked before any are answered.
+    struct address_history {
+        virtual std::future<std::vector<bool>> used (std::span<const digest160>) const = 0;
+        virtual ~address_history () {}
+    };
+    
+    struct discovery_options {
+        // a chain is searched until this many addresses in a row have not been used.
+        uint32 GapLimit {20};
+        
+        // how many addresses of a chain are derived and asked about at once.
+        uint32 Batch {64};
+        
+        // how many accounts are searched at once. Since discovery stops at the first
+        // account that has not been used, the last few may be searched for nothing.
+        uint32 Accounts {4};
+        
+        uint32 MaxAccounts {0x80000000};
+        
+        uint32 CoinType {coin_type_Bitcoin};
+        
+        discovery_options () {};
+    };
+    
+    struct account {
+        uint32 Index;
+        
+        // m / 44' / coin type' / account'.
+        BIP_32::pubkey Pubkey;
+        
+        // the indices of used addresses on each chain, in order.
+        std::vector<uint32> Receive;
+        std::vector<uint32> Change;
+        
+        // the first address of each chain after the last one that has been used.
+        uint32 next_receive () const {
+            return Receive.empty () ? 0 : Receive.back () + 1;
+        }
+        
+        uint32 next_change () const {
+            return Change.empty () ? 0 : Change.back () + 1;
+        }
+    };
+    
+    // Search both chains of an account for used addresses. Addresses are derived in
+    // batches with BIP_32::derive_range, on the threads of the executor if one is
+    // given, and a batch from each chain is asked about before waiting for any answer.
+    // Throws std::runtime_error if the history does not answer for every address.
+    account scan (uint32 index, const BIP_32::pubkey &, const address_history &,
+        const discovery_options & = discovery_options {}, executor * = nullptr);
+    
+    // Find accounts 0, 1, 2 and so on until one has no used receive
+    // addresses as described in BIP 44. That one is not returned.
+    std::vector<account> discover (const BIP_32::secret &, const address_history &,
+        const discovery_options & = discovery_options {}, executor * = nullptr);
+    
     // coin types for standard wallets. 
     constexpr uint32 simply_cash_coin_type = coin_type_Bitcoin_Cash;
     
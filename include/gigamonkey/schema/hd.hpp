@@ -5,8 +5,15 @@
 #define GIGAMONKEY_SCHEMA_HD
 
 #include <gigamonkey/wif.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/p2p/checksum.hpp>
 #include "keysource.hpp"
 #include <ostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 // HD is a format for infinite sequences of keys that 
 // can be derived from a single master. This key format
@@ -54,6 +61,12 @@ namespace Gigamonkey::HD {
         
         path read_path (string_view);
         string write (path);
+        
+        // an extended key as it is stored before it is written in base 58 check.
+        constexpr size_t serialized_size = 78;
+        
+        // the longest that an extended key can be when written in base 58 check.
+        constexpr size_t max_string_size = base58::fixed_check<serialized_size>::MaxEncodedSize;
 
         struct pubkey {
             
@@ -76,6 +89,16 @@ namespace Gigamonkey::HD {
             static pubkey from_seed (seed entropy, type net);
 
             string write () const;
+            
+            // write to out, which must have room for max_string_size
+            // characters, and return the number of characters written.
+            size_t write (char *out) const;
+            
+            // the binary form, without base 58 check.
+            byte_array<serialized_size> serialize () const;
+            
+            // invalid if the data is not serialized_size bytes of an extended pubkey.
+            static pubkey deserialize (bytes_view);
 
             Bitcoin::address::decoded address () const {
                 return {to_address (Net), Bitcoin::Hash160 (Pubkey)};
@@ -113,6 +136,10 @@ namespace Gigamonkey::HD {
             static secret from_seed (seed entropy, type net = main);
 
             string write () const;
+            size_t write (char *out) const;
+            
+            byte_array<serialized_size> serialize () const;
+            static secret deserialize (bytes_view);
             pubkey to_public () const;
             
             bool valid () const {
@@ -139,15 +166,20 @@ namespace Gigamonkey::HD {
         secret derive (const secret &, uint32);
         pubkey derive (const pubkey &, uint32);
         
+        // the first four bytes of the Hash160 of a key, which its children have as Parent.
+        uint32 fingerprint (const secp256k1::pubkey &);
+        
+        // derive a child when the public key and fingerprint of the parent are already known.
+        secret derive (const secret &, const secp256k1::pubkey &, uint32 fingerprint, uint32 child);
+        pubkey derive (const pubkey &, uint32 fingerprint, uint32 child);
+        
         secret inline derive (const secret &s, path l) {
             if (l.empty ()) return s;
             return derive (derive (s, l.first ()), l.rest());
         }
         
-        pubkey inline derive (const pubkey &p, path l) {
-            if (l.empty ()) return p;
-            return derive (derive (p, l.first ()), l.rest ());
-        }
+        // each key along the path is only parsed once.
+        pubkey derive (const pubkey &, path);
         
         pubkey inline pubkey::derive (path l) const {
             return BIP_32::derive (*this, l);
@@ -173,6 +205,105 @@ namespace Gigamonkey::HD {
             return derive (x, read_path (p));
         }
 
+        // the public keys of the children of a key from From to From + size () - 1
+        // together with the Hash160 of each.
+        struct children {
+            uint32 From;
+            type Net;
+            
+            // compressed public keys one after another.
+            std::vector<byte> Pubkeys;
+            std::vector<digest160> Digests;
+            
+            size_t size () const {
+                return Digests.size ();
+            }
+            
+            secp256k1::pubkey key (size_t i) const {
+                return secp256k1::pubkey {bytes_view {Pubkeys.data () + i * secp256k1::pubkey::CompressedSize, secp256k1::pubkey::CompressedSize}};
+            }
+            
+            Bitcoin::address::decoded address (size_t i) const {
+                return {to_address (Net), Digests[i]};
+            }
+        };
+        
+        // the same keys as derive (p, i) for count values of i starting at from, which
+        // are derived in batches that share the work that depends only on p. None of
+        // them may be hardened. With an executor, the batches are derived in parallel.
+        children derive_range (const pubkey &p, uint32 from, uint32 count);
+        children derive_range (const pubkey &p, uint32 from, uint32 count, executor &);
+        
+        // Derives keys along paths that share prefixes without deriving any
+        // ancestor twice. The keys on the way are kept along with their public
+        // keys and fingerprints. At most Capacity of them are kept and those
+        // that were used least recently are forgotten first.
+        template <typename key> struct derivation {
+            key Root;
+            size_t Capacity;
+            
+            explicit derivation (const key &root, size_t capacity = 1024);
+            
+            // the same as BIP_32::derive (Root, p).
+            key derive (path p);
+            
+            size_t size () const {
+                std::lock_guard<std::mutex> lock (Mutex);
+                return Recent.size ();
+            }
+        
+        private:
+            struct node {
+                key Key;
+                secp256k1::pubkey Pubkey;
+                uint32 Fingerprint;
+                
+                explicit node (const key &);
+                key child (uint32) const;
+            };
+            
+            using entry = std::pair<std::vector<uint32>, node>;
+            
+            mutable std::mutex Mutex;
+            node Top;
+            std::list<entry> Recent;
+            std::map<std::vector<uint32>, typename std::list<entry>::iterator> Index;
+            
+            void remember (std::vector<uint32> &&, const node &);
+        };
+        
+        // Keys that have been read already by the strings they were read from, for
+        // when the same few keys are read over and over. Strings are found by their
+        // hash and then compared. At most Capacity keys are kept and those that
+        // were used least recently are forgotten first.
+        template <typename key> struct interned {
+            size_t Capacity;
+            
+            explicit interned (size_t capacity = 4096) : Capacity {capacity}, Mutex {}, Recent {}, Index {} {}
+            
+            // the same as key::read, but nullptr if the key is not valid. Invalid keys are not kept.
+            ptr<const key> read (string_view);
+            
+            size_t size () const {
+                std::lock_guard<std::mutex> lock (Mutex);
+                return Recent.size ();
+            }
+        
+        private:
+            struct string_hash {
+                using is_transparent = void;
+                size_t operator () (string_view x) const {
+                    return std::hash<string_view> {} (x);
+                }
+            };
+            
+            using entry = std::pair<string, ptr<const key>>;
+            
+            mutable std::mutex Mutex;
+            std::list<entry> Recent;
+            std::unordered_map<string, typename std::list<entry>::iterator, string_hash, std::equal_to<>> Index;
+        };
+        
         std::ostream inline &operator << (std::ostream &os, const pubkey &pubkey) {
             return os << pubkey.write ();
         }
@@ -181,49 +312,151 @@ namespace Gigamonkey::HD {
             return os << secret.write ();
         }
     
+        template <typename key> derivation<key>::node::node (const key &k) : Key {k}, Pubkey {}, Fingerprint {} {
+            if constexpr (std::is_same_v<key, secret>) Pubkey = Key.Secret.to_public ();
+            else Pubkey = Key.Pubkey;
+            Fingerprint = fingerprint (Pubkey);
+        }
+    
+        template <typename key> key derivation<key>::node::child (uint32 i) const {
+            if constexpr (std::is_same_v<key, secret>) return BIP_32::derive (Key, Pubkey, Fingerprint, i);
+            else return BIP_32::derive (Key, Fingerprint, i);
+        }
+        
+        template <typename key> derivation<key>::derivation (const key &root, size_t capacity) :
+            Root {root}, Capacity {capacity}, Mutex {}, Top {root}, Recent {}, Index {} {}
+        
+        template <typename key> key derivation<key>::derive (path p) {
+            std::vector<uint32> v;
+            for (uint32 i : p) v.push_back (i);
+            if (v.empty ()) return Root;
+            
+            std::lock_guard<std::mutex> lock (Mutex);
+            
+            // look for the nearest ancestor that we already have.
+            size_t known = v.size () - 1;
+            node parent = Top;
+            for (; known > 0; known--) {
+                auto x = Index.find (std::vector<uint32> (v.begin (), v.begin () + known));
+                if (x == Index.end ()) continue;
+                Recent.splice (Recent.begin (), Recent, x->second);
+                parent = x->second->second;
+                break;
+            }
+            
+            for (size_t i = known; i + 1 < v.size (); i++) {
+                parent = node {parent.child (v[i])};
+                remember (std::vector<uint32> (v.begin (), v.begin () + i + 1), parent);
+            }
+            
+            return parent.child (v.back ());
+        }
+        
+        template <typename key> ptr<const key> interned<key>::read (string_view s) {
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                auto x = Index.find (s);
+                if (x != Index.end ()) {
+                    Recent.splice (Recent.begin (), Recent, x->second);
+                    return x->second->second;
+                }
+            }
+            
+            // read without the lock so that other threads do not wait for us.
+            key k = key::read (s);
+            if (!k.valid ()) return nullptr;
+            auto p = std::make_shared<const key> (std::move (k));
+            
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (Capacity == 0 || Index.find (s) != Index.end ()) return p;
+            Recent.emplace_front (string {s}, p);
+            Index[Recent.front ().first] = Recent.begin ();
+            
+            if (Recent.size () > Capacity) {
+                Index.erase (Recent.back ().first);
+                Recent.pop_back ();
+            }
+            
+            return p;
+        }
+        
+        template <typename key> void derivation<key>::remember (std::vector<uint32> &&k, const node &n) {
+            if (Capacity == 0) return;
+            Recent.emplace_front (k, n);
+            Index[std::move (k)] = Recent.begin ();
+            
+            if (Recent.size () > Capacity) {
+                Index.erase (Recent.back ().first);
+                Recent.pop_back ();
+            }
+        }
+        
     }
     
+    // key_source and address_source share a derivation with the sources
+    // made from them by rest so that the key they start from is only
+    // prepared once.
     struct key_source final : Gigamonkey::key_source {
         uint32 Index;
         BIP_32::secret Key;
+        ptr<BIP_32::derivation<BIP_32::secret>> Derivation;
         
         key_source (uint32 i, const BIP_32::secret &s) :
-            Index {i}, Key {s} {}
+            Index {i}, Key {s}, Derivation {std::make_shared<BIP_32::derivation<BIP_32::secret>> (s)} {}
+        
+        key_source (uint32 i, ptr<BIP_32::derivation<BIP_32::secret>> d) :
+            Index {i}, Key {d->Root}, Derivation {d} {}
         
         key_source (const BIP_32::secret& s) : key_source {1, s} {}
         
         Bitcoin::secret next () override {
-            return Bitcoin::secret (Key.derive (Index++));
+            return Bitcoin::secret (Derivation->derive (BIP_32::path {} << Index++));
         }
         
         Bitcoin::secret first () const {
-            return Bitcoin::secret (Key.derive (Index));
+            return Bitcoin::secret (Derivation->derive (BIP_32::path {} << Index));
         }
         
         key_source rest () const {
-            return key_source {Index + 1, Key};
+            return key_source {Index + 1, Derivation};
         }
     };
     
     struct address_source final : Gigamonkey::address_source {
         uint32 Index;
         BIP_32::pubkey Key;
+        ptr<BIP_32::derivation<BIP_32::pubkey>> Derivation;
         
         address_source (uint32 i, const BIP_32::pubkey& s) :
-            Index {i}, Key {s} {}
+            Index {i}, Key {s}, Derivation {std::make_shared<BIP_32::derivation<BIP_32::pubkey>> (s)} {}
+        
+        address_source (uint32 i, ptr<BIP_32::derivation<BIP_32::pubkey>> d) :
+            Index {i}, Key {d->Root}, Derivation {d} {}
         
         address_source (const BIP_32::pubkey& s) : address_source {1, s} {}
         
         Bitcoin::address::decoded next () override {
-            return Key.derive (Index++).address ();
+            return derived (Index++);
         }
         
         Bitcoin::address::decoded first () const {
-            return Key.derive (Index).address ();
+            return Derivation->derive (BIP_32::path {} << Index).address ();
         }
         
         address_source rest () const {
-            return address_source {Index + 1, Key};
+            return address_source {Index + 1, Derivation};
+        }
+        
+    private:
+        // addresses given by next are derived this many at a time with BIP_32::derive_range.
+        constexpr static uint32 Batch = 64;
+        BIP_32::children Derived {};
+        
+        Bitcoin::address::decoded derived (uint32 i) {
+            if (i >= Derived.From && i - Derived.From < Derived.size ()) return Derived.address (i - Derived.From);
+            if (BIP_32::hardened (i)) return Derivation->derive (BIP_32::path {} << i).address ();
+            Derived = BIP_32::derive_range (Key, i, std::min (Batch, 0x80000000 - i));
+            return Derived.address (0);
         }
     };
 
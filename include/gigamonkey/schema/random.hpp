@@ -5,6 +5,7 @@
 #define GIGAMONKEY_SCHEMA_RANDOM
 
 #include "keysource.hpp"
+#include <gigamonkey/executor.hpp>
 #include <data/crypto/random.hpp>
 
 namespace Gigamonkey {
@@ -43,6 +44,43 @@ namespace Gigamonkey::Bitcoin {
         random_key_source (data::crypto::random &r, secret::type net = secret::main, bool compressed = true) :
             Random {r}, Net {net}, Compressed {compressed} {}
     };
+    
+    // Many new keys at once, for when millions are needed. Secrets are stored
+    // one after another, 32 bytes each, and pubkeys likewise, 33 or 65 bytes each.
+    struct key_batch {
+        struct options {
+            Bitcoin::secret::type Net {Bitcoin::secret::main};
+            bool Compressed {true};
+            
+            // If not zero, the secrets come in runs of this many consecutive numbers,
+            // each starting at a random one, and so each pubkey of a run is the one
+            // before plus the generator. That is much faster, but anyone who learns
+            // one secret of a run learns all of them.
+            uint32 Run {0};
+            
+            options () {};
+        };
+        
+        Bitcoin::secret::type Net;
+        bool Compressed;
+        std::vector<byte> Secrets;
+        std::vector<byte> Pubkeys;
+        
+        size_t size () const {
+            return Secrets.size () / secp256k1::secret::Size;
+        }
+        
+        size_t pubkey_size () const {
+            return Compressed ? secp256k1::pubkey::CompressedSize : secp256k1::pubkey::UncompressedSize;
+        }
+        
+        Bitcoin::secret secret (size_t i) const;
+        Bitcoin::pubkey pubkey (size_t i) const;
+        
+        // Secrets are drawn from the generator on this thread. With an executor,
+        // pubkeys are computed on its threads.
+        static key_batch generate (data::crypto::random &, size_t count, const options & = options {}, executor * = nullptr);
+    };
 
 }
 
@@ -0,0 +1,73 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_BYTECODE
+#define GIGAMONKEY_SCRIPT_BYTECODE
+
+#include <gigamonkey/script/instruction.hpp>
+
+#include <vector>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    // A script that has been decoded once into an array of instructions so that
+    // it can be run many times without being read again. Make one for a locking
+    // script and use it with every input that spends it.
+    struct bytecode {
+        struct operation {
+            op Op;
+            
+            // whether this instruction is as short as it could be.
+            bool Minimal;
+            
+            // where the instruction begins in Script and its size.
+            uint32 Offset;
+            uint32 Size;
+            
+            // for OP_IF, OP_NOTIF and OP_ELSE, the index of the matching
+            // OP_ELSE or OP_ENDIF, or the number of operations if there is none.
+            uint32 Jump;
+        };
+        
+        bytes Script;
+        std::vector<operation> Operations;
+        
+        bytecode () : Script {}, Operations {} {}
+        
+        // a script that decompile would reject produces an empty bytecode,
+        // and an OP_RETURN outside of any conditional takes the rest of the
+        // script as a single operation, as in decompile.
+        explicit bytecode (bytes_view);
+        
+        size_t size () const {
+            return Operations.size ();
+        }
+        
+        bool empty () const {
+            return Operations.empty ();
+        }
+        
+        // the serialized instruction.
+        bytes_view operator [] (size_t i) const {
+            return bytes_view {Script.data () + Operations[i].Offset, Operations[i].Size};
+        }
+        
+        // the data pushed by a push instruction.
+        bytes data (size_t i) const;
+        
+        bool is_push () const;
+        
+        bool is_P2SH () const {
+            return Script.size () == 23 && Script[0] == OP_HASH160 && Script[1] == 0x14 && Script[22] == OP_EQUAL;
+        }
+        
+        // put scripts together with an OP_CODESEPARATOR after each but the last.
+        static bytecode join (std::initializer_list<const bytecode *>);
+    };
+    
+    // the same as verify (decompile (b), flags).
+    ScriptError verify (const bytecode &, uint32 flags = 0);
+    
+}
+
+#endif
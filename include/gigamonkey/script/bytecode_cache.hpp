@@ -0,0 +1,64 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_BYTECODE_CACHE
+#define GIGAMONKEY_SCRIPT_BYTECODE_CACHE
+
+#include <gigamonkey/script/bytecode.hpp>
+#include <gigamonkey/hash.hpp>
+
+#include <atomic>
+#include <shared_mutex>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    // A thread-safe table of locking scripts that have already been decoded,
+    // found by the hash of the script, so that a script that many outputs have,
+    // such as a Boost script, is decoded once. The cache is bounded both by the
+    // number of entries and by the bytes they take up. When it is full,
+    // arbitrary entries are removed until the new one fits.
+    struct bytecode_cache {
+        
+        // scripts smaller than this are about as quick to decode as to hash, so they
+        // are decoded every time and not kept or counted.
+        static constexpr size_t min_script_size = 128;
+        
+        // a script that is larger on its own than max_bytes is never kept.
+        explicit bytecode_cache (size_t max_entries = 1 << 12, size_t max_bytes = 1 << 26);
+        
+        // the decoded script, which is decoded now if it is not in the cache. Counts a hit or a miss.
+        ptr<const bytecode> get (bytes_view script);
+        
+        size_t size () const;
+        
+        // the bytes taken by the scripts and operations in the cache.
+        size_t bytes_used () const;
+        
+        void clear ();
+        
+        uint64 hits () const {
+            return Hits;
+        }
+        
+        uint64 misses () const {
+            return Misses;
+        }
+        
+        // a cache shared by everything that verifies scripts.
+        static bytecode_cache &shared ();
+    
+    private:
+        size_t MaxEntries;
+        size_t MaxBytes;
+        
+        mutable std::shared_mutex Mutex;
+        hash_map<digest256, ptr<const bytecode>> Entries;
+        size_t Bytes;
+        
+        std::atomic<uint64> Hits;
+        std::atomic<uint64> Misses;
+    };
+    
+}
+
+#endif
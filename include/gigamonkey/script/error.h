@@ -78,6 +78,9 @@ typedef enum ScriptError_t
 
     SCRIPT_ERR_BIG_INT,
 
+    /* not a consensus error. The script was stopped by the execution budget of the machine. */
+    SCRIPT_ERR_BUDGET_EXCEEDED,
+
     SCRIPT_ERR_ERROR_COUNT
 } ScriptError;
 
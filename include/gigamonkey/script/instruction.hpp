@@ -14,6 +14,8 @@
 
 #include <gigamonkey/number.hpp>
 
+#include <iterator>
+
 namespace Gigamonkey::Bitcoin { 
     
     using op = opcodetype;
@@ -116,6 +118,23 @@ namespace Gigamonkey::Bitcoin {
     // ASM is a standard human format for Bitcoin scripts that is unique only if the script is minimally encoded. 
     string ASM (bytes_view);
     
+    // Append the ASM of a script to a string, whose memory can be reused. It is
+    // written straight from the script without decompiling it. Nothing is
+    // written for a script that decompile cannot read, and data after an
+    // OP_RETURN outside of any if is left out, as ASM does.
+    void write_ASM (string &, bytes_view);
+    
+    // The script for some ASM, read in one pass. Pushes are given in hex and are
+    // read as minimal pushes, so that the script is the one that the ASM was
+    // written from if that was minimally encoded. Op codes are given by their
+    // names, which may be as GetOpName writes them or as ASM does, except that
+    // GetOpName's 10 through 16 are read as hex. False if any word is neither,
+    // in which case the script may have been partly written.
+    bool read_ASM (string_view, bytes &);
+    
+    // nothing if the ASM cannot be read.
+    maybe<bytes> read_ASM (string_view);
+    
     // a single step in a program. 
     struct instruction; 
     
@@ -190,6 +209,82 @@ namespace Gigamonkey::Bitcoin {
     
     program decompile (bytes_view); 
     
+    // whether decompile can read the script. The empty script can be read. 
+    bool decompilable (bytes_view);
+    
+    // An instruction in a script, read without copying its data. 
+    struct instruction_view {
+        op Op;
+        
+        // the data that is pushed, if any. 
+        bytes_view Data;
+        
+        // the whole instruction as it appears in the script. 
+        bytes_view Serialized;
+    };
+    
+    // iterate over the instructions of a script without allocating anything. Unlike 
+    // decompile, OP_RETURN is read as a single op code. An instruction that runs past 
+    // the end of the script is given as OP_INVALIDOPCODE with everything that is left 
+    // as Serialized, and is the last one. 
+    struct instructions {
+        bytes_view Script;
+        
+        explicit instructions (bytes_view b) : Script {b} {}
+        
+        struct iterator {
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = instruction_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const instruction_view *;
+            using reference = const instruction_view &;
+            
+            iterator () : Rest {}, Next {} {}
+            explicit iterator (bytes_view rest) : Rest {rest}, Next {} {
+                read ();
+            }
+            
+            const instruction_view &operator * () const {
+                return Next;
+            }
+            
+            const instruction_view *operator -> () const {
+                return &Next;
+            }
+            
+            iterator &operator ++ () {
+                Rest = Rest.substr (Next.Serialized.size ());
+                read ();
+                return *this;
+            }
+            
+            iterator operator ++ (int) {
+                iterator i = *this;
+                ++*this;
+                return i;
+            }
+            
+            bool operator == (const iterator &i) const {
+                return Rest.data () == i.Rest.data () && Rest.size () == i.Rest.size ();
+            }
+            
+        private:
+            // the part of the script that begins with Next. 
+            bytes_view Rest;
+            instruction_view Next;
+            
+            void read ();
+        };
+        
+        iterator begin () const {
+            return iterator {Script};
+        }
+        
+        iterator end () const {
+            return iterator {Script.substr (Script.size ())};
+        }
+    };
+    
     size_t serialized_size (program p);
 
     bool is_push (program);
@@ -199,13 +294,14 @@ namespace Gigamonkey::Bitcoin {
     }
     
     size_t inline serialized_size (program p) {
-        if (data::empty (p)) return 0;
-        return serialized_size (p.first ()) + serialized_size (p.rest ());
+        size_t size = 0;
+        for (const instruction &i : p) size += serialized_size (i);
+        return size;
     }
     
     bool inline is_push (program p) {
-        if (data::empty (p)) return true;
-        return is_push (p.first ().Op) && is_push (p.rest ());
+        for (const instruction &i : p) if (!is_push (i.Op)) return false;
+        return true;
     }
     
     bool inline operator == (const instruction &a, const instruction &b) {
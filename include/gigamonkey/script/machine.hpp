@@ -7,25 +7,74 @@
 #include <gigamonkey/script/script.hpp>
 #include <gigamonkey/script/stack.hpp>
 #include <gigamonkey/script/counter.hpp>
+#include <gigamonkey/script/bytecode.hpp>
 #include <gigamonkey/script/config.hpp>
+#include <gigamonkey/script/signature_cache.hpp>
+#include <gigamonkey/script/profile.hpp>
+
+#include <chrono>
 
 namespace Gigamonkey::Bitcoin::interpreter { 
     
-    // a Bitcoin script interpreter that can be advanced step-by-step.
+    // a Bitcoin script interpreter that can be advanced step-by-step. It is cheap
+    // to copy a machine, so a script can be run up to some point once and then
+    // each copy can be run on from there in a different way.
     struct machine {
         bool Halt;
         result Result;
         
+        // Limits on a script beyond those of consensus, for scripts from
+        // untrusted sources. Zero means no limit. A script that goes over
+        // its budget fails with SCRIPT_ERR_BUDGET_EXCEEDED.
+        struct budget {
+            // time spent running the script, not counting time spent paused.
+            std::chrono::nanoseconds Time {0};
+            
+            // operations executed, including pushes.
+            uint64 Operations {0};
+            
+            // the combined memory of the stack and alt stack.
+            uint64 StackBytes {0};
+            
+            bool unlimited () const {
+                return Time.count () == 0 && Operations == 0 && StackBytes == 0;
+            }
+        };
+        
+        // The limits that a script runs under, which depend only on the flags and
+        // on whether it is run for consensus, so that they are looked up once and
+        // not at every step. The limits for the default config are shared by all
+        // machines.
+        struct limits {
+            bool UTXOAfterGenesis;
+            bool RequireMinimal;
+            
+            uint64 MaxScriptNumLength;
+            uint64 MaxOpsPerScript;
+            uint64 MaxPubKeysPerMultiSig;
+            uint64 MaxStackMemoryUsage;
+            
+            static limits make (const script_config &, uint32 flags, bool consensus);
+            static const limits &get (uint32 flags, bool consensus);
+        };
+        
         struct state {
             uint32 Flags;
             bool Consensus;
             
             script_config Config;
             
+            // the limits for Flags and Consensus under the default config.
+            const limits *Limits;
+            
             maybe<redemption_document> Document;
             
-            bytes Script;
-            program_counter Counter;
+            bytecode Script;
+            
+            // the index of the next operation and the position in 
+            // Script after the last OP_CODESEPARATOR that was executed.
+            uint32 Counter;
+            uint32 LastCodeSeparator;
             
             LimitedStack<element> Stack;
             LimitedStack<element> AltStack;
@@ -33,15 +82,63 @@ namespace Gigamonkey::Bitcoin::interpreter {
             cross<bool> Exec;
             cross<bool> Else;
             
+            // the number of false entries in Exec.
+            uint32 Unexecuted;
+            
             long OpCount;
             
-            state (uint32 flags, bool consensus, maybe<redemption_document> doc, const bytes &script);
+            // optional. Signatures are looked up here before they are verified. 
+            signature_cache *Cache;
+            
+            // If set, signatures in OP_CHECKSIG are assumed to be valid and are recorded 
+            // in Deferred to be verified when the script is done. This is only done when 
+            // SCRIPT_VERIFY_NULLFAIL is set because otherwise an invalid signature does not 
+            // necessarily cause the script to fail. The same scripts pass or fail either 
+            // way but the error reported may be different. 
+            bool Defer;
+            std::vector<signature_check> Deferred;
+            
+            // If set, P2PKH and P2PK scripts are run by a specialized function 
+            // that gives the same result as the general interpreter. 
+            bool Standard;
+            
+            // optional. If set, the cost of every operation is recorded here
+            // and scripts are always run by the general interpreter.
+            profile *Profile;
+            
+            // how much of the budget has been used since the last reset.
+            budget Budget;
+            uint64 Operations;
+            std::chrono::nanoseconds Elapsed;
+            
+            state (uint32 flags, bool consensus, maybe<redemption_document> doc, bytecode script);
+            
+            // a copy of a state shares its large stack elements with the original until
+            // either one changes them, so that copying a state in the middle of a script
+            // does not copy the stack. Cache and Profile are shared too.
+            state (const state &);
+            state &operator = (const state &) = delete;
+            
+            // start over with a new script. Memory that has been allocated 
+            // already is kept, and so are Cache, Defer, Standard, Profile and Budget. 
+            void reset (uint32 flags, maybe<redemption_document> doc, bytecode script);
+            
+            // verify deferred signatures. 
+            result finish (result);
             
             program unread () const {
-                return decompile (bytes_view {Counter.Script}.substr (Counter.Counter));
+                return decompile (bytes_view {Script.Script}.substr (
+                    Counter < Script.size () ? Script.Operations[Counter].Offset : Script.Script.size ()));
+            }
+            
+            bytes_view script_code () const {
+                return bytes_view {Script.Script}.substr (LastCodeSeparator);
             }
             
             result step ();
+            
+        private:
+            result jump (uint32 to);
         };
         
         state State;
@@ -51,37 +148,82 @@ namespace Gigamonkey::Bitcoin::interpreter {
         machine (const script &unlock, const script &lock,
             const redemption_document &doc, uint32 flags = StandardScriptVerifyFlags (true, true));
     
+        // use a locking script that has already been decoded.
+        machine (const script &unlock, const bytecode &lock, uint32 flags = StandardScriptVerifyFlags (true, true));
+    
+        machine (const script &unlock, const bytecode &lock,
+            const redemption_document &doc, uint32 flags = StandardScriptVerifyFlags (true, true));
+    
         machine (program p, uint32 flags = StandardScriptVerifyFlags (true, true));
         
+        // evaluate another script with this machine, which is cheaper than making a new one. 
+        void reset (const script &unlock, const script &lock, uint32 flags = StandardScriptVerifyFlags (true, true));
+        
+        void reset (const script &unlock, const script &lock,
+            const redemption_document &doc, uint32 flags = StandardScriptVerifyFlags (true, true));
+        
+        void reset (const script &unlock, const bytecode &lock, uint32 flags = StandardScriptVerifyFlags (true, true));
+        
+        void reset (const script &unlock, const bytecode &lock,
+            const redemption_document &doc, uint32 flags = StandardScriptVerifyFlags (true, true));
+        
         void step ();
         
         result run ();
         
-    private:
-
-        static bool isP2SH (const program p) {
-            bytes script = compile (p);
-            return script.size () == 23 && script[0] == OP_HASH160 &&
-                script[1] == 0x14 && script[22] == OP_EQUAL;
+        // run no more than the given number of operations, or until the script
+        // is done if it is zero. Returns whether the script is done, in which
+        // case the result is in Result. This lets a long script be paused so
+        // that something else can run and then resumed with another call.
+        bool advance (uint64 steps);
+        
+        // the budget applies to run, step and advance. P2PKH and P2PK
+        // scripts are small enough to be run by run without it.
+        void limit (const budget &b) {
+            State.Budget = b;
+        }
+        
+        void cache (signature_cache &c) {
+            State.Cache = &c;
+        }
+        
+        void defer_signatures (bool defer = true) {
+            State.Defer = defer;
+        }
+        
+        // record the cost of every operation in p, which must outlive the machine.
+        // Deferred signatures are verified after the script and are not included.
+        void measure (profile &p) {
+            State.Profile = &p;
+        }
+        
+        // run P2PKH and P2PK scripts with the general interpreter, for testing. 
+        void specialize_standard_scripts (bool specialize = true) {
+            State.Standard = specialize;
         }
         
-        program inline full (const program unlock, const program lock) {
-            if (!isP2SH (lock) || data::empty (unlock)) return (unlock << OP_CODESEPARATOR) + lock;
-            return (unlock << OP_CODESEPARATOR) + (lock << OP_CODESEPARATOR) + decompile (data::reverse (unlock).first ().data ());
+    private:
+
+        static bytecode full (const bytecode &unlock, const bytecode &lock) {
+            if (!lock.is_P2SH () || unlock.empty ()) return bytecode::join ({&unlock, &lock});
+            bytecode redeem {unlock.data (unlock.size () - 1)};
+            return bytecode::join ({&unlock, &lock, &redeem});
         }
         
-        ScriptError check_scripts (const program unlock, const program lock, uint32 flags) {
-            if (flags & SCRIPT_VERIFY_SIGPUSHONLY && !is_push(unlock)) return SCRIPT_ERR_SIG_PUSHONLY;
+        static ScriptError check_scripts (const bytecode &unlock, const bytecode &lock, const bytecode &full, uint32 flags) {
+            if (flags & SCRIPT_VERIFY_SIGPUSHONLY && !unlock.is_push ()) return SCRIPT_ERR_SIG_PUSHONLY;
 
-            if (isP2SH (lock)) {
+            if (lock.is_P2SH ()) {
                 if (unlock.empty ()) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                if (!is_push (unlock)) return SCRIPT_ERR_SIG_PUSHONLY;
+                if (!unlock.is_push ()) return SCRIPT_ERR_SIG_PUSHONLY;
             }
 
-            return verify (full (unlock, lock), flags);
+            return verify (full, flags);
         }
         
-        machine (maybe<redemption_document> doc, const program unlock, const program lock, uint32 flags);
+        machine (maybe<redemption_document> doc, const bytecode &unlock, const bytecode &lock, uint32 flags);
+        
+        void reset (maybe<redemption_document> doc, const bytecode &unlock, const bytecode &lock, uint32 flags);
         
         static const element &script_false () {
             static element False (0);
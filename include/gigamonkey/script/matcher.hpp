@@ -0,0 +1,112 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_MATCHER
+#define GIGAMONKEY_SCRIPT_MATCHER
+
+#include <gigamonkey/types.hpp>
+
+#include <bitset>
+#include <vector>
+
+namespace Gigamonkey {
+    
+    struct pattern;
+    
+    // A pattern compiled into a flat list of steps that runs directly on a
+    // script. Nothing is allocated while matching and captured values are
+    // views into the script, so make one matcher for a pattern and use it
+    // for every script. Matches exactly the scripts that the pattern matches.
+    struct matcher {
+        
+        explicit matcher (const pattern &);
+        
+        // the number of values that the pattern reads, in the order that
+        // they appear in the pattern.
+        size_t captures () const {
+            return Captures;
+        }
+        
+        bool match (bytes_view script) const;
+        
+        // captured values are returned in captures, which is resized to captures ().
+        // if a capture is optional and was not read, it is left empty.
+        bool match (bytes_view script, std::vector<bytes_view> &captures) const;
+        
+        // the first byte of any script that could match, if it is not empty.
+        const std::bitset<256> &first () const {
+            return First;
+        }
+        
+        enum class kind : byte {
+            literal,        // the bytes Pool[A, A + B) exactly.
+            any,            // any instruction.
+            push,           // any push.
+            push_value,     // a push of a number equal to the minimal number in Pool[A, A + B).
+            push_data,      // a push of the data in Pool[A, A + B).
+            push_size,      // an instruction whose data has size A.
+            choice,         // try the following steps and go to A if they fail.
+            commit          // the last choice succeeded. Go to A.
+        };
+        
+        struct step {
+            kind Kind;
+            
+            // Where a push is saved, or -1.
+            int32 Capture;
+            
+            uint32 A;
+            uint32 B;
+        };
+        
+        // these are used to compile a pattern.
+        void literal (bytes_view);
+        void any ();
+        void push (kind, bytes_view operand, bool capture);
+        void push_size (size_t, bool capture);
+        
+        // returns the index of the new step so that its jump can be set later.
+        size_t choice ();
+        size_t commit ();
+        
+        size_t size () const {
+            return Steps.size ();
+        }
+        
+        void jump (size_t step, size_t to) {
+            Steps[step].A = to;
+        }
+    
+    private:
+        std::vector<step> Steps;
+        bytes Pool;
+        uint32 Captures;
+        
+        // the greatest number of choices that can be open at once.
+        uint32 Depth;
+        uint32 Open;
+        
+        std::bitset<256> First;
+        
+        int32 capture (bool);
+        void find_first ();
+        
+        bool run (bytes_view script, bytes_view *captures) const;
+    };
+    
+    // Match a script against many patterns at once. Patterns are only tried
+    // if the first byte of the script could begin them.
+    struct classifier {
+        std::vector<matcher> Matchers;
+        
+        classifier () : Matchers {} {}
+        explicit classifier (std::vector<matcher> m) : Matchers {std::move (m)} {}
+        
+        // the index of the first pattern that matches, or -1.
+        int classify (bytes_view script) const;
+        int classify (bytes_view script, std::vector<bytes_view> &captures) const;
+    };
+    
+}
+
+#endif
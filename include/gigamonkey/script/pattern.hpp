@@ -5,6 +5,7 @@
 #define GIGAMONKEY_SCRIPT_PATTERN
 
 #include <gigamonkey/script/instruction.hpp>
+#include <gigamonkey/script/matcher.hpp>
 #include <gigamonkey/address.hpp>
 #include <data/data.hpp>
 
@@ -47,6 +48,9 @@ namespace Gigamonkey {
             return Pattern->scan (p);
         }
         
+        // write the steps of this pattern to a matcher. 
+        virtual void compile (matcher &) const;
+        
         virtual ~pattern () {}
         
         struct sequence;
@@ -65,6 +69,7 @@ namespace Gigamonkey {
     struct any final : pattern {
         any () {}
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     // A pattern that represents a single instruction. 
@@ -73,6 +78,7 @@ namespace Gigamonkey {
         atom(Bitcoin::instruction i) : Instruction {i} {}
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     // A pattern that represents any string that is part of a program. 
@@ -82,6 +88,7 @@ namespace Gigamonkey {
         string (const bytes &p) : Program {p} {}
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     // A pattern that represents a push instruction 
@@ -107,6 +114,7 @@ namespace Gigamonkey {
         bool match (const Bitcoin::instruction& i) const;
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
         
     };
     
@@ -125,6 +133,7 @@ namespace Gigamonkey {
         bool match (const Bitcoin::instruction &i) const;
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     enum repeated_directive : byte {
@@ -153,6 +162,7 @@ namespace Gigamonkey {
         repeated (alternatives, uint32, uint32);
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     struct optional final : pattern {
@@ -166,6 +176,7 @@ namespace Gigamonkey {
         optional (alternatives);
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     inline pattern::pattern (Bitcoin::op o) : pattern {Bitcoin::instruction {o}} {}
@@ -181,6 +192,7 @@ namespace Gigamonkey {
         sequence (P... p) : Patterns (make (p...)) {}
         
         virtual bytes_view scan (bytes_view p) const override;
+        virtual void compile (matcher &) const override;
         
     private:
         
@@ -206,6 +218,7 @@ namespace Gigamonkey {
         alternatives (P... p) : sequence {p...} {}
         
         virtual bytes_view scan (bytes_view) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     // OP_RETURN followed by arbitrary data. 
@@ -219,6 +232,7 @@ namespace Gigamonkey {
         op_return_data (P... p) : pattern {p...} {}
         
         virtual bytes_view scan (bytes_view p) const final override;
+        virtual void compile (matcher &) const final override;
     };
     
     // A pattern that matches a pubkey and grabs the value of that pubkey.
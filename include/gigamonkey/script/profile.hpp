@@ -0,0 +1,68 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_PROFILE
+#define GIGAMONKEY_SCRIPT_PROFILE
+
+#include <gigamonkey/script/instruction.hpp>
+
+#include <array>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    // The cost of the operations in the scripts that a machine has run, by opcode.
+    // Memory is the combined size of the stack and alt stack as LimitedStack
+    // counts it. Use one profile per script for a report on that script and add
+    // them up for a report on many.
+    struct profile {
+        struct entry {
+            uint64 Count {0};
+            uint64 Nanoseconds {0};
+            
+            // the sum of the increases in stack memory caused by this operation.
+            uint64 Allocated {0};
+            
+            // the most stack memory that there was right after this operation.
+            uint64 PeakMemory {0};
+            
+            entry &operator += (const entry &);
+        };
+        
+        std::array<entry, 256> Opcodes {};
+        
+        // the number of scripts run and the most stack memory used by any.
+        uint64 Scripts {0};
+        uint64 PeakMemory {0};
+        
+        const entry &operator [] (op o) const {
+            return Opcodes[o];
+        }
+        
+        entry &operator [] (op o) {
+            return Opcodes[o];
+        }
+        
+        // record the cost of an operation.
+        void record (op, uint64 nanoseconds, uint64 memory_before, uint64 memory_after);
+        
+        profile &operator += (const profile &);
+        
+        uint64 operations () const;
+        uint64 nanoseconds () const;
+        
+        // opcodes in order of the time spent on them, most first.
+        std::vector<op> ranked () const;
+        
+        // the folded stack format taken by flamegraph tools, one line for each
+        // opcode that was run, as in "name;OP_ADD 1234". Samples are nanoseconds.
+        void write_folded (std::ostream &, const string &name = "script") const;
+        
+        explicit operator JSON () const;
+    };
+    
+    // a table of opcodes ranked by time.
+    std::ostream &operator << (std::ostream &, const profile &);
+    
+}
+
+#endif
@@ -0,0 +1,39 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_ROPE
+#define GIGAMONKEY_SCRIPT_ROPE
+
+#include <gigamonkey/types.hpp>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    // A byte string made of slices of shared buffers, kept in a balanced tree
+    // so that large stack elements can be joined and split in O(log n)
+    // without being copied. A rope is never changed once it has been made.
+    // An empty rope is nullptr.
+    struct rope {
+        uint64 Size;
+        byte Height;
+        
+        // a leaf is a slice of a buffer.
+        ptr<const bytes> Buffer;
+        uint64 Offset;
+        
+        ptr<const rope> Left;
+        ptr<const rope> Right;
+        
+        static ptr<const rope> make (bytes &&);
+        
+        static ptr<const rope> join (ptr<const rope>, ptr<const rope>);
+        
+        // a rope of the first n bytes and a rope of the rest.
+        static std::pair<ptr<const rope>, ptr<const rope>> split (ptr<const rope>, uint64 n);
+        
+        // Size bytes are written to out.
+        void write (byte *out) const;
+    };
+    
+}
+
+#endif
@@ -62,8 +62,16 @@ namespace Gigamonkey::Bitcoin {
         
         index InputIndex;
         
+        // optional. Share this between the documents for every input of a transaction. 
+        ptr<const sighash::precomputed> Precomputed {};
+        
         sighash::document add_script_code (bytes_view script_code) const {
-            return sighash::document {RedeemedValue, script_code, Transaction, InputIndex};
+            return sighash::document {RedeemedValue, script_code, Transaction, InputIndex, Precomputed};
+        }
+        
+        // the same without copying anything, so the document must outlive the view.
+        sighash::document_view view (bytes_view script_code) const {
+            return sighash::document_view {RedeemedValue, script_code, Transaction, InputIndex, Precomputed.get ()};
         }
         
         // holdovers from Bitcoin Core. 
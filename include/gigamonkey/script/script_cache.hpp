@@ -0,0 +1,65 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_SCRIPT_CACHE
+#define GIGAMONKEY_SCRIPT_SCRIPT_CACHE
+
+#include <gigamonkey/timechain.hpp>
+
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_set>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // A thread-safe set of inputs whose scripts are known to succeed with 
+    // some flags, so that a transaction that was checked when it entered the 
+    // mempool does not need to be evaluated again when it appears in a block. 
+    // An entry depends on the txid, the input index, the output being redeemed 
+    // and the flags. When the cache is full, an arbitrary entry is removed. 
+    struct script_cache {
+        
+        explicit script_cache (size_t max_entries = 1 << 18);
+        
+        // counts a hit or a miss. 
+        bool contains (const txid &, uint32 index, const output &redeemed, uint32 flags) const;
+        void insert (const txid &, uint32 index, const output &redeemed, uint32 flags);
+        
+        size_t size () const;
+        void clear ();
+        
+        uint64 hits () const {
+            return Hits;
+        }
+        
+        uint64 misses () const {
+            return Misses;
+        }
+    
+    private:
+        using key = std::array<byte, 32>;
+        
+        struct hasher {
+            size_t operator () (const key &k) const {
+                size_t h;
+                std::copy (k.begin (), k.begin () + sizeof (size_t), (byte *) &h);
+                return h;
+            }
+        };
+        
+        // entries are salted so that the layout of the table cannot be predicted. 
+        key Salt;
+        size_t MaxEntries;
+        
+        mutable std::shared_mutex Mutex;
+        std::unordered_set<key, hasher> Entries;
+        
+        mutable std::atomic<uint64> Hits;
+        mutable std::atomic<uint64> Misses;
+        
+        key make_key (const txid &, uint32 index, const output &redeemed, uint32 flags) const;
+    };
+    
+}
+
+#endif
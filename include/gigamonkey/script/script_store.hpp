@@ -0,0 +1,151 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_SCRIPT_STORE
+#define GIGAMONKEY_SCRIPT_SCRIPT_STORE
+
+#include <gigamonkey/memory.hpp>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // A thread-safe table of scripts in which each distinct script is stored
+    // once and is known by a 32-bit handle, for indexes that keep many outputs
+    // with the same script, such as pay-to-address scripts to an exchange or
+    // Boost scripts. Two scripts in the same store are equal if and only if
+    // their handles are equal. Every handle that is given out counts as a
+    // reference, and a script is removed when nothing refers to it.
+    //
+    // The table is split by the hash of the script into shards that are
+    // locked separately, so that threads rarely wait on one another.
+    struct script_store {
+        using handle = uint32;
+        
+        // no script.
+        static constexpr handle none = 0;
+        
+        script_store ();
+        
+        script_store (const script_store &) = delete;
+        script_store &operator = (const script_store &) = delete;
+        
+        // a handle to the script with a new reference to it.
+        // Throws std::length_error if the store is full.
+        handle intern (bytes_view);
+        
+        // a new reference to a script that is referred to already.
+        void retain (handle);
+        
+        // remove a reference.
+        void release (handle);
+        
+        // the script, which is good for as long as there is a reference to it.
+        bytes_view operator [] (handle) const;
+        
+        uint32 references (handle) const;
+        
+        // the number of distinct scripts and how big they are altogether.
+        size_t size () const;
+        size_t stored () const;
+        
+        // the scripts are the values and their hashes are the keys. Entries of
+        // scripts that have been removed are slack until they are used again.
+        memory_report memory_usage () const;
+        
+        static script_store &shared ();
+    
+    private:
+        static constexpr uint32 shard_bits = 6;
+        static constexpr uint32 shards = 1 << shard_bits;
+        
+        struct entry {
+            bytes Script;
+            uint64 Hash;
+            bool Live;
+            std::atomic<uint32> Count;
+            
+            entry (bytes_view b, uint64 h) : Script (b), Hash {h}, Live {true}, Count {1} {}
+        };
+        
+        struct shard {
+            mutable std::shared_mutex Mutex;
+            
+            // a deque so that entries never move.
+            std::deque<entry> Entries;
+            std::vector<uint32> Free;
+            std::unordered_multimap<uint64, uint32> Index;
+            size_t Stored {0};
+            
+            // the index of the entry with this script, or -1.
+            int64 find (bytes_view, uint64 hash) const;
+        };
+        
+        std::array<shard, shards> Shards;
+        
+        entry &get (handle) const;
+    };
+    
+    // A reference to a script in a store, which is released when it is destroyed.
+    struct interned_script {
+        interned_script () : Store {nullptr}, Handle {script_store::none} {}
+        interned_script (script_store &s, bytes_view b) : Store {&s}, Handle {s.intern (b)} {}
+        explicit interned_script (bytes_view b) : interned_script {script_store::shared (), b} {}
+        
+        interned_script (const interned_script &x) : Store {x.Store}, Handle {x.Handle} {
+            if (Store != nullptr) Store->retain (Handle);
+        }
+        
+        interned_script (interned_script &&x) : Store {x.Store}, Handle {x.Handle} {
+            x.Store = nullptr;
+            x.Handle = script_store::none;
+        }
+        
+        interned_script &operator = (const interned_script &x) {
+            if (x.Store != nullptr) x.Store->retain (x.Handle);
+            if (Store != nullptr) Store->release (Handle);
+            Store = x.Store;
+            Handle = x.Handle;
+            return *this;
+        }
+        
+        interned_script &operator = (interned_script &&x) {
+            std::swap (Store, x.Store);
+            std::swap (Handle, x.Handle);
+            return *this;
+        }
+        
+        ~interned_script () {
+            if (Store != nullptr) Store->release (Handle);
+        }
+        
+        bytes_view script () const {
+            return Store == nullptr ? bytes_view {} : (*Store)[Handle];
+        }
+        
+        operator bytes_view () const {
+            return script ();
+        }
+        
+        script_store::handle handle () const {
+            return Handle;
+        }
+        
+        // scripts from the same store are compared by handle.
+        bool operator == (const interned_script &x) const {
+            return Store == x.Store ? Handle == x.Handle : script () == x.script ();
+        }
+    
+    private:
+        script_store *Store;
+        script_store::handle Handle;
+    };
+    
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_SIGNATURE_CACHE
+#define GIGAMONKEY_SCRIPT_SIGNATURE_CACHE
+
+#include <gigamonkey/secp256k1.hpp>
+
+#include <shared_mutex>
+#include <unordered_set>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // a signature operation that has not been checked yet. 
+    struct signature_check {
+        digest256 Hash;
+        bytes Pubkey;
+        // the signature without the sighash directive. 
+        bytes Signature;
+        
+        signature_check (const digest256 &d, bytes_view pub, bytes_view sig) : Hash {d}, Pubkey {pub}, Signature {sig} {}
+    };
+    
+    // A thread-safe set of signatures that are known to be valid, so that 
+    // a transaction that was checked when it entered the mempool does not 
+    // need its signatures verified again when it appears in a block. 
+    // When the cache is full, an arbitrary entry is removed. 
+    struct signature_cache {
+        
+        explicit signature_cache (size_t max_entries = 1 << 20);
+        
+        bool contains (const digest256 &d, bytes_view pub, bytes_view sig) const;
+        void insert (const digest256 &d, bytes_view pub, bytes_view sig);
+        
+        // check the cache and verify on a miss, remembering if the signature is valid. 
+        bool verify (const digest256 &d, bytes_view pub, bytes_view sig);
+        
+        // the same, with the signature already decoded for when it has to be verified.
+        bool verify (const digest256 &d, bytes_view pub, bytes_view sig, const secp256k1::parsed_signature &);
+        
+        bool verify (const signature_check &x) {
+            return verify (x.Hash, x.Pubkey, x.Signature);
+        }
+        
+        size_t size () const;
+        void clear ();
+        
+    private:
+        using key = std::array<byte, 32>;
+        
+        struct hasher {
+            size_t operator () (const key &k) const {
+                size_t h;
+                std::copy (k.begin (), k.begin () + sizeof (size_t), (byte *) &h);
+                return h;
+            }
+        };
+        
+        // entries are salted so that the layout of the table cannot be predicted. 
+        key Salt;
+        size_t MaxEntries;
+        
+        mutable std::shared_mutex Mutex;
+        std::unordered_set<key, hasher> Entries;
+        
+        key make_key (const digest256 &d, bytes_view pub, bytes_view sig) const;
+        void insert (const key &);
+    };
+    
+}
+
+#endif
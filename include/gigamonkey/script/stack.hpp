@@ -6,6 +6,7 @@
 #define GIGAMONKEY_INTERPRETER_STACK
 
 #include <gigamonkey/number.hpp>
+#include <gigamonkey/script/rope.hpp>
 #include <sv/script/int_serialization.h>
 
 class stack_overflow_error : public std::overflow_error {
@@ -20,7 +21,7 @@ namespace Gigamonkey::Bitcoin::interpreter {
         using bytes::bytes;
         
         element (std::vector<byte> &&v) {
-            std::vector<byte>::operator = (v);
+            std::vector<byte>::operator = (std::move (v));
         }
         
         element (const std::vector<byte>& v) : element(v.begin(), v.end()) {}
@@ -48,18 +49,34 @@ namespace Gigamonkey::Bitcoin::interpreter {
     class LimitedVector
     {
     private:
-        valtype stackElement;
+        // A large element that has been made by OP_CAT is kept as a rope so that
+        // it is not copied every time something is appended to it. It is
+        // flattened into stackElement as soon as anything needs its bytes.
+        mutable valtype stackElement;
+        mutable ptr<const rope> ropeElement;
         std::reference_wrapper<LimitedStack<valtype>> stack;
 
         LimitedVector (const valtype& stackElementIn, LimitedStack<valtype>& stackIn);
+        LimitedVector (valtype &&stackElementIn, LimitedStack<valtype>& stackIn);
 
         // WARNING: modifying returned element will NOT adjust stack size
         valtype& GetElementNonConst ();
+        
+        void flatten () const;
+        
+        // the element as a rope, which it is kept as after this.
+        const ptr<const rope> &asRope () const;
+        
+        // ropes smaller than MIN_ROPE_SIZE are flattened.
+        void setRope (ptr<const rope>);
     public:
 
         // Memory usage of one stack element (without data). This is a consensus rule. Do not change.
         // It prevents someone from creating stack with millions of empty elements.
         static constexpr unsigned int ELEMENT_OVERHEAD = 32;
+        
+        // elements made by OP_CAT that are smaller than this are not kept as ropes.
+        static constexpr size_t MIN_ROPE_SIZE = 1024;
 
         // Warning: returned reference is invalidated if parent stack is modified.
         const valtype &GetElement () const;
@@ -101,7 +118,21 @@ namespace Gigamonkey::Bitcoin::interpreter {
         LimitedStack* parentStack { nullptr };
         void decreaseCombinedStackSize (uint64_t additionalSize);
         void increaseCombinedStackSize (uint64_t additionalSize);
+        
+        // Buffers of elements that have been removed. New elements are copied into 
+        // these so that a script that pushes and pops a lot does not allocate every 
+        // time. They are kept by the root stack and freed with it. 
+        std::vector<valtype> spareElements;
+        static constexpr size_t MAX_SPARE_ELEMENTS = 256;
+        static constexpr size_t MAX_SPARE_ELEMENT_CAPACITY = 4096;
+        
+        LimitedStack &root ();
+        valtype makeElement (const uint8_t *begin, const uint8_t *end);
+        void releaseElement (valtype &&);
 
+        // an element of this stack with the same value, which shares a rope rather than copying it.
+        LimitedVector<valtype> copy (const LimitedVector<valtype> &);
+        
         LimitedStack (const LimitedStack &) = default;
         LimitedStack () = default;
 
@@ -130,6 +161,28 @@ namespace Gigamonkey::Bitcoin::interpreter {
         void pop_back ();
         void push_back (const LimitedVector<valtype> &element);
         void push_back (const valtype &element);
+        
+        // push a copy of some data, such as a push from the script. 
+        void push (bytes_view);
+        
+        // remove every element but keep their buffers to be reused. 
+        void clear ();
+        
+        // (x1 x2 -- x1 || x2) as for OP_CAT, and split the top element in two at
+        // a position that is not past its end as for OP_SPLIT. Large elements are
+        // joined and split as ropes, which does not copy them. Sizes are counted
+        // the same as if the bytes were copied.
+        void cat ();
+        void split (size_t position);
+        
+        // parent must be null and the stack must be empty. 
+        void setMaxStackSize (uint64_t maxStackSizeIn);
+        
+        // Make this empty stack a copy of another. Elements of at least
+        // MIN_ROPE_SIZE are shared rather than copied until one of the stacks
+        // changes them. Both must be root stacks or else the other's parent
+        // must already have been copied into this one's parent.
+        void share (const LimitedStack &other);
 
         // erase elements from including (top - first). element until excluding (top - last). element
         // first and last should be negative numbers (distance from the top)
@@ -181,35 +234,69 @@ namespace Gigamonkey::Bitcoin::interpreter {
     }
     
     template <typename valtype>
-    LimitedVector<valtype>::LimitedVector (const valtype &stackElementIn, LimitedStack<valtype> &stackIn) : stackElement (stackElementIn), stack (stackIn) {}
+    LimitedVector<valtype>::LimitedVector (const valtype &stackElementIn, LimitedStack<valtype> &stackIn) :
+        stackElement (stackElementIn), ropeElement {}, stack (stackIn) {}
+    
+    template <typename valtype>
+    LimitedVector<valtype>::LimitedVector (valtype &&stackElementIn, LimitedStack<valtype> &stackIn) : 
+        stackElement (std::move (stackElementIn)), ropeElement {}, stack (stackIn) {}
+    
+    template <typename valtype>
+    void LimitedVector<valtype>::flatten () const {
+        if (ropeElement == nullptr) return;
+        stackElement.resize (ropeElement->Size);
+        ropeElement->write (stackElement.data ());
+        ropeElement = nullptr;
+    }
+    
+    template <typename valtype>
+    const ptr<const rope> &LimitedVector<valtype>::asRope () const {
+        if (ropeElement == nullptr && !stackElement.empty ()) {
+            ropeElement = rope::make (std::move (static_cast<bytes &> (stackElement)));
+            stackElement.clear ();
+        }
+        
+        return ropeElement;
+    }
+    
+    template <typename valtype>
+    void LimitedVector<valtype>::setRope (ptr<const rope> r) {
+        stackElement.clear ();
+        ropeElement = r;
+        if (ropeElement != nullptr && ropeElement->Size < MIN_ROPE_SIZE) flatten ();
+    }
     
     template <typename valtype>
     const valtype& LimitedVector<valtype>::GetElement () const {
+        flatten ();
         return stackElement;
     }
     
     template <typename valtype>
     valtype& LimitedVector<valtype>::GetElementNonConst () {
+        flatten ();
         return stackElement;
     }
     
     template <typename valtype>
     size_t LimitedVector<valtype>::size () const {
-        return stackElement.size ();
+        return ropeElement != nullptr ? ropeElement->Size : stackElement.size ();
     }
     
     template <typename valtype>
     bool LimitedVector<valtype>::empty () const {
-        return stackElement.empty ();
+        return size () == 0;
     }
     
     template <typename valtype>
     uint8_t& LimitedVector<valtype>::operator [] (uint64_t pos) {
+        flatten ();
         return stackElement[pos];
     }
     
     template <typename valtype>
     const uint8_t &LimitedVector<valtype>::operator [] (uint64_t pos) const {
+        flatten ();
         return stackElement[pos];
     }
     
@@ -217,17 +304,20 @@ namespace Gigamonkey::Bitcoin::interpreter {
     void LimitedVector<valtype>::push_back (uint8_t element)
     {
         stack.get ().increaseCombinedStackSize (1);
+        flatten ();
         stackElement.push_back (element);
     }
     
     template <typename valtype>
     void LimitedVector<valtype>::append (const LimitedVector &second) {
         stack.get ().increaseCombinedStackSize (second.size ());
+        flatten ();
         stackElement.insert (stackElement.end (), second.begin (), second.end ());
     }
     
     template <typename valtype>
     void LimitedVector<valtype>::padRight (size_t size, uint8_t signbit) {
+        flatten ();
         if (size > stackElement.size ())
         {
             size_t sizeDifference = size - stackElement.size ();
@@ -241,46 +331,55 @@ namespace Gigamonkey::Bitcoin::interpreter {
     
     template <typename valtype>
     typename valtype::iterator LimitedVector<valtype>::begin () {
+        flatten ();
         return stackElement.begin ();
     }
     
     template <typename valtype>
     typename valtype::iterator LimitedVector<valtype>::end () {
+        flatten ();
         return stackElement.end ();
     }
     
     template <typename valtype>
     const typename valtype::const_iterator LimitedVector<valtype>::begin () const {
+        flatten ();
         return stackElement.begin ();
     }
     
     template <typename valtype>
     const typename valtype::const_iterator LimitedVector<valtype>::end () const {
+        flatten ();
         return stackElement.end ();
     }
     
     template <typename valtype>
     uint8_t &LimitedVector<valtype>::front () {
+        flatten ();
         return stackElement.front ();
     }
     
     template <typename valtype>
     uint8_t &LimitedVector<valtype>::back () {
+        flatten ();
         return stackElement.back ();
     }
     
     template <typename valtype>
     const uint8_t &LimitedVector<valtype>::front () const {
+        flatten ();
         return stackElement.front();
     }
     
     template <typename valtype>
     const uint8_t &LimitedVector<valtype>::back () const {
+        flatten ();
         return stackElement.back ();
     }
     
     template <typename valtype>
     bool LimitedVector<valtype>::MinimallyEncode () {
+        flatten ();
         stack.get ().decreaseCombinedStackSize (stackElement.size ());
         bool successfulEncoding = bsv::MinimallyEncode (stackElement);
         stack.get ().increaseCombinedStackSize (stackElement.size ());
@@ -290,6 +389,7 @@ namespace Gigamonkey::Bitcoin::interpreter {
     
     template <typename valtype>
     bool LimitedVector<valtype>::IsMinimallyEncoded (uint64_t maxSize) const {
+        flatten ();
         return bsv::IsMinimallyEncoded (stackElement, maxSize);
     }
     
@@ -343,12 +443,50 @@ namespace Gigamonkey::Bitcoin::interpreter {
         }
     }
     
+    template <typename valtype>
+    LimitedStack<valtype> &LimitedStack<valtype>::root () {
+        return parentStack != nullptr ? parentStack->root () : *this;
+    }
+    
+    template <typename valtype>
+    valtype LimitedStack<valtype>::makeElement (const uint8_t *begin, const uint8_t *end) {
+        std::vector<valtype> &spare = root ().spareElements;
+        if (spare.empty ()) return valtype (std::vector<uint8_t> (begin, end));
+        
+        valtype element {std::move (spare.back ())};
+        spare.pop_back ();
+        element.assign (begin, end);
+        return element;
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::releaseElement (valtype &&element) {
+        std::vector<valtype> &spare = root ().spareElements;
+        if (spare.size () >= MAX_SPARE_ELEMENTS || element.capacity () > MAX_SPARE_ELEMENT_CAPACITY) return;
+        
+        element.clear ();
+        spare.push_back (std::move (element));
+    }
+    
+    template <typename valtype>
+    LimitedVector<valtype> LimitedStack<valtype>::copy (const LimitedVector<valtype> &element) {
+        if (element.ropeElement == nullptr) {
+            const valtype &e = element.stackElement;
+            return LimitedVector<valtype> {makeElement (e.data (), e.data () + e.size ()), *this};
+        }
+        
+        LimitedVector<valtype> x {makeElement (nullptr, nullptr), *this};
+        x.ropeElement = element.ropeElement;
+        return x;
+    }
+    
     template <typename valtype>
     void LimitedStack<valtype>::pop_back () {
         if (stack.empty ())
             throw std::runtime_error ("popstack(): stack empty");
 
         decreaseCombinedStackSize (stacktop (-1).size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
+        releaseElement (std::move (stack.back ().stackElement));
         stack.pop_back ();
     }
     
@@ -359,13 +497,98 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 ("Invalid argument - element that is added should have the same parent stack as the one we are adding to.");
 
         increaseCombinedStackSize (element.size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
-        stack.push_back (element);
+        stack.push_back (copy (element));
     }
     
     template <typename valtype>
     void LimitedStack<valtype>::push_back (const valtype &element) {
         increaseCombinedStackSize (element.size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
-        stack.push_back (LimitedVector {element, *this});
+        stack.push_back (LimitedVector<valtype> {makeElement (element.data (), element.data () + element.size ()), *this});
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::push (bytes_view b) {
+        increaseCombinedStackSize (b.size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
+        stack.push_back (LimitedVector<valtype> {makeElement (b.data (), b.data () + b.size ()), *this});
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::clear () {
+        for (LimitedVector<valtype> &it : stack) {
+            decreaseCombinedStackSize (it.size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
+            releaseElement (std::move (it.stackElement));
+        }
+        
+        stack.clear ();
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::cat () {
+        if (stack.size () < 2) throw std::runtime_error ("cat(): stack has fewer than two elements");
+        
+        LimitedVector<valtype> &first = stack[stack.size () - 2];
+        LimitedVector<valtype> &second = stack.back ();
+        
+        // the same as popping the second element and appending it to the first.
+        decreaseCombinedStackSize (LimitedVector<valtype>::ELEMENT_OVERHEAD);
+        
+        if (first.size () + second.size () < LimitedVector<valtype>::MIN_ROPE_SIZE) {
+            first.flatten ();
+            second.flatten ();
+            first.stackElement.insert (first.stackElement.end (), second.stackElement.begin (), second.stackElement.end ());
+        } else first.ropeElement = rope::join (first.asRope (), second.asRope ());
+        
+        releaseElement (std::move (second.stackElement));
+        stack.pop_back ();
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::split (size_t position) {
+        if (stack.empty ()) throw std::runtime_error ("split(): stack empty");
+        
+        LimitedVector<valtype> &x = stack.back ();
+        if (position > x.size ()) throw std::out_of_range ("split(): position is past the end of the element");
+        
+        // the same as popping the element and pushing both parts.
+        increaseCombinedStackSize (LimitedVector<valtype>::ELEMENT_OVERHEAD);
+        
+        if (x.ropeElement == nullptr) {
+            valtype rest = makeElement (x.stackElement.data () + position, x.stackElement.data () + x.stackElement.size ());
+            x.stackElement.resize (position);
+            stack.push_back (LimitedVector<valtype> {std::move (rest), *this});
+            return;
+        }
+        
+        auto [left, right] = rope::split (x.ropeElement, position);
+        LimitedVector<valtype> rest {makeElement (nullptr, nullptr), *this};
+        rest.setRope (right);
+        x.setRope (left);
+        stack.push_back (std::move (rest));
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::setMaxStackSize (uint64_t maxStackSizeIn) {
+        if (parentStack != nullptr || !stack.empty ())
+            throw std::runtime_error ("Max stack size can only be changed on an empty root stack.");
+        
+        maxStackSize = maxStackSizeIn;
+    }
+    
+    template <typename valtype>
+    void LimitedStack<valtype>::share (const LimitedStack &other) {
+        if (!stack.empty () || (parentStack == nullptr) != (other.parentStack == nullptr))
+            throw std::runtime_error ("A stack can only be shared into an empty stack of the same kind.");
+        
+        if (parentStack == nullptr) {
+            maxStackSize = other.maxStackSize;
+            combinedStackSize = other.combinedStackSize;
+        }
+        
+        stack.reserve (other.stack.size ());
+        for (const LimitedVector<valtype> &element : other.stack) {
+            if (element.size () >= LimitedVector<valtype>::MIN_ROPE_SIZE) element.asRope ();
+            stack.push_back (copy (element));
+        }
     }
     
     template <typename valtype>
@@ -389,8 +612,10 @@ namespace Gigamonkey::Bitcoin::interpreter {
         if (last >= 0 || last <= first)
             throw std::invalid_argument ("Invalid argument - first and last should be negative, also last should be larger than first.");
 
-        for (typename std::vector<LimitedVector<valtype>>::iterator it = stack.end () + first; it != stack.end () + last; it++)
+        for (typename std::vector<LimitedVector<valtype>>::iterator it = stack.end () + first; it != stack.end () + last; it++) {
             decreaseCombinedStackSize (it->size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
+            releaseElement (std::move (it->stackElement));
+        }
 
         stack.erase (stack.end () + first, stack.end () + last);
     }
@@ -400,6 +625,7 @@ namespace Gigamonkey::Bitcoin::interpreter {
         if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
 
         decreaseCombinedStackSize (stack.at (stack.size () + index).size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
+        releaseElement (std::move (stack.at (stack.size () + index).stackElement));
         stack.erase (stack.end () + index);
     }
 
@@ -412,7 +638,7 @@ namespace Gigamonkey::Bitcoin::interpreter {
         if (position >= 0) throw std::invalid_argument ("Invalid argument - position should be < 0.");
 
         increaseCombinedStackSize (element.size () + LimitedVector<valtype>::ELEMENT_OVERHEAD);
-        stack.insert (stack.end () + position, element);
+        stack.insert (stack.end () + position, copy (element));
     }
     
     template <typename valtype>
@@ -6,6 +6,8 @@
 
 #include <gigamonkey/types.hpp>
 
+#include <vector>
+
 namespace Gigamonkey {
 
     struct typed_data {
@@ -25,7 +27,16 @@ namespace Gigamonkey {
             return write (bitcoin_script, 1u, n, b);
         }
         
-        static constexpr auto pattern = ctll::fixed_string {"bitcoin-script:(([0-9a-f][0-9a-f])*)|(([0-9A-F][0-9A-F])*)"};
+        // many scripts for the same network at once.
+        static std::vector<string> write (network, const std::vector<bytes> &);
+        
+        // the size of the string for a script of the given size.
+        static constexpr size_t write_size (size_t script_size) {
+            return 15 + 2 * (script_size + 2) + 8;
+        }
+        
+        // write to out, which must have room for write_size (script.size ()) characters.
+        static void write (char *out, network, bytes_view script);
         
         type Type;
         byte Version;
@@ -42,7 +53,15 @@ namespace Gigamonkey {
         
         static typed_data read (string_view);
         
+        // read into a buffer that belongs to the caller so that its memory can be
+        // reused. False if the string is not a valid bitcoin-script of version 1.
+        static bool read (string_view, network &, bytes &script);
+        
+        static std::vector<typed_data> read (const std::vector<string_view> &);
+        
     private:
+        static void write (char *out, byte version, network, bytes_view script);
+        
         typed_data (type t, byte version, network n, const bytes &b):
             Type {t}, Version {version}, Network {n}, Data {b} {}
         typed_data (): Type {}, Version {0}, Network {}, Data {} {}
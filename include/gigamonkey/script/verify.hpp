@@ -0,0 +1,89 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_VERIFY
+#define GIGAMONKEY_SCRIPT_VERIFY
+
+#include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/script/script_cache.hpp>
+#include <gigamonkey/ledger.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/view.hpp>
+
+#include <span>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // Evaluate every input script of a transaction in parallel and return a result 
+    // for each input. There must be one prevout for each input in the same order. 
+    // The sighash digests that are the same for every input are computed only once. 
+    // If stop_on_failure is set, inputs that were not evaluated because some other 
+    // input failed first are left as result {}. If a cache is provided, signatures 
+    // are looked up in it first and valid signatures are added to it. If a script 
+    // cache is provided, inputs that are in it are not evaluated again and every 
+    // input that succeeds is added to it. 
+    std::vector<result> verify_transaction (bytes_view tx, std::span<const prevout> prevouts, uint32 flags, 
+        executor &, bool stop_on_failure = false, signature_cache * = nullptr, script_cache * = nullptr);
+    
+    std::vector<result> verify_transaction (const transaction &tx, std::span<const prevout> prevouts, uint32 flags, 
+        executor &, bool stop_on_failure = false, signature_cache * = nullptr, script_cache * = nullptr);
+    
+    std::vector<result> verify_transaction (const transaction_view &tx, std::span<const prevout> prevouts, uint32 flags, 
+        executor &, bool stop_on_failure = false, signature_cache * = nullptr, script_cache * = nullptr);
+    
+    // true if every result in the list is a success. 
+    bool inline verified (const std::vector<result> &r) {
+        for (const result &x : r) if (!x.verify ()) return false;
+        return true;
+    }
+    
+    // what happened to one transaction of a block.
+    struct transaction_result {
+        enum status : byte {
+            valid,
+            
+            // a script failed. Inputs says which.
+            invalid_script,
+            
+            // an output that is spent is not in the block or the ledger.
+            missing_prevout,
+            
+            // spends a coinbase or a transaction that comes after it in the block,
+            // or spends more than its inputs are worth.
+            invalid_transaction,
+            
+            // spends an output that an earlier transaction in the block spent.
+            double_spend,
+            
+            // spends an output of a transaction in the block that is not valid.
+            dependency_failed
+        };
+        
+        status Status;
+        
+        // one for each input, or empty if the scripts were not evaluated.
+        std::vector<result> Inputs;
+        
+        bool verify () const {
+            return Status == valid;
+        }
+    };
+    
+    struct block_result {
+        // one for each transaction after the coinbase.
+        std::vector<transaction_result> Transactions;
+        bool Valid;
+    };
+    
+    // Verify the scripts of every transaction of a block but the coinbase. Outputs
+    // of transactions in the block are read from the block, and all the others are
+    // asked for from the ledger at once. A transaction that spends an output of
+    // another in the block must be verified after it, so transactions are put into
+    // waves by how far down such a chain they are, and every input of every
+    // transaction in a wave is evaluated together on the executor.
+    block_result verify_block (const block_view &, const ledger &, uint32 flags,
+        executor &, signature_cache * = nullptr, script_cache * = nullptr);
+    
+}
+
+#endif
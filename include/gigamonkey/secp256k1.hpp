@@ -9,6 +9,14 @@
 #include <data/encoding/integer.hpp>
 #include <data/crypto/encrypted.hpp>
 
+#include <array>
+#include <span>
+#include <vector>
+
+namespace Gigamonkey {
+    struct executor;
+}
+
 namespace Gigamonkey::secp256k1 {
     
     using coordinate = uint256;
@@ -26,6 +34,17 @@ namespace Gigamonkey::secp256k1 {
     bool operator == (const point &, const point &);
     bool operator != (const point &, const point &);
     
+    // libsecp256k1 needs tables that take a while to build. By default they 
+    // are built the first time they are needed. Call warm_contexts at startup 
+    // to build them ahead of time. If per-thread contexts are enabled, call 
+    // it again from each thread that will sign. All of this is thread safe.
+    void warm_contexts ();
+    
+    // If enabled, each thread that signs gets its own copy of the signing 
+    // context, randomized to protect against side-channel attacks. Otherwise 
+    // all threads share one context, which is randomized when it is created. 
+    void per_thread_contexts (bool enable = true);
+    
     struct secret;
     struct pubkey;
     
@@ -93,6 +112,10 @@ namespace Gigamonkey::secp256k1 {
         static bytes negate (bytes_view);
         static bytes plus_pubkey (bytes_view, bytes_view);
         static bytes plus_secret (bytes_view, const uint256&);
+        
+        // pk + sk for count values of sk, written to out one after another,
+        // parsing pk only once. False if any of them fails.
+        static bool plus_secrets (bytes_view pk, const uint256 *sk, size_t count, byte *out);
         static bytes times (bytes_view, bytes_view);
         
         static bool valid_size (size_t size) {
@@ -128,6 +151,87 @@ namespace Gigamonkey::secp256k1 {
     private:
         explicit pubkey (bytes&& b) : bytes {b} {}
         friend struct secret;
+        friend struct parsed_pubkey;
+    };
+    
+    // A signature and a pubkey that have been decoded, for when one is checked against
+    // many of the other, as in OP_CHECKMULTISIG, so that each is only decoded once.
+    struct parsed_signature {
+        // invalid.
+        parsed_signature () : Data {}, Valid {false}, StrictDER {false}, LowS {false} {}
+        
+        // the signature is normalized, as in pubkey::verify.
+        explicit parsed_signature (bytes_view der);
+        
+        // Decode a signature that must be strict DER, as in BIP 66, checking the
+        // encoding, reading R and S and checking whether S is low all at once,
+        // so that a script does not need to look at a signature again before it
+        // is verified. Invalid if it is not strict DER or R or S is out of range.
+        static parsed_signature strict (bytes_view der);
+        
+        bool valid () const {
+            return Valid;
+        }
+        
+        // for a signature from strict, whether it was strict DER and whether S was low,
+        // as in signature::minimal and signature::normalized. False for any other.
+        bool strict_DER () const {
+            return StrictDER;
+        }
+        
+        bool low_S () const {
+            return LowS;
+        }
+        
+    private:
+        // the internal representation of secp256k1_ecdsa_signature.
+        std::array<byte, 64> Data;
+        bool Valid;
+        bool StrictDER;
+        bool LowS;
+        
+        friend struct parsed_pubkey;
+    };
+    
+    // Parsing a pubkey means decompressing it, which takes a square root, so
+    // a chain of operations on the same point, as in BIP 32 public derivation
+    // or ECIES, should parse it once and serialize only what it needs.
+    struct parsed_pubkey {
+        explicit parsed_pubkey (bytes_view);
+        
+        bool valid () const {
+            return Valid;
+        }
+        
+        // the form in which the point is serialized, which is the form that it
+        // was parsed in and which results of arithmetic keep from the left side.
+        bool compressed () const {
+            return Compressed;
+        }
+        
+        // the same as pubkey::verify. False if either could not be parsed.
+        bool verify (const digest &, const parsed_signature &) const;
+        bool verify (const digest &, bytes_view sig) const;
+        
+        // invalid if the point was invalid or if the result is the point at infinity.
+        parsed_pubkey compress () const;
+        parsed_pubkey decompress () const;
+        parsed_pubkey operator - () const;
+        parsed_pubkey operator + (const parsed_pubkey &) const;
+        parsed_pubkey operator + (const uint256 &) const;
+        parsed_pubkey operator * (const uint256 &) const;
+        
+        // empty if invalid.
+        pubkey serialize () const;
+        
+        // write the serialization to out, which must have room for it.
+        bool serialize (byte *out) const;
+        
+    private:
+        // the internal representation of secp256k1_pubkey.
+        std::array<byte, 64> Data;
+        bool Valid;
+        bool Compressed;
     };
     
     struct secret final : public nonzero<uint256> {
@@ -135,6 +239,17 @@ namespace Gigamonkey::secp256k1 {
         static bool valid (bytes_view);
         static bytes to_public_compressed (bytes_view);
         static bytes to_public_uncompressed (bytes_view);
+        
+        // the pubkeys of count secrets stored one after another, 32 bytes each, written
+        // one after another to out, 33 or 65 bytes each. They all use the precomputed
+        // tables of one signing context. False if any secret is invalid.
+        static bool to_public (const byte *secrets, size_t count, byte *out, bool compressed = true);
+        
+        // the pubkeys of first, first + 1, first + 2 and so on, where secrets are read as
+        // big endian numbers. Each is the one before plus the generator, which is much
+        // faster than multiplying.
+        static bool to_public_consecutive (const uint256 &first, size_t count, byte *out, bool compressed = true);
+        
         static signature sign (bytes_view, const digest&);
         
         static uint256 negate (const uint256&);
@@ -162,6 +277,32 @@ namespace Gigamonkey::secp256k1 {
         
     };
     
+    // A secret that signs many times, as the key of a hot wallet does. The key is
+    // checked once and the part of the RFC 6979 nonce derivation that depends only
+    // on the key is done once. Signatures are the same as those from secret::sign.
+    struct signing_key {
+        explicit signing_key (const secret &);
+        ~signing_key ();
+        
+        bool valid () const {
+            return Valid;
+        }
+        
+        // empty if the key is not valid.
+        signature sign (const digest &) const;
+        
+        // sign every digest, on the threads of an executor if one is given.
+        std::vector<signature> sign (std::span<const digest>, executor * = nullptr) const;
+        
+    private:
+        std::array<byte, 32> Secret;
+        
+        // the first HMAC of the nonce derivation has an all-zero key. This is its inner
+        // hash after the inner pad and the 64 bytes that come before the last byte of Secret.
+        sha256::state Midstate;
+        bool Valid;
+    };
+    
     bool inline operator == (const point &a, const point &b) {
         return a.R == b.R && a.S == b.S;
     }
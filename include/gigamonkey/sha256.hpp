@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SHA256
+#define GIGAMONKEY_SHA256
+
+#include <gigamonkey/types.hpp>
+
+// SHA-256 kernels for the fixed-size messages that appear over and over
+// in Bitcoin, such as 80-byte block headers. Several messages are hashed
+// in parallel using whatever the cpu supports, which is detected at runtime.
+namespace Gigamonkey::sha256 {
+    
+    // the internal state of SHA-256 between blocks.
+    using state = std::array<uint32, 8>;
+    
+    const state &initial ();
+    
+    enum class implementation : byte {
+        // portable code, 4 messages at a time.
+        generic = 0,
+        // 8 messages at a time.
+        avx2 = 1,
+        // the Intel SHA extensions, one message at a time.
+        shani = 2,
+        // 16 messages at a time.
+        avx512 = 3,
+        // the ARMv8 cryptography extensions, one message at a time.
+        armv8 = 4
+    };
+    
+    const char *name (implementation);
+    
+    // whether this implementation was built and is supported by this cpu.
+    bool supported (implementation);
+    
+    // the fastest supported implementation.
+    implementation best ();
+    
+    // the number of messages that an implementation works on at once.
+    size_t lanes (implementation);
+    
+    // The fastest supported implementation for one message at a time, which is
+    // what transform uses. The blocks of one message are hashed one after another,
+    // so lanes do not help and this is one of shani, armv8 or generic.
+    implementation best_single ();
+    
+    // process 64-byte blocks. The state is not finalized.
+    void transform (state &, const byte *blocks, size_t count);
+    
+    // SHA-256 of a message of any length, written in pieces, using transform.
+    // It has the same interface as CSHA256 so that it can be used in its place.
+    struct hasher {
+        static constexpr size_t OUTPUT_SIZE = 32;
+        
+        hasher () : State {initial ()}, Buffer {}, Size {0} {}
+        
+        // continue from the state after size bytes, which must be a multiple of 64.
+        hasher (const state &midstate, uint64 size) : State {midstate}, Buffer {}, Size {size} {}
+        
+        hasher &Write (const byte *data, size_t size);
+        
+        // 32 bytes are written to out. The hasher must be reset before it is used again.
+        void Finalize (byte *out);
+        
+        hasher &Reset () {
+            State = initial ();
+            Size = 0;
+            return *this;
+        }
+        
+    private:
+        state State;
+        byte Buffer[64];
+        
+        // bytes written so far.
+        uint64 Size;
+    };
+    
+    // double SHA-256 of count 80-byte messages stored contiguously.
+    // 32 * count bytes are written to out.
+    void double_hash_80 (byte *out, const byte *in, size_t count, implementation = best ());
+    
+    // double SHA-256 of count 64-byte messages stored contiguously, which
+    // is what is done to every pair of digests in a Merkle tree.
+    void double_hash_64 (byte *out, const byte *in, size_t count, implementation = best ());
+    
+    // double SHA-256 of count messages of size bytes each stored contiguously, such
+    // as the data in base 58 check strings. size must be less than 56.
+    void double_hash_short (byte *out, const byte *in, size_t size, size_t count, implementation = best ());
+    
+    // SHA-256, done once, of count messages of size bytes each stored contiguously,
+    // such as compressed pubkeys for Hash160. size must be less than 56.
+    void hash_short (byte *out, const byte *in, size_t size, size_t count, implementation = best ());
+    
+    // double SHA-256 of count 80-byte messages which share their first 64 bytes.
+    // midstate is the result of transforming the first 64 bytes and the last 16
+    // bytes of each message are stored contiguously in tails.
+    void double_hash_80 (byte *out, const state &midstate, const byte *tails, size_t count, implementation = best ());
+    
+}
+
+#endif
@@ -7,6 +7,8 @@
 #include <gigamonkey/hash.hpp>
 #include <gigamonkey/incomplete.hpp>
 
+#include <vector>
+
 namespace Gigamonkey::Bitcoin {
     namespace sighash {
         
@@ -51,6 +53,9 @@ namespace Gigamonkey::Bitcoin {
         // depending on the sighash directive. 
         struct document;
         
+        // the same information without owning any of it.
+        struct document_view;
+        
     };
     
     sighash::directive inline directive (sighash::type t, bool anyone_can_pay = false, bool fork_id = true) {
@@ -59,6 +64,28 @@ namespace Gigamonkey::Bitcoin {
     
     namespace sighash {
         
+        namespace Amaury {
+            digest256 hash_prevouts (const incomplete::transaction &);
+            digest256 hash_sequence (const incomplete::transaction &);
+            digest256 hash_outputs (const incomplete::transaction &);
+        }
+        
+        // the parts of the Amaury sighash that are the same for every input of a 
+        // transaction. Compute them once and share them between the documents of 
+        // every input, or else signing a transaction takes time O(n^2) in the inputs. 
+        struct precomputed {
+            digest256 HashPrevouts;
+            digest256 HashSequence;
+            digest256 HashOutputs;
+            
+            // the inputs and outputs of the transaction, so that the one at 
+            // the index of a document can be found without going through a list. 
+            std::vector<incomplete::input> Inputs;
+            std::vector<output> Outputs;
+            
+            explicit precomputed (const incomplete::transaction &tx);
+        };
+        
         // the document containing the information that is signed. 
         struct document {
             // the amount being redeemed. This is ignored in the original hash
@@ -77,18 +104,59 @@ namespace Gigamonkey::Bitcoin {
             // the index of the input containing the signature. 
             index InputIndex;
             
+            // optional data precomputed from Transaction. 
+            ptr<const precomputed> Precomputed;
+            
             bool valid () const {
                 return RedeemedValue >= 0 && InputIndex < Transaction.Inputs.size ();
             }
             
             document (satoshi r, bytes_view script_code, incomplete::transaction tx, index i) :
-                RedeemedValue {r}, ScriptCode {script_code}, Transaction {tx}, InputIndex {i} {}
+                RedeemedValue {r}, ScriptCode {script_code}, Transaction {tx}, InputIndex {i}, Precomputed {} {}
+            
+            // p must have been computed from tx. 
+            document (satoshi r, bytes_view script_code, incomplete::transaction tx, index i, ptr<const precomputed> p) :
+                RedeemedValue {r}, ScriptCode {script_code}, Transaction {tx}, InputIndex {i}, Precomputed {p} {}
+            
+        };
+        
+        // What the script interpreter signs with. A signature operation gives the part
+        // of the script that it is in and everything else is borrowed from the document
+        // of the input, so that checking a signature copies nothing. The transaction
+        // and the script code must outlive the view.
+        struct document_view {
+            satoshi RedeemedValue;
+            bytes_view ScriptCode;
+            const incomplete::transaction &Transaction;
+            index InputIndex;
+            
+            // optional, as for document.
+            const precomputed *Precomputed;
             
+            document_view (satoshi r, bytes_view script_code, const incomplete::transaction &tx, index i, const precomputed *p = nullptr) :
+                RedeemedValue {r}, ScriptCode {script_code}, Transaction {tx}, InputIndex {i}, Precomputed {p} {}
+            
+            document_view (const document &doc) :
+                document_view {doc.RedeemedValue, doc.ScriptCode, doc.Transaction, doc.InputIndex, doc.Precomputed.get ()} {}
+            
+            // the sizes are taken from Precomputed if there is one, since
+            // the size of a list takes time proportional to its length.
+            size_t inputs () const {
+                return Precomputed != nullptr ? Precomputed->Inputs.size () : Transaction.Inputs.size ();
+            }
+            
+            size_t outputs () const {
+                return Precomputed != nullptr ? Precomputed->Outputs.size () : Transaction.Outputs.size ();
+            }
+            
+            bool valid () const {
+                return RedeemedValue >= 0 && InputIndex < inputs ();
+            }
         };
         
         bytes write (const document&, sighash::directive);
         
-        writer &write (writer &w, const document &doc, sighash::directive d);
+        writer &write (writer &w, const document_view &doc, sighash::directive d);
         
         bytes inline write (const document &doc, sighash::directive d) {
             lazy_bytes_writer w;
@@ -96,12 +164,21 @@ namespace Gigamonkey::Bitcoin {
             return w;
         }
         
+        // use precomputed data for the transaction in doc. 
+        writer &write (writer &w, const document_view &doc, sighash::directive d, const precomputed &);
+        
+        bytes inline write (const document &doc, sighash::directive d, const precomputed &p) {
+            lazy_bytes_writer w;
+            write (w, doc, d, p);
+            return w;
+        }
+        
         // two different functions are in use, due to the bitcoin Cash hard fork. 
         bytes write_original (const document &, sighash::directive);
         bytes write_Bitcoin_Cash (const document &, sighash::directive);
         
-        writer &write_original (writer &, const document &, sighash::directive);
-        writer &write_Bitcoin_Cash (writer &, const document &, sighash::directive);
+        writer &write_original (writer &, const document_view &, sighash::directive);
+        writer &write_Bitcoin_Cash (writer &, const document_view &, sighash::directive);
         
         bytes inline write_original (const document &doc, sighash::directive d) {
             lazy_bytes_writer w;
@@ -115,29 +192,28 @@ namespace Gigamonkey::Bitcoin {
             return w;
         }
         
-        writer inline &write (writer &w, const document &doc, sighash::directive d) {
+        writer inline &write (writer &w, const document_view &doc, sighash::directive d) {
             return write_Bitcoin_Cash (w, doc, d);
         }
         
         // a fake transaction constructed from an incomplete transaction that is used in the original sighash algorithm. 
+        // write_original writes the same thing followed by the directive without constructing it. 
         transaction reconstruct (const document &doc, sighash::directive d);
         
-        writer inline &write_original (writer &w, const document &doc, sighash::directive d) {
-            return w << reconstruct (doc, d) << uint32_little {d};
-        }
-        
         namespace Amaury {
             bytes write (const document&, sighash::directive);
-            writer &write (writer &w, const document &doc, sighash::directive d);
-            digest256 hash_prevouts (const incomplete::transaction &);
-            digest256 hash_sequence (const incomplete::transaction &);
-            digest256 hash_outputs (const incomplete::transaction &);
+            writer &write (writer &w, const document_view &doc, sighash::directive d);
+            writer &write (writer &w, const document_view &doc, sighash::directive d, const precomputed &);
         }
         
-        writer inline &write_Bitcoin_Cash (writer &w, const document &doc, sighash::directive d) {
+        writer inline &write_Bitcoin_Cash (writer &w, const document_view &doc, sighash::directive d) {
             return sighash::has_fork_id (d) ? Amaury::write (w, doc, d) : write_original (w, doc, d & ~sighash::fork_id);
         }
         
+        writer inline &write (writer &w, const document_view &doc, sighash::directive d, const precomputed &p) {
+            return sighash::has_fork_id (d) ? Amaury::write (w, doc, d, p) : write_original (w, doc, d & ~sighash::fork_id);
+        }
+        
         namespace Amaury {
         
             bytes inline write (const document &doc, sighash::directive d) {
@@ -146,7 +222,7 @@ namespace Gigamonkey::Bitcoin {
                 return w;
             }
             
-            writer &write (writer &w, const document &doc, sighash::directive d);
+            writer &write (writer &w, const document_view &doc, sighash::directive d);
         }
         
     }
@@ -34,7 +34,7 @@ namespace Gigamonkey::Bitcoin {
         static bool DER (bytes_view x);
         
         // the hash that gets signed. 
-        static digest256 hash (const sighash::document &doc, sighash::directive d);
+        static digest256 hash (const sighash::document_view &doc, sighash::directive d);
         
     };
 
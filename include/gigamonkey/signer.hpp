@@ -0,0 +1,50 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SIGNER
+#define GIGAMONKEY_SIGNER
+
+#include <gigamonkey/fees.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/schema/keysource.hpp>
+
+#include <vector>
+
+namespace Gigamonkey {
+    
+    // Signs every input of a transaction_design. The incomplete transaction and the
+    // parts of the Amaury sighash that are the same for every input are made once,
+    // and the inputs and outputs are kept in arrays so that the document for any
+    // input can be written without going through the lists. With an executor, the
+    // inputs are signed in parallel.
+    struct signer {
+        explicit signer (const transaction_design &);
+        
+        size_t size () const {
+            return Inputs.size ();
+        }
+        
+        // the same as Bitcoin::signature::hash (Design.documents ()[i], d).
+        digest256 hash (size_t i, Bitcoin::sighash::directive d = Bitcoin::directive (Bitcoin::sighash::all)) const;
+        
+        // one key for each input, in order.
+        std::vector<Bitcoin::signature> sign (const std::vector<Bitcoin::secret> &,
+            Bitcoin::sighash::directive d = Bitcoin::directive (Bitcoin::sighash::all)) const;
+        std::vector<Bitcoin::signature> sign (const std::vector<Bitcoin::secret> &, Bitcoin::sighash::directive, executor &) const;
+        
+        // keys are taken from the source one for each input, in order.
+        std::vector<Bitcoin::signature> sign (key_source &, Bitcoin::sighash::directive, executor &) const;
+        
+        const transaction_design Design;
+    
+    private:
+        Bitcoin::incomplete::transaction Transaction;
+        ptr<const Bitcoin::sighash::precomputed> Precomputed;
+        std::vector<transaction_design::input> Inputs;
+        std::vector<Bitcoin::output> Outputs;
+        std::vector<bytes> ScriptCodes;
+    };
+    
+}
+
+#endif
@@ -6,6 +6,16 @@
 
 #include <gigamonkey/timechain.hpp>
 #include <gigamonkey/merkle/dual.hpp>
+#include <gigamonkey/memory.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
 
 namespace Gigamonkey {
     
@@ -20,6 +30,9 @@ namespace Gigamonkey {
             N Height;
             work::difficulty Cumulative;
             
+            // the work of the chain up to and including this header, by which chains are compared.
+            work::chainwork Work;
+            
             bool operator == (const header& h) const {
                 return Header == h.Header;
             }
@@ -33,7 +46,17 @@ namespace Gigamonkey {
             }
             
             header ();
-            header (digest256 s, Bitcoin::header h, N n, work::difficulty d) : Hash {s}, Header {h}, Height {n}, Cumulative {d} {}
+            header (digest256 s, Bitcoin::header h, N n, work::difficulty d, work::chainwork w) :
+                Hash {s}, Header {h}, Height {n}, Cumulative {d}, Work {w} {}
+            
+            // the header with the given hash that comes after this one in its chain.
+            header next (const Bitcoin::header &h, const digest256 &hash) const {
+                return header {hash, h, Height + 1, Cumulative + h.Target.difficulty (), Work + work::chainwork {h.Target}};
+            }
+            
+            header next (const Bitcoin::header &h) const {
+                return next (h, h.hash ());
+            }
         };
         
         virtual header latest () const = 0;
@@ -52,134 +75,282 @@ namespace Gigamonkey {
         // an in-memory version of headers.
         class memory;
         
+        // the best chain stored in a file.
+        class file;
+        
+        virtual ~headers () {}
+        
     };
     
-    /*class headers::memory final : headers {
+    // Headers kept in memory. The best chain is an array indexed by height and
+    // every header can be found by its hash, so both lookups take constant time.
+    // A header that extends any known header is accepted, and if its chain now
+    // has more work than the best chain, the best chain is switched over to it
+    // without copying any headers. Chains are compared by their exact work, so
+    // comparing two tips takes the same time no matter how long they are.
+    //
+    // Headers are read far more often than they are written, so reads never wait
+    // for a lock. Every insert publishes a snapshot of the store that does not
+    // change, which shares all but the end of the best chain with the snapshot
+    // before, and headers are found by hash in a table that is only added to.
+    // Inserts wait for one another. Merkle proofs have a lock of their own.
+    //
+    // Subscribers are told of every change to the best chain with the point at
+    // which the new chain leaves the old one, so that anything that depends on
+    // the best chain only needs to forget what was above that point.
+    class headers::memory final : public headers {
         struct entry : header {
+            const entry *Previous;
+            
+            // the height as an index into the best chain.
+            uint64 Index;
+            
+            // the order in which entries were made, by which a snapshot knows whether it has this one.
+            uint64 Sequence;
+            
             Merkle::map Tree;
-            entry(digest256 s, Bitcoin::header h, N n, work::difficulty d) : header{s, h, n, d}, Tree{} {}
+            
+            entry (const header &x, uint64 n, const entry *p, uint64 s) :
+                header {x}, Previous {p}, Index {n}, Sequence {s}, Tree {} {}
         };
         
-        struct chain {
-            data::stack<ptr<entry>> Chain;
+        // Every entry by hash, with open addressing, so that it can be read while
+        // an entry is added. It is replaced by a bigger one when it is half full.
+        struct table {
+            std::vector<std::atomic<const entry *>> Slots;
             
-            chain() : Chain{} {}
+            explicit table (size_t size) : Slots (size) {}
             
-            chain(const Bitcoin::header& e) : Chain{} {
-                *this = this->insert(e);
-            }
-            
-            chain(const data::stack<ptr<entry>>& x) : Chain{x} {}
+            const entry *find (const digest256 &) const;
+            void insert (const entry *);
+        };
+        
+        // the best chain is kept in pieces so that a snapshot only copies the last one.
+        constexpr static size_t chunk_size = 1024;
+        using chunk = std::vector<const entry *>;
+        
+    public:
+        // the store as it was after some insert.
+        struct snapshot {
             
-            bool valid() const {
-                return Chain.size() == 0;
+            uint64 height () const {
+                return Size - 1;
             }
             
-            work::difficulty difficulty() const {
-                if (valid()) return {};
-                return Chain.first()->Cumulative;
+            size_t size () const {
+                return Entries;
             }
             
-            bool operator<=(const chain& x) const {
-                return difficulty() <= x.difficulty();
+            size_t tips () const {
+                return Tips;
             }
             
-            chain insert(const Bitcoin::header& h) const {
-                auto hash_digest = h.hash();
-                return chain{Chain.prepend(std::make_shared<entry>(
-                    hash_digest, h, Chain.size() + 1, h.Target.difficulty() + difficulty()))};
+            header latest () const {
+                return *at (Size - 1);
             }
             
-            const entry& first() const {
-                return *Chain.first();
-            }
+            header operator [] (const N &) const;
+            header operator [] (const digest256 &) const;
             
-            entry& first() {
-                return *Chain.first();
-            }
+        private:
+            std::vector<ptr<chunk>> Chunks;
+            
+            // the length of the best chain.
+            uint64 Size;
+            
+            uint64 Entries;
+            uint64 Tips;
+            ptr<const table> ByHash;
             
-            bool operator==(const chain& x) const {
-                return Chain == x.Chain;
+            const entry *at (uint64 height) const {
+                return (*Chunks[height / chunk_size])[height % chunk_size];
             }
             
-            bool operator!=(const chain& x) const {
-                return Chain != x.Chain;
+            // nullptr if the header is not in the snapshot.
+            const entry *find (const digest256 &) const;
+            
+            // a chunk that a published snapshot has is copied before it is changed.
+            void push (const entry *);
+            void truncate (uint64 size);
+            
+            friend class memory;
+        };
+        
+        // A change to the best chain. Fork is the last header that the new chain
+        // has in common with the old one, which is Previous unless there was a reorg.
+        struct update {
+            header Previous;
+            header Tip;
+            header Fork;
+            
+            bool reorg () const {
+                return Fork != Previous;
             }
         };
         
-        data::ordered_list<chain> Headers;
+        // subscribers are called on the thread that inserted and must not insert.
+        using subscriber = std::function<void (const update &)>;
+        
+    private:
+        // entries never move once they are made.
+        std::deque<entry> Entries;
         
-        data::map<N, chain> ByHeight;
+        // the header at the end of every chain.
+        hash_set<const entry *> Tips;
         
-        data::map<digest256, chain> ByHash;
+        ptr<table> ByHash;
+        std::atomic<ptr<const snapshot>> Current;
         
-        data::map<digest256, chain> ByRoot;
+        hash_map<digest256, entry *> ByRoot;
+        hash_map<Bitcoin::txid, entry *> ByTxid;
         
-        data::map<txid, chain> ByTxid;
+        // held by inserts.
+        mutable std::mutex Mutex;
         
-        memory(const Bitcoin::header& h) : 
-            Headers{chain{h}}, 
-            ByHeight{0, Headers.first()}, 
-            ByHash{Headers.first().first().Hash, Headers.first()},
-            ByRoot{Headers.first().first().Header.MerkleRoot, Headers.first()}, ByTxid{} {}
+        // held for the merkle trees of entries and ByTxid.
+        mutable std::shared_mutex Proofs;
+        
+        std::map<uint64, subscriber> Subscribers;
+        uint64 NextSubscriber;
+        
+        void reorganize (snapshot &, const entry *tip);
         
     public:
-        memory() : memory(genesis().Header) {}
+        explicit memory (const Bitcoin::header &root);
+        memory () : memory {genesis ().Header} {}
+        
+        memory (const memory &) = delete;
+        memory &operator = (const memory &) = delete;
         
-        header latest() const override {
-            return Headers.first().first();
+        ptr<const snapshot> current () const {
+            return Current.load (std::memory_order_acquire);
         }
         
-        header operator[](const N& n) const override {
-            chain headers = ByHeight[n];
-            if (!headers.valid()) return {};
-            return headers.first();
+        // the height of the best chain.
+        uint64 height () const {
+            return current ()->height ();
         }
         
-        Merkle::dual dual_tree(const digest256& d) const override {
-            chain headers = ByHash[d];
-            if (!headers.valid()) return {};
-            return Merkle::dual{headers.first().Tree, headers.first().Header.MerkleRoot};
+        size_t size () const {
+            return current ()->size ();
         }
         
-        Merkle::proof proof(const txid& t) const override {
-            chain headers = ByTxid[t];
-            if (!headers.valid()) return {};
-            return Merkle::dual{headers.first().Tree, headers.first().Header.MerkleRoot}[t];
-        };
+        size_t tips () const {
+            return current ()->tips ();
+        }
         
-        bool insert(const Bitcoin::header& h) override {
-            data::stack<chain> p{};
-            data::ordered_list<chain> x = Headers;
-            
-            // are we adding to some known chain tip? 
-            while(x.size() > 0) {
-                if (h.Previous == x.first().first().Hash) {
-                    Headers = x.rest() << p << (x.first().insert(h));
-                    return true;
-                }
-                p = p << x.first();
-                x = x.rest();
-            }
-            
-            // Do we know about this prev hash at all?
-            chain headers = ByHash[h.Previous];
-            if (!headers.valid()) return false;
-            
-            Headers = Headers << headers.insert(h);
-            return true;
+        header latest () const override {
+            return current ()->latest ();
         }
         
-        bool insert(const Merkle::proof& p) override {
-            chain headers = ByRoot[p.Root];
-            if (!headers.valid()) return false;
-            auto d = Merkle::dual{headers.first().Tree, headers.first().Header.MerkleRoot} + p;
-            if (!d.valid()) return false;
-            headers.first().Tree = d.Paths;
-            ByTxid = ByTxid.insert(p.Branch.Leaf.Digest, headers);
-            return true;
+        header operator [] (const N &n) const override {
+            return (*current ())[n];
         }
-    };*/
+        
+        header operator [] (const digest256 &d) const override {
+            return (*current ())[d];
+        }
+        
+        Merkle::dual dual_tree (const digest256 &) const override;
+        
+        Merkle::proof proof (const Bitcoin::txid &) const override;
+        
+        // the header's Hash, Height and Cumulative are ignored and computed again.
+        bool insert (const header &h) override {
+            return insert (h.Header);
+        }
+        
+        bool insert (const Bitcoin::header &h) {
+            return insert (std::span<const Bitcoin::header> {&h, 1}) == 1;
+        }
+        
+        // insert headers in order and publish them in one snapshot, with one update
+        // for subscribers. Returns the number that were accepted.
+        size_t insert (std::span<const Bitcoin::header>);
+        
+        bool insert (const Merkle::proof &) override;
+        
+        uint64 subscribe (subscriber);
+        void unsubscribe (uint64);
+        
+        // the roots and txids that headers are found by are the keys and the
+        // headers are the values. Merkle proofs are not counted.
+        memory_report memory_usage () const;
+    };
+    
+    // The best chain in a memory-mapped file that is only ever appended to. Each
+    // header is stored in a fixed-size record with its hash, cumulative
+    // difficulty and work, so opening the file reads nothing but the hashes,
+    // and headers are read by height straight from the map. A record is
+    // written and synced, and the file with it, before the count that includes
+    // it, so a crash during insert loses at most the header being inserted.
+    // On open, the count is brought down to the records that are in the file
+    // and whole. Files written before work was stored are not header files.
+    //
+    // Only the best chain is kept. To follow a reorg, truncate to the fork and
+    // insert the new headers. Merkle proofs are not stored.
+    class headers::file final : public headers {
+    public:
+        // open the file at path or create it with root as the first header.
+        // throws std::invalid_argument if the file is not a header file and
+        // std::runtime_error if it cannot be opened or mapped.
+        file (const std::string &path, const Bitcoin::header &root);
+        explicit file (const std::string &path) : file {path, genesis ().Header} {}
+        ~file ();
+        
+        file (const file &) = delete;
+        file &operator = (const file &) = delete;
+        
+        uint64 height () const {
+            return count () - 1;
+        }
+        
+        // the header in the file, which is good until the next insert or truncate.
+        slice<80> at (uint64 height) const;
+        
+        header latest () const override;
+        
+        header operator [] (const N &) const override;
+        header operator [] (const digest256 &) const override;
+        
+        Merkle::dual dual_tree (const digest256 &) const override {
+            return {};
+        }
+        
+        Merkle::proof proof (const Bitcoin::txid &) const override {
+            return {};
+        }
+        
+        // only a header that extends the best chain is accepted.
+        bool insert (const header &h) override {
+            return insert (h.Header);
+        }
+        
+        bool insert (const Bitcoin::header &);
+        
+        bool insert (const Merkle::proof &) override {
+            return false;
+        }
+        
+        // remove every header above height.
+        void truncate (uint64 height);
+        
+    private:
+        int Descriptor;
+        byte *Map;
+        
+        // the number of records that fit in the map.
+        uint64 Capacity;
+        
+        hash_map<digest256, uint64> ByHash;
+        
+        uint64 count () const;
+        void set_count (uint64);
+        
+        header entry (uint64 height) const;
+        void remap (uint64 capacity);
+        void close ();
+    };
     
 }
 
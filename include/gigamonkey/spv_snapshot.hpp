@@ -0,0 +1,116 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SPV_SNAPSHOT
+#define GIGAMONKEY_SPV_SNAPSHOT
+
+#include <gigamonkey/spv.hpp>
+#include <gigamonkey/merkle/bump.hpp>
+
+#include <filesystem>
+#include <map>
+
+namespace Gigamonkey {
+    
+    // The state of an SPV wallet in a file that can be opened without reading it,
+    // so that a wallet can start up without replaying its history or reading
+    // JSON. The headers are not in the file; it says which headers in a store it
+    // relies on, by a range of heights and the hash of the last one. The proofs
+    // of each block are stored as a BUMP and transactions are stored as they
+    // are serialized, with a table of both by which anything can be found
+    // without reading the rest. Nothing is decoded until it is asked for.
+    //
+    // The file begins with a version, so that the format can change.
+    struct SPV_snapshot {
+        constexpr static uint32 version = 1;
+        
+        // what is written.
+        struct state {
+            // the range of headers in the store that the wallet relies on.
+            uint64 From;
+            uint64 To;
+            
+            // the hash of the header at To.
+            digest256 Tip;
+            
+            // proofs of our transactions by the height of their block.
+            std::map<uint64, Merkle::dual> Proofs;
+            
+            // our transactions, serialized.
+            std::map<Bitcoin::txid, bytes> Transactions;
+            
+            state () : From {0}, To {0}, Tip {}, Proofs {}, Transactions {} {}
+            
+            // the range of heights is everything in the store.
+            explicit state (const headers &);
+            
+            bool operator == (const state &) const;
+        };
+        
+        // The file is written beside the path and moved over it so that there is
+        // never half a snapshot. Throws std::invalid_argument if a dual is not valid
+        // and std::runtime_error if the file cannot be written.
+        static void write (const std::filesystem::path &, const state &);
+        
+        // Throws std::invalid_argument if the file is not a snapshot of a version
+        // that we can read and std::runtime_error if it cannot be opened.
+        explicit SPV_snapshot (const std::filesystem::path &);
+        ~SPV_snapshot ();
+        
+        SPV_snapshot (const SPV_snapshot &) = delete;
+        SPV_snapshot &operator = (const SPV_snapshot &) = delete;
+        
+        uint64 from () const;
+        uint64 to () const;
+        digest256 tip () const;
+        
+        // whether the store has the headers that the snapshot relies on.
+        bool check (const headers &) const;
+        
+        size_t blocks () const;
+        size_t transactions () const;
+        
+        // the heights of the blocks that we have proofs in, in order.
+        std::vector<uint64> heights () const;
+        
+        bool contains (const Bitcoin::txid &) const;
+        
+        // the transaction in the file, which is good as long as the snapshot is open.
+        // Empty if it is not there.
+        bytes_view transaction (const Bitcoin::txid &) const;
+        
+        // the height of the block that a transaction is in, if we have a proof of it.
+        maybe<uint64> height (const Bitcoin::txid &) const;
+        
+        // the proofs of a block, which are invalid if we have none.
+        Merkle::dual dual (uint64 height) const;
+        
+        // an invalid proof if we have none.
+        Merkle::proof proof (const Bitcoin::txid &) const;
+        
+        // read everything.
+        state read () const;
+    
+    private:
+        std::filesystem::path Path;
+        int Descriptor;
+        const byte *Map;
+        size_t Size;
+        
+        uint64 Blocks;
+        uint64 Transactions;
+        
+        const byte *block_record (uint64 index) const;
+        const byte *transaction_record (uint64 index) const;
+        
+        // nullptr if there is none.
+        const byte *find_block (uint64 height) const;
+        const byte *find_transaction (const Bitcoin::txid &) const;
+        
+        // the part of the file that a record points to, or nothing if it goes past the end.
+        maybe<bytes_view> data (const byte *record) const;
+    };
+    
+}
+
+#endif
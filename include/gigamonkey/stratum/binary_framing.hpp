@@ -0,0 +1,89 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_BINARY_FRAMING
+#define GIGAMONKEY_STRATUM_BINARY_FRAMING
+
+#include <gigamonkey/stratum/mining_notify.hpp>
+#include <gigamonkey/stratum/mining_submit.hpp>
+#include <gigamonkey/stratum/fast_json.hpp>
+
+// A binary encoding of the Stratum messages that are sent most often, for
+// clients that ask for it with extension binary_framing in mining.configure.
+// After the response to mining.configure, both sides send frames instead of
+// lines of JSON. Messages without a binary form are sent as JSON in a frame
+// of their own, so the protocol is otherwise the same.
+//
+// A frame is a var_int giving the size of the rest, a byte giving its kind,
+// and the payload. Numbers are little endian. Digests are 32 raw bytes and
+// strings and byte strings are preceded by a var_int giving their size.
+namespace Gigamonkey::Stratum::binary {
+    
+    enum kind : byte {
+        // any message as JSON text.
+        json = 0,
+        
+        // id (see below) | worker name | job id | extra nonce 2 | timestamp (4) |
+        // nonce (4) | whether there are version bits (1) | version bits (4, if there are)
+        submit = 1,
+        
+        // job id | previous (32) | generation tx 1 | generation tx 2 | var_int count |
+        // branch digests (32 each) | version (4) | target (4) | time (4) | clean (1)
+        notify = 2,
+        
+        // id | result (1), for responses with no error that are true or false,
+        // such as the response to mining.submit.
+        boolean_result = 3
+    };
+    
+    // a message id is a byte 0 followed by a uint32 or a byte 1 followed by a string.
+    
+    struct frame {
+        kind Kind;
+        bytes Payload;
+        
+        // the whole frame with its size.
+        explicit operator bytes () const;
+        
+        bool operator == (const frame &) const = default;
+    };
+    
+    // Collects the bytes that come from a connection and splits them into frames.
+    struct frame_reader {
+        // frames that claim to be larger than this are an error.
+        size_t MaxFrameSize;
+        
+        explicit frame_reader (size_t max_frame_size = 1 << 20) : MaxFrameSize {max_frame_size}, Buffer {}, Position {0} {}
+        
+        void push (bytes_view);
+        
+        // nothing until a whole frame has been pushed. Throws std::length_error
+        // for a frame that is too large and std::invalid_argument for one of no
+        // kind that we know about, after which the connection should be closed.
+        maybe<frame> next ();
+    
+    private:
+        bytes Buffer;
+        size_t Position;
+    };
+    
+    // throws std::invalid_argument if the id is a number too big for 32 bits.
+    frame write_submit (const message_id &, const share &);
+    frame write_notify (const mining::notify::parameters &);
+    frame write_boolean_response (const message_id &, bool);
+    
+    // Read the payloads of frames of a given kind. Nothing if the payload is invalid.
+    maybe<submit_line> read_submit (bytes_view);
+    maybe<mining::notify::parameters> read_notify (bytes_view);
+    maybe<Stratum::boolean_response> read_boolean_response (bytes_view);
+    
+    // Any Stratum message in its binary form if it has one, and as JSON otherwise.
+    frame encode (const JSON &);
+    
+    // The message that was encoded, as the JSON sessions expect it.
+    // Nothing if the frame is invalid.
+    maybe<JSON> decode (const frame &);
+    
+}
+
+#endif
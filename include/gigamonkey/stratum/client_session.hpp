@@ -12,10 +12,24 @@
 #include <gigamonkey/stratum/client_get_version.hpp>
 #include <gigamonkey/stratum/client_show_message.hpp>
 #include <gigamonkey/stratum/mining_set_extranonce.hpp>
+#include <gigamonkey/stratum/statistics.hpp>
+
+#include <condition_variable>
+#include <deque>
 
 namespace Gigamonkey::Stratum {
     
     // A client talking to a remote server. 
+    //
+    // Each mining.notify is posed to the solver as soon as it arrives, so the
+    // solver should not wait for work on the old job to end (work::cpu_solver
+    // does not). Solutions arrive on the solver's threads, are checked against
+    // the job that is currently posed, and are put in a queue which is sent
+    // by a thread of our own so that hashing never waits for the network.
+    // Queued shares are dropped when a job arrives with clean_jobs set.
+    //
+    // A type that derives from this and a solver should list the solver
+    // last so that its workers have stopped before this is destroyed.
     struct client_session : public remote_receive_handler, public virtual work::solver {
         request_id send_configure (const extensions::requests &);
         request_id send_authorize (const mining::authorize_request::parameters &);
@@ -29,11 +43,22 @@ namespace Gigamonkey::Stratum {
             optional<extensions::requests> ConfigureRequest;
             optional<mining::authorize_request::parameters> AuthorizeRequest;
             optional<mining::subscribe_request::parameters> SubscribeRequest;
+            
+            // if present, the results of our shares are counted here.
+            ptr<statistics> Statistics {};
         };
         
-        client_session (ptr<net::session<JSON>> p, const options &o) : remote_receive_handler {p}, Options {o} {}
-        virtual ~client_session () {}
+        client_session (ptr<net::session<JSON>> p, const options &o);
+        virtual ~client_session ();
         
+        uint32 shares_submitted () const {
+            return SharesSubmitted;
+        }
+        
+        uint32 shares_accepted () const {
+            return SharesAccepted;
+        }
+    
     private:
         
         void receive_submit (bool);
@@ -50,6 +75,11 @@ namespace Gigamonkey::Stratum {
             std::cout << "Server says: " << m << std::endl;
         }
         
+        // called on the thread that sends shares, just before a share is sent,
+        // and when any answer to a share is received.
+        virtual void submitted (const share &) {}
+        virtual void answered () {}
+        
         void receive_notification (const notification &n) final override;
         void receive_request (const Stratum::request &r) final override;
         void receive_response (method, const Stratum::response &r) final override;
@@ -77,10 +107,24 @@ namespace Gigamonkey::Stratum {
         optional<extensions::version_mask> VersionMask {};
         optional<mining::notify::parameters> Notify {};
         
-        uint32 SharesSubmitted {0};
-        uint32 SharesAccepted {0};
+        std::atomic<uint32> SharesSubmitted {0};
+        std::atomic<uint32> SharesAccepted {0};
+        
+        struct posed {
+            job_id JobID;
+            work::puzzle Puzzle;
+        };
+        
+        // everything below is shared with the solver and submit threads.
+        std::mutex SubmitMutex;
+        std::condition_variable SubmitWake;
+        ptr<const posed> Posed {};
+        std::deque<share> Submits {};
+        bool Closing {false};
+        std::thread Submitter;
         
         void pose_current_puzzle ();
+        void submit ();
         
     };
     
@@ -103,10 +147,11 @@ namespace Gigamonkey::Stratum {
     
     void inline client_session::receive_submit (bool b) {
         if (b) SharesAccepted++;
+        if (Options.Statistics != nullptr) Options.Statistics->share (b ? accepted : invalid);
     }
     
     void inline client_session::receive_submit_error (const error &e) {
-        std::cout << "Share rejected with error " << JSON (e).dump () << std::endl;
+        if (Options.Statistics != nullptr) Options.Statistics->share (result_of (e.Code));
     }
     
     void inline client_session::receive_notify (const mining::notify::parameters &x) {
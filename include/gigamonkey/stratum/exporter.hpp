@@ -0,0 +1,46 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_EXPORTER
+#define GIGAMONKEY_STRATUM_EXPORTER
+
+#include <gigamonkey/stratum/statistics.hpp>
+
+#include <boost/asio.hpp>
+
+#include <thread>
+
+namespace Gigamonkey::Stratum {
+    
+    // Serves statistics over HTTP in the OpenMetrics text format on its own
+    // thread. Every request gets the current statistics, whatever its path,
+    // and the connection is closed after the response.
+    struct exporter {
+        
+        exporter (const boost::asio::ip::tcp::endpoint &, ptr<const statistics>);
+        
+        ~exporter ();
+        
+        exporter (const exporter &) = delete;
+        exporter &operator = (const exporter &) = delete;
+        
+        uint16 port () const;
+        
+        static constexpr const char *ContentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        
+        // the whole response, with headers.
+        static string response (const statistics &);
+    
+    private:
+        ptr<const statistics> Statistics;
+        
+        boost::asio::io_context IO;
+        boost::asio::ip::tcp::acceptor Acceptor;
+        std::thread Thread;
+        
+        void accept ();
+    };
+    
+}
+
+#endif
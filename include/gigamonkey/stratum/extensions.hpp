@@ -12,12 +12,15 @@
 
 namespace Gigamonkey::Stratum::extensions {
     
-    // the four extensions we know about. 
+    // the extensions we know about. binary_framing and version_midstates
+    // are our own; see binary_framing.hpp and mining_set_midstates.hpp.
     enum extension : uint32 {
         version_rolling, 
         minimum_difficulty, 
         subscribe_extranonce, 
-        info
+        info,
+        binary_framing,
+        version_midstates
     };
     
     std::string extension_to_string (extension m);
@@ -90,6 +93,14 @@ namespace Gigamonkey::Stratum::extensions {
         static maybe<configuration> read (const request &p);
     };
     
+    // the number of midstates that the miner would like for each job.
+    template <> struct configuration<version_midstates> {
+        byte Count;
+        
+        operator request () const;
+        static maybe<configuration> read (const request &p);
+    };
+    
     template <> struct configuration<info> {
         string ConnectionURL;
         string HWVersion;
@@ -136,10 +147,23 @@ namespace Gigamonkey::Stratum::extensions {
         bool SupportExtensionSubscribeExtranonce {false};
         bool SupportExtensionMinimumDifficulty {false};
         bool SupportExtensionInfo {false};
+        bool SupportExtensionBinaryFraming {false};
+        
+        // the most midstates that we will send for each job with
+        // extension version_midstates, which is not supported if zero.
+        byte MaxVersionMidstates {0};
     };
     
     template <extension> struct parameters;
     
+    template <> struct parameters<version_midstates> {
+        // the number of midstates to send for each job, or nothing if none can be.
+        static optional<byte> make (byte local_max, const configuration<version_midstates> &r) {
+            if (local_max == 0 || r.Count == 0) return {};
+            return std::min (local_max, r.Count);
+        }
+    };
+    
     template <> struct parameters<version_rolling> {
         version_mask LocalMask;
         configuration<version_rolling> RequestedMask;
@@ -197,6 +221,10 @@ namespace Gigamonkey::Stratum::extensions {
         return {{"value", Value}};
     }
     
+    inline configuration<version_midstates>::operator request () const {
+        return {{"count", Count}};
+    }
+    
     inline configuration<info>::operator request () const {
         return {{"connection-url", ConnectionURL}, {"hw-version", HWVersion}, {"sw-version", SWVersion}, {"hw-id", HWID}};
     }
@@ -0,0 +1,80 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_EXTRANONCE_ALLOCATOR
+#define GIGAMONKEY_STRATUM_EXTRANONCE_ALLOCATOR
+
+#include <gigamonkey/stratum/mining.hpp>
+
+#include <deque>
+#include <mutex>
+
+namespace Gigamonkey::Stratum {
+    
+    // Hands out extra nonce 1 values that are unique across a pool. The
+    // space of session ids is divided among frontends by its top
+    // PartitionBits bits, so frontends that are given different partitions
+    // never give out the same value. A value that has been released is not
+    // given out again until QuarantineSeconds have passed, so that shares
+    // for the old session that are still on their way can't be mistaken for
+    // shares from the new one.
+    struct extranonce_allocator {
+        
+        struct options {
+            uint32 PartitionBits {8};
+            uint32 Partition {0};
+            uint32 QuarantineSeconds {300};
+            size_t ExtraNonce2Size {extranonce::BitcoinExtraNonce2Size};
+            
+            options () {};
+        };
+        
+        explicit extranonce_allocator (const options &);
+        
+        // nothing if every value in the partition is in use or in quarantine.
+        maybe<extranonce> allocate (uint32 now);
+        
+        // a session has ended.
+        void release (session_id, uint32 now);
+        
+        // a new value for a session to move to with mining.set_extranonce.
+        // The old value is released. Nothing if there is nothing to move to,
+        // in which case the old value is kept.
+        maybe<extranonce> reassign (session_id old, uint32 now);
+        
+        // whether the value is in our partition.
+        bool owns (session_id) const;
+        
+        size_t in_use () const;
+        size_t quarantined () const;
+        
+        // the number of values in our partition.
+        uint64 capacity () const {
+            return Capacity;
+        }
+    
+    private:
+        options Options;
+        uint64 Capacity;
+        
+        mutable std::mutex Mutex;
+        
+        // values below this have been given out at least once.
+        uint64 Next;
+        hash_set<uint32> InUse;
+        
+        struct released {
+            uint32 Index;
+            uint32 Time;
+        };
+        
+        // in the order in which they were released.
+        std::deque<released> Quarantine;
+        
+        uint32 value (uint32 index) const;
+        maybe<extranonce> take (uint32 now);
+    };
+    
+}
+
+#endif
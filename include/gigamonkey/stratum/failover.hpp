@@ -0,0 +1,164 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_FAILOVER
+#define GIGAMONKEY_STRATUM_FAILOVER
+
+#include <gigamonkey/stratum/client_session.hpp>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace Gigamonkey::Stratum {
+
+    // One solver with sessions to several pools. Every session stays open,
+    // authorized and subscribed and keeps getting jobs, but only one of them
+    // is given to the solver at a time. If that pool stalls, the solver is
+    // given the current job of the next pool as soon as update is called,
+    // without waiting to connect to it.
+    //
+    // A pool is stalled if it has sent no job for NotifyGapSeconds or if a
+    // share sent to it has been unanswered for SubmitTimeoutSeconds. A pool
+    // that is not stalled and has a job is ready. Normally the solver works
+    // on the first pool that is ready, in the order they were added, so it
+    // goes back to a pool that was stalled once it is ready again. With Split,
+    // the solver works on every pool that is ready in turn, for SliceSeconds
+    // at a time, so that each gets time in proportion to its weight.
+    //
+    // update should be called often, such as every 50 milliseconds. Times
+    // are in seconds and only have to be from the same clock.
+    struct failover {
+
+        struct options {
+            double NotifyGapSeconds {120};
+            double SubmitTimeoutSeconds {10};
+
+            bool Split {false};
+            double SliceSeconds {10};
+
+            options () {};
+        };
+
+        // jobs are given to the solver by calling solver::pose, which is
+        // done with a lock held and so should not wait for the old job to
+        // end (work::cpu_solver does not). The solver must outlast this.
+        explicit failover (work::solver &s, const options &o = options {}) : Solver {s}, Options {o} {}
+
+        // Add a session and return its index. Shares are passed on to e,
+        // which should be a client_session and which must outlast this.
+        uint32 add (work::evaluator &e, double weight = 1);
+
+        // a new job from a session, as given to a solver.
+        void pose (uint32 upstream, const work::puzzle &, const work::solution &initial, double now);
+
+        // a share was sent to a pool, and a pool answered the oldest share that it had not answered.
+        void submitted (uint32 upstream, double now);
+        void answered (uint32 upstream, double now);
+
+        // A solution from the solver, which is passed on to the session whose job
+        // it solves. False if it does not solve the current job of any of them.
+        bool solved (const work::solution &);
+
+        // switch to another pool if there is one that should be worked on
+        // and give its job to the solver. Returns the pool we are working on.
+        maybe<uint32> update (double now);
+
+        // the pool that the solver is working on.
+        maybe<uint32> active () const;
+
+        bool stalled (uint32 upstream, double now) const;
+        bool ready (uint32 upstream, double now) const;
+
+        // how long the last share that was answered waited for its answer.
+        double latency (uint32 upstream) const;
+
+        // how many times the solver has been given the job of another pool.
+        uint32 switches () const;
+
+        size_t upstreams () const;
+
+        // A client_session that gives its jobs to a failover instead of a solver.
+        struct upstream;
+
+    private:
+        work::solver &Solver;
+        options Options;
+
+        mutable std::mutex Mutex;
+
+        struct link {
+            work::evaluator *Upstream;
+            double Weight;
+
+            maybe<work::puzzle> Puzzle;
+            work::solution Initial;
+            double LastJob;
+
+            // when each share that has not been answered was sent.
+            std::deque<double> Unanswered;
+            double Latency;
+
+            // how long the solver has worked on this pool, for Split.
+            double Served;
+        };
+
+        std::vector<link> Links;
+
+        maybe<uint32> Active {};
+        double SliceStart {0};
+        uint32 Switches {0};
+
+        bool is_stalled (const link &, double now) const;
+        bool is_ready (const link &, double now) const;
+        maybe<uint32> choose (double now) const;
+        maybe<uint32> switch_to (maybe<uint32>, double now);
+    };
+
+    struct failover::upstream final : client_session {
+        upstream (failover &f, ptr<net::session<JSON>> s, const client_session::options &o, double weight = 1) :
+            client_session {s, o}, Failover {f}, Index {f.add (*this, weight)} {}
+
+        uint32 index () const {
+            return Index;
+        }
+
+        void pose (const work::puzzle &) override {}
+
+        void pose (const work::puzzle &p, const work::solution &initial) override {
+            Failover.pose (Index, p, initial, now ());
+        }
+
+        static double now () {
+            return std::chrono::duration<double> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+        }
+
+    private:
+        failover &Failover;
+        uint32 Index;
+
+        void submitted (const share &) override {
+            Failover.submitted (Index, now ());
+        }
+
+        void answered () override {
+            Failover.answered (Index, now ());
+        }
+
+        void receive_authorize_error (const error &e) override {
+            std::cout << "pool " << Index << " authorize error: " << JSON (e) << std::endl;
+        }
+
+        void receive_configure_error (const error &e) override {
+            std::cout << "pool " << Index << " configure error: " << JSON (e) << std::endl;
+        }
+
+        void receive_subscribe_error (const error &e) override {
+            std::cout << "pool " << Index << " subscribe error: " << JSON (e) << std::endl;
+        }
+    };
+
+}
+
+#endif
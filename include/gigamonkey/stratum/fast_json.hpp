@@ -0,0 +1,27 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_FAST_JSON
+#define GIGAMONKEY_STRATUM_FAST_JSON
+
+#include <gigamonkey/stratum/mining.hpp>
+
+namespace Gigamonkey::Stratum {
+    
+    struct submit_line {
+        message_id ID;
+        share Share;
+        
+        submit_line (const message_id &id, const share &x) : ID {id}, Share {x} {}
+    };
+    
+    // Read a mining.submit request directly from a line of text without
+    // making a JSON object. Nothing is returned unless the line is a valid
+    // mining.submit request with nothing else in it, so anything that is not
+    // returned should be given to the JSON parser, which will accept or
+    // reject it as it always has.
+    maybe<submit_line> read_submit (string_view line);
+    
+}
+
+#endif
@@ -0,0 +1,127 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_JOB_MANAGER
+#define GIGAMONKEY_STRATUM_JOB_MANAGER
+
+#include <gigamonkey/stratum/job.hpp>
+#include <gigamonkey/work/prepared_puzzle.hpp>
+#include <gigamonkey/coinbase_builder.hpp>
+#include <gigamonkey/boost/job_index.hpp>
+
+#include <map>
+#include <mutex>
+
+namespace Gigamonkey::Stratum {
+    
+    // Turns block templates into jobs for every session. For each template, the
+    // coinbase is split around the extra nonces, the Merkle branch is taken out
+    // of the candidate and the notify message is written once. Extra nonce 1 and
+    // the version mask are all that differ between sessions and neither of them
+    // is in the notify message, so every session is sent the same one.
+    //
+    // Job ids are sequence numbers in hex, so they increase and a job can be
+    // found in the ring of recent jobs without looking it up in a map.
+    //
+    // In pool mode, jobs are Boost puzzles instead. A Boost puzzle is already
+    // split the same way as a coinbase, so a miner sees an ordinary job: the
+    // content is in place of the previous block hash, the tag and miner pubkey
+    // hash are the coinbase header and the user nonce and additional data are
+    // the body. Extra nonce 1 of the session and extra nonce 2 of the share are
+    // the Boost extra nonces, so sessions must have an extra nonce 2 of 8 bytes,
+    // or of no more than 32 if the script uses general purpose bits.
+    struct job_manager {
+        
+        // a job as it is sent to every session.
+        struct shared_job {
+            uint64 Sequence;
+            mining::notify::parameters Notify;
+            
+            // mining::notify::line (Notify).
+            string Line;
+            
+            // the Boost puzzle that the job is for, or nullptr if it is for a block.
+            ptr<const Boost::puzzle> Bounty;
+            
+            // the state of the coinbase hash after the full blocks of
+            // GenerationTx1, if it came from a coinbase_builder.
+            maybe<sha256::state> Midstate;
+            
+            shared_job (uint64 sequence, const mining::notify::parameters &,
+                ptr<const Boost::puzzle> = nullptr, maybe<sha256::state> = {});
+            
+            // the job as the given worker sees it.
+            Stratum::job session (const worker &w) const {
+                return Stratum::job {w, Notify};
+            }
+            
+            // for checking shares with a version mask, or with none. It is made the
+            // first time that it is asked for and shared by every session with the
+            // same mask, since extra nonce 1 is part of the solution.
+            // For a Boost job, the mask is the one that the script says, whatever the
+            // session has.
+            ptr<const work::prepared_puzzle> prepared (const maybe<extensions::version_mask> & = {}) const;
+            
+            // for a Boost job, the proof that a share from a session with the given
+            // extra nonce 1 makes, which is valid if the share meets the bounty target.
+            // Invalid if this is not a Boost job or extra nonce 2 is the wrong size.
+            Boost::proof bounty (const Stratum::session_id &, const work::share &) const;
+            
+            // a transaction that redeems every output of the bounty, with a share that
+            // meets the bounty target. Throws std::invalid_argument if it does not.
+            bytes redeem (const Stratum::session_id &, const work::share &, list<Bitcoin::output>) const;
+        
+        private:
+            mutable std::mutex Mutex;
+            mutable std::map<int32, ptr<const work::prepared_puzzle>> Prepared;
+        };
+        
+        // how many of the most recent jobs can be found by id.
+        explicit job_manager (size_t remember = 16);
+        
+        // a new template, for which clean should be true if it is for a new block.
+        // The coinbase is header | extra nonce 1 | extra nonce 2 | body. Throws
+        // std::invalid_argument if the candidate is not valid.
+        ptr<const shared_job> update (const work::candidate &,
+            const bytes &coinbase_header, const bytes &coinbase_body, Bitcoin::timestamp now, bool clean = true);
+        
+        // the same with the two halves of the coinbase from a builder, whose
+        // midstate is used when the job is prepared for checking shares.
+        ptr<const shared_job> update (const work::candidate &, const coinbase_builder &, Bitcoin::timestamp now, bool clean = true);
+        
+        // a Boost puzzle to be mined instead of a block. Throws std::invalid_argument if it is not valid.
+        ptr<const shared_job> update (const Boost::puzzle &, Bitcoin::timestamp now, bool clean = true);
+        
+        // the most profitable bounty in the index, which is clean if it is not the
+        // one that is being mined already. nullptr if the index is empty.
+        ptr<const shared_job> update (const Boost::job_index &, const Bitcoin::secret &miner, Bitcoin::timestamp now);
+        
+        // the current template with a new time, which is not clean.
+        // nullptr if there have been no templates.
+        ptr<const shared_job> refresh (Bitcoin::timestamp now);
+        
+        // nullptr if there have been no templates.
+        ptr<const shared_job> current () const;
+        
+        // nullptr if the job has been forgotten or is not one of ours.
+        ptr<const shared_job> find (const job_id &) const;
+        
+        // whether a newer job than this one has been made with clean set.
+        bool stale (const shared_job &) const;
+        
+        static job_id id (uint64 sequence);
+        static maybe<uint64> sequence (const job_id &);
+    
+    private:
+        mutable std::mutex Mutex;
+        std::vector<ptr<const shared_job>> Ring;
+        uint64 Next;
+        uint64 LastClean;
+        
+        ptr<const shared_job> push (const mining::notify::parameters &,
+            ptr<const Boost::puzzle> = nullptr, maybe<sha256::state> = {});
+    };
+    
+}
+
+#endif
@@ -25,7 +25,8 @@ namespace Gigamonkey::Stratum {
         client_get_version,
         client_reconnect, 
         client_get_transactions, 
-        client_show_message
+        client_show_message, 
+        mining_set_midstates
     };
     
     std::string method_to_string(method m);
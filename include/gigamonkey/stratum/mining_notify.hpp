@@ -59,6 +59,10 @@ namespace Gigamonkey::Stratum::mining {
         static Stratum::parameters serialize (const parameters &);
         static parameters deserialize (const Stratum::parameters &);
         
+        // the same as notify {p}.dump () followed by a newline, 
+        // written without making a JSON object. 
+        static string line (const parameters &);
+        
         parameters params () const {
             return deserialize (notification::params ());
         }
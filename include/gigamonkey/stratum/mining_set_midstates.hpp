@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_MINING_SET_MIDSTATES
+#define GIGAMONKEY_STRATUM_MINING_SET_MIDSTATES
+
+#include <gigamonkey/stratum/stratum.hpp>
+#include <gigamonkey/stratum/mining.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <vector>
+
+// Extension version_midstates is our own. A miner that has negotiated it is
+// sent mining.set_midstates after each mining.notify. Extra nonce 2 is fixed
+// for the job, so the Merkle root does not change, and the message gives the
+// SHA-256 state after the first 64 bytes of the header for several values of
+// the version bits. The miner only hashes the last 16 bytes of the header,
+// which are the end of the Merkle root, the timestamp, the target and the
+// nonce, and submits the share with the fixed extra nonce 2 and the bits of
+// the midstate that it used.
+//
+// The params are [job_id, extra_nonce_2, root_tail, [[bits, midstate], ...]]
+// in hex. Bits are big endian as in mining.submit, and each word of a
+// midstate is big endian as in a SHA-256 digest.
+namespace Gigamonkey::Stratum::mining {
+    struct set_midstates : notification {
+
+        struct midstate {
+            int32_little Bits;
+            sha256::state State;
+
+            bool operator == (const midstate &m) const {
+                return Bits == m.Bits && State == m.State;
+            }
+        };
+
+        struct parameters {
+            job_id JobID;
+            bytes ExtraNonce2;
+
+            // the last four bytes of the Merkle root.
+            byte_array<4> RootTail;
+
+            std::vector<midstate> Midstates;
+
+            bool operator == (const parameters &p) const {
+                return JobID == p.JobID && ExtraNonce2 == p.ExtraNonce2 && RootTail == p.RootTail && Midstates == p.Midstates;
+            }
+        };
+
+        static Stratum::parameters serialize (const parameters &);
+        static maybe<parameters> deserialize (const Stratum::parameters &);
+
+        using notification::notification;
+        set_midstates (const parameters &p) : notification {mining_set_midstates, serialize (p)} {}
+
+        static bool valid (const notification &n) {
+            return n.valid () && n.method () == mining_set_midstates && deserialize (n.params ());
+        }
+
+        bool valid () const {
+            return valid (*this);
+        }
+
+        parameters params () const {
+            return *deserialize (notification::params ());
+        }
+    };
+}
+
+#endif
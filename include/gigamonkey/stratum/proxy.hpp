@@ -0,0 +1,145 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_PROXY
+#define GIGAMONKEY_STRATUM_PROXY
+
+#include <gigamonkey/stratum/client_session.hpp>
+#include <gigamonkey/stratum/extranonce_allocator.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Gigamonkey::Stratum {
+    
+    // Connects many downstream miners to a few upstream sessions, so that the
+    // pool sees a few connections. The extra nonce 2 of each upstream session
+    // is split: its first four bytes are given to downstream miners as their
+    // extra nonce 1, and they roll the rest as their extra nonce 2. The upstream
+    // extra nonce 1 goes at the end of the first part of the coinbase, so every
+    // miner of an upstream session gets the same mining.notify, which is made
+    // once per upstream job and given to relay. The upstream extra nonce 2 size
+    // must therefore be more than four.
+    //
+    // Shares from downstream should be checked against their own difficulty
+    // first. The proxy checks them against the upstream difficulty and passes
+    // on those that meet it, so the pool only sees shares that it will accept.
+    struct proxy {
+        
+        struct options {
+            // how long a downstream extra nonce 1 is kept out of use after it is released.
+            uint32 QuarantineSeconds {300};
+            
+            options () {};
+        };
+        
+        // called once for every job from an upstream session, with the job as it is to
+        // be sent to each miner assigned to it, for example with server::notify.
+        using relay = std::function<void (uint32 upstream, const mining::notify::parameters &)>;
+        
+        explicit proxy (relay r, const options &o = options {}) : Relay {r}, Options {o}, Mutex {}, Links {} {}
+        
+        // Add an upstream session and return its index. Shares are passed on to e,
+        // which should be a client_session and which must outlast the proxy.
+        uint32 add (work::evaluator &e);
+        
+        // a new job from an upstream session, as given to a solver.
+        void pose (uint32 upstream, const work::puzzle &, const work::solution &initial);
+        
+        // A client_session that gives its jobs to a proxy instead of a solver.
+        struct upstream;
+        
+        struct assignment {
+            uint32 Upstream;
+            
+            // the extra nonce to give to the miner.
+            Stratum::extranonce ExtraNonce;
+        };
+        
+        // assign a new miner to the upstream session with a job that has the fewest
+        // miners. Nothing if there is no upstream session that can take it.
+        maybe<assignment> assign (uint32 now);
+        
+        void release (const assignment &, uint32 now);
+        
+        // the current job of an upstream session as it is given to miners.
+        maybe<mining::notify::parameters> job (uint32 upstream) const;
+        
+        enum result {
+            forwarded,
+            
+            // the share is good for the miner but not for the pool.
+            below_target,
+            
+            // not for the current job of the upstream session.
+            stale,
+            
+            // the extra nonce 2 is the wrong size or the assignment is not ours.
+            invalid
+        };
+        
+        result submit (const assignment &, const share &);
+        
+        size_t upstreams () const;
+        
+        // the number of miners assigned to an upstream session.
+        size_t miners (uint32 upstream) const;
+    
+    private:
+        relay Relay;
+        options Options;
+        
+        mutable std::mutex Mutex;
+        
+        struct link {
+            work::evaluator *Upstream;
+            maybe<work::puzzle> Puzzle;
+            work::solution Initial;
+            
+            // the puzzle as miners see it.
+            maybe<mining::notify::parameters> Notify;
+            uint64 Jobs;
+            
+            // made when the size of extra nonce 2 is known, and again if it changes.
+            std::unique_ptr<extranonce_allocator> Miners;
+        };
+        
+        std::vector<link> Links;
+    };
+    
+    struct proxy::upstream final : client_session {
+        upstream (proxy &p, ptr<net::session<JSON>> s, const client_session::options &o) :
+            client_session {s, o}, Proxy {p}, Index {p.add (*this)} {}
+        
+        uint32 index () const {
+            return Index;
+        }
+        
+        void pose (const work::puzzle &) override {}
+        
+        void pose (const work::puzzle &p, const work::solution &initial) override {
+            Proxy.pose (Index, p, initial);
+        }
+    
+    private:
+        proxy &Proxy;
+        uint32 Index;
+        
+        void receive_authorize_error (const error &e) override {
+            std::cout << "upstream " << Index << " authorize error: " << JSON (e) << std::endl;
+        }
+        
+        void receive_configure_error (const error &e) override {
+            std::cout << "upstream " << Index << " configure error: " << JSON (e) << std::endl;
+        }
+        
+        void receive_subscribe_error (const error &e) override {
+            std::cout << "upstream " << Index << " subscribe error: " << JSON (e) << std::endl;
+        }
+    };
+    
+}
+
+#endif
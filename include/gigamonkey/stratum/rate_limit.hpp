@@ -0,0 +1,106 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_RATE_LIMIT
+#define GIGAMONKEY_STRATUM_RATE_LIMIT
+
+#include <gigamonkey/types.hpp>
+
+#include <functional>
+#include <mutex>
+
+namespace Gigamonkey::Stratum {
+    
+    // Tokens are added at a steady rate up to a limit and each
+    // thing that we allow takes some of them.
+    struct token_bucket {
+        double Rate;
+        double Burst;
+        
+        // starts full.
+        token_bucket (double rate, double burst, double now) : Rate {rate}, Burst {burst}, Tokens {burst}, Last {now} {}
+        
+        // whether there are enough tokens, which are then taken.
+        bool take (double now, double cost = 1);
+        
+        double tokens (double now) const;
+        
+        // when tokens were last taken.
+        double last () const {
+            return Last;
+        }
+    
+    private:
+        double Tokens;
+        double Last;
+    };
+    
+    // Limits on how fast sessions may send messages to the server, both for each
+    // session and for each address, since a broken miner may open many sessions.
+    // Messages are counted before they are parsed.
+    //
+    // When the server is under load, as measured by a function that is given
+    // to us, such as the number of shares waiting to be checked, the limits are
+    // tightened and sessions should be given a higher difficulty for a while.
+    struct rate_limits {
+        struct options {
+            // messages from one session.
+            double SessionMessagesPerSecond {20};
+            double SessionBurst {100};
+            
+            // messages and new connections from all sessions at one address.
+            double AddressMessagesPerSecond {200};
+            double AddressBurst {1000};
+            
+            // a session that has this many messages refused in a row is closed.
+            uint32 MaxRefused {100};
+            
+            // we are under load when the load function is at least this.
+            size_t ShedLoad {10000};
+            
+            // while we are under load, everything costs this many times as much.
+            double ShedCost {4};
+            
+            // and the difficulty of each session is raised by this factor,
+            // no more often than every ShedIntervalSeconds.
+            double ShedDifficultyFactor {4};
+            double ShedIntervalSeconds {30};
+            
+            // addresses that have sent nothing for this long are forgotten.
+            double ForgetAddressSeconds {600};
+            
+            options () {};
+        };
+        
+        const options Options;
+        
+        // throws std::invalid_argument if a rate or a burst is not positive.
+        rate_limits (const options &, std::function<size_t ()> load = {});
+        
+        bool shedding () const;
+        
+        // a bucket for a new session, which belongs to the session and need not be locked.
+        token_bucket session (double now) const;
+        
+        // whether a message may be taken from a session at an address.
+        bool allow (token_bucket &session, const string &address, double now);
+        
+        // whether a new connection may be accepted from an address.
+        bool connect (const string &address, double now);
+        
+        // addresses that are being tracked.
+        size_t addresses () const;
+    
+    private:
+        std::function<size_t ()> Load;
+        
+        mutable std::mutex Mutex;
+        hash_map<string, token_bucket> Addresses;
+        double LastSweep;
+        
+        bool take_address (const string &address, double now, double cost);
+    };
+    
+}
+
+#endif
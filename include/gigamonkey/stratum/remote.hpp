@@ -11,11 +11,60 @@
 #include <gigamonkey/stratum/mining_submit.hpp>
 #include <gigamonkey/stratum/client_get_version.hpp>
 #include <boost/system/error_code.hpp>
+#include <atomic>
+#include <memory>
 #include <data/net/TCP.hpp>
 #include <data/net/JSON.hpp>
 
 namespace Gigamonkey::Stratum {
     
+    // Requests that have been sent and not answered. Request n is kept in 
+    // slot n % capacity so that requests can be sent on one thread and 
+    // answered on another without a lock. If more requests than that are 
+    // outstanding, the oldest is forgotten. 
+    struct pending_requests {
+        
+        struct entry {
+            request_id ID;
+            method Method;
+        };
+        
+        explicit pending_requests (uint32 capacity = 64);
+        
+        // the id of a new request. If a request had to be forgotten 
+        // to make room, it is put in displaced. 
+        request_id insert (method m, uint32 now, maybe<entry> &displaced);
+        
+        // the method of the request, which is then forgotten. 
+        maybe<method> remove (request_id);
+        
+        // forget the requests that were sent before the given time. 
+        std::vector<entry> expire (uint32 before);
+        
+        uint32 capacity () const {
+            return Capacity;
+        }
+        
+    private:
+        struct slot {
+            // 0 for an empty slot, otherwise id + 1 followed by 8 bits of method. 
+            std::atomic<uint64> Tag;
+            std::atomic<uint32> Sent;
+        };
+        
+        uint32 Capacity;
+        std::unique_ptr<slot[]> Slots;
+        std::atomic<uint32> Next;
+        
+        static uint64 tag (request_id id, method m) {
+            return ((id + 1) << 8) | uint64 (m);
+        }
+        
+        static entry read (uint64 tag) {
+            return entry {(tag >> 8) - 1, method (tag & 0xff)};
+        }
+    };
+    
     // can be used for a remote server or a remote client. 
     struct remote_receive_handler {
         ptr<net::session<JSON>> Send;
@@ -26,11 +75,26 @@ namespace Gigamonkey::Stratum {
         
         virtual void parse_error (const string &invalid);
         
-        uint32 Requests {0};
-        std::map<request_id, method> Request;
+        // requests that have not been answered after this long are forgotten. 
+        uint32 RequestTimeoutSeconds {60};
+        pending_requests Request {};
+        
+        // forget requests that have timed out. This is also done whenever
+        // a request is sent. 
+        void expire_requests ();
+        
+        // called for a request that will not be answered. 
+        virtual void request_timed_out (request_id, method) {}
         
         void operator () (const JSON &next);
         
+        // a line of text that has been received. mining.submit is read
+        // directly and anything else goes to the JSON parser. 
+        void receive_line (string_view line);
+        
+        // by default, a submit that was read directly is handled as a request. 
+        virtual void receive_submit (const message_id &, const share &);
+        
         // there are two ways to talk to a server: request and notify. 
         // request expects a response and notify does not. 
         request_id send_request (method m, parameters p);
@@ -57,6 +121,10 @@ namespace Gigamonkey::Stratum {
         Send->send (notification {m, p});
     }
     
+    void inline remote_receive_handler::receive_submit (const message_id &id, const share &x) {
+        receive_request (mining::submit_request {id, x});
+    }
+    
     void inline remote_receive_handler::parse_error (const string &invalid) {
         throw exception {} << "Invalid JSON string: \"" << invalid << "\"";
     }
@@ -0,0 +1,100 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_SERVER
+#define GIGAMONKEY_STRATUM_SERVER
+
+#include <gigamonkey/stratum/server_session.hpp>
+#include <gigamonkey/stratum/statistics.hpp>
+#include <gigamonkey/stratum/rate_limit.hpp>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gigamonkey::Stratum {
+    
+    // Accepts connections from miners and runs a server_session for each of
+    // them on a small pool of threads. Everything that happens to a session
+    // happens on its own strand, so sessions need not be thread safe.
+    //
+    // Each connection has its own write queue. A connection whose queue grows
+    // past MaxQueuedBytes because the miner is not reading, or which sends
+    // nothing for IdleTimeoutSeconds, is closed.
+    //
+    // If there are rate limits, messages that go over them are dropped
+    // before they are parsed, and connections from addresses that go over
+    // them are not accepted.
+    struct server {
+        
+        struct options {
+            uint32 Threads {1};
+            
+            size_t MaxQueuedBytes {1 << 20};
+            size_t MaxMessageSize {1 << 16};
+            
+            uint32 IdleTimeoutSeconds {600};
+            
+            // if present, connections and job fan-out are counted here.
+            ptr<statistics> Statistics {};
+            
+            optional<rate_limits::options> RateLimits {};
+            
+            // how far behind we are for rate limits, such as share_pipeline::pending.
+            std::function<size_t ()> Load {};
+            
+            options () {};
+        };
+        
+        // make a session for a new connection.
+        using make_session = std::function<ptr<server_session> (ptr<net::session<JSON>>)>;
+        
+        // start listening and accepting connections.
+        server (const boost::asio::ip::tcp::endpoint &, make_session, const options & = options {});
+        
+        // close every connection and wait for the threads to finish.
+        ~server ();
+        
+        server (const server &) = delete;
+        server &operator = (const server &) = delete;
+        
+        void stop ();
+        
+        size_t connections () const;
+        
+        // bytes that are waiting to be written to all connections.
+        size_t queued () const;
+        
+        // the port that we are listening on.
+        uint16 port () const;
+        
+        // send a job to every session that has subscribed.
+        void notify (const mining::notify::parameters &);
+    
+    private:
+        struct connection;
+        
+        options Options;
+        make_session Make;
+        ptr<rate_limits> Limits;
+        
+        boost::asio::io_context IO;
+        boost::asio::ip::tcp::acceptor Acceptor;
+        std::vector<std::thread> Threads;
+        
+        mutable std::mutex Mutex;
+        std::vector<ptr<connection>> Connections;
+        
+        std::atomic<size_t> Queued;
+        
+        void accept ();
+        void remove (const connection *);
+    };
+    
+}
+
+#endif
@@ -14,10 +14,45 @@
 #include <gigamonkey/stratum/mining_set_difficulty.hpp>
 #include <gigamonkey/stratum/mining_set_version_mask.hpp>
 #include <gigamonkey/stratum/mining_set_extranonce.hpp>
+#include <gigamonkey/stratum/mining_set_midstates.hpp>
+#include <gigamonkey/stratum/vardiff.hpp>
+#include <gigamonkey/stratum/share_ledger.hpp>
 #include <shared_mutex>
+#include <chrono>
 
 namespace Gigamonkey::Stratum {
     
+    // The shares that have been submitted for one job, by 64 bits of their
+    // hashes, which are already random. Kept with the job and dropped with it
+    // or when a clean job makes it stale.
+    struct share_set {
+        share_set () : Size {0}, Slots (16, 0) {}
+        
+        // returns false if the share is already in the set.
+        bool insert (const uint256 &share_hash);
+        
+        // by the 64 bits that are kept, which are never zero.
+        bool insert (uint64 x);
+        
+        size_t size () const {
+            return Size;
+        }
+        
+        // the 64 bits kept for each share, in no order.
+        std::vector<uint64> hashes () const {
+            std::vector<uint64> x;
+            x.reserve (Size);
+            for (uint64 y : Slots) if (y != 0) x.push_back (y);
+            return x;
+        }
+        
+    private:
+        size_t Size;
+        
+        // 0 means an empty slot.
+        std::vector<uint64> Slots;
+    };
+    
     // this represents a server talking to a remote client. 
     struct server_session : public remote_receive_handler, public work::selector {
         
@@ -30,6 +65,9 @@ namespace Gigamonkey::Stratum {
             
             uint32 RememberOldJobsSeconds {60};
             
+            // the greatest number of old jobs that are remembered at once. 
+            uint32 RememberOldJobsCount {64};
+            
             optional<extensions::options> ExtensionsParameters {};
             
             // if minimum difficulty is supported, do we honor 
@@ -37,6 +75,10 @@ namespace Gigamonkey::Stratum {
             // do we ignore it? 
             bool HonorMinimumDifficulty {true};
             
+            // if set, the difficulty is chosen for each session so that
+            // it submits shares at a steady rate.
+            optional<vardiff::options> VariableDifficulty {};
+            
             options () {};
         };
         
@@ -52,9 +94,43 @@ namespace Gigamonkey::Stratum {
         
         optional<string> username () const;
         
-        // notify the client of a new job. 
+        // whether we have responded true to a mining.subscribe message.
+        bool subscribed () const {
+            return State.subscribed ();
+        }
+        
+        // notify the client of a new job. If variable difficulty is
+        // enabled, a new difficulty may be sent first. If extension
+        // version_midstates was negotiated, set_midstates is sent after.
         void send_notify (const mining::notify::parameters& p);
         
+        // remember a job that has been sent to the client some other way, as
+        // when the same notify message is written to many sessions at once.
+        void notified (const mining::notify::parameters& p) {
+            retarget ();
+            State.notify (p);
+        }
+        
+        // send set_midstates for a job that has just been notified, if extension
+        // version_midstates was negotiated. The midstates are different for each
+        // session, so this is called after the notify message has been written.
+        void send_midstates (const mining::notify::parameters& p);
+        
+        // Raise the difficulty by a factor when we are getting more shares than we
+        // can check. Variable difficulty brings it back down once shares are coming
+        // too slowly, so this only does anything if variable difficulty is enabled.
+        void raise_difficulty (double factor);
+        
+        // shares are written here if it is set. It should be opened 
+        // by the thread that the session runs on. 
+        ptr<share_ring> Ledger {};
+        
+        // tell variable difficulty and the ledger that a share has been accepted.
+        void accepted_share (const share &);
+        
+        // a share was for a job that is no longer current.
+        void stale_share (const share &);
+        
         optional<string> client_version () const;
         
         extensions::version_mask version_mask () const;
@@ -73,6 +149,17 @@ namespace Gigamonkey::Stratum {
         // It doesn't depend on state so can be sent at any time. 
         request_id send_get_version ();
         
+        // Everything that has been agreed with the miner and the jobs that it is
+        // working on, so that the session can be resumed on another frontend when
+        // the miner reconnects, without going through configure, subscribe and
+        // authorize again. The options of this frontend are not included.
+        bytes snapshot () const;
+        
+        // returns false and changes nothing if the snapshot cannot be read. The
+        // extra nonce is the one from the old frontend, so the session should be
+        // moved to one of our own with send_set_extranonce.
+        bool resume (bytes_view snapshot);
+        
     private:
         virtual void receive_get_version (const string &) {};
         
@@ -102,14 +189,31 @@ namespace Gigamonkey::Stratum {
         // empty return value for an accepted share. 
         optional<error> submit (const share &x);
         
+        optional<vardiff> VariableDifficulty {};
+        
+        // send a new difficulty if variable difficulty calls for it.
+        void retarget ();
+        
+        static double now ();
+        
+    public:
         // the state data of the protocol. 
         class state {
+            friend struct server_session;
             
             options Options;
             
             // whether we have received and responded to a mining.configure message. 
             bool Configured {false};
             
+            // whether we have accepted extension binary_framing, after which
+            // messages are sent and received as binary frames.
+            bool BinaryFraming {false};
+            
+            // the number of midstates sent with each job with extension
+            // version_midstates, which was not negotiated if zero.
+            byte VersionMidstates {0};
+            
             // Extension version_rolling allows clients to use ASICBoost. Server and client agree
             // on a mask that says what bits of the version field the client is allowed to alter. 
             extensions::parameters<extensions::version_rolling> VersionRollingMaskParameters;
@@ -143,6 +247,14 @@ namespace Gigamonkey::Stratum {
             // whether we have received and responded to a mining.configure message. 
             bool configured () const;
             
+            bool binary_framing () const;
+            
+            byte version_midstates () const;
+            
+            // the set_midstates message for a job that has been notified, or
+            // nothing if extension version_midstates was not negotiated.
+            maybe<mining::set_midstates::parameters> midstates (const mining::notify::parameters& p) const;
+            
             // whether we have received and responded 'true' to a mining.authorize message.
             bool authorized () const;
             
@@ -178,18 +290,29 @@ namespace Gigamonkey::Stratum {
             optional<extensions::results> configure (const extensions::requests& p);
             
             // we need to keep track of the last few notify notifications that have been sent. 
+            // They are kept in a ring of fixed size that is allocated once, and looked 
+            // up by job id. 
             struct history {
                 struct entry {
                     optional<extensions::version_mask> Mask;
                     Stratum::extranonce ExtraNonce;
                     mining::notify::parameters Notification;
                     
-                    entry ();
+                    // shares that have been submitted for this job.
+                    mutable share_set Shares;
+                    
+                    // shares that were submitted after a newer clean job. 
+                    mutable uint32 StaleShares;
+                    
+                    // the order in which the job was sent. 
+                    uint64 Sequence;
+                    
+                    entry () : Mask {}, ExtraNonce {}, Notification {}, Shares {}, StaleShares {0}, Sequence {0} {}
                     entry (
                         const optional<extensions::version_mask> &m,
                         const Stratum::extranonce &n,
                         const mining::notify::parameters &p) : 
-                        Mask{m}, ExtraNonce {n}, Notification{p} {}
+                        Mask{m}, ExtraNonce {n}, Notification{p}, Shares {}, StaleShares {0}, Sequence {0} {}
                     
                     Bitcoin::timestamp time () const {
                         return Notification.Now;
@@ -197,46 +320,181 @@ namespace Gigamonkey::Stratum {
                 };
                 
                 double RememberForThisMuchTime;
-                std::list<entry> Notifications;
                 
-                void push(
+                history (double remember = 60, size_t capacity = 64) : 
+                    RememberForThisMuchTime {remember}, Ring (capacity > 0 ? capacity : 1),
+                    Index {}, Oldest {0}, Next {0}, LastClean {0}, EvictedStaleShares {0} {}
+                
+                // return value is the number of stale shares that were 
+                // submitted for the jobs that are forgotten to make room. 
+                uint32 push (
                     optional<extensions::version_mask> mask,
                     Stratum::extranonce n,
-                    const mining::notify::parameters &p) {
-                    
-                    while (Notifications.size () > 0 && (p.Now - Notifications.back().time()) > RememberForThisMuchTime)
-                        Notifications.pop_back ();
-                    
-                    Notifications.push_front ({mask, n, p});
+                    const mining::notify::parameters &p);
+                
+                // nullptr if the job is not remembered. 
+                const entry *find (const job_id &) const;
+                
+                // a job is stale if a newer job has been sent with Clean set. 
+                bool stale (const entry &e) const {
+                    return e.Sequence < LastClean;
+                }
+                
+                size_t size () const {
+                    return Next - Oldest;
+                }
+                
+                size_t capacity () const {
+                    return Ring.size ();
+                }
+                
+                // stale shares for all jobs that have been forgotten. 
+                uint64 evicted_stale_shares () const {
+                    return EvictedStaleShares;
                 }
+                
+                // the jobs that are remembered, oldest first.
+                std::vector<const entry *> entries () const {
+                    std::vector<const entry *> x;
+                    x.reserve (size ());
+                    for (uint64 i = Oldest; i < Next; i++) x.push_back (&Ring[i % Ring.size ()]);
+                    return x;
+                }
+                
+                // for a history that is being restored from a snapshot.
+                void add_evicted_stale_shares (uint64 n) {
+                    EvictedStaleShares += n;
+                }
+                
+            private:
+                std::vector<entry> Ring;
+                hash_map<job_id, uint64> Index;
+                
+                // sequence numbers of the oldest job remembered, the 
+                // next job to be sent, and the last clean job. 
+                uint64 Oldest;
+                uint64 Next;
+                uint64 LastClean;
+                
+                uint64 EvictedStaleShares;
+                
+                entry &at (uint64 sequence) {
+                    return Ring[sequence % Ring.size ()];
+                }
+                
+                uint32 pop ();
             };
         
             history Notifies;
-            set<byte_array<80>> Recent;
             
             struct found {
                 proof Proof;
                 bool Found;
                 bool Stale;
                 
-                found () : Proof{}, Found{false}, Stale{true} {}
-                found (const proof &p, bool x) : Proof{p}, Found{true}, Stale{x} {}
+                // the shares for the job that was found.
+                share_set *Shares;
+                
+                found () : Proof{}, Found{false}, Stale{true}, Shares {nullptr} {}
+                found (const proof &p, bool x, share_set *s) : Proof{p}, Found{true}, Stale{x}, Shares {s} {}
             };
             
             found find (const share &x) const;
         
             void notify (const mining::notify::parameters& p);
             
+            bytes snapshot () const;
+            
+            // the state of a snapshot taken with the given options.
+            static maybe<state> restore (const options &, bytes_view);
+            
             state () {}
             state (const options &x) :
-               Options {x}, Notifies {static_cast<double> (x.RememberOldJobsSeconds)}, Recent {} {}
+               Options {x}, Notifies {static_cast<double> (x.RememberOldJobsSeconds), x.RememberOldJobsCount} {}
             
         };
         
+    private:
         state State {};
         
     };
     
+    bool inline share_set::insert (const uint256 &share_hash) {
+        uint64 x;
+        std::copy (share_hash.begin (), share_hash.begin () + 8, reinterpret_cast<byte *> (&x));
+        return insert (x == 0 ? 1 : x);
+    }
+    
+    bool inline share_set::insert (uint64 x) {
+        // keep the table at most half full.
+        if (2 * (Size + 1) > Slots.size ()) {
+            std::vector<uint64> old (Slots.size () * 2, 0);
+            std::swap (old, Slots);
+            for (uint64 y : old) if (y != 0) {
+                size_t i = y & (Slots.size () - 1);
+                while (Slots[i] != 0) i = (i + 1) & (Slots.size () - 1);
+                Slots[i] = y;
+            }
+        }
+        
+        size_t i = x & (Slots.size () - 1);
+        while (Slots[i] != 0) {
+            if (Slots[i] == x) return false;
+            i = (i + 1) & (Slots.size () - 1);
+        }
+        
+        Slots[i] = x;
+        Size++;
+        return true;
+    }
+    
+    uint32 inline server_session::state::history::pop () {
+        entry &e = at (Oldest);
+        auto i = Index.find (e.Notification.JobID);
+        if (i != Index.end () && i->second == Oldest) Index.erase (i);
+        
+        uint32 stale = e.StaleShares;
+        EvictedStaleShares += stale;
+        e.Shares = share_set {};
+        Oldest++;
+        return stale;
+    }
+    
+    uint32 inline server_session::state::history::push (
+        optional<extensions::version_mask> mask,
+        Stratum::extranonce n,
+        const mining::notify::parameters &p) {
+        
+        uint32 stale = 0;
+        while (size () > 0 && (size () == capacity () || (p.Now - at (Oldest).time ()) > RememberForThisMuchTime))
+            stale += pop ();
+        
+        // reuse the storage that is already in the ring. 
+        entry &e = at (Next);
+        e.Mask = mask;
+        e.ExtraNonce = n;
+        e.Notification = p;
+        e.StaleShares = 0;
+        e.Sequence = Next;
+        
+        // shares for stale jobs are rejected before they are looked up.
+        if (p.Clean) {
+            for (uint64 i = Oldest; i < Next; i++) at (i).Shares = share_set {};
+            LastClean = Next;
+        }
+        
+        Index[p.JobID] = Next;
+        Next++;
+        
+        return stale;
+    }
+    
+    const server_session::state::history::entry inline *server_session::state::history::find (const job_id &id) const {
+        auto i = Index.find (id);
+        if (i == Index.end ()) return nullptr;
+        return &Ring[i->second % Ring.size ()];
+    }
+    
     optional<string> inline server_session::username () const {
         return State.name ();
     }
@@ -264,12 +522,56 @@ namespace Gigamonkey::Stratum {
     }
     
     void inline server_session::send_set_difficulty(const Stratum::difficulty& d) {
-        if (State.set_difficulty (d)) this->send_notification (mining_set_difficulty, mining::set_difficulty::serialize (d));
+        if (!State.set_difficulty (d)) return;
+        
+        if (State.Options.VariableDifficulty) {
+            if (!VariableDifficulty) VariableDifficulty = vardiff {*State.Options.VariableDifficulty, double (d), now ()};
+            else VariableDifficulty->set (double (d), now ());
+        }
+        
+        this->send_notification (mining_set_difficulty, mining::set_difficulty::serialize (d));
+    }
+    
+    void inline server_session::accepted_share (const share &x) {
+        if (VariableDifficulty) VariableDifficulty->accepted (now ());
+        if (Ledger) Ledger->push (share_record {State.name (), x.JobID, double (State.difficulty ()), uint32 (x.Share.Timestamp.Value), false});
+    }
+    
+    void inline server_session::stale_share (const share &x) {
+        if (Ledger) Ledger->push (share_record {State.name (), x.JobID, double (State.difficulty ()), uint32 (x.Share.Timestamp.Value), true});
+    }
+    
+    void inline server_session::retarget () {
+        if (!VariableDifficulty) return;
+        
+        auto d = VariableDifficulty->retarget (now ());
+        if (!d) return;
+        
+        double minimum = double (State.minimum_difficulty ());
+        send_set_difficulty (Stratum::difficulty {work::difficulty {std::max (*d, minimum)}});
+    }
+    
+    void inline server_session::raise_difficulty (double factor) {
+        if (!VariableDifficulty || !(factor > 1)) return;
+        
+        double d = std::min (VariableDifficulty->difficulty () * factor, VariableDifficulty->settings ().MaximumDifficulty);
+        double minimum = double (State.minimum_difficulty ());
+        send_set_difficulty (Stratum::difficulty {work::difficulty {std::max (d, minimum)}});
+    }
+    
+    double inline server_session::now () {
+        return std::chrono::duration<double> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
     }
     
     void inline server_session::send_notify(const mining::notify::parameters& p) {
+        retarget ();
         State.notify (p);
         this->send_notification (mining_notify, mining::notify::serialize (p));
+        send_midstates (p);
+    }
+    
+    void inline server_session::send_midstates (const mining::notify::parameters& p) {
+        if (auto m = State.midstates (p); bool (m)) this->send_notification (mining_set_midstates, mining::set_midstates::serialize (*m));
     }
     
     request_id inline server_session::send_get_version () {
@@ -289,6 +591,14 @@ namespace Gigamonkey::Stratum {
         return Configured;
     }
     
+    bool inline server_session::state::binary_framing () const {
+        return BinaryFraming;
+    }
+    
+    byte inline server_session::state::version_midstates () const {
+        return VersionMidstates;
+    }
+    
     // whether we have received and responded 'true' to a mining.authorize message.
     bool inline server_session::state::authorized() const {
         return bool (Name);
@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_SESSION_HANDOFF
+#define GIGAMONKEY_STRATUM_SESSION_HANDOFF
+
+#include <gigamonkey/stratum/session_id.hpp>
+#include <gigamonkey/memory.hpp>
+
+#include <deque>
+#include <mutex>
+
+namespace Gigamonkey::Stratum {
+    
+    // Snapshots of sessions that have been closed on a frontend that is being
+    // drained, kept until their miners reconnect. A miner asks to resume its
+    // session by giving its old extra nonce 1 in mining.subscribe, which is the
+    // resume token. The frontend that it reconnects to takes the snapshot and gives
+    // it to server_session::resume instead of starting a new session.
+    //
+    // Frontends must share the store, so an implementation for more than one
+    // process would keep them in a database.
+    struct session_handoff {
+        virtual void put (session_id, bytes snapshot, uint32 now) = 0;
+        
+        // A snapshot is removed when it is taken so that a session is resumed at
+        // most once. Nothing if there is no snapshot or if it has expired.
+        virtual maybe<bytes> take (session_id, uint32 now) = 0;
+        
+        virtual ~session_handoff () {}
+        
+        class memory;
+    };
+    
+    // for frontends in one process.
+    class session_handoff::memory final : public session_handoff {
+        uint32 ExpireSeconds;
+        
+        mutable std::mutex Mutex;
+        
+        struct entry {
+            bytes Snapshot;
+            uint32 Time;
+        };
+        
+        hash_map<uint32, entry> Snapshots;
+        
+        // the bytes of all the snapshots together.
+        uint64 Stored;
+        
+        // in the order in which they were put, to expire them.
+        std::deque<std::pair<uint32, uint32>> Order;
+        
+        void expire (uint32 now);
+    
+    public:
+        // snapshots are forgotten after this long, by which time the miner will have started over.
+        explicit memory (uint32 expire_seconds = 300) : ExpireSeconds {expire_seconds}, Mutex {}, Snapshots {}, Stored {0}, Order {} {}
+        
+        void put (session_id, bytes snapshot, uint32 now) override;
+        maybe<bytes> take (session_id, uint32 now) override;
+        
+        size_t size () const;
+        
+        // the snapshots are the values.
+        memory_report memory_usage () const;
+    };
+    
+}
+
+#endif
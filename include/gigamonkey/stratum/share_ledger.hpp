@@ -0,0 +1,148 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_SHARE_LEDGER
+#define GIGAMONKEY_STRATUM_SHARE_LEDGER
+
+#include <gigamonkey/stratum/mining.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace Gigamonkey::Stratum {
+    
+    struct share_record {
+        worker_name Worker;
+        job_id JobID;
+        double Difficulty;
+        uint32 Timestamp;
+        bool Stale;
+    };
+    
+    // A queue of shares with one thread that writes and one that reads,
+    // neither of which ever waits for the other. If it is full, shares
+    // are dropped and counted.
+    struct share_ring {
+        // capacity is rounded up to a power of two.
+        explicit share_ring (size_t capacity);
+        
+        bool push (share_record &&);
+        bool pop (share_record &);
+        
+        uint64 dropped () const {
+            return Dropped.load (std::memory_order_relaxed);
+        }
+    
+    private:
+        std::vector<share_record> Records;
+        size_t Mask;
+        alignas (64) std::atomic<size_t> Head;
+        alignas (64) std::atomic<size_t> Tail;
+        std::atomic<uint64> Dropped;
+    };
+    
+    // Collects accepted shares from the threads that receive them and
+    // works out hashrates and a PPLNS window on a thread of its own.
+    // Each receiving thread opens its own ring and writes shares to it.
+    struct share_ledger {
+        
+        struct options {
+            size_t RingSize {1 << 14};
+            
+            // hashrates are averaged over this long.
+            uint32 HashrateWindowSeconds {600};
+            
+            // the last shares that add up to this much difficulty are paid.
+            double PPLNSDifficulty {1e6};
+            
+            // shares are given to the exporter in batches of this many.
+            size_t ExportBatch {1024};
+            
+            uint32 IntervalMilliseconds {250};
+            
+            // if false, there is no thread and update must be called.
+            bool Background {true};
+            
+            options () {};
+        };
+        
+        using exporter = std::function<void (std::vector<share_record> &&)>;
+        
+        explicit share_ledger (const options &, exporter = {});
+        
+        // stops the thread and exports what is left.
+        ~share_ledger ();
+        
+        share_ledger (const share_ledger &) = delete;
+        share_ledger &operator = (const share_ledger &) = delete;
+        
+        // a ring for the calling thread to write to.
+        ptr<share_ring> open ();
+        
+        // read everything that has been written and bring the windows up to date.
+        void update ();
+        
+        // give any shares that have not been exported to the exporter.
+        void flush ();
+        
+        // hashes per second over the window ending at the latest share.
+        double hashrate (const worker_name &) const;
+        double hashrate () const;
+        
+        // difficulty for each worker in the PPLNS window. Stale shares are not counted.
+        std::map<worker_name, double> pplns () const;
+        
+        // shares that were dropped because a ring was full.
+        uint64 dropped () const;
+    
+    private:
+        options Options;
+        exporter Export;
+        
+        mutable std::mutex RingMutex;
+        std::vector<ptr<share_ring>> Rings;
+        
+        // everything below is only changed by update.
+        mutable std::mutex Mutex;
+        
+        // shares from different rings are not in order of time, so the
+        // oldest is kept on top of a heap.
+        struct window {
+            std::priority_queue<std::pair<uint32, double>, std::vector<std::pair<uint32, double>>, std::greater<>> Shares;
+            double Total {0};
+            
+            void add (uint32 time, double d);
+            
+            // forget shares from before earliest.
+            void trim (uint32 earliest);
+        };
+        
+        window Pool;
+        std::map<worker_name, window> Workers;
+        uint32 Latest;
+        
+        std::deque<share_record> PPLNS;
+        std::map<worker_name, double> PPLNSTotals;
+        double PPLNSTotal;
+        
+        std::vector<share_record> Batch;
+        
+        std::mutex StopMutex;
+        std::condition_variable Wake;
+        bool Stop;
+        std::thread Thread;
+        
+        void add (share_record &&);
+        void run ();
+    };
+    
+}
+
+#endif
@@ -0,0 +1,142 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_SHARE_LOG
+#define GIGAMONKEY_STRATUM_SHARE_LOG
+
+#include <gigamonkey/stratum/session_id.hpp>
+#include <gigamonkey/work/prepared_puzzle.hpp>
+
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace Gigamonkey::Stratum {
+    
+    // An accepted share as it is kept in a share log. The target that the share
+    // was checked against is kept rather than its difficulty so that it can be
+    // checked again exactly.
+    struct share_log_record {
+        // the sequence number of the job, as from job_manager::sequence.
+        uint64 Job;
+        session_id ExtraNonce1;
+        work::share Share;
+        work::compact Target;
+        
+        double difficulty () const {
+            return double (Target.difficulty ());
+        }
+        
+        // whether the share meets its target with the puzzle of its job, which must
+        // have been prepared with the version mask of the session.
+        bool valid (const work::prepared_puzzle &p) const {
+            return p.hash (work::solution {Share, ExtraNonce1}) < Target.expand ();
+        }
+        
+        bool operator == (const share_log_record &x) const {
+            return Job == x.Job && ExtraNonce1 == x.ExtraNonce1 && Share == x.Share && Target == x.Target;
+        }
+    };
+    
+    // An append-only log of accepted shares, kept in a directory as files of
+    // fixed-size records, each with room for a fixed number of records and
+    // mapped into memory. Each thread that accepts shares writes them to a
+    // writer of its own, which copies them into the log in batches so that
+    // threads rarely wait for one another. Records are numbered in the order
+    // in which space for them was taken.
+    //
+    // A record whose checksum is wrong is skipped when it is read, which is
+    // what happens to one that is still being written or that was being
+    // written when the process stopped.
+    struct share_log {
+        
+        // a record is 72 bytes, with room for an extra nonce 2 of 32 bytes.
+        static constexpr size_t record_size = 72;
+        static constexpr size_t max_extra_nonce_2_size = 32;
+        
+        struct options {
+            // records in each file.
+            uint64 SegmentRecords {1 << 20};
+            
+            // records that a writer keeps before it copies them into the log.
+            size_t BufferRecords {256};
+            
+            options () {};
+        };
+        
+        // The directory is made if it does not exist. If it has a log already, the
+        // number of records in each file is taken from it. Throws std::invalid_argument
+        // if a file of the log is not one that we wrote and std::runtime_error if
+        // the files cannot be read.
+        explicit share_log (const std::filesystem::path &directory, const options & = options {});
+        ~share_log ();
+        
+        share_log (const share_log &) = delete;
+        share_log &operator = (const share_log &) = delete;
+        
+        // not thread-safe, so each thread must have its own. It must not outlive the log.
+        struct writer {
+            // throws std::invalid_argument if extra nonce 2 is too big.
+            void write (const share_log_record &);
+            
+            // copy what has been written into the log.
+            void flush ();
+            
+            ~writer ();
+            
+            writer (const writer &) = delete;
+            writer &operator = (const writer &) = delete;
+        
+        private:
+            share_log &Log;
+            std::vector<byte> Buffer;
+            size_t Count;
+            
+            explicit writer (share_log &);
+            friend struct share_log;
+        };
+        
+        ptr<writer> open ();
+        
+        // write everything that writers have copied into the log to the disk.
+        void sync ();
+        
+        // the number of records that space has been taken for.
+        uint64 size () const;
+        
+        // the good records among the given number starting at the given one.
+        std::vector<share_log_record> read (uint64 begin, uint64 count) const;
+        
+        // the good records at the end of the log that add up to at least the given
+        // difficulty, or every good record if there are not enough, last first,
+        // for a PPLNS window. Records are read a batch at a time going back.
+        std::vector<share_log_record> last (double difficulty, uint64 batch = 4096) const;
+    
+    private:
+        struct segment;
+        
+        std::filesystem::path Directory;
+        options Options;
+        
+        mutable std::mutex Mutex;
+        std::vector<ptr<segment>> Segments;
+        uint64 End;
+        
+        // segments before this one are full, have nothing being copied into them
+        // and have been written to the disk.
+        uint64 Synced;
+        
+        // a position in the log that has been taken for a number of records.
+        struct reservation {
+            ptr<segment> Segment;
+            uint64 Offset;
+            uint64 Count;
+        };
+        
+        std::vector<reservation> reserve (uint64 count);
+        ptr<segment> open_segment (uint64 number, bool create) const;
+    };
+    
+}
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_SHARE_PIPELINE
+#define GIGAMONKEY_STRATUM_SHARE_PIPELINE
+
+#include <gigamonkey/stratum/mining_notify.hpp>
+#include <gigamonkey/stratum/mining_set_midstates.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <map>
+
+namespace Gigamonkey::Stratum {
+    
+    // a job as one worker sees it, with everything that does not
+    // depend on the share computed once.
+    struct prepared_job {
+        worker Worker;
+        mining::notify::parameters Notify;
+        
+        // the coinbase up to extra nonce 2 and after it.
+        bytes CoinbasePrefix;
+        bytes CoinbaseSuffix;
+        
+        Merkle::path Path;
+        
+        // With extension version_midstates, extra nonce 2 is fixed at zero for
+        // the job and the midstates of the first midstates values of the version
+        // bits are worked out here. A share with that extra nonce 2 and one of
+        // those values is checked from its midstate; any other is checked as usual.
+        prepared_job (const worker &, const mining::notify::parameters &, byte midstates = 0);
+        
+        // whether the share could belong to this job.
+        bool matches (const share &) const;
+        
+        // the header that the share would make.
+        byte_array<80> header (const share &) const;
+        
+        // the state after the first 64 bytes of the header
+        // that the share would make, or nullptr if it is not known.
+        const sha256::state *midstate (const share &) const;
+        
+        // the mining.set_midstates message to send after mining.notify for this job.
+        mining::set_midstates::parameters midstates () const;
+    
+    private:
+        // the Merkle root for the fixed extra nonce 2, if there are midstates.
+        maybe<digest256> Root;
+        std::vector<mining::set_midstates::midstate> Midstates;
+        
+        bool fixed (const share &) const;
+    };
+    
+    // Shares are checked on the threads of an executor rather than on the
+    // thread that received them. Shares waiting to be checked are taken in
+    // batches, grouped by job, and their headers are hashed with the
+    // multi-buffer hasher. Results are delivered in the order that the
+    // shares were submitted, one at a time.
+    //
+    // A share that is submitted is traced with a stratum.submit span in the
+    // span that submitted it, with stratum.queue, stratum.pow_check and
+    // stratum.response spans for its stages. The callback is in the last.
+    struct share_pipeline {
+        
+        struct result {
+            // whether the share meets the target it was submitted for.
+            bool Valid;
+            
+            // whether the share meets the target of the job.
+            bool Solved;
+            
+            byte_array<80> Header;
+            digest256 Hash;
+            
+            result () : Valid {false}, Solved {false}, Header {}, Hash {} {}
+        };
+        
+        using callback = std::function<void (const share &, const result &)>;
+        
+        // no more than max_threads batches are checked at once. Shares are not
+        // counted here but in statistics::session by whatever responds to them,
+        // which knows whether a share was stale or a duplicate.
+        share_pipeline (executor &, uint32 max_batch = 256, uint32 max_threads = 0);
+        
+        // waits for shares that have already been submitted.
+        ~share_pipeline ();
+        
+        share_pipeline (const share_pipeline &) = delete;
+        share_pipeline &operator = (const share_pipeline &) = delete;
+        
+        void submit (ptr<const prepared_job>, const share &, const work::compact &target, callback);
+        
+        // shares that have been submitted and not yet delivered.
+        size_t pending () const;
+    
+    private:
+        struct request {
+            uint64 Sequence;
+            ptr<const prepared_job> Job;
+            share Share;
+            work::compact Target;
+            callback Done;
+            trace::async_span Span;
+        };
+        
+        struct finished {
+            share Share;
+            result Result;
+            callback Done;
+            trace::async_span Span;
+        };
+        
+        executor &Executor;
+        uint32 MaxBatch;
+        uint32 MaxThreads;
+        
+        mutable std::mutex Mutex;
+        std::condition_variable Idle;
+        std::deque<request> Queue;
+        uint32 Running;
+        uint64 Next;
+        
+        // results that are waiting for earlier ones.
+        std::mutex DeliverMutex;
+        std::map<uint64, finished> Finished;
+        uint64 NextDelivery;
+        std::atomic<size_t> Pending;
+        
+        void drain ();
+        void check (std::vector<request> &);
+        void deliver (std::vector<request> &, std::vector<result> &);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_STATISTICS
+#define GIGAMONKEY_STRATUM_STATISTICS
+
+#include <gigamonkey/stratum/error.hpp>
+#include <gigamonkey/work/solver.hpp>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace Gigamonkey::Stratum {
+    
+    // What a share came to, for counting.
+    enum share_result : byte {
+        accepted,
+        stale,
+        duplicate,
+        low_difficulty,
+        // anything else, such as a job that was never sent.
+        invalid,
+        share_results
+    };
+    
+    share_result result_of (error_code);
+    
+    const char *name (share_result);
+    
+    // Counts kept by the Stratum engine for export. Everything is atomic so
+    // that it can be read while sessions are running without taking their locks.
+    struct statistics {
+        
+        // counts of values in buckets whose upper bounds are the powers of 2
+        // from 1 to 2^(size - 1). The last bucket also has everything bigger.
+        template <size_t size> struct log2_histogram {
+            std::array<std::atomic<uint64>, size> Buckets {};
+            std::atomic<uint64> Count {0};
+            
+            static size_t bucket (double x);
+            
+            void add (double x) {
+                Buckets[bucket (x)].fetch_add (1, std::memory_order_relaxed);
+                Count.fetch_add (1, std::memory_order_relaxed);
+            }
+            
+            void remove (double x) {
+                Buckets[bucket (x)].fetch_sub (1, std::memory_order_relaxed);
+                Count.fetch_sub (1, std::memory_order_relaxed);
+            }
+        };
+        
+        // one session, which is shown with the name of its worker.
+        struct session {
+            const string Worker;
+            std::array<std::atomic<uint64>, share_results> Shares {};
+            
+            void share (share_result);
+            
+            // the session has a new difficulty.
+            void difficulty (double);
+            
+            double difficulty () const {
+                return Difficulty.load (std::memory_order_relaxed);
+            }
+            
+            session (statistics &s, const string &worker) : Worker {worker}, Statistics {s} {}
+            ~session ();
+        
+        private:
+            std::atomic<double> Difficulty {0};
+            statistics &Statistics;
+        };
+        
+        std::atomic<uint64> Sessions {0};
+        std::atomic<uint64> Connections {0};
+        
+        // messages and connections that were refused by rate limits.
+        std::atomic<uint64> Throttled {0};
+        std::array<std::atomic<uint64>, share_results> Shares {};
+        
+        std::atomic<uint64> Notifies {0};
+        
+        // microseconds from when a job is given to the server until it
+        // has been queued for every session, from 1us to about 8 seconds.
+        log2_histogram<24> NotifyLatency {};
+        std::atomic<uint64> NotifyLatencySum {0};
+        
+        // sessions by their difficulty, which is rounded up to a power of 2.
+        log2_histogram<64> Difficulties {};
+        
+        void share (share_result x, uint64 n = 1) {
+            Shares[x].fetch_add (n, std::memory_order_relaxed);
+        }
+        
+        void notified (uint64 microseconds);
+        
+        // a session that will be listed separately. It must not outlive this.
+        ptr<session> open (const string &worker);
+        
+        // solvers whose hashes are counted for as long as they exist.
+        void watch (std::weak_ptr<const work::cpu_solver>);
+        
+        statistics () {}
+        statistics (const statistics &) = delete;
+        statistics &operator = (const statistics &) = delete;
+        
+        // OpenMetrics text format, ending with # EOF.
+        string write () const;
+    
+    private:
+        // not held while anything is counted.
+        mutable std::mutex Mutex;
+        mutable std::vector<std::weak_ptr<session>> Open;
+        mutable std::vector<std::weak_ptr<const work::cpu_solver>> Solvers;
+        
+        // hashes of solvers that no longer exist, as of the last
+        // time that they were seen, so that the total never goes down.
+        mutable uint64 RetiredHashes {0};
+        mutable std::vector<uint64> LastHashes;
+    };
+    
+    template <size_t size> size_t statistics::log2_histogram<size>::bucket (double x) {
+        size_t i = 0;
+        double bound = 1;
+        while (i < size - 1 && x > bound) {
+            bound *= 2;
+            i++;
+        }
+        return i;
+    }
+    
+}
+
+#endif
@@ -114,7 +114,7 @@ namespace Gigamonkey::Stratum {
     inline notification::notification () : JSON{} {}
     
     inline notification::notification (Stratum::method m, const parameters& p) :
-        JSON{{"id", nullptr}, {"method"}, {"params", p}} {}
+        JSON{{"id", nullptr}, {"method", method_to_string (m)}, {"params", p}} {}
     
     bool inline notification::valid (const JSON &j) {
         return notification::method (j) != unset && j.contains ("params") &&
@@ -0,0 +1,72 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_STRATUM_VARDIFF
+#define GIGAMONKEY_STRATUM_VARDIFF
+
+#include <gigamonkey/work/target.hpp>
+
+namespace Gigamonkey::Stratum {
+    
+    // Choose a difficulty for one session so that it submits shares at a
+    // steady rate. The time between accepted shares is averaged with an
+    // exponentially weighted moving average and the difficulty is only
+    // changed when the rate is far enough from what we want.
+    struct vardiff {
+        
+        struct options {
+            double SharesPerMinute {20};
+            
+            // how quickly old shares are forgotten.
+            double TimeConstantSeconds {120};
+            
+            // the difficulty is not changed while the rate is within
+            // this factor of SharesPerMinute.
+            double Tolerance {1.5};
+            
+            // the least time between changes.
+            double RetargetSeconds {30};
+            
+            double MinimumDifficulty {1};
+            double MaximumDifficulty {1e15};
+            
+            options () {};
+        };
+        
+        vardiff (const options &, double initial_difficulty, double now);
+        
+        void accepted (double now);
+        
+        // the difficulty has been changed by someone else.
+        void set (double d, double now);
+        
+        // a new difficulty if it should be changed. The change is made as
+        // soon as it is returned, so it should be sent to the client.
+        maybe<double> retarget (double now);
+        
+        double difficulty () const {
+            return Difficulty;
+        }
+        
+        // estimated shares per minute.
+        double rate (double now) const;
+        
+        const options &settings () const {
+            return Options;
+        }
+    
+    private:
+        options Options;
+        double Difficulty;
+        
+        // average seconds between shares, or 0 if we don't know yet.
+        double Interval;
+        double LastShare;
+        double LastRetarget;
+        
+        double clamp (double d) const;
+    };
+    
+}
+
+#endif
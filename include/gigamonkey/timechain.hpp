@@ -10,6 +10,9 @@
 #include <gigamonkey/merkle/proof.hpp>
 #include <gigamonkey/work/target.hpp>
 #include <gigamonkey/script/instruction.hpp>
+#include <gigamonkey/executor.hpp>
+
+#include <span>
 
 namespace Gigamonkey::Bitcoin {
     
@@ -26,6 +29,10 @@ namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const outpoint &h);
     reader &operator >> (reader &r, outpoint &h);
+    
+    // the fast serializers. See write_cursor in p2p/var_int.hpp.
+    write_cursor &operator << (write_cursor &w, const outpoint &h);
+    read_cursor &operator >> (read_cursor &r, outpoint &h);
 
     std::ostream &operator << (std::ostream &o, const outpoint &p);
     
@@ -35,6 +42,9 @@ namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const input &h);
     reader &operator >> (reader &r, input &h);
+    
+    write_cursor &operator << (write_cursor &w, const input &h);
+    read_cursor &operator >> (read_cursor &r, input &h);
 
     std::ostream &operator << (std::ostream &o, const input &p);
     
@@ -44,6 +54,9 @@ namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const output &h);
     reader &operator >> (reader &r, output &h);
+    
+    write_cursor &operator << (write_cursor &w, const output &h);
+    read_cursor &operator >> (read_cursor &r, output &h);
 
     std::ostream &operator << (std::ostream &o, const output &p);
     
@@ -53,6 +66,9 @@ namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const transaction &h);
     reader &operator >> (reader &r, transaction &h);
+    
+    write_cursor &operator << (write_cursor &w, const transaction &h);
+    read_cursor &operator >> (read_cursor &r, transaction &h);
 
     std::ostream &operator << (std::ostream &o, const transaction &p);
     
@@ -67,6 +83,9 @@ namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const header &h);
     reader &operator >> (reader &r, header &h);
+    
+    write_cursor &operator << (write_cursor &w, const header &h);
+    read_cursor &operator >> (read_cursor &r, header &h);
 
     std::ostream &operator << (std::ostream &o, const header &h);
     
@@ -119,7 +138,7 @@ namespace Gigamonkey::Bitcoin {
         byte_array<80> write () const;
         
         digest256 hash () const {
-            return Hash256 (write ());
+            return hash (write ());
         }
         
         bool valid () const;
@@ -127,6 +146,17 @@ namespace Gigamonkey::Bitcoin {
         int16 version () const;
         const transaction &coinbase () const;
     };
+    
+    // hash many headers at once with the fastest kernel that the cpu supports.
+    // There must be as many digests as headers.
+    void Hash256_headers (std::span<const slice<80>> headers, std::span<digest256> digests);
+    
+    // check that each header is valid and comes right after the one before it.
+    // Proof of work is checked with the multi-buffer hasher, on the threads
+    // of e if it is given. Returns the index of the first invalid header, or
+    // the number of headers if they are all valid.
+    size_t validate_chain (std::span<const header> headers);
+    size_t validate_chain (std::span<const header> headers, executor &e);
 
     // an outpoint is a reference to a previous output. 
     struct outpoint {
@@ -239,13 +269,69 @@ namespace Gigamonkey::Bitcoin {
     };
     
     txid inline id (const transaction& t) {
-        return Hash256 (bytes (t));
+        Hash256_writer w;
+        w << t;
+        return w.finalize ();
     }
     
     digest256 inline merkle_root (const list<transaction> t) {
         return Merkle::root (data::for_each (id, t));
     }
     
+    // An immutable transaction whose serialization, size and txid are computed 
+    // once when it is made. Copies share them, so this is cheap to pass around 
+    // and to ask for its id or size many times. 
+    class shared_transaction {
+        struct shared {
+            transaction Transaction;
+            bytes Serialized;
+            txid ID;
+        };
+        
+        ptr<const shared> Shared;
+        
+        explicit shared_transaction (ptr<const shared> x) : Shared {x} {}
+        
+    public:
+        shared_transaction ();
+        explicit shared_transaction (const transaction &);
+        explicit shared_transaction (bytes_view);
+        
+        const transaction &operator * () const {
+            return Shared->Transaction;
+        }
+        
+        const transaction *operator -> () const {
+            return &Shared->Transaction;
+        }
+        
+        bytes_view serialized () const {
+            return Shared->Serialized;
+        }
+        
+        uint64 serialized_size () const {
+            return Shared->Serialized.size ();
+        }
+        
+        const txid &id () const {
+            return Shared->ID;
+        }
+        
+        bool valid () const {
+            return Shared->Transaction.valid ();
+        }
+    };
+    
+    bool inline operator == (const shared_transaction &a, const shared_transaction &b) {
+        return a.serialized () == b.serialized ();
+    }
+    
+    digest256 inline merkle_root (const list<shared_transaction> t) {
+        return Merkle::root (data::for_each ([] (const shared_transaction &x) -> digest256 {
+            return x.id ();
+        }, t));
+    }
+    
     struct block {
         static inline bool valid (bytes_view b) {
             return block {b}.valid ();
@@ -254,11 +340,8 @@ namespace Gigamonkey::Bitcoin {
         static const slice<80> header (bytes_view);
         static std::vector<bytes_view> transactions (bytes_view);
         
-        static digest256 inline merkle_root (bytes_view b) {
-            list<txid> ids {};
-            for (bytes_view x : transactions (b)) ids = ids << Hash256 (x);
-            return Merkle::root (ids);
-        }
+        static digest256 merkle_root (bytes_view b);
+        static digest256 merkle_root (bytes_view b, executor &);
         
         Bitcoin::header Header;
         list<transaction> Transactions;
@@ -390,9 +473,6 @@ namespace Gigamonkey::Bitcoin {
         return digest256 (x.range<36, 68> ());
     }
     
-    digest256 inline header::hash (const slice<80> h) {
-        return Bitcoin::Hash256 (h);
-    }
         
     txid inline transaction::id () const {
         return Bitcoin::id (*this);
@@ -443,5 +523,11 @@ namespace Gigamonkey::Bitcoin {
     }
 }
 
+template <> struct std::hash<Gigamonkey::Bitcoin::outpoint> {
+    size_t operator () (const Gigamonkey::Bitcoin::outpoint &o) const {
+        return std::hash<Gigamonkey::digest256> {} (o.Digest) ^ (static_cast<size_t> (Gigamonkey::uint32 (o.Index)) * 0x9e3779b97f4a7c15);
+    }
+};
+
 #endif
 
@@ -0,0 +1,255 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_TRACE
+#define GIGAMONKEY_TRACE
+
+#include <gigamonkey/types.hpp>
+
+#include <vector>
+
+// Spans for following one request through the stages of a pipeline, such as
+// a Stratum share from the queue through the proof of work check to the
+// response, with the trace and span ids of OpenTelemetry, so that they can
+// be sent to anything that reads OTLP. Spans are only made if the library is
+// built with GIGAMONKEY_TRACING, in which case GIGAMONKEY_ENABLE_TRACING is
+// defined. Otherwise there is nothing in them and collect returns nothing.
+//
+// A new trace is sampled at the sample rate, and nothing is recorded for
+// the spans of a trace that is not. Each thread writes the spans that end on
+// it into a buffer of its own without taking a lock. If the buffer is full
+// because collect has not been called in a while, the span is dropped.
+//
+// The span that a thread is in is the parent of spans that begin on it, and
+// tasks that are submitted to an executor are in the span that submitted them.
+namespace Gigamonkey::trace {
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+    
+    // a span within a trace.
+    struct context {
+        byte_array<16> Trace {};
+        uint64 Span {0};
+        bool Sampled {false};
+        
+        bool valid () const {
+            return Span != 0;
+        }
+        
+        // the W3C traceparent header, such as 00-<trace id>-<span id>-01.
+        std::string traceparent () const;
+        
+        // invalid if the header is not valid.
+        static context read_traceparent (string_view);
+    };
+    
+    // a span that has ended.
+    struct record {
+        byte_array<16> Trace;
+        uint64 Span;
+        
+        // 0 for the first span of a trace.
+        uint64 Parent;
+        
+        // names are not copied, so they must last as long as the program.
+        const char *Name;
+        
+        // nanoseconds since the epoch.
+        uint64 Start;
+        uint64 End;
+    };
+    
+    // nanoseconds since the epoch.
+    uint64 now ();
+    
+    // between 0 and 1. Nothing is sampled at first.
+    void set_sample_rate (double);
+    
+    // every span that has ended since the last time.
+    std::vector<record> collect ();
+    
+    // spans that were lost because a buffer was full.
+    uint64 dropped ();
+    
+    // the records in OTLP/JSON, which an OpenTelemetry collector accepts at /v1/traces.
+    JSON OTLP (const std::vector<record> &, const std::string &service = "gigamonkey");
+    
+    namespace detail {
+        context current ();
+        void set_current (const context &);
+        
+        // a child of the parent, or a new trace if the parent is not valid.
+        context begin (const context &parent);
+        void end (const context &, uint64 parent, const char *name, uint64 start, uint64 end);
+    }
+    
+    // the span that this thread is in, if any.
+    context inline current () {
+        if constexpr (enabled) return detail::current ();
+        else return context {};
+    }
+    
+    // record a span that was timed already, such as the time that something waited in a queue.
+    void inline record_span (const char *name, const context &parent, uint64 start, uint64 end) {
+        if constexpr (enabled) if (parent.Sampled) detail::end (detail::begin (parent), parent.Span, name, start, end);
+    }
+    
+    // A span for a scope, which the thread is in until it ends. If a parent is
+    // given and is not valid, the span begins a new trace. Otherwise it is a
+    // child of the current span and nothing is done if there is none, so that
+    // code that runs very often can have a span that costs nothing unless it
+    // is part of a trace.
+    struct span {
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+        explicit span (const char *name) : Name {name}, Previous {detail::current ()}, Context {}, Parent {0}, Start {0} {
+            if (Previous.valid ()) begin (Previous);
+        }
+        
+        span (const char *name, const trace::context &parent) :
+            Name {name}, Previous {detail::current ()}, Context {}, Parent {0}, Start {0} {
+            begin (parent);
+        }
+        
+        ~span () {
+            if (!Context.valid ()) return;
+            if (Context.Sampled) detail::end (Context, Parent, Name, Start, now ());
+            detail::set_current (Previous);
+        }
+        
+        trace::context context () const {
+            return Context;
+        }
+#else
+        explicit span (const char *) {}
+        span (const char *, const trace::context &) {}
+        
+        trace::context context () const {
+            return {};
+        }
+#endif
+        
+        span (const span &) = delete;
+        span &operator = (const span &) = delete;
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+    private:
+        const char *Name;
+        trace::context Previous;
+        trace::context Context;
+        uint64 Parent;
+        uint64 Start;
+        
+        void begin (const trace::context &parent) {
+            Parent = parent.Span;
+            Context = detail::begin (parent);
+            if (Context.Sampled) Start = now ();
+            detail::set_current (Context);
+        }
+#endif
+    };
+    
+    // A span that is not tied to a scope or a thread, such as one for a request
+    // that goes through a queue. It ends when end is called or when it is
+    // destroyed, on whatever thread that happens. It begins a new trace if the
+    // parent is not valid.
+    struct async_span {
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+        async_span () : Name {nullptr}, Context {}, Parent {0}, Start {0} {}
+        
+        async_span (const char *name, const trace::context &parent) :
+            Name {name}, Context {detail::begin (parent)}, Parent {parent.Span}, Start {Context.Sampled ? now () : 0} {}
+        
+        async_span (async_span &&x) : Name {x.Name}, Context {x.Context}, Parent {x.Parent}, Start {x.Start} {
+            x.Context = {};
+        }
+        
+        async_span &operator = (async_span &&x) {
+            end ();
+            Name = x.Name;
+            Context = x.Context;
+            Parent = x.Parent;
+            Start = x.Start;
+            x.Context = {};
+            return *this;
+        }
+        
+        void end () {
+            if (Context.Sampled) detail::end (Context, Parent, Name, Start, now ());
+            Context = {};
+        }
+        
+        trace::context context () const {
+            return Context;
+        }
+        
+        uint64 start () const {
+            return Start;
+        }
+#else
+        async_span () {}
+        async_span (const char *, const trace::context &) {}
+        async_span (async_span &&) {}
+        async_span &operator = (async_span &&) {
+            return *this;
+        }
+        
+        void end () {}
+        
+        trace::context context () const {
+            return {};
+        }
+        
+        uint64 start () const {
+            return 0;
+        }
+#endif
+        
+        ~async_span () {
+            end ();
+        }
+        
+        async_span (const async_span &) = delete;
+        async_span &operator = (const async_span &) = delete;
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+    private:
+        const char *Name;
+        trace::context Context;
+        uint64 Parent;
+        uint64 Start;
+#endif
+    };
+    
+    // be in the given span for a scope, such as in a task that carries on a trace.
+    struct scope {
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+        explicit scope (const context &c) : Previous {detail::current ()} {
+            detail::set_current (c);
+        }
+        
+        ~scope () {
+            detail::set_current (Previous);
+        }
+#else
+        explicit scope (const context &) {}
+#endif
+        
+        scope (const scope &) = delete;
+        scope &operator = (const scope &) = delete;
+
+#ifdef GIGAMONKEY_ENABLE_TRACING
+    private:
+        context Previous;
+#endif
+    };
+    
+}
+
+#endif
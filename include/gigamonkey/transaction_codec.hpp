@@ -0,0 +1,56 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_TRANSACTION_CODEC
+#define GIGAMONKEY_TRANSACTION_CODEC
+
+#include <gigamonkey/view.hpp>
+
+#include <vector>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // A smaller encoding of a transaction for archives that decodes to
+    // exactly the bytes that it was made from. Numbers are var ints, sequence
+    // numbers are counted down from 0xffffffff, so that the usual ones take
+    // one byte, and a previous transaction may be referred to by its place
+    // in a table rather than by its txid, such as when it is earlier in the same
+    // block. Scripts that match a standard template, such as pay to address
+    // and its unlocking script, are stored as the number of the template and
+    // the data that it was matched with.
+    //
+    // A transaction that would not serialize back to the same bytes, such as
+    // one with var ints that are longer than they need to be, is stored as it is.
+    struct transaction_codec {
+        
+        // txids that can be referred to by position.
+        struct table {
+            std::vector<txid> Txids;
+            hash_map<txid, uint32> Index;
+            
+            table () : Txids {}, Index {} {}
+            
+            // add a txid at the end, if it is not there already.
+            void insert (const txid &);
+            
+            // the position of the txid, or -1.
+            int64 find (const txid &) const;
+            
+            size_t size () const {
+                return Txids.size ();
+            }
+        };
+        
+        static bytes encode (bytes_view tx, const table & = table {});
+        
+        // nothing if the encoding is broken or refers to a position that is not in the table.
+        static maybe<bytes> decode (bytes_view, const table & = table {});
+        
+        // encode every transaction in a block, each with a table of the transactions before it.
+        static std::vector<bytes> encode (const block_view &);
+        static maybe<std::vector<bytes>> decode (const std::vector<bytes> &block);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_TXID_INDEX
+#define GIGAMONKEY_TXID_INDEX
+
+#include <gigamonkey/ledger.hpp>
+
+#include <functional>
+#include <string>
+
+namespace Gigamonkey {
+    
+    // Where every transaction is, in a memory-mapped file. The file has an
+    // open-addressing table of slots, each with the first 8 bytes of a txid
+    // and the number of a record, and then the records themselves in the
+    // order in which they were inserted. A lookup compares the 8 byte
+    // prefixes and only reads a record where they match, to check the whole txid.
+    //
+    // The file is made with room for a given number of transactions and never
+    // grows, so that it is never mapped again. That way, any number of threads
+    // can look up transactions without a lock while one thread inserts.
+    struct txid_index {
+        struct position {
+            // the hash of the block that the transaction is in.
+            digest256 Block;
+            
+            // where the transaction is in the serialized block.
+            uint64 Offset;
+            uint32 Length;
+            
+            // the index of the transaction in the block.
+            uint32 Index;
+        };
+        
+        // open the index at path or make a new one with room for capacity transactions.
+        // throws std::invalid_argument if the file is not an index and std::runtime_error
+        // if it cannot be opened or mapped.
+        txid_index (const std::string &path, uint64 capacity);
+        ~txid_index ();
+        
+        txid_index (const txid_index &) = delete;
+        txid_index &operator = (const txid_index &) = delete;
+        
+        // safe to call while another thread inserts.
+        maybe<position> operator [] (const Bitcoin::txid &) const;
+        
+        // Only one thread may insert at a time. Returns false if the txid is
+        // already in the index, as two transactions in the early chain are.
+        // throws std::length_error if the index is full.
+        bool insert (const Bitcoin::txid &, const position &);
+        
+        uint64 size () const;
+        
+        uint64 capacity () const {
+            return Capacity;
+        }
+        
+        // write everything that has been inserted to the disk.
+        void sync () const;
+        
+        // Read a block with block_reader and insert every transaction in it.
+        // Use one loader for each block.
+        struct loader final : Bitcoin::block_reader {
+            txid_index &Index;
+            
+            explicit loader (txid_index &x, size_t max_part_size = 1 << 30) :
+                Bitcoin::block_reader {max_part_size}, Index {x}, Block {}, Offset {0}, Next {0}, Inserted {0} {}
+            
+            void receive_header (const Bitcoin::header &h, uint64 transactions) override;
+            void receive_transaction (const Bitcoin::transaction_view &) override;
+            
+            // transactions that were not already in the index.
+            uint64 inserted () const {
+                return Inserted;
+            }
+        
+        private:
+            digest256 Block;
+            uint64 Offset;
+            uint32 Next;
+            uint64 Inserted;
+        };
+    
+    private:
+        int Descriptor;
+        byte *Map;
+        
+        // the number of slots, which is a power of two.
+        uint64 Slots;
+        
+        // the number of records.
+        uint64 Capacity;
+        
+        byte *slot (uint64 i) const;
+        byte *record (uint64 i) const;
+        
+        void close ();
+    };
+    
+    // A ledger that answers from local data. Headers come from a store,
+    // transactions are found with a txid_index, and blocks are read by a
+    // function, for example from a block archive, given the hash of the block.
+    struct indexed_ledger final : ledger {
+        using block_source = std::function<bytes (const digest256 &)>;
+        
+        indexed_ledger (const Gigamonkey::headers &h, const txid_index &x, block_source b) :
+            Headers {h}, Index {x}, Blocks {b} {}
+        
+        list<block_header> headers (uint64 since_height) override;
+        
+        // nothing if the transaction is not in the index, its block cannot be read,
+        // or it is not where the index says it is.
+        data::entry<bytes, confirmation> transaction (const Bitcoin::txid &) const override;
+        
+        block_header header (const digest256 &) const override;
+        
+        bytes block (const digest256 &) const override;
+        
+        // the same proof as in the confirmation, which is what headers::proof
+        // would give for a store that kept every proof.
+        Merkle::proof proof (const Bitcoin::txid &) const;
+    
+    private:
+        const Gigamonkey::headers &Headers;
+        const txid_index &Index;
+        block_source Blocks;
+    };
+    
+}
+
+#endif
@@ -7,6 +7,8 @@
 #include <string>
 #include <string_view>
 #include <array>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <nlohmann/json.hpp>
 
@@ -37,6 +39,10 @@ namespace Gigamonkey {
     
     using script = bytes;
     
+    // for indices that are looked up often and do not need to be persistent.
+    template <typename K, typename V, typename H = std::hash<K>> using hash_map = std::unordered_map<K, V, H>;
+    template <typename K, typename H = std::hash<K>> using hash_set = std::unordered_set<K, H>;
+    
     using nonce = uint32_little;
     
     enum chain : byte {test, main};
@@ -0,0 +1,105 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_UTXO
+#define GIGAMONKEY_UTXO
+
+#include <gigamonkey/timechain.hpp>
+#include <gigamonkey/memory.hpp>
+#include <gigamonkey/script/script_store.hpp>
+
+#include <shared_mutex>
+#include <vector>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // A set of unspent outputs in memory, in an open-addressing table keyed by
+    // outpoint. Outputs are stored compactly: the value as a var_int and
+    // pay-to-address and pay-to-pubkey scripts as only their hash or key.
+    // Lookups may run on many threads at once, but they wait while a block is
+    // being applied or undone.
+    //
+    // Other scripts may be kept in a script_store, so that outputs with the
+    // same script, which are very common, share one copy of it.
+    struct utxo_set {
+        
+        // what a block did to the set, so that it can be undone.
+        struct block_undo {
+            // spent outputs in their compact encoding.
+            std::vector<std::pair<outpoint, bytes>> Spent;
+            std::vector<outpoint> Created;
+        };
+        
+        explicit utxo_set (size_t capacity = 1024);
+        
+        // scripts that are not stored compactly are interned in the store, which must outlive the set.
+        utxo_set (size_t capacity, script_store &);
+        ~utxo_set ();
+        
+        size_t size () const;
+        
+        bool contains (const outpoint &) const;
+        
+        // the output, or nothing if it is not in the set.
+        maybe<output> operator [] (const outpoint &) const;
+        
+        // returns false if the outpoint is already in the set.
+        bool insert (const outpoint &, const output &);
+        
+        // returns false if the outpoint is not in the set.
+        bool remove (const outpoint &);
+        
+        // spend every output that the block spends and add every output that
+        // it creates, except those that can never be spent. If any output that
+        // is spent is missing, the set is left unchanged and false is returned.
+        bool apply (const block &, block_undo &);
+        
+        void undo (const block_undo &);
+        
+        // scripts that are interned are counted by the store.
+        memory_report memory_usage () const;
+        
+        // every output in the set in its compact encoding, copied all at once.
+        std::vector<std::pair<outpoint, bytes>> entries () const;
+        
+        // the compact encoding of an output.
+        static bytes encode (const output &);
+        static output decode (bytes_view);
+    
+    private:
+        struct slot {
+            bool Used;
+            outpoint Key;
+            bytes Value;
+        };
+        
+        uint64 Salt;
+        size_t Size;
+        
+        // the bytes of the encodings in the table.
+        uint64 Stored;
+        
+        std::vector<slot> Slots;
+        script_store *Scripts;
+        
+        mutable std::shared_mutex Mutex;
+        
+        size_t home (const outpoint &) const;
+        
+        // the slot with this key or the empty slot where it would go.
+        size_t find (const outpoint &) const;
+        
+        // the encodings that are in the table may refer to a script in the store
+        // in place of the script. Encodings that are given or returned do not.
+        bool insert_encoded (const outpoint &, bytes);
+        bool remove_encoded (const outpoint &, bytes *);
+        
+        bytes intern (bytes) const;
+        bytes expand (bytes_view) const;
+        void release (bytes_view) const;
+        void grow ();
+    };
+    
+}
+
+#endif
@@ -0,0 +1,102 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_UTXO_SNAPSHOT
+#define GIGAMONKEY_UTXO_SNAPSHOT
+
+#include <gigamonkey/utxo.hpp>
+#include <gigamonkey/spv.hpp>
+#include <gigamonkey/executor.hpp>
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+
+namespace Gigamonkey::Bitcoin {
+    
+    // A utxo set in a file, so that a node can start with one rather than
+    // replaying the chain. It says which header the set is for, by height and
+    // hash. Outputs are sorted by outpoint, with outputs of the same
+    // transaction after a single txid, and are stored as utxo_set::encode
+    // stores them.
+    //
+    // Outputs are kept in chunks, each of which has a hash in the table of
+    // chunks, and the table has a hash in the prefix of the file. The table is
+    // checked when the file is opened and the chunks are checked as it is
+    // used, so that outputs can be looked up in the file before every chunk
+    // has been checked.
+    struct utxo_snapshot {
+        constexpr static uint32 version = 1;
+        
+        struct options {
+            // outputs in each chunk.
+            uint32 ChunkOutputs {4096};
+            
+            options () {}
+        };
+        
+        // Write the set as it is now, with the header that it is for. The outputs
+        // are copied out of the set at once and then sorted and encoded on
+        // different threads if there is an executor. The file is written beside
+        // the path and moved over it. Throws std::runtime_error if it cannot be written.
+        static void write (const std::filesystem::path &, const utxo_set &, const headers::header &tip,
+            const options & = options {}, executor * = nullptr);
+        
+        // Throws std::invalid_argument if the file is not a snapshot of a version
+        // that we can read or its table of chunks is wrong, and std::runtime_error
+        // if it cannot be opened.
+        explicit utxo_snapshot (const std::filesystem::path &);
+        ~utxo_snapshot ();
+        
+        utxo_snapshot (const utxo_snapshot &) = delete;
+        utxo_snapshot &operator = (const utxo_snapshot &) = delete;
+        
+        uint64 height () const;
+        digest256 tip () const;
+        
+        // whether the store has the header that the set is for.
+        bool check (const headers &) const;
+        
+        uint64 size () const;
+        uint64 chunks () const;
+        
+        // Check the next chunks that have not been checked, up to the given number.
+        // Returns false if one of them is wrong; it and the rest stay unchecked.
+        // Safe to call on one thread while outputs are looked up on others.
+        bool verify (uint64 count = -1);
+        
+        // how many chunks, from the start, have been checked.
+        uint64 verified () const;
+        
+        bool complete () const {
+            return verified () == chunks ();
+        }
+        
+        // the output, or nothing if it is not in the snapshot or is in a chunk
+        // that cannot be read. The chunk is not checked.
+        maybe<output> operator [] (const outpoint &) const;
+        
+        // Check every chunk and put every output into the set. Returns false,
+        // and leaves the set as it is, if a chunk is wrong.
+        bool load (utxo_set &, executor * = nullptr);
+    
+    private:
+        std::filesystem::path Path;
+        int Descriptor;
+        const byte *Map;
+        size_t Size;
+        
+        uint64 Chunks;
+        std::atomic<uint64> Verified;
+        std::mutex Verifying;
+        
+        const byte *chunk_record (uint64 index) const;
+        
+        // the data of a chunk, or nothing if it goes past the end of the file.
+        maybe<bytes_view> chunk (uint64 index) const;
+        bool check_chunk (uint64 index) const;
+    };
+    
+}
+
+#endif
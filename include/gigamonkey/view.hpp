@@ -0,0 +1,240 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_VIEW
+#define GIGAMONKEY_VIEW
+
+#include <gigamonkey/incomplete.hpp>
+#include <gigamonkey/executor.hpp>
+
+#include <vector>
+
+// views read serialized transactions and blocks in place. The offsets of
+// the parts are found once and nothing else is copied, so the data being
+// viewed must outlive the view.
+namespace Gigamonkey::Bitcoin {
+    
+    struct output_view {
+        bytes_view Data;
+        
+        satoshi value () const {
+            return output::value (Data);
+        }
+        
+        bytes_view script () const {
+            return output::script (Data);
+        }
+        
+        explicit operator output () const {
+            return output {Data};
+        }
+    };
+    
+    struct input_view {
+        bytes_view Data;
+        
+        outpoint reference () const;
+        bytes_view script () const;
+        uint32_little sequence () const;
+        
+        explicit operator input () const {
+            return input {reference (), script (), sequence ()};
+        }
+    };
+    
+    class transaction_view {
+        bytes_view Data;
+        
+        // offsets of every input and output, with an extra one for the end.
+        std::vector<uint32> Inputs;
+        std::vector<uint32> Outputs;
+        
+        mutable maybe<txid> ID;
+        
+        // read a transaction from the front of r, which ends at end.
+        bool scan (bytes_reader &r, const byte *end);
+        
+        friend class block_view;
+    
+    public:
+        transaction_view () : Data {}, Inputs {}, Outputs {}, ID {} {}
+        explicit transaction_view (bytes_view);
+        
+        // read a transaction from the front of r in place, or
+        // return an invalid view if there isn't a whole one.
+        static transaction_view read (bytes_reader &r);
+        
+        // true if the data could be read as a transaction with
+        // nothing left over and with at least one input and output.
+        bool valid () const {
+            return Inputs.size () > 1 && Outputs.size () > 1;
+        }
+        
+        bytes_view serialized () const {
+            return Data;
+        }
+        
+        uint64 serialized_size () const {
+            return Data.size ();
+        }
+        
+        int32_little version () const;
+        uint32_little locktime () const;
+        
+        size_t input_count () const {
+            return Inputs.empty () ? 0 : Inputs.size () - 1;
+        }
+        
+        size_t output_count () const {
+            return Outputs.empty () ? 0 : Outputs.size () - 1;
+        }
+        
+        // throws std::invalid_argument if i is out of range.
+        input_view input (size_t i) const;
+        output_view output (size_t i) const;
+        
+        // the hash is computed the first time this is called, so
+        // don't call it on the same view from different threads.
+        txid id () const;
+        
+        explicit operator transaction () const {
+            return transaction {Data};
+        }
+        
+        explicit operator incomplete::transaction () const;
+    };
+    
+    class block_view {
+        bytes_view Data;
+        std::vector<transaction_view> Transactions;
+    
+    public:
+        block_view () : Data {}, Transactions {} {}
+        explicit block_view (bytes_view);
+        
+        // the transactions could all be read and there is nothing left over.
+        bool valid () const {
+            return Data.size () >= 80 && !Transactions.empty ();
+        }
+        
+        bytes_view serialized () const {
+            return Data;
+        }
+        
+        Bitcoin::header header () const;
+        
+        size_t size () const {
+            return Transactions.size ();
+        }
+        
+        const transaction_view &operator [] (size_t i) const {
+            return Transactions[i];
+        }
+        
+        std::vector<transaction_view>::const_iterator begin () const {
+            return Transactions.begin ();
+        }
+        
+        std::vector<transaction_view>::const_iterator end () const {
+            return Transactions.end ();
+        }
+        
+        digest256 merkle_root () const;
+        
+        // hash the transactions and build the tree on the threads of e.
+        digest256 merkle_root (executor &) const;
+    };
+    
+    digest256 inline merkle_root (const block_view &b) {
+        return b.merkle_root ();
+    }
+    
+    // Finds the end of a transaction that is written a piece at a time. Our
+    // place in the transaction is kept so that a big one is not read again
+    // from the beginning every time more of it is written.
+    class transaction_scanner {
+    public:
+        // no count or script may be bigger than would fit in max_size.
+        explicit transaction_scanner (size_t max_size = 1 << 30) :
+            MaxSize {max_size}, Part {part::version}, Remaining {0}, Offset {0}, Failed {false} {}
+        
+        // the size of the transaction at the front of b if it is complete, or 0. b
+        // must begin with everything that was given before since the last reset.
+        size_t next (bytes_view b);
+        
+        // the bytes cannot be a transaction.
+        bool failed () const {
+            return Failed;
+        }
+        
+        // start looking for the next transaction.
+        void reset () {
+            Part = part::version;
+            Offset = 0;
+        }
+        
+    private:
+        enum class part : byte {version, input_count, inputs, output_count, outputs, locktime};
+        
+        size_t MaxSize;
+        part Part;
+        uint64 Remaining;
+        size_t Offset;
+        bool Failed;
+    };
+    
+    // Read a block a piece at a time, as it comes from a socket or a file.
+    // The header and each transaction are given to the receive functions as
+    // soon as they are complete, and only the part being read is kept, so
+    // memory use depends on the largest transaction and not on the block.
+    class block_reader {
+    public:
+        // the view given to receive_transaction is only good until it returns.
+        virtual void receive_header (const Bitcoin::header &, uint64 transactions) = 0;
+        virtual void receive_transaction (const transaction_view &) = 0;
+        
+        // no part of the block may be bigger than max_part_size.
+        explicit block_reader (size_t max_part_size = 1 << 30);
+        virtual ~block_reader () {}
+        
+        // returns false if the bytes read so far cannot be a block,
+        // after which everything written is ignored.
+        bool write (bytes_view);
+        
+        // every transaction has been read.
+        bool complete () const {
+            return Stage == stage::complete;
+        }
+        
+        bool failed () const {
+            return Stage == stage::failed;
+        }
+        
+        uint64 transactions_read () const {
+            return Read;
+        }
+        
+    private:
+        enum class stage : byte {header, transactions, complete, failed};
+        
+        size_t MaxPartSize;
+        stage Stage;
+        uint64 Count;
+        uint64 Read;
+        
+        // where we are in the transaction being read.
+        transaction_scanner Scanner;
+        
+        // the beginning of a part that has not been completely written.
+        bytes Buffer;
+        
+        // read as many parts from the front as we can and return how much was read.
+        size_t consume (bytes_view);
+        
+        // the size of the part at the front if it is complete, or 0.
+        size_t next (bytes_view);
+    };
+    
+}
+
+#endif
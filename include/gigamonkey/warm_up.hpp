@@ -0,0 +1,34 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WARM_UP
+#define GIGAMONKEY_WARM_UP
+
+#include <gigamonkey/types.hpp>
+
+#include <chrono>
+#include <vector>
+
+namespace Gigamonkey {
+    
+    // how long each part of the library took to get ready.
+    struct warm_up_report {
+        std::vector<std::pair<const char *, std::chrono::nanoseconds>> Components;
+        
+        std::chrono::nanoseconds total () const;
+        
+        // the time of each part in nanoseconds.
+        explicit operator JSON () const;
+    };
+    
+    // Some of the library is made ready the first time it is used: the
+    // secp256k1 contexts, the random number generator, the choice of sha256
+    // and hex code for this cpu, the limits of the script interpreter and the
+    // table of op code names for ASM. Call warm_up at startup so that no request
+    // has to wait for that. Tables that could be, such as the BIP 39 words and
+    // the descriptions of script errors, are compiled in and need nothing.
+    warm_up_report warm_up ();
+    
+}
+
+#endif
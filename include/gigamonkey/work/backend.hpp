@@ -0,0 +1,57 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WORK_BACKEND
+#define GIGAMONKEY_WORK_BACKEND
+
+#include <gigamonkey/sha256.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace Gigamonkey::work {
+    
+    // Something that hashes headers, such as a gpu. It is given the SHA-256
+    // state after the first 64 bytes of a header and the last 16 bytes, of
+    // which the last 4 are the nonce and are ignored.
+    //
+    // The solvers check every candidate on the cpu before it is passed to
+    // evaluator::solved, so a backend may return nonces that are not below
+    // the target, for example by comparing only part of the hash.
+    struct backend {
+        
+        // nonces in [begin, begin + count) whose hashes may be below target.
+        // Called by several threads at once.
+        virtual std::vector<uint32> search (const sha256::state &midstate,
+            const byte_array<16> &tail, uint32 begin, uint32 count, const uint256 &target) = 0;
+        
+        // how many nonces to give search at once. Workers check whether
+        // they have been told to stop between calls.
+        virtual uint32 batch () const = 0;
+        
+        virtual ~backend () {}
+    };
+    
+    // hashes on the cpu with sha256::double_hash_80.
+    struct cpu_backend final : backend {
+        std::vector<uint32> search (const sha256::state &, const byte_array<16> &, uint32 begin, uint32 count, const uint256 &) override;
+        
+        uint32 batch () const override {
+            return 64;
+        }
+    };
+    
+    using backend_factory = std::function<ptr<backend> ()>;
+    
+    // Backends are made by name so that a plugin can register one when it is
+    // loaded. "cpu" is always registered. Registering a name again replaces it.
+    void register_backend (const string &name, backend_factory);
+    
+    // throws std::invalid_argument if nothing by this name has been registered.
+    ptr<backend> make_backend (const string &name);
+    
+    std::vector<string> backends ();
+    
+}
+
+#endif
@@ -0,0 +1,69 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WORK_CALIBRATE
+#define GIGAMONKEY_WORK_CALIBRATE
+
+#include <gigamonkey/work/backend.hpp>
+
+#include <filesystem>
+
+namespace Gigamonkey::work {
+    
+    // The fastest way that we have found to solve puzzles on this machine:
+    // the backend, how many nonces to give it at once and how many threads.
+    struct calibration {
+        string Backend;
+        uint32 Batch;
+        uint32 Threads;
+        double HashesPerSecond;
+        
+        double hashes_per_second_per_core () const {
+            return Threads == 0 ? 0 : HashesPerSecond / Threads;
+        }
+        
+        // the backend, which is given Batch nonces at once. To be used
+        // with Threads threads, as in cpu_solver {Threads, initial, false, make ()}.
+        // Throws std::invalid_argument if the backend is not registered.
+        ptr<backend> make () const;
+        
+        explicit operator JSON () const;
+        
+        // nothing if the JSON is not a calibration.
+        static maybe<calibration> read (const JSON &);
+        
+        bool operator == (const calibration &) const = default;
+    };
+    
+    struct calibration_options {
+        // about how long all the trials together take.
+        double Seconds {.5};
+        
+        // the backends to try. All that are registered if empty.
+        std::vector<string> Backends {};
+        
+        // the most threads to try. The number of cores if zero.
+        uint32 MaxThreads {0};
+        
+        calibration_options () {};
+    };
+    
+    // hashes per second with a backend given batch nonces at once from each of some threads.
+    double trial (backend &, uint32 batch, uint32 threads, double seconds);
+    
+    // Run short trials of every backend with a few batch sizes and numbers
+    // of threads and return the fastest. Backends that throw are skipped.
+    // Throws std::invalid_argument if there is nothing to try.
+    calibration calibrate (const calibration_options & = calibration_options {});
+    
+    // The calibration for this cpu and these backends from the cache, or if
+    // there is none, a new one, which is written to the cache. Nothing is
+    // written if the cache cannot be written.
+    calibration calibrate (const std::filesystem::path &cache, const calibration_options & = calibration_options {});
+    
+    // the model name of the cpu, or "unknown".
+    string cpu_model ();
+    
+}
+
+#endif
@@ -0,0 +1,115 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WORK_DAA
+#define GIGAMONKEY_WORK_DAA
+
+#include <gigamonkey/timechain.hpp>
+
+namespace Gigamonkey::work {
+    
+    // The target that each header must have under the rules that BSV and BCH
+    // share: the original retarget every 2016 blocks, then the emergency
+    // difficulty adjustment after the fork of August 2017 and then, from
+    // November 2017, the DAA over the previous 144 blocks.
+    //
+    // Headers are pushed in order from genesis and popped when they are rolled
+    // back. The timestamps, targets and total work of recent headers are kept in
+    // a ring, so that the expected target of any height in it takes a fixed
+    // number of steps no matter how long the chain is.
+    struct daa {
+        struct options {
+            // the emergency adjustment applies to headers after this height,
+            // which is the fork of August 2017.
+            uint64 UAHFHeight {478558};
+            
+            // the DAA applies to headers after this height.
+            uint64 DAAHeight {504031};
+            
+            // the greatest target.
+            compact Limit {0x1d00ffff};
+            
+            // seconds.
+            uint32 TargetSpacing {600};
+            
+            // blocks between retargets before the DAA.
+            uint32 Interval {2016};
+            
+            // blocks whose work and time are measured by the DAA.
+            uint32 Window {144};
+            
+            // how many headers can be rolled back.
+            uint32 MaxRollback {1000};
+            
+            options () {};
+        };
+        
+        const options Options;
+        
+        // throws std::invalid_argument if Interval or Window is zero or Limit is not valid.
+        explicit daa (const options & = options {});
+        
+        // the header following the last one pushed, which is expected to be valid.
+        void push (const Bitcoin::header &);
+        
+        // roll back the last header. False if there is none, or if it is too
+        // old to be remembered.
+        bool pop ();
+        
+        // the number of headers that have been pushed, which is the height of the next one.
+        uint64 size () const {
+            return Next;
+        }
+        
+        // the total work of every header pushed.
+        chainwork work () const;
+        
+        // The target of the header at this height, which must be no greater than
+        // size (). Nothing if the headers that it depends on are too old to be
+        // remembered or have not been pushed.
+        maybe<compact> expected_target (uint64 height) const;
+        
+        // whether the header has the expected target to be pushed next.
+        bool valid (const Bitcoin::header &h) const {
+            maybe<compact> t = expected_target (Next);
+            return bool (t) && *t == h.Target;
+        }
+    
+    private:
+        struct entry {
+            uint32 Time;
+            uint32 Bits;
+            
+            // the total work of the chain up to this header.
+            chainwork Work;
+        };
+        
+        const exact::target Limit;
+        std::vector<entry> Ring;
+        
+        // headers from Oldest to Next - 1 are in the ring.
+        uint64 Oldest;
+        uint64 Next;
+        
+        bool has (uint64 height) const {
+            return height >= Oldest && height < Next;
+        }
+        
+        const entry &at (uint64 height) const {
+            return Ring[height % Ring.size ()];
+        }
+        
+        // the median of the last 11 timestamps up to this height.
+        uint32 median_time_past (uint64 height) const;
+        
+        // the height of the header whose time is the median of this one and the two before.
+        uint64 suitable (uint64 height) const;
+        
+        uint32 retarget (uint64 height) const;
+        uint32 emergency (uint64 height) const;
+        uint32 cash (uint64 height) const;
+    };
+    
+}
+
+#endif
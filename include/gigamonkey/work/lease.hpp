@@ -0,0 +1,122 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WORK_LEASE
+#define GIGAMONKEY_WORK_LEASE
+
+#include <gigamonkey/work/solver.hpp>
+
+#include <deque>
+#include <map>
+
+namespace Gigamonkey::work {
+    
+    // A range of extra nonce 2 given to one solver node, which searches
+    // every version and nonce for each of them. Ranges given out for the
+    // same puzzle do not overlap, so no work is done twice.
+    struct lease {
+        uint64 ID;
+        puzzle Puzzle;
+        
+        // extra nonce 1, the timestamp, the first version bits and the
+        // first extra nonce 2 of the range.
+        solution Initial;
+        
+        // the number of values of extra nonce 2.
+        uint64 Count;
+    };
+    
+    // search a lease on this machine.
+    proof inline solve (const lease &l, uint32 threads, ptr<backend> b = nullptr) {
+        return solve (l.Puzzle, l.Initial, l.Count, threads, b);
+    }
+    
+    // Gives out leases on a puzzle to solver nodes on other machines in place
+    // of searching it here. The leases are sent to the nodes some other way.
+    // Nodes renew their leases while they work on them and a lease that is
+    // not renewed in time is given to another node. Solutions that come
+    // back are checked and passed to evaluator::solved.
+    //
+    // Time is given by the caller in seconds, from any clock.
+    struct lease_coordinator {
+        struct options {
+            // values of extra nonce 2 in each lease.
+            uint64 LeaseSize {16};
+            
+            // a lease that has not been renewed for this long is given away.
+            double TimeoutSeconds {30};
+            
+            options () {};
+        };
+        
+        const options Options;
+        
+        // throws std::invalid_argument if LeaseSize is zero.
+        lease_coordinator (evaluator &, const options & = options {});
+        
+        // Start leasing a new puzzle. Initial is as for cpu_solver. All leases
+        // on the old puzzle end and solutions for them are not accepted.
+        void pose (const puzzle &, const solution &initial);
+        
+        // stop leasing the current puzzle.
+        void stop ();
+        
+        // Ranges of leases that have been given up or have timed out are given
+        // out again first. Nothing if there is no puzzle or no more extra nonce 2.
+        maybe<lease> acquire (const string &node, double now);
+        
+        // false if the lease has ended, in which case the node should stop.
+        bool renew (uint64 id, double now);
+        
+        // the node searched the whole range or is giving it up. If not
+        // searched, the range is given to another node.
+        void release (uint64 id, bool searched = true);
+        
+        // whether the solution is valid for a current lease and its extra
+        // nonce 2 is in the range of that lease. If so, it is passed to
+        // evaluator::solved, which may call pose.
+        bool submit (uint64 id, const solution &);
+        
+        // give up leases that have not been renewed in time. Called by acquire.
+        // Returns the number of leases given up.
+        size_t expire (double now);
+        
+        // leases that are held now.
+        size_t leases () const;
+        
+        // nodes that hold a lease.
+        std::vector<string> nodes () const;
+    
+    private:
+        evaluator &Evaluator;
+        
+        struct range {
+            uint64 Begin;
+            uint64 Count;
+        };
+        
+        struct held {
+            string Node;
+            range Range;
+            double Renewed;
+        };
+        
+        mutable std::mutex Mutex;
+        maybe<puzzle> Puzzle;
+        solution Initial;
+        
+        // ranges are offsets from the extra nonce 2 in Initial.
+        uint64 Next;
+        uint64 Limit;
+        std::deque<range> Returned;
+        
+        // ids are never used twice, so leases for old puzzles are never mistaken for current ones.
+        uint64 NextID;
+        std::map<uint64, held> Leases;
+        
+        size_t expire_locked (double now);
+    };
+    
+}
+
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_WORK_PREPARED_PUZZLE
+#define GIGAMONKEY_WORK_PREPARED_PUZZLE
+
+#include <gigamonkey/work/proof.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <vector>
+
+namespace Gigamonkey::work {
+    
+    // A puzzle with everything that doesn't depend on the solution worked
+    // out ahead of time: the SHA-256 state after every full block of the
+    // coinbase that comes before the extra nonces, the Merkle branch and the
+    // fields of the block header that don't change. Checking a solution only
+    // hashes the rest of the coinbase, the branch and one header.
+    struct prepared_puzzle {
+        puzzle Puzzle;
+        
+        explicit prepared_puzzle (const puzzle &);
+        
+        // with the state after the full blocks of Puzzle.Header already worked
+        // out, as it is kept by coinbase_builder.
+        prepared_puzzle (const puzzle &, const sha256::state &midstate);
+        
+        // these give the same results as the functions of work::proof {Puzzle, x}.
+        digest256 merkle_root (const solution &) const;
+        work::string string (const solution &) const;
+        byte_array<80> header (const solution &) const;
+        uint256 hash (const solution &) const;
+        bool valid (const solution &) const;
+    
+    private:
+        sha256::state Midstate;
+        
+        // the bytes of Puzzle.Header after the last full block and the length of
+        // what Midstate covers.
+        bytes Remainder;
+        size_t Prefix;
+        
+        // the digests of the Merkle path, one after another.
+        std::vector<byte> Branch;
+        
+        // the header with zero for the version, merkle root, timestamp and nonce.
+        byte_array<80> Template;
+        exact::target Target;
+        
+        digest256 coinbase (const solution &) const;
+    };
+    
+}
+
+#endif
@@ -158,9 +158,10 @@ namespace Gigamonkey::work {
         }
     };
     
+    // single-threaded. Returns an invalid proof if the search space is exhausted.
     proof cpu_solve (const puzzle &p, const solution &initial);
     
-    // right now we only have cpu mining in this lib. 
+    // single-threaded on the cpu. For other hardware, see work/backend.hpp.
     proof inline solve (puzzle p, solution initial) {
         return cpu_solve (p, initial);
     }
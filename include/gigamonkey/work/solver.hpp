@@ -5,6 +5,13 @@
 #define GIGAMONKEY_WORK_SOLVER
 
 #include <gigamonkey/work/proof.hpp>
+#include <gigamonkey/work/backend.hpp>
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 namespace Gigamonkey::work {
     
@@ -15,6 +22,9 @@ namespace Gigamonkey::work {
     
     struct solver : virtual evaluator {
         virtual void pose (const puzzle &) = 0;
+        
+        // initial fills in whatever the puzzle does not determine.
+        virtual void pose (const puzzle &, const solution &initial) = 0;
         virtual ~solver () {}
     };
     
@@ -23,6 +33,96 @@ namespace Gigamonkey::work {
         virtual puzzle select () = 0;
         virtual ~selector () {}
     };
+    
+    // Solve a puzzle with several threads, blocking until a solution is found.
+    // initial determines extra nonce 1 and the size of extra nonce 2.
+    // Returns an invalid proof if the search space is exhausted.
+    // Hashing is done by a cpu_backend unless another is given.
+    proof solve (const puzzle &p, const solution &initial, uint32 threads, ptr<backend> = nullptr);
+    
+    // Search only the first extra_nonces values of extra nonce 2 beginning with the
+    // one in initial, with every nonce and version for each of them, as for a lease.
+    proof solve (const puzzle &p, const solution &initial, uint64 extra_nonces, uint32 threads, ptr<backend> = nullptr);
+    
+    // A multithreaded solver that runs on the cpu. For each value of
+    // extra nonce 2, the midstate of the first 64 bytes of the header
+    // is computed once so that only the last 16 bytes are hashed per nonce.
+    // Each worker takes a different extra nonce 2 and searches the whole
+    // nonce range for it. evaluator::solved is called by the worker that
+    // finds the solution and is left to be implemented by a derived type.
+    //
+    // The workers are started with the solver and wait for puzzles. Every
+    // call to pose or stop increments an epoch which the workers check after
+    // each batch of nonces, so work on an old puzzle ends within a batch
+    // and nothing found for it afterwards is passed to solved. pose does not
+    // wait for this and so may be called from solved.
+    struct cpu_solver : virtual solver {
+        
+        // initial determines extra nonce 1, the initial value and size
+        // of extra nonce 2, the timestamp, and the version bits. If continuous,
+        // workers keep searching after a solution is found and solved may be
+        // called by several workers at once. Otherwise the first solution
+        // ends the search. Headers are hashed by the backend, or on the cpu
+        // if none is given. The threads prepare headers for it and check what
+        // it finds.
+        cpu_solver (uint32 threads, const solution &initial, bool continuous = false, ptr<backend> = nullptr);
+        
+        // calls shutdown, and nothing virtual.
+        virtual ~cpu_solver ();
+        
+        // stop working on the current puzzle, if any, and start on this one.
+        void pose (const puzzle &p) override;
+        void pose (const puzzle &p, const solution &initial) override;
+        
+        // stop working on the current puzzle. Unless called from solved,
+        // wait until every worker has let go of it.
+        void stop ();
+        
+        // end every worker and join it. A derived type that implements solved
+        // must call this in its destructor, so that no worker is still in
+        // solved when it is destroyed. Must not be called from solved. Once
+        // this is called, nothing that is posed is worked on.
+        void shutdown ();
+        
+        uint32 threads () const {
+            return Threads;
+        }
+        
+        uint64 epoch () const {
+            return Epoch.load (std::memory_order_relaxed);
+        }
+    
+        // headers hashed since this was made.
+        uint64 hashes () const {
+            return Hashes.load (std::memory_order_relaxed);
+        }
+    
+    private:
+        uint32 Threads;
+        bool Continuous;
+        ptr<backend> Backend;
+        
+        std::mutex Mutex;
+        std::condition_variable Wake;
+        std::condition_variable Idle;
+        maybe<puzzle> Puzzle;
+        solution Initial;
+        bool Shutdown;
+        
+        // the number of workers that are working on a puzzle.
+        uint32 Busy;
+        
+        // only changed with Mutex held.
+        std::atomic<uint64> Epoch;
+        
+        std::atomic<uint64> Hashes;
+        
+        std::vector<std::thread> Workers;
+        
+        void work (uint32 index);
+        void run (const puzzle &p, solution x, uint32 index, uint64 epoch);
+    };
+    
 }
 
 #endif
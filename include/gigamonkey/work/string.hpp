@@ -40,11 +40,11 @@ namespace Gigamonkey::work {
         }
         
         uint256 hash () const {
-            return Bitcoin::Hash256 (write ());
+            return Bitcoin::header::hash (write ()).Value;
         }
         
         static bool valid (const slice<80> x) {
-            return Bitcoin::Hash256 (x).Value < Bitcoin::header::target (x).expand ();
+            return Bitcoin::header::hash (x).Value < Bitcoin::header::target (x).expand ();
         }
         
         bool valid () const;
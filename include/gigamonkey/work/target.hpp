@@ -6,6 +6,10 @@
 
 #include <gigamonkey/hash.hpp>
 #include <gigamonkey/timestamp.hpp>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <compare>
 #include <vector>
 
 namespace Gigamonkey::work {
@@ -49,6 +53,154 @@ namespace Gigamonkey::work {
     
     uint256 expand (const compact&);
     
+    // Conversions between compact, expanded targets and difficulty done
+    // with integers only. Targets are 256-bit numbers stored as four
+    // 64-bit limbs, the least significant first.
+    namespace exact {
+        using target = limbs::number<32>;
+        
+        constexpr bool zero (const target &x) {
+            return (x[0] | x[1] | x[2] | x[3]) == 0;
+        }
+        
+        // byte i of x, where byte 0 is the least significant.
+        constexpr byte digit (const target &x, uint32 i) {
+            return static_cast<byte> (x[i / 8] >> (8 * (i % 8)));
+        }
+        
+        // whether x << bits fits in 256 bits.
+        constexpr bool fits (uint64 x, int32 bits) {
+            return x == 0 || bits + 64 - std::countl_zero (x) <= 256;
+        }
+        
+        // x << bits, which must fit. Negative bits shift right.
+        constexpr target shift (uint64 x, int32 bits) {
+            target t {};
+            if (x == 0) return t;
+            if (bits < 0) {
+                if (bits > -64) t[0] = x >> -bits;
+                return t;
+            }
+            
+            uint32 limb = bits / 64;
+            uint32 offset = bits % 64;
+            t[limb] = x << offset;
+            if (offset != 0 && limb < 3) t[limb + 1] = x >> (64 - offset);
+            return t;
+        }
+        
+        // zero if the compact number is negative or overflows, as with work::expand.
+        constexpr target expand (uint32 compact) {
+            uint32 size = compact >> 24;
+            uint32 word = compact & 0x007fffff;
+            if (size <= 3) word >>= 8 * (3 - size);
+            
+            if (word != 0 && (compact & 0x00800000) != 0) return {};
+            if (word != 0 && (size > 34 || (word > 0xff && size > 33) || (word > 0xffff && size > 32))) return {};
+            
+            return shift (word, size <= 3 ? 0 : 8 * (size - 3));
+        }
+        
+        // the greatest compact number whose expansion is not greater than x.
+        constexpr uint32 compress (const target &x) {
+            uint32 size = 32;
+            while (size > 0 && digit (x, size - 1) == 0) size--;
+            
+            uint32 word = 0;
+            for (uint32 i = 0; i < 3 && i < size; i++) word |= uint32 (digit (x, size - 1 - i)) << (16 - 8 * i);
+            if (size < 3) word >>= 8 * (3 - size);
+            
+            // the top bit of the digits is a sign bit.
+            if (word & 0x00800000) {
+                word >>= 8;
+                size++;
+            }
+            
+            return word | (size << 24);
+        }
+        
+        // whether a hash, given as 32 little endian bytes, is below the target.
+        constexpr bool below (const byte *hash, const target &x) {
+            for (int limb = 3; limb >= 0; limb--) {
+                uint64 h = 0;
+                for (int i = 7; i >= 0; i--) h = (h << 8) | hash[8 * limb + i];
+                if (h != x[limb]) return h < x[limb];
+            }
+            
+            return false;
+        }
+        
+        constexpr bool below (const byte *hash, uint32 compact) {
+            return below (hash, expand (compact));
+        }
+        
+        // difficulty 1 is 0xffff * 2^208.
+        float64 inline difficulty (uint32 compact) {
+            uint32 size = compact >> 24;
+            uint32 word = compact & 0x007fffff;
+            if (size <= 3) word >>= 8 * (3 - size);
+            if (zero (expand (compact))) word = 0;
+            
+            // 0xffff / word is the only step that rounds.
+            return std::ldexp (65535. / float64 (word), 208 - 8 * (int32 (size <= 3 ? 3 : size) - 3));
+        }
+        
+        // the target for a difficulty, with the precision of a float64. 
+        // Nothing if it is greater than 2^256.
+        maybe<target> inline from_difficulty (float64 difficulty) {
+            if (!(difficulty > 0) || !std::isfinite (difficulty)) return {};
+            
+            // difficulty = M * 2^(e - 53) with M an integer of 53 bits.
+            int e;
+            uint64 m = static_cast<uint64> (std::ldexp (std::frexp (difficulty, &e), 53));
+            
+            // 0xffff * 2^208 / difficulty = q * 2^(151 - e)
+            unsigned __int128 q = (static_cast<unsigned __int128> (0xffff) << 110) / m;
+            int32 bits = 151 - e;
+            
+            // round to 53 bits so that a difficulty which was calculated from
+            // a target gives that target back.
+            int32 size = 128 - (uint64 (q >> 64) != 0 ? std::countl_zero (uint64 (q >> 64)) : 64 + std::countl_zero (uint64 (q)));
+            if (size > 53) {
+                int32 drop = size - 53;
+                q = (q + (static_cast<unsigned __int128> (1) << (drop - 1))) >> drop;
+                bits += drop;
+            }
+            
+            if (!fits (static_cast<uint64> (q), bits)) return {};
+            return shift (static_cast<uint64> (q), bits);
+        }
+        
+        // 2^256 / (x + 1), the expected number of hashes to find one that is
+        // not above x, as with GetBlockProof in Bitcoin Core. Zero for zero.
+        constexpr target work (const target &x) {
+            if (zero (x)) return {};
+            
+            target one {1, 0, 0, 0};
+            target d = x;
+            if (limbs::add (d, one)) return one;
+            
+            // 2^256 / d = (2^256 - d) / d + 1 and 2^256 - d is ~x.
+            target q = limbs::divide (target {~x[0], ~x[1], ~x[2], ~x[3]}, d);
+            limbs::add (q, one);
+            return q;
+        }
+        
+        constexpr target work (uint32 compact) {
+            return work (expand (compact));
+        }
+        
+        uint256 inline write (const target &x) {
+            uint256 n {};
+            limbs::store<32> (x, n.data ());
+            return n;
+        }
+        
+        target inline read (const uint256 &n) {
+            return limbs::load<32> (n.data ());
+        }
+    }
+    
     const compact SuccessHalf {33, 0x8000};
     const compact SuccessQuarter {32, 0x400000};
     const compact SuccessEighth {32, 0x200000};
@@ -77,6 +229,48 @@ namespace Gigamonkey::work {
     };
     
     
+    // The expected number of hashes to find a block, which is how chains are
+    // compared. Unlike difficulty, it is kept exactly, so that the work of a
+    // chain is a sum that does not depend on the order it was added up in and
+    // two chains with the same work are equal. Sums are mod 2^256.
+    struct chainwork {
+        exact::target Value;
+        
+        constexpr chainwork () : Value {} {}
+        constexpr explicit chainwork (const exact::target &x) : Value {x} {}
+        
+        // the work of one block with this target. Zero if it is not valid.
+        explicit chainwork (compact c) : Value {exact::work (uint32 (static_cast<uint32_little> (c)))} {}
+        
+        constexpr chainwork operator + (const chainwork &x) const {
+            chainwork y = *this;
+            return y += x;
+        }
+        
+        constexpr chainwork &operator += (const chainwork &x) {
+            limbs::add (Value, x.Value);
+            return *this;
+        }
+        
+        constexpr bool operator == (const chainwork &x) const {
+            return Value == x.Value;
+        }
+        
+        constexpr std::strong_ordering operator <=> (const chainwork &x) const {
+            return limbs::compare (Value, x.Value) <=> 0;
+        }
+        
+        explicit operator uint256 () const {
+            return exact::write (Value);
+        }
+        
+        // as a float64, which is only for display.
+        explicit operator float64 () const {
+            return std::ldexp (float64 (Value[3]), 192) + std::ldexp (float64 (Value[2]), 128) +
+                std::ldexp (float64 (Value[1]), 64) + float64 (Value[0]);
+        }
+    };
+    
     // proportional to hash operations per second. 
     struct difficulty {
         float64 Value;
@@ -266,8 +460,7 @@ namespace Gigamonkey::work {
     }
     
     inline bool compact::valid () const {
-        uint32 compact = *this;
-        return expand () != 0;
+        return !exact::zero (exact::expand (static_cast<uint32_little> (*this)));
     }
     
     inline uint256 compact::expand () const {
@@ -275,9 +468,7 @@ namespace Gigamonkey::work {
     }
     
     inline work::difficulty compact::difficulty () const {
-        return work::difficulty {
-            double (work::difficulty::unit ()) / 
-            double (N (expand ()))};
+        return work::difficulty {exact::difficulty (static_cast<uint32_little> (*this))};
     };
     
     inline compact::operator work::difficulty () const {
@@ -86,7 +86,22 @@ namespace bsv {
 
         using unique_bn_ptr = std::unique_ptr<bignum_st, empty_bn_deleter>;
         static_assert (sizeof (unique_bn_ptr) == sizeof (bignum_st*));
+        
+        // A value that fits in 64 bits is kept in small_ and nothing is
+        // allocated. value_ is used once a result doesn't fit, and is
+        // null exactly when the value is in small_. See Note 2.
+        int64_t small_;
         unique_bn_ptr value_;
+        
+        bool is_small () const { return value_ == nullptr; }
+        
+        // move the value into value_.
+        void promote ();
+        
+        // the value as a bignum. If it is small, tmp holds it.
+        const bignum_st *bn (unique_bn_ptr &tmp) const;
+        
+        static unique_bn_ptr make_bn (int64_t);
     };
     
     void inline swap (bint &a, bint &b) { a.swap (b);}
@@ -198,6 +213,8 @@ namespace std {
 // Notes
 // -----
 // 1. Used to minimise size of the unique_ptr through empty base class optimization. See Effective Modern C++ Item 18
+// 2. Results are identical whichever representation is used. A value that
+//    has been promoted to a bignum is not moved back.
 
 
 
@@ -36,6 +36,20 @@ void RandAddSeedSleep ();
  */
 void GetStrongRandBytes (uint8_t *buf, int num);
 
+/**
+ * Fill a buffer of any size from a ChaCha20 generator that belongs to the
+ * calling thread, so no lock is taken. Each thread's generator is seeded with
+ * GetStrongRandBytes the first time it is used and again after every
+ * THREAD_RAND_RESEED_BYTES bytes or if the process has forked. A new key is
+ * taken from the stream after every call, so that output which has already
+ * been given out cannot be recovered from the state of the generator.
+ */
+void GetThreadRandBytes (uint8_t *buf, size_t num);
+uint64_t GetThreadRand64 ();
+uint256 GetThreadRandHash ();
+
+static const uint64_t THREAD_RAND_RESEED_BYTES = 1 << 24;
+
 /**
  * Fast randomness source. This is seeded once with secure random data, but is
  * completely deterministic and insecure after that.
@@ -3,13 +3,58 @@
 
 #include <gigamonkey/address.hpp>
 #include <gigamonkey/p2p/checksum.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/sha256.hpp>
+#include <gigamonkey/ripemd160.hpp>
+
+#include <stdexcept>
 
 namespace Gigamonkey::Bitcoin {
+    
+    void Hash160_pubkeys (std::span<const byte> compressed, std::span<digest160> out) {
+        constexpr size_t size = secp256k1::pubkey::CompressedSize;
+        if (compressed.size () != out.size () * size) throw std::invalid_argument {"need one digest for each pubkey"};
+        
+        // in batches so that the SHA-256 digests stay in cache between the two hashes.
+        constexpr size_t batch = 64;
+        byte sha[32 * batch];
+        byte ripemd[20 * batch];
+        
+        for (size_t i = 0; i < out.size (); i += batch) {
+            size_t count = std::min (batch, out.size () - i);
+            sha256::hash_short (sha, compressed.data () + i * size, size, count);
+            ripemd160::hash_32 (ripemd, sha, count);
+            for (size_t j = 0; j < count; j++) std::copy (ripemd + 20 * j, ripemd + 20 * (j + 1), out[i + j].begin ());
+        }
+    }
+    
+    void Hash160_pubkeys (std::span<const pubkey> keys, std::span<digest160> out) {
+        if (keys.size () != out.size ()) throw std::invalid_argument {"need one digest for each pubkey"};
+        
+        constexpr size_t size = secp256k1::pubkey::CompressedSize;
+        std::vector<byte> compressed;
+        std::vector<size_t> which;
+        compressed.reserve (keys.size () * size);
+        which.reserve (keys.size ());
+        
+        for (size_t i = 0; i < keys.size (); i++) if (keys[i].size () == size) {
+            compressed.insert (compressed.end (), keys[i].begin (), keys[i].end ());
+            which.push_back (i);
+        } else out[i] = Hash160 (keys[i]);
+        
+        std::vector<digest160> digests (which.size ());
+        Hash160_pubkeys (compressed, digests);
+        for (size_t j = 0; j < which.size (); j++) out[which[j]] = digests[j];
+    }
 
     address address::encode (char prefix, const digest160 &d) {
 
+        byte_array<21> data;
+        data[0] = byte (prefix);
+        std::copy (d.Value.begin (), d.Value.end (), data.begin () + 1);
+
         address addr {};
-        static_cast<string &> (addr) = std::move (base58::check {byte (prefix), bytes_view {d}}.encode ());
+        static_cast<string &> (addr) = base58::fixed_check<21>::encode (data);
         return addr;
 
     }
@@ -17,11 +62,21 @@ namespace Gigamonkey::Bitcoin {
     address::decoded address::decode (string_view s) {
 
         if (s.size () > 35 || s.size () < 5) return {};
-        base58::check b58 (s);
-        if (!b58.valid ()) return {};
 
         decoded d;
 
+        // almost every address has 20 bytes of digest, so we try that first.
+        byte_array<21> data;
+        if (base58::fixed_check<21>::decode (s, data.data ())) {
+            d.Prefix = type (data[0]);
+            if (!valid_prefix (d.Prefix)) return {};
+            std::copy (data.begin () + 1, data.end (), d.Digest.Value.begin ());
+            return d;
+        }
+
+        base58::check b58 (s);
+        if (!b58.valid ()) return {};
+
         d.Prefix = type (b58.version ());
         if (!valid_prefix (d.Prefix)) return {};
         if (b58.payload ().size () > 20) return {};
@@ -30,4 +85,98 @@ namespace Gigamonkey::Bitcoin {
         return d;
 
     }
+
+    namespace {
+
+        using codec = base58::fixed_check<21>;
+
+        // data is 21 bytes for each address; the checksum is appended as each one is written.
+        address_column write_column (const std::vector<byte> &data, const std::vector<bool> &present) {
+            size_t count = present.size ();
+            std::vector<byte> digests (32 * count);
+            sha256::double_hash_short (digests.data (), data.data (), 21, count);
+
+            address_column column {};
+            column.Characters.resize (count * codec::MaxEncodedSize);
+            column.Offsets.reserve (count + 1);
+
+            uint64 end = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (present[i]) {
+                    byte checked[25];
+                    std::copy (data.begin () + 21 * i, data.begin () + 21 * (i + 1), checked);
+                    std::copy (digests.begin () + 32 * i, digests.begin () + 32 * i + 4, checked + 21);
+                    end += codec::write (checked, column.Characters.data () + end);
+                }
+
+                column.Offsets.push_back (end);
+            }
+
+            column.Characters.resize (end);
+            return column;
+        }
+
+    }
+
+    address_column address_column::encode (const std::vector<address::decoded> &x) {
+        std::vector<byte> data (21 * x.size ());
+        for (size_t i = 0; i < x.size (); i++) {
+            data[21 * i] = byte (x[i].Prefix);
+            std::copy (x[i].Digest.Value.begin (), x[i].Digest.Value.end (), data.begin () + 21 * i + 1);
+        }
+
+        return write_column (data, std::vector<bool> (x.size (), true));
+    }
+
+    address_column address_column::encode (address::type prefix, const std::vector<digest160> &x) {
+        std::vector<byte> data (21 * x.size ());
+        for (size_t i = 0; i < x.size (); i++) {
+            data[21 * i] = byte (prefix);
+            std::copy (x[i].Value.begin (), x[i].Value.end (), data.begin () + 21 * i + 1);
+        }
+
+        return write_column (data, std::vector<bool> (x.size (), true));
+    }
+
+    address_column address_column::scripts (address::type prefix, const std::vector<bytes_view> &x) {
+        std::vector<byte> data (21 * x.size ());
+        std::vector<bool> present (x.size ());
+        for (size_t i = 0; i < x.size (); i++) {
+            pay_to_address p2pkh {x[i]};
+            if (!p2pkh.valid ()) continue;
+            present[i] = true;
+            data[21 * i] = byte (prefix);
+            std::copy (p2pkh.Address.Value.begin (), p2pkh.Address.Value.end (), data.begin () + 21 * i + 1);
+        }
+
+        return write_column (data, present);
+    }
+
+    std::vector<address::decoded> address_column::decode () const {
+        size_t count = size ();
+        std::vector<byte> checked (25 * count);
+        std::vector<bool> present (count);
+        for (size_t i = 0; i < count; i++) present[i] = codec::read ((*this)[i], checked.data () + 25 * i);
+
+        std::vector<byte> data (21 * count);
+        for (size_t i = 0; i < count; i++)
+            std::copy (checked.begin () + 25 * i, checked.begin () + 25 * i + 21, data.begin () + 21 * i);
+
+        std::vector<byte> digests (32 * count);
+        sha256::double_hash_short (digests.data (), data.data (), 21, count);
+
+        std::vector<address::decoded> decoded (count);
+        for (size_t i = 0; i < count; i++) {
+            if (!present[i] || !std::equal (digests.begin () + 32 * i, digests.begin () + 32 * i + 4, checked.begin () + 25 * i + 21)) continue;
+
+            address::decoded d;
+            d.Prefix = address::type (data[21 * i]);
+            if (!address::valid_prefix (d.Prefix)) continue;
+            std::copy (data.begin () + 21 * i + 1, data.begin () + 21 * (i + 1), d.Digest.Value.begin ());
+            decoded[i] = d;
+        }
+
+        return decoded;
+    }
+
 }
@@ -0,0 +1,98 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/async_ledger.hpp>
+
+namespace Gigamonkey {
+    using namespace Bitcoin;
+    
+    awaitable<std::vector<output>> async_ledger::prevouts (std::vector<outpoint> refs) const {
+        std::vector<output> outs (refs.size ());
+        
+        // each previous transaction is only fetched once.
+        hash_map<txid, bytes> txs;
+        for (size_t i = 0; i < refs.size (); i++) {
+            auto tx = txs.find (refs[i].Digest);
+            if (tx == txs.end ()) tx = txs.emplace (refs[i].Digest, (co_await transaction (refs[i].Digest)).Key).first;
+            
+            bytes_view out = Bitcoin::transaction::output (tx->second, refs[i].Index);
+            if (out.size () != 0) outs[i] = output {out};
+        }
+        
+        co_return outs;
+    }
+    
+    awaitable<ledger::vertex> async_ledger::make_vertex (Bitcoin::transaction d) const {
+        std::vector<outpoint> refs;
+        refs.reserve (d.Inputs.size ());
+        for (const input &i : d.Inputs) refs.push_back (i.Reference);
+        
+        std::vector<output> outs = co_await prevouts (refs);
+        
+        data::map<outpoint, output> p;
+        for (size_t i = 0; i < refs.size (); i++) p = p.insert (refs[i], outs[i]);
+        co_return vertex {d, p};
+    }
+    
+    awaitable<list<ledger::block_header>> async_ledger_adapter::headers (uint64 since_height) {
+        return run_on (Pool, [this, since_height] () {
+            return Ledger.headers (since_height);
+        });
+    }
+    
+    awaitable<data::entry<bytes, ledger::confirmation>> async_ledger_adapter::transaction (const txid &t) const {
+        return run_on (Pool, [this, t] () {
+            return Ledger.transaction (t);
+        });
+    }
+    
+    awaitable<ledger::block_header> async_ledger_adapter::header (const digest256 &d) const {
+        return run_on (Pool, [this, d] () {
+            return Ledger.header (d);
+        });
+    }
+    
+    awaitable<bytes> async_ledger_adapter::block (const digest256 &d) const {
+        return run_on (Pool, [this, d] () {
+            return Ledger.block (d);
+        });
+    }
+    
+    // the whole list is given to the ledger at once in case it can fetch them together.
+    awaitable<std::vector<output>> async_ledger_adapter::prevouts (std::vector<outpoint> refs) const {
+        return run_on (Pool, [this, refs = std::move (refs)] () {
+            return Ledger.prevouts (refs).get ();
+        });
+    }
+    
+    awaitable<bool> async_timechain_adapter::broadcast (bytes b) {
+        return run_on (Pool, [this, b = std::move (b)] () {
+            return Timechain.broadcast (b);
+        });
+    }
+    
+    list<ledger::block_header> blocking_ledger::headers (uint64 since_height) {
+        return wait (Loop, Ledger.headers (since_height));
+    }
+    
+    data::entry<bytes, ledger::confirmation> blocking_ledger::transaction (const txid &t) const {
+        return wait (Loop, Ledger.transaction (t));
+    }
+    
+    ledger::block_header blocking_ledger::header (const digest256 &d) const {
+        return wait (Loop, Ledger.header (d));
+    }
+    
+    bytes blocking_ledger::block (const digest256 &d) const {
+        return wait (Loop, Ledger.block (d));
+    }
+    
+    std::future<std::vector<output>> blocking_ledger::prevouts (std::span<const outpoint> refs) const {
+        return boost::asio::co_spawn (Loop, Ledger.prevouts (std::vector<outpoint> (refs.begin (), refs.end ())), boost::asio::use_future);
+    }
+    
+    bool blocking_timechain::broadcast (const bytes_view &b) {
+        return wait (Loop, Timechain.broadcast (bytes (b)));
+    }
+    
+}
@@ -0,0 +1,186 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/base64.hpp>
+
+#include <array>
+
+namespace Gigamonkey::base64 {
+
+#ifdef GIGAMONKEY_ENABLE_AVX2
+    namespace avx2 {
+        // 24 bytes at a time. Each block reads 4 bytes past its end.
+        void write (char *out, const byte *in, size_t blocks);
+        
+        // 32 characters at a time.
+        bool read (byte *out, const char *in, size_t blocks);
+    }
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_NEON
+    namespace neon {
+        // 48 bytes at a time.
+        void write (char *out, const byte *in, size_t blocks);
+        
+        // 64 characters at a time.
+        bool read (byte *out, const char *in, size_t blocks);
+    }
+#endif
+    
+    namespace {
+        
+        enum class implementation : byte {generic, avx2, neon};
+        
+        implementation best () {
+            static const implementation Best = [] () -> implementation {
+#if defined(GIGAMONKEY_ENABLE_NEON)
+                // every aarch64 cpu has it.
+                return implementation::neon;
+#elif defined(GIGAMONKEY_ENABLE_AVX2)
+                return __builtin_cpu_supports ("avx2") ? implementation::avx2 : implementation::generic;
+#else
+                return implementation::generic;
+#endif
+            } ();
+            return Best;
+        }
+        
+        constexpr char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        
+        // -1 for characters that are not base64.
+        constexpr std::array<signed char, 256> values = [] () {
+            std::array<signed char, 256> x {};
+            for (int i = 0; i < 256; i++) x[i] = -1;
+            for (int i = 0; i < 64; i++) x[static_cast<unsigned char> (digits[i])] = i;
+            return x;
+        } ();
+        
+        void generic_write (char *out, const byte *in, size_t size) {
+            for (; size >= 3; size -= 3, in += 3, out += 4) {
+                uint32 x = uint32 (in[0]) << 16 | uint32 (in[1]) << 8 | in[2];
+                out[0] = digits[x >> 18];
+                out[1] = digits[(x >> 12) & 0x3f];
+                out[2] = digits[(x >> 6) & 0x3f];
+                out[3] = digits[x & 0x3f];
+            }
+            
+            if (size == 0) return;
+            
+            uint32 x = uint32 (in[0]) << 16 | (size == 2 ? uint32 (in[1]) << 8 : 0);
+            out[0] = digits[x >> 18];
+            out[1] = digits[(x >> 12) & 0x3f];
+            out[2] = size == 2 ? digits[(x >> 6) & 0x3f] : '=';
+            out[3] = '=';
+        }
+        
+        // size characters without padding.
+        bool generic_read (byte *out, const char *in, size_t size) {
+            int invalid = 0;
+            auto value = [&invalid] (char c) -> uint32 {
+                signed char v = values[static_cast<unsigned char> (c)];
+                invalid |= v;
+                return uint32 (v) & 0x3f;
+            };
+            
+            for (; size >= 4; size -= 4, in += 4, out += 3) {
+                uint32 x = value (in[0]) << 18 | value (in[1]) << 12 | value (in[2]) << 6 | value (in[3]);
+                out[0] = byte (x >> 16);
+                out[1] = byte (x >> 8);
+                out[2] = byte (x);
+            }
+            
+            if (size >= 2) {
+                uint32 x = value (in[0]) << 18 | value (in[1]) << 12 | (size == 3 ? value (in[2]) << 6 : 0);
+                out[0] = byte (x >> 16);
+                if (size == 3) out[1] = byte (x >> 8);
+            }
+            
+            return invalid >= 0;
+        }
+        
+        // the characters that are not padding.
+        size_t unpadded (string_view x) {
+            if (x.size () % 4 != 0) return x.size ();
+            size_t size = x.size ();
+            if (size > 0 && x[size - 1] == '=') size--;
+            if (size > 0 && x[size - 1] == '=') size--;
+            return size;
+        }
+        
+    }
+    
+    maybe<size_t> decoded_size (string_view x) {
+        size_t size = unpadded (x);
+        if (size % 4 == 1) return {};
+        return size / 4 * 3 + (size % 4 == 0 ? 0 : size % 4 - 1);
+    }
+    
+    void write (char *out, const byte *in, size_t size) {
+        size_t done = 0;
+        switch (best ()) {
+#ifdef GIGAMONKEY_ENABLE_AVX2
+            case implementation::avx2:
+                if (size >= 28) {
+                    size_t blocks = (size - 4) / 24;
+                    avx2::write (out, in, blocks);
+                    done = 24 * blocks;
+                }
+                break;
+#endif
+#ifdef GIGAMONKEY_ENABLE_NEON
+            case implementation::neon:
+                done = size - size % 48;
+                neon::write (out, in, done / 48);
+                break;
+#endif
+            default: break;
+        }
+        
+        generic_write (out + done / 3 * 4, in + done, size - done);
+    }
+    
+    bool read (byte *out, string_view x) {
+        size_t size = unpadded (x);
+        if (size % 4 == 1) return false;
+        
+        size_t done = 0;
+        switch (best ()) {
+#ifdef GIGAMONKEY_ENABLE_AVX2
+            case implementation::avx2:
+                done = size - size % 32;
+                if (!avx2::read (out, x.data (), done / 32)) return false;
+                break;
+#endif
+#ifdef GIGAMONKEY_ENABLE_NEON
+            case implementation::neon:
+                done = size - size % 64;
+                if (!neon::read (out, x.data (), done / 64)) return false;
+                break;
+#endif
+            default: break;
+        }
+        
+        return generic_read (out + done / 4 * 3, x.data () + done, size - done);
+    }
+    
+    string write (bytes_view b) {
+        string x;
+        x.resize (encoded_size (b.size ()));
+        write (x.data (), b.data (), b.size ());
+        return x;
+    }
+    
+    maybe<bytes> read (string_view x) {
+        bytes b;
+        if (!read (x, b)) return {};
+        return b;
+    }
+    
+    bool read (string_view x, bytes &b) {
+        maybe<size_t> size = decoded_size (x);
+        if (!bool (size)) return false;
+        b.resize (*size);
+        return read (b.data (), x);
+    }
+    
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -mavx2
+// Based on the AVX2 codec of Wojciech Muła and Alfred Klomp.
+
+#include <gigamonkey/base64.hpp>
+#include <immintrin.h>
+
+namespace Gigamonkey::base64::avx2 {
+    
+    // Each 128-bit half works on 12 bytes and 16 characters by itself.
+    
+    namespace {
+        
+        // the 6-bit values of 12 bytes in each half, one to a byte.
+        inline __m256i split (__m256i x) {
+            // each 3 bytes become 4 in the order that the multiplications need.
+            x = _mm256_shuffle_epi8 (x, _mm256_setr_epi8 (
+                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+            
+            __m256i first = _mm256_mulhi_epu16 (_mm256_and_si256 (x, _mm256_set1_epi32 (0x0fc0fc00)), _mm256_set1_epi32 (0x04000040));
+            __m256i second = _mm256_mullo_epi16 (_mm256_and_si256 (x, _mm256_set1_epi32 (0x003f03f0)), _mm256_set1_epi32 (0x01000010));
+            return _mm256_or_si256 (first, second);
+        }
+        
+        // values to characters by adding the offset of the range that each is in:
+        // A-Z, a-z, 0-9, + and /.
+        inline __m256i characters (__m256i x) {
+            const __m256i offsets = _mm256_setr_epi8 (
+                65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+            
+            // 0 for A-Z, 1 for a-z, 2-11 for 0-9, 12 for + and 13 for /.
+            __m256i range = _mm256_sub_epi8 (_mm256_subs_epu8 (x, _mm256_set1_epi8 (51)), _mm256_cmpgt_epi8 (x, _mm256_set1_epi8 (25)));
+            return _mm256_add_epi8 (x, _mm256_shuffle_epi8 (offsets, range));
+        }
+        
+    }
+    
+    void write (char *out, const byte *in, size_t blocks) {
+        for (size_t i = 0; i < blocks; i++) {
+            __m256i x = _mm256_inserti128_si256 (_mm256_castsi128_si256 (
+                _mm_loadu_si128 ((const __m128i *) (in + 24 * i))), _mm_loadu_si128 ((const __m128i *) (in + 24 * i + 12)), 1);
+            _mm256_storeu_si256 ((__m256i *) (out + 32 * i), characters (split (x)));
+        }
+    }
+    
+    bool read (byte *out, const char *in, size_t blocks) {
+        // A character is valid if the bits for its low and high nibbles
+        // have nothing in common. Then it is made a value by adding an
+        // offset that depends on its high nibble, and on whether it is /.
+        const __m256i low_bits = _mm256_setr_epi8 (
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m256i high_bits = _mm256_setr_epi8 (
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i offsets = _mm256_setr_epi8 (
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        // which is also the mask for the nibbles that are looked up.
+        const __m256i slash = _mm256_set1_epi8 ('/');
+        
+        __m256i invalid = _mm256_setzero_si256 ();
+        for (size_t i = 0; i < blocks; i++) {
+            __m256i c = _mm256_loadu_si256 ((const __m256i *) (in + 32 * i));
+            __m256i high = _mm256_and_si256 (_mm256_srli_epi32 (c, 4), slash);
+            invalid = _mm256_or_si256 (invalid, _mm256_and_si256 (
+                _mm256_shuffle_epi8 (low_bits, _mm256_and_si256 (c, slash)), _mm256_shuffle_epi8 (high_bits, high)));
+            
+            __m256i x = _mm256_add_epi8 (c, _mm256_shuffle_epi8 (offsets, _mm256_add_epi8 (_mm256_cmpeq_epi8 (c, slash), high)));
+            
+            // four values of 6 bits to three bytes, first within pairs and then within fours.
+            x = _mm256_madd_epi16 (_mm256_maddubs_epi16 (x, _mm256_set1_epi32 (0x01400140)), _mm256_set1_epi32 (0x00011000));
+            x = _mm256_shuffle_epi8 (x, _mm256_setr_epi8 (
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            x = _mm256_permutevar8x32_epi32 (x, _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 3, 7));
+            
+            _mm_storeu_si128 ((__m128i *) (out + 24 * i), _mm256_castsi256_si128 (x));
+            _mm_storel_epi64 ((__m128i *) (out + 24 * i + 16), _mm256_extracti128_si256 (x, 1));
+        }
+        
+        return _mm256_testz_si256 (invalid, invalid);
+    }
+    
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// for aarch64, which always has NEON.
+
+#include <gigamonkey/base64.hpp>
+#include <arm_neon.h>
+
+#include <array>
+
+namespace Gigamonkey::base64::neon {
+    
+    // the interleaving loads and stores take bytes and characters apart three
+    // or four at a time, so each register has one of the three or four.
+    
+    void write (char *out, const byte *in, size_t blocks) {
+        const uint8x16x4_t digits {{
+            vld1q_u8 ((const uint8_t *) "ABCDEFGHIJKLMNOP"), vld1q_u8 ((const uint8_t *) "QRSTUVWXYZabcdef"),
+            vld1q_u8 ((const uint8_t *) "ghijklmnopqrstuv"), vld1q_u8 ((const uint8_t *) "wxyz0123456789+/")}};
+        const uint8x16_t mask = vdupq_n_u8 (0x3f);
+        
+        for (size_t i = 0; i < blocks; i++) {
+            uint8x16x3_t x = vld3q_u8 (in + 48 * i);
+            uint8x16x4_t c;
+            c.val[0] = vqtbl4q_u8 (digits, vshrq_n_u8 (x.val[0], 2));
+            c.val[1] = vqtbl4q_u8 (digits, vandq_u8 (vorrq_u8 (vshlq_n_u8 (x.val[0], 4), vshrq_n_u8 (x.val[1], 4)), mask));
+            c.val[2] = vqtbl4q_u8 (digits, vandq_u8 (vorrq_u8 (vshlq_n_u8 (x.val[1], 2), vshrq_n_u8 (x.val[2], 6)), mask));
+            c.val[3] = vqtbl4q_u8 (digits, vandq_u8 (x.val[2], mask));
+            vst4q_u8 ((uint8_t *) out + 64 * i, c);
+        }
+    }
+    
+    namespace {
+        
+        // the values of the characters from 0 to 127, with 0xff for those that are not base64.
+        constexpr std::array<uint8_t, 128> values = [] () {
+            std::array<uint8_t, 128> x {};
+            for (int i = 0; i < 128; i++) x[i] = 0xff;
+            const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (int i = 0; i < 64; i++) x[static_cast<unsigned char> (digits[i])] = uint8_t (i);
+            return x;
+        } ();
+        
+        struct table {
+            uint8x16x4_t Low;
+            uint8x16x4_t High;
+        };
+        
+        // out of range indices give 0, so a character of 128 or more gives 0
+        // from both tables and is caught by its own high bit.
+        inline uint8x16_t value (const table &t, uint8x16_t c, uint8x16_t &invalid) {
+            uint8x16_t v = vorrq_u8 (vqtbl4q_u8 (t.Low, c), vqtbl4q_u8 (t.High, vsubq_u8 (c, vdupq_n_u8 (64))));
+            invalid = vorrq_u8 (invalid, vorrq_u8 (v, c));
+            return v;
+        }
+        
+    }
+    
+    bool read (byte *out, const char *in, size_t blocks) {
+        const table t {vld1q_u8_x4 (values.data ()), vld1q_u8_x4 (values.data () + 64)};
+        
+        uint8x16_t invalid = vdupq_n_u8 (0);
+        for (size_t i = 0; i < blocks; i++) {
+            uint8x16x4_t c = vld4q_u8 ((const uint8_t *) in + 64 * i);
+            uint8x16_t a = value (t, c.val[0], invalid);
+            uint8x16_t b = value (t, c.val[1], invalid);
+            uint8x16_t d = value (t, c.val[2], invalid);
+            uint8x16_t e = value (t, c.val[3], invalid);
+            
+            uint8x16x3_t x;
+            x.val[0] = vorrq_u8 (vshlq_n_u8 (a, 2), vshrq_n_u8 (b, 4));
+            x.val[1] = vorrq_u8 (vshlq_n_u8 (b, 4), vshrq_n_u8 (d, 2));
+            x.val[2] = vorrq_u8 (vshlq_n_u8 (d, 6), e);
+            vst3q_u8 (out + 48 * i, x);
+        }
+        
+        return vmaxvq_u8 (invalid) < 0x80;
+    }
+    
+}
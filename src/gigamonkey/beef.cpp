@@ -0,0 +1,373 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/beef.hpp>
+
+#include <map>
+#include <stdexcept>
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        // the size of the var_int at the front of b and its value, or 0 if it is incomplete.
+        size_t read_var_int (bytes_view b, uint64 &value) {
+            if (b.empty ()) return 0;
+            size_t size = b[0] < 0xfd ? 1 : b[0] == 0xfd ? 3 : b[0] == 0xfe ? 5 : 9;
+            if (b.size () < size) return 0;
+            
+            if (size == 1) value = b[0];
+            else {
+                value = 0;
+                for (size_t i = size - 1; i > 0; i--) value = (value << 8) | b[i];
+            }
+            
+            return size;
+        }
+        
+        // the size of the BUMP at the front of b, or 0 if it is incomplete.
+        size_t BUMP_size (bytes_view b) {
+            uint64 block_height;
+            size_t offset = read_var_int (b, block_height);
+            if (offset == 0 || b.size () == offset) return 0;
+            
+            byte height = b[offset++];
+            for (byte level = 0; level < height; level++) {
+                uint64 count;
+                size_t size = read_var_int (b.substr (offset), count);
+                if (size == 0) return 0;
+                offset += size;
+                
+                for (uint64 i = 0; i < count; i++) {
+                    uint64 node;
+                    size = read_var_int (b.substr (offset), node);
+                    if (size == 0 || b.size () == offset + size) return 0;
+                    offset += size;
+                    
+                    byte flag = b[offset++];
+                    if (flag != Merkle::BUMP::duplicate) offset += 32;
+                    if (b.size () < offset) return 0;
+                }
+            }
+            
+            return offset;
+        }
+        
+        // read everything after the transaction part of a transaction in a BEEF.
+        // The size of it, or 0 if it is incomplete or if the flag is not 0 or 1.
+        size_t read_flag (bytes_view b, maybe<uint64> &index) {
+            if (b.empty () || b[0] > 1) return 0;
+            if (b[0] == 0) {
+                index = {};
+                return 1;
+            }
+            
+            uint64 i;
+            size_t size = read_var_int (b.substr (1), i);
+            if (size == 0) return 0;
+            index = i;
+            return size + 1;
+        }
+        
+        std::vector<Bitcoin::output> outputs (const Bitcoin::transaction_view &tx) {
+            std::vector<Bitcoin::output> outs;
+            outs.reserve (tx.output_count ());
+            for (size_t i = 0; i < tx.output_count (); i++) outs.push_back (Bitcoin::output (tx.output (i)));
+            return outs;
+        }
+        
+        // the outputs spent by an unconfirmed transaction, or nothing if one cannot be found.
+        maybe<std::vector<Bitcoin::prevout>> spent (const Bitcoin::transaction_view &tx,
+            const hash_map<Bitcoin::txid, std::vector<Bitcoin::output>> &known) {
+            std::vector<Bitcoin::prevout> prevouts;
+            prevouts.reserve (tx.input_count ());
+            for (size_t i = 0; i < tx.input_count (); i++) {
+                Bitcoin::outpoint ref = tx.input (i).reference ();
+                auto p = known.find (ref.Digest);
+                if (p == known.end () || uint32 (ref.Index) >= p->second.size ()) return {};
+                prevouts.push_back (Bitcoin::prevout {ref, p->second[uint32 (ref.Index)]});
+            }
+            
+            return prevouts;
+        }
+        
+    }
+    
+    bool BEEF::valid () const {
+        if (Transactions.empty ()) return false;
+        for (const Merkle::BUMP &b : BUMPs) if (!b.valid ()) return false;
+        
+        hash_map<Bitcoin::txid, std::vector<Bitcoin::output>> known;
+        for (const transaction &t : Transactions) {
+            Bitcoin::transaction_view tx {t.Transaction};
+            if (!tx.valid ()) return false;
+            
+            Bitcoin::txid id = tx.id ();
+            if (known.contains (id)) return false;
+            
+            if (t.BUMP) {
+                if (*t.BUMP >= BUMPs.size () || !BUMPs[*t.BUMP].contains (id)) return false;
+            } else if (!spent (tx, known)) return false;
+            
+            known.emplace (id, outputs (tx));
+        }
+        
+        return true;
+    }
+    
+    Bitcoin::txid BEEF::id () const {
+        if (Transactions.empty ()) return {};
+        return Bitcoin::transaction_view {Transactions.back ().Transaction}.id ();
+    }
+    
+    BEEF BEEF::make (const ledger &l, bytes_view tx) {
+        if (!Bitcoin::transaction_view {tx}.valid ()) throw std::invalid_argument {"not a transaction"};
+        
+        // confirmed ancestors, with the height of their block.
+        std::map<uint64, Merkle::BUMP> bumps;
+        std::vector<std::pair<bytes, maybe<uint64>>> ordered;
+        hash_set<Bitcoin::txid> found;
+        
+        // a transaction is added after all of its parents, and the chain of
+        // unconfirmed ancestors may be long, so we go down it with a stack.
+        struct visit {
+            bytes Transaction;
+            size_t Next;
+        };
+        
+        std::vector<visit> stack {visit {bytes (tx), 0}};
+        while (!stack.empty ()) {
+            Bitcoin::transaction_view t {stack.back ().Transaction};
+            if (stack.back ().Next == t.input_count ()) {
+                ordered.emplace_back (std::move (stack.back ().Transaction), maybe<uint64> {});
+                stack.pop_back ();
+                continue;
+            }
+            
+            Bitcoin::txid parent = t.input (stack.back ().Next++).reference ().Digest;
+            if (found.contains (parent)) continue;
+            found.insert (parent);
+            
+            data::entry<bytes, ledger::confirmation> e = l.transaction (parent);
+            if (e.Key.size () == 0) throw std::invalid_argument {"an ancestor of the transaction could not be found"};
+            
+            if (!e.Value.Proof.valid ()) {
+                stack.push_back (visit {e.Key, 0});
+                continue;
+            }
+            
+            uint64 height = uint64 (l.header (e.Value.Header.hash ()).Height);
+            Merkle::BUMP b {height, e.Value.Proof};
+            auto i = bumps.find (height);
+            if (i == bumps.end ()) bumps.emplace (height, b);
+            else i->second = i->second + b;
+            
+            ordered.emplace_back (e.Key, height);
+        }
+        
+        BEEF x;
+        std::map<uint64, uint64> indices;
+        for (const auto &[height, b] : bumps) {
+            indices[height] = x.BUMPs.size ();
+            x.BUMPs.push_back (b);
+        }
+        
+        x.Transactions.reserve (ordered.size ());
+        for (auto &[t, height] : ordered)
+            x.Transactions.push_back (transaction {std::move (t), height ? maybe<uint64> {indices[*height]} : maybe<uint64> {}});
+        
+        return x;
+    }
+    
+    bytes BEEF::write () const {
+        std::vector<bytes> bumps;
+        bumps.reserve (BUMPs.size ());
+        
+        size_t size = 4 + Bitcoin::var_int::size (BUMPs.size ()) + Bitcoin::var_int::size (Transactions.size ());
+        for (const Merkle::BUMP &b : BUMPs) size += bumps.emplace_back (b.write ()).size ();
+        for (const transaction &t : Transactions) size += t.Transaction.size () + 1 + (t.BUMP ? Bitcoin::var_int::size (*t.BUMP) : 0);
+        
+        bytes x (size);
+        bytes_writer w {x.begin (), x.end ()};
+        w << uint32_little {version} << Bitcoin::var_int {BUMPs.size ()};
+        for (const bytes &b : bumps) w << b;
+        w << Bitcoin::var_int {Transactions.size ()};
+        for (const transaction &t : Transactions) {
+            w << t.Transaction << byte (t.BUMP ? 1 : 0);
+            if (t.BUMP) w << Bitcoin::var_int {*t.BUMP};
+        }
+        
+        return x;
+    }
+    
+    maybe<BEEF> BEEF::read (bytes_view b) {
+        if (b.size () < 4 || uint32 (b[0]) + (uint32 (b[1]) << 8) + (uint32 (b[2]) << 16) + (uint32 (b[3]) << 24) != version) return {};
+        
+        BEEF x;
+        size_t offset = 4;
+        
+        uint64 count;
+        size_t size = read_var_int (b.substr (offset), count);
+        if (size == 0) return {};
+        offset += size;
+        
+        for (uint64 i = 0; i < count; i++) {
+            size = BUMP_size (b.substr (offset));
+            if (size == 0) return {};
+            
+            maybe<Merkle::BUMP> bump = Merkle::BUMP::read (b.substr (offset, size));
+            if (!bump) return {};
+            x.BUMPs.push_back (*bump);
+            offset += size;
+        }
+        
+        size = read_var_int (b.substr (offset), count);
+        if (size == 0) return {};
+        offset += size;
+        
+        for (uint64 i = 0; i < count; i++) {
+            Bitcoin::transaction_scanner scanner {b.size ()};
+            size = scanner.next (b.substr (offset));
+            if (size == 0) return {};
+            
+            transaction t {bytes (b.substr (offset, size)), {}};
+            offset += size;
+            
+            size = read_flag (b.substr (offset), t.BUMP);
+            if (size == 0) return {};
+            offset += size;
+            
+            x.Transactions.push_back (std::move (t));
+        }
+        
+        if (offset != b.size () || !x.valid ()) return {};
+        return x;
+    }
+    
+    BEEF_reader::BEEF_reader (const headers &h, executor *e, uint32 flags, size_t max) :
+        Headers {h}, Executor {e}, Flags {flags}, MaxPartSize {max}, Stage {stage::version}, Error {error::none},
+        Count {0}, Read {0}, BUMPs {}, Outputs {}, Last {}, Scanner {max}, Buffer {} {}
+    
+    bool BEEF_reader::write (bytes_view b) {
+        if (failed ()) return false;
+        
+        // if nothing is waiting, read straight from b and only keep what is left over.
+        bytes_view rest {};
+        if (Buffer.empty ()) rest = b.substr (consume (b));
+        else {
+            Buffer.insert (Buffer.end (), b.begin (), b.end ());
+            Buffer.erase (Buffer.begin (), Buffer.begin () + consume (Buffer));
+        }
+        
+        if (failed ()) {
+            Buffer.clear ();
+            return false;
+        }
+        
+        Buffer.insert (Buffer.end (), rest.begin (), rest.end ());
+        
+        // nothing may come after the last transaction.
+        if ((Stage == stage::complete && !Buffer.empty ()) || Buffer.size () > MaxPartSize) {
+            fail (error::format);
+            Buffer.clear ();
+            return false;
+        }
+        
+        return true;
+    }
+    
+    size_t BEEF_reader::fail (error e) {
+        Error = e;
+        return 0;
+    }
+    
+    size_t BEEF_reader::consume (bytes_view b) {
+        size_t read = 0;
+        while (Stage != stage::complete && !failed ()) {
+            size_t size = next (b.substr (read));
+            if (size == 0) break;
+            read += size;
+        }
+        
+        return read;
+    }
+    
+    size_t BEEF_reader::next (bytes_view b) {
+        switch (Stage) {
+            case stage::version: {
+                if (b.size () < 4) return 0;
+                if (uint32 (b[0]) + (uint32 (b[1]) << 8) + (uint32 (b[2]) << 16) + (uint32 (b[3]) << 24) != BEEF::version)
+                    return fail (error::format);
+                
+                Stage = stage::BUMP_count;
+                return 4;
+            }
+            
+            case stage::BUMP_count:
+            case stage::transaction_count: {
+                size_t size = read_var_int (b, Count);
+                if (size == 0) return 0;
+                
+                if (Stage == stage::BUMP_count) Stage = Count == 0 ? stage::transaction_count : stage::BUMPs;
+                else if (Count == 0) return fail (error::format);
+                else Stage = stage::transactions;
+                
+                return size;
+            }
+            
+            case stage::BUMPs: {
+                size_t size = BUMP_size (b);
+                if (size == 0) return 0;
+                
+                maybe<Merkle::BUMP> x = Merkle::BUMP::read (b.substr (0, size));
+                if (!x) return fail (error::format);
+                
+                headers::header h = Headers[N (x->BlockHeight)];
+                if (!h.valid () || !x->verify (h.Header.MerkleRoot)) return fail (error::invalid_proof);
+                
+                BUMPs.push_back (*x);
+                if (BUMPs.size () == Count) Stage = stage::transaction_count;
+                return size;
+            }
+            
+            case stage::transactions: return next_transaction (b);
+            
+            default: return 0;
+        }
+    }
+    
+    size_t BEEF_reader::next_transaction (bytes_view b) {
+        size_t size = Scanner.next (b);
+        if (size == 0) return Scanner.failed () ? fail (error::format) : 0;
+        
+        maybe<uint64> index;
+        size_t flag_size = read_flag (b.substr (size), index);
+        if (flag_size == 0) return b.size () > size && b[size] > 1 ? fail (error::format) : 0;
+        
+        Bitcoin::transaction_view tx {b.substr (0, size)};
+        if (!tx.valid ()) return fail (error::format);
+        
+        Bitcoin::txid id = tx.id ();
+        if (Outputs.contains (id)) return fail (error::format);
+        
+        if (index) {
+            if (*index >= BUMPs.size () || !BUMPs[*index].contains (id)) return fail (error::not_in_proof);
+        } else {
+            maybe<std::vector<Bitcoin::prevout>> prevouts = spent (tx, Outputs);
+            if (!prevouts) return fail (error::missing_parent);
+            
+            if (Executor != nullptr &&
+                !Bitcoin::verified (Bitcoin::verify_transaction (tx, *prevouts, Flags, *Executor, true)))
+                return fail (error::invalid_script);
+        }
+        
+        Outputs.emplace (id, outputs (tx));
+        Last = id;
+        receive (tx, bool (index));
+        
+        Scanner.reset ();
+        if (++Read == Count) Stage = stage::complete;
+        return size + flag_size;
+    }
+    
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/block_assembler.hpp>
+#include <gigamonkey/work/string.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace Gigamonkey {
+    
+    block_assembler::block_assembler (std::vector<Bitcoin::shared_transaction> txs) :
+        Transactions {std::make_shared<const std::vector<Bitcoin::shared_transaction>> (std::move (txs))}, Size {0} {
+        for (const Bitcoin::shared_transaction &tx : *Transactions) Size += tx.serialized_size ();
+    }
+    
+    uint64 block_assembler::size (uint64 coinbase_size) const {
+        return 80 + Bitcoin::var_int::size (Transactions->size () + 1) + coinbase_size + Size;
+    }
+    
+    block_assembler::block block_assembler::assemble (const Bitcoin::header &h, bytes coinbase) const {
+        block b {h, bytes (80 + Bitcoin::var_int::size (Transactions->size () + 1)), std::move (coinbase), Transactions};
+        byte_array<80> serialized = h.write ();
+        std::copy (serialized.begin (), serialized.end (), b.Prefix.begin ());
+        Bitcoin::write_cursor w {b.Prefix.data () + 80, b.Prefix.data () + b.Prefix.size ()};
+        w.put_var_int (Transactions->size () + 1);
+        return b;
+    }
+    
+    // the coinbase is the puzzle's header, the extra nonces and then the puzzle's body.
+    block_assembler::block block_assembler::assemble (const work::proof &p) const {
+        const bytes &n2 = p.Solution.Share.ExtraNonce2;
+        bytes coinbase (p.Puzzle.Header.size () + 4 + n2.size () + p.Puzzle.Body.size ());
+        auto it = std::copy (p.Puzzle.Header.begin (), p.Puzzle.Header.end (), coinbase.begin ());
+        it = std::copy (p.Solution.ExtraNonce1.begin (), p.Solution.ExtraNonce1.end (), it);
+        it = std::copy (n2.begin (), n2.end (), it);
+        std::copy (p.Puzzle.Body.begin (), p.Puzzle.Body.end (), it);
+        return assemble (Bitcoin::header (p.string ()), std::move (coinbase));
+    }
+    
+    uint64 block_assembler::block::size () const {
+        uint64 x = Prefix.size () + Coinbase.size ();
+        for (const Bitcoin::shared_transaction &tx : *Transactions) x += tx.serialized_size ();
+        return x;
+    }
+    
+    std::vector<bytes_view> block_assembler::block::parts () const {
+        std::vector<bytes_view> x;
+        x.reserve (Transactions->size () + 2);
+        x.push_back (Prefix);
+        x.push_back (Coinbase);
+        for (const Bitcoin::shared_transaction &tx : *Transactions) x.push_back (tx.serialized ());
+        return x;
+    }
+    
+    bytes block_assembler::block::write (executor *e) const {
+        std::vector<bytes_view> p = parts ();
+        std::vector<uint64> offsets (p.size () + 1, 0);
+        for (size_t i = 0; i < p.size (); i++) offsets[i + 1] = offsets[i] + p[i].size ();
+        
+        bytes b (offsets.back ());
+        auto copy = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) std::copy (p[i].begin (), p[i].end (), b.begin () + offsets[i]);
+        };
+        
+        if (e == nullptr) copy (0, p.size ());
+        else e->bulk (p.size (), 0, copy);
+        return b;
+    }
+    
+    // writev takes at most IOV_MAX parts and may write less than it is given.
+    void block_assembler::block::write_to (int descriptor) const {
+        std::vector<bytes_view> p = parts ();
+        std::vector<iovec> v;
+        v.reserve (p.size ());
+        for (bytes_view b : p) if (!b.empty ())
+            v.push_back (iovec {const_cast<byte *> (b.data ()), b.size ()});
+        
+        size_t next = 0;
+        while (next < v.size ()) {
+            int count = int (std::min<size_t> (v.size () - next, IOV_MAX));
+            ssize_t written = ::writev (descriptor, v.data () + next, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error {std::string {"could not write block: "} + std::strerror (errno)};
+            }
+            
+            size_t remaining = size_t (written);
+            while (remaining > 0 && remaining >= v[next].iov_len) remaining -= v[next++].iov_len;
+            if (remaining > 0) {
+                v[next].iov_base = static_cast<byte *> (v[next].iov_base) + remaining;
+                v[next].iov_len -= remaining;
+            }
+        }
+    }
+    
+}
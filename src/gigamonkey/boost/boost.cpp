@@ -1,7 +1,9 @@
 #include <gigamonkey/boost/boost.hpp>
 #include <gigamonkey/script/pattern.hpp>
+#include <gigamonkey/work/ASICBoost.hpp>
 #include <data/encoding/halves.hpp>
 #include <gigamonkey/p2p/var_int.hpp>
+#include <array>
 #include <iostream>
 
 namespace Gigamonkey::Bitcoin {
@@ -216,79 +218,106 @@ namespace Gigamonkey::Boost {
         return p;
     }
     
+    namespace {
+        
+        // The parts of an output script that are the same in every Boost script of a
+        // kind. They are compiled the first time they are needed and then copied
+        // around the pushes of each script that is written.
+        struct output_script_fragments {
+            bytes Prefix;
+            bytes Tail;
+            bytes TailGeneralPurposeBits;
+            
+            static const output_script_fragments &get () {
+                static const output_script_fragments Fragments {
+                    compile (program {push_data (bytes {0x62, 0x6F, 0x6F, 0x73, 0x74, 0x70, 0x6F, 0x77}), OP_DROP}), // "boostpow"
+                    compile (program {}.append (
+                        OP_CAT, OP_SWAP, 
+                        // copy mining pool’s pubkey hash to alt stack. A copy remains on the stack.
+                        OP_5, OP_ROLL, OP_DUP, OP_TOALTSTACK, OP_CAT,              
+                        // expand compact form of target and push to altstack. 
+                        OP_2, OP_PICK, OP_TOALTSTACK, 
+                        OP_5, OP_ROLL, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,   // check size of extra_nonce_1
+                        OP_5, OP_ROLL, OP_SIZE, OP_8, OP_EQUALVERIFY, OP_CAT,   // check size of extra_nonce_2
+                        // create metadata document and hash it.
+                        OP_SWAP, OP_CAT, OP_HASH256,    
+                        OP_SWAP, OP_TOALTSTACK, OP_CAT, OP_CAT,                 // target to altstack. 
+                        OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,         // check size of timestamp.
+                        OP_FROMALTSTACK, OP_CAT,                                // attach target
+                        // check size of nonce. Boost POW string is constructed. 
+                        OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,
+                        // Take hash of work string and ensure that it is positive and minimally encoded.
+                        OP_HASH256, ensure_positive, 
+                        // Get target, transform to expanded form, and ensure that it is positive and minimally encoded.
+                        OP_FROMALTSTACK, expand_target, ensure_positive, 
+                        // check that the hash of the Boost POW string is less than the target
+                        OP_LESSTHAN, OP_VERIFY,
+                        // check that the given address matches the pubkey and check signature.
+                        OP_DUP, OP_HASH160, OP_FROMALTSTACK, OP_EQUALVERIFY, OP_CHECKSIG)),
+                    compile (program {}.append (
+                        OP_CAT, OP_SWAP, 
+                        // copy mining pool’s pubkey hash to alt stack. A copy remains on the stack.
+                        OP_5, OP_ROLL, OP_DUP, OP_TOALTSTACK, OP_CAT,              
+                        // expand compact form of target and push to altstack. 
+                        OP_2, OP_PICK, OP_TOALTSTACK, 
+                        // check size of extra_nonce_1
+                        OP_6, OP_ROLL, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,   
+                        // check size of extra_nonce_2
+                        OP_6, OP_ROLL, OP_SIZE, push_data (32), OP_LESSTHANOREQUAL, OP_VERIFY, OP_CAT,
+                        // create metadata document and hash it.
+                        OP_SWAP, OP_CAT, OP_HASH256,    
+                        // target and content + merkleroot to altstack. 
+                        OP_SWAP, OP_TOALTSTACK, OP_CAT, OP_TOALTSTACK, 
+                        push_data (work::ASICBoost::Mask), OP_DUP, OP_INVERT, OP_TOALTSTACK, OP_AND,
+                        // general purpose bits 
+                        OP_SWAP, OP_FROMALTSTACK, OP_AND, OP_OR, 
+                        OP_FROMALTSTACK, OP_CAT,                                // attach content + merkleroot
+                        OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,         // check size of timestamp.
+                        OP_FROMALTSTACK, OP_CAT,                                // attach target
+                        // check size of nonce. Boost POW string is constructed. 
+                        OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,
+                        // Take hash of work string and ensure that it is positive and minimally encoded.
+                        OP_HASH256, ensure_positive, 
+                        // Get target, transform to expanded form, and ensure that it is positive and minimally encoded.
+                        OP_FROMALTSTACK, expand_target, ensure_positive, 
+                        // check that the hash of the Boost POW string is less than the target
+                        OP_LESSTHAN, OP_VERIFY,
+                        // check that the given address matches the pubkey and check signature.
+                        OP_DUP, OP_HASH160, OP_FROMALTSTACK, OP_EQUALVERIFY, OP_CHECKSIG))};
+                
+                return Fragments;
+            }
+        };
+        
+    }
+    
     script output_script::write () const {
         if (Type == Boost::invalid) return {};
-        program boost_output_script = program {push_data (bytes {0x62, 0x6F, 0x6F, 0x73, 0x74, 0x70, 0x6F, 0x77}), OP_DROP}; // "boostpow"
         
-        if (Type == Boost::contract) 
-            boost_output_script = boost_output_script.append (push_data (MinerPubkeyHash));
+        const output_script_fragments &fragments = output_script_fragments::get ();
+        const bytes &tail = UseGeneralPurposeBits ? fragments.TailGeneralPurposeBits : fragments.Tail;
         
-        boost_output_script = UseGeneralPurposeBits ? boost_output_script.append (
-            push_data (Category),
-            push_data (Content),
-            push_data (Target),
-            push_data (Tag),
-            push_data (UserNonce),
-            push_data (bytes_view (AdditionalData)),
-            OP_CAT, OP_SWAP, 
-            // copy mining pool’s pubkey hash to alt stack. A copy remains on the stack.
-            OP_5, OP_ROLL, OP_DUP, OP_TOALTSTACK, OP_CAT,              
-            // expand compact form of target and push to altstack. 
-            OP_2, OP_PICK, OP_TOALTSTACK, 
-            // check size of extra_nonce_1
-            OP_6, OP_ROLL, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,   
-            // check size of extra_nonce_2
-            OP_6, OP_ROLL, OP_SIZE, push_data (32), OP_LESSTHANOREQUAL, OP_VERIFY, OP_CAT,
-            // create metadata document and hash it.
-            OP_SWAP, OP_CAT, OP_HASH256,    
-            // target and content + merkleroot to altstack. 
-            OP_SWAP, OP_TOALTSTACK, OP_CAT, OP_TOALTSTACK, 
-            push_data (work::ASICBoost::Mask), OP_DUP, OP_INVERT, OP_TOALTSTACK, OP_AND,
-            // general purpose bits 
-            OP_SWAP, OP_FROMALTSTACK, OP_AND, OP_OR, 
-            OP_FROMALTSTACK, OP_CAT,                                // attach content + merkleroot
-            OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,         // check size of timestamp.
-            OP_FROMALTSTACK, OP_CAT,                                // attach target
-            // check size of nonce. Boost POW string is constructed. 
-            OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,
-            // Take hash of work string and ensure that it is positive and minimally encoded.
-            OP_HASH256, ensure_positive, 
-            // Get target, transform to expanded form, and ensure that it is positive and minimally encoded.
-            OP_FROMALTSTACK, expand_target, ensure_positive, 
-            // check that the hash of the Boost POW string is less than the target
-            OP_LESSTHAN, OP_VERIFY,
-            // check that the given address matches the pubkey and check signature.
-            OP_DUP, OP_HASH160, OP_FROMALTSTACK, OP_EQUALVERIFY, OP_CHECKSIG) : boost_output_script.append (
+        std::array<instruction, 7> pushes {
+            push_data (MinerPubkeyHash),
             push_data (Category),
             push_data (Content),
             push_data (Target),
             push_data (Tag),
             push_data (UserNonce),
-            push_data (bytes_view(AdditionalData)),
-            OP_CAT, OP_SWAP, 
-            // copy mining pool’s pubkey hash to alt stack. A copy remains on the stack.
-            OP_5, OP_ROLL, OP_DUP, OP_TOALTSTACK, OP_CAT,              
-            // expand compact form of target and push to altstack. 
-            OP_2, OP_PICK, OP_TOALTSTACK, 
-            OP_5, OP_ROLL, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,   // check size of extra_nonce_1
-            OP_5, OP_ROLL, OP_SIZE, OP_8, OP_EQUALVERIFY, OP_CAT,   // check size of extra_nonce_2
-            // create metadata document and hash it.
-            OP_SWAP, OP_CAT, OP_HASH256,    
-            OP_SWAP, OP_TOALTSTACK, OP_CAT, OP_CAT,                 // target to altstack. 
-            OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,         // check size of timestamp.
-            OP_FROMALTSTACK, OP_CAT,                                // attach target
-            // check size of nonce. Boost POW string is constructed. 
-            OP_SWAP, OP_SIZE, OP_4, OP_EQUALVERIFY, OP_CAT,
-            // Take hash of work string and ensure that it is positive and minimally encoded.
-            OP_HASH256, ensure_positive, 
-            // Get target, transform to expanded form, and ensure that it is positive and minimally encoded.
-            OP_FROMALTSTACK, expand_target, ensure_positive, 
-            // check that the hash of the Boost POW string is less than the target
-            OP_LESSTHAN, OP_VERIFY,
-            // check that the given address matches the pubkey and check signature.
-            OP_DUP, OP_HASH160, OP_FROMALTSTACK, OP_EQUALVERIFY, OP_CHECKSIG);
+            push_data (bytes_view (AdditionalData))};
+        
+        // a bounty script has no miner pubkey hash.
+        size_t first = Type == Boost::contract ? 0 : 1;
         
-        return compile (boost_output_script);
+        size_t size = fragments.Prefix.size () + tail.size ();
+        for (size_t i = first; i < pushes.size (); i++) size += pushes[i].serialized_size ();
+        
+        script x (size);
+        bytes_writer w {x.begin (), x.end ()};
+        w << bytes_view (fragments.Prefix);
+        for (size_t i = first; i < pushes.size (); i++) w << pushes[i];
+        w << bytes_view (tail);
+        return x;
     }
     
     inline bool between_inclusive (int x, int y, int z) {
@@ -414,14 +443,16 @@ namespace Gigamonkey::Boost {
         Boost::type boost_type = boost_script.Type;
         bool category_mask = boost_script.UseGeneralPurposeBits;
         
+        ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+        
         uint32 index = 0;
         
         return bytes (transaction {1, data::map_thread (
-            [&sk, &script, &incomplete, &pk, &solution, boost_type, category_mask, &index](
+            [&sk, &script, &incomplete, &precomputed, &pk, &solution, boost_type, category_mask, &index](
                 const incomplete::input &i, 
                 const prevout &prev) -> input {
                 return input {i.Reference, input_script {
-                    sk.sign (sighash::document {prev.Value, script, incomplete, index++}, directive (sighash::all)),
+                    sk.sign (sighash::document {prev.Value, script, incomplete, index++, precomputed}, directive (sighash::all)),
                 pk, solution, boost_type, category_mask}.write (), i.Sequence};
             }, incomplete_inputs, Prevouts.values ()), outs, 0});
         
@@ -434,4 +465,232 @@ namespace Gigamonkey::Boost {
             Prevouts.size () * (input_script_size + Bitcoin::var_int::size (input_script_size) + 40);
     }
 
+    namespace {
+        
+        // OP_1NEGATE and OP_1 through OP_16 push numbers that do not appear in
+        // the script, so views of those pushes point here instead.
+        const byte small_numbers[17] {0x81, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+        
+        // read the push at the front of b and move b past it.
+        bool read_push (bytes_view &b, bytes_view &x) {
+            if (b.size () == 0) return false;
+            
+            byte op = b[0];
+            if (op == OP_1NEGATE || (op >= OP_1 && op <= OP_16)) {
+                x = bytes_view {small_numbers + (op == OP_1NEGATE ? 0 : op - OP_1 + 1), 1};
+                b = b.substr (1);
+                return true;
+            }
+
+            size_t header;
+            uint64 size;
+            if (op < OP_PUSHDATA1) {
+                header = 1;
+                size = op;
+            } else if (op == OP_PUSHDATA1 && b.size () >= 2) {
+                header = 2;
+                size = b[1];
+            } else if (op == OP_PUSHDATA2 && b.size () >= 3) {
+                header = 3;
+                size = uint64 (b[1]) | uint64 (b[2]) << 8;
+            } else if (op == OP_PUSHDATA4 && b.size () >= 5) {
+                header = 5;
+                size = uint64 (b[1]) | uint64 (b[2]) << 8 | uint64 (b[3]) << 16 | uint64 (b[4]) << 24;
+            } else return false;
+            
+            if (b.size () - header < size) return false;
+            x = b.substr (header, size);
+            b = b.substr (header + size);
+            return true;
+        }
+        
+        bool read_push (bytes_view &b, bytes_view &x, size_t size) {
+            return read_push (b, x) && x.size () == size;
+        }
+        
+        const byte boostpow[8] {0x62, 0x6F, 0x6F, 0x73, 0x74, 0x70, 0x6F, 0x77};
+        
+        // Everything in an output script after the additional data, which is
+        // the same for every script of each version. We get it by writing a
+        // script and skipping over the pushes at the start.
+        bytes output_suffix (bool use_general_purpose_bits) {
+            script x = output_script::bounty (int32_little {1}, uint256 {}, work::compact {uint32 {0x1d00ffff}},
+                bytes {}, uint32_little {0}, bytes {}, use_general_purpose_bits).write ();
+            
+            bytes_view b {x};
+            bytes_view field;
+            read_push (b, field);
+            b = b.substr (1);
+            for (int i = 0; i < 6; i++) read_push (b, field);
+            return bytes (b);
+        }
+        
+        bool equal (bytes_view a, bytes_view b) {
+            return a.size () == b.size () && std::equal (a.begin (), a.end (), b.begin ());
+        }
+        
+        template <typename X> X copy (bytes_view b) {
+            X x {};
+            std::copy (b.begin (), b.end (), x.data ());
+            return x;
+        }
+        
+    }
+    
+    output_view::output_view (bytes_view b) : Type {Boost::invalid}, UseGeneralPurposeBits {false},
+        MinerPubkeyHash {}, Category {}, Content {}, Target {}, Tag {}, UserNonce {}, AdditionalData {} {
+        
+        static const bytes suffix_v1 = output_suffix (false);
+        static const bytes suffix_v2 = output_suffix (true);
+        
+        bytes_view x, miner, category, content, target, tag, user_nonce, data;
+        
+        if (!read_push (b, x, 8) || !equal (x, bytes_view {boostpow, 8})) return;
+        if (b.size () == 0 || b[0] != OP_DROP) return;
+        b = b.substr (1);
+        
+        // the miner pubkey hash is only in contract scripts, and the
+        // category after it is a different size, so we can tell which we have.
+        if (!read_push (b, x)) return;
+        if (x.size () == 20) {
+            miner = x;
+            if (!read_push (b, category, 4)) return;
+        } else if (x.size () == 4) category = x;
+        else return;
+        
+        if (!read_push (b, content, 32) || !read_push (b, target, 4) || !read_push (b, tag) ||
+            tag.size () > 20 || !read_push (b, user_nonce, 4) || !read_push (b, data)) return;
+        
+        if (equal (b, suffix_v2)) UseGeneralPurposeBits = true;
+        else if (!equal (b, suffix_v1)) return;
+        
+        Type = miner.size () == 0 ? Boost::bounty : Boost::contract;
+        MinerPubkeyHash = miner;
+        Category = category;
+        Content = content;
+        Target = target;
+        Tag = tag;
+        UserNonce = user_nonce;
+        AdditionalData = data;
+    }
+    
+    int32_little output_view::category () const {
+        return copy<int32_little> (Category);
+    }
+    
+    uint16_little output_view::magic_number () const {
+        return work::ASICBoost::magic_number (category ());
+    }
+    
+    uint256 output_view::content () const {
+        return copy<uint256> (Content);
+    }
+    
+    work::compact output_view::target () const {
+        return copy<work::compact> (Target);
+    }
+    
+    uint32_little output_view::user_nonce () const {
+        return copy<uint32_little> (UserNonce);
+    }
+    
+    digest160 output_view::miner_pubkey_hash () const {
+        return copy<digest160> (MinerPubkeyHash);
+    }
+    
+    output_view::operator output_script () const {
+        if (Type == Boost::invalid) return {};
+        if (Type == Boost::bounty) return output_script::bounty (category (), content (), target (),
+            bytes (Tag), user_nonce (), bytes (AdditionalData), UseGeneralPurposeBits);
+        return output_script::contract (category (), content (), target (),
+            bytes (Tag), user_nonce (), bytes (AdditionalData), miner_pubkey_hash (), UseGeneralPurposeBits);
+    }
+    
+    input_view::input_view (bytes_view b) : Type {Boost::invalid}, Signature {}, Pubkey {}, Nonce {},
+        Timestamp {}, ExtraNonce2 {}, ExtraNonce1 {}, GeneralPurposeBits {}, MinerPubkeyHash {} {
+        
+        bytes_view x, signature, pubkey, nonce, timestamp, extra_nonce_2, extra_nonce_1, bits, miner;
+        
+        if (!read_push (b, signature) || !read_push (b, pubkey) || (pubkey.size () != 33 && pubkey.size () != 65) ||
+            !read_push (b, nonce, 4) || !read_push (b, timestamp, 4) || !read_push (b, extra_nonce_2) ||
+            !read_push (b, extra_nonce_1, 4)) return;
+        
+        // general purpose bits and then the miner pubkey hash, either of which may be missing.
+        if (b.size () != 0) {
+            if (!read_push (b, x)) return;
+            if (x.size () == 4) bits = x;
+            else if (x.size () == 20) miner = x;
+            else return;
+        }
+        
+        if (b.size () != 0 && miner.size () == 0 && !read_push (b, miner, 20)) return;
+        if (b.size () != 0) return;
+        
+        if (bits.size () == 0 ? extra_nonce_2.size () != 8 : extra_nonce_2.size () > 32) return;
+        
+        Type = miner.size () == 0 ? Boost::contract : Boost::bounty;
+        Signature = signature;
+        Pubkey = pubkey;
+        Nonce = nonce;
+        Timestamp = timestamp;
+        ExtraNonce2 = extra_nonce_2;
+        ExtraNonce1 = extra_nonce_1;
+        GeneralPurposeBits = bits;
+        MinerPubkeyHash = miner;
+    }
+    
+    uint32_little input_view::nonce () const {
+        return copy<uint32_little> (Nonce);
+    }
+    
+    Bitcoin::timestamp input_view::timestamp () const {
+        Bitcoin::timestamp t {};
+        std::copy (Timestamp.begin (), Timestamp.end (), t.data ());
+        return t;
+    }
+    
+    Stratum::session_id input_view::extra_nonce_1 () const {
+        Stratum::session_id n {};
+        std::copy (ExtraNonce1.begin (), ExtraNonce1.end (), n.data ());
+        return n;
+    }
+    
+    maybe<int32_little> input_view::general_purpose_bits () const {
+        if (GeneralPurposeBits.size () == 0) return {};
+        return copy<int32_little> (GeneralPurposeBits);
+    }
+    
+    digest160 input_view::miner_pubkey_hash () const {
+        return copy<digest160> (MinerPubkeyHash);
+    }
+    
+    work::solution input_view::solution () const {
+        maybe<int32_little> bits = general_purpose_bits ();
+        return work::solution {bool (bits) ?
+            work::share {timestamp (), nonce (), bytes (ExtraNonce2), *bits} :
+            work::share {timestamp (), nonce (), bytes (ExtraNonce2)}, extra_nonce_1 ()};
+    }
+    
+    input_view::operator input_script () const {
+        if (Type == Boost::invalid) return {};
+        
+        Bitcoin::signature signature {};
+        signature.resize (Signature.size ());
+        std::copy (Signature.begin (), Signature.end (), signature.begin ());
+        
+        Bitcoin::pubkey pubkey {};
+        pubkey.resize (Pubkey.size ());
+        std::copy (Pubkey.begin (), Pubkey.end (), pubkey.begin ());
+        
+        maybe<int32_little> bits = general_purpose_bits ();
+        
+        if (Type == Boost::bounty) return bool (bits) ?
+            input_script::bounty (signature, pubkey, nonce (), timestamp (), bytes (ExtraNonce2), extra_nonce_1 (), *bits, miner_pubkey_hash ()) :
+            input_script::bounty (signature, pubkey, nonce (), timestamp (), bytes (ExtraNonce2), extra_nonce_1 (), miner_pubkey_hash ());
+        
+        return bool (bits) ?
+            input_script::contract (signature, pubkey, nonce (), timestamp (), bytes (ExtraNonce2), extra_nonce_1 (), *bits) :
+            input_script::contract (signature, pubkey, nonce (), timestamp (), bytes (ExtraNonce2), extra_nonce_1 ());
+    }
+    
 }
@@ -0,0 +1,120 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/boost/job_index.hpp>
+
+namespace Gigamonkey::Boost {
+    
+    bool job_index::add (const Bitcoin::outpoint &o, Bitcoin::satoshi value, bytes_view script) {
+        output_view v {script};
+        if (!v.valid ()) return false;
+        
+        double d = double (work::difficulty (v.target ()));
+        if (!(d > 0)) return false;
+        
+        digest256 id = SHA2_256 (script);
+        
+        {
+            std::unique_lock<std::shared_mutex> lock (Mutex);
+            if (Outputs.find (o) != Outputs.end ()) return false;
+            
+            auto e = Entries.find (id);
+            if (e == Entries.end ()) e = Entries.emplace (id, entry {candidate {bytes (script), {}}, {}, 0, d}).first;
+            else Ranking.erase (rank {e->second.profitability (), id});
+            
+            entry &x = e->second;
+            x.Outputs[o] = value;
+            x.Value += int64 (value);
+            x.Candidate = candidate {x.Candidate.Script, x.Candidate.Prevouts << candidate::prevout {o, value}};
+            
+            Outputs[o] = id;
+            Ranking.insert (rank {x.profitability (), id});
+        }
+        
+        Added.notify_all ();
+        return true;
+    }
+    
+    bool job_index::add (const Bitcoin::prevout &p) {
+        return add (p.outpoint (), p.value (), p.script ());
+    }
+    
+    bool job_index::remove (const Bitcoin::outpoint &o) {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        
+        auto out = Outputs.find (o);
+        if (out == Outputs.end ()) return false;
+        
+        digest256 id = out->second;
+        Outputs.erase (out);
+        
+        auto e = Entries.find (id);
+        entry &x = e->second;
+        Ranking.erase (rank {x.profitability (), id});
+        
+        auto v = x.Outputs.find (o);
+        x.Value -= int64 (v->second);
+        x.Outputs.erase (v);
+        
+        if (x.Outputs.empty ()) {
+            Entries.erase (e);
+            return true;
+        }
+        
+        // sets of prevouts are only added to, so we make a new one.
+        set<candidate::prevout> prevouts {};
+        for (const auto &p : x.Outputs) prevouts = prevouts << candidate::prevout {p.first, p.second};
+        x.Candidate = candidate {x.Candidate.Script, prevouts};
+        
+        Ranking.insert (rank {x.profitability (), id});
+        return true;
+    }
+    
+    maybe<candidate> job_index::best () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        if (Ranking.empty ()) return {};
+        return Entries.at (Ranking.begin ()->second).Candidate;
+    }
+    
+    std::vector<candidate> job_index::top (size_t n) const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        std::vector<candidate> x;
+        for (auto r = Ranking.begin (); r != Ranking.end () && x.size () < n; r++) x.push_back (Entries.at (r->second).Candidate);
+        return x;
+    }
+    
+    candidate job_index::wait () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        Added.wait (lock, [this] () {
+            return !Ranking.empty ();
+        });
+        
+        return Entries.at (Ranking.begin ()->second).Candidate;
+    }
+    
+    size_t job_index::size () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Outputs.size ();
+    }
+    
+    size_t job_index::candidates () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Entries.size ();
+    }
+    
+    work::puzzle job_selector::select () {
+        Boost::puzzle p {Index.wait (), MinerKey};
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Selected = p;
+        }
+        
+        return work::puzzle (p);
+    }
+    
+    Boost::puzzle job_selector::selected () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Selected;
+    }
+    
+}
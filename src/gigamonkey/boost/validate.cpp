@@ -0,0 +1,114 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/boost/validate.hpp>
+#include <gigamonkey/work/ASICBoost.hpp>
+#include <gigamonkey/sha256.hpp>
+
+namespace Gigamonkey::Boost {
+    
+    namespace {
+        
+        struct decoded {
+            output_view Output;
+            input_view Input;
+            
+            decoded (const redemption &r) : Output {r.OutputScript}, Input {r.InputScript} {}
+            
+            bool valid () const {
+                return Output.valid () && Input.valid () && Output.Type == Input.Type &&
+                    Output.UseGeneralPurposeBits == (Input.GeneralPurposeBits.size () != 0);
+            }
+            
+            bytes_view miner_pubkey_hash () const {
+                return Output.Type == bounty ? Input.MinerPubkeyHash : Output.MinerPubkeyHash;
+            }
+            
+            // the same as work::proof::string, but read directly from the scripts.
+            work::string string () const {
+                int32_little mask = Output.UseGeneralPurposeBits ? work::ASICBoost::Mask : int32_little {-1};
+                int32_little bits = Output.UseGeneralPurposeBits ? *Input.general_purpose_bits () & ~mask : int32_little {0};
+                
+                bytes_view mpkh = miner_pubkey_hash ();
+                bytes meta (Output.Tag.size () + mpkh.size () + Input.ExtraNonce1.size () +
+                    Input.ExtraNonce2.size () + Output.UserNonce.size () + Output.AdditionalData.size ());
+                
+                auto it = meta.begin ();
+                for (bytes_view b : {Output.Tag, mpkh, Input.ExtraNonce1, Input.ExtraNonce2, Output.UserNonce, Output.AdditionalData})
+                    it = std::copy (b.begin (), b.end (), it);
+                
+                return work::string {(Output.category () & mask) | bits, Output.content (),
+                    Bitcoin::Hash256 (meta), Input.timestamp (), Output.target (), Input.nonce ()};
+            }
+            
+            bool signature (const Bitcoin::sighash::document &doc) const {
+                return Bitcoin::Hash160 (Input.Pubkey) == copy (miner_pubkey_hash ()) &&
+                    Bitcoin::signature::verify (Input.Signature, Input.Pubkey, doc);
+            }
+            
+            static digest160 copy (bytes_view b) {
+                digest160 x {};
+                if (b.size () == 20) std::copy (b.begin (), b.end (), x.begin ());
+                return x;
+            }
+        };
+        
+        template <typename for_each>
+        std::vector<validation> validate (const std::vector<redemption> &redemptions, for_each &&each) {
+            std::vector<validation> results (redemptions.size (), validation {false, false, {}});
+            std::vector<decoded> scripts;
+            std::vector<size_t> valid;
+            scripts.reserve (redemptions.size ());
+            valid.reserve (redemptions.size ());
+            
+            for (size_t i = 0; i < redemptions.size (); i++) {
+                scripts.emplace_back (redemptions[i]);
+                if (!scripts[i].valid ()) continue;
+                results[i].Decoded = true;
+                valid.push_back (i);
+            }
+            
+            std::vector<work::compact> targets (valid.size ());
+            bytes in (80 * valid.size ());
+            bytes out (32 * valid.size ());
+            for (size_t j = 0; j < valid.size (); j++) {
+                work::string x = scripts[valid[j]].string ();
+                targets[j] = x.Target;
+                byte_array<80> header = x.write ();
+                std::copy (header.begin (), header.end (), in.begin () + 80 * j);
+            }
+            
+            sha256::double_hash_80 (out.data (), in.data (), valid.size ());
+            
+            for (size_t j = 0; j < valid.size (); j++) {
+                uint256 hash;
+                std::copy (out.begin () + 32 * j, out.begin () + 32 * j + 32, hash.data ());
+                results[valid[j]].Work = hash < targets[j].expand ();
+            }
+            
+            // there is no batch ECDSA verification in secp256k1, so
+            // signatures are checked one at a time, possibly in parallel.
+            each (valid.size (), [&] (size_t j) {
+                size_t i = valid[j];
+                if (redemptions[i].Document != nullptr)
+                    results[i].Signature = scripts[i].signature (*redemptions[i].Document);
+            });
+            
+            return results;
+        }
+        
+    }
+    
+    std::vector<validation> validate (const std::vector<redemption> &redemptions) {
+        return validate (redemptions, [] (size_t n, auto f) {
+            for (size_t j = 0; j < n; j++) f (j);
+        });
+    }
+    
+    std::vector<validation> validate (const std::vector<redemption> &redemptions, executor &e) {
+        return validate (redemptions, [&e] (size_t n, auto f) {
+            e.parallel_for (n, f);
+        });
+    }
+    
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/builder.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey {
+    
+    transaction_builder::transaction_builder (const transaction_design &d) :
+        Bytes (d.expected_size ()), Slots {}, FirstEmpty {0}, Hasher {}, Hashed {0} {
+        Slots.reserve (d.Inputs.size ());
+        
+        size_t at = 0;
+        auto write = [this, &at] (auto &&x, size_t size) {
+            bytes_writer {Bytes.begin () + at, Bytes.end ()} << x;
+            at += size;
+        };
+        
+        write (d.Version, 4);
+        write (Bitcoin::var_int {d.Inputs.size ()}, Bitcoin::var_int::size (d.Inputs.size ()));
+        
+        // the scripts are left as zeros.
+        for (const transaction_design::input &in : d.Inputs) {
+            write (in.Prevout.Key, 36);
+            Slots.push_back (slot {at, in.ExpectedScriptSize, false});
+            write (Bitcoin::var_int {in.ExpectedScriptSize}, Bitcoin::var_int::size (in.ExpectedScriptSize));
+            at += in.ExpectedScriptSize;
+            write (in.Sequence, 4);
+        }
+        
+        write (Bitcoin::var_int {d.Outputs.size ()}, Bitcoin::var_int::size (d.Outputs.size ()));
+        for (const Bitcoin::output &out : d.Outputs) write (out, out.serialized_size ());
+        write (d.Locktime, 4);
+        
+        hash ();
+    }
+    
+    void transaction_builder::set (size_t input, bytes_view script) {
+        if (input >= Slots.size ()) throw std::out_of_range {"no such input"};
+        slot &s = Slots[input];
+        
+        size_t old_size = Bitcoin::var_int::size (s.Size) + s.Size;
+        size_t new_size = Bitcoin::var_int::size (script.size ()) + script.size ();
+        
+        if (new_size != old_size) {
+            bytes b (Bytes.size () - old_size + new_size);
+            std::copy (Bytes.begin (), Bytes.begin () + s.Offset, b.begin ());
+            std::copy (Bytes.begin () + s.Offset + old_size, Bytes.end (), b.begin () + s.Offset + new_size);
+            Bytes = std::move (b);
+            for (size_t i = input + 1; i < Slots.size (); i++) Slots[i].Offset = Slots[i].Offset + new_size - old_size;
+        }
+        
+        bytes_writer {Bytes.begin () + s.Offset, Bytes.end ()} << Bitcoin::var_int {script.size ()} << script;
+        s.Size = script.size ();
+        s.Filled = true;
+        
+        // the slot was hashed already, so we start again.
+        if (s.Offset < Hashed) {
+            Hasher.Reset ();
+            Hashed = 0;
+        }
+        
+        while (FirstEmpty < Slots.size () && Slots[FirstEmpty].Filled) FirstEmpty++;
+        hash ();
+    }
+    
+    void transaction_builder::hash () {
+        size_t end = complete () ? Bytes.size () : Slots[FirstEmpty].Offset;
+        if (end <= Hashed) return;
+        Hasher.Write (Bytes.data () + Hashed, end - Hashed);
+        Hashed = end;
+    }
+    
+    Bitcoin::txid transaction_builder::id () const {
+        if (!complete ()) throw std::logic_error {"transaction is not complete"};
+        
+        byte first[32];
+        sha256::hasher h = Hasher;
+        h.Finalize (first);
+        
+        Bitcoin::txid x;
+        sha256::hasher {}.Write (first, 32).Finalize (x.Value.data ());
+        return x;
+    }
+    
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/coin_selection.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        // the inputs chosen so far with their total value and size.
+        struct running {
+            // the size of everything but the inputs and the number of inputs.
+            uint64 Fixed;
+            uint64 InputSize {0};
+            uint64 Count {0};
+            int64 Value {0};
+            
+            explicit running (uint64 fixed) : Fixed {fixed} {}
+            
+            void add (const coin_selector::candidate &c) {
+                InputSize += c.serialized_size ();
+                Count++;
+                Value += int64 (c.Prevout.value ());
+            }
+            
+            void remove (const coin_selector::candidate &c) {
+                InputSize -= c.serialized_size ();
+                Count--;
+                Value -= int64 (c.Prevout.value ());
+            }
+            
+            uint64 size () const {
+                return Fixed + Bitcoin::var_int::size (Count) + InputSize;
+            }
+            
+            // what is left after paying sent and the fee.
+            int64 excess (int64 sent, satoshi_per_byte rate) const {
+                return Value - sent - int64 (calculate_fee (rate, size ()));
+            }
+        };
+        
+        struct option {
+            size_t Index;
+            
+            // the value minus the fee for including it.
+            double Effective;
+        };
+        
+    }
+    
+    coin_selector::coin_selector (std::vector<candidate> c, const options &o) : Candidates {c}, Options {o} {}
+    
+    maybe<transaction_design> coin_selector::select (list<Bitcoin::output> payments, satoshi_per_byte rate, const bytes &change_script) const {
+        if (!rate.valid ()) throw data::math::division_by_zero {};
+        double per_byte = double (int64 (rate.Satoshis)) / double (rate.Bytes);
+        
+        int64 sent = 0;
+        uint64 outputs_size = 0;
+        for (const Bitcoin::output &o : payments) {
+            sent += int64 (o.Value);
+            outputs_size += o.serialized_size ();
+        }
+        
+        bool make_change = change_script.size () > 0;
+        uint64 change_size = Bitcoin::output {0, change_script}.serialized_size ();
+        
+        // sizes of everything but the inputs, with and without change.
+        uint64 fixed = 8 + Bitcoin::var_int::size (payments.size ()) + outputs_size;
+        uint64 fixed_with_change = 8 + Bitcoin::var_int::size (payments.size () + 1) + outputs_size + change_size;
+        
+        // without change, we may pay up to this much more than we need to.
+        int64 cost_of_change = make_change ?
+            int64 (calculate_fee (rate, change_size + Options.ChangeInputSize)) + int64 (Options.Dust) :
+            std::numeric_limits<int64>::max () / 2;
+        
+        // candidates that are worth more than it costs to spend them, most valuable first.
+        std::vector<option> options;
+        options.reserve (Candidates.size ());
+        for (size_t i = 0; i < Candidates.size (); i++) {
+            double effective = double (int64 (Candidates[i].Prevout.value ())) - per_byte * double (Candidates[i].serialized_size ());
+            if (effective > 0) options.push_back (option {i, effective});
+        }
+        
+        std::sort (options.begin (), options.end (), [] (const option &a, const option &b) {
+            return a.Effective > b.Effective;
+        });
+        
+        auto finish = [&] (const std::vector<size_t> &chosen) -> transaction_design {
+            list<transaction_design::input> inputs;
+            running with_change {fixed_with_change};
+            for (size_t i : chosen) {
+                inputs = inputs << Candidates[options[i].Index];
+                with_change.add (Candidates[options[i].Index]);
+            }
+            
+            list<Bitcoin::output> outputs = payments;
+            if (make_change) {
+                int64 change = with_change.excess (sent, rate);
+                if (change >= int64 (Options.Dust)) outputs = outputs << Bitcoin::output {Bitcoin::satoshi {change}, change_script};
+            }
+            
+            return transaction_design {Options.Version, inputs, outputs, Options.Locktime};
+        };
+        
+        // branch and bound. We go through the options in order, including each
+        // before trying without it, and go back when we are over the range we want
+        // or when what is left is not enough to get into it.
+        {
+            std::vector<double> left (options.size () + 1, 0);
+            for (size_t i = options.size (); i > 0; i--) left[i - 1] = left[i] + options[i - 1].Effective;
+            
+            double target = double (sent) + per_byte * double (fixed + 1);
+            double upper = target + double (cost_of_change);
+            
+            running current {fixed};
+            std::vector<size_t> chosen;
+            double value = 0;
+            size_t i = 0;
+            for (uint64 tries = 0; tries < Options.MaxTries; tries++) {
+                bool back = value + left[i] < target || value > upper;
+                
+                if (!back && value >= target) {
+                    int64 excess = current.excess (sent, rate);
+                    if (excess >= 0 && excess <= cost_of_change) return finish (chosen);
+                    back = true;
+                }
+                
+                if (back) {
+                    if (chosen.empty ()) break;
+                    i = chosen.back ();
+                    chosen.pop_back ();
+                    value -= options[i].Effective;
+                    current.remove (Candidates[options[i].Index]);
+                    i++;
+                    continue;
+                }
+                
+                chosen.push_back (i);
+                value += options[i].Effective;
+                current.add (Candidates[options[i].Index]);
+                i++;
+            }
+        }
+        
+        // the smallest candidate that pays for everything alone.
+        {
+            maybe<size_t> smallest;
+            for (size_t i = 0; i < options.size (); i++) {
+                const candidate &c = Candidates[options[i].Index];
+                running x {make_change ? fixed_with_change : fixed};
+                x.add (c);
+                if (x.excess (sent, rate) < (make_change ? int64 (Options.Dust) : 0)) continue;
+                if (!smallest || c.Prevout.value () < Candidates[options[*smallest].Index].Prevout.value ()) smallest = i;
+            }
+            
+            if (smallest) return finish (std::vector<size_t> {*smallest});
+        }
+        
+        // the largest candidates until there is enough.
+        running current {fixed};
+        std::vector<size_t> chosen;
+        for (size_t i = 0; i < options.size (); i++) {
+            chosen.push_back (i);
+            current.add (Candidates[options[i].Index]);
+            if (current.excess (sent, rate) >= 0) return finish (chosen);
+        }
+        
+        return {};
+    }
+    
+}
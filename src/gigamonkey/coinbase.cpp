@@ -0,0 +1,78 @@
+// Copyright (c) 2021 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/coinbase.hpp>
+
+namespace Gigamonkey::Bitcoin {
+    
+    transaction coinbase(script x, list<output> outs) {
+        return transaction{int32_little{1}, list<input>{input{outpoint::coinbase(), x, 0xffffffff}}, outs, 0};
+    }
+    
+    maybe<bytes_view> coinbase_script(bytes_view block) {
+        try {
+            read_cursor r{block.data(), block.data() + block.size()};
+            r.check(80);
+            r.skip(80);
+            if (r.get_var_int() == 0) return {};
+            
+            // the version of the coinbase.
+            r.check(4);
+            r.skip(4);
+            if (r.get_var_int() == 0) return {};
+            
+            // the outpoint of the first input.
+            r.check(36);
+            r.skip(36);
+            uint64 size = r.get_var_int();
+            r.check(size);
+            return bytes_view{r.It, size};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+    }
+    
+    namespace BIP34 {
+        
+        maybe<uint64> read(bytes_view script) {
+            if (script.size() == 0) return {};
+            byte op = script[0];
+            
+            // small numbers are pushed with OP_0 through OP_16.
+            if (op == 0x00) return uint64{0};
+            if (op >= 0x51 && op <= 0x60) return uint64{op - 0x50u};
+            
+            if (op > 8 || script.size() < size_t(op) + 1) return {};
+            
+            // little endian with the sign in the top bit of the last byte.
+            if (script[op] & 0x80) return {};
+            uint64 height = 0;
+            for (int i = op; i > 0; i--) height = (height << 8) | script[i];
+            return height;
+        }
+        
+        bytes write(uint64 height) {
+            if (height == 0) return bytes{0x00};
+            if (height <= 16) return bytes{byte(0x50 + height)};
+            
+            bytes b{0x00};
+            for (uint64 h = height; h > 0; h >>= 8) b.push_back(byte(h & 0xff));
+            
+            // a number whose top bit is set needs another byte so that it is not negative.
+            if (b.back() & 0x80) b.push_back(0x00);
+            b[0] = byte(b.size() - 1);
+            return b;
+        }
+        
+        bool valid(bytes_view block, uint64 height) {
+            if (block.size() < 80) return false;
+            read_cursor r{block.data(), block.data() + 4};
+            if (r.get_little<int32>() < 2) return true;
+            
+            maybe<uint64> h = BIP34::height(block);
+            return bool(h) && *h == height;
+        }
+        
+    }
+    
+}
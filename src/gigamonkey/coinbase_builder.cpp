@@ -0,0 +1,108 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/coinbase_builder.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey {
+
+    coinbase_builder::coinbase_builder (bytes script_prefix, bytes script_suffix,
+        size_t extra_nonce_size, const std::vector<Bitcoin::output> &outs) :
+        ScriptPrefix {std::move (script_prefix)}, ScriptSuffix {std::move (script_suffix)},
+        ExtraNonceSize {extra_nonce_size}, Header {}, Body {}, Offsets {}, Midstate {} {
+        write_header ();
+        set_outputs (outs);
+    }
+
+    // version, one input, the null outpoint, the size of the script and the prefix.
+    void coinbase_builder::write_header () {
+        uint64 script_size = ScriptPrefix.size () + ExtraNonceSize + ScriptSuffix.size ();
+        Header = bytes (4 + 1 + 36 + Bitcoin::var_int::size (script_size) + ScriptPrefix.size ());
+
+        Bitcoin::write_cursor w {Header.data (), Header.data () + Header.size ()};
+        w.put_little (int32 (1));
+        w.put_var_int (1);
+        for (int i = 0; i < 32; i++) w.put_little (byte (0));
+        w.put_little (uint32 (0xffffffff));
+        w.put_var_int (script_size);
+        w.put (ScriptPrefix);
+
+        Midstate = sha256::initial ();
+        sha256::transform (Midstate, Header.data (), midstate_size () / 64);
+    }
+
+    // the suffix, the sequence number, the outputs and the lock time.
+    void coinbase_builder::set_outputs (const std::vector<Bitcoin::output> &outs) {
+        size_t size = ScriptSuffix.size () + 4 + Bitcoin::var_int::size (outs.size ()) + 4;
+        for (const Bitcoin::output &o : outs) {
+            if (!o.valid ()) throw std::invalid_argument {"invalid coinbase output"};
+            size += 8 + Bitcoin::var_int::size (o.Script.size ()) + o.Script.size ();
+        }
+
+        Body = bytes (size);
+        Offsets.resize (outs.size ());
+
+        Bitcoin::write_cursor w {Body.data (), Body.data () + Body.size ()};
+        w.put (ScriptSuffix);
+        w.put_little (uint32 (0xffffffff));
+        w.put_var_int (outs.size ());
+        for (size_t i = 0; i < outs.size (); i++) {
+            Offsets[i] = w.It - Body.data ();
+            w.put (outs[i].Value.data (), 8);
+            w.put_var_string (outs[i].Script);
+        }
+
+        w.put_little (uint32 (0));
+    }
+
+    bytes coinbase_builder::coinbase (bytes_view extra_nonces) const {
+        if (extra_nonces.size () != ExtraNonceSize) throw std::invalid_argument {"extra nonces are the wrong size"};
+        bytes x (Header.size () + extra_nonces.size () + Body.size ());
+        auto it = std::copy (Header.begin (), Header.end (), x.begin ());
+        it = std::copy (extra_nonces.begin (), extra_nonces.end (), it);
+        std::copy (Body.begin (), Body.end (), it);
+        return x;
+    }
+
+    Bitcoin::satoshi coinbase_builder::value (size_t index) const {
+        Bitcoin::satoshi v;
+        const byte *b = Body.data () + Offsets.at (index);
+        std::copy (b, b + 8, v.begin ());
+        return v;
+    }
+
+    void coinbase_builder::set_value (size_t index, Bitcoin::satoshi v) {
+        std::copy (v.begin (), v.end (), Body.begin () + Offsets.at (index));
+    }
+
+    size_t coinbase_builder::set_values (const std::vector<Bitcoin::satoshi> &values) {
+        if (values.size () != Offsets.size ()) throw std::invalid_argument {"wrong number of coinbase amounts"};
+
+        size_t changed = 0;
+        for (size_t i = 0; i < values.size (); i++) {
+            byte *b = Body.data () + Offsets[i];
+            if (std::equal (values[i].begin (), values[i].end (), b)) continue;
+            std::copy (values[i].begin (), values[i].end (), b);
+            changed++;
+        }
+
+        return changed;
+    }
+
+    void coinbase_builder::set_script_prefix (bytes_view prefix) {
+        if (prefix.size () != ScriptPrefix.size ()) {
+            ScriptPrefix = bytes (prefix.size ());
+            std::copy (prefix.begin (), prefix.end (), ScriptPrefix.begin ());
+            return write_header ();
+        }
+
+        std::copy (prefix.begin (), prefix.end (), ScriptPrefix.begin ());
+        std::copy (prefix.begin (), prefix.end (), Header.end () - prefix.size ());
+
+        if (Header.size () - prefix.size () >= midstate_size ()) return;
+        Midstate = sha256::initial ();
+        sha256::transform (Midstate, Header.data (), midstate_size () / 64);
+    }
+
+}
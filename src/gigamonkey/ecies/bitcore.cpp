@@ -3,15 +3,118 @@
 
 #include <gigamonkey/ecies/bitcore.hpp>
 
+#include "cryptopp/osrng.h"
+
+#include <stdexcept>
+
 namespace Gigamonkey::ECIES::bitcore {
     
+    namespace {
+        constexpr size_t key_size = secp256k1::pubkey::CompressedSize;
+        constexpr size_t iv_size = 16;
+        
+        // the AES key and the mac key.
+        std::array<byte, 64> derive(const secp256k1::parsed_pubkey &point) {
+            byte shared[key_size];
+            if (!point.compress().serialize(shared)) throw std::logic_error{"could not derive shared secret"};
+            std::array<byte, 64> key;
+            CryptoPP::SHA512{}.CalculateDigest(key.data(), shared + 1, 32);
+            return key;
+        }
+        
+        // an ephemeral key and an iv.
+        std::pair<secp256k1::secret, bytes> random_keys() {
+            CryptoPP::AutoSeededRandomPool random;
+            secp256k1::secret x;
+            do {
+                random.GenerateBlock(x.Value.data(), x.Value.size());
+            } while (!x.valid());
+            
+            bytes iv(iv_size);
+            random.GenerateBlock(iv.data(), iv_size);
+            return {x, iv};
+        }
+    }
+    
+    encryptor::encryptor(writer &out, const secp256k1::pubkey &to) : encryptor{out, to, random_keys()} {}
+    
+    encryptor::encryptor(writer &out, const secp256k1::pubkey &to, const std::pair<secp256k1::secret, bytes> &keys) :
+        encryptor{out, to, keys.first, keys.second} {}
+    
+    encryptor::encryptor(writer &out, const secp256k1::pubkey &to, const secp256k1::secret &ephemeral, bytes_view iv) : Cipher{} {
+        secp256k1::parsed_pubkey point{to};
+        if (!point.valid()) throw std::invalid_argument{"invalid public key"};
+        if (!ephemeral.valid()) throw std::invalid_argument{"invalid ephemeral key"};
+        if (iv.size() != iv_size) throw std::invalid_argument{"iv must be 16 bytes"};
+        
+        // the ephemeral key is not covered by the mac.
+        secp256k1::pubkey r = ephemeral.to_public().compress();
+        out.write(r.data(), r.size());
+        
+        std::array<byte, 64> key = derive(point * ephemeral.Value);
+        bytes_view k{key.data(), key.size()};
+        Cipher = std::make_shared<cbc_hmac_encryptor>(out, k.substr(0, 32), iv, k.substr(32, 32));
+        Cipher->authenticated(iv);
+    }
+    
+    void encryptor::write(const byte *b, size_t size) {
+        Cipher->write(bytes_view{b, size});
+    }
+    
+    void encryptor::finish() {
+        Cipher->finish();
+    }
+    
+    decryptor::decryptor(writer &out, const secp256k1::secret &to) :
+        Out{out}, To{to}, Header{}, Cipher{}, Invalid{false} {
+        if (!to.valid()) throw std::invalid_argument{"invalid secret key"};
+    }
+    
+    void decryptor::write(const byte *b, size_t size) {
+        if (Invalid) return;
+        bytes_view x{b, size};
+        
+        if (Cipher == nullptr) {
+            size_t n = std::min(key_size + iv_size - Header.size(), x.size());
+            Header.insert(Header.end(), x.begin(), x.begin() + n);
+            x = x.substr(n);
+            if (Header.size() < key_size + iv_size) return;
+            
+            secp256k1::parsed_pubkey r{bytes_view{Header}.substr(0, key_size)};
+            if (!r.valid()) {
+                Invalid = true;
+                return;
+            }
+            
+            bytes_view iv = bytes_view{Header}.substr(key_size);
+            std::array<byte, 64> key = derive(r * To.Value);
+            bytes_view k{key.data(), key.size()};
+            Cipher = std::make_shared<cbc_hmac_decryptor>(Out, k.substr(0, 32), iv, k.substr(32, 32));
+            Cipher->authenticated(iv);
+        }
+        
+        Cipher->write(x);
+    }
+    
+    bool decryptor::finish() {
+        if (Invalid || Cipher == nullptr) return false;
+        return Cipher->finish();
+    }
+    
     bytes encrypt(const bytes message, const secp256k1::pubkey& to) {
-        throw method::unimplemented{"bitcore::encrypt"};
+        lazy_bytes_writer w;
+        encryptor e{w, to};
+        e.write(message.data(), message.size());
+        e.finish();
+        return w;
     }
         
     bytes decrypt(const bytes message, const secp256k1::secret& to) {
-        throw method::unimplemented{"bitcore::decrypt"};
+        lazy_bytes_writer w;
+        decryptor d{w, to};
+        d.write(message.data(), message.size());
+        if (!d.finish()) throw std::invalid_argument{"could not decrypt message"};
+        return w;
     }
     
 }
-
@@ -0,0 +1,141 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/ecies/cbc_hmac.hpp>
+
+#include "cryptopp/misc.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::ECIES {
+    
+    namespace {
+        constexpr size_t block_size = 16;
+        constexpr size_t mac_size = 32;
+        
+        // cipher text is processed this much at a time.
+        constexpr size_t chunk_size = 4096;
+        
+        void check_keys(bytes_view key, bytes_view iv) {
+            if (key.size() != 16 && key.size() != 32) throw std::invalid_argument{"AES key must be 16 or 32 bytes"};
+            if (iv.size() != block_size) throw std::invalid_argument{"AES iv must be 16 bytes"};
+        }
+    }
+    
+    cbc_hmac_encryptor::cbc_hmac_encryptor(writer &out, bytes_view key, bytes_view iv, bytes_view mac_key) :
+        Out{out}, Cipher{}, MAC{mac_key.data(), mac_key.size()}, Buffer{}, Buffered{0}, Finished{false} {
+        check_keys(key, iv);
+        Cipher.SetKeyWithIV(key.data(), key.size(), iv.data(), iv.size());
+    }
+    
+    void cbc_hmac_encryptor::emit(const byte *b, size_t size) {
+        MAC.Update(b, size);
+        Out.write(b, size);
+    }
+    
+    void cbc_hmac_encryptor::authenticated(bytes_view b) {
+        if (Finished) throw std::logic_error{"encryption is finished"};
+        emit(b.data(), b.size());
+    }
+    
+    void cbc_hmac_encryptor::write(bytes_view b) {
+        if (Finished) throw std::logic_error{"encryption is finished"};
+        
+        byte encrypted[chunk_size];
+        
+        // fill up a block that we already started.
+        if (Buffered > 0) {
+            size_t n = std::min(block_size - Buffered, b.size());
+            std::copy(b.begin(), b.begin() + n, Buffer + Buffered);
+            Buffered += n;
+            b = b.substr(n);
+            if (Buffered < block_size) return;
+            
+            Cipher.ProcessData(encrypted, Buffer, block_size);
+            emit(encrypted, block_size);
+            Buffered = 0;
+        }
+        
+        while (b.size() >= block_size) {
+            size_t n = std::min(chunk_size, b.size() - b.size() % block_size);
+            Cipher.ProcessData(encrypted, b.data(), n);
+            emit(encrypted, n);
+            b = b.substr(n);
+        }
+        
+        std::copy(b.begin(), b.end(), Buffer);
+        Buffered = b.size();
+    }
+    
+    void cbc_hmac_encryptor::finish() {
+        if (Finished) throw std::logic_error{"encryption is finished"};
+        Finished = true;
+        
+        // there is always at least one byte of padding.
+        byte padding = byte(block_size - Buffered);
+        std::fill(Buffer + Buffered, Buffer + block_size, padding);
+        
+        byte encrypted[block_size];
+        Cipher.ProcessData(encrypted, Buffer, block_size);
+        emit(encrypted, block_size);
+        
+        byte mac[mac_size];
+        MAC.Final(mac);
+        Out.write(mac, mac_size);
+    }
+    
+    cbc_hmac_decryptor::cbc_hmac_decryptor(writer &out, bytes_view key, bytes_view iv, bytes_view mac_key) :
+        Out{out}, Cipher{}, MAC{mac_key.data(), mac_key.size()}, Tail{}, Finished{false} {
+        check_keys(key, iv);
+        Cipher.SetKeyWithIV(key.data(), key.size(), iv.data(), iv.size());
+    }
+    
+    void cbc_hmac_decryptor::authenticated(bytes_view b) {
+        if (Finished) throw std::logic_error{"decryption is finished"};
+        MAC.Update(b.data(), b.size());
+    }
+    
+    void cbc_hmac_decryptor::write(bytes_view b) {
+        if (Finished) throw std::logic_error{"decryption is finished"};
+        
+        byte decrypted[chunk_size];
+        
+        while (b.size() > 0) {
+            size_t n = std::min(chunk_size, b.size());
+            Tail.insert(Tail.end(), b.begin(), b.begin() + n);
+            b = b.substr(n);
+            
+            if (Tail.size() <= block_size + mac_size) continue;
+            size_t ready = (Tail.size() - block_size - mac_size) / block_size * block_size;
+            
+            MAC.Update(Tail.data(), ready);
+            Cipher.ProcessData(decrypted, Tail.data(), ready);
+            Out.write(decrypted, ready);
+            Tail.erase(Tail.begin(), Tail.begin() + ready);
+        }
+    }
+    
+    bool cbc_hmac_decryptor::finish() {
+        if (Finished) throw std::logic_error{"decryption is finished"};
+        Finished = true;
+        
+        if (Tail.size() != block_size + mac_size) return false;
+        
+        MAC.Update(Tail.data(), block_size);
+        byte mac[mac_size];
+        MAC.Final(mac);
+        if (!CryptoPP::VerifyBufsEqual(mac, Tail.data() + block_size, mac_size)) return false;
+        
+        byte last[block_size];
+        Cipher.ProcessData(last, Tail.data(), block_size);
+        
+        byte padding = last[block_size - 1];
+        if (padding == 0 || padding > block_size) return false;
+        for (size_t i = block_size - padding; i < block_size; i++) if (last[i] != padding) return false;
+        
+        Out.write(last, block_size - padding);
+        return true;
+    }
+    
+}
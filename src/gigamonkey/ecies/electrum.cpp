@@ -3,17 +3,241 @@
 
 #include <gigamonkey/ecies/electrum.hpp>
 
+#include "cryptopp/osrng.h"
+
+#include <boost/endian/conversion.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
 namespace Gigamonkey::ECIES::electrum {
     
+    namespace {
+        const byte magic[4] = {'B', 'I', 'E', '1'};
+        constexpr size_t header_size = 4 + secp256k1::pubkey::CompressedSize;
+        
+        const byte envelope_magic[4] = {'B', 'I', 'E', 'M'};
+        
+        // the magic bytes, the ephemeral key and the number of recipients.
+        constexpr size_t envelope_prefix_size = 4 + secp256k1::pubkey::CompressedSize + 4;
+        
+        // a content key with its padding and mac.
+        constexpr size_t content_key_size = 64;
+        constexpr size_t recipient_size = content_key_size + 16 + 32;
+        
+        // the iv, the AES key, and the mac key.
+        std::array<byte, 64> derive(const secp256k1::pubkey &point) {
+            secp256k1::pubkey shared = point.compress();
+            std::array<byte, 64> key;
+            CryptoPP::SHA512{}.CalculateDigest(key.data(), shared.data(), shared.size());
+            return key;
+        }
+        
+        bytes random_bytes(size_t size) {
+            CryptoPP::AutoSeededRandomPool random;
+            bytes x(size);
+            random.GenerateBlock(x.data(), x.size());
+            return x;
+        }
+        
+        secp256k1::secret random_secret() {
+            CryptoPP::AutoSeededRandomPool random;
+            secp256k1::secret x;
+            do {
+                random.GenerateBlock(x.Value.data(), x.Value.size());
+            } while (!x.valid());
+            return x;
+        }
+    }
+    
+    encryptor::encryptor(writer &out, const secp256k1::pubkey &to) : encryptor{out, to, random_secret()} {}
+    
+    encryptor::encryptor(writer &out, const secp256k1::pubkey &to, const secp256k1::secret &ephemeral) : Cipher{} {
+        if (!to.valid()) throw std::invalid_argument{"invalid public key"};
+        if (!ephemeral.valid()) throw std::invalid_argument{"invalid ephemeral key"};
+        
+        std::array<byte, 64> key = derive(to * ephemeral);
+        bytes_view k{key.data(), key.size()};
+        Cipher = std::make_shared<cbc_hmac_encryptor>(out, k.substr(16, 16), k.substr(0, 16), k.substr(32, 32));
+        
+        secp256k1::pubkey r = ephemeral.to_public().compress();
+        Cipher->authenticated(bytes_view{magic, 4});
+        Cipher->authenticated(r);
+    }
+    
+    void encryptor::write(const byte *b, size_t size) {
+        Cipher->write(bytes_view{b, size});
+    }
+    
+    void encryptor::finish() {
+        Cipher->finish();
+    }
+    
+    decryptor::decryptor(writer &out, const secp256k1::secret &to) :
+        Out{out}, To{to}, Header{}, Cipher{}, Invalid{false} {
+        if (!to.valid()) throw std::invalid_argument{"invalid secret key"};
+    }
+    
+    void decryptor::write(const byte *b, size_t size) {
+        if (Invalid) return;
+        bytes_view x{b, size};
+        
+        if (Cipher == nullptr) {
+            size_t n = std::min(header_size - Header.size(), x.size());
+            Header.insert(Header.end(), x.begin(), x.begin() + n);
+            x = x.substr(n);
+            if (Header.size() < header_size) return;
+            
+            secp256k1::pubkey r{bytes_view{Header}.substr(4)};
+            if (!std::equal(magic, magic + 4, Header.begin()) || !r.valid()) {
+                Invalid = true;
+                return;
+            }
+            
+            std::array<byte, 64> key = derive(r * To);
+            bytes_view k{key.data(), key.size()};
+            Cipher = std::make_shared<cbc_hmac_decryptor>(Out, k.substr(16, 16), k.substr(0, 16), k.substr(32, 32));
+            Cipher->authenticated(Header);
+        }
+        
+        Cipher->write(x);
+    }
+    
+    bool decryptor::finish() {
+        if (Invalid || Cipher == nullptr) return false;
+        return Cipher->finish();
+    }
+    
     bytes encrypt(const bytes message, const secp256k1::pubkey& to) {
-        throw method::unimplemented{"electrum::encrypt"};
+        lazy_bytes_writer w;
+        encryptor e{w, to};
+        e.write(message.data(), message.size());
+        e.finish();
+        return w;
     }
         
     bytes decrypt(const bytes message, const secp256k1::secret& to) {
-        throw method::unimplemented{"electrum::decrypt"};
+        lazy_bytes_writer w;
+        decryptor d{w, to};
+        d.write(message.data(), message.size());
+        if (!d.finish()) throw std::invalid_argument{"could not decrypt message"};
+        return w;
+    }
+    
+    envelope_encryptor::envelope_encryptor(writer &out, const std::vector<secp256k1::pubkey> &to) :
+        envelope_encryptor{out, to, random_secret()} {}
+    
+    envelope_encryptor::envelope_encryptor(writer &out, const std::vector<secp256k1::pubkey> &to,
+        const secp256k1::secret &ephemeral) : Cipher{} {
+        if (to.empty() || to.size() > max_recipients) throw std::invalid_argument{"invalid number of recipients"};
+        if (!ephemeral.valid()) throw std::invalid_argument{"invalid ephemeral key"};
+        for (const secp256k1::pubkey &p : to) if (!p.valid()) throw std::invalid_argument{"invalid public key"};
+        
+        // the content key is the iv, the AES key, and the mac key, like a derived key.
+        bytes content = random_bytes(content_key_size);
+        
+        lazy_bytes_writer header;
+        secp256k1::pubkey r = ephemeral.to_public().compress();
+        byte count[4];
+        boost::endian::store_little_u32(count, uint32(to.size()));
+        header.write(envelope_magic, 4);
+        header.write(r.data(), r.size());
+        header.write(count, 4);
+        
+        for (const secp256k1::pubkey &p : to) {
+            std::array<byte, 64> key = derive(p * ephemeral);
+            bytes_view k{key.data(), key.size()};
+            cbc_hmac_encryptor c{header, k.substr(16, 16), k.substr(0, 16), k.substr(32, 32)};
+            c.write(content);
+            c.finish();
+        }
+        
+        bytes_view c{content};
+        Cipher = std::make_shared<cbc_hmac_encryptor>(out, c.substr(16, 16), c.substr(0, 16), c.substr(32, 32));
+        Cipher->authenticated(bytes(header));
+    }
+    
+    void envelope_encryptor::write(const byte *b, size_t size) {
+        Cipher->write(bytes_view{b, size});
+    }
+    
+    void envelope_encryptor::finish() {
+        Cipher->finish();
+    }
+    
+    envelope_decryptor::envelope_decryptor(writer &out, const secp256k1::secret &to) :
+        Out{out}, To{to}, Header{}, HeaderSize{envelope_prefix_size}, Key{}, Cipher{}, Invalid{false} {
+        if (!to.valid()) throw std::invalid_argument{"invalid secret key"};
+    }
+    
+    // called when the header has as much as we know to ask for.
+    void envelope_decryptor::read_header() {
+        if (HeaderSize == envelope_prefix_size) {
+            secp256k1::pubkey r{bytes_view{Header}.substr(4, secp256k1::pubkey::CompressedSize)};
+            uint32 count = boost::endian::load_little_u32(Header.data() + envelope_prefix_size - 4);
+            if (!std::equal(envelope_magic, envelope_magic + 4, Header.begin()) || !r.valid() ||
+                count == 0 || count > envelope_encryptor::max_recipients) {
+                Invalid = true;
+                return;
+            }
+            
+            Key = derive(r * To);
+            HeaderSize += count * recipient_size;
+            return;
+        }
+        
+        // a content key that is not ours fails its mac.
+        bytes_view k{Key.data(), Key.size()};
+        for (size_t at = envelope_prefix_size; at < HeaderSize; at += recipient_size) {
+            lazy_bytes_writer content;
+            cbc_hmac_decryptor d{content, k.substr(16, 16), k.substr(0, 16), k.substr(32, 32)};
+            d.write(bytes_view{Header}.substr(at, recipient_size));
+            if (!d.finish()) continue;
+            
+            bytes c = content;
+            if (c.size() != content_key_size) break;
+            bytes_view v{c};
+            Cipher = std::make_shared<cbc_hmac_decryptor>(Out, v.substr(16, 16), v.substr(0, 16), v.substr(32, 32));
+            Cipher->authenticated(Header);
+            return;
+        }
+        
+        Invalid = true;
+    }
+    
+    void envelope_decryptor::write(const byte *b, size_t size) {
+        bytes_view x{b, size};
+        while (!Invalid && Cipher == nullptr) {
+            size_t n = std::min(HeaderSize - Header.size(), x.size());
+            Header.insert(Header.end(), x.begin(), x.begin() + n);
+            x = x.substr(n);
+            if (Header.size() < HeaderSize) return;
+            read_header();
+        }
+        
+        if (Invalid) return;
+        Cipher->write(x);
+    }
+    
+    bool envelope_decryptor::finish() {
+        if (Invalid || Cipher == nullptr) return false;
+        return Cipher->finish();
+    }
+    
+    bytes encrypt(const bytes message, const std::vector<secp256k1::pubkey> &to) {
+        lazy_bytes_writer w;
+        envelope_encryptor e{w, to};
+        e.write(message.data(), message.size());
+        e.finish();
+        return w;
+    }
+    
+    bytes decrypt_envelope(const bytes message, const secp256k1::secret &to) {
+        lazy_bytes_writer w;
+        envelope_decryptor d{w, to};
+        d.write(message.data(), message.size());
+        if (!d.finish()) throw std::invalid_argument{"could not decrypt envelope"};
+        return w;
     }
     
 }
-
-
-
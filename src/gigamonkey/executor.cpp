@@ -0,0 +1,292 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        // the executor that owns the current thread, if any, and the index of the thread.
+        thread_local const executor *Current = nullptr;
+        thread_local size_t CurrentIndex = 0;
+        
+        std::vector<uint32> allowed_cores () {
+            std::vector<uint32> cores;
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            if (sched_getaffinity (0, sizeof (set), &set) == 0)
+                for (uint32 i = 0; i < CPU_SETSIZE; i++) if (CPU_ISSET (i, &set)) cores.push_back (i);
+#endif
+            if (!cores.empty ()) return cores;
+            
+            uint32 count = std::max (std::thread::hardware_concurrency (), 1u);
+            for (uint32 i = 0; i < count; i++) cores.push_back (i);
+            return cores;
+        }
+        
+        // a list of cores as in /sys, such as "0-3,8,10-11".
+        std::vector<uint32> read_core_list (const std::string &x) {
+            std::vector<uint32> cores;
+            size_t at = 0;
+            while (at < x.size ()) {
+                size_t end = x.find (',', at);
+                if (end == std::string::npos) end = x.size ();
+                
+                std::string range = x.substr (at, end - at);
+                size_t dash = range.find ('-');
+                try {
+                    uint32 first = std::stoul (range.substr (0, dash));
+                    uint32 last = dash == std::string::npos ? first : std::stoul (range.substr (dash + 1));
+                    for (uint32 i = first; i <= last; i++) cores.push_back (i);
+                } catch (const std::exception &) {}
+                
+                at = end + 1;
+            }
+            
+            return cores;
+        }
+        
+        // the NUMA node of each core. Cores that are not here are on node 0.
+        std::map<uint32, uint32> numa_nodes () {
+            std::map<uint32, uint32> nodes;
+#ifdef __linux__
+            std::error_code err;
+            for (const auto &entry : std::filesystem::directory_iterator {"/sys/devices/system/node", err}) {
+                std::string name = entry.path ().filename ().string ();
+                if (name.size () < 5 || name.substr (0, 4) != "node" ||
+                    !std::all_of (name.begin () + 4, name.end (), [] (char c) {
+                        return c >= '0' && c <= '9';
+                    })) continue;
+                
+                std::ifstream in {entry.path () / "cpulist"};
+                std::string list;
+                if (!std::getline (in, list)) continue;
+                
+                uint32 node = std::stoul (name.substr (4));
+                for (uint32 core : read_core_list (list)) nodes[core] = node;
+            }
+#endif
+            return nodes;
+        }
+        
+        void pin (std::thread &t, uint32 core) {
+#ifdef __linux__
+            if (core >= CPU_SETSIZE) return;
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (core, &set);
+            pthread_setaffinity_np (t.native_handle (), sizeof (set), &set);
+#endif
+        }
+        
+    }
+    
+    executor::executor (uint32 threads) : executor {[threads] () {
+        options o {};
+        o.Threads = threads;
+        return o;
+    } ()} {}
+    
+    executor::executor (const options &o) :
+        Queues {}, Workers {}, Victims {}, Mutex {}, Wake {}, Pending {0}, Next {0}, Stop {false} {
+        std::vector<uint32> cores = o.Cores.empty () ? allowed_cores () : o.Cores;
+        std::map<uint32, uint32> nodes = o.Pin ? numa_nodes () : std::map<uint32, uint32> {};
+        auto node = [&nodes] (uint32 core) -> uint32 {
+            auto n = nodes.find (core);
+            return n == nodes.end () ? 0 : n->second;
+        };
+        
+        // threads fill one node before they go on to the next.
+        std::stable_sort (cores.begin (), cores.end (), [&node] (uint32 a, uint32 b) {
+            return node (a) < node (b);
+        });
+        
+        size_t threads = o.Threads != 0 ? o.Threads : std::max (cores.size (), size_t (1));
+        Queues = std::vector<queue> (threads);
+        
+        std::vector<uint32> where (threads, 0);
+        if (!cores.empty ()) for (size_t i = 0; i < threads; i++) where[i] = node (cores[i % cores.size ()]);
+        
+        // threads on the same node first.
+        Victims.resize (threads);
+        for (size_t i = 0; i < threads; i++) {
+            for (size_t j = 1; j < threads; j++) if (where[(i + j) % threads] == where[i]) Victims[i].push_back ((i + j) % threads);
+            for (size_t j = 1; j < threads; j++) if (where[(i + j) % threads] != where[i]) Victims[i].push_back ((i + j) % threads);
+        }
+        
+        Workers.reserve (threads);
+        for (size_t i = 0; i < threads; i++) {
+            Workers.emplace_back (&executor::work, this, i);
+            if (o.Pin && !cores.empty ()) pin (Workers.back (), cores[i % cores.size ()]);
+        }
+    }
+    
+    executor &executor::shared () {
+        static executor e {};
+        return e;
+    }
+    
+    executor::~executor () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        for (std::thread &w : Workers) w.join ();
+    }
+    
+    void executor::submit (task t) {
+        // the task carries on the trace that it was submitted in.
+        if constexpr (trace::enabled) if (trace::context c = trace::current (); c.valid ())
+            t = [c, t = std::move (t)] () {
+                trace::scope s {c};
+                t ();
+            };
+        
+        size_t index = Current == this ? CurrentIndex : Next++ % Queues.size ();
+        
+        // count the task before it can be taken so that Pending never goes below zero.
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Pending++;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock (Queues[index].Mutex);
+            Queues[index].Tasks.push_back (std::move (t));
+        }
+        
+        Wake.notify_one ();
+    }
+    
+    // take the newest task from our own queue or else the oldest from someone else's,
+    // trying threads on our own node first.
+    bool executor::take (size_t index, task &t) {
+        {
+            queue &q = Queues[index];
+            std::lock_guard<std::mutex> lock (q.Mutex);
+            if (!q.Tasks.empty ()) {
+                t = std::move (q.Tasks.back ());
+                q.Tasks.pop_back ();
+                return true;
+            }
+        }
+        
+        for (size_t i : Victims[index]) {
+            queue &q = Queues[i];
+            std::lock_guard<std::mutex> lock (q.Mutex);
+            if (!q.Tasks.empty ()) {
+                t = std::move (q.Tasks.front ());
+                q.Tasks.pop_front ();
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    void executor::work (size_t index) {
+        Current = this;
+        CurrentIndex = index;
+        
+        while (true) {
+            task t;
+            if (take (index, t)) {
+                Pending--;
+                t ();
+                continue;
+            }
+            
+            std::unique_lock<std::mutex> lock (Mutex);
+            Wake.wait (lock, [this] () {
+                return Stop || Pending > 0;
+            });
+            
+            if (Stop && Pending == 0) return;
+        }
+    }
+    
+    void executor::parallel_for (size_t n, std::function<void (size_t)> f) {
+        if (n == 0) return;
+        
+        // tasks may start after we have returned, so everything they use is shared.
+        struct loop {
+            std::function<void (size_t)> Function;
+            size_t Size;
+            std::atomic<size_t> Next;
+            std::atomic<bool> Failed;
+            
+            std::mutex Mutex;
+            std::condition_variable Done;
+            size_t Finished;
+            std::exception_ptr Error;
+            
+            loop (std::function<void (size_t)> f, size_t n) :
+                Function {std::move (f)}, Size {n}, Next {0}, Failed {false}, Mutex {}, Done {}, Finished {0}, Error {} {}
+            
+            void run () {
+                size_t finished = 0;
+                for (size_t i = Next++; i < Size; i = Next++) {
+                    if (!Failed) try {
+                        Function (i);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock (Mutex);
+                        if (!Error) Error = std::current_exception ();
+                        Failed = true;
+                    }
+                    
+                    finished++;
+                }
+                
+                if (finished == 0) return;
+                
+                std::lock_guard<std::mutex> lock (Mutex);
+                Finished += finished;
+                if (Finished == Size) Done.notify_all ();
+            }
+        };
+        
+        auto l = std::make_shared<loop> (std::move (f), n);
+        
+        size_t helpers = std::min (n, Queues.size ()) - 1;
+        for (size_t i = 0; i < helpers; i++) submit ([l] () {
+            l->run ();
+        });
+        
+        l->run ();
+        
+        std::unique_lock<std::mutex> lock (l->Mutex);
+        l->Done.wait (lock, [&l] () {
+            return l->Finished == l->Size;
+        });
+        
+        if (l->Error) std::rethrow_exception (l->Error);
+    }
+    
+    void executor::bulk (size_t n, size_t grain, std::function<void (size_t, size_t)> f) {
+        if (n == 0) return;
+        if (grain == 0) grain = std::max (n / (4 * Queues.size ()), size_t (1));
+        
+        // parallel_for does not return until every call has, so f can be used by reference.
+        parallel_for ((n + grain - 1) / grain, [&f, n, grain] (size_t i) {
+            f (i * grain, std::min (n, (i + 1) * grain));
+        });
+    }
+    
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/flat.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey::Bitcoin {
+    
+    flat_transaction::flat_transaction (const transaction_view &v) :
+        Version {v.version ()}, Inputs {}, Outputs {}, Locktime {v.locktime ()} {
+        Inputs.reserve (v.input_count ());
+        for (size_t i = 0; i < v.input_count (); i++) Inputs.push_back (input (v.input (i)));
+        
+        Outputs.reserve (v.output_count ());
+        for (size_t i = 0; i < v.output_count (); i++) Outputs.push_back (output (v.output (i)));
+    }
+    
+    flat_transaction::flat_transaction (bytes_view b) : flat_transaction {} {
+        try {
+            bytes_reader r {b.begin (), b.end ()};
+            r >> *this;
+        } catch (data::end_of_stream n) {
+            *this = flat_transaction {};
+        } catch (std::bad_alloc n) {
+            // a length prefix that is too big to be true.
+            *this = flat_transaction {};
+        } catch (std::length_error n) {
+            *this = flat_transaction {};
+        }
+    }
+    
+    flat_transaction::operator incomplete::transaction () const {
+        list<incomplete::input> in;
+        for (const input &x : Inputs) in <<= incomplete::input {x};
+        return incomplete::transaction {Version, in, to_list (Outputs), Locktime};
+    }
+    
+    flat_transaction::operator bytes () const {
+        bytes b (serialized_size ());
+        bytes_writer w {b.begin (), b.end ()};
+        w << *this;
+        return b;
+    }
+    
+    bool flat_transaction::valid () const {
+        if (Inputs.size () == 0 || Outputs.size () == 0) return false;
+        for (const input &i : Inputs) if (!i.valid ()) return false;
+        for (const output &o : Outputs) if (!o.valid ()) return false;
+        return true;
+    }
+    
+    txid flat_transaction::id () const {
+        Hash256_writer w;
+        w << *this;
+        return w.finalize ();
+    }
+    
+    uint64 flat_transaction::serialized_size () const {
+        uint64 size = 8 + var_int::size (Inputs.size ()) + var_int::size (Outputs.size ());
+        for (const input &i : Inputs) size += i.serialized_size ();
+        for (const output &o : Outputs) size += o.serialized_size ();
+        return size;
+    }
+    
+    satoshi flat_transaction::sent () const {
+        satoshi x {0};
+        for (const output &o : Outputs) x = x + o.Value;
+        return x;
+    }
+    
+    flat_block::flat_block (const block &b) : Header {b.Header}, Transactions {} {
+        Transactions.reserve (b.Transactions.size ());
+        for (const transaction &t : b.Transactions) Transactions.emplace_back (t);
+    }
+    
+    flat_block::flat_block (bytes_view b) : flat_block {} {
+        try {
+            bytes_reader r {b.begin (), b.end ()};
+            r >> *this;
+        } catch (data::end_of_stream n) {
+            *this = flat_block {};
+        } catch (std::bad_alloc n) {
+            *this = flat_block {};
+        } catch (std::length_error n) {
+            *this = flat_block {};
+        }
+    }
+    
+    flat_block::operator block () const {
+        block b {};
+        b.Header = Header;
+        for (const flat_transaction &t : Transactions) b.Transactions <<= transaction (t);
+        return b;
+    }
+    
+    flat_block::operator bytes () const {
+        bytes b (serialized_size ());
+        bytes_writer w {b.begin (), b.end ()};
+        w << *this;
+        return b;
+    }
+    
+    bool flat_block::valid () const {
+        if (!Header.valid ()) return false;
+        for (const flat_transaction &t : Transactions) if (!t.valid ()) return false;
+        return true;
+    }
+    
+    uint64 flat_block::serialized_size () const {
+        uint64 size = 80 + var_int::size (Transactions.size ());
+        for (const flat_transaction &t : Transactions) size += t.serialized_size ();
+        return size;
+    }
+    
+    digest256 flat_block::merkle_root () const {
+        std::vector<digest256> ids;
+        ids.reserve (Transactions.size ());
+        for (const flat_transaction &t : Transactions) ids.push_back (t.id ());
+        return Merkle::flat_tree {std::move (ids)}.root ();
+    }
+    
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/hex.hpp>
+
+#include <array>
+
+namespace Gigamonkey::hex {
+
+#ifdef GIGAMONKEY_ENABLE_SSSE3
+    namespace ssse3 {
+        // 16 bytes at a time.
+        void write (char *out, const byte *in, size_t blocks);
+        bool read (byte *out, const char *in, size_t blocks);
+    }
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_AVX2
+    namespace avx2 {
+        // 32 bytes at a time.
+        void write (char *out, const byte *in, size_t blocks);
+        bool read (byte *out, const char *in, size_t blocks);
+    }
+#endif
+    
+    namespace {
+        
+        enum class implementation : byte {generic, ssse3, avx2};
+        
+        implementation best () {
+            static const implementation Best = [] () -> implementation {
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef GIGAMONKEY_ENABLE_AVX2
+                if (__builtin_cpu_supports ("avx2")) return implementation::avx2;
+#endif
+#ifdef GIGAMONKEY_ENABLE_SSSE3
+                if (__builtin_cpu_supports ("ssse3")) return implementation::ssse3;
+#endif
+#endif
+                return implementation::generic;
+            } ();
+            return Best;
+        }
+        
+        constexpr char digits[] = "0123456789abcdef";
+        
+        // -1 for characters that are not hex digits.
+        constexpr std::array<signed char, 256> values = [] () {
+            std::array<signed char, 256> x {};
+            for (int i = 0; i < 256; i++) x[i] = -1;
+            for (int i = 0; i < 10; i++) x['0' + i] = i;
+            for (int i = 0; i < 6; i++) x['a' + i] = x['A' + i] = 10 + i;
+            return x;
+        } ();
+        
+        void generic_write (char *out, const byte *in, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                out[2 * i] = digits[in[i] >> 4];
+                out[2 * i + 1] = digits[in[i] & 0x0f];
+            }
+        }
+        
+        bool generic_read (byte *out, const char *in, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                signed char high = values[static_cast<unsigned char> (in[2 * i])];
+                signed char low = values[static_cast<unsigned char> (in[2 * i + 1])];
+                if (high < 0 || low < 0) return false;
+                out[i] = byte (high << 4 | low);
+            }
+            
+            return true;
+        }
+        
+    }
+    
+    void write (char *out, const byte *in, size_t size) {
+        size_t done = 0;
+        switch (best ()) {
+#ifdef GIGAMONKEY_ENABLE_AVX2
+            case implementation::avx2:
+                done = size - size % 32;
+                avx2::write (out, in, done / 32);
+                break;
+#endif
+#ifdef GIGAMONKEY_ENABLE_SSSE3
+            case implementation::ssse3:
+                done = size - size % 16;
+                ssse3::write (out, in, done / 16);
+                break;
+#endif
+            default: break;
+        }
+        
+        generic_write (out + 2 * done, in + done, size - done);
+    }
+    
+    bool read (byte *out, const char *in, size_t size) {
+        size_t done = 0;
+        switch (best ()) {
+#ifdef GIGAMONKEY_ENABLE_AVX2
+            case implementation::avx2:
+                done = size - size % 32;
+                if (!avx2::read (out, in, done / 32)) return false;
+                break;
+#endif
+#ifdef GIGAMONKEY_ENABLE_SSSE3
+            case implementation::ssse3:
+                done = size - size % 16;
+                if (!ssse3::read (out, in, done / 16)) return false;
+                break;
+#endif
+            default: break;
+        }
+        
+        return generic_read (out + done, in + 2 * done, size - done);
+    }
+    
+    string write (bytes_view b) {
+        string x;
+        x.resize (2 * b.size ());
+        write (x.data (), b.data (), b.size ());
+        return x;
+    }
+    
+    maybe<bytes> read (string_view x) {
+        bytes b;
+        if (!read (x, b)) return {};
+        return b;
+    }
+    
+    bool read (string_view x, bytes &b) {
+        if (x.size () % 2 != 0) return false;
+        b.resize (x.size () / 2);
+        return read (b.data (), x.data (), b.size ());
+    }
+    
+}
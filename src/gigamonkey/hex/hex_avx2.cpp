@@ -0,0 +1,66 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -mavx2
+
+#include <gigamonkey/hex.hpp>
+#include <immintrin.h>
+
+namespace Gigamonkey::hex::avx2 {
+    
+    // AVX2 shuffles, unpacks and packs work within each 128-bit half,
+    // so the halves are put back in order afterwards.
+    
+    void write (char *out, const byte *in, size_t blocks) {
+        const __m256i digits = _mm256_setr_epi8 (
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+        const __m256i mask = _mm256_set1_epi8 (0x0f);
+        
+        for (size_t i = 0; i < blocks; i++) {
+            __m256i x = _mm256_loadu_si256 ((const __m256i *) (in + 32 * i));
+            __m256i high = _mm256_shuffle_epi8 (digits, _mm256_and_si256 (_mm256_srli_epi16 (x, 4), mask));
+            __m256i low = _mm256_shuffle_epi8 (digits, _mm256_and_si256 (x, mask));
+            
+            // bytes 0-7 and 16-23, then 8-15 and 24-31.
+            __m256i first = _mm256_unpacklo_epi8 (high, low);
+            __m256i second = _mm256_unpackhi_epi8 (high, low);
+            
+            _mm256_storeu_si256 ((__m256i *) (out + 64 * i), _mm256_permute2x128_si256 (first, second, 0x20));
+            _mm256_storeu_si256 ((__m256i *) (out + 64 * i + 32), _mm256_permute2x128_si256 (first, second, 0x31));
+        }
+    }
+    
+    namespace {
+        
+        // as in hex_ssse3.cpp.
+        inline __m256i values (__m256i c, __m256i &invalid) {
+            __m256i digit = _mm256_and_si256 (_mm256_cmpgt_epi8 (c, _mm256_set1_epi8 ('0' - 1)), _mm256_cmpgt_epi8 (_mm256_set1_epi8 ('9' + 1), c));
+            __m256i lower = _mm256_or_si256 (c, _mm256_set1_epi8 (0x20));
+            __m256i letter = _mm256_and_si256 (_mm256_cmpgt_epi8 (lower, _mm256_set1_epi8 ('a' - 1)), _mm256_cmpgt_epi8 (_mm256_set1_epi8 ('f' + 1), lower));
+            
+            invalid = _mm256_or_si256 (invalid, _mm256_andnot_si256 (_mm256_or_si256 (digit, letter), _mm256_set1_epi8 (-1)));
+            return _mm256_or_si256 (
+                _mm256_and_si256 (digit, _mm256_sub_epi8 (c, _mm256_set1_epi8 ('0'))),
+                _mm256_and_si256 (letter, _mm256_sub_epi8 (lower, _mm256_set1_epi8 ('a' - 10))));
+        }
+        
+    }
+    
+    bool read (byte *out, const char *in, size_t blocks) {
+        const __m256i weights = _mm256_set1_epi16 (0x0110);
+        
+        __m256i invalid = _mm256_setzero_si256 ();
+        for (size_t i = 0; i < blocks; i++) {
+            __m256i a = values (_mm256_loadu_si256 ((const __m256i *) (in + 64 * i)), invalid);
+            __m256i b = values (_mm256_loadu_si256 ((const __m256i *) (in + 64 * i + 32)), invalid);
+            
+            // the halves come out as a0 b0 a1 b1.
+            __m256i packed = _mm256_packus_epi16 (_mm256_maddubs_epi16 (a, weights), _mm256_maddubs_epi16 (b, weights));
+            _mm256_storeu_si256 ((__m256i *) (out + 32 * i), _mm256_permute4x64_epi64 (packed, 0xd8));
+        }
+        
+        return _mm256_movemask_epi8 (invalid) == 0;
+    }
+    
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -mssse3
+
+#include <gigamonkey/hex.hpp>
+#include <immintrin.h>
+
+namespace Gigamonkey::hex::ssse3 {
+    
+    void write (char *out, const byte *in, size_t blocks) {
+        const __m128i digits = _mm_setr_epi8 ('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+        const __m128i mask = _mm_set1_epi8 (0x0f);
+        
+        for (size_t i = 0; i < blocks; i++) {
+            __m128i x = _mm_loadu_si128 ((const __m128i *) (in + 16 * i));
+            __m128i high = _mm_shuffle_epi8 (digits, _mm_and_si128 (_mm_srli_epi16 (x, 4), mask));
+            __m128i low = _mm_shuffle_epi8 (digits, _mm_and_si128 (x, mask));
+            
+            // the high digit of each byte goes first.
+            _mm_storeu_si128 ((__m128i *) (out + 32 * i), _mm_unpacklo_epi8 (high, low));
+            _mm_storeu_si128 ((__m128i *) (out + 32 * i + 16), _mm_unpackhi_epi8 (high, low));
+        }
+    }
+    
+    namespace {
+        
+        // the value of each character, and all ones in invalid for any that is not a hex digit.
+        inline __m128i values (__m128i c, __m128i &invalid) {
+            // characters above 0x7f are negative and so are not in any range.
+            __m128i digit = _mm_and_si128 (_mm_cmpgt_epi8 (c, _mm_set1_epi8 ('0' - 1)), _mm_cmpgt_epi8 (_mm_set1_epi8 ('9' + 1), c));
+            __m128i lower = _mm_or_si128 (c, _mm_set1_epi8 (0x20));
+            __m128i letter = _mm_and_si128 (_mm_cmpgt_epi8 (lower, _mm_set1_epi8 ('a' - 1)), _mm_cmpgt_epi8 (_mm_set1_epi8 ('f' + 1), lower));
+            
+            invalid = _mm_or_si128 (invalid, _mm_andnot_si128 (_mm_or_si128 (digit, letter), _mm_set1_epi8 (-1)));
+            return _mm_or_si128 (
+                _mm_and_si128 (digit, _mm_sub_epi8 (c, _mm_set1_epi8 ('0'))),
+                _mm_and_si128 (letter, _mm_sub_epi8 (lower, _mm_set1_epi8 ('a' - 10))));
+        }
+        
+    }
+    
+    bool read (byte *out, const char *in, size_t blocks) {
+        // multiply the first digit of each pair by 16 and add the second.
+        const __m128i weights = _mm_set1_epi16 (0x0110);
+        
+        __m128i invalid = _mm_setzero_si128 ();
+        for (size_t i = 0; i < blocks; i++) {
+            __m128i a = values (_mm_loadu_si128 ((const __m128i *) (in + 32 * i)), invalid);
+            __m128i b = values (_mm_loadu_si128 ((const __m128i *) (in + 32 * i + 16)), invalid);
+            _mm_storeu_si128 ((__m128i *) (out + 16 * i), _mm_packus_epi16 (_mm_maddubs_epi16 (a, weights), _mm_maddubs_epi16 (b, weights)));
+        }
+        
+        return _mm_movemask_epi8 (invalid) == 0;
+    }
+    
+}
@@ -14,14 +14,122 @@ namespace Gigamonkey {
         
         if (this->sent () > spent ()) return false;
         
+        incomplete::transaction tx {*this};
+        ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (tx);
+        
         uint32 index = 0;
         for (const edge& e: edges) {
             if (!evaluate (e.Input.Script, e.Output.Script,
-                redemption_document {e.Output.Value, incomplete::transaction {*this}, index})) return false;
+                redemption_document {e.Output.Value, tx, index, precomputed})) return false;
             index++;
         }
         
         return true;
     }
     
+    std::future<std::vector<output>> ledger::prevouts (std::span<const outpoint> refs) const {
+        std::vector<output> outs (refs.size ());
+        
+        // each previous transaction is only fetched once.
+        hash_map<txid, bytes> txs;
+        for (size_t i = 0; i < refs.size (); i++) {
+            auto tx = txs.find (refs[i].Digest);
+            if (tx == txs.end ()) tx = txs.emplace (refs[i].Digest, transaction (refs[i].Digest).Key).first;
+            
+            bytes_view out = Bitcoin::transaction::output (tx->second, refs[i].Index);
+            if (out.size () != 0) outs[i] = output {out};
+        }
+        
+        std::promise<std::vector<output>> p;
+        p.set_value (std::move (outs));
+        return p.get_future ();
+    }
+    
+    data::map<outpoint, output> ledger::previous (std::span<const outpoint> refs) const {
+        std::vector<output> outs = prevouts (refs).get ();
+        
+        data::map<outpoint, output> p;
+        for (size_t i = 0; i < refs.size (); i++) p = p.insert (refs[i], outs[i]);
+        return p;
+    }
+    
+    namespace {
+        
+        // interior nodes of a tree that are known to be correct, by height and index.
+        using known_nodes = hash_map<uint64, digest256>;
+        
+        bool check_branch (const Merkle::proof &p, known_nodes &nodes) {
+            std::vector<std::pair<uint64, digest256>> path;
+            
+            Merkle::leaf l = p.Branch.Leaf;
+            Merkle::digests d = p.Branch.Digests;
+            uint64 height = 0;
+            
+            bool valid;
+            while (true) {
+                uint64 key = (height << 32) | l.Index;
+                
+                // if another valid proof went through here, the rest of the path must be the same.
+                auto known = nodes.find (key);
+                if (known != nodes.end ()) {
+                    valid = known->second == l.Digest;
+                    break;
+                }
+                
+                path.push_back ({key, l.Digest});
+                
+                if (d.empty ()) {
+                    valid = l.Digest == p.Root;
+                    break;
+                }
+                
+                l = l.next (d.first ());
+                d = d.rest ();
+                height++;
+            }
+            
+            if (valid) for (const auto &x : path) nodes.insert (x);
+            return valid;
+        }
+        
+    }
+    
+    std::vector<bool> confirmation_verifier::verify (std::span<const ledger::confirmation> c) {
+        std::vector<bool> valid (c.size (), false);
+        
+        // whether each header that we have seen is in the store, by merkle root.
+        hash_map<digest256, std::pair<Bitcoin::header, bool>> blocks;
+        
+        // positions of proofs that are not in the cache, by root.
+        hash_map<digest256, std::vector<size_t>> roots;
+        
+        for (size_t i = 0; i < c.size (); i++) {
+            const ledger::confirmation &x = c[i];
+            if (x.Header.MerkleRoot != x.Proof.Root || !x.Proof.Branch.Leaf.valid ()) continue;
+            
+            auto b = blocks.find (x.Header.MerkleRoot);
+            if (b == blocks.end ()) b = blocks.emplace (x.Header.MerkleRoot,
+                std::pair<Bitcoin::header, bool> {x.Header, Headers[x.Header.hash ()].Header == x.Header}).first;
+            
+            if (b->second.first != x.Header || !b->second.second) continue;
+            
+            if (Cache.contains (key {x.id (), x.Proof.Root})) valid[i] = true;
+            else roots[x.Proof.Root].push_back (i);
+        }
+        
+        for (const auto &[root, group] : roots) {
+            known_nodes nodes;
+            for (size_t i : group) if (check_branch (c[i].Proof, nodes)) {
+                valid[i] = true;
+                
+                // when the cache is full, an arbitrary entry is removed.
+                if (MaxCached == 0) continue;
+                if (Cache.size () >= MaxCached) Cache.erase (Cache.begin ());
+                Cache.insert (key {c[i].id (), root});
+            }
+        }
+        
+        return valid;
+    }
+    
 }
@@ -0,0 +1,199 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/batch.hpp>
+
+#include <map>
+#include <stdexcept>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    MAPI_batcher::MAPI_batcher (MAPI_pool &p, const options &o) :
+        Pool {p}, Journal {nullptr}, Options {o}, Mutex {}, Wake {}, Waiting {}, InFlight {0}, Flush {false}, Stop {false}, Thread {} {
+        if (Options.MaxBatch == 0) throw std::invalid_argument {"MAPI batches must have room for a transaction"};
+        Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    MAPI_batcher::MAPI_batcher (MAPI_pool &p, MAPI_journal &j, const options &o) :
+        Pool {p}, Journal {&j}, Options {o}, Mutex {}, Wake {}, Waiting {}, InFlight {0}, Flush {false}, Stop {false}, Thread {} {
+        if (Options.MaxBatch == 0) throw std::invalid_argument {"MAPI batches must have room for a transaction"};
+        
+        // nobody is waiting for these anymore.
+        for (auto &[number, x] : j.pending ()) Waiting.push_back (entry {x, Bitcoin::transaction::id (x.Transaction), 0, number,
+            clock::now (), std::make_shared<std::promise<MAPI::submit_transaction_response>> (), trace::async_span {}, 0});
+        
+        Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    MAPI_batcher::~MAPI_batcher () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        Thread.join ();
+    }
+    
+    std::future<MAPI::submit_transaction_response> MAPI_batcher::submit (const MAPI::transaction_submission &x) {
+        if (!x.valid ()) throw std::invalid_argument {"invalid transaction submission"};
+        
+        auto promise = std::make_shared<std::promise<MAPI::submit_transaction_response>> ();
+        std::future<MAPI::submit_transaction_response> future = promise->get_future ();
+        
+        uint64 number = Journal != nullptr ? Journal->append (x) : 0;
+        
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (Stop) throw std::logic_error {"MAPI batcher is stopping"};
+            trace::async_span span {"mapi.submit", trace::current ()};
+            uint64 queued = span.start ();
+            Waiting.push_back (entry {x, Bitcoin::transaction::id (x.Transaction), 0, number, clock::now (), promise, std::move (span), queued});
+            full = Waiting.size () >= Options.MaxBatch;
+        }
+        
+        if (full) Wake.notify_all ();
+        return future;
+    }
+    
+    void MAPI_batcher::flush () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Flush = true;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    void MAPI_batcher::run () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (true) {
+            if (Waiting.empty ()) {
+                Flush = false;
+                if (Stop && InFlight == 0) return;
+                Wake.wait (lock);
+                continue;
+            }
+            
+            clock::time_point deadline = Waiting.front ().Time + std::chrono::milliseconds {Options.MaxWaitMilliseconds};
+            if (!Stop && !Flush && Waiting.size () < Options.MaxBatch && clock::now () < deadline) {
+                Wake.wait_until (lock, deadline);
+                continue;
+            }
+            
+            std::vector<entry> batch;
+            while (!Waiting.empty () && batch.size () < Options.MaxBatch) {
+                batch.push_back (std::move (Waiting.front ()));
+                Waiting.pop_front ();
+            }
+            
+            InFlight++;
+            lock.unlock ();
+            send (std::move (batch));
+            lock.lock ();
+        }
+    }
+    
+    void MAPI_batcher::send (std::vector<entry> &&batch) {
+        // nothing is sent that is not on the disk.
+        if (Journal != nullptr) try {
+            Journal->commit ();
+        } catch (...) {
+            return fail (batch, std::current_exception ());
+        }
+        
+        MAPI::submit_transactions_request request {};
+        for (const entry &e : batch) request.Submissions = request.Submissions << e.Submission;
+        
+        trace::context traced {};
+        if constexpr (trace::enabled) {
+            uint64 sending = trace::now ();
+            for (const entry &e : batch) {
+                trace::record_span ("mapi.batch_wait", e.Span.context (), e.Queued, sending);
+                if (!traced.Sampled) traced = e.Span.context ();
+            }
+        }
+        
+        trace::scope in_trace {traced};
+        
+        auto sent = std::make_shared<std::vector<entry>> (std::move (batch));
+        try {
+            Pool.submit_transactions (request, [this, sent] (const MAPI::submit_transactions_response &r) {
+                receive (*sent, r);
+            }, [this, sent] (std::exception_ptr err) {
+                fail (*sent, err);
+            });
+        } catch (...) {
+            fail (*sent, std::current_exception ());
+        }
+    }
+    
+    void MAPI_batcher::receive (std::vector<entry> &batch, const MAPI::submit_transactions_response &r) {
+        std::map<digest256, const MAPI::transaction_status *> statuses;
+        for (const MAPI::transaction_status &s : r.Transactions) statuses[s.TXID] = &s;
+        
+        std::vector<entry> retry;
+        for (entry &e : batch) {
+            auto x = statuses.find (e.TXID);
+            
+            if (x == statuses.end ()) {
+                if (e.Tries < Options.Retries) {
+                    e.Tries++;
+                    retry.push_back (std::move (e));
+                } else e.Promise->set_exception (std::make_exception_ptr (
+                    std::runtime_error {"transaction was missing from MAPI response"}));
+                continue;
+            }
+            
+            const MAPI::transaction_status &s = *x->second;
+            
+            // a double spend will not go away by trying again.
+            if (s.ReturnResult == MAPI::failure && s.ConflictedWith.empty () && e.Tries < Options.Retries) {
+                e.Tries++;
+                retry.push_back (std::move (e));
+                continue;
+            }
+            
+            e.Promise->set_value (MAPI::submit_transaction_response {
+                r.APIVersion, r.Timestamp, s.TXID, s.ReturnResult, s.ResultDescription, r.MinerID,
+                r.TxSecondMempoolExpiry, r.CurrentHighestBlockHash, r.CurrentHighestBlockHeight, s.ConflictedWith});
+            
+            if (Journal != nullptr) Journal->acknowledge (e.Entry);
+        }
+        
+        done (std::move (retry));
+    }
+    
+    void MAPI_batcher::fail (std::vector<entry> &batch, std::exception_ptr err) {
+        std::vector<entry> retry;
+        for (entry &e : batch) {
+            if (e.Tries < Options.Retries) {
+                e.Tries++;
+                retry.push_back (std::move (e));
+            } else e.Promise->set_exception (err);
+        }
+        
+        done (std::move (retry));
+    }
+    
+    void MAPI_batcher::done (std::vector<entry> &&retry) {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            for (entry &e : retry) {
+                e.Time = clock::now ();
+                if constexpr (trace::enabled) e.Queued = trace::now ();
+                Waiting.push_back (std::move (e));
+            }
+            
+            InFlight--;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+}
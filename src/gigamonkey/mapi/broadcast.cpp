@@ -0,0 +1,212 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/broadcast.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    struct MAPI_broadcaster::attempt {
+        MAPI::submit_transaction_request Request;
+        std::vector<ptr<miner>> Order;
+        
+        // how many miners we have sent to and how many have answered.
+        size_t Sent;
+        size_t Answered;
+        
+        // read by the pools to decide whether to drop a request.
+        std::atomic<bool> Done;
+        std::promise<result> Promise;
+        
+        maybe<result> Rejection;
+        std::exception_ptr Error;
+        
+        attempt (const MAPI::submit_transaction_request &r, std::vector<ptr<miner>> &&o) :
+            Request {r}, Order {o}, Sent {0}, Answered {0}, Done {false}, Promise {}, Rejection {}, Error {} {}
+    };
+    
+    double MAPI_broadcaster::miner::latency (const options &o) const {
+        if (Latencies.empty ()) return o.DefaultHedgeMilliseconds;
+        
+        std::vector<double> x (Latencies.begin (), Latencies.end ());
+        size_t i = std::min (x.size () - 1, size_t (o.HedgePercentile * x.size ()));
+        std::nth_element (x.begin (), x.begin () + i, x.end ());
+        return x[i];
+    }
+    
+    double MAPI_broadcaster::miner::score (const options &o) const {
+        // a miner we know nothing about is taken to fail half the time.
+        double errors = double (Errors + 1) / double (Requests + 2);
+        return latency (o) / (1 - errors);
+    }
+    
+    MAPI_broadcaster::MAPI_broadcaster (const options &o) :
+        Options {o}, Mutex {}, Wake {}, Miners {}, Timers {}, InFlight {0}, Stop {false}, Thread {} {
+        if (!(o.HedgePercentile > 0 && o.HedgePercentile <= 1)) throw std::invalid_argument {"hedge percentile must be in (0, 1]"};
+        Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    MAPI_broadcaster::~MAPI_broadcaster () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Stop = true;
+        Timers.clear ();
+        Wake.notify_all ();
+        
+        // callbacks from the pools refer to us.
+        Wake.wait (lock, [this] () {
+            return InFlight == 0;
+        });
+        
+        lock.unlock ();
+        if (Thread.joinable ()) Thread.join ();
+    }
+    
+    void MAPI_broadcaster::add (const string &name, MAPI_pool &pool) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        for (const ptr<miner> &m : Miners) if (m->Name == name) throw std::invalid_argument {"miner " + name + " has already been added"};
+        Miners.push_back (std::make_shared<miner> (miner {name, &pool, 0, 0, 0, 0, {}}));
+    }
+    
+    std::vector<ptr<MAPI_broadcaster::miner>> MAPI_broadcaster::sorted () const {
+        std::vector<std::pair<double, ptr<miner>>> scored;
+        scored.reserve (Miners.size ());
+        for (const ptr<miner> &m : Miners) scored.push_back ({m->score (Options), m});
+        
+        std::stable_sort (scored.begin (), scored.end (), [] (const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+        
+        std::vector<ptr<miner>> x;
+        x.reserve (scored.size ());
+        for (auto &s : scored) x.push_back (s.second);
+        return x;
+    }
+    
+    std::vector<string> MAPI_broadcaster::order () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        std::vector<string> x;
+        for (const ptr<miner> &m : sorted ()) x.push_back (m->Name);
+        return x;
+    }
+    
+    MAPI_broadcaster::statistics MAPI_broadcaster::stats (const string &name) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        for (const ptr<miner> &m : Miners) if (m->Name == name)
+            return statistics {m->Requests, m->Accepted, m->Rejected, m->Errors,
+                std::chrono::milliseconds {int64 (m->latency (Options))}};
+        throw std::invalid_argument {"unknown miner " + name};
+    }
+    
+    std::future<MAPI_broadcaster::result> MAPI_broadcaster::broadcast (const MAPI::submit_transaction_request &r) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (Miners.empty ()) throw std::logic_error {"no miners to broadcast to"};
+        
+        auto a = std::make_shared<attempt> (r, sorted ());
+        std::future<result> future = a->Promise.get_future ();
+        send (a);
+        return future;
+    }
+    
+    void MAPI_broadcaster::next (ptr<attempt> a) {
+        if (a->Done) return;
+        if (a->Sent < a->Order.size ()) return send (a);
+        
+        // a miner that has not answered yet may still accept.
+        if (a->Answered < a->Sent) return;
+        
+        a->Done = true;
+        if (a->Rejection) a->Promise.set_value (*a->Rejection);
+        else a->Promise.set_exception (a->Error);
+    }
+    
+    void MAPI_broadcaster::fail (ptr<attempt> a, ptr<miner> m, std::exception_ptr err) {
+        m->Errors++;
+        a->Answered++;
+        a->Error = err;
+        next (a);
+    }
+    
+    void MAPI_broadcaster::send (ptr<attempt> a) {
+        ptr<miner> m = a->Order[a->Sent++];
+        m->Requests++;
+        
+        clock::time_point sent = clock::now ();
+        if (a->Sent < a->Order.size ()) {
+            Timers.emplace (sent + std::chrono::microseconds {int64 (m->latency (Options) * 1000)},
+                std::pair<ptr<attempt>, size_t> {a, a->Sent});
+            Wake.notify_all ();
+        }
+        
+        InFlight++;
+        try {
+            m->Pool->submit_transaction (a->Request, [this, a, m, sent] (const MAPI::submit_transaction_response &x) {
+                std::lock_guard<std::mutex> lock (Mutex);
+                m->Latencies.push_back (std::chrono::duration<double, std::milli> {clock::now () - sent}.count ());
+                if (m->Latencies.size () > Options.LatencySamples) m->Latencies.pop_front ();
+                
+                a->Answered++;
+                if (x.ReturnResult == MAPI::success) {
+                    m->Accepted++;
+                    if (!a->Done) {
+                        a->Done = true;
+                        a->Promise.set_value (result {m->Name, x});
+                    }
+                } else {
+                    m->Rejected++;
+                    a->Rejection = result {m->Name, x};
+                    next (a);
+                }
+                
+                // we may be destroyed as soon as the lock is released.
+                InFlight--;
+                Wake.notify_all ();
+            }, [this, a, m] (std::exception_ptr err) {
+                std::lock_guard<std::mutex> lock (Mutex);
+                try {
+                    std::rethrow_exception (err);
+                } catch (const MAPI_pool::cancelled &) {
+                    // nothing was sent.
+                    m->Requests--;
+                    a->Answered++;
+                } catch (...) {
+                    fail (a, m, err);
+                }
+                
+                InFlight--;
+                Wake.notify_all ();
+            }, [a] () {
+                return a->Done.load ();
+            });
+        } catch (...) {
+            InFlight--;
+            fail (a, m, std::current_exception ());
+        }
+    }
+    
+    void MAPI_broadcaster::run () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (!Stop) {
+            if (Timers.empty ()) {
+                Wake.wait (lock);
+                continue;
+            }
+            
+            auto t = Timers.begin ();
+            if (clock::now () < t->first) {
+                Wake.wait_until (lock, t->first);
+                continue;
+            }
+            
+            auto [a, sent] = t->second;
+            Timers.erase (t);
+            
+            // if we have already gone on to the next miner because this one failed, there is nothing to do.
+            if (!a->Done && a->Sent == sent) send (a);
+        }
+    }
+    
+}
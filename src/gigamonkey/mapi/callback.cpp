@@ -0,0 +1,350 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/callback.hpp>
+#include "unescape.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    namespace {
+        
+        struct scanner {
+            string_view Text;
+            size_t Position;
+            
+            bool end () const {
+                return Position == Text.size ();
+            }
+            
+            void skip () {
+                while (!end () && (Text[Position] == ' ' || Text[Position] == '\t' ||
+                    Text[Position] == '\n' || Text[Position] == '\r')) Position++;
+            }
+            
+            bool expect (char c) {
+                skip ();
+                if (end () || Text[Position] != c) return false;
+                Position++;
+                return true;
+            }
+            
+            bool peek (char c) {
+                skip ();
+                return !end () && Text[Position] == c;
+            }
+            
+            // the string as it is written, with its escapes.
+            bool read_string (string_view &x, bool &escaped) {
+                if (!expect ('"')) return false;
+                size_t begin = Position;
+                escaped = false;
+                while (!end ()) {
+                    unsigned char c = Text[Position];
+                    if (c == '"') {
+                        x = Text.substr (begin, Position - begin);
+                        Position++;
+                        return true;
+                    }
+                    
+                    if (c < 0x20) return false;
+                    if (c == '\\') {
+                        escaped = true;
+                        Position++;
+                        if (end ()) return false;
+                    }
+                    
+                    Position++;
+                }
+                
+                return false;
+            }
+            
+            bool read_unsigned (uint64 &x) {
+                skip ();
+                size_t begin = Position;
+                x = 0;
+                while (!end () && Text[Position] >= '0' && Text[Position] <= '9') {
+                    uint64 digit = Text[Position] - '0';
+                    if (x > (std::numeric_limits<uint64>::max () - digit) / 10) return false;
+                    x = 10 * x + digit;
+                    Position++;
+                }
+                
+                return Position != begin;
+            }
+            
+            // any value, as it is written.
+            bool read_value (string_view &x) {
+                skip ();
+                if (end ()) return false;
+                size_t begin = Position;
+                
+                if (Text[Position] == '"') {
+                    bool escaped;
+                    if (!read_string (x, escaped)) return false;
+                } else if (Text[Position] == '{' || Text[Position] == '[') {
+                    size_t depth = 0;
+                    while (!end ()) {
+                        char c = Text[Position];
+                        if (c == '"') {
+                            bool escaped;
+                            if (!read_string (x, escaped)) return false;
+                            continue;
+                        }
+                        
+                        Position++;
+                        if (c == '{' || c == '[') depth++;
+                        else if ((c == '}' || c == ']') && --depth == 0) break;
+                    }
+                    
+                    if (depth != 0) return false;
+                } else while (!end () && Text[Position] != ',' && Text[Position] != '}' && Text[Position] != ']' &&
+                    Text[Position] != ' ' && Text[Position] != '\t' && Text[Position] != '\n' && Text[Position] != '\r') Position++;
+                
+                x = Text.substr (begin, Position - begin);
+                return x.size () > 0;
+            }
+            
+            // read the members of an object and give each to f, which
+            // returns false if the object should not be read any further.
+            template <typename F> bool read_object (F f) {
+                if (!expect ('{')) return false;
+                if (peek ('}')) return expect ('}');
+                
+                while (true) {
+                    string_view key;
+                    bool escaped;
+                    if (!read_string (key, escaped) || escaped || !expect (':') || !f (key)) return false;
+                    if (expect ('}')) return true;
+                    if (!expect (',')) return false;
+                }
+            }
+        };
+        
+        bool read_string (scanner &s, string &x) {
+            string_view raw;
+            bool escaped;
+            if (!s.read_string (raw, escaped)) return false;
+            if (escaped) return unescape (raw, x);
+            x = string (raw);
+            return true;
+        }
+        
+        maybe<JSON_envelope> read_envelope_fast (string_view body) {
+            scanner s {body, 0};
+            maybe<string> payload, encoded_as, mimetype, public_key, signature;
+            
+            bool read = s.read_object ([&s, &payload, &encoded_as, &mimetype, &public_key, &signature] (string_view key) -> bool {
+                maybe<string> *field =
+                    key == "payload" ? &payload : key == "encoding" ? &encoded_as : key == "mimetype" ? &mimetype :
+                    key == "publicKey" ? &public_key : key == "signature" ? &signature : nullptr;
+                
+                if (field == nullptr) {
+                    string_view x;
+                    return s.read_value (x);
+                }
+                
+                // the JSON parser would keep the last of two members with the same name.
+                if (bool (*field)) return false;
+                *field = string {};
+                return read_string (s, **field);
+            });
+            
+            s.skip ();
+            if (!read || !s.end () || !payload || !encoded_as || !mimetype) return {};
+            
+            JSON_envelope x;
+            if (*encoded_as == "base64") x.Encoding = JSON_envelope::base64;
+            else if (*encoded_as == "UTF-8") x.Encoding = JSON_envelope::UTF_8;
+            else return {};
+            
+            if (bool (public_key) != bool (signature)) return {};
+            if (bool (signature)) {
+                auto sig_hex = encoding::hex::read (*signature);
+                auto pk_hex = encoding::hex::read (*public_key);
+                if (!bool (sig_hex) || !bool (pk_hex)) return {};
+                x.Signature = secp256k1::signature {*sig_hex};
+                x.PublicKey = secp256k1::pubkey {*pk_hex};
+            }
+            
+            x.Payload = std::move (*payload);
+            x.Mimetype = std::move (*mimetype);
+            return x;
+        }
+        
+        // a task is not worth it for one callback.
+        void in_chunks (executor &e, size_t n, const std::function<void (size_t)> &f) {
+            constexpr size_t chunk = 16;
+            e.parallel_for ((n + chunk - 1) / chunk, [n, &f] (size_t c) {
+                size_t end = std::min (n, (c + 1) * chunk);
+                for (size_t i = c * chunk; i < end; i++) f (i);
+            });
+        }
+        
+    }
+    
+    MAPI_callback MAPI_callback::read (const JSON_envelope &envelope) {
+        string text;
+        if (envelope.Encoding == JSON_envelope::base64) {
+            maybe<size_t> size = Gigamonkey::base64::decoded_size (envelope.Payload);
+            if (!bool (size)) return {};
+            text.resize (*size);
+            if (!Gigamonkey::base64::read (reinterpret_cast<byte *> (text.data ()), envelope.Payload)) return {};
+        } else if (envelope.Encoding == JSON_envelope::UTF_8) text = envelope.Payload;
+        else return {};
+        
+        MAPI_callback x;
+        string reason, txid, block_hash;
+        string_view payload;
+        bool payload_is_string = false;
+        
+        scanner s {text, 0};
+        bool read = s.read_object ([&] (string_view key) -> bool {
+            if (key == "apiVersion") return read_string (s, x.APIVersion);
+            if (key == "timestamp") return read_string (s, x.Timestamp);
+            if (key == "blockHash") return read_string (s, block_hash);
+            if (key == "blockHeight") return s.read_unsigned (x.BlockHeight);
+            if (key == "callbackTxId") return read_string (s, txid);
+            if (key == "callbackReason") return read_string (s, reason);
+            if (key == "minerId" && s.peek ('"')) return read_string (s, x.MinerID);
+            if (key == "callbackPayload") {
+                if (!s.read_value (payload)) return false;
+                payload_is_string = payload[0] == '"';
+                return true;
+            }
+            
+            string_view skipped;
+            return s.read_value (skipped);
+        });
+        
+        s.skip ();
+        if (!read || !s.end () || !read_digest (txid, x.TXID) || payload.empty ()) return {};
+        if (!block_hash.empty () && !read_digest (block_hash, x.BlockHash)) return {};
+        
+        JSON j;
+        try {
+            if (payload_is_string) {
+                string inner;
+                if (!unescape (payload.substr (1, payload.size () - 2), inner)) return {};
+                j = JSON::parse (inner);
+            } else j = JSON::parse (payload.begin (), payload.end ());
+        } catch (const JSON::exception &) {
+            return {};
+        }
+        
+        if (reason == "merkleProof") {
+            x.Proof = proofs_serialization_standard::read_JSON (j);
+            if (!x.Proof.valid ()) return {};
+            x.Reason = merkle_proof;
+        } else if (reason == "doubleSpend" || reason == "doubleSpendAttempt") {
+            if (!j.is_object () || !j.contains ("doubleSpendTxId") || !j["doubleSpendTxId"].is_string () ||
+                !read_digest (string (j["doubleSpendTxId"]), x.DoubleSpendTXID)) return {};
+            
+            if (j.contains ("payload") && j["payload"].is_string ()) {
+                maybe<bytes> tx = encoding::hex::read (string (j["payload"]));
+                if (!bool (tx)) return {};
+                x.DoubleSpendTransaction = *tx;
+            }
+            
+            x.Reason = reason == "doubleSpend" ? double_spend : double_spend_attempt;
+        } else return {};
+        
+        return x;
+    }
+    
+    maybe<JSON_envelope> MAPI_callback_receiver::read_envelope (string_view body) {
+        maybe<JSON_envelope> fast = read_envelope_fast (body);
+        if (bool (fast)) return fast;
+        
+        try {
+            JSON_envelope x {JSON::parse (body.begin (), body.end ())};
+            if (x.valid ()) return x;
+        } catch (const JSON::exception &) {}
+        return {};
+    }
+    
+    MAPI_callback_receiver::MAPI_callback_receiver (const options &o) :
+        Options {o}, Cells {}, Mask {0}, Head {0}, Tail {0}, Dropped {0} {
+        size_t size = 2;
+        while (size < o.QueueSize) size <<= 1;
+        Cells = std::make_unique<cell[]> (size);
+        Mask = size - 1;
+        for (size_t i = 0; i < size; i++) Cells[i].Sequence.store (i, std::memory_order_relaxed);
+    }
+    
+    // each cell is marked with the position that may use it next, so that
+    // a thread only touches a cell once it has claimed that position.
+    bool MAPI_callback_receiver::push (MAPI_callback &&x) {
+        size_t position = Tail.load (std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &Cells[position & Mask];
+            size_t sequence = c->Sequence.load (std::memory_order_acquire);
+            if (sequence == position) {
+                if (Tail.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) break;
+            } else if (sequence < position) {
+                // the cell has not been popped since the last time around.
+                Dropped.fetch_add (1, std::memory_order_relaxed);
+                return false;
+            } else position = Tail.load (std::memory_order_relaxed);
+        }
+        
+        c->Callback = std::move (x);
+        c->Sequence.store (position + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool MAPI_callback_receiver::pop (MAPI_callback &x) {
+        size_t position = Head.load (std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &Cells[position & Mask];
+            size_t sequence = c->Sequence.load (std::memory_order_acquire);
+            if (sequence == position + 1) {
+                if (Head.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) break;
+            } else if (sequence < position + 1) return false;
+            else position = Head.load (std::memory_order_relaxed);
+        }
+        
+        x = std::move (c->Callback);
+        c->Sequence.store (position + Mask + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool MAPI_callback_receiver::accept (const JSON_envelope &e) const {
+        return !Options.RequireSignature || bool (e.PublicKey);
+    }
+    
+    bool MAPI_callback_receiver::receive (string_view body) {
+        maybe<JSON_envelope> e = read_envelope (body);
+        if (!bool (e) || !accept (*e) || !e->verify ()) return false;
+        
+        MAPI_callback x = MAPI_callback::read (*e);
+        return x.valid () && push (std::move (x));
+    }
+    
+    std::vector<bool> MAPI_callback_receiver::receive (std::span<const string_view> bodies, executor &e) {
+        std::vector<JSON_envelope> envelopes (bodies.size ());
+        in_chunks (e, bodies.size (), [this, &bodies, &envelopes] (size_t i) {
+            maybe<JSON_envelope> x = read_envelope (bodies[i]);
+            if (bool (x) && accept (*x)) envelopes[i] = std::move (*x);
+        });
+        
+        // envelopes that could not be read are left invalid and are not verified.
+        std::vector<bool> verified = JSON_envelope::verify (envelopes, e);
+        
+        std::vector<char> received (bodies.size (), 0);
+        in_chunks (e, bodies.size (), [this, &envelopes, &verified, &received] (size_t i) {
+            if (!verified[i]) return;
+            MAPI_callback x = MAPI_callback::read (envelopes[i]);
+            received[i] = x.valid () && push (std::move (x));
+        });
+        
+        return std::vector<bool> (received.begin (), received.end ());
+    }
+    
+}
@@ -0,0 +1,225 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/chain.hpp>
+#include <gigamonkey/builder.hpp>
+#include <gigamonkey/signer.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    payment_chain::payment_chain (MAPI_batcher &b, const Bitcoin::prevout &change, const Bitcoin::secret &key, const options &o) :
+        payment_chain {[&b] (const MAPI::transaction_submission &x) {
+            return b.submit (x);
+        }, change, key, o} {}
+    
+    payment_chain::payment_chain (submit s, const Bitcoin::prevout &change, const Bitcoin::secret &key, const options &o) :
+        Submit {s}, Options {o}, Key {key}, Pubkey {key.to_public ()}, Signer {key.Secret},
+        ChangeScript {pay_to_address::script (key.address ().Digest)},
+        Mutex {}, Wake {}, Tip {change}, Generation {0}, Requests {}, Built {}, Sent {}, Finished {0}, Stop {false} {
+        if (!Signer.valid ()) throw std::invalid_argument {"invalid key for payment chain"};
+        if (Options.FeeRate.Bytes == 0) throw std::invalid_argument {"invalid fee rate"};
+        
+        Building = std::thread {[this] () {
+            build ();
+        }};
+        
+        Sending = std::thread {[this] () {
+            send ();
+        }};
+        
+        Watching = std::thread {[this] () {
+            watch ();
+        }};
+    }
+    
+    payment_chain::~payment_chain () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        Building.join ();
+        Sending.join ();
+        Watching.join ();
+    }
+    
+    std::future<payment_chain::payment> payment_chain::pay (list<Bitcoin::output> outputs) {
+        auto promise = std::make_shared<std::promise<payment>> ();
+        std::future<payment> future = promise->get_future ();
+        
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (Stop) throw std::logic_error {"payment chain is stopping"};
+            Requests.push_back (request {outputs, promise});
+        }
+        
+        Wake.notify_all ();
+        return future;
+    }
+    
+    Bitcoin::prevout payment_chain::tip () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Tip;
+    }
+    
+    size_t payment_chain::pending () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Built.size () + Sent.size ();
+    }
+    
+    payment_chain::made payment_chain::make (const Bitcoin::prevout &spent, const list<Bitcoin::output> &outputs) const {
+        // a signature is at most 73 bytes and a compressed pubkey is 33.
+        constexpr uint64 expected_script_size = 1 + Bitcoin::signature::MaxSize + 1 + 33;
+        
+        transaction_design design {1, list<transaction_design::input> {} << transaction_design::input {spent, expected_script_size},
+            outputs << Bitcoin::output {Bitcoin::satoshi {0}, ChangeScript}, 0};
+        
+        Bitcoin::satoshi change = spent.value () - design.sent () - calculate_fee (Options.FeeRate, design.expected_size ());
+        if (change < Options.MinChange) throw insufficient_funds {};
+        design.set_output (uint32 (outputs.size ()), Bitcoin::output {change, ChangeScript});
+        
+        digest256 hash = signer {design}.hash (0, Options.Directive);
+        Bitcoin::signature sig {Signer.sign (hash), Options.Directive};
+        
+        transaction_builder b {design};
+        b.set (0, pay_to_address::redeem (sig, Pubkey));
+        
+        Bitcoin::txid id = b.id ();
+        Bitcoin::prevout next {Bitcoin::outpoint {id, uint32 (outputs.size ())}, Bitcoin::output {change, ChangeScript}};
+        return made {payment {id, bytes (b), {}}, spent, next, nullptr, {}};
+    }
+    
+    void payment_chain::build () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (true) {
+            if (Requests.empty ()) {
+                if (Stop) break;
+                Wake.wait (lock);
+                continue;
+            }
+            
+            request r = std::move (Requests.front ());
+            Requests.pop_front ();
+            Bitcoin::prevout spent = Tip;
+            uint64 generation = Generation;
+            lock.unlock ();
+            
+            maybe<made> m;
+            try {
+                m = make (spent, r.Outputs);
+            } catch (...) {
+                r.Promise->set_exception (std::current_exception ());
+            }
+            
+            lock.lock ();
+            if (!m) continue;
+            
+            // the chain was rolled back under us, so what we spent is gone.
+            if (generation != Generation) {
+                r.Promise->set_exception (std::make_exception_ptr (rolled_back {}));
+                continue;
+            }
+            
+            m->Promise = r.Promise;
+            Tip = m->Change;
+            Built.push_back (std::move (*m));
+            Wake.notify_all ();
+        }
+        
+        Finished++;
+        Wake.notify_all ();
+    }
+    
+    void payment_chain::send () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (true) {
+            if (Built.empty ()) {
+                if (Finished >= 1) break;
+                Wake.wait (lock);
+                continue;
+            }
+            
+            made m = std::move (Built.front ());
+            Built.pop_front ();
+            uint64 generation = Generation;
+            lock.unlock ();
+            
+            try {
+                m.Response = Submit (MAPI::transaction_submission {m.Payment.Transaction, Options.Parameters});
+            } catch (...) {
+                std::promise<MAPI::submit_transaction_response> failed;
+                failed.set_exception (std::current_exception ());
+                m.Response = failed.get_future ();
+            }
+            
+            lock.lock ();
+            
+            // what we were sending was rolled back while we sent it.
+            if (generation != Generation) {
+                m.Promise->set_exception (std::make_exception_ptr (rolled_back {}));
+                continue;
+            }
+            
+            Sent.push_back (std::move (m));
+            Wake.notify_all ();
+        }
+        
+        Finished++;
+        Wake.notify_all ();
+    }
+    
+    void payment_chain::watch () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (true) {
+            if (Sent.empty ()) {
+                if (Finished >= 2) break;
+                Wake.wait (lock);
+                continue;
+            }
+            
+            // the front stays in Sent while we wait so that it is counted as pending. Only
+            // we take from Sent or roll it back and the sender only adds to the back of it.
+            made &m = Sent.front ();
+            lock.unlock ();
+            
+            maybe<MAPI::submit_transaction_response> response;
+            std::exception_ptr err;
+            try {
+                response = m.Response.get ();
+            } catch (...) {
+                err = std::current_exception ();
+            }
+            
+            lock.lock ();
+            made x = std::move (Sent.front ());
+            Sent.pop_front ();
+            
+            if (response && response->ReturnResult == MAPI::success) {
+                x.Payment.Response = *response;
+                x.Promise->set_value (x.Payment);
+                continue;
+            }
+            
+            roll_back (x.Spent);
+            if (err) x.Promise->set_exception (err);
+            else {
+                x.Payment.Response = *response;
+                x.Promise->set_value (x.Payment);
+            }
+        }
+    }
+    
+    void payment_chain::roll_back (const Bitcoin::prevout &to) {
+        Generation++;
+        Tip = to;
+        
+        for (made &m : Built) m.Promise->set_exception (std::make_exception_ptr (rolled_back {}));
+        for (made &m : Sent) m.Promise->set_exception (std::make_exception_ptr (rolled_back {}));
+        Built.clear ();
+        Sent.clear ();
+        Wake.notify_all ();
+    }
+    
+}
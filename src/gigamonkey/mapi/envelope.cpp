@@ -3,6 +3,9 @@
 
 #include <gigamonkey/mapi/envelope.hpp>
 #include <gigamonkey/address.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <algorithm>
 
 namespace Gigamonkey::BitcoinAssociation {
     
@@ -15,9 +18,24 @@ namespace Gigamonkey::BitcoinAssociation {
             default: return false;
             
             case base64 : {
-                maybe<bytes> decoded = encoding::base64::read (Payload);
-                if (!bool (decoded)) return false;
-                return PublicKey->verify (Gigamonkey::SHA2_256 (*decoded), *Signature);
+                // decoded and hashed a piece at a time, so that the payload is never all decoded at once.
+                constexpr size_t piece = 4096;
+                byte decoded[piece / 4 * 3];
+                sha256::hasher h {};
+                
+                string_view x {Payload};
+                for (; x.size () > piece; x = x.substr (piece)) {
+                    if (x[piece - 1] == '=' || !Gigamonkey::base64::read (decoded, x.substr (0, piece))) return false;
+                    h.Write (decoded, sizeof (decoded));
+                }
+                
+                maybe<size_t> size = Gigamonkey::base64::decoded_size (x);
+                if (!bool (size) || !Gigamonkey::base64::read (decoded, x)) return false;
+                h.Write (decoded, *size);
+                
+                digest256 digest;
+                h.Finalize (digest.Value.data ());
+                return PublicKey->verify (digest, *Signature);
             }
             
             case UTF_8 : 
@@ -25,6 +43,20 @@ namespace Gigamonkey::BitcoinAssociation {
         }
     }
     
+    std::vector<bool> JSON_envelope::verify (std::span<const JSON_envelope> envelopes, executor &e) {
+        // threads can't write to a std::vector<bool> at the same time.
+        std::vector<char> verified (envelopes.size (), 0);
+        
+        // a task is not worth it for one signature.
+        constexpr size_t chunk = 16;
+        e.parallel_for ((envelopes.size () + chunk - 1) / chunk, [&envelopes, &verified] (size_t c) {
+            size_t end = std::min (envelopes.size (), (c + 1) * chunk);
+            for (size_t i = c * chunk; i < end; i++) verified[i] = envelopes[i].verify ();
+        });
+        
+        return std::vector<bool> (verified.begin (), verified.end ());
+    }
+    
     JSON_envelope::JSON_envelope (const JSON &j) : JSON_envelope {} {
         if (!j.is_object () || !j.contains ("payload") || !j.contains ("encoding") || !j.contains ("mimetype") ||
             !j["payload"].is_string () || !j["encoding"].is_string () || !j["mimetype"].is_string ())
@@ -63,7 +95,7 @@ namespace Gigamonkey::BitcoinAssociation {
         if (!valid ()) return nullptr;
         
         JSON j{{"payload", Payload}, {"mimetype", Mimetype}};
-        j["encoding"] = Encoding == base64 ? "base64" : "UTF_8";
+        j["encoding"] = Encoding == base64 ? "base64" : "UTF-8";
         
         if (bool (PublicKey)) {
             j["publicKey"] = encoding::hex::write (*PublicKey);
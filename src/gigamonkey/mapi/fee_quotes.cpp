@@ -0,0 +1,172 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/fee_quotes.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    namespace {
+        
+        // read a time like 2021-09-30T12:04:05.112Z. Fractions of a second are ignored.
+        maybe<std::time_t> read_ISO_8601 (const string &x) {
+            std::tm t {};
+            if (std::sscanf (x.c_str (), "%4d-%2d-%2dT%2d:%2d:%2d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6)
+                return {};
+            
+            size_t end = x.find_first_not_of ("0123456789.", 19);
+            if (end == string::npos || x[end] != 'Z' || end + 1 != x.size ()) return {};
+            
+            t.tm_year -= 1900;
+            t.tm_mon -= 1;
+            std::time_t r = timegm (&t);
+            if (r == -1) return {};
+            return r;
+        }
+        
+        double rate (const satoshi_per_byte &x) {
+            return double (int64 (x.Satoshis)) / double (x.Bytes);
+        }
+        
+    }
+    
+    maybe<fee_quotes::clock::time_point> fee_quotes::expiry (const MAPI::get_fee_quote_response &q) {
+        maybe<std::time_t> t = read_ISO_8601 (q.ExpiryTime);
+        if (!t) return {};
+        return clock::from_time_t (*t);
+    }
+    
+    fee_quotes::fee_quotes (const options &o) :
+        Options {o}, Mutex {}, Wake {}, Miners {}, InFlight {0}, Stop {false}, Thread {} {
+        Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    fee_quotes::~fee_quotes () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Stop = true;
+        Wake.notify_all ();
+        
+        // callbacks from the pools refer to us.
+        Wake.wait (lock, [this] () {
+            return InFlight == 0;
+        });
+        
+        lock.unlock ();
+        if (Thread.joinable ()) Thread.join ();
+    }
+    
+    void fee_quotes::add (const string &name, MAPI_pool &pool) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (Miners.find (name) != Miners.end ()) throw std::invalid_argument {"miner " + name + " has already been added"};
+        Miners.emplace (name, miner {&pool, {}, clock::time_point {}, clock::time_point {}, false, {}});
+        
+        // the refresher will see that we have no quote and ask for one.
+        Wake.notify_all ();
+    }
+    
+    std::shared_future<MAPI::get_fee_quote_response> fee_quotes::request (const string &name, miner &m) {
+        if (m.Requesting) return m.Pending;
+        
+        auto promise = std::make_shared<std::promise<MAPI::get_fee_quote_response>> ();
+        m.Requesting = true;
+        m.Pending = promise->get_future ().share ();
+        InFlight++;
+        
+        m.Pool->get_fee_quote ([this, name, promise] (const MAPI::get_fee_quote_response &q) {
+            maybe<clock::time_point> expires = expiry (q);
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                miner &m = Miners.find (name)->second;
+                m.Requesting = false;
+                if (q.valid ()) {
+                    m.Quote = q;
+                    m.Expires = expires ? *expires : clock::now () + std::chrono::seconds {Options.DefaultLifetimeSeconds};
+                } else m.Retry = clock::now () + std::chrono::seconds {Options.RefreshSeconds};
+                
+                InFlight--;
+                
+                // we may be destroyed as soon as the lock is released.
+                Wake.notify_all ();
+            }
+            
+            promise->set_value (q);
+        }, [this, name, promise] (std::exception_ptr err) {
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                miner &m = Miners.find (name)->second;
+                m.Requesting = false;
+                m.Retry = clock::now () + std::chrono::seconds {Options.RefreshSeconds};
+                InFlight--;
+                Wake.notify_all ();
+            }
+            
+            promise->set_exception (err);
+        });
+        
+        return m.Pending;
+    }
+    
+    std::shared_future<MAPI::get_fee_quote_response> fee_quotes::quote (const string &name) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto x = Miners.find (name);
+        if (x == Miners.end ()) throw std::invalid_argument {"unknown miner " + name};
+        
+        miner &m = x->second;
+        if (m.Quote && clock::now () < m.Expires) {
+            std::promise<MAPI::get_fee_quote_response> p;
+            p.set_value (*m.Quote);
+            return p.get_future ().share ();
+        }
+        
+        return request (name, m);
+    }
+    
+    maybe<fee_quotes::best> fee_quotes::select (const string &fee_type, MAPI::service z) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto now = clock::now ();
+        
+        maybe<best> b {};
+        for (const auto &[name, m] : Miners) {
+            if (!m.Quote || now >= m.Expires) continue;
+            
+            for (const data::entry<string, MAPI::fee> &f : m.Quote->Fees) {
+                if (f.Key != fee_type) continue;
+                
+                satoshi_per_byte r = f.Value.get_fee (z);
+                if (!r.valid ()) continue;
+                if (!b || rate (r) < rate (b->Rate)) b = best {name, r};
+            }
+        }
+        
+        return b;
+    }
+    
+    void fee_quotes::run () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (!Stop) {
+            auto now = clock::now ();
+            auto refresh = std::chrono::seconds {Options.RefreshSeconds};
+            
+            // nothing to do until the next quote is about to expire.
+            maybe<clock::time_point> next {};
+            for (auto &[name, m] : Miners) {
+                if (m.Requesting) continue;
+                
+                // after a failure, we wait a while before trying again.
+                clock::time_point when = std::max (m.Quote ? m.Expires - refresh : now, m.Retry);
+                if (when <= now) request (name, m);
+                else if (!next || when < *next) next = when;
+            }
+            
+            if (next) Wake.wait_until (lock, *next);
+            else Wake.wait (lock);
+        }
+    }
+    
+}
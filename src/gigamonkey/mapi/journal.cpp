@@ -0,0 +1,321 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/journal.hpp>
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    namespace {
+        
+        constexpr byte journal_file_magic[] {'G', 'M', 'M', 'A', 'P', 'I', 'J', '1'};
+        constexpr size_t journal_file_prefix = 64;
+        
+        // Each record begins with the size of its body and the first four bytes of
+        // the SHA2-256 hash of its body. The body is the type of the record, the
+        // number of its entry and then the submission for an entry. All numbers
+        // are little endian.
+        constexpr size_t record_prefix = 8;
+        constexpr size_t body_prefix = 9;
+        
+        constexpr byte entry_record = 1;
+        constexpr byte acknowledgement_record = 2;
+        
+        // which parameters a submission has.
+        enum : byte {
+            callback_URL = 1,
+            callback_token = 2,
+            merkle_proof = 4,
+            merkle_proof_value = 8,
+            merkle_format = 16,
+            ds_check = 32,
+            ds_check_value = 64,
+            callback_encryption = 128
+        };
+        
+        uint32 checksum (const byte *b, size_t size) {
+            digest256 d = SHA2_256 (bytes_view {b, size});
+            return boost::endian::load_little_u32 (d.begin ());
+        }
+        
+        // strings are written with a four byte size.
+        byte *write_string (byte *b, const maybe<string> &x) {
+            if (!bool (x)) return b;
+            boost::endian::store_little_u32 (b, uint32 (x->size ()));
+            return std::copy (x->begin (), x->end (), b + 4);
+        }
+        
+        bool read_string (const byte *&b, const byte *end, maybe<string> &x) {
+            if (end - b < 4) return false;
+            uint32 size = boost::endian::load_little_u32 (b);
+            if (end - b - 4 < int64 (size)) return false;
+            x = string (reinterpret_cast<const char *> (b + 4), size);
+            b += 4 + size;
+            return true;
+        }
+        
+        bytes encode (const MAPI::transaction_submission &x) {
+            const MAPI::submit_transaction_parameters &p = x.Parameters;
+            
+            byte flags = (bool (p.CallbackURL) ? callback_URL : 0) | (bool (p.CallbackToken) ? callback_token : 0) |
+                (bool (p.MerkleProof) ? merkle_proof | (*p.MerkleProof ? merkle_proof_value : 0) : 0) |
+                (bool (p.MerkleFormat) ? merkle_format : 0) |
+                (bool (p.DSCheck) ? ds_check | (*p.DSCheck ? ds_check_value : 0) : 0) |
+                (bool (p.CallbackEncryption) ? callback_encryption : 0);
+            
+            size_t size = 1 + x.Transaction.size ();
+            for (const maybe<string> *s : {&p.CallbackURL, &p.CallbackToken, &p.MerkleFormat, &p.CallbackEncryption})
+                if (bool (*s)) size += 4 + (*s)->size ();
+            
+            bytes b (size);
+            byte *w = b.data ();
+            *w++ = flags;
+            for (const maybe<string> *s : {&p.CallbackURL, &p.CallbackToken, &p.MerkleFormat, &p.CallbackEncryption})
+                w = write_string (w, *s);
+            std::copy (x.Transaction.begin (), x.Transaction.end (), w);
+            return b;
+        }
+        
+        maybe<MAPI::transaction_submission> decode (const byte *b, const byte *end) {
+            if (b == end) return {};
+            byte flags = *b++;
+            
+            MAPI::submit_transaction_parameters p;
+            if ((flags & callback_URL) && !read_string (b, end, p.CallbackURL)) return {};
+            if ((flags & callback_token) && !read_string (b, end, p.CallbackToken)) return {};
+            if ((flags & merkle_format) && !read_string (b, end, p.MerkleFormat)) return {};
+            if ((flags & callback_encryption) && !read_string (b, end, p.CallbackEncryption)) return {};
+            if (flags & merkle_proof) p.MerkleProof = bool (flags & merkle_proof_value);
+            if (flags & ds_check) p.DSCheck = bool (flags & ds_check_value);
+            
+            bytes tx (end - b);
+            std::copy (b, end, tx.begin ());
+            return MAPI::transaction_submission {tx, p};
+        }
+        
+    }
+    
+    MAPI_journal::MAPI_journal (const std::filesystem::path &path, uint64 capacity) :
+        Path {path}, Capacity {capacity}, Mutex {}, Synced {}, Descriptor {-1}, Map {nullptr},
+        End {0}, Durable {0}, Syncing {false}, Entries {}, Next {0} {
+        
+        Descriptor = ::open (Path.c_str (), O_RDWR | O_CREAT, 0644);
+        if (Descriptor < 0) throw std::runtime_error {"could not open MAPI journal " + Path.string ()};
+        
+        try {
+            struct stat st;
+            if (fstat (Descriptor, &st) != 0) throw std::runtime_error {"could not read MAPI journal " + Path.string ()};
+            
+            size_t size = static_cast<size_t> (st.st_size);
+            if (size == 0) {
+                if (Capacity < journal_file_prefix + record_prefix + body_prefix)
+                    throw std::invalid_argument {"MAPI journal must have room for an entry"};
+                if (ftruncate (Descriptor, Capacity) != 0)
+                    throw std::runtime_error {"could not resize MAPI journal " + Path.string ()};
+            } else {
+                byte prefix[journal_file_prefix];
+                if (size < journal_file_prefix || pread (Descriptor, prefix, journal_file_prefix, 0) != journal_file_prefix ||
+                    !std::equal (std::begin (journal_file_magic), std::end (journal_file_magic), prefix))
+                    throw std::invalid_argument {"not a MAPI journal: " + Path.string ()};
+                Capacity = size;
+            }
+            
+            void *m = mmap (nullptr, Capacity, PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor, 0);
+            if (m == MAP_FAILED) throw std::runtime_error {"could not map MAPI journal " + Path.string ()};
+            Map = static_cast<byte *> (m);
+            
+            if (size == 0) std::copy (std::begin (journal_file_magic), std::end (journal_file_magic), Map);
+            
+            uint64 at = journal_file_prefix;
+            while (at + record_prefix <= Capacity) {
+                uint32 body = boost::endian::load_little_u32 (Map + at);
+                if (body < body_prefix || at + record_prefix + body > Capacity ||
+                    checksum (Map + at + record_prefix, body) != boost::endian::load_little_u32 (Map + at + 4)) break;
+                
+                byte type = Map[at + record_prefix];
+                uint64 number = boost::endian::load_little_u64 (Map + at + record_prefix + 1);
+                if (type == entry_record) Entries[number] = at;
+                else if (type == acknowledgement_record) Entries.erase (number);
+                else break;
+                
+                Next = std::max (Next, number + 1);
+                at += record_prefix + body;
+            }
+            
+            // what is left of a record that was not written whole can't be read as part of a later one.
+            if (at + record_prefix <= Capacity) {
+                uint64 stale = std::min (Capacity - at, record_prefix + uint64 (boost::endian::load_little_u32 (Map + at)));
+                std::fill (Map + at, Map + at + stale, 0);
+            }
+            
+            if (msync (Map, Capacity, MS_SYNC) != 0) throw std::runtime_error {"could not sync MAPI journal " + Path.string ()};
+            End = Durable = at;
+        } catch (...) {
+            close ();
+            throw;
+        }
+    }
+    
+    MAPI_journal::~MAPI_journal () {
+        close ();
+    }
+    
+    void MAPI_journal::close () {
+        if (Map != nullptr) munmap (Map, Capacity);
+        if (Descriptor >= 0) ::close (Descriptor);
+        Map = nullptr;
+        Descriptor = -1;
+    }
+    
+    bool MAPI_journal::write (byte type, uint64 number, const bytes &x) {
+        uint64 body = body_prefix + x.size ();
+        if (End + record_prefix + body > Capacity) return false;
+        
+        byte *at = Map + End;
+        boost::endian::store_little_u32 (at, uint32 (body));
+        at[record_prefix] = type;
+        boost::endian::store_little_u64 (at + record_prefix + 1, number);
+        std::copy (x.begin (), x.end (), at + record_prefix + body_prefix);
+        boost::endian::store_little_u32 (at + 4, checksum (at + record_prefix, body));
+        
+        End += record_prefix + body;
+        return true;
+    }
+    
+    uint64 MAPI_journal::append (const MAPI::transaction_submission &x) {
+        bytes body = encode (x);
+        
+        std::unique_lock<std::mutex> lock (Mutex);
+        uint64 number = Next;
+        if (End + record_prefix + body_prefix + body.size () > Capacity) compact (lock);
+        
+        uint64 at = End;
+        if (!write (entry_record, number, body)) throw std::length_error {"MAPI journal is full"};
+        
+        Entries[number] = at;
+        Next++;
+        return number;
+    }
+    
+    void MAPI_journal::acknowledge (uint64 number) {
+        std::unique_lock<std::mutex> lock (Mutex);
+        if (Entries.erase (number) == 0) return;
+        
+        // the entry is left out when the file is written again.
+        if (!write (acknowledgement_record, number, bytes {})) compact (lock);
+    }
+    
+    void MAPI_journal::commit () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        uint64 through = End;
+        
+        // after the file has been compacted, everything in it is on the disk.
+        while (Durable < std::min (through, End)) {
+            if (Syncing) {
+                Synced.wait (lock);
+                continue;
+            }
+            
+            // everything appended until now goes in this sync.
+            Syncing = true;
+            uint64 begin = Durable;
+            uint64 end = End;
+            lock.unlock ();
+            
+            // msync must begin on a page.
+            uint64 page = static_cast<uint64> (sysconf (_SC_PAGESIZE));
+            uint64 first = begin - begin % page;
+            bool synced = msync (Map + first, end - first, MS_SYNC) == 0;
+            
+            lock.lock ();
+            Syncing = false;
+            if (synced) Durable = end;
+            Synced.notify_all ();
+            
+            if (!synced) throw std::runtime_error {"could not sync MAPI journal " + Path.string ()};
+        }
+    }
+    
+    std::vector<std::pair<uint64, MAPI::transaction_submission>> MAPI_journal::pending () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        std::vector<std::pair<uint64, MAPI::transaction_submission>> x;
+        x.reserve (Entries.size ());
+        for (const auto &[number, at] : Entries) {
+            uint32 body = boost::endian::load_little_u32 (Map + at);
+            const byte *b = Map + at + record_prefix + body_prefix;
+            
+            // the checksum was good, so this is a submission that we wrote.
+            maybe<MAPI::transaction_submission> s = decode (b, b + body - body_prefix);
+            if (bool (s)) x.emplace_back (number, *s);
+        }
+        
+        return x;
+    }
+    
+    uint64 MAPI_journal::size () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return End;
+    }
+    
+    void MAPI_journal::compact () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        compact (lock);
+    }
+    
+    // the new file is written beside the old one and then moved over it,
+    // so that one or the other is always whole.
+    void MAPI_journal::compact (std::unique_lock<std::mutex> &lock) {
+        // the map can't change while it is being synced.
+        Synced.wait (lock, [this] () {
+            return !Syncing;
+        });
+        
+        std::filesystem::path temporary = Path;
+        temporary += ".tmp";
+        
+        int descriptor = ::open (temporary.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (descriptor < 0) throw std::runtime_error {"could not open " + temporary.string ()};
+        
+        void *m = MAP_FAILED;
+        if (ftruncate (descriptor, Capacity) == 0) m = mmap (nullptr, Capacity, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        if (m == MAP_FAILED) {
+            ::close (descriptor);
+            throw std::runtime_error {"could not map " + temporary.string ()};
+        }
+        
+        byte *map = static_cast<byte *> (m);
+        std::copy (std::begin (journal_file_magic), std::end (journal_file_magic), map);
+        
+        uint64 end = journal_file_prefix;
+        std::map<uint64, uint64> entries;
+        for (const auto &[number, at] : Entries) {
+            uint64 size = record_prefix + boost::endian::load_little_u32 (Map + at);
+            std::copy (Map + at, Map + at + size, map + end);
+            entries[number] = end;
+            end += size;
+        }
+        
+        std::error_code err;
+        if (msync (map, end, MS_SYNC) == 0) std::filesystem::rename (temporary, Path, err);
+        else err = std::make_error_code (std::errc::io_error);
+        
+        if (err) {
+            munmap (map, Capacity);
+            ::close (descriptor);
+            throw std::runtime_error {"could not compact MAPI journal " + Path.string ()};
+        }
+        
+        close ();
+        Map = map;
+        Descriptor = descriptor;
+        End = Durable = end;
+        Entries = std::move (entries);
+    }
+    
+}
@@ -2,11 +2,14 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/mapi/mapi.hpp>
+#include <gigamonkey/hex.hpp>
+#include <gigamonkey/metrics.hpp>
+#include <gigamonkey/trace.hpp>
 
 namespace Gigamonkey::BitcoinAssociation {
     using namespace Bitcoin;
     
-    JSON MAPI::call (const net::HTTP::request &q) {
+    net::HTTP::response MAPI::fetch (const net::HTTP::request &q) {
         net::HTTP::response r = (*this) (q);
         
         if (static_cast<unsigned int> (r.Status) < 200 ||
@@ -17,6 +20,18 @@ namespace Gigamonkey::BitcoinAssociation {
             throw net::HTTP::exception {q, r, string {"content type is not JSON; it is "} +
                 r.Headers[net::HTTP::header::content_type]};
         
+        return r;
+    }
+    
+    JSON MAPI::call (const net::HTTP::request &q) {
+        metrics::count (metrics::MAPI_calls);
+        metrics::stopwatch timing {metrics::MAPI_call};
+        net::HTTP::response r = [this, &q] () {
+            trace::span http {"mapi.http"};
+            return fetch (q);
+        } ();
+        
+        trace::span verify {"mapi.envelope_verify"};
         auto envelope = JSON_JSON_envelope {JSON_envelope {JSON::parse (r.Body)}};
         
         if (!envelope.verify ()) throw net::HTTP::exception {q, r, "MAPI signature verify fail"};
@@ -24,6 +39,23 @@ namespace Gigamonkey::BitcoinAssociation {
         return envelope.payload ();
     }
     
+    // batch responses can be big, so they are not made into JSON.
+    MAPI::submit_transactions_response MAPI::submit_transactions (const submit_transactions_request &x,
+        const std::function<void (const transaction_status &)> &f) {
+        metrics::count (metrics::MAPI_calls);
+        metrics::stopwatch timing {metrics::MAPI_call};
+        net::HTTP::request q = submit_transactions_HTTP_request (x);
+        net::HTTP::response r = [this, &q] () {
+            trace::span http {"mapi.http"};
+            return fetch (q);
+        } ();
+        
+        trace::span verify {"mapi.envelope_verify"};
+        maybe<submit_transactions_response> response = submit_transactions_response::read (r.Body, f);
+        if (!bool (response)) throw net::HTTP::exception {q, r, "MAPI signature verify fail"};
+        return *response;
+    }
+    
     net::HTTP::request MAPI::transaction_status_HTTP_request (const Bitcoin::txid &request) const {
         if (!request.valid ()) throw std::invalid_argument {"invalid txid"};
         std::stringstream ss;
@@ -115,7 +147,7 @@ namespace Gigamonkey::BitcoinAssociation {
             if (!(j.is_object () &&
                 j.contains ("txid") && j["txid"].is_string () &&
                 j.contains ("returnResult") && j["returnResult"].is_string () &&
-                j.contains ("returnDescription") && j["returnDescription"].is_string () &&
+                j.contains ("resultDescription") && j["resultDescription"].is_string () &&
                 (!j.contains ("conflictedWith") || j["conflictedWith"].is_array ()))) return {};
             
             string rr = j["returnResult"];
@@ -157,7 +189,7 @@ namespace Gigamonkey::BitcoinAssociation {
             
             JSON j = to_JSON (x.Parameters);
             
-            j["rawtx"] = encoding::hex::write (x.Transaction);
+            j["rawtx"] = Gigamonkey::hex::write (x.Transaction);
             
             return j;
         }
@@ -201,7 +233,7 @@ namespace Gigamonkey::BitcoinAssociation {
     }
     
     MAPI::transaction_submission::operator JSON () const {
-        JSON j{{"rawtx", encoding::hex::write (Transaction)}};
+        JSON j{{"rawtx", Gigamonkey::hex::write (Transaction)}};
         
         if (this->Parameters.CallbackURL) j["callbackUrl"] = *this->Parameters.CallbackURL;
         if (this->Parameters.CallbackToken) j["callbackToken"] = *this->Parameters.CallbackToken;
@@ -240,7 +272,7 @@ namespace Gigamonkey::BitcoinAssociation {
         return JSON {
             {"txid", to_JSON (TXID)},
             {"size", Size}, 
-            {"hex", encoding::hex::write (Transaction)}
+            {"hex", Gigamonkey::hex::write (Transaction)}
         };
     }
     
@@ -251,7 +283,7 @@ namespace Gigamonkey::BitcoinAssociation {
             j.contains ("size") && j["size"].is_number_unsigned () &&
             j.contains ("hex") && j["hex"].is_string ())) return;
         
-        auto tx = encoding::hex::read (string (j["hex"]));
+        auto tx = Gigamonkey::hex::read (j["hex"].get_ref<const std::string &> ());
         if (!bool (tx)) return;
         
         TXID = digest256 {string{"0x"} + string (j["txid"])};
@@ -482,7 +514,7 @@ namespace Gigamonkey::BitcoinAssociation {
         auto pk_hex = encoding::hex::read (string (j["minerId"]));
         if (!bool (pk_hex)) return;
         
-        digest256 block_hash {string {"0x"} + string (j["blockHash"])};
+        digest256 block_hash {string {"0x"} + string (j["currentHighestBlockHash"])};
         if (!block_hash.valid ()) return;
         
         MinerID = secp256k1::pubkey {*pk_hex};
@@ -0,0 +1,74 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/pool.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    MAPI_pool::MAPI_pool (connect c, uint32 connections) : Connect {c}, Mutex {}, Wake {}, Tasks {}, Stop {false}, Workers {} {
+        if (!Connect) throw std::invalid_argument {"MAPI pool needs a way to connect"};
+        if (connections == 0) throw std::invalid_argument {"MAPI pool needs at least one connection"};
+        
+        Workers.reserve (connections);
+        for (uint32 i = 0; i < connections; i++) Workers.emplace_back ([this] () {
+            work ();
+        });
+    }
+    
+    MAPI_pool::~MAPI_pool () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        for (std::thread &t : Workers) t.join ();
+    }
+    
+    void MAPI_pool::push (task t) {
+        // the call carries on the trace that it was made in.
+        if constexpr (trace::enabled) if (trace::context c = trace::current (); c.valid ())
+            t = [c, t = std::move (t)] (ptr<MAPI> &connection) {
+                trace::scope s {c};
+                t (connection);
+            };
+        
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (Stop) throw std::logic_error {"MAPI pool is stopping"};
+            Tasks.push_back (std::move (t));
+        }
+        
+        Wake.notify_one ();
+    }
+    
+    size_t MAPI_pool::waiting () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Tasks.size ();
+    }
+    
+    void MAPI_pool::work () {
+        ptr<MAPI> connection;
+        
+        while (true) {
+            task next;
+            {
+                std::unique_lock<std::mutex> lock (Mutex);
+                Wake.wait (lock, [this] () {
+                    return Stop || !Tasks.empty ();
+                });
+                
+                // queued requests are finished before we stop.
+                if (Tasks.empty ()) return;
+                next = std::move (Tasks.front ());
+                Tasks.pop_front ();
+            }
+            
+            next (connection);
+        }
+    }
+    
+}
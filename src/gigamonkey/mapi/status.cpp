@@ -0,0 +1,283 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/status.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    MAPI_status_tracker::MAPI_status_tracker (MAPI_pool &p, const options &o) :
+        MAPI_status_tracker {[&p] (const Bitcoin::txid &x,
+            std::function<void (const MAPI::transaction_status_response &)> then,
+            std::function<void (std::exception_ptr)> fail) {
+            p.get_transaction_status (x, then, fail);
+        }, o} {}
+    
+    MAPI_status_tracker::MAPI_status_tracker (request r, const options &o) :
+        Request {r}, Options {o}, Mutex {}, Wake {}, Tracked {}, Schedule {}, Waiting {}, Outstanding {0},
+        Subscribers {}, NextSubscriber {0}, Changed {false}, Stop {false}, Thread {} {
+        load ();
+        Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    MAPI_status_tracker::~MAPI_status_tracker () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        Thread.join ();
+        
+        // answers call back into the tracker.
+        std::unique_lock<std::mutex> lock (Mutex);
+        Wake.wait (lock, [this] () {
+            return Outstanding == 0;
+        });
+        
+        if (Changed) save (pending_locked ());
+    }
+    
+    std::shared_future<MAPI::transaction_status_response> MAPI_status_tracker::status (const Bitcoin::txid &x) {
+        std::unique_lock<std::mutex> lock (Mutex);
+        if (Stop) throw std::logic_error {"MAPI status tracker is stopping"};
+        return ask (x, lock);
+    }
+    
+    void MAPI_status_tracker::track (const Bitcoin::txid &x) {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (Tracked.contains (x)) return;
+            
+            tracked &t = Tracked[x] = tracked {Options.FirstPollMilliseconds, Schedule.end (), false};
+            schedule (x, t, std::chrono::milliseconds {Options.FirstPollMilliseconds});
+            Changed = true;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    void MAPI_status_tracker::forget (const Bitcoin::txid &x) {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            auto t = Tracked.find (x);
+            if (t == Tracked.end ()) return;
+            
+            if (t->second.Next != Schedule.end ()) Schedule.erase (t->second.Next);
+            Tracked.erase (t);
+            Changed = true;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    void MAPI_status_tracker::receive (const MAPI_callback &c) {
+        if (!c.valid ()) return;
+        
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            auto t = Tracked.find (c.TXID);
+            if (t == Tracked.end ()) return;
+            
+            // if a request is waiting, its answer may be from before the callback.
+            if (Waiting.contains (c.TXID)) t->second.Again = true;
+            else schedule (c.TXID, t->second, clock::duration {0});
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    uint64 MAPI_status_tracker::subscribe (subscriber s) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Subscribers[NextSubscriber] = s;
+        return NextSubscriber++;
+    }
+    
+    void MAPI_status_tracker::unsubscribe (uint64 n) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Subscribers.erase (n);
+    }
+    
+    std::vector<Bitcoin::txid> MAPI_status_tracker::pending () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return pending_locked ();
+    }
+    
+    std::vector<Bitcoin::txid> MAPI_status_tracker::pending_locked () const {
+        std::vector<Bitcoin::txid> x;
+        x.reserve (Tracked.size ());
+        for (const auto &[id, t] : Tracked) x.push_back (id);
+        return x;
+    }
+    
+    void MAPI_status_tracker::run () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (!Stop) {
+            if (Changed && !Options.File.empty ()) {
+                Changed = false;
+                std::vector<Bitcoin::txid> x = pending_locked ();
+                lock.unlock ();
+                save (x);
+                lock.lock ();
+                continue;
+            }
+            
+            if (Schedule.empty ()) {
+                Wake.wait (lock);
+                continue;
+            }
+            
+            auto first = Schedule.begin ();
+            if (clock::now () < first->first) {
+                Wake.wait_until (lock, first->first);
+                continue;
+            }
+            
+            Bitcoin::txid x = first->second;
+            Tracked[x].Next = Schedule.end ();
+            Schedule.erase (first);
+            ask (x, lock);
+        }
+    }
+    
+    std::shared_future<MAPI::transaction_status_response> MAPI_status_tracker::ask (
+        const Bitcoin::txid &x, std::unique_lock<std::mutex> &lock) {
+        auto w = Waiting.find (x);
+        if (w != Waiting.end ()) return w->second.second;
+        
+        auto promise = std::make_shared<std::promise<MAPI::transaction_status_response>> ();
+        std::shared_future<MAPI::transaction_status_response> future = promise->get_future ().share ();
+        Waiting.emplace (x, std::pair {promise, future});
+        Outstanding++;
+        
+        // the answer may come before the request returns.
+        lock.unlock ();
+        try {
+            Request (x, [this, x] (const MAPI::transaction_status_response &r) {
+                answer (x, r);
+            }, [this, x] (std::exception_ptr e) {
+                fail (x, e);
+            });
+        } catch (...) {
+            fail (x, std::current_exception ());
+        }
+        
+        lock.lock ();
+        return future;
+    }
+    
+    void MAPI_status_tracker::schedule (const Bitcoin::txid &x, tracked &t, clock::duration d) {
+        if (t.Next != Schedule.end ()) Schedule.erase (t.Next);
+        t.Next = Schedule.emplace (clock::now () + d, x);
+    }
+    
+    void MAPI_status_tracker::later (const Bitcoin::txid &x, tracked &t) {
+        if (Options.Callbacks) return schedule (x, t, std::chrono::milliseconds {Options.FallbackPollMilliseconds});
+        t.Wait = uint32 (std::min (uint64 (t.Wait) * 2, uint64 (Options.MaxPollMilliseconds)));
+        schedule (x, t, std::chrono::milliseconds {t.Wait});
+    }
+    
+    void MAPI_status_tracker::next (const Bitcoin::txid &x, tracked &t) {
+        if (t.Again) {
+            t.Again = false;
+            schedule (x, t, clock::duration {0});
+        } else if (t.Next == Schedule.end ()) later (x, t);
+    }
+    
+    void MAPI_status_tracker::answer (const Bitcoin::txid &x, const MAPI::transaction_status_response &r) {
+        ptr<std::promise<MAPI::transaction_status_response>> promise;
+        std::vector<subscriber> subscribers;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            // a request that was already answered or failed.
+            auto w = Waiting.find (x);
+            if (w == Waiting.end ()) return;
+            promise = w->second.first;
+            Waiting.erase (w);
+            
+            auto t = Tracked.find (x);
+            if (t != Tracked.end ()) {
+                for (const auto &[n, s] : Subscribers) subscribers.push_back (s);
+                
+                if ((r.Confirmations && *r.Confirmations >= Options.Confirmations) || !r.ConflictedWith.empty ()) {
+                    if (t->second.Next != Schedule.end ()) Schedule.erase (t->second.Next);
+                    Tracked.erase (t);
+                    Changed = true;
+                } else next (x, t->second);
+            }
+        }
+        
+        promise->set_value (r);
+        for (const subscriber &s : subscribers) s (r);
+        
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Outstanding--;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    void MAPI_status_tracker::fail (const Bitcoin::txid &x, std::exception_ptr e) {
+        ptr<std::promise<MAPI::transaction_status_response>> promise;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            // a request that was already answered or failed.
+            auto w = Waiting.find (x);
+            if (w == Waiting.end ()) return;
+            promise = w->second.first;
+            Waiting.erase (w);
+            
+            auto t = Tracked.find (x);
+            if (t != Tracked.end ()) next (x, t->second);
+        }
+        
+        promise->set_exception (e);
+        
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Outstanding--;
+        }
+        
+        Wake.notify_all ();
+    }
+    
+    void MAPI_status_tracker::load () {
+        if (Options.File.empty () || !std::filesystem::exists (Options.File)) return;
+        
+        std::ifstream in {Options.File, std::ios::binary};
+        if (!in) throw std::runtime_error {"could not read " + Options.File.string ()};
+        
+        Bitcoin::txid x;
+        while (in.read (reinterpret_cast<char *> (&x), sizeof (x))) {
+            tracked &t = Tracked[x] = tracked {Options.FirstPollMilliseconds, Schedule.end (), false};
+            schedule (x, t, std::chrono::milliseconds {Options.FirstPollMilliseconds});
+        }
+        
+        if (in.gcount () != 0) throw std::runtime_error {Options.File.string () + " is not a file of txids"};
+    }
+    
+    void MAPI_status_tracker::save (const std::vector<Bitcoin::txid> &x) const {
+        if (Options.File.empty ()) return;
+        
+        // so that the file is never left half written.
+        std::filesystem::path temporary = Options.File;
+        temporary += ".tmp";
+        
+        {
+            std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+            if (!out) return;
+            for (const Bitcoin::txid &id : x) out.write (reinterpret_cast<const char *> (&id), sizeof (id));
+            if (!out) return;
+        }
+        
+        std::error_code err;
+        std::filesystem::rename (temporary, Options.File, err);
+    }
+    
+}
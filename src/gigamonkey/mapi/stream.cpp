@@ -0,0 +1,485 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mapi/mapi.hpp>
+#include "unescape.hpp"
+
+#include <limits>
+
+namespace Gigamonkey::BitcoinAssociation {
+    
+    namespace {
+        
+        using handler = std::function<void (const MAPI::transaction_status &)>;
+        
+        struct plain {
+            string_view Text;
+            size_t Position;
+            
+            bool end () const {
+                return Position == Text.size ();
+            }
+            
+            char front () const {
+                return Text[Position];
+            }
+            
+            void pop () {
+                Position++;
+            }
+        };
+        
+        // the contents of a string in the envelope, with its escapes decoded
+        // as they are read. Everything that is read is hashed, so that the
+        // payload is never copied out of the envelope.
+        struct escaped {
+            string_view Text;
+            
+            // of the next character in Text that has not been read.
+            size_t Position;
+            
+            // characters from here to Position have been read but not hashed.
+            size_t Run;
+            SHA2_256_writer Hash;
+            
+            // the last escape, which has been hashed and is read before Position.
+            string Decoded;
+            size_t Next;
+            
+            // the closing quote is at Position.
+            bool Closed;
+            bool Failed;
+            
+            escaped (string_view text, size_t begin) :
+                Text {text}, Position {begin}, Run {begin}, Hash {}, Decoded {}, Next {0}, Closed {false}, Failed {false} {
+                settle ();
+            }
+            
+            bool end () const {
+                return Closed || Failed;
+            }
+            
+            char front () const {
+                return Next < Decoded.size () ? Decoded[Next] : Text[Position];
+            }
+            
+            void pop () {
+                if (Next < Decoded.size ()) Next++;
+                else Position++;
+                settle ();
+            }
+            
+            digest256 digest () {
+                flush ();
+                return Hash.finalize ();
+            }
+        
+        private:
+            void flush () {
+                Hash.write (reinterpret_cast<const byte *> (Text.data ()) + Run, Position - Run);
+                Run = Position;
+            }
+            
+            // decode the escape at Position if there is one.
+            void settle () {
+                if (Next < Decoded.size ()) return;
+                if (Position == Text.size ()) {
+                    Failed = true;
+                    return;
+                }
+                
+                char c = Text[Position];
+                if (c == '"') {
+                    flush ();
+                    Closed = true;
+                    return;
+                }
+                
+                if (static_cast<unsigned char> (c) < 0x20) Failed = true;
+                if (c != '\\') return;
+                
+                flush ();
+                Decoded.clear ();
+                Next = 0;
+                size_t size = read_escape (Text.substr (Position), Decoded);
+                if (size == 0) {
+                    Failed = true;
+                    return;
+                }
+                
+                Hash.write (reinterpret_cast<const byte *> (Decoded.data ()), Decoded.size ());
+                Position += size;
+                Run = Position;
+            }
+        };
+        
+        template <typename source> struct parser {
+            source &Source;
+            
+            static bool space (char c) {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            }
+            
+            void skip () {
+                while (!Source.end () && space (Source.front ())) Source.pop ();
+            }
+            
+            bool expect (char c) {
+                skip ();
+                if (Source.end () || Source.front () != c) return false;
+                Source.pop ();
+                return true;
+            }
+            
+            bool peek (char c) {
+                skip ();
+                return !Source.end () && Source.front () == c;
+            }
+            
+            // move past the front, which is appended to x if it is given.
+            void take (string *x) {
+                if (x != nullptr) x->push_back (Source.front ());
+                Source.pop ();
+            }
+            
+            bool read_string (string &x) {
+                if (!expect ('"')) return false;
+                x.clear ();
+                bool escaped = false;
+                while (!Source.end ()) {
+                    char c = Source.front ();
+                    Source.pop ();
+                    if (c == '"') {
+                        if (!escaped) return true;
+                        string raw = std::move (x);
+                        return unescape (raw, x);
+                    }
+                    
+                    if (static_cast<unsigned char> (c) < 0x20) return false;
+                    x.push_back (c);
+                    if (c == '\\') {
+                        if (Source.end ()) return false;
+                        escaped = true;
+                        take (&x);
+                    }
+                }
+                
+                return false;
+            }
+            
+            // a string as it is written, with its quotes and escapes.
+            bool read_raw_string (string *x) {
+                if (!peek ('"')) return false;
+                take (x);
+                while (!Source.end ()) {
+                    char c = Source.front ();
+                    take (x);
+                    if (c == '"') return true;
+                    if (static_cast<unsigned char> (c) < 0x20) return false;
+                    if (c == '\\') {
+                        if (Source.end ()) return false;
+                        take (x);
+                    }
+                }
+                
+                return false;
+            }
+            
+            bool read_unsigned (uint64 &x) {
+                skip ();
+                bool digits = false;
+                x = 0;
+                while (!Source.end () && Source.front () >= '0' && Source.front () <= '9') {
+                    uint64 digit = Source.front () - '0';
+                    if (x > (std::numeric_limits<uint64>::max () - digit) / 10) return false;
+                    x = 10 * x + digit;
+                    digits = true;
+                    Source.pop ();
+                }
+                
+                return digits;
+            }
+            
+            bool read_uint32 (uint32 &x) {
+                uint64 n;
+                if (!read_unsigned (n) || n > std::numeric_limits<uint32>::max ()) return false;
+                x = uint32 (n);
+                return true;
+            }
+            
+            // any value, which is appended to x as it is written if x is given.
+            bool read_value (string *x = nullptr) {
+                skip ();
+                if (Source.end ()) return false;
+                char c = Source.front ();
+                if (c == '"') return read_raw_string (x);
+                
+                if (c == '{' || c == '[') {
+                    size_t depth = 0;
+                    while (!Source.end ()) {
+                        c = Source.front ();
+                        if (c == '"') {
+                            if (!read_raw_string (x)) return false;
+                            continue;
+                        }
+                        
+                        take (x);
+                        if (c == '{' || c == '[') depth++;
+                        else if ((c == '}' || c == ']') && --depth == 0) return true;
+                    }
+                    
+                    return false;
+                }
+                
+                bool read = false;
+                while (!Source.end () && !space (Source.front ()) &&
+                    Source.front () != ',' && Source.front () != '}' && Source.front () != ']') {
+                    take (x);
+                    read = true;
+                }
+                
+                return read;
+            }
+            
+            // read the members of an object and give each to f, which
+            // returns false if the object should not be read any further.
+            template <typename F> bool read_object (F f) {
+                if (!expect ('{')) return false;
+                if (peek ('}')) return expect ('}');
+                
+                string key;
+                while (true) {
+                    if (!read_string (key) || !expect (':') || !f (key)) return false;
+                    if (expect ('}')) return true;
+                    if (!expect (',')) return false;
+                }
+            }
+            
+            // f reads each element of an array.
+            template <typename F> bool read_array (F f) {
+                if (!expect ('[')) return false;
+                if (peek (']')) return expect (']');
+                
+                while (true) {
+                    if (!f ()) return false;
+                    if (expect (']')) return true;
+                    if (!expect (',')) return false;
+                }
+            }
+        };
+        
+        template <typename source> bool read_member (parser<source> &p, maybe<string> &x) {
+            x = string {};
+            return p.read_string (*x);
+        }
+        
+        template <typename source> maybe<MAPI::transaction_status> read_status (parser<source> &p) {
+            string txid, result, conflicts;
+            maybe<string> description;
+            
+            bool read = p.read_object ([&] (const string &key) -> bool {
+                if (key == "txid") return p.read_string (txid);
+                if (key == "returnResult") return p.read_string (result);
+                if (key == "resultDescription") return read_member (p, description);
+                if (key == "conflictedWith") {
+                    conflicts.clear ();
+                    return p.read_value (&conflicts);
+                }
+                
+                return p.read_value ();
+            });
+            
+            if (!read || !bool (description)) return {};
+            
+            MAPI::transaction_status x;
+            if (!read_digest (txid, x.TXID)) return {};
+            
+            if (result == "success") x.ReturnResult = MAPI::success;
+            else if (result == "failure") x.ReturnResult = MAPI::failure;
+            else return {};
+            
+            x.ResultDescription = std::move (*description);
+            
+            // conflicts are rare, so they are read as JSON.
+            if (!conflicts.empty ()) {
+                JSON j = JSON::parse (conflicts, nullptr, false);
+                if (!j.is_array ()) return {};
+                for (const JSON &w : j) {
+                    MAPI::conflicted_with c {w};
+                    if (!c.valid ()) return {};
+                    x.ConflictedWith = x.ConflictedWith << c;
+                }
+            }
+            
+            return x;
+        }
+        
+        // given is the number of statuses that have been given to f.
+        template <typename source> bool read_response (parser<source> &p,
+            MAPI::submit_transactions_response &x, const handler &f, size_t &given) {
+            maybe<string> api_version, timestamp, miner_id, block_hash;
+            bool height = false, expiry = false, failures = false, txs = false;
+            
+            bool read = p.read_object ([&] (const string &key) -> bool {
+                if (key == "apiVersion") return read_member (p, api_version);
+                if (key == "timestamp") return read_member (p, timestamp);
+                if (key == "minerId") return read_member (p, miner_id);
+                if (key == "currentHighestBlockHash") return read_member (p, block_hash);
+                if (key == "currentHighestBlockHeight") return height = p.read_unsigned (x.CurrentHighestBlockHeight);
+                if (key == "txSecondMempoolExpiry") return expiry = p.read_uint32 (x.TxSecondMempoolExpiry);
+                if (key == "failureCount") return failures = p.read_uint32 (x.FailureCount);
+                if (key == "txs") {
+                    // the statuses have already been given out.
+                    if (txs) return false;
+                    return txs = p.read_array ([&] () -> bool {
+                        maybe<MAPI::transaction_status> status = read_status (p);
+                        if (!bool (status) || !status->valid ()) return false;
+                        if (f) f (*status);
+                        given++;
+                        x.Transactions = x.Transactions << *status;
+                        return true;
+                    });
+                }
+                
+                return p.read_value ();
+            });
+            
+            if (!read || !api_version || !timestamp || !miner_id || !block_hash || !height || !expiry || !failures || !txs) return false;
+            
+            maybe<bytes> pubkey = encoding::hex::read (*miner_id);
+            if (!bool (pubkey) || !read_digest (*block_hash, x.CurrentHighestBlockHash)) return false;
+            
+            x.APIVersion = std::move (*api_version);
+            x.Timestamp = std::move (*timestamp);
+            x.MinerID = secp256k1::pubkey {*pubkey};
+            return true;
+        }
+        
+        bool base64_character (char c) {
+            return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/' || c == '=';
+        }
+        
+        enum class outcome {
+            // not something that we can read in one pass.
+            unread,
+            
+            bad_signature,
+            read
+        };
+        
+        outcome read_fast (string_view body, MAPI::submit_transactions_response &x, const handler &f, size_t &given) {
+            plain text {body, 0};
+            parser<plain> p {text};
+            
+            bool has_payload = false;
+            bool in_place = false;
+            string payload;
+            maybe<digest256> digest;
+            maybe<string> encoded_as, mimetype, public_key, signature;
+            
+            bool read = p.read_object ([&] (const string &key) -> bool {
+                if (key == "payload") {
+                    if (has_payload || !p.peek ('"')) return false;
+                    has_payload = true;
+                    
+                    // base64 can't be JSON, so anything else is read as a response where it is.
+                    if (text.Position + 1 < body.size () && base64_character (body[text.Position + 1]))
+                        return p.read_string (payload);
+                    
+                    escaped e {body, text.Position + 1};
+                    parser<escaped> q {e};
+                    if (!read_response (q, x, f, given)) return false;
+                    q.skip ();
+                    if (!e.Closed) return false;
+                    
+                    digest = e.digest ();
+                    text.Position = e.Position + 1;
+                    in_place = true;
+                    return true;
+                }
+                
+                maybe<string> *field =
+                    key == "encoding" ? &encoded_as : key == "mimetype" ? &mimetype :
+                    key == "publicKey" ? &public_key : key == "signature" ? &signature : nullptr;
+                
+                if (field == nullptr) return p.read_value ();
+                if (bool (*field)) return false;
+                
+                // MAPI writes null for the signature of an unsigned response.
+                if ((field == &public_key || field == &signature) && p.peek ('n')) {
+                    string null;
+                    return p.read_value (&null) && null == "null";
+                }
+                
+                return read_member (p, *field);
+            });
+            
+            p.skip ();
+            if (!read || !text.end () || !has_payload || !encoded_as || !mimetype || bool (public_key) != bool (signature))
+                return outcome::unread;
+            
+            if (*encoded_as == "base64") {
+                if (in_place) return outcome::unread;
+                // decoded straight into the string that it will be read from.
+                maybe<size_t> size = Gigamonkey::base64::decoded_size (payload);
+                if (!bool (size)) return outcome::unread;
+                string decoded;
+                decoded.resize (*size);
+                if (!Gigamonkey::base64::read (reinterpret_cast<byte *> (decoded.data ()), payload)) return outcome::unread;
+                digest = SHA2_256 (string_view {decoded});
+                payload = std::move (decoded);
+            } else if (*encoded_as == "UTF-8") {
+                if (!in_place) digest = SHA2_256 (payload);
+            } else return outcome::unread;
+            
+            if (bool (signature)) {
+                maybe<bytes> sig = encoding::hex::read (*signature);
+                maybe<bytes> pubkey = encoding::hex::read (*public_key);
+                if (!bool (sig) || !bool (pubkey)) return outcome::unread;
+                if (!secp256k1::pubkey {*pubkey}.verify (*digest, secp256k1::signature {*sig})) return outcome::bad_signature;
+            }
+            
+            // a payload that was not read where it was is read now that it has been checked.
+            if (!in_place) {
+                plain inner {payload, 0};
+                parser<plain> q {inner};
+                if (!read_response (q, x, f, given)) return outcome::unread;
+                q.skip ();
+                if (!inner.end ()) return outcome::unread;
+            }
+            
+            return outcome::read;
+        }
+        
+    }
+    
+    maybe<MAPI::submit_transactions_response> MAPI::submit_transactions_response::read (string_view body, const handler &f) {
+        size_t given = 0;
+        {
+            submit_transactions_response x;
+            switch (read_fast (body, x, f, given)) {
+                case outcome::read: return x;
+                case outcome::bad_signature: return {};
+                default: break;
+            }
+        }
+        
+        // anything unusual is read as a JSON document.
+        JSON j = JSON::parse (body.begin (), body.end (), nullptr, false);
+        if (j.is_discarded ()) return {};
+        
+        JSON_JSON_envelope envelope {JSON_envelope {j}};
+        if (!envelope.verify ()) return {};
+        
+        JSON payload = JSON::parse (envelope.Payload, nullptr, false);
+        submit_transactions_response x = payload.is_discarded () ? submit_transactions_response {} : submit_transactions_response {payload};
+        
+        if (f) {
+            size_t i = 0;
+            for (const transaction_status &status : x.Transactions) if (i++ >= given) f (status);
+        }
+        
+        return x;
+    }
+    
+}
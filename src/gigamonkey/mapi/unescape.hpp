@@ -0,0 +1,110 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MAPI_UNESCAPE
+#define GIGAMONKEY_MAPI_UNESCAPE
+
+#include <gigamonkey/hash.hpp>
+
+// Pieces of JSON strings for the readers of MAPI messages that do not build
+// a JSON document. This file is included by more than one translation unit,
+// so everything here has internal linkage.
+namespace Gigamonkey::BitcoinAssociation {
+    
+    namespace {
+        
+        inline void write_utf8 (string &out, uint32 c) {
+            if (c < 0x80) out.push_back (char (c));
+            else if (c < 0x800) {
+                out.push_back (char (0xc0 | (c >> 6)));
+                out.push_back (char (0x80 | (c & 0x3f)));
+            } else if (c < 0x10000) {
+                out.push_back (char (0xe0 | (c >> 12)));
+                out.push_back (char (0x80 | ((c >> 6) & 0x3f)));
+                out.push_back (char (0x80 | (c & 0x3f)));
+            } else {
+                out.push_back (char (0xf0 | (c >> 18)));
+                out.push_back (char (0x80 | ((c >> 12) & 0x3f)));
+                out.push_back (char (0x80 | ((c >> 6) & 0x3f)));
+                out.push_back (char (0x80 | (c & 0x3f)));
+            }
+        }
+        
+        inline bool read_code_unit (string_view x, size_t i, uint32 &c) {
+            if (i + 4 > x.size ()) return false;
+            c = 0;
+            for (size_t j = i; j < i + 4; j++) {
+                char d = x[j];
+                c <<= 4;
+                if (d >= '0' && d <= '9') c |= d - '0';
+                else if (d >= 'a' && d <= 'f') c |= d - 'a' + 10;
+                else if (d >= 'A' && d <= 'F') c |= d - 'A' + 10;
+                else return false;
+            }
+            
+            return true;
+        }
+        
+        // the escape at the front of x, which begins with a backslash, is written to out.
+        // Returns the size of the escape or 0 if it is not one.
+        inline size_t read_escape (string_view x, string &out) {
+            if (x.size () < 2) return 0;
+            switch (x[1]) {
+                case '"': out.push_back ('"'); return 2;
+                case '\\': out.push_back ('\\'); return 2;
+                case '/': out.push_back ('/'); return 2;
+                case 'b': out.push_back ('\b'); return 2;
+                case 'f': out.push_back ('\f'); return 2;
+                case 'n': out.push_back ('\n'); return 2;
+                case 'r': out.push_back ('\r'); return 2;
+                case 't': out.push_back ('\t'); return 2;
+                case 'u': {
+                    uint32 c;
+                    if (!read_code_unit (x, 2, c)) return 0;
+                    
+                    // characters outside of the basic plane are written as surrogate pairs.
+                    if (c >= 0xd800 && c < 0xdc00) {
+                        uint32 low;
+                        if (x.size () < 12 || x[6] != '\\' || x[7] != 'u' ||
+                            !read_code_unit (x, 8, low) || low < 0xdc00 || low >= 0xe000) return 0;
+                        write_utf8 (out, 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00));
+                        return 12;
+                    } else if (c >= 0xdc00 && c < 0xe000) return 0;
+                    
+                    write_utf8 (out, c);
+                    return 6;
+                }
+                default: return 0;
+            }
+        }
+        
+        // the contents of a string as it is written between its quotes.
+        inline bool unescape (string_view x, string &out) {
+            out.clear ();
+            out.reserve (x.size ());
+            for (size_t i = 0; i < x.size ();) {
+                if (x[i] != '\\') {
+                    out.push_back (x[i++]);
+                    continue;
+                }
+                
+                size_t size = read_escape (x.substr (i), out);
+                if (size == 0) return false;
+                i += size;
+            }
+            
+            return true;
+        }
+        
+        inline bool read_digest (string_view x, digest256 &d) {
+            if (x.size () != 64) return false;
+            for (char c : x) if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) return false;
+            d = digest256 {string {"0x"} + string (x)};
+            return true;
+        }
+        
+    }
+    
+}
+
+#endif
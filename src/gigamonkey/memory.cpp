@@ -0,0 +1,38 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/memory.hpp>
+
+#include <cstring>
+
+namespace Gigamonkey {
+    
+    void *arena::do_allocate (size_t size, size_t alignment) {
+        void *x = Resource.allocate (size, alignment);
+        Allocated += size;
+        Allocations++;
+        return x;
+    }
+    
+    bytes_view arena::copy (bytes_view b) {
+        if (b.size () == 0) return bytes_view {};
+        byte *x = static_cast<byte *> (allocate (b.size (), 1));
+        std::memcpy (x, b.data (), b.size ());
+        return bytes_view {x, b.size ()};
+    }
+    
+    memory_report::operator JSON () const {
+        return JSON {
+            {"keys", Keys},
+            {"values", Values},
+            {"overhead", Overhead},
+            {"slack", Slack},
+            {"total", total ()}};
+    }
+    
+    std::pmr::memory_resource *thread_pool () {
+        thread_local std::pmr::unsynchronized_pool_resource Pool {};
+        return &Pool;
+    }
+    
+}
@@ -0,0 +1,238 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/mempool.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+namespace Gigamonkey {
+    using namespace Bitcoin;
+    
+    hash_set<txid> mempool::ancestors (const node &n) const {
+        hash_set<txid> found;
+        std::vector<txid> next (n.Parents.begin (), n.Parents.end ());
+        while (!next.empty ()) {
+            txid t = next.back ();
+            next.pop_back ();
+            if (!found.insert (t).second) continue;
+            for (const txid &p : Entries.at (t).Parents) next.push_back (p);
+        }
+        
+        return found;
+    }
+    
+    hash_set<txid> mempool::descendants (const node &n) const {
+        hash_set<txid> found;
+        std::vector<txid> next (n.Children.begin (), n.Children.end ());
+        while (!next.empty ()) {
+            txid t = next.back ();
+            next.pop_back ();
+            if (!found.insert (t).second) continue;
+            for (const txid &c : Entries.at (t).Children) next.push_back (c);
+        }
+        
+        return found;
+    }
+    
+    mempool::result mempool::insert (const shared_transaction &t, satoshi fee) {
+        std::unique_lock<std::shared_mutex> lock {Mutex};
+        const txid &id = t.id ();
+        if (Entries.contains (id)) return duplicate;
+        
+        node n {entry {t, fee, 1, t.serialized_size (), fee, 1, t.serialized_size (), fee}, {}, {}};
+        for (const input &in : t->Inputs) {
+            if (Spent.contains (in.Reference)) return conflict;
+            if (Entries.contains (in.Reference.Digest)) n.Parents.insert (in.Reference.Digest);
+        }
+        
+        hash_set<txid> up = ancestors (n);
+        if (up.size () + 1 > Options.MaxAncestors) return too_many_ancestors;
+        
+        for (const txid &a : up) {
+            const entry &e = Entries.at (a).Entry;
+            if (e.DescendantCount + 1 > Options.MaxDescendants) return too_many_descendants;
+            n.Entry.AncestorCount++;
+            n.Entry.AncestorSize += e.size ();
+            n.Entry.AncestorFees = n.Entry.AncestorFees + e.Fee;
+        }
+        
+        // the new transaction is a descendant of all of its ancestors.
+        for (const txid &a : up) {
+            node &x = Entries.at (a);
+            ByDescendantRate.erase (x.descendant_score ());
+            x.Entry.DescendantCount++;
+            x.Entry.DescendantSize += t.serialized_size ();
+            x.Entry.DescendantFees = x.Entry.DescendantFees + fee;
+            ByDescendantRate.insert (x.descendant_score ());
+        }
+        
+        for (const txid &p : n.Parents) Entries.at (p).Children.insert (id);
+        for (const input &in : t->Inputs) Spent.emplace (in.Reference, id);
+        
+        ByAncestorRate.insert (n.ancestor_score ());
+        ByDescendantRate.insert (n.descendant_score ());
+        Links += 2 * n.Parents.size ();
+        Entries.emplace (id, std::move (n));
+        TotalSize += t.serialized_size ();
+        
+        // evict the packages that pay the least until there is room.
+        while (TotalSize > Options.MaxSize) erase_with_descendants (ByDescendantRate.begin ()->ID);
+        
+        return Entries.contains (id) ? accepted : evicted;
+    }
+    
+    void mempool::erase (const txid &id) {
+        auto it = Entries.find (id);
+        node &n = it->second;
+        const entry &e = n.Entry;
+        
+        for (const txid &a : ancestors (n)) {
+            node &x = Entries.at (a);
+            ByDescendantRate.erase (x.descendant_score ());
+            x.Entry.DescendantCount--;
+            x.Entry.DescendantSize -= e.size ();
+            x.Entry.DescendantFees = x.Entry.DescendantFees - e.Fee;
+            ByDescendantRate.insert (x.descendant_score ());
+        }
+        
+        for (const txid &d : descendants (n)) {
+            node &x = Entries.at (d);
+            ByAncestorRate.erase (x.ancestor_score ());
+            x.Entry.AncestorCount--;
+            x.Entry.AncestorSize -= e.size ();
+            x.Entry.AncestorFees = x.Entry.AncestorFees - e.Fee;
+            ByAncestorRate.insert (x.ancestor_score ());
+        }
+        
+        for (const txid &p : n.Parents) Entries.at (p).Children.erase (id);
+        for (const txid &c : n.Children) Entries.at (c).Parents.erase (id);
+        for (const input &in : e.Transaction->Inputs) Spent.erase (in.Reference);
+        
+        ByAncestorRate.erase (n.ancestor_score ());
+        ByDescendantRate.erase (n.descendant_score ());
+        TotalSize -= e.size ();
+        Links -= 2 * (n.Parents.size () + n.Children.size ());
+        Entries.erase (it);
+    }
+    
+    size_t mempool::erase_with_descendants (const txid &id) {
+        const node &n = Entries.at (id);
+        hash_set<txid> down = descendants (n);
+        
+        // a transaction has more ancestors than any of its ancestors, so
+        // in this order nothing is erased before what depends on it.
+        std::vector<std::pair<uint32, txid>> order;
+        order.reserve (down.size () + 1);
+        order.push_back ({n.Entry.AncestorCount, id});
+        for (const txid &d : down) order.push_back ({Entries.at (d).Entry.AncestorCount, d});
+        std::sort (order.begin (), order.end (), [] (const auto &a, const auto &b) -> bool {
+            return a.first > b.first;
+        });
+        
+        for (const auto &[count, t] : order) erase (t);
+        return order.size ();
+    }
+    
+    size_t mempool::remove (const txid &id) {
+        std::unique_lock<std::shared_mutex> lock {Mutex};
+        if (!Entries.contains (id)) return 0;
+        return erase_with_descendants (id);
+    }
+    
+    void mempool::remove_confirmed (std::span<const shared_transaction> block) {
+        std::unique_lock<std::shared_mutex> lock {Mutex};
+        for (const shared_transaction &t : block) {
+            // anything that this spends in the pool came earlier in the block, so it is gone already.
+            if (Entries.contains (t.id ())) {
+                erase (t.id ());
+                continue;
+            }
+            
+            for (const input &in : t->Inputs) {
+                auto s = Spent.find (in.Reference);
+                if (s != Spent.end ()) erase_with_descendants (txid {s->second});
+            }
+        }
+    }
+    
+    maybe<mempool::entry> mempool::operator [] (const txid &id) const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        auto it = Entries.find (id);
+        if (it == Entries.end ()) return {};
+        return it->second.Entry;
+    }
+    
+    bool mempool::contains (const txid &id) const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        return Entries.contains (id);
+    }
+    
+    size_t mempool::size () const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        return Entries.size ();
+    }
+    
+    uint64 mempool::total_size () const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        return TotalSize;
+    }
+    
+    memory_report mempool::memory_usage () const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        return memory_report {
+            Entries.size () * sizeof (txid) + Spent.size () * sizeof (outpoint),
+            TotalSize + Entries.size () * sizeof (node) + Spent.size () * sizeof (txid),
+            hash_table_overhead (Entries) + hash_table_overhead (Spent) + Links * (sizeof (txid) + 2 * sizeof (void *)) +
+                tree_overhead (ByAncestorRate) + tree_overhead (ByDescendantRate) +
+                (ByAncestorRate.size () + ByDescendantRate.size ()) * sizeof (score),
+            0};
+    }
+    
+    std::vector<shared_transaction> mempool::select (uint64 max_size) const {
+        std::shared_lock<std::shared_mutex> lock {Mutex};
+        std::vector<shared_transaction> selected;
+        hash_set<txid> included;
+        uint64 size = 0;
+        
+        for (const score &s : ByAncestorRate) {
+            if (included.contains (s.ID)) continue;
+            
+            const node &n = Entries.at (s.ID);
+            if (size + n.Entry.size () > max_size) continue;
+            
+            // the transaction and whatever it needs that is not in yet.
+            std::vector<const entry *> package {&n.Entry};
+            uint64 package_size = n.Entry.size ();
+            for (const txid &a : ancestors (n)) if (!included.contains (a)) {
+                const entry &e = Entries.at (a).Entry;
+                package.push_back (&e);
+                package_size += e.size ();
+            }
+            
+            if (size + package_size > max_size) continue;
+            
+            std::sort (package.begin (), package.end (), [] (const entry *a, const entry *b) -> bool {
+                return a->AncestorCount < b->AncestorCount;
+            });
+            
+            for (const entry *e : package) {
+                selected.push_back (e->Transaction);
+                included.insert (e->Transaction.id ());
+            }
+            
+            size += package_size;
+        }
+        
+        return selected;
+    }
+    
+    mempool::block_template mempool::make_template (int32_little version, const digest256 &previous, work::compact target, uint64 max_size) const {
+        block_template t {select (max_size), {}, {}};
+        t.Accumulator << digest256 {};
+        for (const shared_transaction &x : t.Transactions) t.Accumulator << x.id ();
+        t.Candidate = work::candidate {version, previous.Value, target, t.Accumulator.coinbase_path ()};
+        return t;
+    }
+    
+}
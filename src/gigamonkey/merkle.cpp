@@ -4,41 +4,42 @@
 #include <gigamonkey/merkle/tree.hpp>
 #include <gigamonkey/merkle/dual.hpp>
 #include <gigamonkey/merkle/server.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+#include <gigamonkey/metrics.hpp>
+#include <gigamonkey/sha256.hpp>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
 
 namespace Gigamonkey::Merkle {
     
+    digest hash_pair (const digest &a, const digest &b) {
+        byte in[64];
+        std::copy (a.begin (), a.end (), in);
+        std::copy (b.begin (), b.end (), in + 32);
+        
+        byte out[32];
+        sha256::double_hash_64 (out, in, 1);
+        
+        digest d;
+        std::copy (out, out + 32, d.begin ());
+        return d;
+    }
+    
     namespace {
     
         leaf_digests round (leaf_digests l) {
             leaf_digests r {};
             while (l.size () >= 2) {
-                r = r << hash_concatinated (l.first (), l.rest ().first ());
+                r = r << hash_pair (l.first (), l.rest ().first ());
                 l = l.rest ().rest ();
             }
-            if (l.size () == 1) r = r << hash_concatinated (l.first (), l.first ());
+            if (l.size () == 1) r = r << hash_pair (l.first (), l.first ());
             return r;
         }
     
-        bool check_proofs (ordered_list<proof> x) {
-            if (x.size () == 0) return true;
-            set<leaf> g;
-            for (proof p : x) {
-                digest256 root = p.Root;
-                branch b = p.Branch;
-                while (true) {
-                    if (g.contains (b.Leaf)) break;
-                    g = g.insert (b.Leaf);
-                    if (b.empty ()) {
-                        if (b.Leaf.Digest != root) return false;
-                        else break;
-                    }
-                    b = b.rest ();
-                }
-            }
-            return true;
-        }
-    
         void append_proofs (list<proof> &p, uint32 index, digests l, data::tree<digest256> t, const digest256 &r, uint32 height) {
             if (height == 1) {
                 p = p << proof {branch {leaf {t.root (), index}, l}, r};
@@ -71,89 +72,168 @@ namespace Gigamonkey::Merkle {
             return right_height + 1;
         }
         
-        bool check_tree(const data::tree<digest256> &t, uint32 expected_width, uint32 expected_height) {
-            if (expected_height == 0) return false;
-            if (expected_height == 1)
-                return expected_width == 1 && !t.empty () && t.left ().empty () && t.right ().empty () && t.root ().valid ();
+        // collect the nodes of t level by level, leaves first, checking that it has
+        // the shape of a tree with the given width and height. Nothing is hashed.
+        bool collect_levels (std::vector<std::vector<digest>> &levels,
+            const data::tree<digest256> &t, uint32 expected_width, uint32 expected_height) {
+            if (expected_height == 0 || t.empty ()) return false;
             
-            if (t.left ().empty ()) return false;
+            if (expected_height == 1) {
+                if (expected_width != 1 || !t.left ().empty () || !t.right ().empty () || !t.root ().valid ()) return false;
+                levels[0].push_back (t.root ());
+                return true;
+            }
             
-            uint32 expected_left_width;
-            digest256 expected_value;
+            if (t.left ().empty ()) return false;
             
+            // a node with no right branch is the hash of its left branch with itself.
             if (t.right ().empty ()) {
-                expected_left_width = expected_width;
-                expected_value = hash_concatinated (t.left ().root (), t.left ().root ());
+                if (!collect_levels (levels, t.left (), expected_width, expected_height - 1)) return false;
             } else {
-                expected_left_width = 1 << (expected_height - 2);
-                expected_value = hash_concatinated (t.left ().root (), t.right ().root ());
-                if (!check_tree (t.right (), expected_width - expected_left_width, expected_height - 1)) return false;
+                uint32 expected_left_width = 1 << (expected_height - 2);
+                if (expected_width <= expected_left_width ||
+                    !collect_levels (levels, t.left (), expected_left_width, expected_height - 1) ||
+                    !collect_levels (levels, t.right (), expected_width - expected_left_width, expected_height - 1)) return false;
             }
             
-            if (!check_tree (t.left (), expected_left_width, expected_height - 1)) return false;
-            
-            return t.root () == expected_value;
+            levels[expected_height - 1].push_back (t.root ());
+            return true;
         }
-    
-    }
-    
-    tree tree::make (leaf_digests h) {
         
-        if (h.size () == 0) tree {};
-        if (h.size () == 1) return tree {h.first ()};
-        
-        uint32 width = h.size ();
-        uint32 height = 2;
-        
-        leaf_digests next_round = round (h);
+        // levels with fewer pairs than this are not worth splitting up between threads.
+        constexpr size_t chunk = 1 << 12;
+        
+        // whether the pairs [begin, end) of children hash to parents.
+        bool check_pairs (const digest *children, const digest *parents, size_t begin, size_t end) {
+            constexpr size_t batch = 64;
+            digest hashed[batch];
+            for (size_t i = begin; i < end; i += batch) {
+                size_t count = std::min (batch, end - i);
+                hash_pairs (hashed, children + 2 * i, count);
+                if (!std::equal (hashed, hashed + count, parents + i)) return false;
+            }
+            return true;
+        }
         
-        using trees = list<data::tree<digest256>>;
-        trees Trees {};
+        // every level is checked against the one above it, so the levels can be
+        // done in any order and big levels are split between threads.
+        bool check_levels (const std::vector<std::vector<digest>> &levels, executor *e) {
+            for (size_t h = 0; h + 1 < levels.size (); h++)
+                if (levels[h + 1].size () != (levels[h].size () + 1) / 2) return false;
+            
+            std::atomic<bool> ok {true};
+            auto check_level = [&levels, &ok, e] (size_t h) {
+                const std::vector<digest> &children = levels[h];
+                const std::vector<digest> &parents = levels[h + 1];
+                size_t pairs = children.size () / 2;
+                
+                // the last digest of an odd level is paired with itself.
+                if ((children.size () & 1) && parents.back () != hash_pair (children.back (), children.back ())) ok = false;
+                
+                if (e == nullptr || pairs < 2 * chunk) {
+                    if (!check_pairs (children.data (), parents.data (), 0, pairs)) ok = false;
+                } else e->parallel_for ((pairs + chunk - 1) / chunk, [&children, &parents, &ok, pairs] (size_t c) {
+                    if (ok && !check_pairs (children.data (), parents.data (), c * chunk, std::min (pairs, (c + 1) * chunk))) ok = false;
+                });
+            };
+            
+            for (size_t h = 0; h + 1 < levels.size () && ok; h++) check_level (h);
+            return ok;
+        }
         
-        leaf_digests last = h;
-        leaf_digests next = next_round;
-
-        while (!next.empty ()) {
-            if (last.size () >= 2) {
-                Trees = Trees << data::tree<digest256> {next.first (),
-                    data::tree<digest256> {last.first ()},
-                    data::tree<digest256> {last.rest ().first ()}};
-                last = last.rest ().rest ();
-            } else {
-                Trees = Trees << data::tree<digest256> {next.first (),
-                    data::tree<digest256> {last.first ()},
-                    data::tree<digest256> {}};
-                last = last.rest ();
-            }
-            next = next.rest ();
+        bool check_tree (const tree &t, executor *e) {
+            if (t.Height == 0 || t.Width == 0) return false;
+            std::vector<std::vector<digest>> levels (t.Height);
+            return collect_levels (levels, t, t.Width, t.Height) && check_levels (levels, e);
         }
         
-        while (next_round.size () > 1) {
-            trees last_trees = Trees;
-            Trees = trees {};
-            next_round = round (next_round);
-            next = next_round;
-            height++;
-            
-            while (!next.empty ()) {
-                if (last_trees.size () >= 2) {
-                    Trees = Trees << data::tree<digest256> {next.first (),
-                        data::tree<digest256> {last_trees.first ()},
-                        data::tree<digest256> {last_trees.rest ().first ()}};
-                    last_trees = last_trees.rest ().rest ();
-                } else {
-                    Trees = Trees << data::tree<digest256> {next.first (),
-                        data::tree<digest256> {last_trees.first ()},
-                        data::tree<digest256> {}};
-                    last_trees = last_trees.rest ();
+        // Every path of a dual is checked at once by working out each node that
+        // is on some path once, level by level, rather than hashing the shared
+        // upper nodes again for each path. A node that two paths disagree about
+        // makes the dual invalid.
+        bool check_dual (const dual &d, executor *e) {
+            if (d.Paths.size () == 0) return false;
+            
+            size_t depth = (*d.Paths.begin ()).Value.Digests.size ();
+            
+            // an index has 32 bits, so no tree is deeper than that.
+            if (depth > 32) return false;
+            
+            // each path as its index and its digests in an array.
+            std::vector<uint32> indices;
+            std::vector<digest> siblings;
+            indices.reserve (d.Paths.size ());
+            siblings.reserve (d.Paths.size () * depth);
+            
+            // the nodes that we know at the current level, by index.
+            std::vector<std::pair<uint32, digest>> nodes;
+            nodes.reserve (2 * d.Paths.size ());
+            
+            for (const entry &x : d.Paths) {
+                if (x.Value.Digests.size () != depth || !x.Key.valid ()) return false;
+                if (depth < 32 && x.Value.Index >> depth != 0) return false;
+                indices.push_back (x.Value.Index);
+                for (const digest &z : x.Value.Digests) siblings.push_back (z);
+                nodes.emplace_back (x.Value.Index, x.Key);
+            }
+            
+            std::vector<digest> children;
+            std::vector<digest> parents;
+            for (size_t h = 0; h < depth; h++) {
+                for (size_t i = 0; i < indices.size (); i++)
+                    nodes.emplace_back ((indices[i] >> h) ^ 1, siblings[i * depth + h]);
+                
+                std::sort (nodes.begin (), nodes.end (), [] (const auto &a, const auto &b) {
+                    return a.first < b.first;
+                });
+                
+                // every node is now next to its sibling.
+                children.clear ();
+                auto it = nodes.begin ();
+                while (it != nodes.end ()) {
+                    auto next = it + 1;
+                    while (next != nodes.end () && next->first == it->first) {
+                        if (next->second != it->second) return false;
+                        next++;
+                    }
+                    
+                    if (children.size () % 2 == 0 && (it->first & 1)) return false;
+                    if (children.size () % 2 == 1 && it->first != (std::prev (it)->first | 1)) return false;
+                    children.push_back (it->second);
+                    it = next;
                 }
-
-                next = next.rest ();
+                
+                if (children.size () % 2 != 0) return false;
+                
+                size_t pairs = children.size () / 2;
+                parents.resize (pairs);
+                if (e == nullptr || pairs < 2 * chunk) hash_pairs (parents.data (), children.data (), pairs);
+                else e->parallel_for ((pairs + chunk - 1) / chunk, [&children, &parents, pairs] (size_t c) {
+                    size_t begin = c * chunk;
+                    hash_pairs (parents.data () + begin, children.data () + 2 * begin, std::min (chunk, pairs - begin));
+                });
+                
+                uint32 last = std::numeric_limits<uint32>::max ();
+                size_t p = 0;
+                std::vector<std::pair<uint32, digest>> next_nodes;
+                next_nodes.reserve (2 * pairs + indices.size ());
+                for (const auto &n : nodes) if (n.first >> 1 != last) {
+                    last = n.first >> 1;
+                    next_nodes.emplace_back (last, parents[p++]);
+                }
+                
+                nodes = std::move (next_nodes);
             }
+            
+            return nodes.size () == 1 && nodes[0].first == 0 && nodes[0].second == d.Root;
         }
-        
-        // trees should have size 1 by this point. 
-        return tree {Trees.first(), width, height};
+    
+    }
+    
+    tree tree::make (leaf_digests h) {
+        metrics::count (metrics::Merkle_trees);
+        metrics::stopwatch timing {metrics::Merkle_tree_make};
+        return flat_tree {h};
     }
     
     digest root (list<digest> l) {
@@ -164,7 +244,7 @@ namespace Gigamonkey::Merkle {
     
     digest root (leaf l, digests d) {
         while (d.size () > 0) {
-            l = leaf {l.Index & 1 ? hash_concatinated (d.first (), l.Digest) : hash_concatinated (l.Digest, d.first ()), l.Index >> 1};
+            l = leaf {l.Index & 1 ? hash_pair (d.first (), l.Digest) : hash_pair (l.Digest, d.first ()), l.Index >> 1};
             d = d.rest ();
         }
         return l.Digest;
@@ -187,8 +267,11 @@ namespace Gigamonkey::Merkle {
     }
     
     bool tree::valid () const {
-        if (Height == 0 || Width == 0) return false;
-        return check_tree (*this, Width, Height);
+        return check_tree (*this, nullptr);
+    }
+    
+    bool tree::valid (executor &e) const {
+        return check_tree (*this, &e);
     }
     
     proof tree::operator[] (uint32 i) const {
@@ -337,6 +420,12 @@ namespace Gigamonkey::Merkle {
         for (const proof& x : p) Paths = Paths.insert(entry(x.Branch));
     }
     
+    dual::dual(const flat_tree& t) : dual{} {
+        if (!t.valid()) return;
+        Root = t.root();
+        for (const proof& x : t.proofs()) Paths = Paths.insert(entry(x.Branch));
+    }
+    
     const ordered_list<proof> dual::proofs() const {
         ordered_list<proof> p{};
         for (const auto& e : Paths) p = p << proof{branch(e), Root};
@@ -344,7 +433,11 @@ namespace Gigamonkey::Merkle {
     }
     
     bool dual::valid() const {
-        return Root.valid() && Paths.valid() && Paths.size() > 0 && check_proofs(proofs());
+        return Root.valid() && Paths.valid() && check_dual(*this, nullptr);
+    }
+    
+    bool dual::valid(executor &e) const {
+        return Root.valid() && Paths.valid() && check_dual(*this, &e);
     }
     
     server::server(const tree& t) : server {} {
@@ -369,6 +462,8 @@ namespace Gigamonkey::Merkle {
             height--;
             write_at_height(b, t, height);
         } while (height > 0);
+        
+        index();
     }
     
     server::operator tree() const {
@@ -403,70 +498,117 @@ namespace Gigamonkey::Merkle {
         return tree{trees.first(), Width, Height};
     }
     
-    server::server(leaf_digests l) : server{} {
-        if (l.size() == 0) return;
+    server::server(leaf_digests l) : server{flat_tree{l}} {}
+    
+    server::server(const flat_tree& t) : server{} {
+        if (!t.valid()) return;
         
-        Width = l.size();
-        Height = 1;
+        Width = t.Width;
+        Height = t.Height;
         
-        uint32 width = Width;
-        uint32 total = width;
-        while (width > 1) {
-            width = (width + 1) / 2;
-            total += width;
-            Height++;
-        } 
-        Digests.resize(total);
+        Digests.resize(t.Digests.size());
+        std::copy(t.Digests.begin(), t.Digests.end(), Digests.begin());
         
-        leaf_digests v = l;
-        uint32 i = 0;
+        index();
+    }
+    
+    namespace {
         
-        while (true) {
-            leaf_digests x = v;
-            while (!x.empty()) {
-                Digests[i] = x.first();
-                x = x.rest();
-                i++;
-            }
-            if (i == total) break;
-            v = round(v);
-        } 
+        // txids are already uniformly distributed, so their first bytes will do as a hash. 
+        size_t slot_hash(const digest& d) {
+            size_t h = 0;
+            auto b = d.begin();
+            for (int i = 0; i < 8; i++, b++) h = (h << 8) | *b;
+            return h;
+        }
+        
+        // enough for a tree with 2^32 leaves. 
+        constexpr size_t max_path = 32;
+        
+    }
+    
+    void server::index() {
+        size_t capacity = 1;
+        while (capacity < 2 * size_t(Width)) capacity <<= 1;
+        size_t mask = capacity - 1;
+        
+        Slots.assign(capacity, 0);
+        for (uint32 i = 0; i < Width; i++) {
+            size_t s = slot_hash(Digests[i]) & mask;
+            
+            // if a digest appears twice, we keep the first. 
+            while (Slots[s] != 0 && Digests[Slots[s] - 1] != Digests[i]) s = (s + 1) & mask;
+            if (Slots[s] == 0) Slots[s] = i + 1;
+        }
+    }
+    
+    maybe<uint32> server::find(const digest& d) const {
+        if (Slots.empty()) return {};
+        
+        size_t mask = Slots.size() - 1;
+        for (size_t s = slot_hash(d) & mask; Slots[s] != 0; s = (s + 1) & mask)
+            if (Digests[Slots[s] - 1] == d) return Slots[s] - 1;
+        
+        return {};
+    }
+    
+    size_t server::write_path(uint32 index, std::span<digest> p) const {
+        if (index >= Width) return 0;
+        if (p.size() < Height - 1) throw std::invalid_argument{"not enough room for Merkle path"};
         
-        auto a = Digests[total - 1];
-        auto b = Digests[-1];
+        uint32 width = Width;
+        uint32 i = index;
+        size_t cumulative = 0;
+        size_t n = 0;
         
-        for (uint32 x = 0; x < Width; x++) Indices = Indices.insert(Digests[x], x + 1);
+        while (width > 1) {
+            p[n++] = Digests[cumulative + (i & 1 ? i - 1 : i == width - 1 ? i : i + 1)];
+            cumulative += width;
+            width = (width + 1) / 2;
+            i >>= 1;
+        }
         
+        return n;
     }
     
     namespace {
-        proof get_server_proof(const cross<digest>& x, uint32 width, uint32 index) {
+        proof get_server_proof(const server& x, const digest& leaf_digest, uint32 index) {
+            std::array<digest, max_path> buffer;
+            size_t n = x.write_path(index, buffer);
+            
             digests p;
-            uint32 i = index;
-            uint32 cumulative = 0;
-            
-            while (width > 1) {
-                p = p << x[cumulative + i + (i & 1 ? - 1 : i == width - 1 ? 0 : 1)];
-                cumulative += width;
-                width = (width + 1) / 2;
-                i >>= 1;
-            }
+            while (n > 0) p = p << buffer[--n];
             
-            return proof{branch{leaf{x[index], index}, data::reverse(p)}, x[-1]};
+            return proof{branch{leaf{leaf_digest, index}, p}, x.root()};
         }
     }
     
     proof server::operator[](const digest& d) const {
-        uint32 index = Indices[d];
-        if (index == 0) return {};
+        maybe<uint32> index = find(d);
+        if (!bool(index)) return {};
         
-        return get_server_proof(Digests, Width, index - 1);
+        return get_server_proof(*this, d, *index);
+    }
+    
+    std::vector<proof> server::operator[](std::span<const digest> d) const {
+        std::vector<proof> p;
+        p.reserve(d.size());
+        for (const digest& x : d) p.push_back((*this)[x]);
+        return p;
     }
         
     list<proof> server::proofs() const {
         list<proof> p;
-        for (uint32 i = 0; i < Width; i++) p = p << get_server_proof(Digests, Width, i);
+        for (uint32 i = 0; i < Width; i++) p = p << get_server_proof(*this, Digests[i], i);
         return p;
     }
     
+    proofs_table server::all_proofs() const {
+        return proofs_table{std::span<const digest>{Digests.data(), Digests.size()}, Width};
+    }
+    
+    proofs_table server::all_proofs(executor& e) const {
+        return proofs_table{std::span<const digest>{Digests.data(), Digests.size()}, Width, &e};
+    }
+    
 }
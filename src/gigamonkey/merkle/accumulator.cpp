@@ -0,0 +1,59 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/accumulator.hpp>
+
+namespace Gigamonkey::Merkle {
+    
+    void accumulator::append (const digest &d) {
+        digest next = d;
+        uint32 height = 0;
+        
+        // carry up as with a binary counter.
+        while ((Width >> height) & 1) {
+            
+            // there is nothing above, so the subtree on the left contains the first leaf.
+            if ((Width >> (height + 1)) == 0) Branch.push_back (next);
+            
+            next = hash_pair (Frontier[height], next);
+            height++;
+        }
+        
+        if (Frontier.size () <= height) Frontier.resize (height + 1);
+        Frontier[height] = next;
+        Width++;
+    }
+    
+    digest accumulator::fold (uint32 height) const {
+        uint32 i = 0;
+        while (!((Width >> i) & 1)) i++;
+        
+        // the lowest subtree has nothing to its right, so it is paired with itself.
+        digest next = hash_pair (Frontier[i], Frontier[i]);
+        
+        for (i++; i < height; i++)
+            next = (Width >> i) & 1 ? hash_pair (Frontier[i], next) : hash_pair (next, next);
+        
+        return next;
+    }
+    
+    digest accumulator::root () const {
+        if (Width == 0) return {};
+        
+        // a power of two is one complete tree.
+        if ((Width & (Width - 1)) == 0) return Frontier[Branch.size ()];
+        
+        return fold (Branch.size () + 1);
+    }
+    
+    path accumulator::coinbase_path () const {
+        digests p {};
+        if (Width == 0) return path {0, p};
+        
+        if ((Width & (Width - 1)) != 0) p = p << fold (Branch.size ());
+        for (auto i = Branch.rbegin (); i != Branch.rend (); i++) p = p << *i;
+        
+        return path {0, p};
+    }
+    
+}
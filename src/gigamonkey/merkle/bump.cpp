@@ -0,0 +1,284 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/bump.hpp>
+#include <gigamonkey/p2p/var_int.hpp>
+
+#include <set>
+#include <stdexcept>
+
+namespace Gigamonkey::Merkle {
+    
+    namespace {
+        
+        // leaf indices are 32 bits.
+        constexpr size_t max_height = 32;
+        
+        using levels = std::vector<std::map<uint64, digest>>;
+        
+        // the siblings of a leaf from the bottom up.
+        maybe<digests> siblings (const levels &known, uint64 offset) {
+            std::vector<digest> up;
+            for (size_t h = 0; h + 1 < known.size (); h++) {
+                auto s = known[h].find ((offset >> h) ^ 1);
+                if (s == known[h].end ()) return {};
+                up.push_back (s->second);
+            }
+            
+            digests d;
+            for (auto s = up.rbegin (); s != up.rend (); s++) d = d << *s;
+            return d;
+        }
+        
+        std::vector<branch> dual_branches (const dual &d) {
+            std::vector<branch> b;
+            for (const entry &e : d.Paths) b.push_back (branch {e});
+            return b;
+        }
+        
+    }
+    
+    BUMP::BUMP (uint64 block_height, const std::vector<branch> &b) : BlockHeight {block_height}, Levels {} {
+        if (b.empty ()) throw std::invalid_argument {"BUMP needs at least one branch"};
+        
+        size_t height = b.front ().Digests.size ();
+        if (height == 0) throw std::invalid_argument {"BUMP cannot be made for a block with one transaction"};
+        if (height > max_height) throw std::invalid_argument {"Merkle tree is too high"};
+        
+        // nodes on the path of some client can be computed from the level below.
+        std::vector<std::set<uint64>> paths (height);
+        digest root = b.front ().root ();
+        for (const branch &x : b) {
+            if (x.Digests.size () != height || (uint64 (x.Leaf.Index) >> height) != 0)
+                throw std::invalid_argument {"branches are for trees of different heights"};
+            
+            if (!(x.root () == root)) throw std::invalid_argument {"branches have different roots"};
+            
+            for (size_t h = 0; h < height; h++) paths[h].insert (x.Leaf.Index >> h);
+        }
+        
+        std::vector<std::map<uint64, node>> nodes (height);
+        auto put = [&nodes] (size_t h, const node &n) {
+            auto [it, inserted] = nodes[h].insert ({n.Offset, n});
+            if (!inserted && !(it->second == n)) throw std::invalid_argument {"branches do not agree"};
+        };
+        
+        for (const branch &x : b) {
+            put (0, node {x.Leaf.Index, client, x.Leaf.Digest});
+            
+            leaf l = x.Leaf;
+            size_t h = 0;
+            for (const digest &d : x.Digests) {
+                uint64 offset = l.Index ^ 1;
+                if (!paths[h].contains (offset)) {
+                    // the last node of a level with an odd number of nodes is paired with itself.
+                    if (offset & 1 && d == l.Digest) put (h, node {offset, duplicate, digest {}});
+                    else put (h, node {offset, intermediate, d});
+                }
+                
+                l = l.next (d);
+                h++;
+            }
+        }
+        
+        Levels.resize (height);
+        for (size_t h = 0; h < height; h++)
+            for (const auto &[offset, n] : nodes[h]) Levels[h].push_back (n);
+    }
+    
+    BUMP::BUMP (uint64 block_height, const dual &d) : BUMP {block_height, dual_branches (d)} {
+        maybe<digest> r = root ();
+        if (!r || !(*r == d.Root)) throw std::invalid_argument {"paths do not match the root"};
+    }
+    
+    bool BUMP::expand (levels &known) const {
+        known.clear ();
+        known.resize (Levels.size () + 1);
+        
+        for (size_t h = 0; h < Levels.size (); h++) {
+            auto &level = known[h];
+            for (const node &n : Levels[h]) {
+                if ((n.Offset >> (Levels.size () - h)) != 0) return false;
+                if (n.Flag == duplicate) continue;
+                
+                // a stored node might also have been computed from below.
+                auto [it, inserted] = level.insert ({n.Offset, n.Digest});
+                if (!inserted && !(it->second == n.Digest)) return false;
+            }
+            
+            for (const node &n : Levels[h]) if (n.Flag == duplicate) {
+                auto s = level.find (n.Offset ^ 1);
+                if (!(n.Offset & 1) || s == level.end ()) return false;
+                if (!level.insert ({n.Offset, s->second}).second) return false;
+            }
+            
+            auto &next = known[h + 1];
+            for (auto left = level.begin (); left != level.end (); left++) {
+                if (left->first & 1) continue;
+                auto right = level.find (left->first + 1);
+                if (right != level.end ()) next[left->first >> 1] = hash_pair (left->second, right->second);
+            }
+        }
+        
+        return known.back ().size () == 1 && known.back ().begin ()->first == 0;
+    }
+    
+    bool BUMP::valid () const {
+        if (Levels.empty () || Levels.size () > max_height || Levels[0].empty ()) return false;
+        
+        for (size_t h = 0; h < Levels.size (); h++) for (size_t i = 0; i < Levels[h].size (); i++) {
+            const node &n = Levels[h][i];
+            if (n.Flag > client || (n.Flag == client && h != 0)) return false;
+            if (n.Flag == duplicate && !(n.Digest == digest {})) return false;
+            if (i > 0 && Levels[h][i - 1].Offset >= n.Offset) return false;
+        }
+        
+        levels known;
+        if (!expand (known)) return false;
+        
+        bool clients = false;
+        for (const node &n : Levels[0]) if (n.Flag == client) {
+            if (!siblings (known, n.Offset)) return false;
+            clients = true;
+        }
+        
+        return clients;
+    }
+    
+    maybe<digest> BUMP::root () const {
+        levels known;
+        if (Levels.empty () || !expand (known)) return {};
+        return known.back ().begin ()->second;
+    }
+    
+    bool BUMP::verify (const digest &r) const {
+        if (!valid ()) return false;
+        return *root () == r;
+    }
+    
+    std::vector<leaf> BUMP::leaves () const {
+        std::vector<leaf> x;
+        if (!Levels.empty ()) for (const node &n : Levels[0])
+            if (n.Flag == client) x.push_back (leaf {n.Digest, uint32 (n.Offset)});
+        return x;
+    }
+    
+    bool BUMP::contains (const digest &txid) const {
+        if (!Levels.empty ()) for (const node &n : Levels[0])
+            if (n.Flag == client && n.Digest == txid) return true;
+        return false;
+    }
+    
+    proof BUMP::operator [] (const digest &txid) const {
+        levels known;
+        if (Levels.empty () || !expand (known)) return proof {};
+        
+        for (const node &n : Levels[0]) if (n.Flag == client && n.Digest == txid) {
+            maybe<digests> d = siblings (known, n.Offset);
+            if (!d) return proof {};
+            return proof {branch {leaf {txid, uint32 (n.Offset)}, *d}, known.back ().begin ()->second};
+        }
+        
+        return proof {};
+    }
+    
+    std::vector<branch> BUMP::branches () const {
+        std::vector<branch> b;
+        levels known;
+        if (Levels.empty () || !expand (known)) return b;
+        
+        for (const node &n : Levels[0]) if (n.Flag == client) {
+            maybe<digests> d = siblings (known, n.Offset);
+            if (d) b.push_back (branch {leaf {n.Digest, uint32 (n.Offset)}, *d});
+        }
+        
+        return b;
+    }
+    
+    BUMP BUMP::operator + (const BUMP &x) const {
+        if (Levels.empty ()) return x;
+        if (x.Levels.empty ()) return *this;
+        
+        if (BlockHeight != x.BlockHeight || Levels.size () != x.Levels.size ())
+            throw std::invalid_argument {"BUMPs are from different blocks"};
+        
+        std::vector<branch> b = branches ();
+        for (const branch &y : x.branches ()) b.push_back (y);
+        return BUMP {BlockHeight, b};
+    }
+    
+    BUMP BUMP::prune (const digest &txid) const {
+        std::vector<branch> b;
+        for (const branch &x : branches ()) if (!(x.Leaf.Digest == txid)) b.push_back (x);
+        if (b.empty ()) return BUMP {};
+        return BUMP {BlockHeight, b};
+    }
+    
+    BUMP::operator dual () const {
+        maybe<digest> r = root ();
+        if (!r) return dual {};
+        
+        dual d {*r};
+        for (const branch &b : branches ()) d.Paths = d.Paths.insert (b.Leaf.Digest, path {b.Leaf.Index, b.Digests});
+        return d;
+    }
+    
+    bytes BUMP::write () const {
+        size_t size = Bitcoin::var_int::size (BlockHeight) + 1;
+        for (const std::vector<node> &level : Levels) {
+            size += Bitcoin::var_int::size (level.size ());
+            for (const node &n : level) size += Bitcoin::var_int::size (n.Offset) + 1 + (n.Flag == duplicate ? 0 : 32);
+        }
+        
+        bytes b (size);
+        bytes_writer w {b.begin (), b.end ()};
+        w << Bitcoin::var_int {BlockHeight} << byte (Levels.size ());
+        for (const std::vector<node> &level : Levels) {
+            w << Bitcoin::var_int {level.size ()};
+            for (const node &n : level) {
+                w << Bitcoin::var_int {n.Offset} << byte (n.Flag);
+                if (n.Flag != duplicate) w << n.Digest;
+            }
+        }
+        
+        return b;
+    }
+    
+    maybe<BUMP> BUMP::read (bytes_view b) {
+        try {
+            BUMP x;
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            
+            Bitcoin::var_int block_height;
+            byte height;
+            r >> block_height >> height;
+            if (height == 0 || height > max_height) return {};
+            
+            x.BlockHeight = block_height;
+            x.Levels.resize (height);
+            for (std::vector<node> &level : x.Levels) {
+                Bitcoin::var_int count;
+                r >> count;
+                
+                // every node takes at least two bytes.
+                if (count > b.size () / 2) return {};
+                level.reserve (count);
+                
+                for (uint64 i = 0; i < count; i++) {
+                    Bitcoin::var_int offset;
+                    byte f;
+                    r >> offset >> f;
+                    if (f > client) return {};
+                    
+                    node n {offset, flag (f), digest {}};
+                    if (n.Flag != duplicate) r >> n.Digest;
+                    level.push_back (n);
+                }
+            }
+            
+            if (x.valid ()) return x;
+        } catch (...) {}
+        return {};
+    }
+    
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/compact_dual.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::Merkle {
+    
+    compact_dual::compact_dual (const dual &d) : compact_dual {} {
+        for (const entry &e : d.Paths) insert (proof {branch {e}, d.Root});
+    }
+    
+    size_t compact_dual::nodes () const {
+        size_t n = 0;
+        for (const auto &level : Levels) n += level.size ();
+        return n;
+    }
+    
+    memory_report compact_dual::memory_usage () const {
+        memory_report m {Leaves.size () * sizeof (digest), 0, hash_table_overhead (Leaves), 0};
+        m.Values += Leaves.size () * sizeof (uint32);
+        m.Overhead += Levels.size () * sizeof (std::map<uint32, node>);
+        m.Slack += (Levels.capacity () - Levels.size ()) * sizeof (std::map<uint32, node>);
+        for (const auto &level : Levels) {
+            m.Values += level.size () * (sizeof (uint32) + sizeof (node));
+            m.Overhead += tree_overhead (level);
+        }
+        
+        return m;
+    }
+    
+    bool compact_dual::fits (uint32 height, uint32 offset, const digest &d) const {
+        auto n = Levels[height].find (offset);
+        return n == Levels[height].end () || n->second.Digest == d;
+    }
+    
+    void compact_dual::add (uint32 height, uint32 offset, const digest &d) {
+        auto [n, inserted] = Levels[height].insert ({offset, node {d, 1}});
+        if (!inserted) n->second.References++;
+    }
+    
+    void compact_dual::release (uint32 height, uint32 offset) {
+        auto n = Levels[height].find (offset);
+        if (--n->second.References == 0) Levels[height].erase (n);
+    }
+    
+    void compact_dual::insert (const proof &p) {
+        if (!p.valid ()) throw std::invalid_argument {"invalid Merkle proof"};
+        
+        uint32 height = p.Branch.Digests.size ();
+        if ((uint64 (p.Branch.Leaf.Index) >> height) != 0) throw std::invalid_argument {"leaf index is too big for its path"};
+        
+        if (Leaves.size () != 0 && (p.Root != Root || height != Height))
+            throw std::invalid_argument {"Merkle proof is for a different tree"};
+        
+        const leaf &first = p.Branch.Leaf;
+        auto known = Leaves.find (first.Digest);
+        if (known != Leaves.end ()) {
+            if (known->second != first.Index) throw std::invalid_argument {"leaf is already in the tree at a different index"};
+            return;
+        }
+        
+        if (Leaves.size () == 0) {
+            Root = p.Root;
+            Height = height;
+            Levels.resize (height);
+        }
+        
+        // check everything before anything is changed.
+        leaf l = first;
+        uint32 h = 0;
+        for (const digest &d : p.Branch.Digests) {
+            if (!fits (h, l.Index, l.Digest) || !fits (h, l.Index ^ 1, d))
+                throw std::invalid_argument {"Merkle proof does not agree with the tree"};
+            l = l.next (d);
+            h++;
+        }
+        
+        l = first;
+        h = 0;
+        for (const digest &d : p.Branch.Digests) {
+            add (h, l.Index, l.Digest);
+            add (h, l.Index ^ 1, d);
+            l = l.next (d);
+            h++;
+        }
+        
+        Leaves.emplace (first.Digest, first.Index);
+    }
+    
+    bool compact_dual::remove (const digest &d) {
+        auto known = Leaves.find (d);
+        if (known == Leaves.end ()) return false;
+        
+        uint32 index = known->second;
+        for (uint32 h = 0; h < Height; h++) {
+            release (h, index >> h);
+            release (h, (index >> h) ^ 1);
+        }
+        
+        Leaves.erase (known);
+        if (Leaves.size () == 0) *this = compact_dual {};
+        return true;
+    }
+    
+    proof compact_dual::operator [] (const digest &d) const {
+        auto known = Leaves.find (d);
+        if (known == Leaves.end ()) return proof {};
+        
+        uint32 index = known->second;
+        digests p;
+        for (uint32 h = Height; h > 0; h--) p = p << Levels[h - 1].find ((index >> (h - 1)) ^ 1)->second.Digest;
+        
+        return proof {branch {leaf {d, index}, p}, Root};
+    }
+    
+    std::vector<leaf> compact_dual::leaves () const {
+        std::vector<leaf> x;
+        x.reserve (Leaves.size ());
+        for (const auto &[d, index] : Leaves) x.push_back (leaf {d, index});
+        std::sort (x.begin (), x.end (), [] (const leaf &a, const leaf &b) {
+            return a.Index < b.Index;
+        });
+        return x;
+    }
+    
+    compact_dual &compact_dual::operator += (const compact_dual &d) {
+        if (&d == this) return *this;
+        if (d.Leaves.size () != 0 && Leaves.size () != 0 && (d.Root != Root || d.Height != Height))
+            throw std::invalid_argument {"Merkle duals are for different trees"};
+        
+        for (const auto &[x, index] : d.Leaves) insert (d[x]);
+        return *this;
+    }
+    
+    compact_dual::operator dual () const {
+        dual d {Root};
+        for (const auto &[x, index] : Leaves) d.Paths = d.Paths.insert (x, path ((*this)[x].Branch));
+        return d;
+    }
+    
+}
@@ -0,0 +1,215 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/disk_tree.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Gigamonkey::Merkle {
+    
+    namespace {
+        
+        // the files are mapped as arrays of digests.
+        static_assert (sizeof (digest) == 32);
+        
+        // digests are written to a file this many at a time. It must be even
+        // so that only the last write of a level can leave a digest unpaired.
+        constexpr size_t chunk = 1 << 12;
+        
+        // enough for a tree with 2^32 leaves.
+        constexpr size_t max_path = 32;
+        
+        // the same as server's.
+        size_t slot_hash (const digest &d) {
+            size_t h = 0;
+            auto b = d.begin ();
+            for (int i = 0; i < 8; i++, b++) h = (h << 8) | *b;
+            return h;
+        }
+        
+        void write_all (int descriptor, const digest *d, size_t count) {
+            const char *b = reinterpret_cast<const char *> (d);
+            size_t size = count * sizeof (digest);
+            while (size > 0) {
+                ssize_t written = ::write (descriptor, b, size);
+                if (written < 0) throw std::runtime_error {"could not write Merkle tree file"};
+                b += written;
+                size -= written;
+            }
+        }
+        
+        void *map_file (int descriptor, size_t size, int protection) {
+            void *m = mmap (nullptr, size, protection, MAP_SHARED, descriptor, 0);
+            if (m == MAP_FAILED) throw std::runtime_error {"could not map Merkle tree file"};
+            return m;
+        }
+        
+    }
+    
+    disk_tree::disk_tree (const std::string &prefix) :
+        Prefix {prefix}, Levels {}, Width {0}, Height {0}, IndexDescriptor {-1}, Slots {nullptr}, Capacity {0} {}
+    
+    disk_tree::~disk_tree () {
+        close ();
+    }
+    
+    std::string disk_tree::file_name (uint32 height) const {
+        return Prefix + "." + std::to_string (height);
+    }
+    
+    void disk_tree::close () {
+        for (uint32 h = 0; h < Levels.size (); h++) {
+            if (Levels[h].Map != nullptr) munmap (const_cast<digest *> (Levels[h].Map), Levels[h].Written * sizeof (digest));
+            if (Levels[h].Descriptor >= 0) ::close (Levels[h].Descriptor);
+            unlink (file_name (h).c_str ());
+        }
+        
+        if (Slots != nullptr) munmap (Slots, Capacity * sizeof (uint32));
+        if (IndexDescriptor >= 0) {
+            ::close (IndexDescriptor);
+            unlink ((Prefix + ".index").c_str ());
+        }
+        
+        Levels.clear ();
+        Slots = nullptr;
+        IndexDescriptor = -1;
+    }
+    
+    void disk_tree::append (const digest &d) {
+        if (finished ()) throw std::logic_error {"cannot append to a finished Merkle tree"};
+        if (Width == std::numeric_limits<uint32>::max ()) throw std::logic_error {"too many leaves"};
+        push (0, d);
+        Width++;
+    }
+    
+    void disk_tree::push (uint32 height, const digest &d) {
+        if (height == Levels.size ()) {
+            int descriptor = ::open (file_name (height).c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (descriptor < 0) throw std::runtime_error {"could not open Merkle tree file " + file_name (height)};
+            Levels.push_back (level {descriptor, 0, {}, nullptr});
+            Levels.back ().Buffer.reserve (chunk);
+        }
+        
+        Levels[height].Buffer.push_back (d);
+        if (Levels[height].Buffer.size () == chunk) flush (height);
+    }
+    
+    void disk_tree::flush (uint32 height) {
+        // pushing to the level above may add a level, so we don't keep a reference.
+        std::vector<digest> buffer = std::move (Levels[height].Buffer);
+        write_all (Levels[height].Descriptor, buffer.data (), buffer.size ());
+        Levels[height].Written += buffer.size ();
+        
+        size_t pairs = buffer.size () / 2;
+        std::vector<digest> parents (pairs + (buffer.size () & 1));
+        hash_pairs (parents.data (), buffer.data (), pairs);
+        
+        // the last digest of an odd level is paired with itself.
+        if (buffer.size () & 1) parents[pairs] = hash_pair (buffer.back (), buffer.back ());
+        
+        buffer.clear ();
+        Levels[height].Buffer = std::move (buffer);
+        
+        for (const digest &d : parents) push (height + 1, d);
+    }
+    
+    void disk_tree::finish () {
+        if (finished ()) return;
+        if (Width == 0) throw std::logic_error {"Merkle tree has no leaves"};
+        
+        // every level with more than one digest has a level above it.
+        uint32 h = 0;
+        while (Levels[h].Written + Levels[h].Buffer.size () > 1) flush (h++);
+        
+        write_all (Levels[h].Descriptor, Levels[h].Buffer.data (), Levels[h].Buffer.size ());
+        Levels[h].Written += Levels[h].Buffer.size ();
+        
+        for (level &l : Levels) {
+            l.Buffer = {};
+            l.Map = static_cast<const digest *> (map_file (l.Descriptor, l.Written * sizeof (digest), PROT_READ));
+        }
+        
+        index ();
+        Height = h + 1;
+    }
+    
+    void disk_tree::index () {
+        Capacity = 1;
+        while (Capacity < 2 * size_t (Width)) Capacity <<= 1;
+        size_t mask = Capacity - 1;
+        
+        IndexDescriptor = ::open ((Prefix + ".index").c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (IndexDescriptor < 0) throw std::runtime_error {"could not open Merkle tree file " + Prefix + ".index"};
+        if (ftruncate (IndexDescriptor, Capacity * sizeof (uint32)) != 0) throw std::runtime_error {"could not resize Merkle tree index"};
+        Slots = static_cast<uint32 *> (map_file (IndexDescriptor, Capacity * sizeof (uint32), PROT_READ | PROT_WRITE));
+        
+        const digest *leaves = Levels[0].Map;
+        for (uint32 i = 0; i < Width; i++) {
+            size_t s = slot_hash (leaves[i]) & mask;
+            
+            // if a digest appears twice, we keep the first.
+            while (Slots[s] != 0 && leaves[Slots[s] - 1] != leaves[i]) s = (s + 1) & mask;
+            if (Slots[s] == 0) Slots[s] = i + 1;
+        }
+    }
+    
+    digest disk_tree::root () const {
+        if (!finished ()) return digest {};
+        return Levels[Height - 1].Map[0];
+    }
+    
+    maybe<uint32> disk_tree::find (const digest &d) const {
+        if (Slots == nullptr) return {};
+        
+        size_t mask = Capacity - 1;
+        for (size_t s = slot_hash (d) & mask; Slots[s] != 0; s = (s + 1) & mask)
+            if (Levels[0].Map[Slots[s] - 1] == d) return Slots[s] - 1;
+        
+        return {};
+    }
+    
+    size_t disk_tree::write_path (uint32 index, std::span<digest> p) const {
+        if (!finished () || index >= Width) return 0;
+        if (p.size () < Height - 1) throw std::invalid_argument {"not enough room for Merkle path"};
+        
+        uint32 width = Width;
+        uint32 i = index;
+        size_t n = 0;
+        
+        for (uint32 h = 0; width > 1; h++) {
+            p[n++] = Levels[h].Map[i & 1 ? i - 1 : i == width - 1 ? i : i + 1];
+            width = (width + 1) / 2;
+            i >>= 1;
+        }
+        
+        return n;
+    }
+    
+    proof disk_tree::operator [] (const digest &d) const {
+        maybe<uint32> index = find (d);
+        if (!bool (index)) return {};
+        
+        std::array<digest, max_path> buffer;
+        size_t n = write_path (*index, buffer);
+        
+        digests p;
+        while (n > 0) p = p << buffer[--n];
+        
+        return proof {branch {leaf {d, *index}, p}, root ()};
+    }
+    
+    std::vector<proof> disk_tree::operator [] (std::span<const digest> d) const {
+        std::vector<proof> p;
+        p.reserve (d.size ());
+        for (const digest &x : d) p.push_back ((*this)[x]);
+        return p;
+    }
+    
+}
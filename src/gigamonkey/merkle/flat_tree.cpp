@@ -0,0 +1,297 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/flat_tree.hpp>
+#include <gigamonkey/merkle/tree.hpp>
+#include <gigamonkey/merkle/serialize.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::Merkle {
+    
+    namespace {
+        
+        // levels with fewer pairs than this are not worth splitting up between threads.
+        constexpr size_t chunk = 1 << 12;
+        
+        // call f on [begin, end) for pieces of [0, n), on the threads of e if there are enough.
+        template <typename F> void for_chunks (executor *e, size_t n, F f) {
+            if (e == nullptr || n < 2 * chunk) f (0, n);
+            else e->parallel_for ((n + chunk - 1) / chunk, [n, &f] (size_t c) {
+                f (c * chunk, std::min (n, (c + 1) * chunk));
+            });
+        }
+        
+        // whether the node at i is the last of an odd level, so that it is paired with itself.
+        bool duplicated (uint32 i, uint32 width) {
+            return !(i & 1) && i == width - 1;
+        }
+        
+        byte *write_var_int (byte *out, uint64 x) {
+            if (x < 0xfd) {
+                *out = byte (x);
+                return out + 1;
+            }
+            
+            size_t n = x <= 0xffff ? 2 : x <= 0xffffffff ? 4 : 8;
+            *out++ = n == 2 ? 0xfd : n == 4 ? 0xfe : 0xff;
+            for (size_t i = 0; i < n; i++) *out++ = byte (x >> (8 * i));
+            return out;
+        }
+        
+        byte *write_digest (byte *out, const digest &d) {
+            return std::copy (d.begin (), d.end (), out);
+        }
+        
+    }
+    
+    void hash_pairs (digest *out, const digest *in, size_t pairs) {
+        constexpr size_t batch = 16;
+        byte buffer_in[64 * batch];
+        byte buffer_out[32 * batch];
+        
+        for (size_t i = 0; i < pairs; i += batch) {
+            size_t count = std::min (batch, pairs - i);
+            for (size_t j = 0; j < 2 * count; j++) std::copy (in[2 * i + j].begin (), in[2 * i + j].end (), buffer_in + 32 * j);
+            sha256::double_hash_64 (buffer_out, buffer_in, count);
+            for (size_t j = 0; j < count; j++) std::copy (buffer_out + 32 * j, buffer_out + 32 * j + 32, out[i + j].begin ());
+        }
+    }
+    
+    digest coinbase_root (const digest &coinbase, std::span<const digest> branch) {
+        digest root = coinbase;
+        for (const digest &d : branch) root = hash_pair (root, d);
+        return root;
+    }
+    
+    void coinbase_roots (std::span<digest> roots, std::span<const digest> coinbases, std::span<const digest> branch) {
+        if (roots.size () != coinbases.size ()) throw std::invalid_argument {"need one root for each coinbase"};
+        
+        constexpr size_t batch = 16;
+        byte buffer_in[64 * batch];
+        byte buffer_out[32 * batch];
+        
+        // each message is the node so far followed by the next digest of the
+        // branch, which is the same for every coinbase.
+        for (size_t i = 0; i < coinbases.size (); i += batch) {
+            size_t count = std::min (batch, coinbases.size () - i);
+            for (size_t j = 0; j < count; j++) std::copy (coinbases[i + j].begin (), coinbases[i + j].end (), buffer_in + 64 * j);
+            
+            for (const digest &d : branch) {
+                for (size_t j = 0; j < count; j++) std::copy (d.begin (), d.end (), buffer_in + 64 * j + 32);
+                sha256::double_hash_64 (buffer_out, buffer_in, count);
+                for (size_t j = 0; j < count; j++) std::copy (buffer_out + 32 * j, buffer_out + 32 * j + 32, buffer_in + 64 * j);
+            }
+            
+            for (size_t j = 0; j < count; j++) std::copy (buffer_in + 64 * j, buffer_in + 64 * j + 32, roots[i + j].begin ());
+        }
+    }
+    
+    size_t flat_tree::size (uint32 width) {
+        if (width == 0) return 0;
+        size_t total = width;
+        while (width > 1) {
+            width = (width + 1) / 2;
+            total += width;
+        }
+        return total;
+    }
+    
+    flat_tree::flat_tree (leaf_digests l) : flat_tree {} {
+        if (l.size () == 0) return;
+        Digests.reserve (size (l.size ()));
+        for (const digest &d : l) Digests.push_back (d);
+        build (nullptr);
+    }
+    
+    flat_tree::flat_tree (std::vector<digest> leaves) : flat_tree {} {
+        Digests = std::move (leaves);
+        build (nullptr);
+    }
+    
+    flat_tree::flat_tree (std::vector<digest> leaves, executor &e) : flat_tree {} {
+        Digests = std::move (leaves);
+        build (&e);
+    }
+    
+    void flat_tree::build (executor *e) {
+        Width = Digests.size ();
+        if (Width == 0) return;
+        
+        Digests.resize (size (Width));
+        Height = 1;
+        
+        size_t offset = 0;
+        uint32 width = Width;
+        while (width > 1) {
+            const digest *in = Digests.data () + offset;
+            digest *out = Digests.data () + offset + width;
+            size_t pairs = width / 2;
+            
+            if (e == nullptr || pairs < 2 * chunk) hash_pairs (out, in, pairs);
+            else e->parallel_for ((pairs + chunk - 1) / chunk, [in, out, pairs] (size_t c) {
+                size_t begin = c * chunk;
+                hash_pairs (out + begin, in + 2 * begin, std::min (chunk, pairs - begin));
+            });
+            
+            // the last digest of an odd level is paired with itself.
+            if (width & 1) out[pairs] = hash_pair (in[width - 1], in[width - 1]);
+            
+            offset += width;
+            width = (width + 1) / 2;
+            Height++;
+        }
+    }
+    
+    std::span<const digest> flat_tree::level (uint32 height) const {
+        if (height >= Height) return {};
+        
+        size_t offset = 0;
+        uint32 width = Width;
+        for (uint32 h = 0; h < height; h++) {
+            offset += width;
+            width = (width + 1) / 2;
+        }
+        
+        return std::span<const digest> {Digests.data () + offset, width};
+    }
+    
+    proof flat_tree::operator [] (uint32 index) const {
+        if (index >= Width) return {};
+        
+        digests p;
+        uint32 i = index;
+        uint32 width = Width;
+        size_t offset = 0;
+        
+        while (width > 1) {
+            p = p << Digests[offset + (i & 1 ? i - 1 : i == width - 1 ? i : i + 1)];
+            offset += width;
+            width = (width + 1) / 2;
+            i >>= 1;
+        }
+        
+        return proof {branch {leaf {Digests[index], index}, data::reverse (p)}, root ()};
+    }
+    
+    list<proof> flat_tree::proofs () const {
+        list<proof> p;
+        for (uint32 i = 0; i < Width; i++) p = p << (*this)[i];
+        return p;
+    }
+    
+    proofs_table::proofs_table (std::span<const digest> levels, uint32 width, executor *e) : proofs_table {} {
+        if (width == 0) return;
+        if (levels.size () != flat_tree::size (width)) throw std::invalid_argument {"wrong number of digests for Merkle tree"};
+        
+        Width = width;
+        for (uint32 w = width; w > 1; w = (w + 1) / 2) Depth++;
+        Root = levels.back ();
+        Digests.resize (size_t (Width) * (Depth + 1));
+        
+        for_chunks (e, Width, [this, levels] (size_t begin, size_t end) {
+            for (size_t index = begin; index < end; index++) {
+                digest *out = Digests.data () + index * (Depth + 1);
+                *out++ = levels[index];
+                
+                uint32 i = index;
+                uint32 width = Width;
+                size_t offset = 0;
+                while (width > 1) {
+                    *out++ = levels[offset + (i & 1 ? i - 1 : i == width - 1 ? i : i + 1)];
+                    offset += width;
+                    width = (width + 1) / 2;
+                    i >>= 1;
+                }
+            }
+        });
+    }
+    
+    proof proofs_table::operator [] (uint32 index) const {
+        if (index >= Width) return {};
+        
+        std::span<const digest> x = path (index);
+        digests p;
+        for (size_t k = Depth; k > 0; k--) p = p << x[k - 1];
+        
+        return proof {branch {Merkle::leaf {leaf (index), index}, p}, Root};
+    }
+    
+    size_t proofs_table::serialized_size (uint32 index) const {
+        // flags, index, txid, root, and the number of nodes.
+        size_t size = 1 + Bitcoin::var_int::size (index) + 64 + Bitcoin::var_int::size (Depth);
+        
+        uint32 i = index;
+        for (uint32 width = Width; width > 1; width = (width + 1) / 2, i >>= 1)
+            size += duplicated (i, width) ? 1 : 33;
+        
+        return size;
+    }
+    
+    void proofs_table::write (uint32 index, byte *out) const {
+        *out++ = byte (BitcoinAssociation::proofs_serialization_standard::target_type_Merkle_root);
+        out = write_var_int (out, index);
+        out = write_digest (out, leaf (index));
+        out = write_digest (out, Root);
+        out = write_var_int (out, Depth);
+        
+        std::span<const digest> x = path (index);
+        uint32 i = index;
+        uint32 k = 0;
+        for (uint32 width = Width; width > 1; width = (width + 1) / 2, i >>= 1, k++)
+            if (duplicated (i, width)) *out++ = 1;
+            else {
+                *out++ = 0;
+                out = write_digest (out, x[k]);
+            }
+    }
+    
+    bytes proofs_table::write (executor *e) const {
+        // where each proof begins.
+        std::vector<size_t> offsets (size_t (Width) + 1);
+        offsets[0] = 0;
+        for (uint32 i = 0; i < Width; i++) offsets[i + 1] = offsets[i] + serialized_size (i);
+        
+        bytes b (offsets.back ());
+        for_chunks (e, Width, [this, &b, &offsets] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) write (i, b.data () + offsets[i]);
+        });
+        
+        return b;
+    }
+    
+    flat_tree::operator tree () const {
+        if (Width == 0) return tree {};
+        
+        list<data::tree<digest>> trees {};
+        
+        auto b = Digests.begin ();
+        for (uint32 i = 0; i < Width; i++) {
+            trees = trees << *b;
+            b++;
+        }
+        
+        while (trees.size () > 1) {
+            list<data::tree<digest>> next {};
+            
+            while (trees.size () > 1) {
+                next = next << data::tree<digest> {*b, trees.first (), trees.rest ().first ()};
+                trees = trees.rest ().rest ();
+                b++;
+            }
+            
+            if (trees.size () == 1) {
+                next = next << data::tree<digest> {*b, trees.first (), data::tree<digest> {}};
+                trees = trees.rest ();
+                b++;
+            }
+            
+            trees = next;
+        }
+        
+        return tree {trees.first (), Width, Height};
+    }
+    
+}
@@ -1,5 +1,7 @@
 #include<gigamonkey/merkle/serialize.hpp>
 
+#include <limits>
+
 namespace Gigamonkey::BitcoinAssociation {
     
     digest256 read_digest (const string &x) {
@@ -338,4 +340,164 @@ namespace Gigamonkey::BitcoinAssociation {
         return {};
     }
     
+    namespace {
+        
+        // read a var int from the front of b and move past it. 
+        bool read_var_int (bytes_view &b, uint64 &x) {
+            if (b.size () < 1) return false;
+            byte first = b[0];
+            size_t size = first < 0xfd ? 0 : first == 0xfd ? 2 : first == 0xfe ? 4 : 8;
+            if (b.size () < size + 1) return false;
+            
+            if (size == 0) x = first;
+            else {
+                x = 0;
+                for (size_t i = size; i > 0; i--) x = (x << 8) | b[i];
+            }
+
+            b = b.substr (size + 1);
+            return true;
+        }
+        
+        bool read_bytes (bytes_view &b, size_t size, bytes_view &x) {
+            if (b.size () < size) return false;
+            x = b.substr (0, size);
+            b = b.substr (size);
+            return true;
+        }
+        
+        digest256 to_digest (bytes_view b) {
+            digest256 d;
+            std::copy (b.begin (), b.end (), d.begin ());
+            return d;
+        }
+        
+    }
+    
+    proofs_serialization_standard::view::view (bytes_view b) :
+        Flags {0}, Index {0}, Transaction {}, Txid {}, Target {}, Nodes {0}, Path {}, Valid {false} {
+        if (b.size () < 1) return;
+        Flags = b[0];
+        b = b.substr (1);
+        
+        if (composite_proof (Flags) || proof_type (Flags) != proof_type_branch) return;
+        
+        uint64 index;
+        if (!read_var_int (b, index) || index > std::numeric_limits<uint32>::max ()) return;
+        Index = uint32 (index);
+        
+        if (transaction_included ()) {
+            uint64 size;
+            if (!read_var_int (b, size) || !read_bytes (b, size, Transaction)) return;
+        } else if (!read_bytes (b, 32, Txid)) return;
+        
+        switch (target_type ()) {
+            case target_type_block_hash:
+            case target_type_Merkle_root:
+                if (!read_bytes (b, 32, Target)) return;
+                break;
+            case target_type_block_header:
+                if (!read_bytes (b, 80, Target)) return;
+                break;
+            default: return;
+        }
+        
+        uint64 nodes;
+        if (!read_var_int (b, nodes)) return;
+        
+        // check every node now so that nothing needs to be checked later. 
+        bytes_view rest = b;
+        for (uint64 i = 0; i < nodes; i++) {
+            if (rest.size () < 1) return;
+            if (rest[0] == 1) rest = rest.substr (1);
+            else if (rest[0] == 0 && rest.size () >= 33) rest = rest.substr (33);
+            else return;
+        }
+        
+        Nodes = nodes;
+        Path = b.substr (0, b.size () - rest.size ());
+        Valid = true;
+    }
+    
+    digest256 proofs_serialization_standard::view::txid () const {
+        if (!Valid) return {};
+        if (transaction_included ()) return Bitcoin::Hash256 (Transaction);
+        return to_digest (Txid);
+    }
+    
+    maybe<digest256> proofs_serialization_standard::view::block_hash () const {
+        if (!Valid || target_type () != target_type_block_hash) return {};
+        return to_digest (Target);
+    }
+    
+    maybe<digest256> proofs_serialization_standard::view::Merkle_root () const {
+        if (!Valid) return {};
+        if (target_type () == target_type_Merkle_root) return to_digest (Target);
+        if (target_type () == target_type_block_header) return to_digest (Target.substr (36, 32));
+        return {};
+    }
+    
+    maybe<Bitcoin::header> proofs_serialization_standard::view::block_header () const {
+        if (!Valid || target_type () != target_type_block_header) return {};
+        return Bitcoin::header {slice<80> {const_cast<byte *> (Target.data ())}};
+    }
+    
+    digest256 proofs_serialization_standard::view::root () const {
+        if (!Valid) return {};
+        
+        Merkle::leaf l {txid (), Index};
+        bytes_view rest = Path;
+        for (size_t i = 0; i < Nodes; i++) {
+            if (rest[0] == 1) {
+                l = l.next (l.Digest);
+                rest = rest.substr (1);
+            } else {
+                l = l.next (to_digest (rest.substr (1, 32)));
+                rest = rest.substr (33);
+            }
+        }
+        
+        return l.Digest;
+    }
+    
+    bool proofs_serialization_standard::view::verify () const {
+        maybe<digest256> expected = Merkle_root ();
+        return bool (expected) && root () == *expected;
+    }
+    
+    bool proofs_serialization_standard::view::verify (const Bitcoin::header &h) const {
+        if (!Valid) return false;
+        if (target_type () == target_type_block_hash && to_digest (Target) != h.hash ()) return false;
+        if (target_type () == target_type_block_header && !(Bitcoin::header {slice<80> {const_cast<byte *> (Target.data ())}} == h)) return false;
+        if (target_type () == target_type_Merkle_root && to_digest (Target) != h.MerkleRoot) return false;
+        return root () == h.MerkleRoot;
+    }
+    
+    Merkle::path proofs_serialization_standard::view::path () const {
+        if (!Valid) return {};
+        
+        Merkle::path p;
+        p.Index = Index;
+        
+        Merkle::digests d;
+        Merkle::leaf l {txid (), Index};
+        bytes_view rest = Path;
+        for (size_t i = 0; i < Nodes; i++) {
+            digest256 next;
+            if (rest[0] == 1) {
+                next = l.Digest;
+                rest = rest.substr (1);
+            } else {
+                next = to_digest (rest.substr (1, 32));
+                rest = rest.substr (33);
+            }
+            
+            d = d << next;
+            l = l.next (next);
+        }
+        
+        p.Digests = data::reverse (d);
+        return p;
+    }
+    
 }
@@ -0,0 +1,235 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/metrics.hpp>
+
+#include <atomic>
+#include <bit>
+#include <mutex>
+
+namespace Gigamonkey::metrics {
+    
+    const char *name (counter c) {
+        switch (c) {
+            case hashes: return "hashes";
+            case scripts: return "scripts";
+            case signatures: return "signatures";
+            case shares_accepted: return "shares_accepted";
+            case shares_rejected: return "shares_rejected";
+            case MAPI_calls: return "MAPI_calls";
+            case Merkle_trees: return "Merkle_trees";
+            default: return "";
+        }
+    }
+    
+    const char *name (timer t) {
+        switch (t) {
+            case script_run: return "script_run";
+            case signature_verify: return "signature_verify";
+            case share_check: return "share_check";
+            case MAPI_call: return "MAPI_call";
+            case Merkle_tree_make: return "Merkle_tree_make";
+            default: return "";
+        }
+    }
+    
+    size_t histogram::bucket (uint64 ns) {
+        if (ns < 16) return ns;
+        size_t width = std::bit_width (ns);
+        // the leading four bits, which are between 8 and 15.
+        uint64 leading = ns >> (width - 4);
+        return 16 + (width - 5) * 8 + (leading - 8);
+    }
+    
+    uint64 histogram::lower (size_t b) {
+        if (b < 16) return b;
+        size_t width = (b - 16) / 8 + 5;
+        return uint64 ((b - 16) % 8 + 8) << (width - 4);
+    }
+    
+    uint64 histogram::percentile (double p) const {
+        if (Count == 0) return 0;
+        uint64 rank = std::min (Count - 1, uint64 (p * Count));
+        uint64 seen = 0;
+        for (size_t b = 0; b < Buckets.size (); b++) {
+            seen += Buckets[b];
+            if (seen > rank) return lower (b);
+        }
+        
+        return Max;
+    }
+    
+    snapshot::operator JSON () const {
+        JSON c = JSON::object ();
+        for (byte i = 0; i < counters; i++) c[name (counter (i))] = Counters[i];
+        
+        JSON t = JSON::object ();
+        for (byte i = 0; i < timers; i++) {
+            const histogram &h = Timers[i];
+            
+            // only buckets that have something in them, by their lower bounds.
+            JSON::array_t b;
+            for (size_t j = 0; j < h.Buckets.size (); j++)
+                if (h.Buckets[j] != 0) b.push_back (JSON::array ({histogram::lower (j), h.Buckets[j]}));
+            
+            t[name (timer (i))] = JSON {
+                {"count", h.Count},
+                {"sum_ns", h.Sum},
+                {"max_ns", h.Max},
+                {"p50_ns", h.percentile (.5)},
+                {"p90_ns", h.percentile (.9)},
+                {"p99_ns", h.percentile (.99)},
+                {"buckets", b}};
+        }
+        
+        JSON m = JSON::object ();
+        for (const auto &[n, r] : Memory) m[n] = JSON (r);
+        
+        return JSON {{"counters", c}, {"timers", t}, {"memory", m}};
+    }
+    
+    namespace {
+        
+        // only the thread that owns a block writes to it, so there is no
+        // need for read-modify-write operations. Others only read.
+        void inline add (std::atomic<uint64> &x, uint64 n) {
+            x.store (x.load (std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        
+        struct timer_block {
+            std::atomic<uint64> Count {0};
+            std::atomic<uint64> Sum {0};
+            std::atomic<uint64> Max {0};
+            std::array<std::atomic<uint64>, histogram::buckets> Buckets {};
+            
+            void record (uint64 ns) {
+                add (Count, 1);
+                add (Sum, ns);
+                if (ns > Max.load (std::memory_order_relaxed)) Max.store (ns, std::memory_order_relaxed);
+                add (Buckets[histogram::bucket (ns)], 1);
+            }
+            
+            void read (histogram &h) const {
+                h.Count += Count.load (std::memory_order_relaxed);
+                h.Sum += Sum.load (std::memory_order_relaxed);
+                h.Max = std::max (h.Max, Max.load (std::memory_order_relaxed));
+                for (size_t i = 0; i < histogram::buckets; i++) h.Buckets[i] += Buckets[i].load (std::memory_order_relaxed);
+            }
+            
+            void clear () {
+                Count.store (0, std::memory_order_relaxed);
+                Sum.store (0, std::memory_order_relaxed);
+                Max.store (0, std::memory_order_relaxed);
+                for (auto &b : Buckets) b.store (0, std::memory_order_relaxed);
+            }
+        };
+        
+        struct block {
+            std::array<std::atomic<uint64>, counters> Counters {};
+            std::array<timer_block, timers> Timers {};
+            
+            void read (snapshot &s) const {
+                for (size_t i = 0; i < counters; i++) s.Counters[i] += Counters[i].load (std::memory_order_relaxed);
+                for (size_t i = 0; i < timers; i++) Timers[i].read (s.Timers[i]);
+            }
+            
+            void clear () {
+                for (auto &c : Counters) c.store (0, std::memory_order_relaxed);
+                for (auto &t : Timers) t.clear ();
+            }
+        };
+        
+        // the blocks of every running thread, and the totals of those that have exited.
+        struct registry {
+            std::mutex Mutex;
+            std::vector<block *> Live;
+            snapshot Retired;
+        };
+        
+        registry &blocks () {
+            // never destroyed so that threads that exit after main has returned can still use it.
+            static registry *Registry = new registry {};
+            return *Registry;
+        }
+        
+        struct local {
+            block Block;
+            
+            local () {
+                registry &r = blocks ();
+                std::lock_guard<std::mutex> lock (r.Mutex);
+                r.Live.push_back (&Block);
+            }
+            
+            ~local () {
+                registry &r = blocks ();
+                std::lock_guard<std::mutex> lock (r.Mutex);
+                Block.read (r.Retired);
+                std::erase (r.Live, &Block);
+            }
+        };
+        
+        block &this_thread () {
+            thread_local local Local {};
+            return Local.Block;
+        }
+        
+        struct sources {
+            std::mutex Mutex;
+            std::vector<const memory_source *> Live;
+        };
+        
+        sources &memory_sources () {
+            static sources *Sources = new sources {};
+            return *Sources;
+        }
+        
+    }
+    
+    memory_source::memory_source (std::string name, std::function<memory_report ()> f) :
+        Name {std::move (name)}, Report {std::move (f)} {
+        sources &s = memory_sources ();
+        std::lock_guard<std::mutex> lock (s.Mutex);
+        s.Live.push_back (this);
+    }
+    
+    memory_source::~memory_source () {
+        sources &s = memory_sources ();
+        std::lock_guard<std::mutex> lock (s.Mutex);
+        std::erase (s.Live, this);
+    }
+    
+    void detail::count (counter c, uint64 n) {
+        add (this_thread ().Counters[c], n);
+    }
+    
+    void detail::time (timer t, uint64 ns) {
+        this_thread ().Timers[t].record (ns);
+    }
+    
+    snapshot collect () {
+        snapshot s;
+        
+        // the counters are read first so that a memory source which counts
+        // something in its report does not wait on the registry.
+        {
+            registry &r = blocks ();
+            std::lock_guard<std::mutex> lock (r.Mutex);
+            s = r.Retired;
+            for (const block *b : r.Live) b->read (s);
+        }
+        
+        sources &m = memory_sources ();
+        std::lock_guard<std::mutex> memory_lock (m.Mutex);
+        for (const memory_source *x : m.Live) s.Memory[x->Name] += x->Report ();
+        return s;
+    }
+    
+    void reset () {
+        registry &r = blocks ();
+        std::lock_guard<std::mutex> lock (r.Mutex);
+        r.Retired = snapshot {};
+        for (block *b : r.Live) b->clear ();
+    }
+    
+}
@@ -0,0 +1,246 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/p2p/block_filter.hpp>
+#include <gigamonkey/p2p/compact_block.hpp>
+#include <gigamonkey/hash.hpp>
+
+#include <algorithm>
+
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    namespace {
+        
+        uint64 read_64 (const byte *b) {
+            uint64 x = 0;
+            for (int i = 7; i >= 0; i--) x = (x << 8) | b[i];
+            return x;
+        }
+        
+        // the SipHash key is the first 16 bytes of the block hash.
+        std::pair<uint64, uint64> filter_key (const digest256 &block) {
+            return {read_64 (block.Value.data ()), read_64 (block.Value.data () + 8)};
+        }
+        
+        // map a hash into [0, n * M) without dividing.
+        uint64 reduce (uint64 hash, uint64 n) {
+            return static_cast<uint64> ((static_cast<unsigned __int128> (hash) * (n * basic_filter_M)) >> 64);
+        }
+        
+        // outputs that begin with OP_RETURN or, after Genesis, OP_FALSE OP_RETURN
+        // are data and can never be spent, so they are left out.
+        bool include_output (bytes_view script) {
+            return script.size () != 0 && script[0] != 0x6a && !(script.size () > 1 && script[0] == 0x00 && script[1] == 0x6a);
+        }
+        
+        // bits are written from the most significant bit of each byte.
+        struct bit_writer {
+            bytes Data {};
+            byte Current {0};
+            int Bits {0};
+            
+            void bit (bool b) {
+                Current = (Current << 1) | byte (b);
+                if (++Bits == 8) {
+                    Data.push_back (Current);
+                    Current = 0;
+                    Bits = 0;
+                }
+            }
+            
+            void bits (uint64 x, uint32 n) {
+                while (n > 0) bit ((x >> --n) & 1);
+            }
+            
+            bytes finish () {
+                if (Bits != 0) Data.push_back (Current << (8 - Bits));
+                return std::move (Data);
+            }
+        };
+        
+        struct bit_reader {
+            bytes_view Data;
+            size_t Position {0};
+            
+            bool done () const {
+                return Position == 8 * Data.size ();
+            }
+            
+            // must not be done.
+            bool bit () {
+                bool b = (Data[Position / 8] >> (7 - Position % 8)) & 1;
+                Position++;
+                return b;
+            }
+        };
+        
+        // decodes the elements of a filter in order.
+        struct golomb_reader {
+            bit_reader Bits;
+            uint64 Remaining;
+            uint64 Last {0};
+            
+            // false if there is nothing left or the filter is cut short.
+            bool next (uint64 &x) {
+                if (Remaining == 0) return false;
+                uint64 q = 0;
+                while (true) {
+                    if (Bits.done ()) return false;
+                    if (!Bits.bit ()) break;
+                    q++;
+                }
+                
+                uint64 r = 0;
+                for (uint32 i = 0; i < basic_filter_P; i++) {
+                    if (Bits.done ()) return false;
+                    r = (r << 1) | uint64 (Bits.bit ());
+                }
+                
+                Remaining--;
+                Last += (q << basic_filter_P) | r;
+                x = Last;
+                return true;
+            }
+        };
+        
+        block_filter make_filter (const digest256 &block, std::vector<uint64> hashes) {
+            // the elements are a set, so identical scripts are only included once.
+            std::sort (hashes.begin (), hashes.end ());
+            hashes.erase (std::unique (hashes.begin (), hashes.end ()), hashes.end ());
+            
+            uint64 n = hashes.size ();
+            
+            // reduce is monotonic, so the reduced hashes are still in order.
+            bit_writer w {};
+            uint64 last = 0;
+            for (uint64 h : hashes) {
+                uint64 x = reduce (h, n);
+                uint64 difference = x - last;
+                last = x;
+                for (uint64 q = difference >> basic_filter_P; q > 0; q--) w.bit (true);
+                w.bit (false);
+                w.bits (difference, basic_filter_P);
+            }
+            
+            return block_filter {block, n, w.finish ()};
+        }
+        
+    }
+    
+    block_filter::operator bytes () const {
+        bytes b (var_int::size (N) + Data.size ());
+        bytes_writer w {b.begin (), b.end ()};
+        w << var_int {N} << Data;
+        return b;
+    }
+    
+    maybe<block_filter> block_filter::read (const digest256 &block, bytes_view b) {
+        try {
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            var_int n;
+            r >> n;
+            
+            // every element takes at least P + 1 bits.
+            size_t rest = static_cast<size_t> (r.End - r.Begin);
+            if (n.Value > 8 * static_cast<uint64> (rest) / (basic_filter_P + 1)) return {};
+            return block_filter {block, n.Value, bytes (bytes_view {r.Begin, rest})};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+    }
+    
+    digest256 block_filter::hash () const {
+        return Hash256 (bytes (*this));
+    }
+    
+    digest256 block_filter::header (const digest256 &previous) const {
+        Hash256_writer w;
+        w << hash () << previous;
+        return w.finalize ();
+    }
+    
+    bool block_filter::match (bytes_view script) const {
+        return match_any (std::span<const bytes_view> {&script, 1});
+    }
+    
+    bool block_filter::match_any (std::span<const bytes_view> scripts) const {
+        if (N == 0 || scripts.size () == 0) return false;
+        
+        auto [k0, k1] = filter_key (Block);
+        std::vector<uint64> queries;
+        queries.reserve (scripts.size ());
+        for (const bytes_view &s : scripts) queries.push_back (reduce (siphash (k0, k1, s), N));
+        std::sort (queries.begin (), queries.end ());
+        
+        golomb_reader r {bit_reader {Data}, N};
+        auto q = queries.begin ();
+        uint64 x;
+        while (q != queries.end () && r.next (x)) {
+            while (q != queries.end () && *q < x) q++;
+            if (q != queries.end () && *q == x) return true;
+        }
+        
+        return false;
+    }
+    
+    void block_filter_builder::receive_header (const Bitcoin::header &h, uint64 transactions) {
+        Block = h.hash ();
+        std::tie (K0, K1) = filter_key (Block);
+        Hashes.clear ();
+    }
+    
+    void block_filter_builder::receive_transaction (const transaction_view &t) {
+        for (size_t i = 0; i < t.output_count (); i++) {
+            bytes_view script = t.output (i).script ();
+            if (include_output (script)) add (script);
+        }
+    }
+    
+    void block_filter_builder::spent (bytes_view script) {
+        if (script.size () != 0) add (script);
+    }
+    
+    void block_filter_builder::add (bytes_view script) {
+        Hashes.push_back (siphash (K0, K1, script));
+    }
+    
+    block_filter block_filter_builder::finish () {
+        return make_filter (Block, std::move (Hashes));
+    }
+    
+    block_filter basic_filter (const block_view &b, std::span<const bytes_view> spent) {
+        digest256 block = b.header ().hash ();
+        auto [k0, k1] = filter_key (block);
+        
+        std::vector<uint64> hashes;
+        hashes.reserve (spent.size ());
+        for (size_t i = 0; i < b.size (); i++) {
+            transaction_view t = b[i];
+            for (size_t j = 0; j < t.output_count (); j++) {
+                bytes_view script = t.output (j).script ();
+                if (include_output (script)) hashes.push_back (siphash (k0, k1, script));
+            }
+        }
+        
+        for (const bytes_view &s : spent) if (s.size () != 0) hashes.push_back (siphash (k0, k1, s));
+        
+        return make_filter (block, std::move (hashes));
+    }
+    
+    bool filter_headers::insert (const block_filter &f) {
+        headers::header h = Headers[f.Block];
+        if (!h.valid ()) return false;
+        if (!Blocks.empty () && h.Header.Previous != Blocks.back ()) return false;
+        
+        FilterHeaders.push_back (f.header (latest ()));
+        Blocks.push_back (f.Block);
+        return true;
+    }
+    
+    void filter_headers::truncate (uint64 n) {
+        if (n >= FilterHeaders.size ()) return;
+        FilterHeaders.resize (n);
+        Blocks.resize (n);
+    }
+    
+}
@@ -5,6 +5,8 @@
 #include <gigamonkey/hash.hpp>
 #include <data/encoding/base58.hpp>
 
+#include <algorithm>
+
 namespace Gigamonkey::Bitcoin {
 
     bytes append_checksum (bytes_view b) {
@@ -135,3 +137,174 @@ namespace Gigamonkey::base58 {
         
     }
 }
+
+namespace Gigamonkey::base58 {
+
+    namespace {
+
+        constexpr char characters[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+        struct digits {
+            signed char Value[128];
+
+            constexpr digits () : Value {} {
+                for (int i = 0; i < 128; i++) Value[i] = -1;
+                for (int i = 0; i < 58; i++) Value[int (characters[i])] = static_cast<signed char> (i);
+            }
+        };
+
+        constexpr digits digit {};
+
+        // 58^5 is the greatest power of 58 that fits in 32 bits.
+        constexpr uint64 power = 656356768;
+
+        // 58^0 through 58^5.
+        constexpr uint64 powers[] = {1, 58, 3364, 195112, 11316496, 656356768};
+
+    }
+
+    template <size_t size> size_t fixed_check<size>::encode (const byte *in, char *out) {
+        byte checked[size + 4];
+        std::copy (in, in + size, checked);
+        Gigamonkey::checksum x = Bitcoin::checksum (bytes_view {in, size});
+        std::copy (x.begin (), x.end (), checked + size);
+        return write (checked, out);
+    }
+
+    template <size_t size> size_t fixed_check<size>::write (const byte *in, char *out) {
+        constexpr size_t total = size + 4;
+        constexpr size_t limbs = (total + 3) / 4;
+        constexpr size_t offset = limbs * 4 - total;
+
+        byte number[limbs * 4] {};
+        std::copy (in, in + total, number + offset);
+
+        size_t zeros = 0;
+        while (zeros < total && number[offset + zeros] == 0) zeros++;
+
+        uint32 n[limbs];
+        for (size_t j = 0; j < limbs; j++) n[j] =
+            (uint32 (number[4 * j]) << 24) | (uint32 (number[4 * j + 1]) << 16) | (uint32 (number[4 * j + 2]) << 8) | uint32 (number[4 * j + 3]);
+
+        // digits come out least significant first.
+        char reversed[MaxEncodedSize];
+        size_t d = 0;
+        size_t start = 0;
+        while (start < limbs && n[start] == 0) start++;
+        while (start < limbs) {
+            uint64 remainder = 0;
+            for (size_t j = start; j < limbs; j++) {
+                uint64 current = (remainder << 32) | n[j];
+                n[j] = uint32 (current / power);
+                remainder = current % power;
+            }
+
+            while (start < limbs && n[start] == 0) start++;
+            for (int k = 0; k < 5; k++) {
+                reversed[d++] = char (remainder % 58);
+                remainder /= 58;
+            }
+        }
+
+        while (d > 0 && reversed[d - 1] == 0) d--;
+
+        std::fill (out, out + zeros, '1');
+        for (size_t i = 0; i < d; i++) out[zeros + i] = characters[int (reversed[d - 1 - i])];
+        return zeros + d;
+    }
+
+    template <size_t size> std::string fixed_check<size>::encode (const byte_array<size> &x) {
+        char out[MaxEncodedSize];
+        return std::string (out, encode (x.data (), out));
+    }
+
+    template <size_t size> bool fixed_check<size>::decode (string_view s, byte *out) {
+        byte checked[size + 4];
+        if (!read (s, checked)) return false;
+
+        Gigamonkey::checksum x = Bitcoin::checksum (bytes_view {checked, size});
+        if (!std::equal (x.begin (), x.end (), checked + size)) return false;
+
+        std::copy (checked, checked + size, out);
+        return true;
+    }
+
+    template <size_t size> bool fixed_check<size>::read (string_view s, byte *out) {
+        constexpr size_t total = size + 4;
+        constexpr size_t limbs = (total + 3) / 4;
+        constexpr size_t offset = limbs * 4 - total;
+
+        if (s.size () > MaxEncodedSize) return false;
+
+        size_t ones = 0;
+        while (ones < s.size () && s[ones] == '1') ones++;
+        if (ones > total) return false;
+
+        uint32 n[limbs] {};
+        for (size_t i = ones; i < s.size ();) {
+
+            // read up to five digits at once.
+            uint64 chunk = 0;
+            size_t k = 0;
+            for (; k < 5 && i < s.size (); k++, i++) {
+                unsigned char c = s[i];
+                if (c >= 128 || digit.Value[c] < 0) return false;
+                chunk = chunk * 58 + digit.Value[c];
+            }
+
+            uint64 carry = chunk;
+            for (size_t j = limbs; j-- > 0;) {
+                uint64 current = uint64 (n[j]) * powers[k] + carry;
+                n[j] = uint32 (current);
+                carry = current >> 32;
+            }
+
+            if (carry != 0) return false;
+        }
+
+        byte number[limbs * 4];
+        for (size_t j = 0; j < limbs; j++) {
+            number[4 * j] = byte (n[j] >> 24);
+            number[4 * j + 1] = byte (n[j] >> 16);
+            number[4 * j + 2] = byte (n[j] >> 8);
+            number[4 * j + 3] = byte (n[j]);
+        }
+
+        for (size_t i = 0; i < offset; i++) if (number[i] != 0) return false;
+
+        // every leading zero byte must be written as a '1', and nothing else.
+        const byte *b = number + offset;
+        size_t zeros = 0;
+        while (zeros < total && b[zeros] == 0) zeros++;
+        if (zeros != ones) return false;
+
+        std::copy (b, b + total, out);
+        return true;
+    }
+
+    template <size_t size> maybe<byte_array<size>> fixed_check<size>::decode (string_view s) {
+        byte_array<size> x;
+        if (!decode (s, x.data ())) return {};
+        return x;
+    }
+
+    template <size_t size> std::vector<std::string> fixed_check<size>::encode (const std::vector<byte_array<size>> &x) {
+        std::vector<std::string> encoded;
+        encoded.reserve (x.size ());
+        for (const byte_array<size> &b : x) encoded.push_back (encode (b));
+        return encoded;
+    }
+
+    template <size_t size> std::vector<maybe<byte_array<size>>> fixed_check<size>::decode (const std::vector<string_view> &x) {
+        std::vector<maybe<byte_array<size>>> decoded;
+        decoded.reserve (x.size ());
+        for (const string_view &s : x) decoded.push_back (decode (s));
+        return decoded;
+    }
+
+    template struct fixed_check<21>;
+    template struct fixed_check<33>;
+    template struct fixed_check<34>;
+    template struct fixed_check<78>;
+
+}
@@ -0,0 +1,365 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/p2p/compact_block.hpp>
+#include <gigamonkey/hash.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    namespace {
+        
+        struct sip {
+            uint64 V0, V1, V2, V3;
+            
+            sip (uint64 k0, uint64 k1) :
+                V0 {k0 ^ 0x736f6d6570736575ull}, V1 {k1 ^ 0x646f72616e646f6dull},
+                V2 {k0 ^ 0x6c7967656e657261ull}, V3 {k1 ^ 0x7465646279746573ull} {}
+            
+            void round () {
+                V0 += V1; V1 = std::rotl (V1, 13); V1 ^= V0; V0 = std::rotl (V0, 32);
+                V2 += V3; V3 = std::rotl (V3, 16); V3 ^= V2;
+                V0 += V3; V3 = std::rotl (V3, 21); V3 ^= V0;
+                V2 += V1; V1 = std::rotl (V1, 17); V1 ^= V2; V2 = std::rotl (V2, 32);
+            }
+            
+            void word (uint64 m) {
+                V3 ^= m;
+                round ();
+                round ();
+                V0 ^= m;
+            }
+            
+            uint64 finish () {
+                V2 ^= 0xff;
+                round ();
+                round ();
+                round ();
+                round ();
+                return V0 ^ V1 ^ V2 ^ V3;
+            }
+        };
+        
+        uint64 read_64 (const byte *b) {
+            uint64 x = 0;
+            for (int i = 7; i >= 0; i--) x = (x << 8) | b[i];
+            return x;
+        }
+        
+        // don't trust a count with more memory than the data could fill.
+        bool too_many (uint64 count, const bytes_reader &r, size_t min_size) {
+            return count > static_cast<uint64> (r.End - r.Begin) / min_size;
+        }
+        
+    }
+    
+    uint64 siphash (uint64 k0, uint64 k1, const digest256 &d) {
+        sip s {k0, k1};
+        for (int i = 0; i < 4; i++) s.word (read_64 (d.Value.data () + 8 * i));
+        // the length of the message in the top byte.
+        s.word (uint64 {32} << 56);
+        return s.finish ();
+    }
+    
+    uint64 siphash (uint64 k0, uint64 k1, bytes_view b) {
+        sip s {k0, k1};
+        size_t words = b.size () / 8;
+        for (size_t i = 0; i < words; i++) s.word (read_64 (b.data () + 8 * i));
+        
+        // what is left of the message and its length in the top byte.
+        uint64 last = uint64 (b.size ()) << 56;
+        for (size_t i = 8 * words; i < b.size (); i++) last |= uint64 (b[i]) << (8 * (i - 8 * words));
+        s.word (last);
+        return s.finish ();
+    }
+    
+    short_id_key::short_id_key (const Bitcoin::header &h, uint64 nonce) {
+        bytes b (88);
+        bytes_writer w {b.begin (), b.end ()};
+        w << h << uint64_little {nonce};
+        digest256 k = SHA2_256 (b);
+        K0 = read_64 (k.Value.data ());
+        K1 = read_64 (k.Value.data () + 8);
+    }
+    
+    short_id short_id_key::operator () (const txid &t) const {
+        return siphash (K0, K1, t) & short_id_mask;
+    }
+    
+    short_id compact_block::id (const txid &t) const {
+        return short_id_key {Header, Nonce} (t);
+    }
+    
+    compact_block compact_block::make (const block_view &b, uint64 nonce, std::span<const size_t> prefill) {
+        compact_block c {};
+        c.Header = b.header ();
+        c.Nonce = nonce;
+        
+        std::vector<size_t> whole {0};
+        for (size_t i : prefill) if (i < b.size ()) whole.push_back (i);
+        std::sort (whole.begin (), whole.end ());
+        whole.erase (std::unique (whole.begin (), whole.end ()), whole.end ());
+        
+        short_id_key key {c.Header, nonce};
+        auto next = whole.begin ();
+        c.ShortIDs.reserve (b.size () - whole.size ());
+        for (size_t i = 0; i < b.size (); i++) {
+            if (next != whole.end () && *next == i) {
+                c.Prefilled.push_back (prefilled_transaction {i, bytes (b[i].serialized ())});
+                next++;
+            } else c.ShortIDs.push_back (key (b[i].id ()));
+        }
+        
+        return c;
+    }
+    
+    compact_block::operator bytes () const {
+        size_t size = 80 + 8 + var_int::size (ShortIDs.size ()) + 6 * ShortIDs.size () + var_int::size (Prefilled.size ());
+        uint64 last = 0;
+        for (const prefilled_transaction &p : Prefilled) {
+            size += var_int::size (p.Index - last) + p.Transaction.size ();
+            last = p.Index + 1;
+        }
+        
+        bytes b (size);
+        bytes_writer w {b.begin (), b.end ()};
+        w << Header << uint64_little {Nonce} << var_int {ShortIDs.size ()};
+        for (short_id x : ShortIDs) for (int i = 0; i < 6; i++) w << byte (x >> (8 * i));
+        
+        // indices are written as the difference from the one before.
+        w << var_int {Prefilled.size ()};
+        last = 0;
+        for (const prefilled_transaction &p : Prefilled) {
+            w << var_int {p.Index - last} << p.Transaction;
+            last = p.Index + 1;
+        }
+        
+        return b;
+    }
+    
+    maybe<compact_block> compact_block::read (bytes_view b) {
+        compact_block c {};
+        try {
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            uint64_little nonce;
+            var_int count;
+            r >> c.Header >> nonce >> count;
+            c.Nonce = uint64 (nonce);
+            if (too_many (count.Value, r, 6)) return {};
+            
+            c.ShortIDs.resize (count.Value);
+            for (short_id &x : c.ShortIDs) {
+                byte id[6];
+                for (byte &z : id) r >> z;
+                x = 0;
+                for (int i = 5; i >= 0; i--) x = (x << 8) | id[i];
+            }
+            
+            r >> count;
+            if (too_many (count.Value, r, 61)) return {};
+            
+            uint64 next = 0;
+            for (uint64 i = 0; i < count.Value; i++) {
+                var_int difference;
+                r >> difference;
+                if (difference.Value > 0xffff) return {};
+                transaction_view t = transaction_view::read (r);
+                if (t.serialized_size () == 0) return {};
+                c.Prefilled.push_back (prefilled_transaction {next + difference.Value, bytes (t.serialized ())});
+                next += difference.Value + 1;
+            }
+            
+            if (r.Begin != r.End) return {};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+        
+        return c;
+    }
+    
+    block_transactions_request::operator bytes () const {
+        size_t size = 32 + var_int::size (Indices.size ());
+        uint64 last = 0;
+        for (uint64 i : Indices) {
+            size += var_int::size (i - last);
+            last = i + 1;
+        }
+        
+        bytes b (size);
+        bytes_writer w {b.begin (), b.end ()};
+        w << Block << var_int {Indices.size ()};
+        last = 0;
+        for (uint64 i : Indices) {
+            w << var_int {i - last};
+            last = i + 1;
+        }
+        
+        return b;
+    }
+    
+    maybe<block_transactions_request> block_transactions_request::read (bytes_view b) {
+        block_transactions_request x {};
+        try {
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            var_int count;
+            r >> x.Block >> count;
+            if (too_many (count.Value, r, 1)) return {};
+            
+            x.Indices.reserve (count.Value);
+            uint64 next = 0;
+            for (uint64 i = 0; i < count.Value; i++) {
+                var_int difference;
+                r >> difference;
+                if (difference.Value > 0xffff) return {};
+                x.Indices.push_back (next + difference.Value);
+                next += difference.Value + 1;
+            }
+            
+            if (r.Begin != r.End) return {};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+        
+        return x;
+    }
+    
+    block_transactions::operator bytes () const {
+        size_t size = 32 + var_int::size (Transactions.size ());
+        for (const bytes &t : Transactions) size += t.size ();
+        
+        bytes b (size);
+        bytes_writer w {b.begin (), b.end ()};
+        w << Block << var_int {Transactions.size ()};
+        for (const bytes &t : Transactions) w << t;
+        return b;
+    }
+    
+    maybe<block_transactions> block_transactions::read (bytes_view b) {
+        block_transactions x {};
+        try {
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            var_int count;
+            r >> x.Block >> count;
+            if (too_many (count.Value, r, 60)) return {};
+            
+            x.Transactions.reserve (count.Value);
+            for (uint64 i = 0; i < count.Value; i++) {
+                transaction_view t = transaction_view::read (r);
+                if (t.serialized_size () == 0) return {};
+                x.Transactions.push_back (bytes (t.serialized ()));
+            }
+            
+            if (r.Begin != r.End) return {};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+        
+        return x;
+    }
+    
+    block_transactions block_transactions::make (const block_view &b, const block_transactions_request &r) {
+        block_transactions x {r.Block, {}};
+        for (uint64 i : r.Indices) if (i < b.size ()) x.Transactions.push_back (bytes (b[i].serialized ()));
+        return x;
+    }
+    
+    partial_block::partial_block (const compact_block &c, std::span<const mempool_entry> mempool) :
+        Header {c.Header}, Valid {true}, Missing {0}, Transactions (c.size ()), Owned {}, Serialized {} {
+        
+        // where each short id goes, and whether a transaction has been found for it.
+        struct slot {
+            size_t Index;
+            bool Found;
+        };
+        
+        hash_map<short_id, slot> slots;
+        slots.reserve (c.ShortIDs.size ());
+        
+        std::vector<bool> prefilled (c.size (), false);
+        for (const prefilled_transaction &p : c.Prefilled) {
+            if (p.Index >= c.size ()) {
+                Valid = false;
+                return;
+            }
+            
+            prefilled[p.Index] = true;
+            Transactions[p.Index] = Owned.emplace_back (p.Transaction);
+        }
+        
+        size_t next = 0;
+        for (short_id x : c.ShortIDs) {
+            while (prefilled[next]) next++;
+            if (!slots.emplace (x, slot {next, false}).second) {
+                Valid = false;
+                return;
+            }
+            
+            next++;
+        }
+        
+        short_id_key key {c.Header, c.Nonce};
+        for (const mempool_entry &e : mempool) {
+            auto s = slots.find (key (e.ID));
+            if (s == slots.end ()) continue;
+            
+            // two transactions with the same short id are both left out.
+            if (s->second.Found) Transactions[s->second.Index] = bytes_view {};
+            else {
+                s->second.Found = true;
+                Transactions[s->second.Index] = e.Transaction;
+            }
+        }
+        
+        for (const bytes_view &t : Transactions) if (t.size () == 0) Missing++;
+    }
+    
+    std::vector<uint64> partial_block::missing () const {
+        std::vector<uint64> m;
+        m.reserve (Missing);
+        for (size_t i = 0; i < Transactions.size (); i++) if (Transactions[i].size () == 0) m.push_back (i);
+        return m;
+    }
+    
+    block_transactions_request partial_block::request () const {
+        return block_transactions_request {Header.hash (), missing ()};
+    }
+    
+    bool partial_block::fill (const block_transactions &b) {
+        if (!Valid || b.Block != Header.hash () || b.Transactions.size () != Missing) return false;
+        
+        auto next = b.Transactions.begin ();
+        for (bytes_view &t : Transactions) if (t.size () == 0) t = Owned.emplace_back (*next++);
+        
+        Missing = 0;
+        return true;
+    }
+    
+    void partial_block::serialize () {
+        size_t size = 80 + var_int::size (Transactions.size ());
+        for (const bytes_view &t : Transactions) size += t.size ();
+        
+        Serialized.resize (size);
+        bytes_writer w {Serialized.begin (), Serialized.end ()};
+        w << Header << var_int {Transactions.size ()};
+        for (const bytes_view &t : Transactions) w << t;
+    }
+    
+    block_view partial_block::check (executor *e) {
+        if (!complete ()) return block_view {};
+        serialize ();
+        block_view b {Serialized};
+        if (!b.valid () || (e == nullptr ? b.merkle_root () : b.merkle_root (*e)) != Header.MerkleRoot) return block_view {};
+        return b;
+    }
+    
+    block_view partial_block::assemble (executor &e) {
+        return check (&e);
+    }
+    
+    block_view partial_block::assemble () {
+        return check (nullptr);
+    }
+    
+}
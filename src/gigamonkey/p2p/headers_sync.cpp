@@ -0,0 +1,392 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/p2p/headers_sync.hpp>
+#include <gigamonkey/schema/random.hpp>
+
+#include <algorithm>
+#include <deque>
+
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    namespace asio = boost::asio;
+    using clock = std::chrono::steady_clock;
+    
+    namespace {
+        
+        // a view of the payload, which is copied to storage only if it is in two pieces.
+        bytes_view contiguous (const segments &x, bytes &storage) {
+            if (x.Second.size () == 0) return x.First;
+            storage = bytes (x);
+            return storage;
+        }
+        
+        // a network address in a version message, with no services and no address.
+        void write_address (writer &w) {
+            w << uint64_little {0} << bytes (18, 0);
+        }
+        
+    }
+    
+    version_message::operator bytes () const {
+        lazy_bytes_writer w;
+        w << int32_little {Version} << uint64_little {Services} << int64_little {Timestamp};
+        write_address (w);
+        write_address (w);
+        w << uint64_little {Nonce} << var_string {bytes (UserAgent.begin (), UserAgent.end ())}
+            << int32_little {StartHeight} << byte (Relay ? 1 : 0);
+        return w;
+    }
+    
+    maybe<version_message> version_message::read (const segments &payload) {
+        bytes storage;
+        bytes_view b = contiguous (payload, storage);
+        try {
+            bytes_reader r {b.begin (), b.end ()};
+            int32_little version;
+            uint64_little services;
+            int64_little timestamp;
+            uint64_little nonce;
+            bytes user_agent;
+            int32_little start_height;
+            r >> version >> services >> timestamp;
+            r.skip (52);
+            r >> nonce >> var_string {user_agent} >> start_height;
+            
+            // relay was added later and may not be there.
+            byte relay = 1;
+            if (r.Begin != r.End) r >> relay;
+            
+            return version_message {int32 (version), uint64 (services), int64 (timestamp), uint64 (nonce),
+                std::string (user_agent.begin (), user_agent.end ()), int32 (start_height), relay != 0};
+        } catch (data::end_of_stream) {
+            return {};
+        }
+    }
+    
+    bytes getheaders_payload (std::span<const digest256> locator, const digest256 &stop) {
+        bytes b (4 + var_int::size (locator.size ()) + 32 * (locator.size () + 1));
+        bytes_writer w {b.begin (), b.end ()};
+        w << uint32_little {uint32 (protocol_version)} << var_int {locator.size ()};
+        for (const digest256 &d : locator) w << d;
+        w << stop;
+        return b;
+    }
+    
+    bytes headers_payload (std::span<const Bitcoin::header> h) {
+        // each header is followed by a transaction count, which is zero.
+        bytes b (var_int::size (h.size ()) + 81 * h.size ());
+        bytes_writer w {b.begin (), b.end ()};
+        w << var_int {h.size ()};
+        for (const Bitcoin::header &x : h) w << x << byte {0};
+        return b;
+    }
+    
+    maybe<std::vector<Bitcoin::header>> read_headers (const segments &payload) {
+        bytes storage;
+        bytes_view b = contiguous (payload, storage);
+        try {
+            bytes_reader r {b.begin (), b.end ()};
+            var_int count;
+            r >> count;
+            if (count.Value > max_headers) return {};
+            
+            std::vector<Bitcoin::header> h (count.Value);
+            for (Bitcoin::header &x : h) {
+                var_int transactions;
+                r >> x >> transactions;
+            }
+            
+            if (r.Begin != r.End) return {};
+            return h;
+        } catch (data::end_of_stream) {
+            return {};
+        }
+    }
+    
+    std::vector<digest256> locator (const headers &h) {
+        std::vector<digest256> l;
+        uint64 height = uint64 (h.latest ().Height);
+        uint64 step = 1;
+        while (true) {
+            headers::header x = h[N (height)];
+            if (x.Hash != digest256 {}) l.push_back (x.Hash);
+            if (height == 0) break;
+            if (l.size () >= 10) step *= 2;
+            height = height > step ? height - step : 0;
+        }
+        
+        return l;
+    }
+    
+    headers_sync::result headers_sync::receive (std::span<const Bitcoin::header> h) {
+        result r {h.size (), 0, false};
+        if (h.size () == 0) return r;
+        
+        headers::header previous = Store[h[0].Previous];
+        if (previous.Hash != h[0].Previous) {
+            r.Invalid = true;
+            return r;
+        }
+        
+        size_t valid = Executor == nullptr ? validate_chain (h) : validate_chain (h, *Executor);
+        if (valid < h.size ()) r.Invalid = true;
+        
+        // headers before the first invalid one are still good.
+        for (size_t i = 0; i < valid; i++) {
+            headers::header next = previous.next (h[i]);
+            if (Store.insert (next)) r.Inserted++;
+            previous = next;
+        }
+        
+        return r;
+    }
+    
+    struct headers_client::peer : std::enable_shared_from_this<peer> {
+        headers_client &Client;
+        const asio::ip::tcp::endpoint Endpoint;
+        asio::ip::tcp::socket Socket;
+        asio::steady_timer Retry;
+        
+        // the data that has been read is between Begin and End.
+        bytes Buffer;
+        size_t Begin {0};
+        size_t End {0};
+        
+        std::deque<bytes> Outgoing {};
+        
+        bool Connected {false};
+        bool Version {false};
+        bool Ready {false};
+        
+        // an average of how long the peer takes to answer, in milliseconds.
+        double Latency;
+        
+        peer (headers_client &c, const asio::ip::tcp::endpoint &e) :
+            Client {c}, Endpoint {e}, Socket {c.IO}, Retry {c.IO}, Buffer (1 << 16),
+            Latency (double (c.Options.StallTimeout.count ())) {}
+        
+        void connect () {
+            Socket.async_connect (Endpoint, [self = shared_from_this ()] (const boost::system::error_code &err) {
+                if (err) return self->close ();
+                self->Connected = true;
+                self->send (command {"version"}, bytes (version_message {protocol_version, 0,
+                    std::chrono::duration_cast<std::chrono::seconds> (std::chrono::system_clock::now ().time_since_epoch ()).count (),
+                    nonce (), self->Client.Options.UserAgent, int32 (uint64 (self->Client.Store.latest ().Height)), false}));
+                self->read ();
+            });
+        }
+        
+        static uint64 nonce () {
+            uint64 x;
+            bitcoind_random {}.get ((byte *) &x, sizeof (x));
+            return x;
+        }
+        
+        void read () {
+            if (End == Buffer.size ()) Buffer.resize (Buffer.size () * 2);
+            Socket.async_read_some (asio::buffer (Buffer.data () + End, Buffer.size () - End),
+                [self = shared_from_this ()] (const boost::system::error_code &err, size_t n) {
+                    if (err) return self->close ();
+                    self->End += n;
+                    if (self->process ()) self->read ();
+                });
+        }
+        
+        // false if the connection was closed.
+        bool process () {
+            static constexpr auto table = make_commands ("version", "verack", "ping", "headers");
+            
+            decoder d {Client.Options.Magic, 1 << 24};
+            while (true) {
+                message_view m;
+                decoder::status x = d.read (segments {bytes_view {Buffer.data () + Begin, End - Begin}}, m);
+                if (x == decoder::incomplete) break;
+                if (x != decoder::message) {
+                    close ();
+                    return false;
+                }
+                
+                table.dispatch (m,
+                    [this] (const message_view &) {
+                        Version = true;
+                        send (command {"verack"}, bytes {});
+                    },
+                    [this] (const message_view &) {
+                        if (!Ready) {
+                            Ready = true;
+                            Client.handshake (*this);
+                        }
+                    },
+                    [this] (const message_view &m) {
+                        send (command {"pong"}, bytes (m.Payload));
+                    },
+                    [this] (const message_view &m) {
+                        maybe<std::vector<Bitcoin::header>> h = read_headers (m.Payload);
+                        if (!h) return close ();
+                        Client.receive (*this, *h);
+                    });
+                
+                if (!Socket.is_open ()) return false;
+                Begin += m.serialized_size ();
+            }
+            
+            // move what is left to the front so that there is room to read the rest.
+            std::copy (Buffer.begin () + Begin, Buffer.begin () + End, Buffer.begin ());
+            End -= Begin;
+            Begin = 0;
+            return true;
+        }
+        
+        void send (const command &c, bytes_view payload) {
+            Outgoing.push_back (p2p::write (Client.Options.Magic, c, payload));
+            if (Outgoing.size () == 1) write ();
+        }
+        
+        void write () {
+            asio::async_write (Socket, asio::buffer (Outgoing.front ()),
+                [self = shared_from_this ()] (const boost::system::error_code &err, size_t) {
+                    if (err) return self->close ();
+                    self->Outgoing.pop_front ();
+                    if (!self->Outgoing.empty ()) self->write ();
+                });
+        }
+        
+        // handlers of the old connection that fail after
+        // it has been closed should not close it again.
+        bool Closed {false};
+        
+        void close () {
+            if (Closed) return;
+            Closed = true;
+            boost::system::error_code err;
+            Socket.close (err);
+            bool was_ready = Ready;
+            Connected = Version = Ready = false;
+            Begin = End = 0;
+            Outgoing.clear ();
+            if (was_ready) Client.closed (*this);
+            reconnect ();
+        }
+        
+        void reconnect () {
+            Retry.expires_after (Client.Options.Reconnect);
+            Retry.async_wait ([self = shared_from_this ()] (const boost::system::error_code &err) {
+                if (err) return;
+                self->Closed = false;
+                self->Socket = asio::ip::tcp::socket {self->Client.IO};
+                self->connect ();
+            });
+        }
+    };
+    
+    headers_client::headers_client (headers &h, std::vector<asio::ip::tcp::endpoint> peers, options o) :
+        Store {h}, Options {o}, Mutex {}, Sync {h, o.Executor}, IO {}, Timer {IO}, Peers {} {
+        if (peers.empty ()) throw std::invalid_argument {"headers_client needs a peer"};
+        for (const asio::ip::tcp::endpoint &e : peers) Peers.push_back (std::make_shared<peer> (*this, e));
+        for (const ptr<peer> &p : Peers) p->connect ();
+        tick ();
+        Thread = std::thread {[this] () {
+            IO.run ();
+        }};
+    }
+    
+    headers_client::~headers_client () {
+        IO.stop ();
+        Thread.join ();
+    }
+    
+    size_t headers_client::ready () const {
+        return Ready.load ();
+    }
+    
+    headers_client::peer *headers_client::fastest (const peer *p) const {
+        peer *best = nullptr;
+        for (const ptr<peer> &x : Peers)
+            if (x->Ready && x.get () != p && (best == nullptr || x->Latency < best->Latency)) best = x.get ();
+        return best;
+    }
+    
+    void headers_client::request (peer *p, std::vector<digest256> locator) {
+        Active = p;
+        if (p == nullptr) return;
+        Requested = clock::now ();
+        p->send (command {"getheaders"}, getheaders_payload (locator));
+    }
+    
+    void headers_client::request () {
+        std::vector<digest256> l;
+        {
+            auto held = lock ();
+            l = locator (Store);
+        }
+        
+        request (Active != nullptr ? Active : fastest (nullptr), l);
+    }
+    
+    void headers_client::handshake (peer &) {
+        Ready++;
+        if (Active == nullptr) request ();
+    }
+    
+    void headers_client::closed (peer &p) {
+        Ready--;
+        if (Active != &p) return;
+        Active = nullptr;
+        request ();
+    }
+    
+    void headers_client::receive (peer &p, const std::vector<Bitcoin::header> &h) {
+        if (&p == Active) {
+            double ms = double (std::chrono::duration_cast<std::chrono::milliseconds> (clock::now () - Requested).count ());
+            p.Latency = (p.Latency * 3 + ms) / 4;
+            
+            // ask for the next batch before checking this one so that the
+            // peer can be sending it while we check.
+            if (h.size () == max_headers) request (&p, std::vector<digest256> {h.back ().hash ()});
+            else Active = nullptr;
+        }
+        
+        headers_sync::result r;
+        {
+            auto held = lock ();
+            r = Sync.receive (h);
+        }
+        
+        if (h.size () < max_headers && !r.Invalid) Synced = true;
+        if (Options.OnHeaders) Options.OnHeaders (r);
+        
+        if (r.Invalid) {
+            p.close ();
+            // the request that we already sent was based on bad headers.
+            if (Active == &p || Active == nullptr) {
+                Active = nullptr;
+                request ();
+            }
+        }
+    }
+    
+    void headers_client::tick () {
+        Timer.expires_after (std::min (Options.StallTimeout, Options.Poll) / 4);
+        Timer.async_wait ([this] (const boost::system::error_code &err) {
+            if (err) return;
+            auto waited = clock::now () - Requested;
+            if (Active != nullptr && waited > Options.StallTimeout) {
+                // count the stall against the peer and go to a faster one.
+                Active->Latency = std::max (Active->Latency * 2, double (Options.StallTimeout.count ()));
+                peer *next = fastest (Active);
+                Active = nullptr;
+                if (next != nullptr) {
+                    std::vector<digest256> l;
+                    {
+                        auto held = lock ();
+                        l = locator (Store);
+                    }
+                    request (next, l);
+                }
+            } else if (Active == nullptr && waited > Options.Poll) request ();
+            tick ();
+        });
+    }
+    
+}
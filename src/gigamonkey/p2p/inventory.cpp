@@ -0,0 +1,202 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/p2p/inventory.hpp>
+#include <gigamonkey/p2p/compact_block.hpp>
+#include <sv/random.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    bytes inventory_payload (std::span<const inventory> x) {
+        bytes b (var_int::size (x.size ()) + inventory::serialized_size * x.size ());
+        bytes_writer w {b.begin (), b.end ()};
+        w << var_int {x.size ()};
+        for (const inventory &i : x) w << uint32_little {i.Type} << i.Hash;
+        return b;
+    }
+    
+    maybe<std::vector<inventory>> read_inventory (const segments &payload) {
+        bytes b (payload);
+        try {
+            bytes_reader r {b.data (), b.data () + b.size ()};
+            var_int count;
+            r >> count;
+            if (count.Value > max_inventory) return {};
+            
+            std::vector<inventory> x (count.Value);
+            for (inventory &i : x) {
+                uint32_little type;
+                r >> type >> i.Hash;
+                i.Type = inventory::type (uint32 (type));
+            }
+            
+            if (r.Begin != r.End) return {};
+            return x;
+        } catch (data::end_of_stream) {
+            return {};
+        }
+    }
+    
+    rolling_bloom_filter::rolling_bloom_filter (uint32 elements, double false_positive_rate) {
+        if (elements == 0 || !(false_positive_rate > 0 && false_positive_rate < 1))
+            throw std::invalid_argument {"rolling_bloom_filter"};
+        
+        double log_rate = std::log (false_positive_rate);
+        HashFunctions = std::max (1, std::min (int (std::round (log_rate / std::log (0.5))), 50));
+        EntriesPerGeneration = (elements + 1) / 2;
+        
+        // three generations of entries are in the filter when it is full.
+        uint32 max_elements = EntriesPerGeneration * 3;
+        uint64 bits = std::ceil (-1.0 * HashFunctions * max_elements / std::log (1.0 - std::exp (log_rate / HashFunctions)));
+        
+        // each word of bits is stored as a pair of words for the two bits of the generation.
+        Data.resize (((bits + 63) / 64) << 1);
+        reset ();
+    }
+    
+    void rolling_bloom_filter::reset () {
+        K0 = GetThreadRand64 ();
+        K1 = GetThreadRand64 ();
+        EntriesThisGeneration = 0;
+        Generation = 1;
+        std::fill (Data.begin (), Data.end (), 0);
+    }
+    
+    uint64 rolling_bloom_filter::hash (uint32 n, const digest256 &d) const {
+        return siphash (K0, K1 ^ n, d);
+    }
+    
+    void rolling_bloom_filter::insert (const digest256 &d) {
+        if (EntriesThisGeneration == EntriesPerGeneration) {
+            EntriesThisGeneration = 0;
+            Generation++;
+            if (Generation == 4) Generation = 1;
+            
+            // clear every entry that has the generation that we are about to reuse.
+            uint64 mask_0 = -uint64 (Generation & 1);
+            uint64 mask_1 = -uint64 (Generation >> 1);
+            for (size_t p = 0; p < Data.size (); p += 2) {
+                uint64 x = Data[p];
+                uint64 y = Data[p + 1];
+                uint64 mask = (x ^ mask_0) | (y ^ mask_1);
+                Data[p] = x & mask;
+                Data[p + 1] = y & mask;
+            }
+        }
+        
+        EntriesThisGeneration++;
+        
+        for (uint32 n = 0; n < HashFunctions; n++) {
+            uint64 h = hash (n, d);
+            int bit = h & 63;
+            size_t pos = ((h >> 32) * Data.size ()) >> 32;
+            Data[pos & ~1] = (Data[pos & ~1] & ~(uint64 {1} << bit)) | (uint64 (Generation & 1) << bit);
+            Data[pos | 1] = (Data[pos | 1] & ~(uint64 {1} << bit)) | (uint64 (Generation >> 1) << bit);
+        }
+    }
+    
+    bool rolling_bloom_filter::contains (const digest256 &d) const {
+        for (uint32 n = 0; n < HashFunctions; n++) {
+            uint64 h = hash (n, d);
+            int bit = h & 63;
+            size_t pos = ((h >> 32) * Data.size ()) >> 32;
+            if (!(((Data[pos & ~1] | Data[pos | 1]) >> bit) & 1)) return false;
+        }
+        
+        return true;
+    }
+    
+    relay::clock::time_point relay::schedule (clock::time_point now) const {
+        // uniform in (0, 1].
+        double u = double ((GetThreadRand64 () >> 11) + 1) * 0x1.0p-53;
+        return now + std::chrono::duration_cast<clock::duration> (-std::log (u) * std::chrono::duration<double, std::milli> {Options.Interval});
+    }
+    
+    void relay::add_peer (peer_id id, clock::time_point now) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        Peers.insert_or_assign (id, peer {rolling_bloom_filter {Options.KnownInventory, 0.000001}, {}, schedule (now)});
+    }
+    
+    void relay::remove_peer (peer_id id) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        Peers.erase (id);
+    }
+    
+    bool relay::broadcast (const shared_transaction &t, clock::time_point now) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        if (!Cache.emplace (t.id (), entry {t, now + Options.Expire}).second) return false;
+        for (auto &[id, p] : Peers) if (!p.Known.contains (t.id ())) p.Queue.push_back (t.id ());
+        return true;
+    }
+    
+    void relay::known (peer_id id, std::span<const inventory> x) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        auto p = Peers.find (id);
+        if (p == Peers.end ()) return;
+        for (const inventory &i : x) if (i.Type == inventory::transaction) p->second.Known.insert (i.Hash);
+    }
+    
+    relay::clock::time_point relay::next (peer_id id) const {
+        std::lock_guard<std::mutex> lock {Mutex};
+        auto p = Peers.find (id);
+        if (p == Peers.end ()) return clock::time_point::max ();
+        return p->second.Next;
+    }
+    
+    std::vector<inventory> relay::flush (peer_id id, clock::time_point now) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        auto it = Peers.find (id);
+        if (it == Peers.end () || now < it->second.Next) return {};
+        
+        peer &p = it->second;
+        p.Next = schedule (now);
+        
+        std::vector<inventory> inv;
+        inv.reserve (std::min (p.Queue.size (), Options.MaxBatch));
+        auto q = p.Queue.begin ();
+        for (; q != p.Queue.end () && inv.size () < Options.MaxBatch; q++) {
+            // the peer may have told us about it since it was queued.
+            if (p.Known.contains (*q)) continue;
+            p.Known.insert (*q);
+            inv.push_back (inventory {inventory::transaction, *q});
+        }
+        
+        p.Queue.erase (p.Queue.begin (), q);
+        return inv;
+    }
+    
+    relay::response relay::get_data (std::span<const inventory> x) const {
+        std::lock_guard<std::mutex> lock {Mutex};
+        response r {};
+        for (const inventory &i : x) {
+            if (i.Type == inventory::transaction) {
+                auto e = Cache.find (i.Hash);
+                if (e != Cache.end ()) {
+                    r.Transactions.push_back (e->second.Transaction);
+                    continue;
+                }
+            }
+            
+            r.NotFound.push_back (i);
+        }
+        
+        return r;
+    }
+    
+    void relay::expire (clock::time_point now) {
+        std::lock_guard<std::mutex> lock {Mutex};
+        std::erase_if (Cache, [now] (const auto &e) -> bool {
+            return e.second.Expires <= now;
+        });
+    }
+    
+    size_t relay::cached () const {
+        std::lock_guard<std::mutex> lock {Mutex};
+        return Cache.size ();
+    }
+    
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/p2p/message.hpp>
+#include <gigamonkey/hash.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace Gigamonkey::Bitcoin::p2p {
+    
+    segments segments::substr (size_t i, size_t n) const {
+        if (i + n > size ()) throw std::out_of_range {"segments::substr"};
+        if (i >= First.size ()) return segments {Second.substr (i - First.size (), n)};
+        size_t first = std::min (n, First.size () - i);
+        return segments {First.substr (i, first), Second.substr (0, n - first)};
+    }
+    
+    void segments::copy (byte *out) const {
+        std::copy (First.begin (), First.end (), out);
+        std::copy (Second.begin (), Second.end (), out + First.size ());
+    }
+    
+    segments::operator bytes () const {
+        bytes b (size ());
+        copy (b.data ());
+        return b;
+    }
+    
+    Gigamonkey::checksum checksum (const segments &x) {
+        Hash256_writer w;
+        w << x.First << x.Second;
+        digest256 digest = w.finalize ();
+        Gigamonkey::checksum c;
+        std::copy (digest.Value.begin (), digest.Value.begin () + 4, c.begin ());
+        return c;
+    }
+    
+    header header::make (uint32 magic, const command &c, const segments &payload) {
+        if (payload.size () >= extended_length) return header {uint32_little {magic}, c, payload.size (), Gigamonkey::checksum {0}};
+        return header {uint32_little {magic}, c, payload.size (), p2p::checksum (payload)};
+    }
+    
+    void header::write (byte *out) const {
+        bytes_writer w {out, out + serialized_size ()};
+        w << Magic;
+        if (extended ()) {
+            w << bytes_view {(const byte *) extended_command.data (), 12}
+                << uint32_little {extended_length} << Gigamonkey::checksum {0}
+                << bytes_view {(const byte *) Command.data (), 12} << uint64_little {Length};
+            return;
+        }
+        
+        w << bytes_view {(const byte *) Command.data (), 12} << uint32_little {uint32 (Length)} << Checksum;
+    }
+    
+    bytes write (uint32 magic, const command &c, bytes_view payload) {
+        header h = header::make (magic, c, segments {payload});
+        bytes b (h.serialized_size () + payload.size ());
+        h.write (b.data ());
+        std::copy (payload.begin (), payload.end (), b.begin () + h.serialized_size ());
+        return b;
+    }
+    
+    bool message_view::checksum_valid () const {
+        return Header.extended () || p2p::checksum (Payload) == Header.Checksum;
+    }
+    
+    namespace {
+        
+        // padded with nulls, with nothing after the first null.
+        bool valid (const command &c) {
+            size_t n = c.view ().size ();
+            for (size_t i = n; i < 12; i++) if (c[i] != 0) return false;
+            return true;
+        }
+        
+    }
+    
+    decoder::status decoder::read (const segments &data, message_view &m) const {
+        if (data.size () < header::size) return incomplete;
+        
+        // the header is the only part that is copied, in case it straddles the two segments.
+        byte h[header::extended_size];
+        data.substr (0, header::size).copy (h);
+        
+        bytes_reader r {h, h + header::size};
+        uint32_little length;
+        r >> m.Header.Magic;
+        m.Header.Command = command {std::string_view {(const char *) h + 4, 12}};
+        r.skip (12);
+        r >> length >> m.Header.Checksum;
+        m.Header.Length = uint32 (length);
+        
+        if (m.Header.Magic != Magic) return wrong_magic;
+        if (!valid (m.Header.Command)) return invalid_command;
+        
+        if (m.Header.Command == header::extended_command && length == header::extended_length) {
+            if (data.size () < header::extended_size) return incomplete;
+            data.substr (header::size, header::extended_size - header::size).copy (h + header::size);
+            
+            bytes_reader x {h + header::size, h + header::extended_size};
+            uint64_little extended_length;
+            m.Header.Command = command {std::string_view {(const char *) h + header::size, 12}};
+            x.skip (12);
+            x >> extended_length;
+            m.Header.Length = uint64 (extended_length);
+            
+            if (!valid (m.Header.Command)) return invalid_command;
+            
+            // a message that could have been sent in the ordinary format is not accepted.
+            if (m.Header.Length < header::extended_length) return invalid_command;
+        }
+        
+        if (m.Header.Length > MaxPayload) return too_big;
+        
+        size_t header_size = m.Header.serialized_size ();
+        if (data.size () - header_size < m.Header.Length) return incomplete;
+        
+        m.Payload = data.substr (header_size, m.Header.Length);
+        if (CheckChecksum && !m.checksum_valid ()) return invalid_checksum;
+        return message;
+    }
+    
+    const char *name (decoder::status x) {
+        switch (x) {
+            case decoder::incomplete: return "incomplete";
+            case decoder::message: return "message";
+            case decoder::wrong_magic: return "wrong_magic";
+            case decoder::invalid_command: return "invalid_command";
+            case decoder::too_big: return "too_big";
+            case decoder::invalid_checksum: return "invalid_checksum";
+            default: return "";
+        }
+    }
+    
+    std::vector<bool> checksums_valid (std::span<const message_view> m) {
+        // the multi-buffer kernel only takes messages of less than 56 bytes.
+        constexpr size_t max_short = 55;
+        
+        std::vector<bool> valid (m.size (), true);
+        std::map<size_t, std::vector<size_t>> short_messages;
+        
+        for (size_t i = 0; i < m.size (); i++) {
+            if (m[i].Header.extended ()) continue;
+            if (m[i].Payload.size () <= max_short) short_messages[m[i].Payload.size ()].push_back (i);
+            else valid[i] = m[i].checksum_valid ();
+        }
+        
+        bytes in;
+        bytes out;
+        for (const auto &[size, group] : short_messages) {
+            in.resize (size * group.size ());
+            out.resize (32 * group.size ());
+            for (size_t j = 0; j < group.size (); j++) m[group[j]].Payload.copy (in.data () + j * size);
+            
+            sha256::double_hash_short (out.data (), in.data (), size, group.size ());
+            
+            for (size_t j = 0; j < group.size (); j++)
+                valid[group[j]] = std::equal (out.begin () + 32 * j, out.begin () + 32 * j + 4, m[group[j]].Header.Checksum.begin ());
+        }
+        
+        return valid;
+    }
+    
+}
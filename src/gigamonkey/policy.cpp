@@ -0,0 +1,84 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/policy.hpp>
+#include <gigamonkey/script/matcher.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/script/pattern/op_return.hpp>
+
+namespace Gigamonkey::policy {
+    using namespace Bitcoin;
+    
+    namespace {
+        
+        enum output_template {
+            p2pkh,
+            p2pk,
+            null_data
+        };
+        
+        // compiled once and shared by every thread, since matching does not change them.
+        const classifier &templates () {
+            static const classifier Templates {[] () {
+                bytes x;
+                return std::vector<matcher> {
+                    matcher {pay_to_address::pattern (x)},
+                    matcher {pay_to_pubkey::pattern (x)},
+                    matcher {op_return::pattern ()}};
+            } ()};
+            
+            return Templates;
+        }
+        
+        bool push_only (bytes_view script) {
+            for (const instruction_view &i : instructions {script}) if (!is_push (i.Op)) return false;
+            return true;
+        }
+        
+    }
+    
+    std::ostream &operator << (std::ostream &o, reason r) {
+        switch (r) {
+            case standard: return o << "standard";
+            case invalid: return o << "invalid";
+            case version: return o << "version";
+            case too_big: return o << "too big";
+            case script_sig_size: return o << "script sig size";
+            case script_sig_not_push_only: return o << "script sig not push only";
+            case script_pubkey: return o << "script pubkey";
+            case dust: return o << "dust";
+            default: return o << "unknown";
+        }
+    }
+    
+    bool is_dust (const output_view &out, const limits &l) {
+        return out.value () < calculate_fee (l.DustRelayFee, 3 * (out.Data.size () + 148));
+    }
+    
+    reason check_standard (const transaction_view &tx, const limits &l) {
+        if (!tx.valid ()) return invalid;
+        
+        int32 v = int32 (tx.version ());
+        if (v < l.MinVersion || v > l.MaxVersion) return version;
+        
+        if (tx.serialized_size () > l.MaxSize) return too_big;
+        
+        for (size_t i = 0; i < tx.input_count (); i++) {
+            bytes_view script = tx.input (i).script ();
+            if (script.size () > l.MaxScriptSigSize) return script_sig_size;
+            if (l.PushOnly && !push_only (script)) return script_sig_not_push_only;
+        }
+        
+        const classifier &c = templates ();
+        for (size_t i = 0; i < tx.output_count (); i++) {
+            output_view out = tx.output (i);
+            int t = c.classify (out.script ());
+            if (t < 0) return script_pubkey;
+            if (t != null_data && is_dust (out, l)) return dust;
+        }
+        
+        return standard;
+    }
+    
+}
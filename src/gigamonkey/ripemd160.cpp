@@ -0,0 +1,134 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/ripemd160.hpp>
+
+namespace Gigamonkey::ripemd160 {
+    
+    namespace {
+        
+        // Each lane of a vector holds a word of a different message, as in sha256/lanes.hpp.
+        using one = uint32 __attribute__ ((vector_size (4)));
+        using four = uint32 __attribute__ ((vector_size (16)));
+        
+        template <typename V> constexpr size_t width = sizeof (V) / sizeof (uint32);
+        
+        template <typename V> inline V splat (uint32 x) {
+            return V {} + x;
+        }
+        
+        template <typename V> inline V rotate (V x, int n) {
+            return (x << n) | (x >> (32 - n));
+        }
+        
+        inline uint32 read_little (const byte *b) {
+            return uint32 (b[0]) | (uint32 (b[1]) << 8) | (uint32 (b[2]) << 16) | (uint32 (b[3]) << 24);
+        }
+        
+        inline void write_little (byte *b, uint32 x) {
+            b[0] = byte (x);
+            b[1] = byte (x >> 8);
+            b[2] = byte (x >> 16);
+            b[3] = byte (x >> 24);
+        }
+        
+        constexpr uint32 initial[5] {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+        
+        // which word of the message each round reads, on the left and on the right.
+        constexpr int R[80] {
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+            3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+            1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+            4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13};
+        
+        constexpr int RR[80] {
+            5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+            6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+            15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+            8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+            12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11};
+        
+        // how far each round rotates, on the left and on the right.
+        constexpr int S[80] {
+            11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+            7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+            11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+            11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+            9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6};
+        
+        constexpr int SR[80] {
+            8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+            9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+            9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+            15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+            8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11};
+        
+        constexpr uint32 K[5] {0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e};
+        constexpr uint32 KR[5] {0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000};
+        
+        // the boolean function of round group j.
+        template <typename V> inline V f (int j, V x, V y, V z) {
+            switch (j) {
+                case 0: return x ^ y ^ z;
+                case 1: return (x & y) | (~x & z);
+                case 2: return (x | ~y) ^ z;
+                case 3: return (x & z) | (y & ~z);
+                default: return x ^ (y | ~z);
+            }
+        }
+        
+        template <typename V> void transform (V h[5], const V x[16]) {
+            V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            V ar = a, br = b, cr = c, dr = d, er = e;
+            
+            for (int i = 0; i < 80; i++) {
+                int j = i / 16;
+                
+                V t = rotate (a + f (j, b, c, d) + x[R[i]] + splat<V> (K[j]), S[i]) + e;
+                a = e;
+                e = d;
+                d = rotate (c, 10);
+                c = b;
+                b = t;
+                
+                t = rotate (ar + f (4 - j, br, cr, dr) + x[RR[i]] + splat<V> (KR[j]), SR[i]) + er;
+                ar = er;
+                er = dr;
+                dr = rotate (cr, 10);
+                cr = br;
+                br = t;
+            }
+            
+            V t = h[1] + c + dr;
+            h[1] = h[2] + d + er;
+            h[2] = h[3] + e + ar;
+            h[3] = h[4] + a + br;
+            h[4] = h[0] + b + cr;
+            h[0] = t;
+        }
+        
+        template <typename V> void parallel_hash_32 (byte *out, const byte *in) {
+            V x[16];
+            for (int i = 0; i < 8; i++) for (size_t l = 0; l < width<V>; l++) x[i][l] = read_little (in + 32 * l + 4 * i);
+            
+            // the padding, which is the same for every message.
+            x[8] = splat<V> (0x80);
+            for (int i = 9; i < 16; i++) x[i] = V {};
+            x[14] = splat<V> (32 * 8);
+            
+            V h[5];
+            for (int i = 0; i < 5; i++) h[i] = splat<V> (initial[i]);
+            transform (h, x);
+            
+            for (size_t l = 0; l < width<V>; l++) for (int i = 0; i < 5; i++) write_little (out + 20 * l + 4 * i, h[i][l]);
+        }
+        
+    }
+    
+    void hash_32 (byte *out, const byte *in, size_t count) {
+        for (; count >= 4; count -= 4, in += 32 * 4, out += 20 * 4) parallel_hash_32<four> (out, in);
+        for (; count > 0; count--, in += 32, out += 20) parallel_hash_32<one> (out, in);
+    }
+    
+}
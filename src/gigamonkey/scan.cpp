@@ -0,0 +1,123 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/scan.hpp>
+#include <gigamonkey/hash.hpp>
+#include <gigamonkey/script/matcher.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/script/pattern/pay_to_script_hash.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace Gigamonkey {
+    using namespace Bitcoin;
+    
+    namespace {
+        
+        uint64 read_64 (const byte *b) {
+            uint64 x;
+            std::memcpy (&x, b, 8);
+            return x;
+        }
+        
+        // the output templates in the order of output_match::kind.
+        const classifier &templates () {
+            static const classifier Templates {[] () {
+                bytes x;
+                return std::vector<matcher> {
+                    matcher {pay_to_address::pattern (x)},
+                    matcher {pay_to_pubkey::pattern (x)},
+                    matcher {pay_to_script_hash::pattern (x)}};
+            } ()};
+            
+            return Templates;
+        }
+        
+        void scan_outputs (const transaction_view &tx, const watch_list &w, uint32 index,
+            std::vector<bytes_view> &captures, std::vector<output_match> &matches) {
+            const classifier &c = templates ();
+            for (size_t i = 0; i < tx.output_count (); i++) {
+                int t = c.classify (tx.output (i).script (), captures);
+                if (t < 0) continue;
+                
+                digest160 h;
+                if (t == output_match::pubkey) h = Hash160 (captures[0]);
+                else std::copy (captures[0].begin (), captures[0].end (), h.Value.begin ());
+                
+                if (w.may_contain (h) && w.contains (h))
+                    matches.push_back (output_match {index, uint32 (i), output_match::kind (t), h});
+            }
+        }
+        
+    }
+    
+    bloom_filter::bloom_filter (uint64 elements, double false_positive_rate) {
+        if (elements == 0 || !(false_positive_rate > 0 && false_positive_rate < 1))
+            throw std::invalid_argument {"bloom_filter"};
+        
+        double ln2 = std::log (2.0);
+        Bits = std::max (uint64 {64}, uint64 (std::ceil (-double (elements) * std::log (false_positive_rate) / (ln2 * ln2))));
+        HashFunctions = std::max (1, std::min (int (std::round (double (Bits) / double (elements) * ln2)), 30));
+        Data.resize ((Bits + 63) / 64);
+    }
+    
+    // the positions are h1 + n h2 for two numbers taken from the digest.
+    void bloom_filter::insert (const digest160 &d) {
+        uint64 h1 = read_64 (d.Value.data ());
+        uint64 h2 = read_64 (d.Value.data () + 8) | 1;
+        for (uint32 n = 0; n < HashFunctions; n++) {
+            uint64 bit = (h1 + n * h2) % Bits;
+            Data[bit >> 6] |= uint64 {1} << (bit & 63);
+        }
+    }
+    
+    bool bloom_filter::contains (const digest160 &d) const {
+        uint64 h1 = read_64 (d.Value.data ());
+        uint64 h2 = read_64 (d.Value.data () + 8) | 1;
+        for (uint32 n = 0; n < HashFunctions; n++) {
+            uint64 bit = (h1 + n * h2) % Bits;
+            if (!((Data[bit >> 6] >> (bit & 63)) & 1)) return false;
+        }
+        
+        return true;
+    }
+    
+    size_t watched_addresses::hasher::operator () (const digest160 &d) const {
+        return read_64 (d.Value.data () + 12);
+    }
+    
+    std::vector<output_match> scan (const transaction_view &tx, const watch_list &w, uint32 index) {
+        std::vector<bytes_view> captures;
+        std::vector<output_match> matches;
+        scan_outputs (tx, w, index, captures, matches);
+        return matches;
+    }
+    
+    std::vector<output_match> scan (const block_view &b, const watch_list &w) {
+        std::vector<bytes_view> captures;
+        std::vector<output_match> matches;
+        for (size_t i = 0; i < b.size (); i++) scan_outputs (b[i], w, uint32 (i), captures, matches);
+        return matches;
+    }
+    
+    std::vector<output_match> scan (const block_view &b, const watch_list &w, executor &e) {
+        constexpr size_t per_batch = 256;
+        size_t batches = (b.size () + per_batch - 1) / per_batch;
+        
+        // each batch has its own list so that they can be put together in order.
+        std::vector<std::vector<output_match>> found (batches);
+        e.parallel_for (batches, [&b, &w, &found] (size_t j) {
+            std::vector<bytes_view> captures;
+            size_t end = std::min (b.size (), (j + 1) * per_batch);
+            for (size_t i = j * per_batch; i < end; i++) scan_outputs (b[i], w, uint32 (i), captures, found[j]);
+        });
+        
+        std::vector<output_match> matches;
+        for (const std::vector<output_match> &f : found) matches.insert (matches.end (), f.begin (), f.end ());
+        return matches;
+    }
+    
+}
@@ -12,6 +12,7 @@
 #include <cryptopp/hex.h>
 #include <cryptopp/pwdbased.h>
 #include <boost/locale.hpp>
+#include <algorithm>
 
 
 namespace Gigamonkey::HD::BIP_39 {
@@ -23,17 +24,6 @@ namespace Gigamonkey::HD::BIP_39 {
         bitarray[index/8] = bitarray[index/8] | (value  << 7-(index & 0x7));
     }
     
-    const cross<std::string>& getWordList(language lang) {
-        switch(lang) {
-            case english:
-                return english_words();
-            case japanese:
-                return japanese_words();
-            default:
-                return english_words();
-        }
-    }
-    
     std::string getLangSplit(language lang) {
         switch(lang) {
             case japanese:
@@ -43,26 +33,114 @@ namespace Gigamonkey::HD::BIP_39 {
         }
     }
 
+    namespace {
+        
+        using word64 = CryptoPP::word64;
+        
+        void words_from_big(const byte *in, word64 *out, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                word64 w = 0;
+                for (int j = 0; j < 8; j++) w = (w << 8) | in[8 * i + j];
+                out[i] = w;
+            }
+        }
+        
+        void words_to_big(const word64 *in, byte *out, size_t count) {
+            for (size_t i = 0; i < count; i++)
+                for (int j = 0; j < 8; j++) out[8 * i + j] = byte(in[i] >> (56 - 8 * j));
+        }
+        
+        // HMAC-SHA512 with the states after the inner and outer pads worked
+        // out once, so that a MAC of one 64 byte digest is two compressions.
+        struct hmac_sha512 {
+            word64 Inner[8];
+            word64 Outer[8];
+            
+            explicit hmac_sha512(bytes_view key) {
+                byte block[128] = {};
+                if (key.size() > 128) CryptoPP::SHA512().CalculateDigest(block, key.data(), key.size());
+                else std::copy(key.begin(), key.end(), block);
+                
+                word64 pad[16];
+                byte padded[128];
+                
+                for (int i = 0; i < 128; i++) padded[i] = block[i] ^ 0x36;
+                words_from_big(padded, pad, 16);
+                CryptoPP::SHA512::InitState(Inner);
+                CryptoPP::SHA512::Transform(Inner, pad);
+                
+                for (int i = 0; i < 128; i++) padded[i] = block[i] ^ 0x5c;
+                words_from_big(padded, pad, 16);
+                CryptoPP::SHA512::InitState(Outer);
+                CryptoPP::SHA512::Transform(Outer, pad);
+            }
+            
+            // HMAC of a message of 64 bytes given as words.
+            void mac(const word64 *in, word64 *out) const {
+                // the message and its padding, which follows a block of pad.
+                word64 block[16] = {};
+                std::copy(in, in + 8, block);
+                block[8] = word64{1} << 63;
+                block[15] = (128 + 64) * 8;
+                
+                word64 inner[8];
+                std::copy(Inner, Inner + 8, inner);
+                CryptoPP::SHA512::Transform(inner, block);
+                
+                std::copy(inner, inner + 8, block);
+                std::copy(Outer, Outer + 8, out);
+                CryptoPP::SHA512::Transform(out, block);
+            }
+        };
+        
+        // PBKDF2-HMAC-SHA512 with 2048 iterations and a 64 byte key, as in BIP 39.
+        seed pbkdf2(const std::string& words, const std::string& salt) {
+            bytes_view password{(const byte *)words.data(), words.size()};
+            hmac_sha512 hmac{password};
+            
+            // the first round is the only one with a message of a different size.
+            byte first[64];
+            CryptoPP::HMAC<CryptoPP::SHA512> h((const byte *)words.data(), words.size());
+            h.Update((const byte *)salt.data(), salt.size());
+            const byte one[4] = {0, 0, 0, 1};
+            h.Update(one, 4);
+            h.Final(first);
+            
+            word64 u[8];
+            word64 t[8];
+            words_from_big(first, u, 8);
+            std::copy(u, u + 8, t);
+            
+            for (int i = 1; i < 2048; i++) {
+                hmac.mac(u, u);
+                for (int j = 0; j < 8; j++) t[j] ^= u[j];
+            }
+            
+            seed seedObj(64);
+            words_to_big(t, seedObj.data(), 8);
+            return seedObj;
+        }
+        
+    }
+
     seed read(std::string words, const string& passphrase, language lang) {
         if(lang!=english)
             throw data::method::unimplemented("Non English Language");
         /*if(!valid(passphrase,lang)) {
             throw "Invalid Words";
         }*/
-        std::string passcode;
-        char wordsBA2[words.length()];
-        for(int i=0;i<words.length();i++)
-        {
-            wordsBA2[i]=words[i];
-        }
+        return pbkdf2(words, "mnemonic"+passphrase);
+    }
+    
+    std::vector<seed> read(const std::vector<std::string>& words, const string& passphrase, executor& e, language lang) {
+        if(lang!=english)
+            throw data::method::unimplemented("Non English Language");
         std::string salt="mnemonic"+passphrase;
-        CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA512> pbkdf2;
-        byte key[64];
-
-        pbkdf2.DeriveKey(key,sizeof(key),0,(const byte *)wordsBA2,words.length(),(const byte *)salt.data(),salt.length(),2048);
-        seed seedObj(64);
-        std::copy(std::begin(key),std::end(key),seedObj.begin());
-        return seedObj;
+        std::vector<seed> seeds(words.size());
+        e.parallel_for(words.size(), [&words, &salt, &seeds](size_t i) {
+            seeds[i] = pbkdf2(words[i], salt);
+        });
+        return seeds;
     }
 
     std::string generate(entropy ent, language lang) {
@@ -86,7 +164,7 @@ namespace Gigamonkey::HD::BIP_39 {
             word_indices[i /11]+=getBit(i,ent) << (10 - (i%11));
         }
         cross<std::string> words_ret;
-        const cross<std::string>& wordList=getWordList(lang);
+        const std::array<std::string_view, 2048>& wordList=word_list(lang);
 
         for(short word_indice : word_indices)
         {
@@ -110,19 +188,11 @@ namespace Gigamonkey::HD::BIP_39 {
         std::vector<std::string> wordsList;
         boost::split(wordsList, words_text, boost::is_any_of(getLangSplit(lang)));
         std::vector<int> wordIndices(wordsList.size());
-        const cross<std::string>& refWordList=getWordList(lang);
         for(int i=0;i<wordsList.size();i++) {
-            bool found=false;
-            for(int j=0;j<refWordList.size();j++) {
-                if(refWordList[j]==wordsList[i]) {
-                    wordIndices[i] = j;
-                    found=true;
-                }
-            }
-            if(!found)
+            maybe<uint32> index = word_index(wordsList[i], lang);
+            if(!index)
                 return false;
-
-
+            wordIndices[i] = *index;
         }
         int wordIndicesSize=wordIndices.size();
         double numBits=((wordIndices.size())*11);
@@ -145,8 +215,9 @@ namespace Gigamonkey::HD::BIP_39 {
         return checkByte==check;
     }
     
-    const cross<std::string> &english_words() {
-        static cross<std::string> Words{
+    namespace {
+        
+        constexpr std::array<std::string_view, 2048> English{
             "abandon", "ability", "able", "about", "above", "absent", "absorb", "abstract", "absurd", "abuse",
             "access", "accident", "account", "accuse", "achieve", "acid", "acoustic", "acquire", "across", "act",
             "action", "actor", "actress", "actual", "adapt", "add", "addict", "address", "adjust", "admit", "adult",
@@ -339,11 +410,8 @@ namespace Gigamonkey::HD::BIP_39 {
             "wire", "wisdom", "wise", "wish", "witness", "wolf", "woman", "wonder", "wood", "wool", "word", "work",
             "world", "worry", "worth", "wrap", "wreck", "wrestle", "wrist", "write", "wrong", "yard", "year",
             "yellow", "you", "young", "youth", "zebra", "zero", "zone", "zoo"};
-        return Words;
-    };
-    
-    const cross<std::string> &japanese_words() {
-        static cross<std::string> Words{
+        
+        constexpr std::array<std::string_view, 2048> Japanese{
                 "あいこくしん", "あいさつ", "あいだ", "あおぞら", "あかちゃん", "あきる", "あけがた", "あける", "あこがれる",
                 "あさい", "あさひ", "あしあと", "あじわう", "あずかる", "あずき", "あそぶ", "あたえる", "あたためる",
                 "あたりまえ", "あたる", "あつい", "あつかう", "あっしゅく", "あつまり", "あつめる", "あてな", "あてはまる", "あひる",
@@ -543,6 +611,53 @@ namespace Gigamonkey::HD::BIP_39 {
                 "われる"
         };
         
+        // the positions of the words in the order of their bytes, for a binary search.
+        constexpr std::array<uint16, 2048> sorted(const std::array<std::string_view, 2048>& words) {
+            std::array<uint16, 2048> x{};
+            for (size_t i = 0; i < x.size(); i++) x[i] = uint16(i);
+            std::sort(x.begin(), x.end(), [&words](uint16 a, uint16 b) {
+                return words[a] < words[b];
+            });
+            return x;
+        }
+        
+        constexpr std::array<uint16, 2048> EnglishOrder = sorted(English);
+        constexpr std::array<uint16, 2048> JapaneseOrder = sorted(Japanese);
+        
+        cross<std::string> strings(const std::array<std::string_view, 2048>& words) {
+            cross<std::string> x;
+            for (std::string_view w : words) x.emplace_back(w);
+            return x;
+        }
+        
+    }
+    
+    const std::array<std::string_view, 2048>& word_list(language lang) {
+        return lang == japanese ? Japanese : English;
+    }
+    
+    const cross<std::string> &english_words() {
+        static const cross<std::string> Words = strings(English);
+        return Words;
+    }
+    
+    const cross<std::string> &japanese_words() {
+        static const cross<std::string> Words = strings(Japanese);
         return Words;
     }
+    
+    const cross<std::string>& words(language lang) {
+        return lang == japanese ? japanese_words() : english_words();
+    }
+    
+    maybe<uint32> word_index(std::string_view word, language lang) {
+        const std::array<std::string_view, 2048>& list = word_list(lang);
+        const std::array<uint16, 2048>& order = lang == japanese ? JapaneseOrder : EnglishOrder;
+        auto x = std::lower_bound(order.begin(), order.end(), word, [&list](uint16 i, std::string_view w) {
+            return list[i] < w;
+        });
+        
+        if (x == order.end() || list[*x] != word) return {};
+        return *x;
+    }
 }
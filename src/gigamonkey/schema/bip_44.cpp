@@ -0,0 +1,106 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/schema/bip_44.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::HD::BIP_44 {
+    
+    namespace {
+        
+        struct chain {
+            BIP_32::pubkey Key;
+            std::vector<uint32> &Used;
+            
+            // the next address to ask about.
+            uint32 Next;
+            
+            bool done (uint32 gap_limit) const {
+                uint32 unused = Next - (Used.empty () ? 0 : Used.back () + 1);
+                return unused >= gap_limit || Next == BIP_32::harden (0);
+            }
+        };
+        
+        // search every chain together, a batch from each at a time.
+        void search (std::vector<chain> &chains, const address_history &history, const discovery_options &o, executor *e) {
+            if (o.Batch == 0) throw std::invalid_argument {"batch size must not be zero"};
+            
+            while (true) {
+                std::vector<size_t> searching;
+                std::vector<BIP_32::children> batches;
+                for (size_t i = 0; i < chains.size (); i++) {
+                    chain &c = chains[i];
+                    if (c.done (o.GapLimit)) continue;
+                    uint32 count = std::min (o.Batch, BIP_32::harden (0) - c.Next);
+                    searching.push_back (i);
+                    batches.push_back (e == nullptr ?
+                        BIP_32::derive_range (c.Key, c.Next, count) :
+                        BIP_32::derive_range (c.Key, c.Next, count, *e));
+                }
+                
+                if (searching.empty ()) return;
+                
+                // every question is asked before we wait for an answer. batches does
+                // not change after this, so the digests stay where they are.
+                std::vector<std::future<std::vector<bool>>> answers;
+                answers.reserve (batches.size ());
+                for (const BIP_32::children &b : batches) answers.push_back (history.used (b.Digests));
+                
+                for (size_t i = 0; i < searching.size (); i++) {
+                    std::vector<bool> used = answers[i].get ();
+                    const BIP_32::children &b = batches[i];
+                    if (used.size () != b.size ()) throw std::runtime_error {"address history did not answer for every address"};
+                    
+                    chain &c = chains[searching[i]];
+                    for (uint32 j = 0; j < b.size (); j++) if (used[j]) c.Used.push_back (b.From + j);
+                    c.Next = b.From + b.size ();
+                }
+            }
+        }
+        
+        // search the chains of many accounts at once.
+        void search (std::vector<account> &accounts, const address_history &history, const discovery_options &o, executor *e) {
+            std::vector<chain> chains;
+            chains.reserve (2 * accounts.size ());
+            for (account &a : accounts) {
+                chains.push_back (chain {BIP_32::derive (a.Pubkey, receive_index), a.Receive, 0});
+                chains.push_back (chain {BIP_32::derive (a.Pubkey, change_index), a.Change, 0});
+            }
+            
+            search (chains, history, o, e);
+        }
+        
+    }
+    
+    account scan (uint32 index, const BIP_32::pubkey &p, const address_history &history, const discovery_options &o, executor *e) {
+        std::vector<account> a {account {index, p, {}, {}}};
+        search (a, history, o, e);
+        return a[0];
+    }
+    
+    std::vector<account> discover (const BIP_32::secret &root, const address_history &history, const discovery_options &o, executor *e) {
+        if (o.Accounts == 0) throw std::invalid_argument {"accounts searched at once must not be zero"};
+        
+        std::vector<account> found;
+        for (uint32 first = 0; first < o.MaxAccounts;) {
+            uint32 count = std::min (o.Accounts, o.MaxAccounts - first);
+            std::vector<account> accounts;
+            accounts.reserve (count);
+            for (uint32 i = first; i < first + count; i++)
+                accounts.push_back (account {i, from_root (root, o.CoinType, i).to_public (), {}, {}});
+            first += count;
+            
+            search (accounts, history, o, e);
+            
+            for (account &a : accounts) {
+                if (a.Receive.empty ()) return found;
+                found.push_back (std::move (a));
+            }
+        }
+        
+        return found;
+    }
+    
+}
@@ -18,6 +18,7 @@
 //#include <unicode/utypes.h>
 //#include <unicode/unistr.h>
 #include <bitset>
+#include <stdexcept>
 
 namespace Gigamonkey::HD::BIP_32 {
 
@@ -28,12 +29,19 @@ namespace Gigamonkey::HD::BIP_32 {
         return (uint32_t) hsh[0] << 24 | (uint32_t) hsh[1] << 16 | (uint32_t) hsh[2] << 8 | (uint32_t) hsh[3];
     }
 
+    uint32 fingerprint(const secp256k1::pubkey &pub) {
+        return fp(Bitcoin::Hash160(pub));
+    }
+
     secret derive(const secret& sec, uint32 child) {
-        Bitcoin::pubkey pub = sec.Secret.to_public();
+        secp256k1::pubkey pub = sec.Secret.to_public();
+        return derive(sec, pub, fingerprint(pub), child);
+    }
         
+    secret derive(const secret& sec, const secp256k1::pubkey &pub, uint32 parent, uint32 child) {
         secret derived;
         derived.Depth = sec.Depth + 1;
-        derived.Parent = fp(Bitcoin::Hash160(pub));
+        derived.Parent = parent;
         derived.Sequence = child;
         derived.Net = sec.Net;
         
@@ -46,7 +54,7 @@ namespace Gigamonkey::HD::BIP_32 {
             data_bytes.insert(data_bytes.begin(), (byte) 0);
         } else {
             data_bytes.clear();
-            for (byte &b : pub) {
+            for (const byte &b : pub) {
                 data_bytes.push_back(b);
             }
         }
@@ -73,7 +81,7 @@ namespace Gigamonkey::HD::BIP_32 {
         
         std::copy(left.begin(), left.end(), ll.begin());
         
-        if (ll > CURVE_ORDER) return derive(sec, child + 1);
+        if (ll > CURVE_ORDER) return derive(sec, pub, parent, child + 1);
         
         uint256 k = uint256{};
         std::copy(sec.Secret.Value.begin(), sec.Secret.Value.end(), k.begin());
@@ -84,7 +92,7 @@ namespace Gigamonkey::HD::BIP_32 {
         keyCode %= (N) CURVE_ORDER;
         
         if (keyCode == 0)
-            return derive(sec, child + 1);
+            return derive(sec, pub, parent, child + 1);
         bytes child_key;
         
         for (unsigned char &itr2 : k) {
@@ -101,100 +109,210 @@ namespace Gigamonkey::HD::BIP_32 {
     
     
     pubkey derive(const pubkey &pub, uint32 child) {
-        pubkey derived;
-        derived.Depth = pub.Depth + 1;
-        derived.Parent = fp(Bitcoin::Hash160(pub.Pubkey));
-        derived.Sequence = child;
-        derived.Net = pub.Net;
-
-        bool is_hardened = child >= 0x80000000;
-
-        data::bytes data_bytes(0);
-
-        if (is_hardened)
-            return pubkey();
-        data_bytes.clear();
-        for (auto &b : pub.Pubkey) {
-            data_bytes.push_back(b);
+        return derive(pub, fingerprint(pub.Pubkey), child);
+    }
+    
+    namespace {
+        
+        // derive a child from a parent whose point has already been parsed, giving the point of 
+        // the child in next, so that a path can be derived without parsing each key along it. 
+        pubkey derive_from(const pubkey &pub, const secp256k1::parsed_pubkey &point, uint32 parent, uint32 child, secp256k1::parsed_pubkey &next) {
+            if (child >= 0x80000000) return pubkey();
+            
+            pubkey derived;
+            derived.Depth = pub.Depth + 1;
+            derived.Parent = parent;
+            derived.Sequence = child;
+            derived.Net = pub.Net;
+            
+            bytes data_bytes{pub.Pubkey};
+            data_bytes.push_back(child >> 24);
+            data_bytes.push_back((child >> 16) & 0xff);
+            data_bytes.push_back((child >> 8) & 0xff);
+            data_bytes.push_back(child & 0xff);
+            
+            byte hmaced[CryptoPP::HMAC<CryptoPP::SHA512>::DIGESTSIZE];
+            try {
+                CryptoPP::HMAC<CryptoPP::SHA512> hmac(pub.ChainCode.data(), pub.ChainCode.size());
+                hmac.Update(reinterpret_cast<const byte *>(data_bytes.data()), data_bytes.size());
+                hmac.Final(hmaced);
+            } catch (const CryptoPP::Exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            
+            uint256 ll{};
+            std::copy(hmaced, hmaced + 32, ll.begin());
+            if (ll > CURVE_ORDER) return derive_from(pub, point, parent, child + 1, next);
+            
+            next = point + ll;
+            derived.Pubkey = next.serialize();
+            derived.ChainCode = bytes{bytes_view{hmaced + 32, 32}};
+            return derived;
         }
-
-        data_bytes.push_back(child >> 24);
-        data_bytes.push_back((child >> 16) & 0xff);
-        data_bytes.push_back((child >> 8) & 0xff);
-        data_bytes.push_back(child & 0xff);
-
-        byte hmaced[CryptoPP::HMAC<CryptoPP::SHA512>::DIGESTSIZE];
-        try {
-            CryptoPP::HMAC<CryptoPP::SHA512> hmac(pub.ChainCode.data(), pub.ChainCode.size());
-            hmac.Update(reinterpret_cast<const byte *>(data_bytes.data()), data_bytes.size());
-            hmac.Final(hmaced);
-        } catch (const CryptoPP::Exception &e) {
-            std::cerr << e.what() << std::endl;
+        
+    }
+    
+    pubkey derive(const pubkey &pub, uint32 parent, uint32 child) {
+        secp256k1::parsed_pubkey point{pub.Pubkey};
+        secp256k1::parsed_pubkey next{point};
+        return derive_from(pub, point, parent, child, next);
+    }
+    
+    pubkey derive(const pubkey &pub, path l) {
+        pubkey derived = pub;
+        secp256k1::parsed_pubkey point{pub.Pubkey};
+        for (uint32 child : l) {
+            secp256k1::parsed_pubkey next{point};
+            derived = derive_from(derived, point, fingerprint(derived.Pubkey), child, next);
+            if (derived.Pubkey.size() == 0) return derived;
+            point = next;
         }
-        bytes left;
-        for (int i = 0; i < 32; i++)
-            left.push_back(hmaced[i]);
-        uint256 ll = uint256{};
-
-        std::copy(left.begin(), left.end(), ll.begin());
-
-        if (ll > CURVE_ORDER)
-            return derive(pub, child + 1);
-
-        secp256k1::secret key;
-        std::copy(left.begin(), left.end(), key.Value.begin());
-        secp256k1::pubkey pubkey = pub.Pubkey + key;
-        derived.Pubkey = pubkey;
-        bytes child_key;
-        for (int i = 32; i < 64; i++)
-            derived.ChainCode.push_back(hmaced[i]);
+        
         return derived;
     }
 
 
-    secret secret::read(string_view str) {
-        Gigamonkey::base58::check tmp(str);
-        secret secret1;
-        if (!tmp.valid())
-            return secret();
-        auto view = tmp.payload();
-        if (view.length() != 77) {
-            return secret();
+    namespace {
+        
+        constexpr uint32 children_per_batch = 256;
+        
+        // derive count children of pub starting at first into x.
+        void derive_children(const pubkey &pub, uint32 parent, uint32 first, uint32 count, children &x) {
+            constexpr size_t size = secp256k1::pubkey::CompressedSize;
+            
+            // the pubkey goes into every HMAC and only the last four bytes change.
+            byte input[size + 4];
+            std::copy(pub.Pubkey.begin(), pub.Pubkey.end(), input);
+            
+            CryptoPP::HMAC<CryptoPP::SHA512> hmac(pub.ChainCode.data(), pub.ChainCode.size());
+            std::vector<uint256> tweaks(count);
+            bool over = false;
+            for (uint32 i = 0; i < count; i++) {
+                uint32 child = first + i;
+                input[size] = child >> 24;
+                input[size + 1] = (child >> 16) & 0xff;
+                input[size + 2] = (child >> 8) & 0xff;
+                input[size + 3] = child & 0xff;
+                
+                byte hmaced[CryptoPP::HMAC<CryptoPP::SHA512>::DIGESTSIZE];
+                hmac.Update(input, sizeof(input));
+                hmac.Final(hmaced);
+                
+                std::copy(hmaced, hmaced + 32, tweaks[i].begin());
+                if (tweaks[i] > CURVE_ORDER) over = true;
+            }
+            
+            size_t offset = first - x.From;
+            byte *out = x.Pubkeys.data() + offset * size;
+            
+            // almost never happens, so these are left to derive, which knows what to do.
+            if (over || !secp256k1::pubkey::plus_secrets(pub.Pubkey, tweaks.data(), count, out))
+                for (uint32 i = 0; i < count; i++) {
+                    pubkey derived = derive(pub, parent, first + i);
+                    if (derived.Pubkey.size() != size) throw std::logic_error{"could not derive BIP 32 pubkey"};
+                    std::copy(derived.Pubkey.begin(), derived.Pubkey.end(), out + i * size);
+                }
+            
+            Bitcoin::Hash160_pubkeys(std::span<const byte>{out, count * size}, std::span<digest160>{x.Digests.data() + offset, count});
         }
-        secret1.Net = main;
-        bytes prv = bytes({0x88, 0xAD, 0xE4});
-
-        auto check = view.substr(0, 3);
-        if (prv != check)
-            return secret();
-        bytes_reader reader(view.begin() + 3, view.end());
         
-        data::endian::arithmetic<false, endian::big, 1> depth;
-        reader >> depth;
-        secret1.Depth = depth;
-        data::endian::arithmetic<false, endian::big, 4> parent;
-        reader >> parent;
-        secret1.Parent = parent;
-        data::endian::arithmetic<false, endian::big, 4> sequence;
+        template <typename loop>
+        children derive_children(const pubkey &pub, uint32 from, uint32 count, loop each) {
+            if (!pub.valid()) throw std::invalid_argument{"invalid BIP 32 pubkey"};
+            if (hardened(from) || count > 0x80000000 - from) throw std::invalid_argument{"cannot derive hardened children of a pubkey"};
+            
+            children x{from, pub.Net, std::vector<byte>(size_t(count) * secp256k1::pubkey::CompressedSize), std::vector<digest160>(count)};
+            uint32 parent = fingerprint(pub.Pubkey);
+            
+            each((count + children_per_batch - 1) / children_per_batch, [&pub, parent, from, count, &x](size_t j) {
+                uint32 first = from + uint32(j) * children_per_batch;
+                derive_children(pub, parent, first, std::min(children_per_batch, from + count - first), x);
+            });
+            
+            return x;
+        }
         
-        reader >> sequence;
-        secret1.Sequence = sequence;
-        bytes_view chain_code = view.substr(12, 32);
-        bytes_view key = view.substr(12 + 32 + 1);
-
-        uint256 keyuint;
+    }
+    
+    children derive_range(const pubkey &pub, uint32 from, uint32 count) {
+        return derive_children(pub, from, count, [](size_t n, auto f) {
+            for (size_t j = 0; j < n; j++) f(j);
+        });
+    }
+    
+    children derive_range(const pubkey &pub, uint32 from, uint32 count, executor &e) {
+        return derive_children(pub, from, count, [&e](size_t n, auto f) {
+            e.parallel_for(n, f);
+        });
+    }
 
-        auto tmpItr = key.begin();
-        auto keyItr = keyuint.begin();
-        while (tmpItr != key.end()) {
-            *keyItr = *tmpItr;
-            keyItr++;
-            tmpItr++;
+    namespace {
+        
+        // the first four bytes of a serialized extended key.
+        const byte xpub_version[4]{0x04, 0x88, 0xB2, 0x1E};
+        const byte xprv_version[4]{0x04, 0x88, 0xAD, 0xE4};
+        
+        void write_uint32(byte* out, uint32 x) {
+            for (int i = 0; i < 4; i++) out[i] = static_cast<byte>(x >> (24 - 8 * i));
         }
-        secret1.ChainCode = bytes(32);
-        std::copy(chain_code.begin(), chain_code.end(), secret1.ChainCode.begin());
-        secret1.Secret = secp256k1::secret{keyuint};
-        return secret1;
+        
+        uint32 read_uint32(const byte* in) {
+            return uint32(in[0]) << 24 | uint32(in[1]) << 16 | uint32(in[2]) << 8 | uint32(in[3]);
+        }
+        
+        // everything but the key, which is the last 33 bytes.
+        void write_header(byte* out, const byte* version, byte depth, uint32 parent, uint32 sequence, const chain_code& cc) {
+            std::copy(version, version + 4, out);
+            out[4] = depth;
+            write_uint32(out + 5, parent);
+            write_uint32(out + 9, sequence);
+            std::fill(out + 13, out + 45, 0);
+            std::copy(cc.begin(), cc.begin() + std::min(cc.size(), size_t(32)), out + 13);
+        }
+        
+        template <typename key>
+        bool read_header(bytes_view b, const byte* version, key& k) {
+            if (b.size() != serialized_size || !std::equal(version, version + 4, b.begin())) return false;
+            k.Net = main;
+            k.Depth = b[4];
+            k.Parent = read_uint32(b.data() + 5);
+            k.Sequence = read_uint32(b.data() + 9);
+            k.ChainCode = bytes(32);
+            std::copy(b.begin() + 13, b.begin() + 45, k.ChainCode.begin());
+            return true;
+        }
+        
+    }
+    
+    byte_array<serialized_size> secret::serialize() const {
+        byte_array<serialized_size> x;
+        write_header(x.data(), xprv_version, Depth, Parent, Sequence, ChainCode);
+        x[45] = 0;
+        std::copy(Secret.Value.begin(), Secret.Value.end(), x.begin() + 46);
+        return x;
+    }
+    
+    secret secret::deserialize(bytes_view b) {
+        secret x;
+        // the secret key is preceded by a zero byte.
+        if (!read_header(b, xprv_version, x) || b[45] != 0) return secret();
+        std::copy(b.begin() + 46, b.end(), x.Secret.Value.begin());
+        return x;
+    }
+    
+    secret secret::read(string_view str) {
+        byte_array<serialized_size> x;
+        if (!base58::fixed_check<serialized_size>::decode(str, x.data())) return secret();
+        return deserialize(bytes_view{x.data(), x.size()});
+    }
+    
+    size_t secret::write(char* out) const {
+        return base58::fixed_check<serialized_size>::encode(serialize().data(), out);
+    }
+    
+    string secret::write() const {
+        char out[max_string_size];
+        return string(out, write(out));
     }
 
     secret secret::from_seed(seed entropy, type net) {
@@ -221,38 +339,6 @@ namespace Gigamonkey::HD::BIP_32 {
         return secret1;
     }
 
-    string secret::write() const {
-        bytes output;
-
-        bytes prv = bytes({0x88, 0xAD, 0xE4});
-        for (int i = 0; i < prv.size(); i++)
-            output.push_back(prv[i]);
-        output.push_back(Depth);
-        output.push_back((uint32_t) Parent >> 24);
-        output.push_back(((uint32_t) Parent >> 16) & 0xff);
-        output.push_back(((uint32_t) Parent >> 8) & 0xff);
-        output.push_back((uint32_t) Parent & 0xff);
-        output.push_back((uint32_t) Sequence >> 24);
-        output.push_back(((uint32_t) Sequence >> 16) & 0xff);
-        output.push_back(((uint32_t) Sequence >> 8) & 0xff);
-        output.push_back((uint32_t) Sequence & 0xff);
-        bytes chain_value(ChainCode.size());
-        std::reverse_copy(ChainCode.begin(), ChainCode.end(), chain_value.begin());
-        auto itr2 = ChainCode.begin();
-        while (itr2 != ChainCode.end()) {
-            output.push_back(*itr2++);
-        }
-        output.push_back(0);
-        bytes sec_value(Secret.Value.size());
-        std::reverse_copy(Secret.Value.begin(), Secret.Value.end(), sec_value.begin());
-        auto itr = Secret.Value.begin();
-
-        while (itr != Secret.Value.end()) {
-            output.push_back(*itr++);
-        }
-        Gigamonkey::base58::check outputString(0x04, output);
-        return outputString.encode();
-    }
     /*
     std::ostream &operator<<(std::ostream &os, const secret &secret) {
         os << "Secret: " << data::encoding::hex::write(secret.Secret.Value) << " ChainCode: "
@@ -284,30 +370,28 @@ namespace Gigamonkey::HD::BIP_32 {
         return !(rhs == *this);
     }
 
+    byte_array<serialized_size> pubkey::serialize() const {
+        byte_array<serialized_size> x;
+        write_header(x.data(), xpub_version, Depth, Parent, Sequence, ChainCode);
+        std::fill(x.begin() + 45, x.end(), 0);
+        std::copy(Pubkey.begin(), Pubkey.begin() + std::min(Pubkey.size(), size_t(33)), x.begin() + 45);
+        return x;
+    }
+    
+    pubkey pubkey::deserialize(bytes_view b) {
+        pubkey x;
+        if (!read_header(b, xpub_version, x)) return pubkey();
+        x.Pubkey = secp256k1::pubkey{b.substr(45)};
+        return x;
+    }
+    
+    size_t pubkey::write(char* out) const {
+        return base58::fixed_check<serialized_size>::encode(serialize().data(), out);
+    }
+    
     string pubkey::write() const {
-        bytes output;
-        bytes prv = bytes({0x88, 0xB2, 0x1E});
-        for (int i = 0; i < prv.size(); i++)
-            output.push_back(prv[i]);
-        output.push_back(Depth);
-        output.push_back((uint32_t) Parent >> 24);
-        output.push_back(((uint32_t) Parent >> 16) & 0xff);
-        output.push_back(((uint32_t) Parent >> 8) & 0xff);
-        output.push_back((uint32_t) Parent & 0xff);
-        output.push_back((uint32_t) Sequence >> 24);
-        output.push_back(((uint32_t) Sequence >> 16) & 0xff);
-        output.push_back(((uint32_t) Sequence >> 8) & 0xff);
-        output.push_back((uint32_t) Sequence & 0xff);
-        auto itr2 = ChainCode.begin();
-        while (itr2 != ChainCode.end()) {
-            output.push_back(*itr2++);
-        }
-        auto itr = Pubkey.begin();
-        while (itr != Pubkey.end()) {
-            output.push_back(*itr++);
-        }
-        Gigamonkey::base58::check outputString(0x04, output);
-        return outputString.encode();
+        char out[max_string_size];
+        return string(out, write(out));
     }
 
     pubkey pubkey::from_seed(seed entropy, type net) {
@@ -315,42 +399,11 @@ namespace Gigamonkey::HD::BIP_32 {
     }
 
     pubkey pubkey::read(string_view str) {
-        Gigamonkey::base58::check tmp(str);
-        pubkey pubkey1;
-        if (!tmp.valid())
-            return pubkey();
-        auto view = tmp.payload();
-        if (view.length() != 77) {
-            return pubkey();
-        }
-        pubkey1.Net = main;
-        bytes prv = bytes({0x88, 0xB2, 0x1E});
-        auto check = view.substr(0, 3);
-        if (prv != check)
-            return pubkey();
-        bytes_reader reader(view.begin() + 3, view.end());
-        
-        data::endian::arithmetic<false, endian::big, 1> depth;
-        reader >> depth;
-        pubkey1.Depth = depth;
-        data::endian::arithmetic<false, endian::big, 4> parent;
-        reader >> parent;
-        pubkey1.Parent = parent;
-        data::endian::arithmetic<false, endian::big, 4> sequence;
-        
-        reader >> sequence;
-        pubkey1.Sequence = sequence;
-        //sequence |= view[12] & 0xff;
-        bytes_view chain_code = view.substr(12, 32);
-        bytes_view key = view.substr(12 + 32);
-
-        uint<33> keyuint;
-        std::copy(key.begin(), key.end(), keyuint.begin());
-        pubkey1.ChainCode = bytes(32);
-        std::copy(chain_code.begin(), chain_code.end(), pubkey1.ChainCode.begin());
-        pubkey1.Pubkey = secp256k1::pubkey{keyuint};
-        return pubkey1;
+        byte_array<serialized_size> x;
+        if (!base58::fixed_check<serialized_size>::decode(str, x.data())) return pubkey();
+        return deserialize(bytes_view{x.data(), x.size()});
     }
+    
     /*
     std::ostream &operator<<(std::ostream &os, const pubkey &pubkey) {
         os << "Pubkey: " << data::encoding::hex::write(pubkey.Pubkey) << " ChainCode: "
@@ -2,17 +2,99 @@
 #include <sv/random.h>
 #include <gigamonkey/schema/random.hpp>
 
+#include <stdexcept>
+
 namespace Gigamonkey {
     
+    // GetStrongRandBytes takes a lock and gives no more than 32 bytes at a
+    // time, so we use the generator for this thread, which it seeds.
     void bitcoind_random::get(byte* x, size_t size) {
-        static bool initialized = false;
-        if (!initialized) {
-            void RandomInit();
-            initialized = true;
-        }
+        static const bool initialized = (RandomInit (), true);
+        (void) initialized;
         
-        GetStrongRandBytes(x, size);
+        GetThreadRandBytes(x, size);
     } 
 
 }
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        // keys are computed in pieces of this many, on different threads if there is an executor.
+        constexpr size_t keys_per_piece = 1024;
+        
+        void draw(data::crypto::random &r, byte *secret) {
+            do r.get(secret, secp256k1::secret::Size);
+            while (!secp256k1::secret::valid(bytes_view{secret, secp256k1::secret::Size}));
+        }
+        
+    }
+    
+    secret key_batch::secret(size_t i) const {
+        secp256k1::secret x;
+        std::copy(Secrets.begin() + i * secp256k1::secret::Size, Secrets.begin() + (i + 1) * secp256k1::secret::Size, x.Value.begin());
+        return Bitcoin::secret{Net, x, Compressed};
+    }
+    
+    pubkey key_batch::pubkey(size_t i) const {
+        return secp256k1::pubkey{bytes_view{Pubkeys.data() + i * pubkey_size(), pubkey_size()}};
+    }
+    
+    key_batch key_batch::generate(data::crypto::random &r, size_t count, const options &o, executor *e) {
+        constexpr size_t size = secp256k1::secret::Size;
+        key_batch x{o.Net, o.Compressed, std::vector<byte>(count * size), {}};
+        x.Pubkeys.resize(count * x.pubkey_size());
+        
+        // in a run, each secret is the one before plus one, read as a big endian number.
+        uint256 one{0};
+        *(one.end() - 1) = 1;
+        
+        size_t run = o.Run == 0 ? 1 : o.Run;
+        for (size_t i = 0; i < count; i++) {
+            byte *out = x.Secrets.data() + i * size;
+            if (i % run == 0) draw(r, out);
+            else {
+                uint256 previous;
+                std::copy(out - size, out, previous.begin());
+                uint256 next = secp256k1::secret::plus(previous, one);
+                
+                // past the order of the curve, so the run starts again.
+                if (next == 0) draw(r, out);
+                else std::copy(next.begin(), next.end(), out);
+            }
+        }
+        
+        auto piece = [&x, &o, count, run](size_t p) {
+            size_t begin = p * keys_per_piece;
+            size_t end = std::min(count, begin + keys_per_piece);
+            const byte *secrets = x.Secrets.data();
+            byte *pubkeys = x.Pubkeys.data();
+            
+            for (size_t i = begin; i < end;) {
+                // the rest of this run in this piece.
+                size_t next = o.Run == 0 ? end : std::min(end, (i / run + 1) * run);
+                uint256 first;
+                std::copy(secrets + i * size, secrets + (i + 1) * size, first.begin());
+                
+                bool computed = o.Run == 0 ?
+                    secp256k1::secret::to_public(secrets + i * size, next - i, pubkeys + i * x.pubkey_size(), o.Compressed) :
+                    secp256k1::secret::to_public_consecutive(first, next - i, pubkeys + i * x.pubkey_size(), o.Compressed);
+                
+                // a run that started again in the middle is done one key at a time.
+                if (!computed && !secp256k1::secret::to_public(secrets + i * size, next - i, pubkeys + i * x.pubkey_size(), o.Compressed))
+                    throw std::logic_error{"could not compute pubkeys"};
+                
+                i = next;
+            }
+        };
+        
+        size_t pieces = (count + keys_per_piece - 1) / keys_per_piece;
+        if (e == nullptr) for (size_t p = 0; p < pieces; p++) piece(p);
+        else e->parallel_for(pieces, piece);
+        
+        return x;
+    }
+    
+}
         
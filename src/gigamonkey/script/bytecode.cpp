@@ -0,0 +1,194 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/bytecode.hpp>
+
+#include <limits>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    namespace {
+        
+        // marks a jump that has not been matched yet.
+        constexpr uint32 unmatched = std::numeric_limits<uint32>::max ();
+        
+        bool is_minimal_push_data (op o, bytes_view data) {
+            if (data.size () == 1 && (data[0] == 0x81 || (data[0] >= 1 && data[0] <= 16))) return false;
+            if (o == OP_PUSHDATA1) return data.size () > 75;
+            if (o == OP_PUSHDATA2) return data.size () > 256;
+            if (o == OP_PUSHDATA4) return data.size () > 65536;
+            return true;
+        }
+        
+        // size of the op code and length of a push_data instruction.
+        size_t push_header_size (op o) {
+            return o <= OP_PUSHSIZE75 ? 1 : o == OP_PUSHDATA1 ? 2 : o == OP_PUSHDATA2 ? 3 : 5;
+        }
+        
+        size_t push_data_size (op o, const byte *header) {
+            if (o <= OP_PUSHSIZE75) return o;
+            if (o == OP_PUSHDATA1) return header[1];
+            if (o == OP_PUSHDATA2) return size_t (header[1]) | (size_t (header[2]) << 8);
+            return size_t (header[1]) | (size_t (header[2]) << 8) | (size_t (header[3]) << 16) | (size_t (header[4]) << 24);
+        }
+        
+        bool is_control (op o) {
+            return o == OP_IF || o == OP_NOTIF || o == OP_ELSE;
+        }
+        
+    }
+    
+    bytecode::bytecode (bytes_view b) : bytecode {} {
+        std::vector<operation> ops;
+        
+        // open OP_IF, OP_NOTIF and OP_ELSE, as in decompile.
+        std::vector<uint32> control;
+        
+        size_t i = 0;
+        while (i < b.size ()) {
+            op o = op (b[i]);
+            if (o == OP_INVALIDOPCODE || o == OP_RESERVED || o >= FIRST_UNDEFINED_OP_VALUE) return;
+            
+            uint32 index = ops.size ();
+            operation x {o, true, uint32 (i), 1, is_control (o) ? unmatched : 0};
+            
+            if (is_push_data (o)) {
+                size_t header = push_header_size (o);
+                if (header > b.size () - i) return;
+                
+                size_t size = push_data_size (o, b.data () + i);
+                if (size > b.size () - i - header) return;
+                
+                x.Size = header + size;
+                x.Minimal = is_minimal_push_data (o, b.substr (i + header, size));
+            } else if (o == OP_RETURN && control.empty ()) {
+                x.Size = b.size () - i;
+                x.Minimal = x.Size == 1;
+            } else if (o == OP_IF || o == OP_NOTIF) control.push_back (index);
+            else if (o == OP_ELSE) {
+                if (!control.empty () && ops[control.back ()].Jump == unmatched) ops[control.back ()].Jump = index;
+                control.push_back (index);
+            } else if (o == OP_ENDIF) {
+                if (control.empty ()) return;
+                if (ops[control.back ()].Jump == unmatched) ops[control.back ()].Jump = index;
+                op prev = ops[control.back ()].Op;
+                control.pop_back ();
+                
+                if (prev == OP_ELSE) {
+                    if (control.empty ()) return;
+                    prev = ops[control.back ()].Op;
+                    control.pop_back ();
+                }
+                
+                if (prev != OP_IF && prev != OP_NOTIF) return;
+            }
+            
+            ops.push_back (x);
+            i += x.Size;
+        }
+        
+        for (operation &x : ops) if (x.Jump == unmatched) x.Jump = ops.size ();
+        
+        Script = bytes (b);
+        Operations = std::move (ops);
+    }
+    
+    bytes bytecode::data (size_t i) const {
+        const operation &x = Operations[i];
+        if (is_push_data (x.Op)) {
+            size_t header = push_header_size (x.Op);
+            return bytes (bytes_view {Script.data () + x.Offset + header, x.Size - header});
+        }
+        
+        if (x.Op == OP_RETURN) return bytes (bytes_view {Script.data () + x.Offset + 1, x.Size - 1});
+        if (!Bitcoin::is_push (x.Op)) return {};
+        if (x.Op == OP_1NEGATE) return {0x81};
+        return bytes {static_cast<byte> (x.Op - 0x50)};
+    }
+    
+    bool bytecode::is_push () const {
+        for (const operation &x : Operations) if (!Bitcoin::is_push (x.Op)) return false;
+        return true;
+    }
+    
+    bytecode bytecode::join (std::initializer_list<const bytecode *> scripts) {
+        size_t script_size = 0;
+        size_t ops_size = 0;
+        for (const bytecode *b : scripts) {
+            script_size += b->Script.size () + 1;
+            ops_size += b->size () + 1;
+        }
+        
+        bytecode joined {};
+        if (scripts.size () == 0) return joined;
+        
+        joined.Script.resize (script_size - 1);
+        joined.Operations.reserve (ops_size - 1);
+        
+        uint32 script_offset = 0;
+        for (const bytecode *b : scripts) {
+            if (script_offset != 0) {
+                joined.Script[script_offset - 1] = OP_CODESEPARATOR;
+                joined.Operations.push_back (operation {OP_CODESEPARATOR, true, script_offset - 1, 1, 0});
+            }
+            
+            uint32 base = joined.Operations.size ();
+            std::copy (b->Script.begin (), b->Script.end (), joined.Script.begin () + script_offset);
+            for (operation x : b->Operations) {
+                x.Offset += script_offset;
+                if (is_control (x.Op)) x.Jump = x.Jump == b->size () ? unmatched : x.Jump + base;
+                joined.Operations.push_back (x);
+            }
+            
+            script_offset += b->Script.size () + 1;
+        }
+        
+        for (operation &x : joined.Operations) if (x.Jump == unmatched) x.Jump = joined.size ();
+        
+        return joined;
+    }
+    
+    ScriptError verify (const bytecode &b, uint32 flags) {
+        bool script_genesis = (flags & SCRIPT_GENESIS) != 0;
+        bool utxo_after_genesis = (flags & SCRIPT_UTXO_AFTER_GENESIS) != 0;
+        
+        if (utxo_after_genesis && !script_genesis) return SCRIPT_ERR_IMPOSSIBLE_ENCODING;
+        
+        if (b.empty ()) return SCRIPT_ERR_OK;
+        
+        // first we check for OP_RETURN data.
+        if (script_genesis && utxo_after_genesis) {
+            if (b.size () == 2 && b.Operations[0].Op == OP_FALSE && b.Operations[1].Op == OP_RETURN) return SCRIPT_ERR_OK;
+        } else if (b.size () == 1 && b.Operations[0].Op == OP_RETURN) return SCRIPT_ERR_OK;
+        
+        std::vector<op> control;
+        for (size_t i = 0; i < b.size (); i++) {
+            const bytecode::operation &x = b.Operations[i];
+            
+            if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !x.Minimal) return SCRIPT_ERR_MINIMALDATA;
+            
+            if (x.Op == OP_RETURN) {
+                if (!utxo_after_genesis) return SCRIPT_ERR_OP_RETURN;
+                if (control.empty () && i + 1 == b.size ()) return SCRIPT_ERR_OK;
+                if (x.Size != 1) return SCRIPT_ERR_OP_RETURN;
+            }
+            
+            if (x.Op == OP_ENDIF) {
+                if (control.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                op prev = control.back ();
+                control.pop_back ();
+                
+                if (prev == OP_ELSE) {
+                    if (control.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                    prev = control.back ();
+                    control.pop_back ();
+                }
+                
+                if (prev != OP_IF && prev != OP_NOTIF) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+            } else if (is_control (x.Op)) control.push_back (x.Op);
+        }
+        
+        return control.empty () ? SCRIPT_ERR_OK : SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+    }
+    
+}
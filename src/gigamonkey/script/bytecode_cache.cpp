@@ -0,0 +1,76 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/bytecode_cache.hpp>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    namespace {
+        
+        size_t cost (const bytecode &b) {
+            return b.Script.size () + b.Operations.size () * sizeof (bytecode::operation);
+        }
+        
+    }
+    
+    bytecode_cache::bytecode_cache (size_t max_entries, size_t max_bytes) :
+        MaxEntries {max_entries}, MaxBytes {max_bytes}, Mutex {}, Entries {}, Bytes {0}, Hits {0}, Misses {0} {
+        Entries.reserve (std::min (max_entries, size_t {1} << 16));
+    }
+    
+    ptr<const bytecode> bytecode_cache::get (bytes_view script) {
+        if (script.size () < min_script_size) return std::make_shared<const bytecode> (script);
+        
+        digest256 key = SHA2_256 (script);
+        
+        {
+            std::shared_lock<std::shared_mutex> lock (Mutex);
+            auto e = Entries.find (key);
+            if (e != Entries.end ()) {
+                ++Hits;
+                return e->second;
+            }
+        }
+        
+        ++Misses;
+        ptr<const bytecode> decoded = std::make_shared<const bytecode> (script);
+        size_t c = cost (*decoded);
+        if (MaxEntries == 0 || c > MaxBytes) return decoded;
+        
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        auto e = Entries.find (key);
+        if (e != Entries.end ()) return e->second;
+        
+        // the keys are hashes, so the first one is as good as a random one.
+        while (Entries.size () > 0 && (Entries.size () >= MaxEntries || Bytes + c > MaxBytes)) {
+            auto first = Entries.begin ();
+            Bytes -= cost (*first->second);
+            Entries.erase (first);
+        }
+        
+        Bytes += c;
+        return Entries.emplace (key, decoded).first->second;
+    }
+    
+    size_t bytecode_cache::size () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Entries.size ();
+    }
+    
+    size_t bytecode_cache::bytes_used () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Bytes;
+    }
+    
+    void bytecode_cache::clear () {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        Entries.clear ();
+        Bytes = 0;
+    }
+    
+    bytecode_cache &bytecode_cache::shared () {
+        static bytecode_cache Shared {};
+        return Shared;
+    }
+    
+}
@@ -2,8 +2,12 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/script/pattern.hpp>
+#include <gigamonkey/hex.hpp>
 #include <data/math/number/bytes/Z.hpp>
 
+#include <algorithm>
+#include <cctype>
+
 namespace Gigamonkey::Bitcoin {
     
     writer &operator << (writer &w, const instruction& i) {
@@ -11,7 +15,7 @@ namespace Gigamonkey::Bitcoin {
             if (i.Op <= OP_PUSHSIZE75) w << static_cast<byte> (i.Op);
             else if (i.Op == OP_PUSHDATA1) w << static_cast<byte> (OP_PUSHDATA1) << static_cast<byte> (i.Data.size ());
             else if (i.Op == OP_PUSHDATA2) w << static_cast<byte> (OP_PUSHDATA2) << static_cast<uint16_little> (i.Data.size ());
-            else w << static_cast<byte> (OP_PUSHDATA2) << static_cast<uint32_little> (i.Data.size ());
+            else w << static_cast<byte> (OP_PUSHDATA4) << static_cast<uint32_little> (i.Data.size ());
             return w << i.Data;
         }
         
@@ -54,7 +58,8 @@ namespace Gigamonkey::Bitcoin {
             }
             
             script_writer &operator << (program p) {
-                return p.size () == 0 ? *this : (*this << p.first () << p.rest ());
+                for (const instruction &i : p) *this << i;
+                return *this;
             }
             
             script_writer (bytes_writer &w) : Writer {w} {}
@@ -178,23 +183,164 @@ namespace Gigamonkey::Bitcoin {
         return 0; // invalid 
     }
     
-    std::ostream& write_asm (std::ostream& o, instruction i) {
-        if (i.Op == OP_0) return o << "0";
-        if (is_push_data (i.Op)) return o << data::encoding::hex::write (i.Data);
-        return o << i.Op;
+    namespace {
+        
+        bool is_name (op x) {
+            return x == OP_0 || (!is_push_data (x) && x < FIRST_UNDEFINED_OP_VALUE);
+        }
+        
+        // the name of each op code as ASM writes it, and the names that can be read.
+        struct ASM_names {
+            std::array<std::string_view, 256> Write;
+            std::vector<std::pair<std::string_view, op>> Read;
+            
+            ASM_names () : Write {}, Read {} {
+                // the names of OP_1 through OP_16 are not the same as those that GetOpName gives.
+                static const char *Numbers[] {"OP_0", "OP_1", "OP_2", "OP_3", "OP_4", "OP_5", "OP_6", "OP_7", "OP_8",
+                    "OP_9", "OP_10", "OP_11", "OP_12", "OP_13", "OP_14", "OP_15", "OP_16"};
+                
+                for (int i = 0; i < 256; i++) {
+                    op x = op (i);
+                    if (!is_name (x)) continue;
+                    Write[i] = x >= OP_1 && x <= OP_16 ? Numbers[x - OP_1 + 1] : GetOpName (x);
+                    
+                    // GetOpName writes OP_10 through OP_16 as numbers that are also hex, which are read as pushes.
+                    if (string_view {GetOpName (x)} != "OP_UNKNOWN" && (x < OP_10 || x > OP_16)) Read.emplace_back (GetOpName (x), x);
+                    if (x == OP_0 || (x >= OP_1 && x <= OP_16)) Read.emplace_back (Numbers[x == OP_0 ? 0 : x - OP_1 + 1], x);
+                }
+                
+                Read.emplace_back ("OP_1NEGATE", OP_1NEGATE);
+                Read.emplace_back ("OP_FALSE", OP_FALSE);
+                Read.emplace_back ("OP_TRUE", OP_TRUE);
+                std::sort (Read.begin (), Read.end ());
+            }
+            
+            maybe<op> read (string_view name) const {
+                auto x = std::lower_bound (Read.begin (), Read.end (), name, [] (const auto &entry, string_view n) {
+                    return entry.first < n;
+                });
+                
+                if (x == Read.end () || x->first != name) return {};
+                return x->second;
+            }
+        };
+        
+        const ASM_names &names () {
+            static const ASM_names Names {};
+            return Names;
+        }
+        
+        bool is_hex (string_view x) {
+            if (x.size () % 2 != 0) return false;
+            for (char c : x) if (!std::isxdigit (static_cast<unsigned char> (c))) return false;
+            return true;
+        }
+        
+        // write a minimal push of the data in some hex.
+        void read_push (bytes &b, string_view x) {
+            size_t size = x.size () / 2;
+            size_t header = size <= 0x4b ? 1 : size <= 0xff ? 2 : size <= 0xffff ? 3 : 5;
+            size_t at = b.size ();
+            b.resize (at + header + size);
+            
+            byte *h = b.data () + at;
+            if (header == 1) h[0] = byte (size);
+            else if (header == 2) {
+                h[0] = OP_PUSHDATA1;
+                h[1] = byte (size);
+            } else if (header == 3) {
+                h[0] = OP_PUSHDATA2;
+                boost::endian::store_little_u16 (h + 1, uint16 (size));
+            } else {
+                h[0] = OP_PUSHDATA4;
+                boost::endian::store_little_u32 (h + 1, uint32 (size));
+            }
+            
+            Gigamonkey::hex::read (h + header, x.data (), size);
+            
+            // small numbers have op codes of their own.
+            if (size == 1 && (h[1] == 0x81 || (h[1] >= 1 && h[1] <= 16))) {
+                h[0] = h[1] == 0x81 ? byte (OP_1NEGATE) : byte (h[1] + 0x50);
+                b.pop_back ();
+            }
+        }
+        
+    }
+    
+    // the same checks as decompilable, so that nothing is written for a script that decompile would not read.
+    void write_ASM (string &x, bytes_view b) {
+        const ASM_names &n = names ();
+        size_t begin = x.size ();
+        std::vector<op> control;
+        
+        for (const instruction_view &i : instructions {b}) {
+            if (i.Op == OP_INVALIDOPCODE || i.Op == OP_RESERVED || i.Op >= FIRST_UNDEFINED_OP_VALUE) {
+                x.resize (begin);
+                return;
+            }
+            
+            if (x.size () != begin) x.push_back (' ');
+            
+            if (i.Op == OP_0) x.push_back ('0');
+            else if (is_push_data (i.Op)) {
+                size_t at = x.size ();
+                x.resize (at + 2 * i.Data.size ());
+                Gigamonkey::hex::write (x.data () + at, i.Data.data (), i.Data.size ());
+            } else x += n.Write[i.Op];
+            
+            // the rest of the script is data, which is not written.
+            if (i.Op == OP_RETURN && control.empty ()) return;
+            
+            if (i.Op == OP_ENDIF) {
+                bool balanced = !control.empty ();
+                if (balanced && control.back () == OP_ELSE) {
+                    control.pop_back ();
+                    balanced = !control.empty ();
+                }
+                
+                if (!balanced || (control.back () != OP_IF && control.back () != OP_NOTIF)) {
+                    x.resize (begin);
+                    return;
+                }
+                
+                control.pop_back ();
+            } else if (i.Op == OP_ELSE || i.Op == OP_IF || i.Op == OP_NOTIF) control.push_back (i.Op);
+        }
     }
     
     string ASM (bytes_view b) {
-        std::stringstream ss;
-        program p = decompile (b);
-
-        if (p.size () != 0) {
-            auto i = p.begin ();
-            write_asm (ss, *i);
-            while (++i != p.end ()) write_asm (ss << " ", *i);
+        string x;
+        x.reserve (2 * b.size ());
+        write_ASM (x, b);
+        return x;
+    }
+    
+    bool read_ASM (string_view x, bytes &b) {
+        const ASM_names &n = names ();
+        b.clear ();
+        b.reserve (x.size () / 2);
+        
+        size_t i = 0;
+        while (true) {
+            while (i < x.size () && std::isspace (static_cast<unsigned char> (x[i]))) i++;
+            if (i == x.size ()) return true;
+            
+            size_t end = i;
+            while (end < x.size () && !std::isspace (static_cast<unsigned char> (x[end]))) end++;
+            string_view word = x.substr (i, end - i);
+            i = end;
+            
+            if (word == "0") b.push_back (OP_0);
+            else if (is_hex (word)) read_push (b, word);
+            else if (maybe<op> o = n.read (word); bool (o)) b.push_back (static_cast<byte> (*o));
+            else return false;
         }
-
-        return ss.str ();
+    }
+    
+    maybe<bytes> read_ASM (string_view x) {
+        bytes b;
+        if (!read_ASM (x, b)) return {};
+        return b;
     }
     
     bool is_minimal (bytes_view b) {
@@ -351,6 +497,64 @@ namespace Gigamonkey::Bitcoin {
         return p;
     }
     
+    bool decompilable (bytes_view b) {
+        std::vector<op> control;
+        
+        for (const instruction_view &i : instructions {b}) {
+            if (i.Op == OP_INVALIDOPCODE || i.Op == OP_RESERVED || i.Op >= FIRST_UNDEFINED_OP_VALUE) return false;
+            
+            // the rest of the script is data. 
+            if (i.Op == OP_RETURN && control.empty ()) return true;
+            
+            if (i.Op == OP_ENDIF) {
+                if (control.empty ()) return false;
+                op prev = control.back ();
+                control.pop_back ();
+                
+                if (prev == OP_ELSE) {
+                    if (control.empty ()) return false;
+                    prev = control.back ();
+                    control.pop_back ();
+                }
+                
+                if (prev != OP_IF && prev != OP_NOTIF) return false;
+            } else if (i.Op == OP_ELSE || i.Op == OP_IF || i.Op == OP_NOTIF) control.push_back (i.Op);
+        }
+        
+        return true;
+    }
+    
+    void instructions::iterator::read () {
+        if (Rest.size () == 0) {
+            Next = instruction_view {};
+            return;
+        }
+        
+        op o = op (Rest[0]);
+        if (!is_push_data (o)) {
+            Next = instruction_view {o, bytes_view {}, Rest.substr (0, 1)};
+            return;
+        }
+        
+        size_t header = o <= OP_PUSHSIZE75 ? 1 : o == OP_PUSHDATA1 ? 2 : o == OP_PUSHDATA2 ? 3 : 5;
+        if (Rest.size () < header) {
+            Next = instruction_view {OP_INVALIDOPCODE, bytes_view {}, Rest};
+            return;
+        }
+        
+        size_t size = o <= OP_PUSHSIZE75 ? size_t (o) :
+            o == OP_PUSHDATA1 ? size_t (Rest[1]) :
+            o == OP_PUSHDATA2 ? size_t (boost::endian::load_little_u16 (&Rest[1])) :
+            size_t (boost::endian::load_little_u32 (&Rest[1]));
+        
+        if (Rest.size () - header < size) {
+            Next = instruction_view {OP_INVALIDOPCODE, bytes_view {}, Rest};
+            return;
+        }
+        
+        Next = instruction_view {o, Rest.substr (header, size), Rest.substr (0, header + size)};
+    }
+    
     ScriptError valid_program (program p, stack<op> x, uint32 flags) {
         
         if (data::empty (p)) {
@@ -3,6 +3,7 @@
 
 #include <gigamonkey/script/machine.hpp>
 #include <gigamonkey/script/bitcoin_core.hpp>
+#include <gigamonkey/metrics.hpp>
 #include <sv/script/interpreter.h>
 #include <sv/script/script.h>
 #include <sv/script/script_num.h>
@@ -11,35 +12,133 @@
 #include <boost/scoped_ptr.hpp>
 #include <data/io/wait_for_enter.hpp>
 
+#include <array>
+#include <chrono>
+#include <optional>
+
 // not in use but required by config.h dependency
 bool fRequireStandard = true;
 
 namespace Gigamonkey::Bitcoin::interpreter { 
     
-    result verify_signature (bytes_view sig, bytes_view pub, const sighash::document &doc, uint32 flags) {
+    // The checks on a pubkey and a signature that come before the signature is verified.
+    ScriptError check_pubkey_encoding (bytes_view pub, uint32 flags) {
 
         if (flags & SCRIPT_VERIFY_COMPRESSED_PUBKEYTYPE && !secp256k1::pubkey::compressed (pub)) return SCRIPT_ERR_NONCOMPRESSED_PUBKEY;
         else if (flags & SCRIPT_VERIFY_STRICTENC && !secp256k1::pubkey::valid (pub)) return SCRIPT_ERR_PUBKEYTYPE;
 
+        return SCRIPT_ERR_OK;
+    }
+
+    // An empty signature passes, since it is how a script says that a signature is
+    // missing, and then fails verification. Otherwise, the signature is decoded
+    // once here for verification, in the same pass that checks its encoding.
+    ScriptError check_signature_encoding (bytes_view sig, uint32 flags, secp256k1::parsed_signature &parsed) {
+
+        if (sig.size () == 0) return SCRIPT_ERR_OK;
+
         auto d = signature::directive (sig);
-        auto raw = signature::raw (sig);
 
         if (!sighash::valid (d)) return SCRIPT_ERR_SIG_HASHTYPE;
         if (sighash::has_fork_id (d) && !(flags & SCRIPT_ENABLE_SIGHASH_FORKID)) return SCRIPT_ERR_ILLEGAL_FORKID;
         if (!sighash::has_fork_id (d) && (flags & SCRIPT_ENABLE_SIGHASH_FORKID)) return SCRIPT_ERR_MUST_USE_FORKID;
 
-        if ((flags & (SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_STRICTENC)) && !signature::DER (sig))
-            return SCRIPT_ERR_SIG_DER;
+        if (!(flags & (SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_STRICTENC))) {
+            parsed = secp256k1::parsed_signature {signature::raw (sig)};
+            return SCRIPT_ERR_OK;
+        }
 
-        if ((flags & SCRIPT_VERIFY_LOW_S) && !secp256k1::signature::normalized (raw)) return SCRIPT_ERR_SIG_HIGH_S;
+        parsed = secp256k1::parsed_signature::strict (signature::raw (sig));
+        if (!parsed.strict_DER ()) return SCRIPT_ERR_SIG_DER;
+        if ((flags & SCRIPT_VERIFY_LOW_S) && !parsed.low_S ()) return SCRIPT_ERR_SIG_HIGH_S;
 
-        if (signature::verify (sig, pub, doc)) return true;
+        return SCRIPT_ERR_OK;
+    }
+
+    result verify_signature (bytes_view sig, bytes_view pub, const sighash::document_view &doc, uint32 flags,
+        signature_cache *cache = nullptr, std::vector<signature_check> *deferred = nullptr) {
+
+        secp256k1::parsed_signature parsed {};
+        if (ScriptError err = check_pubkey_encoding (pub, flags); err != SCRIPT_ERR_OK) return err;
+        if (ScriptError err = check_signature_encoding (sig, flags, parsed); err != SCRIPT_ERR_OK) return err;
+        if (sig.size () == 0) return false;
+
+        auto d = signature::directive (sig);
+        auto raw = signature::raw (sig);
+
+        digest256 hash = signature::hash (doc, d);
+        
+        // with NULLFAIL, a bad signature is an error, so we can wait to check it. 
+        if (deferred != nullptr && flags & SCRIPT_VERIFY_NULLFAIL && sig.size () != 0) {
+            deferred->emplace_back (hash, pub, raw);
+            return true;
+        }
+
+        metrics::count (metrics::signatures);
+        metrics::stopwatch timing {metrics::signature_verify};
+        if (cache == nullptr ? secp256k1::parsed_pubkey {pub}.verify (hash, parsed) : cache->verify (hash, pub, raw, parsed)) return true;
 
         if (flags & SCRIPT_VERIFY_NULLFAIL && sig.size () != 0) return SCRIPT_ERR_SIG_NULLFAIL;
 
         return false;
     }
     
+    // OP_CHECKMULTISIG tries each key once, in order, against the next signature that
+    // has not matched yet, so a signature may be tried against many keys. Each signature
+    // is checked and decoded once, the sighash is computed once for each directive, and keys
+    // and signatures that can't be decoded fail without any elliptic curve operations.
+    // A pair that does not match is not an error; NULLFAIL is checked by the opcode
+    // once it knows whether all the signatures matched.
+    struct multisig_checker {
+        multisig_checker (const sighash::document_view &doc, uint32 flags, signature_cache *cache) :
+            Document {doc}, Flags {flags}, Cache {cache}, Hashes {}, Signature {}, Error {SCRIPT_ERR_OK}, Parsed {} {}
+
+        result check (bytes_view sig, bytes_view pub) {
+            if (ScriptError err = check_pubkey_encoding (pub, Flags); err != SCRIPT_ERR_OK) return err;
+
+            if (sig.data () != Signature.data () || sig.size () != Signature.size ()) {
+                Signature = sig;
+                Error = check_signature_encoding (sig, Flags, Parsed);
+            }
+
+            if (Error != SCRIPT_ERR_OK) return Error;
+            if (sig.size () == 0 || !Parsed.valid ()) return false;
+
+            secp256k1::parsed_pubkey key {pub};
+            if (!key.valid ()) return false;
+
+            bytes_view raw = signature::raw (sig);
+            const digest256 &hash = this->hash (signature::directive (sig));
+            if (Cache != nullptr && Cache->contains (hash, pub, raw)) return true;
+
+            metrics::count (metrics::signatures);
+            metrics::stopwatch timing {metrics::signature_verify};
+            if (!key.verify (hash, Parsed)) return false;
+
+            if (Cache != nullptr) Cache->insert (hash, pub, raw);
+            return true;
+        }
+
+    private:
+        sighash::document_view Document;
+        uint32 Flags;
+        signature_cache *Cache;
+
+        // there are only a few directives, so this need not be a map.
+        std::vector<std::pair<sighash::directive, digest256>> Hashes;
+
+        // the last signature that was checked, what was wrong with it and what it decoded to.
+        bytes_view Signature;
+        ScriptError Error;
+        secp256k1::parsed_signature Parsed;
+
+        const digest256 &hash (sighash::directive d) {
+            for (const auto &h : Hashes) if (h.first == d) return h.second;
+            Hashes.emplace_back (d, signature::hash (Document, d));
+            return Hashes.back ().second;
+        }
+    };
+
     list<bool> make_list (const std::vector<bool> &v) {
         list<bool> l;
         for (const bool &b : v) l << b;
@@ -65,20 +164,119 @@ namespace Gigamonkey::Bitcoin::interpreter {
         std::cout << "Result " << m.Result << std::endl;
     }
     
-    machine::state::state (uint32 flags, bool consensus, maybe<redemption_document> doc, const bytes &script) :
-        Flags {flags}, Consensus {consensus}, Config {}, Document {doc}, Script {script}, Counter {program_counter {Script}},
-        Stack {Config.GetMaxStackMemoryUsage (Flags & SCRIPT_UTXO_AFTER_GENESIS, consensus)},
-        AltStack {Stack.makeChildStack ()}, Exec {}, Else {}, OpCount {0} {}
+    machine::limits machine::limits::make (const script_config &config, uint32 flags, bool consensus) {
+        bool after_genesis = (flags & SCRIPT_UTXO_AFTER_GENESIS) != 0;
+        return limits {after_genesis, (flags & SCRIPT_VERIFY_MINIMALDATA) != 0,
+            config.GetMaxScriptNumLength (after_genesis, consensus),
+            config.GetMaxOpsPerScript (after_genesis, consensus),
+            config.GetMaxPubKeysPerMultiSig (after_genesis, consensus),
+            config.GetMaxStackMemoryUsage (after_genesis, consensus)};
+    }
+    
+    const machine::limits &machine::limits::get (uint32 flags, bool consensus) {
+        // only two flags matter, so there are eight possibilities.
+        static const std::array<limits, 8> Limits = [] () {
+            script_config config {};
+            std::array<limits, 8> x;
+            for (int i = 0; i < 8; i++) x[i] = make (config,
+                (i & 1 ? SCRIPT_UTXO_AFTER_GENESIS : 0) | (i & 2 ? SCRIPT_VERIFY_MINIMALDATA : 0), (i & 4) != 0);
+            return x;
+        } ();
+        
+        return Limits[((flags & SCRIPT_UTXO_AFTER_GENESIS) != 0) + 2 * ((flags & SCRIPT_VERIFY_MINIMALDATA) != 0) + 4 * consensus];
+    }
+    
+    machine::state::state (uint32 flags, bool consensus, maybe<redemption_document> doc, bytecode script) :
+        Flags {flags}, Consensus {consensus}, Config {}, Limits {&limits::get (flags, consensus)},
+        Document {doc}, Script {std::move (script)}, Counter {0}, LastCodeSeparator {0},
+        Stack {Limits->MaxStackMemoryUsage},
+        AltStack {Stack.makeChildStack ()}, Exec {}, Else {}, Unexecuted {0}, OpCount {0}, Cache {nullptr}, Defer {false}, Deferred {}, Standard {true}, Profile {nullptr},
+        Budget {}, Operations {0}, Elapsed {0} {}
+    
+    machine::state::state (const state &x) :
+        Flags {x.Flags}, Consensus {x.Consensus}, Config {x.Config}, Limits {x.Limits},
+        Document {x.Document}, Script {x.Script}, Counter {x.Counter}, LastCodeSeparator {x.LastCodeSeparator},
+        Stack {x.Limits->MaxStackMemoryUsage},
+        AltStack {Stack.makeChildStack ()}, Exec {x.Exec}, Else {x.Else}, Unexecuted {x.Unexecuted}, OpCount {x.OpCount},
+        Cache {x.Cache}, Defer {x.Defer}, Deferred {x.Deferred}, Standard {x.Standard}, Profile {x.Profile},
+        Budget {x.Budget}, Operations {x.Operations}, Elapsed {x.Elapsed} {
+        Stack.share (x.Stack);
+        AltStack.share (x.AltStack);
+    }
+    
+    void machine::state::reset (uint32 flags, maybe<redemption_document> doc, bytecode script) {
+        Flags = flags;
+        Limits = &limits::get (flags, Consensus);
+        Document = doc;
+        Script = std::move (script);
+        Counter = 0;
+        LastCodeSeparator = 0;
+        
+        // the alt stack is a child of the main stack, so it goes first.
+        AltStack.clear ();
+        Stack.clear ();
+        Stack.setMaxStackSize (Limits->MaxStackMemoryUsage);
+        
+        Exec.clear ();
+        Else.clear ();
+        Unexecuted = 0;
+        OpCount = 0;
+        Deferred.clear ();
+        
+        Operations = 0;
+        Elapsed = std::chrono::nanoseconds {0};
+    }
+    
+    result machine::state::finish (result r) {
+        if (!r.Success || r.Error) return r;
+        for (const signature_check &x : Deferred)
+            if (!(Cache == nullptr ? secp256k1::pubkey::verify (x.Pubkey, x.Hash, x.Signature) : Cache->verify (x)))
+                return SCRIPT_ERR_SIG_NULLFAIL;
+        Deferred.clear ();
+        return r;
+    }
     
     machine::machine (const script &unlock, const script &lock, const redemption_document &doc, uint32 flags) :
-        machine {{doc}, decompile (unlock), decompile (lock), flags} {}
+        machine {{doc}, bytecode {unlock}, bytecode {lock}, flags} {}
     
     machine::machine (const script &unlock, const script &lock, uint32 flags) :
-        machine {{}, decompile (unlock), decompile (lock), flags} {}
+        machine {{}, bytecode {unlock}, bytecode {lock}, flags} {}
+    
+    machine::machine (const script &unlock, const bytecode &lock, const redemption_document &doc, uint32 flags) :
+        machine {{doc}, bytecode {unlock}, lock, flags} {}
+    
+    machine::machine (const script &unlock, const bytecode &lock, uint32 flags) :
+        machine {{}, bytecode {unlock}, lock, flags} {}
+    
+    machine::machine (maybe<redemption_document> doc, const bytecode &unlock, const bytecode &lock, uint32 flags) :
+        Halt {false}, Result {false}, State {flags, false, doc, full (unlock, lock)} {
+        if (auto err = check_scripts (unlock, lock, State.Script, flags); err) {
+            Halt = true;
+            Result = err;
+        }
+    }
+    
+    void machine::reset (const script &unlock, const script &lock, const redemption_document &doc, uint32 flags) {
+        reset ({doc}, bytecode {unlock}, bytecode {lock}, flags);
+    }
+    
+    void machine::reset (const script &unlock, const script &lock, uint32 flags) {
+        reset ({}, bytecode {unlock}, bytecode {lock}, flags);
+    }
+    
+    void machine::reset (const script &unlock, const bytecode &lock, const redemption_document &doc, uint32 flags) {
+        reset ({doc}, bytecode {unlock}, lock, flags);
+    }
+    
+    void machine::reset (const script &unlock, const bytecode &lock, uint32 flags) {
+        reset ({}, bytecode {unlock}, lock, flags);
+    }
     
-    machine::machine (maybe<redemption_document> doc, const program unlock, const program lock, uint32 flags) :
-        Halt {false}, Result {false}, State {flags, false, doc, compile (full (unlock, lock))} {
-        if (auto err = check_scripts (unlock, lock, flags); err) {
+    void machine::reset (maybe<redemption_document> doc, const bytecode &unlock, const bytecode &lock, uint32 flags) {
+        Halt = false;
+        Result = false;
+        State.reset (flags, doc, full (unlock, lock));
+        if (auto err = check_scripts (unlock, lock, State.Script, flags); err) {
             Halt = true;
             Result = err;
         }
@@ -95,7 +293,151 @@ namespace Gigamonkey::Bitcoin::interpreter {
         }
     }
     
-    result catch_all_errors (result (*fn) (machine::state &), machine::state &x) {
+    // the step after the last operation only checks the final stack, so it is not recorded.
+    result state_step_profiled (machine::state &x) {
+        if (x.Counter >= x.Script.size ()) return x.step ();
+        
+        op o = x.Script.Operations[x.Counter].Op;
+        uint64 before = x.Stack.getCombinedStackSize ();
+        auto start = std::chrono::steady_clock::now ();
+        
+        // the operation is recorded even if it throws.
+        struct recorder {
+            machine::state &State;
+            op Op;
+            uint64 Before;
+            std::chrono::steady_clock::time_point Start;
+            
+            ~recorder () {
+                State.Profile->record (Op, std::chrono::duration_cast<std::chrono::nanoseconds>
+                    (std::chrono::steady_clock::now () - Start).count (), Before, State.Stack.getCombinedStackSize ());
+            }
+        } r {x, o, before, start};
+        
+        return x.step ();
+    }
+    
+    result state_run_profiled (machine::state &x) {
+        while (true) {
+            auto err = state_step_profiled (x);
+            if (err.Error || err.Success) return err;
+        }
+    }
+    
+    // run with the budget for no more than max_steps operations, or without
+    // end if max_steps is zero. Paused is set if we stopped without finishing.
+    result state_run_limited (machine::state &x, uint64 max_steps, bool &paused) {
+        using clock = std::chrono::steady_clock;
+        const machine::budget &b = x.Budget;
+        
+        // the clock is only read every so often because that is not free.
+        constexpr uint64 clock_interval = 64;
+        
+        auto start = clock::now ();
+        struct timer {
+            machine::state &State;
+            clock::time_point Start;
+            
+            ~timer () {
+                State.Elapsed += std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now () - Start);
+            }
+        } t {x, start};
+        
+        for (uint64 steps = 0; ; steps++) {
+            if (max_steps != 0 && steps == max_steps) {
+                paused = true;
+                return false;
+            }
+            
+            if (x.Counter < x.Script.size ()) {
+                if (b.Operations != 0 && x.Operations == b.Operations) return SCRIPT_ERR_BUDGET_EXCEEDED;
+                
+                if (b.Time.count () != 0 && x.Operations % clock_interval == 0 &&
+                    x.Elapsed + (clock::now () - start) > b.Time) return SCRIPT_ERR_BUDGET_EXCEEDED;
+                
+                x.Operations++;
+            }
+            
+            auto err = x.Profile != nullptr ? state_step_profiled (x) : x.step ();
+            
+            if (b.StackBytes != 0 && x.Stack.getCombinedStackSize () > b.StackBytes) return SCRIPT_ERR_BUDGET_EXCEEDED;
+            
+            if (err.Error || err.Success) return err;
+        }
+    }
+    
+    bytes_view inline cleanup_script_code (bytes_view script_code, bytes_view sig, bytes &scratch);
+    
+    // the parts of a script that are used by the specialized functions. 
+    bool is_standard_push (const bytecode::operation &x) {
+        return is_push_data (x.Op) && x.Size <= MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS;
+    }
+    
+    bool is_pubkey_hash_push (const bytecode::operation &x) {
+        return x.Op == OP_PUSHSIZE20 && x.Size == 21;
+    }
+    
+    // the unlocking and locking scripts are joined, so we look for them with the 
+    // OP_CODESEPARATOR between them. These scripts are small enough that no limits 
+    // apply, so they can only fail at OP_EQUALVERIFY or OP_CHECKSIG. 
+    bool is_P2PKH (const bytecode &b) {
+        const auto &o = b.Operations;
+        return o.size () == 8 && is_standard_push (o[0]) && is_standard_push (o[1]) &&
+            o[2].Op == OP_CODESEPARATOR && o[3].Op == OP_DUP && o[4].Op == OP_HASH160 &&
+            is_pubkey_hash_push (o[5]) && o[6].Op == OP_EQUALVERIFY && o[7].Op == OP_CHECKSIG;
+    }
+    
+    bool is_P2PK (const bytecode &b) {
+        const auto &o = b.Operations;
+        return o.size () == 4 && is_standard_push (o[0]) && o[1].Op == OP_CODESEPARATOR &&
+            is_standard_push (o[2]) && o[3].Op == OP_CHECKSIG;
+    }
+    
+    bool inline is_standard (const bytecode &b) {
+        return is_P2PKH (b) || is_P2PK (b);
+    }
+    
+    // the same as OP_CHECKSIG as the last instruction of the script. The stack 
+    // is left with the result of the check on it, as the general interpreter would 
+    // leave it, and a check that fails without an error fails the script. 
+    result standard_checksig (machine::state &x, uint32 code_separator, bytes_view sig, bytes_view pub) {
+        x.LastCodeSeparator = x.Script.Operations[code_separator].Offset + 1;
+        x.Counter = x.Script.size ();
+        
+        bytes scratch;
+        result r = bool (x.Document) ?
+            result {verify_signature
+                (sig, pub, x.Document->view (cleanup_script_code (x.script_code (), sig, scratch)), x.Flags,
+                    x.Cache, x.Defer ? &x.Deferred : nullptr)} :
+            result {true};
+        
+        if (r.Error) return r.Error;
+        
+        x.Stack.push_back (r.Success ? element (1, 1) : element (0));
+        if (!r.Success) return SCRIPT_ERR_EVAL_FALSE;
+        return true;
+    }
+    
+    result state_run_standard (machine::state &x) {
+        if (is_P2PKH (x.Script)) {
+            bytes sig = x.Script.data (0);
+            bytes pub = x.Script.data (1);
+            bytes hash = x.Script.data (5);
+            digest160 pubkey_hash = Hash160 (pub);
+            if (!std::equal (hash.begin (), hash.end (), pubkey_hash.begin ())) {
+                x.Counter = 6;
+                return SCRIPT_ERR_EQUALVERIFY;
+            }
+            
+            return standard_checksig (x, 2, sig, pub);
+        }
+        
+        if (is_P2PK (x.Script)) return standard_checksig (x, 1, x.Script.data (0), x.Script.data (2));
+        
+        return state_run (x);
+    }
+    
+    template <typename F> result catch_all_errors (F fn, machine::state &x) {
         try {
             return fn (x);
         } catch (scriptnum_overflow_error &err) {
@@ -114,25 +456,55 @@ namespace Gigamonkey::Bitcoin::interpreter {
     }
     
     void machine::step () {
+        if (!State.Budget.unlimited ()) {
+            advance (1);
+            return;
+        }
+        
         if (Halt) return;
-        auto err = catch_all_errors (state_step, State);
+        if (State.Profile != nullptr && State.Counter == 0) State.Profile->Scripts++;
+        auto err = catch_all_errors (State.Profile != nullptr ? state_step_profiled : state_step, State);
         if (err.Error || err.Success) {
             Halt = true;
-            Result = err;
+            Result = State.finish (err);
         }
     }
     
+    bool machine::advance (uint64 steps) {
+        if (Halt) return true;
+        if (State.Profile != nullptr && State.Counter == 0) State.Profile->Scripts++;
+        
+        bool paused = false;
+        auto err = catch_all_errors ([steps, &paused] (machine::state &x) {
+            return state_run_limited (x, steps, paused);
+        }, State);
+        
+        if (paused && !err.Error) return false;
+        
+        Halt = true;
+        Result = State.finish (err);
+        return true;
+    }
+    
     result machine::run () {
-        Result = catch_all_errors (state_run, State);
+        if (Halt) return Result;
+        metrics::count (metrics::scripts);
+        metrics::stopwatch timing {metrics::script_run};
+        
+        // standard scripts are too small for the budget to matter.
+        if (!State.Budget.unlimited () && !(State.Standard && State.Counter == 0 && State.Profile == nullptr && is_standard (State.Script))) {
+            advance (0);
+            return Result;
+        }
+        
+        if (State.Profile != nullptr) {
+            if (State.Counter == 0) State.Profile->Scripts++;
+            Result = State.finish (catch_all_errors (state_run_profiled, State));
+        } else Result = State.finish (catch_all_errors (State.Standard && State.Counter == 0 ? state_run_standard : state_run, State));
         Halt = true;
         return Result;
     }
     
-    bool inline IsValidMaxOpsPerScript
-        (uint64_t nOpCount, const script_config &config, bool isGenesisEnabled, bool consensus) {
-        return (nOpCount <= config.GetMaxOpsPerScript (isGenesisEnabled, consensus));
-    }
-
     static bool IsOpcodeDisabled (opcodetype opcode) {
         switch (opcode) {
             case OP_2MUL:
@@ -147,14 +519,82 @@ namespace Gigamonkey::Bitcoin::interpreter {
         return false;
     }
     
-    bytes inline cleanup_script_code (bytes_view script_code, bytes_view sig) {
-        return sighash::has_fork_id (signature::directive (sig)) ?
-            bytes (script_code) :
-            find_and_delete (script_code, compile (instruction::push (sig)));
+    bool inline IsInvalidBranchingOpcode (opcodetype opcode) {
+        return opcode == OP_VERNOTIF || opcode == OP_VERIF;
+    }
+    
+    // After genesis, CScriptNum uses bint for every number. Numbers of up to 8 bytes
+    // fit in an int64, so we do arithmetic on them directly and only use bint if 
+    // the result overflows. Numbers are checked in the same way as in CScriptNum. 
+    bool read_small_number (const element &e, bool require_minimal, size_t max_size, int64_t &n) {
+        if (e.size () > 8) return false;
+        
+        if (e.size () > max_size) throw scriptnum_overflow_error ("script number overflow");
+        
+        if (require_minimal && !bsv::IsMinimallyEncoded (e, max_size))
+            throw scriptnum_minencode_error ("non-minimally encoded script number");
+        
+        n = e.empty () ? 0 : bsv::deserialize<int64_t> (e.begin (), e.end ());
+        return true;
+    }
+    
+    // the same encoding as CScriptNum::getvch.
+    void push_small_number (LimitedStack<element> &stack, int64_t n) {
+        std::array<byte, 9> b;
+        size_t size = 0;
+        
+        for (uint64_t x = bsv::abs (n); x != 0; x >>= 8) b[size++] = x & 0xff;
+        
+        if (size > 0) {
+            if (b[size - 1] & 0x80) b[size++] = n < 0 ? 0x80 : 0;
+            else if (n < 0) b[size - 1] |= 0x80;
+        }
+        
+        stack.push (bytes_view {b.data (), size});
+    }
+    
+    // return false if the result does not fit in an int64. 
+    bool small_unary (op o, int64_t &n) {
+        switch (o) {
+            case OP_1ADD: return !__builtin_add_overflow (n, 1, &n);
+            case OP_1SUB: return !__builtin_sub_overflow (n, 1, &n);
+            case OP_NEGATE: n = -n; return true;
+            case OP_ABS: if (n < 0) n = -n; return true;
+            case OP_NOT: n = n == 0; return true;
+            case OP_0NOTEQUAL: n = n != 0; return true;
+            default: return false;
+        }
+    }
+    
+    // division by zero is checked before this is called. 
+    bool small_binary (op o, int64_t a, int64_t b, int64_t &n) {
+        switch (o) {
+            case OP_ADD: return !__builtin_add_overflow (a, b, &n);
+            case OP_SUB: return !__builtin_sub_overflow (a, b, &n);
+            case OP_MUL: return !__builtin_mul_overflow (a, b, &n);
+            case OP_DIV: n = a / b; return true;
+            case OP_MOD: n = a % b; return true;
+            case OP_BOOLAND: n = a != 0 && b != 0; return true;
+            case OP_BOOLOR: n = a != 0 || b != 0; return true;
+            case OP_NUMEQUAL:
+            case OP_NUMEQUALVERIFY: n = a == b; return true;
+            case OP_NUMNOTEQUAL: n = a != b; return true;
+            case OP_LESSTHAN: n = a < b; return true;
+            case OP_GREATERTHAN: n = a > b; return true;
+            case OP_LESSTHANOREQUAL: n = a <= b; return true;
+            case OP_GREATERTHANOREQUAL: n = a >= b; return true;
+            case OP_MIN: n = a < b ? a : b; return true;
+            case OP_MAX: n = a > b ? a : b; return true;
+            default: return false;
+        }
     }
     
-    sighash::document *add_script_code (redemption_document &doc, bytes_view script_code) {
-        return new sighash::document (doc.RedeemedValue, script_code, doc.Transaction, doc.InputIndex);
+    // Signatures without fork id are removed from the script code. Otherwise
+    // it is not changed and not copied. If it is changed, it goes in scratch.
+    bytes_view inline cleanup_script_code (bytes_view script_code, bytes_view sig, bytes &scratch) {
+        if (sighash::has_fork_id (signature::directive (sig))) return script_code;
+        scratch = find_and_delete (script_code, compile (instruction::push (sig)));
+        return scratch;
     }
 
     bool CastToBool (const valtype &vch) {
@@ -186,39 +626,47 @@ namespace Gigamonkey::Bitcoin::interpreter {
     
     result machine::state::step () {
     
-        const bool utxo_after_genesis {(Flags & SCRIPT_UTXO_AFTER_GENESIS) != 0};
-        const uint64_t maxScriptNumLength = Config.GetMaxScriptNumLength (utxo_after_genesis, Consensus);
-        const bool fRequireMinimal = (Flags & SCRIPT_VERIFY_MINIMALDATA) != 0;
+        const bool utxo_after_genesis = Limits->UTXOAfterGenesis;
+        const uint64_t maxScriptNumLength = Limits->MaxScriptNumLength;
+        const bool fRequireMinimal = Limits->RequireMinimal;
         
         // this will always be valid because we've already checked for invalid op codes. 
-        //bytes_view next = Counter.next_instruction();
-        
-        if (Counter.Next == bytes_view {}) {
+        // the script succeeds if it leaves true on the top of the stack. 
+        if (Counter >= Script.size ()) {
+            if (Stack.empty () || !CastToBool (Stack.stacktop (-1).GetElement ())) return SCRIPT_ERR_EVAL_FALSE;
             if ((Flags & SCRIPT_VERIFY_CLEANSTACK) != 0 && Stack.size () != 1) return SCRIPT_ERR_CLEANSTACK;
             return true;
         }
         
-        op Op = op (Counter.Next[0]);
+        const bytecode::operation &Next = Script.Operations[Counter];
+        bytes_view next_instruction = Script[Counter];
+        op Op = Next.Op;
         
         // Check opcode limits.
         //
         // Push values are not taken into consideration.
         // Note how OP_RESERVED does not count towards the opcode limit.
-        if ((Op > OP_16) && !IsValidMaxOpsPerScript (++OpCount, Config, utxo_after_genesis, Consensus))
+        if ((Op > OP_16) && uint64 (++OpCount) > Limits->MaxOpsPerScript)
             return SCRIPT_ERR_OP_COUNT;
 
-        if (!utxo_after_genesis && (Counter.Next.size () - 1 > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS))
+        if (!utxo_after_genesis && (Next.Size - 1 > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS))
             return SCRIPT_ERR_PUSH_SIZE;
         
-        // whether this op code will be executed. 
-        bool executed = !count (Exec.begin (), Exec.end (), false);
-        if (!executed) return SCRIPT_ERR_OK;
+        // whether this op code will be executed. Branches that are not taken are 
+        // normally jumped over, so this only happens if a conditional is not closed. 
+        bool executed = Unexecuted == 0;
 
         // Some opcodes are disabled.
-        if (IsOpcodeDisabled (Op) && (!utxo_after_genesis || executed ))
+        if (IsOpcodeDisabled (Op) && (!utxo_after_genesis || executed))
             return SCRIPT_ERR_DISABLED_OPCODE;
         
-        if (executed && 0 <= Op && Op <= OP_PUSHDATA4) Stack.push_back (get_push_data (Counter.Next));
+        if (!executed && Op != OP_IF && Op != OP_NOTIF && Op != OP_ELSE && Op != OP_ENDIF) {
+            if (IsInvalidBranchingOpcode (Op) && !utxo_after_genesis) return SCRIPT_ERR_BAD_OPCODE;
+            Counter++;
+            return SCRIPT_ERR_OK;
+        }
+        
+        if (0 <= Op && Op <= OP_PUSHDATA4) Stack.push (get_push_data (next_instruction));
         else switch (Op) {
             //
             // Push value
@@ -345,9 +793,58 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 
             } break;
             
+            case OP_IF:
+            case OP_NOTIF: {
+                // <expression> if [statements] [else [statements]] endif
+                bool value = false;
+                if (executed) {
+                    if (Stack.size () < 1) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                    
+                    const auto &top = Stack.stacktop (-1);
+                    if (Flags & SCRIPT_VERIFY_MINIMALIF) {
+                        if (top.size () > 1) return SCRIPT_ERR_MINIMALIF;
+                        if (top.size () == 1 && top[0] != 1) return SCRIPT_ERR_MINIMALIF;
+                    }
+                    
+                    value = CastToBool (top.GetElement ());
+                    if (Op == OP_NOTIF) value = !value;
+                    
+                    Stack.pop_back ();
+                }
+                
+                Exec.push_back (value);
+                Else.push_back (false);
+                
+                if (!value && ++Unexecuted == 1) return jump (Next.Jump);
+            } break;
+            
+            case OP_ELSE: {
+                // Only one ELSE is allowed in IF after genesis.
+                if (Exec.empty () || (Else.back () && utxo_after_genesis)) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                
+                Exec.back () = !Exec.back ();
+                Else.back () = true;
+                
+                if (Exec.back ()) Unexecuted--;
+                else if (++Unexecuted == 1) return jump (Next.Jump);
+            } break;
+            
+            case OP_ENDIF: {
+                if (Exec.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                
+                if (!Exec.back ()) Unexecuted--;
+                
+                Exec.pop_back ();
+                Else.pop_back ();
+            } break;
+            
             case OP_RETURN: {
                 if (utxo_after_genesis) {
-                    if (Exec.empty ()) return true;
+                    // the rest of the script is skipped and the stack is checked as at the end. 
+                    if (Exec.empty ()) {
+                        Counter = Script.size ();
+                        return step ();
+                    }
                     // Pre-Genesis OP_RETURN marks script as invalid
                 } else return SCRIPT_ERR_OP_RETURN;
             } break;
@@ -544,6 +1041,39 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 
             } break;
 
+            //
+            // Byte string operations
+            //
+            case OP_CAT: {
+                // (x1 x2 -- out)
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                
+                if (!utxo_after_genesis &&
+                    (Stack.stacktop (-2).size () + Stack.stacktop (-1).size () > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS))
+                    return SCRIPT_ERR_PUSH_SIZE;
+                
+                Stack.cat ();
+                
+            } break;
+
+            case OP_SPLIT: {
+                // (in position -- x1 x2)
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                
+                const CScriptNum n {
+                    Stack.stacktop (-1).GetElement (), fRequireMinimal,
+                    maxScriptNumLength,
+                    utxo_after_genesis};
+                
+                if (n < 0 || n > Stack.stacktop (-2).size ())
+                    return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                
+                const auto position {n.to_size_t_limited ()};
+                Stack.pop_back ();
+                Stack.split (position);
+                
+            } break;
+
             //
             // Bitwise logic
             //
@@ -627,6 +1157,14 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
                 const auto &top {Stack.stacktop (-1).GetElement ()};
+                
+                int64_t n;
+                if (utxo_after_genesis && read_small_number (top, fRequireMinimal, maxScriptNumLength, n) && small_unary (Op, n)) {
+                    Stack.pop_back ();
+                    push_small_number (Stack, n);
+                    break;
+                }
+                
                 CScriptNum bn {top, fRequireMinimal, maxScriptNumLength, utxo_after_genesis};
                 
                 switch (Op) {
@@ -675,10 +1213,29 @@ namespace Gigamonkey::Bitcoin::interpreter {
             case OP_MIN:
             case OP_MAX: {
                 // (x1 x2 -- out)
-                if (Stack.size () < 2) SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
                 const auto& arg_2 = Stack.stacktop (-2);
                 const auto& arg_1 = Stack.stacktop (-1);
+                
+                int64_t a, b, n;
+                if (utxo_after_genesis &&
+                    read_small_number (arg_2.GetElement (), fRequireMinimal, maxScriptNumLength, a) &&
+                    read_small_number (arg_1.GetElement (), fRequireMinimal, maxScriptNumLength, b)) {
+                    if (Op == OP_DIV && b == 0) return SCRIPT_ERR_DIV_BY_ZERO;
+                    if (Op == OP_MOD && b == 0) return SCRIPT_ERR_MOD_BY_ZERO;
+                    
+                    if (small_binary (Op, a, b, n)) {
+                        Stack.pop_back ();
+                        Stack.pop_back ();
+                        
+                        if (Op == OP_NUMEQUALVERIFY) {
+                            if (n == 0) return SCRIPT_ERR_NUMEQUALVERIFY;
+                        } else push_small_number (Stack, n);
+                        
+                        break;
+                    }
+                }
 
                 CScriptNum bn1 (arg_2.GetElement (), fRequireMinimal,
                                 maxScriptNumLength,
@@ -766,6 +1323,20 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 if (Stack.size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
                 const auto& top_3 {Stack.stacktop (-3).GetElement ()};
+                
+                int64_t x, lower, upper;
+                if (utxo_after_genesis &&
+                    read_small_number (top_3, fRequireMinimal, maxScriptNumLength, x) &&
+                    read_small_number (Stack.stacktop (-2).GetElement (), fRequireMinimal, maxScriptNumLength, lower) &&
+                    read_small_number (Stack.stacktop (-1).GetElement (), fRequireMinimal, maxScriptNumLength, upper)) {
+                    Stack.pop_back ();
+                    Stack.pop_back ();
+                    Stack.pop_back ();
+                    
+                    Stack.push_back (script_bool (lower <= x && x < upper));
+                    break;
+                }
+                
                 const CScriptNum bn1 {
                     top_3, fRequireMinimal,
                     maxScriptNumLength,
@@ -819,25 +1390,24 @@ namespace Gigamonkey::Bitcoin::interpreter {
                         .Write (vch.GetElement ().data (), vch.size ())
                         .Finalize (vchHash.data ());
                 } else if (Op == OP_SHA256) {
-                    CSHA256 ()
+                    sha256::hasher ()
                         .Write (vch.GetElement ().data (), vch.size ())
                         .Finalize (vchHash.data ());
                 } else if (Op == OP_HASH160) {
-                    CHash160 ()
-                        .Write (vch.GetElement ().data (), vch.size ())
-                        .Finalize(vchHash.data ());
+                    digest160 d = Bitcoin::Hash160 (bytes_view {vch.GetElement ().data (), vch.size ()});
+                    std::copy (d.begin (), d.end (), vchHash.begin ());
                 } else if (Op == OP_HASH256) {
-                    CHash256 ()
-                        .Write (vch.GetElement ().data (), vch.size ())
-                        .Finalize (vchHash.data ());
+                    digest256 d = Bitcoin::Hash256 (bytes_view {vch.GetElement ().data (), vch.size ()});
+                    std::copy (d.begin (), d.end (), vchHash.begin ());
                 }
 
                 Stack.pop_back ();
                 Stack.push_back (vchHash);
             } break;
             
-            // we take care of this elsewhere. 
-            case OP_CODESEPARATOR: break;
+            case OP_CODESEPARATOR: {
+                LastCodeSeparator = Next.Offset + Next.Size;
+            } break;
             
             case OP_CHECKSIG: 
             case OP_CHECKSIGVERIFY: {
@@ -846,9 +1416,11 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 const element &sig = Stack.stacktop (-2).GetElement ();
                 const element &pub = Stack.stacktop (-1).GetElement ();
                 
+                bytes scratch;
                 result r = bool (Document) ?
                     result {verify_signature
-                        (sig, pub, Document->add_script_code (cleanup_script_code (Counter.script_code (), sig)), Flags)} :
+                        (sig, pub, Document->view (cleanup_script_code (script_code (), sig, scratch)), Flags,
+                            Cache, Defer ? &Deferred : nullptr)} :
                     result {true};
                 
                 if (r.Error) return r.Error;
@@ -882,11 +1454,11 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 if (nKeysCountSigned < 0) return SCRIPT_ERR_PUBKEY_COUNT;
                 
                 uint64_t nKeysCount = static_cast<uint64_t> (nKeysCountSigned);
-                if (nKeysCount > Config.GetMaxPubKeysPerMultiSig (utxo_after_genesis, Consensus))
+                if (nKeysCount > Limits->MaxPubKeysPerMultiSig)
                     return SCRIPT_ERR_PUBKEY_COUNT;
                 
                 OpCount += nKeysCount;
-                if (!IsValidMaxOpsPerScript (OpCount, Config, utxo_after_genesis, Consensus))
+                if (uint64 (OpCount) > Limits->MaxOpsPerScript)
                     return SCRIPT_ERR_OP_COUNT;
                 
                 uint64_t ikey = ++i;
@@ -910,16 +1482,15 @@ namespace Gigamonkey::Bitcoin::interpreter {
                 i += nSigsCount;
                 if (Stack.size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                sighash::document *doc = nullptr;
-                if (bool (Document)) {
-                    bytes script_code = Counter.script_code ();
-                    
-                    // Remove signature for pre-fork scripts
-                    for (auto it = Stack.begin () + 1; it != Stack.begin () + 1 + nSigsCount; it++)
-                        script_code = cleanup_script_code (script_code, it->GetElement ());
-                    
-                    doc = add_script_code (*Document, script_code);
-                }
+                bytes scratch;
+                bytes_view script_code = this->script_code ();
+                
+                // Remove signature for pre-fork scripts
+                if (bool (Document)) for (auto it = Stack.begin () + 1; it != Stack.begin () + 1 + nSigsCount; it++)
+                    script_code = cleanup_script_code (script_code, it->GetElement (), scratch);
+                
+                std::optional<multisig_checker> checker;
+                if (bool (Document)) checker.emplace (Document->view (script_code), Flags, Cache);
                 
                 bool fSuccess = true;
                 while (fSuccess && nSigsCount > 0) {
@@ -933,7 +1504,7 @@ namespace Gigamonkey::Bitcoin::interpreter {
                     // See the script_(in)valid tests for details.
                     // Check signature
                     
-                    result r = (doc == nullptr) ? result {true} : result {verify_signature (sig, pub, *doc, Flags)};
+                    result r = bool (checker) ? checker->check (sig, pub) : result {true};
                     
                     if (r.Error) return r.Error;
                     
@@ -952,8 +1523,6 @@ namespace Gigamonkey::Bitcoin::interpreter {
                     
                 }
                 
-                delete doc;
-                
                 // Clean up stack of actual arguments
                 while (i-- > 1) {
                     // If the operation failed, we require that all
@@ -995,12 +1564,17 @@ namespace Gigamonkey::Bitcoin::interpreter {
             default: {
                 ScriptError err;
                 
+                // everything in Exec is true here, so EvalScript 
+                // does not need to look at it. 
+                cross<bool> exec {};
+                cross<bool> other {};
+                
                 long count;
                 maybe<bool> result = EvalScript (
                     Config, Consensus, 
-                    Stack, CScript (Counter.Next.begin (), Counter.Next.end ()), Flags,
+                    Stack, CScript (next_instruction.begin (), next_instruction.end ()), Flags,
                     AltStack, count,
-                    Exec, Else, &err);
+                    exec, other, &err);
                 
                 if (err) return err;
                 
@@ -1011,10 +1585,31 @@ namespace Gigamonkey::Bitcoin::interpreter {
         if (!utxo_after_genesis && (Stack.size () + AltStack.size () > MAX_STACK_ELEMENTS_BEFORE_GENESIS))
             return SCRIPT_ERR_STACK_SIZE;
         
-        Counter = Counter.next ();
+        Counter++;
         
         return SCRIPT_ERR_OK;
         
     }
     
+    // jump over a branch that will not be executed. 
+    result machine::state::jump (uint32 to) {
+        const bool utxo_after_genesis = Limits->UTXOAfterGenesis;
+        
+        for (uint32 i = Counter + 1; i < to; i++) {
+            const bytecode::operation &skipped = Script.Operations[i];
+            
+            if ((skipped.Op > OP_16) && uint64 (++OpCount) > Limits->MaxOpsPerScript)
+                return SCRIPT_ERR_OP_COUNT;
+            
+            if (!utxo_after_genesis && (skipped.Size - 1 > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS))
+                return SCRIPT_ERR_PUSH_SIZE;
+            
+            if (!utxo_after_genesis && (IsOpcodeDisabled (skipped.Op) || IsInvalidBranchingOpcode (skipped.Op)))
+                return IsOpcodeDisabled (skipped.Op) ? SCRIPT_ERR_DISABLED_OPCODE : SCRIPT_ERR_BAD_OPCODE;
+        }
+        
+        Counter = to;
+        return SCRIPT_ERR_OK;
+    }
+    
 }
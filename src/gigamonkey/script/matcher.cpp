@@ -0,0 +1,289 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/matcher.hpp>
+#include <gigamonkey/script/pattern.hpp>
+
+#include <algorithm>
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        // the data pushed by OP_1NEGATE and OP_1 through OP_16.
+        constexpr byte small_numbers[] {0x81, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+        
+        // the size of the instruction at the front of b and the data that
+        // it pushes, or 0 if it cannot be read.
+        size_t read_instruction (bytes_view b, bytes_view &data) {
+            Bitcoin::op o = Bitcoin::op (b[0]);
+            data = bytes_view {};
+            
+            if (o == OP_INVALIDOPCODE) return 0;
+            
+            if (!Bitcoin::is_push_data (o)) {
+                if (o == OP_1NEGATE) data = bytes_view {small_numbers, 1};
+                else if (o >= OP_1 && o <= OP_16) data = bytes_view {small_numbers + (o - OP_1 + 1), 1};
+                return 1;
+            }
+            
+            size_t header = o <= Bitcoin::OP_PUSHSIZE75 ? 1 : o == OP_PUSHDATA1 ? 2 : o == OP_PUSHDATA2 ? 3 : 5;
+            if (b.size () < header) return 0;
+            
+            size_t size = o <= Bitcoin::OP_PUSHSIZE75 ? size_t (o) :
+                o == OP_PUSHDATA1 ? size_t (b[1]) :
+                o == OP_PUSHDATA2 ? size_t (boost::endian::load_little_u16 (&b[1])) :
+                size_t (boost::endian::load_little_u32 (&b[1]));
+            
+            if (b.size () - header < size) return 0;
+            data = b.substr (header, size);
+            return header + size;
+        }
+        
+        // whether x is the same number as the minimally-encoded number m.
+        bool equal_number (bytes_view x, bytes_view m) {
+            // find the last byte of the magnitude that is not zero.
+            size_t last = x.size ();
+            while (last > 0 && (last == x.size () ? x[last - 1] & 0x7f : x[last - 1]) == 0) last--;
+            
+            if (last == 0) return m.size () == 0;
+            
+            bool negative = x.back () & 0x80;
+            byte top = last == x.size () ? x[last - 1] & 0x7f : x[last - 1];
+            size_t size = top & 0x80 ? last + 1 : last;
+            
+            if (m.size () != size) return false;
+            if (!std::equal (x.begin (), x.begin () + last - 1, m.begin ())) return false;
+            
+            if (top & 0x80) return m[last - 1] == top && m[last] == (negative ? 0x80 : 0);
+            return m[last - 1] == (negative ? top | 0x80 : top);
+        }
+        
+        // the minimal encoding of the number x.
+        bytes minimal_number (bytes_view x) {
+            size_t last = x.size ();
+            while (last > 0 && (last == x.size () ? x[last - 1] & 0x7f : x[last - 1]) == 0) last--;
+            
+            if (last == 0) return {};
+            
+            bytes m (x.substr (0, last));
+            bool negative = x.back () & 0x80;
+            if (last == x.size ()) m.back () &= 0x7f;
+            if (m.back () & 0x80) m.push_back (negative ? 0x80 : 0);
+            else if (negative) m.back () |= 0x80;
+            return m;
+        }
+        
+        // choices are kept on the stack unless there are too many of them.
+        constexpr size_t max_local_depth = 32;
+        
+        struct backtrack {
+            uint32 Step;
+            uint32 Position;
+        };
+        
+    }
+    
+    matcher::matcher (const pattern &p) : Steps {}, Pool {}, Captures {0}, Depth {0}, Open {0}, First {} {
+        p.compile (*this);
+        find_first ();
+    }
+    
+    int32 matcher::capture (bool c) {
+        return c ? int32 (Captures++) : -1;
+    }
+    
+    void matcher::literal (bytes_view b) {
+        Steps.push_back (step {kind::literal, -1, uint32 (Pool.size ()), uint32 (b.size ())});
+        Pool.insert (Pool.end (), b.begin (), b.end ());
+    }
+    
+    void matcher::any () {
+        Steps.push_back (step {kind::any, -1, 0, 0});
+    }
+    
+    void matcher::push (kind k, bytes_view operand, bool c) {
+        bytes number;
+        if (k == kind::push_value) {
+            number = minimal_number (operand);
+            operand = number;
+        }
+        
+        Steps.push_back (step {k, capture (c), uint32 (Pool.size ()), uint32 (operand.size ())});
+        Pool.insert (Pool.end (), operand.begin (), operand.end ());
+    }
+    
+    void matcher::push_size (size_t size, bool c) {
+        Steps.push_back (step {kind::push_size, capture (c), uint32 (size), 0});
+    }
+    
+    size_t matcher::choice () {
+        if (++Open > Depth) Depth = Open;
+        Steps.push_back (step {kind::choice, -1, 0, 0});
+        return Steps.size () - 1;
+    }
+    
+    size_t matcher::commit () {
+        Open--;
+        Steps.push_back (step {kind::commit, -1, 0, 0});
+        return Steps.size () - 1;
+    }
+    
+    // we follow every path from the beginning until it reads a byte.
+    void matcher::find_first () {
+        std::vector<bool> visited (Steps.size () + 1, false);
+        std::vector<size_t> next {0};
+        
+        auto push_ops = [this] () {
+            for (int o = 0; o <= OP_16; o++) if (Bitcoin::is_push (Bitcoin::op (o))) First.set (o);
+        };
+        
+        while (!next.empty ()) {
+            size_t i = next.back ();
+            next.pop_back ();
+            
+            if (visited[i]) continue;
+            visited[i] = true;
+            
+            // a pattern that can match nothing could begin with anything.
+            if (i == Steps.size ()) {
+                First.set ();
+                return;
+            }
+            
+            const step &s = Steps[i];
+            switch (s.Kind) {
+                case kind::literal:
+                    if (s.B == 0) next.push_back (i + 1);
+                    else First.set (Pool[s.A]);
+                    break;
+                case kind::push:
+                case kind::push_value:
+                case kind::push_data:
+                    push_ops ();
+                    break;
+                case kind::push_size:
+                    if (s.A == 0) First.set ();
+                    else push_ops ();
+                    break;
+                case kind::choice:
+                    next.push_back (i + 1);
+                    next.push_back (s.A);
+                    break;
+                case kind::commit:
+                    next.push_back (s.A);
+                    break;
+                default:
+                    First.set ();
+            }
+        }
+    }
+    
+    bool matcher::run (bytes_view script, bytes_view *captures) const {
+        if (script.size () > 0 && !First[script[0]]) return false;
+        
+        backtrack local[max_local_depth];
+        std::vector<backtrack> heap;
+        backtrack *stack = local;
+        if (Depth > max_local_depth) {
+            heap.resize (Depth);
+            stack = heap.data ();
+        }
+        
+        size_t open = 0;
+        size_t position = 0;
+        size_t i = 0;
+        
+        while (i < Steps.size ()) {
+            const step &s = Steps[i];
+            
+            if (s.Kind == kind::choice) {
+                stack[open++] = backtrack {s.A, uint32 (position)};
+                i++;
+                continue;
+            }
+            
+            if (s.Kind == kind::commit) {
+                open--;
+                i = s.A;
+                continue;
+            }
+            
+            bytes_view rest = script.substr (position);
+            size_t size = 0;
+            bool matched;
+            
+            if (s.Kind == kind::literal) {
+                size = s.B;
+                matched = rest.size () >= s.B && std::equal (Pool.begin () + s.A, Pool.begin () + s.A + s.B, rest.begin ());
+            } else {
+                bytes_view data;
+                if (rest.size () != 0) size = read_instruction (rest, data);
+                
+                bool push = size != 0 && Bitcoin::is_push (Bitcoin::op (rest[0]));
+                switch (s.Kind) {
+                    case kind::any:
+                        matched = size != 0;
+                        break;
+                    case kind::push:
+                        matched = push;
+                        break;
+                    case kind::push_value:
+                        matched = push && equal_number (data, bytes_view {Pool.data () + s.A, s.B});
+                        break;
+                    case kind::push_data:
+                        matched = push && data == bytes_view {Pool.data () + s.A, s.B};
+                        break;
+                    default:
+                        matched = size != 0 && data.size () == s.A;
+                }
+                
+                if (matched && s.Capture >= 0 && captures != nullptr) captures[s.Capture] = data;
+            }
+            
+            if (matched) {
+                position += size;
+                i++;
+            } else if (open == 0) return false;
+            else {
+                open--;
+                i = stack[open].Step;
+                position = stack[open].Position;
+            }
+        }
+        
+        return position == script.size ();
+    }
+    
+    bool matcher::match (bytes_view script) const {
+        return run (script, nullptr);
+    }
+    
+    bool matcher::match (bytes_view script, std::vector<bytes_view> &captures) const {
+        captures.assign (Captures, bytes_view {});
+        return run (script, captures.data ());
+    }
+    
+    namespace {
+        
+        int classify_with (const std::vector<matcher> &matchers, bytes_view script, std::vector<bytes_view> *captures) {
+            for (size_t i = 0; i < matchers.size (); i++) {
+                const matcher &m = matchers[i];
+                if (script.size () > 0 && !m.first ()[script[0]]) continue;
+                if (captures == nullptr ? m.match (script) : m.match (script, *captures)) return i;
+            }
+            
+            return -1;
+        }
+        
+    }
+    
+    int classifier::classify (bytes_view script) const {
+        return classify_with (Matchers, script, nullptr);
+    }
+    
+    int classifier::classify (bytes_view script, std::vector<bytes_view> &captures) const {
+        return classify_with (Matchers, script, &captures);
+    }
+    
+}
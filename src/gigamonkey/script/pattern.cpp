@@ -150,5 +150,96 @@ namespace Gigamonkey {
 
         throw fail {};
     };
+    
+    void pattern::compile (matcher &m) const {
+        if (Pattern != nullptr) Pattern->compile (m);
+    }
+    
+    void any::compile (matcher &m) const {
+        m.any ();
+    }
+    
+    void pattern::atom::compile (matcher &m) const {
+        m.literal (Bitcoin::compile (Instruction));
+    }
+    
+    void pattern::string::compile (matcher &m) const {
+        m.literal (Program);
+    }
+    
+    void push::compile (matcher &m) const {
+        switch (Type) {
+            case value : 
+                return m.push (matcher::kind::push_value, Value, false);
+            case data : 
+                return m.push (matcher::kind::push_data, Data, false);
+            default : 
+                return m.push (matcher::kind::push, bytes_view {}, Type == read);
+        }
+    }
+    
+    void push_size::compile (matcher &m) const {
+        m.push_size (Size, Reader);
+    }
+    
+    void op_return_data::compile (matcher &m) const {
+        m.literal (bytes {OP_RETURN});
+        pattern::compile (m);
+    }
+    
+    void pattern::sequence::compile (matcher &m) const {
+        for (const ptr<pattern> &p : Patterns) p->compile (m);
+    }
+    
+    void optional::compile (matcher &m) const {
+        size_t choice = m.choice ();
+        pattern::Pattern->compile (m);
+        size_t commit = m.commit ();
+        m.jump (choice, m.size ());
+        m.jump (commit, m.size ());
+    }
+    
+    // the same numbers of matches as in scan. 
+    void repeated::compile (matcher &m) const {
+        uint32 min = Second == -1 && Directive == or_less ? 0 : First;
+        int64 max = Second != -1 ? Second : Directive == or_more ? -1 : First;
+        
+        uint32 required = max > 0 && max < min ? max : min;
+        for (uint32 i = 0; i < required; i++) pattern::Pattern->compile (m);
+        
+        if (max <= 0) {
+            size_t loop = m.choice ();
+            pattern::Pattern->compile (m);
+            m.jump (m.commit (), loop);
+            m.jump (loop, m.size ());
+            return;
+        }
+        
+        std::vector<size_t> choices;
+        for (int64 i = required; i < max; i++) {
+            choices.push_back (m.choice ());
+            pattern::Pattern->compile (m);
+            m.jump (m.commit (), m.size ());
+        }
+        
+        for (size_t choice : choices) m.jump (choice, m.size ());
+    }
+    
+    void alternatives::compile (matcher &m) const {
+        std::vector<size_t> commits;
+        list<ptr<pattern>> patt = Patterns;
+        
+        while (!data::empty (patt.rest ())) {
+            size_t choice = m.choice ();
+            patt.first ()->compile (m);
+            commits.push_back (m.commit ());
+            m.jump (choice, m.size ());
+            patt = patt.rest ();
+        }
+        
+        patt.first ()->compile (m);
+        
+        for (size_t commit : commits) m.jump (commit, m.size ());
+    }
 
 }
@@ -0,0 +1,98 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/profile.hpp>
+
+#include <algorithm>
+#include <iomanip>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    profile::entry &profile::entry::operator += (const entry &e) {
+        Count += e.Count;
+        Nanoseconds += e.Nanoseconds;
+        Allocated += e.Allocated;
+        PeakMemory = std::max (PeakMemory, e.PeakMemory);
+        return *this;
+    }
+    
+    void profile::record (op o, uint64 nanoseconds, uint64 memory_before, uint64 memory_after) {
+        entry &e = Opcodes[o];
+        e.Count++;
+        e.Nanoseconds += nanoseconds;
+        if (memory_after > memory_before) e.Allocated += memory_after - memory_before;
+        e.PeakMemory = std::max (e.PeakMemory, memory_after);
+        PeakMemory = std::max (PeakMemory, memory_after);
+    }
+    
+    profile &profile::operator += (const profile &p) {
+        for (size_t i = 0; i < Opcodes.size (); i++) Opcodes[i] += p.Opcodes[i];
+        Scripts += p.Scripts;
+        PeakMemory = std::max (PeakMemory, p.PeakMemory);
+        return *this;
+    }
+    
+    uint64 profile::operations () const {
+        uint64 n = 0;
+        for (const entry &e : Opcodes) n += e.Count;
+        return n;
+    }
+    
+    uint64 profile::nanoseconds () const {
+        uint64 n = 0;
+        for (const entry &e : Opcodes) n += e.Nanoseconds;
+        return n;
+    }
+    
+    std::vector<op> profile::ranked () const {
+        std::vector<op> r;
+        for (size_t i = 0; i < Opcodes.size (); i++) if (Opcodes[i].Count > 0) r.push_back (op (i));
+        std::stable_sort (r.begin (), r.end (), [this] (op a, op b) {
+            return Opcodes[a].Nanoseconds > Opcodes[b].Nanoseconds;
+        });
+        return r;
+    }
+    
+    void profile::write_folded (std::ostream &o, const string &name) const {
+        for (op x : ranked ()) o << name << ";" << GetOpName (x) << " " << Opcodes[x].Nanoseconds << "\n";
+    }
+    
+    profile::operator JSON () const {
+        JSON::array_t ops;
+        for (op x : ranked ()) {
+            const entry &e = Opcodes[x];
+            ops.push_back (JSON {
+                {"op", GetOpName (x)},
+                {"count", e.Count},
+                {"ns", e.Nanoseconds},
+                {"allocated", e.Allocated},
+                {"peak_memory", e.PeakMemory}});
+        }
+        
+        return JSON {
+            {"scripts", Scripts},
+            {"operations", operations ()},
+            {"ns", nanoseconds ()},
+            {"peak_memory", PeakMemory},
+            {"opcodes", ops}};
+    }
+    
+    std::ostream &operator << (std::ostream &o, const profile &p) {
+        uint64 total = p.nanoseconds ();
+        o << p.Scripts << " scripts, " << p.operations () << " operations, " << total
+            << " ns, peak stack memory " << p.PeakMemory << " bytes";
+        
+        for (op x : p.ranked ()) {
+            const profile::entry &e = p[x];
+            o << "\n" << std::left << std::setw (24) << GetOpName (x) << std::right
+                << std::setw (12) << e.Count
+                << std::setw (14) << e.Nanoseconds << " ns"
+                << std::setw (7) << std::fixed << std::setprecision (1) << (total == 0 ? 0. : 100. * e.Nanoseconds / total) << "%"
+                << std::setw (12) << e.Allocated << " B allocated"
+                << std::setw (12) << e.PeakMemory << " B peak";
+        }
+        
+        return o;
+    }
+    
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/rope.hpp>
+
+#include <algorithm>
+
+namespace Gigamonkey::Bitcoin::interpreter {
+    
+    namespace {
+        
+        // pieces that are smaller than this together are copied into one leaf,
+        // so that a rope built from many small pushes does not have a leaf for each.
+        constexpr uint64 merge_size = 256;
+        
+        ptr<const rope> leaf (ptr<const bytes> b, uint64 offset, uint64 size) {
+            return std::make_shared<const rope> (rope {size, 0, b, offset, nullptr, nullptr});
+        }
+        
+        ptr<const rope> node (ptr<const rope> l, ptr<const rope> r) {
+            return std::make_shared<const rope> (rope {l->Size + r->Size,
+                byte (std::max (l->Height, r->Height) + 1), nullptr, 0, l, r});
+        }
+        
+        // a node for children whose heights differ by at most two, rotated
+        // so that they differ by at most one, as in an AVL tree.
+        ptr<const rope> balance (ptr<const rope> l, ptr<const rope> r) {
+            if (l->Height > r->Height + 1) {
+                if (l->Left->Height >= l->Right->Height) return node (l->Left, node (l->Right, r));
+                return node (node (l->Left, l->Right->Left), node (l->Right->Right, r));
+            }
+            
+            if (r->Height > l->Height + 1) {
+                if (r->Right->Height >= r->Left->Height) return node (node (l, r->Left), r->Right);
+                return node (node (l, r->Left->Left), node (r->Left->Right, r->Right));
+            }
+            
+            return node (l, r);
+        }
+        
+    }
+    
+    ptr<const rope> rope::make (bytes &&b) {
+        if (b.size () == 0) return nullptr;
+        uint64 size = b.size ();
+        return leaf (std::make_shared<const bytes> (std::move (b)), 0, size);
+    }
+    
+    // the shorter rope goes down the side of the taller one until they are
+    // about the same height, so this is O(difference in height).
+    ptr<const rope> rope::join (ptr<const rope> l, ptr<const rope> r) {
+        if (l == nullptr) return r;
+        if (r == nullptr) return l;
+        
+        if (l->Size + r->Size <= merge_size) {
+            bytes b (l->Size + r->Size);
+            l->write (b.data ());
+            r->write (b.data () + l->Size);
+            return make (std::move (b));
+        }
+        
+        if (l->Height > r->Height + 1) return balance (l->Left, join (l->Right, r));
+        if (r->Height > l->Height + 1) return balance (join (l, r->Left), r->Right);
+        return node (l, r);
+    }
+    
+    std::pair<ptr<const rope>, ptr<const rope>> rope::split (ptr<const rope> x, uint64 n) {
+        if (x == nullptr || n == 0) return {nullptr, x};
+        if (n >= x->Size) return {x, nullptr};
+        
+        if (x->Buffer != nullptr) return {leaf (x->Buffer, x->Offset, n), leaf (x->Buffer, x->Offset + n, x->Size - n)};
+        
+        uint64 left = x->Left->Size;
+        if (n < left) {
+            auto [a, b] = split (x->Left, n);
+            return {a, join (b, x->Right)};
+        }
+        
+        if (n > left) {
+            auto [a, b] = split (x->Right, n - left);
+            return {join (x->Left, a), b};
+        }
+        
+        return {x->Left, x->Right};
+    }
+    
+    void rope::write (byte *out) const {
+        if (Buffer != nullptr) {
+            std::copy (Buffer->begin () + Offset, Buffer->begin () + Offset + Size, out);
+            return;
+        }
+        
+        Left->write (out);
+        Right->write (out + Left->Size);
+    }
+    
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/script_cache.hpp>
+
+#include <random>
+
+namespace Gigamonkey::Bitcoin {
+    
+    script_cache::script_cache (size_t max_entries) : 
+        Salt {}, MaxEntries {max_entries}, Mutex {}, Entries {}, Hits {0}, Misses {0} {
+        std::random_device r;
+        for (byte &b : Salt) b = static_cast<byte> (r ());
+        Entries.reserve (std::min (max_entries, size_t {1} << 16));
+    }
+    
+    script_cache::key script_cache::make_key (const txid &id, uint32 index, const output &redeemed, uint32 flags) const {
+        SHA2_256_writer w;
+        w << bytes_view {Salt.data (), Salt.size ()} << id << uint32_little {index} << redeemed << uint32_little {flags};
+        digest256 h = w.finalize ();
+        key k;
+        std::copy (h.begin (), h.end (), k.begin ());
+        return k;
+    }
+    
+    bool script_cache::contains (const txid &id, uint32 index, const output &redeemed, uint32 flags) const {
+        key k = make_key (id, index, redeemed, flags);
+        bool found;
+        
+        {
+            std::shared_lock<std::shared_mutex> lock (Mutex);
+            found = Entries.contains (k);
+        }
+        
+        ++(found ? Hits : Misses);
+        return found;
+    }
+    
+    void script_cache::insert (const txid &id, uint32 index, const output &redeemed, uint32 flags) {
+        if (MaxEntries == 0) return;
+        key k = make_key (id, index, redeemed, flags);
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        // the keys are salted hashes, so the first one is as good as a random one. 
+        if (Entries.size () >= MaxEntries) Entries.erase (Entries.begin ());
+        Entries.insert (k);
+    }
+    
+    size_t script_cache::size () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Entries.size ();
+    }
+    
+    void script_cache::clear () {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        Entries.clear ();
+    }
+    
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/script_store.hpp>
+
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        uint64 script_hash (bytes_view b) {
+            return std::hash<std::string_view> {} (std::string_view {reinterpret_cast<const char *> (b.data ()), b.size ()});
+        }
+        
+    }
+    
+    script_store::script_store () : Shards {} {}
+    
+    int64 script_store::shard::find (bytes_view b, uint64 hash) const {
+        auto [begin, end] = Index.equal_range (hash);
+        for (auto i = begin; i != end; i++) if (bytes_view (Entries[i->second].Script) == b) return i->second;
+        return -1;
+    }
+    
+    script_store::entry &script_store::get (handle h) const {
+        const shard &s = Shards[h & (shards - 1)];
+        return const_cast<entry &> (s.Entries[(h >> shard_bits) - 1]);
+    }
+    
+    script_store::handle script_store::intern (bytes_view b) {
+        uint64 hash = script_hash (b);
+        uint32 n = hash & (shards - 1);
+        shard &s = Shards[n];
+        
+        // an entry whose count has gone to zero can come back here, since it is
+        // not removed until its last reference takes the lock and sees that it
+        // is still zero.
+        {
+            std::shared_lock<std::shared_mutex> lock (s.Mutex);
+            int64 i = s.find (b, hash);
+            if (i >= 0) {
+                s.Entries[i].Count++;
+                return handle ((i + 1) << shard_bits) | n;
+            }
+        }
+        
+        std::unique_lock<std::shared_mutex> lock (s.Mutex);
+        int64 i = s.find (b, hash);
+        if (i >= 0) {
+            s.Entries[i].Count++;
+            return handle ((i + 1) << shard_bits) | n;
+        }
+        
+        if (!s.Free.empty ()) {
+            i = s.Free.back ();
+            s.Free.pop_back ();
+            entry &e = s.Entries[i];
+            e.Script = bytes (b);
+            e.Hash = hash;
+            e.Live = true;
+            e.Count = 1;
+        } else {
+            if (s.Entries.size () + 1 >= (uint64 {1} << (32 - shard_bits)))
+                throw std::length_error {"script store is full"};
+            i = s.Entries.size ();
+            s.Entries.emplace_back (b, hash);
+        }
+        
+        s.Index.emplace (hash, uint32 (i));
+        s.Stored += b.size ();
+        return handle ((i + 1) << shard_bits) | n;
+    }
+    
+    void script_store::retain (handle h) {
+        if (h == none) return;
+        shard &s = Shards[h & (shards - 1)];
+        std::shared_lock<std::shared_mutex> lock (s.Mutex);
+        get (h).Count++;
+    }
+    
+    void script_store::release (handle h) {
+        if (h == none) return;
+        shard &s = Shards[h & (shards - 1)];
+        uint32 i = (h >> shard_bits) - 1;
+        
+        {
+            std::shared_lock<std::shared_mutex> lock (s.Mutex);
+            if (--s.Entries[i].Count != 0) return;
+        }
+        
+        std::unique_lock<std::shared_mutex> lock (s.Mutex);
+        entry &e = s.Entries[i];
+        if (!e.Live || e.Count != 0) return;
+        
+        auto [begin, end] = s.Index.equal_range (e.Hash);
+        for (auto j = begin; j != end; j++) if (j->second == i) {
+            s.Index.erase (j);
+            break;
+        }
+        
+        s.Stored -= e.Script.size ();
+        e.Script = bytes {};
+        e.Live = false;
+        s.Free.push_back (i);
+    }
+    
+    bytes_view script_store::operator [] (handle h) const {
+        if (h == none) return {};
+        const shard &s = Shards[h & (shards - 1)];
+        std::shared_lock<std::shared_mutex> lock (s.Mutex);
+        return get (h).Script;
+    }
+    
+    uint32 script_store::references (handle h) const {
+        if (h == none) return 0;
+        const shard &s = Shards[h & (shards - 1)];
+        std::shared_lock<std::shared_mutex> lock (s.Mutex);
+        return get (h).Count;
+    }
+    
+    size_t script_store::size () const {
+        size_t x = 0;
+        for (const shard &s : Shards) {
+            std::shared_lock<std::shared_mutex> lock (s.Mutex);
+            x += s.Index.size ();
+        }
+        
+        return x;
+    }
+    
+    size_t script_store::stored () const {
+        size_t x = 0;
+        for (const shard &s : Shards) {
+            std::shared_lock<std::shared_mutex> lock (s.Mutex);
+            x += s.Stored;
+        }
+        
+        return x;
+    }
+    
+    memory_report script_store::memory_usage () const {
+        memory_report m {};
+        for (const shard &s : Shards) {
+            std::shared_lock<std::shared_mutex> lock (s.Mutex);
+            m.Keys += s.Index.size () * sizeof (uint64);
+            m.Values += s.Stored;
+            m.Overhead += (s.Entries.size () - s.Free.size ()) * sizeof (entry) +
+                hash_table_overhead (s.Index) + s.Index.size () * sizeof (uint32);
+            m.Slack += s.Free.size () * sizeof (entry) + s.Free.capacity () * sizeof (uint32);
+        }
+        
+        return m;
+    }
+    
+    script_store &script_store::shared () {
+        static script_store Shared {};
+        return Shared;
+    }
+    
+}
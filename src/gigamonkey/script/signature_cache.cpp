@@ -0,0 +1,81 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/signature_cache.hpp>
+
+#include <random>
+
+namespace Gigamonkey::Bitcoin {
+    
+    signature_cache::signature_cache (size_t max_entries) : Salt {}, MaxEntries {max_entries}, Mutex {}, Entries {} {
+        std::random_device r;
+        for (byte &b : Salt) b = static_cast<byte> (r ());
+        Entries.reserve (std::min (max_entries, size_t {1} << 16));
+    }
+    
+    signature_cache::key signature_cache::make_key (const digest256 &d, bytes_view pub, bytes_view sig) const {
+        SHA2_256_writer w;
+        w << bytes_view {Salt.data (), Salt.size ()} << d << static_cast<byte> (pub.size ()) << pub << sig;
+        digest256 h = w.finalize ();
+        key k;
+        std::copy (h.begin (), h.end (), k.begin ());
+        return k;
+    }
+    
+    bool signature_cache::contains (const digest256 &d, bytes_view pub, bytes_view sig) const {
+        key k = make_key (d, pub, sig);
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Entries.contains (k);
+    }
+    
+    void signature_cache::insert (const key &k) {
+        if (MaxEntries == 0) return;
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        // the keys are salted hashes, so the first one is as good as a random one. 
+        if (Entries.size () >= MaxEntries) Entries.erase (Entries.begin ());
+        Entries.insert (k);
+    }
+    
+    void signature_cache::insert (const digest256 &d, bytes_view pub, bytes_view sig) {
+        insert (make_key (d, pub, sig));
+    }
+    
+    bool signature_cache::verify (const digest256 &d, bytes_view pub, bytes_view sig) {
+        key k = make_key (d, pub, sig);
+        
+        {
+            std::shared_lock<std::shared_mutex> lock (Mutex);
+            if (Entries.contains (k)) return true;
+        }
+        
+        if (!secp256k1::pubkey::verify (pub, d, sig)) return false;
+        
+        insert (k);
+        return true;
+    }
+    
+    bool signature_cache::verify (const digest256 &d, bytes_view pub, bytes_view sig, const secp256k1::parsed_signature &parsed) {
+        key k = make_key (d, pub, sig);
+        
+        {
+            std::shared_lock<std::shared_mutex> lock (Mutex);
+            if (Entries.contains (k)) return true;
+        }
+        
+        if (!secp256k1::parsed_pubkey {pub}.verify (d, parsed)) return false;
+        
+        insert (k);
+        return true;
+    }
+    
+    size_t signature_cache::size () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Entries.size ();
+    }
+    
+    void signature_cache::clear () {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        Entries.clear ();
+    }
+    
+}
@@ -1,51 +1,114 @@
 #include <gigamonkey/script/typed_data_bip_276.hpp>
-#include <gigamonkey/p2p/checksum.hpp>
+#include <gigamonkey/hex.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <algorithm>
 
 namespace Gigamonkey {
     
-    string typed_data::write (type t, byte version, network n, const bytes& b) {
-        std::stringstream ss;
-        
-        switch (t) {
-            case bitcoin_script: {
-                ss << "bitcoin-script";
-            } break;
-            
-            default: throw "invalid data type";
-        }
+    namespace {
         
-        bytes data = bytes::write (b.size() + 2, version, byte(n), b);
+        constexpr string_view prefix {"bitcoin-script:"};
         
-        ss << ':' << encoding::hex::write (data, hex_case::lower);
+        // the first four bytes of the double SHA-256 of the string.
+        void write_checksum (byte *out, string_view z) {
+            byte once[32];
+            byte twice[32];
+            sha256::hasher {}.Write (reinterpret_cast<const byte *> (z.data ()), z.size ()).Finalize (once);
+            sha256::hash_short (twice, once, 32, 1);
+            std::copy (twice, twice + 4, out);
+        }
+        
+        // hex digits that are all the same case. The characters must already be known to
+        // be hex digits, so a letter has 0x40 set and a lower case letter has 0x20 set too.
+        bool one_case (string_view z) {
+            bool lower = false;
+            bool upper = false;
+            for (char c : z) {
+                lower |= (c & 0x60) == 0x60;
+                upper |= (c & 0x60) == 0x40;
+            }
+            return !(lower && upper);
+        }
         
-        auto checksum = Bitcoin::checksum (bytes::from_string (ss.str ()));
+    }
+    
+    string typed_data::write (type t, byte version, network n, const bytes& b) {
+        if (t != bitcoin_script) throw "invalid data type";
+        string x (write_size (b.size ()), '0');
+        write (x.data (), version, n, b);
+        return x;
+    }
+    
+    void typed_data::write (char *out, network n, bytes_view script) {
+        write (out, 1, n, script);
+    }
+    
+    void typed_data::write (char *out, byte version, network n, bytes_view script) {
+        size_t size = write_size (script.size ());
+        std::copy (prefix.begin (), prefix.end (), out);
         
-        ss << encoding::hex::write (checksum, hex_case::lower);
+        byte header[2] {version, byte (n)};
+        Gigamonkey::hex::write (out + 15, header, 2);
+        Gigamonkey::hex::write (out + 19, script.data (), script.size ());
         
-        return ss.str ();
+        byte sum[4];
+        write_checksum (sum, string_view {out, size - 8});
+        Gigamonkey::hex::write (out + size - 8, sum, 4);
     }
     
-    typed_data typed_data::read (string_view z) {
+    std::vector<string> typed_data::write (network n, const std::vector<bytes> &scripts) {
+        std::vector<string> x;
+        x.reserve (scripts.size ());
+        for (const bytes &b : scripts) {
+            string &z = x.emplace_back (write_size (b.size ()), '0');
+            write (z.data (), n, b);
+        }
+        return x;
+    }
+    
+    bool typed_data::read (string_view z, network &n, bytes &script) {
         // 8 characters of checksum, 15 of "bitcoin-script:", 2 of version and 2 of network.
-        if (z.size () <= 27) return {};
-        
-        if (!ctre::match<pattern> (z)) return {};
+        if (z.size () <= 27 || (z.size () & 1) == 0 || z.substr (0, 15) != prefix) return false;
         
-        bytes last_4_bytes = *encoding::hex::read (z.substr (z.size () - 8));
+        byte header[2];
+        if (!Gigamonkey::hex::read (header, z.data () + 15, 2) || header[0] != 1 || header[1] > 2) return false;
         
-        uint32_little expected_checksum;
-        std::copy (last_4_bytes.begin (), last_4_bytes.end (), expected_checksum.begin ());
-        uint32_little real_checksum = Bitcoin::checksum (bytes::from_string (z.substr (0, z.size () - 8)));
+        byte expected[4];
+        byte sum[4];
+        if (!Gigamonkey::hex::read (expected, z.data () + z.size () - 8, 4)) return false;
+        write_checksum (sum, z.substr (0, z.size () - 8));
+        if (!std::equal (sum, sum + 4, expected)) return false;
         
-        // does the checksum match? 
-        if (expected_checksum != real_checksum) return {};
+        script.resize ((z.size () - 27) / 2);
+        if (!Gigamonkey::hex::read (script.data (), z.data () + 19, script.size ())) return false;
         
-        bytes payload = *encoding::hex::read (z.substr (15, z.size () - 23));
+        // the digits after the prefix are either all lower case or all upper case.
+        if (!one_case (z.substr (15))) return false;
         
-        if (payload[0] != 1 || payload[1] > 2) return {};
+        n = network (header[1]);
+        return true;
+    }
+    
+    typed_data typed_data::read (string_view z) {
+        network n;
+        bytes script;
+        if (!read (z, n, script)) return {};
+        return {bitcoin_script, 1, n, script};
+    }
+    
+    std::vector<typed_data> typed_data::read (const std::vector<string_view> &x) {
+        std::vector<typed_data> decoded;
+        decoded.reserve (x.size ());
         
-        return {bitcoin_script, 1, network (payload[1]), bytes {bytes_view {payload.data () + 2, payload.size () - 2}}};
+        network n;
+        bytes script;
+        for (const string_view &z : x) {
+            if (read (z, n, script)) decoded.push_back (typed_data {bitcoin_script, 1, n, script});
+            else decoded.push_back (typed_data {});
+        }
         
+        return decoded;
     }
     
 }
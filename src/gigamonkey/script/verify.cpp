@@ -0,0 +1,248 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/verify.hpp>
+#include <gigamonkey/script/bytecode_cache.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        result evaluate_input (const txid &id, const incomplete::transaction &incomplete, const ptr<const sighash::precomputed> &precomputed, 
+            bytes_view unlock, const prevout &p, uint32 i, uint32 flags, signature_cache *cache, script_cache *scripts_cache) {
+            
+            if (scripts_cache != nullptr && scripts_cache->contains (id, i, p.Value, flags)) return true;
+            
+            redemption_document doc {p.value (), incomplete, i, precomputed};
+            
+            // every worker keeps a machine and resets it for each input so that 
+            // the memory it has already allocated for its stacks can be used again. 
+            // large locking scripts that many outputs have in common are only decoded once. 
+            ptr<const interpreter::bytecode> lock = interpreter::bytecode_cache::shared ().get (p.Value.Script);
+            
+            thread_local std::unique_ptr<interpreter::machine> m;
+            if (m == nullptr) m = std::make_unique<interpreter::machine> (script {unlock}, *lock, doc, flags);
+            else m->reset (script {unlock}, *lock, doc, flags);
+            
+            m->State.Cache = cache;
+            
+            // elliptic curve operations are done last so that we do not waste time on them if the script fails anyway. 
+            m->defer_signatures ();
+            
+            result r = m->run ();
+            
+            // the machine outlives this call, so it must not keep the document,
+            // which refers to the transaction, or the cache.
+            m->State.Document = {};
+            m->State.Deferred.clear ();
+            m->State.Cache = nullptr;
+            
+            if (r.verify () && scripts_cache != nullptr) scripts_cache->insert (id, i, p.Value, flags);
+            return r;
+        }
+        
+        std::vector<result> verify_scripts (const txid &id, const incomplete::transaction &incomplete, const std::vector<bytes_view> &scripts, 
+            std::span<const prevout> prevouts, uint32 flags, executor &e, bool stop_on_failure, signature_cache *cache, script_cache *scripts_cache) {
+            
+            ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+            
+            std::vector<result> results (scripts.size ());
+            std::atomic<bool> failed {false};
+            
+            e.parallel_for (scripts.size (), [&] (size_t i) {
+                if (stop_on_failure && failed) return;
+                
+                results[i] = evaluate_input (id, incomplete, precomputed, scripts[i], prevouts[i], static_cast<uint32> (i), flags, cache, scripts_cache);
+                if (!results[i].verify ()) failed = true;
+            });
+            
+            return results;
+        }
+        
+    }
+    
+    std::vector<result> verify_transaction (bytes_view b, std::span<const prevout> prevouts, uint32 flags, 
+        executor &e, bool stop_on_failure, signature_cache *cache, script_cache *scripts_cache) {
+        return verify_transaction (transaction_view {b}, prevouts, flags, e, stop_on_failure, cache, scripts_cache);
+    }
+    
+    std::vector<result> verify_transaction (const transaction &tx, std::span<const prevout> prevouts, uint32 flags, 
+        executor &e, bool stop_on_failure, signature_cache *cache, script_cache *scripts_cache) {
+        if (!tx.valid ()) throw std::invalid_argument {"invalid transaction"};
+        
+        if (tx.Inputs.size () != prevouts.size ()) throw std::invalid_argument {"need one prevout for each input"};
+        
+        std::vector<bytes_view> scripts;
+        scripts.reserve (prevouts.size ());
+        for (const input &in : tx.Inputs) {
+            if (!(in.Reference == prevouts[scripts.size ()].outpoint ())) throw std::invalid_argument {"prevouts do not match inputs"};
+            scripts.push_back (in.Script);
+        }
+        
+        return verify_scripts (tx.id (), incomplete::transaction {tx}, scripts, prevouts, flags, e, stop_on_failure, cache, scripts_cache);
+    }
+    
+    std::vector<result> verify_transaction (const transaction_view &tx, std::span<const prevout> prevouts, uint32 flags, 
+        executor &e, bool stop_on_failure, signature_cache *cache, script_cache *scripts_cache) {
+        if (!tx.valid ()) throw std::invalid_argument {"invalid transaction"};
+        if (tx.input_count () != prevouts.size ()) throw std::invalid_argument {"need one prevout for each input"};
+        
+        std::vector<bytes_view> scripts (tx.input_count ());
+        for (size_t i = 0; i < scripts.size (); i++) {
+            input_view in = tx.input (i);
+            if (!(in.reference () == prevouts[i].outpoint ())) throw std::invalid_argument {"prevouts do not match inputs"};
+            scripts[i] = in.script ();
+        }
+        
+        return verify_scripts (tx.id (), incomplete::transaction (tx), scripts, prevouts, flags, e, stop_on_failure, cache, scripts_cache);
+    }
+    
+    
+    block_result verify_block (const block_view &b, const ledger &l, uint32 flags, 
+        executor &e, signature_cache *cache, script_cache *scripts_cache) {
+        
+        block_result r {{}, false};
+        if (!b.valid () || b.size () == 0) return r;
+        
+        size_t n = b.size ();
+        r.Transactions.resize (n - 1, transaction_result {transaction_result::valid, {}});
+        
+        // where each transaction is in the block.
+        hash_map<txid, uint32> positions;
+        positions.reserve (n);
+        for (uint32 i = 0; i < n; i++) positions.emplace (b[i].id (), i);
+        
+        struct pending {
+            txid ID;
+            std::vector<outpoint> References;
+            std::vector<output> Spent;
+            std::vector<bytes_view> Scripts;
+            
+            // transactions in the block that this one spends from.
+            std::vector<uint32> Dependencies;
+            uint32 Wave;
+            
+            ptr<const incomplete::transaction> Incomplete;
+            ptr<const sighash::precomputed> Precomputed;
+            std::vector<prevout> Prevouts;
+        };
+        
+        std::vector<pending> txs (n);
+        
+        // outputs that must be asked for from the ledger, and which input each is for.
+        std::vector<outpoint> external;
+        std::vector<std::pair<uint32, uint32>> external_inputs;
+        
+        hash_set<outpoint> spent;
+        uint32 waves = 0;
+        
+        auto fail = [&r] (uint32 i, transaction_result::status x) {
+            if (r.Transactions[i - 1].Status == transaction_result::valid) r.Transactions[i - 1].Status = x;
+        };
+        
+        for (uint32 i = 1; i < n; i++) {
+            const transaction_view &tx = b[i];
+            pending &p = txs[i];
+            p.ID = tx.id ();
+            p.Wave = 0;
+            
+            size_t inputs = tx.input_count ();
+            p.References.resize (inputs);
+            p.Spent.resize (inputs);
+            p.Scripts.resize (inputs);
+            
+            for (uint32 j = 0; j < inputs; j++) {
+                input_view in = tx.input (j);
+                p.References[j] = in.reference ();
+                p.Scripts[j] = in.script ();
+                
+                const outpoint &op = p.References[j];
+                if (!spent.insert (op).second) fail (i, transaction_result::double_spend);
+                
+                auto from = positions.find (op.Digest);
+                if (from == positions.end ()) {
+                    external.push_back (op);
+                    external_inputs.push_back ({i, j});
+                    continue;
+                }
+                
+                // the coinbase can't be spent yet and transactions can only spend those before them.
+                if (from->second == 0 || from->second >= i) {
+                    fail (i, transaction_result::invalid_transaction);
+                    continue;
+                }
+                
+                const transaction_view &previous = b[from->second];
+                if (uint32 (op.Index) >= previous.output_count ()) {
+                    fail (i, transaction_result::missing_prevout);
+                    continue;
+                }
+                
+                p.Spent[j] = output (previous.output (uint32 (op.Index)));
+                p.Dependencies.push_back (from->second);
+                p.Wave = std::max (p.Wave, txs[from->second].Wave + 1);
+            }
+            
+            waves = std::max (waves, p.Wave + 1);
+        }
+        
+        if (external.size () > 0) {
+            std::vector<output> outs = l.prevouts (external).get ();
+            for (size_t k = 0; k < external.size (); k++) {
+                auto [i, j] = external_inputs[k];
+                if (k >= outs.size () || !outs[k].valid ()) fail (i, transaction_result::missing_prevout);
+                else txs[i].Spent[j] = outs[k];
+            }
+        }
+        
+        std::vector<std::vector<uint32>> by_wave (waves);
+        for (uint32 i = 1; i < n; i++) by_wave[txs[i].Wave].push_back (i);
+        
+        for (const std::vector<uint32> &wave : by_wave) {
+            std::vector<std::pair<uint32, uint32>> tasks;
+            
+            for (uint32 i : wave) {
+                for (uint32 d : txs[i].Dependencies) if (!r.Transactions[d - 1].verify ()) fail (i, transaction_result::dependency_failed);
+                if (!r.Transactions[i - 1].verify ()) continue;
+                
+                const transaction_view &tx = b[i];
+                pending &p = txs[i];
+                
+                satoshi value {0};
+                for (const output &o : p.Spent) value = value + o.Value;
+                satoshi sent {0};
+                for (size_t k = 0; k < tx.output_count (); k++) sent = sent + tx.output (k).value ();
+                if (value < sent) {
+                    fail (i, transaction_result::invalid_transaction);
+                    continue;
+                }
+                
+                p.Incomplete = std::make_shared<const incomplete::transaction> (incomplete::transaction (tx));
+                p.Precomputed = std::make_shared<const sighash::precomputed> (*p.Incomplete);
+                p.Prevouts.reserve (p.Spent.size ());
+                for (size_t k = 0; k < p.Spent.size (); k++) p.Prevouts.push_back (prevout {p.References[k], p.Spent[k]});
+                
+                r.Transactions[i - 1].Inputs.resize (p.Scripts.size ());
+                for (uint32 j = 0; j < p.Scripts.size (); j++) tasks.push_back ({i, j});
+            }
+            
+            e.parallel_for (tasks.size (), [&] (size_t k) {
+                auto [i, j] = tasks[k];
+                const pending &p = txs[i];
+                r.Transactions[i - 1].Inputs[j] = evaluate_input (p.ID, *p.Incomplete, p.Precomputed,
+                    p.Scripts[j], p.Prevouts[j], j, flags, cache, scripts_cache);
+            });
+            
+            for (uint32 i : wave) if (r.Transactions[i - 1].verify () && !verified (r.Transactions[i - 1].Inputs))
+                r.Transactions[i - 1].Status = transaction_result::invalid_script;
+        }
+        
+        r.Valid = true;
+        for (const transaction_result &x : r.Transactions) if (!x.verify ()) r.Valid = false;
+        return r;
+    }
+    
+}
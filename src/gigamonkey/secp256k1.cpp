@@ -5,9 +5,17 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/secp256k1.hpp>
+#include <gigamonkey/executor.hpp>
 #include <data/encoding/integer.hpp>
 #include <secp256k1.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <random>
+
 namespace Gigamonkey::secp256k1 {
     
     reader &operator>>(reader& r, point& p) {
@@ -199,22 +207,65 @@ namespace Gigamonkey::secp256k1 {
         return 1;
     }
     
-    class context {
-        mutable secp256k1_context* Context;
-    public:
-        int Flags;
+    namespace {
         
-        context(int flags) : Context{nullptr}, Flags{flags} {}
+        struct context_deleter {
+            void operator()(secp256k1_context* c) const {
+                secp256k1_context_destroy(c);
+            }
+        };
         
-        secp256k1_context* operator()() const {
-            if (Context == nullptr) Context = secp256k1_context_create(Flags);
-            return Context;
+        using context_ptr = std::unique_ptr<secp256k1_context, context_deleter>;
+        
+        // randomize a signing context so that the values that are computed 
+        // while signing cannot be learned by watching the cpu. 
+        void randomize(secp256k1_context* c) {
+            std::random_device r;
+            byte seed[32];
+            for (byte& b : seed) b = static_cast<byte>(r());
+            if (secp256k1_context_randomize(c, seed) != 1) throw std::runtime_error{"could not randomize secp256k1 context"};
         }
         
-        ~context() {
-            if (Context != nullptr) secp256k1_context_destroy(Context);
+        // function-local statics are initialized once even with many threads. 
+        const secp256k1_context* Verification() {
+            static const context_ptr Context{secp256k1_context_create(SECP256K1_CONTEXT_VERIFY)};
+            return Context.get();
+        }
+        
+        const secp256k1_context* shared_signing() {
+            static const context_ptr Context{[]() -> secp256k1_context* {
+                secp256k1_context* c = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+                randomize(c);
+                return c;
+            }()};
+            return Context.get();
+        }
+        
+        std::atomic<bool> PerThread{false};
+        
+        const secp256k1_context* Signing() {
+            if (!PerThread) return shared_signing();
+            
+            // copying the shared context is much faster than building a new one. 
+            thread_local context_ptr Local{};
+            if (Local == nullptr) {
+                Local = context_ptr{secp256k1_context_clone(shared_signing())};
+                randomize(Local.get());
+            }
+            
+            return Local.get();
         }
-    } Verification{SECP256K1_CONTEXT_VERIFY}, Signing{SECP256K1_CONTEXT_SIGN};
+        
+    }
+    
+    void warm_contexts() {
+        Verification();
+        Signing();
+    }
+    
+    void per_thread_contexts(bool enable) {
+        PerThread = enable;
+    }
     
     bool signature::normalized(const bytes_view vchSig) {
         secp256k1_ecdsa_signature sig;
@@ -252,24 +303,64 @@ namespace Gigamonkey::secp256k1 {
         return secp256k1_ec_pubkey_create(context, &pubkey, sk.data()) == 1 && serialize(context, p, pubkey) ? p : 0;
     }
     
+    bool secret::to_public(const byte *secrets, size_t count, byte *out, bool compressed) {
+        size_t expected = compressed ? pubkey::CompressedSize : pubkey::UncompressedSize;
+        auto context = Signing();
+        for (size_t i = 0; i < count; i++) {
+            secp256k1_pubkey p;
+            size_t size = expected;
+            if (secp256k1_ec_pubkey_create(context, &p, secrets + i * Size) != 1 ||
+                secp256k1_ec_pubkey_serialize(context, out + i * expected, &size, &p,
+                    compressed ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED) != 1) return false;
+        }
+        
+        return true;
+    }
+    
+    bool secret::to_public_consecutive(const uint256 &first, size_t count, byte *out, bool compressed) {
+        if (count == 0) return true;
+        
+        // the secret 1, as secp256k1 reads it, whose pubkey is the generator.
+        byte one[Size] {};
+        one[Size - 1] = 1;
+        
+        auto context = Signing();
+        secp256k1_pubkey g;
+        secp256k1_pubkey p;
+        if (secp256k1_ec_pubkey_create(context, &g, one) != 1 ||
+            secp256k1_ec_pubkey_create(context, &p, first.data()) != 1) return false;
+        
+        size_t expected = compressed ? pubkey::CompressedSize : pubkey::UncompressedSize;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                const secp256k1_pubkey* keys[2] = {&p, &g};
+                secp256k1_pubkey next;
+                
+                // fails at the point at infinity, where the secret would be zero.
+                if (secp256k1_ec_pubkey_combine(Verification(), &next, keys, 2) != 1) return false;
+                p = next;
+            }
+            
+            size_t size = expected;
+            if (secp256k1_ec_pubkey_serialize(Verification(), out + i * expected, &size, &p,
+                compressed ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED) != 1) return false;
+        }
+        
+        return true;
+    }
+    
     bool parse(const secp256k1_context* context, secp256k1_pubkey& out, bytes_view pk) {
         return secp256k1_ec_pubkey_parse(context, &out, pk.data(), pk.size()) == 1;
     }
     
     bytes pubkey::compress(bytes_view pk) {
         if (pk.size() == pubkey::CompressedSize) return bytes{pk};
-        secp256k1_pubkey pubkey;
-        bytes p(pubkey::CompressedSize);
-        const auto context = Verification();
-        return parse(context, pubkey, pk) && serialize(context, p, pubkey) ? p : 0;
+        return parsed_pubkey{pk}.compress().serialize();
     }
     
     bytes pubkey::decompress(bytes_view pk) {
         if (pk.size() == pubkey::UncompressedSize) return bytes{pk};
-        secp256k1_pubkey pubkey;
-        bytes p(pubkey::UncompressedSize);
-        const auto context = Verification();
-        return parse(context, pubkey, pk) && serialize(context, p, pubkey) ? p : 0;
+        return parsed_pubkey{pk}.decompress().serialize();
     }
     
     coordinate pubkey::x() const {
@@ -287,35 +378,330 @@ namespace Gigamonkey::secp256k1 {
         return v;
     }
     
+    namespace {
+        
+        signature serialize(const secp256k1_context* context, const secp256k1_ecdsa_signature& x) {
+            signature sig{};
+            sig.resize(signature::MaxSize);
+            size_t size = sig.size();
+            secp256k1_ecdsa_signature_serialize_der(context, sig.data(), &size, &x);
+            sig.resize(size);
+            return sig;
+        }
+        
+    }
+    
     signature secret::sign(bytes_view sk, const digest& d) {
         secp256k1_ecdsa_signature x;
         auto context = Signing();
         if (secp256k1_ecdsa_sign(context, &x, d.Value.data(), sk.data(),
             secp256k1_nonce_function_rfc6979, nullptr) != 1) return {};
         
-        signature sig{};
-        sig.resize(signature::MaxSize);
-        size_t size = sig.size();
-        secp256k1_ecdsa_signature_serialize_der(context, sig.data(), &size, &x);
-        sig.resize(size);
-        return sig;
+        return serialize(context, x);
     }
     
-    bool verify_signature(const secp256k1_context* context,
-        const secp256k1_pubkey point, bytes_view hash,
-        const secp256k1_ecdsa_signature& s) {
+    namespace {
         
-        secp256k1_ecdsa_signature normal;
-        secp256k1_ecdsa_signature_normalize(context, &normal, &s);
-        return secp256k1_ecdsa_verify(context, &normal, hash.data(), &point) == 1;
+        // RFC 6979 as libsecp256k1 does it in secp256k1_nonce_function_rfc6979, which is
+        // HMAC-DRBG with SHA-256 seeded with the key and the message reduced mod n.
+        
+        const byte Zero[32]{};
+        
+        // a hasher that has taken in a 32-byte HMAC key padded to a block and xored with pad.
+        sha256::hasher padded(const byte* key, byte pad) {
+            byte block[64];
+            for (int i = 0; i < 32; i++) block[i] = key[i] ^ pad;
+            std::fill(block + 32, block + 64, pad);
+            sha256::hasher h{};
+            h.Write(block, 64);
+            return h;
+        }
+        
+        void finish(byte* out, const byte* key, sha256::hasher& inner) {
+            byte d[32];
+            inner.Finalize(d);
+            padded(key, 0x5c).Write(d, 32).Finalize(out);
+        }
+        
+        // HMAC-SHA256 with a 32-byte key of the concatenation of parts.
+        void hmac(byte* out, const byte* key, std::initializer_list<bytes_view> parts) {
+            byte k[32];
+            std::copy(key, key + 32, k);
+            sha256::hasher inner = padded(k, 0x36);
+            for (bytes_view x : parts) inner.Write(x.data(), x.size());
+            finish(out, k, inner);
+        }
+        
+        // the message as a big endian number mod n. Since n is more
+        // than half of 2^256, subtracting it once is enough.
+        void reduce(byte* out, const byte* msg) {
+            static const byte N[32]{
+                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+                0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41};
+            
+            std::copy(msg, msg + 32, out);
+            if (std::lexicographical_compare(msg, msg + 32, N, N + 32)) return;
+            
+            int borrow = 0;
+            for (int i = 31; i >= 0; i--) {
+                int diff = int(msg[i]) - int(N[i]) - borrow;
+                borrow = diff < 0;
+                out[i] = static_cast<byte>(diff + (borrow << 8));
+            }
+        }
+        
+        void wipe(byte* x, size_t size) {
+            volatile byte* v = x;
+            for (size_t i = 0; i < size; i++) v[i] = 0;
+        }
+        
+        // data is the midstate of a signing_key.
+        int precomputed_rfc6979(unsigned char* nonce32, const unsigned char* msg32, const unsigned char* key32,
+            const unsigned char* algo16, void* data, unsigned int attempt) {
+            // the midstate is only good for ecdsa without extra data.
+            if (algo16 != nullptr || data == nullptr)
+                return secp256k1_nonce_function_rfc6979(nonce32, msg32, key32, algo16, nullptr, attempt);
+            
+            const byte zero = 0x00;
+            const byte one = 0x01;
+            
+            byte msg[32];
+            reduce(msg, msg32);
+            
+            byte K[32];
+            byte V[32];
+            std::fill(V, V + 32, 0x01);
+            
+            // K = HMAC_K(V || 0x00 || key || msg), where K is all zeros, which
+            // the midstate has already done up to the last byte of the key.
+            sha256::hasher inner{*static_cast<const sha256::state*>(data), 128};
+            inner.Write(key32 + 31, 1).Write(msg, 32);
+            finish(K, Zero, inner);
+            
+            hmac(V, K, {bytes_view{V, 32}});
+            hmac(K, K, {bytes_view{V, 32}, bytes_view{&one, 1}, bytes_view{key32, 32}, bytes_view{msg, 32}});
+            hmac(V, K, {bytes_view{V, 32}});
+            
+            // each attempt after the first generates again.
+            for (unsigned int i = 0; i <= attempt; i++) {
+                if (i > 0) {
+                    hmac(K, K, {bytes_view{V, 32}, bytes_view{&zero, 1}});
+                    hmac(V, K, {bytes_view{V, 32}});
+                }
+                
+                hmac(V, K, {bytes_view{V, 32}});
+            }
+            
+            std::copy(V, V + 32, nonce32);
+            wipe(K, 32);
+            wipe(V, 32);
+            wipe(msg, 32);
+            return 1;
+        }
+        
+    }
+    
+    signing_key::signing_key(const secret& s) : Secret{}, Midstate{sha256::initial()}, Valid{false} {
+        std::copy(s.Value.begin(), s.Value.end(), Secret.begin());
+        if (secp256k1_ec_seckey_verify(Verification(), Secret.data()) != 1) return;
+        
+        byte block[64];
+        std::fill(block, block + 64, 0x36);
+        sha256::transform(Midstate, block, 1);
+        
+        std::fill(block, block + 32, 0x01);
+        block[32] = 0x00;
+        std::copy(Secret.begin(), Secret.begin() + 31, block + 33);
+        sha256::transform(Midstate, block, 1);
+        wipe(block, 64);
+        
+        Valid = true;
+    }
+    
+    signing_key::~signing_key() {
+        wipe(Secret.data(), Secret.size());
+        wipe(reinterpret_cast<byte*>(Midstate.data()), sizeof(Midstate));
+    }
+    
+    signature signing_key::sign(const digest& d) const {
+        if (!Valid) return {};
+        
+        secp256k1_ecdsa_signature x;
+        auto context = Signing();
+        if (secp256k1_ecdsa_sign(context, &x, d.Value.data(), Secret.data(), precomputed_rfc6979, &Midstate) != 1) return {};
+        
+        return serialize(context, x);
+    }
+    
+    std::vector<signature> signing_key::sign(std::span<const digest> d, executor* e) const {
+        std::vector<signature> x(d.size());
+        auto f = [this, &x, d](size_t i) {
+            x[i] = sign(d[i]);
+        };
+        
+        if (e == nullptr) for (size_t i = 0; i < d.size(); i++) f(i);
+        else e->parallel_for(d.size(), f);
+        return x;
     }
     
     bool pubkey::verify(bytes_view pk, const digest& d, bytes_view s) {
-        secp256k1_pubkey pubkey;
+        return parsed_pubkey{pk}.verify(d, s);
+    }
+    
+    static_assert(sizeof(secp256k1_ecdsa_signature) == 64 && sizeof(secp256k1_pubkey) == 64);
+    
+    parsed_signature::parsed_signature(bytes_view der) : Data{}, Valid{false}, StrictDER{false}, LowS{false} {
         const auto context = Verification();
         secp256k1_ecdsa_signature parsed;
-        secp256k1_ecdsa_signature_parse_der(context, &parsed, s.data(), s.size());
-        return parse(context, pubkey, pk) && verify_signature(context, pubkey, d, parsed);
+        if (secp256k1_ecdsa_signature_parse_der(context, &parsed, der.data(), der.size()) != 1) return;
+        
+        secp256k1_ecdsa_signature normal;
+        secp256k1_ecdsa_signature_normalize(context, &normal, &parsed);
+        std::memcpy(Data.data(), &normal, Data.size());
+        Valid = true;
+    }
+    
+    parsed_signature parsed_signature::strict(bytes_view x) {
+        parsed_signature p{};
+        if (!signature::minimal(x)) return p;
+        p.StrictDER = true;
+        
+        size_t r_size = x[3];
+        size_t s_size = x[5 + r_size];
+        bytes_view r = x.substr(4, r_size);
+        bytes_view s = x.substr(6 + r_size, s_size);
+        
+        // since the encoding is minimal, a number only begins with zero if it would be negative without it.
+        if (r[0] == 0) r = r.substr(1);
+        if (s[0] == 0) s = s.substr(1);
+        
+        // a number that is out of range is read as zero by ecdsa_signature_parse_der_lax,
+        // so S is low, as in normalized, and the signature can't be verified.
+        p.LowS = true;
+        if (r.size() > 32 || s.size() > 32) return p;
+        
+        byte compact[64]{};
+        std::copy(r.begin(), r.end(), compact + 32 - r.size());
+        std::copy(s.begin(), s.end(), compact + 64 - s.size());
+        
+        const auto context = Verification();
+        secp256k1_ecdsa_signature parsed;
+        if (secp256k1_ecdsa_signature_parse_compact(context, &parsed, compact) != 1) return p;
+        
+        secp256k1_ecdsa_signature normal;
+        p.LowS = secp256k1_ecdsa_signature_normalize(context, &normal, &parsed) == 0;
+        std::memcpy(p.Data.data(), &normal, p.Data.size());
+        p.Valid = true;
+        return p;
+    }
+    
+    namespace {
+        
+        void load(secp256k1_pubkey& out, const std::array<byte, 64>& data) {
+            std::memcpy(&out, data.data(), data.size());
+        }
+        
+        void store(std::array<byte, 64>& data, const secp256k1_pubkey& in) {
+            std::memcpy(data.data(), &in, data.size());
+        }
+        
+        // apply an operation from libsecp256k1 to a parsed point in place.
+        template <typename F>
+        bool modify(std::array<byte, 64>& data, F f) {
+            secp256k1_pubkey p;
+            load(p, data);
+            if (f(p) != 1) return false;
+            store(data, p);
+            return true;
+        }
+        
+    }
+    
+    parsed_pubkey::parsed_pubkey(bytes_view pk) : Data{}, Valid{false}, Compressed{pk.size() == pubkey::CompressedSize} {
+        secp256k1_pubkey p;
+        if (!parse(Verification(), p, pk)) return;
+        store(Data, p);
+        Valid = true;
+    }
+    
+    bool parsed_pubkey::verify(const digest& d, const parsed_signature& s) const {
+        if (!Valid || !s.Valid) return false;
+        
+        secp256k1_pubkey p;
+        secp256k1_ecdsa_signature sig;
+        load(p, Data);
+        std::memcpy(&sig, s.Data.data(), s.Data.size());
+        return secp256k1_ecdsa_verify(Verification(), &sig, d.Value.data(), &p) == 1;
+    }
+    
+    bool parsed_pubkey::verify(const digest& d, bytes_view sig) const {
+        return Valid && verify(d, parsed_signature{sig});
+    }
+    
+    parsed_pubkey parsed_pubkey::compress() const {
+        parsed_pubkey x{*this};
+        x.Compressed = true;
+        return x;
+    }
+    
+    parsed_pubkey parsed_pubkey::decompress() const {
+        parsed_pubkey x{*this};
+        x.Compressed = false;
+        return x;
+    }
+    
+    parsed_pubkey parsed_pubkey::operator-() const {
+        parsed_pubkey x{*this};
+        x.Valid = Valid && modify(x.Data, [](secp256k1_pubkey& p) {
+            return secp256k1_ec_pubkey_negate(Verification(), &p);
+        });
+        return x;
+    }
+    
+    parsed_pubkey parsed_pubkey::operator+(const parsed_pubkey& b) const {
+        parsed_pubkey x{*this};
+        x.Valid = Valid && b.Valid && modify(x.Data, [&b](secp256k1_pubkey& p) {
+            secp256k1_pubkey q;
+            load(q, b.Data);
+            const secp256k1_pubkey* keys[2] = {&p, &q};
+            secp256k1_pubkey sum;
+            if (secp256k1_ec_pubkey_combine(Verification(), &sum, keys, 2) != 1) return 0;
+            p = sum;
+            return 1;
+        });
+        return x;
+    }
+    
+    parsed_pubkey parsed_pubkey::operator+(const uint256& sk) const {
+        parsed_pubkey x{*this};
+        x.Valid = Valid && modify(x.Data, [&sk](secp256k1_pubkey& p) {
+            return secp256k1_ec_pubkey_tweak_add(Verification(), &p, sk.data());
+        });
+        return x;
+    }
+    
+    parsed_pubkey parsed_pubkey::operator*(const uint256& sk) const {
+        parsed_pubkey x{*this};
+        x.Valid = Valid && modify(x.Data, [&sk](secp256k1_pubkey& p) {
+            return secp256k1_ec_pubkey_tweak_mul(Verification(), &p, sk.data());
+        });
+        return x;
+    }
+    
+    bool parsed_pubkey::serialize(byte* out) const {
+        if (!Valid) return false;
+        secp256k1_pubkey p;
+        load(p, Data);
+        size_t expected = Compressed ? pubkey::CompressedSize : pubkey::UncompressedSize;
+        size_t size = expected;
+        return secp256k1_ec_pubkey_serialize(Verification(), out, &size, &p,
+            Compressed ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED) == 1 && size == expected;
+    }
+    
+    pubkey parsed_pubkey::serialize() const {
+        bytes p(Compressed ? pubkey::CompressedSize : pubkey::UncompressedSize);
+        if (!serialize(p.data())) return pubkey{};
+        return pubkey{std::move(p)};
     }
     
     uint256 secret::negate(const uint256& sk) {
@@ -324,54 +710,44 @@ namespace Gigamonkey::secp256k1 {
     }
     
     bytes pubkey::negate(bytes_view pk) {
-        const auto context = Verification();
-        secp256k1_pubkey pubkey;
-        bytes out = bytes(pk.size());
-        return parse(context, pubkey, pk) &&
-            secp256k1_ec_pubkey_negate(context, &pubkey) == 1 &&
-            serialize(context, out, pubkey) ? out : 0;
+        return (-parsed_pubkey{pk}).serialize();
     }
     
     uint256 secret::plus(const uint256& sk_a, const uint256& sk_b) {
         const auto context = Verification();
         coordinate out{sk_a};
-        return secp256k1_ec_seckey_tweak_add(context, out.data(), sk_b.data()) == 1;
+        return secp256k1_ec_seckey_tweak_add(context, out.data(), sk_b.data()) == 1 ? out : 0;
     }
     
     uint256 secret::times(const uint256& sk_a, const uint256& sk_b) {
         const auto context = Verification();
         coordinate out{sk_a};
-        return secp256k1_ec_seckey_tweak_mul(context, out.data(), sk_b.data()) == 1;
+        return secp256k1_ec_seckey_tweak_mul(context, out.data(), sk_b.data()) == 1 ? out : 0;
     }
     
     bytes pubkey::plus_pubkey(const bytes_view pk_a, bytes_view pk_b) {
-        const auto context = Verification();
-        secp256k1_pubkey pubkey;
-        secp256k1_pubkey b;
-        secp256k1_pubkey* keys[1];
-        keys[0] = &b;
-        if (!parse(context, b, pk_b)) return 0;
-        
-        bytes out = bytes(pk_a.size());
-        return secp256k1_ec_pubkey_combine(context, &pubkey, keys, 1) == 1 && serialize(context, out, pubkey) ? out : 0;
+        return (parsed_pubkey{pk_a} + parsed_pubkey{pk_b}).serialize();
     }
     
     bytes pubkey::plus_secret(const bytes_view pk, const uint256& sk) {
-        const auto context = Verification();
-        bytes out = bytes(pk.size());
-        secp256k1_pubkey pubkey;
-        return parse(context, pubkey, pk) &&
-            secp256k1_ec_pubkey_tweak_add(context, &pubkey, sk.data()) == 1 &&
-            serialize(context, out, pubkey) ? out : 0;
+        return (parsed_pubkey{pk} + sk).serialize();
+    }
+    
+    bool pubkey::plus_secrets(const bytes_view pk, const uint256 *sk, size_t count, byte *out) {
+        parsed_pubkey base{pk};
+        if (!base.valid()) return false;
+        
+        for (size_t i = 0; i < count; i++)
+            if (!(base + sk[i]).serialize(out + i * pk.size())) return false;
+        
+        return true;
     }
     
     bytes pubkey::times(const bytes_view pk, bytes_view sk) {
-        const auto context = Verification();
-        bytes out{pk};
-        secp256k1_pubkey pubkey;
-        return parse(context, pubkey, pk) &&
-            secp256k1_ec_pubkey_tweak_mul(context, &pubkey, sk.data()) == 1 &&
-            serialize(context, out, pubkey) ? out : 0;
+        if (sk.size() != secret::Size) return {};
+        uint256 x;
+        std::copy(sk.begin(), sk.end(), x.begin());
+        return (parsed_pubkey{pk} * x).serialize();
     }
     
 }
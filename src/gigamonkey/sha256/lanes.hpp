@@ -0,0 +1,209 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SHA256_LANES
+#define GIGAMONKEY_SHA256_LANES
+
+#include <gigamonkey/sha256.hpp>
+
+#include <bit>
+
+// SHA-256 on several messages at once, written with compiler vector extensions.
+// Each lane of a vector holds a word of a different message. This file is
+// included by translation units that are compiled with different instruction
+// sets, so everything here has internal linkage.
+namespace Gigamonkey::sha256 {
+    
+    extern const uint32 K[64];
+    
+    namespace {
+        
+        template <typename V> constexpr size_t width = sizeof (V) / sizeof (uint32);
+        
+        template <typename V> inline V splat (uint32 x) {
+            return V {} + x;
+        }
+        
+        template <typename V> inline V rotate (V x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+        
+        inline uint32 read_big (const byte *b) {
+            return (uint32 (b[0]) << 24) | (uint32 (b[1]) << 16) | (uint32 (b[2]) << 8) | uint32 (b[3]);
+        }
+        
+        inline void write_big (byte *b, uint32 x) {
+            b[0] = byte (x >> 24);
+            b[1] = byte (x >> 16);
+            b[2] = byte (x >> 8);
+            b[3] = byte (x);
+        }
+        
+        // the 64 rounds of SHA-256, where word (i) is word i of the message schedule.
+        template <typename V, typename F> inline void rounds (V s[8], F word) {
+            V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+            
+            for (int i = 0; i < 64; i++) {
+                V t1 = h + (rotate (e, 6) ^ rotate (e, 11) ^ rotate (e, 25)) + (g ^ (e & (f ^ g))) + word (i);
+                V t2 = (rotate (a, 2) ^ rotate (a, 13) ^ rotate (a, 22)) + ((a & b) | (c & (a | b)));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            
+            s[0] += a;
+            s[1] += b;
+            s[2] += c;
+            s[3] += d;
+            s[4] += e;
+            s[5] += f;
+            s[6] += g;
+            s[7] += h;
+        }
+        
+        template <typename V> void transform (V s[8], V w[16]) {
+            rounds (s, [w] (int i) -> V {
+                if (i >= 16) {
+                    V w2 = w[(i - 2) & 15];
+                    V w15 = w[(i - 15) & 15];
+                    w[i & 15] += (rotate (w2, 17) ^ rotate (w2, 19) ^ (w2 >> 10)) + w[(i - 7) & 15] +
+                        (rotate (w15, 7) ^ rotate (w15, 18) ^ (w15 >> 3));
+                }
+                
+                return splat<V> (K[i]) + w[i & 15];
+            });
+        }
+        
+        // The message schedule of a block that is all padding, which is what follows
+        // every 64-byte message. It never changes, so it is worked out at compile time.
+        struct padding_schedule {
+            uint32 W[64];
+            
+            constexpr padding_schedule (uint64 bits) : W {} {
+                W[0] = 0x80000000;
+                W[14] = uint32 (bits >> 32);
+                W[15] = uint32 (bits);
+                for (int i = 16; i < 64; i++) W[i] = W[i - 16] + W[i - 7] +
+                    (std::rotr (W[i - 2], 17) ^ std::rotr (W[i - 2], 19) ^ (W[i - 2] >> 10)) +
+                    (std::rotr (W[i - 15], 7) ^ std::rotr (W[i - 15], 18) ^ (W[i - 15] >> 3));
+            }
+        };
+        
+        constexpr padding_schedule padding_64 {64 * 8};
+        
+        // transform the padding block of a 64-byte message.
+        template <typename V> void transform_padding_64 (V s[8]) {
+            rounds (s, [] (int i) -> V {
+                return splat<V> (K[i] + padding_64.W[i]);
+            });
+        }
+        
+        // write the digests given by the states in s to out.
+        template <typename V> void write_digests (byte *out, V s[8]) {
+            for (size_t l = 0; l < width<V>; l++) for (int i = 0; i < 8; i++) write_big (out + 32 * l + 4 * i, s[i][l]);
+        }
+        
+        // hash the digests given by the states in s again and write the results to out.
+        template <typename V> void second_hash (byte *out, V s[8]) {
+            V w[16];
+            for (int i = 0; i < 8; i++) w[i] = s[i];
+            w[8] = splat<V> (0x80000000);
+            for (int i = 9; i < 15; i++) w[i] = V {};
+            w[15] = splat<V> (32 * 8);
+            
+            V t[8];
+            for (int i = 0; i < 8; i++) t[i] = splat<V> (initial ()[i]);
+            
+            transform (t, w);
+            write_digests (out, t);
+        }
+        
+        // hash the last 16 bytes of each 80-byte message, given the state after the
+        // first 64 bytes, then hash the result again and write the digests to out.
+        template <typename V> void finish_80 (byte *out, V s[8], const byte *tails, size_t stride) {
+            V w[16];
+            
+            for (int i = 0; i < 4; i++) for (size_t l = 0; l < width<V>; l++) w[i][l] = read_big (tails + stride * l + 4 * i);
+            w[4] = splat<V> (0x80000000);
+            for (int i = 5; i < 15; i++) w[i] = V {};
+            w[15] = splat<V> (80 * 8);
+            
+            transform (s, w);
+            second_hash (out, s);
+        }
+        
+        // double hash width<V> consecutive 80-byte messages.
+        template <typename V> void parallel_double_hash_80 (byte *out, const byte *in) {
+            V s[8];
+            for (int i = 0; i < 8; i++) s[i] = splat<V> (initial ()[i]);
+            
+            V w[16];
+            for (int i = 0; i < 16; i++) for (size_t l = 0; l < width<V>; l++) w[i][l] = read_big (in + 80 * l + 4 * i);
+            
+            transform (s, w);
+            finish_80 (out, s, in + 64, 80);
+        }
+        
+        // double hash width<V> consecutive 64-byte messages, such as two digests in a Merkle tree.
+        template <typename V> void parallel_double_hash_64 (byte *out, const byte *in) {
+            V s[8];
+            for (int i = 0; i < 8; i++) s[i] = splat<V> (initial ()[i]);
+            
+            V w[16];
+            for (int i = 0; i < 16; i++) for (size_t l = 0; l < width<V>; l++) w[i][l] = read_big (in + 64 * l + 4 * i);
+            
+            transform (s, w);
+            
+            // the second block is all padding.
+            transform_padding_64 (s);
+            second_hash (out, s);
+        }
+        
+        // hash width<V> consecutive messages of the same size, which must be less than 56
+        // so that each message and its padding fit in one block. The states are left in s.
+        template <typename V> void first_hash_short (V s[8], const byte *in, size_t size) {
+            for (int i = 0; i < 8; i++) s[i] = splat<V> (initial ()[i]);
+            
+            V w[16];
+            for (size_t l = 0; l < width<V>; l++) {
+                byte block[64] {};
+                std::copy (in + size * l, in + size * (l + 1), block);
+                block[size] = 0x80;
+                block[62] = byte ((size * 8) >> 8);
+                block[63] = byte (size * 8);
+                for (int i = 0; i < 16; i++) w[i][l] = read_big (block + 4 * i);
+            }
+            
+            transform (s, w);
+        }
+        
+        // hash width<V> short messages once, as for the first half of Hash160.
+        template <typename V> void parallel_hash_short (byte *out, const byte *in, size_t size) {
+            V s[8];
+            first_hash_short (s, in, size);
+            write_digests (out, s);
+        }
+        
+        template <typename V> void parallel_double_hash_short (byte *out, const byte *in, size_t size) {
+            V s[8];
+            first_hash_short (s, in, size);
+            second_hash (out, s);
+        }
+        
+        // double hash width<V> 80-byte messages with a common midstate.
+        template <typename V> void parallel_double_hash_80 (byte *out, const state &midstate, const byte *tails) {
+            V s[8];
+            for (int i = 0; i < 8; i++) s[i] = splat<V> (midstate[i]);
+            finish_80 (out, s, tails, 16);
+        }
+        
+    }
+    
+}
+
+#endif
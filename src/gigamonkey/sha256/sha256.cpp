@@ -0,0 +1,463 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "lanes.hpp"
+#include <gigamonkey/metrics.hpp>
+
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace Gigamonkey::sha256 {
+    
+    const uint32 K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    
+    const state &initial () {
+        static const state Initial {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        return Initial;
+    }
+
+#ifdef GIGAMONKEY_ENABLE_AVX2
+    namespace avx2 {
+        void double_hash_80 (byte *out, const byte *in);
+        void double_hash_80 (byte *out, const state &midstate, const byte *tails);
+        void double_hash_64 (byte *out, const byte *in);
+        void double_hash_short (byte *out, const byte *in, size_t size);
+        void hash_short (byte *out, const byte *in, size_t size);
+    }
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_AVX512
+    namespace avx512 {
+        void double_hash_80 (byte *out, const byte *in);
+        void double_hash_80 (byte *out, const state &midstate, const byte *tails);
+        void double_hash_64 (byte *out, const byte *in);
+        void double_hash_short (byte *out, const byte *in, size_t size);
+        void hash_short (byte *out, const byte *in, size_t size);
+    }
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_SHANI
+    namespace shani {
+        void transform (uint32 *s, const byte *blocks, size_t count);
+    }
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_ARMV8
+    namespace armv8 {
+        void transform (uint32 *s, const byte *blocks, size_t count);
+    }
+#endif
+
+#if defined(GIGAMONKEY_ENABLE_SHANI) || defined(GIGAMONKEY_ENABLE_ARMV8)
+#define GIGAMONKEY_ENABLE_SERIAL
+#endif
+    
+    namespace {
+        
+        using one = uint32 __attribute__ ((vector_size (4)));
+        using four = uint32 __attribute__ ((vector_size (16)));
+        
+        bool detect (implementation x) {
+#if defined(__x86_64__) || defined(__i386__)
+            switch (x) {
+                case implementation::generic: return true;
+                case implementation::avx2: return __builtin_cpu_supports ("avx2");
+                case implementation::avx512: return __builtin_cpu_supports ("avx512f");
+                case implementation::shani: {
+                    // gcc does not know about sha in __builtin_cpu_supports, so we ask cpuid.
+                    unsigned int a, b, c, d;
+                    if (!__get_cpuid_count (7, 0, &a, &b, &c, &d)) return false;
+                    return ((b >> 29) & 1) && __builtin_cpu_supports ("sse4.1");
+                }
+                default: return false;
+            }
+#elif defined(__aarch64__)
+            switch (x) {
+                case implementation::generic: return true;
+                case implementation::armv8: {
+#if defined(__linux__)
+                    return (getauxval (AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif defined(__APPLE__)
+                    // every 64-bit Apple cpu has them.
+                    return true;
+#else
+                    return false;
+#endif
+                }
+                default: return false;
+            }
+#else
+            return x == implementation::generic;
+#endif
+        }
+        
+        bool built (implementation x) {
+            switch (x) {
+                case implementation::generic: return true;
+#ifdef GIGAMONKEY_ENABLE_AVX2
+                case implementation::avx2: return true;
+#endif
+#ifdef GIGAMONKEY_ENABLE_AVX512
+                case implementation::avx512: return true;
+#endif
+#ifdef GIGAMONKEY_ENABLE_SHANI
+                case implementation::shani: return true;
+#endif
+#ifdef GIGAMONKEY_ENABLE_ARMV8
+                case implementation::armv8: return true;
+#endif
+                default: return false;
+            }
+        }
+        
+        void generic_transform (state &s, const byte *blocks, size_t count) {
+            one v[8];
+            for (int i = 0; i < 8; i++) v[i] = splat<one> (s[i]);
+            while (count--) {
+                one w[16];
+                for (int i = 0; i < 16; i++) w[i] = splat<one> (read_big (blocks + 4 * i));
+                transform (v, w);
+                blocks += 64;
+            }
+            for (int i = 0; i < 8; i++) s[i] = v[i][0];
+        }
+
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        // A function that transforms blocks one message at a time using special
+        // instructions, which is shani::transform or armv8::transform.
+        using serial = void (*) (uint32 *s, const byte *blocks, size_t count);
+        
+        // the padding block of a 64-byte message, so that the message need not be copied.
+        constexpr byte padding_block_64[64] {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, byte ((64 * 8) >> 8), byte (64 * 8)};
+        
+        // hash the digest given by the state again and write the result to out.
+        void serial_second_hash (serial T, byte *out, const state &s) {
+            byte second[64] {};
+            for (int i = 0; i < 8; i++) write_big (second + 4 * i, s[i]);
+            second[32] = 0x80;
+            second[62] = byte ((32 * 8) >> 8);
+            second[63] = byte (32 * 8);
+            
+            state t = initial ();
+            T (t.data (), second, 1);
+            for (int i = 0; i < 8; i++) write_big (out + 4 * i, t[i]);
+        }
+        
+        // finish an 80-byte message, given the state after the first 64 bytes.
+        void serial_finish_80 (serial T, byte *out, state s, const byte *tail) {
+            byte block[64] {};
+            std::copy (tail, tail + 16, block);
+            block[16] = 0x80;
+            block[62] = byte ((80 * 8) >> 8);
+            block[63] = byte (80 * 8);
+            T (s.data (), block, 1);
+            serial_second_hash (T, out, s);
+        }
+        
+        void serial_double_hash_80 (serial T, byte *out, const byte *in) {
+            state s = initial ();
+            T (s.data (), in, 1);
+            serial_finish_80 (T, out, s, in + 64);
+        }
+        
+        void serial_double_hash_64 (serial T, byte *out, const byte *in) {
+            state s = initial ();
+            T (s.data (), in, 1);
+            T (s.data (), padding_block_64, 1);
+            serial_second_hash (T, out, s);
+        }
+        
+        state serial_first_hash_short (serial T, const byte *in, size_t size) {
+            byte block[64] {};
+            std::copy (in, in + size, block);
+            block[size] = 0x80;
+            block[62] = byte ((size * 8) >> 8);
+            block[63] = byte (size * 8);
+            
+            state s = initial ();
+            T (s.data (), block, 1);
+            return s;
+        }
+        
+        void serial_hash_short (serial T, byte *out, const byte *in, size_t size) {
+            state s = serial_first_hash_short (T, in, size);
+            for (int i = 0; i < 8; i++) write_big (out + 4 * i, s[i]);
+        }
+        
+        void serial_double_hash_short (serial T, byte *out, const byte *in, size_t size) {
+            serial_second_hash (T, out, serial_first_hash_short (T, in, size));
+        }
+        
+        // The special instructions that are used for whatever is left over after the
+        // vector implementations, if the cpu has them. nullptr if it has none.
+        serial serial_transform (implementation x) {
+#ifdef GIGAMONKEY_ENABLE_SHANI
+            if (x == implementation::shani || (x != implementation::generic && supported (implementation::shani))) return shani::transform;
+#endif
+#ifdef GIGAMONKEY_ENABLE_ARMV8
+            if (x == implementation::armv8 || (x != implementation::generic && supported (implementation::armv8))) return armv8::transform;
+#endif
+            return nullptr;
+        }
+#endif
+        
+    }
+    
+    const char *name (implementation x) {
+        switch (x) {
+            case implementation::generic: return "generic";
+            case implementation::avx2: return "avx2";
+            case implementation::shani: return "shani";
+            case implementation::avx512: return "avx512";
+            case implementation::armv8: return "armv8";
+            default: return "unknown";
+        }
+    }
+    
+    bool supported (implementation x) {
+        static const std::array<bool, 5> Supported {
+            built (implementation::generic) && detect (implementation::generic),
+            built (implementation::avx2) && detect (implementation::avx2),
+            built (implementation::shani) && detect (implementation::shani),
+            built (implementation::avx512) && detect (implementation::avx512),
+            built (implementation::armv8) && detect (implementation::armv8)};
+        return byte (x) < Supported.size () && Supported[byte (x)];
+    }
+    
+    implementation best () {
+        static const implementation Best = [] () -> implementation {
+            if (supported (implementation::avx512)) return implementation::avx512;
+            if (supported (implementation::avx2)) return implementation::avx2;
+            if (supported (implementation::shani)) return implementation::shani;
+            if (supported (implementation::armv8)) return implementation::armv8;
+            return implementation::generic;
+        } ();
+        return Best;
+    }
+    
+    implementation best_single () {
+        static const implementation Best = [] () -> implementation {
+            if (supported (implementation::shani)) return implementation::shani;
+            if (supported (implementation::armv8)) return implementation::armv8;
+            return implementation::generic;
+        } ();
+        return Best;
+    }
+    
+    size_t lanes (implementation x) {
+        switch (x) {
+            case implementation::generic: return 4;
+            case implementation::avx2: return 8;
+            case implementation::avx512: return 16;
+            default: return 1;
+        }
+    }
+    
+    void transform (state &s, const byte *blocks, size_t count) {
+        using function = void (*) (state &, const byte *, size_t);
+        
+        // chosen once, the first time that anything is hashed.
+        static const function Transform = [] () -> function {
+#ifdef GIGAMONKEY_ENABLE_SHANI
+            if (best_single () == implementation::shani) return [] (state &s, const byte *blocks, size_t count) {
+                shani::transform (s.data (), blocks, count);
+            };
+#endif
+#ifdef GIGAMONKEY_ENABLE_ARMV8
+            if (best_single () == implementation::armv8) return [] (state &s, const byte *blocks, size_t count) {
+                armv8::transform (s.data (), blocks, count);
+            };
+#endif
+            return generic_transform;
+        } ();
+        
+        Transform (s, blocks, count);
+    }
+    
+    hasher &hasher::Write (const byte *data, size_t size) {
+        size_t buffered = Size % 64;
+        Size += size;
+        
+        if (buffered != 0) {
+            size_t fill = std::min (size, 64 - buffered);
+            std::copy (data, data + fill, Buffer + buffered);
+            data += fill;
+            size -= fill;
+            if (buffered + fill < 64) return *this;
+            transform (State, Buffer, 1);
+        }
+        
+        // whole blocks are transformed where they are, without copying them.
+        if (size >= 64) {
+            transform (State, data, size / 64);
+            data += size - size % 64;
+            size %= 64;
+        }
+        
+        std::copy (data, data + size, Buffer);
+        return *this;
+    }
+    
+    void hasher::Finalize (byte *out) {
+        uint64 bits = Size * 8;
+        size_t buffered = Size % 64;
+        
+        byte padding[128] {};
+        std::copy (Buffer, Buffer + buffered, padding);
+        padding[buffered] = 0x80;
+        
+        size_t blocks = buffered < 56 ? 1 : 2;
+        for (int i = 0; i < 8; i++) padding[64 * blocks - 1 - i] = byte (bits >> (8 * i));
+        transform (State, padding, blocks);
+        
+        for (int i = 0; i < 8; i++) write_big (out + 4 * i, State[i]);
+    }
+    
+    void double_hash_80 (byte *out, const byte *in, size_t count, implementation x) {
+        metrics::count (metrics::hashes, count);
+        if (!supported (x)) x = implementation::generic;
+
+#ifdef GIGAMONKEY_ENABLE_AVX512
+        if (x == implementation::avx512) for (; count >= 16; count -= 16, in += 80 * 16, out += 32 * 16)
+            avx512::double_hash_80 (out, in);
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_AVX2
+        if (x == implementation::avx2 || x == implementation::avx512) for (; count >= 8; count -= 8, in += 80 * 8, out += 32 * 8)
+            avx2::double_hash_80 (out, in);
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        // whatever is left over is done one at a time if we have the sha instructions.
+        if (serial T = serial_transform (x)) {
+            for (; count > 0; count--, in += 80, out += 32) serial_double_hash_80 (T, out, in);
+            return;
+        }
+#endif
+        
+        for (; count >= 4; count -= 4, in += 80 * 4, out += 32 * 4) parallel_double_hash_80<four> (out, in);
+        for (; count > 0; count--, in += 80, out += 32) parallel_double_hash_80<one> (out, in);
+    }
+    
+    void double_hash_80 (byte *out, const state &midstate, const byte *tails, size_t count, implementation x) {
+        metrics::count (metrics::hashes, count);
+        if (!supported (x)) x = implementation::generic;
+
+#ifdef GIGAMONKEY_ENABLE_AVX512
+        if (x == implementation::avx512) for (; count >= 16; count -= 16, tails += 16 * 16, out += 32 * 16)
+            avx512::double_hash_80 (out, midstate, tails);
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_AVX2
+        if (x == implementation::avx2 || x == implementation::avx512) for (; count >= 8; count -= 8, tails += 16 * 8, out += 32 * 8)
+            avx2::double_hash_80 (out, midstate, tails);
+#endif
+
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        if (serial T = serial_transform (x)) {
+            for (; count > 0; count--, tails += 16, out += 32) serial_finish_80 (T, out, midstate, tails);
+            return;
+        }
+#endif
+        
+        for (; count >= 4; count -= 4, tails += 16 * 4, out += 32 * 4) parallel_double_hash_80<four> (out, midstate, tails);
+        for (; count > 0; count--, tails += 16, out += 32) parallel_double_hash_80<one> (out, midstate, tails);
+    }
+    
+    void double_hash_64 (byte *out, const byte *in, size_t count, implementation x) {
+        metrics::count (metrics::hashes, count);
+        if (!supported (x)) x = implementation::generic;
+        
+#ifdef GIGAMONKEY_ENABLE_AVX512
+        if (x == implementation::avx512) for (; count >= 16; count -= 16, in += 64 * 16, out += 32 * 16)
+            avx512::double_hash_64 (out, in);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_AVX2
+        if (x == implementation::avx2 || x == implementation::avx512) for (; count >= 8; count -= 8, in += 64 * 8, out += 32 * 8)
+            avx2::double_hash_64 (out, in);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        if (serial T = serial_transform (x)) {
+            for (; count > 0; count--, in += 64, out += 32) serial_double_hash_64 (T, out, in);
+            return;
+        }
+#endif
+        
+        for (; count >= 4; count -= 4, in += 64 * 4, out += 32 * 4) parallel_double_hash_64<four> (out, in);
+        for (; count > 0; count--, in += 64, out += 32) parallel_double_hash_64<one> (out, in);
+    }
+    
+    void double_hash_short (byte *out, const byte *in, size_t size, size_t count, implementation x) {
+        if (size > 55) throw std::invalid_argument {"message is too big to fit in one block"};
+        metrics::count (metrics::hashes, count);
+        if (!supported (x)) x = implementation::generic;
+        
+#ifdef GIGAMONKEY_ENABLE_AVX512
+        if (x == implementation::avx512) for (; count >= 16; count -= 16, in += size * 16, out += 32 * 16)
+            avx512::double_hash_short (out, in, size);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_AVX2
+        if (x == implementation::avx2 || x == implementation::avx512) for (; count >= 8; count -= 8, in += size * 8, out += 32 * 8)
+            avx2::double_hash_short (out, in, size);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        if (serial T = serial_transform (x)) {
+            for (; count > 0; count--, in += size, out += 32) serial_double_hash_short (T, out, in, size);
+            return;
+        }
+#endif
+        
+        for (; count >= 4; count -= 4, in += size * 4, out += 32 * 4) parallel_double_hash_short<four> (out, in, size);
+        for (; count > 0; count--, in += size, out += 32) parallel_double_hash_short<one> (out, in, size);
+    }
+    
+    void hash_short (byte *out, const byte *in, size_t size, size_t count, implementation x) {
+        if (size > 55) throw std::invalid_argument {"message is too big to fit in one block"};
+        metrics::count (metrics::hashes, count);
+        if (!supported (x)) x = implementation::generic;
+        
+#ifdef GIGAMONKEY_ENABLE_AVX512
+        if (x == implementation::avx512) for (; count >= 16; count -= 16, in += size * 16, out += 32 * 16)
+            avx512::hash_short (out, in, size);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_AVX2
+        if (x == implementation::avx2 || x == implementation::avx512) for (; count >= 8; count -= 8, in += size * 8, out += 32 * 8)
+            avx2::hash_short (out, in, size);
+#endif
+        
+#ifdef GIGAMONKEY_ENABLE_SERIAL
+        if (serial T = serial_transform (x)) {
+            for (; count > 0; count--, in += size, out += 32) serial_hash_short (T, out, in, size);
+            return;
+        }
+#endif
+        
+        for (; count >= 4; count -= 4, in += size * 4, out += 32 * 4) parallel_hash_short<four> (out, in, size);
+        for (; count > 0; count--, in += size, out += 32) parallel_hash_short<one> (out, in, size);
+    }
+
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -march=armv8-a+crypto
+// Based on the ARMv8 cryptography extensions implementation in Bitcoin Core.
+
+#include <gigamonkey/sha256.hpp>
+#include <arm_neon.h>
+
+namespace Gigamonkey::sha256 {
+    extern const uint32 K[64];
+}
+
+namespace Gigamonkey::sha256::armv8 {
+    
+    // unlike the Intel instructions, these take the state in its usual order.
+    void transform (uint32 *s, const byte *blocks, size_t count) {
+        uint32x4_t s0 = vld1q_u32 (s);
+        uint32x4_t s1 = vld1q_u32 (s + 4);
+        
+        while (count--) {
+            uint32x4_t so0 = s0;
+            uint32x4_t so1 = s1;
+            
+            // words are read big-endian.
+            uint32x4_t m[4];
+            for (int i = 0; i < 4; i++) m[i] = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (blocks + 16 * i)));
+            
+            // four rounds at a time. After each of the first twelve, the four
+            // words of the schedule that were just used are replaced with the
+            // four that will be needed sixteen rounds later.
+            for (int j = 0; j < 16; j++) {
+                uint32x4_t msg = vaddq_u32 (m[j & 3], vld1q_u32 (K + 4 * j));
+                if (j < 12) m[j & 3] = vsha256su0q_u32 (m[j & 3], m[(j + 1) & 3]);
+                
+                uint32x4_t t = s0;
+                s0 = vsha256hq_u32 (s0, s1, msg);
+                s1 = vsha256h2q_u32 (s1, t, msg);
+                
+                if (j < 12) m[j & 3] = vsha256su1q_u32 (m[j & 3], m[(j + 2) & 3], m[(j + 3) & 3]);
+            }
+            
+            s0 = vaddq_u32 (s0, so0);
+            s1 = vaddq_u32 (s1, so1);
+            blocks += 64;
+        }
+        
+        vst1q_u32 (s, s0);
+        vst1q_u32 (s + 4, s1);
+    }
+    
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -mavx2
+
+#include "lanes.hpp"
+
+namespace Gigamonkey::sha256::avx2 {
+    
+    using vector = uint32 __attribute__ ((vector_size (32)));
+    
+    void double_hash_80 (byte *out, const byte *in) {
+        parallel_double_hash_80<vector> (out, in);
+    }
+    
+    void double_hash_80 (byte *out, const state &midstate, const byte *tails) {
+        parallel_double_hash_80<vector> (out, midstate, tails);
+    }
+    
+    void double_hash_64 (byte *out, const byte *in) {
+        parallel_double_hash_64<vector> (out, in);
+    }
+    
+    void double_hash_short (byte *out, const byte *in, size_t size) {
+        parallel_double_hash_short<vector> (out, in, size);
+    }
+    
+    void hash_short (byte *out, const byte *in, size_t size) {
+        parallel_hash_short<vector> (out, in, size);
+    }
+
+}
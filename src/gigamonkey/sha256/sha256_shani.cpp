@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// compiled with -msha -msse4.1
+// Based on the Intel SHA extensions reference code and the implementation in Bitcoin Core.
+
+#include <gigamonkey/sha256.hpp>
+#include <immintrin.h>
+
+namespace Gigamonkey::sha256 {
+    extern const uint32 K[64];
+}
+
+namespace Gigamonkey::sha256::shani {
+    
+    namespace {
+        
+        // shuffle bytes so that 32-bit words are read big-endian.
+        inline __m128i load (const byte *in) {
+            return _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) in),
+                _mm_set_epi64x (0x0c0d0e0f08090a0bull, 0x0405060700010203ull));
+        }
+        
+        inline void quad_round (__m128i &s0, __m128i &s1, __m128i m, int i) {
+            const __m128i msg = _mm_add_epi32 (m, _mm_loadu_si128 ((const __m128i *) (K + i)));
+            s1 = _mm_sha256rnds2_epu32 (s1, s0, msg);
+            s0 = _mm_sha256rnds2_epu32 (s0, s1, _mm_shuffle_epi32 (msg, 0x0e));
+        }
+        
+        inline void shift_message_a (__m128i &m0, __m128i m1) {
+            m0 = _mm_sha256msg1_epu32 (m0, m1);
+        }
+        
+        inline void shift_message_c (__m128i &m0, __m128i m1, __m128i &m2) {
+            m2 = _mm_sha256msg2_epu32 (_mm_add_epi32 (m2, _mm_alignr_epi8 (m1, m0, 4)), m1);
+        }
+        
+        inline void shift_message_b (__m128i &m0, __m128i m1, __m128i &m2) {
+            shift_message_c (m0, m1, m2);
+            shift_message_a (m0, m1);
+        }
+        
+        // the sha instructions expect the state in ABEF/CDGH order.
+        inline void shuffle (__m128i &s0, __m128i &s1) {
+            const __m128i t1 = _mm_shuffle_epi32 (s0, 0xB1);
+            const __m128i t2 = _mm_shuffle_epi32 (s1, 0x1B);
+            s0 = _mm_alignr_epi8 (t1, t2, 0x08);
+            s1 = _mm_blend_epi16 (t2, t1, 0xF0);
+        }
+        
+        inline void unshuffle (__m128i &s0, __m128i &s1) {
+            const __m128i t1 = _mm_shuffle_epi32 (s0, 0x1B);
+            const __m128i t2 = _mm_shuffle_epi32 (s1, 0xB1);
+            s0 = _mm_blend_epi16 (t1, t2, 0xF0);
+            s1 = _mm_alignr_epi8 (t2, t1, 0x08);
+        }
+        
+    }
+    
+    void transform (uint32 *s, const byte *blocks, size_t count) {
+        __m128i m0, m1, m2, m3, s0, s1, so0, so1;
+        
+        s0 = _mm_loadu_si128 ((const __m128i *) s);
+        s1 = _mm_loadu_si128 ((const __m128i *) (s + 4));
+        shuffle (s0, s1);
+        
+        while (count--) {
+            so0 = s0;
+            so1 = s1;
+            
+            m0 = load (blocks);
+            quad_round (s0, s1, m0, 0);
+            m1 = load (blocks + 16);
+            quad_round (s0, s1, m1, 4);
+            shift_message_a (m0, m1);
+            m2 = load (blocks + 32);
+            quad_round (s0, s1, m2, 8);
+            shift_message_a (m1, m2);
+            m3 = load (blocks + 48);
+            quad_round (s0, s1, m3, 12);
+            shift_message_b (m2, m3, m0);
+            quad_round (s0, s1, m0, 16);
+            shift_message_b (m3, m0, m1);
+            quad_round (s0, s1, m1, 20);
+            shift_message_b (m0, m1, m2);
+            quad_round (s0, s1, m2, 24);
+            shift_message_b (m1, m2, m3);
+            quad_round (s0, s1, m3, 28);
+            shift_message_b (m2, m3, m0);
+            quad_round (s0, s1, m0, 32);
+            shift_message_b (m3, m0, m1);
+            quad_round (s0, s1, m1, 36);
+            shift_message_b (m0, m1, m2);
+            quad_round (s0, s1, m2, 40);
+            shift_message_b (m1, m2, m3);
+            quad_round (s0, s1, m3, 44);
+            shift_message_b (m2, m3, m0);
+            quad_round (s0, s1, m0, 48);
+            shift_message_b (m3, m0, m1);
+            quad_round (s0, s1, m1, 52);
+            shift_message_b (m0, m1, m2);
+            quad_round (s0, s1, m2, 56);
+            shift_message_c (m1, m2, m3);
+            quad_round (s0, s1, m3, 60);
+            
+            s0 = _mm_add_epi32 (s0, so0);
+            s1 = _mm_add_epi32 (s1, so1);
+            
+            blocks += 64;
+        }
+        
+        unshuffle (s0, s1);
+        _mm_storeu_si128 ((__m128i *) s, s0);
+        _mm_storeu_si128 ((__m128i *) (s + 4), s1);
+    }
+    
+}
@@ -4,13 +4,26 @@
 #include <gigamonkey/sighash.hpp>
 #include <gigamonkey/script/script.hpp>
 
+#include <algorithm>
+
 namespace Gigamonkey::Bitcoin::sighash {
     
     bytes remove_code_separators (bytes_view script_code) {
-        program p = decompile (script_code);
-        program r;
-        for (const instruction &i : p) if (i.Op != OP_CODESEPARATOR) r = r << i;
-        return compile (r);
+        bytes r;
+        r.reserve (script_code.size ());
+        for (const instruction_view &i : instructions {script_code})
+            if (i.Op != OP_CODESEPARATOR) r.insert (r.end (), i.Serialized.begin (), i.Serialized.end ());
+        return r;
+    }
+    
+    precomputed::precomputed (const incomplete::transaction &tx) :
+        HashPrevouts {Amaury::hash_prevouts (tx)},
+        HashSequence {Amaury::hash_sequence (tx)},
+        HashOutputs {Amaury::hash_outputs (tx)}, Inputs {}, Outputs {} {
+        Inputs.reserve (tx.Inputs.size ());
+        for (const incomplete::input &in : tx.Inputs) Inputs.push_back (in);
+        Outputs.reserve (tx.Outputs.size ());
+        for (const output &out : tx.Outputs) Outputs.push_back (out);
     }
     
     transaction reconstruct (const document &doc, sighash::directive d) {
@@ -21,10 +34,16 @@ namespace Gigamonkey::Bitcoin::sighash {
         if (sighash::is_anyone_can_pay (d))
             in <<= doc.Transaction.Inputs[doc.InputIndex].complete (remove_code_separators (doc.ScriptCode));
         
-        else for (int i = 0; i < doc.Transaction.Inputs.size (); i++)
-            in <<= input {doc.Transaction.Inputs[i].Reference,
-                i == doc.InputIndex ? remove_code_separators (doc.ScriptCode) : bytes{},
-                base (d) == sighash::all || i == doc.InputIndex ? doc.Transaction.Inputs[i].Sequence : uint32_little {0}};
+        // go through the list rather than index it so that this takes linear time. 
+        else {
+            index i = 0;
+            for (const incomplete::input &x : doc.Transaction.Inputs) {
+                in <<= input {x.Reference,
+                    i == doc.InputIndex ? remove_code_separators (doc.ScriptCode) : bytes{},
+                    base (d) == sighash::all || i == doc.InputIndex ? x.Sequence : uint32_little {0}};
+                i++;
+            }
+        }
         
         if (sighash::base (d) == sighash::single)
             out <<= doc.Transaction.Outputs[doc.InputIndex]; 
@@ -36,6 +55,76 @@ namespace Gigamonkey::Bitcoin::sighash {
         
     }
     
+    namespace {
+        
+        // the script code is written with its code separators removed. Decompiling 
+        // it is only necessary if it might contain a code separator. 
+        writer &write_script_code (writer &w, bytes_view script_code) {
+            if (std::find (script_code.begin (), script_code.end (), OP_CODESEPARATOR) == script_code.end ())
+                return w << var_int {script_code.size ()} << script_code;
+            
+            size_t size = 0;
+            for (const instruction_view &i : instructions {script_code})
+                if (i.Op != OP_CODESEPARATOR) size += i.Serialized.size ();
+            
+            w << var_int {size};
+            for (const instruction_view &i : instructions {script_code})
+                if (i.Op != OP_CODESEPARATOR) w << i.Serialized;
+            
+            return w;
+        }
+        
+        // the inputs are either a list or the vector in precomputed. 
+        template <typename inputs>
+        writer &write_inputs (writer &w, const inputs &ins, const document_view &doc, sighash::directive d) {
+            index i = 0;
+            for (const incomplete::input &in : ins) {
+                w << in.Reference;
+                if (i == doc.InputIndex) write_script_code (w, doc.ScriptCode);
+                else w << var_int {0};
+                w << (base (d) == sighash::all || i == doc.InputIndex ? in.Sequence : uint32_little {0});
+                i++;
+            }
+            
+            return w;
+        }
+        
+        template <typename outputs>
+        writer &write_outputs (writer &w, const outputs &outs) {
+            for (const output &o : outs) w << o;
+            return w;
+        }
+        
+    }
+    
+    // the modified transaction is written as it would be serialized without 
+    // being constructed, going through the inputs and outputs once each. 
+    writer &write_original (writer &w, const document_view &doc, sighash::directive d) {
+        const precomputed *p = doc.Precomputed;
+        
+        w << doc.Transaction.Version;
+        
+        if (sighash::is_anyone_can_pay (d)) {
+            const incomplete::input &in = p != nullptr ? p->Inputs[doc.InputIndex] : doc.Transaction.Inputs[doc.InputIndex];
+            write_script_code (w << var_int {1} << in.Reference, doc.ScriptCode) << in.Sequence;
+        } else {
+            w << var_int {doc.inputs ()};
+            if (p != nullptr) write_inputs (w, p->Inputs, doc, d);
+            else write_inputs (w, doc.Transaction.Inputs, doc, d);
+        }
+        
+        if (sighash::base (d) == sighash::single)
+            w << var_int {1} << (p != nullptr ? p->Outputs[doc.InputIndex] : doc.Transaction.Outputs[doc.InputIndex]);
+        else if (sighash::base (d) == sighash::all) {
+            w << var_int {doc.outputs ()};
+            if (p != nullptr) write_outputs (w, p->Outputs);
+            else write_outputs (w, doc.Transaction.Outputs);
+        } else w << var_int {0};
+        
+        return w << doc.Transaction.Locktime << uint32_little {d};
+        
+    }
+    
     namespace Amaury {
         
         digest256 hash_prevouts (const incomplete::transaction &tx) {
@@ -56,53 +145,92 @@ namespace Gigamonkey::Bitcoin::sighash {
             return w.finalize ();
         }
         
-        // can use cached data, but we didn't. 
-        writer &write (writer &w, const document &doc, sighash::directive d) {
+        namespace {
             
-            if (!sighash::has_fork_id (d)) return write_original (w, doc, d & ~sighash::fork_id);
+            writer &write_digests (writer &w, const document_view &doc, sighash::directive d, const incomplete::input &in,
+                const digest256 &hashPrevouts, const digest256 &hashSequence, const digest256 &hashOutputs) {
+                
+                // Version
+                return w << doc.Transaction.Version
+                
+                    // Input prevouts/nSequence (none/all, depending on flags)
+                    << hashPrevouts
+                    << hashSequence
+                    
+                    // The input being signed (replacing the scriptSig with scriptCode +
+                    // amount). The prevout may already be contained in hashPrevout, and the
+                    // nSequence may already be contain in hashSequence.
+                    << in.Reference 
+                    << var_int {doc.ScriptCode.size ()} << doc.ScriptCode
+                    << doc.RedeemedValue
+                    << in.Sequence
+                
+                    // Outputs (none/one/all, depending on flags)
+                    << hashOutputs
+                    // Locktime
+                    << doc.Transaction.Locktime
+                    // Sighash type
+                    << uint32_little {d};
+                
+            }
             
-            digest256 hashPrevouts;
-            digest256 hashSequence;
-            digest256 hashOutputs;
+            bool uses_prevouts (sighash::directive d) {
+                return !sighash::is_anyone_can_pay (d);
+            }
             
-            if (!sighash::is_anyone_can_pay (d)) {
-                hashPrevouts = Amaury::hash_prevouts (doc.Transaction);
+            bool uses_sequence (sighash::directive d) {
+                return !sighash::is_anyone_can_pay (d) &&
+                    (sighash::base (d) != sighash::single) &&
+                    (sighash::base (d) != sighash::none);
             }
             
-            if (!sighash::is_anyone_can_pay (d) &&
-                (sighash::base (d) != sighash::single) &&
-                (sighash::base (d) != sighash::none)) {
-                hashSequence = Amaury::hash_sequence (doc.Transaction);
+            bool uses_outputs (sighash::directive d) {
+                return (sighash::base (d) != sighash::single) &&
+                    (sighash::base (d) != sighash::none);
             }
             
-            if ((sighash::base (d) != sighash::single) &&
-                (sighash::base (d) != sighash::none)) {
-                hashOutputs = Amaury::hash_outputs (doc.Transaction);
-            } else if ((sighash::base (d) == sighash::single) && (doc.InputIndex < doc.Transaction.Inputs.size ())) {
-                hashOutputs = Hash256 (bytes (doc.Transaction.Outputs[doc.InputIndex]));
+            digest256 hash_single_output (const document_view &doc, sighash::directive d) {
+                if ((sighash::base (d) == sighash::single) && (doc.InputIndex < doc.Transaction.Inputs.size ())) {
+                    Hash256_writer w;
+                    w << doc.Transaction.Outputs[doc.InputIndex];
+                    return w.finalize ();
+                }
+                return {};
             }
             
-            // Version
-            return w << doc.Transaction.Version
+            digest256 hash_single_output (const document_view &doc, sighash::directive d, const precomputed &p) {
+                if ((sighash::base (d) == sighash::single) && (doc.InputIndex < p.Inputs.size ()) && (doc.InputIndex < p.Outputs.size ())) {
+                    Hash256_writer w;
+                    w << p.Outputs[doc.InputIndex];
+                    return w.finalize ();
+                }
+                return hash_single_output (doc, d);
+            }
             
-                // Input prevouts/nSequence (none/all, depending on flags)
-                << hashPrevouts
-                << hashSequence
-                
-                // The input being signed (replacing the scriptSig with scriptCode +
-                // amount). The prevout may already be contained in hashPrevout, and the
-                // nSequence may already be contain in hashSequence.
-                << doc.Transaction.Inputs[doc.InputIndex].Reference 
-                << var_string {doc.ScriptCode}
-                << doc.RedeemedValue
-                << doc.Transaction.Inputs[doc.InputIndex].Sequence
-            
-                // Outputs (none/one/all, depending on flags)
-                << hashOutputs
-                // Locktime
-                << doc.Transaction.Locktime
-                // Sighash type
-                << uint32_little {d};
+        }
+        
+        writer &write (writer &w, const document_view &doc, sighash::directive d) {
+            
+            if (!sighash::has_fork_id (d)) return write_original (w, doc, d & ~sighash::fork_id);
+            
+            if (doc.Precomputed != nullptr) return Amaury::write (w, doc, d, *doc.Precomputed);
+            
+            return write_digests (w, doc, d, doc.Transaction.Inputs[doc.InputIndex],
+                uses_prevouts (d) ? Amaury::hash_prevouts (doc.Transaction) : digest256 {}, 
+                uses_sequence (d) ? Amaury::hash_sequence (doc.Transaction) : digest256 {}, 
+                uses_outputs (d) ? Amaury::hash_outputs (doc.Transaction) : hash_single_output (doc, d));
+            
+        }
+        
+        writer &write (writer &w, const document_view &doc, sighash::directive d, const precomputed &p) {
+            
+            if (!sighash::has_fork_id (d)) return write_original (w, doc, d & ~sighash::fork_id);
+            
+            return write_digests (w, doc, d,
+                doc.InputIndex < p.Inputs.size () ? p.Inputs[doc.InputIndex] : doc.Transaction.Inputs[doc.InputIndex],
+                uses_prevouts (d) ? p.HashPrevouts : digest256 {}, 
+                uses_sequence (d) ? p.HashSequence : digest256 {}, 
+                uses_outputs (d) ? p.HashOutputs : hash_single_output (doc, d, p));
             
         }
         
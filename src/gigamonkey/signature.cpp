@@ -5,10 +5,9 @@
 
 namespace Gigamonkey::Bitcoin {
     
-    digest256 signature::hash(const sighash::document &doc, sighash::directive d) {
-        if (!doc.valid() || (sighash::base(d) == sighash::single && doc.InputIndex >= doc.Transaction.Outputs.size())) return {}; 
-        //Hash256_writer w;
-        lazy_hash_writer w(Hash256);
+    digest256 signature::hash(const sighash::document_view &doc, sighash::directive d) {
+        if (!doc.valid() || (sighash::base(d) == sighash::single && doc.InputIndex >= doc.outputs())) return {}; 
+        Hash256_writer w;
         sighash::write(w, doc, d);
         return w.finalize();
     }
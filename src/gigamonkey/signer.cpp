@@ -0,0 +1,90 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/signer.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey {
+    
+    signer::signer (const transaction_design &d) : Design {d}, Transaction {Bitcoin::incomplete::transaction (d)},
+        Precomputed {std::make_shared<const Bitcoin::sighash::precomputed> (Transaction)}, Inputs {}, Outputs {}, ScriptCodes {} {
+        Inputs.reserve (d.Inputs.size ());
+        ScriptCodes.reserve (d.Inputs.size ());
+        for (const transaction_design::input &in : d.Inputs) {
+            Inputs.push_back (in);
+            ScriptCodes.push_back (in.script_code ());
+        }
+        
+        Outputs.reserve (d.Outputs.size ());
+        for (const Bitcoin::output &out : d.Outputs) Outputs.push_back (out);
+    }
+    
+    digest256 signer::hash (size_t i, Bitcoin::sighash::directive d) const {
+        using namespace Bitcoin;
+        if (i >= Inputs.size () || (sighash::base (d) == sighash::single && i >= Outputs.size ())) return {};
+        
+        // the original algorithm is not worth optimizing.
+        if (!sighash::has_fork_id (d))
+            return Bitcoin::signature::hash (sighash::document {Inputs[i].Prevout.value (), ScriptCodes[i], Transaction, uint32_little (i), Precomputed}, d);
+        
+        bool anyone_can_pay = sighash::is_anyone_can_pay (d);
+        bool all = sighash::base (d) != sighash::single && sighash::base (d) != sighash::none;
+        
+        digest256 hash_outputs {};
+        if (all) hash_outputs = Precomputed->HashOutputs;
+        else if (sighash::base (d) == sighash::single) {
+            Hash256_writer w;
+            w << Outputs[i];
+            hash_outputs = w.finalize ();
+        }
+        
+        Hash256_writer w;
+        w << Design.Version
+            << (anyone_can_pay ? digest256 {} : Precomputed->HashPrevouts)
+            << (!anyone_can_pay && all ? Precomputed->HashSequence : digest256 {})
+            << Inputs[i].Prevout.Key
+            << var_string {ScriptCodes[i]}
+            << Inputs[i].Prevout.value ()
+            << Inputs[i].Sequence
+            << hash_outputs
+            << Design.Locktime
+            << uint32_little {d};
+        return w.finalize ();
+    }
+    
+    namespace {
+        
+        template <typename loop>
+        std::vector<Bitcoin::signature> sign_all (const signer &s, const std::vector<Bitcoin::secret> &keys, Bitcoin::sighash::directive d, loop each) {
+            if (keys.size () != s.size ()) throw std::invalid_argument {"need one key for each input"};
+            std::vector<Bitcoin::signature> signatures (keys.size ());
+            each (keys.size (), [&s, &keys, &signatures, d] (size_t i) {
+                signatures[i] = Bitcoin::signature {keys[i].Secret.sign (s.hash (i, d)), d};
+            });
+            return signatures;
+        }
+        
+    }
+    
+    std::vector<Bitcoin::signature> signer::sign (const std::vector<Bitcoin::secret> &keys, Bitcoin::sighash::directive d) const {
+        return sign_all (*this, keys, d, [] (size_t n, auto f) {
+            for (size_t i = 0; i < n; i++) f (i);
+        });
+    }
+    
+    std::vector<Bitcoin::signature> signer::sign (const std::vector<Bitcoin::secret> &keys, Bitcoin::sighash::directive d, executor &e) const {
+        return sign_all (*this, keys, d, [&e] (size_t n, auto f) {
+            e.parallel_for (n, f);
+        });
+    }
+    
+    std::vector<Bitcoin::signature> signer::sign (key_source &k, Bitcoin::sighash::directive d, executor &e) const {
+        // key sources are not made to be used from many threads.
+        std::vector<Bitcoin::secret> keys;
+        keys.reserve (Inputs.size ());
+        for (size_t i = 0; i < Inputs.size (); i++) keys.push_back (k.next ());
+        return sign (keys, d, e);
+    }
+    
+}
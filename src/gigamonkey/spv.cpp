@@ -3,10 +3,18 @@
 
 #include <gigamonkey/spv.hpp>
 
-namespace Gigamonkey::Bitcoin {
+#include <bit>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey {
     
-    block genesis() {
-        static block Genesis = block{bytes(encoding::hex::string{std::string{} + 
+    Bitcoin::block genesis() {
+        static Bitcoin::block Genesis = Bitcoin::block{bytes(encoding::hex::string{std::string{} + 
             "0100000000000000000000000000000000000000000000000000000000000000" +
             "000000003BA3EDFD7A7B12B27AC72C3E67768F617FC81BC3888A51323A9FB8AA" +
             "4B1E5E4A29AB5F49FFFF001D1DAC2B7C01010000000100000000000000000000" +
@@ -19,4 +27,383 @@ namespace Gigamonkey::Bitcoin {
         return Genesis;
     }
     
+    headers::header::header() : Hash{}, Header{}, Height{0}, Cumulative{}, Work{} {}
+    
+    namespace {
+        
+        // hashes of headers are random, so any part of one will do.
+        size_t slot(const digest256 &d, size_t size) {
+            return boost::endian::load_little_u64(d.begin()) & (size - 1);
+        }
+        
+    }
+    
+    const headers::memory::entry *headers::memory::table::find(const digest256 &d) const {
+        for (size_t i = slot(d, Slots.size());; i = (i + 1) & (Slots.size() - 1)) {
+            const entry *e = Slots[i].load(std::memory_order_acquire);
+            if (e == nullptr || e->Hash == d) return e;
+        }
+    }
+    
+    void headers::memory::table::insert(const entry *e) {
+        size_t i = slot(e->Hash, Slots.size());
+        while (Slots[i].load(std::memory_order_relaxed) != nullptr) i = (i + 1) & (Slots.size() - 1);
+        Slots[i].store(e, std::memory_order_release);
+    }
+    
+    const headers::memory::entry *headers::memory::snapshot::find(const digest256 &d) const {
+        const entry *e = ByHash->find(d);
+        return e == nullptr || e->Sequence >= Entries ? nullptr : e;
+    }
+    
+    headers::header headers::memory::snapshot::operator[](const N &n) const {
+        if (n >= N(Size)) return {};
+        return *at(uint64(n));
+    }
+    
+    headers::header headers::memory::snapshot::operator[](const digest256 &d) const {
+        const entry *e = find(d);
+        if (e == nullptr) return {};
+        return *e;
+    }
+    
+    void headers::memory::snapshot::push(const entry *e) {
+        if (Size % chunk_size == 0) {
+            Chunks.push_back(std::make_shared<chunk>());
+            Chunks.back()->reserve(chunk_size);
+        } else if (Chunks.back().use_count() > 1) {
+            auto c = std::make_shared<chunk>();
+            c->reserve(chunk_size);
+            c->insert(c->end(), Chunks.back()->begin(), Chunks.back()->end());
+            Chunks.back() = c;
+        }
+        
+        Chunks.back()->push_back(e);
+        Size++;
+    }
+    
+    void headers::memory::snapshot::truncate(uint64 size) {
+        Chunks.resize((size + chunk_size - 1) / chunk_size);
+        Size = size;
+        
+        size_t last = size - (Chunks.size() - 1) * chunk_size;
+        if (Chunks.back()->size() == last) return;
+        if (Chunks.back().use_count() > 1) Chunks.back() = std::make_shared<chunk>(Chunks.back()->begin(), Chunks.back()->begin() + last);
+        else Chunks.back()->resize(last);
+    }
+    
+    headers::memory::memory(const Bitcoin::header &root) :
+        Entries{}, Tips{}, ByHash{std::make_shared<table>(1024)}, Current{}, ByRoot{}, ByTxid{},
+        Mutex{}, Proofs{}, Subscribers{}, NextSubscriber{0} {
+        entry &e = Entries.emplace_back(header{root.hash(), root, N(0), root.Target.difficulty(), work::chainwork{root.Target}}, 0, nullptr, 0);
+        Tips.insert(&e);
+        ByHash->insert(&e);
+        ByRoot[root.MerkleRoot] = &e;
+        
+        auto x = std::make_shared<snapshot>();
+        x->Size = 0;
+        x->push(&e);
+        x->Entries = 1;
+        x->Tips = 1;
+        x->ByHash = ByHash;
+        Current.store(x, std::memory_order_release);
+    }
+    
+    Merkle::dual headers::memory::dual_tree(const digest256 &d) const {
+        const entry *e = current()->find(d);
+        if (e == nullptr) return {};
+        std::shared_lock<std::shared_mutex> lock(Proofs);
+        return Merkle::dual{e->Tree, e->Header.MerkleRoot};
+    }
+    
+    Merkle::proof headers::memory::proof(const Bitcoin::txid &t) const {
+        std::shared_lock<std::shared_mutex> lock(Proofs);
+        auto e = ByTxid.find(t);
+        if (e == ByTxid.end()) return {};
+        return Merkle::dual{e->second->Tree, e->second->Header.MerkleRoot}[t];
+    }
+    
+    size_t headers::memory::insert(std::span<const Bitcoin::header> x) {
+        std::lock_guard<std::mutex> lock(Mutex);
+        ptr<const snapshot> previous = Current.load(std::memory_order_relaxed);
+        auto next = std::make_shared<snapshot>(*previous);
+        
+        size_t accepted = 0;
+        for (const Bitcoin::header &h : x) {
+            const entry *p = ByHash->find(h.Previous);
+            if (p == nullptr) continue;
+            
+            digest256 hash = h.hash();
+            if (ByHash->find(hash) != nullptr || !h.valid()) continue;
+            
+            entry &e = Entries.emplace_back(p->next(h, hash), p->Index + 1, p, Entries.size());
+            
+            if (Entries.size() * 2 > ByHash->Slots.size()) {
+                auto bigger = std::make_shared<table>(ByHash->Slots.size() * 2);
+                for (const entry &y : Entries) bigger->insert(&y);
+                ByHash = bigger;
+            } else ByHash->insert(&e);
+            
+            ByRoot[h.MerkleRoot] = &e;
+            Tips.erase(p);
+            Tips.insert(&e);
+            accepted++;
+            
+            if (e.Work > next->at(next->Size - 1)->Work) {
+                if (p == next->at(next->Size - 1)) next->push(&e);
+                else reorganize(*next, &e);
+            }
+        }
+        
+        if (accepted == 0) return 0;
+        
+        next->Entries = Entries.size();
+        next->Tips = Tips.size();
+        next->ByHash = ByHash;
+        Current.store(next, std::memory_order_release);
+        
+        const entry *tip = next->at(next->Size - 1);
+        const entry *old = previous->at(previous->Size - 1);
+        if (tip == old) return accepted;
+        
+        // the chains share everything up to the fork.
+        uint64 fork = std::min(next->Size, previous->Size) - 1;
+        while (next->at(fork) != previous->at(fork)) fork--;
+        
+        update u{*old, *tip, *next->at(fork)};
+        for (const auto &[n, s] : Subscribers) s(u);
+        return accepted;
+    }
+    
+    // we only replace the part of the best chain after the fork.
+    void headers::memory::reorganize(snapshot &x, const entry *tip) {
+        std::vector<const entry *> branch;
+        const entry *e = tip;
+        while (e->Index >= x.Size || x.at(e->Index) != e) {
+            branch.push_back(e);
+            e = e->Previous;
+        }
+        
+        x.truncate(e->Index + 1);
+        for (auto b = branch.rbegin(); b != branch.rend(); b++) x.push(*b);
+    }
+    
+    bool headers::memory::insert(const Merkle::proof &p) {
+        std::lock_guard<std::mutex> lock(Mutex);
+        auto e = ByRoot.find(p.Root);
+        if (e == ByRoot.end()) return false;
+        
+        std::unique_lock<std::shared_mutex> proofs(Proofs);
+        Merkle::dual d = Merkle::dual{e->second->Tree, e->second->Header.MerkleRoot} + p;
+        if (!d.valid()) return false;
+        
+        e->second->Tree = d.Paths;
+        ByTxid[p.Branch.Leaf.Digest] = e->second;
+        return true;
+    }
+    
+    memory_report headers::memory::memory_usage() const {
+        std::lock_guard<std::mutex> lock(Mutex);
+        std::shared_lock<std::shared_mutex> proofs(Proofs);
+        ptr<const snapshot> x = current();
+        uint64 chunks = x->Chunks.size() * chunk_size;
+        uint64 slots = ByHash->Slots.size();
+        
+        memory_report m{};
+        m.Keys = ByRoot.size() * sizeof(digest256) + ByTxid.size() * sizeof(Bitcoin::txid);
+        m.Values = Entries.size() * sizeof(entry);
+        m.Overhead = hash_table_overhead(ByRoot) + hash_table_overhead(ByTxid) + hash_table_overhead(Tips) +
+            (ByRoot.size() + ByTxid.size() + Tips.size()) * sizeof(entry *) +
+            (Entries.size() + x->Size) * sizeof(entry *);
+        m.Slack = (slots - Entries.size() + chunks - x->Size) * sizeof(entry *);
+        return m;
+    }
+    
+    uint64 headers::memory::subscribe(subscriber s) {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Subscribers[NextSubscriber] = s;
+        return NextSubscriber++;
+    }
+    
+    void headers::memory::unsubscribe(uint64 n) {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Subscribers.erase(n);
+    }
+    
+    namespace {
+        
+        constexpr byte header_file_magic[8] {'G', 'M', 'H', 'D', 'R', 'W', 'R', 'K'};
+        
+        // the magic bytes and the number of records.
+        constexpr size_t header_file_prefix = 16;
+        
+        // a header, its hash, its cumulative difficulty and its work.
+        constexpr size_t header_record_size = 152;
+        
+        constexpr uint64 header_file_initial_capacity = 1024;
+        
+        size_t header_file_size(uint64 capacity) {
+            return header_file_prefix + capacity * header_record_size;
+        }
+        
+        // msync needs an address on a page boundary.
+        void sync_range(byte *map, size_t begin, size_t end) {
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t start = begin / page * page;
+            if (msync(map + start, end - start, MS_SYNC) != 0) throw std::runtime_error{"could not sync header file"};
+        }
+        
+        void write_header_record(byte *r, const headers::header &h) {
+            auto serialized = h.Header.write();
+            std::copy(serialized.begin(), serialized.end(), r);
+            std::copy(h.Hash.begin(), h.Hash.end(), r + 80);
+            boost::endian::store_little_u64(r + 112, std::bit_cast<uint64>(float64(h.Cumulative)));
+            limbs::store<32>(h.Work.Value, r + 120);
+        }
+        
+        digest256 read_header_record_hash(const byte *r) {
+            digest256 hash;
+            std::copy(r + 80, r + 112, hash.begin());
+            return hash;
+        }
+        
+        // whether the record at this height has the hash of its header and follows the record before it.
+        bool intact_header_record(const byte *map, uint64 height) {
+            const byte *r = map + header_file_size(height);
+            Bitcoin::header h{slice<80>{const_cast<byte *>(r)}};
+            if (h.hash() != read_header_record_hash(r)) return false;
+            return height == 0 || h.Previous == read_header_record_hash(map + header_file_size(height - 1));
+        }
+        
+    }
+    
+    headers::file::file(const std::string &path, const Bitcoin::header &root) : Descriptor{-1}, Map{nullptr}, Capacity{0}, ByHash{} {
+        Descriptor = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (Descriptor < 0) throw std::runtime_error{"could not open header file " + path};
+        
+        try {
+            struct stat st;
+            if (fstat(Descriptor, &st) != 0) throw std::runtime_error{"could not read header file " + path};
+            
+            size_t size = static_cast<size_t>(st.st_size);
+            if (size == 0) {
+                remap(header_file_initial_capacity);
+                std::copy(std::begin(header_file_magic), std::end(header_file_magic), Map);
+                
+                write_header_record(Map + header_file_prefix,
+                    header{root.hash(), root, N(0), root.Target.difficulty(), work::chainwork{root.Target}});
+                sync_range(Map, 0, header_file_size(1));
+                set_count(1);
+            } else {
+                if (size < header_file_size(1) || (size - header_file_prefix) % header_record_size != 0)
+                    throw std::invalid_argument{"not a header file: " + path};
+                
+                remap((size - header_file_prefix) / header_record_size);
+                if (!std::equal(std::begin(header_file_magic), std::end(header_file_magic), Map) ||
+                    count() == 0 || !intact_header_record(Map, 0)) throw std::invalid_argument{"not a header file: " + path};
+                
+                // the count is not trusted past the records that are in the file
+                // and whole, in case the process stopped while they were written.
+                uint64 n = std::min(count(), Capacity);
+                while (n > 1 && !intact_header_record(Map, n - 1)) n--;
+                if (n != count()) set_count(n);
+            }
+        } catch (...) {
+            close();
+            throw;
+        }
+        
+        uint64 n = count();
+        ByHash.reserve(n);
+        for (uint64 i = 0; i < n; i++) ByHash[read_header_record_hash(Map + header_file_size(i))] = i;
+    }
+    
+    headers::file::~file() {
+        close();
+    }
+    
+    void headers::file::close() {
+        if (Map != nullptr) munmap(Map, header_file_size(Capacity));
+        if (Descriptor >= 0) ::close(Descriptor);
+        Map = nullptr;
+        Descriptor = -1;
+    }
+    
+    void headers::file::remap(uint64 capacity) {
+        if (Map != nullptr) munmap(Map, header_file_size(Capacity));
+        Map = nullptr;
+        
+        if (ftruncate(Descriptor, header_file_size(capacity)) != 0) throw std::runtime_error{"could not resize header file"};
+        
+        void *m = mmap(nullptr, header_file_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor, 0);
+        if (m == MAP_FAILED) throw std::runtime_error{"could not map header file"};
+        
+        Map = static_cast<byte *>(m);
+        Capacity = capacity;
+    }
+    
+    uint64 headers::file::count() const {
+        return boost::endian::load_little_u64(Map + 8);
+    }
+    
+    void headers::file::set_count(uint64 n) {
+        // the records that the count includes, and the size of the file, go to disk first.
+        if (fsync(Descriptor) != 0) throw std::runtime_error{"could not sync header file"};
+        boost::endian::store_little_u64(Map + 8, n);
+        sync_range(Map, 8, 16);
+    }
+    
+    slice<80> headers::file::at(uint64 height) const {
+        if (height >= count()) throw std::invalid_argument{"no header at that height"};
+        return slice<80>{Map + header_file_size(height)};
+    }
+    
+    headers::header headers::file::entry(uint64 height) const {
+        const byte *r = Map + header_file_size(height);
+        return header{read_header_record_hash(r), Bitcoin::header{slice<80>{const_cast<byte *>(r)}}, N(height),
+            work::difficulty{std::bit_cast<float64>(boost::endian::load_little_u64(r + 112))},
+            work::chainwork{limbs::load<32>(r + 120)}};
+    }
+    
+    headers::header headers::file::latest() const {
+        return entry(count() - 1);
+    }
+    
+    headers::header headers::file::operator[](const N &n) const {
+        if (n >= N(count())) return {};
+        return entry(uint64(n));
+    }
+    
+    headers::header headers::file::operator[](const digest256 &d) const {
+        auto e = ByHash.find(d);
+        if (e == ByHash.end()) return {};
+        return entry(e->second);
+    }
+    
+    bool headers::file::insert(const Bitcoin::header &h) {
+        uint64 n = count();
+        header tip = entry(n - 1);
+        if (h.Previous != tip.Hash || !h.valid()) return false;
+        
+        if (n == Capacity) remap(2 * Capacity);
+        
+        digest256 hash = h.hash();
+        write_header_record(Map + header_file_size(n), tip.next(h, hash));
+        
+        // the record must be on disk before the count that includes it.
+        sync_range(Map, header_file_size(n), header_file_size(n + 1));
+        set_count(n + 1);
+        
+        ByHash[hash] = n;
+        return true;
+    }
+    
+    void headers::file::truncate(uint64 height) {
+        uint64 n = count();
+        if (height + 1 >= n) return;
+        
+        set_count(height + 1);
+        for (uint64 i = height + 1; i < n; i++) ByHash.erase(read_header_record_hash(Map + header_file_size(i)));
+    }
+    
 }
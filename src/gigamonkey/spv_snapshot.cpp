@@ -0,0 +1,328 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/spv_snapshot.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        constexpr byte snapshot_file_magic[] {'G', 'M', 'S', 'P', 'V', 'S', 'N', 'P'};
+        
+        // The magic, the version, four bytes that are not used, the range of
+        // heights and the hash of the last header, and then the number of blocks
+        // and the number of transactions. All numbers are little endian.
+        constexpr size_t snapshot_file_prefix = 80;
+        
+        // the height of the block and the position and size of its BUMP.
+        constexpr size_t block_record_size = 24;
+        
+        // the txid, the index of the block, four bytes that are not used and the
+        // position and size of the transaction. Records are sorted by txid.
+        constexpr size_t transaction_record_size = 56;
+        
+        constexpr uint32 no_block = 0xffffffff;
+        
+        int compare (const byte *record, const Bitcoin::txid &x) {
+            return std::memcmp (record, x.begin (), 32);
+        }
+        
+        // flush what has been written to a file, or a change to a directory, to the disk.
+        bool fsync_path (const std::filesystem::path &p, int flags) {
+            int descriptor = ::open (p.c_str (), flags);
+            if (descriptor < 0) return false;
+            bool synced = ::fsync (descriptor) == 0;
+            ::close (descriptor);
+            return synced;
+        }
+        
+    }
+    
+    SPV_snapshot::state::state (const headers &h) : state {} {
+        headers::header latest = h.latest ();
+        To = uint64 (latest.Height);
+        Tip = latest.Hash;
+    }
+    
+    bool SPV_snapshot::state::operator == (const state &x) const {
+        return From == x.From && To == x.To && Tip == x.Tip && Proofs == x.Proofs && Transactions == x.Transactions;
+    }
+    
+    void SPV_snapshot::write (const std::filesystem::path &path, const state &x) {
+        std::vector<std::pair<uint64, bytes>> blocks;
+        for (const auto &[height, d] : x.Proofs) {
+            if (!d.valid ()) throw std::invalid_argument {"SPV snapshot: invalid proofs at height " + std::to_string (height)};
+            blocks.emplace_back (height, Merkle::BUMP {height, d}.write ());
+        }
+        
+        std::vector<std::pair<const Bitcoin::txid *, const bytes *>> transactions;
+        for (const auto &[id, tx] : x.Transactions) transactions.emplace_back (&id, &tx);
+        std::sort (transactions.begin (), transactions.end (), [] (const auto &a, const auto &b) {
+            return std::memcmp (a.first->begin (), b.first->begin (), 32) < 0;
+        });
+        
+        size_t size = snapshot_file_prefix + blocks.size () * block_record_size + transactions.size () * transaction_record_size;
+        for (const auto &[height, b] : blocks) size += b.size ();
+        for (const auto &[id, tx] : transactions) size += tx->size ();
+        
+        bytes file (size);
+        byte *b = file.data ();
+        std::fill (b, b + snapshot_file_prefix, 0);
+        std::copy (std::begin (snapshot_file_magic), std::end (snapshot_file_magic), b);
+        boost::endian::store_little_u32 (b + 8, version);
+        boost::endian::store_little_u64 (b + 16, x.From);
+        boost::endian::store_little_u64 (b + 24, x.To);
+        std::copy (x.Tip.begin (), x.Tip.end (), b + 32);
+        boost::endian::store_little_u64 (b + 64, blocks.size ());
+        boost::endian::store_little_u64 (b + 72, transactions.size ());
+        
+        byte *record = b + snapshot_file_prefix;
+        uint64 at = snapshot_file_prefix + blocks.size () * block_record_size + transactions.size () * transaction_record_size;
+        for (const auto &[height, bump] : blocks) {
+            boost::endian::store_little_u64 (record, height);
+            boost::endian::store_little_u64 (record + 8, at);
+            boost::endian::store_little_u64 (record + 16, bump.size ());
+            std::copy (bump.begin (), bump.end (), b + at);
+            record += block_record_size;
+            at += bump.size ();
+        }
+        
+        for (const auto &[id, tx] : transactions) {
+            uint32 block = no_block;
+            uint32 index = 0;
+            for (const auto &[height, d] : x.Proofs) {
+                if (d.contains (*id)) {
+                    block = index;
+                    break;
+                }
+                
+                index++;
+            }
+            
+            std::copy (id->begin (), id->end (), record);
+            boost::endian::store_little_u32 (record + 32, block);
+            boost::endian::store_little_u32 (record + 36, 0);
+            boost::endian::store_little_u64 (record + 40, at);
+            boost::endian::store_little_u64 (record + 48, tx->size ());
+            std::copy (tx->begin (), tx->end (), b + at);
+            record += transaction_record_size;
+            at += tx->size ();
+        }
+        
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        
+        {
+            std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+            if (out) out.write (reinterpret_cast<const char *> (file.data ()), file.size ());
+            if (!out) throw std::runtime_error {"could not write SPV snapshot " + temporary.string ()};
+        }
+        
+        // the contents are on the disk before the file has its name, and the name after.
+        if (!fsync_path (temporary, O_RDONLY)) throw std::runtime_error {"could not sync SPV snapshot " + temporary.string ()};
+        
+        std::error_code err;
+        std::filesystem::rename (temporary, path, err);
+        if (err) throw std::runtime_error {"could not write SPV snapshot " + path.string ()};
+        
+        std::filesystem::path directory = path.has_parent_path () ? path.parent_path () : std::filesystem::path {"."};
+        if (!fsync_path (directory, O_RDONLY | O_DIRECTORY)) throw std::runtime_error {"could not sync directory of SPV snapshot " + path.string ()};
+    }
+    
+    SPV_snapshot::SPV_snapshot (const std::filesystem::path &path) :
+        Path {path}, Descriptor {-1}, Map {nullptr}, Size {0}, Blocks {0}, Transactions {0} {
+        
+        Descriptor = ::open (Path.c_str (), O_RDONLY);
+        if (Descriptor < 0) throw std::runtime_error {"could not open SPV snapshot " + Path.string ()};
+        
+        struct stat st;
+        if (fstat (Descriptor, &st) != 0) {
+            ::close (Descriptor);
+            throw std::runtime_error {"could not read SPV snapshot " + Path.string ()};
+        }
+        
+        Size = static_cast<size_t> (st.st_size);
+        if (Size < snapshot_file_prefix) {
+            ::close (Descriptor);
+            throw std::invalid_argument {"not an SPV snapshot: " + Path.string ()};
+        }
+        
+        void *m = mmap (nullptr, Size, PROT_READ, MAP_SHARED, Descriptor, 0);
+        if (m == MAP_FAILED) {
+            ::close (Descriptor);
+            throw std::runtime_error {"could not map SPV snapshot " + Path.string ()};
+        }
+        
+        Map = static_cast<const byte *> (m);
+        Blocks = boost::endian::load_little_u64 (Map + 64);
+        Transactions = boost::endian::load_little_u64 (Map + 72);
+        
+        // only the tables need to fit for the file to be opened.
+        if (!std::equal (std::begin (snapshot_file_magic), std::end (snapshot_file_magic), Map) ||
+            boost::endian::load_little_u32 (Map + 8) != version ||
+            Blocks > Size / block_record_size || Transactions > Size / transaction_record_size ||
+            snapshot_file_prefix + Blocks * block_record_size + Transactions * transaction_record_size > Size) {
+            munmap (const_cast<byte *> (Map), Size);
+            ::close (Descriptor);
+            throw std::invalid_argument {"not an SPV snapshot of version " + std::to_string (version) + ": " + Path.string ()};
+        }
+    }
+    
+    SPV_snapshot::~SPV_snapshot () {
+        munmap (const_cast<byte *> (Map), Size);
+        ::close (Descriptor);
+    }
+    
+    uint64 SPV_snapshot::from () const {
+        return boost::endian::load_little_u64 (Map + 16);
+    }
+    
+    uint64 SPV_snapshot::to () const {
+        return boost::endian::load_little_u64 (Map + 24);
+    }
+    
+    digest256 SPV_snapshot::tip () const {
+        digest256 x;
+        std::copy (Map + 32, Map + 64, x.begin ());
+        return x;
+    }
+    
+    bool SPV_snapshot::check (const headers &h) const {
+        headers::header last = h[N (to ())];
+        return h[N (from ())].valid () && last.valid () && last.Hash == tip ();
+    }
+    
+    size_t SPV_snapshot::blocks () const {
+        return Blocks;
+    }
+    
+    size_t SPV_snapshot::transactions () const {
+        return Transactions;
+    }
+    
+    const byte *SPV_snapshot::block_record (uint64 index) const {
+        return Map + snapshot_file_prefix + index * block_record_size;
+    }
+    
+    const byte *SPV_snapshot::transaction_record (uint64 index) const {
+        return Map + snapshot_file_prefix + Blocks * block_record_size + index * transaction_record_size;
+    }
+    
+    maybe<bytes_view> SPV_snapshot::data (const byte *record) const {
+        uint64 at = boost::endian::load_little_u64 (record);
+        uint64 size = boost::endian::load_little_u64 (record + 8);
+        if (at > Size || size > Size - at) return {};
+        return bytes_view {Map + at, size};
+    }
+    
+    std::vector<uint64> SPV_snapshot::heights () const {
+        std::vector<uint64> x;
+        x.reserve (Blocks);
+        for (uint64 i = 0; i < Blocks; i++) x.push_back (boost::endian::load_little_u64 (block_record (i)));
+        return x;
+    }
+    
+    const byte *SPV_snapshot::find_block (uint64 height) const {
+        uint64 begin = 0;
+        uint64 end = Blocks;
+        while (begin < end) {
+            uint64 middle = begin + (end - begin) / 2;
+            uint64 h = boost::endian::load_little_u64 (block_record (middle));
+            if (h == height) return block_record (middle);
+            if (h < height) begin = middle + 1;
+            else end = middle;
+        }
+        
+        return nullptr;
+    }
+    
+    const byte *SPV_snapshot::find_transaction (const Bitcoin::txid &x) const {
+        uint64 begin = 0;
+        uint64 end = Transactions;
+        while (begin < end) {
+            uint64 middle = begin + (end - begin) / 2;
+            int c = compare (transaction_record (middle), x);
+            if (c == 0) return transaction_record (middle);
+            if (c < 0) begin = middle + 1;
+            else end = middle;
+        }
+        
+        return nullptr;
+    }
+    
+    bool SPV_snapshot::contains (const Bitcoin::txid &x) const {
+        return find_transaction (x) != nullptr;
+    }
+    
+    bytes_view SPV_snapshot::transaction (const Bitcoin::txid &x) const {
+        const byte *record = find_transaction (x);
+        if (record == nullptr) return {};
+        maybe<bytes_view> tx = data (record + 40);
+        if (!bool (tx)) return {};
+        return *tx;
+    }
+    
+    maybe<uint64> SPV_snapshot::height (const Bitcoin::txid &x) const {
+        const byte *record = find_transaction (x);
+        if (record == nullptr) return {};
+        uint32 block = boost::endian::load_little_u32 (record + 32);
+        if (block >= Blocks) return {};
+        return boost::endian::load_little_u64 (block_record (block));
+    }
+    
+    Merkle::dual SPV_snapshot::dual (uint64 height) const {
+        const byte *record = find_block (height);
+        if (record == nullptr) return {};
+        maybe<bytes_view> b = data (record + 8);
+        if (!bool (b)) return {};
+        maybe<Merkle::BUMP> bump = Merkle::BUMP::read (*b);
+        if (!bool (bump) || bump->BlockHeight != height) return {};
+        return Merkle::dual (*bump);
+    }
+    
+    Merkle::proof SPV_snapshot::proof (const Bitcoin::txid &x) const {
+        maybe<uint64> h = height (x);
+        if (!bool (h)) return {};
+        const byte *record = find_block (*h);
+        maybe<bytes_view> b = data (record + 8);
+        if (!bool (b)) return {};
+        maybe<Merkle::BUMP> bump = Merkle::BUMP::read (*b);
+        if (!bool (bump)) return {};
+        return (*bump)[x];
+    }
+    
+    SPV_snapshot::state SPV_snapshot::read () const {
+        state x {};
+        x.From = from ();
+        x.To = to ();
+        x.Tip = tip ();
+        
+        for (uint64 height : heights ()) {
+            Merkle::dual d = dual (height);
+            if (d.valid ()) x.Proofs[height] = d;
+        }
+        
+        for (uint64 i = 0; i < Transactions; i++) {
+            const byte *record = transaction_record (i);
+            maybe<bytes_view> tx = data (record + 40);
+            if (!bool (tx)) continue;
+            
+            Bitcoin::txid id;
+            std::copy (record, record + 32, id.begin ());
+            x.Transactions[id] = bytes (*tx);
+        }
+        
+        return x;
+    }
+    
+}
@@ -0,0 +1,331 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/binary_framing.hpp>
+
+#include <limits>
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum::binary {
+    
+    namespace {
+        
+        size_t var_int_size (uint64 x) {
+            return x < 0xfd ? 1 : x <= 0xffff ? 3 : x <= 0xffffffff ? 5 : 9;
+        }
+        
+        struct writer {
+            bytes Bytes;
+            
+            void put (byte b) {
+                Bytes.push_back (b);
+            }
+            
+            void put_n (uint64 x, int n) {
+                for (int i = 0; i < n; i++) put (byte (x >> (8 * i)));
+            }
+            
+            void put_32 (uint32 x) {
+                put_n (x, 4);
+            }
+            
+            void put_var_int (uint64 x) {
+                if (x < 0xfd) return put (byte (x));
+                if (x <= 0xffff) {
+                    put (byte (0xfd));
+                    return put_n (x, 2);
+                }
+                
+                if (x <= 0xffffffff) {
+                    put (byte (0xfe));
+                    return put_n (x, 4);
+                }
+                
+                put (byte (0xff));
+                put_n (x, 8);
+            }
+            
+            void put (bytes_view b) {
+                put_var_int (b.size ());
+                for (byte x : b) put (x);
+            }
+            
+            void put (const string &x) {
+                put (bytes_view {reinterpret_cast<const byte *> (x.data ()), x.size ()});
+            }
+            
+            void put (const uint256 &x) {
+                for (byte b : x) put (b);
+            }
+            
+            void put (const message_id &id) {
+                if (id.is_number_unsigned ()) {
+                    uint64 n = uint64 (id);
+                    if (n > std::numeric_limits<uint32>::max ()) throw std::invalid_argument {"message id is too big for a binary frame"};
+                    put (byte (0));
+                    return put_32 (uint32 (n));
+                }
+                
+                put (byte (1));
+                put (string (id));
+            }
+        };
+        
+        // throws std::out_of_range if there is not enough.
+        struct reader {
+            bytes_view Bytes;
+            size_t Position {0};
+            
+            bool end () const {
+                return Position == Bytes.size ();
+            }
+            
+            size_t remaining () const {
+                return Bytes.size () - Position;
+            }
+            
+            byte get () {
+                if (end ()) throw std::out_of_range {"end of frame"};
+                return Bytes[Position++];
+            }
+            
+            uint64 get_n (int n) {
+                uint64 x = 0;
+                for (int i = 0; i < n; i++) x |= uint64 (get ()) << (8 * i);
+                return x;
+            }
+            
+            uint32 get_32 () {
+                return uint32 (get_n (4));
+            }
+            
+            uint64 get_var_int () {
+                byte b = get ();
+                return b < 0xfd ? b : b == 0xfd ? get_n (2) : b == 0xfe ? get_n (4) : get_n (8);
+            }
+            
+            bytes_view get_view () {
+                uint64 size = get_var_int ();
+                if (size > remaining ()) throw std::out_of_range {"end of frame"};
+                bytes_view x = Bytes.substr (Position, size);
+                Position += size;
+                return x;
+            }
+            
+            bytes get_bytes () {
+                return bytes (get_view ());
+            }
+            
+            string get_string () {
+                bytes_view x = get_view ();
+                return string (reinterpret_cast<const char *> (x.data ()), x.size ());
+            }
+            
+            uint256 get_uint256 () {
+                uint256 x;
+                for (byte &b : x) b = get ();
+                return x;
+            }
+            
+            message_id get_id () {
+                switch (get ()) {
+                    case 0: return message_id {get_32 ()};
+                    case 1: return message_id {get_string ()};
+                    default: throw std::out_of_range {"invalid message id"};
+                }
+            }
+        };
+        
+        bool valid_id (const message_id &id) {
+            return id.is_string () || (id.is_number_unsigned () && uint64 (id) <= std::numeric_limits<uint32>::max ());
+        }
+        
+    }
+    
+    frame::operator bytes () const {
+        writer w {};
+        w.Bytes.reserve (var_int_size (Payload.size () + 1) + Payload.size () + 1);
+        w.put_var_int (Payload.size () + 1);
+        w.put (byte (Kind));
+        for (byte b : Payload) w.put (b);
+        return w.Bytes;
+    }
+    
+    void frame_reader::push (bytes_view b) {
+        // forget what has been read once that is most of the buffer.
+        if (Position > 0 && Position >= Buffer.size () / 2) {
+            Buffer.erase (Buffer.begin (), Buffer.begin () + Position);
+            Position = 0;
+        }
+        
+        Buffer.insert (Buffer.end (), b.begin (), b.end ());
+    }
+    
+    maybe<frame> frame_reader::next () {
+        reader r {bytes_view {Buffer}.substr (Position)};
+        uint64 size;
+        try {
+            size = r.get_var_int ();
+        } catch (const std::out_of_range &) {
+            return {};
+        }
+        
+        if (size > MaxFrameSize) throw std::length_error {"Stratum frame is too large"};
+        if (size == 0) throw std::invalid_argument {"empty Stratum frame"};
+        if (size > r.remaining ()) return {};
+        
+        byte k = r.get ();
+        if (k > boolean_result) throw std::invalid_argument {"unknown kind of Stratum frame"};
+        
+        frame f {kind (k), bytes (r.Bytes.substr (r.Position, size - 1))};
+        Position += r.Position + size - 1;
+        return f;
+    }
+    
+    frame write_submit (const message_id &id, const share &x) {
+        writer w {};
+        w.put (id);
+        w.put (x.Name);
+        w.put (x.JobID);
+        w.put (bytes_view {x.Share.ExtraNonce2});
+        w.put_32 (x.Share.Timestamp.Value);
+        w.put_32 (uint32 (x.Share.Nonce));
+        w.put (byte (bool (x.Share.Bits)));
+        if (x.Share.Bits) w.put_32 (uint32 (int32 (*x.Share.Bits)));
+        return frame {submit, w.Bytes};
+    }
+    
+    frame write_notify (const mining::notify::parameters &p) {
+        writer w {};
+        w.Bytes.reserve (p.JobID.size () + p.GenerationTx1.size () + p.GenerationTx2.size () + 32 * p.Path.size () + 64);
+        w.put (p.JobID);
+        w.put (p.Digest);
+        w.put (bytes_view {p.GenerationTx1});
+        w.put (bytes_view {p.GenerationTx2});
+        
+        // in the same order as in mining.notify as JSON.
+        std::vector<const digest256 *> path;
+        path.reserve (p.Path.size ());
+        for (const digest256 &d : p.Path) path.push_back (&d);
+        w.put_var_int (path.size ());
+        for (auto d = path.rbegin (); d != path.rend (); d++) w.put ((*d)->Value);
+        
+        w.put_32 (uint32 (int32 (p.Version)));
+        w.put_32 (uint32 (uint32_little (p.Target)));
+        w.put_32 (p.Now.Value);
+        w.put (byte (p.Clean));
+        return frame {notify, w.Bytes};
+    }
+    
+    frame write_boolean_response (const message_id &id, bool b) {
+        writer w {};
+        w.put (id);
+        w.put (byte (b));
+        return frame {boolean_result, w.Bytes};
+    }
+    
+    maybe<submit_line> read_submit (bytes_view b) {
+        try {
+            reader r {b};
+            message_id id = r.get_id ();
+            share x {};
+            x.Name = r.get_string ();
+            x.JobID = r.get_string ();
+            x.Share.ExtraNonce2 = r.get_bytes ();
+            x.Share.Timestamp = Bitcoin::timestamp {r.get_32 ()};
+            x.Share.Nonce = uint32_little {r.get_32 ()};
+            byte bits = r.get ();
+            if (bits > 1) return {};
+            if (bits == 1) x.Share.Bits = int32_little {int32 (r.get_32 ())};
+            if (!r.end ()) return {};
+            return submit_line {id, x};
+        } catch (const std::out_of_range &) {
+            return {};
+        }
+    }
+    
+    maybe<mining::notify::parameters> read_notify (bytes_view b) {
+        try {
+            reader r {b};
+            mining::notify::parameters p {};
+            p.JobID = r.get_string ();
+            p.Digest = r.get_uint256 ();
+            p.GenerationTx1 = r.get_bytes ();
+            p.GenerationTx2 = r.get_bytes ();
+            
+            uint64 count = r.get_var_int ();
+            if (count > r.remaining () / 32) return {};
+            for (uint64 i = 0; i < count; i++) p.Path = p.Path << digest256 {r.get_uint256 ()};
+            
+            p.Version = int32_little {int32 (r.get_32 ())};
+            p.Target = work::compact {uint32_little {r.get_32 ()}};
+            p.Now = Bitcoin::timestamp {r.get_32 ()};
+            byte clean = r.get ();
+            if (clean > 1 || !r.end ()) return {};
+            p.Clean = clean == 1;
+            return p;
+        } catch (const std::out_of_range &) {
+            return {};
+        }
+    }
+    
+    maybe<Stratum::boolean_response> read_boolean_response (bytes_view b) {
+        try {
+            reader r {b};
+            message_id id = r.get_id ();
+            byte result = r.get ();
+            if (result > 1 || !r.end ()) return {};
+            return Stratum::boolean_response {id, result == 1};
+        } catch (const std::out_of_range &) {
+            return {};
+        }
+    }
+    
+    frame encode (const JSON &j) {
+        if (notification::valid (j) && notification::method (j) == mining_notify) {
+            auto p = mining::notify::deserialize (notification::params (j));
+            if (p.valid ()) return write_notify (p);
+        } else if (request::valid (j) && request::method (j) == mining_submit) {
+            message_id id = request::id (j);
+            share x = mining::submit_request::deserialize (request::params (j));
+            if (valid_id (id) && x.valid ()) return write_submit (id, x);
+        } else if (response::valid (j) && response::result (j).is_boolean () && !response::error (j)) {
+            message_id id = response::id (j);
+            if (valid_id (id)) return write_boolean_response (id, bool (response::result (j)));
+        }
+        
+        string text = j.dump ();
+        return frame {json, bytes (bytes_view {reinterpret_cast<const byte *> (text.data ()), text.size ()})};
+    }
+    
+    maybe<JSON> decode (const frame &f) {
+        switch (f.Kind) {
+            case submit: {
+                auto x = read_submit (f.Payload);
+                if (!x) return {};
+                return JSON (mining::submit_request {x->ID, x->Share});
+            }
+            
+            case notify: {
+                auto p = read_notify (f.Payload);
+                if (!p) return {};
+                return JSON (notification {mining_notify, mining::notify::serialize (*p)});
+            }
+            
+            case boolean_result: {
+                auto r = read_boolean_response (f.Payload);
+                if (!r) return {};
+                return JSON (*r);
+            }
+            
+            case json: {
+                JSON j = JSON::parse (string (reinterpret_cast<const char *> (f.Payload.data ()), f.Payload.size ()), nullptr, false);
+                if (j.is_discarded ()) return {};
+                return j;
+            }
+            
+            default: return {};
+        }
+    }
+    
+}
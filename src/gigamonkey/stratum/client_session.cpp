@@ -3,6 +3,22 @@
 
 namespace Gigamonkey::Stratum {
     
+    client_session::client_session (ptr<net::session<JSON>> p, const options &o) : remote_receive_handler {p}, Options {o} {
+        Submitter = std::thread {[this] () {
+            submit ();
+        }};
+    }
+    
+    client_session::~client_session () {
+        {
+            std::lock_guard<std::mutex> lock (SubmitMutex);
+            Closing = true;
+        }
+        
+        SubmitWake.notify_all ();
+        if (Submitter.joinable ()) Submitter.join ();
+    }
+    
     void client_session::receive_notification (const notification &n) {
         if (mining::notify::valid (n)) return receive_notify (mining::notify {n}.params ());
         if (mining::set_difficulty::valid (n)) return receive_set_difficulty (mining::set_difficulty {n}.params ());
@@ -41,7 +57,8 @@ namespace Gigamonkey::Stratum {
                 else receive_subscribe (mining::subscribe_response::deserialize (r.result ()));
             } break;
             case mining_submit : {
-                if (r.error ()) receive_submit (false);
+                answered ();
+                if (r.error ()) receive_submit_error (*r.error ());
                 else receive_submit (r.result ());
             } break;
             default: throw exception {"Invalid method returned? Should not be possible."};
@@ -108,6 +125,72 @@ namespace Gigamonkey::Stratum {
         if (r) Authorized = true;
     }
     
+    void client_session::receive_subscribe (const mining::subscribe_response::parameters &p) {
+        Subscriptions = p.Subscriptions;
+        ExtraNonce = p.ExtraNonce;
+    }
+    
+    void client_session::pose_current_puzzle () {
+        if (!Notify || !ExtraNonce || !Difficulty) return;
+        
+        work::puzzle p {Notify->Version, Notify->Digest, work::compact {work::difficulty (*Difficulty)},
+            Merkle::path {0, Notify->Path}, Notify->GenerationTx1, Notify->GenerationTx2,
+            bool (VersionMask) ? *VersionMask : int32_little {-1}};
+        
+        {
+            std::lock_guard<std::mutex> lock (SubmitMutex);
+            // shares for old jobs would be rejected as stale.
+            if (Notify->Clean) Submits.clear ();
+            Posed = std::make_shared<const posed> (posed {Notify->JobID, p});
+        }
+        
+        bytes extra_nonce_2 (ExtraNonce->ExtraNonce2Size);
+        std::fill (extra_nonce_2.begin (), extra_nonce_2.end (), 0);
+        
+        this->pose (p, work::solution {bool (VersionMask) ?
+            work::share {Notify->Now, 0, extra_nonce_2, int32_little {0}} :
+            work::share {Notify->Now, 0, extra_nonce_2}, ExtraNonce->ExtraNonce1});
+    }
+    
+    void client_session::solved (const work::solution &x) {
+        ptr<const posed> current;
+        {
+            std::lock_guard<std::mutex> lock (SubmitMutex);
+            current = Posed;
+        }
+        
+        // the solver may have found this just before it was given a new job.
+        if (current == nullptr || !work::proof {current->Puzzle, x}.valid ()) return;
+        
+        {
+            std::lock_guard<std::mutex> lock (SubmitMutex);
+            if (current != Posed) return;
+            Submits.push_back (share {bool (Options.AuthorizeRequest) ?
+                Options.AuthorizeRequest->Username : worker_name {}, current->JobID, x.Share});
+        }
+        
+        SubmitWake.notify_one ();
+    }
+    
+    void client_session::submit () {
+        std::unique_lock<std::mutex> lock (SubmitMutex);
+        while (true) {
+            SubmitWake.wait (lock, [this] () {
+                return Closing || !Submits.empty ();
+            });
+            
+            if (Closing) return;
+            
+            share x = Submits.front ();
+            Submits.pop_front ();
+            
+            lock.unlock ();
+            submitted (x);
+            send_submit (x);
+            lock.lock ();
+        }
+    }
+    
     /*
     mining::subscribe_response::parameters client_session::subscribe(const mining::subscribe_request::parameters &x) {
         auto serialized = mining::subscribe_request::serialize(x);
@@ -0,0 +1,77 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/exporter.hpp>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace asio = boost::asio;
+    
+    namespace {
+        
+        // scrapers only send small requests.
+        constexpr size_t MaxRequestSize = 1 << 13;
+        
+        struct scrape : std::enable_shared_from_this<scrape> {
+            asio::ip::tcp::socket Socket;
+            asio::streambuf Input;
+            ptr<const statistics> Statistics;
+            string Output;
+            
+            scrape (asio::ip::tcp::socket s, ptr<const statistics> x) :
+                Socket {std::move (s)}, Input {MaxRequestSize}, Statistics {x}, Output {} {}
+            
+            void start () {
+                asio::async_read_until (Socket, Input, "\r\n\r\n",
+                    [self = shared_from_this ()] (const boost::system::error_code &err, size_t) {
+                        if (err) return;
+                        self->Output = exporter::response (*self->Statistics);
+                        asio::async_write (self->Socket, asio::buffer (self->Output),
+                            [self] (const boost::system::error_code &, size_t) {
+                                boost::system::error_code err;
+                                self->Socket.shutdown (asio::ip::tcp::socket::shutdown_both, err);
+                                self->Socket.close (err);
+                            });
+                    });
+            }
+        };
+        
+    }
+    
+    string exporter::response (const statistics &s) {
+        string body = s.write ();
+        return string {"HTTP/1.1 200 OK\r\nContent-Type: "} + ContentType +
+            "\r\nContent-Length: " + std::to_string (body.size ()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+    
+    exporter::exporter (const asio::ip::tcp::endpoint &e, ptr<const statistics> s) :
+        Statistics {s}, IO {}, Acceptor {IO, e}, Thread {} {
+        if (Statistics == nullptr) throw std::invalid_argument {"exporter needs statistics"};
+        accept ();
+        Thread = std::thread {[this] () {
+            IO.run ();
+        }};
+    }
+    
+    exporter::~exporter () {
+        asio::post (IO, [this] () {
+            boost::system::error_code err;
+            Acceptor.close (err);
+        });
+        IO.stop ();
+        Thread.join ();
+    }
+    
+    uint16 exporter::port () const {
+        return Acceptor.local_endpoint ().port ();
+    }
+    
+    void exporter::accept () {
+        Acceptor.async_accept ([this] (const boost::system::error_code &err, asio::ip::tcp::socket s) {
+            if (err) return;
+            std::make_shared<scrape> (std::move (s), Statistics)->start ();
+            accept ();
+        });
+    }
+    
+}
@@ -39,6 +39,12 @@ namespace Gigamonkey::Stratum::extensions {
         return {};
     }
     
+    maybe<configuration<version_midstates>> configuration<version_midstates>::read (const request &p) {
+        auto x = p.contains ("count");
+        if (!x || !x->is_number_unsigned () || uint64 (*x) > 255) return {};
+        return {configuration {byte (*x)}};
+    }
+    
     maybe<configuration<info>> configuration<info>::read (const request &p) {
         auto a = p.contains ("connection-url");
         auto b = p.contains ("hw-version");
@@ -67,8 +73,20 @@ namespace Gigamonkey::Stratum::extensions {
             case (minimum_difficulty) : return "minimum_difficulty";
             case (subscribe_extranonce) : return "subscribe_extranonce";
             case (info) : return "info";
+            case (binary_framing) : return "binary_framing";
+            case (version_midstates) : return "version_midstates";
             default: throw std::invalid_argument{"Unknown extension"};
         }
     }
     
+    extension extension_from_string (std::string st) {
+        if (st == "version_rolling") return version_rolling;
+        if (st == "minimum_difficulty") return minimum_difficulty;
+        if (st == "subscribe_extranonce") return subscribe_extranonce;
+        if (st == "info") return info;
+        if (st == "binary_framing") return binary_framing;
+        if (st == "version_midstates") return version_midstates;
+        throw std::invalid_argument{"Unknown extension"};
+    }
+    
 }
@@ -0,0 +1,78 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/extranonce_allocator.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum {
+    
+    extranonce_allocator::extranonce_allocator (const options &o) :
+        Options {o}, Capacity {0}, Mutex {}, Next {0}, InUse {}, Quarantine {} {
+        if (o.PartitionBits > 31) throw std::invalid_argument {"too many partition bits"};
+        if (uint64 (o.Partition) >= (uint64 {1} << o.PartitionBits)) throw std::invalid_argument {"partition out of range"};
+        if (o.ExtraNonce2Size == 0) throw std::invalid_argument {"extra nonce 2 size must not be zero"};
+        Capacity = uint64 {1} << (32 - o.PartitionBits);
+    }
+    
+    uint32 extranonce_allocator::value (uint32 index) const {
+        if (Options.PartitionBits == 0) return index;
+        return (Options.Partition << (32 - Options.PartitionBits)) | index;
+    }
+    
+    bool extranonce_allocator::owns (session_id x) const {
+        if (Options.PartitionBits == 0) return true;
+        return (uint32 (x) >> (32 - Options.PartitionBits)) == Options.Partition;
+    }
+    
+    maybe<extranonce> extranonce_allocator::take (uint32 now) {
+        uint32 index;
+        
+        // new values are preferred so that released ones stay out of use as long as possible.
+        if (Next < Capacity) index = uint32 (Next++);
+        else if (!Quarantine.empty () && now - Quarantine.front ().Time >= Options.QuarantineSeconds) {
+            index = Quarantine.front ().Index;
+            Quarantine.pop_front ();
+        } else return {};
+        
+        InUse.insert (index);
+        return extranonce {session_id {value (index)}, Options.ExtraNonce2Size};
+    }
+    
+    maybe<extranonce> extranonce_allocator::allocate (uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return take (now);
+    }
+    
+    void extranonce_allocator::release (session_id x, uint32 now) {
+        if (!owns (x)) return;
+        uint32 index = uint32 (x) & uint32 (Capacity - 1);
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (InUse.erase (index) != 0) Quarantine.push_back (released {index, now});
+    }
+    
+    maybe<extranonce> extranonce_allocator::reassign (session_id old, uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        maybe<extranonce> x = take (now);
+        if (!x) return {};
+        
+        if (owns (old)) {
+            uint32 index = uint32 (old) & uint32 (Capacity - 1);
+            if (InUse.erase (index) != 0) Quarantine.push_back (released {index, now});
+        }
+        
+        return x;
+    }
+    
+    size_t extranonce_allocator::in_use () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return InUse.size ();
+    }
+    
+    size_t extranonce_allocator::quarantined () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Quarantine.size ();
+    }
+    
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/failover.hpp>
+
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum {
+
+    uint32 failover::add (work::evaluator &e, double weight) {
+        if (!(weight > 0)) throw std::invalid_argument {"failover weight must be positive"};
+        std::lock_guard<std::mutex> lock (Mutex);
+        Links.push_back (link {&e, weight, {}, work::solution {}, 0, {}, 0, 0});
+        return Links.size () - 1;
+    }
+
+    void failover::pose (uint32 upstream, const work::puzzle &p, const work::solution &initial, double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        link &l = Links.at (upstream);
+        l.Puzzle = p;
+        l.Initial = initial;
+        l.LastJob = now;
+        if (Active && *Active == upstream) Solver.pose (p, initial);
+    }
+
+    void failover::submitted (uint32 upstream, double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Links.at (upstream).Unanswered.push_back (now);
+    }
+
+    void failover::answered (uint32 upstream, double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        link &l = Links.at (upstream);
+        if (l.Unanswered.empty ()) return;
+        l.Latency = now - l.Unanswered.front ();
+        l.Unanswered.pop_front ();
+    }
+
+    bool failover::solved (const work::solution &x) {
+        work::evaluator *to = nullptr;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+
+            // almost always the solution is for the active pool, so try it first.
+            if (Active && Links[*Active].Puzzle && work::proof {*Links[*Active].Puzzle, x}.valid ())
+                to = Links[*Active].Upstream;
+            // otherwise it was found just before a switch.
+            else for (const link &l : Links) if (l.Puzzle && work::proof {*l.Puzzle, x}.valid ()) {
+                to = l.Upstream;
+                break;
+            }
+        }
+
+        if (to == nullptr) return false;
+        to->solved (x);
+        return true;
+    }
+
+    bool failover::is_stalled (const link &l, double now) const {
+        return (bool (l.Puzzle) && now - l.LastJob >= Options.NotifyGapSeconds) ||
+            (!l.Unanswered.empty () && now - l.Unanswered.front () >= Options.SubmitTimeoutSeconds);
+    }
+
+    bool failover::is_ready (const link &l, double now) const {
+        return bool (l.Puzzle) && !is_stalled (l, now);
+    }
+
+    maybe<uint32> failover::choose (double now) const {
+        if (!Options.Split) {
+            for (uint32 i = 0; i < Links.size (); i++) if (is_ready (Links[i], now)) return i;
+            return {};
+        }
+
+        if (Active && is_ready (Links[*Active], now) && now - SliceStart < Options.SliceSeconds) return Active;
+
+        // the pool that has had the least time for its weight, counting the current slice.
+        maybe<uint32> least {};
+        double least_share = 0;
+        for (uint32 i = 0; i < Links.size (); i++) {
+            if (!is_ready (Links[i], now)) continue;
+            double served = Links[i].Served + (Active && *Active == i ? now - SliceStart : 0);
+            double share = served / Links[i].Weight;
+            if (!least || share < least_share) {
+                least = i;
+                least_share = share;
+            }
+        }
+
+        return least;
+    }
+
+    maybe<uint32> failover::switch_to (maybe<uint32> next, double now) {
+        if (Active) Links[*Active].Served += now - SliceStart;
+        SliceStart = now;
+
+        if (next == Active) return Active;
+
+        Active = next;
+        if (Active) {
+            Switches++;
+            Solver.pose (*Links[*Active].Puzzle, Links[*Active].Initial);
+        }
+
+        return Active;
+    }
+
+    maybe<uint32> failover::update (double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+
+        if (Options.Split) {
+            // a pool that was not ready is not owed the time it missed, so it
+            // comes back level with the pool that has had the least time.
+            maybe<double> least {};
+            for (const link &l : Links) if (is_ready (l, now)) {
+                double share = l.Served / l.Weight;
+                if (!least || share < *least) least = share;
+            }
+
+            if (least) for (link &l : Links) if (!is_ready (l, now) && l.Served < *least * l.Weight)
+                l.Served = *least * l.Weight;
+        }
+
+        maybe<uint32> next = choose (now);
+        if (next != Active || (Options.Split && Active && now - SliceStart >= Options.SliceSeconds))
+            return switch_to (next, now);
+
+        return Active;
+    }
+
+    maybe<uint32> failover::active () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Active;
+    }
+
+    bool failover::stalled (uint32 upstream, double now) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return is_stalled (Links.at (upstream), now);
+    }
+
+    bool failover::ready (uint32 upstream, double now) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return is_ready (Links.at (upstream), now);
+    }
+
+    double failover::latency (uint32 upstream) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Links.at (upstream).Latency;
+    }
+
+    uint32 failover::switches () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Switches;
+    }
+
+    size_t failover::upstreams () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Links.size ();
+    }
+
+}
@@ -0,0 +1,188 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/fast_json.hpp>
+
+#include <limits>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        struct scanner {
+            string_view Text;
+            size_t Position;
+            
+            bool end () const {
+                return Position == Text.size ();
+            }
+            
+            void skip () {
+                while (!end () && (Text[Position] == ' ' || Text[Position] == '\t' ||
+                    Text[Position] == '\n' || Text[Position] == '\r')) Position++;
+            }
+            
+            bool expect (char c) {
+                skip ();
+                if (end () || Text[Position] != c) return false;
+                Position++;
+                return true;
+            }
+            
+            bool peek (char c) {
+                skip ();
+                return !end () && Text[Position] == c;
+            }
+            
+            // strings with escapes or characters outside of ASCII are
+            // left for the JSON parser.
+            bool read_string (string_view &x) {
+                if (!expect ('"')) return false;
+                size_t begin = Position;
+                while (!end ()) {
+                    unsigned char c = Text[Position];
+                    if (c == '"') {
+                        x = Text.substr (begin, Position - begin);
+                        Position++;
+                        return true;
+                    }
+                    
+                    if (c < 0x20 || c >= 0x80 || c == '\\') return false;
+                    Position++;
+                }
+                
+                return false;
+            }
+            
+            bool read_unsigned (uint64 &x) {
+                skip ();
+                size_t begin = Position;
+                x = 0;
+                while (!end () && Text[Position] >= '0' && Text[Position] <= '9') {
+                    uint64 digit = Text[Position] - '0';
+                    if (x > (std::numeric_limits<uint64>::max () - digit) / 10) return false;
+                    x = 10 * x + digit;
+                    Position++;
+                }
+                
+                size_t size = Position - begin;
+                if (size == 0 || (size > 1 && Text[begin] == '0')) return false;
+                
+                // fractions and exponents make a float, which is not a valid id.
+                return end () || (Text[Position] != '.' && Text[Position] != 'e' && Text[Position] != 'E');
+            }
+        };
+        
+        // upper case is left for the JSON parser.
+        int hex_digit (char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        }
+        
+        bool read_hex (string_view x, bytes &b) {
+            if (x.size () % 2 != 0) return false;
+            b.resize (x.size () / 2);
+            for (size_t i = 0; i < b.size (); i++) {
+                int high = hex_digit (x[2 * i]);
+                int low = hex_digit (x[2 * i + 1]);
+                if (high < 0 || low < 0) return false;
+                b[i] = byte (high << 4 | low);
+            }
+            
+            return true;
+        }
+        
+        // 8 hex digits as a big endian number, as in mining.cpp.
+        bool read_hex (string_view x, uint32 &n) {
+            if (x.size () != 8) return false;
+            n = 0;
+            for (char c : x) {
+                int d = hex_digit (c);
+                if (d < 0) return false;
+                n = n << 4 | uint32 (d);
+            }
+            
+            return true;
+        }
+        
+    }
+    
+    maybe<submit_line> read_submit (string_view line) {
+        scanner s {line, 0};
+        
+        bool has_id = false;
+        bool has_method = false;
+        bool has_params = false;
+        
+        uint64 number_id = 0;
+        string_view string_id;
+        bool is_string_id = false;
+        
+        string_view params[6];
+        size_t count = 0;
+        
+        if (!s.expect ('{')) return {};
+        
+        while (true) {
+            string_view key;
+            if (!s.read_string (key) || !s.expect (':')) return {};
+            
+            if (key == "id") {
+                if (has_id) return {};
+                has_id = true;
+                
+                if (s.peek ('"')) {
+                    if (!s.read_string (string_id)) return {};
+                    is_string_id = true;
+                } else if (!s.read_unsigned (number_id) || number_id > std::numeric_limits<uint32>::max ()) return {};
+            } else if (key == "method") {
+                string_view m;
+                if (has_method || !s.read_string (m) || m != "mining.submit") return {};
+                has_method = true;
+            } else if (key == "params") {
+                if (has_params || !s.expect ('[')) return {};
+                has_params = true;
+                
+                if (!s.peek (']')) while (true) {
+                    if (count == 6 || !s.read_string (params[count++])) return {};
+                    if (s.peek (']')) break;
+                    if (!s.expect (',')) return {};
+                }
+                
+                if (!s.expect (']')) return {};
+            } else return {};
+            
+            if (s.peek ('}')) break;
+            if (!s.expect (',')) return {};
+        }
+        
+        s.expect ('}');
+        s.skip ();
+        if (!s.end () || !has_id || !has_method || !has_params || count < 5) return {};
+        
+        // the same checks as submit_request::deserialize and share::valid.
+        share x {};
+        uint32 timestamp;
+        uint32 nonce;
+        if (params[0].size () == 0 ||
+            !read_hex (params[2], x.Share.ExtraNonce2) ||
+            !read_hex (params[3], timestamp) ||
+            !read_hex (params[4], nonce)) return {};
+        
+        if (count == 6) {
+            uint32 bits;
+            if (!read_hex (params[5], bits)) return {};
+            x.Share.Bits = int32_little (int32 (bits));
+        }
+        
+        x.Name = string (params[0]);
+        x.JobID = string (params[1]);
+        x.Share.Timestamp = Bitcoin::timestamp {timestamp};
+        x.Share.Nonce = nonce;
+        
+        if (is_string_id) return submit_line {message_id {string (string_id)}, x};
+        return submit_line {message_id {uint32 (number_id)}, x};
+    }
+    
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/job_manager.hpp>
+
+#include <charconv>
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum {
+    
+    job_manager::shared_job::shared_job (uint64 sequence, const mining::notify::parameters &p,
+        ptr<const Boost::puzzle> b, maybe<sha256::state> m) :
+        Sequence {sequence}, Notify {p}, Line {mining::notify::line (p)}, Bounty {b}, Midstate {m}, Mutex {}, Prepared {} {}
+    
+    ptr<const work::prepared_puzzle> job_manager::shared_job::prepared (const maybe<extensions::version_mask> &mask) const {
+        int32_little m = mask ? *mask : int32_little {-1};
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto x = Prepared.find (int32 (m));
+        if (x != Prepared.end ()) return x->second;
+        
+        work::puzzle p (Notify);
+        p.Mask = Bounty != nullptr ? work::puzzle (*Bounty).Mask : m;
+        return Prepared[int32 (m)] = Midstate ?
+            std::make_shared<const work::prepared_puzzle> (p, *Midstate) :
+            std::make_shared<const work::prepared_puzzle> (p);
+    }
+    
+    Boost::proof job_manager::shared_job::bounty (const Stratum::session_id &n1, const work::share &x) const {
+        if (Bounty == nullptr) return {};
+        
+        Boost::output_script script {Bounty->Script};
+        size_t n2 = x.ExtraNonce2.size ();
+        if (script.UseGeneralPurposeBits ? n2 > 32 : n2 != 8) return {};
+        
+        return Boost::proof {work::job {work::puzzle (*Bounty), n1}, x, script.Type, Bitcoin::signature {}, Bounty->MinerKey.to_public ()};
+    }
+    
+    bytes job_manager::shared_job::redeem (const Stratum::session_id &n1, const work::share &x, list<Bitcoin::output> to) const {
+        if (!bounty (n1, x).valid ()) throw std::invalid_argument {"share does not solve the Boost puzzle"};
+        return Bounty->redeem (work::solution {x, n1}, to);
+    }
+    
+    job_manager::job_manager (size_t remember) : Mutex {}, Ring (remember > 0 ? remember : 1), Next {0}, LastClean {0} {}
+    
+    job_id job_manager::id (uint64 sequence) {
+        char x[16];
+        auto r = std::to_chars (x, x + sizeof (x), sequence, 16);
+        return job_id (x, r.ptr);
+    }
+    
+    maybe<uint64> job_manager::sequence (const job_id &id) {
+        uint64 x;
+        auto r = std::from_chars (id.data (), id.data () + id.size (), x, 16);
+        if (id.empty () || r.ec != std::errc {} || r.ptr != id.data () + id.size ()) return {};
+        return x;
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::push (const mining::notify::parameters &p,
+        ptr<const Boost::puzzle> b, maybe<sha256::state> m) {
+        auto j = std::make_shared<const shared_job> (Next, p, b, m);
+        Ring[Next % Ring.size ()] = j;
+        if (p.Clean) LastClean = Next;
+        Next++;
+        return j;
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::update (const work::candidate &c,
+        const bytes &coinbase_header, const bytes &coinbase_body, Bitcoin::timestamp now, bool clean) {
+        if (!c.valid ()) throw std::invalid_argument {"invalid block candidate"};
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        return push (mining::notify::parameters {id (Next),
+            c.Digest, coinbase_header, coinbase_body, c.Path.Digests, c.Category, c.Target, now, clean});
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::update (const work::candidate &c,
+        const coinbase_builder &x, Bitcoin::timestamp now, bool clean) {
+        if (!c.valid ()) throw std::invalid_argument {"invalid block candidate"};
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        return push (mining::notify::parameters {id (Next),
+            c.Digest, x.header (), x.body (), c.Path.Digests, c.Category, c.Target, now, clean}, nullptr, x.midstate ());
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::update (const Boost::puzzle &b, Bitcoin::timestamp now, bool clean) {
+        if (!b.valid ()) throw std::invalid_argument {"invalid Boost puzzle"};
+        
+        work::puzzle p (b);
+        std::lock_guard<std::mutex> lock (Mutex);
+        return push (mining::notify::parameters {id (Next),
+            p.Candidate.Digest, p.Header, p.Body, p.Candidate.Path.Digests, p.Candidate.Category, p.Candidate.Target, now, clean},
+            std::make_shared<const Boost::puzzle> (b));
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::update (const Boost::job_index &x, const Bitcoin::secret &miner, Bitcoin::timestamp now) {
+        maybe<Boost::candidate> best = x.best ();
+        if (!best) return nullptr;
+        
+        // more outputs with the same script do not change the puzzle.
+        ptr<const shared_job> last = current ();
+        bool clean = last == nullptr || last->Bounty == nullptr || last->Bounty->Script != best->Script;
+        return update (Boost::puzzle {*best, miner}, now, clean);
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::refresh (Bitcoin::timestamp now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (Next == 0) return nullptr;
+        
+        const shared_job &last = *Ring[(Next - 1) % Ring.size ()];
+        mining::notify::parameters p = last.Notify;
+        p.JobID = id (Next);
+        p.Now = now;
+        p.Clean = false;
+        return push (p, last.Bounty, last.Midstate);
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::current () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (Next == 0) return nullptr;
+        return Ring[(Next - 1) % Ring.size ()];
+    }
+    
+    ptr<const job_manager::shared_job> job_manager::find (const job_id &x) const {
+        maybe<uint64> n = sequence (x);
+        if (!n) return nullptr;
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (*n >= Next || Next - *n > Ring.size ()) return nullptr;
+        
+        // ids with leading zeros are not ours.
+        const ptr<const shared_job> &j = Ring[*n % Ring.size ()];
+        return j->Notify.JobID == x ? j : nullptr;
+    }
+    
+    bool job_manager::stale (const shared_job &j) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return j.Sequence < LastClean;
+    }
+    
+}
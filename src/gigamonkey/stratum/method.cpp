@@ -27,6 +27,8 @@ namespace Gigamonkey::Stratum {
                 return "client.get_version";
             case client_show_message :
                 return "client.show_message";
+            case mining_set_midstates :
+                return "mining.set_midstates";
             default: 
                 return "";
         }
@@ -43,6 +45,7 @@ namespace Gigamonkey::Stratum {
         if (st == "mining.set_version_mask") return mining_set_version_mask;
         if (st == "client.get_version") return client_get_version;
         if (st == "client.show_message") return client_show_message;
+        if (st == "mining.set_midstates") return mining_set_midstates;
         return unset;
     }
 }
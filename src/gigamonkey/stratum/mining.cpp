@@ -2,6 +2,7 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/stratum/job.hpp>
+#include <gigamonkey/hex.hpp>
 
 namespace Gigamonkey::Stratum::mining {
     
@@ -29,22 +30,18 @@ namespace Gigamonkey::Stratum::mining {
             return true;
         }
         
-        encoding::hex::string inline write (const bytes &b) {
-            return encoding::hex::write (b, hex_case::lower);
+        string inline write (const bytes &b) {
+            return Gigamonkey::hex::write (b);
         }
         
         bool read (const JSON &j, bytes &x) {
             if (!j.is_string ()) return false;
-            string str (j);
-            maybe<bytes> b = encoding::hex::read (str);
-            if (!bool (b)) return false;
-            x = *b;
-            return true;
+            return Gigamonkey::hex::read (j.get_ref<const std::string &> (), x);
         }
         
         parameters write (const Merkle::digests& x) {
             parameters p;
-            Merkle::digests n;
+            Merkle::digests n = x;
             p.resize (x.size ());
             for (auto it = p.rbegin (); it != p.rend (); ++it) {
                 *it = write (n.first ().Value);
@@ -147,6 +144,43 @@ namespace Gigamonkey::Stratum::mining {
             write (p.Path), write (p.Version), write (p.Target), write (p.Now), p.Clean};
     }
     
+    string notify::line (const parameters &p) {
+        string x;
+        x.reserve (160 + 2 * (p.GenerationTx1.size () + p.GenerationTx2.size ()) + 67 * p.Path.size ());
+        
+        auto quote = [&x] (const string &str) {
+            x += '"';
+            x += str;
+            x += "\",";
+        };
+        
+        x += "{\"id\":null,\"method\":\"mining.notify\",\"params\":[";
+        
+        // the job id is the only value that could need to be escaped.
+        x += JSON (p.JobID).dump ();
+        x += ',';
+        
+        quote (write (p.Digest));
+        quote (write (p.GenerationTx1));
+        quote (write (p.GenerationTx2));
+        
+        x += '[';
+        for (const JSON &d : write (p.Path)) {
+            if (x.back () != '[') x += ',';
+            x += '"';
+            x += string (d);
+            x += '"';
+        }
+        x += "],";
+        
+        quote (write (p.Version));
+        quote (write (p.Target));
+        quote (write (p.Now));
+        
+        x += p.Clean ? "true]}\n" : "false]}\n";
+        return x;
+    }
+    
     notify::parameters notify::deserialize (const Stratum::parameters &n) {
         
         parameters p;
@@ -0,0 +1,82 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/mining_set_midstates.hpp>
+#include <gigamonkey/hex.hpp>
+
+namespace Gigamonkey::Stratum::mining {
+
+    namespace {
+
+        void put_big (byte *out, uint32 x) {
+            for (int i = 0; i < 4; i++) out[i] = byte (x >> (24 - 8 * i));
+        }
+
+        uint32 get_big (const byte *in) {
+            uint32 x = 0;
+            for (int i = 0; i < 4; i++) x = (x << 8) | in[i];
+            return x;
+        }
+
+        bool read (const JSON &j, byte *out, size_t size) {
+            if (!j.is_string ()) return false;
+            const std::string &str = j.get_ref<const std::string &> ();
+            return str.size () == 2 * size && Gigamonkey::hex::read (out, str.data (), size);
+        }
+
+        string write (const byte *in, size_t size) {
+            string x (2 * size, '0');
+            Gigamonkey::hex::write (x.data (), in, size);
+            return x;
+        }
+
+    }
+
+    Stratum::parameters set_midstates::serialize (const parameters &p) {
+        JSON midstates = JSON::array ();
+        for (const midstate &m : p.Midstates) {
+            byte bits[4];
+            put_big (bits, uint32 (int32 (m.Bits)));
+            byte state[32];
+            for (int i = 0; i < 8; i++) put_big (state + 4 * i, m.State[i]);
+            midstates.push_back (JSON::array ({write (bits, 4), write (state, 32)}));
+        }
+
+        Stratum::parameters x;
+        x.push_back (p.JobID);
+        x.push_back (Gigamonkey::hex::write (p.ExtraNonce2));
+        x.push_back (write (p.RootTail.data (), 4));
+        x.push_back (midstates);
+        return x;
+    }
+
+    maybe<set_midstates::parameters> set_midstates::deserialize (const Stratum::parameters &x) {
+        if (x.size () != 4 || !x[0].is_string () || !x[1].is_string () || !x[3].is_array ()) return {};
+
+        parameters p;
+        p.JobID = string (x[0]);
+
+        maybe<bytes> n2 = Gigamonkey::hex::read (x[1].get_ref<const std::string &> ());
+        if (!n2) return {};
+        p.ExtraNonce2 = *n2;
+
+        if (!read (x[2], p.RootTail.data (), 4)) return {};
+
+        p.Midstates.reserve (x[3].size ());
+        for (const JSON &m : x[3]) {
+            if (!m.is_array () || m.size () != 2) return {};
+
+            byte bits[4];
+            byte state[32];
+            if (!read (m[0], bits, 4) || !read (m[1], state, 32)) return {};
+
+            midstate z;
+            z.Bits = int32_little {int32 (get_big (bits))};
+            for (int i = 0; i < 8; i++) z.State[i] = get_big (state + 4 * i);
+            p.Midstates.push_back (z);
+        }
+
+        return p;
+    }
+
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/proxy.hpp>
+
+#include <string>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        // the part of the upstream extra nonce 2 that is the downstream extra nonce 1.
+        constexpr size_t split = 4;
+        
+    }
+    
+    uint32 proxy::add (work::evaluator &e) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Links.push_back (link {&e, {}, {}, {}, 0, nullptr});
+        return Links.size () - 1;
+    }
+    
+    void proxy::pose (uint32 upstream, const work::puzzle &p, const work::solution &initial) {
+        mining::notify::parameters n;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (upstream >= Links.size ()) return;
+            link &l = Links[upstream];
+            
+            size_t size = initial.Share.ExtraNonce2.size ();
+            bool changed = !l.Puzzle || l.Initial.ExtraNonce1 != initial.ExtraNonce1 || l.Initial.Share.ExtraNonce2.size () != size;
+            if (changed) {
+                l.Miners = nullptr;
+                if (size > split) {
+                    extranonce_allocator::options o {};
+                    o.PartitionBits = 0;
+                    o.QuarantineSeconds = Options.QuarantineSeconds;
+                    o.ExtraNonce2Size = size - split;
+                    l.Miners = std::make_unique<extranonce_allocator> (o);
+                }
+            }
+            
+            l.Puzzle = p;
+            l.Initial = initial;
+            
+            if (l.Miners == nullptr) {
+                l.Notify = {};
+                return;
+            }
+            
+            // the upstream extra nonce 1 is the same for every miner.
+            bytes header (p.Header.size () + 4);
+            std::copy (p.Header.begin (), p.Header.end (), header.begin ());
+            std::copy (initial.ExtraNonce1.begin (), initial.ExtraNonce1.end (), header.begin () + p.Header.size ());
+            
+            work::puzzle downstream = p;
+            downstream.Header = header;
+            
+            // only shares for the current job can be passed on, so every job is clean.
+            n = mining::notify::parameters {std::to_string (upstream) + "." + std::to_string (l.Jobs++),
+                downstream, initial.Share.Timestamp, true};
+            l.Notify = n;
+        }
+        
+        Relay (upstream, n);
+    }
+    
+    maybe<proxy::assignment> proxy::assign (uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        maybe<uint32> best {};
+        for (uint32 i = 0; i < Links.size (); i++) {
+            const link &l = Links[i];
+            if (!l.Notify || l.Miners->in_use () == l.Miners->capacity ()) continue;
+            if (!best || l.Miners->in_use () < Links[*best].Miners->in_use ()) best = i;
+        }
+        
+        if (!best) return {};
+        
+        maybe<extranonce> x = Links[*best].Miners->allocate (now);
+        if (!x) return {};
+        return assignment {*best, *x};
+    }
+    
+    void proxy::release (const assignment &a, uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (a.Upstream >= Links.size ()) return;
+        if (Links[a.Upstream].Miners != nullptr) Links[a.Upstream].Miners->release (a.ExtraNonce.ExtraNonce1, now);
+    }
+    
+    maybe<mining::notify::parameters> proxy::job (uint32 upstream) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (upstream >= Links.size ()) return {};
+        return Links[upstream].Notify;
+    }
+    
+    proxy::result proxy::submit (const assignment &a, const share &x) {
+        work::evaluator *e;
+        work::solution solution;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (a.Upstream >= Links.size ()) return invalid;
+            const link &l = Links[a.Upstream];
+            if (!l.Notify || x.JobID != l.Notify->JobID) return stale;
+            
+            size_t size = l.Initial.Share.ExtraNonce2.size ();
+            if (a.ExtraNonce.ExtraNonce2Size + split != size || x.Share.ExtraNonce2.size () + split != size) return invalid;
+            
+            // the miner's extra nonce 1 and 2 make up the upstream extra nonce 2.
+            bytes extra_nonce_2 (size);
+            std::copy (a.ExtraNonce.ExtraNonce1.begin (), a.ExtraNonce.ExtraNonce1.end (), extra_nonce_2.begin ());
+            std::copy (x.Share.ExtraNonce2.begin (), x.Share.ExtraNonce2.end (), extra_nonce_2.begin () + split);
+            
+            work::share upstream_share = x.Share;
+            upstream_share.ExtraNonce2 = extra_nonce_2;
+            solution = work::solution {upstream_share, l.Initial.ExtraNonce1};
+            
+            if (!work::proof {*l.Puzzle, solution}.valid ()) return below_target;
+            e = l.Upstream;
+        }
+        
+        e->solved (solution);
+        return forwarded;
+    }
+    
+    size_t proxy::upstreams () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Links.size ();
+    }
+    
+    size_t proxy::miners (uint32 upstream) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (upstream >= Links.size () || Links[upstream].Miners == nullptr) return 0;
+        return Links[upstream].Miners->in_use ();
+    }
+    
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/rate_limit.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum {
+    
+    double token_bucket::tokens (double now) const {
+        return std::min (Burst, Tokens + std::max (now - Last, 0.) * Rate);
+    }
+    
+    bool token_bucket::take (double now, double cost) {
+        Tokens = tokens (now);
+        Last = std::max (now, Last);
+        if (Tokens < cost) return false;
+        Tokens -= cost;
+        return true;
+    }
+    
+    rate_limits::rate_limits (const options &o, std::function<size_t ()> load) :
+        Options {o}, Load {load}, Mutex {}, Addresses {}, LastSweep {0} {
+        if (!(o.SessionMessagesPerSecond > 0) || !(o.SessionBurst > 0) ||
+            !(o.AddressMessagesPerSecond > 0) || !(o.AddressBurst > 0) || !(o.ShedCost >= 1))
+            throw std::invalid_argument {"invalid rate limits"};
+    }
+    
+    bool rate_limits::shedding () const {
+        return bool (Load) && Load () >= Options.ShedLoad;
+    }
+    
+    token_bucket rate_limits::session (double now) const {
+        return token_bucket {Options.SessionMessagesPerSecond, Options.SessionBurst, now};
+    }
+    
+    bool rate_limits::take_address (const string &address, double now, double cost) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        
+        // an idle address whose bucket has filled up is the same as one that we have never seen.
+        if (now - LastSweep >= Options.ForgetAddressSeconds) {
+            LastSweep = now;
+            std::erase_if (Addresses, [this, now] (const auto &x) -> bool {
+                return now - x.second.last () >= Options.ForgetAddressSeconds && x.second.tokens (now) >= x.second.Burst;
+            });
+        }
+        
+        auto x = Addresses.find (address);
+        if (x == Addresses.end ()) x = Addresses.emplace (address,
+            token_bucket {Options.AddressMessagesPerSecond, Options.AddressBurst, now}).first;
+        
+        return x->second.take (now, cost);
+    }
+    
+    // the session is charged first so that one noisy session
+    // does not use up what the others at its address are allowed.
+    bool rate_limits::allow (token_bucket &session, const string &address, double now) {
+        double cost = shedding () ? Options.ShedCost : 1;
+        return session.take (now, cost) && take_address (address, now, cost);
+    }
+    
+    bool rate_limits::connect (const string &address, double now) {
+        return take_address (address, now, shedding () ? Options.ShedCost : 1);
+    }
+    
+    size_t rate_limits::addresses () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Addresses.size ();
+    }
+    
+}
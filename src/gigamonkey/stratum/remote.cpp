@@ -2,9 +2,23 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/stratum/remote.hpp>
+#include <gigamonkey/stratum/fast_json.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <chrono>
+#include <limits>
 
 namespace Gigamonkey::Stratum {
     
+    namespace {
+        
+        uint32 seconds () {
+            return uint32 (std::chrono::duration_cast<std::chrono::seconds> (
+                std::chrono::steady_clock::now ().time_since_epoch ()).count ());
+        }
+        
+    }
+    
     void remote_receive_handler::operator () (const JSON &next) {
         if (notification::valid (next)) {
             receive_notification (notification {next});
@@ -12,16 +26,13 @@ namespace Gigamonkey::Stratum {
         }
         
         if (response::valid (next)) {
-            method m;
             response r {next};
-            {
-                auto x = Request.find (r.id ());
-                if (x == Request.end ()) throw exception{"response with unknown message id returned"};
-                m = x->second;
-                Request.erase (x);
-            }
+            message_id id = r.id ();
+            maybe<method> m;
+            if (id.is_number_unsigned ()) m = Request.remove (request_id (id));
+            if (!m) throw exception {"response with unknown message id returned"};
             
-            receive_response (m, r);
+            receive_response (*m, r);
             return;
         }
         
@@ -33,11 +44,75 @@ namespace Gigamonkey::Stratum {
         throw exception {} << "invalid Stratum message received: " << next.dump ();
     }
     
+    void remote_receive_handler::receive_line (string_view line) {
+        // each line that is sampled begins a trace, of which a share that it submits is a part.
+        trace::span parsing {"stratum.parse", trace::context {}};
+        
+        if (auto x = read_submit (line); bool (x)) return receive_submit (x->ID, x->Share);
+        
+        JSON j = JSON::parse (line, nullptr, false);
+        if (j.is_discarded ()) parse_error (string (line));
+        else (*this) (j);
+    }
+    
     request_id remote_receive_handler::send_request (method m, parameters p) {
-        message_id id (Requests);
-        Send->send (Stratum::request {id, m, p});
-        Request[id] = m;
-        return Requests++;
+        expire_requests ();
+        
+        maybe<pending_requests::entry> displaced;
+        request_id id = Request.insert (m, seconds (), displaced);
+        if (displaced) request_timed_out (displaced->ID, displaced->Method);
+        
+        Send->send (Stratum::request {message_id (uint32 (id)), m, p});
+        return id;
+    }
+    
+    void remote_receive_handler::expire_requests () {
+        uint32 now = seconds ();
+        if (now < RequestTimeoutSeconds) return;
+        for (const pending_requests::entry &e : Request.expire (now - RequestTimeoutSeconds))
+            request_timed_out (e.ID, e.Method);
+    }
+    
+    pending_requests::pending_requests (uint32 capacity) :
+        Capacity {capacity > 0 ? capacity : 1}, Slots {new slot[capacity > 0 ? capacity : 1]}, Next {0} {
+        for (uint32 i = 0; i < Capacity; i++) {
+            Slots[i].Tag.store (0, std::memory_order_relaxed);
+            Slots[i].Sent.store (0, std::memory_order_relaxed);
+        }
+    }
+    
+    request_id pending_requests::insert (method m, uint32 now, maybe<entry> &displaced) {
+        request_id id = Next.fetch_add (1, std::memory_order_relaxed);
+        slot &x = Slots[id % Capacity];
+        
+        x.Sent.store (now, std::memory_order_relaxed);
+        uint64 old = x.Tag.exchange (tag (id, m), std::memory_order_acq_rel);
+        
+        displaced = {};
+        if (old != 0) displaced = read (old);
+        return id;
+    }
+    
+    maybe<method> pending_requests::remove (request_id id) {
+        if (id > std::numeric_limits<uint32>::max ()) return {};
+        slot &x = Slots[id % Capacity];
+        
+        uint64 current = x.Tag.load (std::memory_order_acquire);
+        if (current == 0 || read (current).ID != id) return {};
+        if (!x.Tag.compare_exchange_strong (current, 0, std::memory_order_acq_rel)) return {};
+        return read (current).Method;
+    }
+    
+    std::vector<pending_requests::entry> pending_requests::expire (uint32 before) {
+        std::vector<entry> expired;
+        for (uint32 i = 0; i < Capacity; i++) {
+            slot &x = Slots[i];
+            uint64 current = x.Tag.load (std::memory_order_acquire);
+            if (current == 0 || x.Sent.load (std::memory_order_relaxed) >= before) continue;
+            if (x.Tag.compare_exchange_strong (current, 0, std::memory_order_acq_rel)) expired.push_back (read (current));
+        }
+        
+        return expired;
     }
     
 }
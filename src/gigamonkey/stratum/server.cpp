@@ -0,0 +1,307 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/server.hpp>
+
+#include <chrono>
+#include <deque>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace asio = boost::asio;
+    
+    namespace {
+        
+        double seconds () {
+            return std::chrono::duration<double> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+        }
+        
+    }
+    
+    struct server::connection final : net::session<JSON>, std::enable_shared_from_this<connection> {
+        server &Server;
+        asio::ip::tcp::socket Socket;
+        asio::strand<asio::io_context::executor_type> Strand;
+        asio::steady_timer Timer;
+        asio::streambuf Input;
+        
+        ptr<server_session> Session;
+        
+        // messages waiting to be written. The first Writing of them are
+        // being written now. A message to many connections is shared by all.
+        std::deque<ptr<const string>> Output;
+        size_t Writing;
+        size_t Queued;
+        
+        bool Closed;
+        
+        // for rate limits.
+        string Address;
+        maybe<token_bucket> Bucket;
+        uint32 Refused;
+        double LastShed;
+        
+        connection (server &s, asio::ip::tcp::socket x, const string &address) : Server {s}, Socket {std::move (x)},
+            Strand {asio::make_strand (s.IO)}, Timer {Strand}, Input {s.Options.MaxMessageSize},
+            Session {}, Output {}, Writing {0}, Queued {0}, Closed {false}, Address {address}, Bucket {}, Refused {0}, LastShed {0} {
+            if (s.Limits != nullptr) Bucket = s.Limits->session (seconds ());
+        }
+        
+        void start ();
+        void read ();
+        
+        // whether a message that has been received should be handled.
+        bool allow ();
+        void wait ();
+        void write ();
+        
+        // queue a message that has already been serialized, ending with a newline.
+        void send (ptr<const string>);
+        
+        // called by the session, which is always on our strand.
+        void send (JSON j) override;
+        
+        bool closed () override {
+            return Closed;
+        }
+        
+        void close () override;
+    };
+    
+    void server::connection::start () {
+        asio::dispatch (Strand, [self = shared_from_this ()] () {
+            boost::system::error_code err;
+            self->Socket.set_option (asio::socket_base::keep_alive {true}, err);
+            self->Session = self->Server.Make (self);
+            self->wait ();
+            self->read ();
+        });
+    }
+    
+    // we are closed if the timer goes off before the next message.
+    void server::connection::wait () {
+        Timer.expires_after (std::chrono::seconds {Server.Options.IdleTimeoutSeconds});
+        Timer.async_wait ([self = shared_from_this ()] (const boost::system::error_code &err) {
+            if (err != asio::error::operation_aborted) self->close ();
+        });
+    }
+    
+    void server::connection::read () {
+        asio::async_read_until (Socket, Input, '\n',
+            asio::bind_executor (Strand, [self = shared_from_this ()] (const boost::system::error_code &err, size_t size) {
+                if (err || self->Closed) return self->close ();
+                
+                string line {asio::buffers_begin (self->Input.data ()), asio::buffers_begin (self->Input.data ()) + size};
+                self->Input.consume (size);
+                self->wait ();
+                
+                try {
+                    if (self->allow ()) self->Session->receive_line (line);
+                } catch (...) {
+                    return self->close ();
+                }
+                
+                if (!self->Closed) self->read ();
+            }));
+    }
+    
+    bool server::connection::allow () {
+        if (Server.Limits == nullptr) return true;
+        
+        rate_limits &limits = *Server.Limits;
+        double now = seconds ();
+        
+        if (limits.shedding () && now - LastShed >= limits.Options.ShedIntervalSeconds) {
+            LastShed = now;
+            Session->raise_difficulty (limits.Options.ShedDifficultyFactor);
+        }
+        
+        if (limits.allow (*Bucket, Address, now)) {
+            Refused = 0;
+            return true;
+        }
+        
+        if (Server.Options.Statistics != nullptr) Server.Options.Statistics->Throttled++;
+        if (++Refused >= limits.Options.MaxRefused) close ();
+        return false;
+    }
+    
+    void server::connection::send (JSON j) {
+        send (std::make_shared<const string> (j.dump () + "\n"));
+    }
+    
+    void server::connection::send (ptr<const string> message) {
+        if (Closed) return;
+        
+        Queued += message->size ();
+        Server.Queued += message->size ();
+        
+        // the miner is not keeping up.
+        if (Queued > Server.Options.MaxQueuedBytes) return close ();
+        
+        Output.push_back (std::move (message));
+        if (Writing == 0) write ();
+    }
+    
+    // everything that is waiting is written at once.
+    void server::connection::write () {
+        std::vector<asio::const_buffer> buffers;
+        buffers.reserve (Output.size ());
+        for (const ptr<const string> &x : Output) buffers.push_back (asio::buffer (*x));
+        Writing = Output.size ();
+        
+        asio::async_write (Socket, buffers,
+            asio::bind_executor (Strand, [self = shared_from_this ()] (const boost::system::error_code &err, size_t size) {
+                if (err || self->Closed) return self->close ();
+                
+                self->Queued -= size;
+                self->Server.Queued -= size;
+                self->Output.erase (self->Output.begin (), self->Output.begin () + self->Writing);
+                self->Writing = 0;
+                if (!self->Output.empty () && !self->Closed) self->write ();
+            }));
+    }
+    
+    void server::connection::close () {
+        if (Closed) return;
+        Closed = true;
+        
+        // nothing more will be written.
+        Server.Queued -= Queued;
+        Queued = 0;
+        
+        boost::system::error_code err;
+        Timer.cancel ();
+        Socket.shutdown (asio::ip::tcp::socket::shutdown_both, err);
+        Socket.close (err);
+        
+        // the session points back to us, but it may be the one that closed us,
+        // so we let it go after it returns.
+        asio::post (Strand, [self = shared_from_this ()] () {
+            self->Session = nullptr;
+        });
+        
+        Server.remove (this);
+    }
+    
+    server::server (const asio::ip::tcp::endpoint &e, make_session m, const options &o) :
+        Options {o}, Make {m}, Limits {o.RateLimits ? std::make_shared<rate_limits> (*o.RateLimits, o.Load) : nullptr},
+        IO {}, Acceptor {IO, e}, Threads {}, Mutex {}, Connections {}, Queued {0} {
+        accept ();
+        for (uint32 i = 0; i < std::max (Options.Threads, uint32 {1}); i++) Threads.emplace_back ([this] () {
+            IO.run ();
+        });
+    }
+    
+    server::~server () {
+        stop ();
+        for (std::thread &t : Threads) t.join ();
+    }
+    
+    void server::stop () {
+        asio::post (IO, [this] () {
+            boost::system::error_code err;
+            Acceptor.close (err);
+            
+            std::vector<ptr<connection>> open;
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                open = Connections;
+            }
+            
+            for (const ptr<connection> &c : open) asio::dispatch (c->Strand, [c] () {
+                c->close ();
+            });
+        });
+    }
+    
+    size_t server::connections () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Connections.size ();
+    }
+    
+    size_t server::queued () const {
+        return Queued.load ();
+    }
+    
+    uint16 server::port () const {
+        return Acceptor.local_endpoint ().port ();
+    }
+    
+    void server::accept () {
+        Acceptor.async_accept (asio::make_strand (IO), [this] (const boost::system::error_code &err, asio::ip::tcp::socket s) {
+            if (err) return;
+            
+            boost::system::error_code endpoint_err;
+            auto endpoint = s.remote_endpoint (endpoint_err);
+            string address = endpoint_err ? string {} : endpoint.address ().to_string ();
+            
+            // the socket is closed when it goes away.
+            if (Limits != nullptr && !Limits->connect (address, seconds ())) {
+                if (Options.Statistics != nullptr) Options.Statistics->Throttled++;
+                return accept ();
+            }
+            
+            auto c = std::make_shared<connection> (*this, std::move (s), address);
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                Connections.push_back (c);
+            }
+            
+            if (Options.Statistics != nullptr) {
+                Options.Statistics->Sessions++;
+                Options.Statistics->Connections++;
+            }
+            
+            c->start ();
+            accept ();
+        });
+    }
+    
+    void server::remove (const connection *c) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        for (size_t i = 0; i < Connections.size (); i++) if (Connections[i].get () == c) {
+            Connections[i] = Connections.back ();
+            Connections.pop_back ();
+            if (Options.Statistics != nullptr) Options.Statistics->Sessions--;
+            return;
+        }
+    }
+    
+    // the message is the same for every session, so we only serialize it once.
+    // Per-session values such as extranonce and difficulty are sent separately.
+    void server::notify (const mining::notify::parameters &p) {
+        std::vector<ptr<connection>> open;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            open = Connections;
+        }
+        
+        auto start = std::chrono::steady_clock::now ();
+        auto job = std::make_shared<const mining::notify::parameters> (p);
+        auto message = std::make_shared<const string> (mining::notify::line (p));
+        
+        // the last session to be given the job records how long it took.
+        auto remaining = std::make_shared<std::atomic<size_t>> (open.size ());
+        ptr<statistics> stats = Options.Statistics;
+        auto done = [start, remaining, stats] () {
+            if (stats == nullptr || remaining->fetch_sub (1) != 1) return;
+            stats->notified (std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now () - start).count ());
+        };
+        
+        if (open.empty () && stats != nullptr) stats->notified (0);
+        
+        for (const ptr<connection> &c : open) asio::post (c->Strand, [c, job, message, done] () {
+            if (!c->Closed && c->Session != nullptr && c->Session->subscribed ()) try {
+                c->Session->notified (*job);
+                c->send (message);
+                c->Session->send_midstates (*job);
+            } catch (...) {
+                c->close ();
+            }
+            
+            done ();
+        });
+    }
+    
+}
@@ -2,9 +2,373 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/stratum/server_session.hpp>
+#include <gigamonkey/stratum/share_pipeline.hpp>
+
+#include <bit>
+#include <stdexcept>
 
 namespace Gigamonkey::Stratum {
     
+    namespace {
+        
+        // the version of the snapshot format. Version 2 added binary framing and version midstates.
+        constexpr byte snapshot_version = 2;
+        
+        // numbers are little endian and strings are preceded by their sizes.
+        struct snapshot_writer {
+            bytes Bytes {};
+            
+            void put (byte b) {
+                Bytes.push_back (b);
+            }
+            
+            void put_32 (uint32 x) {
+                for (int i = 0; i < 4; i++) put (byte (x >> (8 * i)));
+            }
+            
+            void put_64 (uint64 x) {
+                for (int i = 0; i < 8; i++) put (byte (x >> (8 * i)));
+            }
+            
+            void put (bytes_view b) {
+                put_32 (b.size ());
+                for (byte x : b) put (x);
+            }
+            
+            void put (const string &x) {
+                put (bytes_view {reinterpret_cast<const byte *> (x.data ()), x.size ()});
+            }
+            
+            template <typename X> void put_digest (const X &d) {
+                for (byte x : d) put (x);
+            }
+            
+            // difficulty may be an integer or a float.
+            void put (const difficulty &d) {
+                if (d.is_number_unsigned ()) {
+                    put (byte (1));
+                    put_64 (uint64 (d));
+                } else if (d.is_number_float ()) {
+                    put (byte (2));
+                    put_64 (std::bit_cast<uint64> (double (d)));
+                } else put (byte (0));
+            }
+            
+            void put (const extranonce &n) {
+                put_32 (uint32 (n.ExtraNonce1));
+                put_32 (n.ExtraNonce2Size);
+            }
+            
+            void put (const optional<extensions::version_mask> &m) {
+                put (byte (bool (m)));
+                if (m) put_32 (uint32 (int32 (*m)));
+            }
+            
+            void put (const mining::notify::parameters &p) {
+                put (p.JobID);
+                put_digest (p.Digest);
+                put (bytes_view {p.GenerationTx1});
+                put (bytes_view {p.GenerationTx2});
+                put_32 (p.Path.size ());
+                for (const digest256 &d : p.Path) put_digest (d);
+                put_32 (uint32 (int32 (p.Version)));
+                put_32 (uint32 (p.Target));
+                put_32 (uint32 (p.Now.Value));
+                put (byte (p.Clean));
+            }
+        };
+        
+        // throws std::out_of_range if the snapshot is too short.
+        struct snapshot_reader {
+            bytes_view Data;
+            size_t Position {0};
+            
+            byte get () {
+                if (Position >= Data.size ()) throw std::out_of_range {"snapshot is too short"};
+                return Data[Position++];
+            }
+            
+            uint32 get_32 () {
+                uint32 x = 0;
+                for (int i = 0; i < 4; i++) x |= uint32 (get ()) << (8 * i);
+                return x;
+            }
+            
+            uint64 get_64 () {
+                uint64 x = 0;
+                for (int i = 0; i < 8; i++) x |= uint64 (get ()) << (8 * i);
+                return x;
+            }
+            
+            bytes get_bytes () {
+                uint32 size = get_32 ();
+                if (size > Data.size () - Position) throw std::out_of_range {"snapshot is too short"};
+                bytes b (size);
+                for (byte &x : b) x = get ();
+                return b;
+            }
+            
+            string get_string () {
+                bytes b = get_bytes ();
+                return string (b.begin (), b.end ());
+            }
+            
+            template <typename X> X get_digest () {
+                X d {};
+                for (byte &x : d) x = get ();
+                return d;
+            }
+            
+            Stratum::difficulty get_difficulty () {
+                switch (get ()) {
+                    case 0: return Stratum::difficulty {};
+                    case 1: return Stratum::difficulty {get_64 ()};
+                    case 2: return Stratum::difficulty {work::difficulty {std::bit_cast<double> (get_64 ())}};
+                    default: throw std::out_of_range {"invalid difficulty in snapshot"};
+                }
+            }
+            
+            Stratum::extranonce get_extranonce () {
+                uint32 n1 = get_32 ();
+                return Stratum::extranonce {session_id {n1}, get_32 ()};
+            }
+            
+            optional<extensions::version_mask> get_mask () {
+                if (get () == 0) return {};
+                return extensions::version_mask {int32 (get_32 ())};
+            }
+            
+            mining::notify::parameters get_notify () {
+                job_id id = get_string ();
+                uint256 digest = get_digest<uint256> ();
+                bytes tx1 = get_bytes ();
+                bytes tx2 = get_bytes ();
+                
+                std::vector<digest256> path (get_32 ());
+                if (path.size () > (Data.size () - Position) / 32) throw std::out_of_range {"snapshot is too short"};
+                for (digest256 &d : path) d = get_digest<digest256> ();
+                Merkle::digests p;
+                for (auto d = path.rbegin (); d != path.rend (); d++) p = p << *d;
+                
+                int32_little version {int32 (get_32 ())};
+                work::compact target {get_32 ()};
+                Bitcoin::timestamp now {get_32 ()};
+                bool clean = get () != 0;
+                return mining::notify::parameters {id, digest, tx1, tx2, p, version, target, now, clean};
+            }
+        };
+        
+    }
+    
+    bytes server_session::state::snapshot () const {
+        snapshot_writer w {};
+        w.put (snapshot_version);
+        w.put (byte (Configured));
+        w.put (byte (BinaryFraming));
+        w.put (VersionMidstates);
+        w.put_32 (uint32 (int32 (VersionRollingMaskParameters.LocalMask)));
+        w.put_32 (uint32 (int32 (VersionRollingMaskParameters.RequestedMask.Mask)));
+        w.put (VersionRollingMaskParameters.RequestedMask.MinBitCount);
+        
+        w.put (MinimumDifficulty ? *MinimumDifficulty : Stratum::difficulty {});
+        w.put (byte (bool (ClientVersion)));
+        if (ClientVersion) w.put (*ClientVersion);
+        w.put (byte (bool (Name)));
+        if (Name) w.put (*Name);
+        
+        w.put_32 (Subscriptions.size ());
+        for (const mining::subscription &x : Subscriptions) {
+            w.put (byte (x.Method));
+            w.put (x.ID);
+        }
+        
+        w.put (Extranonce);
+        w.put (NextExtranonce);
+        w.put (Difficulty);
+        w.put (NextDifficulty);
+        
+        // the jobs, with the shares that have been submitted for them.
+        w.put_64 (Notifies.evicted_stale_shares ());
+        std::vector<const history::entry *> jobs = Notifies.entries ();
+        w.put_32 (jobs.size ());
+        for (const history::entry *e : jobs) {
+            w.put (e->Mask);
+            w.put (e->ExtraNonce);
+            w.put (e->Notification);
+            w.put_32 (e->StaleShares);
+            std::vector<uint64> shares = e->Shares.hashes ();
+            w.put_32 (shares.size ());
+            for (uint64 x : shares) w.put_64 (x);
+        }
+        
+        return w.Bytes;
+    }
+    
+    maybe<server_session::state> server_session::state::restore (const options &o, bytes_view b) {
+        state x {o};
+        try {
+            snapshot_reader r {b};
+            if (r.get () != snapshot_version) return {};
+            
+            x.Configured = r.get () != 0;
+            x.BinaryFraming = r.get () != 0;
+            x.VersionMidstates = r.get ();
+            x.VersionRollingMaskParameters.LocalMask = extensions::version_mask {int32 (r.get_32 ())};
+            x.VersionRollingMaskParameters.RequestedMask.Mask = extensions::version_mask {int32 (r.get_32 ())};
+            x.VersionRollingMaskParameters.RequestedMask.MinBitCount = r.get ();
+            
+            Stratum::difficulty minimum = r.get_difficulty ();
+            if (minimum.valid ()) x.MinimumDifficulty = minimum;
+            if (r.get () != 0) x.ClientVersion = r.get_string ();
+            if (r.get () != 0) x.Name = r.get_string ();
+            
+            uint32 subscriptions = r.get_32 ();
+            for (uint32 i = 0; i < subscriptions; i++) {
+                method m = method (r.get ());
+                x.Subscriptions = x.Subscriptions << mining::subscription {m, r.get_string ()};
+            }
+            
+            x.Extranonce = r.get_extranonce ();
+            x.NextExtranonce = r.get_extranonce ();
+            x.Difficulty = r.get_difficulty ();
+            x.NextDifficulty = r.get_difficulty ();
+            
+            x.Notifies.add_evicted_stale_shares (r.get_64 ());
+            uint32 jobs = r.get_32 ();
+            for (uint32 i = 0; i < jobs; i++) {
+                optional<extensions::version_mask> mask = r.get_mask ();
+                Stratum::extranonce n = r.get_extranonce ();
+                mining::notify::parameters p = r.get_notify ();
+                x.Notifies.push (mask, n, p);
+                
+                // the job that was just pushed is the one that is found.
+                const history::entry *e = x.Notifies.find (p.JobID);
+                e->StaleShares = r.get_32 ();
+                uint32 shares = r.get_32 ();
+                for (uint32 j = 0; j < shares; j++) {
+                    uint64 h = r.get_64 ();
+                    if (h != 0) e->Shares.insert (h);
+                }
+            }
+            
+            if (r.Position != b.size ()) return {};
+        } catch (const std::out_of_range &) {
+            return {};
+        }
+        
+        return x;
+    }
+    
+    // If this function has been called, then we already know that extensions are supported. 
+    extensions::result server_session::state::configure_result(
+        const string &extension, 
+        const extensions::request &request) {
+        
+        extensions::extension x;
+        try {
+            x = extensions::extension_from_string(extension);
+        } catch (const std::invalid_argument &) {
+            return extensions::result{extensions::accepted{false}};
+        }
+        
+        switch (x) {
+            case extensions::version_rolling: {
+                auto mask = Options.ExtensionsParameters->VersionRollingMask;
+                if (!mask) return extensions::result{extensions::accepted{false}};
+                
+                VersionRollingMaskParameters.LocalMask = *mask;
+                
+                auto requested = extensions::configuration<extensions::version_rolling>::read(request);
+                if (!requested) return extensions::result{extensions::accepted{"invalid version rolling request received"}};
+                
+                auto new_mask = VersionRollingMaskParameters.configure(*requested);
+                if (!new_mask) return extensions::result{extensions::accepted{"cannot satisfy min bit requirement"}};
+                return extensions::result{extensions::configured<extensions::version_rolling>{*new_mask}};
+            } 
+            
+            case extensions::minimum_difficulty: {
+                if (!Options.ExtensionsParameters->SupportExtensionMinimumDifficulty) 
+                    return extensions::result{extensions::accepted{false}};
+                
+                auto requested = extensions::configuration<extensions::minimum_difficulty>::read(request);
+                if (!requested) return extensions::result{extensions::accepted{"invalid minimum difficulty received"}};
+                
+                set_minimum_difficulty(requested->Value);
+                return extensions::result{extensions::accepted{true}};
+            }
+            
+            case extensions::subscribe_extranonce: 
+                return extensions::result{extensions::accepted{
+                    bool(Options.ExtensionsParameters->SupportExtensionSubscribeExtranonce)}};
+            
+            case extensions::info: 
+                return extensions::result{extensions::accepted{
+                    bool(Options.ExtensionsParameters->SupportExtensionInfo)}};
+            
+            // the response to mining.configure is the last message in JSON.
+            case extensions::binary_framing: 
+                BinaryFraming = Options.ExtensionsParameters->SupportExtensionBinaryFraming;
+                return extensions::result{extensions::accepted{BinaryFraming}};
+            
+            // the midstates themselves say how many there are, so the count is not returned.
+            case extensions::version_midstates: {
+                auto requested = extensions::configuration<extensions::version_midstates>::read(request);
+                if (!requested) return extensions::result{extensions::accepted{"invalid version midstates request received"}};
+                
+                auto count = extensions::parameters<extensions::version_midstates>::make(
+                    Options.ExtensionsParameters->MaxVersionMidstates, *requested);
+                VersionMidstates = count ? *count : 0;
+                return extensions::result{extensions::accepted{bool(count)}};
+            }
+            
+            default: return extensions::result{extensions::accepted{false}};
+        }
+    }
+    
+    optional<extensions::results> server_session::state::configure(const extensions::requests& p) {
+        extensions::results results{};
+        
+        for (const data::entry<string, extensions::request> &x : p) 
+            results = results.insert(x.Key, configure_result(x.Key, x.Value));
+        
+        Configured = true;
+        
+        return results;
+    } 
+    
+    void server_session::state::notify(const mining::notify::parameters& p) {
+        Notifies.push(version_mask(), extranonce(), p);
+        Extranonce = NextExtranonce;
+        Difficulty = NextDifficulty;
+    }
+    
+    maybe<mining::set_midstates::parameters> server_session::state::midstates(const mining::notify::parameters& p) const {
+        if (VersionMidstates == 0) return {};
+        
+        // the job as it was remembered, with the extra nonce and mask that were in effect for it.
+        const history::entry *n = Notifies.find(p.JobID);
+        if (n == nullptr) return {};
+        
+        worker w = n->Mask ? worker(name(), n->ExtraNonce, *n->Mask) : worker(name(), n->ExtraNonce);
+        return prepared_job{w, n->Notification, VersionMidstates}.midstates();
+    }
+    
+    bytes server_session::snapshot () const {
+        return State.snapshot ();
+    }
+    
+    bool server_session::resume (bytes_view b) {
+        maybe<state> x = state::restore (State.Options, b);
+        if (!x) return false;
+        State = std::move (*x);
+        
+        VariableDifficulty = {};
+        if (State.Options.VariableDifficulty && State.subscribed ())
+            VariableDifficulty = vardiff {*State.Options.VariableDifficulty, double (State.difficulty ()), now ()};
+        
+        return true;
+    }
+    
     bool server_session::state::set_difficulty (const Stratum::difficulty& d) {
         if (!subscribed ()) throw exception {"Cannot set difficulty before client is subscribed"};
         if (bool (MinimumDifficulty) && d < *MinimumDifficulty) return false;
@@ -49,33 +413,36 @@ namespace Gigamonkey::Stratum {
         
         auto authorization = authorize (r.params ());
         
-        if (authorization) {
+        if (!authorization) {
             State.set_name (r.params ().Username);
             return mining::authorize_response {r.id (), true};
         }
         
         return mining::authorize_response {r.id (), *authorization};
     }
-    /*
+    
+    bool static is_minimum_difficulty_only(const mining::configure_request::parameters &params) {
+        return params.Supported.size() == 1 && params.Supported.first() == "minimum_difficulty";
+    }
+    
     // generate a configure response from a configure request message. 
     // this the optional first method of the protocol. 
     mining::configure_response server_session::configure(const mining::configure_request &r) {
-        if (!State.extensions_supported()) return response{r.id(), nullptr, error{ILLEGAL_METHOD}};
+        if (!State.extensions_supported()) return mining::configure_response{r.id(), nullptr, error{ILLEGAL_METHOD}};
         
-        if (!r.valid()) return response{r.id(), nullptr, error{ILLEGAL_PARAMS}};
+        if (!r.valid()) return mining::configure_response{r.id(), nullptr, error{ILLEGAL_PARAMS}};
         
         // minimum difficulty is allowed after the initial configure message. 
         auto params = r.params();
-        if (State.configured() || !is_minimum_difficulty_only(params)) 
-            return response{r.id(), nullptr, error{ILLEGAL_METHOD}};
+        if (State.configured() && !is_minimum_difficulty_only(params)) 
+            return mining::configure_response{r.id(), nullptr, error{ILLEGAL_METHOD}};
         
         auto config = State.configure(extensions::requests(params));
-        if (config) return response{r.id(), nullptr, error{ILLEGAL_METHOD}};
+        if (!config) return mining::configure_response{r.id(), nullptr, error{ILLEGAL_METHOD}};
         return mining::configure_response{r.id(), mining::configure_response::parameters{*config}};
     }
     
     void server_session::receive_request(const Stratum::request &r) {
-        std::unique_lock lock(Mutex);
         switch (r.method()) {
             case mining_submit: {
                 response submit_response;
@@ -87,159 +454,96 @@ namespace Gigamonkey::Stratum {
                     submit_response = response{r.id(), nullptr, error{NOT_SUBSCRIBED}};
                 else {
                     auto submit_result = submit(mining::submit_request::params(r));
-                    submit_response = (submit_result) ? 
+                    submit_response = !submit_result ? 
                         mining::submit_response{r.id(), true} : 
                         mining::submit_response{r.id(), *submit_result};
                 }
                 
-                return JSON_line_session::send(submit_response);
+                Send->send(submit_response);
+                return;
             }
             
             case mining_configure: 
-                return JSON_line_session::send(configure(mining::configure_request{r}));
+                Send->send(configure(mining::configure_request{r}));
+                return;
             
             case mining_authorize: 
-                return JSON_line_session::send(authorize(mining::authorize_request{r}));
+                Send->send(authorize(mining::authorize_request{r}));
+                return;
             
+            // the difficulty and the first job are sent by whoever runs the session, 
+            // as when the server sends a job to every session that has subscribed. 
             case mining_subscribe: {
-                if (!r.valid()) {
-                    JSON_line_session::send(response{r.id(), nullptr, error{ILLEGAL_PARAMS}});
+                if (!mining::subscribe_request::valid(r)) {
+                    Send->send(response{r.id(), nullptr, error{ILLEGAL_PARAMS}});
                     return;
                 }
                 
                 if (State.subscribed()) {
-                    JSON_line_session::send(response{r.id(), nullptr, error{ILLEGAL_METHOD}});
+                    Send->send(response{r.id(), nullptr, error{ILLEGAL_METHOD}});
+                    return;
                 }
                 
-                auto response = subscribe(mining::subscribe_request::params(r));
-                
-                State.Subscriptions = response.SubscribeParams.Subscriptions;
-                JSON_line_session::send(mining::subscribe_response{r.id(), response.SubscribeParams});
-                
-                State.set_difficulty(response.InitialDifficulty);
-                this->send_notification(mining_set_difficulty,
-                    mining::set_difficulty::serialize(response.InitialDifficulty));
-                
-                State.notify(response.NotifyParams);
-                this->send_notification(mining_notify, mining::notify::serialize(response.NotifyParams));
-                
+                auto p = subscribe(mining::subscribe_request::params(r));
+                State.Subscriptions = p.Subscriptions;
+                State.Extranonce = State.NextExtranonce = p.ExtraNonce;
+                Send->send(mining::subscribe_response{r.id(), p});
                 return;
-            };
-            
-            default : 
-                JSON_line_session::send(response{r.id(), nullptr, error{ILLEGAL_METHOD}});
-        }
-    }
-    
-    // If this function has been called, then we already know that extensions are supported. 
-    extensions::result server_session::state::configure_result(
-        const string &extension, 
-        const extensions::request &request) {
-        
-        switch (extensions::extension_from_string(extension)) {
-            case extensions::version_rolling: {
-                auto mask = Options.ExtensionsParameters->VersionRollingMask;
-                if (!mask) return extensions::result{extensions::accepted{false}};
-                
-                VersionRollingMaskParameters.LocalMask = *mask;
-                
-                auto requested = extensions::configuration<extensions::version_rolling>::read(request);
-                if (!requested) return extensions::result{extensions::accepted{"invalid version rolling request received"}};
-                
-                auto new_mask = VersionRollingMaskParameters.configure(*requested);
-                if (!new_mask) return extensions::result{extensions::accepted{"cannot satisfy min bit requirement"}};
-                return extensions::result{extensions::configured<extensions::version_rolling>{*new_mask}};
-            } 
-            
-            case extensions::minimum_difficulty: {
-                if (!Options.ExtensionsParameters->SupportExtensionMinimumDifficulty) 
-                    return extensions::result{extensions::accepted{false}};
-                
-                auto requested = extensions::configuration<extensions::minimum_difficulty>::read(request);
-                if (!requested) return extensions::result{extensions::accepted{"invalid minimum difficulty received"}};
-                
-                set_minimum_difficulty(requested->Value);
-                return extensions::result{extensions::accepted{true}};
             }
             
-            case extensions::subscribe_extranonce: 
-                return extensions::result{extensions::accepted{
-                    bool(Options.ExtensionsParameters->SupportExtensionSubscribeExtranonce)}};
-            
-            case extensions::info: 
-                return extensions::result{extensions::accepted{
-                    bool(Options.ExtensionsParameters->SupportExtensionInfo)}};
-            
-            default: return extensions::result{extensions::accepted{false}};
+            default : 
+                Send->send(response{r.id(), nullptr, error{ILLEGAL_METHOD}});
         }
     }
     
-    optional<extensions::results> server_session::state::configure(const extensions::requests& p) {
-        extensions::results results{};
-        
-        for (const data::entry<string, extensions::request> &x : p) 
-            results = results.insert(x.Key, configure_result(x.Key, x.Value));
-        
-        Configured = true;
-        
-        return results;
-    } 
-    
-    bool is_minimum_difficulty_only(const mining::configure_request::parameters &params) {
-        return params.Supported.size() == 1 && params.Supported.first() == "minimum_difficulty";
-    }
-    
-    void server_session::set_version_mask(const extensions::version_mask& p) {
-        std::unique_lock lock(Mutex);
-        if (!State.subscribed()) throw 0;
-        auto new_mask = State.set_version_mask(p);
-        if (!new_mask) throw std::logic_error{"new version mask fails to satisfy user's requirements"};
-        this->send_notification(mining_set_version_mask, mining::set_version_mask::serialize(*new_mask));
-    }
-    
-    void server_session::state::notify(const mining::notify::parameters& p) {
-        if (p.Clean) Recent = set<byte_array<80>>{};
-        Notifies.push(version_mask(), extranonce(), p);
-        Extranonce = NextExtranonce;
-        Difficulty = NextDifficulty;
+    // the latest job, or nothing if there is none yet. 
+    work::puzzle server_session::select() {
+        std::vector<const state::history::entry *> jobs = State.Notifies.entries();
+        if (jobs.empty()) return work::puzzle{};
+        const state::history::entry &e = *jobs.back();
+        return e.Mask ? 
+            work::puzzle{e.Notification.Version, e.Notification.Digest, e.Notification.Target, 
+                Merkle::path{0, e.Notification.Path}, e.Notification.GenerationTx1, e.Notification.GenerationTx2, *e.Mask} : 
+            work::puzzle(e.Notification);
     }
     
     server_session::state::found server_session::state::find(const share &x) const {
-        bool stale = false;
-        for (const auto &n : Notifies.Notifications) {
-            if (n.Notification.JobID == x.JobID) {
-                worker w = n.Mask ? 
-                    worker(username(), n.ExtraNonce, *n.Mask) : 
-                    worker(username(), n.ExtraNonce);
-                return {proof{w, n.Notification, x}, stale};
-            }
-            
-            if (n.Notification.Clean) stale = true;
-        }
+        const history::entry *n = Notifies.find(x.JobID);
+        if (n == nullptr) return {};
         
-        return {};
+        bool stale = Notifies.stale(*n);
+        if (stale) n->StaleShares++;
+        
+        worker w = n->Mask ? 
+            worker(name(), n->ExtraNonce, *n->Mask) : 
+            worker(name(), n->ExtraNonce);
+        return {proof{w, n->Notification, x}, stale, &n->Shares};
     }
     
     // empty return value for an accepted share. 
     optional<error> server_session::submit(const share &x) {
-        auto now = std::chrono::duration_cast<std::chrono::seconds>(
+        int64 now = std::chrono::duration_cast<std::chrono::seconds>(
                 std::chrono::system_clock::now().time_since_epoch()).count();
         
-        if (now - uint32(x.Share.Timestamp) > State.Options.MaxTimeDifferenceSeconds) return error{TIME_TOO_OLD};
-        if (uint32(x.Share.Timestamp) - now > State.Options.MaxTimeDifferenceSeconds) return error{TIME_TOO_NEW};
+        int64 time = int64(uint32(x.Share.Timestamp));
+        if (now - time > State.Options.MaxTimeDifferenceSeconds) return error{TIME_TOO_OLD};
+        if (time - now > State.Options.MaxTimeDifferenceSeconds) return error{TIME_TOO_NEW};
         
         state::found f = State.find(x);
         if (!f.Found) return error{JOB_NOT_FOUND};
-        if (f.Stale) return error{STALE_SHARE};
-        
-        byte_array<80> string = work::proof(f.Proof).string().write();
+        if (f.Stale) {
+            stale_share(x);
+            return error{STALE_SHARE};
+        }
         
-        if (State.Recent.contains(string)) return error{DUPLICATE_SHARE};
-        State.Recent = State.Recent.insert(string);
+        // shares are remembered with their job and forgotten when it expires.
+        if (!f.Shares->insert(work::proof(f.Proof).string().hash())) return error{DUPLICATE_SHARE};
         
         if (!f.Proof.valid(work::compact(work::difficulty(State.difficulty())))) return error{LOW_DIFFICULTY};
         if (f.Proof.valid()) solved(work::proof(f.Proof).Solution);
+        accepted_share(x);
         
         return {};
-    }*/
+    }
 }
+
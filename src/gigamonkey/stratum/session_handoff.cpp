@@ -0,0 +1,58 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/session_handoff.hpp>
+
+namespace Gigamonkey::Stratum {
+    
+    void session_handoff::memory::expire (uint32 now) {
+        while (!Order.empty () && now - Order.front ().second >= ExpireSeconds) {
+            auto [id, time] = Order.front ();
+            Order.pop_front ();
+            
+            // the session may have been put again since.
+            auto x = Snapshots.find (id);
+            if (x != Snapshots.end () && x->second.Time == time) {
+                Stored -= x->second.Snapshot.size ();
+                Snapshots.erase (x);
+            }
+        }
+    }
+    
+    void session_handoff::memory::put (session_id id, bytes snapshot, uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        expire (now);
+        entry &e = Snapshots[uint32 (id)];
+        Stored += snapshot.size ();
+        Stored -= e.Snapshot.size ();
+        e = entry {std::move (snapshot), now};
+        Order.push_back ({uint32 (id), now});
+    }
+    
+    maybe<bytes> session_handoff::memory::take (session_id id, uint32 now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        expire (now);
+        auto x = Snapshots.find (uint32 (id));
+        if (x == Snapshots.end ()) return {};
+        
+        bytes snapshot = std::move (x->second.Snapshot);
+        Stored -= snapshot.size ();
+        Snapshots.erase (x);
+        return snapshot;
+    }
+    
+    size_t session_handoff::memory::size () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Snapshots.size ();
+    }
+    
+    memory_report session_handoff::memory::memory_usage () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return memory_report {
+            Snapshots.size () * sizeof (uint32),
+            Stored + Snapshots.size () * sizeof (entry),
+            hash_table_overhead (Snapshots) + Order.size () * sizeof (std::pair<uint32, uint32>),
+            0};
+    }
+    
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/share_ledger.hpp>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        size_t round_up (size_t n) {
+            size_t x = 1;
+            while (x < n) x <<= 1;
+            return x;
+        }
+        
+        // the expected number of hashes for a share of difficulty 1.
+        constexpr double hashes_per_difficulty = 4294967296.;
+        
+    }
+    
+    share_ring::share_ring (size_t capacity) :
+        Records (round_up (capacity > 1 ? capacity : 2)), Mask {Records.size () - 1}, Head {0}, Tail {0}, Dropped {0} {}
+    
+    bool share_ring::push (share_record &&x) {
+        size_t tail = Tail.load (std::memory_order_relaxed);
+        if (tail - Head.load (std::memory_order_acquire) == Records.size ()) {
+            Dropped.fetch_add (1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        Records[tail & Mask] = std::move (x);
+        Tail.store (tail + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool share_ring::pop (share_record &x) {
+        size_t head = Head.load (std::memory_order_relaxed);
+        if (head == Tail.load (std::memory_order_acquire)) return false;
+        
+        x = std::move (Records[head & Mask]);
+        Head.store (head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    void share_ledger::window::add (uint32 time, double d) {
+        Shares.push ({time, d});
+        Total += d;
+    }
+    
+    void share_ledger::window::trim (uint32 earliest) {
+        while (!Shares.empty () && Shares.top ().first < earliest) {
+            Total -= Shares.top ().second;
+            Shares.pop ();
+        }
+    }
+    
+    share_ledger::share_ledger (const options &o, exporter e) :
+        Options {o}, Export {e}, RingMutex {}, Rings {}, Mutex {}, Pool {}, Workers {}, Latest {0},
+        PPLNS {}, PPLNSTotals {}, PPLNSTotal {0}, Batch {}, StopMutex {}, Wake {}, Stop {false}, Thread {} {
+        if (Options.Background) Thread = std::thread {[this] () {
+            run ();
+        }};
+    }
+    
+    share_ledger::~share_ledger () {
+        {
+            std::lock_guard<std::mutex> lock (StopMutex);
+            Stop = true;
+        }
+        
+        Wake.notify_all ();
+        if (Thread.joinable ()) Thread.join ();
+        
+        update ();
+        flush ();
+    }
+    
+    ptr<share_ring> share_ledger::open () {
+        auto r = std::make_shared<share_ring> (Options.RingSize);
+        std::lock_guard<std::mutex> lock (RingMutex);
+        Rings.push_back (r);
+        return r;
+    }
+    
+    void share_ledger::run () {
+        std::unique_lock<std::mutex> lock (StopMutex);
+        while (!Stop) {
+            Wake.wait_for (lock, std::chrono::milliseconds {Options.IntervalMilliseconds});
+            if (Stop) return;
+            
+            lock.unlock ();
+            update ();
+            lock.lock ();
+        }
+    }
+    
+    void share_ledger::add (share_record &&x) {
+        if (x.Timestamp > Latest) Latest = x.Timestamp;
+        
+        Pool.add (x.Timestamp, x.Difficulty);
+        Workers[x.Worker].add (x.Timestamp, x.Difficulty);
+        
+        if (!x.Stale) {
+            PPLNSTotals[x.Worker] += x.Difficulty;
+            PPLNSTotal += x.Difficulty;
+            PPLNS.push_back (x);
+            
+            // keep the fewest shares that add up to the window.
+            while (PPLNS.size () > 1 && PPLNSTotal - PPLNS.front ().Difficulty >= Options.PPLNSDifficulty) {
+                const share_record &old = PPLNS.front ();
+                PPLNSTotal -= old.Difficulty;
+                auto w = PPLNSTotals.find (old.Worker);
+                if ((w->second -= old.Difficulty) <= 0) PPLNSTotals.erase (w);
+                PPLNS.pop_front ();
+            }
+        }
+        
+        Batch.push_back (std::move (x));
+    }
+    
+    void share_ledger::update () {
+        std::vector<ptr<share_ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock (RingMutex);
+            rings = Rings;
+        }
+        
+        std::vector<share_record> batch;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            share_record x;
+            for (const ptr<share_ring> &r : rings) while (r->pop (x)) add (std::move (x));
+            
+            // workers that have not submitted lately are forgotten.
+            uint32 earliest = Latest > Options.HashrateWindowSeconds ? Latest - Options.HashrateWindowSeconds : 0;
+            Pool.trim (earliest);
+            for (auto w = Workers.begin (); w != Workers.end ();) {
+                w->second.trim (earliest);
+                if (w->second.Shares.empty ()) w = Workers.erase (w);
+                else w++;
+            }
+            
+            if (Batch.size () >= Options.ExportBatch) std::swap (batch, Batch);
+        }
+        
+        if (!batch.empty () && Export) Export (std::move (batch));
+    }
+    
+    void share_ledger::flush () {
+        std::vector<share_record> batch;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            std::swap (batch, Batch);
+        }
+        
+        if (!batch.empty () && Export) Export (std::move (batch));
+    }
+    
+    double share_ledger::hashrate (const worker_name &w) const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto x = Workers.find (w);
+        if (x == Workers.end ()) return 0;
+        return x->second.Total * hashes_per_difficulty / Options.HashrateWindowSeconds;
+    }
+    
+    double share_ledger::hashrate () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Pool.Total * hashes_per_difficulty / Options.HashrateWindowSeconds;
+    }
+    
+    std::map<worker_name, double> share_ledger::pplns () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return PPLNSTotals;
+    }
+    
+    uint64 share_ledger::dropped () const {
+        std::lock_guard<std::mutex> lock (RingMutex);
+        uint64 total = 0;
+        for (const ptr<share_ring> &r : Rings) total += r->dropped ();
+        return total;
+    }
+    
+}
@@ -0,0 +1,300 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/share_log.hpp>
+
+#include <atomic>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        constexpr byte segment_file_magic[] {'G', 'M', 'S', 'H', 'R', 'L', 'G', '1'};
+        
+        // the magic and then the number of records in the file.
+        constexpr size_t segment_file_prefix = 64;
+        
+        // A record is the job, the extra nonce 1, the timestamp, the nonce, the target,
+        // the version bits, the flags, the size of extra nonce 2 and then extra nonce 2,
+        // and it ends with the first four bytes of the SHA2-256 hash of everything before.
+        // All numbers are little endian. A record that is all zeros has not been written.
+        constexpr size_t checksum_position = 68;
+        
+        enum : byte {
+            present = 1,
+            has_bits = 2
+        };
+        
+        uint32 checksum (const byte *b) {
+            digest256 d = SHA2_256 (bytes_view {b, checksum_position});
+            return boost::endian::load_little_u32 (d.begin ());
+        }
+        
+        void encode (byte *b, const share_log_record &x) {
+            std::fill (b, b + share_log::record_size, 0);
+            boost::endian::store_little_u64 (b, x.Job);
+            std::copy (x.ExtraNonce1.begin (), x.ExtraNonce1.end (), b + 8);
+            boost::endian::store_little_u32 (b + 12, uint32 (x.Share.Timestamp.Value));
+            boost::endian::store_little_u32 (b + 16, uint32 (x.Share.Nonce));
+            boost::endian::store_little_u32 (b + 20, uint32 (x.Target));
+            if (bool (x.Share.Bits)) boost::endian::store_little_s32 (b + 24, int32 (*x.Share.Bits));
+            b[28] = present | (bool (x.Share.Bits) ? has_bits : 0);
+            b[29] = byte (x.Share.ExtraNonce2.size ());
+            std::copy (x.Share.ExtraNonce2.begin (), x.Share.ExtraNonce2.end (), b + 30);
+            boost::endian::store_little_u32 (b + checksum_position, checksum (b));
+        }
+        
+        maybe<share_log_record> decode (const byte *b) {
+            if (!(b[28] & present) || b[28] > (present | has_bits) || b[29] > share_log::max_extra_nonce_2_size ||
+                checksum (b) != boost::endian::load_little_u32 (b + checksum_position)) return {};
+            
+            uint32 timestamp = boost::endian::load_little_u32 (b + 12);
+            if (timestamp == 0) return {};
+            
+            session_id n1 {};
+            std::copy (b + 8, b + 12, n1.begin ());
+            
+            bytes n2 (b[29]);
+            std::copy (b + 30, b + 30 + b[29], n2.begin ());
+            
+            nonce n {boost::endian::load_little_u32 (b + 16)};
+            work::share share = b[28] & has_bits ?
+                work::share {Bitcoin::timestamp {timestamp}, n, n2, int32_little {boost::endian::load_little_s32 (b + 24)}} :
+                work::share {Bitcoin::timestamp {timestamp}, n, n2};
+            
+            return share_log_record {boost::endian::load_little_u64 (b), n1, share,
+                work::compact {boost::endian::load_little_u32 (b + 20)}};
+        }
+        
+    }
+    
+    struct share_log::segment {
+        std::filesystem::path Path;
+        int Descriptor;
+        byte *Map;
+        uint64 Records;
+        
+        // writers that have taken space in the segment and not finished copying into it.
+        std::atomic<uint32> Writing;
+        
+        segment (const std::filesystem::path &p) : Path {p}, Descriptor {-1}, Map {nullptr}, Records {0}, Writing {0} {}
+        
+        ~segment () {
+            if (Map != nullptr) munmap (Map, size ());
+            if (Descriptor >= 0) ::close (Descriptor);
+        }
+        
+        size_t size () const {
+            return segment_file_prefix + Records * record_size;
+        }
+        
+        byte *record (uint64 n) const {
+            return Map + segment_file_prefix + n * record_size;
+        }
+    };
+    
+    ptr<share_log::segment> share_log::open_segment (uint64 number, bool create) const {
+        std::filesystem::path path = Directory / (std::to_string (number) + ".shares");
+        if (!create && !std::filesystem::exists (path)) return nullptr;
+        
+        auto s = std::make_shared<segment> (path);
+        s->Descriptor = ::open (path.c_str (), O_RDWR | O_CREAT, 0644);
+        if (s->Descriptor < 0) throw std::runtime_error {"could not open share log " + path.string ()};
+        
+        struct stat st;
+        if (fstat (s->Descriptor, &st) != 0) throw std::runtime_error {"could not read share log " + path.string ()};
+        
+        size_t size = static_cast<size_t> (st.st_size);
+        byte prefix[segment_file_prefix] {};
+        if (size == 0) {
+            s->Records = Options.SegmentRecords;
+            if (ftruncate (s->Descriptor, s->size ()) != 0)
+                throw std::runtime_error {"could not resize share log " + path.string ()};
+        } else {
+            if (size < segment_file_prefix || pread (s->Descriptor, prefix, segment_file_prefix, 0) != segment_file_prefix ||
+                !std::equal (std::begin (segment_file_magic), std::end (segment_file_magic), prefix))
+                throw std::invalid_argument {"not a share log: " + path.string ()};
+            
+            s->Records = boost::endian::load_little_u64 (prefix + 8);
+            if (s->Records == 0 || s->size () != size) throw std::invalid_argument {"not a share log: " + path.string ()};
+        }
+        
+        void *m = mmap (nullptr, s->size (), PROT_READ | PROT_WRITE, MAP_SHARED, s->Descriptor, 0);
+        if (m == MAP_FAILED) throw std::runtime_error {"could not map share log " + path.string ()};
+        s->Map = static_cast<byte *> (m);
+        
+        if (size == 0) {
+            std::copy (std::begin (segment_file_magic), std::end (segment_file_magic), s->Map);
+            boost::endian::store_little_u64 (s->Map + 8, s->Records);
+        }
+        
+        return s;
+    }
+    
+    share_log::share_log (const std::filesystem::path &directory, const options &o) :
+        Directory {directory}, Options {o}, Mutex {}, Segments {}, End {0}, Synced {0} {
+        if (Options.SegmentRecords == 0 || Options.BufferRecords == 0)
+            throw std::invalid_argument {"share log must have room for records"};
+        
+        std::filesystem::create_directories (Directory);
+        
+        while (true) {
+            ptr<segment> s = open_segment (Segments.size (), false);
+            if (s == nullptr) break;
+            
+            if (Segments.empty ()) Options.SegmentRecords = s->Records;
+            else if (s->Records != Options.SegmentRecords) throw std::invalid_argument {"not a share log: " + s->Path.string ()};
+            
+            Segments.push_back (s);
+        }
+        
+        if (Segments.empty ()) return;
+        
+        // new records go after the last good one.
+        const segment &last = *Segments.back ();
+        uint64 first = (Segments.size () - 1) * Options.SegmentRecords;
+        End = first;
+        for (uint64 n = last.Records; n > 0; n--) if (bool (decode (last.record (n - 1)))) {
+            End = first + n;
+            break;
+        }
+        
+        Synced = Segments.size () - 1;
+    }
+    
+    share_log::~share_log () {}
+    
+    share_log::writer::writer (share_log &l) :
+        Log {l}, Buffer (l.Options.BufferRecords * record_size), Count {0} {}
+    
+    share_log::writer::~writer () {
+        try {
+            flush ();
+        } catch (...) {}
+    }
+    
+    ptr<share_log::writer> share_log::open () {
+        return ptr<writer> {new writer {*this}};
+    }
+    
+    void share_log::writer::write (const share_log_record &x) {
+        if (x.Share.ExtraNonce2.size () > max_extra_nonce_2_size)
+            throw std::invalid_argument {"extra nonce 2 is too big for the share log"};
+        
+        encode (Buffer.data () + Count * record_size, x);
+        if (++Count == Log.Options.BufferRecords) flush ();
+    }
+    
+    void share_log::writer::flush () {
+        if (Count == 0) return;
+        
+        // the records are copied without the lock, since no one else can write where they go.
+        const byte *b = Buffer.data ();
+        for (const reservation &r : Log.reserve (Count)) {
+            std::copy (b, b + r.Count * record_size, r.Segment->record (r.Offset));
+            b += r.Count * record_size;
+            r.Segment->Writing--;
+        }
+        
+        Count = 0;
+    }
+    
+    std::vector<share_log::reservation> share_log::reserve (uint64 count) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        std::vector<reservation> x;
+        while (count > 0) {
+            uint64 number = End / Options.SegmentRecords;
+            if (number == Segments.size ()) Segments.push_back (open_segment (number, true));
+            
+            uint64 offset = End % Options.SegmentRecords;
+            uint64 size = std::min (count, Options.SegmentRecords - offset);
+            Segments[number]->Writing++;
+            x.push_back (reservation {Segments[number], offset, size});
+            
+            End += size;
+            count -= size;
+        }
+        
+        return x;
+    }
+    
+    void share_log::sync () {
+        std::vector<ptr<segment>> segments;
+        uint64 first;
+        uint64 end;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            first = Synced;
+            end = End;
+            segments.assign (Segments.begin () + std::min (uint64 (Segments.size ()), Synced), Segments.end ());
+        }
+        
+        // a segment that is full and has nothing being copied into it never needs to be synced again.
+        uint64 synced = first;
+        bool done = true;
+        for (const ptr<segment> &s : segments) {
+            bool full = end >= (first + 1) * Options.SegmentRecords && s->Writing == 0;
+            if (msync (s->Map, s->size (), MS_SYNC) != 0) throw std::runtime_error {"could not sync share log " + s->Path.string ()};
+            done = done && full;
+            if (done) synced = first + 1;
+            first++;
+        }
+        
+        std::lock_guard<std::mutex> lock (Mutex);
+        Synced = std::max (Synced, synced);
+    }
+    
+    uint64 share_log::size () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return End;
+    }
+    
+    std::vector<share_log_record> share_log::read (uint64 begin, uint64 count) const {
+        std::vector<ptr<segment>> segments;
+        uint64 end;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (begin >= End || count == 0) return {};
+            end = begin + std::min (count, End - begin);
+            segments.assign (Segments.begin () + begin / Options.SegmentRecords,
+                Segments.begin () + (end - 1) / Options.SegmentRecords + 1);
+        }
+        
+        std::vector<share_log_record> x;
+        x.reserve (end - begin);
+        uint64 first = begin / Options.SegmentRecords;
+        for (uint64 n = begin; n < end; n++) {
+            maybe<share_log_record> r = decode (segments[n / Options.SegmentRecords - first]->record (n % Options.SegmentRecords));
+            if (bool (r)) x.push_back (*r);
+        }
+        
+        return x;
+    }
+    
+    std::vector<share_log_record> share_log::last (double difficulty, uint64 batch) const {
+        if (batch == 0) throw std::invalid_argument {"batch must not be empty"};
+        
+        std::vector<share_log_record> x;
+        double total = 0;
+        uint64 end = size ();
+        while (end > 0 && total < difficulty) {
+            uint64 begin = end > batch ? end - batch : 0;
+            std::vector<share_log_record> records = read (begin, end - begin);
+            for (auto r = records.rbegin (); r != records.rend () && total < difficulty; r++) {
+                total += r->difficulty ();
+                x.push_back (*r);
+            }
+            
+            end = begin;
+        }
+        
+        return x;
+    }
+    
+}
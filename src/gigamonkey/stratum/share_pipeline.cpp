@@ -0,0 +1,257 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/share_pipeline.hpp>
+#include <gigamonkey/sha256.hpp>
+#include <gigamonkey/metrics.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace Gigamonkey::Stratum {
+    
+    namespace {
+        
+        // the kth value of the bits that are set in mask, counting from the lowest.
+        uint32 deposit (uint32 k, uint32 mask) {
+            uint32 x = 0;
+            for (; mask != 0 && k != 0; mask &= mask - 1, k >>= 1) if (k & 1) x |= mask & (~mask + 1);
+            return x;
+        }
+        
+    }
+    
+    prepared_job::prepared_job (const worker &w, const mining::notify::parameters &n, byte midstates) :
+        Worker {w}, Notify {n},
+        CoinbasePrefix {write (n.GenerationTx1.size () + 4, n.GenerationTx1, w.ExtraNonce.ExtraNonce1)},
+        CoinbaseSuffix {n.GenerationTx2}, Path {0, n.Path}, Root {}, Midstates {} {
+        
+        if (midstates == 0) return;
+        
+        Root = Path.derive_root (Bitcoin::Hash256 (write (
+            CoinbasePrefix.size () + w.ExtraNonce.ExtraNonce2Size + CoinbaseSuffix.size (),
+            CoinbasePrefix, bytes (w.ExtraNonce.ExtraNonce2Size, 0), CoinbaseSuffix)));
+        
+        // there are only so many distinct values of the bits that can be rolled.
+        uint32 rolling = Worker.Mask ? uint32 (int32 (~*Worker.Mask)) : 0;
+        int bits = std::popcount (rolling);
+        size_t count = bits < 8 ? std::min (size_t (midstates), size_t (1) << bits) : size_t (midstates);
+        
+        Midstates.resize (count);
+        for (size_t k = 0; k < count; k++) {
+            int32_little b {int32 (deposit (k, rolling))};
+            
+            // the last 16 bytes are not part of the midstate, so the timestamp and nonce do not matter.
+            byte_array<80> h = work::string {(Notify.Version & ~int32_little {int32 (rolling)}) | b,
+                Notify.Digest, *Root, n.Now, Notify.Target, 0}.write ();
+            
+            Midstates[k].Bits = b;
+            Midstates[k].State = sha256::initial ();
+            sha256::transform (Midstates[k].State, h.data (), 1);
+        }
+    }
+    
+    bool prepared_job::matches (const share &x) const {
+        return x.JobID == Notify.JobID && bool (Worker.Mask) == bool (x.Share.Bits);
+    }
+    
+    bool prepared_job::fixed (const share &x) const {
+        return bool (Root) && x.Share.ExtraNonce2.size () == Worker.ExtraNonce.ExtraNonce2Size &&
+            std::all_of (x.Share.ExtraNonce2.begin (), x.Share.ExtraNonce2.end (), [] (byte b) -> bool {
+                return b == 0;
+            });
+    }
+    
+    byte_array<80> prepared_job::header (const share &x) const {
+        int32_little mask = Worker.Mask ? *Worker.Mask : int32_little {-1};
+        
+        digest256 root;
+        if (fixed (x)) root = *Root;
+        else root = Path.derive_root (Bitcoin::Hash256 (write (
+            CoinbasePrefix.size () + x.Share.ExtraNonce2.size () + CoinbaseSuffix.size (),
+            CoinbasePrefix, x.Share.ExtraNonce2, CoinbaseSuffix)));
+        
+        return work::string {
+            (Notify.Version & mask) | x.Share.general_purpose_bits (~mask),
+            Notify.Digest,
+            root,
+            x.Share.Timestamp,
+            Notify.Target,
+            x.Share.Nonce
+        }.write ();
+    }
+    
+    const sha256::state *prepared_job::midstate (const share &x) const {
+        if (!fixed (x)) return nullptr;
+        
+        int32_little rolling = Worker.Mask ? ~*Worker.Mask : int32_little {0};
+        int32_little bits = x.Share.general_purpose_bits (rolling);
+        for (const mining::set_midstates::midstate &m : Midstates) if ((m.Bits & rolling) == bits) return &m.State;
+        return nullptr;
+    }
+    
+    mining::set_midstates::parameters prepared_job::midstates () const {
+        mining::set_midstates::parameters p {Notify.JobID, bytes (Worker.ExtraNonce.ExtraNonce2Size, 0), {}, Midstates};
+        if (Root) std::copy (Root->begin () + 28, Root->end (), p.RootTail.begin ());
+        return p;
+    }
+    
+    share_pipeline::share_pipeline (executor &e, uint32 max_batch, uint32 max_threads) :
+        Executor {e}, MaxBatch {max_batch > 0 ? max_batch : 1},
+        MaxThreads {max_threads > 0 ? max_threads : e.threads ()},
+        Mutex {}, Idle {}, Queue {}, Running {0}, Next {0},
+        DeliverMutex {}, Finished {}, NextDelivery {0}, Pending {0} {}
+    
+    share_pipeline::~share_pipeline () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Idle.wait (lock, [this] () {
+            return Running == 0;
+        });
+    }
+    
+    size_t share_pipeline::pending () const {
+        return Pending.load ();
+    }
+    
+    void share_pipeline::submit (ptr<const prepared_job> j, const share &x, const work::compact &target, callback f) {
+        bool schedule = false;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Queue.push_back (request {Next++, j, x, target, f, trace::async_span {"stratum.submit", trace::current ()}});
+            Pending++;
+            if (Running < MaxThreads) {
+                Running++;
+                schedule = true;
+            }
+        }
+        
+        if (schedule) Executor.submit ([this] () {
+            drain ();
+        });
+    }
+    
+    void share_pipeline::drain () {
+        std::vector<request> batch;
+        while (true) {
+            batch.clear ();
+            {
+                std::lock_guard<std::mutex> lock (Mutex);
+                if (Queue.empty ()) {
+                    Running--;
+                    Idle.notify_all ();
+                    return;
+                }
+                
+                size_t count = std::min (Queue.size (), size_t (MaxBatch));
+                std::move (Queue.begin (), Queue.begin () + count, std::back_inserter (batch));
+                Queue.erase (Queue.begin (), Queue.begin () + count);
+            }
+            
+            check (batch);
+        }
+    }
+    
+    void share_pipeline::check (std::vector<request> &batch) {
+        metrics::stopwatch timing {metrics::share_check};
+        uint64 checking = trace::enabled ? trace::now () : 0;
+        
+        // shares for the same job are next to each other so that the
+        // job only has to be brought into the cache once.
+        std::stable_sort (batch.begin (), batch.end (), [] (const request &a, const request &b) {
+            return a.Job.get () < b.Job.get ();
+        });
+        
+        std::vector<result> results (batch.size ());
+        std::vector<size_t> valid;
+        valid.reserve (batch.size ());
+        
+        // shares that can be hashed from a midstate, by midstate.
+        std::vector<std::pair<const sha256::state *, size_t>> rolled;
+        
+        for (size_t i = 0; i < batch.size (); i++) {
+            const request &r = batch[i];
+            if (r.Job == nullptr || !r.Job->matches (r.Share)) continue;
+            results[i].Header = r.Job->header (r.Share);
+            if (const sha256::state *m = r.Job->midstate (r.Share); m != nullptr) rolled.push_back ({m, i});
+            else valid.push_back (i);
+        }
+        
+        bytes in (80 * valid.size ());
+        bytes out (32 * valid.size ());
+        for (size_t j = 0; j < valid.size (); j++)
+            std::copy (results[valid[j]].Header.begin (), results[valid[j]].Header.end (), in.begin () + 80 * j);
+        
+        sha256::double_hash_80 (out.data (), in.data (), valid.size ());
+        
+        for (size_t j = 0; j < valid.size (); j++)
+            std::copy (out.begin () + 32 * j, out.begin () + 32 * j + 32, results[valid[j]].Hash.begin ());
+        
+        // only the last 16 bytes of each header are hashed, as many at once as share a midstate.
+        std::stable_sort (rolled.begin (), rolled.end (), [] (const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+        
+        bytes tails (16 * rolled.size ());
+        bytes hashes (32 * rolled.size ());
+        for (size_t j = 0; j < rolled.size (); j++) {
+            const byte_array<80> &h = results[rolled[j].second].Header;
+            std::copy (h.begin () + 64, h.end (), tails.begin () + 16 * j);
+        }
+        
+        for (size_t j = 0; j < rolled.size ();) {
+            size_t k = j + 1;
+            while (k < rolled.size () && rolled[k].first == rolled[j].first) k++;
+            sha256::double_hash_80 (hashes.data () + 32 * j, *rolled[j].first, tails.data () + 16 * j, k - j);
+            j = k;
+        }
+        
+        for (size_t j = 0; j < rolled.size (); j++) {
+            std::copy (hashes.begin () + 32 * j, hashes.begin () + 32 * j + 32, results[rolled[j].second].Hash.begin ());
+            valid.push_back (rolled[j].second);
+        }
+        
+        for (size_t i : valid) {
+            result &x = results[i];
+            x.Valid = x.Hash.Value < batch[i].Target.expand ();
+            x.Solved = x.Hash.Value < batch[i].Job->Notify.Target.expand ();
+        }
+        
+        if constexpr (trace::enabled) {
+            uint64 checked = trace::now ();
+            for (const request &r : batch) {
+                trace::record_span ("stratum.queue", r.Span.context (), r.Span.start (), checking);
+                trace::record_span ("stratum.pow_check", r.Span.context (), checking, checked);
+            }
+        }
+        
+        uint64 accepted = 0;
+        for (const result &x : results) if (x.Valid) accepted++;
+        metrics::count (metrics::shares_accepted, accepted);
+        metrics::count (metrics::shares_rejected, results.size () - accepted);
+        
+        deliver (batch, results);
+    }
+    
+    void share_pipeline::deliver (std::vector<request> &batch, std::vector<result> &results) {
+        std::lock_guard<std::mutex> lock (DeliverMutex);
+        for (size_t i = 0; i < batch.size (); i++)
+            Finished.emplace (batch[i].Sequence,
+                finished {std::move (batch[i].Share), results[i], std::move (batch[i].Done), std::move (batch[i].Span)});
+        
+        // a result that is waiting for one that is being checked
+        // elsewhere will be delivered by whoever finishes that one.
+        while (!Finished.empty () && Finished.begin ()->first == NextDelivery) {
+            finished &f = Finished.begin ()->second;
+            {
+                trace::span responding {"stratum.response", f.Span.context ()};
+                if (f.Done) f.Done (f.Share, f.Result);
+            }
+            
+            f.Span.end ();
+            Finished.erase (Finished.begin ());
+            NextDelivery++;
+            Pending--;
+        }
+    }
+    
+}
@@ -0,0 +1,188 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/statistics.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+
+namespace Gigamonkey::Stratum {
+    
+    share_result result_of (error_code e) {
+        switch (e) {
+            case JOB_NOT_FOUND_OR_STALE:
+            case STALE_SHARE: return stale;
+            case DUPLICATE_SHARE: return duplicate;
+            case LOW_DIFFICULTY: return low_difficulty;
+            default: return invalid;
+        }
+    }
+    
+    const char *name (share_result x) {
+        switch (x) {
+            case accepted: return "accepted";
+            case stale: return "stale";
+            case duplicate: return "duplicate";
+            case low_difficulty: return "low_difficulty";
+            case invalid: return "invalid";
+            default: return "";
+        }
+    }
+    
+    void statistics::session::share (share_result x) {
+        Shares[x].fetch_add (1, std::memory_order_relaxed);
+        Statistics.share (x);
+    }
+    
+    void statistics::session::difficulty (double d) {
+        double old = Difficulty.exchange (d, std::memory_order_relaxed);
+        if (old == d) return;
+        if (old > 0) Statistics.Difficulties.remove (old);
+        if (d > 0) Statistics.Difficulties.add (d);
+    }
+    
+    statistics::session::~session () {
+        double d = Difficulty.load (std::memory_order_relaxed);
+        if (d > 0) Statistics.Difficulties.remove (d);
+    }
+    
+    void statistics::notified (uint64 microseconds) {
+        Notifies.fetch_add (1, std::memory_order_relaxed);
+        NotifyLatency.add (double (microseconds));
+        NotifyLatencySum.fetch_add (microseconds, std::memory_order_relaxed);
+    }
+    
+    ptr<statistics::session> statistics::open (const string &worker) {
+        auto s = std::make_shared<session> (*this, worker);
+        std::lock_guard<std::mutex> lock (Mutex);
+        std::erase_if (Open, [] (const std::weak_ptr<session> &x) {
+            return x.expired ();
+        });
+        Open.push_back (s);
+        return s;
+    }
+    
+    void statistics::watch (std::weak_ptr<const work::cpu_solver> x) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Solvers.push_back (x);
+        LastHashes.push_back (0);
+    }
+    
+    namespace {
+        
+        // label values are quoted with backslash escapes.
+        string label (const string &x) {
+            string o;
+            o.reserve (x.size () + 2);
+            o += '"';
+            for (char c : x) switch (c) {
+                case '\\': o += "\\\\"; break;
+                case '"': o += "\\\""; break;
+                case '\n': o += "\\n"; break;
+                default: o += c;
+            }
+            o += '"';
+            return o;
+        }
+        
+        void header (std::ostream &o, const char *name, const char *type, const char *help) {
+            o << "# TYPE " << name << " " << type << "\n# HELP " << name << " " << help << "\n";
+        }
+        
+        // the shortest text that reads back as the same double.
+        string number (double x) {
+            char buffer[32];
+            return string (buffer, std::to_chars (buffer, buffer + sizeof (buffer), x).ptr);
+        }
+        
+        uint64 inline load (const std::atomic<uint64> &x) {
+            return x.load (std::memory_order_relaxed);
+        }
+        
+        // cumulative buckets, with bounds divided by scale.
+        template <size_t size>
+        void buckets (std::ostream &o, const char *name, const statistics::log2_histogram<size> &h, double scale, uint64 &total) {
+            total = 0;
+            double bound = 1;
+            for (size_t i = 0; i < size; i++) {
+                total += load (h.Buckets[i]);
+                if (i + 1 < size) o << name << "_bucket{le=\"" << number (bound / scale) << "\"} " << total << "\n";
+                else o << name << "_bucket{le=\"+Inf\"} " << total << "\n";
+                bound *= 2;
+            }
+        }
+        
+    }
+    
+    string statistics::write () const {
+        std::vector<ptr<session>> open;
+        uint64 hashes = 0;
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            for (const auto &w : Open) if (ptr<session> s = w.lock (); s != nullptr) open.push_back (s);
+            
+            for (size_t i = 0; i < Solvers.size (); i++)
+                if (ptr<const work::cpu_solver> s = Solvers[i].lock (); s != nullptr) LastHashes[i] = s->hashes ();
+            
+            // solvers that are gone are remembered by what they last hashed.
+            for (size_t i = Solvers.size (); i-- > 0;) if (Solvers[i].expired ()) {
+                RetiredHashes += LastHashes[i];
+                Solvers.erase (Solvers.begin () + i);
+                LastHashes.erase (LastHashes.begin () + i);
+            }
+            
+            hashes = RetiredHashes;
+            for (uint64 h : LastHashes) hashes += h;
+        }
+        
+        std::stringstream o;
+        
+        header (o, "stratum_sessions", "gauge", "Sessions that are connected.");
+        o << "stratum_sessions " << load (Sessions) << "\n";
+        
+        header (o, "stratum_connections", "counter", "Connections that have been accepted.");
+        o << "stratum_connections_total " << load (Connections) << "\n";
+        
+        header (o, "stratum_throttled", "counter", "Messages and connections refused by rate limits.");
+        o << "stratum_throttled_total " << load (Throttled) << "\n";
+        
+        header (o, "stratum_shares", "counter", "Shares by result.");
+        uint64 total_shares = 0;
+        for (byte x = 0; x < share_results; x++) {
+            uint64 n = load (Shares[x]);
+            total_shares += n;
+            o << "stratum_shares_total{result=\"" << name (share_result (x)) << "\"} " << n << "\n";
+        }
+        
+        header (o, "stratum_stale_ratio", "gauge", "The fraction of shares that were stale.");
+        o << "stratum_stale_ratio " << number (total_shares == 0 ? 0. : double (load (Shares[stale])) / total_shares) << "\n";
+        
+        header (o, "stratum_notify_fanout_seconds", "histogram", "Time to queue a job for every session.");
+        uint64 notified;
+        buckets (o, "stratum_notify_fanout_seconds", NotifyLatency, 1e6, notified);
+        o << "stratum_notify_fanout_seconds_count " << notified << "\n";
+        o << "stratum_notify_fanout_seconds_sum " << number (double (load (NotifyLatencySum)) / 1e6) << "\n";
+        
+        header (o, "stratum_difficulty", "gaugehistogram", "Sessions by difficulty.");
+        uint64 difficulties;
+        buckets (o, "stratum_difficulty", Difficulties, 1, difficulties);
+        o << "stratum_difficulty_gcount " << difficulties << "\n";
+        
+        header (o, "stratum_solver_hashes", "counter", "Headers hashed by local solvers.");
+        o << "stratum_solver_hashes_total " << hashes << "\n";
+        
+        header (o, "stratum_session_shares", "counter", "Shares by session and result.");
+        for (const ptr<session> &s : open) for (byte x = 0; x < share_results; x++)
+            o << "stratum_session_shares_total{worker=" << label (s->Worker) << ",result=\""
+                << name (share_result (x)) << "\"} " << load (s->Shares[x]) << "\n";
+        
+        header (o, "stratum_session_difficulty", "gauge", "The difficulty of each session.");
+        for (const ptr<session> &s : open)
+            o << "stratum_session_difficulty{worker=" << label (s->Worker) << "} " << number (s->difficulty ()) << "\n";
+        
+        o << "# EOF\n";
+        return o.str ();
+    }
+    
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/stratum/vardiff.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Gigamonkey::Stratum {
+    
+    vardiff::vardiff (const options &o, double initial, double now) :
+        Options {o}, Difficulty {0}, Interval {0}, LastShare {now}, LastRetarget {now} {
+        if (!(o.SharesPerMinute > 0) || !(o.TimeConstantSeconds > 0) || !(o.Tolerance >= 1) ||
+            !(o.MinimumDifficulty > 0) || !(o.MaximumDifficulty >= o.MinimumDifficulty))
+            throw std::invalid_argument {"invalid vardiff options"};
+        Difficulty = clamp (initial);
+    }
+    
+    double vardiff::clamp (double d) const {
+        return std::clamp (d, Options.MinimumDifficulty, Options.MaximumDifficulty);
+    }
+    
+    void vardiff::accepted (double now) {
+        double interval = std::max (now - LastShare, 0.);
+        LastShare = now;
+        
+        // until we have a share, the time since the start is the best guess we have.
+        if (Interval == 0) {
+            Interval = std::max (interval, 1e-3);
+            return;
+        }
+        
+        // the weight of a new interval depends on how long it is, so
+        // that the average is over time rather than over shares.
+        double alpha = 1 - std::exp (-interval / Options.TimeConstantSeconds);
+        Interval = std::max (Interval + alpha * (interval - Interval), 1e-3);
+    }
+    
+    double vardiff::rate (double now) const {
+        // if no shares are coming, the wait so far is a lower bound on the interval.
+        double interval = std::max (Interval, now - LastShare);
+        if (interval <= 0) return 0;
+        return 60 / interval;
+    }
+    
+    void vardiff::set (double d, double now) {
+        d = clamp (d);
+        if (d == Difficulty) return;
+        
+        // Intervals that were measured at the old difficulty are scaled so that
+        // the average remains a prediction for the new difficulty.
+        Interval *= d / Difficulty;
+        Difficulty = d;
+        LastRetarget = now;
+    }
+    
+    maybe<double> vardiff::retarget (double now) {
+        if (now - LastRetarget < Options.RetargetSeconds) return {};
+        
+        double r = rate (now);
+        if (r == 0) return {};
+        
+        double ratio = r / Options.SharesPerMinute;
+        if (ratio < Options.Tolerance && ratio > 1 / Options.Tolerance) return {};
+        
+        double old = Difficulty;
+        set (Difficulty * ratio, now);
+        if (Difficulty == old) return {};
+        return Difficulty;
+    }
+    
+}
@@ -4,6 +4,9 @@
 #include <gigamonkey/work/proof.hpp>
 #include <gigamonkey/script/script.hpp>
 #include <gigamonkey/work/ASICBoost.hpp>
+#include <gigamonkey/sha256.hpp>
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/trace.hpp>
 
 namespace Gigamonkey {
     bool header_valid_work(slice<80> h) {
@@ -45,6 +48,82 @@ namespace Gigamonkey::Bitcoin {
         return n;
     }
     
+    digest256 header::hash(const slice<80> h) {
+        byte_array<80> x;
+        std::copy(h.begin(), h.end(), x.begin());
+        digest256 d;
+        sha256::double_hash_80(d.begin(), x.data(), 1);
+        return d;
+    }
+    
+    void Hash256_headers(std::span<const slice<80>> headers, std::span<digest256> digests) {
+        if (headers.size() != digests.size()) throw std::invalid_argument{"need one digest for each header"};
+        
+        // enough for the widest kernel.
+        constexpr size_t batch = 16;
+        byte in[80 * batch];
+        byte out[32 * batch];
+        
+        for (size_t i = 0; i < headers.size(); i += batch) {
+            size_t count = std::min(batch, headers.size() - i);
+            for (size_t j = 0; j < count; j++) std::copy(headers[i + j].begin(), headers[i + j].end(), in + 80 * j);
+            sha256::double_hash_80(out, in, count);
+            for (size_t j = 0; j < count; j++) std::copy(out + 32 * j, out + 32 * j + 32, digests[i + j].begin());
+        }
+    }
+    
+    namespace {
+        
+        size_t validate_headers(std::span<const header> headers, executor *e) {
+            trace::span validating{"validate.headers"};
+            
+            // each task checks this many headers.
+            constexpr size_t chunk = 4096;
+            
+            std::vector<digest256> hashes(headers.size());
+            std::vector<byte> work(headers.size());
+            
+            auto check_work = [headers, &hashes, &work](size_t c) {
+                constexpr size_t batch = 16;
+                byte in[80 * batch];
+                byte out[32 * batch];
+                
+                size_t end = std::min((c + 1) * chunk, headers.size());
+                for (size_t i = c * chunk; i < end; i += batch) {
+                    size_t count = std::min(batch, end - i);
+                    for (size_t j = 0; j < count; j++) {
+                        byte_array<80> x = headers[i + j].write();
+                        std::copy(x.begin(), x.end(), in + 80 * j);
+                    }
+                    
+                    sha256::double_hash_80(out, in, count);
+                    for (size_t j = 0; j < count; j++) {
+                        std::copy(out + 32 * j, out + 32 * j + 32, hashes[i + j].begin());
+                        work[i + j] = hashes[i + j].Value < headers[i + j].Target.expand();
+                    }
+                }
+            };
+            
+            size_t chunks = (headers.size() + chunk - 1) / chunk;
+            if (e == nullptr) for (size_t c = 0; c < chunks; c++) check_work(c);
+            else e->parallel_for(chunks, check_work);
+            
+            for (size_t i = 0; i < headers.size(); i++)
+                if (!work[i] || !header_valid(headers[i]) || (i > 0 && headers[i].Previous != hashes[i - 1])) return i;
+            
+            return headers.size();
+        }
+        
+    }
+    
+    size_t validate_chain(std::span<const header> headers) {
+        return validate_headers(headers, nullptr);
+    }
+    
+    size_t validate_chain(std::span<const header> headers, executor &e) {
+        return validate_headers(headers, &e);
+    }
+    
     bool header::valid(const slice<80> h) {
         return header_valid(Bitcoin::header{h}) && header_valid_work(h);
     }
@@ -54,11 +133,11 @@ namespace Gigamonkey::Bitcoin {
     }
     
     bool input::valid() const {
-        return decompile(Script) != program{};
+        return Script.size() != 0 && decompilable(Script);
     }
     
     bool output::valid() const {
-        return Value < 2100000000000000 && decompile(Script) != program{};
+        return Value < 2100000000000000 && Script.size() != 0 && decompilable(Script);
     }
     
     uint64 transaction::serialized_size() const {
@@ -73,14 +152,14 @@ namespace Gigamonkey::Bitcoin {
     
     uint64 block::serialized_size() const {
         return 80 + var_int::size(Transactions.size()) + 
-        data::fold([](uint64 size, transaction x)-> uint64 {
+        data::fold([](uint64 size, const transaction &x)-> uint64 {
             return size + x.serialized_size();
         }, 0u, Transactions);
     }
     
     transaction::transaction(bytes_view b) : transaction{} {
         try {
-            bytes_reader r{b.begin(), b.end()};
+            read_cursor r{b.data(), b.data() + b.size()};
             r >> *this;
         } catch (data::end_of_stream n) {
             *this = transaction{};
@@ -89,8 +168,14 @@ namespace Gigamonkey::Bitcoin {
         
     block::block(bytes_view b) : block{} {
         try {
-            bytes_reader r{b.begin(), b.end()};
-            r >> *this;
+            read_cursor r{b.data(), b.data() + b.size()};
+            r >> Header;
+            uint64 count = r.get_var_int();
+            for (uint64 i = 0; i < count; i++) {
+                transaction t;
+                r >> t;
+                Transactions <<= t;
+            }
         } catch (data::end_of_stream n) {
             *this = block{};
         } catch (std::bad_alloc n) {
@@ -98,38 +183,183 @@ namespace Gigamonkey::Bitcoin {
         }
     }
     
+    namespace {
+        // these do not check bounds. The callers below check for a whole structure first.
+        void put(write_cursor &w, const outpoint &o) {
+            w.put(o.Digest.begin(), 32);
+            w.put_little(uint32(o.Index));
+        }
+        
+        void put(write_cursor &w, const input &in) {
+            put(w, in.Reference);
+            w.put_var_string(in.Script);
+            w.put_little(uint32(in.Sequence));
+        }
+        
+        void put(write_cursor &w, const output &o) {
+            w.put_little(int64(o.Value));
+            w.put_var_string(o.Script);
+        }
+        
+        void put(write_cursor &w, const transaction &t) {
+            w.put_little(int32(t.Version));
+            w.put_var_int(t.Inputs.size());
+            for (const input &in : t.Inputs) put(w, in);
+            w.put_var_int(t.Outputs.size());
+            for (const output &o : t.Outputs) put(w, o);
+            w.put_little(uint32(t.Locktime));
+        }
+        
+        void put(write_cursor &w, const header &h) {
+            w.put_little(int32(h.Version));
+            w.put(h.Previous.begin(), 32);
+            w.put(h.MerkleRoot.begin(), 32);
+            w.put_little(uint32(h.Timestamp));
+            w.put_little(uint32(h.Target));
+            w.put_little(uint32(h.Nonce));
+        }
+        
+        void get(read_cursor &r, outpoint &o) {
+            r.get(o.Digest.begin(), 32);
+            o.Index = index{r.get_little<uint32>()};
+        }
+        
+        // a script followed by tail bytes of fixed size, all checked at once.
+        void get_script(read_cursor &r, bytes &script, size_t tail) {
+            uint64 size = r.get_var_int();
+            r.check(size);
+            r.check(size + tail);
+            script = bytes(size);
+            r.get(script.data(), size);
+        }
+    }
+    
+    write_cursor &operator<<(write_cursor &w, const outpoint &o) {
+        w.check(36);
+        put(w, o);
+        return w;
+    }
+    
+    write_cursor &operator<<(write_cursor &w, const input &in) {
+        w.check(in.serialized_size());
+        put(w, in);
+        return w;
+    }
+    
+    write_cursor &operator<<(write_cursor &w, const output &o) {
+        w.check(o.serialized_size());
+        put(w, o);
+        return w;
+    }
+    
+    write_cursor &operator<<(write_cursor &w, const transaction &t) {
+        w.check(t.serialized_size());
+        put(w, t);
+        return w;
+    }
+    
+    write_cursor &operator<<(write_cursor &w, const header &h) {
+        w.check(80);
+        put(w, h);
+        return w;
+    }
+    
+    read_cursor &operator>>(read_cursor &r, outpoint &o) {
+        r.check(36);
+        get(r, o);
+        return r;
+    }
+    
+    read_cursor &operator>>(read_cursor &r, input &in) {
+        r.check(36);
+        get(r, in.Reference);
+        get_script(r, in.Script, 4);
+        in.Sequence = uint32_little{r.get_little<uint32>()};
+        return r;
+    }
+    
+    read_cursor &operator>>(read_cursor &r, output &o) {
+        r.check(8);
+        o.Value = satoshi{r.get_little<int64>()};
+        get_script(r, o.Script, 0);
+        return r;
+    }
+    
+    read_cursor &operator>>(read_cursor &r, transaction &t) {
+        t = transaction{};
+        r.check(4);
+        t.Version = int32_little{r.get_little<int32>()};
+        
+        uint64 inputs = r.get_var_int();
+        for (uint64 i = 0; i < inputs; i++) {
+            input in;
+            r >> in;
+            t.Inputs <<= in;
+        }
+        
+        uint64 outputs = r.get_var_int();
+        for (uint64 i = 0; i < outputs; i++) {
+            output o;
+            r >> o;
+            t.Outputs <<= o;
+        }
+        
+        r.check(4);
+        t.Locktime = uint32_little{r.get_little<uint32>()};
+        return r;
+    }
+    
+    read_cursor &operator>>(read_cursor &r, header &h) {
+        r.check(80);
+        h.Version = int32_little{r.get_little<int32>()};
+        r.get(h.Previous.begin(), 32);
+        r.get(h.MerkleRoot.begin(), 32);
+        h.Timestamp = Bitcoin::timestamp{r.get_little<uint32>()};
+        h.Target = work::compact{r.get_little<uint32>()};
+        h.Nonce = uint32_little{r.get_little<uint32>()};
+        return r;
+    }
+    
     output::operator bytes() const {
         bytes b(serialized_size());
-        bytes_writer w{b.begin(), b.end()};
-        w << *this;
+        write_cursor w{b.data(), b.data() + b.size()};
+        put(w, *this);
         return b;
     }
     
     transaction::operator bytes() const {
         bytes b(serialized_size());
-        bytes_writer w{b.begin(), b.end()};
-        w << *this;
+        write_cursor w{b.data(), b.data() + b.size()};
+        put(w, *this);
         return b;
     }
     
+    shared_transaction::shared_transaction() : shared_transaction{transaction{}} {}
+    
+    shared_transaction::shared_transaction(const transaction &tx) : Shared{} {
+        bytes serialized = bytes(tx);
+        txid id = Hash256(serialized);
+        Shared = std::make_shared<const shared>(shared{tx, std::move(serialized), id});
+    }
+    
+    shared_transaction::shared_transaction(bytes_view b) : shared_transaction{transaction{b}} {}
+    
     std::vector<bytes_view> block::transactions(bytes_view b) {
-        bytes_reader r(b.data(), b.data() + b.size());
-        Bitcoin::header h;
-        var_int num_txs; 
-        r >> h >> num_txs;
+        block_view v{b};
         std::vector<bytes_view> x;
-        x.resize(num_txs);
-        auto prev = r.Begin;
-        for (int i = 0; i < num_txs; i++) {
-            transaction tx;
-            r >> tx;
-            auto next = r.Begin;
-            x[i] = bytes_view{prev, static_cast<size_t>(next - prev)};
-            prev = next;
-        }
+        x.reserve(v.size());
+        for (const transaction_view& tx : v) x.push_back(tx.serialized());
         return x;
     }
     
+    digest256 block::merkle_root(bytes_view b) {
+        return block_view{b}.merkle_root();
+    }
+    
+    digest256 block::merkle_root(bytes_view b, executor &e) {
+        return block_view{b}.merkle_root(e);
+    }
+    
     template <typename reader>
     bool read_transaction_version(reader &r, int32_little& v) {
         r >> v;
@@ -212,8 +442,8 @@ namespace Gigamonkey::Bitcoin {
     
     byte_array<80> header::write() const {
         byte_array<80> x; 
-        bytes_writer w{x.begin(), x.end()};
-        w << Version << Previous << MerkleRoot << Timestamp << Target << Nonce;
+        write_cursor w{x.data(), x.data() + 80};
+        put(w, *this);
         return x;
     }
     
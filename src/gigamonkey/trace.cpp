@@ -0,0 +1,243 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/trace.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace Gigamonkey::trace {
+    
+    namespace {
+        
+        const char digits[] = "0123456789abcdef";
+        
+        void write_hex (std::string &x, const byte *b, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                x.push_back (digits[b[i] >> 4]);
+                x.push_back (digits[b[i] & 0x0f]);
+            }
+        }
+        
+        std::string hex (const byte_array<16> &trace) {
+            std::string x;
+            write_hex (x, trace.data (), trace.size ());
+            return x;
+        }
+        
+        // big endian, as in the W3C header.
+        std::string hex (uint64 span) {
+            byte b[8];
+            for (int i = 0; i < 8; i++) b[i] = byte (span >> (56 - 8 * i));
+            std::string x;
+            write_hex (x, b, 8);
+            return x;
+        }
+        
+        int digit (char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        }
+        
+        bool read_hex (string_view x, byte *b) {
+            for (size_t i = 0; i < x.size () / 2; i++) {
+                int high = digit (x[2 * i]);
+                int low = digit (x[2 * i + 1]);
+                if (high < 0 || low < 0) return false;
+                b[i] = byte ((high << 4) | low);
+            }
+            
+            return true;
+        }
+        
+    }
+    
+    std::string context::traceparent () const {
+        return "00-" + hex (Trace) + "-" + hex (Span) + (Sampled ? "-01" : "-00");
+    }
+    
+    context context::read_traceparent (string_view x) {
+        if (x.size () != 55 || x.substr (0, 3) != "00-" || x[35] != '-' || x[52] != '-') return {};
+        
+        context c {};
+        byte span[8];
+        byte flags;
+        if (!read_hex (x.substr (3, 32), c.Trace.data ()) || !read_hex (x.substr (36, 16), span) ||
+            !read_hex (x.substr (53, 2), &flags)) return {};
+        
+        for (int i = 0; i < 8; i++) c.Span = (c.Span << 8) | span[i];
+        if (c.Trace == byte_array<16> {}) return {};
+        
+        c.Sampled = flags & 1;
+        return c;
+    }
+    
+    uint64 now () {
+        return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::system_clock::now ().time_since_epoch ()).count ();
+    }
+    
+    JSON OTLP (const std::vector<record> &records, const std::string &service) {
+        JSON::array_t spans;
+        for (const record &r : records) {
+            JSON s {
+                {"traceId", hex (r.Trace)},
+                {"spanId", hex (r.Span)},
+                {"name", r.Name},
+                {"kind", 1},
+                {"startTimeUnixNano", std::to_string (r.Start)},
+                {"endTimeUnixNano", std::to_string (r.End)}};
+            
+            if (r.Parent != 0) s["parentSpanId"] = hex (r.Parent);
+            spans.push_back (s);
+        }
+        
+        return JSON {{"resourceSpans", JSON::array ({JSON {
+            {"resource", {{"attributes", JSON::array ({JSON {
+                {"key", "service.name"},
+                {"value", {{"stringValue", service}}}}})}}},
+            {"scopeSpans", JSON::array ({JSON {
+                {"scope", {{"name", "gigamonkey"}}},
+                {"spans", spans}}})}}})}};
+    }
+    
+    namespace {
+        
+        // one writer, which is the thread that owns it, and one reader, which is collect.
+        struct buffer {
+            static constexpr size_t size = 1 << 12;
+            
+            std::array<record, size> Records {};
+            std::atomic<uint64> Head {0};
+            std::atomic<uint64> Tail {0};
+            
+            bool push (const record &r) {
+                uint64 head = Head.load (std::memory_order_relaxed);
+                if (head - Tail.load (std::memory_order_acquire) >= size) return false;
+                Records[head % size] = r;
+                Head.store (head + 1, std::memory_order_release);
+                return true;
+            }
+            
+            void drain (std::vector<record> &x) {
+                uint64 tail = Tail.load (std::memory_order_relaxed);
+                uint64 head = Head.load (std::memory_order_acquire);
+                for (uint64 i = tail; i < head; i++) x.push_back (Records[i % size]);
+                Tail.store (head, std::memory_order_release);
+            }
+        };
+        
+        // the buffers of every running thread, and what was left in those that have exited.
+        struct registry {
+            std::mutex Mutex;
+            std::vector<buffer *> Live;
+            std::vector<record> Retired;
+        };
+        
+        registry &buffers () {
+            // never destroyed so that threads that exit after main has returned can still use it.
+            static registry *Registry = new registry {};
+            return *Registry;
+        }
+        
+        std::atomic<uint64> Dropped {0};
+        std::atomic<double> SampleRate {0};
+        
+        // the buffer is not in the thread_local itself, which would make every thread bigger.
+        struct local {
+            std::unique_ptr<buffer> Buffer;
+            
+            local () : Buffer {std::make_unique<buffer> ()} {
+                registry &r = buffers ();
+                std::lock_guard<std::mutex> lock (r.Mutex);
+                r.Live.push_back (Buffer.get ());
+            }
+            
+            ~local () {
+                registry &r = buffers ();
+                std::lock_guard<std::mutex> lock (r.Mutex);
+                Buffer->drain (r.Retired);
+                std::erase (r.Live, Buffer.get ());
+            }
+        };
+        
+        buffer &this_thread () {
+            thread_local local Local {};
+            return *Local.Buffer;
+        }
+        
+        thread_local context Current {};
+        
+        // ids only have to be unlikely to be the same, so they needn't be secure.
+        uint64 next_random () {
+            thread_local uint64 State = [] () {
+                std::random_device r;
+                return (uint64 (r ()) << 32) | r ();
+            } ();
+            
+            // splitmix64
+            uint64 z = (State += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
+        
+        uint64 span_id () {
+            uint64 x;
+            do x = next_random (); while (x == 0);
+            return x;
+        }
+        
+    }
+    
+    void set_sample_rate (double x) {
+        SampleRate.store (x < 0 ? 0 : x > 1 ? 1 : x, std::memory_order_relaxed);
+    }
+    
+    uint64 dropped () {
+        return Dropped.load (std::memory_order_relaxed);
+    }
+    
+    std::vector<record> collect () {
+        registry &r = buffers ();
+        std::lock_guard<std::mutex> lock (r.Mutex);
+        std::vector<record> x = std::move (r.Retired);
+        r.Retired = {};
+        for (buffer *b : r.Live) b->drain (x);
+        return x;
+    }
+    
+    context detail::current () {
+        return Current;
+    }
+    
+    void detail::set_current (const context &c) {
+        Current = c;
+    }
+    
+    // an unsampled trace keeps the same context all the way down, since nothing is recorded for it.
+    context detail::begin (const context &parent) {
+        if (parent.valid ()) return parent.Sampled ? context {parent.Trace, span_id (), true} : parent;
+        
+        context c {};
+        c.Span = span_id ();
+        double rate = SampleRate.load (std::memory_order_relaxed);
+        c.Sampled = rate > 0 && double (next_random () >> 11) < rate * double (uint64 {1} << 53);
+        for (size_t i = 0; i < 16; i += 8) {
+            uint64 x = next_random ();
+            for (size_t j = 0; j < 8; j++) c.Trace[i + j] = byte (x >> (8 * j));
+        }
+        
+        return c;
+    }
+    
+    void detail::end (const context &c, uint64 parent, const char *name, uint64 start, uint64 end) {
+        if (!this_thread ().push (record {c.Trace, c.Span, parent, name, start, end}))
+            Dropped.fetch_add (1, std::memory_order_relaxed);
+    }
+    
+}
@@ -0,0 +1,260 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/transaction_codec.hpp>
+#include <gigamonkey/hash.hpp>
+#include <gigamonkey/script/matcher.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/script/pattern/pay_to_script_hash.hpp>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        enum : byte {
+            stored_as_is = 0,
+            encoded = 1
+        };
+        
+        // a script is the number of its template, or 0 for a script that is
+        // stored as it is, followed by the data that it was matched with.
+        enum script_template : byte {
+            raw = 0,
+            pay_to_address_script = 1,
+            pay_to_pubkey_script = 2,
+            pay_to_script_hash_script = 3,
+            signature_and_pubkey = 4,
+            single_push = 5
+        };
+        
+        // the templates in order, starting with 1.
+        const classifier &templates () {
+            static const classifier Templates {[] () {
+                bytes x;
+                bytes y;
+                return std::vector<matcher> {
+                    matcher {pay_to_address::pattern (x)},
+                    matcher {pay_to_pubkey::pattern (x)},
+                    matcher {pay_to_script_hash::pattern (x)},
+                    matcher {Gigamonkey::pattern {Gigamonkey::push {x}, pubkey_pattern (y)}},
+                    matcher {Gigamonkey::pattern {Gigamonkey::push {x}}}};
+            } ()};
+            
+            return Templates;
+        }
+        
+        bytes build (int t, const std::vector<bytes_view> &c) {
+            switch (t) {
+                case pay_to_address_script:
+                    return compile (program {OP_DUP, OP_HASH160, push_data (c[0]), OP_EQUALVERIFY, OP_CHECKSIG});
+                case pay_to_pubkey_script:
+                    return compile (program {push_data (c[0]), OP_CHECKSIG});
+                case pay_to_script_hash_script:
+                    return compile (program {OP_HASH160, push_data (c[0]), OP_EQUAL});
+                case signature_and_pubkey:
+                    return compile (program {push_data (c[0]), push_data (c[1])});
+                default:
+                    return compile (push_data (c[0]));
+            }
+        }
+        
+        void put_var_int (bytes &b, uint64 x) {
+            size_t at = b.size ();
+            b.resize (at + var_int::size (x));
+            write_cursor w {b.data () + at, b.data () + b.size ()};
+            w.put_var_int (x);
+        }
+        
+        void put_var_string (bytes &b, bytes_view x) {
+            put_var_int (b, x.size ());
+            b.insert (b.end (), x.begin (), x.end ());
+        }
+        
+        // a script that does not build back into itself from its template is stored as it is.
+        void put_script (bytes &b, bytes_view script, std::vector<bytes_view> &captures) {
+            int t = templates ().classify (script, captures) + 1;
+            if (t != raw && bytes_view (build (t, captures)) == script) {
+                b.push_back (static_cast<byte> (t));
+                for (const bytes_view &c : captures) put_var_string (b, c);
+                return;
+            }
+            
+            b.push_back (raw);
+            put_var_string (b, script);
+        }
+        
+        bytes_view get_view (read_cursor &r, uint64 size) {
+            r.check (size);
+            bytes_view x {r.It, size};
+            r.skip (size);
+            return x;
+        }
+        
+        // the script, written to b as a serialized transaction has it.
+        void get_script (read_cursor &r, bytes &b, std::vector<bytes_view> &captures) {
+            r.check (1);
+            byte t = *r.It++;
+            if (t == raw) {
+                bytes_view script = get_view (r, r.get_var_int ());
+                put_var_string (b, script);
+                return;
+            }
+            
+            if (t > single_push) throw data::end_of_stream {};
+            captures.resize (templates ().Matchers[t - 1].captures ());
+            for (bytes_view &c : captures) c = get_view (r, r.get_var_int ());
+            put_var_string (b, build (t, captures));
+        }
+        
+        template <std::integral X> void put_little (bytes &b, X x) {
+            using U = std::make_unsigned_t<X>;
+            U u = static_cast<U> (x);
+            for (size_t i = 0; i < sizeof (X); i++) b.push_back (static_cast<byte> (u >> (8 * i)));
+        }
+        
+        // whether the transaction is as long as it would be with the shortest var ints.
+        bool canonical (const transaction_view &v) {
+            uint64 size = 8 + var_int::size (v.input_count ()) + var_int::size (v.output_count ());
+            for (size_t i = 0; i < v.input_count (); i++) {
+                uint64 script = v.input (i).script ().size ();
+                size += 40 + var_int::size (script) + script;
+            }
+            
+            for (size_t i = 0; i < v.output_count (); i++) {
+                uint64 script = v.output (i).script ().size ();
+                size += 8 + var_int::size (script) + script;
+            }
+            
+            return size == v.serialized_size ();
+        }
+        
+    }
+    
+    void transaction_codec::table::insert (const txid &x) {
+        if (Index.emplace (x, uint32 (Txids.size ())).second) Txids.push_back (x);
+    }
+    
+    int64 transaction_codec::table::find (const txid &x) const {
+        auto i = Index.find (x);
+        return i == Index.end () ? -1 : int64 (i->second);
+    }
+    
+    bytes transaction_codec::encode (bytes_view tx, const table &previous) {
+        transaction_view v {tx};
+        if (!v.valid () || !canonical (v)) {
+            bytes b;
+            b.reserve (tx.size () + 1);
+            b.push_back (stored_as_is);
+            b.insert (b.end (), tx.begin (), tx.end ());
+            return b;
+        }
+        
+        bytes b;
+        b.reserve (tx.size () / 2);
+        b.push_back (encoded);
+        put_var_int (b, uint32 (int32 (v.version ())));
+        put_var_int (b, uint32 (v.locktime ()));
+        
+        std::vector<bytes_view> captures;
+        put_var_int (b, v.input_count ());
+        for (size_t i = 0; i < v.input_count (); i++) {
+            input_view in = v.input (i);
+            outpoint o = in.reference ();
+            
+            // 0 for a txid that is written out, or one more than its position in the table.
+            int64 position = previous.find (o.Digest);
+            put_var_int (b, uint64 (position + 1));
+            if (position < 0) b.insert (b.end (), o.Digest.begin (), o.Digest.end ());
+            
+            put_var_int (b, uint32 (o.Index));
+            put_script (b, in.script (), captures);
+            put_var_int (b, 0xffffffff - uint32 (in.sequence ()));
+        }
+        
+        put_var_int (b, v.output_count ());
+        for (size_t i = 0; i < v.output_count (); i++) {
+            output_view out = v.output (i);
+            put_var_int (b, uint64 (int64 (out.value ())));
+            put_script (b, out.script (), captures);
+        }
+        
+        return b;
+    }
+    
+    maybe<bytes> transaction_codec::decode (bytes_view b, const table &previous) {
+        if (b.empty ()) return {};
+        if (b[0] == stored_as_is) return bytes (b.substr (1));
+        if (b[0] != encoded) return {};
+        
+        try {
+            read_cursor r {b.data () + 1, b.data () + b.size ()};
+            bytes tx;
+            tx.reserve (b.size () * 2);
+            
+            uint64 version = r.get_var_int ();
+            uint64 locktime = r.get_var_int ();
+            if (version > 0xffffffff || locktime > 0xffffffff) return {};
+            put_little (tx, uint32 (version));
+            
+            std::vector<bytes_view> captures;
+            uint64 inputs = r.get_var_int ();
+            put_var_int (tx, inputs);
+            for (uint64 i = 0; i < inputs; i++) {
+                uint64 position = r.get_var_int ();
+                if (position > previous.size ()) return {};
+                bytes_view id = position == 0 ? get_view (r, 32) : bytes_view (previous.Txids[position - 1]);
+                tx.insert (tx.end (), id.begin (), id.end ());
+                
+                uint64 index = r.get_var_int ();
+                if (index > 0xffffffff) return {};
+                put_little (tx, uint32 (index));
+                get_script (r, tx, captures);
+                
+                uint64 sequence = r.get_var_int ();
+                if (sequence > 0xffffffff) return {};
+                put_little (tx, uint32 (0xffffffff - sequence));
+            }
+            
+            uint64 outputs = r.get_var_int ();
+            put_var_int (tx, outputs);
+            for (uint64 i = 0; i < outputs; i++) {
+                put_little (tx, r.get_var_int ());
+                get_script (r, tx, captures);
+            }
+            
+            put_little (tx, uint32 (locktime));
+            if (r.It != r.End) return {};
+            return tx;
+        } catch (const data::end_of_stream &) {
+            return {};
+        }
+    }
+    
+    std::vector<bytes> transaction_codec::encode (const block_view &block) {
+        std::vector<bytes> x;
+        x.reserve (block.size ());
+        table previous {};
+        for (const transaction_view &tx : block) {
+            x.push_back (encode (tx.serialized (), previous));
+            previous.insert (tx.id ());
+        }
+        
+        return x;
+    }
+    
+    maybe<std::vector<bytes>> transaction_codec::decode (const std::vector<bytes> &block) {
+        std::vector<bytes> x;
+        x.reserve (block.size ());
+        table previous {};
+        for (const bytes &b : block) {
+            maybe<bytes> tx = decode (b, previous);
+            if (!bool (tx)) return {};
+            previous.insert (Hash256 (*tx));
+            x.push_back (std::move (*tx));
+        }
+        
+        return x;
+    }
+    
+}
@@ -0,0 +1,228 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/txid_index.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+
+#include <atomic>
+#include <bit>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey {
+    
+    namespace {
+        
+        // the file begins with the magic, the number of slots, the number of records and
+        // the number of records that have been used. All numbers are little endian.
+        constexpr byte index_file_magic[] {'G', 'M', 'T', 'X', 'I', 'D', 'X', '1'};
+        constexpr size_t index_file_prefix = 64;
+        constexpr size_t count_position = 24;
+        
+        // the first 8 bytes of the txid and the number of the record plus one, or zero if empty.
+        constexpr size_t slot_size = 16;
+        
+        // txid, block hash, offset, length and index.
+        constexpr size_t record_size = 80;
+        
+        size_t index_file_size (uint64 slots, uint64 capacity) {
+            return index_file_prefix + slots * slot_size + capacity * record_size;
+        }
+        
+        // the fields that are read while they are written.
+        uint64 load (byte *p, std::memory_order order) {
+            return boost::endian::little_to_native (std::atomic_ref<uint64> {*reinterpret_cast<uint64 *> (p)}.load (order));
+        }
+        
+        void store (byte *p, uint64 x, std::memory_order order) {
+            std::atomic_ref<uint64> {*reinterpret_cast<uint64 *> (p)}.store (boost::endian::native_to_little (x), order);
+        }
+        
+        uint64 txid_prefix (const Bitcoin::txid &t) {
+            return boost::endian::load_little_u64 (t.begin ());
+        }
+        
+    }
+    
+    txid_index::txid_index (const std::string &path, uint64 capacity) :
+        Descriptor {-1}, Map {nullptr}, Slots {0}, Capacity {0} {
+        
+        Descriptor = ::open (path.c_str (), O_RDWR | O_CREAT, 0644);
+        if (Descriptor < 0) throw std::runtime_error {"could not open txid index " + path};
+        
+        try {
+            struct stat st;
+            if (fstat (Descriptor, &st) != 0) throw std::runtime_error {"could not read txid index " + path};
+            
+            size_t size = static_cast<size_t> (st.st_size);
+            if (size == 0) {
+                if (capacity == 0) throw std::invalid_argument {"txid index must have room for a transaction"};
+                
+                // at most half of the slots are ever used, so probes are short.
+                Capacity = capacity;
+                Slots = std::bit_ceil (std::max (capacity * 2, uint64 {16}));
+                if (ftruncate (Descriptor, index_file_size (Slots, Capacity)) != 0)
+                    throw std::runtime_error {"could not resize txid index " + path};
+            } else {
+                byte prefix[index_file_prefix];
+                if (size < index_file_prefix || pread (Descriptor, prefix, index_file_prefix, 0) != index_file_prefix ||
+                    !std::equal (std::begin (index_file_magic), std::end (index_file_magic), prefix))
+                    throw std::invalid_argument {"not a txid index: " + path};
+                
+                Slots = boost::endian::load_little_u64 (prefix + 8);
+                Capacity = boost::endian::load_little_u64 (prefix + 16);
+                if (!std::has_single_bit (Slots) || size != index_file_size (Slots, Capacity))
+                    throw std::invalid_argument {"not a txid index: " + path};
+            }
+            
+            void *m = mmap (nullptr, index_file_size (Slots, Capacity), PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor, 0);
+            if (m == MAP_FAILED) throw std::runtime_error {"could not map txid index " + path};
+            Map = static_cast<byte *> (m);
+            
+            if (size == 0) {
+                std::copy (std::begin (index_file_magic), std::end (index_file_magic), Map);
+                boost::endian::store_little_u64 (Map + 8, Slots);
+                boost::endian::store_little_u64 (Map + 16, Capacity);
+                store (Map + count_position, 0, std::memory_order_relaxed);
+            } else if (this->size () > Capacity) throw std::invalid_argument {"not a txid index: " + path};
+        } catch (...) {
+            close ();
+            throw;
+        }
+    }
+    
+    txid_index::~txid_index () {
+        close ();
+    }
+    
+    void txid_index::close () {
+        if (Map != nullptr) munmap (Map, index_file_size (Slots, Capacity));
+        if (Descriptor >= 0) ::close (Descriptor);
+        Map = nullptr;
+        Descriptor = -1;
+    }
+    
+    byte *txid_index::slot (uint64 i) const {
+        return Map + index_file_prefix + i * slot_size;
+    }
+    
+    byte *txid_index::record (uint64 i) const {
+        return Map + index_file_prefix + Slots * slot_size + i * record_size;
+    }
+    
+    uint64 txid_index::size () const {
+        return load (Map + count_position, std::memory_order_acquire);
+    }
+    
+    void txid_index::sync () const {
+        if (msync (Map, index_file_size (Slots, Capacity), MS_SYNC) != 0) throw std::runtime_error {"could not sync txid index"};
+    }
+    
+    maybe<txid_index::position> txid_index::operator [] (const Bitcoin::txid &t) const {
+        uint64 prefix = txid_prefix (t);
+        for (uint64 i = prefix & (Slots - 1);; i = (i + 1) & (Slots - 1)) {
+            byte *s = slot (i);
+            
+            // the record is published after the prefix, so if we see it we see the prefix too.
+            uint64 r = load (s + 8, std::memory_order_acquire);
+            if (r == 0) return {};
+            if (load (s, std::memory_order_relaxed) != prefix) continue;
+            
+            const byte *x = record (r - 1);
+            if (!std::equal (t.begin (), t.end (), x)) continue;
+            
+            position p {};
+            std::copy (x + 32, x + 64, p.Block.begin ());
+            p.Offset = boost::endian::load_little_u64 (x + 64);
+            p.Length = boost::endian::load_little_u32 (x + 72);
+            p.Index = boost::endian::load_little_u32 (x + 76);
+            return p;
+        }
+    }
+    
+    bool txid_index::insert (const Bitcoin::txid &t, const position &p) {
+        uint64 prefix = txid_prefix (t);
+        for (uint64 i = prefix & (Slots - 1);; i = (i + 1) & (Slots - 1)) {
+            byte *s = slot (i);
+            uint64 r = load (s + 8, std::memory_order_relaxed);
+            if (r != 0) {
+                if (load (s, std::memory_order_relaxed) == prefix && std::equal (t.begin (), t.end (), record (r - 1))) return false;
+                continue;
+            }
+            
+            uint64 n = size ();
+            if (n == Capacity) throw std::length_error {"txid index is full"};
+            
+            byte *x = record (n);
+            std::copy (t.begin (), t.end (), x);
+            std::copy (p.Block.begin (), p.Block.end (), x + 32);
+            boost::endian::store_little_u64 (x + 64, p.Offset);
+            boost::endian::store_little_u32 (x + 72, p.Length);
+            boost::endian::store_little_u32 (x + 76, p.Index);
+            
+            store (s, prefix, std::memory_order_relaxed);
+            store (s + 8, n + 1, std::memory_order_release);
+            store (Map + count_position, n + 1, std::memory_order_release);
+            return true;
+        }
+    }
+    
+    void txid_index::loader::receive_header (const Bitcoin::header &h, uint64 transactions) {
+        Block = h.hash ();
+        Offset = 80 + Bitcoin::var_int::size (transactions);
+        Next = 0;
+    }
+    
+    void txid_index::loader::receive_transaction (const Bitcoin::transaction_view &t) {
+        if (Index.insert (t.id (), position {Block, Offset, uint32 (t.serialized_size ()), Next})) Inserted++;
+        Offset += t.serialized_size ();
+        Next++;
+    }
+    
+    list<ledger::block_header> indexed_ledger::headers (uint64 since_height) {
+        list<block_header> h;
+        uint64 top = uint64 (Headers.latest ().Height);
+        for (uint64 i = since_height; i <= top; i++) h <<= Headers[N (i)];
+        return h;
+    }
+    
+    data::entry<bytes, ledger::confirmation> indexed_ledger::transaction (const Bitcoin::txid &t) const {
+        data::entry<bytes, confirmation> none {bytes {}, confirmation {}};
+        
+        maybe<txid_index::position> p = Index[t];
+        if (!p) return none;
+        
+        bytes b = Blocks (p->Block);
+        if (b.size () < p->Offset + p->Length) return none;
+        
+        Bitcoin::block_view v {b};
+        if (!v.valid () || p->Index >= v.size ()) return none;
+        
+        std::vector<digest256> leaves;
+        leaves.reserve (v.size ());
+        for (const Bitcoin::transaction_view &x : v) leaves.push_back (x.id ());
+        
+        // the index may be out of date or wrong about this transaction.
+        if (leaves[p->Index] != t) return none;
+        
+        return data::entry<bytes, confirmation> {bytes (bytes_view {b}.substr (p->Offset, p->Length)),
+            confirmation {Merkle::flat_tree {std::move (leaves)}[p->Index], Headers[p->Block].Header}};
+    }
+    
+    ledger::block_header indexed_ledger::header (const digest256 &d) const {
+        return Headers[d];
+    }
+    
+    bytes indexed_ledger::block (const digest256 &d) const {
+        return Blocks (d);
+    }
+    
+    Merkle::proof indexed_ledger::proof (const Bitcoin::txid &t) const {
+        return transaction (t).Value.Proof;
+    }
+    
+}
@@ -0,0 +1,324 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/utxo.hpp>
+#include <gigamonkey/trace.hpp>
+
+#include <mutex>
+#include <random>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        enum class utxo_template : byte {
+            raw = 0,
+            pay_to_address = 1,
+            pay_to_compressed_pubkey = 2,
+            pay_to_uncompressed_pubkey = 3,
+            
+            // a handle to a script in a script_store. Only used inside the table.
+            interned = 4
+        };
+        
+        void write_utxo_var_int (bytes &b, uint64 x) {
+            size_t size;
+            if (x < 0xfd) size = 0, b.push_back (static_cast<byte> (x));
+            else if (x <= 0xffff) size = 2, b.push_back (0xfd);
+            else if (x <= 0xffffffff) size = 4, b.push_back (0xfe);
+            else size = 8, b.push_back (0xff);
+            
+            for (size_t i = 0; i < size; i++) b.push_back (static_cast<byte> (x >> (8 * i)));
+        }
+        
+        size_t read_utxo_var_int (bytes_view b, uint64 &x) {
+            if (b.empty ()) return 0;
+            size_t size = b[0] < 0xfd ? 0 : b[0] == 0xfd ? 2 : b[0] == 0xfe ? 4 : 8;
+            if (b.size () < size + 1) return 0;
+            
+            if (size == 0) x = b[0];
+            else {
+                x = 0;
+                for (size_t i = size; i > 0; i--) x = (x << 8) | b[i];
+            }
+            
+            return size + 1;
+        }
+        
+        bool is_pay_to_address (bytes_view s) {
+            return s.size () == 25 && s[0] == OP_DUP && s[1] == OP_HASH160 && s[2] == 20 &&
+                s[23] == OP_EQUALVERIFY && s[24] == OP_CHECKSIG;
+        }
+        
+        bool is_pay_to_pubkey (bytes_view s, size_t pubkey_size) {
+            return s.size () == pubkey_size + 2 && s[0] == pubkey_size && s[pubkey_size + 1] == OP_CHECKSIG;
+        }
+        
+        // outputs that begin with OP_FALSE OP_RETURN can never be spent. Since
+        // Genesis, one that begins with OP_RETURN alone may be.
+        bool unspendable (bytes_view s) {
+            return s.size () > 1 && s[0] == OP_FALSE && s[1] == OP_RETURN;
+        }
+        
+    }
+    
+    bytes utxo_set::encode (const output &o) {
+        bytes b;
+        b.reserve (o.Script.size () + 10);
+        write_utxo_var_int (b, static_cast<uint64> (int64 (o.Value)));
+        
+        bytes_view script = o.Script;
+        if (is_pay_to_address (script)) {
+            b.push_back (static_cast<byte> (utxo_template::pay_to_address));
+            b.insert (b.end (), script.begin () + 3, script.begin () + 23);
+        } else if (is_pay_to_pubkey (script, 33)) {
+            b.push_back (static_cast<byte> (utxo_template::pay_to_compressed_pubkey));
+            b.insert (b.end (), script.begin () + 1, script.begin () + 34);
+        } else if (is_pay_to_pubkey (script, 65)) {
+            b.push_back (static_cast<byte> (utxo_template::pay_to_uncompressed_pubkey));
+            b.insert (b.end (), script.begin () + 1, script.begin () + 66);
+        } else {
+            b.push_back (static_cast<byte> (utxo_template::raw));
+            b.insert (b.end (), script.begin (), script.end ());
+        }
+        
+        return b;
+    }
+    
+    output utxo_set::decode (bytes_view b) {
+        uint64 value;
+        size_t size = read_utxo_var_int (b, value);
+        if (size == 0 || b.size () == size) return output {};
+        
+        utxo_template t = static_cast<utxo_template> (b[size]);
+        bytes_view rest = b.substr (size + 1);
+        
+        bytes script;
+        switch (t) {
+            case utxo_template::pay_to_address:
+                script.reserve (25);
+                script.insert (script.end (), {byte (OP_DUP), byte (OP_HASH160), byte (20)});
+                script.insert (script.end (), rest.begin (), rest.end ());
+                script.insert (script.end (), {byte (OP_EQUALVERIFY), byte (OP_CHECKSIG)});
+                break;
+            case utxo_template::pay_to_compressed_pubkey:
+            case utxo_template::pay_to_uncompressed_pubkey:
+                script.reserve (rest.size () + 2);
+                script.push_back (static_cast<byte> (rest.size ()));
+                script.insert (script.end (), rest.begin (), rest.end ());
+                script.push_back (OP_CHECKSIG);
+                break;
+            default:
+                script = bytes (rest);
+        }
+        
+        return output {satoshi {static_cast<int64> (value)}, script};
+    }
+    
+    utxo_set::utxo_set (size_t capacity) : Salt {0}, Size {0}, Stored {0}, Slots {}, Scripts {nullptr}, Mutex {} {
+        std::random_device r;
+        Salt = (uint64 (r ()) << 32) | r ();
+        
+        size_t n = 16;
+        while (n < 2 * capacity) n <<= 1;
+        Slots.resize (n);
+    }
+    
+    utxo_set::utxo_set (size_t capacity, script_store &scripts) : utxo_set {capacity} {
+        Scripts = &scripts;
+    }
+    
+    utxo_set::~utxo_set () {
+        if (Scripts != nullptr) for (const slot &s : Slots) if (s.Used) release (s.Value);
+    }
+    
+    // a script that is no bigger than a handle is left as it is.
+    bytes utxo_set::intern (bytes b) const {
+        uint64 value;
+        size_t size = read_utxo_var_int (b, value);
+        if (Scripts == nullptr || size == 0 || b.size () <= size + 1 + sizeof (script_store::handle) ||
+            static_cast<utxo_template> (b[size]) != utxo_template::raw) return b;
+        
+        script_store::handle h = Scripts->intern (bytes_view (b).substr (size + 1));
+        b.resize (size + 1 + sizeof (script_store::handle));
+        b[size] = static_cast<byte> (utxo_template::interned);
+        boost::endian::store_little_u32 (b.data () + size + 1, h);
+        return b;
+    }
+    
+    bytes utxo_set::expand (bytes_view b) const {
+        uint64 value;
+        size_t size = read_utxo_var_int (b, value);
+        if (Scripts == nullptr || size == 0 || b.size () != size + 1 + sizeof (script_store::handle) ||
+            static_cast<utxo_template> (b[size]) != utxo_template::interned) return bytes (b);
+        
+        bytes_view script = (*Scripts)[boost::endian::load_little_u32 (b.data () + size + 1)];
+        bytes x;
+        x.reserve (size + 1 + script.size ());
+        x.insert (x.end (), b.begin (), b.begin () + size);
+        x.push_back (static_cast<byte> (utxo_template::raw));
+        x.insert (x.end (), script.begin (), script.end ());
+        return x;
+    }
+    
+    void utxo_set::release (bytes_view b) const {
+        uint64 value;
+        size_t size = read_utxo_var_int (b, value);
+        if (Scripts == nullptr || size == 0 || b.size () != size + 1 + sizeof (script_store::handle) ||
+            static_cast<utxo_template> (b[size]) != utxo_template::interned) return;
+        
+        Scripts->release (boost::endian::load_little_u32 (b.data () + size + 1));
+    }
+    
+    size_t utxo_set::home (const outpoint &o) const {
+        uint64 x;
+        std::copy (o.Digest.begin (), o.Digest.begin () + 8, reinterpret_cast<byte *> (&x));
+        x ^= Salt ^ (uint64 (o.Index) * 0x9e3779b97f4a7c15);
+        x ^= x >> 31;
+        x *= 0xbf58476d1ce4e5b9;
+        x ^= x >> 29;
+        return x & (Slots.size () - 1);
+    }
+    
+    size_t utxo_set::find (const outpoint &o) const {
+        size_t mask = Slots.size () - 1;
+        size_t i = home (o);
+        while (Slots[i].Used && Slots[i].Key != o) i = (i + 1) & mask;
+        return i;
+    }
+    
+    void utxo_set::grow () {
+        std::vector<slot> old (Slots.size () * 2);
+        std::swap (old, Slots);
+        for (slot &s : old) if (s.Used) Slots[find (s.Key)] = std::move (s);
+    }
+    
+    bool utxo_set::insert_encoded (const outpoint &o, bytes b) {
+        if (2 * (Size + 1) > Slots.size ()) grow ();
+        
+        slot &s = Slots[find (o)];
+        if (s.Used) return false;
+        
+        s = slot {true, o, intern (std::move (b))};
+        Size++;
+        Stored += s.Value.size ();
+        return true;
+    }
+    
+    // we shift later entries back so that no tombstones are left behind.
+    bool utxo_set::remove_encoded (const outpoint &o, bytes *removed) {
+        size_t i = find (o);
+        if (!Slots[i].Used) return false;
+        if (removed != nullptr) *removed = expand (Slots[i].Value);
+        release (Slots[i].Value);
+        Stored -= Slots[i].Value.size ();
+        
+        size_t mask = Slots.size () - 1;
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (!Slots[j].Used) break;
+            
+            // an entry can move back to i unless its home is after i.
+            size_t k = home (Slots[j].Key);
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+            
+            Slots[i] = std::move (Slots[j]);
+            i = j;
+        }
+        
+        Slots[i] = slot {};
+        Size--;
+        return true;
+    }
+    
+    size_t utxo_set::size () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Size;
+    }
+    
+    bool utxo_set::contains (const outpoint &o) const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return Slots[find (o)].Used;
+    }
+    
+    maybe<output> utxo_set::operator [] (const outpoint &o) const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        const slot &s = Slots[find (o)];
+        if (!s.Used) return {};
+        if (Scripts != nullptr) return decode (expand (s.Value));
+        return decode (s.Value);
+    }
+    
+    bool utxo_set::insert (const outpoint &o, const output &x) {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        return insert_encoded (o, encode (x));
+    }
+    
+    bool utxo_set::remove (const outpoint &o) {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        return remove_encoded (o, nullptr);
+    }
+    
+    bool utxo_set::apply (const block &b, block_undo &u) {
+        trace::span applying {"validate.utxo_apply"};
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        
+        block_undo changes;
+        bool first = true;
+        for (const transaction &tx : b.Transactions) {
+            // the coinbase does not spend anything.
+            if (!first) for (const input &in : tx.Inputs) {
+                bytes removed;
+                if (!remove_encoded (in.Reference, &removed)) {
+                    for (auto &[o, x] : changes.Spent) insert_encoded (o, std::move (x));
+                    for (const outpoint &o : changes.Created) remove_encoded (o, nullptr);
+                    return false;
+                }
+                
+                changes.Spent.emplace_back (in.Reference, std::move (removed));
+            }
+            
+            first = false;
+            
+            txid id = tx.id ();
+            uint32 index = 0;
+            for (const output &out : tx.Outputs) {
+                if (!unspendable (out.Script)) {
+                    outpoint o {id, index};
+                    if (insert_encoded (o, encode (out))) changes.Created.push_back (o);
+                }
+                
+                index++;
+            }
+        }
+        
+        u = std::move (changes);
+        return true;
+    }
+    
+    // outputs that were created and spent in the same block are put back and then removed again.
+    void utxo_set::undo (const block_undo &u) {
+        std::unique_lock<std::shared_mutex> lock (Mutex);
+        for (const auto &[o, x] : u.Spent) insert_encoded (o, x);
+        for (const outpoint &o : u.Created) remove_encoded (o, nullptr);
+    }
+    
+    memory_report utxo_set::memory_usage () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        return memory_report {
+            Size * sizeof (outpoint),
+            Stored,
+            Size * (sizeof (slot) - sizeof (outpoint)),
+            (Slots.size () - Size) * sizeof (slot)};
+    }
+    
+    std::vector<std::pair<outpoint, bytes>> utxo_set::entries () const {
+        std::shared_lock<std::shared_mutex> lock (Mutex);
+        std::vector<std::pair<outpoint, bytes>> x;
+        x.reserve (Size);
+        for (const slot &s : Slots) if (s.Used) x.emplace_back (s.Key, expand (s.Value));
+        return x;
+    }
+    
+}
@@ -0,0 +1,362 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/utxo_snapshot.hpp>
+#include <gigamonkey/hash.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        constexpr byte utxo_snapshot_magic[] {'G', 'M', 'U', 'T', 'X', 'O', 'S', '1'};
+        
+        // The magic, the version, four bytes that are not used, the height and hash
+        // of the header that the set is for, the number of outputs, the number of
+        // chunks, the outputs in each chunk, four bytes that are not used, and the
+        // SHA2-256 hash of the table of chunks. All numbers are little endian.
+        constexpr size_t utxo_snapshot_prefix = 112;
+        
+        // The position and size of the chunk, the first outpoint in it, the
+        // number of outputs in it and the SHA2-256 hash of it.
+        constexpr size_t chunk_record_size = 88;
+        
+        // In a chunk, the outputs of each transaction are the txid, the number of
+        // outputs, and then the index, the size of the encoding and the encoding
+        // of each. Numbers in a chunk are written seven bits at a time.
+        void write_number (bytes &b, uint64 x) {
+            while (x >= 0x80) {
+                b.push_back (static_cast<byte> (x | 0x80));
+                x >>= 7;
+            }
+            
+            b.push_back (static_cast<byte> (x));
+        }
+        
+        bool read_number (bytes_view &b, uint64 &x) {
+            x = 0;
+            for (uint32 shift = 0; shift < 64; shift += 7) {
+                if (b.empty ()) return false;
+                byte next = b[0];
+                b = b.substr (1);
+                x |= uint64 (next & 0x7f) << shift;
+                if (!(next & 0x80)) return true;
+            }
+            
+            return false;
+        }
+        
+        using entry = std::pair<outpoint, bytes>;
+        
+        int compare (const outpoint &a, const outpoint &b) {
+            int c = std::memcmp (a.Digest.begin (), b.Digest.begin (), 32);
+            if (c != 0) return c;
+            return a.Index < b.Index ? -1 : a.Index > b.Index ? 1 : 0;
+        }
+        
+        bool before (const entry &a, const entry &b) {
+            return compare (a.first, b.first) < 0;
+        }
+        
+        bytes encode_chunk (const entry *begin, const entry *end) {
+            bytes b;
+            while (begin != end) {
+                const entry *next = begin;
+                while (next != end && next->first.Digest == begin->first.Digest) next++;
+                
+                b.insert (b.end (), begin->first.Digest.begin (), begin->first.Digest.end ());
+                write_number (b, next - begin);
+                for (; begin != next; begin++) {
+                    write_number (b, begin->first.Index);
+                    write_number (b, begin->second.size ());
+                    b.insert (b.end (), begin->second.begin (), begin->second.end ());
+                }
+            }
+            
+            return b;
+        }
+        
+        // calls f on every outpoint and encoding in the chunk until it returns false.
+        template <typename F> bool decode_chunk (bytes_view b, F f) {
+            while (!b.empty ()) {
+                if (b.size () < 32) return false;
+                txid id;
+                std::copy (b.begin (), b.begin () + 32, id.begin ());
+                b = b.substr (32);
+                
+                uint64 count;
+                if (!read_number (b, count)) return false;
+                for (uint64 i = 0; i < count; i++) {
+                    uint64 index;
+                    uint64 size;
+                    if (!read_number (b, index) || index > 0xffffffff || !read_number (b, size) || size > b.size ()) return false;
+                    if (!f (outpoint {id, uint32 (index)}, b.substr (0, size))) return true;
+                    b = b.substr (size);
+                }
+            }
+            
+            return true;
+        }
+        
+        // sync a file before it is renamed, or its directory after, so that a crash leaves the old file or the new one.
+        bool fsync_path (const std::filesystem::path &p, int flags) {
+            int descriptor = ::open (p.c_str (), flags);
+            if (descriptor < 0) return false;
+            bool synced = ::fsync (descriptor) == 0;
+            ::close (descriptor);
+            return synced;
+        }
+        
+    }
+    
+    void utxo_snapshot::write (const std::filesystem::path &path, const utxo_set &utxos,
+        const headers::header &tip, const options &o, executor *e) {
+        if (o.ChunkOutputs == 0) throw std::invalid_argument {"utxo snapshot chunks must have room for outputs"};
+        
+        std::vector<entry> entries = utxos.entries ();
+        size_t n = entries.size ();
+        
+        // sort pieces separately and then merge them.
+        size_t piece = e == nullptr ? std::max<size_t> (n, 1) : std::max<size_t> (o.ChunkOutputs, n / 16 + 1);
+        size_t pieces = (n + piece - 1) / piece;
+        auto sort_pieces = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                std::sort (entries.begin () + i * piece, entries.begin () + std::min (n, (i + 1) * piece), before);
+        };
+        
+        if (e == nullptr) sort_pieces (0, pieces);
+        else e->bulk (pieces, 1, sort_pieces);
+        
+        for (size_t width = piece; width < n; width *= 2)
+            for (size_t i = 0; i + width < n; i += 2 * width)
+                std::inplace_merge (entries.begin () + i, entries.begin () + i + width,
+                    entries.begin () + std::min (n, i + 2 * width), before);
+        
+        uint64 chunk_count = (n + o.ChunkOutputs - 1) / o.ChunkOutputs;
+        std::vector<bytes> chunks (chunk_count);
+        std::vector<digest256> digests (chunk_count);
+        auto encode_chunks = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                chunks[i] = encode_chunk (entries.data () + i * o.ChunkOutputs,
+                    entries.data () + std::min<size_t> (n, (i + 1) * o.ChunkOutputs));
+                digests[i] = SHA2_256 (chunks[i]);
+            }
+        };
+        
+        if (e == nullptr) encode_chunks (0, chunk_count);
+        else e->bulk (chunk_count, 1, encode_chunks);
+        
+        bytes table (chunk_count * chunk_record_size);
+        uint64 at = utxo_snapshot_prefix + table.size ();
+        for (uint64 i = 0; i < chunk_count; i++) {
+            byte *r = table.data () + i * chunk_record_size;
+            const entry &first = entries[i * o.ChunkOutputs];
+            std::fill (r, r + chunk_record_size, 0);
+            boost::endian::store_little_u64 (r, at);
+            boost::endian::store_little_u64 (r + 8, chunks[i].size ());
+            std::copy (first.first.Digest.begin (), first.first.Digest.end (), r + 16);
+            boost::endian::store_little_u32 (r + 48, first.first.Index);
+            boost::endian::store_little_u32 (r + 52, std::min<uint64> (o.ChunkOutputs, n - i * o.ChunkOutputs));
+            std::copy (digests[i].begin (), digests[i].end (), r + 56);
+            at += chunks[i].size ();
+        }
+        
+        byte prefix[utxo_snapshot_prefix] {};
+        std::copy (std::begin (utxo_snapshot_magic), std::end (utxo_snapshot_magic), prefix);
+        boost::endian::store_little_u32 (prefix + 8, version);
+        boost::endian::store_little_u64 (prefix + 16, uint64 (tip.Height));
+        std::copy (tip.Hash.begin (), tip.Hash.end (), prefix + 24);
+        boost::endian::store_little_u64 (prefix + 56, n);
+        boost::endian::store_little_u64 (prefix + 64, chunk_count);
+        boost::endian::store_little_u32 (prefix + 72, o.ChunkOutputs);
+        digest256 table_digest = SHA2_256 (table);
+        std::copy (table_digest.begin (), table_digest.end (), prefix + 80);
+        
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        
+        {
+            std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+            if (out) out.write (reinterpret_cast<const char *> (prefix), utxo_snapshot_prefix);
+            if (out) out.write (reinterpret_cast<const char *> (table.data ()), table.size ());
+            for (const bytes &chunk : chunks) if (out) out.write (reinterpret_cast<const char *> (chunk.data ()), chunk.size ());
+            if (!out) throw std::runtime_error {"could not write utxo snapshot " + temporary.string ()};
+        }
+        
+        // the contents are on the disk before the file has its name, and the name after.
+        if (!fsync_path (temporary, O_RDONLY)) throw std::runtime_error {"could not sync utxo snapshot " + temporary.string ()};
+        
+        std::error_code err;
+        std::filesystem::rename (temporary, path, err);
+        if (err) throw std::runtime_error {"could not write utxo snapshot " + path.string ()};
+        
+        std::filesystem::path directory = path.has_parent_path () ? path.parent_path () : std::filesystem::path {"."};
+        if (!fsync_path (directory, O_RDONLY | O_DIRECTORY)) throw std::runtime_error {"could not sync directory of utxo snapshot " + path.string ()};
+    }
+    
+    utxo_snapshot::utxo_snapshot (const std::filesystem::path &path) :
+        Path {path}, Descriptor {-1}, Map {nullptr}, Size {0}, Chunks {0}, Verified {0}, Verifying {} {
+        
+        Descriptor = ::open (Path.c_str (), O_RDONLY);
+        if (Descriptor < 0) throw std::runtime_error {"could not open utxo snapshot " + Path.string ()};
+        
+        struct stat st;
+        if (fstat (Descriptor, &st) != 0) {
+            ::close (Descriptor);
+            throw std::runtime_error {"could not read utxo snapshot " + Path.string ()};
+        }
+        
+        Size = static_cast<size_t> (st.st_size);
+        if (Size < utxo_snapshot_prefix) {
+            ::close (Descriptor);
+            throw std::invalid_argument {"not a utxo snapshot: " + Path.string ()};
+        }
+        
+        void *m = mmap (nullptr, Size, PROT_READ, MAP_SHARED, Descriptor, 0);
+        if (m == MAP_FAILED) {
+            ::close (Descriptor);
+            throw std::runtime_error {"could not map utxo snapshot " + Path.string ()};
+        }
+        
+        Map = static_cast<const byte *> (m);
+        Chunks = boost::endian::load_little_u64 (Map + 64);
+        
+        bool good = std::equal (std::begin (utxo_snapshot_magic), std::end (utxo_snapshot_magic), Map) &&
+            boost::endian::load_little_u32 (Map + 8) == version &&
+            Chunks <= (Size - utxo_snapshot_prefix) / chunk_record_size;
+        
+        if (good) {
+            digest256 table_digest = SHA2_256 (bytes_view {Map + utxo_snapshot_prefix, Chunks * chunk_record_size});
+            good = std::equal (table_digest.begin (), table_digest.end (), Map + 80);
+        }
+        
+        if (!good) {
+            munmap (const_cast<byte *> (Map), Size);
+            ::close (Descriptor);
+            throw std::invalid_argument {"not a utxo snapshot of version " + std::to_string (version) + ": " + Path.string ()};
+        }
+    }
+    
+    utxo_snapshot::~utxo_snapshot () {
+        munmap (const_cast<byte *> (Map), Size);
+        ::close (Descriptor);
+    }
+    
+    uint64 utxo_snapshot::height () const {
+        return boost::endian::load_little_u64 (Map + 16);
+    }
+    
+    digest256 utxo_snapshot::tip () const {
+        digest256 x;
+        std::copy (Map + 24, Map + 56, x.begin ());
+        return x;
+    }
+    
+    bool utxo_snapshot::check (const headers &h) const {
+        headers::header x = h[N (height ())];
+        return x.valid () && x.Hash == tip ();
+    }
+    
+    uint64 utxo_snapshot::size () const {
+        return boost::endian::load_little_u64 (Map + 56);
+    }
+    
+    uint64 utxo_snapshot::chunks () const {
+        return Chunks;
+    }
+    
+    uint64 utxo_snapshot::verified () const {
+        return Verified;
+    }
+    
+    const byte *utxo_snapshot::chunk_record (uint64 index) const {
+        return Map + utxo_snapshot_prefix + index * chunk_record_size;
+    }
+    
+    maybe<bytes_view> utxo_snapshot::chunk (uint64 index) const {
+        const byte *r = chunk_record (index);
+        uint64 at = boost::endian::load_little_u64 (r);
+        uint64 size = boost::endian::load_little_u64 (r + 8);
+        if (at > Size || size > Size - at) return {};
+        return bytes_view {Map + at, size};
+    }
+    
+    bool utxo_snapshot::check_chunk (uint64 index) const {
+        maybe<bytes_view> b = chunk (index);
+        if (!bool (b)) return false;
+        digest256 d = SHA2_256 (*b);
+        return std::equal (d.begin (), d.end (), chunk_record (index) + 56);
+    }
+    
+    bool utxo_snapshot::verify (uint64 count) {
+        std::lock_guard<std::mutex> lock (Verifying);
+        uint64 end = Verified + std::min (count, Chunks - Verified);
+        while (Verified < end) {
+            if (!check_chunk (Verified)) return false;
+            Verified++;
+        }
+        
+        return true;
+    }
+    
+    maybe<output> utxo_snapshot::operator [] (const outpoint &o) const {
+        // the last chunk whose first outpoint is not after this one.
+        uint64 begin = 0;
+        uint64 end = Chunks;
+        while (begin < end) {
+            uint64 middle = begin + (end - begin) / 2;
+            const byte *r = chunk_record (middle);
+            outpoint first;
+            std::copy (r + 16, r + 48, first.Digest.begin ());
+            first.Index = boost::endian::load_little_u32 (r + 48);
+            if (compare (first, o) <= 0) begin = middle + 1;
+            else end = middle;
+        }
+        
+        if (begin == 0) return {};
+        maybe<bytes_view> b = chunk (begin - 1);
+        if (!bool (b)) return {};
+        
+        maybe<output> x;
+        decode_chunk (*b, [&] (const outpoint &p, bytes_view encoded) {
+            int c = compare (p, o);
+            if (c == 0) x = utxo_set::decode (encoded);
+            return c < 0;
+        });
+        
+        return x;
+    }
+    
+    bool utxo_snapshot::load (utxo_set &utxos, executor *e) {
+        if (!verify ()) return false;
+        
+        std::vector<std::vector<std::pair<outpoint, output>>> decoded (Chunks);
+        std::atomic<bool> good {true};
+        auto decode_chunks = [&] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                maybe<bytes_view> b = chunk (i);
+                if (!bool (b) || !decode_chunk (*b, [&] (const outpoint &p, bytes_view encoded) {
+                    decoded[i].emplace_back (p, utxo_set::decode (encoded));
+                    return true;
+                })) good = false;
+            }
+        };
+        
+        if (e == nullptr) decode_chunks (0, Chunks);
+        else e->bulk (Chunks, 1, decode_chunks);
+        
+        if (!good) return false;
+        for (const auto &outputs : decoded) for (const auto &[p, x] : outputs) utxos.insert (p, x);
+        return true;
+    }
+    
+}
@@ -0,0 +1,334 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::Bitcoin {
+    
+    namespace {
+        
+        // the smallest possible serialized input and output.
+        constexpr size_t min_input_size = 41;
+        constexpr size_t min_output_size = 9;
+        
+        // the size of the var_int at the front of b and its value, or 0 if it is incomplete.
+        size_t read_var_int (bytes_view b, uint64 &value) {
+            if (b.empty ()) return 0;
+            size_t size = b[0] < 0xfd ? 1 : b[0] == 0xfd ? 3 : b[0] == 0xfe ? 5 : 9;
+            if (b.size () < size) return 0;
+            
+            if (size == 1) value = b[0];
+            else {
+                value = 0;
+                for (size_t i = size - 1; i > 0; i--) value = (value << 8) | b[i];
+            }
+            
+            return size;
+        }
+        
+        // read the offsets from start of count parts of a transaction, each of 
+        // which has a script preceded by prefix bytes and followed by suffix bytes.
+        bool scan_parts (bytes_reader &r, const byte *start, const byte *end,
+            std::vector<uint32> &offsets, size_t min_size, size_t prefix, size_t suffix) {
+            var_int count;
+            r >> count;
+            
+            // don't let a bad count make us allocate too much.
+            if (count > static_cast<size_t> (end - r.Begin) / min_size) return false;
+            
+            offsets.resize (count + 1);
+            for (size_t i = 0; i < count; i++) {
+                offsets[i] = r.Begin - start;
+                var_int script_size;
+                r.skip (prefix);
+                r >> script_size;
+                r.skip (script_size);
+                r.skip (suffix);
+            }
+            
+            offsets[count] = r.Begin - start;
+            return true;
+        }
+        
+    }
+    
+    bool transaction_view::scan (bytes_reader &r, const byte *end) {
+        const byte *start = r.Begin;
+        try {
+            r.skip (4);
+            if (!scan_parts (r, start, end, Inputs, min_input_size, 36, 4) ||
+                !scan_parts (r, start, end, Outputs, min_output_size, 8, 0)) throw data::end_of_stream {};
+            r.skip (4);
+        } catch (data::end_of_stream) {
+            Inputs.clear ();
+            Outputs.clear ();
+            return false;
+        }
+        
+        Data = bytes_view {start, static_cast<size_t> (r.Begin - start)};
+        return true;
+    }
+    
+    transaction_view::transaction_view (bytes_view b) : transaction_view {} {
+        bytes_reader r {b.data (), b.data () + b.size ()};
+        if (!scan (r, b.data () + b.size ()) || Data.size () != b.size ()) *this = transaction_view {};
+    }
+    
+    transaction_view transaction_view::read (bytes_reader &r) {
+        transaction_view t {};
+        if (!t.scan (r, r.End)) return transaction_view {};
+        return t;
+    }
+    
+    int32_little transaction_view::version () const {
+        int32_little v;
+        std::copy (Data.begin (), Data.begin () + 4, v.data ());
+        return v;
+    }
+    
+    uint32_little transaction_view::locktime () const {
+        uint32_little l;
+        std::copy (Data.end () - 4, Data.end (), l.data ());
+        return l;
+    }
+    
+    input_view transaction_view::input (size_t i) const {
+        if (i >= input_count ()) throw std::invalid_argument {"input index out of range"};
+        return input_view {Data.substr (Inputs[i], Inputs[i + 1] - Inputs[i])};
+    }
+    
+    output_view transaction_view::output (size_t i) const {
+        if (i >= output_count ()) throw std::invalid_argument {"output index out of range"};
+        return output_view {Data.substr (Outputs[i], Outputs[i + 1] - Outputs[i])};
+    }
+    
+    txid transaction_view::id () const {
+        if (!bool (ID)) ID = Hash256 (Data);
+        return *ID;
+    }
+    
+    transaction_view::operator incomplete::transaction () const {
+        list<incomplete::input> in;
+        list<Bitcoin::output> out;
+        
+        for (size_t i = 0; i < input_count (); i++) {
+            input_view x = input (i);
+            in <<= incomplete::input {x.reference (), x.sequence ()};
+        }
+        
+        for (size_t i = 0; i < output_count (); i++) out <<= Bitcoin::output (output (i));
+        
+        return incomplete::transaction {version (), in, out, locktime ()};
+    }
+    
+    outpoint input_view::reference () const {
+        outpoint o;
+        bytes_reader r {Data.data (), Data.data () + Data.size ()};
+        r >> o;
+        return o;
+    }
+    
+    bytes_view input_view::script () const {
+        bytes_reader r {Data.data () + 36, Data.data () + Data.size ()};
+        var_int script_size;
+        r >> script_size;
+        return bytes_view {r.Begin, script_size};
+    }
+    
+    uint32_little input_view::sequence () const {
+        uint32_little s;
+        std::copy (Data.end () - 4, Data.end (), s.data ());
+        return s;
+    }
+    
+    block_view::block_view (bytes_view b) : block_view {} {
+        if (b.size () < 80) return;
+        
+        bytes_reader r {b.data () + 80, b.data () + b.size ()};
+        var_int count;
+        
+        try {
+            r >> count;
+        } catch (data::end_of_stream) {
+            return;
+        }
+        
+        // a transaction is at least 60 bytes.
+        if (count > (b.size () - 80) / 60) return;
+        
+        Transactions.resize (count);
+        for (transaction_view &tx : Transactions) if (!tx.scan (r, b.data () + b.size ())) {
+            Transactions.clear ();
+            return;
+        }
+        
+        if (r.Begin != b.data () + b.size ()) {
+            Transactions.clear ();
+            return;
+        }
+        
+        Data = b;
+    }
+    
+    Bitcoin::header block_view::header () const {
+        if (Data.size () < 80) return {};
+        return Bitcoin::header {slice<80> {const_cast<byte *> (Data.data ())}};
+    }
+    
+    digest256 block_view::merkle_root () const {
+        std::vector<digest256> ids;
+        ids.reserve (Transactions.size ());
+        for (const transaction_view &tx : Transactions) ids.push_back (tx.id ());
+        return Merkle::flat_tree {std::move (ids)}.root ();
+    }
+    
+    digest256 block_view::merkle_root (executor &e) const {
+        // each task hashes this many transactions.
+        constexpr size_t chunk = 256;
+        
+        std::vector<digest256> ids (Transactions.size ());
+        e.parallel_for ((Transactions.size () + chunk - 1) / chunk, [this, &ids] (size_t c) {
+            size_t end = std::min ((c + 1) * chunk, Transactions.size ());
+            for (size_t i = c * chunk; i < end; i++) ids[i] = Hash256 (Transactions[i].Data);
+        });
+        
+        return Merkle::flat_tree {std::move (ids), e}.root ();
+    }
+    
+    block_reader::block_reader (size_t max) : MaxPartSize {max}, Stage {stage::header}, Count {0}, Read {0},
+        Scanner {max}, Buffer {} {}
+    
+    bool block_reader::write (bytes_view b) {
+        if (Stage == stage::failed) return false;
+        
+        // if nothing is waiting, read straight from b and only keep what is left over.
+        bytes_view rest {};
+        if (Buffer.empty ()) rest = b.substr (consume (b));
+        else {
+            Buffer.insert (Buffer.end (), b.begin (), b.end ());
+            Buffer.erase (Buffer.begin (), Buffer.begin () + consume (Buffer));
+        }
+        
+        if (Stage == stage::failed) return false;
+        
+        Buffer.insert (Buffer.end (), rest.begin (), rest.end ());
+        
+        // nothing may come after the last transaction.
+        if ((Stage == stage::complete && !Buffer.empty ()) || Buffer.size () > MaxPartSize) {
+            Stage = stage::failed;
+            Buffer.clear ();
+            return false;
+        }
+        
+        return true;
+    }
+    
+    size_t block_reader::consume (bytes_view b) {
+        size_t read = 0;
+        while (Stage != stage::complete && Stage != stage::failed) {
+            size_t size = next (b.substr (read));
+            if (size == 0) break;
+            read += size;
+        }
+        
+        return read;
+    }
+    
+    size_t block_reader::next (bytes_view b) {
+        switch (Stage) {
+            case stage::header: {
+                if (b.size () < 80) return 0;
+                
+                size_t size = read_var_int (b.substr (80), Count);
+                if (size == 0) return 0;
+                
+                if (Count == 0) {
+                    Stage = stage::failed;
+                    return 0;
+                }
+                
+                Stage = stage::transactions;
+                receive_header (Bitcoin::header {slice<80> {const_cast<byte *> (b.data ())}}, Count);
+                return 80 + size;
+            }
+            
+            case stage::transactions: {
+                size_t size = Scanner.next (b);
+                if (size == 0) {
+                    if (Scanner.failed ()) Stage = stage::failed;
+                    return 0;
+                }
+                
+                receive_transaction (transaction_view {b.substr (0, size)});
+                
+                Scanner.reset ();
+                if (++Read == Count) Stage = stage::complete;
+                return size;
+            }
+            
+            default: return 0;
+        }
+    }
+    
+    size_t transaction_scanner::next (bytes_view b) {
+        if (Failed) return 0;
+        while (true) {
+            bytes_view rest = b.substr (Offset);
+            switch (Part) {
+                case part::version:
+                    if (rest.size () < 4) return 0;
+                    Offset += 4;
+                    Part = part::input_count;
+                    break;
+                    
+                case part::input_count:
+                case part::output_count: {
+                    size_t size = read_var_int (rest, Remaining);
+                    if (size == 0) return 0;
+                    
+                    size_t min_size = Part == part::input_count ? min_input_size : min_output_size;
+                    if (Remaining == 0 || Remaining > MaxSize / min_size) {
+                        Failed = true;
+                        return 0;
+                    }
+                    
+                    Offset += size;
+                    Part = Part == part::input_count ? part::inputs : part::outputs;
+                    break;
+                }
+                
+                case part::inputs:
+                case part::outputs: {
+                    size_t prefix = Part == part::inputs ? 36 : 8;
+                    size_t suffix = Part == part::inputs ? 4 : 0;
+                    if (rest.size () < prefix) return 0;
+                    
+                    uint64 script_size;
+                    size_t size = read_var_int (rest.substr (prefix), script_size);
+                    if (size == 0) return 0;
+                    
+                    if (script_size > MaxSize) {
+                        Failed = true;
+                        return 0;
+                    }
+                    
+                    if (rest.size () - prefix - size < script_size + suffix) return 0;
+                    
+                    Offset += prefix + size + script_size + suffix;
+                    if (--Remaining == 0) Part = Part == part::inputs ? part::output_count : part::locktime;
+                    break;
+                }
+                
+                default: {
+                    if (rest.size () < 4) return 0;
+                    return Offset + 4;
+                }
+            }
+        }
+    }
+    
+}
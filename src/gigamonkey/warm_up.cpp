@@ -0,0 +1,65 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/warm_up.hpp>
+#include <gigamonkey/secp256k1.hpp>
+#include <gigamonkey/sha256.hpp>
+#include <gigamonkey/hex.hpp>
+#include <gigamonkey/schema/random.hpp>
+#include <gigamonkey/script/machine.hpp>
+
+namespace Gigamonkey {
+    
+    std::chrono::nanoseconds warm_up_report::total () const {
+        std::chrono::nanoseconds x {0};
+        for (const auto &[name, time] : Components) x += time;
+        return x;
+    }
+    
+    warm_up_report::operator JSON () const {
+        JSON x = JSON::object ();
+        for (const auto &[name, time] : Components) x[name] = time.count ();
+        return x;
+    }
+    
+    warm_up_report warm_up () {
+        warm_up_report r {};
+        
+        auto time = [&r] (const char *name, auto f) {
+            auto start = std::chrono::steady_clock::now ();
+            f ();
+            r.Components.emplace_back (name, std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start));
+        };
+        
+        time ("secp256k1", [] () {
+            secp256k1::warm_contexts ();
+        });
+        
+        time ("random", [] () {
+            byte b;
+            bitcoind_random {}.get (&b, 1);
+        });
+        
+        time ("sha256", [] () {
+            byte block[64] {};
+            byte digest[32];
+            sha256::double_hash_64 (digest, block, 1);
+            sha256::hasher {}.Write (block, 64).Finalize (digest);
+        });
+        
+        time ("hex", [] () {
+            byte b[32] {};
+            char x[64];
+            hex::write (x, b, 32);
+        });
+        
+        time ("script", [] () {
+            // all of them are made at once.
+            Bitcoin::interpreter::machine::limits::get (0, true);
+            Bitcoin::ASM (bytes {});
+        });
+        
+        return r;
+    }
+    
+}
@@ -9,17 +9,16 @@ namespace Gigamonkey::Bitcoin {
     
     secret WIF::decode (string_view s) {
 
-        base58::check b58 (s);
-        if (!b58.valid ()) return Bitcoin::secret {};
+        byte_array<CompressedSize> data;
         Bitcoin::secret w {};
 
-        if (b58.size () == 33) {
-            w.Compressed = false;
-        } else if (b58.size () == 34) {
+        if (base58::fixed_check<CompressedSize>::decode (s, data.data ())) {
             w.Compressed = true;
+        } else if (base58::fixed_check<UncompressedSize>::decode (s, data.data ())) {
+            w.Compressed = false;
         } else return {};
 
-        bytes_reader r (b58.data (), b58.data () + b58.size ());
+        bytes_reader r (data.data (), data.data () + (w.Compressed ? CompressedSize : UncompressedSize));
         r >> (byte &) (w.Prefix);
         r.read (w.Secret.Value.data (), secp256k1::secret::Size);
         
@@ -35,13 +34,18 @@ namespace Gigamonkey::Bitcoin {
     
     WIF WIF::encode (byte prefix, const secp256k1::secret& s, bool compressed) {
 
-        bytes data (compressed ? CompressedSize - 1: UncompressedSize - 1);
-        bytes_writer w (data.begin (), data.end ());
-        w << bytes_view (s.Value);
-        if (compressed) w << CompressedSuffix;
+        byte_array<CompressedSize> data;
+        data[0] = prefix;
+        std::copy (s.Value.begin (), s.Value.end (), data.begin () + 1);
+        data[CompressedSize - 1] = CompressedSuffix;
+
+        char out[base58::fixed_check<CompressedSize>::MaxEncodedSize];
+        size_t size = compressed ?
+            base58::fixed_check<CompressedSize>::encode (data.data (), out) :
+            base58::fixed_check<UncompressedSize>::encode (data.data (), out);
 
         WIF wif;
-        static_cast<string &> (wif) = base58::check {prefix, data}.encode ();
+        static_cast<string &> (wif) = string (out, size);
         return wif;
 
     }
@@ -0,0 +1,93 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/backend.hpp>
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        struct registry {
+            std::mutex Mutex;
+            std::map<string, backend_factory> Factories;
+            
+            registry () : Mutex {}, Factories {} {
+                Factories["cpu"] = [] () -> ptr<backend> {
+                    return std::make_shared<cpu_backend> ();
+                };
+            }
+        };
+        
+        registry &get_registry () {
+            static registry r {};
+            return r;
+        }
+        
+        constexpr uint32 lanes = 64;
+        
+    }
+    
+    std::vector<uint32> cpu_backend::search (const sha256::state &midstate,
+        const byte_array<16> &tail, uint32 begin, uint32 count, const uint256 &target) {
+        
+        std::vector<uint32> candidates {};
+        byte tails[16 * lanes];
+        byte digests[32 * lanes];
+        
+        for (uint32 done = 0; done < count;) {
+            uint32 size = count - done < lanes ? count - done : lanes;
+            uint32 n = begin + done;
+            
+            for (uint32 i = 0; i < size; i++) {
+                std::copy (tail.begin (), tail.end (), tails + 16 * i);
+                nonce x {n + i};
+                std::copy (x.data (), x.data () + 4, tails + 16 * i + 12);
+            }
+            
+            sha256::double_hash_80 (digests, midstate, tails, size);
+            
+            for (uint32 i = 0; i < size; i++) {
+                uint256 hash;
+                std::copy (digests + 32 * i, digests + 32 * i + 32, hash.data ());
+                if (hash < target) candidates.push_back (n + i);
+            }
+            
+            done += size;
+        }
+        
+        return candidates;
+    }
+    
+    void register_backend (const string &name, backend_factory f) {
+        if (!f) throw std::invalid_argument {"backend factory must not be empty"};
+        registry &r = get_registry ();
+        std::lock_guard<std::mutex> lock (r.Mutex);
+        r.Factories[name] = f;
+    }
+    
+    ptr<backend> make_backend (const string &name) {
+        backend_factory f;
+        {
+            registry &r = get_registry ();
+            std::lock_guard<std::mutex> lock (r.Mutex);
+            auto x = r.Factories.find (name);
+            if (x == r.Factories.end ()) throw std::invalid_argument {"unknown backend " + name};
+            f = x->second;
+        }
+        
+        return f ();
+    }
+    
+    std::vector<string> backends () {
+        registry &r = get_registry ();
+        std::lock_guard<std::mutex> lock (r.Mutex);
+        std::vector<string> names;
+        for (const auto &x : r.Factories) names.push_back (x.first);
+        return names;
+    }
+    
+}
@@ -0,0 +1,181 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/calibrate.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        // a backend that is given a different number of nonces at once.
+        struct batched final : backend {
+            ptr<backend> Backend;
+            uint32 Batch;
+            
+            batched (ptr<backend> b, uint32 batch) : Backend {b}, Batch {batch} {}
+            
+            std::vector<uint32> search (const sha256::state &midstate,
+                const byte_array<16> &tail, uint32 begin, uint32 count, const uint256 &target) override {
+                return Backend->search (midstate, tail, begin, count, target);
+            }
+            
+            uint32 batch () const override {
+                return Batch;
+            }
+        };
+        
+        // identifies what a calibration was made for.
+        string cache_key (const std::vector<string> &names) {
+            string key = cpu_model ();
+            for (const string &name : names) key += "/" + name;
+            return key;
+        }
+        
+    }
+    
+    ptr<backend> calibration::make () const {
+        ptr<backend> b = make_backend (Backend);
+        if (Batch == 0 || b->batch () == Batch) return b;
+        return std::make_shared<batched> (b, Batch);
+    }
+    
+    calibration::operator JSON () const {
+        return JSON {
+            {"backend", Backend},
+            {"batch", Batch},
+            {"threads", Threads},
+            {"hashes_per_second", HashesPerSecond}};
+    }
+    
+    maybe<calibration> calibration::read (const JSON &j) {
+        if (!j.is_object () || !j.contains ("backend") || !j["backend"].is_string () ||
+            !j.contains ("batch") || !j["batch"].is_number_unsigned () ||
+            !j.contains ("threads") || !j["threads"].is_number_unsigned () ||
+            !j.contains ("hashes_per_second") || !j["hashes_per_second"].is_number ()) return {};
+        
+        calibration x {string (j["backend"]), uint32 (j["batch"]), uint32 (j["threads"]), double (j["hashes_per_second"])};
+        if (x.Batch == 0 || x.Threads == 0) return {};
+        return x;
+    }
+    
+    double trial (backend &b, uint32 batch, uint32 threads, double seconds) {
+        if (batch == 0 || threads == 0) return 0;
+        
+        // nothing is below a target of zero, so every nonce is hashed and none are returned.
+        byte_array<80> header {};
+        sha256::state midstate = sha256::initial ();
+        sha256::transform (midstate, header.data (), 1);
+        byte_array<16> tail {};
+        uint256 target {0};
+        
+        std::atomic<uint64> hashes {0};
+        auto start = std::chrono::steady_clock::now ();
+        auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration> (std::chrono::duration<double> {seconds});
+        
+        std::vector<std::thread> workers;
+        workers.reserve (threads);
+        for (uint32 i = 0; i < threads; i++) workers.emplace_back ([&, i] () {
+            uint32 n = i * (0xffffffff / threads);
+            uint64 done = 0;
+            do {
+                b.search (midstate, tail, n, batch, target);
+                n += batch;
+                done += batch;
+            } while (std::chrono::steady_clock::now () < end);
+            hashes += done;
+        });
+        
+        for (std::thread &w : workers) w.join ();
+        
+        double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+        return elapsed > 0 ? hashes.load () / elapsed : 0;
+    }
+    
+    calibration calibrate (const calibration_options &o) {
+        std::vector<string> names = o.Backends.empty () ? backends () : o.Backends;
+        
+        uint32 cores = std::max (std::thread::hardware_concurrency (), 1u);
+        uint32 max_threads = o.MaxThreads == 0 ? cores : o.MaxThreads;
+        std::vector<uint32> thread_counts {1};
+        if (max_threads / 2 > 1) thread_counts.push_back (max_threads / 2);
+        if (max_threads > 1) thread_counts.push_back (max_threads);
+        
+        std::vector<ptr<backend>> made;
+        std::vector<string> made_names;
+        for (const string &name : names) try {
+            made.push_back (make_backend (name));
+            made_names.push_back (name);
+        } catch (const std::exception &) {}
+        
+        size_t trials = made.size () * 3 * thread_counts.size ();
+        if (trials == 0) throw std::invalid_argument {"no backends to calibrate"};
+        double seconds = o.Seconds / trials;
+        
+        maybe<calibration> best;
+        for (size_t i = 0; i < made.size (); i++) {
+            // a backend's own batch size and larger ones, since a gpu may do better with more at once.
+            uint32 base = std::max (made[i]->batch (), 1u);
+            for (uint32 batch : {base, base * 4, base * 16}) for (uint32 threads : thread_counts) {
+                double rate;
+                try {
+                    rate = trial (*made[i], batch, threads, seconds);
+                } catch (const std::exception &) {
+                    continue;
+                }
+                
+                if (!best || rate > best->HashesPerSecond) best = calibration {made_names[i], batch, threads, rate};
+            }
+        }
+        
+        if (!best) throw std::invalid_argument {"no backend could be calibrated"};
+        return *best;
+    }
+    
+    calibration calibrate (const std::filesystem::path &cache, const calibration_options &o) {
+        std::vector<string> names = o.Backends.empty () ? backends () : o.Backends;
+        string key = cache_key (names);
+        
+        // the cache may have calibrations for other machines that share the file.
+        JSON cached = JSON::object ();
+        {
+            std::ifstream in {cache};
+            if (in) {
+                JSON j = JSON::parse (in, nullptr, false);
+                if (j.is_object ()) cached = j;
+            }
+        }
+        
+        if (cached.contains (key)) {
+            maybe<calibration> x = calibration::read (cached[key]);
+            if (x && std::find (names.begin (), names.end (), x->Backend) != names.end ()) return *x;
+        }
+        
+        calibration x = calibrate (o);
+        cached[key] = JSON (x);
+        
+        std::ofstream out {cache};
+        if (out) out << cached.dump (4) << std::endl;
+        return x;
+    }
+    
+    string cpu_model () {
+        std::ifstream info {"/proc/cpuinfo"};
+        string line;
+        while (std::getline (info, line)) if (line.rfind ("model name", 0) == 0) {
+            size_t colon = line.find (':');
+            if (colon == string::npos) break;
+            size_t begin = line.find_first_not_of (" \t", colon + 1);
+            return begin == string::npos ? string {"unknown"} : line.substr (begin);
+        }
+        
+        return "unknown";
+    }
+    
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/daa.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        exact::target limit (const daa::options &o) {
+            if (o.Interval == 0) throw std::invalid_argument {"retarget interval must not be zero"};
+            if (o.Window == 0) throw std::invalid_argument {"DAA window must not be zero"};
+            exact::target x = exact::expand (uint32 (static_cast<uint32_little> (o.Limit)));
+            if (exact::zero (x)) throw std::invalid_argument {"invalid target limit"};
+            return x;
+        }
+        
+        size_t capacity (const daa::options &o) {
+            // the retarget looks back Interval headers, the DAA looks back Window + 3
+            // and the emergency adjustment needs the median time 6 blocks ago.
+            return std::max<size_t> ({o.Interval, size_t (o.Window) + 3, 17}) + o.MaxRollback;
+        }
+        
+        exact::target number (uint64 x) {
+            return exact::target {x, 0, 0, 0};
+        }
+        
+        int64 clamp (int64 timespan, int64 min, int64 max) {
+            return timespan < min ? min : timespan > max ? max : timespan;
+        }
+        
+    }
+    
+    daa::daa (const options &o) : Options {o}, Limit {limit (o)}, Ring (capacity (o)), Oldest {0}, Next {0} {}
+    
+    void daa::push (const Bitcoin::header &h) {
+        uint32 bits = uint32 (static_cast<uint32_little> (h.Target));
+        chainwork w = work () + chainwork {h.Target};
+        Ring[Next % Ring.size ()] = entry {uint32 (h.Timestamp.Value), bits, w};
+        Next++;
+        if (Next - Oldest > Ring.size ()) Oldest++;
+    }
+    
+    bool daa::pop () {
+        // the oldest header that we remember is kept so that we know the total work.
+        if (Next == 0 || (Oldest > 0 && Next == Oldest + 1)) return false;
+        Next--;
+        return true;
+    }
+    
+    chainwork daa::work () const {
+        return Next == 0 ? chainwork {} : at (Next - 1).Work;
+    }
+    
+    uint32 daa::median_time_past (uint64 height) const {
+        uint32 times[11];
+        size_t count = 0;
+        for (uint64 i = height + 1; i > 0 && count < 11; i--) times[count++] = at (i - 1).Time;
+        std::sort (times, times + count);
+        return times[count / 2];
+    }
+    
+    uint64 daa::suitable (uint64 height) const {
+        // the same sorting network as the reference implementation, so that
+        // ties between equal times are broken in the same way.
+        uint64 blocks[3] {height - 2, height - 1, height};
+        if (at (blocks[0]).Time > at (blocks[2]).Time) std::swap (blocks[0], blocks[2]);
+        if (at (blocks[0]).Time > at (blocks[1]).Time) std::swap (blocks[0], blocks[1]);
+        if (at (blocks[1]).Time > at (blocks[2]).Time) std::swap (blocks[1], blocks[2]);
+        return blocks[1];
+    }
+    
+    uint32 daa::retarget (uint64 height) const {
+        const entry &last = at (height - 1);
+        int64 expected = int64 (Options.Interval) * Options.TargetSpacing;
+        int64 timespan = clamp (int64 (last.Time) - int64 (at (height - Options.Interval).Time), expected / 4, expected * 4);
+        
+        exact::target next = limbs::divide (limbs::multiply (exact::expand (last.Bits), number (timespan)), number (expected));
+        if (limbs::compare (next, Limit) > 0) next = Limit;
+        return exact::compress (next);
+    }
+    
+    uint32 daa::emergency (uint64 height) const {
+        uint32 bits = at (height - 1).Bits;
+        
+        // we can't go below the minimum difficulty.
+        if (bits == uint32 (static_cast<uint32_little> (Options.Limit)) || height < 7) return bits;
+        
+        // if the last 6 blocks took less than 12 hours, the target stays the same.
+        if (int64 (median_time_past (height - 1)) - int64 (median_time_past (height - 7)) < 12 * 3600) return bits;
+        
+        // otherwise it increases by a quarter.
+        exact::target next = exact::expand (bits);
+        limbs::add (next, limbs::shift_right (next, 2));
+        if (limbs::compare (next, Limit) > 0) next = Limit;
+        return exact::compress (next);
+    }
+    
+    uint32 daa::cash (uint64 height) const {
+        const entry &last = at (suitable (height - 1));
+        const entry &first = at (suitable (height - 1 - Options.Window));
+        
+        exact::target w = last.Work.Value;
+        limbs::subtract (w, first.Work.Value);
+        w = limbs::multiply (w, number (Options.TargetSpacing));
+        
+        int64 spacing = Options.TargetSpacing;
+        int64 timespan = clamp (int64 (last.Time) - int64 (first.Time), spacing * (Options.Window / 2), spacing * (Options.Window * 2));
+        w = limbs::divide (w, number (timespan));
+        if (exact::zero (w)) return uint32 (static_cast<uint32_little> (Options.Limit));
+        
+        // (2^256 - w) / w, which is the target at which each block has work w.
+        exact::target minus {};
+        limbs::subtract (minus, w);
+        exact::target next = limbs::divide (minus, w);
+        if (limbs::compare (next, Limit) > 0) next = Limit;
+        return exact::compress (next);
+    }
+    
+    maybe<compact> daa::expected_target (uint64 height) const {
+        if (height == 0) return Options.Limit;
+        if (height > Next || !has (height - 1)) return {};
+        
+        if (height - 1 >= Options.DAAHeight) {
+            if (height < Options.Window + 3 || !has (height - 3 - Options.Window)) return {};
+            return compact {cash (height)};
+        }
+        
+        if (height % Options.Interval == 0) {
+            if (height < Options.Interval || !has (height - Options.Interval)) return {};
+            return compact {retarget (height)};
+        }
+        
+        // before the fork the target only changes at a retarget.
+        if (height - 1 < Options.UAHFHeight) return compact {at (height - 1).Bits};
+        
+        if (height >= 7 && !has (height - 7 - std::min<uint64> (height - 7, 10))) return {};
+        return compact {emergency (height)};
+    }
+    
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/lease.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        // add n to a big-endian number, carrying across its full width.
+        bytes add (bytes x, uint64 n) {
+            uint64 carry = n;
+            for (auto i = x.rbegin (); i != x.rend () && carry != 0; i++) {
+                uint32 sum = uint32 (carry & 0xff) + *i;
+                *i = static_cast<byte> (sum & 0xff);
+                carry = (carry >> 8) + (sum >> 8);
+            }
+            
+            return x;
+        }
+        
+        // how many values of extra nonce 2 there are from x up to where it overflows.
+        uint64 remaining (const bytes &x) {
+            if (x.size () == 0) return 0;
+            
+            // beyond 8 bytes, there are more than we will ever lease.
+            size_t size = std::min (x.size (), size_t (8));
+            uint64 value = 0;
+            for (size_t i = x.size () - size; i < x.size (); i++) value = (value << 8) | x[i];
+            
+            if (size == 8) return std::numeric_limits<uint64>::max () - value;
+            return (uint64 (1) << (8 * size)) - value;
+        }
+        
+        // how far x is past initial, if it is not before it and the distance fits in 64 bits.
+        maybe<uint64> offset (const bytes &initial, const bytes &x) {
+            if (x.size () != initial.size ()) return {};
+            
+            bytes d (x.size ());
+            int borrow = 0;
+            for (size_t i = x.size (); i > 0; i--) {
+                int diff = int (x[i - 1]) - int (initial[i - 1]) - borrow;
+                borrow = diff < 0 ? 1 : 0;
+                d[i - 1] = static_cast<byte> (diff + 256 * borrow);
+            }
+            
+            if (borrow != 0) return {};
+            
+            uint64 value = 0;
+            for (size_t i = 0; i < d.size (); i++) {
+                if (d.size () - i > 8 && d[i] != 0) return {};
+                value = (value << 8) | d[i];
+            }
+            
+            return value;
+        }
+        
+    }
+    
+    lease_coordinator::lease_coordinator (evaluator &e, const options &o) :
+        Options {o}, Evaluator {e}, Mutex {}, Puzzle {}, Initial {},
+        Next {0}, Limit {0}, Returned {}, NextID {1}, Leases {} {
+        if (o.LeaseSize == 0) throw std::invalid_argument {"lease size must not be zero"};
+    }
+    
+    void lease_coordinator::pose (const puzzle &p, const solution &initial) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Puzzle = p;
+        Initial = initial;
+        Next = 0;
+        Limit = remaining (initial.Share.ExtraNonce2);
+        Returned.clear ();
+        Leases.clear ();
+    }
+    
+    void lease_coordinator::stop () {
+        std::lock_guard<std::mutex> lock (Mutex);
+        Puzzle = {};
+        Returned.clear ();
+        Leases.clear ();
+    }
+    
+    size_t lease_coordinator::expire_locked (double now) {
+        size_t expired = 0;
+        for (auto i = Leases.begin (); i != Leases.end ();)
+            if (now - i->second.Renewed > Options.TimeoutSeconds) {
+                Returned.push_back (i->second.Range);
+                i = Leases.erase (i);
+                expired++;
+            } else i++;
+        
+        return expired;
+    }
+    
+    size_t lease_coordinator::expire (double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return expire_locked (now);
+    }
+    
+    maybe<lease> lease_coordinator::acquire (const string &node, double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        if (!Puzzle) return {};
+        expire_locked (now);
+        
+        range r;
+        if (!Returned.empty ()) {
+            r = Returned.front ();
+            Returned.pop_front ();
+        } else {
+            if (Next == Limit) return {};
+            r = range {Next, std::min (Options.LeaseSize, Limit - Next)};
+            Next += r.Count;
+        }
+        
+        uint64 id = NextID++;
+        Leases[id] = held {node, r, now};
+        
+        solution initial = Initial;
+        initial.Share.ExtraNonce2 = add (Initial.Share.ExtraNonce2, r.Begin);
+        return lease {id, *Puzzle, initial, r.Count};
+    }
+    
+    bool lease_coordinator::renew (uint64 id, double now) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto i = Leases.find (id);
+        if (i == Leases.end ()) return false;
+        i->second.Renewed = now;
+        return true;
+    }
+    
+    void lease_coordinator::release (uint64 id, bool searched) {
+        std::lock_guard<std::mutex> lock (Mutex);
+        auto i = Leases.find (id);
+        if (i == Leases.end ()) return;
+        if (!searched) Returned.push_back (i->second.Range);
+        Leases.erase (i);
+    }
+    
+    bool lease_coordinator::submit (uint64 id, const solution &x) {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            if (!Puzzle) return false;
+            auto l = Leases.find (id);
+            if (l == Leases.end () || x.ExtraNonce1 != Initial.ExtraNonce1) return false;
+            
+            // the solution must be in the range that was leased.
+            const range &r = l->second.Range;
+            maybe<uint64> n = offset (Initial.Share.ExtraNonce2, x.Share.ExtraNonce2);
+            if (!n || *n < r.Begin || *n - r.Begin >= r.Count) return false;
+            
+            if (!proof {*Puzzle, x}.valid ()) return false;
+        }
+        
+        // not locked so that solved can pose the next puzzle.
+        Evaluator.solved (x);
+        return true;
+    }
+    
+    size_t lease_coordinator::leases () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        return Leases.size ();
+    }
+    
+    std::vector<string> lease_coordinator::nodes () const {
+        std::lock_guard<std::mutex> lock (Mutex);
+        std::vector<string> x;
+        for (const auto &[id, h] : Leases) if (std::find (x.begin (), x.end (), h.Node) == x.end ()) x.push_back (h.Node);
+        return x;
+    }
+    
+}
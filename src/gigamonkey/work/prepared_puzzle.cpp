@@ -0,0 +1,130 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/prepared_puzzle.hpp>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        void write_big (byte *p, uint32 x) {
+            p[0] = byte (x >> 24);
+            p[1] = byte (x >> 16);
+            p[2] = byte (x >> 8);
+            p[3] = byte (x);
+        }
+        
+        // pad and hash the last of a message whose first length - size bytes
+        // have already been transformed into s.
+        void finish (sha256::state &s, const byte *rest, size_t size, uint64 length) {
+            size_t blocks = (size + 9 + 63) / 64;
+            bytes last (blocks * 64);
+            std::copy (rest, rest + size, last.begin ());
+            last[size] = 0x80;
+            for (int i = 0; i < 8; i++) last[last.size () - 1 - i] = byte ((length * 8) >> (8 * i));
+            sha256::transform (s, last.data (), blocks);
+        }
+        
+        // SHA-256 of the SHA-256 whose state is s.
+        digest256 second (const sha256::state &s) {
+            byte first[32];
+            for (int i = 0; i < 8; i++) write_big (first + 4 * i, s[i]);
+            
+            sha256::state t = sha256::initial ();
+            finish (t, first, 32, 32);
+            
+            digest256 d;
+            for (int i = 0; i < 8; i++) write_big (d.data () + 4 * i, t[i]);
+            return d;
+        }
+        
+    }
+    
+    prepared_puzzle::prepared_puzzle (const puzzle &p) : prepared_puzzle {p, [&p] () {
+            sha256::state s = sha256::initial ();
+            sha256::transform (s, p.Header.data (), p.Header.size () / 64);
+            return s;
+        } ()} {}
+    
+    prepared_puzzle::prepared_puzzle (const puzzle &p, const sha256::state &midstate) : Puzzle {p}, Midstate {midstate},
+        Remainder {}, Prefix {p.Header.size () - p.Header.size () % 64}, Branch {}, Template {},
+        Target {exact::expand (static_cast<uint32_little> (p.Candidate.Target))} {
+        
+        Remainder = bytes (Puzzle.Header.size () - Prefix);
+        std::copy (Puzzle.Header.begin () + Prefix, Puzzle.Header.end (), Remainder.begin ());
+        
+        for (const digest256 &d : Puzzle.Candidate.Path.Digests) Branch.insert (Branch.end (), d.begin (), d.end ());
+        
+        std::fill (Template.begin (), Template.end (), 0);
+        const uint256 &previous = Puzzle.Candidate.Digest;
+        const compact &target = Puzzle.Candidate.Target;
+        std::copy (previous.begin (), previous.end (), Template.begin () + 4);
+        std::copy (target.begin (), target.end (), Template.begin () + 72);
+    }
+    
+    digest256 prepared_puzzle::coinbase (const solution &x) const {
+        const bytes &n2 = x.Share.ExtraNonce2;
+        bytes rest (Remainder.size () + 4 + n2.size () + Puzzle.Body.size ());
+        auto i = std::copy (Remainder.begin (), Remainder.end (), rest.begin ());
+        i = std::copy (x.ExtraNonce1.begin (), x.ExtraNonce1.end (), i);
+        i = std::copy (n2.begin (), n2.end (), i);
+        std::copy (Puzzle.Body.begin (), Puzzle.Body.end (), i);
+        
+        sha256::state s = Midstate;
+        finish (s, rest.data (), rest.size (), Prefix + rest.size ());
+        return second (s);
+    }
+    
+    digest256 prepared_puzzle::merkle_root (const solution &x) const {
+        digest256 d = coinbase (x);
+        uint32 index = Puzzle.Candidate.Path.Index;
+        
+        byte pair[64];
+        for (size_t i = 0; i < Branch.size (); i += 32, index >>= 1) {
+            const byte *other = Branch.data () + i;
+            if (index & 1) {
+                std::copy (other, other + 32, pair);
+                std::copy (d.begin (), d.end (), pair + 32);
+            } else {
+                std::copy (d.begin (), d.end (), pair);
+                std::copy (other, other + 32, pair + 32);
+            }
+            
+            sha256::double_hash_64 (d.data (), pair, 1);
+        }
+        
+        return d;
+    }
+    
+    work::string prepared_puzzle::string (const solution &x) const {
+        return work::string {
+            (Puzzle.Candidate.Category & Puzzle.Mask) | x.Share.general_purpose_bits (~Puzzle.Mask),
+            Puzzle.Candidate.Digest, merkle_root (x), x.Share.Timestamp, Puzzle.Candidate.Target, x.Share.Nonce};
+    }
+    
+    byte_array<80> prepared_puzzle::header (const solution &x) const {
+        byte_array<80> h = Template;
+        int32_little version = (Puzzle.Candidate.Category & Puzzle.Mask) | x.Share.general_purpose_bits (~Puzzle.Mask);
+        digest256 root = merkle_root (x);
+        std::copy (version.begin (), version.end (), h.begin ());
+        std::copy (root.begin (), root.end (), h.begin () + 36);
+        std::copy (x.Share.Timestamp.Value.begin (), x.Share.Timestamp.Value.end (), h.begin () + 68);
+        std::copy (x.Share.Nonce.begin (), x.Share.Nonce.end (), h.begin () + 76);
+        return h;
+    }
+    
+    uint256 prepared_puzzle::hash (const solution &x) const {
+        byte_array<80> h = header (x);
+        uint256 d;
+        sha256::double_hash_80 (d.data (), h.data (), 1);
+        return d;
+    }
+    
+    bool prepared_puzzle::valid (const solution &x) const {
+        byte_array<80> h = header (x);
+        byte d[32];
+        sha256::double_hash_80 (d, h.data (), 1);
+        return exact::below (d, Target);
+    }
+    
+}
@@ -0,0 +1,272 @@
+// Copyright (c) 2022 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/work/solver.hpp>
+#include <gigamonkey/sha256.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace Gigamonkey::work {
+    
+    namespace {
+        
+        // add n to a big-endian number, carrying across its full width.
+        // return false if the number overflows.
+        bool increment (bytes &x, uint32 n) {
+            uint64 carry = n;
+            for (auto i = x.rbegin (); i != x.rend () && carry != 0; i++) {
+                carry += *i;
+                *i = static_cast<byte> (carry & 0xff);
+                carry >>= 8;
+            }
+            return carry == 0;
+        }
+        
+        // the SHA-256 state after the first 64 bytes of the header,
+        // which do not depend on the nonce.
+        struct midstate {
+            sha256::state State;
+            byte_array<16> Tail;
+            
+            midstate (const byte_array<80> &header) : State {sha256::initial ()} {
+                sha256::transform (State, header.data (), 1);
+                std::copy (header.begin () + 64, header.end (), Tail.begin ());
+            }
+        };
+        
+        // Version rolling (BIP 320). The bits outside the puzzle's mask may be
+        // chosen by the miner. They are in the first 64 bytes of the header
+        // but not in the coinbase, so a new value costs one more compression
+        // for the midstate rather than a new merkle root. Versions are tried
+        // from the initial bits up; false when they wrap around, in which
+        // case the bits are put back to where they started.
+        bool roll (const puzzle &p, solution &x, int32_little first) {
+            int32_little rolled = ~p.Mask;
+            if (!bool (x.Share.Bits) || rolled == 0) return false;
+            
+            int32_little next = ((*x.Share.Bits | p.Mask) + 1) & rolled;
+            if (next == 0) {
+                x.Share.Bits = first;
+                return false;
+            }
+            
+            x.Share.Bits = next;
+            return true;
+        }
+        
+        // write the version for the bits in x into the header.
+        void write_version (const puzzle &p, const solution &x, byte_array<80> &header) {
+            int32_little version = (p.Candidate.Category & p.Mask) | x.Share.general_purpose_bits (~p.Mask);
+            std::copy (version.data (), version.data () + 4, header.begin ());
+        }
+        
+        int32_little bits (const solution &x) {
+            return bool (x.Share.Bits) ? *x.Share.Bits : int32_little {0};
+        }
+        
+        // whether nonce n really is below the target.
+        bool check (const midstate &m, uint32 n, const uint256 &target) {
+            byte tail[16];
+            std::copy (m.Tail.begin (), m.Tail.end (), tail);
+            nonce x {n};
+            std::copy (x.data (), x.data () + 4, tail + 12);
+            
+            uint256 hash;
+            sha256::double_hash_80 (hash.data (), m.State, tail, 1);
+            return hash < target;
+        }
+        
+        // Search nonces beginning with x. When the nonces are exhausted, the
+        // version bits are rolled, and when those are exhausted, extra nonce 2
+        // is increased by stride, for at most steps values of extra nonce 2.
+        // The epoch is checked after every batch and we give up as soon as
+        // it is no longer e. Each solution is given to found, which returns
+        // whether to keep going.
+        template <typename F>
+        void search (const puzzle &p, solution x, const uint256 &target, uint32 stride, uint64 steps,
+            backend &b, const std::atomic<uint64> &epoch, uint64 e, std::atomic<uint64> *hashes, F found) {
+            
+            int32_little first = bits (x);
+            uint64 batch = b.batch () == 0 ? 1 : b.batch ();
+            
+            while (epoch.load (std::memory_order_relaxed) == e) {
+                // the coinbase and merkle root are only worked out once for each extra nonce 2.
+                byte_array<80> header = proof {p, x}.string ().write ();
+                
+                do {
+                    midstate m {header};
+                    uint32 n = x.Share.Nonce;
+                    
+                    do {
+                        // a short batch at first if we do not start on a multiple of the batch size.
+                        uint32 count = uint32 (batch - n % batch);
+                        if (uint64 (n) + count > 0x100000000) count = uint32 (0x100000000 - n);
+                        
+                        std::vector<uint32> candidates = b.search (m.State, m.Tail, n, count, target);
+                        if (hashes != nullptr) hashes->fetch_add (count, std::memory_order_relaxed);
+                        std::sort (candidates.begin (), candidates.end ());
+                        for (uint32 c : candidates) {
+                            if (c - n >= count || !check (m, c, target)) continue;
+                            x.Share.Nonce = c;
+                            if (!found (x)) return;
+                        }
+                        
+                        n += count;
+                    } while (n != 0 && epoch.load (std::memory_order_relaxed) == e);
+                    
+                    if (n != 0) return;
+                    
+                    x.Share.Nonce = 0;
+                    if (!roll (p, x, first)) break;
+                    write_version (p, x, header);
+                } while (epoch.load (std::memory_order_relaxed) == e);
+                
+                if (--steps == 0 || !increment (x.Share.ExtraNonce2, stride)) return;
+            }
+        }
+        
+        // the first value of x for the worker with the given index.
+        bool start (const puzzle &p, solution &x, uint32 index) {
+            return p.Candidate.Target.expand () != 0 && x.Share.ExtraNonce2.size () != 0 && increment (x.Share.ExtraNonce2, index);
+        }
+        
+    }
+    
+    proof solve (const puzzle &p, const solution &initial, uint32 threads, ptr<backend> b) {
+        return solve (p, initial, std::numeric_limits<uint64>::max (), threads, b);
+    }
+    
+    proof solve (const puzzle &p, const solution &initial, uint64 extra_nonces, uint32 threads, ptr<backend> b) {
+        if (threads == 0) threads = 1;
+        if (b == nullptr) b = std::make_shared<cpu_backend> ();
+        
+        uint256 target = p.Candidate.Target.expand ();
+        std::atomic<uint64> epoch {0};
+        std::mutex mutex;
+        maybe<solution> found {};
+        
+        std::vector<std::thread> workers;
+        workers.reserve (threads);
+        for (uint32 i = 0; i < threads && i < extra_nonces; i++) workers.emplace_back (
+            [&p, &initial, &target, &b, &epoch, &mutex, &found, i, threads, extra_nonces] () {
+            solution x = initial;
+            if (!start (p, x, i)) return;
+            
+            // worker i takes values i, i + threads, ... of the range.
+            uint64 steps = (extra_nonces - i - 1) / threads + 1;
+            search (p, x, target, threads, steps, *b, epoch, 0, nullptr, [&epoch, &mutex, &found] (const solution &r) -> bool {
+                std::lock_guard<std::mutex> lock (mutex);
+                if (!bool (found)) found = r;
+                epoch = 1;
+                return false;
+            });
+        });
+        
+        for (std::thread &w : workers) w.join ();
+        
+        if (!bool (found)) return {};
+        return proof {p, *found};
+    }
+    
+    cpu_solver::cpu_solver (uint32 threads, const solution &initial, bool continuous, ptr<backend> b) :
+        Threads {threads == 0 ? 1 : threads}, Continuous {continuous},
+        Backend {b == nullptr ? std::make_shared<cpu_backend> () : b}, Mutex {}, Wake {}, Idle {},
+        Puzzle {}, Initial {initial}, Shutdown {false}, Busy {0}, Epoch {0}, Hashes {0}, Workers {} {
+        Workers.reserve (Threads);
+        for (uint32 i = 0; i < Threads; i++) Workers.emplace_back (&cpu_solver::work, this, i);
+    }
+    
+    cpu_solver::~cpu_solver () {
+        shutdown ();
+    }
+    
+    void cpu_solver::shutdown () {
+        {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Shutdown = true;
+            Puzzle = {};
+            Epoch++;
+        }
+        
+        Wake.notify_all ();
+        for (std::thread &w : Workers) if (w.joinable ()) w.join ();
+    }
+    
+    void cpu_solver::stop () {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Puzzle = {};
+        Epoch++;
+        
+        // a worker that calls stop from solved cannot wait for itself.
+        for (const std::thread &w : Workers) if (w.get_id () == std::this_thread::get_id ()) return;
+        
+        Idle.wait (lock, [this] () {
+            return Busy == 0;
+        });
+    }
+    
+    void cpu_solver::pose (const puzzle &p) {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Puzzle = p;
+        Epoch++;
+        lock.unlock ();
+        Wake.notify_all ();
+    }
+    
+    void cpu_solver::pose (const puzzle &p, const solution &initial) {
+        std::unique_lock<std::mutex> lock (Mutex);
+        Puzzle = p;
+        Initial = initial;
+        Epoch++;
+        lock.unlock ();
+        Wake.notify_all ();
+    }
+    
+    void cpu_solver::work (uint32 index) {
+        uint64 seen = 0;
+        std::unique_lock<std::mutex> lock (Mutex);
+        while (true) {
+            Wake.wait (lock, [this, &seen] () {
+                return Shutdown || (bool (Puzzle) && Epoch != seen);
+            });
+            
+            if (Shutdown) return;
+            
+            seen = Epoch;
+            puzzle p = *Puzzle;
+            solution x = Initial;
+            Busy++;
+            
+            lock.unlock ();
+            run (p, x, index, seen);
+            lock.lock ();
+            
+            if (--Busy == 0) Idle.notify_all ();
+        }
+    }
+    
+    void cpu_solver::run (const puzzle &p, solution x, uint32 index, uint64 e) {
+        if (!start (p, x, index)) return;
+        
+        search (p, x, p.Candidate.Target.expand (), Threads, std::numeric_limits<uint64>::max (), *Backend, Epoch, e, &Hashes, [this, e] (const solution &found) -> bool {
+            if (Continuous) {
+                if (Epoch.load (std::memory_order_relaxed) != e) return false;
+                this->solved (found);
+                return true;
+            }
+            
+            {
+                // the first worker to get here ends the search.
+                std::lock_guard<std::mutex> lock (Mutex);
+                if (Epoch != e) return false;
+                Puzzle = {};
+                Epoch++;
+            }
+            
+            this->solved (found);
+            return false;
+        });
+    }
+    
+}
@@ -5,6 +5,7 @@
 #include <sv/big_int.h>
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <iostream>
 #include <limits>
@@ -18,95 +19,58 @@ void bsv::bint::empty_bn_deleter::operator () (bignum_st* p) const {
     ::BN_free (p);
 }
 
-bsv::bint::bint () : value_ {nullptr} {}
+namespace {
+    // the magnitude of a 64-bit number, which always fits in 64 unsigned bits.
+    uint64_t magnitude (const int64_t i) {
+        return i < 0 ? uint64_t {0} - static_cast<uint64_t> (i) : static_cast<uint64_t> (i);
+    }
+}
 
-bsv::bint::bint (const int i) : value_ (BN_new (), empty_bn_deleter ()) {
-    // assert(value_);
-    if (!value_) throw big_int_error ();
+bsv::bint::unique_bn_ptr bsv::bint::make_bn (const int64_t i) {
+    unique_bn_ptr b {BN_new (), empty_bn_deleter ()};
+    // assert(b);
+    if (!b) throw big_int_error ();
 
-    if (i >= 0) {
-        const auto s {BN_set_word (value_.get (), i)};
-        // assert(s);
-        if (!s) throw big_int_error ();
-    } else if (i > INT_MIN) {
-        const auto s {BN_set_word (value_.get (), -i)};
-        // assert(s);
-        if (!s) throw big_int_error ();
-        BN_set_negative (value_.get (), 1);
-    } else {
-        const int ii {i + 1}; // add 1 to avoid overflow in negation
-        auto s {BN_set_word (value_.get (), -ii)};
-        // assert(s);
-        if (!s) throw big_int_error ();
+    const auto s {BN_set_word (b.get (), magnitude (i))};
+    // assert(s);
+    if (!s) throw big_int_error ();
+    if (i < 0) BN_set_negative (b.get (), 1);
 
-        BN_set_negative (value_.get (), 1);
+    return b;
+}
 
-        // subtract 1 to compensate for earlier addition
-        s = BN_sub (value_.get (), value_.get (), BN_value_one ());
-        // assert(s);
-        if (!s) throw big_int_error ();
-    }
+void bsv::bint::promote () {
+    if (is_small ()) value_ = make_bn (small_);
+}
 
-    // clang-format off
-    //assert( ((i < 0) && (is_negative(*this))) ||
-    //        ((i == 0) && (BN_is_zero(value_.get()))) ||
-    //        ((i > 0) && (!is_negative(*this))) );
-    // clang-format on
+const bignum_st *bsv::bint::bn (unique_bn_ptr &tmp) const {
+    if (!is_small ()) return value_.get ();
+    tmp = make_bn (small_);
+    return tmp.get ();
 }
 
-bsv::bint::bint (const int64_t i) : value_ (BN_new (), empty_bn_deleter ()) {
-    // assert(value_);
-    if (!value_) throw big_int_error ();
+bsv::bint::bint () : small_ {0}, value_ {nullptr} {}
 
-    if (i >= 0) {
-        const auto s {BN_set_word (value_.get (), i)};
-        // assert(s);
-        if (!s) throw big_int_error ();
-    } else if (i > INT64_MIN) {
-        const auto s {BN_set_word (value_.get(), -i)};
-        // assert(s);
-        if (!s) throw big_int_error ();
-        BN_set_negative (value_.get (), 1);
-    } else {
-        const int64_t ii {i + 1}; // add 1 to avoid overflow in negation
-        auto s {BN_set_word (value_.get (), -ii)};
-        // assert(s);
-        if (!s) throw big_int_error ();
+bsv::bint::bint (const int i) : small_ {i}, value_ {nullptr} {}
 
-        BN_set_negative (value_.get (), 1);
+bsv::bint::bint (const int64_t i) : small_ {i}, value_ {nullptr} {}
 
-        // subtract 1 to compensate for earlier addition
-        s = BN_sub (value_.get (), value_.get (), BN_value_one ());
-        // assert(s);
-        if (!s) throw big_int_error ();
+bsv::bint::bint (const size_t i) : small_ {0}, value_ {nullptr} {
+    if (i <= static_cast<size_t> (std::numeric_limits<int64_t>::max ())) {
+        small_ = static_cast<int64_t> (i);
+        return;
     }
 
-    // clang-format off
-    //assert( ((i < 0) && (is_negative(*this))) ||
-    //      ((i == 0) && (BN_is_zero(value_.get()))) ||
-    //      ((i > 0) && (!is_negative(*this))) );
-    // clang-format on
-}
-
-bsv::bint::bint (const size_t i) : value_ (BN_new (), empty_bn_deleter ()) {
-    assert (value_);
+    value_ = unique_bn_ptr {BN_new (), empty_bn_deleter ()};
+    // assert(value_);
     if (!value_) throw big_int_error ();
 
-    // Precondition: i > std::numeric_limits<size_t>::min()
-    // as negation is out-of-range of size_t
-    // assert(i >= std::numeric_limits<size_t>::min());
-    // assert(value_);
     const auto s {BN_set_word (value_.get (), i)};
     // assert(s);
     if (!s) throw big_int_error ();
-
-    // clang-format off
-    //assert( ((i == 0) && (BN_is_zero(value_.get())))  ||
-    //      ((i > 0) && (!is_negative(*this))) );
-    // clang-format on
 }
 
-bsv::bint::bint (const std::string &n) : value_ (BN_new (), empty_bn_deleter ()) {
+bsv::bint::bint (const std::string &n) : small_ {0}, value_ (BN_new (), empty_bn_deleter ()) {
     // assert(value_);
     if (!value_) throw big_int_error ();
 
@@ -116,8 +80,10 @@ bsv::bint::bint (const std::string &n) : value_ (BN_new (), empty_bn_deleter ())
     if (!s) throw big_int_error ();
 }
 
-bsv::bint::bint (const bint& other) : value_ (BN_new (), empty_bn_deleter ()) {
-    // assert(other.value_); // See Note 2 @ eof
+bsv::bint::bint (const bint& other) : small_ {other.small_}, value_ {nullptr} {
+    if (other.is_small ()) return;
+
+    value_ = unique_bn_ptr {BN_new (), empty_bn_deleter ()};
     // assert(value_);
     if (!value_) throw big_int_error ();
 
@@ -135,6 +101,7 @@ bsv::bint &bsv::bint::operator = (const bint &other) {
 void bsv::bint::swap (bint &other) noexcept {
     // assert(value_);
     using std::swap;
+    swap (small_, other.small_);
     swap (value_, other.value_);
 }
 
@@ -149,16 +116,32 @@ bool bsv::operator == (const bint &a, const bint &b) {
 
 // Arithmetic operators
 bsv::bint &bsv::bint::operator += (const bint &other) {
-    // assert(value_);
-    const auto s = BN_add (value_.get (), value_.get (), other.value_.get ());
+    // the result is only kept if it fits, since other may be *this.
+    int64_t x;
+    if (is_small () && other.is_small () && !__builtin_add_overflow (small_, other.small_, &x)) {
+        small_ = x;
+        return *this;
+    }
+
+    promote ();
+    unique_bn_ptr tmp;
+    const auto s = BN_add (value_.get (), value_.get (), other.bn (tmp));
     // assert(s);
     if (!s) throw big_int_error ();
     return *this;
 }
 
 bsv::bint& bsv::bint::operator -= (const bint &other) {
-    // assert(value_);
-    const auto s = BN_sub (value_.get (), value_.get (), other.value_.get ());
+    // the result is only kept if it fits, since other may be *this.
+    int64_t x;
+    if (is_small () && other.is_small () && !__builtin_sub_overflow (small_, other.small_, &x)) {
+        small_ = x;
+        return *this;
+    }
+
+    promote ();
+    unique_bn_ptr tmp;
+    const auto s = BN_sub (value_.get (), value_.get (), other.bn (tmp));
     // assert(s);
     if (!s) throw big_int_error ();
     return *this;
@@ -178,21 +161,40 @@ namespace {
 }
 
 bsv::bint &bsv::bint::operator *= (const bint &other) {
-    // assert(value_);
+    // the result is only kept if it fits, since other may be *this.
+    int64_t x;
+    if (is_small () && other.is_small () && !__builtin_mul_overflow (small_, other.small_, &x)) {
+        small_ = x;
+        return *this;
+    }
+
+    promote ();
+    unique_bn_ptr tmp;
     unique_ctx_ptr ctx {make_unique_ctx_ptr ()};
     const auto s {
-        BN_mul (value_.get (), value_.get (), other.value_.get (), ctx.get ())};
+        BN_mul (value_.get (), value_.get (), other.bn (tmp), ctx.get ())};
     // assert(s);
     if (!s) throw big_int_error ();
     return *this;
 }
 
+// Both BN_div and C++ round the quotient toward zero and give the remainder
+// the sign of the dividend, so small values are divided directly unless the
+// quotient would overflow.
 bsv::bint &bsv::bint::operator /= (const bint &other) {
-    // assert(value_);
-    bint rem;
+    if (is_small () && other.is_small ()) {
+        if (other.small_ == 0) throw big_int_error ();
+        if (small_ != std::numeric_limits<int64_t>::min () || other.small_ != -1) {
+            small_ /= other.small_;
+            return *this;
+        }
+    }
+
+    promote ();
+    unique_bn_ptr tmp;
     unique_ctx_ptr ctx {make_unique_ctx_ptr ()};
-    const auto s {BN_div (value_.get (), rem.value_.get (), value_.get (),
-                        other.value_.get (), ctx.get ())};
+    const auto s {BN_div (value_.get (), nullptr, value_.get (),
+                        other.bn (tmp), ctx.get ())};
     // assert(s);
     if (!s) throw big_int_error ();
 
@@ -200,11 +202,17 @@ bsv::bint &bsv::bint::operator /= (const bint &other) {
 }
 
 bsv::bint &bsv::bint::operator %= (const bint &other) {
-    // assert(value_);
-    bint rem;
+    if (is_small () && other.is_small ()) {
+        if (other.small_ == 0) throw big_int_error ();
+        small_ = other.small_ == -1 ? 0 : small_ % other.small_;
+        return *this;
+    }
+
+    promote ();
+    unique_bn_ptr tmp;
     unique_ctx_ptr ctx {make_unique_ctx_ptr ()};
     const auto s {
-        BN_mod (value_.get (), value_.get (), other.value_.get (), ctx.get ())};
+        BN_mod (value_.get (), value_.get (), other.bn (tmp), ctx.get ())};
     // assert(s);
     if (!s) throw big_int_error ();
     return *this;
@@ -225,6 +233,7 @@ bsv::bint &bsv::bint::operator &= (const bint &other) {
     auto bytes_other {other.to_bin ()};
     auto bytes_this {to_bin ()};
 
+    promote ();
     if (bytes_other.size () <= bytes_this.size ()) {
         transform (rbegin (bytes_other), rend (bytes_other), rbegin (bytes_this),
             rbegin (bytes_other), [] (auto byte_other, auto byte_this) {
@@ -259,6 +268,7 @@ bsv::bint &bsv::bint::operator |= (const bint &other) {
     auto bytes_other {other.to_bin ()};
     auto bytes_this {to_bin ()};
 
+    promote ();
     if (bytes_other.size () <= bytes_this.size ()) {
         transform (rbegin(bytes_other), rend (bytes_other), rbegin (bytes_this),
             rbegin (bytes_this), [] (auto byte_other, auto byte_this) {
@@ -278,9 +288,17 @@ bsv::bint &bsv::bint::operator |= (const bint &other) {
     return *this;
 }
 
+// Shifts act on the magnitude and keep the sign, as BN_lshift and BN_rshift do.
 bsv::bint &bsv::bint::operator <<= (const int n) {
     if (n <= 0) return *this;
 
+    int64_t x;
+    if (is_small () && (small_ == 0 || (n < 63 && !__builtin_mul_overflow (small_, int64_t {1} << n, &x)))) {
+        if (small_ != 0) small_ = x;
+        return *this;
+    }
+
+    promote ();
     const auto s {BN_lshift (value_.get (), value_.get (), n)};
     // assert(s);
     if (!s) throw big_int_error ();
@@ -290,6 +308,12 @@ bsv::bint &bsv::bint::operator <<= (const int n) {
 bsv::bint &bsv::bint::operator >>= (const int n) {
     if (n <= 0) return *this;
 
+    if (is_small ()) {
+        const uint64_t m {n < 64 ? magnitude (small_) >> n : 0};
+        small_ = small_ < 0 ? -static_cast<int64_t> (m) : static_cast<int64_t> (m);
+        return *this;
+    }
+
     const auto s {BN_rshift (value_.get (), value_.get (), n)};
     // assert(s);
     if (!s) throw big_int_error ();
@@ -303,6 +327,8 @@ bsv::bint bsv::bint::operator - () const {
 }
 
 uint8_t bsv::bint::lsb () const {
+    if (is_small ()) return static_cast<uint8_t> (magnitude (small_));
+
     const auto buffer {to_bin ()};
     if (buffer.empty ()) return 0;
 
@@ -311,30 +337,52 @@ uint8_t bsv::bint::lsb () const {
 
 // auto operator<=>(const bint&) in C++20
 int bsv::bint::spaceship_operator (const bint &other) const {
-    // assert(value_);
-    return BN_cmp (value_.get (), other.value_.get ());
+    if (is_small () && other.is_small ()) return small_ < other.small_ ? -1 : small_ > other.small_ ? 1 : 0;
+
+    unique_bn_ptr a;
+    unique_bn_ptr b;
+    return BN_cmp (bn (a), other.bn (b));
 }
 
 void bsv::bint::negate () {
+    if (is_small () && small_ != std::numeric_limits<int64_t>::min ()) {
+        small_ = -small_;
+        return;
+    }
+
+    promote ();
     const bool neg = is_negative (*this);
     if (neg) BN_set_negative (value_.get (), 0); // set +ve
     else BN_set_negative (value_.get (), 1); // set -ve
 }
 
 void bsv::bint::mask_bits (const int n) {
+    promote ();
     const auto s {BN_mask_bits (value_.get (), n)};
     // assert(s);
     if (!s) throw big_int_error ();
 }
 
-int bsv::bint::size_bits () const { return BN_num_bits (value_.get ()); }
+int bsv::bint::size_bits () const {
+    if (is_small ()) return 64 - std::countl_zero (magnitude (small_));
+    return BN_num_bits (value_.get ());
+}
 
-int bsv::bint::size_bytes () const { return BN_num_bytes (value_.get ()); }
+int bsv::bint::size_bytes () const {
+    if (is_small ()) return (size_bits () + 7) / 8;
+    return BN_num_bytes (value_.get ());
+}
 
 bsv::bint::buffer_type bsv::bint::to_bin () const {
     // assert(value_);
 
     buffer_type buffer (size_bytes ());
+    if (is_small ()) {
+        uint64_t m {magnitude (small_)};
+        for (auto i = buffer.rbegin (); i != buffer.rend (); i++, m >>= 8) *i = static_cast<unsigned char> (m);
+        return buffer;
+    }
+
     BN_bn2bin (value_.get (), buffer.data ());
     // const auto n{BN_bn2bin(value_.get(), buffer.data())};
     // assert(buffer.size() == static_cast<buffer_type::size_type>(n));
@@ -356,7 +404,7 @@ namespace {
 }
 
 std::ostream& bsv::operator << (std::ostream &os, const bint &n) {
-    if (n.value_ == nullptr) return os;
+    if (n.is_small ()) return os << n.small_;
 
     const auto s {to_str (n.value_.get ())};
     os << s.get ();
@@ -364,6 +412,8 @@ std::ostream& bsv::operator << (std::ostream &os, const bint &n) {
 }
 
 bool bsv::is_negative (const bint &n) {
+    if (n.is_small ()) return n.small_ < 0;
+
     const auto s {BN_is_negative (n.value_.get ())};
     return s == 1;
 }
@@ -399,6 +449,8 @@ long bsv::to_long (const bint &n) {
     // Linux/GCC (sizeof(long) == 8 bytes)
     // n <= numeric_limit<int64_t>::max() and n>=0
 
+    if (n.is_small ()) return static_cast<long> (n.small_);
+
     const auto asn1 {to_asn1 (n.value_.get ())};
     // assert(asn1);
     if (!asn1) throw big_int_error ();
@@ -426,7 +478,16 @@ namespace {
     constexpr auto length_in_bytes {4};
 }
 
+// little endian magnitude with the sign in the top bit of the last byte.
 std::vector<uint8_t> bsv::bint::serialize () const {
+    if (is_small ()) {
+        vector<uint8_t> result;
+        for (uint64_t m {magnitude (small_)}; m != 0; m >>= 8) result.push_back (static_cast<uint8_t> (m));
+        if (!result.empty () && (result.back () & 0x80)) result.push_back (0);
+        if (small_ < 0) result.back () |= 0x80;
+        return result;
+    }
+
     const auto len {BN_bn2mpi (value_.get (), nullptr)};
     // assert(len >= length_in_bytes);
     vector<unsigned char> result (len);
@@ -438,6 +499,18 @@ std::vector<uint8_t> bsv::bint::serialize () const {
 
 bsv::bint bsv::bint::deserialize (std::span<const uint8_t> s) {
     const auto size {s.size ()};
+
+    // with the sign bit taken away, 8 bytes always fit.
+    if (size <= 8) {
+        uint64_t m {0};
+        for (auto i = s.rbegin (); i != s.rend (); i++) m = (m << 8) | *i;
+        if (size == 0) return bint {0};
+
+        const uint64_t sign {uint64_t {0x80} << (8 * (size - 1))};
+        const int64_t x {static_cast<int64_t> (m & ~sign)};
+        return bint {(m & sign) ? -x : x};
+    }
+
     vector<uint8_t> tmp (size + length_in_bytes);
     tmp[0] = (size >> 24) & 0xff;
     tmp[1] = (size >> 16) & 0xff;
@@ -19,6 +19,7 @@
 
 #ifndef WIN32
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 
 #ifdef HAVE_SYS_GETRANDOM
@@ -454,6 +455,78 @@ bool Random_SanityCheck() {
     return true;
 }
 
+namespace {
+
+struct ThreadRandomContext {
+    ChaCha20 rng;
+    bool seeded = false;
+    uint64_t output = 0;
+#ifndef WIN32
+    pid_t pid = 0;
+#endif
+
+    bool NeedsSeed() const {
+#ifndef WIN32
+        if (seeded && getpid() != pid) return true;
+#endif
+        return !seeded || output >= THREAD_RAND_RESEED_BYTES;
+    }
+
+    void Seed() {
+        uint8_t seed[32];
+        GetStrongRandBytes(seed, 32);
+        rng.SetKey(seed, 32);
+        memory_cleanse(seed, 32);
+        seeded = true;
+        output = 0;
+#ifndef WIN32
+        pid = getpid();
+#endif
+    }
+
+    void Fill(uint8_t *buf, size_t num) {
+        if (NeedsSeed()) Seed();
+        if (num > 0) rng.Output(buf, num);
+        output += num;
+
+        // Fast key erasure.
+        uint8_t key[32];
+        rng.Output(key, 32);
+        rng.SetKey(key, 32);
+        memory_cleanse(key, 32);
+    }
+
+    ~ThreadRandomContext() {
+        uint8_t zero[32] = {0};
+        rng.SetKey(zero, 32);
+    }
+};
+
+ThreadRandomContext &ThreadRandom() {
+    thread_local ThreadRandomContext context;
+    return context;
+}
+
+} // namespace
+
+void GetThreadRandBytes(uint8_t *buf, size_t num) {
+    ThreadRandom().Fill(buf, num);
+}
+
+uint64_t GetThreadRand64() {
+    uint8_t buf[8];
+    GetThreadRandBytes(buf, 8);
+    uint64_t x = ReadLE64(buf);
+    memory_cleanse(buf, 8);
+    return x;
+}
+
+uint256 GetThreadRandHash() {
+    uint256 hash;
+    GetThreadRandBytes(hash.begin(), 32);
+    return hash;
+}
+
 FastRandomContext::FastRandomContext(bool fDeterministic)
     : requires_seed(!fDeterministic), bytebuf_size(0), bitbuf_size(0) {
     if (!fDeterministic) {
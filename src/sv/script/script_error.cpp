@@ -100,6 +100,8 @@ const char *ScriptErrorString(const ScriptError serror) {
             return "Signature must use SIGHASH_FORKID";
         case SCRIPT_ERR_BIG_INT:
             return "Big integer OpenSSL error";
+        case SCRIPT_ERR_BUDGET_EXCEEDED:
+            return "Script execution budget exceeded";
         case SCRIPT_ERR_UNKNOWN_ERROR:
         case SCRIPT_ERR_ERROR_COUNT:
         default:
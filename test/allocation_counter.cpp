@@ -0,0 +1,169 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "allocation_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace Gigamonkey::test {
+    
+    namespace {
+        
+        struct counts {
+            uint64 Allocations;
+            uint64 Deallocations;
+            uint64 Allocated;
+        };
+        
+        // constinit so that nothing has to be made the first time it is used in operator new.
+        thread_local constinit counts Counts {0, 0, 0};
+        
+        // nothing if there is no memory.
+        void *allocate (size_t size, size_t alignment) noexcept {
+            if (size == 0) size = 1;
+            void *x = alignment <= alignof (std::max_align_t) ? std::malloc (size) :
+                std::aligned_alloc (alignment, (size + alignment - 1) / alignment * alignment);
+            
+            if (x != nullptr) {
+                Counts.Allocations++;
+                Counts.Allocated += size;
+            }
+            
+            return x;
+        }
+        
+        // as operator new does when there is no memory, the new handler is called until there is.
+        void *allocate_or_throw (size_t size, size_t alignment) {
+            while (true) {
+                void *x = allocate (size, alignment);
+                if (x != nullptr) return x;
+                
+                std::new_handler h = std::get_new_handler ();
+                if (h == nullptr) throw std::bad_alloc {};
+                h ();
+            }
+        }
+        
+        void *allocate_or_null (size_t size, size_t alignment) noexcept {
+            try {
+                return allocate_or_throw (size, alignment);
+            } catch (const std::bad_alloc &) {
+                return nullptr;
+            }
+        }
+        
+        void deallocate (void *x) noexcept {
+            if (x == nullptr) return;
+            Counts.Deallocations++;
+            std::free (x);
+        }
+        
+    }
+    
+    allocation_counter::allocation_counter () :
+        Allocations {Counts.Allocations}, Deallocations {Counts.Deallocations}, Allocated {Counts.Allocated} {}
+    
+    uint64 allocation_counter::allocations () const {
+        return Counts.Allocations - Allocations;
+    }
+    
+    uint64 allocation_counter::deallocations () const {
+        return Counts.Deallocations - Deallocations;
+    }
+    
+    uint64 allocation_counter::allocated () const {
+        return Counts.Allocated - Allocated;
+    }
+    
+    void allocation_counter::reset () {
+        Allocations = Counts.Allocations;
+        Deallocations = Counts.Deallocations;
+        Allocated = Counts.Allocated;
+    }
+    
+}
+
+using Gigamonkey::test::allocate_or_throw;
+using Gigamonkey::test::allocate_or_null;
+using Gigamonkey::test::deallocate;
+
+void *operator new (size_t size) {
+    return allocate_or_throw (size, 0);
+}
+
+void *operator new[] (size_t size) {
+    return allocate_or_throw (size, 0);
+}
+
+void *operator new (size_t size, const std::nothrow_t &) noexcept {
+    return allocate_or_null (size, 0);
+}
+
+void *operator new[] (size_t size, const std::nothrow_t &) noexcept {
+    return allocate_or_null (size, 0);
+}
+
+void *operator new (size_t size, std::align_val_t a) {
+    return allocate_or_throw (size, size_t (a));
+}
+
+void *operator new[] (size_t size, std::align_val_t a) {
+    return allocate_or_throw (size, size_t (a));
+}
+
+void *operator new (size_t size, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return allocate_or_null (size, size_t (a));
+}
+
+void *operator new[] (size_t size, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return allocate_or_null (size, size_t (a));
+}
+
+void operator delete (void *x) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x) noexcept {
+    deallocate (x);
+}
+
+void operator delete (void *x, size_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x, size_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete (void *x, const std::nothrow_t &) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x, const std::nothrow_t &) noexcept {
+    deallocate (x);
+}
+
+void operator delete (void *x, std::align_val_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x, std::align_val_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete (void *x, size_t, std::align_val_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x, size_t, std::align_val_t) noexcept {
+    deallocate (x);
+}
+
+void operator delete (void *x, std::align_val_t, const std::nothrow_t &) noexcept {
+    deallocate (x);
+}
+
+void operator delete[] (void *x, std::align_val_t, const std::nothrow_t &) noexcept {
+    deallocate (x);
+}
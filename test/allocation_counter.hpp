@@ -0,0 +1,37 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_TEST_ALLOCATION_COUNTER
+#define GIGAMONKEY_TEST_ALLOCATION_COUNTER
+
+#include <gigamonkey/types.hpp>
+
+// Counts allocations made with the global operator new, so that code that
+// is supposed to allocate nothing can be held to it. A program only counts
+// anything if it is linked with allocation_counter.cpp, which replaces
+// operator new and delete. The library itself is never linked with it.
+namespace Gigamonkey::test {
+    
+    // Allocations made on this thread over the life of the counter. Counters
+    // may be nested, and each counts everything in its own scope.
+    struct allocation_counter {
+        allocation_counter ();
+        
+        uint64 allocations () const;
+        uint64 deallocations () const;
+        
+        // the bytes that were asked for.
+        uint64 allocated () const;
+        
+        // start again from zero.
+        void reset ();
+    
+    private:
+        uint64 Allocations;
+        uint64 Deallocations;
+        uint64 Allocated;
+    };
+    
+}
+
+#endif
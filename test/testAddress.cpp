@@ -12,6 +12,7 @@
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
 #include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
 #include <gigamonkey/script/typed_data_bip_276.hpp>
+#include <gigamonkey/schema/random.hpp>
 #include <data/crypto/NIST_DRBG.hpp>
 #include <data/encoding/hex.hpp>
 #include "gtest/gtest.h"
@@ -160,6 +161,164 @@ namespace Gigamonkey::Bitcoin {
         
     }
     
+    template <size_t size> void test_fixed_base58 (crypto::NIST::DRBG &random) {
+        for (int i = 0; i < 20; i++) {
+            byte_array<size> x;
+            random >> x;
+            
+            // check that leading zeros are written as ones.
+            for (int j = 0; j < i % 4; j++) x[j] = 0;
+            
+            string encoded = base58::fixed_check<size>::encode (x);
+            EXPECT_EQ (encoded, base58::check {bytes (bytes_view {x.data (), size})}.encode ());
+            
+            auto decoded = base58::fixed_check<size>::decode (encoded);
+            ASSERT_TRUE (bool (decoded));
+            EXPECT_EQ (*decoded, x);
+            
+            string broken = encoded;
+            broken[broken.size () / 2] = broken[broken.size () / 2] == 'z' ? 'y' : 'z';
+            EXPECT_FALSE (bool (base58::fixed_check<size>::decode (broken)));
+            EXPECT_FALSE (bool (base58::fixed_check<size>::decode (encoded + "1")));
+            EXPECT_FALSE (bool (base58::fixed_check<size>::decode (string {"1"} + encoded)));
+            EXPECT_FALSE (bool (base58::fixed_check<size>::decode (encoded.substr (1))));
+        }
+    }
+    
+    TEST(AddressTest, TestFixedBase58) {
+        
+        ptr<crypto::entropy> entropy = std::static_pointer_cast<crypto::entropy> (std::make_shared<crypto::fixed_entropy> (
+            bytes_view (bytes::from_string ("fixed width base 58 check entropy"))));
+        
+        crypto::NIST::DRBG random {crypto::NIST::DRBG::HMAC_DRBG, entropy, bytes {}, 305};
+        
+        test_fixed_base58<21> (random);
+        test_fixed_base58<33> (random);
+        test_fixed_base58<34> (random);
+        
+        EXPECT_FALSE (bool (base58::fixed_check<21>::decode ("")));
+        EXPECT_FALSE (bool (base58::fixed_check<21>::decode ("1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN0")));
+        
+        // a well known address.
+        auto satoshi = base58::fixed_check<21>::decode ("1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa");
+        ASSERT_TRUE (bool (satoshi));
+        EXPECT_EQ ((*satoshi)[0], 0);
+        EXPECT_EQ (base58::fixed_check<21>::encode (*satoshi), "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa");
+        
+        std::vector<byte_array<21>> batch {*satoshi, *satoshi};
+        std::vector<string> encoded = base58::fixed_check<21>::encode (batch);
+        EXPECT_EQ (encoded.size (), 2);
+        EXPECT_EQ (encoded[1], "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa");
+        
+        auto decoded = base58::fixed_check<21>::decode (std::vector<string_view> {encoded[0], "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNb"});
+        EXPECT_TRUE (bool (decoded[0]));
+        EXPECT_FALSE (bool (decoded[1]));
+        
+    }
+    
+    TEST(AddressTest, TestHash160Pubkeys) {
+        
+        // more than one batch, with some left over.
+        std::vector<pubkey> keys;
+        for (uint32 i = 1; i <= 70; i++) {
+            pubkey p = secret {secret::main, secp256k1::secret {uint256 {i * 7919}}}.to_public ();
+            keys.push_back (i % 10 == 0 ? p.decompress () : p.compress ());
+        }
+        
+        std::vector<digest160> digests (keys.size ());
+        Hash160_pubkeys (keys, digests);
+        for (size_t i = 0; i < keys.size (); i++) EXPECT_EQ (digests[i], Hash160 (keys[i])) << i;
+        
+        std::vector<byte> compressed;
+        for (const pubkey &p : keys) if (p.size () == secp256k1::pubkey::CompressedSize)
+            compressed.insert (compressed.end (), p.begin (), p.end ());
+        
+        std::vector<digest160> compressed_digests (compressed.size () / secp256k1::pubkey::CompressedSize);
+        Hash160_pubkeys (compressed, compressed_digests);
+        for (size_t i = 0, j = 0; i < keys.size (); i++) if (keys[i].size () == secp256k1::pubkey::CompressedSize)
+            EXPECT_EQ (compressed_digests[j++], Hash160 (keys[i]));
+        
+        EXPECT_THROW (Hash160_pubkeys (compressed, std::span<digest160> {digests.data (), 3}), std::invalid_argument);
+    }
+    
+    TEST (AddressTest, TestKeyBatch) {
+        bitcoind_random random;
+        executor pool {4};
+        
+        // more than one piece, so that the pieces are done on different threads.
+        key_batch::options independent;
+        independent.Net = secret::test;
+        key_batch a = key_batch::generate (random, 2500, independent, &pool);
+        ASSERT_EQ (a.size (), 2500u);
+        ASSERT_EQ (a.Pubkeys.size (), 2500u * secp256k1::pubkey::CompressedSize);
+        
+        key_batch::options consecutive;
+        consecutive.Compressed = false;
+        consecutive.Run = 300;
+        key_batch b = key_batch::generate (random, 2500, consecutive);
+        ASSERT_EQ (b.size (), 2500u);
+        
+        uint256 one {0};
+        *(one.end () - 1) = 1;
+        
+        for (size_t i : {0u, 1u, 1023u, 1024u, 2499u}) {
+            secret x = a.secret (i);
+            EXPECT_TRUE (x.valid ());
+            EXPECT_EQ (x.Prefix, secret::test);
+            EXPECT_EQ (a.pubkey (i), x.to_public ());
+            
+            secret y = b.secret (i);
+            EXPECT_FALSE (y.Compressed);
+            EXPECT_EQ (b.pubkey (i), y.to_public ());
+        }
+        
+        // within a run, each secret is the one before plus one.
+        for (size_t i : {1u, 299u, 1024u, 2499u}) EXPECT_EQ (b.secret (i).Secret, secp256k1::secret {secp256k1::secret::plus (b.secret (i - 1).Secret.Value, one)});
+        EXPECT_NE (b.secret (300).Secret, secp256k1::secret {secp256k1::secret::plus (b.secret (299).Secret.Value, one)});
+        
+        EXPECT_NE (a.secret (0), a.secret (1));
+    }
+    
+    TEST(AddressTest, TestAddressColumn) {
+        
+        std::vector<digest160> digests;
+        for (int i = 0; i < 23; i++) {
+            digest160 d;
+            for (int j = 0; j < 20; j++) d.Value[j] = byte (i * 31 + j);
+            digests.push_back (d);
+        }
+        
+        // leading zeros.
+        digests[3] = digest160 {};
+        
+        address_column column = address_column::encode (address::main, digests);
+        ASSERT_EQ (column.size (), digests.size ());
+        for (size_t i = 0; i < digests.size (); i++) EXPECT_EQ (column[i], string (address {address::main, digests[i]}));
+        
+        std::vector<address::decoded> decoded = column.decode ();
+        ASSERT_EQ (decoded.size (), digests.size ());
+        for (size_t i = 0; i < digests.size (); i++) {
+            EXPECT_EQ (decoded[i].Prefix, address::main);
+            EXPECT_EQ (decoded[i].Digest, digests[i]);
+        }
+        
+        std::vector<address::decoded> test_addresses {address::decoded {address::test, digests[0]}};
+        EXPECT_EQ (address_column::encode (test_addresses)[0], string (address {address::test, digests[0]}));
+        
+        bytes p2pkh = pay_to_address::script (digests[1]);
+        bytes other = pay_to_pubkey::script (secret {secret::main, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}}.to_public ());
+        address_column scripts = address_column::scripts (address::main, {bytes_view (p2pkh), bytes_view (other), bytes_view (p2pkh)});
+        ASSERT_EQ (scripts.size (), 3);
+        EXPECT_EQ (scripts[0], column[1]);
+        EXPECT_EQ (scripts[1], "");
+        EXPECT_EQ (scripts[2], column[1]);
+        
+        std::vector<address::decoded> from_scripts = scripts.decode ();
+        EXPECT_TRUE (from_scripts[0].valid ());
+        EXPECT_FALSE (from_scripts[1].valid ());
+        
+    }
+    
     TEST (ScriptTest, TestBIP276) {
         
         digest160 digest_one {"0x1111111111111111111111111111111111111111"};
@@ -179,6 +338,55 @@ namespace Gigamonkey::Bitcoin {
         EXPECT_EQ (recovered_one.Data, script_p2pkh_one);
         EXPECT_EQ (recovered_two.Data, script_p2pkh_two);
         
+        // the checksum is the usual one over everything before it.
+        string_view body {human_data_one.data (), human_data_one.size () - 8};
+        EXPECT_EQ (human_data_one.substr (human_data_one.size () - 8),
+            encoding::hex::write (Bitcoin::checksum (bytes::from_string (body)), hex_case::lower));
+        
+        std::vector<string> batch = typed_data::write (typed_data::testnet, std::vector<bytes> {script_p2pkh_one, script_p2pkh_two});
+        ASSERT_EQ (batch.size (), 2u);
+        EXPECT_EQ (batch[0], typed_data::write (typed_data::testnet, script_p2pkh_one));
+        EXPECT_EQ (batch[1], typed_data::write (typed_data::testnet, script_p2pkh_two));
+        
+        auto with_checksum = [] (const string &body, hex_case c) -> string {
+            return body + encoding::hex::write (Bitcoin::checksum (bytes::from_string (body)), c);
+        };
+        
+        string upper {body};
+        std::transform (upper.begin () + 15, upper.end (), upper.begin () + 15, [] (char c) -> char {
+            return c >= 'a' && c <= 'f' ? c - 'a' + 'A' : c;
+        });
+        upper = with_checksum (upper, hex_case::upper);
+        
+        // one letter in upper case and the rest in lower case.
+        string mixed {body};
+        auto letter = std::find_if (mixed.begin () + 15, mixed.end (), [] (char c) -> bool {
+            return c >= 'a' && c <= 'f';
+        });
+        ASSERT_NE (letter, mixed.end ());
+        *letter = *letter - 'a' + 'A';
+        mixed = with_checksum (mixed, hex_case::lower);
+        
+        string bad_checksum = human_data_one;
+        bad_checksum.back () = bad_checksum.back () == '0' ? '1' : '0';
+        
+        string no_prefix = human_data_one.substr (1);
+        
+        std::vector<typed_data> read = typed_data::read (std::vector<string_view> {
+            batch[0], batch[1], upper, mixed, bad_checksum, no_prefix, "bitcoin-script:"});
+        ASSERT_EQ (read.size (), 7u);
+        EXPECT_EQ (read[0].Data, script_p2pkh_one);
+        EXPECT_EQ (read[0].Network, typed_data::testnet);
+        EXPECT_EQ (read[1].Data, script_p2pkh_two);
+        EXPECT_EQ (read[2].Data, script_p2pkh_one);
+        for (int i = 3; i < 7; i++) EXPECT_FALSE (read[i].valid ());
+        
+        typed_data::network net;
+        bytes buffer;
+        EXPECT_TRUE (typed_data::read (human_data_two, net, buffer));
+        EXPECT_EQ (buffer, script_p2pkh_two);
+        EXPECT_EQ (net, typed_data::mainnet);
+        
     }
 
 }
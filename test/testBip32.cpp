@@ -4,6 +4,8 @@
 
 #include "gtest/gtest.h"
 #include <gigamonkey/schema/hd.hpp>
+#include <gigamonkey/schema/bip_44.hpp>
+#include <set>
 #include <gmock/gmock.h>
 
 
@@ -80,6 +82,54 @@ TEST(Bip32,PublicWrite) {
     ASSERT_EQ(expected.write(),"xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8");
 }
 
+TEST(Bip32,Serialize) {
+    string xpub="xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8";
+    string xprv="xprv9wTYmMFdV23N2TdNG573QoEsfRrWKQgWeibmLntzniatZvR9BmLnvSxqu53Kw1UmYPxLgboyZQaXwTCg8MSY3H2EU4pWcQDnRnrVA1xe8fs";
+    BIP_32::pubkey pubkey=BIP_32::pubkey::read(xpub);
+    BIP_32::secret secret=BIP_32::secret::read(xprv);
+    ASSERT_TRUE(pubkey.valid());
+    ASSERT_TRUE(secret.valid());
+
+    byte_array<BIP_32::serialized_size> p=pubkey.serialize();
+    byte_array<BIP_32::serialized_size> s=secret.serialize();
+    EXPECT_EQ(BIP_32::pubkey::deserialize(bytes_view{p.data(), p.size()}), pubkey);
+    EXPECT_EQ(BIP_32::secret::deserialize(bytes_view{s.data(), s.size()}), secret);
+    EXPECT_EQ(secret.write(), xprv);
+
+    char out[BIP_32::max_string_size];
+    EXPECT_EQ(string(out, pubkey.write(out)), xpub);
+    EXPECT_EQ(string(out, secret.write(out)), xprv);
+
+    // the wrong kind of key or the wrong size.
+    EXPECT_FALSE(BIP_32::pubkey::deserialize(bytes_view{s.data(), s.size()}).valid());
+    EXPECT_FALSE(BIP_32::secret::deserialize(bytes_view{p.data(), p.size()}).valid());
+    EXPECT_FALSE(BIP_32::pubkey::deserialize(bytes_view{p.data(), p.size() - 1}).valid());
+    EXPECT_FALSE(BIP_32::pubkey::read(xpub.substr(0, xpub.size() - 1) + "9").valid());
+
+    // a secret key must be preceded by a zero byte.
+    byte_array<BIP_32::serialized_size> bad=s;
+    bad[45]=0x01;
+    EXPECT_FALSE(BIP_32::secret::deserialize(bytes_view{bad.data(), bad.size()}).valid());
+
+    BIP_32::interned<BIP_32::pubkey> pubkeys{2};
+    ptr<const BIP_32::pubkey> a=pubkeys.read(xpub);
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(*a, pubkey);
+    EXPECT_EQ(pubkeys.read(xpub), a);
+    EXPECT_EQ(pubkeys.read(xprv), nullptr);
+    EXPECT_EQ(pubkeys.size(), 1u);
+
+    // the oldest is forgotten when there are more than Capacity.
+    pubkeys.read(BIP_32::derive(pubkey, 1).write());
+    pubkeys.read(BIP_32::derive(pubkey, 2).write());
+    EXPECT_EQ(pubkeys.size(), 2u);
+    EXPECT_NE(pubkeys.read(xpub), a);
+    EXPECT_EQ(*pubkeys.read(xpub), pubkey);
+
+    BIP_32::interned<BIP_32::secret> secrets{};
+    EXPECT_EQ(*secrets.read(xprv), secret);
+}
+
 TEST(Bip32,ToPublic) {
     std::vector<char> input=HexToBytes("000102030405060708090a0b0c0d0e0f");
 
@@ -93,4 +143,112 @@ TEST(Bip32,ToPublic) {
 
 }
 
+TEST(Bip32,CachedDerivation) {
+    BIP_32::secret secret=BIP_32::secret::read("xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi");
+    BIP_32::pubkey pubkey=secret.to_public();
+
+    // a small capacity so that keys are forgotten along the way.
+    BIP_32::derivation<BIP_32::secret> secrets{secret, 3};
+    BIP_32::derivation<BIP_32::pubkey> pubkeys{pubkey, 3};
+
+    list<string> paths{"44'/236'/0'/0/0", "44'/236'/0'/0/1", "44'/236'/0'/1/0", "44'/236'/1'/0/0", "0/1/2", "44'/236'/0'/0/2", "", "0"};
+    for (const string &p : paths) {
+        BIP_32::path path=BIP_32::read_path(p);
+        EXPECT_EQ(secrets.derive(path), BIP_32::derive(secret, path)) << p;
+        EXPECT_LE(secrets.size(), 3u);
+    }
+
+    for (const string &p : list<string>{"0/1/2", "0/1/3", "1/0", "0/1"}) {
+        BIP_32::path path=BIP_32::read_path(p);
+        EXPECT_EQ(pubkeys.derive(path), BIP_32::derive(pubkey, path)) << p;
+        EXPECT_EQ(pubkeys.derive(path), secrets.derive(path).to_public()) << p;
+    }
+
+    HD::key_source keys{secret};
+    HD::address_source addresses{pubkey};
+    for (uint32 i = 1; i < 5; i++) {
+        EXPECT_EQ(keys.first(), Bitcoin::secret(BIP_32::derive(secret, i)));
+        EXPECT_EQ(keys.next(), Bitcoin::secret(BIP_32::derive(secret, i)));
+        EXPECT_EQ(addresses.next(), BIP_32::derive(pubkey, i).address());
+    }
+}
+
+TEST(Bip32,DeriveRange) {
+    BIP_32::pubkey pubkey=BIP_32::pubkey::read("xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8");
+    executor e{4};
+
+    // more than one batch, starting and ending in the middle of one.
+    uint32 from=100;
+    uint32 count=600;
+    BIP_32::children serial=BIP_32::derive_range(pubkey, from, count);
+    BIP_32::children parallel=BIP_32::derive_range(pubkey, from, count, e);
+    ASSERT_EQ(serial.size(), count);
+    ASSERT_EQ(parallel.size(), count);
+    EXPECT_EQ(serial.Pubkeys, parallel.Pubkeys);
+
+    for (uint32 i = 0; i < count; i++) {
+        BIP_32::pubkey expected=BIP_32::derive(pubkey, from + i);
+        EXPECT_EQ(serial.key(i), expected.Pubkey);
+        EXPECT_EQ(serial.address(i), expected.address());
+        EXPECT_EQ(parallel.address(i), expected.address());
+    }
+
+    EXPECT_EQ(BIP_32::derive_range(pubkey, 0, 0, e).size(), 0u);
+    EXPECT_THROW(BIP_32::derive_range(pubkey, BIP_32::harden(0), 1), std::invalid_argument);
+    EXPECT_THROW(BIP_32::derive_range(pubkey, 0x7fffffff, 2, e), std::invalid_argument);
+}
+
+// answers on another thread, as a query to a server would.
+struct test_history final : BIP_44::address_history {
+    std::set<digest160> Used;
+
+    std::future<std::vector<bool>> used(std::span<const digest160> d) const override {
+        return std::async(std::launch::async, [this, d]() {
+            std::vector<bool> x;
+            for (const digest160 &a : d) x.push_back(Used.contains(a));
+            return x;
+        });
+    }
+};
+
+TEST(Bip32,DiscoverAccounts) {
+    BIP_32::secret root=BIP_32::secret::read("xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi");
+
+    BIP_44::discovery_options o{};
+    o.GapLimit=20;
+    o.Batch=8;
+    o.Accounts=2;
+
+    auto address = [&](uint32 account, uint32 chain, uint32 index) {
+        return BIP_32::derive(root, BIP_44::derivation_path(account, chain, index, o.CoinType)).to_public().address().Digest;
+    };
+
+    // 24 is within the gap limit after 5 but 50 is not after 24.
+    test_history history{};
+    for (uint32 i : {0, 5, 24, 50}) history.Used.insert(address(0, BIP_44::receive_index, i));
+    history.Used.insert(address(0, BIP_44::change_index, 2));
+    history.Used.insert(address(1, BIP_44::receive_index, 0));
+    history.Used.insert(address(2, BIP_44::change_index, 0));
+
+    executor e{4};
+    std::vector<BIP_44::account> found=BIP_44::discover(root, history, o, &e);
+
+    // account 2 has no used receive addresses, so discovery stops there.
+    ASSERT_EQ(found.size(), 2u);
+    EXPECT_EQ(found[0].Index, 0u);
+    EXPECT_EQ(found[0].Receive, (std::vector<uint32>{0, 5, 24}));
+    EXPECT_EQ(found[0].Change, (std::vector<uint32>{2}));
+    EXPECT_EQ(found[0].next_receive(), 25u);
+    EXPECT_EQ(found[1].Receive, (std::vector<uint32>{0}));
+    EXPECT_TRUE(found[1].Change.empty());
+    EXPECT_EQ(found[1].Pubkey, BIP_44::from_root(root, o.CoinType, 1).to_public());
+
+    BIP_44::account scanned=BIP_44::scan(0, found[0].Pubkey, history, o);
+    EXPECT_EQ(scanned.Receive, found[0].Receive);
+    EXPECT_EQ(scanned.Change, found[0].Change);
+
+    // nothing used at all.
+    EXPECT_TRUE(BIP_44::discover(root, test_history{}, o).empty());
+}
+
 }
@@ -87,6 +87,41 @@ TEST_P(Bip39Tests,CheckChecksum) {
     ASSERT_FALSE(Gigamonkey::HD::BIP_39::valid(words,std::get<0>(GetParam()))) << "Checksum should not valid on altered string";
 }
 
+TEST(Bip39,WordIndex) {
+    using namespace Gigamonkey::HD::BIP_39;
+    for (language lang : {english, japanese}) {
+        const Gigamonkey::cross<std::string>& list = words(lang);
+        ASSERT_EQ(list.size(), 2048);
+        for (uint32_t i = 0; i < list.size(); i++) ASSERT_EQ(word_index(list[i], lang), i) << list[i];
+        for (uint32_t i = 0; i < list.size(); i++) ASSERT_EQ(word_list(lang)[i], list[i]);
+    }
+
+    EXPECT_EQ(word_index("abandon"), 0);
+    EXPECT_EQ(word_index("zoo"), 2047);
+    EXPECT_FALSE(word_index("abandonment"));
+    EXPECT_FALSE(word_index(""));
+    EXPECT_FALSE(word_index("abandon", japanese));
+}
+
+TEST(Bip39,ReadMany) {
+    using namespace Gigamonkey::HD::BIP_39;
+    std::vector<std::string> mnemonics;
+    for (int i = 0; i < 10; i++) {
+        Gigamonkey::bytes ent(16);
+        for (int j = 0; j < 16; j++) ent[j] = i * 16 + j;
+        mnemonics.push_back(generate(ent));
+    }
+
+    // a long mnemonic is hashed before it is used as a key.
+    mnemonics.push_back(std::string(200, 'a'));
+
+    Gigamonkey::executor e{3};
+    std::vector<Gigamonkey::HD::seed> seeds = read(mnemonics, "TREZOR", e);
+    ASSERT_EQ(seeds.size(), mnemonics.size());
+    for (size_t i = 0; i < mnemonics.size(); i++) EXPECT_EQ(seeds[i], read(mnemonics[i], "TREZOR"));
+    EXPECT_NE(seeds[0], read(mnemonics[0], "trezor"));
+}
+
 INSTANTIATE_TEST_SUITE_P(Bip39,Bip39Tests,::testing::Values(
         /*std::make_tuple(
                 Gigamonkey::HD::BIP_39::language::japanese,
@@ -1,8 +1,11 @@
 #include <gigamonkey/boost/boost.hpp>
+#include <gigamonkey/boost/job_index.hpp>
+#include <gigamonkey/boost/validate.hpp>
 #include <gigamonkey/script/machine.hpp>
 #include <gigamonkey/address.hpp>
 #include <gigamonkey/wif.hpp>
 #include <gigamonkey/stratum/job.hpp>
+#include <gigamonkey/work/ASICBoost.hpp>
 
 #include "gtest/gtest.h"
 
@@ -973,4 +976,187 @@ namespace Gigamonkey::Boost {
         
     }
 
+    TEST (BoostTest, TestViews) {
+        
+        Bitcoin::secret key (Bitcoin::secret::main, secp256k1::secret (uint256 (12345)));
+        Bitcoin::pubkey pubkey = key.to_public ();
+        digest160 address = Bitcoin::Hash160 (pubkey);
+        Bitcoin::signature signature {bytes (71, 0x30)};
+        
+        uint256 content {};
+        content[3] = 0x21;
+        work::compact target {32, 0x008000};
+        bytes extra_nonce_2 (8, 0x07);
+        
+        // a one-byte tag is pushed with OP_5 and so is not in the script.
+        for (const bytes &tag : {bytes {}, bytes {0x05}, bytes (20, 0x41)}) for (bool gpb : {false, true}) {
+            for (const output_script &o : {
+                output_script::bounty (0x21e8, content, target, tag, 17, bytes (300, 0x11), gpb),
+                output_script::contract (0x21e8, content, target, tag, 17, bytes {}, address, gpb)}) {
+                
+                script x = o.write ();
+                output_view v {x};
+                
+                EXPECT_TRUE (v.valid ());
+                EXPECT_EQ (v.Type, o.Type);
+                EXPECT_EQ (v.UseGeneralPurposeBits, gpb);
+                EXPECT_EQ (bytes (v.Tag), tag);
+                EXPECT_EQ (v.content (), content);
+                EXPECT_EQ (v.target (), target);
+                EXPECT_EQ (v.magic_number (), work::ASICBoost::magic_number (0x21e8));
+                EXPECT_EQ (output_script (v), o);
+                EXPECT_EQ (output_script (v), output_script::read (x));
+                EXPECT_EQ (output_script::version (x), o.Category);
+                
+                // anything added or taken away and it is not a Boost script.
+                EXPECT_FALSE (output_view {bytes_view {x}.substr (0, x.size () - 1)}.valid ());
+                bytes longer (x.size () + 1);
+                std::copy (x.begin (), x.end (), longer.begin ());
+                longer[x.size ()] = OP_NOP;
+                EXPECT_FALSE (output_view {longer}.valid ());
+            }
+        }
+
+        for (const input_script &in : {
+            input_script::bounty (signature, pubkey, 9, Bitcoin::timestamp {1000}, extra_nonce_2, 353, address),
+            input_script::bounty (signature, pubkey, 9, Bitcoin::timestamp {1000}, bytes {0x03}, 353, 0x4000, address),
+            input_script::contract (signature, pubkey, 9, Bitcoin::timestamp {1000}, extra_nonce_2, 353),
+            input_script::contract (signature, pubkey, 9, Bitcoin::timestamp {1000}, extra_nonce_2, 353, 0x4000)}) {
+            
+            script x = in.write ();
+            input_view v {x};
+            
+            EXPECT_TRUE (v.valid ());
+            EXPECT_EQ (v.Type, in.Type);
+            EXPECT_EQ (v.nonce (), in.Nonce);
+            EXPECT_EQ (v.timestamp (), in.Timestamp);
+            EXPECT_EQ (v.general_purpose_bits (), in.GeneralPurposeBits);
+            EXPECT_EQ (input_script (v), in);
+            EXPECT_EQ (input_script (v), input_script::read (x));
+        }
+        
+        // extra nonce 2 must be 8 bytes without general purpose bits.
+        EXPECT_FALSE (input_view {input_script::contract (signature, pubkey, 9, Bitcoin::timestamp {1000}, bytes {0x03}, 353).write ()}.valid ());
+        EXPECT_FALSE (output_view {bytes {}}.valid ());
+        
+    }
+    
+
+    TEST (BoostTest, TestJobIndex) {
+        
+        uint256 content {};
+        content[0] = 0x01;
+        
+        // the same value at a lower difficulty is more profitable.
+        script easy = output_script::bounty (1, content, work::compact {work::difficulty {1}}, bytes {}, 1, bytes {}).write ();
+        script hard = output_script::bounty (1, content, work::compact {work::difficulty {4}}, bytes {}, 2, bytes {}).write ();
+        
+        auto outpoint = [] (byte n) -> Bitcoin::outpoint {
+            Bitcoin::txid id {};
+            id[0] = n;
+            return Bitcoin::outpoint {id, 0};
+        };
+        
+        job_index x {};
+        EXPECT_FALSE (x.best ());
+        EXPECT_FALSE (x.add (outpoint (9), Bitcoin::satoshi {1000}, bytes {OP_1}));
+        
+        EXPECT_TRUE (x.add (outpoint (1), Bitcoin::satoshi {1000}, hard));
+        EXPECT_FALSE (x.add (outpoint (1), Bitcoin::satoshi {1000}, hard));
+        EXPECT_TRUE (x.add (outpoint (2), Bitcoin::satoshi {2000}, easy));
+        EXPECT_EQ (x.size (), 2);
+        EXPECT_EQ (x.candidates (), 2);
+        EXPECT_EQ (x.best ()->Script, easy);
+        
+        // another output with the same script makes its candidate worth more.
+        EXPECT_TRUE (x.add (outpoint (3), Bitcoin::satoshi {8000}, hard));
+        EXPECT_EQ (x.candidates (), 2);
+        EXPECT_EQ (x.best ()->Script, hard);
+        EXPECT_EQ (int64 (x.best ()->value ()), 9000);
+        EXPECT_EQ (x.best ()->Prevouts.size (), 2);
+        
+        auto top = x.top (5);
+        EXPECT_EQ (top.size (), 2);
+        EXPECT_EQ (top[1].Script, easy);
+        
+        // redeeming it puts the other first again.
+        EXPECT_TRUE (x.remove (outpoint (3)));
+        EXPECT_FALSE (x.remove (outpoint (3)));
+        EXPECT_EQ (x.best ()->Script, easy);
+        EXPECT_EQ (x.best ()->Prevouts.size (), 1);
+        
+        EXPECT_TRUE (x.remove (outpoint (1)));
+        EXPECT_TRUE (x.remove (outpoint (2)));
+        EXPECT_EQ (x.size (), 0);
+        EXPECT_FALSE (x.best ());
+        
+    }
+
+    TEST (BoostTest, TestValidate) {
+        
+        Bitcoin::secret key (Bitcoin::secret::main, secp256k1::secret (uint256 (5555)));
+        Bitcoin::pubkey pubkey = key.to_public ();
+        digest160 address = Bitcoin::Hash160 (pubkey);
+        
+        uint256 content {};
+        content[7] = 0x99;
+        work::compact target {32, 0x0080ff};
+        bytes extra_nonce_2 (8, 0x02);
+        
+        std::vector<bytes> outputs;
+        std::vector<bytes> inputs;
+        std::vector<Bitcoin::sighash::document> documents;
+        
+        for (bool gpb : {false, true}) for (const output_script &o : {
+            output_script::bounty (0x21e8, content, target, bytes {}, 81, bytes (40, 0x11), gpb),
+            output_script::contract (0x21e8, content, target, bytes (8, 0x41), 82, bytes {}, address, gpb)}) {
+            
+            outputs.push_back (o.write ());
+            documents.push_back (Bitcoin::sighash::document {Bitcoin::satoshi {1000}, outputs.back (),
+                Bitcoin::incomplete::transaction {
+                    {Bitcoin::incomplete::input {Bitcoin::outpoint {Bitcoin::txid {}, uint32 (outputs.size ())}, 0xffffffff}},
+                    {Bitcoin::output {Bitcoin::satoshi {900}, outputs.back ()}}, 0}, 0});
+            
+            work::proof p = work::cpu_solve (work_puzzle (o, address), gpb ?
+                work::solution {work::share {Bitcoin::timestamp {1000}, 0, extra_nonce_2, 0x2000}, 353} :
+                work::solution {work::share {Bitcoin::timestamp {1000}, 0, extra_nonce_2}, 353});
+            EXPECT_TRUE (p.valid ());
+            
+            const work::share &x = p.Solution.Share;
+            Bitcoin::signature sig = key.sign (documents.back ());
+            inputs.push_back ((o.Type == bounty ?
+                (gpb ? input_script::bounty (sig, pubkey, x.Nonce, x.Timestamp, x.ExtraNonce2, p.Solution.ExtraNonce1, *x.Bits, address) :
+                    input_script::bounty (sig, pubkey, x.Nonce, x.Timestamp, x.ExtraNonce2, p.Solution.ExtraNonce1, address)) :
+                (gpb ? input_script::contract (sig, pubkey, x.Nonce, x.Timestamp, x.ExtraNonce2, p.Solution.ExtraNonce1, *x.Bits) :
+                    input_script::contract (sig, pubkey, x.Nonce, x.Timestamp, x.ExtraNonce2, p.Solution.ExtraNonce1))).write ());
+        }
+
+        std::vector<redemption> redemptions;
+        for (size_t i = 0; i < outputs.size (); i++) redemptions.push_back (redemption {outputs[i], inputs[i], &documents[i]});
+        
+        // the wrong document, the wrong output, and no document.
+        redemptions.push_back (redemption {outputs[0], inputs[0], &documents[1]});
+        redemptions.push_back (redemption {outputs[1], inputs[0], &documents[0]});
+        redemptions.push_back (redemption {outputs[2], inputs[2]});
+        redemptions.push_back (redemption {outputs[2], bytes {OP_1}});
+        
+        executor e {2};
+        for (const std::vector<validation> &results : {validate (redemptions), validate (redemptions, e)}) {
+            EXPECT_EQ (results.size (), redemptions.size ());
+            
+            for (size_t i = 0; i < outputs.size (); i++) {
+                EXPECT_TRUE (results[i].valid ());
+                EXPECT_EQ (results[i].Work, Boost::proof (output_script::read (outputs[i]), input_script::read (inputs[i])).valid ());
+            }
+            
+            EXPECT_TRUE (results[4].Work);
+            EXPECT_FALSE (*results[4].Signature);
+            EXPECT_FALSE (results[5].Decoded);
+            EXPECT_TRUE (results[6].valid ());
+            EXPECT_FALSE (bool (results[6].Signature));
+            EXPECT_FALSE (results[7].Decoded);
+        }
+        
+    }
+    
 }
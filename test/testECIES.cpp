@@ -22,9 +22,11 @@ namespace Gigamonkey::ECIES {
         bytes message_bytes(message.size());
         std::copy(message.begin(), message.end(), message_bytes.begin());
         
-        bytes encrypted_bytes = encrypt(message_bytes, bobKey.Secret.to_public());
+        // the test vector was made with a random ephemeral key, so we can only decrypt it.
+        EXPECT_EQ(decrypt(*encoding::hex::read(encrypted), bobKey.Secret), message_bytes);
         
-        EXPECT_EQ(encrypted, encoding::hex::write(message_bytes));
+        bytes encrypted_bytes = encrypt(message_bytes, bobKey.Secret.to_public());
+        EXPECT_NE(encoding::hex::write(encrypted_bytes), encrypted);
         
         bytes decrypted_bytes = decrypt(encrypted_bytes, bobKey.Secret);
         
@@ -42,16 +44,17 @@ namespace Gigamonkey::ECIES {
         Bitcoin::secret aliceKey{"L1Ejc5dAigm5XrM3mNptMEsNnHzS7s51YxU7J61ewGshZTKkbmzJ"};
         Bitcoin::secret bobKey{"KxfxrUXSMjJQcb3JgnaaA6MqsrKQ1nBSxvhuigdKRyFiEm6BZDgG"};
         
-        // bitcore
+        // electrum
         std::string message{"attack at dawn"};
         std::string encrypted{"QklFMQM55QTWSSsILaluEejwOXlrBs1IVcEB4kkqbxDz4Fap56+ajq0hzmnaQJXwUMZ/DUNgEx9i2TIhCA1mpBFIfxWZy+sH6H+sqqfX3sPHsGu0ug=="};
         
         bytes message_bytes(message.size());
         std::copy(message.begin(), message.end(), message_bytes.begin());
         
-        bytes encrypted_bytes = encrypt(message_bytes, bobKey.Secret.to_public());
+        EXPECT_EQ(decrypt(*encoding::base64::read(encrypted), bobKey.Secret), message_bytes);
         
-        EXPECT_EQ(encrypted, encoding::base64::write(message_bytes));
+        bytes encrypted_bytes = encrypt(message_bytes, bobKey.Secret.to_public());
+        EXPECT_NE(encoding::base64::write(encrypted_bytes), encrypted);
         
         bytes decrypted_bytes = decrypt(encrypted_bytes, bobKey.Secret);
         
@@ -63,5 +66,100 @@ namespace Gigamonkey::ECIES {
         
     }
 
-}
+    template <typename encryptor, typename decryptor>
+    void test_streaming(const Bitcoin::secret &key, size_t size, size_t chunk) {
+        bytes message(size);
+        for (size_t i = 0; i < size; i++) message[i] = byte(i * 13 + 7);
+        
+        lazy_bytes_writer encrypted;
+        encryptor e{encrypted, key.Secret.to_public()};
+        for (size_t i = 0; i < size; i += chunk) e.write(message.data() + i, std::min(chunk, size - i));
+        e.finish();
+        
+        bytes x = encrypted;
+        
+        lazy_bytes_writer decrypted;
+        decryptor d{decrypted, key.Secret};
+        for (size_t i = 0; i < x.size(); i += chunk) d.write(x.data() + i, std::min(chunk, x.size() - i));
+        EXPECT_TRUE(d.finish()) << size << " " << chunk;
+        EXPECT_EQ(bytes(decrypted), message) << size << " " << chunk;
+        
+        x[x.size() / 2] ^= 1;
+        lazy_bytes_writer tampered;
+        decryptor t{tampered, key.Secret};
+        t.write(x.data(), x.size());
+        EXPECT_FALSE(t.finish()) << size << " " << chunk;
+    }
 
+    TEST(ECIESTest, TestStreaming) {
+        Bitcoin::secret bobKey{"KxfxrUXSMjJQcb3JgnaaA6MqsrKQ1nBSxvhuigdKRyFiEm6BZDgG"};
+
+        bytes message = bytes::from_string("attack at dawn");
+        
+        // decrypt the test vectors one byte at a time.
+        bytes electrum_encrypted = *encoding::base64::read(
+            "QklFMQM55QTWSSsILaluEejwOXlrBs1IVcEB4kkqbxDz4Fap56+ajq0hzmnaQJXwUMZ/DUNgEx9i2TIhCA1mpBFIfxWZy+sH6H+sqqfX3sPHsGu0ug==");
+        lazy_bytes_writer electrum_decrypted;
+        electrum::decryptor electrum_decryptor{electrum_decrypted, bobKey.Secret};
+        for (byte b : electrum_encrypted) electrum_decryptor.write(&b, 1);
+        EXPECT_TRUE(electrum_decryptor.finish());
+        EXPECT_EQ(bytes(electrum_decrypted), message);
+        EXPECT_EQ(electrum::decrypt(electrum_encrypted, bobKey.Secret), message);
+        
+        bytes bitcore_encrypted = *encoding::hex::read(
+            "0339e504d6492b082da96e11e8f039796b06cd4855c101e2492a6f10f3e056a9e712c732611c6917ab5c57a1926973bc44a1586e94a783f81d05ce72518d9b0a80e2e13c7ff7d1306583f9cc7a48def5b37fbf2d5f294f128472a6e9c78dede5f5");
+        EXPECT_EQ(bitcore::decrypt(bitcore_encrypted, bobKey.Secret), message);
+        
+        for (size_t size : {0, 1, 15, 16, 17, 100, 10000})
+            for (size_t chunk : {1, 7, 16, 4096, 5000}) {
+                test_streaming<electrum::encryptor, electrum::decryptor>(bobKey, size, chunk);
+                test_streaming<bitcore::encryptor, bitcore::decryptor>(bobKey, size, chunk);
+            }
+        
+        // truncated messages are invalid.
+        bytes truncated = electrum_encrypted;
+        truncated.resize(truncated.size() - 1);
+        EXPECT_THROW(electrum::decrypt(truncated, bobKey.Secret), std::invalid_argument);
+    }
+
+    TEST(ECIESTest, TestEnvelope) {
+        std::vector<secp256k1::secret> keys(5);
+        std::vector<secp256k1::pubkey> to;
+        for (size_t i = 0; i < keys.size(); i++) {
+            keys[i].Value[31] = byte(i + 1);
+            keys[i].Value[0] = byte(i + 0x40);
+            if (i < 4) to.push_back(keys[i].to_public());
+        }
+        
+        bytes message(1000);
+        for (size_t i = 0; i < message.size(); i++) message[i] = byte(i * 13 + 7);
+        
+        bytes x = electrum::encrypt(message, to);
+        EXPECT_EQ(x.size(), 41 + 4 * 112 + 1008 + 32);
+        
+        // every recipient can decrypt it, however it is given.
+        for (size_t i = 0; i < 4; i++) {
+            EXPECT_EQ(electrum::decrypt_envelope(x, keys[i]), message);
+            for (size_t chunk : {1, 7, 112, 4096}) {
+                lazy_bytes_writer decrypted;
+                electrum::envelope_decryptor d{decrypted, keys[i]};
+                for (size_t j = 0; j < x.size(); j += chunk) d.write(x.data() + j, std::min(chunk, x.size() - j));
+                EXPECT_TRUE(d.finish()) << i << " " << chunk;
+                EXPECT_EQ(bytes(decrypted), message) << i << " " << chunk;
+            }
+        }
+        
+        // anyone else can't.
+        EXPECT_THROW(electrum::decrypt_envelope(x, keys[4]), std::invalid_argument);
+        
+        // a change to any part of it is noticed.
+        for (size_t at : {size_t(2), size_t(40), size_t(41 + 112 + 5), x.size() / 2, x.size() - 1}) {
+            bytes tampered = x;
+            tampered[at] ^= 1;
+            EXPECT_THROW(electrum::decrypt_envelope(tampered, keys[0]), std::invalid_argument) << at;
+        }
+        
+        EXPECT_THROW(electrum::encrypt(message, std::vector<secp256k1::pubkey>{}), std::invalid_argument);
+    }
+    
+}
@@ -2,6 +2,7 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/timechain.hpp>
+#include <gigamonkey/work/daa.hpp>
 #include "dot_cross.hpp"
 #include "gtest/gtest.h"
 #include <type_traits>
@@ -29,7 +30,7 @@ namespace Gigamonkey::work {
         
         return dot_cross(expect_equal, input, expected);
     }
-
+    
     // can result in stack smashing
     TEST(ExpandCompactTest, TestExpandCompact) {
         
@@ -56,7 +57,7 @@ namespace Gigamonkey::work {
                 std::string{"0x2000000000000000000000000000000000000000000000000000000000000000"}} <<
             test_case{SuccessSixteenth, 
                 std::string{"0x1000000000000000000000000000000000000000000000000000000000000000"}};
-                
+        
         EXPECT_TRUE(check(tests));
         
         // TODO
@@ -66,7 +67,162 @@ namespace Gigamonkey::work {
         
         EXPECT_EQ(a, b);*/
     }
-
+    
+    TEST(ExpandCompactTest, TestExact) {
+        
+        static_assert(exact::expand(0x1d00ffff) == exact::target{0, 0, 0, 0x00000000ffff0000});
+        static_assert(exact::compress(exact::expand(0x1d00ffff)) == 0x1d00ffff);
+        static_assert(exact::zero(exact::expand(0x20800000)));
+        
+        for (compact c : {compact{2, 0xabcd}, compact{3, 0xabcd}, compact{5, 0xabcd}, compact{32, 0x0080ff}, 
+            compact{33, 0xabcd}, SuccessHalf, SuccessSixteenth, compact{work::difficulty{1000}}}) {
+            EXPECT_EQ(exact::write(exact::expand(c)), c.expand());
+            EXPECT_EQ(compact{c.expand()}, compact{exact::compress(exact::expand(c))});
+            
+            uint256 below = c.expand() - 1;
+            uint256 above = c.expand();
+            EXPECT_TRUE(exact::below(below.data(), c));
+            EXPECT_FALSE(exact::below(above.data(), c));
+            EXPECT_EQ(exact::below(below.data(), c), below < c.expand());
+        }
+        
+        // a target with the top bit of its digits set needs another byte.
+        EXPECT_EQ(compact{uint256{"0x0000000000000000000000000000000000000000000000000000000000ab0000"}}, (compact{4, 0x00ab00}));
+        
+        EXPECT_EQ(compact{work::difficulty{1}}, (compact{29, 0x00ffff}));
+        EXPECT_EQ(compact{work::difficulty{1}}.difficulty(), work::difficulty{1});
+        EXPECT_EQ(compact{work::difficulty{0}}, compact::max());
+        
+    }
+    
+    TEST(ExpandCompactTest, TestChainwork) {
+        
+        // the work of the genesis block.
+        static_assert(exact::work(0x1d00ffff) == exact::target{0x100010001, 0, 0, 0});
+        static_assert(exact::work(exact::target{~0ull, ~0ull, ~0ull, ~0ull}) == exact::target{1, 0, 0, 0});
+        static_assert(exact::work(exact::target{~0ull, ~0ull, ~0ull, ~0ull >> 1}) == exact::target{2, 0, 0, 0});
+        static_assert(exact::zero(exact::work(exact::target{})));
+        static_assert(exact::zero(exact::work(0x20800000)));
+        
+        chainwork genesis{compact{0x1d00ffff}};
+        EXPECT_EQ(uint256(genesis), uint256{"0x0000000000000000000000000000000000000000000000000000000100010001"});
+        EXPECT_EQ(float64(genesis), 4295032833.);
+        
+        // work is exact where difficulty is not.
+        chainwork easy{compact{32, 0x0080ff}};
+        chainwork hard{compact{20, 0x00abcd}};
+        chainwork x = easy;
+        for (int i = 0; i < 1000; i++) x += easy;
+        x += hard;
+        
+        chainwork y = hard;
+        for (int i = 0; i < 1001; i++) y += easy;
+        EXPECT_EQ(x, y);
+        EXPECT_GT(x + easy, y);
+        EXPECT_LT(x, y + chainwork{exact::target{1, 0, 0, 0}});
+        EXPECT_GT(hard, easy);
+        
+        EXPECT_EQ(chainwork{compact{}}, chainwork{});
+        
+    }
+    
+    TEST(ExpandCompactTest, TestDAA) {
+        
+        daa::options o;
+        o.UAHFHeight = 20;
+        o.DAAHeight = 100;
+        o.Interval = 16;
+        o.Window = 8;
+        o.MaxRollback = 4;
+        daa d{o};
+        
+        // a few blocks of each kind of adjustment: the retarget every Interval blocks,
+        // the emergency adjustment when blocks are hours apart and then the DAA.
+        auto spacing = [](uint64 h) -> uint32 {
+            if (h <= 16 || (h > 30 && h <= 100)) return 600;
+            if (h <= 30) return 3 * 3600;
+            if (h <= 130) return 300;
+            return 6000;
+        };
+        
+        auto header = [](uint32 time, compact target) -> Bitcoin::header {
+            return Bitcoin::header{int32_little{1}, digest256{}, digest256{}, Bitcoin::timestamp{time}, target, uint32_little{0}};
+        };
+        
+        EXPECT_EQ(d.expected_target(0), o.Limit);
+        EXPECT_FALSE(d.pop());
+        
+        uint32 time = 1231006505;
+        std::vector<uint32> times{time};
+        std::vector<compact> targets{compact{0x1c0fffff}};
+        d.push(header(time, targets[0]));
+        
+        for (uint64 h = 1; h <= 150; h++) {
+            maybe<compact> t = d.expected_target(h);
+            ASSERT_TRUE(bool(t));
+            time += spacing(h);
+            Bitcoin::header next = header(time, *t);
+            EXPECT_TRUE(d.valid(next));
+            EXPECT_FALSE(d.valid(header(time, compact{0x1d00fffe})));
+            d.push(next);
+            times.push_back(time);
+            targets.push_back(*t);
+        }
+        
+        EXPECT_EQ(targets[15], compact{0x1c0fffff});
+        EXPECT_EQ(targets[16], compact{0x1c0effff});
+        EXPECT_EQ(targets[25], compact{0x1c0effff});
+        EXPECT_EQ(targets[26], compact{0x1c12bffe});
+        EXPECT_EQ(targets[32], compact{0x1d00e4e1});
+        EXPECT_EQ(targets[33], compact{0x1d00ffff});
+        EXPECT_EQ(targets[48], compact{0x1d00efff});
+        EXPECT_EQ(targets[101], compact{0x1d00cc21});
+        EXPECT_EQ(targets[120], compact{0x1c159634});
+        EXPECT_EQ(targets[150], compact{0x1c4301bd});
+        EXPECT_EQ(d.expected_target(151), compact{0x1c4c4111});
+        
+        // with the fork at height 26, the emergency adjustment starts one block later.
+        daa::options late = o;
+        late.UAHFHeight = 26;
+        daa e{late};
+        for (uint64 h = 0; h < 26; h++) e.push(header(times[h], targets[h]));
+        EXPECT_EQ(e.expected_target(26), targets[25]);
+        e.push(header(times[26], targets[25]));
+        EXPECT_EQ(e.expected_target(27), compact{0x1c12bffe});
+        
+        // targets of recent heights are remembered.
+        EXPECT_EQ(d.expected_target(145), targets[145]);
+        EXPECT_FALSE(bool(d.expected_target(152)));
+        EXPECT_FALSE(bool(d.expected_target(20)));
+        
+        chainwork total{};
+        for (const compact &t : targets) total += chainwork{t};
+        EXPECT_EQ(d.work(), total);
+        
+        // roll back and replace some headers.
+        for (int i = 0; i < 4; i++) EXPECT_TRUE(d.pop());
+        EXPECT_EQ(d.size(), 147u);
+        EXPECT_EQ(d.expected_target(147), targets[147]);
+        chainwork rolled_back{};
+        for (int i = 147; i <= 150; i++) rolled_back += chainwork{targets[i]};
+        EXPECT_EQ(d.work() + rolled_back, total);
+        
+        time -= 4 * spacing(150);
+        for (uint64 h = 147; h <= 150; h++) {
+            maybe<compact> t = d.expected_target(h);
+            ASSERT_TRUE(bool(t));
+            time += 600;
+            d.push(header(time, *t));
+        }
+        
+        EXPECT_EQ(d.size(), 151u);
+        EXPECT_NE(d.expected_target(151), compact{0x1c4c4111});
+        
+        // headers that are too old are forgotten.
+        while (d.pop()) {}
+        EXPECT_GT(d.size(), 0u);
+        EXPECT_FALSE(bool(d.expected_target(d.size())));
+        
+    }
+    
 }
-
-
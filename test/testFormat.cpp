@@ -6,6 +6,10 @@
 #include <gigamonkey/address.hpp>
 #include "gtest/gtest.h"
 #include <gigamonkey/wif.hpp>
+#include <gigamonkey/hex.hpp>
+#include <gigamonkey/base64.hpp>
+#include <gigamonkey/p2p/message.hpp>
+#include <gigamonkey/p2p/inventory.hpp>
 #include <boost/algorithm/string.hpp>
 
 namespace Gigamonkey::Bitcoin {
@@ -142,4 +146,196 @@ namespace Gigamonkey::Bitcoin {
         
     }
 
+    TEST (FormatTest, TestHex) {
+        // sizes that exercise the block kernels as well as the tail.
+        for (size_t size : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100}) {
+            bytes b (size);
+            for (size_t i = 0; i < size; i++) b[i] = byte (i * 37 + 11);
+            
+            string expected = encoding::hex::write (b, hex_case::lower);
+            string written = hex::write (b);
+            EXPECT_EQ (written, expected);
+            EXPECT_EQ (hex::read (written), maybe<bytes> {b});
+            
+            string upper = encoding::hex::write (b, hex_case::upper);
+            EXPECT_EQ (hex::read (upper), maybe<bytes> {b});
+            
+            if (size == 0) continue;
+            
+            string odd = written.substr (1);
+            EXPECT_FALSE (bool (hex::read (odd)));
+            
+            for (char c : {'g', 'G', '/', ':', '@', '`', ' ', char (0xb0)}) {
+                string invalid = written;
+                invalid[written.size () - 1] = c;
+                EXPECT_FALSE (bool (hex::read (invalid)));
+                invalid = written;
+                invalid[0] = c;
+                EXPECT_FALSE (bool (hex::read (invalid)));
+            }
+        }
+    }
+    
+    TEST (FormatTest, TestBase64) {
+        // sizes that exercise the block kernels as well as the tail.
+        for (size_t size : {0, 1, 2, 3, 23, 24, 27, 28, 47, 48, 49, 52, 100, 1000}) {
+            bytes b (size);
+            for (size_t i = 0; i < size; i++) b[i] = byte (i * 37 + 11);
+            
+            string expected = encoding::base64::write (b);
+            string written = base64::write (b);
+            EXPECT_EQ (written, expected);
+            EXPECT_EQ (base64::decoded_size (written), maybe<size_t> {size});
+            EXPECT_EQ (base64::read (written), maybe<bytes> {b});
+            
+            // without padding.
+            string unpadded = written.substr (0, written.find ('='));
+            EXPECT_EQ (base64::read (unpadded), maybe<bytes> {b});
+            
+            if (size == 0) continue;
+            
+            for (char c : {'-', '_', '.', '=', ' ', char (0xb0)}) {
+                string invalid = unpadded;
+                invalid[unpadded.size () - 1] = c;
+                EXPECT_FALSE (bool (base64::read (invalid)));
+                invalid = unpadded;
+                invalid[0] = c;
+                EXPECT_FALSE (bool (base64::read (invalid)));
+            }
+        }
+        
+        EXPECT_FALSE (bool (base64::read ("abcde")));
+    }
+    
+    TEST (FormatTest, TestP2PMessage) {
+        using namespace p2p;
+        
+        bytes verack = write (magic::main, command {"verack"}, bytes {});
+        EXPECT_EQ (verack, *encoding::hex::read ("e3e1f3e876657261636b000000000000000000005df6e0e2"));
+        
+        decoder d {magic::main};
+        message_view m;
+        EXPECT_EQ (d.read (segments {verack}, m), decoder::message);
+        EXPECT_EQ (m.Header.Command.view (), "verack");
+        EXPECT_EQ (m.Payload.size (), 0);
+        EXPECT_EQ (m.serialized_size (), verack.size ());
+        
+        EXPECT_EQ (d.read (segments {bytes_view {verack}.substr (0, 23)}, m), decoder::incomplete);
+        EXPECT_EQ (decoder {magic::test}.read (segments {verack}, m), decoder::wrong_magic);
+        
+        bytes payload {1, 2, 3, 4, 5, 6, 7, 8};
+        bytes ping = write (magic::main, command {"ping"}, payload);
+        EXPECT_EQ (ping.size (), 32);
+        
+        // as if the message wrapped around the end of a ring buffer anywhere.
+        for (size_t i = 0; i <= ping.size (); i++) {
+            bytes_view b {ping};
+            EXPECT_EQ (d.read (segments {b.substr (0, i), b.substr (i)}, m), decoder::message);
+            EXPECT_EQ (m.Header.Command, command {"ping"});
+            EXPECT_EQ (bytes (m.Payload), payload);
+            
+            // everything but the last byte.
+            size_t j = std::min (i, ping.size () - 1);
+            EXPECT_EQ (d.read (segments {b.substr (0, j), b.substr (j, ping.size () - 1 - j)}, m), decoder::incomplete);
+        }
+        
+        bytes bad_checksum = ping;
+        bad_checksum.back () ^= 1;
+        EXPECT_EQ (d.read (segments {bad_checksum}, m), decoder::invalid_checksum);
+        EXPECT_EQ (decoder (magic::main, 1 << 20, false).read (segments {bad_checksum}, m), decoder::message);
+        EXPECT_EQ (decoder (magic::main, 7).read (segments {ping}, m), decoder::too_big);
+        
+        bytes bad_command = ping;
+        bad_command[10] = 'x';
+        EXPECT_EQ (d.read (segments {bad_command}, m), decoder::invalid_command);
+        
+        std::vector<message_view> batch;
+        for (const bytes *b : {&verack, &ping, &bad_checksum, &ping}) {
+            message_view x;
+            decoder (magic::main, 1 << 20, false).read (segments {*b}, x);
+            batch.push_back (x);
+        }
+        
+        EXPECT_EQ (checksums_valid (batch), (std::vector<bool> {true, true, false, true}));
+        
+        // an extended header, which is only read as far as the header.
+        header big {uint32_little {magic::main}, command {"block"}, uint64 {1} << 32, Gigamonkey::checksum {0}};
+        bytes extended (header::extended_size);
+        big.write (extended.data ());
+        EXPECT_EQ (decoder (magic::main, uint64 {1} << 33).read (segments {extended}, m), decoder::incomplete);
+        EXPECT_EQ (m.Header, big);
+        EXPECT_EQ (d.read (segments {extended}, m), decoder::too_big);
+        
+        constexpr auto table = make_commands ("version", "verack", "ping");
+        static_assert (table.find (command {"ping"}) == 2);
+        static_assert (table.find (command {"pong"}) == 3);
+        
+        int called = -1;
+        EXPECT_TRUE (table.dispatch (batch[1],
+            [&called] (const message_view &) { called = 0; },
+            [&called] (const message_view &) { called = 1; },
+            [&called] (const message_view &) { called = 2; }));
+        EXPECT_EQ (called, 2);
+    }
+    
+    TEST (FormatTest, TestInventoryRelay) {
+        using namespace p2p;
+        
+        std::vector<inventory> inv {{inventory::transaction, digest256 {uint256 {1}}}, {inventory::block, digest256 {uint256 {2}}}};
+        bytes payload = inventory_payload (inv);
+        EXPECT_EQ (payload.size (), 73);
+        EXPECT_EQ (*read_inventory (segments {payload}), inv);
+        EXPECT_FALSE (bool (read_inventory (segments {bytes_view {payload}.substr (0, 72)})));
+        
+        rolling_bloom_filter filter {100, 0.001};
+        for (uint32 i = 0; i < 100; i++) filter.insert (digest256 {uint256 {i}});
+        for (uint32 i = 0; i < 100; i++) EXPECT_TRUE (filter.contains (digest256 {uint256 {i}}));
+        
+        // after many more entries, the first ones are forgotten.
+        for (uint32 i = 100; i < 1000; i++) filter.insert (digest256 {uint256 {i}});
+        int remembered = 0;
+        for (uint32 i = 0; i < 100; i++) if (filter.contains (digest256 {uint256 {i}})) remembered++;
+        EXPECT_LT (remembered, 5);
+        
+        relay r {relay::options {std::chrono::milliseconds {100}, 2}};
+        auto now = relay::clock::now ();
+        r.add_peer (1, now);
+        r.add_peer (2, now);
+        
+        std::vector<shared_transaction> txs;
+        for (uint32 i = 0; i < 3; i++) txs.push_back (shared_transaction {transaction {
+            list<input> {input {outpoint {txid {uint256 {i + 1}}, 0}, bytes {}}},
+            list<output> {output {satoshi {1000}, bytes {}}}}});
+        
+        for (const shared_transaction &t : txs) EXPECT_TRUE (r.broadcast (t, now));
+        EXPECT_FALSE (r.broadcast (txs[0], now));
+        EXPECT_EQ (r.cached (), 3);
+        
+        // peer 2 already has the first transaction.
+        std::vector<inventory> known {{inventory::transaction, txs[0].id ()}};
+        r.known (2, known);
+        
+        EXPECT_TRUE (r.flush (1, now - std::chrono::milliseconds {1}).empty ());
+        
+        auto later = now + std::chrono::hours {1};
+        std::vector<inventory> first = r.flush (1, later);
+        EXPECT_EQ (first.size (), 2);
+        EXPECT_GT (r.next (1), later);
+        EXPECT_EQ (r.flush (1, r.next (1)).size (), 1);
+        EXPECT_TRUE (r.flush (1, later + std::chrono::hours {1}).empty ());
+        
+        std::vector<inventory> second = r.flush (2, later);
+        EXPECT_EQ (second.size (), 2);
+        EXPECT_EQ (second[0].Hash, txs[1].id ());
+        
+        std::vector<inventory> request {{inventory::transaction, txs[2].id ()}, {inventory::transaction, digest256 {uint256 {7}}}};
+        relay::response response = r.get_data (request);
+        ASSERT_EQ (response.Transactions.size (), 1);
+        EXPECT_EQ (response.Transactions[0], txs[2]);
+        EXPECT_EQ (response.NotFound, std::vector<inventory> {request[1]});
+        
+        r.expire (now + std::chrono::hours {1});
+        EXPECT_EQ (r.cached (), 0);
+    }
+    
 }
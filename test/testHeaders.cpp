@@ -0,0 +1,214 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/spv.hpp>
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Gigamonkey::Bitcoin {
+    
+    header mine_header(const digest256 &previous, byte tag) {
+        header h{};
+        h.Version = 1;
+        h.Previous = previous;
+        h.MerkleRoot = Hash256(bytes{tag});
+        h.Timestamp = timestamp{uint32(1600000000 + tag)};
+        h.Target = target{uint32(0x207fffff)};
+        while (!h.valid()) h.Nonce = h.Nonce + 1;
+        return h;
+    }
+    
+    TEST(HeaderTest, TestHeadersMemory) {
+        headers::memory g{};
+        EXPECT_EQ(g.latest().Hash, genesis().Header.hash());
+        EXPECT_EQ(g.height(), 0);
+        
+        header root = mine_header(digest256{}, 0);
+        headers::memory m{root};
+        
+        // a chain of three.
+        header a1 = mine_header(root.hash(), 1);
+        header a2 = mine_header(a1.hash(), 2);
+        header a3 = mine_header(a2.hash(), 3);
+        
+        EXPECT_TRUE(m.insert(a1));
+        EXPECT_TRUE(m.insert(a2));
+        EXPECT_TRUE(m.insert(a3));
+        EXPECT_FALSE(m.insert(a3));
+        EXPECT_FALSE(m.insert(mine_header(digest256{}, 4)));
+        
+        EXPECT_EQ(m.height(), 3);
+        EXPECT_EQ(m.latest().Header, a3);
+        EXPECT_EQ(m[N(2)].Header, a2);
+        EXPECT_EQ(m[a1.hash()].Height, N(1));
+        EXPECT_FALSE(m[N(4)].valid());
+        
+        // a fork from a1 that becomes longer.
+        header b2 = mine_header(a1.hash(), 5);
+        header b3 = mine_header(b2.hash(), 6);
+        header b4 = mine_header(b3.hash(), 7);
+        
+        EXPECT_TRUE(m.insert(b2));
+        EXPECT_TRUE(m.insert(b3));
+        EXPECT_EQ(m.latest().Header, a3);
+        EXPECT_EQ(m.tips(), 2);
+        
+        EXPECT_TRUE(m.insert(b4));
+        EXPECT_EQ(m.latest().Header, b4);
+        EXPECT_EQ(m.height(), 4);
+        EXPECT_EQ(m[N(1)].Header, a1);
+        EXPECT_EQ(m[N(2)].Header, b2);
+        EXPECT_EQ(m[a3.hash()].Height, N(3));
+        EXPECT_EQ(m.size(), 7);
+        EXPECT_EQ(m.latest().Work, m[N(3)].Work + work::chainwork{b4.Target});
+        EXPECT_EQ(m[a3.hash()].Work, m[b3.hash()].Work);
+    }
+    
+    TEST(HeaderTest, TestHeadersSnapshots) {
+        header root = mine_header(digest256{}, 0);
+        headers::memory m{root};
+        
+        std::vector<headers::memory::update> updates;
+        uint64 subscription = m.subscribe([&updates](const headers::memory::update &u) {
+            updates.push_back(u);
+        });
+        
+        header a1 = mine_header(root.hash(), 1);
+        header a2 = mine_header(a1.hash(), 2);
+        header b2 = mine_header(a1.hash(), 3);
+        header b3 = mine_header(b2.hash(), 4);
+        
+        EXPECT_EQ(m.insert(std::vector<header>{a1, a2}), 2);
+        ASSERT_EQ(updates.size(), 1);
+        EXPECT_EQ(updates[0].Previous.Header, root);
+        EXPECT_EQ(updates[0].Tip.Header, a2);
+        EXPECT_FALSE(updates[0].reorg());
+        
+        auto before = m.current();
+        
+        // a header that does not change the best chain is not an update.
+        EXPECT_TRUE(m.insert(b2));
+        EXPECT_EQ(updates.size(), 1);
+        
+        EXPECT_TRUE(m.insert(b3));
+        ASSERT_EQ(updates.size(), 2);
+        EXPECT_TRUE(updates[1].reorg());
+        EXPECT_EQ(updates[1].Fork.Header, a1);
+        EXPECT_EQ(updates[1].Previous.Header, a2);
+        EXPECT_EQ(updates[1].Tip.Header, b3);
+        
+        // the snapshot from before is as it was.
+        EXPECT_EQ(before->latest().Header, a2);
+        EXPECT_EQ((*before)[N(2)].Header, a2);
+        EXPECT_FALSE((*before)[b2.hash()].valid());
+        EXPECT_EQ(before->size(), 3);
+        EXPECT_EQ(m[N(2)].Header, b2);
+        EXPECT_EQ(m[b2.hash()].Height, N(2));
+        
+        // enough headers that the best chain is in more than one piece and the table grows.
+        std::vector<header> chain{b3};
+        for (int i = 0; i < 3000; i++) chain.push_back(mine_header(chain.back().hash(), 10 + i));
+        EXPECT_EQ(m.insert(std::span<const header>{chain}.subspan(1)), 3000);
+        EXPECT_EQ(m.height(), 3003);
+        EXPECT_EQ(m[N(2500)].Header, chain[2497]);
+        EXPECT_EQ(m[chain[1234].hash()].Height, N(1237));
+        EXPECT_EQ(updates.size(), 3);
+        EXPECT_EQ(before->height(), 2);
+        
+        m.unsubscribe(subscription);
+        EXPECT_TRUE(m.insert(mine_header(chain.back().hash(), 5000)));
+        EXPECT_EQ(updates.size(), 3);
+    }
+    
+    TEST(HeaderTest, TestValidateChain) {
+        std::vector<header> chain{mine_header(digest256{}, 0)};
+        for (int i = 1; i < 40; i++) chain.push_back(mine_header(chain.back().hash(), i));
+        
+        executor e{4};
+        EXPECT_EQ(validate_chain(chain), chain.size());
+        EXPECT_EQ(validate_chain(chain, e), chain.size());
+        
+        std::vector<header> broken = chain;
+        broken[17] = mine_header(chain[15].hash(), 100);
+        EXPECT_EQ(validate_chain(broken), 17);
+        EXPECT_EQ(validate_chain(broken, e), 17);
+        
+        // find a nonce that does not work.
+        broken = chain;
+        while (broken[25].valid()) broken[25].Nonce = broken[25].Nonce + 1;
+        EXPECT_EQ(validate_chain(broken, e), 25);
+    }
+    
+    TEST(HeaderTest, TestHeadersFile) {
+        std::string path = (std::filesystem::temp_directory_path() / "gigamonkey_test_headers").string();
+        std::filesystem::remove(path);
+        
+        header root = mine_header(digest256{}, 0);
+        header a1 = mine_header(root.hash(), 1);
+        header a2 = mine_header(a1.hash(), 2);
+        header b2 = mine_header(a1.hash(), 3);
+        
+        {
+            headers::file f{path, root};
+            EXPECT_EQ(f.height(), 0);
+            EXPECT_TRUE(f.insert(a1));
+            EXPECT_TRUE(f.insert(a2));
+            EXPECT_FALSE(f.insert(b2));
+            EXPECT_EQ(f.height(), 2);
+        }
+        
+        {
+            headers::file f{path, root};
+            EXPECT_EQ(f.height(), 2);
+            EXPECT_EQ(f.latest().Header, a2);
+            EXPECT_EQ(f[N(1)].Header, a1);
+            EXPECT_EQ(f[a2.hash()].Height, N(2));
+            EXPECT_EQ(header{f.at(1)}, a1);
+            EXPECT_EQ(f.latest().Cumulative, root.Target.difficulty() + a1.Target.difficulty() + a2.Target.difficulty());
+            EXPECT_EQ(f.latest().Work, work::chainwork{root.Target} + work::chainwork{a1.Target} + work::chainwork{a2.Target});
+            
+            f.truncate(1);
+            EXPECT_FALSE(f[a2.hash()].valid());
+            EXPECT_TRUE(f.insert(b2));
+        }
+        
+        {
+            headers::file f{path, root};
+            EXPECT_EQ(f.latest().Header, b2);
+        }
+        
+        // a count that got ahead of the records is brought back down.
+        {
+            std::fstream x{path, std::ios::in | std::ios::out | std::ios::binary};
+            x.seekp(8);
+            char count[8] {5, 0, 0, 0, 0, 0, 0, 0};
+            x.write(count, 8);
+        }
+        
+        {
+            headers::file f{path, root};
+            EXPECT_EQ(f.height(), 2);
+            EXPECT_EQ(f.latest().Header, b2);
+        }
+        
+        // so is one that includes a record that is not whole.
+        {
+            std::fstream x{path, std::ios::in | std::ios::out | std::ios::binary};
+            x.seekg(16 + 2 * 152 + 80);
+            char c = char(x.get() ^ 1);
+            x.seekp(16 + 2 * 152 + 80);
+            x.put(c);
+        }
+        
+        {
+            headers::file f{path, root};
+            EXPECT_EQ(f.height(), 1);
+            EXPECT_TRUE(f.insert(a2));
+        }
+        
+        std::filesystem::remove(path);
+    }
+
+}
@@ -5,8 +5,22 @@
 #include <gigamonkey/merkle/dual.hpp>
 #include <gigamonkey/merkle/server.hpp>
 #include <gigamonkey/merkle/serialize.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+#include <gigamonkey/merkle/accumulator.hpp>
+#include <gigamonkey/merkle/bump.hpp>
+#include <gigamonkey/merkle/disk_tree.hpp>
+#include <gigamonkey/merkle/compact_dual.hpp>
+#include <gigamonkey/ledger.hpp>
+#include <gigamonkey/p2p/headers_sync.hpp>
+#include <gigamonkey/txid_index.hpp>
+#include <gigamonkey/spv_snapshot.hpp>
+#include <gigamonkey/sha256.hpp>
 #include "gtest/gtest.h"
 
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
 namespace Gigamonkey::Merkle {
     
     TEST(MerkleTest, TestMerkle) {
@@ -54,6 +68,36 @@ namespace Gigamonkey::Merkle {
             
             EXPECT_EQ(server(Tree), Server);
             
+            flat_tree Flat{l};
+            
+            EXPECT_TRUE(Flat.valid());
+            EXPECT_EQ(Flat.root(), Tree.root());
+            EXPECT_EQ(Flat.proofs(), tree_proofs);
+            EXPECT_EQ(tree(Flat), Tree);
+            EXPECT_EQ(server(Flat), Server);
+            EXPECT_EQ(dual(Flat), Dual);
+            
+            std::vector<digest256> queries{};
+            for (const digest256 &d : l) queries.push_back(d);
+            queries.push_back(fail);
+            
+            std::vector<proof> batch = Server[queries];
+            ASSERT_EQ(batch.size(), queries.size());
+            EXPECT_FALSE(batch.back().valid());
+            EXPECT_FALSE(bool(Server.find(fail)));
+            
+            std::vector<digest256> path_buffer(Server.Height - 1);
+            for (uint32 j = 0; j < l.size(); j++) {
+                EXPECT_TRUE(batch[j].valid());
+                EXPECT_EQ(batch[j], server(Tree)[queries[j]]);
+                EXPECT_EQ(*Server.find(queries[j]), j);
+                EXPECT_EQ(Server.write_path(j, path_buffer), path_buffer.size());
+                
+                digests written{};
+                for (auto d = path_buffer.rbegin(); d != path_buffer.rend(); d++) written = written << *d;
+                EXPECT_EQ(written, batch[j].Branch.Digests);
+            }
+            
             dual ReconstructedLeft{};
             
             for (const leaf& j : Dual.leaves()) {
@@ -100,6 +144,272 @@ namespace Gigamonkey::Merkle {
         }
     }
     
+    TEST(MerkleTest, TestHashPair) {
+        
+        // enough pairs to use every lane of every implementation and some left over.
+        std::vector<digest256> digests;
+        for (uint32 i = 0; i < 74; i++) digests.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        
+        std::vector<digest256> expected;
+        for (uint32 i = 0; i < 37; i++) {
+            expected.push_back(Bitcoin::Hash256(write(64, digests[2 * i], digests[2 * i + 1])));
+            EXPECT_EQ(hash_pair(digests[2 * i], digests[2 * i + 1]), expected[i]);
+        }
+        
+        std::vector<byte> in;
+        for (const digest256 &d : digests) in.insert(in.end(), d.begin(), d.end());
+        
+        for (auto x : {sha256::implementation::generic, sha256::implementation::avx2,
+            sha256::implementation::shani, sha256::implementation::avx512}) {
+            if (!sha256::supported(x)) continue;
+            
+            std::vector<byte> out(32 * 37);
+            sha256::double_hash_64(out.data(), in.data(), 37, x);
+            for (uint32 i = 0; i < 37; i++)
+                EXPECT_TRUE(std::equal(out.begin() + 32 * i, out.begin() + 32 * (i + 1), expected[i].begin())) << sha256::name(x);
+        }
+    }
+    
+    TEST(MerkleTest, TestFlatTree) {
+        EXPECT_FALSE(flat_tree{}.valid());
+        
+        executor pool{4};
+        
+        // big enough that the lower levels are split between threads. 
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 20001; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        
+        flat_tree one_thread{leaves};
+        flat_tree many_threads{leaves, pool};
+        
+        EXPECT_EQ(one_thread, many_threads);
+        EXPECT_EQ(one_thread.level(0).size(), leaves.size());
+        EXPECT_EQ(one_thread.level(one_thread.Height - 1).size(), 1u);
+        
+        leaf_digests l;
+        for (const digest256 &d : leaves) l = l << d;
+        EXPECT_EQ(one_thread.root(), root(l));
+        
+        for (uint32 i : {0u, 1u, 4095u, 8192u, 19999u, 20000u}) {
+            proof p = many_threads[i];
+            EXPECT_TRUE(p.valid());
+            EXPECT_EQ(p.index(), i);
+            EXPECT_EQ(p.Branch.Leaf.Digest, leaves[i]);
+        }
+        
+        EXPECT_FALSE(many_threads[20001].valid());
+    }
+    
+    TEST(MerkleTest, TestValidInParallel) {
+        executor pool{4};
+        
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 20001; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree flat{leaves};
+        
+        tree t(flat);
+        EXPECT_TRUE(t.valid());
+        EXPECT_TRUE(t.valid(pool));
+        EXPECT_FALSE(tree{}.valid(pool));
+        
+        // neighbors share most of their paths.
+        map m;
+        for (uint32 i : {0u, 1u, 2u, 3u, 4095u, 4096u, 8192u, 19999u, 20000u}) m = m.insert(entry(flat[i].Branch));
+        dual d{m, flat.root()};
+        EXPECT_TRUE(d.valid());
+        EXPECT_TRUE(d.valid(pool));
+        EXPECT_TRUE(dual{flat}.valid(pool));
+        
+        digest256 fail = Bitcoin::Hash256("Z");
+        
+        // a path that disagrees with its neighbor about their sibling.
+        proof p = flat[3];
+        map bad;
+        for (uint32 i : {0u, 1u, 2u, 4095u}) bad = bad.insert(entry(flat[i].Branch));
+        dual bad_sibling{bad.insert(p.Branch.Leaf.Digest, path{3, p.Branch.Digests.rest() << fail}), flat.root()};
+        EXPECT_FALSE(bad_sibling.valid());
+        EXPECT_FALSE(bad_sibling.valid(pool));
+        
+        // a path whose index is too big for its depth.
+        proof q = flat[7];
+        dual bad_index = dual{flat.root()};
+        bad_index.Paths = map{}.insert(q.Branch.Leaf.Digest, path{7 + (1u << 20), q.Branch.Digests});
+        EXPECT_FALSE(bad_index.valid());
+        
+        // paths that are too long for a 32-bit index.
+        digests too_long = q.Branch.Digests;
+        while (too_long.size() <= 32) too_long = too_long << fail;
+        dual too_deep = dual{flat.root()};
+        too_deep.Paths = map{}.insert(q.Branch.Leaf.Digest, path{7, too_long});
+        EXPECT_FALSE(too_deep.valid());
+        EXPECT_FALSE(too_deep.valid(pool));
+        
+        d.Root = fail;
+        EXPECT_FALSE(d.valid(pool));
+    }
+    
+    TEST(MerkleTest, TestProofsTable) {
+        EXPECT_EQ(flat_tree{}.all_proofs().Width, 0u);
+        
+        executor pool{4};
+        
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 10001; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        server s{tree};
+        
+        proofs_table one_thread = tree.all_proofs();
+        proofs_table many_threads = s.all_proofs(pool);
+        EXPECT_EQ(one_thread.Digests, many_threads.Digests);
+        EXPECT_EQ(one_thread.Depth, tree.Height - 1);
+        
+        bytes all = many_threads.write(&pool);
+        EXPECT_EQ(all, one_thread.write());
+        
+        size_t offset = 0;
+        for (uint32 i = 0; i < tree.Width; i++) {
+            size_t size = one_thread.serialized_size(i);
+            
+            // the last leaf is paired with itself.
+            if (i == 0 || i == 4096 || i == 10000) {
+                proof p = tree[i];
+                EXPECT_EQ(one_thread[i], p);
+                EXPECT_EQ(bytes_view(all).substr(offset, size), bytes_view(bytes(BitcoinAssociation::proofs_serialization_standard{p})));
+            }
+            
+            offset += size;
+        }
+        
+        EXPECT_EQ(offset, all.size());
+        EXPECT_FALSE(one_thread[10001].valid());
+    }
+    
+    TEST(MerkleTest, TestConfirmationVerifier) {
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 100; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        
+        Bitcoin::header h{};
+        h.Version = 1;
+        h.MerkleRoot = tree.root();
+        h.Timestamp = Bitcoin::timestamp{uint32(1600000000)};
+        h.Target = Bitcoin::target{uint32(0x207fffff)};
+        while (!h.valid()) h.Nonce = h.Nonce + 1;
+        
+        // a header that is not in the store.
+        Bitcoin::header unknown = h;
+        unknown.Timestamp = Bitcoin::timestamp{uint32(1600000001)};
+        
+        headers::memory store{h};
+        confirmation_verifier verifier{store};
+        
+        std::vector<ledger::confirmation> confirmations;
+        for (uint32 i = 0; i < 100; i++) confirmations.push_back(ledger::confirmation{tree[i], h});
+        
+        // a proof with a wrong digest, and one with a header that is not in the store.
+        ledger::confirmation wrong{tree[7], h};
+        wrong.Proof.Branch.Leaf.Digest = leaves[8];
+        confirmations.push_back(wrong);
+        confirmations.push_back(ledger::confirmation{tree[9], unknown});
+        
+        std::vector<bool> valid = verifier.verify(confirmations);
+        for (uint32 i = 0; i < 100; i++) EXPECT_TRUE(valid[i]);
+        EXPECT_FALSE(valid[100]);
+        EXPECT_FALSE(valid[101]);
+        EXPECT_EQ(verifier.cached(), 100);
+        
+        EXPECT_TRUE(verifier.verify(confirmations[50]));
+        EXPECT_FALSE(verifier.verify(wrong));
+    }
+    
+    TEST(MerkleTest, TestDiskTree) {
+        std::string prefix = (std::filesystem::temp_directory_path() / "gigamonkey_test_disk_tree").string();
+        
+        EXPECT_THROW(disk_tree{prefix}.finish(), std::logic_error);
+        
+        // a width of 4096 fills the buffer of the bottom level exactly.
+        for (uint32 width : {1u, 2u, 3u, 4096u, 20001u}) {
+            std::vector<digest256> leaves;
+            for (uint32 i = 0; i < width; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+            
+            flat_tree expected{leaves};
+            server s{expected};
+            
+            disk_tree tree{prefix};
+            for (const digest256 &d : leaves) tree << d;
+            EXPECT_FALSE(tree.finished());
+            
+            tree.finish();
+            ASSERT_TRUE(tree.finished());
+            EXPECT_EQ(tree.width(), width);
+            EXPECT_EQ(tree.height(), expected.Height);
+            EXPECT_EQ(tree.root(), expected.root());
+            EXPECT_THROW(tree.append(leaves[0]), std::logic_error);
+            
+            for (uint32 i : {0u, width / 2, width - 1}) {
+                EXPECT_EQ(tree.find(leaves[i]), i);
+                EXPECT_EQ(tree[leaves[i]], s[leaves[i]]);
+            }
+            
+            EXPECT_FALSE(tree[Bitcoin::Hash256("not a leaf")].valid());
+            
+            std::vector<proof> many = tree[std::span<const digest256>{leaves}];
+            ASSERT_EQ(many.size(), leaves.size());
+            for (uint32 i = 0; i < width; i++) EXPECT_EQ(many[i], expected[i]);
+        }
+        
+        EXPECT_FALSE(std::filesystem::exists(prefix + ".0"));
+        EXPECT_FALSE(std::filesystem::exists(prefix + ".index"));
+    }
+    
+    TEST(MerkleTest, TestAccumulator) {
+        accumulator Accumulator{};
+        EXPECT_EQ(Accumulator.root(), digest256{});
+        
+        leaf_digests l;
+        for (uint32 i = 0; i < 70; i++) {
+            digest256 next = Bitcoin::Hash256(write(4, uint32_little{i}));
+            Accumulator << next;
+            l = l << next;
+            
+            EXPECT_EQ(Accumulator.width(), l.size());
+            EXPECT_EQ(Accumulator.root(), root(l));
+            
+            proof p = server{l}[l.first()];
+            EXPECT_EQ(Accumulator.coinbase_path(), path(p.Branch));
+            
+            // the coinbase path does not depend on the coinbase. 
+            digest256 coinbase = Bitcoin::Hash256("coinbase");
+            EXPECT_EQ(Accumulator.root(coinbase), root(l.rest().prepend(coinbase)));
+        }
+    }
+    
+    TEST(MerkleTest, TestCoinbaseRoot) {
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 1001; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        
+        std::vector<digest256> branch;
+        for (const digest256 &d : flat_tree{leaves}[0].Branch.Digests) branch.push_back(d);
+        
+        // more than one batch of the kernel.
+        std::vector<digest256> coinbases;
+        for (uint32 extra_nonce = 0; extra_nonce < 40; extra_nonce++) 
+            coinbases.push_back(Bitcoin::Hash256(write(4, uint32_little{extra_nonce + 5000})));
+        
+        std::vector<digest256> roots(coinbases.size());
+        coinbase_roots(roots, coinbases, branch);
+        
+        for (size_t i = 0; i < coinbases.size(); i++) EXPECT_EQ(roots[i], coinbase_root(coinbases[i], branch));
+        
+        for (size_t i : {0u, 17u, 39u}) {
+            leaves[0] = coinbases[i];
+            EXPECT_EQ(roots[i], flat_tree{leaves}.root());
+        }
+        
+        EXPECT_EQ(coinbase_root(coinbases[0], {}), coinbases[0]);
+        EXPECT_THROW(coinbase_roots(std::span<digest256>{roots.data(), 1}, coinbases, branch), std::invalid_argument);
+    }
+    
     // This test comes from 
     // https://tsc.bitcoinassociation.net/standards/merkle-proof-standardised-format/
     // and is not very good but it's better than nothing. 
@@ -141,4 +451,525 @@ namespace Gigamonkey::Merkle {
         EXPECT_EQ(write_binary_from_JSON, binary_format);
         
     }
+    
+    TEST(MerkleTest, TestMerkleSerializationView) {
+        using namespace BitcoinAssociation;
+        
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 100; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        
+        Bitcoin::header h{};
+        h.Version = 1;
+        h.MerkleRoot = tree.root();
+        h.Timestamp = Bitcoin::timestamp{uint32(1600000000)};
+        h.Target = Bitcoin::target{uint32(0x207fffff)};
+        
+        Bitcoin::header other = h;
+        other.Timestamp = Bitcoin::timestamp{uint32(1600000001)};
+        
+        // the last leaf is paired with itself.
+        for (uint32 i : {0u, 1u, 50u, 99u}) {
+            proof p = tree[i];
+            
+            bytes with_root = bytes(proofs_serialization_standard{p});
+            proofs_serialization_standard::view v{with_root};
+            ASSERT_TRUE(v.valid());
+            EXPECT_EQ(v.Index, i);
+            EXPECT_EQ(v.txid(), leaves[i]);
+            EXPECT_EQ(v.root(), tree.root());
+            EXPECT_EQ(v.path(), Merkle::path(p.Branch));
+            EXPECT_TRUE(v.verify());
+            EXPECT_TRUE(v.verify(h));
+            
+            bytes with_header = bytes(proofs_serialization_standard{p.Branch, h});
+            proofs_serialization_standard::view vh{with_header};
+            EXPECT_TRUE(vh.verify());
+            EXPECT_TRUE(vh.verify(h));
+            EXPECT_FALSE(vh.verify(other));
+            EXPECT_EQ(*vh.block_header(), h);
+            
+            bytes with_hash = bytes(proofs_serialization_standard{p.Branch, h.hash()});
+            proofs_serialization_standard::view vb{with_hash};
+            EXPECT_FALSE(vb.verify());
+            EXPECT_TRUE(vb.verify(h));
+            EXPECT_FALSE(vb.verify(other));
+            
+            bytes tampered = with_root;
+            tampered[tampered.size() - 1] ^= 1;
+            EXPECT_FALSE(proofs_serialization_standard::view{tampered}.verify());
+            
+            bytes truncated = with_root;
+            truncated.resize(truncated.size() - 1);
+            EXPECT_FALSE(proofs_serialization_standard::view{truncated}.valid());
+        }
+
+        bytes tsc = *encoding::hex::read(
+            "000cef65a4611570303539143dabd6aa64dbd0f41ed89074406dc0e7cd251cf1efff69f17b44cfe9c2a23285168fe05084e125"
+            "4daa5305311ed8cd95b19ea6b0ed7505008e66d81026ddb2dae0bd88082632790fc6921b299ca798088bef5325a607efb9004d"
+            "104f378654a25e35dbd6a539505a1e3ddbba7f92420414387bb5b12fc1c10f00472581a20a043cee55edee1c65dd6677e09903"
+            "f22992062d8fd4b8d55de7b060006fcc978b3f999a3dbb85a6ae55edc06dd9a30855a030b450206c3646dadbd8c000423ab027"
+            "3c2572880cdc0030034c72ec300ec9dd7bbc7d3f948a9d41b3621e39");
+        
+        proofs_serialization_standard::view v{tsc};
+        auto x = proofs_serialization_standard::read_binary(tsc);
+        ASSERT_TRUE(v.valid());
+        EXPECT_EQ(v.Index, 12);
+        EXPECT_EQ(v.Nodes, 5);
+        EXPECT_EQ(v.block_hash(), x.block_hash());
+        EXPECT_EQ(v.root(), x.root());
+        EXPECT_EQ(v.path(), x.paths().values().first());
+        
+        EXPECT_FALSE(proofs_serialization_standard::view{bytes_view{}}.valid());
+    }
+    
+    TEST(MerkleTest, TestBUMP) {
+        EXPECT_FALSE(BUMP{}.valid());
+        
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 100; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        
+        // a node on the path of 99 is paired with itself; 20 and 21 are siblings.
+        std::vector<uint32> indices{0, 20, 21, 50, 99};
+        std::vector<branch> branches;
+        for (uint32 i : indices) branches.push_back(tree[i].Branch);
+        
+        BUMP b{800000, branches};
+        ASSERT_TRUE(b.valid());
+        EXPECT_EQ(b.height(), tree.Height - 1);
+        EXPECT_EQ(*b.root(), tree.root());
+        EXPECT_TRUE(b.verify(tree.root()));
+        EXPECT_EQ(b.leaves().size(), indices.size());
+        
+        // shared nodes are only stored once.
+        size_t stored = 0;
+        for (const auto &level : b.Levels) stored += level.size();
+        size_t separate = 0;
+        for (const branch &x : branches) separate += x.Digests.size() + 1;
+        EXPECT_LT(stored, separate);
+        
+        for (uint32 i : indices) {
+            proof p = b[leaves[i]];
+            EXPECT_TRUE(p.valid());
+            EXPECT_EQ(p, tree[i]);
+        }
+
+        EXPECT_FALSE(b[leaves[1]].valid());
+        
+        bytes serialized = bytes(b);
+        auto read = BUMP::read(serialized);
+        ASSERT_TRUE(bool(read));
+        EXPECT_EQ(*read, b);
+        
+        bytes truncated = serialized;
+        truncated.resize(truncated.size() - 1);
+        EXPECT_FALSE(bool(BUMP::read(truncated)));
+        
+        BUMP left{800000, std::vector<branch>{branches[0], branches[1], branches[4]}};
+        BUMP right{800000, std::vector<branch>{branches[2], branches[3]}};
+        EXPECT_EQ(left + right, b);
+        EXPECT_EQ(b.prune(leaves[21]).prune(leaves[50]), left);
+        EXPECT_EQ(BUMP{800000, tree[7]}.prune(leaves[7]), BUMP{});
+        
+        EXPECT_THROW(left + BUMP{800001, tree[1]}, std::invalid_argument);
+        
+        dual d = dual(b);
+        EXPECT_TRUE(d.valid());
+        EXPECT_EQ(d.Root, tree.root());
+        for (uint32 i : indices) EXPECT_EQ(d[leaves[i]], tree[i]);
+        EXPECT_EQ((BUMP{800000, d}), b);
+    }
+    
+    TEST(MerkleTest, TestCompactDual) {
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 1000; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        
+        compact_dual a;
+        EXPECT_FALSE(a.valid());
+        
+        dual expected{tree.root()};
+        for (uint32 i = 0; i < 1000; i += 3) {
+            a.insert(tree[i]);
+            expected = expected + dual{tree[i]};
+        }
+
+        ASSERT_TRUE(a.valid());
+        EXPECT_EQ(a.root(), tree.root());
+        EXPECT_EQ(a.size(), 334u);
+        EXPECT_EQ(dual(a), expected);
+        EXPECT_EQ(compact_dual{expected}, a);
+        
+        // every node is stored once, so there are fewer than in separate paths.
+        EXPECT_LT(a.nodes(), 334u * 2 * (tree.Height - 1));
+        
+        for (uint32 i = 0; i < 1000; i++) {
+            EXPECT_EQ(a.contains(leaves[i]), i % 3 == 0);
+            if (i % 3 == 0) EXPECT_EQ(a[leaves[i]], tree[i]);
+            else EXPECT_FALSE(a[leaves[i]].valid());
+        }
+        
+        // inserting the same proof again changes nothing.
+        size_t nodes = a.nodes();
+        a.insert(tree[0]);
+        EXPECT_EQ(a.nodes(), nodes);
+        
+        std::vector<digest256> other_leaves = leaves;
+        other_leaves[1] = Bitcoin::Hash256("other");
+        flat_tree other{other_leaves};
+        EXPECT_THROW(a.insert(other[0]), std::invalid_argument);
+        EXPECT_EQ(a.nodes(), nodes);
+        
+        compact_dual b;
+        for (uint32 i = 1; i < 1000; i += 3) b.insert(tree[i]);
+        compact_dual c = a + b;
+        EXPECT_EQ(c.size(), a.size() + b.size());
+        for (uint32 i = 0; i < 1000; i++) if (i % 3 != 2) EXPECT_EQ(c[leaves[i]], tree[i]);
+        
+        // removing leaves removes the nodes that only they needed.
+        for (uint32 i = 1; i < 1000; i += 3) EXPECT_TRUE(c.remove(leaves[i]));
+        EXPECT_FALSE(c.remove(leaves[1]));
+        EXPECT_EQ(c, a);
+        EXPECT_EQ(c.nodes(), a.nodes());
+        
+        for (uint32 i = 0; i < 1000; i += 3) c.remove(leaves[i]);
+        EXPECT_FALSE(c.valid());
+        EXPECT_EQ(c.nodes(), 0u);
+    }
+    
+    TEST(MerkleTest, TestSPVSnapshot) {
+        std::vector<digest256> leaves;
+        for (uint32 i = 0; i < 100; i++) leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree tree{leaves};
+        
+        std::vector<digest256> other_leaves;
+        for (uint32 i = 100; i < 150; i++) other_leaves.push_back(Bitcoin::Hash256(write(4, uint32_little{i})));
+        flat_tree other{other_leaves};
+        
+        headers::memory store;
+        SPV_snapshot::state state{store};
+        EXPECT_EQ(state.To, 0u);
+        
+        dual a{tree.root()};
+        for (uint32 i : {3, 40, 41, 99}) {
+            a = a + dual{tree[i]};
+            state.Transactions[Bitcoin::txid{leaves[i]}] = bytes(write(4, uint32_little{i}));
+        }
+        
+        state.Proofs[800000] = a;
+        state.Proofs[800007] = dual{other[12]};
+        state.Transactions[Bitcoin::txid{other_leaves[12]}] = bytes(write(8, uint64_little{12}));
+        
+        // an unconfirmed transaction.
+        state.Transactions[Bitcoin::txid{Bitcoin::Hash256("unconfirmed")}] = *bytes::from_hex("010203");
+        
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "gigamonkey_test_spv_snapshot";
+        std::filesystem::remove(path);
+        SPV_snapshot::write(path, state);
+        
+        {
+            SPV_snapshot snapshot{path};
+            EXPECT_EQ(snapshot.blocks(), 2u);
+            EXPECT_EQ(snapshot.transactions(), 6u);
+            EXPECT_EQ(snapshot.heights(), (std::vector<uint64>{800000, 800007}));
+            EXPECT_TRUE(snapshot.check(store));
+            EXPECT_EQ(snapshot.tip(), store.latest().Hash);
+            
+            for (uint32 i : {3, 40, 41, 99}) {
+                Bitcoin::txid id{leaves[i]};
+                ASSERT_TRUE(snapshot.contains(id));
+                EXPECT_EQ(bytes(snapshot.transaction(id)), bytes(write(4, uint32_little{i})));
+                EXPECT_EQ(snapshot.height(id), maybe<uint64>{800000});
+                EXPECT_EQ(snapshot.proof(id), tree[i]);
+            }
+            
+            Bitcoin::txid unconfirmed{Bitcoin::Hash256("unconfirmed")};
+            EXPECT_TRUE(snapshot.contains(unconfirmed));
+            EXPECT_FALSE(bool(snapshot.height(unconfirmed)));
+            EXPECT_FALSE(snapshot.proof(unconfirmed).valid());
+            
+            EXPECT_FALSE(snapshot.contains(Bitcoin::txid{leaves[4]}));
+            EXPECT_EQ(snapshot.transaction(Bitcoin::txid{leaves[4]}).size(), 0u);
+            
+            EXPECT_EQ(snapshot.proof(Bitcoin::txid{other_leaves[12]}), other[12]);
+            EXPECT_EQ(snapshot.dual(800000), a);
+            EXPECT_FALSE(snapshot.dual(800001).valid());
+            EXPECT_EQ(snapshot.read(), state);
+        }
+        
+        // a snapshot that relies on headers that the store does not have.
+        state.To = 10;
+        SPV_snapshot::write(path, state);
+        EXPECT_FALSE(SPV_snapshot{path}.check(store));
+        
+        state.Proofs[800001] = dual{};
+        EXPECT_THROW(SPV_snapshot::write(path, state), std::invalid_argument);
+        
+        {
+            std::ofstream out{path, std::ios::binary | std::ios::trunc};
+            out << "not a snapshot at all, but long enough to have a prefix of 80 bytes if it goes on a bit.";
+        }
+        
+        EXPECT_THROW(SPV_snapshot{path}, std::invalid_argument);
+        std::filesystem::remove(path);
+    }
+    
+    TEST(MerkleTest, TestHeadersSync) {
+        // a chain of headers with easy work.
+        auto mine = [](const digest256 &previous, uint32 i) -> Bitcoin::header {
+            Bitcoin::header h{};
+            h.Version = 1;
+            h.Previous = previous;
+            h.MerkleRoot = Bitcoin::Hash256(write(4, uint32_little{i}));
+            h.Timestamp = Bitcoin::timestamp{uint32(1600000000 + i)};
+            h.Target = Bitcoin::target{uint32(0x207fffff)};
+            while (!h.valid()) h.Nonce = h.Nonce + 1;
+            return h;
+        };
+        
+        Bitcoin::header root = mine(digest256{}, 0);
+        std::vector<Bitcoin::header> chain;
+        for (uint32 i = 1; i <= 25; i++) chain.push_back(mine(i == 1 ? root.hash() : chain.back().hash(), i));
+        
+        headers::memory store{root};
+        EXPECT_EQ(p2p::locator(store), std::vector<digest256>{root.hash()});
+        
+        bytes payload = p2p::headers_payload(chain);
+        EXPECT_EQ(payload.size(), 1 + 25 * 81);
+        maybe<std::vector<Bitcoin::header>> read = p2p::read_headers(p2p::segments{bytes_view{payload}.substr(0, 100), bytes_view{payload}.substr(100)});
+        ASSERT_TRUE(bool(read));
+        EXPECT_EQ(*read, chain);
+        EXPECT_FALSE(bool(p2p::read_headers(p2p::segments{bytes_view{payload}.substr(0, 1000)})));
+        
+        std::vector<digest256> l{root.hash()};
+        EXPECT_EQ(p2p::getheaders_payload(l).size(), 4 + 1 + 64);
+        
+        p2p::headers_sync sync{store};
+        auto r = sync.receive(std::span<const Bitcoin::header>{chain}.subspan(0, 20));
+        EXPECT_EQ(r.Received, 20);
+        EXPECT_EQ(r.Inserted, 20);
+        EXPECT_FALSE(r.Invalid);
+        EXPECT_EQ(store.height(), 20);
+        
+        // headers that we already have.
+        r = sync.receive(std::span<const Bitcoin::header>{chain}.subspan(10, 10));
+        EXPECT_EQ(r.Inserted, 0);
+        EXPECT_FALSE(r.Invalid);
+        
+        // ten in a row starting from the tip, then heights 9, 5 and 0.
+        l = p2p::locator(store);
+        EXPECT_EQ(l.size(), 13);
+        EXPECT_EQ(l.front(), chain[19].hash());
+        EXPECT_EQ(l[10], chain[8].hash());
+        EXPECT_EQ(l.back(), root.hash());
+        
+        // a header that does not connect to the one before it.
+        std::vector<Bitcoin::header> broken{chain.begin() + 20, chain.end()};
+        broken[2].Previous = root.hash();
+        r = sync.receive(broken);
+        EXPECT_TRUE(r.Invalid);
+        EXPECT_EQ(r.Inserted, 2);
+        EXPECT_EQ(store.height(), 22);
+        
+        // headers that do not follow anything in the store.
+        r = sync.receive(std::span<const Bitcoin::header>{chain}.subspan(24, 1));
+        EXPECT_TRUE(r.Invalid);
+        EXPECT_EQ(r.Inserted, 0);
+        
+        p2p::version_message v{p2p::protocol_version, 0, 1600000000, 12345, "/test:1.0/", 22, false};
+        bytes written = bytes(v);
+        EXPECT_EQ(written.size(), 4 + 8 + 8 + 26 + 26 + 8 + 11 + 4 + 1);
+        maybe<p2p::version_message> back = p2p::version_message::read(p2p::segments{written});
+        ASSERT_TRUE(bool(back));
+        EXPECT_EQ(back->UserAgent, "/test:1.0/");
+        EXPECT_EQ(back->Nonce, 12345);
+        EXPECT_EQ(back->StartHeight, 22);
+        EXPECT_FALSE(back->Relay);
+    }
+    
+    TEST(MerkleTest, TestHeadersClient) {
+        auto mine = [](const digest256 &previous, uint32 i) -> Bitcoin::header {
+            Bitcoin::header h{};
+            h.Version = 1;
+            h.Previous = previous;
+            h.MerkleRoot = Bitcoin::Hash256(write(4, uint32_little{i}));
+            h.Timestamp = Bitcoin::timestamp{uint32(1600000000 + i)};
+            h.Target = Bitcoin::target{uint32(0x207fffff)};
+            while (!h.valid()) h.Nonce = h.Nonce + 1;
+            return h;
+        };
+        
+        // more than fit in one headers message.
+        std::vector<Bitcoin::header> chain{mine(digest256{}, 0)};
+        for (uint32 i = 1; i <= p2p::max_headers + 500; i++) chain.push_back(mine(chain.back().hash(), i));
+        
+        // a peer on another thread that does the handshake and answers getheaders from the chain.
+        boost::asio::io_context io{};
+        boost::asio::ip::tcp::acceptor acceptor{io, boost::asio::ip::tcp::endpoint{boost::asio::ip::make_address("127.0.0.1"), 0}};
+        std::atomic<uint32> requests{0};
+        
+        std::thread peer{[&]() {
+            boost::asio::ip::tcp::socket socket{io};
+            acceptor.accept(socket);
+            
+            auto send = [&socket](const char *c, bytes_view payload) {
+                bytes m = p2p::write(p2p::magic::regtest, p2p::command{c}, payload);
+                boost::system::error_code err;
+                boost::asio::write(socket, boost::asio::buffer(m.data(), m.size()), err);
+            };
+            
+            p2p::decoder d{p2p::magic::regtest};
+            std::vector<byte> buffer;
+            std::array<byte, 1 << 16> in;
+            while (true) {
+                boost::system::error_code err;
+                size_t n = socket.read_some(boost::asio::buffer(in), err);
+                
+                // the client has gone away.
+                if (err) return;
+                buffer.insert(buffer.end(), in.begin(), in.begin() + n);
+                
+                p2p::message_view m;
+                while (d.read(p2p::segments{bytes_view{buffer.data(), buffer.size()}}, m) == p2p::decoder::message) {
+                    p2p::command c = m.Header.Command;
+                    bytes payload = bytes(m.Payload);
+                    buffer.erase(buffer.begin(), buffer.begin() + m.serialized_size());
+                    
+                    if (c == p2p::command{"version"}) {
+                        send("version", bytes(p2p::version_message{p2p::protocol_version, 0, 1600000000, 1, "/test:1.0/", 0, false}));
+                        send("verack", bytes{});
+                    } else if (c == p2p::command{"getheaders"}) {
+                        requests++;
+                        
+                        // the first hash of the locator that we have, after the version and a count of less than 0xfd.
+                        size_t start = chain.size();
+                        for (size_t i = 0; i < payload[4] && start == chain.size(); i++) {
+                            digest256 x;
+                            std::copy(payload.begin() + 5 + 32 * i, payload.begin() + 37 + 32 * i, x.begin());
+                            for (size_t j = 0; j < chain.size(); j++) if (chain[j].hash() == x) start = j + 1;
+                        }
+                        
+                        size_t end = std::min(chain.size(), start + p2p::max_headers);
+                        send("headers", p2p::headers_payload(std::span<const Bitcoin::header>{chain}.subspan(start, end - start)));
+                    }
+                }
+            }
+        }};
+        
+        headers::memory store{chain[0]};
+        std::atomic<uint32> batches{0};
+        
+        {
+            p2p::headers_client::options o{};
+            o.Magic = p2p::magic::regtest;
+            o.OnHeaders = [&batches](const p2p::headers_sync::result &r) {
+                EXPECT_FALSE(r.Invalid);
+                batches++;
+            };
+            
+            p2p::headers_client client{store, {acceptor.local_endpoint()}, o};
+            for (int i = 0; i < 1000 && !client.synced(); i++) std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            
+            EXPECT_TRUE(client.synced());
+            EXPECT_EQ(client.ready(), 1);
+            
+            auto held = client.lock();
+            EXPECT_EQ(store.height(), chain.size() - 1);
+            EXPECT_EQ(store.latest().Header, chain.back());
+        }
+        
+        peer.join();
+        
+        // one full batch and then the rest.
+        EXPECT_EQ(batches, 2);
+        EXPECT_EQ(requests, 2);
+    }
+    
+    TEST(MerkleTest, TestTxidIndex) {
+        std::string path = (std::filesystem::temp_directory_path() / "gigamonkey_test_txid_index").string();
+        std::filesystem::remove(path);
+        
+        list<Bitcoin::transaction> txs;
+        for (uint32 i = 0; i < 5; i++) txs <<= Bitcoin::transaction{
+            list<Bitcoin::input>{Bitcoin::input{Bitcoin::outpoint{Bitcoin::txid{uint256{i + 1}}, i}, bytes{}}},
+            list<Bitcoin::output>{Bitcoin::output{Bitcoin::satoshi{1000 + i}, bytes{0x51}}}};
+        
+        Bitcoin::header root{};
+        root.Version = 1;
+        root.MerkleRoot = Bitcoin::Hash256("root");
+        root.Timestamp = Bitcoin::timestamp{uint32(1600000000)};
+        root.Target = Bitcoin::target{uint32(0x207fffff)};
+        while (!root.valid()) root.Nonce = root.Nonce + 1;
+        
+        Bitcoin::block b{};
+        b.Header = root;
+        b.Header.Previous = root.hash();
+        b.Header.MerkleRoot = Bitcoin::merkle_root(txs);
+        b.Header.Nonce = 0;
+        while (!b.Header.valid()) b.Header.Nonce = b.Header.Nonce + 1;
+        b.Transactions = txs;
+        bytes serialized(b);
+        digest256 hash = b.Header.hash();
+        
+        headers::memory store{root};
+        ASSERT_TRUE(store.insert(b.Header));
+        
+        {
+            txid_index index{path, 8};
+            EXPECT_EQ(index.size(), 0);
+            
+            txid_index::loader loader{index};
+            EXPECT_TRUE(loader.write(serialized));
+            EXPECT_TRUE(loader.complete());
+            EXPECT_EQ(loader.inserted(), 5);
+            EXPECT_EQ(index.size(), 5);
+            
+            // the same block again.
+            txid_index::loader again{index};
+            again.write(serialized);
+            EXPECT_EQ(again.inserted(), 0);
+            
+            EXPECT_FALSE(bool(index[Bitcoin::txid{uint256{7}}]));
+            
+            index.insert(Bitcoin::txid{uint256{10}}, txid_index::position{hash, 0, 1, 0});
+            index.insert(Bitcoin::txid{uint256{11}}, txid_index::position{hash, 0, 1, 0});
+            index.insert(Bitcoin::txid{uint256{12}}, txid_index::position{hash, 0, 1, 0});
+            EXPECT_THROW(index.insert(Bitcoin::txid{uint256{13}}, txid_index::position{hash, 0, 1, 0}), std::length_error);
+        }
+        
+        txid_index index{path, 0};
+        EXPECT_EQ(index.size(), 8);
+        EXPECT_EQ(index.capacity(), 8);
+        
+        Bitcoin::block_view v{serialized};
+        for (uint32 i = 0; i < 5; i++) {
+            maybe<txid_index::position> p = index[v[i].id()];
+            ASSERT_TRUE(bool(p));
+            EXPECT_EQ(p->Block, hash);
+            EXPECT_EQ(p->Index, i);
+            EXPECT_EQ(bytes_view{serialized}.substr(p->Offset, p->Length), v[i].serialized());
+        }
+        
+        indexed_ledger local{store, index, [&serialized, hash](const digest256 &d) -> bytes {
+            return d == hash ? serialized : bytes{};
+        }};
+        
+        auto tx = local.transaction(v[3].id());
+        EXPECT_EQ(bytes_view{tx.Key}, v[3].serialized());
+        EXPECT_EQ(tx.Value.Header, b.Header);
+        EXPECT_TRUE(tx.Value.Proof.valid());
+        EXPECT_EQ(tx.Value.Proof.Root, b.Header.MerkleRoot);
+        EXPECT_EQ(tx.Value.id(), v[3].id());
+        EXPECT_EQ(local.proof(v[3].id()), tx.Value.Proof);
+        EXPECT_EQ(local.headers(0).size(), 2);
+        EXPECT_EQ(local.block(hash), serialized);
+        
+        // in the index, but not where the index says it is.
+        EXPECT_EQ(local.transaction(Bitcoin::txid{uint256{10}}).Key.size(), 0);
+        EXPECT_EQ(local.proof(Bitcoin::txid{uint256{11}}), Merkle::proof{});
+        
+        std::filesystem::remove(path);
+    }
+    
 }
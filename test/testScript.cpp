@@ -3,12 +3,24 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
 #include <gigamonkey/address.hpp>
 #include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/script/matcher.hpp>
+#include <gigamonkey/script/verify.hpp>
+#include <gigamonkey/script/bytecode_cache.hpp>
+#include <gigamonkey/beef.hpp>
+#include <gigamonkey/merkle/flat_tree.hpp>
+#include <gigamonkey/async_ledger.hpp>
+#include <gigamonkey/wif.hpp>
+#include <gigamonkey/metrics.hpp>
+#include <gigamonkey/trace.hpp>
 #include <data/crypto/NIST_DRBG.hpp>
+#include <sv/big_int.h>
 #include <data/encoding/hex.hpp>
 #include "gtest/gtest.h"
 #include <iostream>
+#include <random>
 
 namespace Gigamonkey::Bitcoin {
     
@@ -104,10 +116,1286 @@ namespace Gigamonkey::Bitcoin {
         multisig_test{200, false, doc, {k3, k2, k1}, {p1, p2, p3}}.test();
         multisig_test{210, false, doc, {k2, k3, k1}, {p1, p2, p3}}.test();
         
+        // with NULLFAIL, a signature that doesn't match a key is only an error if the operation fails.
+        auto nullfail = [&doc](list<secp256k1::secret> s, list<secp256k1::pubkey> p) -> result {
+            return evaluate({}, multisig_script(doc, s, p), doc, SCRIPT_VERIFY_NULLFAIL);
+        };
+        
+        EXPECT_TRUE(nullfail({k2}, {p1, p2}));
+        EXPECT_TRUE(nullfail({k1, k3}, {p1, p2, p3}));
+        EXPECT_EQ(nullfail({k3}, {p1, p2}), result{SCRIPT_ERR_SIG_NULLFAIL});
+        
         // TODO test that not adding the prefix fails
         // TODO test that adding a different prefix fails for the right flags. 
         // TODO test that signatures that fail should be null for certain flags. 
         
     }
     
+    TEST(ScriptTest, TestBytecode) {
+        
+        // if the top of the stack is zero, leave 1. Otherwise leave 0. 
+        program conditional {OP_IF, OP_0, OP_ELSE, OP_1, OP_ENDIF};
+        bytes lock = compile (conditional);
+        
+        interpreter::bytecode b {lock};
+        EXPECT_EQ (b.size (), 5u);
+        EXPECT_EQ (b.Operations[0].Jump, 2u);
+        EXPECT_EQ (b.Operations[2].Jump, 4u);
+        
+        program nested {OP_IF, OP_0, OP_IF, OP_0, OP_ENDIF, OP_1, OP_ELSE, OP_0, OP_ENDIF};
+        interpreter::bytecode n {compile (nested)};
+        EXPECT_EQ (n.Operations[0].Jump, 6u);
+        EXPECT_EQ (n.Operations[2].Jump, 4u);
+        EXPECT_EQ (n.Operations[6].Jump, 8u);
+        
+        // scripts that can't be decompiled are empty. 
+        EXPECT_TRUE (interpreter::bytecode {compile (program {OP_ENDIF})}.empty ());
+        EXPECT_TRUE (interpreter::bytecode {bytes {0x4c}}.empty ());
+        EXPECT_TRUE (interpreter::bytecode {bytes {0x02, 0x01}}.empty ());
+        
+        for (const program &p : list<program> {conditional, nested, 
+            {OP_1, OP_IF}, {OP_ELSE, OP_1}, {OP_RETURN}, {OP_0, OP_RETURN}, {OP_1, OP_RETURN, OP_1},
+            {push_data (bytes {0x01})}, {push_data (bytes (80, 0x07)), OP_DROP}})
+            for (uint32 flags : {uint32 (0), StandardScriptVerifyFlags (true, true), StandardScriptVerifyFlags (false, false)})
+                EXPECT_EQ (interpreter::verify (interpreter::bytecode {compile (p)}, flags), verify (decompile (compile (p)), flags)) << p;
+        
+        // the same bytecode can be used any number of times. 
+        for (const program &unlock : list<program> {{OP_0}, {OP_1}, {OP_0, OP_0}, {OP_1NEGATE}, {}}) {
+            bytes u = compile (unlock);
+            for (uint32 flags : {StandardScriptVerifyFlags (true, true), StandardScriptVerifyFlags (false, false)}) {
+                result expected = evaluate (u, lock, flags);
+                EXPECT_EQ (interpreter::machine (u, b, flags).run (), expected) << unlock;
+            }
+        }
+        
+        EXPECT_TRUE (evaluate (compile (program {OP_0}), lock, StandardScriptVerifyFlags (true, true)));
+        EXPECT_FALSE (evaluate (compile (program {OP_1}), lock, StandardScriptVerifyFlags (true, true)));
+        EXPECT_TRUE (evaluate (compile (program {OP_1}), compile (nested), StandardScriptVerifyFlags (true, true)));
+        
+    }
+    
+    // the cost of an instruction must not depend on how deeply it is nested. 
+    TEST(ScriptTest, TestNestedConditionals) {
+        
+        constexpr size_t depth = 50000;
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        
+        // 1 if 1 if 1 if ... 1 end_if end_if end_if ...
+        bytes nested {};
+        for (size_t i = 0; i < depth; i++) {
+            nested.push_back (OP_IF);
+            nested.push_back (OP_1);
+        }
+        
+        for (size_t i = 0; i < depth; i++) nested.push_back (OP_ENDIF);
+        
+        EXPECT_TRUE (evaluate (bytes {OP_1}, nested, flags));
+        EXPECT_FALSE (evaluate (bytes {OP_0}, nested, flags));
+        
+        // the same thing in a branch that is not taken. 
+        bytes skipped {OP_IF};
+        skipped.insert (skipped.end (), nested.begin (), nested.end ());
+        skipped.push_back (OP_ELSE);
+        skipped.push_back (OP_1);
+        skipped.push_back (OP_ENDIF);
+        
+        EXPECT_TRUE (evaluate (bytes {OP_0}, skipped, flags));
+        EXPECT_FALSE (evaluate (bytes {OP_1}, skipped, flags));
+        
+    }
+    
+    // numbers that fit in 8 bytes are computed without bint, and results that overflow fall back to it. 
+    TEST(ScriptTest, TestSmallNumbers) {
+        
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        
+        auto test = [flags] (bytes a, bytes b, op o, bytes expected) {
+            program p {push_data (a), push_data (b), o, push_data (expected), OP_EQUAL};
+            EXPECT_TRUE (evaluate ({}, compile (p), flags)) << p;
+        };
+        
+        bytes max {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f};
+        bytes min {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        
+        test ({0x7f}, {0x01}, OP_ADD, {0x80, 0x00});
+        test ({0x81}, {0x01}, OP_ADD, {});
+        test ({0x85}, {0x02}, OP_DIV, {0x82});
+        test ({0x85}, {0x02}, OP_MOD, {0x81});
+        test ({0x03}, {0x85}, OP_MUL, {0x8f});
+        test ({0x03}, {0x85}, OP_LESSTHAN, {});
+        test ({0x85}, {0x03}, OP_MIN, {0x85});
+        test (max, {0x01}, OP_ADD, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00});
+        test (min, {0x01}, OP_SUB, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80});
+        test (max, {0x02}, OP_MUL, {0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00});
+        test (max, min, OP_ADD, {});
+        test ({0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00}, max, OP_SUB, {0x01});
+        
+        auto unary = [flags] (bytes a, op o, bytes expected) {
+            program p {push_data (a), o, push_data (expected), OP_EQUAL};
+            EXPECT_TRUE (evaluate ({}, compile (p), flags)) << p;
+        };
+        
+        unary (max, OP_1ADD, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00});
+        unary (min, OP_1SUB, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80});
+        unary (max, OP_NEGATE, min);
+        unary (min, OP_ABS, max);
+        unary ({}, OP_NOT, {0x01});
+        
+        EXPECT_FALSE (evaluate ({}, compile (program {OP_1, OP_0, OP_DIV}), flags));
+        EXPECT_TRUE (evaluate ({}, compile (program {OP_2, OP_1, OP_3, OP_WITHIN}), flags));
+        EXPECT_FALSE (evaluate ({}, compile (program {OP_3, OP_1, OP_3, OP_WITHIN}), flags));
+        
+        // non-minimal numbers are still rejected. 
+        EXPECT_FALSE (evaluate ({}, compile (program {push_data (bytes {0x01, 0x00}), OP_1ADD}), flags));
+        
+    }
+    
+    // a bint made from a string is always a bignum, so it checks the inline values.
+    TEST(ScriptTest, TestBintSmallValues) {
+        
+        auto big = [] (int64_t x) -> bsv::bint {
+            return bsv::bint {std::to_string (x)};
+        };
+        
+        int64_t max = std::numeric_limits<int64_t>::max ();
+        int64_t min = std::numeric_limits<int64_t>::min ();
+        
+        for (int64_t a : {int64_t {0}, int64_t {1}, int64_t {-7}, int64_t {300}, int64_t {-32768}, max, min + 1}) {
+            EXPECT_EQ (bsv::bint {a}.serialize (), big (a).serialize ());
+            EXPECT_EQ (bsv::bint::deserialize (big (a).serialize ()), bsv::bint {a});
+            EXPECT_EQ (-bsv::bint {a}, -big (a));
+            
+            bsv::bint x {a};
+            bsv::bint y = big (a);
+            x <<= 5;
+            y <<= 5;
+            EXPECT_EQ (x, y);
+            x >>= 7;
+            y >>= 7;
+            EXPECT_EQ (x, y);
+            
+            EXPECT_EQ (bsv::bint {a}.lsb (), big (a).lsb ());
+            EXPECT_EQ (bsv::to_string (bsv::bint {a}), std::to_string (a));
+            
+            for (int64_t b : {int64_t {1}, int64_t {-1}, int64_t {3}, int64_t {-1000}, max, min}) {
+                EXPECT_EQ (bsv::bint {a} + bsv::bint {b}, big (a) + big (b));
+                EXPECT_EQ (bsv::bint {a} - bsv::bint {b}, big (a) - big (b));
+                EXPECT_EQ (bsv::bint {a} * bsv::bint {b}, big (a) * big (b));
+                EXPECT_EQ (bsv::bint {a} / bsv::bint {b}, big (a) / big (b));
+                EXPECT_EQ (bsv::bint {a} % bsv::bint {b}, big (a) % big (b));
+                EXPECT_EQ (bsv::bint {a} < bsv::bint {b}, big (a) < big (b));
+                EXPECT_EQ ((bsv::bint {a} & bsv::bint {b}), (big (a) & big (b)));
+            }
+        }
+        
+        EXPECT_EQ (bsv::bint {min} / bsv::bint {-1}, big (min) / big (-1));
+        EXPECT_EQ (bsv::bint {min} - bsv::bint {1}, big (min) - big (1));
+        
+        // results that overflow an int64 are computed from the original values. 
+        EXPECT_EQ (bsv::bint {max} + bsv::bint {1}, big (max) + big (1));
+        EXPECT_EQ (bsv::to_string (bsv::bint {max} + bsv::bint {1}), "9223372036854775808");
+        EXPECT_EQ (bsv::bint {min} + bsv::bint {-1}, big (min) + big (-1));
+        EXPECT_EQ (bsv::bint {max} - bsv::bint {-1}, big (max) - big (-1));
+        EXPECT_EQ (bsv::bint {max} * bsv::bint {2}, big (max) * big (2));
+        EXPECT_EQ (bsv::bint {min} * bsv::bint {-1}, big (min) * big (-1));
+        
+        bsv::bint shifted {int64_t {3}};
+        shifted <<= 62;
+        EXPECT_EQ (shifted, big (3) * big (int64_t {1} << 62));
+        
+        // an operand may be the value that is assigned to. 
+        for (int64_t a : {int64_t {5}, max, min}) {
+            bsv::bint x {a};
+            x += x;
+            EXPECT_EQ (x, big (a) + big (a));
+            
+            bsv::bint y {a};
+            y -= y;
+            EXPECT_EQ (y, bsv::bint {0});
+            
+            bsv::bint z {a};
+            z *= z;
+            EXPECT_EQ (z, big (a) * big (a));
+        }
+        
+    }
+    
+    // a machine that has been reset gives the same result as a new one. 
+    TEST(ScriptTest, TestMachineReset) {
+        
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        
+        list<std::pair<program, program>> tests {
+            {{OP_1}, {}},
+            {{OP_0}, {}},
+            {{OP_1, OP_2}, {OP_TOALTSTACK, OP_FROMALTSTACK, OP_2, OP_EQUALVERIFY}},
+            {{OP_1, OP_2, OP_3}, {OP_TOALTSTACK, OP_TOALTSTACK}},
+            {{OP_0}, {OP_IF, OP_0, OP_ELSE, OP_1, OP_ENDIF}},
+            {{OP_1}, {OP_IF, OP_1, OP_IF, OP_0}},
+            {{}, {OP_1, OP_RETURN}},
+            {{push_data (bytes (100, 0x02))}, {OP_DUP, OP_CAT, OP_SIZE, push_data (200), OP_EQUAL}}};
+        
+        interpreter::machine m {bytes {}, bytes {}, flags};
+        for (const auto &[unlock, lock] : tests) {
+            bytes u = compile (unlock);
+            bytes l = compile (lock);
+            m.reset (u, l, flags);
+            EXPECT_EQ (m.run (), evaluate (u, l, flags)) << unlock << " " << lock;
+            
+            // stop in the middle and reset again. 
+            m.reset (u, l, flags);
+            m.step ();
+        }
+        
+        m.reset (compile (program {OP_1}), compile (program {OP_VERIFY, OP_1}), flags);
+        EXPECT_TRUE (m.run ());
+        
+    }
+    
+    // a copy of a machine in the middle of a script runs on the same as the original
+    // and both can change elements that they share without changing the other. 
+    TEST(ScriptTest, TestMachineCopy) {
+        
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        
+        bytes unlock = compile (program {push_data (bytes (2000, 0x05)), push_data (bytes (10, 0x01))});
+        bytes lock = compile (program {OP_TOALTSTACK, OP_DUP, OP_INVERT, OP_FROMALTSTACK, OP_DROP,
+            OP_SIZE, push_data (2000), OP_EQUALVERIFY, push_data (bytes (2000, 0xfa)), OP_EQUALVERIFY,
+            push_data (bytes (2000, 0x05)), OP_EQUAL});
+        
+        result expected = evaluate (unlock, lock, flags);
+        EXPECT_TRUE (expected);
+        
+        for (int steps = 0; steps < 16; steps++) {
+            interpreter::machine m {unlock, lock, flags};
+            for (int i = 0; i < steps && !m.Halt; i++) m.step ();
+            
+            interpreter::machine c {m};
+            EXPECT_EQ (c.State.Stack, m.State.Stack);
+            EXPECT_EQ (c.State.AltStack, m.State.AltStack);
+            EXPECT_EQ (c.State.Stack.getCombinedStackSize (), m.State.Stack.getCombinedStackSize ());
+            
+            EXPECT_EQ (c.run (), expected) << steps;
+            EXPECT_EQ (m.run (), expected) << steps;
+        }
+        
+    }
+    
+    // large elements made by OP_CAT are kept as ropes, which must look the same as flat elements. 
+    TEST(ScriptTest, TestRopeElements) {
+        
+        bytes expected {};
+        interpreter::LimitedStack<interpreter::element> stack {1 << 24};
+        stack.push (bytes {});
+        
+        // append and prepend pieces so that the rope has to be rebalanced on both sides. 
+        for (int i = 0; i < 60; i++) {
+            bytes piece (i % 7 == 0 ? 3 : 300 + i, byte (i));
+            stack.push (piece);
+            if (i % 2 == 0) {
+                stack.cat ();
+                expected.insert (expected.end (), piece.begin (), piece.end ());
+            } else {
+                stack.swapElements (0, 1);
+                stack.cat ();
+                expected.insert (expected.begin (), piece.begin (), piece.end ());
+            }
+            
+            EXPECT_EQ (stack.size (), 1);
+            EXPECT_EQ (stack.stacktop (-1).size (), expected.size ());
+            EXPECT_EQ (stack.getCombinedStackSize (), expected.size () + interpreter::LimitedVector<interpreter::element>::ELEMENT_OVERHEAD);
+        }
+        
+        stack.push_back (stack.stacktop (-1));
+        EXPECT_EQ (bytes (stack.stacktop (-2).GetElement ()), expected);
+        stack.pop_back ();
+        
+        for (size_t position : {size_t {0}, size_t {1}, size_t {500}, expected.size () / 2, expected.size () - 1, expected.size ()}) {
+            stack.push_back (stack.stacktop (-1));
+            stack.split (position);
+            EXPECT_EQ (stack.size (), 3);
+            EXPECT_EQ (stack.getCombinedStackSize (), 2 * expected.size () + 3 * interpreter::LimitedVector<interpreter::element>::ELEMENT_OVERHEAD);
+            EXPECT_EQ (bytes (stack.stacktop (-1).GetElement ()), bytes (expected.begin () + position, expected.end ()));
+            EXPECT_EQ (bytes (stack.stacktop (-2).GetElement ()), bytes (expected.begin (), expected.begin () + position));
+            stack.pop_back ();
+            stack.pop_back ();
+        }
+        
+        // the same through the script interpreter. 
+        program unlock {};
+        program lock {};
+        bytes whole {};
+        for (int i = 0; i < 50; i++) {
+            bytes piece (520, byte (i));
+            whole.insert (whole.end (), piece.begin (), piece.end ());
+            unlock <<= push_data (piece);
+            if (i > 0) lock <<= OP_CAT;
+        }
+        
+        for (const instruction &x : program {OP_DUP, OP_SIZE, push_data (int (whole.size ())), OP_EQUALVERIFY,
+            push_data (10001), OP_SPLIT, push_data (bytes (whole.begin () + 10001, whole.end ())), OP_EQUALVERIFY,
+            push_data (bytes (whole.begin (), whole.begin () + 10001)), OP_EQUALVERIFY,
+            push_data (whole), OP_EQUAL}) lock <<= x;
+        
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        EXPECT_TRUE (evaluate (compile (unlock), compile (lock), flags));
+        
+        // before genesis, an element may not be bigger than 520 bytes. 
+        EXPECT_FALSE (evaluate (compile (program {push_data (bytes (300, 0x01)), push_data (bytes (300, 0x02))}),
+            compile (program {OP_CAT, OP_DROP, OP_1}), StandardScriptVerifyFlags (false, false)));
+        
+    }
+    
+    // iterating over a script gives the same instructions as decompile. 
+    TEST(ScriptTest, TestInstructions) {
+        
+        list<program> programs {{}, {OP_1, OP_DUP, OP_CODESEPARATOR, OP_ADD}, 
+            {push_data (bytes (100, 0x01)), push_data (bytes (300, 0x02)), push_data (bytes (70000, 0x03)), OP_DROP},
+            {OP_IF, OP_0, OP_ELSE, OP_1, OP_ENDIF}, {OP_ENDIF}, {OP_IF, OP_ELSE, OP_ELSE, OP_ENDIF}};
+        
+        for (const program &p : programs) {
+            bytes script = compile (p);
+            EXPECT_EQ (decompilable (script), script.size () == 0 || decompile (script) != program {}) << p;
+            
+            list<instruction> read;
+            size_t size = 0;
+            for (const instruction_view &i : instructions {script}) {
+                instruction x = instruction::read (i.Serialized);
+                EXPECT_EQ (i.Data, bytes_view (x.data ()));
+                read <<= x;
+                size += i.Serialized.size ();
+            }
+            
+            EXPECT_EQ (read, p);
+            EXPECT_EQ (size, script.size ());
+        }
+        
+        // the rest of a truncated script is given as a single instruction. 
+        bytes truncated {OP_1, 0x05, 0x01, 0x02};
+        auto i = instructions {truncated}.begin ();
+        EXPECT_EQ (i->Op, OP_1);
+        i++;
+        EXPECT_EQ (i->Op, OP_INVALIDOPCODE);
+        EXPECT_EQ (i->Serialized.size (), 3u);
+        EXPECT_TRUE (++i == instructions {truncated}.end ());
+        EXPECT_FALSE (decompilable (truncated));
+        
+        // data after OP_RETURN is not read. 
+        EXPECT_TRUE (decompilable (bytes {OP_0, OP_RETURN, 0xff, 0x4c}));
+        EXPECT_TRUE (output {satoshi {0}, bytes {OP_0, OP_RETURN, 0xff, 0x4c}}.valid ());
+        EXPECT_FALSE (output {satoshi {0}, bytes {}}.valid ());
+        
+    }
+    
+    TEST (ScriptTest, TestASM) {
+        
+        EXPECT_EQ (ASM (compile (program {OP_DUP, OP_HASH160, push_data (bytes (20, 0xab)), OP_EQUALVERIFY, OP_CHECKSIG})),
+            "OP_DUP OP_HASH160 abababababababababababababababababababab OP_EQUALVERIFY OP_CHECKSIG");
+        EXPECT_EQ (ASM (compile (program {OP_0, OP_1NEGATE, OP_1, OP_16, OP_IF, OP_ELSE, OP_ENDIF})), "0 -1 OP_1 OP_16 OP_IF OP_ELSE OP_ENDIF");
+        EXPECT_EQ (ASM (bytes {}), "");
+        
+        // data after OP_RETURN is left out, and nothing is written for a script that cannot be decompiled.
+        EXPECT_EQ (ASM (bytes {OP_0, OP_RETURN, 0xff, 0x4c}), "0 OP_RETURN");
+        EXPECT_EQ (ASM (bytes {OP_1, 0x05, 0x01, 0x02}), "");
+        EXPECT_EQ (ASM (compile (program {OP_1, OP_ENDIF})), "");
+        
+        // written to the end of what is there already.
+        string x {"script: "};
+        write_ASM (x, compile (program {OP_1, OP_ADD}));
+        EXPECT_EQ (x, "script: OP_1 OP_ADD");
+        
+        list<program> programs {{}, {OP_1, OP_DUP, OP_CODESEPARATOR, OP_ADD},
+            {push_data (bytes (100, 0x01)), push_data (bytes (300, 0x02)), push_data (bytes (70000, 0x03)), OP_DROP},
+            {OP_IF, OP_0, OP_ELSE, OP_1, OP_ENDIF}, {push_data (bytes {0x00}), push_data (bytes {0x10}), push_data (bytes {0x81, 0x00})}};
+        
+        for (const program &p : programs) {
+            bytes script = compile (p);
+            EXPECT_EQ (read_ASM (ASM (script)), script) << p;
+        }
+        
+        // names as GetOpName writes them, and hex in either case.
+        EXPECT_EQ (read_ASM ("  1 2  OP_TRUE OP_FALSE\tOP_CHECKSIG ABcd "), compile (program {OP_1, OP_2, OP_1, OP_0, OP_CHECKSIG, push_data (bytes {0xab, 0xcd})}));
+        EXPECT_EQ (read_ASM ("05"), bytes {OP_5});
+        EXPECT_EQ (read_ASM ("-1 OP_1NEGATE"), (bytes {OP_1NEGATE, OP_1NEGATE}));
+        
+        // numbers that are also hex are pushes.
+        EXPECT_EQ (read_ASM ("10"), bytes {OP_16});
+        EXPECT_EQ (read_ASM ("16"), (bytes {0x01, 0x16}));
+        EXPECT_EQ (read_ASM (ASM (compile (program {push_data (bytes {0x16})}))), (bytes {0x01, 0x16}));
+        
+        EXPECT_FALSE (read_ASM ("OP_DUP OP_NOTANOPCODE"));
+        EXPECT_FALSE (read_ASM ("abc"));
+        EXPECT_FALSE (read_ASM ("OP_PUSHDATA1"));
+        
+    }
+    
+    // a compiled pattern matches the same scripts as the pattern. 
+    TEST(ScriptTest, TestMatcher) {
+        
+        bytes address {};
+        bytes pubkey_data {};
+        bytes tag {};
+        bytes read {};
+        
+        list<pattern> patterns {
+            pay_to_address::pattern (address),
+            pay_to_pubkey::pattern (pubkey_data),
+            pattern {push {bytes {0x01, 0x02}}, push_size {4, tag}, optional {push_size {20}}, OP_DROP},
+            pattern {repeated {push {}, 2, 3}, push {5}, alternatives {OP_ADD, program {OP_SUB, OP_VERIFY}}},
+            pattern {repeated {OP_NOP, 2, or_less}, any {}, repeated {push {read}, 1, or_more}}};
+        
+        bytes pk (33, 0x02);
+        digest160 hash {};
+        
+        list<bytes> scripts {
+            {}, pay_to_address::script (hash), compile (program {push_data (pk), OP_CHECKSIG}),
+            compile (program {OP_DUP, OP_HASH160, push_data (bytes (19, 0x00)), OP_EQUALVERIFY, OP_CHECKSIG}),
+            compile (program {push_data (bytes {0x01, 0x02}), push_data (bytes {1, 2, 3, 4}), OP_DROP}),
+            compile (program {push_data (bytes {0x01, 0x02}), push_data (bytes {1, 2, 3, 4}), push_data (bytes (20, 0x03)), OP_DROP}),
+            compile (program {OP_1, OP_2, OP_5, OP_ADD}), compile (program {OP_1, OP_2, OP_3, push_data (bytes {0x05, 0x00}), OP_SUB, OP_VERIFY}),
+            compile (program {OP_1, OP_5, OP_ADD}), compile (program {OP_1, OP_2, OP_3, OP_4, OP_5, OP_ADD}),
+            compile (program {OP_NOP, OP_CHECKSIG, OP_1, OP_2}), compile (program {OP_NOP, OP_NOP, OP_NOP, OP_1})};
+        
+        for (const pattern &p : patterns) {
+            matcher m {p};
+            for (const bytes &script : scripts) EXPECT_EQ (m.match (script), p.match (script)) << script;
+            
+            // scripts that can't be read don't match. 
+            EXPECT_FALSE (m.match (bytes {0x4c}));
+            EXPECT_FALSE (m.match (bytes {0x05, 0x01}));
+        }
+        
+        // captures are views of the script. 
+        std::vector<bytes_view> captures;
+        bytes p2pkh = pay_to_address::script (hash);
+        matcher m {pay_to_address::pattern (address)};
+        EXPECT_EQ (m.captures (), 1u);
+        EXPECT_TRUE (m.match (p2pkh, captures));
+        EXPECT_EQ (captures[0], bytes_view (hash));
+        EXPECT_EQ (captures[0].data (), p2pkh.data () + 3);
+        
+        classifier c {{matcher {patterns[0]}, matcher {patterns[1]}, matcher {patterns[3]}}};
+        EXPECT_EQ (c.classify (p2pkh), 0);
+        EXPECT_EQ (c.classify (compile (program {push_data (pk), OP_CHECKSIG}), captures), 1);
+        EXPECT_EQ (captures[0], bytes_view (pk));
+        EXPECT_EQ (c.classify (compile (program {OP_1, OP_2, OP_5, OP_ADD})), 2);
+        EXPECT_EQ (c.classify (bytes {OP_RETURN}), -1);
+        
+    }
+    
+    // P2PKH and P2PK scripts give the same results with and without the specialized functions. 
+    TEST(ScriptTest, TestStandardScripts) {
+        
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        secret other {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a8"}}};
+        pubkey pk = key.to_public ();
+        pubkey other_pk = other.to_public ();
+        
+        outpoint op {txid {uint256 {1000}}, 0};
+        incomplete::transaction incomplete {transaction::LatestVersion, list<incomplete::input> {incomplete::input {op}}, 
+            list<output> {output {satoshi {900}, pay_to_address::script (Hash160 (pk))}}, 0};
+        
+        for (const bytes &lock : list<bytes> {pay_to_address::script (Hash160 (pk)), pay_to_pubkey::script (pk)}) {
+            redemption_document doc {satoshi {1000}, incomplete, 0};
+            sighash::document signed_doc {doc.RedeemedValue, lock, incomplete, 0};
+            signature sig = key.sign (signed_doc);
+            signature wrong = other.sign (signed_doc);
+            
+            bool p2pkh = lock.size () == 25;
+            auto redeem = [p2pkh] (const signature &x, const pubkey &p) -> bytes {
+                return p2pkh ? pay_to_address::redeem (x, p) : pay_to_pubkey::redeem (x);
+            };
+            
+            list<bytes> unlocks {redeem (sig, pk), redeem (wrong, pk), redeem (sig, other_pk), 
+                redeem (signature {}, pk), compile (program {OP_0, OP_0}), bytes {}};
+            
+            for (const bytes &unlock : unlocks)
+                for (uint32 flags : {StandardScriptVerifyFlags (true, true), StandardScriptVerifyFlags (false, false), 
+                    uint32 (SCRIPT_ENABLE_SIGHASH_FORKID), uint32 (0)}) {
+                    
+                    interpreter::machine general {unlock, lock, doc, flags};
+                    general.specialize_standard_scripts (false);
+                    
+                    interpreter::machine standard {unlock, lock, doc, flags};
+                    EXPECT_EQ (standard.run (), general.run ()) << unlock << " " << lock;
+                    
+                    interpreter::machine no_doc {unlock, lock, flags};
+                    interpreter::machine no_doc_general {unlock, lock, flags};
+                    no_doc_general.specialize_standard_scripts (false);
+                    EXPECT_EQ (no_doc.run (), no_doc_general.run ()) << unlock << " " << lock;
+                }
+            
+            EXPECT_TRUE (evaluate (redeem (sig, pk), lock, doc, StandardScriptVerifyFlags (true, true)));
+            EXPECT_FALSE (evaluate (redeem (wrong, pk), lock, doc, StandardScriptVerifyFlags (true, true)));
+            
+            // without NULLFAIL, a signature that does not match is not an error, but it leaves false on the stack. 
+            for (bool specialize : {true, false}) {
+                interpreter::machine m {redeem (wrong, pk), lock, doc, uint32 (SCRIPT_ENABLE_SIGHASH_FORKID)};
+                m.specialize_standard_scripts (specialize);
+                EXPECT_EQ (m.run (), result {SCRIPT_ERR_EVAL_FALSE});
+                ASSERT_EQ (m.State.Stack.size (), 1u);
+                EXPECT_EQ (m.State.Stack.stacktop (-1).size (), 0u);
+            }
+            
+            EXPECT_FALSE (evaluate (redeem (wrong, pk), lock, doc, uint32 (SCRIPT_ENABLE_SIGHASH_FORKID)));
+        }
+        
+    }
+    
+    // large scripts are decoded once and small ones are not kept. 
+    TEST(ScriptTest, TestBytecodeCache) {
+        
+        interpreter::bytecode_cache cache {2};
+        
+        bytes small = compile (program {OP_DUP, OP_HASH160, push_data (bytes (20, 0x01)), OP_EQUALVERIFY, OP_CHECKSIG});
+        EXPECT_NE (cache.get (small), cache.get (small));
+        EXPECT_EQ (cache.size (), 0);
+        EXPECT_EQ (cache.hits () + cache.misses (), 0);
+        
+        list<bytes> large {
+            compile (program {push_data (bytes (200, 0x01)), OP_DROP, OP_1}),
+            compile (program {push_data (bytes (200, 0x02)), OP_DROP, OP_1}),
+            compile (program {push_data (bytes (200, 0x03)), OP_DROP, OP_1})};
+        
+        ptr<const interpreter::bytecode> first = cache.get (large[0]);
+        EXPECT_EQ (first->Script, large[0]);
+        EXPECT_EQ (first->size (), 3);
+        EXPECT_EQ (cache.get (large[0]), first);
+        EXPECT_EQ (cache.hits (), 1);
+        EXPECT_EQ (cache.misses (), 1);
+        
+        for (const bytes &b : large) EXPECT_EQ (cache.get (b)->Script, b);
+        EXPECT_EQ (cache.size (), 2);
+        
+        cache.clear ();
+        EXPECT_EQ (cache.size (), 0);
+        EXPECT_EQ (cache.bytes_used (), 0);
+        
+        // room for two of the large scripts by size but for many by number.
+        size_t each = large[0].size () + 3 * sizeof (interpreter::bytecode::operation);
+        interpreter::bytecode_cache budget {16, 2 * each + 1};
+        for (const bytes &b : large) EXPECT_EQ (budget.get (b)->Script, b);
+        EXPECT_EQ (budget.size (), 2);
+        EXPECT_EQ (budget.bytes_used (), 2 * each);
+        
+        // a script larger than the budget is not kept.
+        bytes huge = compile (program {push_data (bytes (4 * each, 0x04)), OP_DROP, OP_1});
+        EXPECT_EQ (budget.get (huge)->Script, huge);
+        EXPECT_EQ (budget.size (), 2);
+        EXPECT_EQ (budget.bytes_used (), 2 * each);
+        
+    }
+    
+    TEST(ScriptTest, TestVerifyTransaction) {
+        
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        constexpr uint32 inputs = 9;
+        
+        list<incomplete::input> incomplete_inputs;
+        std::vector<prevout> prevouts;
+        for (uint32 i = 0; i < inputs; i++) {
+            outpoint op {txid {uint256 {1000 + i}}, i};
+            incomplete_inputs <<= incomplete::input {op};
+            prevouts.push_back (prevout {op, output {satoshi {1000 + i}, lock}});
+        }
+        
+        incomplete::transaction incomplete {transaction::LatestVersion, incomplete_inputs, 
+            list<output> {output {satoshi {5000}, lock}}, 0};
+        
+        ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+        
+        list<bytes> unlocks;
+        for (uint32 i = 0; i < inputs; i++) unlocks <<= pay_to_address::redeem (
+            key.sign (sighash::document {prevouts[i].value (), lock, incomplete, i, precomputed}), pk);
+        
+        transaction tx = incomplete.complete (unlocks);
+        
+        executor e {4};
+        
+        std::vector<result> results = verify_transaction (bytes (tx), prevouts, StandardScriptVerifyFlags (true, true), e);
+        EXPECT_EQ (results.size (), inputs);
+        EXPECT_TRUE (verified (results));
+        
+        // swap the first two signatures so that those inputs fail. 
+        list<bytes> swapped {unlocks[1], unlocks[0]};
+        for (uint32 i = 2; i < inputs; i++) swapped <<= unlocks[i];
+        
+        results = verify_transaction (incomplete.complete (swapped), prevouts, StandardScriptVerifyFlags (true, true), e);
+        EXPECT_FALSE (verified (results));
+        EXPECT_FALSE (results[0].verify ());
+        EXPECT_FALSE (results[1].verify ());
+        for (uint32 i = 2; i < inputs; i++) EXPECT_TRUE (results[i].verify ());
+        
+        results = verify_transaction (incomplete.complete (swapped), prevouts, StandardScriptVerifyFlags (true, true), e, true);
+        EXPECT_FALSE (verified (results));
+        
+        // valid signatures are remembered. 
+        signature_cache cache {};
+        EXPECT_TRUE (verified (verify_transaction (tx, prevouts, StandardScriptVerifyFlags (true, true), e, false, &cache)));
+        EXPECT_EQ (cache.size (), inputs);
+        EXPECT_TRUE (verified (verify_transaction (tx, prevouts, StandardScriptVerifyFlags (true, true), e, false, &cache)));
+        EXPECT_EQ (cache.size (), inputs);
+        
+        // invalid ones are not. 
+        EXPECT_FALSE (verified (verify_transaction (incomplete.complete (swapped), prevouts, 
+            StandardScriptVerifyFlags (true, true), e, false, &cache)));
+        EXPECT_EQ (cache.size (), inputs);
+        
+        // scripts that succeeded are not evaluated again. 
+        script_cache scripts {};
+        EXPECT_TRUE (verified (verify_transaction (tx, prevouts, StandardScriptVerifyFlags (true, true), e, false, nullptr, &scripts)));
+        EXPECT_EQ (scripts.size (), inputs);
+        EXPECT_EQ (scripts.hits (), 0u);
+        EXPECT_EQ (scripts.misses (), inputs);
+        EXPECT_TRUE (verified (verify_transaction (tx, prevouts, StandardScriptVerifyFlags (true, true), e, false, nullptr, &scripts)));
+        EXPECT_EQ (scripts.hits (), inputs);
+        
+        // the flags are part of the key. 
+        EXPECT_TRUE (verified (verify_transaction (tx, prevouts, StandardScriptVerifyFlags (true, false), e, false, nullptr, &scripts)));
+        EXPECT_EQ (scripts.size (), 2 * inputs);
+        
+        // failures are not remembered. 
+        EXPECT_FALSE (verified (verify_transaction (incomplete.complete (swapped), prevouts, 
+            StandardScriptVerifyFlags (true, true), e, false, nullptr, &scripts)));
+        EXPECT_EQ (scripts.size (), 3 * inputs - 2);
+        
+        // a deferred signature that is invalid still causes the script to fail. 
+        redemption_document doc {prevouts[0].value (), incomplete, 0};
+        interpreter::machine deferred {unlocks[1], lock, doc, StandardScriptVerifyFlags (true, true)};
+        deferred.defer_signatures ();
+        EXPECT_FALSE (deferred.run ());
+        
+        interpreter::machine not_deferred {unlocks[0], lock, doc, StandardScriptVerifyFlags (true, true)};
+        not_deferred.defer_signatures ();
+        EXPECT_TRUE (not_deferred.run ());
+        
+    }
+    
+    TEST (ScriptTest, TestExecutor) {
+        executor::options o {};
+        o.Threads = 3;
+        o.Pin = true;
+        executor e {o};
+        EXPECT_EQ (e.threads (), 3);
+        
+        std::vector<int> x (1000, 0);
+        e.bulk (x.size (), 7, [&x] (size_t begin, size_t end) {
+            EXPECT_LE (end - begin, 7);
+            for (size_t i = begin; i < end; i++) x[i]++;
+        });
+        
+        e.bulk (x.size (), 0, [&x] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) x[i]++;
+        });
+        
+        EXPECT_TRUE (std::all_of (x.begin (), x.end (), [] (int i) {
+            return i == 2;
+        }));
+        
+        // loops within loops on the executor that everything shares.
+        std::atomic<size_t> count {0};
+        executor::shared ().parallel_for (4, [&count] (size_t) {
+            executor::shared ().bulk (100, 10, [&count] (size_t begin, size_t end) {
+                count += end - begin;
+            });
+        });
+        
+        EXPECT_EQ (count, 400);
+        EXPECT_EQ (&executor::shared (), &executor::shared ());
+    }
+    
+    // a ledger that only knows some outputs and transactions.
+    struct test_ledger final : ledger {
+        hash_map<outpoint, output> Outputs;
+        hash_map<txid, data::entry<bytes, confirmation>> Transactions;
+        hash_map<digest256, block_header> Headers;
+        
+        list<block_header> headers (uint64) override {
+            return {};
+        }
+        
+        data::entry<bytes, confirmation> transaction (const txid &id) const override {
+            auto t = Transactions.find (id);
+            if (t == Transactions.end ()) return {bytes {}, confirmation {}};
+            return t->second;
+        }
+        
+        block_header header (const digest256 &d) const override {
+            auto h = Headers.find (d);
+            if (h == Headers.end ()) return {};
+            return h->second;
+        }
+        
+        bytes block (const digest256 &) const override {
+            return {};
+        }
+        
+        std::future<std::vector<output>> prevouts (std::span<const outpoint> refs) const override {
+            std::vector<output> outs (refs.size ());
+            for (size_t i = 0; i < refs.size (); i++) {
+                auto o = Outputs.find (refs[i]);
+                if (o != Outputs.end ()) outs[i] = o->second;
+            }
+            
+            std::promise<std::vector<output>> p;
+            p.set_value (std::move (outs));
+            return p.get_future ();
+        }
+    };
+    
+    TEST (ScriptTest, TestVerifyBlock) {
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        secret wrong {secret::test, secp256k1::secret {uint256 {12345}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        // spend to one output of the given value.
+        auto spend = [&] (std::vector<prevout> from, int64 value, const secret &k) -> transaction {
+            list<incomplete::input> ins;
+            for (const prevout &p : from) ins <<= incomplete::input {p.outpoint ()};
+            incomplete::transaction incomplete {transaction::LatestVersion, ins, list<output> {output {satoshi {value}, lock}}, 0};
+            ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+            
+            list<bytes> unlocks;
+            for (uint32 i = 0; i < from.size (); i++) unlocks <<= pay_to_address::redeem (
+                k.sign (sighash::document {from[i].value (), lock, incomplete, i, precomputed}), pk);
+            
+            return incomplete.complete (unlocks);
+        };
+        
+        // the first output of a transaction made by spend.
+        auto first = [] (const transaction &t) -> prevout {
+            return prevout {outpoint {t.id (), 0}, t.Outputs.first ()};
+        };
+        
+        test_ledger l {};
+        std::vector<prevout> external;
+        for (uint32 i = 0; i < 4; i++) {
+            outpoint op {txid {uint256 {2000 + i}}, i};
+            external.push_back (prevout {op, output {satoshi {1000}, lock}});
+            l.Outputs[op] = output {satoshi {1000}, lock};
+        }
+        
+        transaction cb {int32_little {1}, list<input> {input {outpoint::coinbase (), bytes {0x51, 0x51}, 0xffffffff}},
+            list<output> {output {satoshi {5000000000}, lock}}, 0};
+        
+        transaction a = spend ({external[0], external[1]}, 1500, key);
+        transaction b = spend ({first (a)}, 1400, key);
+        transaction c = spend ({first (b)}, 1300, key);
+        transaction d = spend ({external[2]}, 900, wrong);
+        transaction e = spend ({first (d)}, 800, key);
+        transaction f = spend ({first (a)}, 100, key);
+        transaction g = spend ({prevout {outpoint {txid {uint256 {3000}}, 0}, output {satoshi {1000}, lock}}}, 900, key);
+        transaction h = spend ({external[3]}, 5000, key);
+        
+        executor ex {4};
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        
+        block good {};
+        good.Transactions = list<transaction> {cb, a, b, c};
+        bytes good_serialized (good);
+        block_result result = verify_block (block_view {good_serialized}, l, flags, ex);
+        EXPECT_TRUE (result.Valid);
+        ASSERT_EQ (result.Transactions.size (), 3);
+        for (const transaction_result &x : result.Transactions) EXPECT_EQ (x.Status, transaction_result::valid);
+        EXPECT_EQ (result.Transactions[0].Inputs.size (), 2);
+        
+        block bad {};
+        bad.Transactions = list<transaction> {cb, a, b, c, d, e, f, g, h};
+        bytes bad_serialized (bad);
+        result = verify_block (block_view {bad_serialized}, l, flags, ex);
+        EXPECT_FALSE (result.Valid);
+        ASSERT_EQ (result.Transactions.size (), 8);
+        EXPECT_TRUE (result.Transactions[2].verify ());
+        EXPECT_EQ (result.Transactions[3].Status, transaction_result::invalid_script);
+        EXPECT_FALSE (result.Transactions[3].Inputs[0].verify ());
+        EXPECT_EQ (result.Transactions[4].Status, transaction_result::dependency_failed);
+        EXPECT_TRUE (result.Transactions[4].Inputs.empty ());
+        EXPECT_EQ (result.Transactions[5].Status, transaction_result::double_spend);
+        EXPECT_EQ (result.Transactions[6].Status, transaction_result::missing_prevout);
+        EXPECT_EQ (result.Transactions[7].Status, transaction_result::invalid_transaction);
+        
+        // a transaction can't spend one that comes after it.
+        block backwards {};
+        backwards.Transactions = list<transaction> {cb, b, a};
+        bytes backwards_serialized (backwards);
+        result = verify_block (block_view {backwards_serialized}, l, flags, ex);
+        EXPECT_FALSE (result.Valid);
+        EXPECT_EQ (result.Transactions[0].Status, transaction_result::invalid_transaction);
+        EXPECT_TRUE (result.Transactions[1].verify ());
+    }
+    
+    struct counting_BEEF_reader final : BEEF_reader {
+        using BEEF_reader::BEEF_reader;
+        uint32 Confirmed {0};
+        uint32 Unconfirmed {0};
+        
+        void receive (const transaction_view &, bool confirmed) override {
+            (confirmed ? Confirmed : Unconfirmed)++;
+        }
+    };
+    
+    TEST (ScriptTest, TestBEEF) {
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        secret wrong {secret::test, secp256k1::secret {uint256 {12345}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        auto spend = [&] (std::vector<prevout> from, int64 value, const secret &k) -> transaction {
+            list<incomplete::input> ins;
+            for (const prevout &p : from) ins <<= incomplete::input {p.outpoint ()};
+            incomplete::transaction incomplete {transaction::LatestVersion, ins, list<output> {output {satoshi {value}, lock}}, 0};
+            ptr<const sighash::precomputed> precomputed = std::make_shared<const sighash::precomputed> (incomplete);
+            
+            list<bytes> unlocks;
+            for (uint32 i = 0; i < from.size (); i++) unlocks <<= pay_to_address::redeem (
+                k.sign (sighash::document {from[i].value (), lock, incomplete, i, precomputed}), pk);
+            
+            return incomplete.complete (unlocks);
+        };
+        
+        // a confirmed transaction in a block with three others.
+        transaction p {int32_little {1}, list<input> {input {outpoint {txid {uint256 {5000}}, 0}, bytes {}, 0xffffffff}},
+            list<output> {output {satoshi {2000}, lock}, output {satoshi {1000}, lock}}, 0};
+        
+        Merkle::flat_tree tree {std::vector<digest256> {p.id (), txid {uint256 {1}}, txid {uint256 {2}}, txid {uint256 {3}}}};
+        
+        header h {};
+        h.Version = 1;
+        h.MerkleRoot = tree.root ();
+        h.Timestamp = timestamp {uint32 (1600000000)};
+        h.Target = target {uint32 (0x207fffff)};
+        while (!h.valid ()) h.Nonce = h.Nonce + 1;
+        
+        Gigamonkey::headers::memory store {h};
+        
+        // two unconfirmed transactions, the second of which spends both outputs of p.
+        transaction b = spend ({prevout {outpoint {p.id (), 0}, p.Outputs[0]}}, 1900, key);
+        transaction c = spend ({prevout {outpoint {b.id (), 0}, b.Outputs[0]}, prevout {outpoint {p.id (), 1}, p.Outputs[1]}}, 2800, key);
+        
+        test_ledger l {};
+        l.Transactions[p.id ()] = {bytes (p), ledger::confirmation {tree[0], h}};
+        l.Transactions[b.id ()] = {bytes (b), ledger::confirmation {}};
+        l.Headers[h.hash ()] = store.latest ();
+        
+        BEEF x = BEEF::make (l, bytes (c));
+        EXPECT_TRUE (x.valid ());
+        ASSERT_EQ (x.BUMPs.size (), 1);
+        ASSERT_EQ (x.Transactions.size (), 3);
+        EXPECT_TRUE (x.Transactions[0] == (BEEF::transaction {bytes (p), 0}));
+        EXPECT_TRUE (x.Transactions[1] == (BEEF::transaction {bytes (b), {}}));
+        EXPECT_EQ (x.id (), c.id ());
+        
+        bytes serialized (x);
+        EXPECT_TRUE (BEEF::read (serialized) == x);
+        EXPECT_FALSE (bool (BEEF::read (bytes_view {serialized}.substr (0, serialized.size () - 1))));
+        
+        // with scripts, a byte at a time.
+        executor ex {2};
+        uint32 flags = StandardScriptVerifyFlags (true, true);
+        counting_BEEF_reader r {store, &ex, flags};
+        for (byte z : serialized) ASSERT_TRUE (r.write (bytes_view {&z, 1}));
+        EXPECT_TRUE (r.complete ());
+        EXPECT_EQ (r.transactions_read (), 3);
+        EXPECT_EQ (r.Confirmed, 1);
+        EXPECT_EQ (r.Unconfirmed, 2);
+        EXPECT_EQ (r.last (), c.id ());
+        
+        // nothing may come after.
+        EXPECT_FALSE (r.write (bytes {0}));
+        
+        // the proof is checked against the headers.
+        Gigamonkey::headers::memory other {};
+        BEEF_reader unknown {other};
+        EXPECT_FALSE (unknown.write (serialized));
+        EXPECT_EQ (unknown.why (), BEEF_reader::error::invalid_proof);
+        
+        // a bad signature is only found if scripts are run.
+        transaction d = spend ({prevout {outpoint {b.id (), 0}, b.Outputs[0]}}, 1800, wrong);
+        bytes bad_script (BEEF {x.BUMPs, {x.Transactions[0], x.Transactions[1], BEEF::transaction {bytes (d), {}}}});
+        
+        BEEF_reader without_scripts {store};
+        EXPECT_TRUE (without_scripts.write (bad_script));
+        EXPECT_TRUE (without_scripts.complete ());
+        
+        BEEF_reader with_scripts {store, &ex, flags};
+        EXPECT_FALSE (with_scripts.write (bad_script));
+        EXPECT_EQ (with_scripts.why (), BEEF_reader::error::invalid_script);
+        EXPECT_EQ (with_scripts.transactions_read (), 2);
+        
+        // an unconfirmed transaction whose parent is not in the package.
+        BEEF missing {x.BUMPs, {x.Transactions[1], x.Transactions[2]}};
+        EXPECT_FALSE (missing.valid ());
+        BEEF_reader m {store};
+        EXPECT_FALSE (m.write (bytes (missing)));
+        EXPECT_EQ (m.why (), BEEF_reader::error::missing_parent);
+        
+        // a transaction that is not in its BUMP.
+        BEEF not_in_proof {x.BUMPs, {BEEF::transaction {bytes (b), 0}}};
+        EXPECT_FALSE (not_in_proof.valid ());
+        BEEF_reader n {store};
+        EXPECT_FALSE (n.write (bytes (not_in_proof)));
+        EXPECT_EQ (n.why (), BEEF_reader::error::not_in_proof);
+        
+        // an ancestor that the ledger doesn't have.
+        l.Transactions.erase (b.id ());
+        EXPECT_THROW (BEEF::make (l, bytes (c)), std::invalid_argument);
+    }
+    
+    // a ledger that is made into a coroutine ledger and back gives the same answers.
+    TEST (ScriptTest, TestAsyncLedger) {
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        test_ledger l {};
+        outpoint op {txid {uint256 {4000}}, 0};
+        l.Outputs[op] = output {satoshi {1000}, lock};
+        
+        incomplete::transaction incomplete {transaction::LatestVersion,
+            list<incomplete::input> {incomplete::input {op}},
+            list<output> {output {satoshi {900}, lock}}, 0};
+        transaction t = incomplete.complete (list<bytes> {
+            pay_to_address::redeem (key.sign (sighash::document {satoshi {1000}, lock, incomplete, 0}), pk)});
+        
+        boost::asio::thread_pool pool {2};
+        boost::asio::io_context loop;
+        auto work = boost::asio::make_work_guard (loop);
+        std::thread runner {[&loop] () {
+            loop.run ();
+        }};
+        
+        async_ledger_adapter async {l, pool.get_executor ()};
+        blocking_ledger blocking {async, loop.get_executor ()};
+        
+        ledger::vertex v = blocking.make_vertex (t);
+        EXPECT_TRUE (v.valid ());
+        EXPECT_EQ (v.fee (), satoshi {100});
+        EXPECT_EQ (v.edges ().size (), 1);
+        EXPECT_EQ (v[uint32_little {0}].spent (), satoshi {1000});
+        
+        // edges follow the inputs when they are changed.
+        ledger::vertex changed = v;
+        changed.Inputs = list<input> {};
+        EXPECT_EQ (changed.edges ().size (), 0);
+        EXPECT_EQ (changed.spent (), satoshi {0});
+        EXPECT_EQ (changed.fee_rate (), -900.0 / double (changed.serialized_size ()));
+        EXPECT_THROW (changed[uint32_little {0}], std::out_of_range);
+        
+        ledger::vertex w = wait (loop.get_executor (), async.make_vertex (t));
+        EXPECT_TRUE (w.valid ());
+        EXPECT_EQ (w.fee (), satoshi {100});
+        
+        work.reset ();
+        runner.join ();
+        pool.join ();
+    }
+    
+    // a ledger that only knows whole transactions, so prevouts are found in them.
+    struct transaction_ledger final : ledger {
+        hash_map<txid, bytes> Transactions;
+        mutable uint32 Fetched {0};
+        
+        list<block_header> headers (uint64) override {
+            return {};
+        }
+        
+        data::entry<bytes, confirmation> transaction (const txid &id) const override {
+            Fetched++;
+            auto t = Transactions.find (id);
+            if (t == Transactions.end ()) return {bytes {}, confirmation {}};
+            return {t->second, confirmation {}};
+        }
+        
+        block_header header (const digest256 &) const override {
+            return {};
+        }
+        
+        bytes block (const digest256 &) const override {
+            return {};
+        }
+    };
+    
+    TEST (ScriptTest, TestLedgerPrevouts) {
+        // a transaction with n outputs, worth value, value + 1, and so on.
+        auto make = [] (uint32 n, int64 value) -> transaction {
+            list<output> outs;
+            for (uint32 i = 0; i < n; i++) outs <<= output {satoshi {value + i}, bytes {0x51}};
+            return transaction {int32_little {1}, list<input> {input {outpoint::coinbase (), bytes {0x51, 0x51}, 0xffffffff}}, outs, 0};
+        };
+        
+        auto paid = [] (int64 value) -> output {
+            return output {satoshi {value}, bytes {0x51}};
+        };
+        
+        transaction a = make (3, 1000);
+        transaction b = make (2, 2000);
+        
+        transaction_ledger l {};
+        l.Transactions[a.id ()] = bytes (a);
+        l.Transactions[b.id ()] = bytes (b);
+        
+        // in the order of the outpoints, and each transaction is fetched once.
+        std::vector<outpoint> refs {outpoint {b.id (), 1}, outpoint {a.id (), 2}, outpoint {a.id (), 0}};
+        std::vector<output> outs = l.prevouts (refs).get ();
+        ASSERT_EQ (outs.size (), 3);
+        EXPECT_EQ (outs[0], paid (2001));
+        EXPECT_EQ (outs[1], paid (1002));
+        EXPECT_EQ (outs[2], paid (1000));
+        EXPECT_EQ (l.Fetched, 2);
+        
+        // an output that is not found is left invalid in its place.
+        l.Fetched = 0;
+        refs = {outpoint {a.id (), 1}, outpoint {txid {uint256 {5}}, 0}, outpoint {a.id (), 3}, outpoint {b.id (), 0}};
+        outs = l.prevouts (refs).get ();
+        ASSERT_EQ (outs.size (), 4);
+        EXPECT_EQ (outs[0], paid (1001));
+        EXPECT_FALSE (outs[1].valid ());
+        EXPECT_FALSE (outs[2].valid ());
+        EXPECT_EQ (outs[3], paid (2000));
+        EXPECT_EQ (l.Fetched, 3);
+        
+        // so a transaction that spends it is not valid.
+        transaction spends {int32_little {1}, list<input> {
+                input {outpoint {a.id (), 0}, bytes {}, 0xffffffff},
+                input {outpoint {txid {uint256 {5}}, 0}, bytes {}, 0xffffffff}},
+            list<output> {paid (500)}, 0};
+        ledger::vertex v = l.make_vertex (spends);
+        EXPECT_EQ (v.edges ().size (), 2);
+        EXPECT_EQ (v.edges ()[0].Output, paid (1000));
+        EXPECT_FALSE (v.edges ()[1].Output.valid ());
+        EXPECT_FALSE (v.valid ());
+    }
+    
+
+    // when metrics are not built, nothing is ever counted. 
+    TEST (ScriptTest, TestMetrics) {
+        
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        incomplete::transaction incomplete {transaction::LatestVersion, 
+            list<incomplete::input> {incomplete::input {outpoint {txid {uint256 {1000}}, 0}}}, 
+            list<output> {output {satoshi {900}, lock}}, 0};
+        
+        redemption_document doc {satoshi {1000}, incomplete, 0};
+        bytes unlock = pay_to_address::redeem (key.sign (sighash::document {doc.RedeemedValue, lock, incomplete, 0}), pk);
+        
+        metrics::reset ();
+        for (int i = 0; i < 3; i++) EXPECT_TRUE (interpreter::machine (unlock, lock, doc).run ());
+        
+        metrics::snapshot s = metrics::collect ();
+        uint64 expected = metrics::enabled ? 3 : 0;
+        EXPECT_EQ (s[metrics::scripts], expected);
+        EXPECT_EQ (s[metrics::signatures], expected);
+        EXPECT_EQ (s[metrics::script_run].Count, expected);
+        EXPECT_EQ (s[metrics::signature_verify].Count, expected);
+        
+        for (size_t b = 1; b < metrics::histogram::buckets; b++) {
+            EXPECT_LT (metrics::histogram::lower (b - 1), metrics::histogram::lower (b));
+            EXPECT_EQ (metrics::histogram::bucket (metrics::histogram::lower (b)), b);
+            EXPECT_EQ (metrics::histogram::bucket (metrics::histogram::lower (b) - 1), b - 1);
+        }
+        
+    }
+    
+    TEST (ScriptTest, TestTrace) {
+        
+        trace::context c = trace::context::read_traceparent ("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+        EXPECT_TRUE (c.valid ());
+        EXPECT_TRUE (c.Sampled);
+        EXPECT_EQ (c.Span, 0x00f067aa0ba902b7);
+        EXPECT_EQ (c.traceparent (), "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+        
+        EXPECT_FALSE (trace::context::read_traceparent ("00-00000000000000000000000000000000-00f067aa0ba902b7-01").valid ());
+        EXPECT_FALSE (trace::context::read_traceparent ("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7").valid ());
+        EXPECT_FALSE (trace::context::read_traceparent ("00-4bf92f3577b34da6a3ce929d0e0e473g-00f067aa0ba902b7-01").valid ());
+        
+        trace::collect ();
+        trace::set_sample_rate (1);
+        
+        {
+            trace::span outer {"test.outer", trace::context {}};
+            trace::span inner {"test.inner"};
+        }
+        
+        // there is no current span, so nothing is made.
+        {
+            trace::span none {"test.none"};
+        }
+        
+        trace::set_sample_rate (0);
+        std::vector<trace::record> records = trace::collect ();
+        JSON otlp = trace::OTLP (records);
+        
+        if constexpr (trace::enabled) {
+            ASSERT_EQ (records.size (), 2);
+            EXPECT_EQ (std::string {records[0].Name}, "test.inner");
+            EXPECT_EQ (records[0].Trace, records[1].Trace);
+            EXPECT_EQ (records[0].Parent, records[1].Span);
+            EXPECT_EQ (records[1].Parent, 0);
+            EXPECT_LE (records[1].Start, records[0].Start);
+            EXPECT_LE (records[0].End, records[1].End);
+            
+            const JSON &spans = otlp["resourceSpans"][0]["scopeSpans"][0]["spans"];
+            ASSERT_EQ (spans.size (), 2);
+            EXPECT_EQ (spans[0]["parentSpanId"], spans[1]["spanId"]);
+            EXPECT_FALSE (spans[1].contains ("parentSpanId"));
+        } else EXPECT_EQ (records.size (), 0);
+        
+    }
+    
+    TEST (ScriptTest, TestProfile) {
+        
+        secret key {secret::test, secp256k1::secret {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}}};
+        pubkey pk = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pk));
+        
+        incomplete::transaction incomplete {transaction::LatestVersion, 
+            list<incomplete::input> {incomplete::input {outpoint {txid {uint256 {1000}}, 0}}}, 
+            list<output> {output {satoshi {900}, lock}}, 0};
+        
+        redemption_document doc {satoshi {1000}, incomplete, 0};
+        bytes unlock = pay_to_address::redeem (key.sign (sighash::document {doc.RedeemedValue, lock, incomplete, 0}), pk);
+        
+        interpreter::profile total {};
+        for (int i = 0; i < 2; i++) {
+            interpreter::profile p {};
+            interpreter::machine m {unlock, lock, doc};
+            m.measure (p);
+            EXPECT_TRUE (m.run ());
+            
+            // P2PKH is run by the general interpreter when it is profiled.
+            EXPECT_EQ (p.Scripts, 1);
+            EXPECT_EQ (p[OP_CHECKSIG].Count, 1);
+            EXPECT_EQ (p[OP_DUP].Count, 1);
+            EXPECT_EQ (p[OP_HASH160].Count, 1);
+            EXPECT_EQ (p[OP_EQUALVERIFY].Count, 1);
+            EXPECT_GT (p[OP_DUP].Allocated, 0);
+            EXPECT_GE (p.PeakMemory, p[OP_DUP].PeakMemory);
+            EXPECT_GT (p.PeakMemory, 0);
+            total += p;
+        }
+
+        EXPECT_EQ (total.Scripts, 2);
+        EXPECT_EQ (total[OP_CHECKSIG].Count, 2);
+        
+        // two pushes, the code separator between the scripts and five more operations.
+        EXPECT_EQ (total.ranked ().size (), 8);
+        
+        std::stringstream folded;
+        total.write_folded (folded, "p2pkh");
+        EXPECT_NE (folded.str ().find ("p2pkh;OP_CHECKSIG "), string::npos);
+        
+        // stepping through is profiled too.
+        interpreter::profile s {};
+        interpreter::machine m {compile (program {OP_1, OP_2}), compile (program {OP_ADD, OP_3, OP_EQUAL})};
+        m.measure (s);
+        while (!m.Halt) m.step ();
+        EXPECT_TRUE (m.Result);
+        EXPECT_EQ (s.Scripts, 1);
+        EXPECT_EQ (s[OP_ADD].Count, 1);
+        EXPECT_EQ (s.operations (), 6);
+    }
+    
+    TEST (ScriptTest, TestBudget) {
+        bytes unlock = compile (program {OP_1});
+        
+        program loop {};
+        for (int i = 0; i < 500; i++) {
+            loop <<= OP_DUP;
+            loop <<= OP_DROP;
+        }
+        bytes lock = compile (loop);
+        
+        // one push, the code separator and the rest of the script.
+        uint64 operations = 1002;
+        
+        EXPECT_TRUE (interpreter::machine (unlock, lock).run ());
+        
+        interpreter::machine::budget enough {};
+        enough.Operations = operations;
+        
+        interpreter::machine a {unlock, lock};
+        a.limit (enough);
+        EXPECT_TRUE (a.run ());
+        
+        interpreter::machine::budget few {};
+        few.Operations = operations - 1;
+        
+        interpreter::machine b {unlock, lock};
+        b.limit (few);
+        EXPECT_EQ (b.run ().Error, SCRIPT_ERR_BUDGET_EXCEEDED);
+        
+        interpreter::machine::budget memory {};
+        memory.StackBytes = 64;
+        
+        interpreter::machine c {unlock, compile (program {OP_DUP, OP_DUP, OP_DROP, OP_DROP})};
+        c.limit (memory);
+        EXPECT_EQ (c.run ().Error, SCRIPT_ERR_BUDGET_EXCEEDED);
+        
+        interpreter::machine::budget time {};
+        time.Time = std::chrono::nanoseconds {1};
+        
+        interpreter::machine d {unlock, lock};
+        d.limit (time);
+        EXPECT_EQ (d.run ().Error, SCRIPT_ERR_BUDGET_EXCEEDED);
+        
+        // a script can be paused and resumed, with the budget kept across pauses.
+        interpreter::machine e {unlock, lock};
+        int calls = 1;
+        while (!e.advance (100)) calls++;
+        EXPECT_EQ (calls, 11);
+        EXPECT_TRUE (e.Result);
+        
+        interpreter::machine f {unlock, lock};
+        f.limit (few);
+        while (!f.advance (100)) EXPECT_FALSE (f.Halt);
+        EXPECT_EQ (f.Result.Error, SCRIPT_ERR_BUDGET_EXCEEDED);
+    }
+    
+    // random scripts give the same results however they are run.
+    TEST (ScriptTest, TestDifferential) {
+        std::mt19937_64 r {1};
+        std::vector<op> ops {OP_0, OP_1, OP_2, OP_16, OP_1NEGATE, OP_IF, OP_NOTIF, OP_ELSE, OP_ENDIF, OP_VERIFY,
+            OP_DUP, OP_DROP, OP_SWAP, OP_PICK, OP_ROLL, OP_TOALTSTACK, OP_FROMALTSTACK, OP_CAT, OP_SPLIT,
+            OP_NUM2BIN, OP_BIN2NUM, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_NUMEQUAL, OP_LESSTHAN,
+            OP_EQUAL, OP_SIZE, OP_LSHIFT, OP_SHA256, OP_CHECKSIG};
+        
+        interpreter::machine reused {bytes {}, bytes {}};
+        for (int i = 0; i < 500; i++) {
+            program unlock {};
+            for (size_t j = 0, n = r () % 4; j < n; j++) unlock <<= push_data (int (r () % 40) - 20);
+            
+            program lock {};
+            for (size_t j = 0, n = r () % 16; j < n; j++)
+                if (r () % 5 == 0) {
+                    bytes b (r () % 9);
+                    for (byte &x : b) x = byte (r ());
+                    lock <<= push_data (b);
+                } else lock <<= instruction {ops[r () % ops.size ()]};
+            
+            bytes u = compile (unlock);
+            bytes l = compile (lock);
+            uint32 flags = r () % 2 ? StandardScriptVerifyFlags (true, true) : StandardScriptVerifyFlags (false, false);
+            
+            interpreter::machine reference {u, l, flags};
+            reference.specialize_standard_scripts (false);
+            while (!reference.Halt) reference.step ();
+            
+            EXPECT_EQ (interpreter::machine (u, l, flags).run (), reference.Result) << u << " " << l;
+            
+            reused.reset (u, l, flags);
+            EXPECT_EQ (reused.run (), reference.Result) << u << " " << l;
+            
+            interpreter::machine paused {u, l, flags};
+            while (!paused.advance (3));
+            EXPECT_EQ (paused.Result, reference.Result) << u << " " << l;
+        }
+    }
+    
 }
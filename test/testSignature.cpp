@@ -6,8 +6,14 @@
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
 #include <gigamonkey/wif.hpp>
 #include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/schema/random.hpp>
+#include <gigamonkey/executor.hpp>
+#include <gigamonkey/warm_up.hpp>
 #include <sv/script/script.h>
+#include <sv/random.h>
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <thread>
 
 namespace Gigamonkey::Bitcoin {
     
@@ -127,6 +133,28 @@ namespace Gigamonkey::Bitcoin {
             EXPECT_EQ(changed_value, sighash::write(doc_changed_value, directive));
             EXPECT_EQ(added_input, sighash::write(doc_added_input, directive));
             
+            // writing the original preimage directly is the same as reconstructing the transaction. 
+            if (!sighash::has_fork_id(directive)) {
+                lazy_bytes_writer w;
+                w << sighash::reconstruct(doc, directive) << uint32_little{directive};
+                EXPECT_EQ(written, bytes(w));
+                
+                // with code separators to remove, more than one input, and inputs taken from precomputed. 
+                for (const sighash::document &x : {doc_added_code_separator, doc_added_input}) {
+                    lazy_bytes_writer r;
+                    r << sighash::reconstruct(x, directive) << uint32_little{directive};
+                    EXPECT_EQ(sighash::write(x, directive), bytes(r));
+                    EXPECT_EQ(sighash::write(sighash::document{x.RedeemedValue, x.ScriptCode, x.Transaction, x.InputIndex, 
+                        std::make_shared<const sighash::precomputed>(x.Transaction)}, directive), bytes(r));
+                }
+            }
+            
+            // precomputed data must not change anything. 
+            sighash::precomputed precomputed{doc.Transaction};
+            EXPECT_EQ(written, sighash::write(doc, directive, precomputed));
+            EXPECT_EQ(written, sighash::write(sighash::document{doc.RedeemedValue, doc.ScriptCode, doc.Transaction, doc.InputIndex, 
+                std::make_shared<const sighash::precomputed>(precomputed)}, directive));
+            
             EXPECT_EQ(Hash256(written), signature::hash(doc, directive));
             EXPECT_EQ(Hash256(mutate_same_output), signature::hash(doc_mutate_same_output, directive));
             EXPECT_EQ(Hash256(mutate_different_output), signature::hash(doc_mutate_different_output, directive));
@@ -182,6 +210,171 @@ namespace Gigamonkey::Bitcoin {
         EXPECT_TRUE(x1_4 == x1) << x1_4 << " vs " << x1;
         
     }
+    
+    TEST(SignatureTest, TestContextsFromManyThreads) {
+        
+        for (bool per_thread : {false, true}) {
+            secp256k1::per_thread_contexts(per_thread);
+            secp256k1::warm_contexts();
+            
+            std::vector<int> valid(8, 0);
+            std::vector<std::thread> threads;
+            for (uint32 i = 0; i < valid.size(); i++) threads.emplace_back([&valid, i]() {
+                secp256k1::warm_contexts();
+                secp256k1::secret key{uint256{1000 + i}};
+                digest256 d = Hash256(bytes(32, byte(i)));
+                bool ok = true;
+                for (int j = 0; j < 20; j++) ok = ok && key.to_public().verify(d, key.sign(d));
+                valid[i] = ok;
+            });
+            
+            for (std::thread &t : threads) t.join();
+            for (int v : valid) EXPECT_TRUE(v);
+        }
+        
+        secp256k1::per_thread_contexts(false);
+        
+    }
+    
+    TEST(SignatureTest, TestWarmUp) {
+        
+        warm_up_report r = warm_up();
+        EXPECT_EQ(r.Components.size(), 5);
+        
+        JSON j = JSON(r);
+        for (const auto &[name, time] : r.Components) {
+            EXPECT_GE(time.count(), 0);
+            EXPECT_EQ(j[name], time.count());
+        }
+        
+        // everything is ready already, so it is faster the second time.
+        EXPECT_LE(warm_up().total(), r.total() + std::chrono::milliseconds{10});
+        
+    }
+    
+    TEST(SignatureTest, TestParsedPubkey) {
+        
+        secp256k1::secret a{uint256{12345}};
+        secp256k1::secret b{uint256{67890}};
+        secp256k1::pubkey A = a.to_public();
+        secp256k1::pubkey B = b.to_public();
+        
+        secp256k1::parsed_pubkey pa{A};
+        secp256k1::parsed_pubkey pb{B};
+        EXPECT_TRUE(pa.valid() && pa.compressed());
+        EXPECT_FALSE(secp256k1::parsed_pubkey{bytes(33, 0x02)}.valid());
+        
+        EXPECT_EQ((pa + pb).serialize(), (a + b).to_public());
+        EXPECT_EQ((pa + pb).serialize(), A + B);
+        EXPECT_EQ((pa + b.Value).serialize(), (a + b).to_public());
+        EXPECT_EQ((pa * b.Value).serialize(), (a * b).to_public());
+        EXPECT_EQ((-pa).serialize(), (-a).to_public());
+        EXPECT_EQ((pa + pb + (-pb)).serialize(), A);
+        
+        // a point plus its negation is the point at infinity, which is not a pubkey.
+        EXPECT_FALSE((pa + (-pa)).valid());
+        EXPECT_EQ((pa + (-pa)).serialize(), secp256k1::pubkey{});
+        
+        secp256k1::parsed_pubkey uncompressed = pa.decompress();
+        EXPECT_FALSE(uncompressed.compressed());
+        EXPECT_EQ(uncompressed.serialize(), A.decompress());
+        EXPECT_EQ(secp256k1::parsed_pubkey{A.decompress()}.compress().serialize(), A);
+        EXPECT_EQ((uncompressed + b.Value).serialize(), (a + b).to_public().decompress());
+        
+        digest256 d = Hash256(bytes(32, 0x07));
+        EXPECT_TRUE(pa.verify(d, a.sign(d)));
+        EXPECT_FALSE(pa.verify(d, b.sign(d)));
+        EXPECT_TRUE((pa + pb).verify(d, (a + b).sign(d)));
+        
+    }
+    
+    TEST(SignatureTest, TestStrictSignature) {
+        
+        secp256k1::secret a{uint256{12345}};
+        digest256 d = Hash256(bytes(32, 0x07));
+        secp256k1::signature sig = a.sign(d);
+        
+        secp256k1::parsed_signature strict = secp256k1::parsed_signature::strict(sig);
+        EXPECT_TRUE(strict.valid() && strict.strict_DER() && strict.low_S());
+        EXPECT_TRUE(secp256k1::parsed_pubkey{a.to_public()}.verify(d, strict));
+        
+        // R = 1 and S = 1; S = 0x7fff...ff, which is high; S more than the order;
+        // R with a zero that it doesn't need; and a signature cut short.
+        bytes high = *bytes::from_hex("302502010102207fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+        bytes overflow = *bytes::from_hex("3026020101022100ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+        for (const bytes &x : {*bytes::from_hex("3006020101020101"), high, overflow,
+            *bytes::from_hex("300702020001020101"), bytes(bytes_view(sig).substr(0, sig.size() - 1))}) {
+            secp256k1::parsed_signature p = secp256k1::parsed_signature::strict(x);
+            EXPECT_EQ(p.strict_DER(), secp256k1::signature::minimal(x));
+            if (p.strict_DER()) EXPECT_EQ(p.low_S(), secp256k1::signature::normalized(x));
+        }
+        
+        EXPECT_FALSE(secp256k1::parsed_signature::strict(high).low_S());
+        EXPECT_TRUE(secp256k1::parsed_signature::strict(high).valid());
+        EXPECT_FALSE(secp256k1::parsed_signature::strict(overflow).valid());
+        EXPECT_FALSE(secp256k1::parsed_signature{}.valid());
+        
+    }
+    
+    TEST(SignatureTest, TestSigningKey) {
+        
+        EXPECT_FALSE(secp256k1::signing_key{secp256k1::secret{uint256{0}}}.valid());
+        EXPECT_EQ(secp256k1::signing_key{secp256k1::secret{uint256{0}}}.sign(Hash256(bytes(32, 0x01))), secp256k1::signature{});
+        
+        // a digest that is more than the order of the curve, which is reduced for the nonce.
+        digest256 high{};
+        std::fill(high.Value.begin(), high.Value.end(), 0xff);
+        
+        std::vector<digest256> digests{high};
+        for (int i = 0; i < 40; i++) digests.push_back(Hash256(bytes(32, byte(i))));
+        
+        executor pool{4};
+        for (const secp256k1::secret &key : {secp256k1::secret{uint256{1}}, secp256k1::secret{uint256{12345}},
+            secp256k1::secret{secp256k1::secret::order() - 1}}) {
+            secp256k1::signing_key k{key};
+            EXPECT_TRUE(k.valid());
+            
+            for (const digest256 &d : digests) EXPECT_EQ(k.sign(d), key.sign(d));
+            
+            std::vector<secp256k1::signature> in_order = k.sign(digests);
+            std::vector<secp256k1::signature> parallel = k.sign(digests, &pool);
+            ASSERT_EQ(parallel.size(), digests.size());
+            EXPECT_EQ(parallel, in_order);
+            for (size_t i = 0; i < digests.size(); i++) EXPECT_TRUE(key.to_public().verify(digests[i], parallel[i]));
+        }
+        
+    }
+    
+    TEST(SignatureTest, TestThreadRandom) {
+        
+        uint256 a = GetThreadRandHash();
+        uint256 b = GetThreadRandHash();
+        EXPECT_NE(a, b);
+        
+        // more than one block of output, which is more than GetStrongRandBytes allows.
+        bytes big(100000, 0);
+        GetThreadRandBytes(big.data(), big.size());
+        EXPECT_NE(big, bytes(100000, 0));
+        
+        bitcoind_random r{};
+        bytes x(1000, 0);
+        bytes y(1000, 0);
+        r.get(x.data(), x.size());
+        r.get(y.data(), y.size());
+        EXPECT_NE(x, y);
+        
+        // each thread has its own state, so no two should agree.
+        std::vector<uint64_t> values(8, 0);
+        std::vector<std::thread> threads;
+        for (uint32 i = 0; i < values.size(); i++) threads.emplace_back([&values, i]() {
+            values[i] = GetThreadRand64();
+        });
+        
+        for (std::thread &t : threads) t.join();
+        std::sort(values.begin(), values.end());
+        EXPECT_EQ(std::adjacent_find(values.begin(), values.end()), values.end());
+        
+    }
 
 }
 
@@ -5,8 +5,27 @@
 #include <gigamonkey/stratum/mining_authorize.hpp>
 #include <gigamonkey/stratum/mining_subscribe.hpp>
 #include <gigamonkey/stratum/job.hpp>
+#include <gigamonkey/stratum/server_session.hpp>
+#include <gigamonkey/stratum/share_pipeline.hpp>
+#include <gigamonkey/stratum/job_manager.hpp>
+#include <gigamonkey/stratum/vardiff.hpp>
+#include <gigamonkey/stratum/fast_json.hpp>
+#include <gigamonkey/stratum/binary_framing.hpp>
+#include <gigamonkey/stratum/remote.hpp>
+#include <gigamonkey/stratum/extranonce_allocator.hpp>
+#include <gigamonkey/stratum/share_ledger.hpp>
+#include <gigamonkey/stratum/share_log.hpp>
+#include <gigamonkey/stratum/exporter.hpp>
+#include <gigamonkey/stratum/proxy.hpp>
+#include <gigamonkey/stratum/session_handoff.hpp>
+#include <gigamonkey/stratum/server.hpp>
+#include <gigamonkey/stratum/rate_limit.hpp>
+#include <gigamonkey/stratum/failover.hpp>
 #include <gigamonkey/work/ASICBoost.hpp>
 #include <data/net/session.hpp>
+#include <algorithm>
+#include <thread>
+#include <stdlib.h>
 #include "gtest/gtest.h"
 
 namespace Gigamonkey::Stratum {
@@ -393,6 +412,1458 @@ namespace Gigamonkey::Stratum::mining {
     TEST (StratumTest, TestMiningConfigure) {
         //extensions::requests{ };
     }
+    
+    TEST (StratumTest, TestJobHistory) {
+        using history = server_session::state::history;
+        
+        auto job = [] (const job_id &id, uint32 now, bool clean) {
+            mining::notify::parameters p {};
+            p.JobID = id;
+            p.Now = Bitcoin::timestamp {now};
+            p.Clean = clean;
+            return p;
+        };
+        
+        history h {60, 3};
+        EXPECT_EQ (h.find ("a"), nullptr);
+        
+        EXPECT_EQ (h.push ({}, {}, job ("a", 100, true)), 0);
+        EXPECT_EQ (h.push ({}, {}, job ("b", 110, false)), 0);
+        
+        const history::entry *a = h.find ("a");
+        const history::entry *b = h.find ("b");
+        ASSERT_NE (a, nullptr);
+        ASSERT_NE (b, nullptr);
+        EXPECT_EQ (a->Notification.JobID, "a");
+        EXPECT_FALSE (h.stale (*a));
+        EXPECT_FALSE (h.stale (*b));
+        
+        // a clean job makes the older ones stale.
+        EXPECT_EQ (h.push ({}, {}, job ("c", 120, true)), 0);
+        EXPECT_TRUE (h.stale (*h.find ("a")));
+        EXPECT_TRUE (h.stale (*h.find ("b")));
+        EXPECT_FALSE (h.stale (*h.find ("c")));
+        EXPECT_EQ (h.size (), 3);
+        
+        h.find ("a")->StaleShares += 2;
+        
+        // the ring is full, so the oldest job is forgotten.
+        EXPECT_EQ (h.push ({}, {}, job ("d", 130, false)), 2);
+        EXPECT_EQ (h.find ("a"), nullptr);
+        EXPECT_NE (h.find ("d"), nullptr);
+        EXPECT_EQ (h.size (), 3);
+        EXPECT_EQ (h.evicted_stale_shares (), 2);
+        
+        // jobs that are too old are forgotten.
+        EXPECT_EQ (h.push ({}, {}, job ("e", 185, false)), 0);
+        EXPECT_EQ (h.find ("b"), nullptr);
+        EXPECT_EQ (h.find ("c"), nullptr);
+        EXPECT_NE (h.find ("d"), nullptr);
+        EXPECT_EQ (h.size (), 2);
+    }
+    
+    TEST (StratumTest, TestShareSet) {
+        share_set s {};
+        EXPECT_EQ (s.size (), 0);
+        
+        EXPECT_TRUE (s.insert (uint256 {7}));
+        EXPECT_FALSE (s.insert (uint256 {7}));
+        EXPECT_FALSE (s.insert (uint64 {7}));
+        
+        // zero means an empty slot, so it is kept as 1.
+        EXPECT_TRUE (s.insert (uint256 {0}));
+        EXPECT_FALSE (s.insert (uint64 {1}));
+        EXPECT_EQ (s.size (), 2);
+        
+        // far past the 16 slots that we start with. The first of these all begin at the same slot.
+        for (uint64 i = 1; i <= 500; i++) EXPECT_TRUE (s.insert (i << 32)) << i;
+        for (uint64 i = 1; i <= 500; i++) EXPECT_TRUE (s.insert (i * 0x9e3779b97f4a7c15)) << i;
+        EXPECT_EQ (s.size (), 1002);
+        EXPECT_EQ (s.hashes ().size (), 1002);
+        
+        EXPECT_FALSE (s.insert (uint256 {7}));
+        EXPECT_FALSE (s.insert (uint64 {1}));
+        for (uint64 i = 1; i <= 500; i++) {
+            EXPECT_FALSE (s.insert (i << 32)) << i;
+            EXPECT_FALSE (s.insert (i * 0x9e3779b97f4a7c15)) << i;
+        }
+        EXPECT_EQ (s.size (), 1002);
+        
+        // shares are forgotten with their jobs.
+        using history = server_session::state::history;
+        
+        auto job = [] (const job_id &id, uint32 now, bool clean) {
+            mining::notify::parameters p {};
+            p.JobID = id;
+            p.Now = Bitcoin::timestamp {now};
+            p.Clean = clean;
+            return p;
+        };
+        
+        history h {60, 3};
+        h.push ({}, {}, job ("a", 100, true));
+        h.push ({}, {}, job ("b", 101, false));
+        h.push ({}, {}, job ("c", 102, false));
+        EXPECT_TRUE (h.find ("a")->Shares.insert (uint64 {5}));
+        EXPECT_TRUE (h.find ("b")->Shares.insert (uint64 {6}));
+        EXPECT_TRUE (h.find ("c")->Shares.insert (uint64 {7}));
+        
+        // a leaves the ring and comes back without its shares.
+        h.push ({}, {}, job ("d", 103, false));
+        EXPECT_EQ (h.find ("a"), nullptr);
+        h.push ({}, {}, job ("a", 104, false));
+        EXPECT_EQ (h.find ("b"), nullptr);
+        EXPECT_EQ (h.find ("a")->Shares.size (), 0);
+        EXPECT_TRUE (h.find ("a")->Shares.insert (uint64 {5}));
+        EXPECT_FALSE (h.find ("c")->Shares.insert (uint64 {7}));
+        
+        // a clean job makes the others stale and their shares are forgotten.
+        h.push ({}, {}, job ("e", 105, true));
+        EXPECT_EQ (h.find ("c"), nullptr);
+        EXPECT_TRUE (h.stale (*h.find ("d")));
+        EXPECT_TRUE (h.stale (*h.find ("a")));
+        EXPECT_EQ (h.find ("d")->Shares.size (), 0);
+        EXPECT_EQ (h.find ("a")->Shares.size (), 0);
+        EXPECT_EQ (h.find ("e")->Shares.size (), 0);
+        
+        // a share that is submitted twice to a session is a duplicate the second time.
+        struct messages final : net::session<JSON> {
+            std::vector<JSON> Sent {};
+            
+            void send (JSON j) override {
+                Sent.push_back (j);
+            }
+            
+            bool closed () override {
+                return false;
+            }
+            
+            void close () override {}
+        };
+        
+        struct test_session final : server_session {
+            test_session (ptr<net::session<JSON>> p) : server_session {p, server_session::options {}} {}
+        
+        private:
+            optional<error> authorize (const mining::authorize_request::parameters &) override {
+                return {};
+            }
+            
+            mining::subscribe_response::parameters subscribe (const mining::subscribe_request::parameters &) override {
+                return {{mining::subscription {mining_notify, "1"}}, {1, 8}};
+            }
+        };
+        
+        auto sent = std::make_shared<messages> ();
+        test_session session {sent};
+        session.receive_line (mining::subscribe_request {1, "test miner"}.dump ());
+        ASSERT_TRUE (session.subscribed ());
+        
+        Bitcoin::timestamp now = Bitcoin::timestamp::now ();
+        session.send_set_difficulty (Stratum::difficulty {uint64 {1}});
+        session.send_notify (mining::notify::parameters {"a", uint256 {1}, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+            {}, int32_little {2}, work::compact {work::difficulty (.0001)}, now, true});
+        
+        auto submit = [&session, &sent, now] (const message_id &id, const job_id &jid, uint32 n) -> response {
+            session.receive_line (mining::submit_request {id, share {"alice", jid, bytes (8, 0), now, nonce {n}}}.dump ());
+            return response {sent->Sent.back ()};
+        };
+        
+        response r = submit (2, "a", 0);
+        EXPECT_EQ (r.id (), message_id {2});
+        if (r.error ()) EXPECT_NE (r.error ()->Code, DUPLICATE_SHARE);
+        
+        r = submit (3, "a", 0);
+        EXPECT_EQ (r.id (), message_id {3});
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, DUPLICATE_SHARE);
+        
+        r = submit (4, "a", 1);
+        if (r.error ()) EXPECT_NE (r.error ()->Code, DUPLICATE_SHARE);
+    }
+    
+    TEST (StratumTest, TestSessionSnapshot) {
+        using state = server_session::state;
+        
+        auto job = [] (const job_id &id, uint32 now, bool clean) {
+            return mining::notify::parameters {id, uint256 {1}, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+                Merkle::digests {} << digest256 {uint256 {2}} << digest256 {uint256 {3}}, int32_little {2},
+                work::compact {work::difficulty (.0001)}, Bitcoin::timestamp {now}, clean};
+        };
+        
+        server_session::options o {};
+        state s {o};
+        s.set_name ("alice");
+        s.set_client_version ("miner 1.0");
+        s.set_minimum_difficulty (Stratum::difficulty {uint64 {8}});
+        s.set_version_mask (extensions::version_mask {0x1fffe000});
+        s.notify (job ("a", 100, true));
+        s.notify (job ("b", 110, true));
+        s.notify (job ("c", 120, false));
+        s.Notifies.find ("a")->StaleShares = 3;
+        s.Notifies.find ("c")->Shares.insert (uint64 {12345});
+        
+        bytes snapshot = s.snapshot ();
+        maybe<state> restored = state::restore (o, snapshot);
+        ASSERT_TRUE (bool (restored));
+        EXPECT_EQ (restored->snapshot (), snapshot);
+        EXPECT_EQ (restored->name (), "alice");
+        EXPECT_EQ (restored->client_version (), optional<string> {"miner 1.0"});
+        EXPECT_EQ (restored->version_mask (), s.version_mask ());
+        EXPECT_EQ (double (work::difficulty (restored->minimum_difficulty ())), 8);
+        
+        // the jobs are resumed with their shares and whether they are stale.
+        ASSERT_EQ (restored->Notifies.size (), 3);
+        EXPECT_TRUE (restored->Notifies.stale (*restored->Notifies.find ("a")));
+        EXPECT_FALSE (restored->Notifies.stale (*restored->Notifies.find ("b")));
+        EXPECT_EQ (restored->Notifies.find ("a")->StaleShares, 3);
+        EXPECT_EQ (restored->Notifies.find ("c")->Notification, job ("c", 120, false));
+        EXPECT_FALSE (restored->Notifies.find ("c")->Shares.insert (uint64 {12345}));
+        
+        EXPECT_FALSE (bool (state::restore (o, bytes_view {snapshot}.substr (0, snapshot.size () - 1))));
+        EXPECT_FALSE (bool (state::restore (o, bytes {})));
+        
+        bytes longer = snapshot;
+        longer.push_back (0);
+        EXPECT_FALSE (bool (state::restore (o, longer)));
+        
+        // snapshots from before binary framing are not read.
+        bytes older = snapshot;
+        older[0] = 1;
+        EXPECT_FALSE (bool (state::restore (o, older)));
+        
+        // a snapshot is taken once.
+        session_handoff::memory handoff {60};
+        handoff.put (session_id {7}, snapshot, 1000);
+        EXPECT_FALSE (bool (handoff.take (session_id {8}, 1001)));
+        EXPECT_EQ (handoff.take (session_id {7}, 1001), maybe<bytes> {snapshot});
+        EXPECT_FALSE (bool (handoff.take (session_id {7}, 1002)));
+        
+        // and not after it expires.
+        handoff.put (session_id {7}, snapshot, 1000);
+        EXPECT_EQ (handoff.size (), 1);
+        EXPECT_FALSE (bool (handoff.take (session_id {7}, 1060)));
+        EXPECT_EQ (handoff.size (), 0);
+    }
+    
+    TEST (StratumTest, TestSharePipeline) {
+        
+        job_id jid = "2333";
+        extranonce en {1, 8};
+        Bitcoin::timestamp timestamp {3};
+        
+        work::compact d {work::difficulty (.0001)};
+        digest256 prevHash {"0x0000000000000000000000000000000000000000000000000000000000000001"};
+        bytes gentx1 = *bytes::from_hex ("abcdef");
+        bytes gentx2 = *bytes::from_hex ("010203");
+        bytes extra_nonce_2 = *bytes::from_hex ("abcdef0123456789");
+        
+        string name {"Daniel"};
+        
+        mining::notify::parameters notify {jid, prevHash, gentx1, gentx2, {}, int32_little {2}, d, timestamp, true};
+        
+        auto w1 = worker {name, en};
+        auto w2 = worker {name, en, work::ASICBoost::Mask};
+        
+        std::vector<share> shares {
+            share {name, jid, work::share {timestamp, 65067, extra_nonce_2}},
+            share {name, jid, work::share {timestamp, 449600, extra_nonce_2, int32_little (0xffffffff)}},
+            share {name, jid, work::share {timestamp, 1, extra_nonce_2}},
+            share {name, "other", work::share {timestamp, 65067, extra_nonce_2}}};
+        
+        std::vector<worker> workers {w1, w2, w1, w1};
+        auto j1 = std::make_shared<prepared_job> (w1, notify);
+        auto j2 = std::make_shared<prepared_job> (w2, notify);
+        std::vector<ptr<const prepared_job>> jobs {j1, j2, j1, j1};
+        
+        std::vector<share_pipeline::result> results;
+        std::vector<share> delivered;
+        
+        {
+            executor e {2};
+            share_pipeline pipeline {e, 3};
+            
+            for (int round = 0; round < 5; round++) for (size_t i = 0; i < shares.size (); i++)
+                pipeline.submit (jobs[i], shares[i], d, [&] (const share &x, const share_pipeline::result &r) {
+                    delivered.push_back (x);
+                    results.push_back (r);
+                });
+        }
+        
+        ASSERT_EQ (results.size (), 5 * shares.size ());
+        for (size_t i = 0; i < results.size (); i++) {
+            size_t k = i % shares.size ();
+            EXPECT_TRUE (delivered[i] == shares[k]);
+            
+            proof p {workers[k], notify, shares[k]};
+            EXPECT_EQ (results[i].Valid, p.valid ());
+            EXPECT_EQ (results[i].Solved, p.valid ());
+            if (k < 3) EXPECT_EQ (results[i].Header, work::proof (p).string ().write ());
+        }
+        
+        EXPECT_TRUE (results[0].Valid);
+        EXPECT_TRUE (results[1].Valid);
+        EXPECT_FALSE (results[2].Valid);
+        EXPECT_FALSE (results[3].Valid);
+        
+        // a share submitted while a line is parsed is part of its trace.
+        trace::collect ();
+        trace::set_sample_rate (1);
+        trace::context parsed {};
+        {
+            executor e {1};
+            share_pipeline pipeline {e, 1};
+            trace::span parsing {"stratum.parse", trace::context {}};
+            parsed = parsing.context ();
+            pipeline.submit (jobs[0], shares[0], d, [] (const share &, const share_pipeline::result &) {});
+        }
+        
+        trace::set_sample_rate (0);
+        std::vector<trace::record> records = trace::collect ();
+        if constexpr (trace::enabled) {
+            auto submitted = std::find_if (records.begin (), records.end (), [] (const trace::record &r) {
+                return std::string {r.Name} == "stratum.submit";
+            });
+            
+            ASSERT_NE (submitted, records.end ());
+            EXPECT_EQ (submitted->Parent, parsed.Span);
+        } else EXPECT_EQ (records.size (), 0);
+    }
+    
+    TEST (StratumTest, TestVersionMidstates) {
+        
+        job_id jid = "2334";
+        extranonce en {1, 8};
+        Bitcoin::timestamp timestamp {3};
+        
+        work::compact d {work::difficulty (.0001)};
+        digest256 prevHash {"0x0000000000000000000000000000000000000000000000000000000000000001"};
+        mining::notify::parameters notify {jid, prevHash, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+            {}, int32_little {2}, d, timestamp, true};
+        
+        string name {"Daniel"};
+        worker w {name, en, work::ASICBoost::Mask};
+        
+        auto plain = std::make_shared<prepared_job> (w, notify);
+        auto rolled = std::make_shared<prepared_job> (w, notify, 4);
+        
+        mining::set_midstates::parameters m = rolled->midstates ();
+        EXPECT_EQ (m.JobID, jid);
+        EXPECT_EQ (m.ExtraNonce2, bytes (8, 0));
+        ASSERT_EQ (m.Midstates.size (), 4);
+        for (size_t i = 0; i < 4; i++) for (size_t j = 0; j < i; j++) EXPECT_NE (m.Midstates[i].Bits, m.Midstates[j].Bits);
+        EXPECT_EQ (plain->midstates ().Midstates.size (), 0);
+        
+        // without a version mask there is only one.
+        EXPECT_EQ (prepared_job (worker {name, en}, notify, 4).midstates ().Midstates.size (), 1);
+        
+        mining::set_midstates n {m};
+        EXPECT_TRUE (n.valid ());
+        EXPECT_EQ (n.params (), m);
+        EXPECT_EQ (method_from_string ("mining.set_midstates"), mining_set_midstates);
+        
+        // the midstate gives the same hash as the whole header.
+        std::vector<share> shares;
+        for (const auto &x : m.Midstates) for (uint32 nonce = 0; nonce < 16; nonce++) {
+            share z {name, jid, work::share {timestamp, nonce, m.ExtraNonce2, x.Bits}};
+            const sha256::state *s = rolled->midstate (z);
+            ASSERT_NE (s, nullptr);
+            EXPECT_EQ (*s, x.State);
+            
+            byte_array<80> h = plain->header (z);
+            EXPECT_EQ (rolled->header (z), h);
+            EXPECT_TRUE (std::equal (m.RootTail.begin (), m.RootTail.end (), h.begin () + 64));
+            
+            uint256 hash;
+            sha256::double_hash_80 (hash.data (), *s, h.data () + 64, 1);
+            EXPECT_EQ (hash, Bitcoin::Hash256 (h).Value);
+            shares.push_back (z);
+        }
+        
+        // shares that were not made from a midstate are checked as usual.
+        share other {name, jid, work::share {timestamp, 65067, *bytes::from_hex ("abcdef0123456789"), int32_little {0}}};
+        EXPECT_EQ (rolled->midstate (other), nullptr);
+        shares.push_back (other);
+        
+        std::vector<share_pipeline::result> expected;
+        std::vector<share_pipeline::result> results;
+        
+        {
+            executor e {2};
+            share_pipeline pipeline {e, 8};
+            
+            for (const share &x : shares) {
+                pipeline.submit (plain, x, d, [&] (const share &, const share_pipeline::result &r) {
+                    expected.push_back (r);
+                });
+                
+                pipeline.submit (rolled, x, d, [&] (const share &, const share_pipeline::result &r) {
+                    results.push_back (r);
+                });
+            }
+        }
+        
+        ASSERT_EQ (results.size (), shares.size ());
+        ASSERT_EQ (expected.size (), shares.size ());
+        for (size_t i = 0; i < shares.size (); i++) {
+            EXPECT_EQ (results[i].Hash, expected[i].Hash);
+            EXPECT_EQ (results[i].Valid, expected[i].Valid);
+            EXPECT_EQ (results[i].Valid, (proof {w, notify, shares[i]}.valid ()));
+        }
+        
+        // negotiating the extension.
+        extensions::configuration<extensions::version_midstates> requested {8};
+        EXPECT_EQ (extensions::configuration<extensions::version_midstates>::read (extensions::request (requested))->Count, 8);
+        EXPECT_EQ (extensions::parameters<extensions::version_midstates>::make (4, requested), optional<byte> {4});
+        EXPECT_FALSE (extensions::parameters<extensions::version_midstates>::make (0, requested));
+        EXPECT_EQ (extensions::extension_from_string ("version_midstates"), extensions::version_midstates);
+        
+        // a session that has negotiated the extension is sent midstates for each job.
+        server_session::options o {};
+        o.ExtensionsParameters = extensions::options {};
+        o.ExtensionsParameters->MaxVersionMidstates = 4;
+        
+        server_session::state session {o};
+        session.set_name (name);
+        session.set_version_mask (work::ASICBoost::Mask);
+        
+        auto configured = session.configure (extensions::requests {}.insert (requested));
+        ASSERT_TRUE (bool (configured));
+        EXPECT_TRUE (bool (configured->contains ("version_midstates")->Accepted));
+        EXPECT_EQ (session.version_midstates (), 4);
+        
+        // not until the job has been sent.
+        EXPECT_FALSE (bool (session.midstates (notify)));
+        session.notify (notify);
+        
+        maybe<mining::set_midstates::parameters> sent = session.midstates (notify);
+        ASSERT_TRUE (bool (sent));
+        EXPECT_EQ (*sent, prepared_job (worker {name, extranonce {}, work::ASICBoost::Mask}, notify, 4).midstates ());
+        EXPECT_EQ (server_session::state::restore (o, session.snapshot ())->version_midstates (), 4);
+        
+        // a server that does not support it says so and sends nothing.
+        o.ExtensionsParameters->MaxVersionMidstates = 0;
+        server_session::state unsupported {o};
+        configured = unsupported.configure (extensions::requests {}.insert (requested));
+        ASSERT_TRUE (bool (configured));
+        EXPECT_FALSE (bool (configured->contains ("version_midstates")->Accepted));
+        unsupported.notify (notify);
+        EXPECT_FALSE (bool (unsupported.midstates (notify)));
+    }
+    
+    TEST (StratumTest, TestJobManager) {
+        
+        work::compact d {work::difficulty (.0001)};
+        digest256 prevHash {"0x0000000000000000000000000000000000000000000000000000000000000001"};
+        bytes gentx1 = *bytes::from_hex ("abcdef");
+        bytes gentx2 = *bytes::from_hex ("010203");
+        bytes extra_nonce_2 = *bytes::from_hex ("abcdef0123456789");
+        Bitcoin::timestamp timestamp {3};
+        extranonce en {1, 8};
+        string name {"Daniel"};
+        
+        auto w1 = worker {name, en};
+        auto w2 = worker {name, en, work::ASICBoost::Mask};
+        
+        job_manager jobs {2};
+        EXPECT_EQ (jobs.current (), nullptr);
+        EXPECT_EQ (jobs.refresh (timestamp), nullptr);
+        EXPECT_THROW (jobs.update (work::candidate {}, gentx1, gentx2, timestamp), std::invalid_argument);
+        
+        auto j0 = jobs.update (work::candidate {int32_little {2}, prevHash, d, Merkle::path {0, {}}}, gentx1, gentx2, timestamp);
+        mining::notify::parameters notify {"0", prevHash, gentx1, gentx2, {}, int32_little {2}, d, timestamp, true};
+        EXPECT_EQ (j0->Notify, notify);
+        EXPECT_EQ (j0->Line, mining::notify::line (notify));
+        EXPECT_EQ (jobs.current (), j0);
+        EXPECT_TRUE (j0->session (w2) == (job {w2, notify}));
+        
+        // the same shares as in TestSharePipeline.
+        share s1 {name, "0", work::share {timestamp, 65067, extra_nonce_2}};
+        share s2 {name, "0", work::share {timestamp, 449600, extra_nonce_2, int32_little (0xffffffff)}};
+        
+        auto p1 = j0->prepared ();
+        auto p2 = j0->prepared (work::ASICBoost::Mask);
+        EXPECT_EQ (p1, j0->prepared ());
+        EXPECT_NE (p1, p2);
+        
+        work::proof x1 {proof {w1, notify, s1}};
+        work::proof x2 {proof {w2, notify, s2}};
+        EXPECT_EQ (p1->hash (x1.Solution), x1.string ().hash ());
+        EXPECT_EQ (p2->hash (x2.Solution), x2.string ().hash ());
+        EXPECT_TRUE (p1->valid (x1.Solution));
+        EXPECT_TRUE (p2->valid (x2.Solution));
+        
+        // a new time is not a clean job.
+        auto j1 = jobs.refresh (Bitcoin::timestamp {4});
+        EXPECT_EQ (j1->Notify.JobID, "1");
+        EXPECT_FALSE (j1->Notify.Clean);
+        EXPECT_EQ (j1->Notify.Digest, prevHash);
+        EXPECT_FALSE (jobs.stale (*j0));
+        
+        auto j2 = jobs.update (work::candidate {int32_little {2}, digest256 {"0x0000000000000000000000000000000000000000000000000000000000000002"}, d, Merkle::path {0, {}}}, gentx1, gentx2, timestamp);
+        EXPECT_EQ (j2->Notify.JobID, "2");
+        EXPECT_TRUE (jobs.stale (*j0));
+        EXPECT_TRUE (jobs.stale (*j1));
+        EXPECT_FALSE (jobs.stale (*j2));
+        
+        // only two jobs are remembered.
+        EXPECT_EQ (jobs.find ("0"), nullptr);
+        EXPECT_EQ (jobs.find ("1"), j1);
+        EXPECT_EQ (jobs.find ("2"), j2);
+        EXPECT_EQ (jobs.find ("02"), nullptr);
+        EXPECT_EQ (jobs.find ("3"), nullptr);
+        EXPECT_EQ (jobs.find ("x"), nullptr);
+        
+        EXPECT_EQ (job_manager::id (255), "ff");
+        EXPECT_EQ (job_manager::sequence ("ff"), maybe<uint64> {255});
+        EXPECT_FALSE (bool (job_manager::sequence ("")));
+    }
+    
+    TEST (StratumTest, TestBoostJobs) {
+        
+        Bitcoin::secret key (Bitcoin::secret::main, secp256k1::secret (uint256 (5555)));
+        uint256 content {};
+        content[7] = 0x99;
+        work::compact target {32, 0x0080ff};
+        Bitcoin::timestamp now {1000};
+        Stratum::session_id n1 {353};
+        
+        Bitcoin::txid id {};
+        id[0] = 1;
+        bytes bounty = Boost::output_script::bounty (0x21e8, content, target, bytes {}, 81, bytes (40, 0x11), false).write ();
+        
+        job_manager jobs {4};
+        Boost::job_index index {};
+        EXPECT_EQ (jobs.update (index, key, now), nullptr);
+        EXPECT_THROW (jobs.update (Boost::puzzle {}, now), std::invalid_argument);
+        
+        EXPECT_TRUE (index.add (Bitcoin::outpoint {id, 0}, Bitcoin::satoshi {1000}, bounty));
+        auto j0 = jobs.update (index, key, now);
+        ASSERT_NE (j0, nullptr);
+        EXPECT_TRUE (j0->Notify.Clean);
+        EXPECT_EQ (j0->Bounty->Script, bounty);
+        
+        // the miner sees the Boost puzzle as an ordinary job.
+        work::puzzle expected (*j0->Bounty);
+        work::puzzle notified (j0->Notify);
+        EXPECT_EQ (notified.Candidate.Digest, expected.Candidate.Digest);
+        EXPECT_EQ (notified.Candidate.Category, expected.Candidate.Category);
+        EXPECT_EQ (notified.Header, expected.Header);
+        EXPECT_EQ (notified.Body, expected.Body);
+        
+        // the same bounty again is not clean, and neither is a new time.
+        EXPECT_FALSE (jobs.update (index, key, now)->Notify.Clean);
+        auto j1 = jobs.refresh (Bitcoin::timestamp {1001});
+        EXPECT_FALSE (j1->Notify.Clean);
+        EXPECT_EQ (j1->Bounty->Script, bounty);
+        
+        work::proof p = work::cpu_solve (expected, work::solution {work::share {now, 0, bytes (8, 0x02)}, n1});
+        ASSERT_TRUE (p.valid ());
+        EXPECT_TRUE (j0->prepared ()->valid (p.Solution));
+        EXPECT_TRUE (j0->prepared (work::ASICBoost::Mask)->valid (p.Solution));
+        EXPECT_TRUE (j0->bounty (n1, p.Solution.Share).valid ());
+        
+        // without general purpose bits, extra nonce 2 must be 8 bytes.
+        EXPECT_FALSE (j0->bounty (n1, work::share {now, p.Solution.Share.Nonce, bytes (4, 0x02)}).valid ());
+        
+        Bitcoin::transaction tx {j0->redeem (n1, p.Solution.Share, {Bitcoin::output {Bitcoin::satoshi {900}, bytes {OP_1}}})};
+        ASSERT_TRUE (tx.valid ());
+        EXPECT_EQ (tx.Inputs.size (), 1);
+        EXPECT_TRUE (Boost::proof (Boost::output_script::read (bounty), Boost::input_script::read (tx.Inputs[0].Script)).valid ());
+        
+        // a job for a block is not a bounty.
+        auto j2 = jobs.update (work::candidate {int32_little {2}, digest256 {"0x0000000000000000000000000000000000000000000000000000000000000003"}, target, Merkle::path {0, {}}}, bytes {}, bytes {}, now);
+        EXPECT_EQ (j2->Bounty, nullptr);
+        EXPECT_FALSE (j2->bounty (n1, p.Solution.Share).valid ());
+        EXPECT_THROW (j2->redeem (n1, p.Solution.Share, {}), std::invalid_argument);
+        
+        // a block in between makes the bounty clean again.
+        EXPECT_TRUE (jobs.update (index, key, now)->Notify.Clean);
+    }
+    
+    TEST (StratumTest, TestVardiff) {
+        vardiff::options o {};
+        o.SharesPerMinute = 20;
+        o.RetargetSeconds = 30;
+        o.Tolerance = 1.5;
+        o.MinimumDifficulty = 1;
+        o.MaximumDifficulty = 1000000;
+        
+        vardiff::options bad {o};
+        bad.SharesPerMinute = 0;
+        EXPECT_THROW (vardiff (bad, 1, 0), std::invalid_argument);
+        
+        // a miner that is eight times too fast.
+        vardiff fast {o, 100, 0};
+        for (int i = 1; i < 80; i++) fast.accepted (i * 3. / 8);
+        
+        // too soon to change anything.
+        EXPECT_FALSE (fast.retarget (29.625));
+        
+        fast.accepted (30);
+        auto d = fast.retarget (30);
+        ASSERT_TRUE (d);
+        EXPECT_GT (*d, 400);
+        EXPECT_LT (*d, 1200);
+        EXPECT_EQ (fast.difficulty (), *d);
+        
+        // a miner that is at the right rate is left alone.
+        vardiff steady {o, 100, 0};
+        for (int i = 1; i <= 40; i++) steady.accepted (i * 3.);
+        EXPECT_FALSE (steady.retarget (120));
+        EXPECT_EQ (steady.difficulty (), 100);
+        
+        // a miner that has stopped submitting shares.
+        vardiff slow {o, 100, 0};
+        d = slow.retarget (600);
+        ASSERT_TRUE (d);
+        EXPECT_LT (*d, 100);
+        
+        // the difficulty does not go below the minimum.
+        vardiff bottom {o, 1, 0};
+        EXPECT_FALSE (bottom.retarget (600));
+        EXPECT_EQ (bottom.difficulty (), 1);
+    }
+    
+    TEST (StratumTest, TestFastJSON) {
+        
+        std::vector<string> valid {
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"params":["Daniel","j","","5f5e1000","ffffffff","1fffe000"],"method":"mining.submit","id":"abc"})",
+            " { \"id\" : 0 , \"method\" : \"mining.submit\" , \"params\" : [ \"a\" , \"\" , \"00\" , \"00000000\" , \"00000000\" ] } \n"};
+        
+        for (const string &line : valid) {
+            auto x = read_submit (line);
+            ASSERT_TRUE (bool (x)) << line;
+            
+            request r {JSON::parse (line)};
+            ASSERT_TRUE (mining::submit_request::valid (r));
+            EXPECT_TRUE (x->ID == r.id ());
+            EXPECT_TRUE (x->Share == mining::submit_request::params (r));
+        }
+        
+        // these are either invalid or are left for the JSON parser.
+        std::vector<string> other {
+            "",
+            "{}",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef012345678", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "0000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2g"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]} x)",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"])",
+            R"({"id": null, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": -1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1.5, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 01, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.authorize", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "id": 2, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2\u0033", "abcdef0123456789", "00000003", "0000fe2b"]})",
+            R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b"], "x": 0})"};
+        
+        for (const string &line : other) EXPECT_FALSE (bool (read_submit (line))) << line;
+        
+        Merkle::digests path = Merkle::digests {} << 
+            digest256 {"0x0000000000000000000000000000000000000000000000000000000000000001"} << 
+            digest256 {"0x00000000000000000000000000000000000000000000000000000000000000ab"};
+        
+        for (const job_id &id : std::vector<job_id> {"2333", "a \"quoted\"\n id"}) for (bool clean : {true, false}) {
+            mining::notify::parameters p {id, 
+                uint256 {"0x0000000000000000000000000000000000000000000000000000000000000001"}, 
+                *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"), path, int32_little {2}, 
+                work::compact {work::difficulty (.0001)}, Bitcoin::timestamp {3}, clean};
+            
+            EXPECT_EQ (mining::notify::line (p), mining::notify {p}.dump () + "\n");
+            EXPECT_TRUE (mining::notify::valid (mining::notify {JSON::parse (mining::notify::line (p))}));
+        }
+    }
+    
+    TEST (StratumTest, TestBinaryFraming) {
+        EXPECT_EQ (extensions::extension_from_string ("binary_framing"), extensions::binary_framing);
+        EXPECT_EQ (extensions::extension_to_string (extensions::binary_framing), "binary_framing");
+        
+        Merkle::digests path = Merkle::digests {} << 
+            digest256 {"0x0000000000000000000000000000000000000000000000000000000000000001"} << 
+            digest256 {"0x00000000000000000000000000000000000000000000000000000000000000ab"};
+        
+        mining::notify::parameters p {"2333", 
+            uint256 {"0x0000000000000000000000000000000000000000000000000000000000000001"}, 
+            *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"), path, int32_little {2}, 
+            work::compact {work::difficulty (.0001)}, Bitcoin::timestamp {3}, true};
+        
+        JSON submit = JSON::parse (R"({"id": 1, "method": "mining.submit", "params": ["Daniel", "2333", "abcdef0123456789", "00000003", "0000fe2b", "1fffe000"]})");
+        
+        std::vector<std::pair<JSON, binary::kind>> messages {
+            {JSON (mining::notify {p}), binary::notify},
+            {submit, binary::submit},
+            {JSON (boolean_response {message_id {"abc"}, true}), binary::boolean_result},
+            {JSON (boolean_response {message_id {7}, false}), binary::boolean_result},
+            {JSON (mining::authorize_request {message_id {2}, "Daniel"}), binary::json}};
+        
+        binary::frame_reader reader {};
+        for (const auto &[message, kind] : messages) {
+            binary::frame f = binary::encode (message);
+            EXPECT_EQ (f.Kind, kind) << message;
+            
+            // frames can arrive in pieces.
+            bytes b (f);
+            reader.push (bytes_view {b}.substr (0, b.size () / 2));
+            EXPECT_FALSE (bool (reader.next ()));
+            reader.push (bytes_view {b}.substr (b.size () / 2));
+            auto read = reader.next ();
+            ASSERT_TRUE (bool (read));
+            EXPECT_EQ (*read, f);
+            EXPECT_FALSE (bool (reader.next ()));
+            
+            auto decoded = binary::decode (*read);
+            ASSERT_TRUE (bool (decoded)) << message;
+            if (kind == binary::submit) {
+                EXPECT_EQ (request::id (*decoded), request::id (message));
+                EXPECT_EQ (mining::submit_request::params (request {*decoded}), mining::submit_request::params (request {message}));
+            } else EXPECT_EQ (*decoded, message);
+        }
+        
+        binary::frame n = binary::write_notify (p);
+        EXPECT_LT (bytes (n).size (), mining::notify::line (p).size () / 2);
+        EXPECT_EQ (binary::read_notify (n.Payload), maybe<mining::notify::parameters> {p});
+        EXPECT_FALSE (bool (binary::read_notify (bytes_view {n.Payload}.substr (0, n.Payload.size () - 1))));
+        
+        bytes longer = n.Payload;
+        longer.push_back (0);
+        EXPECT_FALSE (bool (binary::read_notify (longer)));
+        
+        // ids that do not fit in a frame are sent as JSON.
+        JSON big_id = submit;
+        big_id["id"] = uint64 {1} << 40;
+        EXPECT_EQ (binary::encode (big_id).Kind, binary::json);
+        
+        binary::frame_reader unknown {};
+        unknown.push (*bytes::from_hex ("020900"));
+        EXPECT_THROW (unknown.next (), std::invalid_argument);
+        
+        binary::frame_reader large {100};
+        large.push (*bytes::from_hex ("fd0010"));
+        EXPECT_THROW (large.next (), std::length_error);
+    }
+    
+    TEST (StratumTest, TestPendingRequests) {
+        pending_requests r {4};
+        maybe<pending_requests::entry> displaced;
+        
+        request_id a = r.insert (client_get_version, 10, displaced);
+        EXPECT_FALSE (displaced);
+        request_id b = r.insert (mining_notify, 20, displaced);
+        EXPECT_FALSE (displaced);
+        EXPECT_NE (a, b);
+        
+        EXPECT_EQ (r.remove (b), maybe<method> {mining_notify});
+        EXPECT_FALSE (r.remove (b));
+        EXPECT_FALSE (r.remove (b + 4));
+        
+        // a is the only one left and it was sent before 15.
+        auto expired = r.expire (15);
+        ASSERT_EQ (expired.size (), 1);
+        EXPECT_EQ (expired[0].ID, a);
+        EXPECT_EQ (expired[0].Method, client_get_version);
+        EXPECT_FALSE (r.remove (a));
+        
+        // more requests than there are slots.
+        std::vector<request_id> ids;
+        for (int i = 0; i < 4; i++) {
+            ids.push_back (r.insert (mining_set_difficulty, 30, displaced));
+            EXPECT_FALSE (displaced);
+        }
+        
+        request_id c = r.insert (client_show_message, 40, displaced);
+        ASSERT_TRUE (displaced);
+        EXPECT_EQ (c, ids[0] + 4);
+        EXPECT_EQ (displaced->ID, ids[0]);
+        EXPECT_EQ (r.remove (c), maybe<method> {client_show_message});
+        
+        EXPECT_EQ (r.expire (100).size (), 3);
+        EXPECT_EQ (r.expire (100).size (), 0);
+    }
+    
+    TEST (StratumTest, TestExtranonceAllocator) {
+        extranonce_allocator::options o {};
+        o.PartitionBits = 30;
+        o.Partition = 2;
+        o.QuarantineSeconds = 100;
+        o.ExtraNonce2Size = 4;
+        
+        extranonce_allocator::options bad {o};
+        bad.Partition = 4;
+        EXPECT_THROW (extranonce_allocator {bad}, std::invalid_argument);
+        
+        extranonce_allocator a {o};
+        EXPECT_EQ (a.capacity (), 4);
+        
+        std::vector<session_id> ids;
+        for (int i = 0; i < 4; i++) {
+            auto x = a.allocate (0);
+            ASSERT_TRUE (x);
+            EXPECT_EQ (x->ExtraNonce2Size, 4);
+            EXPECT_TRUE (a.owns (x->ExtraNonce1));
+            EXPECT_EQ (uint32 (x->ExtraNonce1) >> 30, 2);
+            for (const session_id &id : ids) EXPECT_NE (id, x->ExtraNonce1);
+            ids.push_back (x->ExtraNonce1);
+        }
+        
+        EXPECT_FALSE (a.allocate (0));
+        EXPECT_FALSE (a.owns (session_id {1}));
+        
+        // released values are kept out of use for a while.
+        a.release (ids[1], 10);
+        EXPECT_EQ (a.in_use (), 3);
+        EXPECT_EQ (a.quarantined (), 1);
+        EXPECT_FALSE (a.allocate (50));
+        EXPECT_FALSE (a.reassign (ids[0], 50));
+        
+        auto x = a.allocate (110);
+        ASSERT_TRUE (x);
+        EXPECT_EQ (x->ExtraNonce1, ids[1]);
+        
+        // another frontend never gives out the same values.
+        o.Partition = 1;
+        extranonce_allocator b {o};
+        for (int i = 0; i < 4; i++) {
+            auto y = b.allocate (0);
+            ASSERT_TRUE (y);
+            for (const session_id &id : ids) EXPECT_NE (id, y->ExtraNonce1);
+        }
+        
+        a.release (ids[2], 120);
+        auto z = a.reassign (ids[3], 220);
+        ASSERT_TRUE (z);
+        EXPECT_EQ (z->ExtraNonce1, ids[2]);
+        EXPECT_EQ (a.quarantined (), 1);
+        EXPECT_EQ (a.in_use (), 3);
+    }
+    
+    TEST (StratumTest, TestProxy) {
+        struct upstream final : work::evaluator {
+            std::vector<work::solution> Solved;
+            void solved (const work::solution &x) override {
+                Solved.push_back (x);
+            }
+        };
+        
+        std::vector<std::pair<uint32, mining::notify::parameters>> relayed;
+        proxy p {[&relayed] (uint32 u, const mining::notify::parameters &n) {
+            relayed.push_back ({u, n});
+        }};
+        
+        upstream a, b;
+        EXPECT_EQ (p.add (a), 0);
+        EXPECT_EQ (p.add (b), 1);
+        EXPECT_FALSE (p.assign (0));
+        
+        Bitcoin::timestamp timestamp {3};
+        work::puzzle puzzle {int32_little {2}, uint256 {1}, work::compact {work::difficulty (.0001)}, Merkle::path {},
+            *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203")};
+        
+        // there is no room to split an extra nonce 2 of four bytes.
+        p.pose (1, puzzle, work::solution {work::share {timestamp, 0, bytes (4)}, session_id {7}});
+        EXPECT_EQ (relayed.size (), 0);
+        EXPECT_FALSE (p.job (1));
+        
+        p.pose (0, puzzle, work::solution {work::share {timestamp, 0, bytes (8)}, session_id {0xabcdef01}});
+        ASSERT_EQ (relayed.size (), 1);
+        EXPECT_EQ (relayed[0].first, 0);
+        EXPECT_EQ (relayed[0].second.GenerationTx1, *bytes::from_hex ("abcdefabcdef01"));
+        
+        // miners are assigned to the only upstream session with a job.
+        auto m1 = p.assign (0);
+        auto m2 = p.assign (0);
+        ASSERT_TRUE (m1);
+        ASSERT_TRUE (m2);
+        EXPECT_EQ (m1->Upstream, 0);
+        EXPECT_EQ (m1->ExtraNonce.ExtraNonce2Size, 4);
+        EXPECT_NE (m1->ExtraNonce.ExtraNonce1, m2->ExtraNonce.ExtraNonce1);
+        EXPECT_EQ (p.miners (0), 2);
+        
+        // a miner solves the job that was relayed to it.
+        work::proof solved = work::solve (work::puzzle (relayed[0].second),
+            work::solution {work::share {timestamp, 0, bytes (4)}, m1->ExtraNonce.ExtraNonce1});
+        ASSERT_TRUE (solved.valid ());
+        
+        job_id id = relayed[0].second.JobID;
+        EXPECT_EQ (p.submit (*m1, share {"miner", id, solved.Solution.Share}), proxy::forwarded);
+        ASSERT_EQ (a.Solved.size (), 1);
+        
+        // the solution is good for the upstream job.
+        EXPECT_TRUE ((work::proof {puzzle, a.Solved[0]}.valid ()));
+        EXPECT_EQ (a.Solved[0].ExtraNonce1, session_id {0xabcdef01});
+        
+        // the same share from another miner has a different coinbase.
+        EXPECT_EQ (p.submit (*m2, share {"miner", id, solved.Solution.Share}), proxy::below_target);
+        EXPECT_EQ (p.submit (*m1, share {"miner", "other", solved.Solution.Share}), proxy::stale);
+        EXPECT_EQ (p.submit (*m1, share {"miner", id, work::share {timestamp, 0, bytes (8)}}), proxy::invalid);
+        EXPECT_EQ (a.Solved.size (), 1);
+        
+        p.release (*m2, 0);
+        EXPECT_EQ (p.miners (0), 1);
+        
+        // a new job is relayed once.
+        p.pose (0, puzzle, work::solution {work::share {timestamp, 0, bytes (8)}, session_id {0xabcdef01}});
+        ASSERT_EQ (relayed.size (), 2);
+        EXPECT_NE (relayed[1].second.JobID, id);
+        EXPECT_EQ (p.submit (*m1, share {"miner", id, solved.Solution.Share}), proxy::stale);
+    }
+    
+    TEST (StratumTest, TestShareLedger) {
+        share_ring ring {3};
+        EXPECT_TRUE (ring.push (share_record {"a", "1", 1, 0, false}));
+        EXPECT_TRUE (ring.push (share_record {"a", "1", 1, 0, false}));
+        EXPECT_TRUE (ring.push (share_record {"a", "1", 1, 0, false}));
+        EXPECT_TRUE (ring.push (share_record {"a", "1", 1, 0, false}));
+        EXPECT_FALSE (ring.push (share_record {"a", "1", 1, 0, false}));
+        EXPECT_EQ (ring.dropped (), 1);
+        
+        share_record x;
+        for (int i = 0; i < 4; i++) EXPECT_TRUE (ring.pop (x));
+        EXPECT_FALSE (ring.pop (x));
+        
+        share_ledger::options o {};
+        o.Background = false;
+        o.HashrateWindowSeconds = 100;
+        o.PPLNSDifficulty = 10;
+        o.ExportBatch = 4;
+        
+        std::vector<share_record> exported;
+        {
+            share_ledger ledger {o, [&exported] (std::vector<share_record> &&b) {
+                for (share_record &r : b) exported.push_back (std::move (r));
+            }};
+            
+            auto r1 = ledger.open ();
+            auto r2 = ledger.open ();
+            
+            r1->push (share_record {"alice", "1", 4, 1000, false});
+            r2->push (share_record {"bob", "1", 2, 1010, false});
+            r2->push (share_record {"bob", "1", 2, 1020, true});
+            ledger.update ();
+            
+            EXPECT_EQ (exported.size (), 0);
+            EXPECT_DOUBLE_EQ (ledger.hashrate ("alice"), 4 * 4294967296. / 100);
+            EXPECT_DOUBLE_EQ (ledger.hashrate ("bob"), 4 * 4294967296. / 100);
+            EXPECT_DOUBLE_EQ (ledger.hashrate (), 8 * 4294967296. / 100);
+            
+            auto p = ledger.pplns ();
+            EXPECT_EQ (p.size (), 2);
+            EXPECT_DOUBLE_EQ (p["alice"], 4);
+            EXPECT_DOUBLE_EQ (p["bob"], 2);
+            
+            // alice's share is now too old for the hashrate and too far back for PPLNS.
+            r1->push (share_record {"carol", "2", 8, 1150, false});
+            ledger.update ();
+            
+            EXPECT_EQ (exported.size (), 4);
+            EXPECT_EQ (ledger.hashrate ("alice"), 0);
+            EXPECT_DOUBLE_EQ (ledger.hashrate (), 8 * 4294967296. / 100);
+            
+            p = ledger.pplns ();
+            EXPECT_EQ (p.size (), 2);
+            EXPECT_DOUBLE_EQ (p["bob"], 2);
+            EXPECT_DOUBLE_EQ (p["carol"], 8);
+            
+            r2->push (share_record {"bob", "2", 1, 1160, false});
+        }
+        
+        // what is left is exported when the ledger is destroyed.
+        EXPECT_EQ (exported.size (), 5);
+        EXPECT_EQ (exported[4].Worker, "bob");
+        
+        // shares from different rings may come out of order, but old ones are still forgotten.
+        {
+            share_ledger ledger {o};
+            auto r1 = ledger.open ();
+            auto r2 = ledger.open ();
+            
+            r1->push (share_record {"alice", "1", 1, 1100, false});
+            r2->push (share_record {"bob", "1", 1, 1000, false});
+            ledger.update ();
+            EXPECT_DOUBLE_EQ (ledger.hashrate (), 2 * 4294967296. / 100);
+            
+            r1->push (share_record {"carol", "1", 1, 1150, false});
+            ledger.update ();
+            EXPECT_DOUBLE_EQ (ledger.hashrate (), 2 * 4294967296. / 100);
+            EXPECT_EQ (ledger.hashrate ("bob"), 0);
+        }
+    }
+
+    TEST (StratumTest, TestShareLog) {
+        
+        work::compact d {work::difficulty (.0001)};
+        digest256 prevHash {"0x0000000000000000000000000000000000000000000000000000000000000001"};
+        bytes gentx1 = *bytes::from_hex ("abcdef");
+        bytes gentx2 = *bytes::from_hex ("010203");
+        bytes extra_nonce_2 = *bytes::from_hex ("abcdef0123456789");
+        Bitcoin::timestamp timestamp {3};
+        
+        job_manager jobs {2};
+        auto j0 = jobs.update (work::candidate {int32_little {2}, prevHash, d, Merkle::path {0, {}}}, gentx1, gentx2, timestamp);
+        
+        // the same shares as in TestJobManager.
+        share_log_record r1 {0, session_id {1}, work::share {timestamp, 65067, extra_nonce_2}, d};
+        share_log_record r2 {0, session_id {1}, work::share {timestamp, 449600, extra_nonce_2, int32_little (0xffffffff)}, d};
+        share_log_record r3 {0, session_id {1}, work::share {timestamp, 65068, extra_nonce_2}, d};
+        
+        EXPECT_TRUE (r1.valid (*j0->prepared ()));
+        EXPECT_TRUE (r2.valid (*j0->prepared (work::ASICBoost::Mask)));
+        
+        // a directory of our own, so that tests that run at the same time don't share it.
+        string name = (std::filesystem::temp_directory_path () / "gigamonkey_test_share_log_XXXXXX").string ();
+        ASSERT_NE (::mkdtemp (name.data ()), nullptr);
+        std::filesystem::path directory {name};
+        
+        share_log::options o {};
+        o.SegmentRecords = 4;
+        o.BufferRecords = 2;
+        
+        {
+            share_log log {directory, o};
+            auto w1 = log.open ();
+            auto w2 = log.open ();
+            
+            w1->write (r1);
+            EXPECT_EQ (log.size (), 0);
+            w1->write (r2);
+            EXPECT_EQ (log.size (), 2);
+            
+            share_log_record big = r3;
+            big.Share.ExtraNonce2 = bytes (33);
+            EXPECT_THROW (w2->write (big), std::invalid_argument);
+            
+            for (int i = 0; i < 3; i++) w2->write (r3);
+            log.sync ();
+            EXPECT_EQ (log.size (), 4);
+        }
+        
+        // what is left in a writer is written when it is destroyed.
+        share_log log {directory};
+        EXPECT_EQ (log.size (), 5);
+        
+        auto x = log.read (0, 10);
+        EXPECT_EQ (x.size (), 5);
+        EXPECT_EQ (x[0], r1);
+        EXPECT_EQ (x[1], r2);
+        EXPECT_EQ (x[4], r3);
+        EXPECT_TRUE (x[0].valid (*jobs.find (job_manager::id (x[0].Job))->prepared ()));
+        
+        // the PPLNS window goes back from the last share.
+        auto window = log.last (2.5 * r1.difficulty (), 2);
+        EXPECT_EQ (window.size (), 3);
+        EXPECT_EQ (window[0], r3);
+        EXPECT_EQ (window[2], r3);
+        EXPECT_EQ (log.last (100 * r1.difficulty ()).size (), 5);
+        
+        log.open ()->write (r1);
+        EXPECT_EQ (log.read (5, 1)[0], r1);
+        std::filesystem::remove_all (directory);
+    }
+    
+    TEST (StratumTest, TestRateLimits) {
+        token_bucket b {2, 4, 100};
+        for (int i = 0; i < 4; i++) EXPECT_TRUE (b.take (100));
+        EXPECT_FALSE (b.take (100));
+        
+        // tokens come back at the rate but not beyond the burst.
+        EXPECT_TRUE (b.take (100.5));
+        EXPECT_FALSE (b.take (100.5));
+        EXPECT_EQ (b.tokens (1000), 4);
+        EXPECT_FALSE (b.take (1000, 5));
+        EXPECT_EQ (b.tokens (1000), 4);
+        
+        rate_limits::options o {};
+        o.SessionMessagesPerSecond = 1;
+        o.SessionBurst = 4;
+        o.AddressMessagesPerSecond = 1;
+        o.AddressBurst = 6;
+        o.ShedLoad = 10;
+        o.ShedCost = 2;
+        o.ForgetAddressSeconds = 100;
+        
+        size_t load = 0;
+        rate_limits limits {o, [&load] () -> size_t {
+            return load;
+        }};
+        
+        EXPECT_FALSE (limits.shedding ());
+        
+        // two sessions at one address.
+        token_bucket a = limits.session (0);
+        token_bucket c = limits.session (0);
+        for (int i = 0; i < 4; i++) EXPECT_TRUE (limits.allow (a, "1.2.3.4", 0));
+        EXPECT_FALSE (limits.allow (a, "1.2.3.4", 0));
+        
+        // the limit of the address is shared.
+        EXPECT_TRUE (limits.allow (c, "1.2.3.4", 0));
+        EXPECT_TRUE (limits.allow (c, "1.2.3.4", 0));
+        EXPECT_FALSE (limits.allow (c, "1.2.3.4", 0));
+        EXPECT_FALSE (limits.connect ("1.2.3.4", 0));
+        EXPECT_TRUE (limits.connect ("5.6.7.8", 0));
+        EXPECT_EQ (limits.addresses (), 2);
+        
+        // under load, everything costs more.
+        load = 10;
+        EXPECT_TRUE (limits.shedding ());
+        token_bucket d = limits.session (0);
+        EXPECT_TRUE (limits.allow (d, "9.9.9.9", 0));
+        EXPECT_TRUE (limits.allow (d, "9.9.9.9", 0));
+        EXPECT_FALSE (limits.allow (d, "9.9.9.9", 0));
+        load = 0;
+        
+        // idle addresses are forgotten.
+        EXPECT_TRUE (limits.connect ("5.6.7.8", 200));
+        EXPECT_EQ (limits.addresses (), 1);
+        
+        rate_limits::options invalid {};
+        invalid.SessionBurst = 0;
+        EXPECT_THROW (rate_limits {invalid}, std::invalid_argument);
+    }
+    
+    TEST (StratumTest, TestFailover) {
+        struct upstream final : work::evaluator {
+            std::vector<work::solution> Solved;
+            void solved (const work::solution &x) override {
+                Solved.push_back (x);
+            }
+        };
+        
+        struct solver final : work::solver {
+            std::vector<work::puzzle> Posed;
+            void pose (const work::puzzle &p) override {
+                Posed.push_back (p);
+            }
+            
+            void pose (const work::puzzle &p, const work::solution &) override {
+                Posed.push_back (p);
+            }
+            
+            void solved (const work::solution &) override {}
+        };
+        
+        Bitcoin::timestamp timestamp {3};
+        work::puzzle pa {int32_little {2}, uint256 {1}, work::compact {work::difficulty (.0001)}, Merkle::path {},
+            *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203")};
+        work::puzzle pb {int32_little {2}, uint256 {2}, work::compact {work::difficulty (.0001)}, Merkle::path {},
+            *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203")};
+        work::solution initial {work::share {timestamp, 0, bytes (4)}, session_id {7}};
+        
+        failover::options o {};
+        o.NotifyGapSeconds = 100;
+        o.SubmitTimeoutSeconds = 5;
+        
+        solver s;
+        failover f {s, o};
+        upstream a, b;
+        EXPECT_EQ (f.add (a), 0);
+        EXPECT_EQ (f.add (b), 1);
+        EXPECT_THROW (f.add (a, 0), std::invalid_argument);
+        
+        // nothing to work on until a job arrives.
+        EXPECT_FALSE (f.update (0));
+        
+        // the standby's job is kept but not given to the solver.
+        f.pose (1, pb, initial, 0);
+        EXPECT_EQ (f.update (0), maybe<uint32> {1});
+        f.pose (0, pa, initial, 1);
+        EXPECT_EQ (f.update (1), maybe<uint32> {0});
+        ASSERT_EQ (s.Posed.size (), 2);
+        EXPECT_EQ (s.Posed[1], pa);
+        
+        // new jobs from the active pool go straight to the solver.
+        f.pose (0, pa, initial, 2);
+        EXPECT_EQ (s.Posed.size (), 3);
+        f.pose (1, pb, initial, 2);
+        EXPECT_EQ (s.Posed.size (), 3);
+        
+        // solutions go to the pool whose job they solve.
+        work::proof solved_a = work::solve (pa, initial);
+        work::proof solved_b = work::solve (pb, initial);
+        ASSERT_TRUE (solved_a.valid ());
+        ASSERT_TRUE (solved_b.valid ());
+        EXPECT_TRUE (f.solved (solved_a.Solution));
+        EXPECT_TRUE (f.solved (solved_b.Solution));
+        EXPECT_EQ (a.Solved.size (), 1);
+        EXPECT_EQ (b.Solved.size (), 1);
+        
+        // a share that is not answered in time stalls the pool.
+        f.submitted (0, 3);
+        f.answered (0, 4);
+        EXPECT_EQ (f.latency (0), 1);
+        f.submitted (0, 5);
+        EXPECT_FALSE (f.stalled (0, 9));
+        EXPECT_TRUE (f.stalled (0, 10));
+        EXPECT_EQ (f.update (10), maybe<uint32> {1});
+        EXPECT_EQ (s.Posed.back (), pb);
+        EXPECT_EQ (f.switches (), 3);
+        
+        // we go back once it answers.
+        f.answered (0, 11);
+        EXPECT_EQ (f.update (11), maybe<uint32> {0});
+        
+        // a pool that sends no jobs is stalled.
+        f.pose (1, pb, initial, 60);
+        EXPECT_EQ (f.update (102), maybe<uint32> {1});
+        f.pose (0, pa, initial, 103);
+        EXPECT_EQ (f.update (103), maybe<uint32> {0});
+        
+        // with split, pools take turns in proportion to their weights.
+        failover::options split {};
+        split.Split = true;
+        split.SliceSeconds = 1;
+        
+        solver t;
+        failover g {t, split};
+        g.add (a, 1);
+        g.add (b, 3);
+        g.pose (0, pa, initial, 0);
+        g.pose (1, pb, initial, 0);
+        
+        std::vector<uint32> time (2, 0);
+        for (int i = 0; i < 40; i++) time[*g.update (i)]++;
+        EXPECT_EQ (time[0], 10);
+        EXPECT_EQ (time[1], 30);
+    }
+    
+    TEST (StratumTest, TestStatistics) {
+        EXPECT_EQ (result_of (STALE_SHARE), stale);
+        EXPECT_EQ (result_of (JOB_NOT_FOUND_OR_STALE), stale);
+        EXPECT_EQ (result_of (DUPLICATE_SHARE), duplicate);
+        EXPECT_EQ (result_of (LOW_DIFFICULTY), low_difficulty);
+        EXPECT_EQ (result_of (UNAUTHORIZED), invalid);
+        
+        EXPECT_EQ (statistics::log2_histogram<4>::bucket (0), 0);
+        EXPECT_EQ (statistics::log2_histogram<4>::bucket (1), 0);
+        EXPECT_EQ (statistics::log2_histogram<4>::bucket (3), 2);
+        EXPECT_EQ (statistics::log2_histogram<4>::bucket (1000), 3);
+        
+        auto stats = std::make_shared<statistics> ();
+        stats->Sessions = 2;
+        stats->Connections = 3;
+        stats->notified (3);
+        
+        {
+            auto a = stats->open ("alice \"1\"");
+            auto b = stats->open ("bob");
+            a->share (accepted);
+            a->share (stale);
+            b->share (accepted);
+            b->share (accepted);
+            a->difficulty (8);
+            b->difficulty (8);
+            b->difficulty (100);
+            EXPECT_EQ (stats->Difficulties.Count, 2);
+            
+            string text = stats->write ();
+            EXPECT_NE (text.find ("stratum_sessions 2\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_shares_total{result=\"accepted\"} 3\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_stale_ratio 0.25\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_notify_fanout_seconds_count 1\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_difficulty_bucket{le=\"8\"} 1\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_difficulty_bucket{le=\"128\"} 2\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_session_difficulty{worker=\"alice \\\"1\\\"\"} 8\n"), string::npos);
+            EXPECT_NE (text.find ("stratum_session_shares_total{worker=\"bob\",result=\"accepted\"} 2\n"), string::npos);
+            EXPECT_EQ (text.substr (text.size () - 6), "# EOF\n");
+        }
+        
+        // closed sessions are no longer listed.
+        EXPECT_EQ (stats->Difficulties.Count, 0);
+        EXPECT_EQ (stats->write ().find ("worker="), string::npos);
+        
+        string response = exporter::response (*stats);
+        EXPECT_EQ (response.find ("HTTP/1.1 200 OK\r\n"), 0);
+        EXPECT_NE (response.find (exporter::ContentType), string::npos);
+        
+        // the same response is served over HTTP, whatever the path.
+        exporter served {boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), 0}, stats};
+        for (const char *path : {"/metrics", "/"}) {
+            boost::asio::io_context io {};
+            boost::asio::ip::tcp::socket socket {io};
+            socket.connect (boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), served.port ()});
+            boost::asio::write (socket, boost::asio::buffer (string {"GET "} + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+            
+            // the connection is closed after the response.
+            string received;
+            boost::system::error_code err;
+            boost::asio::read (socket, boost::asio::dynamic_buffer (received), err);
+            EXPECT_EQ (err, boost::asio::error::eof);
+            EXPECT_EQ (received, response);
+        }
+    }
+    
+    TEST (StratumTest, TestStratumServer) {
+        
+        // accepts everyone but mallory and gives every session the same extra nonce.
+        struct test_session final : server_session {
+            test_session (ptr<net::session<JSON>> p) : server_session {p, server_session::options {}} {}
+            
+        private:
+            optional<error> authorize (const mining::authorize_request::parameters &p) override {
+                if (p.Username == "mallory") return error {UNAUTHORIZED};
+                return {};
+            }
+            
+            mining::subscribe_response::parameters subscribe (const mining::subscribe_request::parameters &) override {
+                return {{mining::subscription {mining_notify, "1"}}, {1, 8}};
+            }
+        };
+        
+        server served {boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), 0},
+            [] (ptr<net::session<JSON>> p) -> ptr<server_session> {
+                return std::make_shared<test_session> (p);
+            }};
+        
+        boost::asio::io_context io {};
+        boost::asio::ip::tcp::socket socket {io};
+        socket.connect (boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), served.port ()});
+        
+        auto send = [&socket] (const JSON &j) {
+            boost::asio::write (socket, boost::asio::buffer (j.dump () + "\n"));
+        };
+        
+        // the next line from the server.
+        string input;
+        auto receive = [&socket, &input] () -> JSON {
+            size_t size = boost::asio::read_until (socket, boost::asio::dynamic_buffer (input), '\n');
+            JSON j = JSON::parse (input.substr (0, size));
+            input.erase (0, size);
+            return j;
+        };
+        
+        Bitcoin::timestamp now = Bitcoin::timestamp::now ();
+        auto submit = [now] (const message_id &id, const job_id &jid) {
+            return mining::submit_request {id, share {"alice", jid, bytes (8, 0), now, nonce {0}}};
+        };
+        
+        // shares are not accepted before subscribe.
+        send (submit (1, "a"));
+        response r {receive ()};
+        EXPECT_EQ (r.id (), message_id {1});
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, NOT_SUBSCRIBED);
+        
+        send (mining::subscribe_request {2, "test miner"});
+        r = response {receive ()};
+        EXPECT_EQ (r.id (), message_id {2});
+        EXPECT_FALSE (r.is_error ());
+        EXPECT_EQ (mining::subscribe_response::deserialize (r.result ()),
+            (mining::subscribe_response::parameters {{mining::subscription {mining_notify, "1"}}, {1, 8}}));
+        
+        send (mining::subscribe_request {3, "test miner"});
+        r = response {receive ()};
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, ILLEGAL_METHOD);
+        
+        send (mining::authorize_request {4, "mallory"});
+        r = response {receive ()};
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, UNAUTHORIZED);
+        
+        send (mining::authorize_request {5, "alice"});
+        EXPECT_TRUE (mining::authorize_response {receive ()}.result ());
+        
+        EXPECT_EQ (served.connections (), 1);
+        
+        // the job is sent to the session, which has subscribed.
+        mining::notify::parameters job {"a", uint256 {1}, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+            {}, int32_little {2}, work::compact {work::difficulty (.0001)}, now, true};
+        served.notify (job);
+        
+        mining::notify n {receive ()};
+        EXPECT_TRUE (n.valid ());
+        EXPECT_EQ (n.params (), job);
+        
+        send (submit (6, "b"));
+        r = response {receive ()};
+        EXPECT_EQ (r.id (), message_id {6});
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, JOB_NOT_FOUND);
+        
+        // the server does not answer requests that are meant for the client.
+        send (request {7, client_get_version, {}});
+        r = response {receive ()};
+        ASSERT_TRUE (bool (r.error ()));
+        EXPECT_EQ (r.error ()->Code, ILLEGAL_METHOD);
+        
+        // the connection is forgotten once the miner goes away.
+        socket.close ();
+        for (int i = 0; i < 200 && served.connections () > 0; i++) std::this_thread::sleep_for (std::chrono::milliseconds {10});
+        EXPECT_EQ (served.connections (), 0);
+    }
+    
+    TEST (StratumTest, TestStratumServerNotify) {
+        
+        struct test_session final : server_session {
+            test_session (ptr<net::session<JSON>> p) : server_session {p, server_session::options {}} {}
+        
+        private:
+            optional<error> authorize (const mining::authorize_request::parameters &) override {
+                return {};
+            }
+            
+            mining::subscribe_response::parameters subscribe (const mining::subscribe_request::parameters &) override {
+                return {{mining::subscription {mining_notify, "1"}}, {1, 8}};
+            }
+        };
+        
+        server::options o {};
+        o.Threads = 2;
+        server served {boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), 0},
+            [] (ptr<net::session<JSON>> p) -> ptr<server_session> {
+                return std::make_shared<test_session> (p);
+            }, o};
+        
+        boost::asio::io_context io {};
+        std::vector<boost::asio::ip::tcp::socket> sockets;
+        std::vector<string> inputs (5);
+        
+        // the next line from a miner's socket, with its newline.
+        auto receive = [&sockets, &inputs] (size_t i) -> string {
+            size_t size = boost::asio::read_until (sockets[i], boost::asio::dynamic_buffer (inputs[i]), '\n');
+            string line = inputs[i].substr (0, size);
+            inputs[i].erase (0, size);
+            return line;
+        };
+        
+        for (size_t i = 0; i < inputs.size (); i++) {
+            sockets.emplace_back (io);
+            sockets[i].connect (boost::asio::ip::tcp::endpoint {boost::asio::ip::make_address ("127.0.0.1"), served.port ()});
+            boost::asio::write (sockets[i], boost::asio::buffer (JSON (mining::subscribe_request {uint32 (i + 1), "test miner"}).dump () + "\n"));
+            EXPECT_FALSE (response {JSON::parse (receive (i))}.is_error ());
+        }
+        
+        EXPECT_EQ (served.connections (), inputs.size ());
+        
+        Bitcoin::timestamp now = Bitcoin::timestamp::now ();
+        std::vector<mining::notify::parameters> jobs {
+            {"a", uint256 {1}, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+                {}, int32_little {2}, work::compact {work::difficulty (.0001)}, now, true},
+            {"b", uint256 {2}, *bytes::from_hex ("abcdef"), *bytes::from_hex ("010203"),
+                Merkle::digests {} << digest256 {uint256 {3}}, int32_little {2}, work::compact {work::difficulty (.0001)}, now, false}};
+        
+        // every miner is sent the same bytes for each job.
+        for (const mining::notify::parameters &job : jobs) served.notify (job);
+        for (const mining::notify::parameters &job : jobs) {
+            string first = receive (0);
+            mining::notify n {JSON::parse (first)};
+            EXPECT_TRUE (n.valid ());
+            EXPECT_EQ (n.params (), job);
+            for (size_t i = 1; i < sockets.size (); i++) EXPECT_EQ (receive (i), first) << i;
+        }
+        
+        // and nothing is left waiting to be written.
+        for (int i = 0; i < 200 && served.queued () > 0; i++) std::this_thread::sleep_for (std::chrono::milliseconds {10});
+        EXPECT_EQ (served.queued (), 0);
+        
+        for (boost::asio::ip::tcp::socket &s : sockets) s.close ();
+        for (int i = 0; i < 200 && served.connections () > 0; i++) std::this_thread::sleep_for (std::chrono::milliseconds {10});
+        EXPECT_EQ (served.connections (), 0);
+        EXPECT_EQ (served.queued (), 0);
+    }
 
 }
 /*
@@ -5,8 +5,57 @@
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
 #include "gtest/gtest.h"
 #include <gigamonkey/boost/boost.hpp>
+#include <gigamonkey/view.hpp>
+#include <gigamonkey/flat.hpp>
+#include <gigamonkey/coin_selection.hpp>
+#include <gigamonkey/signer.hpp>
+#include <gigamonkey/builder.hpp>
+#include <gigamonkey/mapi/chain.hpp>
+#include <gigamonkey/mapi/status.hpp>
+#include <gigamonkey/mapi/journal.hpp>
+#include <gigamonkey/mapi/pool.hpp>
+#include <gigamonkey/mapi/batch.hpp>
+#include <gigamonkey/mapi/fee_quotes.hpp>
+#include <gigamonkey/mapi/broadcast.hpp>
+#include <gigamonkey/memory.hpp>
+#include <gigamonkey/p2p/compact_block.hpp>
+#include <gigamonkey/p2p/block_filter.hpp>
+#include <gigamonkey/coinbase.hpp>
+#include <gigamonkey/mempool.hpp>
+#include <gigamonkey/policy.hpp>
+#include <gigamonkey/script/pattern/op_return.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/script/pattern/pay_to_script_hash.hpp>
+#include <gigamonkey/scan.hpp>
+#include <gigamonkey/transaction_codec.hpp>
+#include <gigamonkey/block_assembler.hpp>
+#include <gigamonkey/coinbase_builder.hpp>
+#include <fstream>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iomanip>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 namespace Gigamonkey::Bitcoin {
+    
+    struct test_block_reader final : block_reader {
+        maybe<Bitcoin::header> Header;
+        list<transaction> Transactions;
+        
+        void receive_header (const Bitcoin::header &h, uint64) override {
+            Header = h;
+        }
+        
+        void receive_transaction (const transaction_view &tx) override {
+            Transactions <<= transaction (tx);
+        }
+        
+        using block_reader::block_reader;
+    };
 
     // can result in stack smashing
     TEST (TransactionTest, TestTransaction) {
@@ -152,5 +201,1749 @@ namespace Gigamonkey::Bitcoin {
         
         EXPECT_EQ (bytes (t), *tx);
         
+        // the cursors agree with the serializers that go through writer and reader.
+        bytes slow (t.serialized_size ());
+        bytes_writer sw {slow.begin (), slow.end ()};
+        sw << t;
+        EXPECT_EQ (slow, *tx);
+        
+        bytes fast (t.serialized_size ());
+        write_cursor fw {fast.data (), fast.data () + fast.size ()};
+        fw << t;
+        EXPECT_EQ (fast, slow);
+        
+        write_cursor short_writer {fast.data (), fast.data () + fast.size () - 1};
+        EXPECT_THROW (short_writer << t, data::end_of_stream);
+        
+        transaction read_back;
+        read_cursor fr {tx->data (), tx->data () + tx->size ()};
+        fr >> read_back;
+        EXPECT_EQ (read_back, t);
+        EXPECT_EQ (fr.It, fr.End);
+        
+        read_cursor short_reader {tx->data (), tx->data () + tx->size () - 1};
+        EXPECT_THROW (short_reader >> read_back, data::end_of_stream);
+        
+        transaction_view v {*tx};
+        
+        EXPECT_TRUE (v.valid ());
+        EXPECT_EQ (v.version (), t.Version);
+        EXPECT_EQ (v.input_count (), 1);
+        EXPECT_EQ (v.output_count (), 110);
+        EXPECT_EQ (v.locktime (), t.Locktime);
+        EXPECT_EQ (v.id (), t.id ());
+        EXPECT_EQ (transaction (v), t);
+        EXPECT_EQ (input (v.input (0)), t.Inputs.first ());
+        
+        uint32 i = 0;
+        for (const output &o : t.Outputs) {
+            EXPECT_EQ (output (v.output (i)), o);
+            EXPECT_EQ (v.output (i).value (), o.Value);
+            i++;
+        }
+        
+        EXPECT_THROW (v.output (110), std::invalid_argument);
+        EXPECT_FALSE (transaction_view {bytes_view {*tx}.substr (0, 7675)}.valid ());
+        
+        block b {};
+        b.Transactions = list<transaction> {t, t, t};
+        bytes serialized (b);
+        block_view bv {serialized};
+        
+        EXPECT_TRUE (bv.valid ());
+        EXPECT_EQ (bv.size (), 3);
+        EXPECT_EQ (bv[2].serialized (), bytes_view {*tx});
+        EXPECT_EQ (bv.merkle_root (), merkle_root (b.Transactions));
+        EXPECT_EQ (block::merkle_root (serialized), merkle_root (b.Transactions));
+        
+        executor e {4};
+        EXPECT_EQ (bv.merkle_root (e), merkle_root (b.Transactions));
+        EXPECT_EQ (block::merkle_root (serialized, e), merkle_root (b.Transactions));
+        EXPECT_EQ (block::transactions (serialized).size (), 3);
+        
+        for (size_t chunk : {size_t (1), size_t (7), size_t (1000), serialized.size ()}) {
+            test_block_reader reader {};
+            bytes_view rest = serialized;
+            while (rest.size () > 0) {
+                EXPECT_TRUE (reader.write (rest.substr (0, chunk)));
+                rest = rest.substr (std::min (chunk, rest.size ()));
+            }
+            
+            EXPECT_TRUE (reader.complete ());
+            EXPECT_EQ (reader.transactions_read (), 3);
+            EXPECT_EQ (*reader.Header, b.Header);
+            EXPECT_EQ (reader.Transactions, b.Transactions);
+        }
+        
+        bytes extra = serialized;
+        extra.push_back (0);
+        test_block_reader too_much {};
+        EXPECT_FALSE (too_much.write (extra));
+        EXPECT_TRUE (too_much.failed ());
+        
+        test_block_reader too_small {1000};
+        EXPECT_FALSE (too_small.write (serialized));
+        
+        shared_transaction st {*tx};
+        shared_transaction copy = st;
+        
+        EXPECT_TRUE (st.valid ());
+        EXPECT_EQ (st.id (), t.id ());
+        EXPECT_EQ (st.serialized_size (), t.serialized_size ());
+        EXPECT_EQ (st.serialized (), bytes_view {*tx});
+        EXPECT_EQ (*st, t);
+        EXPECT_EQ (copy, st);
+        EXPECT_EQ (copy.serialized ().data (), st.serialized ().data ());
+        EXPECT_EQ (shared_transaction {t}, st);
+        EXPECT_EQ (merkle_root (list<shared_transaction> {st, st, st}), merkle_root (b.Transactions));
+        
+        flat_transaction ft {*tx};
+        
+        EXPECT_TRUE (ft.valid ());
+        EXPECT_EQ (ft.Outputs.size (), 110);
+        EXPECT_EQ (ft, flat_transaction {t});
+        EXPECT_EQ (ft, flat_transaction {v});
+        EXPECT_EQ (transaction (ft), t);
+        EXPECT_EQ (bytes (ft), *tx);
+        EXPECT_EQ (ft.serialized_size (), 7676);
+        EXPECT_EQ (ft.id (), t.id ());
+        EXPECT_EQ (ft.sent (), t.sent ());
+        EXPECT_EQ (ft.Outputs[37], output (v.output (37)));
+        EXPECT_FALSE (flat_transaction {bytes_view {*tx}.substr (0, 7675)}.valid ());
+        
+        // one input whose script is said to be as long as possible.
+        bytes too_long (4 + 1 + 36 + 9, 0xff);
+        too_long[4] = 0x01;
+        EXPECT_FALSE (flat_transaction {too_long}.valid ());
+        
+        flat_block fb {serialized};
+        
+        EXPECT_EQ (fb, flat_block {b});
+        EXPECT_EQ (fb.Transactions.size (), 3);
+        EXPECT_EQ (block (fb), b);
+        EXPECT_EQ (bytes (fb), serialized);
+        EXPECT_EQ (fb.merkle_root (), merkle_root (b.Transactions));
+        
+    }
+    
+    TEST (TransactionTest, TestDesignTotals) {
+        
+        bytes script = pay_to_address::script (digest160 {"0x2222222222222222222222222222222222222222"});
+        
+        auto expected_size = [] (const transaction_design &d) -> uint64 {
+            uint64 size = 8 + var_int::size (d.Inputs.size ()) + var_int::size (d.Outputs.size ());
+            for (const transaction_design::input &in : d.Inputs) size += in.serialized_size ();
+            for (const output &o : d.Outputs) size += o.serialized_size ();
+            return size;
+        };
+        
+        auto sent = [] (const transaction_design &d) -> int64 {
+            int64 x = 0;
+            for (const output &o : d.Outputs) x += int64 (o.Value);
+            return x;
+        };
+        
+        transaction_design d {1, list<transaction_design::input> {}, list<output> {}, 0};
+        d.add (transaction_design::input {prevout {outpoint {txid {uint256 {1}}, 0}, output {satoshi {1000000}, script}}, 107});
+        
+        // across the boundary where the number of outputs takes three bytes.
+        for (int64 i = 0; i < 260; i++) {
+            d.add (output {satoshi {i + 1}, script});
+            EXPECT_EQ (d.expected_size (), expected_size (d));
+            EXPECT_EQ (int64 (d.sent ()), sent (d));
+        }
+        
+        EXPECT_EQ (int64 (d.spent ()), 1000000);
+        EXPECT_EQ (int64 (d.fee ()), 1000000 - sent (d));
+        
+        // a change output with a longer script.
+        d.set_output (259, output {satoshi {5000}, bytes (300)});
+        EXPECT_EQ (d.Outputs.size (), 260);
+        EXPECT_EQ (d.expected_size (), expected_size (d));
+        EXPECT_EQ (int64 (d.sent ()), sent (d));
+        EXPECT_THROW (d.set_output (260, output {satoshi {1}, script}), std::out_of_range);
+        
+        // after editing the lists directly.
+        d.Outputs = list<output> {} << output {satoshi {10}, script};
+        d.recount ();
+        EXPECT_EQ (d.expected_size (), expected_size (d));
+        EXPECT_EQ (int64 (d.sent ()), 10);
+        
+    }
+    
+    TEST (TransactionTest, TestCoinSelection) {
+        
+        bytes script = pay_to_address::script (digest160 {"0x1111111111111111111111111111111111111111"});
+        uint64 script_size = 107;
+        satoshi_per_byte rate {1, 2};
+        
+        std::vector<coin_selector::candidate> candidates;
+        for (uint32 i = 0; i < 200; i++)
+            candidates.push_back (coin_selector::candidate {
+                prevout {outpoint {txid {uint256 {i + 1}}, i}, output {satoshi {int64 (1000 + 997 * i)}, script}}, script_size});
+        
+        coin_selector selector {candidates};
+        
+        auto check = [&] (const maybe<transaction_design> &d, list<output> payments) {
+            ASSERT_TRUE (bool (d));
+            EXPECT_GE (int64 (d->fee ()), int64 (calculate_fee (rate, d->expected_size ())));
+            EXPECT_EQ (d->Outputs.size () - payments.size () < 2, true);
+            
+            // no input is used twice.
+            std::set<uint32> used;
+            for (const transaction_design::input &in : d->Inputs) EXPECT_TRUE (used.insert (uint32 (in.Prevout.Key.Index)).second);
+        };
+        
+        // the value of two candidates less the fee for a transaction spending
+        // them, so that there is a match without change.
+        {
+            list<output> payments = list<output> {} << output {satoshi {0}, script};
+            uint64 size = transaction_design {1, list<transaction_design::input> {} << candidates[3] << candidates[8], payments, 0}.expected_size ();
+            int64 amount = 2000 + 997 * 11 - int64 (calculate_fee (rate, size));
+            payments = list<output> {} << output {satoshi {amount}, script};
+            
+            maybe<transaction_design> d = selector.select (payments, rate, script);
+            check (d, payments);
+            EXPECT_EQ (d->Outputs.size (), 1);
+            EXPECT_LE (int64 (d->fee ()) - int64 (calculate_fee (rate, d->expected_size ())), 
+                int64 (calculate_fee (rate, output {0, script}.serialized_size () + 148)) + 1);
+        }
+
+        // with change.
+        {
+            list<output> payments = list<output> {} << output {satoshi {123457}, script} << output {satoshi {50}, script};
+            maybe<transaction_design> d = selector.select (payments, rate, script);
+            check (d, payments);
+        }
+        
+        // more than any one candidate.
+        {
+            list<output> payments = list<output> {} << output {satoshi {1000000}, script};
+            maybe<transaction_design> d = selector.select (payments, rate, script);
+            check (d, payments);
+            EXPECT_GT (d->Inputs.size (), 1);
+            
+            // without change, whatever is left goes to the fee.
+            maybe<transaction_design> e = selector.select (payments, rate);
+            check (e, payments);
+            EXPECT_EQ (e->Outputs.size (), 1);
+        }
+        
+        // more than we have.
+        EXPECT_FALSE (bool (selector.select (list<output> {} << output {satoshi {100000000}, script}, rate, script)));
+        
+    }
+    
+    TEST (TransactionTest, TestSigner) {
+        
+        bytes script = pay_to_address::script (digest160 {"0x1111111111111111111111111111111111111111"});
+        secret first {secret::main, secp256k1::secret {uint256 {12345}}, true};
+        
+        list<transaction_design::input> inputs;
+        std::vector<secret> keys;
+        increment_key_source increment {first};
+        for (uint32 i = 0; i < 5; i++) {
+            inputs = inputs << transaction_design::input {
+                prevout {outpoint {txid {uint256 {i + 7}}, i}, output {satoshi {int64 (10000 + i)}, script}}, 107, 0xfffffffe - i};
+            keys.push_back (increment.next ());
+        }
+
+        transaction_design design {2, inputs, list<output> {} << output {satoshi {20000}, script} << output {satoshi {20000}, script}, 0};
+        list<sighash::document> documents = design.documents ();
+        
+        signer s {design};
+        ASSERT_EQ (s.size (), 5);
+        
+        for (sighash::directive d : {
+            directive (sighash::all), directive (sighash::none), directive (sighash::single),
+            directive (sighash::all, true), directive (sighash::none, true), directive (sighash::single, true),
+            directive (sighash::all, false, false), directive (sighash::single, false, false)}) {
+            for (uint32 i = 0; i < 5; i++) EXPECT_EQ (s.hash (i, d), signature::hash (documents[i], d)) << i << " " << int (d);
+        }
+        
+        executor e {3};
+        std::vector<signature> signatures = s.sign (keys, directive (sighash::all), e);
+        EXPECT_EQ (signatures, s.sign (keys));
+        
+        increment_key_source source {first};
+        EXPECT_EQ (signatures, s.sign (source, directive (sighash::all), e));
+        
+        for (uint32 i = 0; i < 5; i++) {
+            EXPECT_EQ (signatures[i], keys[i].sign (documents[i]));
+            EXPECT_TRUE (signature::verify (signatures[i], keys[i].to_public (), documents[i]));
+        }
+        
+        EXPECT_THROW (s.sign (std::vector<secret> (4, first)), std::invalid_argument);
+        
+    }
+    
+    TEST (TransactionTest, TestBuilder) {
+        
+        bytes script = pay_to_address::script (digest160 {"0x1111111111111111111111111111111111111111"});
+        secret first {secret::main, secp256k1::secret {uint256 {12345}}, true};
+        
+        list<transaction_design::input> inputs;
+        std::vector<secret> keys;
+        increment_key_source increment {first};
+        for (uint32 i = 0; i < 4; i++) {
+            inputs = inputs << transaction_design::input {
+                prevout {outpoint {txid {uint256 {i + 7}}, i}, output {satoshi {int64 (10000 + i)}, script}}, 107, 0xfffffffe - i};
+            keys.push_back (increment.next ());
+        }
+        
+        transaction_design design {2, inputs, list<output> {} << output {satoshi {20000}, script} << output {satoshi {15000}, script}, 7};
+        
+        transaction_builder b {design};
+        ASSERT_EQ (b.inputs (), 4);
+        EXPECT_EQ (b.serialized ().size (), design.expected_size ());
+        EXPECT_FALSE (b.complete ());
+        EXPECT_THROW (b.id (), std::logic_error);
+        EXPECT_THROW (b.set (4, bytes {}), std::out_of_range);
+        
+        std::vector<signature> signatures = signer {design}.sign (keys);
+        list<bytes> redeem;
+        for (uint32 i = 0; i < 4; i++) redeem = redeem << pay_to_address::redeem (signatures[i], keys[i].to_public ());
+        
+        // a script that is much bigger than expected, which is replaced later.
+        b.set (2, bytes (300, 0x51));
+        
+        // out of order, and not all the size that was expected.
+        for (uint32 i : {1, 0, 3, 2}) b.set (i, redeem[i]);
+        EXPECT_TRUE (b.complete ());
+        
+        transaction expected = design.complete (redeem);
+        EXPECT_EQ (bytes (b), bytes (expected));
+        EXPECT_EQ (b.id (), expected.id ());
+        EXPECT_EQ (transaction {b.serialized ()}, expected);
+        
+    }
+    
+    TEST (TransactionTest, TestPaymentChain) {
+        using namespace BitcoinAssociation;
+        
+        secret key {secret::main, secp256k1::secret {uint256 {777}}, true};
+        bytes change_script = pay_to_address::script (key.address ().Digest);
+        prevout first {outpoint {txid {uint256 {99}}, 0}, output {satoshi {100000}, change_script}};
+        
+        // the test decides when each submission is answered.
+        std::mutex mutex;
+        std::condition_variable submitted;
+        std::vector<transaction> transactions;
+        std::vector<std::promise<MAPI::submit_transaction_response>> answers;
+        
+        auto submit = [&] (const MAPI::transaction_submission &x) {
+            std::lock_guard<std::mutex> lock (mutex);
+            transactions.push_back (transaction {x.Transaction});
+            answers.emplace_back ();
+            submitted.notify_all ();
+            return answers.back ().get_future ();
+        };
+        
+        auto wait_for = [&] (size_t n) {
+            std::unique_lock<std::mutex> lock (mutex);
+            submitted.wait (lock, [&] () {
+                return transactions.size () >= n;
+            });
+        };
+        
+        auto answer = [&] (size_t i, MAPI::return_result r) {
+            MAPI::submit_transaction_response x {};
+            x.TXID = transactions[i].id ();
+            x.ReturnResult = r;
+            std::lock_guard<std::mutex> lock (mutex);
+            answers[i].set_value (x);
+        };
+        
+        bytes pay_script = pay_to_address::script (digest160 {"0x1111111111111111111111111111111111111111"});
+        auto payment = [&] (int64 amount) {
+            return list<output> {} << output {satoshi {amount}, pay_script};
+        };
+        
+        payment_chain::options o {};
+        o.FeeRate = satoshi_per_byte {satoshi {1}, 1};
+        payment_chain chain {submit, first, key, o};
+        
+        std::future<payment_chain::payment> a = chain.pay (payment (1000));
+        std::future<payment_chain::payment> b = chain.pay (payment (2000));
+        std::future<payment_chain::payment> c = chain.pay (payment (3000));
+        EXPECT_THROW (chain.pay (payment (1000000)).get (), payment_chain::insufficient_funds);
+        wait_for (3);
+        
+        // each spends the change of the one before.
+        EXPECT_EQ (transactions[0].Inputs.first ().Reference, first.Key);
+        for (size_t i = 1; i < 3; i++) {
+            EXPECT_EQ (transactions[i].Inputs.first ().Reference, (outpoint {transactions[i - 1].id (), 1}));
+            EXPECT_EQ (transactions[i].Outputs[1].Script, change_script);
+        }
+        
+        // the fee is for the expected size, which is at least the real size.
+        EXPECT_GE (first.value () - transactions[0].sent (), calculate_fee (o.FeeRate, bytes (transactions[0]).size ()));
+        
+        answer (0, MAPI::success);
+        payment_chain::payment pa = a.get ();
+        EXPECT_EQ (pa.TXID, transactions[0].id ());
+        EXPECT_EQ (pa.Response.ReturnResult, MAPI::success);
+        
+        // the second is rejected, so the third is rolled back and the chain goes back to the change of the first.
+        answer (1, MAPI::failure);
+        EXPECT_EQ (b.get ().Response.ReturnResult, MAPI::failure);
+        EXPECT_THROW (c.get (), payment_chain::rolled_back);
+        EXPECT_EQ (chain.tip ().Key, (outpoint {transactions[0].id (), 1}));
+        
+        std::future<payment_chain::payment> d = chain.pay (payment (4000));
+        wait_for (4);
+        EXPECT_EQ (transactions[3].Inputs.first ().Reference, (outpoint {transactions[0].id (), 1}));
+        answer (3, MAPI::success);
+        EXPECT_EQ (d.get ().TXID, transactions[3].id ());
+        EXPECT_EQ (chain.pending (), 0);
+        
+    }
+    
+    TEST (TransactionTest, TestStatusTracker) {
+        using namespace BitcoinAssociation;
+        
+        // the test decides when each request is answered.
+        std::mutex mutex;
+        std::condition_variable asked;
+        std::vector<std::pair<txid, std::function<void (const MAPI::transaction_status_response &)>>> requests;
+        
+        auto request = [&] (const txid &x,
+            std::function<void (const MAPI::transaction_status_response &)> then,
+            std::function<void (std::exception_ptr)>) {
+            std::lock_guard<std::mutex> lock (mutex);
+            requests.emplace_back (x, then);
+            asked.notify_all ();
+        };
+        
+        auto wait_for = [&] (size_t n) {
+            std::unique_lock<std::mutex> lock (mutex);
+            asked.wait (lock, [&] () {
+                return requests.size () >= n;
+            });
+        };
+        
+        auto answer = [&] (size_t i, uint32 confirmations) {
+            MAPI::transaction_status_response r {};
+            std::function<void (const MAPI::transaction_status_response &)> then;
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                r.TXID = requests[i].first;
+                then = requests[i].second;
+            }
+            
+            r.ReturnResult = MAPI::success;
+            if (confirmations > 0) r.Confirmations = confirmations;
+            then (r);
+        };
+        
+        txid a {uint256 {1}};
+        txid b {uint256 {2}};
+        
+        // after the first poll, transactions are only polled when a callback comes.
+        MAPI_status_tracker::options o {};
+        o.FirstPollMilliseconds = 1;
+        o.Callbacks = true;
+        o.FallbackPollMilliseconds = 3600000;
+        
+        {
+            MAPI_status_tracker tracker {request, o};
+            
+            // requests that are made at the same time share an answer.
+            std::shared_future<MAPI::transaction_status_response> first = tracker.status (b);
+            std::shared_future<MAPI::transaction_status_response> second = tracker.status (b);
+            EXPECT_EQ (requests.size (), 1);
+            answer (0, 0);
+            EXPECT_EQ (first.get ().TXID, b);
+            EXPECT_EQ (second.get ().TXID, b);
+            
+            std::atomic<uint32> updates {0};
+            tracker.subscribe ([&updates] (const MAPI::transaction_status_response &) {
+                updates++;
+            });
+            
+            tracker.track (a);
+            EXPECT_EQ (tracker.pending (), std::vector<txid> {a});
+            wait_for (2);
+            EXPECT_EQ (requests[1].first, a);
+            
+            // a callback while a request is waiting means that we ask again.
+            MAPI_callback mined {};
+            mined.Reason = MAPI_callback::merkle_proof;
+            mined.TXID = a;
+            tracker.receive (mined);
+            answer (1, 0);
+            EXPECT_EQ (updates, 1);
+            
+            wait_for (3);
+            EXPECT_EQ (requests[2].first, a);
+            answer (2, 1);
+            EXPECT_EQ (updates, 2);
+            EXPECT_TRUE (tracker.pending ().empty ());
+        }
+        
+        // tracked transactions are kept across restarts.
+        std::filesystem::path file = std::filesystem::temp_directory_path () / "gigamonkey_test_status_tracker";
+        std::filesystem::remove (file);
+        
+        MAPI_status_tracker::options p {};
+        p.FirstPollMilliseconds = 3600000;
+        p.File = file;
+        
+        {
+            MAPI_status_tracker tracker {request, p};
+            tracker.track (a);
+            tracker.track (b);
+            tracker.forget (a);
+        }
+        
+        {
+            MAPI_status_tracker tracker {request, p};
+            EXPECT_EQ (tracker.pending (), std::vector<txid> {b});
+        }
+        
+        EXPECT_EQ (requests.size (), 3);
+        std::filesystem::remove (file);
+    }
+    
+    TEST (TransactionTest, TestSubmitTransactionsResponse) {
+        using namespace BitcoinAssociation;
+        
+        secp256k1::secret miner {uint256 {4321}};
+        
+        auto txid_hex = [] (uint32 i) {
+            std::stringstream ss;
+            ss << std::hex << std::setw (64) << std::setfill ('0') << i;
+            return ss.str ();
+        };
+        
+        JSON txs = JSON::array ();
+        for (uint32 i = 1; i <= 300; i++) txs.push_back (JSON {
+            {"txid", txid_hex (i)},
+            {"returnResult", i % 7 == 0 ? "failure" : "success"},
+            {"resultDescription", i % 7 == 0 ? "Missing inputs\t\"\u00e9\"" : ""}});
+        
+        JSON payload {
+            {"apiVersion", "1.4.0"},
+            {"timestamp", "2023-01-01T00:00:00.000Z"},
+            {"minerId", encoding::hex::write (miner.to_public ())},
+            {"currentHighestBlockHash", txid_hex (999)},
+            {"currentHighestBlockHeight", 800000},
+            {"txSecondMempoolExpiry", 1},
+            {"txs", txs},
+            {"failureCount", 42}};
+        
+        MAPI::submit_transactions_response expected {payload};
+        ASSERT_TRUE (expected.valid ());
+        ASSERT_EQ (expected.Transactions.size (), 300);
+        
+        auto same = [&expected] (const MAPI::submit_transactions_response &r) {
+            if (!r.valid () || r.APIVersion != expected.APIVersion || r.Timestamp != expected.Timestamp ||
+                r.MinerID != expected.MinerID || r.CurrentHighestBlockHash != expected.CurrentHighestBlockHash ||
+                r.CurrentHighestBlockHeight != expected.CurrentHighestBlockHeight ||
+                r.TxSecondMempoolExpiry != expected.TxSecondMempoolExpiry || r.FailureCount != expected.FailureCount ||
+                r.Transactions.size () != expected.Transactions.size ()) return false;
+            
+            for (size_t i = 0; i < r.Transactions.size (); i++)
+                if (r.Transactions[i].TXID != expected.Transactions[i].TXID ||
+                    r.Transactions[i].ReturnResult != expected.Transactions[i].ReturnResult ||
+                    r.Transactions[i].ResultDescription != expected.Transactions[i].ResultDescription) return false;
+            
+            return true;
+        };
+        
+        // the payload is escaped inside the envelope, and characters that are not ascii are escaped too.
+        string body = JSON (JSON_JSON_envelope {payload, miner}).dump (-1, ' ', true);
+        
+        size_t given = 0;
+        maybe<MAPI::submit_transactions_response> read = MAPI::submit_transactions_response::read (body,
+            [&given, &expected] (const MAPI::transaction_status &status) {
+                EXPECT_EQ (status.TXID, expected.Transactions[given].TXID);
+                given++;
+            });
+        
+        ASSERT_TRUE (bool (read));
+        EXPECT_TRUE (same (*read));
+        EXPECT_EQ (given, 300);
+        
+        // a payload that does not match its signature.
+        string tampered = body;
+        size_t at = tampered.find ("800000");
+        ASSERT_NE (at, string::npos);
+        tampered[at + 5] = '1';
+        EXPECT_FALSE (bool (MAPI::submit_transactions_response::read (tampered)));
+        
+        // an unsigned response, with its payload as base64 and as text.
+        string text = payload.dump ();
+        bytes data (text.size ());
+        std::copy (text.begin (), text.end (), data.begin ());
+        for (const JSON &unsigned_envelope : {
+            JSON {{"payload", text}, {"signature", nullptr}, {"publicKey", nullptr},
+                {"encoding", "UTF-8"}, {"mimetype", "application/json"}},
+            JSON {{"payload", encoding::base64::write (data)}, {"encoding", "base64"}, {"mimetype", "application/json"}}}) {
+            maybe<MAPI::submit_transactions_response> x = MAPI::submit_transactions_response::read (unsigned_envelope.dump (2));
+            ASSERT_TRUE (bool (x));
+            EXPECT_TRUE (same (*x));
+        }
+        
+        // a signed base64 payload, which is long enough to be decoded in more than one piece.
+        JSON_envelope signed_base64 {data, "application/json", miner};
+        EXPECT_TRUE (signed_base64.verify ());
+        maybe<MAPI::submit_transactions_response> from_base64 = MAPI::submit_transactions_response::read (JSON (signed_base64).dump ());
+        ASSERT_TRUE (bool (from_base64));
+        EXPECT_TRUE (same (*from_base64));
+        signed_base64.Payload[100] = signed_base64.Payload[100] == 'A' ? 'B' : 'A';
+        EXPECT_FALSE (signed_base64.verify ());
+        
+        EXPECT_FALSE (bool (MAPI::submit_transactions_response::read ("{\"payload\": ")));
+    }
+    
+    TEST (TransactionTest, TestVerifyEnvelopes) {
+        using namespace BitcoinAssociation;
+        
+        secp256k1::secret miner {uint256 {4321}};
+        
+        // unsigned, signed text and signed base64 envelopes, enough for several chunks.
+        std::vector<JSON_envelope> envelopes;
+        for (int i = 0; i < 40; i++) {
+            string payload = JSON {{"n", i}}.dump ();
+            if (i % 3 == 0) envelopes.push_back (JSON_envelope {payload, "application/json"});
+            else if (i % 3 == 1) envelopes.push_back (JSON_envelope {payload, "application/json", miner});
+            else envelopes.push_back (JSON_envelope {bytes (payload.begin (), payload.end ()), "application/json", miner});
+        }
+        
+        // payloads that do not match their signatures and an envelope that is not valid.
+        for (int i : {4, 17, 38}) envelopes[i].Payload = envelopes[i - 3].Payload;
+        envelopes.push_back (JSON_envelope {});
+        
+        executor e {2};
+        std::vector<bool> verified = JSON_envelope::verify (std::span<const JSON_envelope> {envelopes}, e);
+        ASSERT_EQ (verified.size (), envelopes.size ());
+        for (size_t i = 0; i < envelopes.size (); i++) EXPECT_EQ (verified[i], envelopes[i].verify ()) << i;
+        EXPECT_EQ (std::count (verified.begin (), verified.end (), false), 4);
+        
+        EXPECT_TRUE (JSON_envelope::verify (std::span<const JSON_envelope> {}, e).empty ());
+    }
+    
+    TEST (TransactionTest, TestMAPICallback) {
+        using namespace BitcoinAssociation;
+        
+        secp256k1::secret miner {uint256 {4321}};
+        string callback_txid = "ffeff11c25cde7c06d407490d81ef4d0db64aad6ab3d14393530701561a465ef";
+        string double_spend_txid = "00000000000000000000000000000000000000000000000000000000000000ab";
+        
+        JSON proof = JSON::parse (R"JSON({
+            "index": 12,
+            "txOrId": "ffeff11c25cde7c06d407490d81ef4d0db64aad6ab3d14393530701561a465ef",
+            "target": "75edb0a69eb195cdd81e310553aa4d25e18450e08f168532a2c2e9cf447bf169",
+            "nodes": [
+                "b9ef07a62553ef8b0898a79c291b92c60f7932260888bde0dab2dd2610d8668e",
+                "0fc1c12fb1b57b38140442927fbadb3d1e5a5039a5d6db355ea25486374f104d",
+                "60b0e75dd5b8d48f2d069229f20399e07766dd651ceeed55ee3c040aa2812547",
+                "c0d8dbda46366c2050b430a05508a3d96dc0ed55aea685bb3d9a993f8b97cc6f",
+                "391e62b3419d8a943f7dbc7bddc90e30ec724c033000dc0c8872253c27b03a42"
+            ]
+        })JSON");
+        
+        // the callback payload is usually written as a string, with its own escapes.
+        JSON merkle_proof {
+            {"apiVersion", "1.4.0 \"é\""},
+            {"timestamp", "2023-01-01T00:00:00.000Z"},
+            {"minerId", encoding::hex::write (miner.to_public ())},
+            {"blockHash", "75edb0a69eb195cdd81e310553aa4d25e18450e08f168532a2c2e9cf447bf169"},
+            {"blockHeight", 800000},
+            {"callbackTxId", callback_txid},
+            {"callbackReason", "merkleProof"},
+            {"callbackPayload", proof.dump ()}};
+        
+        JSON double_spend {
+            {"apiVersion", "1.4.0"},
+            {"timestamp", "2023-01-01T00:00:00.000Z"},
+            {"minerId", nullptr},
+            {"callbackTxId", callback_txid},
+            {"callbackReason", "doubleSpendAttempt"},
+            {"callbackPayload", {{"doubleSpendTxId", double_spend_txid}, {"payload", "0100"}}}};
+        
+        string signed_body = JSON (JSON_JSON_envelope {merkle_proof, miner}).dump (-1, ' ', true);
+        string text = double_spend.dump ();
+        bytes data (text.size ());
+        std::copy (text.begin (), text.end (), data.begin ());
+        string unsigned_body = JSON (JSON_envelope {data, "application/json"}).dump (2);
+        
+        // the envelope is read the same way as by the JSON parser.
+        for (const string &body : {signed_body, unsigned_body}) {
+            maybe<JSON_envelope> fast = MAPI_callback_receiver::read_envelope (body);
+            ASSERT_TRUE (bool (fast));
+            EXPECT_EQ (JSON (*fast), JSON (JSON_envelope {JSON::parse (body)}));
+            EXPECT_TRUE (fast->verify ());
+        }
+        
+        MAPI_callback mined = MAPI_callback::read (*MAPI_callback_receiver::read_envelope (signed_body));
+        ASSERT_TRUE (mined.valid ());
+        EXPECT_EQ (mined.Reason, MAPI_callback::merkle_proof);
+        EXPECT_EQ (mined.APIVersion, "1.4.0 \"é\"");
+        EXPECT_EQ (mined.MinerID, encoding::hex::write (miner.to_public ()));
+        EXPECT_EQ (mined.TXID, digest256 {"0x" + callback_txid});
+        EXPECT_EQ (mined.BlockHeight, 800000);
+        EXPECT_EQ (JSON (mined.Proof), JSON (proofs_serialization_standard::read_JSON (proof)));
+        
+        MAPI_callback spent = MAPI_callback::read (*MAPI_callback_receiver::read_envelope (unsigned_body));
+        ASSERT_TRUE (spent.valid ());
+        EXPECT_EQ (spent.Reason, MAPI_callback::double_spend_attempt);
+        EXPECT_EQ (spent.MinerID, "");
+        EXPECT_EQ (spent.DoubleSpendTXID, digest256 {"0x" + double_spend_txid});
+        EXPECT_EQ (spent.DoubleSpendTransaction, *encoding::hex::read ("0100"));
+        
+        // a duplicate member is left to the JSON parser, which keeps the last.
+        string duplicate = R"({"payload": "a", "payload": "b", "encoding": "UTF-8", "mimetype": "text/plain"})";
+        ASSERT_TRUE (bool (MAPI_callback_receiver::read_envelope (duplicate)));
+        EXPECT_EQ (MAPI_callback_receiver::read_envelope (duplicate)->Payload, "b");
+        
+        // envelopes that cannot be read.
+        for (const string &body : {
+            string {}, string {"{"}, signed_body.substr (0, signed_body.size () - 1), signed_body + "}",
+            string {R"({"payload": "\x", "encoding": "UTF-8", "mimetype": "text/plain"})"},
+            string {R"({"payload": "a", "encoding": "UTF_8", "mimetype": "text/plain"})"},
+            string {R"({"payload": "a", "mimetype": "text/plain"})"},
+            string {R"({"payload": "a", "encoding": "UTF-8", "mimetype": "text/plain", "signature": "00"})"}})
+            EXPECT_FALSE (bool (MAPI_callback_receiver::read_envelope (body))) << body;
+        
+        // callbacks that cannot be read.
+        auto callback = [] (JSON j) {
+            return MAPI_callback::read (JSON_envelope {j.dump (), "application/json"});
+        };
+        
+        EXPECT_TRUE (callback (merkle_proof).valid ());
+        for (const char *key : {"callbackTxId", "callbackPayload"}) {
+            JSON j = merkle_proof;
+            j.erase (key);
+            EXPECT_FALSE (callback (j).valid ()) << key;
+        }
+        
+        JSON wrong = merkle_proof;
+        wrong["callbackReason"] = "somethingElse";
+        EXPECT_FALSE (callback (wrong).valid ());
+        wrong = merkle_proof;
+        wrong["callbackPayload"] = "{not JSON";
+        EXPECT_FALSE (callback (wrong).valid ());
+        wrong = merkle_proof;
+        wrong["callbackTxId"] = "abcd";
+        EXPECT_FALSE (callback (wrong).valid ());
+        wrong = double_spend;
+        wrong["callbackPayload"]["payload"] = "not hex";
+        EXPECT_FALSE (callback (wrong).valid ());
+        EXPECT_FALSE (MAPI_callback::read (JSON_envelope {}).valid ());
+        
+        // callbacks without signatures are not accepted unless we say so.
+        MAPI_callback_receiver::options o {};
+        o.QueueSize = 2;
+        MAPI_callback_receiver receiver {o};
+        EXPECT_FALSE (receiver.receive (unsigned_body));
+        
+        string tampered = signed_body;
+        tampered[tampered.find ("800000")] = '9';
+        EXPECT_FALSE (receiver.receive (tampered));
+        
+        // the queue holds two, and the rest are dropped.
+        EXPECT_TRUE (receiver.receive (signed_body));
+        EXPECT_TRUE (receiver.receive (signed_body));
+        EXPECT_FALSE (receiver.receive (signed_body));
+        EXPECT_EQ (receiver.dropped (), 1);
+        
+        MAPI_callback x;
+        EXPECT_TRUE (receiver.pop (x));
+        EXPECT_EQ (x.TXID, mined.TXID);
+        EXPECT_TRUE (receiver.receive (signed_body));
+        EXPECT_TRUE (receiver.pop (x));
+        EXPECT_TRUE (receiver.pop (x));
+        EXPECT_FALSE (receiver.pop (x));
+        
+        o.RequireSignature = false;
+        o.QueueSize = 1 << 10;
+        MAPI_callback_receiver open {o};
+        EXPECT_TRUE (open.receive (unsigned_body));
+        EXPECT_TRUE (open.pop (x));
+        EXPECT_EQ (x.Reason, MAPI_callback::double_spend_attempt);
+        
+        // many threads receive and pop at once, and everything received is popped once.
+        std::atomic<uint32> received {0};
+        std::atomic<uint32> popped {0};
+        {
+            std::vector<std::thread> threads;
+            for (int i = 0; i < 4; i++) threads.emplace_back ([&] () {
+                for (int j = 0; j < 50; j++) if (open.receive (j % 2 == 0 ? signed_body : unsigned_body)) received++;
+            });
+            
+            for (int i = 0; i < 2; i++) threads.emplace_back ([&] () {
+                MAPI_callback y;
+                for (int j = 0; j < 200; j++) if (open.pop (y)) popped++;
+            });
+            
+            for (std::thread &t : threads) t.join ();
+        }
+        
+        MAPI_callback y;
+        while (open.pop (y)) popped++;
+        EXPECT_EQ (received, 200);
+        EXPECT_EQ (popped, received);
+        EXPECT_EQ (open.dropped (), 0);
+        
+        // and in batches.
+        executor e {2};
+        std::vector<string_view> bodies {signed_body, tampered, unsigned_body, "{"};
+        EXPECT_EQ (open.receive (bodies, e), (std::vector<bool> {true, false, true, false}));
+    }
+    
+    TEST (TransactionTest, TestMAPIJournal) {
+        using namespace BitcoinAssociation;
+        
+        std::filesystem::path file = std::filesystem::temp_directory_path () / "gigamonkey_test_mapi_journal";
+        std::filesystem::remove (file);
+        
+        auto submission = [] (byte i) {
+            MAPI::submit_transaction_parameters p;
+            if (i % 2 == 0) p.CallbackURL = "https://example.com/callback";
+            if (i % 3 == 0) p.MerkleProof = i % 4 == 0;
+            p.DSCheck = true;
+            
+            bytes tx (100 + i);
+            std::fill (tx.begin (), tx.end (), i);
+            return MAPI::transaction_submission {tx, p};
+        };
+        
+        auto same = [] (const MAPI::transaction_submission &a, const MAPI::transaction_submission &b) {
+            return a.Transaction == b.Transaction && a.Parameters.CallbackURL == b.Parameters.CallbackURL &&
+                a.Parameters.CallbackToken == b.Parameters.CallbackToken && a.Parameters.MerkleProof == b.Parameters.MerkleProof &&
+                a.Parameters.MerkleFormat == b.Parameters.MerkleFormat && a.Parameters.DSCheck == b.Parameters.DSCheck &&
+                a.Parameters.CallbackEncryption == b.Parameters.CallbackEncryption;
+        };
+        
+        {
+            MAPI_journal journal {file, 4096};
+            EXPECT_TRUE (journal.pending ().empty ());
+            for (byte i = 0; i < 6; i++) EXPECT_EQ (journal.append (submission (i)), i);
+            journal.acknowledge (1);
+            journal.acknowledge (4);
+            journal.commit ();
+        }
+        
+        {
+            MAPI_journal journal {file, 0};
+            EXPECT_EQ (journal.capacity (), 4096);
+            
+            auto pending = journal.pending ();
+            ASSERT_EQ (pending.size (), 4);
+            std::vector<byte> expected {0, 2, 3, 5};
+            for (size_t i = 0; i < 4; i++) {
+                EXPECT_EQ (pending[i].first, expected[i]);
+                EXPECT_TRUE (same (pending[i].second, submission (expected[i])));
+            }
+            
+            // entries that are acknowledged make room for more when the file is full.
+            for (byte i = 0; i < 4; i++) journal.acknowledge (expected[i]);
+            uint64 last = 0;
+            for (byte i = 0; i < 100; i++) {
+                last = journal.append (submission (i % 10));
+                journal.acknowledge (last);
+            }
+            
+            EXPECT_EQ (last, 105);
+            EXPECT_LT (journal.size (), 4096);
+            
+            journal.append (submission (7));
+            journal.commit ();
+        }
+        
+        // a torn record at the end is left out.
+        {
+            std::fstream f {file, std::ios::in | std::ios::out | std::ios::binary};
+            MAPI_journal journal {file, 0};
+            ASSERT_EQ (journal.pending ().size (), 1);
+            uint64 end = journal.size ();
+            journal.append (submission (8));
+            journal.commit ();
+            
+            f.seekp (end + 20);
+            f.put ('x');
+        }
+        
+        {
+            MAPI_journal journal {file, 0};
+            auto pending = journal.pending ();
+            ASSERT_EQ (pending.size (), 1);
+            EXPECT_TRUE (same (pending[0].second, submission (7)));
+            
+            // there is no room for anything as big as the file.
+            EXPECT_THROW (journal.append (MAPI::transaction_submission {bytes (4096)}), std::length_error);
+        }
+        
+        std::filesystem::remove (file);
+    }
+    
+    // there is no miner to talk to here, so every connection fails.
+    TEST (TransactionTest, TestMAPIPool) {
+        using namespace BitcoinAssociation;
+        
+        EXPECT_THROW ((MAPI_pool {MAPI_pool::connect {}, 1}), std::invalid_argument);
+        EXPECT_THROW ((MAPI_pool {[] () -> ptr<MAPI> {
+            return nullptr;
+        }, 0}), std::invalid_argument);
+        
+        std::atomic<uint32> connections {0};
+        auto refuse = [&connections] () -> ptr<MAPI> {
+            connections++;
+            throw std::runtime_error {"connection refused"};
+        };
+        
+        {
+            MAPI_pool pool {refuse, 2};
+            
+            // the error goes to the future and the next request tries to connect again.
+            std::vector<std::future<MAPI::get_fee_quote_response>> quotes;
+            for (int i = 0; i < 4; i++) quotes.push_back (pool.get_fee_quote ());
+            for (auto &q : quotes) EXPECT_THROW (q.get (), std::runtime_error);
+            EXPECT_EQ (connections.load (), 4);
+            
+            EXPECT_THROW (pool.get_transaction_status (txid {uint256 {1}}).get (), std::runtime_error);
+            EXPECT_THROW (pool.submit_transaction (MAPI::submit_transaction_request {bytes (10, 1)}).get (), std::runtime_error);
+            EXPECT_EQ (connections.load (), 6);
+            
+            // or to the fail callback.
+            std::promise<string> failed;
+            pool.get_fee_quote ([] (const MAPI::get_fee_quote_response &) {
+                ADD_FAILURE ();
+            }, [&failed] (std::exception_ptr err) {
+                try {
+                    std::rethrow_exception (err);
+                } catch (const std::exception &e) {
+                    failed.set_value (e.what ());
+                }
+            });
+            
+            EXPECT_EQ (failed.get_future ().get (), "connection refused");
+            EXPECT_EQ (connections.load (), 7);
+        }
+        
+        // requests wait for a connection, and those still waiting when the pool is destroyed are made anyway.
+        std::promise<void> open;
+        std::shared_future<void> opened = open.get_future ().share ();
+        std::vector<std::future<MAPI::get_fee_quote_response>> waiting;
+        {
+            MAPI_pool pool {[opened, refuse] () -> ptr<MAPI> {
+                opened.wait ();
+                return refuse ();
+            }, 1};
+            
+            for (int i = 0; i < 3; i++) waiting.push_back (pool.get_fee_quote ());
+            
+            // the first has been taken by the connection.
+            for (int i = 0; i < 1000 && pool.waiting () > 2; i++) std::this_thread::sleep_for (std::chrono::milliseconds {5});
+            EXPECT_EQ (pool.waiting (), 2);
+            open.set_value ();
+        }
+        
+        for (auto &w : waiting) EXPECT_THROW (w.get (), std::runtime_error);
+        EXPECT_EQ (connections.load (), 10);
+    }
+    
+    // coroutines wait for the pool without blocking the thread of their executor.
+    TEST (TransactionTest, TestAsyncMAPIPool) {
+        using namespace BitcoinAssociation;
+        
+        std::atomic<uint32> connections {0};
+        MAPI_pool pool {[&connections] () -> ptr<MAPI> {
+            connections++;
+            throw std::runtime_error {"connection refused"};
+        }, 1};
+        
+        boost::asio::thread_pool loop {1};
+        
+        // errors are thrown from co_await.
+        EXPECT_THROW (Gigamonkey::wait (loop.get_executor (), pool.async_get_fee_quote ()), std::runtime_error);
+        EXPECT_THROW (Gigamonkey::wait (loop.get_executor (),
+            pool.async_submit_transaction (MAPI::submit_transaction_request {bytes (10, 1)})), std::runtime_error);
+        EXPECT_THROW (Gigamonkey::wait (loop.get_executor (),
+            pool.async_submit_transactions (MAPI::submit_transactions_request {})), std::runtime_error);
+        EXPECT_EQ (connections.load (), 3);
+        
+        // and results are given back on the executor of the coroutine, whatever thread they come from.
+        std::thread answer;
+        EXPECT_EQ (Gigamonkey::wait (loop.get_executor (), from_callbacks<int> ([&answer] (auto then, auto) {
+            answer = std::thread {[then] () {
+                then (7);
+            }};
+        })), 7);
+        
+        answer.join ();
+        loop.join ();
+    }
+    
+    TEST (TransactionTest, TestMAPIBatcher) {
+        using namespace BitcoinAssociation;
+        
+        std::atomic<uint32> connections {0};
+        MAPI_pool pool {[&connections] () -> ptr<MAPI> {
+            connections++;
+            throw std::runtime_error {"connection refused"};
+        }, 1};
+        
+        auto submission = [] (byte i) {
+            return MAPI::transaction_submission {bytes (100, i)};
+        };
+        
+        MAPI_batcher::options o {};
+        o.MaxBatch = 0;
+        EXPECT_THROW ((MAPI_batcher {pool, o}), std::invalid_argument);
+        
+        // a batch that fails is sent again until it runs out of retries.
+        o.MaxBatch = 2;
+        o.MaxWaitMilliseconds = 1;
+        o.Retries = 2;
+        {
+            MAPI_batcher batcher {pool, o};
+            EXPECT_THROW (batcher.submit (MAPI::transaction_submission {bytes {}}), std::invalid_argument);
+            EXPECT_THROW (batcher.submit (submission (1)).get (), std::runtime_error);
+            EXPECT_EQ (connections.load (), 3);
+        }
+        
+        // a full batch goes out at once and the rest wait, here until the batcher is destroyed.
+        o.MaxWaitMilliseconds = 600000;
+        o.Retries = 0;
+        std::vector<std::future<MAPI::submit_transaction_response>> submitted;
+        {
+            MAPI_batcher batcher {pool, o};
+            for (byte i = 0; i < 3; i++) submitted.push_back (batcher.submit (submission (i)));
+            EXPECT_THROW (submitted[0].get (), std::runtime_error);
+            EXPECT_THROW (submitted[1].get (), std::runtime_error);
+            EXPECT_EQ (connections.load (), 4);
+        }
+        
+        EXPECT_THROW (submitted[2].get (), std::runtime_error);
+        EXPECT_EQ (connections.load (), 5);
+        
+        // with a journal, transactions that failed are still pending and the next batcher sends them again.
+        std::filesystem::path file = std::filesystem::temp_directory_path () /
+            ("gigamonkey_test_mapi_batcher_" + std::to_string (::getpid ()));
+        std::filesystem::remove (file);
+        
+        {
+            MAPI_journal journal {file, 4096};
+            {
+                MAPI_batcher batcher {pool, journal, o};
+                auto x = batcher.submit (submission (7));
+                batcher.flush ();
+                EXPECT_THROW (x.get (), std::runtime_error);
+            }
+            
+            EXPECT_EQ (connections.load (), 6);
+            ASSERT_EQ (journal.pending ().size (), 1);
+            EXPECT_EQ (journal.pending ()[0].second.Transaction, submission (7).Transaction);
+            
+            {
+                MAPI_batcher batcher {pool, journal, o};
+            }
+            
+            EXPECT_EQ (connections.load (), 7);
+            EXPECT_EQ (journal.pending ().size (), 1);
+        }
+        
+        std::filesystem::remove (file);
+    }
+    
+    TEST (TransactionTest, TestFeeQuotes) {
+        using namespace BitcoinAssociation;
+        
+        auto expiry = [] (const string &x) {
+            MAPI::get_fee_quote_response q {};
+            q.ExpiryTime = x;
+            return fee_quotes::expiry (q);
+        };
+        
+        maybe<fee_quotes::clock::time_point> expected {fee_quotes::clock::from_time_t (1633003445)};
+        EXPECT_EQ (expiry ("2021-09-30T12:04:05Z"), expected);
+        EXPECT_EQ (expiry ("2021-09-30T12:04:05.112Z"), expected);
+        EXPECT_EQ (expiry ("2000-02-29T00:00:00Z"), (maybe<fee_quotes::clock::time_point> {fee_quotes::clock::from_time_t (951782400)}));
+        
+        for (const string &bad : {"", "2021-09-30", "2021-09-30 12:04:05Z", "2021-09-30T12:04:05",
+            "2021-09-30T12:04:05+01:00", "2021-09-30T12:04:05Zx", "2021-09-30T12:04:05.1a2Z"})
+            EXPECT_FALSE (bool (expiry (bad))) << bad;
+        
+        // the miner does not answer until we let it, and then fails.
+        std::atomic<uint32> connections {0};
+        std::promise<void> answer;
+        std::shared_future<void> answered = answer.get_future ().share ();
+        MAPI_pool pool {[answered, &connections] () -> ptr<MAPI> {
+            connections++;
+            answered.wait ();
+            throw std::runtime_error {"connection refused"};
+        }, 1};
+        
+        fee_quotes::options o {};
+        o.RefreshSeconds = 3600;
+        
+        fee_quotes quotes {o};
+        EXPECT_THROW (quotes.quote ("taal"), std::invalid_argument);
+        quotes.add ("taal", pool);
+        EXPECT_THROW (quotes.add ("taal", pool), std::invalid_argument);
+        
+        // the refresher asks as soon as the miner is added, and we wait on the same request.
+        auto a = quotes.quote ("taal");
+        auto b = quotes.quote ("taal");
+        answer.set_value ();
+        EXPECT_THROW (a.get (), std::runtime_error);
+        EXPECT_THROW (b.get (), std::runtime_error);
+        EXPECT_EQ (connections.load (), 1);
+        
+        // nothing can be selected without a quote.
+        EXPECT_FALSE (bool (quotes.select ()));
+        EXPECT_FALSE (bool (quotes.fee (250)));
+        
+        // we can ask again ourselves, but the refresher waits a while after a failure.
+        EXPECT_THROW (quotes.quote ("taal").get (), std::runtime_error);
+        EXPECT_EQ (connections.load (), 2);
+        std::this_thread::sleep_for (std::chrono::milliseconds {50});
+        EXPECT_EQ (connections.load (), 2);
+    }
+    
+    TEST (TransactionTest, TestMAPIBroadcaster) {
+        using namespace BitcoinAssociation;
+        
+        MAPI_broadcaster::options o {};
+        o.HedgePercentile = 0;
+        EXPECT_THROW ((MAPI_broadcaster {o}), std::invalid_argument);
+        
+        // miner a does not answer until we let it, and then fails. Miner b fails right away.
+        std::atomic<uint32> a_connections {0};
+        std::atomic<uint32> b_connections {0};
+        std::promise<void> answer;
+        std::shared_future<void> answered = answer.get_future ().share ();
+        std::promise<void> hedged;
+        
+        MAPI_pool a {[answered, &a_connections] () -> ptr<MAPI> {
+            a_connections++;
+            answered.wait ();
+            throw std::runtime_error {"a is down"};
+        }, 1};
+        
+        MAPI_pool b {[&hedged, &b_connections] () -> ptr<MAPI> {
+            if (b_connections++ == 0) hedged.set_value ();
+            throw std::runtime_error {"b is down"};
+        }, 1};
+        
+        MAPI::submit_transaction_request request {bytes (10, 1)};
+        
+        o.HedgePercentile = .9;
+        o.DefaultHedgeMilliseconds = 20;
+        {
+            MAPI_broadcaster broadcaster {o};
+            EXPECT_THROW (broadcaster.broadcast (request), std::logic_error);
+            
+            broadcaster.add ("a", a);
+            broadcaster.add ("b", b);
+            EXPECT_THROW (broadcaster.add ("a", a), std::invalid_argument);
+            EXPECT_THROW (broadcaster.stats ("c"), std::invalid_argument);
+            
+            // we know nothing about either miner yet, so they are tried in the order that they were added.
+            EXPECT_EQ (broadcaster.order (), (std::vector<string> {"a", "b"}));
+            
+            // b is tried once a has taken too long, and the error from the last to answer goes to the future.
+            std::future<MAPI_broadcaster::result> result = broadcaster.broadcast (request);
+            ASSERT_EQ (hedged.get_future ().wait_for (std::chrono::seconds {10}), std::future_status::ready);
+            EXPECT_EQ (result.wait_for (std::chrono::milliseconds {0}), std::future_status::timeout);
+            
+            answer.set_value ();
+            try {
+                result.get ();
+                ADD_FAILURE ();
+            } catch (const std::runtime_error &e) {
+                EXPECT_EQ (string {e.what ()}, "a is down");
+            }
+            
+            EXPECT_EQ (a_connections.load (), 1);
+            
+            for (const string &m : {"a", "b"}) {
+                MAPI_broadcaster::statistics s = broadcaster.stats (m);
+                EXPECT_EQ (s.Requests, 1);
+                EXPECT_EQ (s.Errors, 1);
+                EXPECT_EQ (s.Accepted, 0);
+                EXPECT_EQ (s.Latency, std::chrono::milliseconds {20});
+            }
+            
+            // a miner that has not failed goes first.
+            broadcaster.add ("c", b);
+            EXPECT_EQ (broadcaster.order (), (std::vector<string> {"c", "a", "b"}));
+        }
+        
+        // a request that is no longer wanted when a connection takes it is not sent.
+        uint32 connected = b_connections;
+        std::promise<bool> cancelled;
+        b.submit_transaction (request, [] (const MAPI::submit_transaction_response &) {
+            ADD_FAILURE ();
+        }, [&cancelled] (std::exception_ptr err) {
+            try {
+                std::rethrow_exception (err);
+            } catch (const MAPI_pool::cancelled &) {
+                cancelled.set_value (true);
+            } catch (...) {
+                cancelled.set_value (false);
+            }
+        }, [] () {
+            return true;
+        });
+        
+        EXPECT_TRUE (cancelled.get_future ().get ());
+        EXPECT_EQ (b_connections.load (), connected);
+    }
+    
+    TEST (TransactionTest, TestArena) {
+        transaction t {
+            list<input> {input {outpoint {txid {uint256 {1}}, 0}, bytes {}}},
+            list<output> {output {satoshi {1000}, pay_to_address::script (digest160 {})}}};
+        bytes serialized (t);
+        
+        arena a {256};
+        bytes_view copy = a.copy (serialized);
+        EXPECT_NE (copy.data (), serialized.data ());
+        EXPECT_EQ (bytes (copy), serialized);
+        
+        // transactions can be read from memory in the arena.
+        transaction_view v {copy};
+        EXPECT_TRUE (v.valid ());
+        EXPECT_EQ (v.id (), t.id ());
+        
+        pmr_bytes b = make_pmr_bytes (serialized, &a);
+        EXPECT_EQ (bytes (b.begin (), b.end ()), serialized);
+        EXPECT_EQ (a.allocations (), 2);
+        EXPECT_GE (a.allocated (), 2 * serialized.size ());
+        
+        uint64 *n = a.make<uint64> (7u);
+        EXPECT_EQ (*n, 7);
+        EXPECT_EQ (a.allocations (), 3);
+        
+        a.release ();
+        EXPECT_EQ (a.allocated (), 0);
+        EXPECT_EQ (a.allocations (), 0);
+        
+        pmr_bytes pooled = make_pmr_bytes (serialized, thread_pool ());
+        EXPECT_EQ (bytes (pooled.begin (), pooled.end ()), serialized);
+    }
+    
+    TEST (TransactionTest, TestCompactBlock) {
+        using namespace Bitcoin::p2p;
+        
+        list<transaction> txs;
+        for (uint32 i = 0; i < 5; i++) txs <<= transaction {
+            list<input> {input {outpoint {txid {uint256 {i + 1}}, i}, bytes {}}},
+            list<output> {output {satoshi {1000 + i}, pay_to_address::script (digest160 {})}}};
+        
+        block b {};
+        b.Transactions = txs;
+        b.Header.MerkleRoot = merkle_root (txs);
+        bytes serialized (b);
+        block_view bv {serialized};
+        
+        std::vector<size_t> prefill {3};
+        compact_block c = compact_block::make (bv, 12345, prefill);
+        EXPECT_EQ (c.size (), 5);
+        EXPECT_EQ (c.ShortIDs.size (), 3);
+        EXPECT_EQ (c.Prefilled.size (), 2);
+        EXPECT_EQ (c.Prefilled[1].Index, 3);
+        EXPECT_EQ (c.ShortIDs[0], c.id (bv[1].id ()));
+        EXPECT_LE (c.ShortIDs[0], short_id_mask);
+        EXPECT_EQ (c.ShortIDs[0], (short_id_key {bv.header (), 12345} (bv[1].id ())));
+        
+        // ids follow the nonce when it changes.
+        compact_block renonced = c;
+        renonced.Nonce = 54321;
+        EXPECT_NE (renonced.id (bv[1].id ()), c.ShortIDs[0]);
+        
+        bytes cb (c);
+        maybe<compact_block> read = compact_block::read (cb);
+        ASSERT_TRUE (bool (read));
+        EXPECT_EQ (read->ShortIDs, c.ShortIDs);
+        EXPECT_EQ (read->Prefilled[1].Index, 3);
+        EXPECT_EQ (read->Prefilled[1].Transaction, bytes (bv[3].serialized ()));
+        EXPECT_FALSE (bool (compact_block::read (bytes_view {cb}.substr (1))));
+        
+        // the mempool is missing transaction 2.
+        std::vector<mempool_entry> mempool {
+            mempool_entry {bv[1].id (), bv[1].serialized ()},
+            mempool_entry {bv[4].id (), bv[4].serialized ()}};
+        
+        partial_block p {*read, mempool};
+        EXPECT_TRUE (p.valid ());
+        EXPECT_FALSE (p.complete ());
+        EXPECT_EQ (p.missing (), std::vector<uint64> {2});
+        EXPECT_FALSE (p.assemble ().valid ());
+        
+        maybe<block_transactions_request> request = block_transactions_request::read (bytes (p.request ()));
+        ASSERT_TRUE (bool (request));
+        EXPECT_EQ (request->Block, b.Header.hash ());
+        EXPECT_EQ (request->Indices, std::vector<uint64> {2});
+        
+        maybe<block_transactions> response = block_transactions::read (bytes (block_transactions::make (bv, *request)));
+        ASSERT_TRUE (bool (response));
+        EXPECT_FALSE (p.fill (block_transactions {response->Block, {}}));
+        EXPECT_TRUE (p.fill (*response));
+        EXPECT_TRUE (p.complete ());
+        
+        executor e {2};
+        block_view assembled = p.assemble (e);
+        EXPECT_TRUE (assembled.valid ());
+        EXPECT_EQ (assembled.serialized (), bytes_view {serialized});
+        
+        // a transaction with the right short id but the wrong txid gives the wrong root.
+        mempool[0].Transaction = bv[2].serialized ();
+        partial_block wrong {c, mempool};
+        EXPECT_TRUE (wrong.fill (block_transactions::make (bv, wrong.request ())));
+        EXPECT_FALSE (wrong.assemble ().valid ());
+    }
+    
+    TEST (TransactionTest, TestBlockFilter) {
+        using namespace Bitcoin::p2p;
+        
+        // the reference test vector for SipHash-2-4.
+        bytes message (15);
+        for (int i = 0; i < 15; i++) message[i] = byte (i);
+        EXPECT_EQ (siphash (0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull, message), 0xa129ca6149be45e5ull);
+        
+        list<transaction> txs;
+        for (uint32 i = 0; i < 20; i++) txs <<= transaction {
+            list<input> {input {outpoint {txid {uint256 {i + 1}}, i}, bytes {}}},
+            list<output> {
+                output {satoshi {1000 + i}, pay_to_address::script (Hash160 (bytes {byte (i)}))},
+                output {satoshi {0}, op_return::script (bytes {byte (i)})}}};
+        
+        block b {};
+        b.Transactions = txs;
+        b.Header.MerkleRoot = merkle_root (txs);
+        bytes serialized (b);
+        block_view bv {serialized};
+        
+        bytes spent_script = pay_to_address::script (Hash160 (bytes {0xff}));
+        std::vector<bytes_view> spent {bytes_view {spent_script}, bytes_view {}};
+        block_filter f = basic_filter (bv, spent);
+        EXPECT_EQ (f.Block, b.Header.hash ());
+        
+        // the empty script and the op_returns are left out.
+        EXPECT_EQ (f.N, 21);
+        
+        for (uint32 i = 0; i < 20; i++) EXPECT_TRUE (f.match (bv[i].output (0).script ()));
+        EXPECT_TRUE (f.match (spent_script));
+        
+        // the chance of a false positive is about 1 / 2^19 for each.
+        std::vector<bytes> absent;
+        for (uint32 i = 20; i < 30; i++) absent.push_back (pay_to_address::script (Hash160 (bytes {byte (i)})));
+        std::vector<bytes_view> queries (absent.begin (), absent.end ());
+        EXPECT_FALSE (f.match_any (queries));
+        for (const bytes &x : absent) EXPECT_FALSE (f.match (x));
+        
+        queries.push_back (bv[7].output (0).script ());
+        EXPECT_TRUE (f.match_any (queries));
+        
+        // a filter built while the block is read is the same.
+        block_filter_builder builder {};
+        EXPECT_TRUE (builder.write (serialized));
+        EXPECT_TRUE (builder.complete ());
+        builder.spent (spent_script);
+        block_filter built = builder.finish ();
+        EXPECT_EQ (built.N, f.N);
+        EXPECT_EQ (built.Data, f.Data);
+        
+        maybe<block_filter> read = block_filter::read (f.Block, bytes (f));
+        ASSERT_TRUE (bool (read));
+        EXPECT_EQ (read->N, f.N);
+        EXPECT_EQ (read->Data, f.Data);
+        EXPECT_EQ (read->hash (), f.hash ());
+        EXPECT_FALSE (bool (block_filter::read (f.Block, bytes {0xfd})));
+        
+        // the block is the root of the headers, so its filter may come first.
+        headers::memory h {b.Header};
+        filter_headers chain {h};
+        EXPECT_TRUE (chain.insert (f));
+        EXPECT_EQ (chain.size (), 1);
+        EXPECT_EQ (chain.latest (), f.header (digest256 {}));
+        
+        // but not again, since the block does not come after itself.
+        EXPECT_FALSE (chain.insert (f));
+        chain.truncate (0);
+        EXPECT_EQ (chain.latest (), digest256 {});
+    }
+    
+    TEST (TransactionTest, TestBIP34) {
+        for (uint64 height : {uint64 {0}, uint64 {1}, uint64 {16}, uint64 {17}, uint64 {127}, uint64 {128}, uint64 {255}, uint64 {256}, uint64 {800000}}) {
+            bytes push = BIP34::write (height);
+            EXPECT_EQ (BIP34::read (push), maybe<uint64> {height});
+        }
+        
+        // height 800000 is 0x0c3500.
+        EXPECT_EQ (BIP34::write (800000), (bytes {0x03, 0x00, 0x35, 0x0c}));
+        EXPECT_EQ (BIP34::write (128), (bytes {0x02, 0x80, 0x00}));
+        EXPECT_FALSE (bool (BIP34::read (bytes {0x02, 0x80})));
+        EXPECT_FALSE (bool (BIP34::read (bytes {0x01, 0x81})));
+        
+        bytes script = BIP34::write (700001);
+        script.push_back (0xab);
+        
+        block b {};
+        b.Header.Version = 2;
+        b.Transactions = list<transaction> {coinbase (script, list<output> {output {satoshi {625000000}, pay_to_address::script (digest160 {})}})};
+        bytes serialized (b);
+        
+        EXPECT_EQ (coinbase_script (serialized), maybe<bytes_view> {bytes_view {script}});
+        EXPECT_EQ (BIP34::height (serialized), maybe<uint64> {700001});
+        EXPECT_TRUE (BIP34::valid (serialized, 700001));
+        EXPECT_FALSE (BIP34::valid (serialized, 700000));
+        EXPECT_TRUE (BIP34::valid (b, 700001));
+        EXPECT_FALSE (bool (coinbase_script (bytes_view {serialized}.substr (0, 120))));
+        
+        block_view bv {serialized};
+        EXPECT_EQ (BIP34::read (bv[0]), maybe<uint64> {700001});
+        
+        b.Header.Version = 1;
+        EXPECT_TRUE (BIP34::valid (bytes (b), 0));
+    }
+    
+    TEST (TransactionTest, TestMempool) {
+        // every transaction made this way is the same size.
+        auto make = [] (const outpoint &from, int64 value) -> shared_transaction {
+            return shared_transaction {transaction {int32_little {1}, list<input> {input {from, bytes {0x51}, 0xffffffff}},
+                list<output> {output {satoshi {value}, bytes {0x51}}}, 0}};
+        };
+        
+        shared_transaction a = make (outpoint {txid {uint256 {1}}, 0}, 1000);
+        shared_transaction b = make (outpoint {a.id (), 0}, 900);
+        shared_transaction c = make (outpoint {txid {uint256 {2}}, 0}, 800);
+        shared_transaction d = make (outpoint {a.id (), 0}, 700);
+        shared_transaction e = make (outpoint {txid {uint256 {2}}, 0}, 500);
+        uint64 size = a.serialized_size ();
+        
+        mempool pool {};
+        EXPECT_EQ (pool.insert (a, satoshi {10}), mempool::accepted);
+        EXPECT_EQ (pool.insert (a, satoshi {10}), mempool::duplicate);
+        EXPECT_EQ (pool.insert (b, satoshi {1000}), mempool::accepted);
+        EXPECT_EQ (pool.insert (c, satoshi {100}), mempool::accepted);
+        EXPECT_EQ (pool.insert (d, satoshi {1000}), mempool::conflict);
+        EXPECT_EQ (pool.size (), 3);
+        EXPECT_EQ (pool.total_size (), 3 * size);
+        
+        maybe<mempool::entry> x = pool[a.id ()];
+        ASSERT_TRUE (bool (x));
+        EXPECT_EQ (x->DescendantCount, 2u);
+        EXPECT_EQ (x->DescendantFees, satoshi {1010});
+        EXPECT_EQ (pool[b.id ()]->AncestorCount, 2u);
+        EXPECT_EQ (pool[b.id ()]->AncestorSize, 2 * size);
+        
+        // b pays for a, so they come before c.
+        std::vector<shared_transaction> selected = pool.select (1000000);
+        ASSERT_EQ (selected.size (), 3);
+        EXPECT_EQ (selected[0].id (), a.id ());
+        EXPECT_EQ (selected[1].id (), b.id ());
+        EXPECT_EQ (selected[2].id (), c.id ());
+        
+        // b can't go in without a.
+        selected = pool.select (size);
+        ASSERT_EQ (selected.size (), 1);
+        EXPECT_EQ (selected[0].id (), c.id ());
+        
+        mempool::block_template t = pool.make_template (int32_little {2}, digest256 {uint256 {3}}, work::compact {0x1d00ffff}, 1000000);
+        EXPECT_EQ (t.Transactions.size (), 3);
+        EXPECT_EQ (t.Accumulator.width (), 4);
+        EXPECT_EQ (t.Candidate.Path, t.Accumulator.coinbase_path ());
+        
+        EXPECT_EQ (pool.remove (a.id ()), 2);
+        EXPECT_EQ (pool.size (), 1);
+        EXPECT_EQ (pool.total_size (), size);
+        
+        // mining a leaves b behind, and e conflicts with c.
+        EXPECT_EQ (pool.insert (a, satoshi {10}), mempool::accepted);
+        EXPECT_EQ (pool.insert (b, satoshi {1000}), mempool::accepted);
+        std::vector<shared_transaction> mined {a, e};
+        pool.remove_confirmed (mined);
+        EXPECT_FALSE (pool.contains (a.id ()));
+        EXPECT_FALSE (pool.contains (c.id ()));
+        EXPECT_TRUE (pool.contains (b.id ()));
+        EXPECT_EQ (pool[b.id ()]->AncestorCount, 1u);
+        EXPECT_EQ (pool.total_size (), size);
+        
+        // the package that pays the least per byte is evicted.
+        mempool small {mempool::options {2 * size, 1000, 1000}};
+        EXPECT_EQ (small.insert (a, satoshi {10}), mempool::accepted);
+        EXPECT_EQ (small.insert (c, satoshi {100}), mempool::accepted);
+        EXPECT_EQ (small.insert (b, satoshi {1}), mempool::evicted);
+        EXPECT_EQ (small.size (), 2);
+        EXPECT_LE (small.total_size (), 2 * size);
+    }
+    
+    TEST (TransactionTest, TestStandard) {
+        bytes p2pkh = pay_to_address::script (digest160 {uint160 {7}});
+        bytes unlock = compile (program {push_data (bytes (71, 0x30)), push_data (bytes (33, 0x02))});
+        
+        auto check = [] (int32 version, bytes in, list<output> outs) -> policy::reason {
+            bytes tx (transaction {int32_little {version}, list<input> {input {outpoint {txid {uint256 {1}}, 0}, in, 0xffffffff}}, outs, 0});
+            return policy::check_standard (transaction_view {tx});
+        };
+        
+        EXPECT_EQ (check (1, unlock, {output {satoshi {1000}, p2pkh}}), policy::standard);
+        EXPECT_EQ (check (2, unlock, {output {satoshi {1000}, p2pkh}, output {satoshi {0}, op_return::script (bytes {1, 2, 3})}}), policy::standard);
+        EXPECT_EQ (check (3, unlock, {output {satoshi {1000}, p2pkh}}), policy::version);
+        EXPECT_EQ (check (1, compile (program {OP_1, OP_DUP}), {output {satoshi {1000}, p2pkh}}), policy::script_sig_not_push_only);
+        EXPECT_EQ (check (1, unlock, {output {satoshi {1000}, bytes {0x51}}}), policy::script_pubkey);
+        EXPECT_EQ (check (1, unlock, {output {satoshi {10}, p2pkh}}), policy::dust);
+        EXPECT_EQ (policy::check_standard (transaction_view {bytes {0x01, 0x00}}), policy::invalid);
+    }
+    
+    TEST (TransactionTest, TestScan) {
+        secp256k1::pubkey pk = secp256k1::secret {uint256 {123}}.to_public ();
+        
+        // enough transactions for more than one batch.
+        block b {};
+        list<transaction> txs;
+        for (uint32 i = 0; i < 300; i++) txs <<= transaction {int32_little {1},
+            list<input> {input {outpoint {txid {uint256 {i + 1}}, 0}, bytes {0x51}, 0xffffffff}},
+            list<output> {
+                output {satoshi {1000}, pay_to_address::script (digest160 {uint160 {i}})},
+                output {satoshi {1000}, op_return::script (bytes {1, 2, 3})},
+                output {satoshi {1000}, pay_to_script_hash::script (digest160 {uint160 {i + 1000}})},
+                output {satoshi {1000}, pay_to_pubkey::script (pk)}}, 0};
+        b.Transactions = txs;
+        bytes serialized (b);
+        block_view v {serialized};
+        ASSERT_TRUE (v.valid ());
+        
+        watched_addresses w {100};
+        for (uint32 i = 0; i < 300; i += 50) w.insert (digest160 {uint160 {i}});
+        w.insert (digest160 {uint160 {1299}});
+        w.insert (Hash160 (pk));
+        EXPECT_EQ (w.size (), 8);
+        
+        std::vector<output_match> matches = scan (v, w);
+        ASSERT_EQ (matches.size (), 307);
+        EXPECT_EQ (matches[0].Transaction, 0u);
+        EXPECT_EQ (matches[0].Output, 0u);
+        EXPECT_EQ (matches[0].Kind, output_match::address);
+        EXPECT_EQ (matches[1].Output, 3u);
+        EXPECT_EQ (matches[1].Kind, output_match::pubkey);
+        EXPECT_EQ (matches[1].Hash, Hash160 (pk));
+        EXPECT_EQ (matches.back ().Transaction, 299u);
+        EXPECT_EQ (matches.back ().Kind, output_match::pubkey);
+        EXPECT_EQ (matches[matches.size () - 2].Kind, output_match::script_hash);
+        
+        executor e {4};
+        std::vector<output_match> parallel = scan (v, w, e);
+        ASSERT_EQ (parallel.size (), matches.size ());
+        for (size_t i = 0; i < matches.size (); i++) {
+            EXPECT_EQ (parallel[i].Transaction, matches[i].Transaction);
+            EXPECT_EQ (parallel[i].Output, matches[i].Output);
+        }
+        
+        // no false negatives.
+        bloom_filter f {1000, 0.01};
+        for (uint32 i = 0; i < 256; i++) f.insert (Hash160 (bytes (4, byte (i))));
+        for (uint32 i = 0; i < 256; i++) EXPECT_TRUE (f.contains (Hash160 (bytes (4, byte (i)))));
+    }
+    
+    TEST (TransactionTest, TestTransactionCodec) {
+        secp256k1::pubkey pk = secp256k1::secret {uint256 {123}}.to_public ();
+        
+        // something shaped like a signature.
+        bytes sig (71, 0x01);
+        sig[0] = 0x30;
+        bytes unlock = pay_to_address::redeem (signature {sig}, pubkey {pk});
+        
+        transaction coinbase {int32_little {1},
+            list<input> {input {outpoint::coinbase (), bytes {3, 1, 2, 3}, 0xffffffff}},
+            list<output> {output {satoshi {5000000000}, pay_to_pubkey::script (pk)}}, 0};
+        
+        transaction first {int32_little {1},
+            list<input> {input {outpoint {coinbase.id (), 0}, unlock, 0xffffffff}},
+            list<output> {
+                output {satoshi {1000}, pay_to_address::script (digest160 {uint160 {7}})},
+                output {satoshi {2000}, pay_to_script_hash::script (digest160 {uint160 {8}})},
+                output {satoshi {0}, op_return::script (bytes {1, 2, 3})},
+                output {satoshi {3000}, bytes {OP_1, OP_2, OP_ADD}}}, 0};
+        
+        transaction second {int32_little {2},
+            list<input> {
+                input {outpoint {first.id (), 0}, unlock, 0xfffffffe},
+                input {outpoint {txid {uint256 {99}}, 3}, bytes {0x51}, 7}},
+            list<output> {output {satoshi {900}, pay_to_address::script (digest160 {uint160 {9}})}}, 800000};
+        
+        for (const transaction &tx : {coinbase, first, second}) {
+            bytes b (tx);
+            bytes encoded = transaction_codec::encode (b);
+            EXPECT_LT (encoded.size (), b.size ());
+            EXPECT_EQ (transaction_codec::decode (encoded), maybe<bytes> {b});
+        }
+        
+        // a txid in the table takes less room, and the table is needed to decode it.
+        transaction_codec::table previous {};
+        previous.insert (coinbase.id ());
+        previous.insert (first.id ());
+        EXPECT_EQ (previous.find (first.id ()), 1);
+        EXPECT_EQ (previous.find (second.id ()), -1);
+        
+        bytes b (second);
+        bytes with_table = transaction_codec::encode (b, previous);
+        EXPECT_EQ (with_table.size () + 32, transaction_codec::encode (b).size ());
+        EXPECT_EQ (transaction_codec::decode (with_table, previous), maybe<bytes> {b});
+        EXPECT_FALSE (bool (transaction_codec::decode (with_table)));
+        
+        // a var int that is longer than it needs to be is kept as it is.
+        bytes long_count = b;
+        long_count.erase (long_count.begin () + 4);
+        long_count.insert (long_count.begin () + 4, {0xfd, 0x02, 0x00});
+        ASSERT_TRUE (transaction_view {long_count}.valid ());
+        bytes kept = transaction_codec::encode (long_count);
+        EXPECT_EQ (kept.size (), long_count.size () + 1);
+        EXPECT_EQ (transaction_codec::decode (kept), maybe<bytes> {long_count});
+        
+        EXPECT_FALSE (bool (transaction_codec::decode (bytes {})));
+        EXPECT_FALSE (bool (transaction_codec::decode (bytes {2, 1, 2})));
+        bytes truncated = transaction_codec::encode (bytes (first));
+        truncated.resize (truncated.size () - 1);
+        EXPECT_FALSE (bool (transaction_codec::decode (truncated)));
+        
+        block bl {};
+        bl.Transactions = list<transaction> {coinbase, first, second};
+        bytes serialized (bl);
+        block_view v {serialized};
+        ASSERT_TRUE (v.valid ());
+        
+        std::vector<bytes> encoded = transaction_codec::encode (v);
+        ASSERT_EQ (encoded.size (), 3);
+        maybe<std::vector<bytes>> decoded = transaction_codec::decode (encoded);
+        ASSERT_TRUE (bool (decoded));
+        EXPECT_EQ ((*decoded)[0], bytes (coinbase));
+        EXPECT_EQ ((*decoded)[1], bytes (first));
+        EXPECT_EQ ((*decoded)[2], bytes (second));
+    }
+    
+    TEST (TransactionTest, TestBlockAssembler) {
+        transaction coinbase {int32_little {1},
+            list<input> {input {outpoint::coinbase (), bytes {3, 1, 2, 3}, 0xffffffff}},
+            list<output> {output {satoshi {5000000000}, bytes {OP_1}}}, 0};
+        
+        std::vector<shared_transaction> txs;
+        list<transaction> all {coinbase};
+        for (uint32 i = 0; i < 300; i++) {
+            transaction tx {int32_little {1},
+                list<input> {input {outpoint {txid {uint256 {i + 1}}, 0}, bytes {0x51}, 0xffffffff}},
+                list<output> {output {satoshi {1000 + i}, pay_to_address::script (digest160 {uint160 {i}})}}, 0};
+            txs.push_back (shared_transaction {tx});
+            all <<= tx;
+        }
+        
+        block full {};
+        full.Header = header {int32_little {1}, digest256 {uint256 {5}}, digest256 {uint256 {6}},
+            timestamp {1700000000}, work::compact {0x207fffff}, uint32_little {42}};
+        full.Transactions = all;
+        bytes serialized (full);
+        
+        block_assembler assembler {txs};
+        EXPECT_EQ (assembler.transactions (), 300);
+        EXPECT_EQ (assembler.size (bytes (coinbase).size ()), serialized.size ());
+        
+        block_assembler::block b = assembler.assemble (full.Header, bytes (coinbase));
+        EXPECT_EQ (b.size (), serialized.size ());
+        EXPECT_EQ (b.parts ().size (), 302);
+        EXPECT_EQ (bytes (b), serialized);
+        
+        executor e {4};
+        EXPECT_EQ (b.write (&e), serialized);
+        
+        // the transactions are shared by every block that is made.
+        block_assembler::block other = assembler.assemble (full.Header, bytes {1, 2, 3});
+        EXPECT_EQ (other.Transactions, b.Transactions);
+        
+        std::filesystem::path path = std::filesystem::temp_directory_path () / "gigamonkey_test_block_assembler";
+        int fd = ::open (path.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GE (fd, 0);
+        b.write_to (fd);
+        ::close (fd);
+        
+        std::ifstream in {path, std::ios::binary};
+        bytes written (serialized.size ());
+        in.read (reinterpret_cast<char *> (written.data ()), written.size ());
+        EXPECT_EQ (written, serialized);
+        std::filesystem::remove (path);
+        
+        EXPECT_THROW (b.write_to (-1), std::runtime_error);
+    }
+    
+    TEST (TransactionTest, TestCoinbaseBuilder) {
+        bytes prefix = Gigamonkey::write (BIP34::write (800000).size () + 3, BIP34::write (800000), bytes {0x02, 0xab, 0xcd});
+        bytes suffix {0x04, 'p', 'o', 'o', 'l'};
+        
+        std::vector<output> outs;
+        list<output> payouts;
+        for (uint32 i = 0; i < 300; i++) {
+            outs.push_back (output {satoshi {1000 + i}, pay_to_address::script (digest160 {uint160 {i}})});
+            payouts <<= outs.back ();
+        }
+        
+        coinbase_builder b {prefix, suffix, 12, outs};
+        EXPECT_EQ (b.outputs (), 300);
+        
+        bytes extra_nonces (12, 0x07);
+        auto expected = [&] () -> bytes {
+            return bytes (coinbase (Gigamonkey::write (prefix.size () + 12 + suffix.size (), prefix, extra_nonces, suffix), payouts));
+        };
+        
+        EXPECT_EQ (b.coinbase (extra_nonces), expected ());
+        EXPECT_EQ (Gigamonkey::write (b.header ().size () + 12 + b.body ().size (), b.header (), extra_nonces, b.body ()), expected ());
+        EXPECT_THROW (b.coinbase (bytes (8)), std::invalid_argument);
+        
+        auto midstate = [] (const bytes &header) {
+            sha256::state s = sha256::initial ();
+            sha256::transform (s, header.data (), header.size () / 64);
+            return s;
+        };
+        
+        EXPECT_EQ (b.midstate_size () % 64, 0);
+        EXPECT_EQ (b.midstate (), midstate (b.header ()));
+        
+        // only the amounts that change are written.
+        std::vector<satoshi> values;
+        for (uint32 i = 0; i < 300; i++) values.push_back (satoshi {1000 + (i % 3 == 0 ? 2 * i : i)});
+        EXPECT_EQ (b.set_values (values), 99);
+        EXPECT_EQ (b.set_values (values), 0);
+        
+        payouts = {};
+        for (uint32 i = 0; i < 300; i++) {
+            outs[i].Value = values[i];
+            payouts <<= outs[i];
+        }
+        
+        EXPECT_EQ (b.coinbase (extra_nonces), expected ());
+        EXPECT_EQ (b.value (3), satoshi {1006});
+        
+        b.set_value (299, satoshi {5});
+        EXPECT_EQ (b.value (299), satoshi {5});
+        EXPECT_THROW (b.set_value (300, satoshi {5}), std::out_of_range);
+        EXPECT_THROW (b.set_values ({}), std::invalid_argument);
+        b.set_value (299, values[299]);
+        
+        // the height of the next block.
+        prefix = Gigamonkey::write (BIP34::write (800001).size () + 3, BIP34::write (800001), bytes {0x02, 0xab, 0xcd});
+        b.set_script_prefix (prefix);
+        EXPECT_EQ (b.coinbase (extra_nonces), expected ());
+        EXPECT_EQ (b.midstate (), midstate (b.header ()));
+        
+        // a longer prefix.
+        prefix = Gigamonkey::write (prefix.size () + 70, prefix, bytes (70, 0x01));
+        b.set_script_prefix (prefix);
+        EXPECT_EQ (b.coinbase (extra_nonces), expected ());
+        EXPECT_EQ (b.midstate (), midstate (b.header ()));
+        
+        // fewer outputs.
+        outs.resize (2);
+        payouts = list<output> {outs[0], outs[1]};
+        b.set_outputs (outs);
+        EXPECT_EQ (b.outputs (), 2);
+        EXPECT_EQ (b.coinbase (extra_nonces), expected ());
+        
+        outs[0].Value = satoshi {-1};
+        EXPECT_THROW (b.set_outputs (outs), std::invalid_argument);
     }
+    
 }
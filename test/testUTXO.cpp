@@ -0,0 +1,295 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/utxo.hpp>
+#include <gigamonkey/utxo_snapshot.hpp>
+#include <gigamonkey/metrics.hpp>
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Gigamonkey::Bitcoin {
+    
+    TEST (UTXOTest, TestEncoding) {
+        bytes pay_to_address {OP_DUP, OP_HASH160, 20};
+        pay_to_address.insert (pay_to_address.end (), 20, 0xab);
+        pay_to_address.insert (pay_to_address.end (), {byte (OP_EQUALVERIFY), byte (OP_CHECKSIG)});
+        
+        bytes pay_to_pubkey {};
+        pay_to_pubkey.push_back (33);
+        pay_to_pubkey.insert (pay_to_pubkey.end (), 33, 0x02);
+        pay_to_pubkey.push_back (OP_CHECKSIG);
+        
+        for (const output &o : {
+            output {satoshi {0}, pay_to_address},
+            output {satoshi {5000000000}, pay_to_pubkey},
+            output {satoshi {300}, bytes {OP_1}},
+            output {satoshi {70000}, bytes {}}}) EXPECT_EQ (utxo_set::decode (utxo_set::encode (o)), o);
+        
+        EXPECT_EQ (utxo_set::encode (output {satoshi {1}, pay_to_address}).size (), 22);
+    }
+    
+    TEST (UTXOTest, TestUTXOSet) {
+        utxo_set utxos {1};
+        
+        outpoint a {Hash256 (bytes {1}), 0};
+        output x {satoshi {1000}, bytes {OP_1}};
+        
+        hash_set<outpoint> outpoints {a, outpoint {Hash256 (bytes {1}), 1}};
+        EXPECT_EQ (outpoints.size (), 2);
+        EXPECT_TRUE (outpoints.contains (outpoint {Hash256 (bytes {1}), 0}));
+        
+        EXPECT_TRUE (utxos.insert (a, x));
+        EXPECT_FALSE (utxos.insert (a, x));
+        EXPECT_EQ (*utxos[a], x);
+        EXPECT_TRUE (utxos.remove (a));
+        EXPECT_FALSE (utxos.remove (a));
+        EXPECT_FALSE (bool (utxos[a]));
+        
+        // enough to make the table grow several times.
+        for (uint32 i = 0; i < 1000; i++) EXPECT_TRUE (utxos.insert (outpoint {Hash256 (bytes {2}), i}, x));
+        for (uint32 i = 0; i < 1000; i += 2) EXPECT_TRUE (utxos.remove (outpoint {Hash256 (bytes {2}), i}));
+        EXPECT_EQ (utxos.size (), 500);
+        for (uint32 i = 0; i < 1000; i++) EXPECT_EQ (utxos.contains (outpoint {Hash256 (bytes {2}), i}), i % 2 == 1);
+        
+        transaction coinbase {
+            list<input> {input {outpoint::coinbase (), bytes {OP_0}}},
+            list<output> {
+                output {satoshi {5000}, bytes {OP_1}},
+                output {satoshi {0}, bytes {OP_FALSE, OP_RETURN}},
+                output {satoshi {1}, bytes {OP_RETURN, OP_1}}}};
+        
+        // spends the coinbase, and is spent in the same block.
+        transaction spend {
+            list<input> {input {outpoint {coinbase.id (), 0}, bytes {OP_1}}},
+            list<output> {output {satoshi {4000}, bytes {OP_1}}}};
+        
+        transaction spend_again {
+            list<input> {input {outpoint {spend.id (), 0}, bytes {OP_1}}, input {outpoint {Hash256 (bytes {2}), 1}, bytes {OP_1}}},
+            list<output> {output {satoshi {4500}, bytes {OP_2}}}};
+        
+        block b {};
+        b.Transactions = list<transaction> {coinbase, spend, spend_again};
+        
+        utxo_set::block_undo undo;
+        EXPECT_TRUE (utxos.apply (b, undo));
+        EXPECT_EQ (utxos.size (), 501);
+        EXPECT_FALSE (utxos.contains (outpoint {coinbase.id (), 0}));
+        EXPECT_FALSE (utxos.contains (outpoint {coinbase.id (), 1}));
+        
+        // after Genesis a script that begins with OP_RETURN can be spent.
+        EXPECT_TRUE (utxos.contains (outpoint {coinbase.id (), 2}));
+        EXPECT_FALSE (utxos.contains (outpoint {spend.id (), 0}));
+        EXPECT_FALSE (utxos.contains (outpoint {Hash256 (bytes {2}), 1}));
+        EXPECT_EQ (*utxos[outpoint {spend_again.id (), 0}], (output {satoshi {4500}, bytes {OP_2}}));
+        
+        // applying it again fails because the outputs are spent.
+        utxo_set::block_undo again;
+        EXPECT_FALSE (utxos.apply (b, again));
+        EXPECT_EQ (utxos.size (), 501);
+        EXPECT_TRUE (utxos.contains (outpoint {spend_again.id (), 0}));
+        
+        utxos.undo (undo);
+        EXPECT_EQ (utxos.size (), 500);
+        EXPECT_TRUE (utxos.contains (outpoint {Hash256 (bytes {2}), 1}));
+        EXPECT_FALSE (utxos.contains (outpoint {spend_again.id (), 0}));
+        EXPECT_FALSE (utxos.contains (outpoint {spend.id (), 0}));
+    }
+    
+    TEST (UTXOTest, TestScriptStore) {
+        script_store store {};
+        
+        bytes boost_script (200, 0xaa);
+        bytes other_script (200, 0xbb);
+        
+        script_store::handle a = store.intern (boost_script);
+        EXPECT_NE (a, script_store::none);
+        EXPECT_EQ (store.intern (boost_script), a);
+        EXPECT_EQ (store.references (a), 2);
+        EXPECT_EQ (store[a], bytes_view (boost_script));
+        
+        script_store::handle b = store.intern (other_script);
+        EXPECT_NE (a, b);
+        EXPECT_EQ (store.size (), 2);
+        EXPECT_EQ (store.stored (), 400);
+        
+        store.release (a);
+        store.release (a);
+        store.release (b);
+        EXPECT_EQ (store.size (), 0);
+        EXPECT_EQ (store.stored (), 0);
+        
+        {
+            interned_script x {store, boost_script};
+            interned_script y = x;
+            EXPECT_EQ (x, y);
+            EXPECT_EQ (store.references (x.handle ()), 2);
+            EXPECT_FALSE (x == (interned_script {store, other_script}));
+            EXPECT_EQ (y.script (), bytes_view (boost_script));
+        }
+        
+        EXPECT_EQ (store.size (), 0);
+        
+        // outputs with the same script share it.
+        {
+            utxo_set utxos {16, store};
+            output x {satoshi {1000}, boost_script};
+            for (uint32 i = 0; i < 100; i++) EXPECT_TRUE (utxos.insert (outpoint {Hash256 (bytes {3}), i}, x));
+            EXPECT_TRUE (utxos.insert (outpoint {Hash256 (bytes {4}), 0}, output {satoshi {1}, bytes {OP_1}}));
+            EXPECT_EQ (store.size (), 1);
+            EXPECT_EQ (store.stored (), 200);
+            EXPECT_EQ (*utxos[outpoint {Hash256 (bytes {3}), 7}], x);
+            EXPECT_EQ (*utxos[outpoint {Hash256 (bytes {4}), 0}], (output {satoshi {1}, bytes {OP_1}}));
+            
+            transaction spend {
+                list<input> {input {outpoint {Hash256 (bytes {3}), 0}, bytes {OP_1}}},
+                list<output> {output {satoshi {900}, other_script}}};
+            
+            transaction coinbase {
+                list<input> {input {outpoint::coinbase (), bytes {OP_0}}},
+                list<output> {output {satoshi {0}, bytes {OP_FALSE, OP_RETURN}}}};
+            
+            block bl {};
+            bl.Transactions = list<transaction> {coinbase, spend};
+            
+            utxo_set::block_undo undo;
+            EXPECT_TRUE (utxos.apply (bl, undo));
+            EXPECT_EQ (store.size (), 2);
+            EXPECT_EQ (undo.Spent.size (), 1);
+            EXPECT_EQ (utxo_set::decode (undo.Spent[0].second), x);
+            
+            utxos.undo (undo);
+            EXPECT_EQ (store.size (), 1);
+            EXPECT_EQ (*utxos[outpoint {Hash256 (bytes {3}), 0}], x);
+            
+            for (uint32 i = 0; i < 50; i++) EXPECT_TRUE (utxos.remove (outpoint {Hash256 (bytes {3}), i}));
+            script_store::handle h = store.intern (boost_script);
+            EXPECT_EQ (store.references (h), 51);
+            store.release (h);
+        }
+        
+        EXPECT_EQ (store.size (), 0);
+    }
+    
+    TEST (UTXOTest, TestUTXOSnapshot) {
+        bytes pay_to_address {OP_DUP, OP_HASH160, 20};
+        pay_to_address.insert (pay_to_address.end (), 20, 0xab);
+        pay_to_address.insert (pay_to_address.end (), {byte (OP_EQUALVERIFY), byte (OP_CHECKSIG)});
+        
+        utxo_set utxos {16};
+        std::vector<std::pair<outpoint, output>> expected;
+        for (uint32 i = 0; i < 300; i++) for (uint32 j = 0; j < 1 + i % 5; j++) {
+            outpoint o {Hash256 (write (4, uint32_little {i})), j * 2};
+            output x {satoshi {int64 (i) * 1000 + j}, j % 2 == 0 ? pay_to_address : bytes {OP_1, byte (j)}};
+            EXPECT_TRUE (utxos.insert (o, x));
+            expected.emplace_back (o, x);
+        }
+        
+        headers::memory store;
+        std::filesystem::path path = std::filesystem::temp_directory_path () / "gigamonkey_test_utxo_snapshot";
+        std::filesystem::remove (path);
+        
+        utxo_snapshot::options options {};
+        options.ChunkOutputs = 64;
+        executor e {2};
+        utxo_snapshot::write (path, utxos, store.latest (), options, &e);
+        
+        {
+            utxo_snapshot snapshot {path};
+            EXPECT_EQ (snapshot.size (), expected.size ());
+            EXPECT_EQ (snapshot.chunks (), (expected.size () + 63) / 64);
+            EXPECT_TRUE (snapshot.check (store));
+            
+            // outputs can be found before the chunks are checked.
+            EXPECT_EQ (snapshot.verified (), 0);
+            for (const auto &[o, x] : expected) EXPECT_EQ (snapshot[o], maybe<output> {x});
+            EXPECT_FALSE (bool (snapshot[outpoint {Hash256 (write (4, uint32_little {0})), 1}]));
+            EXPECT_FALSE (bool (snapshot[outpoint {Hash256 (bytes {5}), 0}]));
+            
+            EXPECT_TRUE (snapshot.verify (3));
+            EXPECT_EQ (snapshot.verified (), 3);
+            EXPECT_TRUE (snapshot.verify ());
+            EXPECT_TRUE (snapshot.complete ());
+            
+            utxo_set loaded {16};
+            EXPECT_TRUE (snapshot.load (loaded, &e));
+            EXPECT_EQ (loaded.size (), utxos.size ());
+            for (const auto &[o, x] : expected) EXPECT_EQ (loaded[o], maybe<output> {x});
+        }
+        
+        // the same file is written without an executor.
+        std::filesystem::path serial = path;
+        serial += ".serial";
+        utxo_snapshot::write (serial, utxos, store.latest (), options);
+        EXPECT_EQ (std::filesystem::file_size (serial), std::filesystem::file_size (path));
+        std::filesystem::remove (serial);
+        
+        // break the last chunk.
+        uintmax_t size = std::filesystem::file_size (path);
+        {
+            std::fstream f {path, std::ios::binary | std::ios::in | std::ios::out};
+            f.seekp (size - 1);
+            f.put ('x');
+        }
+        
+        {
+            utxo_snapshot snapshot {path};
+            EXPECT_FALSE (snapshot.verify ());
+            EXPECT_EQ (snapshot.verified (), snapshot.chunks () - 1);
+            EXPECT_EQ (snapshot[expected[0].first], maybe<output> {expected[0].second});
+            
+            utxo_set loaded {16};
+            EXPECT_FALSE (snapshot.load (loaded));
+            EXPECT_EQ (loaded.size (), 0);
+        }
+        
+        {
+            std::ofstream out {path, std::ios::binary | std::ios::trunc};
+            out << std::string (200, 'x');
+        }
+        
+        EXPECT_THROW (utxo_snapshot {path}, std::invalid_argument);
+        std::filesystem::remove (path);
+    }
+    
+    TEST (UTXOTest, TestMemoryUsage) {
+        script_store scripts {};
+        utxo_set utxos {16, scripts};
+        EXPECT_EQ (utxos.memory_usage ().Values, 0);
+        EXPECT_EQ (scripts.memory_usage ().Values, 0);
+        
+        // each output is a value of 3 bytes, a template and a handle.
+        output x {satoshi {1000}, bytes (40)};
+        for (uint32 i = 0; i < 100; i++) EXPECT_TRUE (utxos.insert (outpoint {Hash256 (bytes {3}), i}, x));
+        
+        memory_report m = utxos.memory_usage ();
+        EXPECT_EQ (m.Keys, 100 * sizeof (outpoint));
+        EXPECT_EQ (m.Values, 800);
+        EXPECT_GT (m.Slack, 0);
+        EXPECT_EQ (m.total (), m.Keys + m.Values + m.Overhead + m.Slack);
+        EXPECT_EQ (scripts.memory_usage ().Values, 40);
+        
+        {
+            metrics::memory_source utxo_memory {"utxo", [&utxos] () {
+                return utxos.memory_usage ();
+            }};
+            
+            metrics::memory_source script_memory {"utxo", [&scripts] () {
+                return scripts.memory_usage ();
+            }};
+            
+            metrics::snapshot s = metrics::collect ();
+            EXPECT_EQ (s.Memory["utxo"], utxos.memory_usage () + scripts.memory_usage ());
+            EXPECT_EQ (JSON (s)["memory"]["utxo"]["total"], s.Memory["utxo"].total ());
+        }
+        
+        EXPECT_FALSE (metrics::collect ().Memory.contains ("utxo"));
+        
+        for (uint32 i = 0; i < 100; i++) EXPECT_TRUE (utxos.remove (outpoint {Hash256 (bytes {3}), i}));
+        EXPECT_EQ (utxos.memory_usage ().Keys, 0);
+        EXPECT_EQ (utxos.memory_usage ().Values, 0);
+        EXPECT_EQ (scripts.memory_usage ().Values, 0);
+    }
+    
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2023 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/script.hpp>
+#include "gtest/gtest.h"
+#include <random>
+
+namespace Gigamonkey::Bitcoin {
+    
+    TEST(UintTest, TestUintLimbs) {
+        
+        static_assert([] () {
+            std::array<uint64, 2> a {0xffffffffffffffff, 0};
+            bool carry = limbs::add(a, std::array<uint64, 2>{1, 0});
+            return !carry && a == std::array<uint64, 2>{0, 1};
+        } ());
+        
+        static_assert(limbs::multiply(std::array<uint64, 2>{0xffffffffffffffff, 0}, std::array<uint64, 2>{2, 0}) == 
+            std::array<uint64, 2>{0xfffffffffffffffe, 1});
+        
+        uint256 a{"0x00000000000000000000000000000001ffffffffffffffffffffffffffffffff"};
+        uint256 b{"0x0000000000000000000000000000000000000000000000010000000000000003"};
+        uint256 max{"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"};
+        
+        EXPECT_EQ(a + b, uint256(N(a) + N(b)));
+        EXPECT_EQ(a - b, uint256(N(a) - N(b)));
+        EXPECT_EQ(a * b, uint256(N(a) * N(b)));
+        EXPECT_EQ(max + uint256{1}, uint256{0});
+        EXPECT_EQ(uint256{0} - uint256{1}, max);
+        EXPECT_EQ(max * max, uint256{1});
+        
+        for (unsigned int shift : {0, 1, 63, 64, 65, 128, 200, 255}) {
+            EXPECT_EQ(a << shift, uint256(N(a) << shift));
+            EXPECT_EQ(a >> shift, uint256(N(a) >> shift));
+        }
+
+        EXPECT_EQ(max >> 256, uint256{0});
+        EXPECT_LT(b, a);
+        EXPECT_GT(a, b);
+        EXPECT_LE(a, a);
+        EXPECT_GE(max, a);
+        EXPECT_NE(a, b);
+        
+        // a uint whose size is not a multiple of 8.
+        uint160 c{"0xffffffffffffffffffffffffffffffffffffffff"};
+        EXPECT_EQ(c + uint160{1}, uint160{0});
+        EXPECT_EQ(c >> 152, uint160{0xff});
+        EXPECT_EQ(uint160{1} << 159, uint160{"0x8000000000000000000000000000000000000000"});
+        EXPECT_EQ(N(c) + N(1), N(1) << 160);
+        
+    }
+    
+    // uints are little endian, so the order is that of their bytes read backwards.
+    template <size_t X> void test_uint_ordering (std::mt19937 &gen) {
+        for (int i = 0; i < 1000; i++) {
+            uint<X> a, b;
+            // few distinct bytes so that long common prefixes are likely.
+            for (byte &x : a) x = gen () % 3;
+            std::copy (a.begin (), a.end (), b.begin ());
+            b[gen () % X] = gen () % 3;
+            if (gen () % 2) b[gen () % X] = byte (gen ());
+            
+            std::reverse_iterator<const byte *> ra {a.data () + X}, rb {b.data () + X}, end_a {a.data ()}, end_b {b.data ()};
+            bool less = std::lexicographical_compare (ra, end_a, rb, end_b);
+            bool greater = std::lexicographical_compare (rb, end_b, ra, end_a);
+            
+            EXPECT_EQ (a < b, less);
+            EXPECT_EQ (a > b, greater);
+            EXPECT_EQ (a <= b, !greater);
+            EXPECT_EQ (a >= b, !less);
+            EXPECT_EQ (a == b, !less && !greater);
+        }
+    }
+    
+    TEST(UintTest, TestUintOrdering) {
+        std::mt19937 gen {7};
+        test_uint_ordering<4> (gen);
+        test_uint_ordering<20> (gen);
+        test_uint_ordering<32> (gen);
+        test_uint_ordering<80> (gen);
+    }
+    
+}
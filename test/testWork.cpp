@@ -3,9 +3,15 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/work/proof.hpp>
+#include <gigamonkey/work/solver.hpp>
+#include <gigamonkey/work/prepared_puzzle.hpp>
+#include <gigamonkey/work/lease.hpp>
+#include <gigamonkey/work/calibrate.hpp>
 #include "dot_cross.hpp"
+#include "allocation_counter.hpp"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <algorithm>
 
 namespace Gigamonkey::work {
     
@@ -104,4 +110,430 @@ namespace Gigamonkey::work {
         
     }
 
+    TEST(WorkTest, TestMultithreadedSolver) {
+        
+        std::string message{"Capitalists can spend more energy than socialists."};
+        
+        auto targets = list<compact>{} << compact{32, 0x010000} << compact{32, 0x008000};
+        
+        uint16_little magic_number = 0x21e8;
+        uint16_little gpb = 0xffff;
+        int32_little category = ASICBoost::category(magic_number, gpb);
+        
+        uint64_big extra_nonce = 7777;
+        
+        for (const compact &t : targets) for (uint32 threads : {1u, 4u}) {
+            puzzle p(category, SHA2_256(message), t,
+                Merkle::path{}, bytes{}, bytes::from_string(message), ASICBoost::Mask);
+            
+            extra_nonce++;
+            proof pr = solve(p, solution(share{Bitcoin::timestamp(1), 0, (bytes_view)(extra_nonce), -1}, 353), threads);
+            
+            EXPECT_TRUE(pr.valid());
+            EXPECT_EQ(pr.Puzzle, p);
+            EXPECT_EQ(pr.Solution.ExtraNonce1, Stratum::session_id{353});
+            EXPECT_EQ(pr.Solution.Share.ExtraNonce2.size(), 8);
+        }
+        
+    }
+    
+    TEST(WorkTest, TestRollOver) {
+        
+        std::string message{"Capitalists can spend more energy than socialists."};
+        compact target {32, 0x010000};
+        
+        // at the last nonce, extra nonce 2 is carried across its full width.
+        {
+            puzzle p(1, SHA2_256(message), target, Merkle::path{}, bytes{}, bytes::from_string(message));
+            uint16_big extra_nonce = 0x00ff;
+            proof pr = cpu_solve(p, solution(share{Bitcoin::timestamp(1), nonce{0xffffffff}, (bytes_view)(extra_nonce)}, 353));
+            EXPECT_TRUE(pr.valid());
+        }
+        
+        // with no extra nonce 2 left, the version bits are rolled instead.
+        {
+            uint16_little magic_number = 0x21e8;
+            puzzle p(ASICBoost::category(magic_number, 0), SHA2_256(message), target,
+                Merkle::path{}, bytes{}, bytes::from_string(message), ASICBoost::Mask);
+            
+            bytes extra_nonce(1);
+            extra_nonce[0] = 0xff;
+            proof pr = cpu_solve(p, solution(share{Bitcoin::timestamp(1), nonce{0xffffffff}, extra_nonce, 0}, 353));
+            EXPECT_TRUE(pr.valid());
+            EXPECT_EQ(pr.Solution.Share.ExtraNonce2, extra_nonce);
+            EXPECT_EQ(pr.string().magic_number(), magic_number);
+        }
+        
+        // with neither, the search ends.
+        {
+            puzzle p(1, SHA2_256(message), compact{3, 0x000001}, Merkle::path{}, bytes{}, bytes::from_string(message));
+            bytes extra_nonce(1);
+            extra_nonce[0] = 0xff;
+            EXPECT_FALSE(cpu_solve(p, solution(share{Bitcoin::timestamp(1), nonce{0xfffffff0}, extra_nonce}, 353)).valid());
+        }
+        
+    }
+    
+    TEST(WorkTest, TestSHA256Hasher) {
+        EXPECT_EQ(sha256::lanes(sha256::best_single()), 1u);
+        
+        EXPECT_EQ(SHA2_256(bytes{}), digest256{"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"});
+        EXPECT_EQ(SHA2_256(string_view{"abc"}), digest256{"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"});
+        
+        // messages of every length up to a few blocks, written in pieces of different sizes.
+        bytes message(300);
+        for (size_t i = 0; i < message.size(); i++) message[i] = byte(i * 7 + 3);
+        
+        for (size_t size = 0; size <= message.size(); size++) {
+            bytes_view b = bytes_view(message).substr(0, size);
+            digest256 expected = CryptoPP::hash_writer<CryptoPP::SHA256, 32>{}(b);
+            EXPECT_EQ(SHA2_256(b), expected) << size;
+            
+            for (size_t piece : {1u, 13u, 64u, 65u}) {
+                sha256::hasher h;
+                for (size_t i = 0; i < size; i += piece) h.Write(b.data() + i, std::min(piece, size - i));
+                digest256 d;
+                h.Finalize(d.begin());
+                EXPECT_EQ(d, expected) << size << " " << piece;
+            }
+        }
+        
+        // a hasher can be used again after it is reset.
+        sha256::hasher h;
+        h.Write(message.data(), 100);
+        digest256 d;
+        h.Reset().Write(message.data(), 3).Finalize(d.begin());
+        EXPECT_EQ(d, SHA2_256(bytes_view(message).substr(0, 3)));
+        
+        EXPECT_EQ(Bitcoin::Hash256(bytes_view(message)), SHA2_256(SHA2_256(bytes_view(message))));
+    }
+    
+    TEST(WorkTest, TestAllocations) {
+        bytes message(300);
+        for (size_t i = 0; i < message.size(); i++) message[i] = byte(i * 7 + 3);
+        
+        // hashing a message in pieces allocates nothing.
+        test::allocation_counter counter;
+        sha256::hasher h;
+        for (size_t i = 0; i < message.size(); i += 13) h.Write(message.data() + i, std::min(size_t(13), message.size() - i));
+        digest256 d;
+        h.Finalize(d.begin());
+        EXPECT_EQ(counter.allocations(), 0u);
+        EXPECT_EQ(d, SHA2_256(message));
+        
+        // counters count what is allocated in their scope, and may be nested.
+        counter.reset();
+        {
+            test::allocation_counter inner;
+            std::vector<byte> x(1000);
+            EXPECT_EQ(inner.allocations(), 1u);
+            EXPECT_GE(inner.allocated(), 1000u);
+            EXPECT_EQ(inner.deallocations(), 0u);
+        }
+        
+        EXPECT_EQ(counter.allocations(), 1u);
+        EXPECT_EQ(counter.deallocations(), 1u);
+    }
+    
+    TEST(WorkTest, TestPreparedPuzzle) {
+        
+        std::string message{"Anyone can make money if they make enough of it."};
+        compact target{32, 0x010000};
+        
+        Merkle::digests branch{};
+        for (byte i = 1; i <= 3; i++) {
+            digest256 d{};
+            std::fill(d.begin(), d.end(), i);
+            branch = branch << d;
+        }
+        
+        // headers that end before, at and after a block boundary.
+        for (size_t header_size : {0, 20, 64, 100, 130}) {
+            bytes header(header_size);
+            for (size_t i = 0; i < header_size; i++) header[i] = byte(i);
+            
+            for (const Merkle::path &path : {Merkle::path{}, Merkle::path{5, branch}}) {
+                puzzle p(ASICBoost::category(0x21e8, 0), SHA2_256(message), target,
+                    path, header, bytes::from_string(message), ASICBoost::Mask);
+                prepared_puzzle pp{p};
+                
+                for (uint32 n : {0u, 1u, 0xabcdefu}) {
+                    bytes extra_nonce(header_size % 5 + 1);
+                    solution x{share{Bitcoin::timestamp(7), nonce{n}, extra_nonce, int32_little{0x1234}}, 353};
+                    proof pr{p, x};
+                    EXPECT_EQ(pp.merkle_root(x), pr.merkle_root());
+                    EXPECT_EQ(pp.string(x), pr.string());
+                    EXPECT_EQ(pp.header(x), pr.string().write());
+                    EXPECT_EQ(pp.hash(x), pr.string().hash());
+                    EXPECT_EQ(pp.valid(x), pr.valid());
+                }
+                
+                proof solved = cpu_solve(p, solution(share{Bitcoin::timestamp(1), nonce{0}, bytes(4)}, 353));
+                EXPECT_TRUE(solved.valid());
+                EXPECT_TRUE(pp.valid(solved.Solution));
+            }
+        }
+        
+    }
+    
+    // returns everything the cpu finds along with many nonces that are not solutions.
+    struct noisy_backend final : backend {
+        cpu_backend Cpu;
+        
+        std::vector<uint32> search(const sha256::state &m, const byte_array<16> &tail, uint32 begin, uint32 count, const uint256 &target) override {
+            std::vector<uint32> x = Cpu.search(m, tail, begin, count, target);
+            for (uint32 i = 0; i < count; i += 7) x.push_back(begin + i);
+            x.push_back(begin + count);
+            return x;
+        }
+        
+        uint32 batch() const override {
+            return 1000;
+        }
+    };
+    
+    TEST(WorkTest, TestBackend) {
+        
+        auto names = backends();
+        EXPECT_NE(std::find(names.begin(), names.end(), "cpu"), names.end());
+        EXPECT_NE(make_backend("cpu"), nullptr);
+        EXPECT_THROW(make_backend("abacus"), std::invalid_argument);
+        
+        register_backend("noisy", []() -> ptr<backend> {
+            return std::make_shared<noisy_backend>();
+        });
+        
+        std::string message{"Capitalists can spend more energy than socialists."};
+        puzzle p(1, SHA2_256(message), compact{32, 0x008000}, Merkle::path{}, bytes{}, bytes::from_string(message));
+        
+        uint64_big extra_nonce = 4321;
+        solution initial {Bitcoin::timestamp(1), 0, (bytes_view)(extra_nonce), 353};
+        
+        // candidates that are not solutions are thrown out, so we get the same answer.
+        proof expected = solve(p, initial, 1);
+        proof noisy = solve(p, initial, 1, make_backend("noisy"));
+        EXPECT_TRUE(expected.valid());
+        EXPECT_TRUE(noisy.valid());
+        EXPECT_EQ(expected, noisy);
+        
+    }
+    
+    TEST(WorkTest, TestCalibrate) {
+        
+        calibration_options o;
+        o.Seconds = .05;
+        o.Backends = {"cpu"};
+        o.MaxThreads = 2;
+        
+        calibration c = calibrate(o);
+        EXPECT_EQ(c.Backend, "cpu");
+        EXPECT_GT(c.HashesPerSecond, 0);
+        EXPECT_GE(c.Threads, 1);
+        EXPECT_LE(c.Threads, 2);
+        EXPECT_EQ(c.Batch % make_backend("cpu")->batch(), 0);
+        EXPECT_EQ(c.make()->batch(), c.Batch);
+        EXPECT_NEAR(c.hashes_per_second_per_core(), c.HashesPerSecond / c.Threads, 1);
+        
+        EXPECT_EQ(calibration::read(JSON(c)), maybe<calibration>{c});
+        EXPECT_FALSE(bool(calibration::read(JSON{{"backend", "cpu"}})));
+        
+        o.Backends = {"abacus"};
+        EXPECT_THROW(calibrate(o), std::invalid_argument);
+        o.Backends = {"cpu"};
+        
+        // the second time, the calibration comes from the cache.
+        auto cache = std::filesystem::temp_directory_path() / "gigamonkey_test_calibration.json";
+        std::filesystem::remove(cache);
+        calibration first = calibrate(cache, o);
+        EXPECT_TRUE(std::filesystem::exists(cache));
+        EXPECT_EQ(calibrate(cache, o), first);
+        std::filesystem::remove(cache);
+        
+    }
+    
+    struct test_solver final : cpu_solver {
+        std::mutex Mutex;
+        std::vector<solution> Solutions;
+        
+        test_solver (uint32 threads, const solution &initial, bool continuous) : cpu_solver {threads, initial, continuous} {}
+        
+        ~test_solver () {
+            shutdown ();
+        }
+        
+        void solved (const solution &x) override {
+            std::lock_guard<std::mutex> lock (Mutex);
+            Solutions.push_back (x);
+        }
+        
+        size_t count () {
+            std::lock_guard<std::mutex> lock (Mutex);
+            return Solutions.size ();
+        }
+        
+        // wait up to ten seconds for at least n solutions.
+        bool wait_for (size_t n) {
+            for (int i = 0; i < 1000; i++) {
+                if (count () >= n) return true;
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            }
+            return false;
+        }
+    };
+    
+    TEST(WorkTest, TestSolverEpoch) {
+        
+        std::string message1{"Capitalists can spend more energy than socialists."};
+        std::string message2{"If you can't transform energy, why should anyone listen to you?"};
+        
+        compact target {32, 0x010000};
+        
+        puzzle p1(1, SHA2_256(message1), target, Merkle::path{}, bytes{}, bytes::from_string(message1));
+        puzzle p2(1, SHA2_256(message2), target, Merkle::path{}, bytes{}, bytes::from_string(message2));
+        
+        uint64_big extra_nonce = 5555;
+        solution initial {Bitcoin::timestamp(1), 0, (bytes_view)(extra_nonce), 353};
+        
+        // without continuous, the search ends at the first solution.
+        {
+            test_solver s {4, initial, false};
+            s.pose(p1);
+            EXPECT_TRUE(s.wait_for(1));
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            s.stop();
+            EXPECT_EQ(s.count(), 1);
+            EXPECT_TRUE((proof{p1, s.Solutions[0]}.valid()));
+        }
+        
+        // with continuous, solutions keep coming until the next puzzle and
+        // nothing for the old puzzle arrives once we have switched.
+        {
+            test_solver s {4, initial, true};
+            s.pose(p1);
+            EXPECT_TRUE(s.wait_for(20));
+            
+            uint64 epoch = s.epoch();
+            s.pose(p2);
+            EXPECT_GT(s.epoch(), epoch);
+            s.stop();
+            
+            size_t switched = s.count();
+            for (const solution &x : s.Solutions) EXPECT_TRUE((proof{p1, x}.valid() || proof{p2, x}.valid()));
+            
+            s.pose(p2);
+            EXPECT_TRUE(s.wait_for(switched + 20));
+            s.stop();
+            
+            size_t stopped = s.count();
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            EXPECT_EQ(s.count(), stopped);
+            
+            for (size_t i = switched; i < stopped; i++) EXPECT_TRUE((proof{p2, s.Solutions[i]}.valid()));
+            
+            // solutions are not repeated.
+            for (size_t i = switched; i < stopped; i++) for (size_t j = i + 1; j < stopped; j++)
+                EXPECT_NE(s.Solutions[i], s.Solutions[j]);
+            
+            // after shutdown, nothing more is found.
+            s.shutdown();
+            s.pose(p1);
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            EXPECT_EQ(s.count(), stopped);
+        }
+        
+    }
+    
+    struct test_evaluator : evaluator {
+        std::vector<solution> Solutions;
+        
+        void solved(const solution &x) override {
+            Solutions.push_back(x);
+        }
+    };
+    
+    TEST(WorkTest, TestLeases) {
+        
+        std::string message1{"Capitalists can spend more energy than socialists."};
+        std::string message2{"If you can't transform energy, why should anyone listen to you?"};
+        
+        compact target {32, 0x010000};
+        
+        puzzle p1(1, SHA2_256(message1), target, Merkle::path{}, bytes{}, bytes::from_string(message1));
+        puzzle p2(1, SHA2_256(message2), target, Merkle::path{}, bytes{}, bytes::from_string(message2));
+        
+        // 16 values of extra nonce 2 are left.
+        bytes extra_nonce(1);
+        extra_nonce[0] = 0xf0;
+        solution initial {share{Bitcoin::timestamp(1), 0, extra_nonce}, 353};
+        
+        lease_coordinator::options o;
+        o.LeaseSize = 4;
+        o.TimeoutSeconds = 10;
+        
+        test_evaluator e;
+        
+        lease_coordinator::options zero;
+        zero.LeaseSize = 0;
+        EXPECT_THROW((lease_coordinator{e, zero}), std::invalid_argument);
+        
+        lease_coordinator c {e, o};
+        EXPECT_FALSE(bool(c.acquire("a", 0)));
+        
+        c.pose(p1, initial);
+        auto a = c.acquire("a", 0);
+        auto b = c.acquire("b", 0);
+        ASSERT_TRUE(bool(a) && bool(b));
+        EXPECT_EQ(a->Initial.Share.ExtraNonce2[0], 0xf0);
+        EXPECT_EQ(b->Initial.Share.ExtraNonce2[0], 0xf4);
+        EXPECT_EQ(a->Count, 4);
+        EXPECT_EQ(a->Puzzle, p1);
+        EXPECT_EQ(c.leases(), 2);
+        
+        // b is not renewed, so its range goes to the next node.
+        EXPECT_TRUE(c.renew(a->ID, 5));
+        auto d = c.acquire("c", 12);
+        ASSERT_TRUE(bool(d));
+        EXPECT_EQ(d->Initial.Share.ExtraNonce2[0], 0xf4);
+        EXPECT_FALSE(c.renew(b->ID, 12));
+        EXPECT_EQ(c.leases(), 2);
+        
+        // a range that is given up without being searched is given out again.
+        c.release(a->ID, false);
+        auto f = c.acquire("a", 12);
+        ASSERT_TRUE(bool(f));
+        EXPECT_EQ(f->Initial.Share.ExtraNonce2[0], 0xf0);
+        
+        EXPECT_TRUE(bool(c.acquire("b", 12)));
+        EXPECT_TRUE(bool(c.acquire("b", 12)));
+        EXPECT_FALSE(bool(c.acquire("b", 12)));
+        EXPECT_EQ(c.nodes().size(), 3);
+        
+        // the node solves its lease without going outside of it.
+        proof pr = solve(*d, 2);
+        ASSERT_TRUE(pr.valid());
+        EXPECT_GE(pr.Solution.Share.ExtraNonce2[0], 0xf4);
+        EXPECT_LT(pr.Solution.Share.ExtraNonce2[0], 0xf8);
+        
+        EXPECT_FALSE(c.submit(b->ID, pr.Solution));
+        solution other = pr.Solution;
+        other.ExtraNonce1 = 354;
+        EXPECT_FALSE(c.submit(d->ID, other));
+        
+        // a solution from outside the range of the lease.
+        EXPECT_FALSE(c.submit(f->ID, pr.Solution));
+        EXPECT_TRUE(e.Solutions.empty());
+        
+        EXPECT_TRUE(c.submit(d->ID, pr.Solution));
+        ASSERT_EQ(e.Solutions.size(), 1);
+        EXPECT_EQ(e.Solutions[0], pr.Solution);
+        
+        // a new puzzle ends every lease.
+        c.pose(p2, initial);
+        EXPECT_EQ(c.leases(), 0);
+        EXPECT_FALSE(c.submit(d->ID, pr.Solution));
+        
+        // an empty range has no solution.
+        EXPECT_FALSE(solve(p1, initial, 0, 2).valid());
+    }
+    
 }
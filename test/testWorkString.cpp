@@ -3,6 +3,7 @@
 
 #include <gigamonkey/work/string.hpp>
 #include <gigamonkey/timechain.hpp>
+#include <gigamonkey/sha256.hpp>
 #include "gtest/gtest.h"
 
 namespace Gigamonkey::Bitcoin {
@@ -75,5 +76,83 @@ namespace Gigamonkey::Bitcoin {
         
     }
 
-}
+    TEST (WorkStringTest, TestHash256Headers) {
+        
+        // enough headers that every kernel has a remainder to deal with.
+        constexpr size_t count = 37;
+        
+        std::vector<byte_array<80>> headers (count);
+        for (size_t i = 0; i < count; i++)
+            for (size_t j = 0; j < 80; j++) headers[i][j] = static_cast<byte> (i * 97 + j * 31 + (j >> 3));
+        
+        std::vector<digest256> expected (count);
+        for (size_t i = 0; i < count; i++) expected[i] = Hash256 (headers[i]);
+        
+        std::vector<slice<80>> slices;
+        for (byte_array<80> &h : headers) slices.push_back (slice<80> (h.data ()));
+        
+        std::vector<digest256> digests (count);
+        Hash256_headers (slices, digests);
+        EXPECT_EQ (digests, expected);
+        
+        for (size_t i = 0; i < count; i++) EXPECT_EQ (header::hash (slices[i]), expected[i]);
+        
+        std::vector<byte> in (80 * count);
+        for (size_t i = 0; i < count; i++) std::copy (headers[i].begin (), headers[i].end (), in.begin () + 80 * i);
+        
+        // the last 16 bytes of each header following the first 64 bytes of the first header.
+        sha256::state midstate = sha256::initial ();
+        sha256::transform (midstate, in.data (), 1);
+        std::vector<byte> tails (16 * count);
+        std::vector<digest256> expected_tails (count);
+        for (size_t i = 0; i < count; i++) {
+            std::copy (headers[i].begin () + 64, headers[i].end (), tails.begin () + 16 * i);
+            byte_array<80> h = headers[0];
+            std::copy (headers[i].begin () + 64, headers[i].end (), h.begin () + 64);
+            expected_tails[i] = Hash256 (h);
+        }
+        
+        for (byte x = 0; x < 4; x++) {
+            sha256::implementation impl = static_cast<sha256::implementation> (x);
+            if (!sha256::supported (impl)) continue;
+            
+            std::vector<byte> out (32 * count);
+            
+            sha256::double_hash_80 (out.data (), in.data (), count, impl);
+            for (size_t i = 0; i < count; i++)
+                EXPECT_EQ (digest256 (slice<32> (out.data () + 32 * i)), expected[i]) << sha256::name (impl);
+            
+            sha256::double_hash_80 (out.data (), midstate, tails.data (), count, impl);
+            for (size_t i = 0; i < count; i++)
+                EXPECT_EQ (digest256 (slice<32> (out.data () + 32 * i)), expected_tails[i]) << sha256::name (impl);
+        }
+        
+    }
+
+    TEST (WorkStringTest, TestDoubleHashShort) {
+        
+        for (size_t size : {0, 1, 21, 25, 33, 55}) {
+            size_t count = 37;
+            
+            std::vector<byte> in (size * count);
+            for (size_t i = 0; i < in.size (); i++) in[i] = byte (i * 7 + size);
+            
+            for (byte x = 0; x < 4; x++) {
+                sha256::implementation impl = static_cast<sha256::implementation> (x);
+                if (!sha256::supported (impl)) continue;
+                
+                std::vector<byte> out (32 * count);
+                sha256::double_hash_short (out.data (), in.data (), size, count, impl);
+                for (size_t i = 0; i < count; i++)
+                    EXPECT_EQ (digest256 (slice<32> (out.data () + 32 * i)), Hash256 (bytes_view {in.data () + size * i, size}))
+                        << sha256::name (impl) << " " << size;
+            }
+        }
 
+        byte too_big[56] {};
+        byte out[32];
+        EXPECT_THROW (sha256::double_hash_short (out, too_big, 56, 1), std::invalid_argument);
+
+    }
+
+}